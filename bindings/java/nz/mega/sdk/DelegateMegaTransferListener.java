@@ -15,6 +15,8 @@
  */
 package nz.mega.sdk;
 
+import java.nio.ByteBuffer;
+
 import nz.mega.sdk.MegaApi;
 import nz.mega.sdk.MegaTransfer;
 
@@ -32,6 +34,7 @@ class DelegateMegaTransferListener extends MegaTransferListener {
     MegaApiJava megaApi;
     MegaTransferListenerInterface listener;
     boolean singleListener;
+    byte[] pooledBuffer;
 
     DelegateMegaTransferListener(MegaApiJava megaApi, MegaTransferListenerInterface listener, boolean singleListener) {
         this.megaApi = megaApi;
@@ -170,17 +173,45 @@ class DelegateMegaTransferListener extends MegaTransferListener {
      * @param transfer
      *          Information about the transfer.
      * @param buffer
-     *          Buffer with the last read bytes.
+     *          Direct buffer over the last read bytes, valid until this function returns.
      * @return
-     *          Size of the buffer.
+     *          true to continue the transfer, false to cancel it.
+     * @see MegaTransferDataListenerInterface#onTransferData(MegaApiJava api, MegaTransfer transfer, ByteBuffer buffer)
      * @see MegaTransferListenerInterface#onTransferData(MegaApiJava api, MegaTransfer transfer, byte[] buffer)
-     * @see MegaTransferListener#onTransferData(MegaApi api, MegaTransfer transfer, byte[] buffer)
+     * @see MegaTransferListener#onTransferData(MegaApi api, MegaTransfer transfer, ByteBuffer buffer)
      */
-    public boolean onTransferData(MegaApi api, MegaTransfer transfer, byte[] buffer) {
+    @Override
+    public boolean onTransferData(MegaApi api, MegaTransfer transfer, ByteBuffer buffer) {
+        if (listener instanceof MegaTransferDataListenerInterface) {
+            final MegaTransfer megaTransfer = transfer.copy();
+            return ((MegaTransferDataListenerInterface) listener).onTransferData(megaApi, megaTransfer, buffer);
+        }
         if (listener != null) {
             final MegaTransfer megaTransfer = transfer.copy();
-            return listener.onTransferData(megaApi, megaTransfer, buffer);
+            return listener.onTransferData(megaApi, megaTransfer, toArray(buffer));
         }
         return false;
     }
+
+    /**
+     * Copies the bytes of a streaming callback to an array, for the listeners that take one.
+     * <p>
+     * With MegaApiJava.setTransferDataArraysReused(true), an array of the same size as the
+     * previous one is reused instead of allocated: it is only valid until the callback returns.
+     *
+     * @param buffer
+     *          Direct buffer over the last read bytes.
+     * @return
+     *          Array with the bytes of the buffer.
+     */
+    byte[] toArray(ByteBuffer buffer) {
+        int size = buffer.remaining();
+        byte[] array = pooledBuffer;
+        if (array == null || array.length != size) {
+            array = new byte[size];
+            pooledBuffer = megaApi.areTransferDataArraysReused() ? array : null;
+        }
+        buffer.get(array);
+        return array;
+    }
 }
@@ -17,6 +17,9 @@ package nz.mega.sdk;
 
 import java.io.IOException;
 import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.Channels;
+import java.nio.channels.WritableByteChannel;
 
 /**
  * The listener interface for receiving delegateOutputMegaTransfer events.
@@ -30,6 +33,7 @@ import java.io.OutputStream;
  */
 public class DelegateOutputMegaTransferListener extends DelegateMegaTransferListener {
     OutputStream outputStream;
+    WritableByteChannel outputChannel;
 
     /**
      * Instantiates a new delegate output mega transfer listener.
@@ -47,6 +51,10 @@ public class DelegateOutputMegaTransferListener extends DelegateMegaTransferList
             boolean singleListener) {
         super(megaApi, listener, singleListener);
         this.outputStream = outputStream;
+        if (outputStream != null) {
+            // writes through a buffer of its own, reused for every call
+            this.outputChannel = Channels.newChannel(outputStream);
+        }
     }
 
     /**
@@ -57,15 +65,18 @@ public class DelegateOutputMegaTransferListener extends DelegateMegaTransferList
      * @param transfer
      *              Information about the transfer.
      * @param buffer
-     *              Buffer with the last read bytes.
+     *              Direct buffer over the last read bytes, valid until this function returns.
      * @return
      *              true, if successful.
-     * @see DelegateMegaTransferListener#onTransferData(MegaApi api, MegaTransfer transfer, byte[] buffer)
+     * @see DelegateMegaTransferListener#onTransferData(MegaApi api, MegaTransfer transfer, ByteBuffer buffer)
      */
-    public boolean onTransferData(MegaApi api, MegaTransfer transfer, byte[] buffer) {
-        if (outputStream != null) {
+    @Override
+    public boolean onTransferData(MegaApi api, MegaTransfer transfer, ByteBuffer buffer) {
+        if (outputChannel != null) {
             try {
-                outputStream.write(buffer);
+                while (buffer.hasRemaining()) {
+                    outputChannel.write(buffer);
+                }
                 return true;
             } catch (IOException e) {
             }
@@ -49,6 +49,7 @@ import java.util.Set;
 public class MegaApiJava {
     MegaApi megaApi;
     MegaGfxProcessor gfxProcessor;
+    volatile boolean transferDataArraysReused;
 
     void runCallback(Runnable runnable) {
         runnable.run();
@@ -5386,6 +5387,33 @@ public class MegaApiJava {
         megaApi.startStreaming(node, startPos, size, createDelegateTransferListener(listener));
     }
 
+    /**
+     * Reuse the byte arrays passed to MegaTransferListenerInterface.onTransferData
+     * <p>
+     * By default, each call gets a new array with a copy of the data. With this option, the array
+     * of the previous call is reused when the size is the same, which is the usual case while
+     * streaming. The array is then only valid until the callback returns: copy what has to be kept.
+     * <p>
+     * Listeners implementing MegaTransferDataListenerInterface get no array at all, but a direct
+     * ByteBuffer over the data of the SDK.
+     *
+     * @param reuse true to reuse the arrays, false to allocate one per call
+     * @see MegaTransferDataListenerInterface
+     */
+    public void setTransferDataArraysReused(boolean reuse) {
+        transferDataArraysReused = reuse;
+    }
+
+    /**
+     * Check if the byte arrays passed to MegaTransferListenerInterface.onTransferData are reused
+     *
+     * @return true if they are reused, false if there is one per call
+     * @see MegaApiJava#setTransferDataArraysReused(boolean)
+     */
+    public boolean areTransferDataArraysReused() {
+        return transferDataArraysReused;
+    }
+
     /**
      * Cancel a transfer.
      * <p>
@@ -0,0 +1,94 @@
+/*
+ * (c) 2020 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,\
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * @copyright Simplified (2-clause) BSD License.
+ * You should have received a copy of the license along with this
+ * program.
+ */
+package nz.mega.sdk;
+
+import java.nio.charset.Charset;
+
+/**
+ * The main fields of the nodes of a MegaNodeList, read in a few calls to the SDK.
+ * <p>
+ * Going through a large MegaNodeList with MegaNodeList.get() and the getters of each MegaNode
+ * crosses to the native side several times per node and creates a MegaNode object for each
+ * of them. This class reads each field of all the nodes at once, in arrays indexed by the
+ * position of the nodes in the list. The names are kept in UTF-8 and only decoded by getName().
+ * <p>
+ * The nodes that don't exist anymore have INVALID_HANDLE as handle, -1 as size and
+ * modification time, MegaNode.TYPE_UNKNOWN as type and an empty name.
+ */
+public class MegaNodeListColumns {
+    static final Charset UTF8 = Charset.forName("UTF-8");
+
+    /** Handles of the nodes. */
+    public final long[] handles;
+    /** Sizes of the nodes, as MegaNode.getSize(). */
+    public final long[] sizes;
+    /** Modification times of the nodes, as MegaNode.getModificationTime(). */
+    public final long[] modificationTimes;
+    /** Types of the nodes, as MegaNode.getType(). */
+    public final int[] types;
+    /** Names of the nodes in UTF-8, one after another. */
+    public final byte[] names;
+    /** Where the name of each node starts in names, plus the length of all of them at the end. */
+    public final int[] nameOffsets;
+
+    /**
+     * Reads the fields of all the nodes of a list.
+     *
+     * @param list
+     *              List of nodes. It is not used after this constructor returns.
+     */
+    public MegaNodeListColumns(MegaNodeList list) {
+        int size = list.size();
+
+        handles = new long[size];
+        list.getHandles(handles);
+        sizes = new long[size];
+        list.getSizes(sizes);
+        modificationTimes = new long[size];
+        list.getModificationTimes(modificationTimes);
+        types = new int[size];
+        list.getTypes(types);
+
+        // the names may change between both calls, when the nodes are updated meanwhile
+        nameOffsets = new int[size + 1];
+        byte[] buffer = new byte[list.getNames(null, null)];
+        int length;
+        while ((length = list.getNames(buffer, nameOffsets)) > buffer.length) {
+            buffer = new byte[length];
+        }
+        names = buffer;
+    }
+
+    /**
+     * Returns the number of nodes.
+     *
+     * @return Number of nodes.
+     */
+    public int size() {
+        return handles.length;
+    }
+
+    /**
+     * Returns the name of the node at a position.
+     *
+     * @param i
+     *              Position of the node in the list.
+     * @return Name of the node.
+     */
+    public String getName(int i) {
+        return new String(names, nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i], UTF8);
+    }
+}
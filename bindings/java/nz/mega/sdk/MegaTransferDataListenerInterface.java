@@ -0,0 +1,48 @@
+/*
+ * (c) 2020 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,\
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * @copyright Simplified (2-clause) BSD License.
+ * You should have received a copy of the license along with this
+ * program.
+ */
+package nz.mega.sdk;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Interface to receive information about transfers, with the data of streaming downloads in place.
+ * <p>
+ * The listeners implementing this interface get the last read bytes of streaming downloads in a direct
+ * ByteBuffer over the buffer of the SDK, without copying them to a new array for each call. The
+ * onTransferData variant taking a byte array is not called for them.
+ *
+ * @see MegaTransferListenerInterface
+ */
+public interface MegaTransferDataListenerInterface extends MegaTransferListenerInterface {
+    /**
+     * This function is called to provide the last read bytes of streaming downloads.
+     * <p>
+     * This function will not be called for non streaming downloads. The buffer is a view of the memory
+     * of the SDK: it is only valid until this function returns and must not be written to. Copy the
+     * bytes that have to be kept. The SDK retains the ownership of the transfer parameter.
+     * Do not use it after this functions returns.
+     *
+     * @param api
+     *          MegaApi object that started the transfer.
+     * @param transfer
+     *          Information about the transfer.
+     * @param buffer
+     *          Direct buffer over the last read bytes, from its position to its limit.
+     * @return
+     *          true to continue the transfer, false to cancel it.
+     */
+    public boolean onTransferData(MegaApiJava api, MegaTransfer transfer, ByteBuffer buffer);
+}
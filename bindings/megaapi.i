@@ -282,20 +282,116 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 %}
 #endif
 
-%apply (char *STRING, size_t LENGTH) {(char *buffer, size_t size)};
+// the streaming data reaches Java as a direct ByteBuffer over the buffer of the SDK,
+// valid until the callback returns: no copy and no array for the GC to collect
+%typemap(jni) (char *buffer, size_t size) "jobject"
+%typemap(jtype) (char *buffer, size_t size) "java.nio.ByteBuffer"
+%typemap(jstype) (char *buffer, size_t size) "java.nio.ByteBuffer"
+%typemap(javain) (char *buffer, size_t size) "$javainput"
+%typemap(javadirectorin) (char *buffer, size_t size) "$jniinput"
+
+%typemap(in) (char *buffer, size_t size)
+%{
+    $1 = $input ? (char *)jenv->GetDirectBufferAddress($input) : NULL;
+    if (!$1)
+    {
+        SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "direct ByteBuffer expected");
+        return $null;
+    }
+    $2 = (size_t)jenv->GetDirectBufferCapacity($input);
+%}
 
-#if SWIG_VERSION < 0x030012
-%typemap(directorargout) (char *buffer, size_t size)
+%typemap(directorin, descriptor="Ljava/nio/ByteBuffer;") (char *buffer, size_t size)
 %{
-    jenv->DeleteLocalRef($input);
+    $input = jenv->NewDirectByteBuffer($1, (jlong)$2);
+    Swig::LocalRefGuard $1_refguard(jenv, $input);
 %}
-#else
+
 %typemap(directorargout) (char *buffer, size_t size)
 %{
-   // not copying the buffer back to improve performance
+   // the Java side reads the buffer of the SDK in place
+%}
+
+// the bulk getters of MegaNodeList fill a whole Java array in one call,
+// its length being the count
+%define MEGA_JAVA_ARRAY(CTYPE, NAME, COUNT, JNITYPE, JTYPE, JELEMENT, ELEMENTS)
+%typemap(jni) (CTYPE *NAME, int COUNT) "JNITYPE"
+%typemap(jtype) (CTYPE *NAME, int COUNT) "JTYPE"
+%typemap(jstype) (CTYPE *NAME, int COUNT) "JTYPE"
+%typemap(javain) (CTYPE *NAME, int COUNT) "$javainput"
+%typemap(in) (CTYPE *NAME, int COUNT)
+%{
+    $1 = NULL;
+    $2 = 0;
+    if ($input)
+    {
+        $2 = (int)jenv->GetArrayLength($input);
+        $1 = (CTYPE *)jenv->Get##ELEMENTS##ArrayElements($input, NULL);
+    }
 %}
+%typemap(argout) (CTYPE *NAME, int COUNT)
+%{
+    if ($1)
+    {
+        jenv->Release##ELEMENTS##ArrayElements($input, (JELEMENT *)$1, 0);
+    }
+%}
+%enddef
+
+MEGA_JAVA_ARRAY(MegaHandle, handles, count, jlongArray, long[], jlong, Long)
+MEGA_JAVA_ARRAY(int64_t, sizes, count, jlongArray, long[], jlong, Long)
+MEGA_JAVA_ARRAY(int64_t, mtimes, count, jlongArray, long[], jlong, Long)
+MEGA_JAVA_ARRAY(int, types, count, jintArray, int[], jint, Int)
+MEGA_JAVA_ARRAY(int, offsets, count, jintArray, int[], jint, Int)
+MEGA_JAVA_ARRAY(char, names, namesSize, jbyteArray, byte[], jbyte, Byte)
+
 #endif
 
+#ifdef SWIGPYTHON
+// the bulk getters of MegaNodeList fill a whole writable buffer in one call
+// (array.array, bytearray...), its size being the count
+%define MEGA_PYTHON_BUFFER(CTYPE, NAME, COUNT)
+%typemap(in) (CTYPE *NAME, int COUNT) (Py_buffer view, bool viewed = false)
+%{
+    $1 = NULL;
+    $2 = 0;
+    if ($input != Py_None)
+    {
+        if (PyObject_GetBuffer($input, &view, PyBUF_WRITABLE) < 0)
+        {
+            SWIG_fail;
+        }
+        viewed = true;
+        $1 = (CTYPE *)view.buf;
+        $2 = (int)(view.len / sizeof(CTYPE));
+    }
+%}
+%typemap(freearg) (CTYPE *NAME, int COUNT)
+%{
+    if (viewed$argnum)
+    {
+        PyBuffer_Release(&view$argnum);
+    }
+%}
+%enddef
+
+MEGA_PYTHON_BUFFER(MegaHandle, handles, count)
+MEGA_PYTHON_BUFFER(int64_t, sizes, count)
+MEGA_PYTHON_BUFFER(int64_t, mtimes, count)
+MEGA_PYTHON_BUFFER(int, types, count)
+MEGA_PYTHON_BUFFER(int, offsets, count)
+MEGA_PYTHON_BUFFER(char, names, namesSize)
+
+// the streaming data reaches Python as a read-only memoryview over the buffer
+// of the SDK, valid until the callback returns: bytes(buffer) to keep it
+%typemap(directorin) (char *buffer, size_t size)
+%{
+#if PY_VERSION_HEX >= 0x03030000
+    $input = PyMemoryView_FromMemory($1, (Py_ssize_t)$2, PyBUF_READ);
+#else
+    $input = PyBuffer_FromMemory($1, (Py_ssize_t)$2);
+#endif
+%}
 #endif
 
 %feature("director") mega::MegaGlobalListener;
@@ -29,6 +29,7 @@ SOURCES += src/attrmap.cpp \
     src/user.cpp \
     src/useralerts.cpp \
     src/utils.cpp \
+    src/trace.cpp \
     src/logging.cpp \
     src/waiterbase.cpp  \
     src/proxy.cpp \
@@ -305,10 +306,13 @@ win32 {
     CONFIG += USE_CURL
 
     CONFIG(USE_CURL) {
+        # WinHTTP stays available with MegaApi::setNetworkBackend
         SOURCES += src/wincurl/net.cpp  \
+            src/win32/net.cpp \
             src/wincurl/fs.cpp  \
             src/wincurl/waiter.cpp
-        HEADERS += include/mega/wincurl/meganet.h
+        HEADERS += include/mega/wincurl/meganet.h \
+            include/mega/win32/meganet.h
         DEFINES += USE_CURL USE_OPENSSL
         LIBS +=  -llibcurl -lcares -llibeay32 -lssleay32
     }
@@ -362,6 +366,7 @@ HEADERS  += include/mega.h \
             include/mega/user.h \
             include/mega/useralerts.h \
             include/mega/utils.h \
+            include/mega/trace.h \
             include/mega/logging.h \
             include/mega/waiter.h \
             include/mega/proxy.h \
@@ -597,5 +602,5 @@ macx {
 
 
 
-   LIBS += -framework SystemConfiguration
+   LIBS += -framework SystemConfiguration -framework CoreServices
 }
@@ -25,6 +25,8 @@ SOURCES += \
     ../../../../tests/unit/main.cpp \
     ../../../../tests/unit/Commands_test.cpp \
     ../../../../tests/unit/Crypto_test.cpp \
+    ../../../../tests/unit/Logging_test.cpp \
     ../../../../tests/unit/Serialization_test.cpp \
     ../../../../tests/unit/PayCrypter_test.cpp \
-    ../../../../tests/unit/MegaApi_test.cpp
+    ../../../../tests/unit/MegaApi_test.cpp \
+    ../../../../tests/unit/Utils_test.cpp
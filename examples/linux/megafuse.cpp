@@ -20,10 +20,12 @@
  */
 
 // This example implements the following operations: getattr, readdir,
-// open, read, mkdir, rmdir, unlink and rename.
-// File writes are NOT supported yet.
-// There isn't any caching nor the implementation does any prefetching
-// to improve read performance.
+// open, create, read, write, truncate, release, mkdir, rmdir, unlink and
+// rename.
+// Attributes of nodes are cached until the nodes change, file data is read
+// in cached blocks with read-ahead, and written files are staged locally
+// and uploaded when they are closed. FUSE runs the operations on several
+// threads, so everything shared between them is protected by a mutex.
 
 #define FUSE_USE_VERSION 30
 #include <fuse.h>
@@ -34,9 +36,16 @@
 #include <megaapi.h>
 #include <unistd.h>
 #include <termios.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 #include <mutex>
 #include <condition_variable>
 #include <iostream>
+#include <map>
+#include <set>
+#include <list>
+#include <memory>
 
 using namespace mega;
 using namespace std;
@@ -183,27 +192,523 @@ class SynchronousTransferListenerFuse : public MegaTransferListener
 		mutex m;
 };
 
+// Attributes of the nodes already looked up, by path, so that the kernel's
+// getattr calls don't resolve the whole path every time. They are dropped
+// when the nodes change (or all of them, when a folder changes, because
+// the paths below it might have changed too)
+struct NodeAttributes
+{
+	MegaHandle handle;
+	bool isFile;
+	long long size;
+	int64_t mtime;
+};
+
+class NodeCache : public MegaGlobalListener
+{
+	public:
+		static const size_t MAX_NODES = 100000;
+
+		bool get(const string &path, NodeAttributes *attributes)
+		{
+			unique_lock<mutex> lock(m);
+			map<string, NodeAttributes>::iterator it = nodes.find(path);
+			if (it == nodes.end())
+			{
+				return false;
+			}
+			*attributes = it->second;
+			return true;
+		}
+
+		static void fromNode(MegaNode *node, NodeAttributes *attributes)
+		{
+			attributes->handle = node->getHandle();
+			attributes->isFile = node->isFile();
+			attributes->size = node->isFile() ? node->getSize() : 4096;
+			attributes->mtime = node->isFile() ? node->getModificationTime() : node->getCreationTime();
+		}
+
+		void put(const string &path, MegaNode *node)
+		{
+			NodeAttributes attributes;
+			fromNode(node, &attributes);
+
+			unique_lock<mutex> lock(m);
+			if (nodes.size() >= MAX_NODES)
+			{
+				nodes.clear();
+				paths.clear();
+			}
+			nodes[path] = attributes;
+			paths[attributes.handle] = path;
+		}
+
+		void clear()
+		{
+			unique_lock<mutex> lock(m);
+			nodes.clear();
+			paths.clear();
+		}
+
+		void onNodesUpdate(MegaApi *api, MegaNodeList *updated)
+		{
+			unique_lock<mutex> lock(m);
+			if (!updated)
+			{
+				nodes.clear();
+				paths.clear();
+				return;
+			}
+
+			for (int i = 0; i < updated->size(); i++)
+			{
+				MegaNode *n = updated->get(i);
+				if (!n->isFile())
+				{
+					nodes.clear();
+					paths.clear();
+					return;
+				}
+
+				map<MegaHandle, string>::iterator it = paths.find(n->getHandle());
+				if (it != paths.end())
+				{
+					nodes.erase(it->second);
+					paths.erase(it);
+				}
+			}
+		}
+
+	private:
+		mutex m;
+		map<string, NodeAttributes> nodes;
+		map<MegaHandle, string> paths;
+};
+
+NodeCache nodeCache;
+
+// Blocks of file data already downloaded, with a LRU limit. A modified
+// file is a new node with a new handle, so blocks are never outdated.
+// Concurrent reads of a block share a single download of it
+class BlockCache
+{
+	public:
+		static const long long BLOCK_SIZE = 1048576;
+		static const size_t MAX_BLOCKS = 64;
+
+		// copies data of a block, from its offset, to buf.
+		// returns the number of bytes copied, or a negative errno
+		int read(MegaNode *node, long long index, size_t offset, char *buf, size_t size)
+		{
+			shared_ptr<Block> block = getBlock(node, index);
+
+			unique_lock<mutex> lock(m);
+			cv.wait(lock, [&block]{return block->finished;});
+			if (block->failed)
+			{
+				return -EIO;
+			}
+
+			if (offset >= block->data.size())
+			{
+				return 0;
+			}
+
+			size_t len = min(size, block->data.size() - offset);
+			memcpy(buf, block->data.data() + offset, len);
+			return int(len);
+		}
+
+		// starts the download of a block, if it isn't cached yet
+		void prefetch(MegaNode *node, long long index)
+		{
+			getBlock(node, index);
+		}
+
+	private:
+		struct Block
+		{
+			string data;
+			bool finished = false;
+			bool failed = false;
+		};
+
+		typedef pair<MegaHandle, long long> BlockKey;
+
+		class BlockListener : public MegaTransferListener
+		{
+			public:
+				BlockListener(BlockCache *cache, BlockKey key, shared_ptr<Block> block)
+					: cache(cache), key(key), block(block)
+				{
+				}
+
+				bool onTransferData(MegaApi *api, MegaTransfer *transfer, char *buffer, size_t s)
+				{
+					block->data.append(buffer, s);
+					return true;
+				}
+
+				void onTransferFinish(MegaApi *api, MegaTransfer *transfer, MegaError *error)
+				{
+					cache->finish(key, block, error->getErrorCode() == MegaError::API_OK);
+					delete this;
+				}
+
+			private:
+				BlockCache *cache;
+				BlockKey key;
+				shared_ptr<Block> block;
+		};
+
+		shared_ptr<Block> getBlock(MegaNode *node, long long index)
+		{
+			BlockKey key(node->getHandle(), index);
+			shared_ptr<Block> block;
+			{
+				unique_lock<mutex> lock(m);
+				map<BlockKey, list<BlockKey>::iterator>::iterator it = positions.find(key);
+				if (it != positions.end())
+				{
+					lru.splice(lru.end(), lru, it->second);
+					return blocks[key];
+				}
+
+				if (blocks.size() >= MAX_BLOCKS)
+				{
+					// readers of the evicted block still hold it
+					positions.erase(lru.front());
+					blocks.erase(lru.front());
+					lru.pop_front();
+				}
+
+				block = make_shared<Block>();
+				blocks[key] = block;
+				positions[key] = lru.insert(lru.end(), key);
+			}
+
+			long long start = index * BLOCK_SIZE;
+			long long len = node->getSize() - start;
+			if (len > BLOCK_SIZE)
+			{
+				len = BLOCK_SIZE;
+			}
+			block->data.reserve(size_t(len));
+			megaApi->startStreaming(node, start, len, new BlockListener(this, key, block));
+			return block;
+		}
+
+		void finish(BlockKey key, shared_ptr<Block> block, bool ok)
+		{
+			{
+				unique_lock<mutex> lock(m);
+				block->finished = true;
+				block->failed = !ok;
+
+				// failed downloads are retried by the next read
+				map<BlockKey, shared_ptr<Block> >::iterator it = blocks.find(key);
+				if (!ok && it != blocks.end() && it->second == block)
+				{
+					lru.erase(positions[key]);
+					positions.erase(key);
+					blocks.erase(it);
+				}
+			}
+			cv.notify_all();
+		}
+
+		mutex m;
+		condition_variable cv;
+		map<BlockKey, shared_ptr<Block> > blocks;
+		map<BlockKey, list<BlockKey>::iterator> positions;
+		list<BlockKey> lru;
+};
+
+BlockCache blockCache;
+
+// Files open for writing, by path. Writes are staged in a local file that
+// is uploaded once the last handle is released. Until the upload finishes,
+// the staged file is the content of the path
+struct StagedFile
+{
+	string path;
+	string localPath;
+	int fd;
+	int openCount;
+	bool ready; // the current content has been downloaded
+	bool dirty;
+	bool uploading;
+	bool detached; // uploaded while still open for reading
+};
+
+mutex stagingMutex;
+condition_variable stagingCv;
+map<string, StagedFile*> stagedFiles;
+string stagingDir;
+unsigned long long stagingCounter = 0;
+
+static void discardStaged(StagedFile *staged)
+{
+	if (staged->fd >= 0)
+	{
+		close(staged->fd);
+	}
+	unlink(staged->localPath.c_str());
+	delete staged;
+}
+
+// removes a staged file from the staging area, once it's not needed
+static void unstage(StagedFile *staged)
+{
+	bool discard;
+	{
+		unique_lock<mutex> lock(stagingMutex);
+		stagedFiles.erase(staged->path);
+		staged->uploading = false;
+		discard = !staged->openCount;
+		staged->detached = !discard;
+	}
+	stagingCv.notify_all();
+
+	if (discard)
+	{
+		discardStaged(staged);
+	}
+}
+
+class UploadListenerFuse : public MegaTransferListener
+{
+	public:
+		UploadListenerFuse(StagedFile *staged) : staged(staged)
+		{
+		}
+
+		void onTransferFinish(MegaApi *api, MegaTransfer *transfer, MegaError *error)
+		{
+			if (error->getErrorCode() != MegaError::API_OK)
+			{
+				MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Error uploading file:");
+				MegaApi::log(MegaApi::LOG_LEVEL_ERROR, staged->path.c_str());
+			}
+			else
+			{
+				MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File uploaded OK");
+			}
+
+			nodeCache.clear();
+			unstage(staged);
+			delete this;
+		}
+
+	private:
+		StagedFile *staged;
+};
+
+// node of a path, through the attribute cache
+static MegaNode *getNode(const string &path)
+{
+	NodeAttributes attributes;
+	if (nodeCache.get(path, &attributes))
+	{
+		MegaNode *n = megaApi->getNodeByHandle(attributes.handle);
+		if (n)
+		{
+			return n;
+		}
+	}
+
+	MegaNode *n = megaApi->getNodeByPath(path.c_str());
+	if (n)
+	{
+		nodeCache.put(path, n);
+	}
+	return n;
+}
+
+// gets the staged file of a path, staging it (with the current content of
+// the file, unless it's new or truncated) if create is set.
+// returns 0 or a negative errno
+static int openStaged(const string &path, bool create, bool truncate, bool isNew, StagedFile **result)
+{
+	*result = NULL;
+	unique_lock<mutex> lock(stagingMutex);
+
+	// a file being uploaded is written again once the upload has finished
+	stagingCv.wait(lock, [&path, create]{
+		map<string, StagedFile*>::iterator it = stagedFiles.find(path);
+		return it == stagedFiles.end() || (it->second->ready && (!create || !it->second->uploading));
+	});
+
+	map<string, StagedFile*>::iterator it = stagedFiles.find(path);
+	if (it != stagedFiles.end())
+	{
+		StagedFile *staged = it->second;
+		if (truncate)
+		{
+			if (ftruncate(staged->fd, 0))
+			{
+				return -errno;
+			}
+			staged->dirty = true;
+		}
+		staged->openCount++;
+		*result = staged;
+		return 0;
+	}
+
+	if (!create)
+	{
+		return 0;
+	}
+
+	StagedFile *staged = new StagedFile();
+	staged->path = path;
+	staged->localPath = stagingDir + "/" + to_string(stagingCounter++);
+	staged->fd = -1;
+	staged->openCount = 1;
+	staged->ready = false;
+	staged->dirty = isNew || truncate;
+	staged->uploading = false;
+	staged->detached = false;
+	stagedFiles[path] = staged;
+	lock.unlock();
+
+	int error = 0;
+	MegaNode *node = (isNew || truncate) ? NULL : getNode(path);
+	if (node && node->getSize())
+	{
+		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Downloading file to stage it:");
+		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
+
+		SynchronousTransferListenerFuse listener;
+		megaApi->startDownload(node, staged->localPath.c_str(), &listener);
+		listener.wait();
+		if (listener.getError()->getErrorCode() != MegaError::API_OK)
+		{
+			MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Error downloading file");
+			error = -EIO;
+		}
+	}
+	delete node;
+
+	if (!error)
+	{
+		staged->fd = open(staged->localPath.c_str(), O_RDWR | O_CREAT, 0600);
+		if (staged->fd < 0)
+		{
+			error = -errno;
+		}
+	}
+
+	if (error)
+	{
+		staged->openCount = 0;
+		unstage(staged);
+		return error;
+	}
+
+	lock.lock();
+	staged->ready = true;
+	lock.unlock();
+	stagingCv.notify_all();
+
+	*result = staged;
+	return 0;
+}
+
+// releases a handle of a staged file. The last one uploads it if it was modified
+static void releaseStaged(StagedFile *staged)
+{
+	{
+		unique_lock<mutex> lock(stagingMutex);
+		if (--staged->openCount)
+		{
+			return;
+		}
+
+		if (staged->detached)
+		{
+			lock.unlock();
+			discardStaged(staged);
+			return;
+		}
+
+		if (staged->dirty)
+		{
+			staged->dirty = false;
+			staged->uploading = true;
+		}
+	}
+
+	if (!staged->uploading)
+	{
+		unstage(staged);
+		return;
+	}
+
+	size_t index = staged->path.find_last_of('/');
+	string parentPath = staged->path.substr(0, index + 1);
+	string name = staged->path.substr(index + 1);
+	MegaNode *parent = getNode(parentPath);
+	if (!parent || parent->isFile())
+	{
+		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Parent folder of an uploaded file not found:");
+		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, staged->path.c_str());
+		delete parent;
+		unstage(staged);
+		return;
+	}
+
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Uploading file:");
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, staged->path.c_str());
+	megaApi->startUpload(staged->localPath.c_str(), parent, name.c_str(), new UploadListenerFuse(staged));
+	delete parent;
+}
+
 static int MEGAgetattr(const char *p, struct stat *stbuf)
 {
 	string path = megaBasePath + p;
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Getting attributes:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 
-	MegaNode *n = megaApi->getNodeByPath(path.c_str());
-	if (!n)
-	{
-		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Node not found");
-		return -ENOENT;
-	}
-	
 	stbuf->st_uid = getuid();
 	stbuf->st_gid = getgid();
-	stbuf->st_mode = n->isFile() ? S_IFREG | 0444 : S_IFDIR | 0755;
 	stbuf->st_nlink = 1;
-	stbuf->st_size = n->isFile() ? n->getSize() : 4096;
-	stbuf->st_mtime = n->isFile() ? n->getModificationTime() : n->getCreationTime();
-		
-	delete n;
+
+	{
+		unique_lock<mutex> lock(stagingMutex);
+		map<string, StagedFile*>::iterator it = stagedFiles.find(path);
+		struct stat st;
+		if (it != stagedFiles.end() && it->second->ready && !fstat(it->second->fd, &st))
+		{
+			stbuf->st_mode = S_IFREG | 0644;
+			stbuf->st_size = st.st_size;
+			stbuf->st_mtime = st.st_mtime;
+			MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Attributes of staged file read OK");
+			return 0;
+		}
+	}
+
+	NodeAttributes attributes;
+	if (!nodeCache.get(path, &attributes))
+	{
+		MegaNode *n = megaApi->getNodeByPath(path.c_str());
+		if (!n)
+		{
+			MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Node not found");
+			return -ENOENT;
+		}
+
+		nodeCache.put(path, n);
+		NodeCache::fromNode(n, &attributes);
+		delete n;
+	}
+
+	stbuf->st_mode = attributes.isFile ? S_IFREG | 0644 : S_IFDIR | 0755;
+	stbuf->st_size = attributes.size;
+	stbuf->st_mtime = attributes.mtime;
+
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Attributes read OK");
 	return 0;
 }
@@ -251,6 +756,7 @@ static int MEGAmkdir(const char *p, mode_t mode)
 		return -EIO;
 	}
 
+	nodeCache.clear();
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Folder created OK");
 	return 0;
 }
@@ -293,6 +799,7 @@ static int MEGArmdir(const char *p)
 		return -EIO;
 	}
 
+	nodeCache.clear();
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Folder deleted OK");
 	return 0;
 }
@@ -329,6 +836,7 @@ static int MEGAunlink(const char *p)
 		return -EIO;
 	}
 
+	nodeCache.clear();
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File deleted OK");
 	return 0;
 }
@@ -374,6 +882,7 @@ static int MEGArename(const char *f, const char *t)
 				return -EIO;
 			}
 
+			nodeCache.clear();
 			MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File/folder moved OK");
 			return 0;
 		}
@@ -427,6 +936,7 @@ static int MEGArename(const char *f, const char *t)
 		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Error moving file/folder");
 		return -EIO;
 	}
+	nodeCache.clear();
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File/folder moved OK");
 
 	if (strcmp(source->getName(), destname.c_str()))
@@ -442,6 +952,7 @@ static int MEGArename(const char *f, const char *t)
 			return -EIO;
 		}
 		
+		nodeCache.clear();
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File/folder renamed OK");
 	}
 	
@@ -456,43 +967,123 @@ static int MEGAreaddir(const char *p, void *buf, fuse_fill_dir_t filler,
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Listing folder:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 
-	MegaNode *node = megaApi->getNodeByPath(path.c_str());
+	MegaNode *node = getNode(path);
 	if (!node)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Folder not found");
 		return -ENOENT;
 	}
-	
+
+	string prefix = path;
+	if (!prefix.size() || prefix[prefix.size() - 1] != '/')
+	{
+		prefix.append("/");
+	}
+
 	filler(buf, ".", NULL, 0);
 	filler(buf, "..", NULL, 0);
+	set<string> names;
 	MegaNodeList *children = megaApi->getChildren(node);
 	for (int i=0; i<children->size(); i++)
 	{
 		MegaNode *n = children->get(i);
+
+		// the attributes of the children are the next thing the kernel asks for
+		nodeCache.put(prefix + n->getName(), n);
+		names.insert(n->getName());
 		filler(buf, n->getName(), NULL, 0);
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, n->getName());
 	}
-	
+
 	delete node;
 	delete children;
 
+	// new files that are still being written or uploaded
+	{
+		unique_lock<mutex> lock(stagingMutex);
+		for (map<string, StagedFile*>::iterator it = stagedFiles.begin(); it != stagedFiles.end(); it++)
+		{
+			const string &stagedPath = it->first;
+			if (stagedPath.size() > prefix.size() && !stagedPath.compare(0, prefix.size(), prefix)
+					&& stagedPath.find('/', prefix.size()) == string::npos
+					&& !names.count(stagedPath.substr(prefix.size())))
+			{
+				filler(buf, stagedPath.c_str() + prefix.size(), NULL, 0);
+			}
+		}
+	}
+
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Folder listed OK");	
 	return 0;
 }
 
-static int MEGAopen(const char *path, struct fuse_file_info *fi)
+static int MEGAopen(const char *p, struct fuse_file_info *fi)
 {
-    return 0;
+	string path = megaBasePath + p;
+	bool write = (fi->flags & O_ACCMODE) != O_RDONLY;
+
+	// files open for reading only are read from the block cache,
+	// unless they are being written
+	StagedFile *staged = NULL;
+	int result = openStaged(path, write, write && (fi->flags & O_TRUNC), false, &staged);
+	if (result)
+	{
+		return result;
+	}
+
+	fi->fh = (uint64_t)(uintptr_t)staged;
+	return 0;
+}
+
+static int MEGAcreate(const char *p, mode_t mode, struct fuse_file_info *fi)
+{
+	string path = megaBasePath + p;
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Creating file:");
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
+
+	size_t index = path.find_last_of('/');
+	if (index == string::npos)
+	{
+		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Invalid path");
+		return -ENOENT;
+	}
+
+	MegaNode *parent = getNode(path.substr(0, index + 1));
+	if (!parent || parent->isFile())
+	{
+		MegaApi::log(MegaApi::LOG_LEVEL_WARNING, "Parent folder not found");
+		delete parent;
+		return -ENOTDIR;
+	}
+	delete parent;
+
+	StagedFile *staged = NULL;
+	int result = openStaged(path, true, true, true, &staged);
+	if (result)
+	{
+		return result;
+	}
+
+	fi->fh = (uint64_t)(uintptr_t)staged;
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File created OK");
+	return 0;
 }
 
 static int MEGAread(const char *p, char *buf, size_t size, off_t offset,
                       struct fuse_file_info *fi)
 {
+	StagedFile *staged = (StagedFile *)(uintptr_t)fi->fh;
+	if (staged)
+	{
+		ssize_t len = pread(staged->fd, buf, size, offset);
+		return len < 0 ? -errno : int(len);
+	}
+
 	string path = megaBasePath + p;
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Reading file:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
         	
-	MegaNode *node = megaApi->getNodeByPath(path.c_str());
+	MegaNode *node = getNode(path);
 	if (!node)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File not found");
@@ -509,26 +1100,119 @@ static int MEGAread(const char *p, char *buf, size_t size, off_t offset,
 	{
 		size = node->getSize() - offset;
 	}
-	
-	SynchronousTransferListenerFuse listener;
-	megaApi->startStreaming(node, offset, size, &listener);
-	listener.wait();
-	delete node;
-	if (listener.getError()->getErrorCode() != MegaError::API_OK)
+
+	size_t copied = 0;
+	while (copied < size)
 	{
-		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Transfer error");
-		return -EIO;
+		long long position = offset + copied;
+		int len = blockCache.read(node, position / BlockCache::BLOCK_SIZE,
+		                          size_t(position % BlockCache::BLOCK_SIZE), buf + copied, size - copied);
+		if (len < 0)
+		{
+			delete node;
+			MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Transfer error");
+			return len;
+		}
+
+		if (!len)
+		{
+			break;
+		}
+		copied += len;
 	}
-	
-	if (listener.getDataSize() != size)
+
+	// the next block is read ahead once a read reaches the second half of one
+	long long end = offset + copied;
+	long long next = end / BlockCache::BLOCK_SIZE + 1;
+	if (end % BlockCache::BLOCK_SIZE >= BlockCache::BLOCK_SIZE / 2 && next * BlockCache::BLOCK_SIZE < node->getSize())
 	{
-		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Internal error");
-		return -EIO;
+		blockCache.prefetch(node, next);
 	}
-	
-	memcpy(buf, listener.getData(), size);
+	delete node;
+
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File read OK");
-    return size;
+	return int(copied);
+}
+
+static int MEGAwrite(const char *p, const char *buf, size_t size, off_t offset,
+                      struct fuse_file_info *fi)
+{
+	StagedFile *staged = (StagedFile *)(uintptr_t)fi->fh;
+	if (!staged)
+	{
+		return -EBADF;
+	}
+
+	ssize_t len = pwrite(staged->fd, buf, size, offset);
+	if (len < 0)
+	{
+		return -errno;
+	}
+
+	unique_lock<mutex> lock(stagingMutex);
+	staged->dirty = true;
+	return int(len);
+}
+
+static int MEGAftruncate(const char *p, off_t size, struct fuse_file_info *fi)
+{
+	StagedFile *staged = (StagedFile *)(uintptr_t)fi->fh;
+	if (!staged)
+	{
+		return -EBADF;
+	}
+
+	if (ftruncate(staged->fd, size))
+	{
+		return -errno;
+	}
+
+	unique_lock<mutex> lock(stagingMutex);
+	staged->dirty = true;
+	return 0;
+}
+
+static int MEGAtruncate(const char *p, off_t size)
+{
+	string path = megaBasePath + p;
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Truncating file:");
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
+
+	StagedFile *staged = NULL;
+	int result = openStaged(path, true, !size, false, &staged);
+	if (result)
+	{
+		return result;
+	}
+
+	struct fuse_file_info fi;
+	memset(&fi, 0, sizeof fi);
+	fi.fh = (uint64_t)(uintptr_t)staged;
+	result = MEGAftruncate(p, size, &fi);
+	releaseStaged(staged);
+	return result;
+}
+
+static int MEGAflush(const char *p, struct fuse_file_info *fi)
+{
+	// written files are uploaded when their last handle is released
+	return 0;
+}
+
+static int MEGArelease(const char *p, struct fuse_file_info *fi)
+{
+	StagedFile *staged = (StagedFile *)(uintptr_t)fi->fh;
+	if (staged)
+	{
+		releaseStaged(staged);
+	}
+	return 0;
+}
+
+static int MEGAutimens(const char *p, const struct timespec tv[2])
+{
+	// modification times are taken from the staged file when it's uploaded
+	return 0;
 }
 
 int main(int argc, char *argv[])
@@ -615,6 +1299,15 @@ int main(int argc, char *argv[])
 		delete baseNode;
 	}
 		
+	char stagingTemplate[] = "/tmp/megafuse.XXXXXX";
+	if (!mkdtemp(stagingTemplate))
+	{
+		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Unable to create the staging folder");
+		return 0;
+	}
+	stagingDir = stagingTemplate;
+	megaApi->addGlobalListener(&nodeCache);
+
 	MegaApi::log(MegaApi::LOG_LEVEL_INFO, "MEGA initialization complete!");	
 	megaApi->setLogLevel(MegaApi::LOG_LEVEL_WARNING);
 
@@ -623,7 +1316,14 @@ int main(int argc, char *argv[])
     ops.getattr     = MEGAgetattr;
     ops.readdir     = MEGAreaddir;
     ops.open        = MEGAopen;
+    ops.create      = MEGAcreate;
     ops.read		= MEGAread;
+    ops.write       = MEGAwrite;
+    ops.truncate    = MEGAtruncate;
+    ops.ftruncate   = MEGAftruncate;
+    ops.flush       = MEGAflush;
+    ops.release     = MEGArelease;
+    ops.utimens     = MEGAutimens;
     ops.mkdir		= MEGAmkdir;
     ops.rmdir		= MEGArmdir;
     ops.unlink		= MEGAunlink;
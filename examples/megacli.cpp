@@ -286,8 +286,12 @@ void DemoApp::transfer_failed(Transfer* t, error e, dstime)
     cout << errorstring(e) << ")" << endl;
 }
 
+static void scenario_transferred(Transfer*);
+
 void DemoApp::transfer_complete(Transfer* t)
 {
+    scenario_transferred(t);
+
     if (gVerboseMode)
     {
         displaytransferdetails(t, "completed, ");
@@ -2372,7 +2376,7 @@ void exec_sendDeferred(autocomplete::ACState& s)
 void exec_codeTimings(autocomplete::ACState& s)
 {
     bool reset = s.extractflag("-reset");
-    cout << client->performanceStats.report(reset, client->httpio, client->waiter) << flush;
+    cout << client->performanceStats.report(reset, client->httpio, client->waiter, client->sctable) << flush;
 }
 
 #endif
@@ -2495,6 +2499,289 @@ void exec_quit(ac::ACState&)
     quit_flag = true;
 }
 
+// scripted scenarios: the commands of a script run one after another, each one as soon
+// as the client has settled after the previous one, and the time taken by each step is
+// reported as JSON together with the performance stats of the client
+struct Scenario
+{
+    std::ifstream script;
+    string reportpath;
+    bool quitwhendone = false;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    // step in progress (its command without passwords, empty between steps), since when
+    // the client is idle, and the bytes transferred and peak speeds meanwhile
+    string command;
+    std::chrono::steady_clock::time_point stepstarted;
+    std::chrono::steady_clock::time_point idlesince;
+    bool idle = false;
+    m_off_t bytes[2] = { 0, 0 };
+    m_off_t peakspeed[2] = { 0, 0 };
+
+    std::ostringstream steps;
+    unsigned stepcount = 0;
+
+    // the end of a step may not come with any event, so the client is woken up periodically
+    std::atomic<bool> stopping { false };
+    std::thread ticker;
+
+    ~Scenario()
+    {
+        stopping = true;
+        if (ticker.joinable())
+        {
+            ticker.join();
+        }
+    }
+};
+
+static std::unique_ptr<Scenario> scenario;
+
+// how long the client has to stay idle for a step to be over (the filesystem notifications
+// of syncs can come in a while after the changes), and how long a step is waited for
+static const std::chrono::milliseconds SCENARIO_SETTLE_TIME(2000);
+static const std::chrono::seconds SCENARIO_STEP_TIMEOUT(3600);
+
+static string jsonstring(const string& s)
+{
+    string result = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", c);
+            result += buf;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+// no requests, transfers or sync work in flight
+static bool scenarioidle()
+{
+    if (client->pendingcs || client->reqs.cmdspending() || client->fetchingnodes
+     || !client->transfers[GET].empty() || !client->transfers[PUT].empty()
+     || !appxferq[GET].empty() || !appxferq[PUT].empty())
+    {
+        return false;
+    }
+
+#ifdef ENABLE_SYNC
+    if (client->syncactivity || client->syncdownrequired || !client->synccreate.empty())
+    {
+        return false;
+    }
+
+    for (Sync* sync : client->syncs)
+    {
+        if (sync->state == SYNC_INITIALSCAN
+         || !sync->dirnotify->notifyq[DirNotify::DIREVENTS].empty()
+         || !sync->dirnotify->notifyq[DirNotify::RETRY].empty())
+        {
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+static void scenario_transferred(Transfer* t)
+{
+    if (scenario && (t->type == GET || t->type == PUT))
+    {
+        scenario->bytes[t->type] += t->size;
+    }
+}
+
+static void scenarioendstep(bool completed)
+{
+    auto end = completed ? scenario->idlesince : std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - scenario->stepstarted).count();
+
+    scenario->steps << (scenario->stepcount++ ? "," : "") << "\n    {\"command\": " << jsonstring(scenario->command)
+                    << ", \"seconds\": " << seconds
+                    << ", \"completed\": " << (completed ? "true" : "false")
+                    << ", \"downloadedBytes\": " << scenario->bytes[GET]
+                    << ", \"uploadedBytes\": " << scenario->bytes[PUT]
+                    << ", \"peakDownloadSpeed\": " << scenario->peakspeed[GET]
+                    << ", \"peakUploadSpeed\": " << scenario->peakspeed[PUT] << "}";
+
+    cout << "Scenario step " << scenario->stepcount << " (" << scenario->command << "): " << seconds << " s"
+         << (completed ? "" : ", timed out") << endl;
+
+    scenario->command.clear();
+    scenario->bytes[GET] = scenario->bytes[PUT] = 0;
+    scenario->peakspeed[GET] = scenario->peakspeed[PUT] = 0;
+}
+
+static void scenariofinish()
+{
+    string fetchnodes;
+    client->fnstats.toJsonArray(&fetchnodes);
+
+    std::ostringstream report;
+    report << "{\n  \"steps\": [" << scenario->steps.str() << "\n  ],\n"
+           << "  \"seconds\": " << std::chrono::duration<double>(std::chrono::steady_clock::now() - scenario->started).count() << ",\n"
+           << "  \"fetchnodes\": " << (fetchnodes.empty() ? "null" : fetchnodes) << ",\n"
+           << "  \"latencies\": " << client->performanceStats.latencies(false) << ",\n"
+           << "  \"performance\": " << jsonstring(client->performanceStats.report(false, client->httpio, client->waiter, client->sctable)) << "\n"
+           << "}\n";
+
+    if (scenario->reportpath.empty())
+    {
+        cout << report.str() << flush;
+    }
+    else
+    {
+        std::ofstream file(scenario->reportpath);
+        if (file << report.str())
+        {
+            cout << "Scenario report written to " << scenario->reportpath << endl;
+        }
+        else
+        {
+            cout << "Unable to write the scenario report to " << scenario->reportpath << endl;
+        }
+    }
+
+    if (scenario->quitwhendone)
+    {
+        quit_flag = true;
+    }
+    scenario.reset();
+}
+
+// start the next command of the script, or finish the scenario
+static void scenarionext()
+{
+    string line;
+    while (std::getline(scenario->script, line))
+    {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream words(line);
+        string word;
+        words >> word;
+        if (word == "quit" || word == "q" || word == "exit")
+        {
+            scenario->quitwhendone = true;
+            break;
+        }
+
+        // keep credentials out of the report
+        scenario->command = word;
+        if (word == "login" || word == "passwd")
+        {
+            if (words >> word && word.find('@') != string::npos)
+            {
+                scenario->command += " " + word;
+            }
+        }
+        else
+        {
+            scenario->command = line;
+        }
+
+        cout << "Scenario step " << scenario->stepcount + 1 << ": " << scenario->command << endl;
+        scenario->stepstarted = std::chrono::steady_clock::now();
+        scenario->idle = false;
+        process_line(&line[0]);
+        return;
+    }
+
+    scenariofinish();
+}
+
+// called after each run of the client's engine
+static void scenariotick()
+{
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        m_off_t speed = d == GET ? client->httpio->downloadSpeed : client->httpio->uploadSpeed;
+        scenario->peakspeed[d] = std::max(scenario->peakspeed[d], speed);
+    }
+
+    if (scenario->command.empty())
+    {
+        scenarionext();
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (prompt != COMMAND || !scenarioidle())
+    {
+        scenario->idle = false;
+        if (now - scenario->stepstarted > SCENARIO_STEP_TIMEOUT)
+        {
+            scenarioendstep(false);
+        }
+        return;
+    }
+
+    if (!scenario->idle)
+    {
+        scenario->idle = true;
+        scenario->idlesince = now;
+    }
+
+    if (now - scenario->idlesince >= SCENARIO_SETTLE_TIME)
+    {
+        scenarioendstep(true);
+    }
+}
+
+static bool startscenario(const string& scriptpath, const string& reportpath, bool quitwhendone)
+{
+    if (scenario)
+    {
+        cout << "A scenario is already running" << endl;
+        return false;
+    }
+
+    std::unique_ptr<Scenario> s(new Scenario);
+    s->script.open(scriptpath);
+    if (!s->script)
+    {
+        cout << "Unable to open " << scriptpath << endl;
+        return false;
+    }
+
+    s->reportpath = reportpath;
+    s->quitwhendone = quitwhendone;
+    s->ticker = std::thread([](Scenario* s, Waiter* waiter)
+    {
+        while (!s->stopping)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            waiter->notify();
+        }
+    }, s.get(), client->waiter);
+
+    scenario = std::move(s);
+    return true;
+}
+
+void exec_scenario(ac::ACState& s)
+{
+    startscenario(s.words[1].s, s.words.size() > 2 ? s.words[2].s : string(), false);
+}
+
 void exec_showattributes(autocomplete::ACState& s)
 {
     if (const Node* n = nodeFromRemotePath(s.words[1].s))
@@ -2669,6 +2956,7 @@ autocomplete::ACN autocompleteSyntax()
 #endif
     p->Add(exec_help, either(text("help"), text("h"), text("?")));
     p->Add(exec_quit, either(text("quit"), text("q"), text("exit")));
+    p->Add(exec_scenario, sequence(text("scenario"), localFSFile("script"), opt(localFSFile("report"))));
 
     p->Add(exec_find, sequence(text("find"), text("raided")));
 
@@ -7308,6 +7596,15 @@ void megacli()
         // pass the CPU to the engine (nonblocking)
         client->exec();
 
+        if (scenario)
+        {
+            scenariotick();
+            if (quit_flag)
+            {
+                return;
+            }
+        }
+
         if (puts && !appxferq[PUT].size())
         {
             cout << "Uploads complete" << endl;
@@ -7353,7 +7650,7 @@ public:
 
 MegaCLILogger logger;
 
-int main()
+int main(int argc, char* argv[])
 {
 #ifdef _WIN32
     SimpleLogger::setLogLevel(logMax);  // warning and stronger to console; info and weaker to VS output window
@@ -7394,6 +7691,14 @@ int main()
 #endif
 
     clientFolder = NULL;    // additional for folder links
+
+    // megacli --scenario <script> [<report>] runs the script and quits
+    if (argc > 2 && !strcmp(argv[1], "--scenario")
+     && !startscenario(argv[2], argc > 3 ? argv[3] : "", true))
+    {
+        return 1;
+    }
+
     megacli();
 }
 
@@ -23,6 +23,17 @@
 
 #ifdef _WIN32
 #include <conio.h>
+#else
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #endif
 
 using namespace mega;
@@ -73,13 +84,353 @@ struct Login
 };
 static Login login;
 
+// globals
+MegaClient* client;
+
+#ifndef _WIN32
+// settings of the daemon mode, read from its configuration file:
+//   # comment
+//   sync <local folder> <remote folder>    (once per sync, "quoted" if needed)
+//   session <file>                         session kept across restarts
+//   cachedir <folder>                      where the local caches are stored
+//   scanthreads <n>                        threads listing and fingerprinting
+//   connections get|put <n>                transfer connections per direction
+//   connectioncache <maxconnects> <hostconnections> <totalconnections> <idleseconds>
+//   dbsync off|normal|full|extra           durability of the local caches
+//   dbcache <KiB>                          page cache of each local cache
+//   dbcompress on|off                      compress the records of the local caches
+//   lazynodes on|off                       load the cached nodes on demand
+//   metricsport <port>                     Prometheus metrics on 127.0.0.1
+//   loglevel error|warning|info|debug|max
+struct DaemonConfig
+{
+    vector<pair<string, string>> syncs;
+    string sessionfile;
+    string cachedir;
+    unsigned scanthreads = MegaClient::SYNCSCANTHREADS;
+    int connections[2] = { 0, 0 };
+    ConnectionCacheOptions connectioncache;
+    int dbsynchronous = -1;
+    int dbcachekib = -1;
+    bool dbcompress = false;
+    bool lazynodes = true;
+    int metricsport = 0;
+    int loglevel = logInfo;
+
+    bool load(const string& path);
+};
+
+// splits a line in words separated by blanks, "quoted" words keep them
+static vector<string> configwords(const string& line)
+{
+    vector<string> words;
+    size_t i = 0;
+
+    for (;;)
+    {
+        while (i < line.size() && isspace((unsigned char)line[i]))
+        {
+            i++;
+        }
+
+        if (i == line.size() || line[i] == '#')
+        {
+            return words;
+        }
+
+        string word;
+        if (line[i] == '"')
+        {
+            size_t end = line.find('"', ++i);
+            if (end == string::npos)
+            {
+                end = line.size();
+            }
+            word = line.substr(i, end - i);
+            i = end < line.size() ? end + 1 : end;
+        }
+        else
+        {
+            while (i < line.size() && !isspace((unsigned char)line[i]))
+            {
+                word.push_back(line[i++]);
+            }
+        }
+        words.push_back(word);
+    }
+}
+
+bool DaemonConfig::load(const string& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file.is_open())
+    {
+        LOG_err << "Unable to read the configuration file " << path;
+        return false;
+    }
+
+    static const char* levels[] = { "error", "warning", "info", "debug", "max" };
+    static const char* syncmodes[] = { "off", "normal", "full", "extra" };
+
+    string line;
+    int lineno = 0;
+    while (std::getline(file, line))
+    {
+        lineno++;
+        vector<string> w = configwords(line);
+        if (w.empty())
+        {
+            continue;
+        }
+
+        bool ok = true;
+        if (w[0] == "sync" && w.size() == 3)
+        {
+            syncs.push_back(make_pair(w[1], w[2]));
+        }
+        else if (w[0] == "session" && w.size() == 2)
+        {
+            sessionfile = w[1];
+        }
+        else if (w[0] == "cachedir" && w.size() == 2)
+        {
+            cachedir = w[1];
+            if (!cachedir.empty() && cachedir.back() != '/')
+            {
+                cachedir.push_back('/');
+            }
+        }
+        else if (w[0] == "scanthreads" && w.size() == 2)
+        {
+            scanthreads = unsigned(atoi(w[1].c_str()));
+            ok = scanthreads > 0;
+        }
+        else if (w[0] == "connections" && w.size() == 3 && (w[1] == "get" || w[1] == "put"))
+        {
+            connections[w[1] == "get" ? GET : PUT] = atoi(w[2].c_str());
+        }
+        else if (w[0] == "connectioncache" && w.size() == 5)
+        {
+            connectioncache.maxconnects = atoi(w[1].c_str());
+            connectioncache.maxhostconnections = atoi(w[2].c_str());
+            connectioncache.maxtotalconnections = atoi(w[3].c_str());
+            connectioncache.maxidleseconds = atoi(w[4].c_str());
+        }
+        else if (w[0] == "dbsync" && w.size() == 2)
+        {
+            dbsynchronous = -1;
+            for (int i = 0; i < 4; i++)
+            {
+                if (w[1] == syncmodes[i])
+                {
+                    dbsynchronous = i;
+                }
+            }
+            ok = dbsynchronous >= 0;
+        }
+        else if (w[0] == "dbcache" && w.size() == 2)
+        {
+            dbcachekib = atoi(w[1].c_str());
+        }
+        else if (w[0] == "dbcompress" && w.size() == 2 && (w[1] == "on" || w[1] == "off"))
+        {
+            dbcompress = w[1] == "on";
+        }
+        else if (w[0] == "lazynodes" && w.size() == 2 && (w[1] == "on" || w[1] == "off"))
+        {
+            lazynodes = w[1] == "on";
+        }
+        else if (w[0] == "metricsport" && w.size() == 2)
+        {
+            metricsport = atoi(w[1].c_str());
+            ok = metricsport > 0 && metricsport < 65536;
+        }
+        else if (w[0] == "loglevel" && w.size() == 2)
+        {
+            loglevel = -1;
+            for (int i = 0; i < 5; i++)
+            {
+                if (w[1] == levels[i])
+                {
+                    loglevel = logError + i;
+                }
+            }
+            ok = loglevel >= 0;
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            LOG_err << path << ":" << lineno << ": invalid setting: " << line;
+            return false;
+        }
+    }
+
+    if (syncs.empty())
+    {
+        LOG_err << path << ": no sync configured";
+        return false;
+    }
+    return true;
+}
+
+// serves the latest metrics of the client over HTTP on 127.0.0.1; the
+// snapshot is taken by the thread running the client (see update())
+class MetricsServer
+{
+    int fd = -1;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    string snapshot;
+    unsigned generation = 0;
+    std::atomic<bool> requested{false};
+
+    void serve();
+
+public:
+    std::atomic<unsigned> restarts{0};
+
+    bool start(int port);
+    void stop();
+
+    // takes a snapshot if the listener is waiting for one
+    void update();
+};
+
+bool MetricsServer::start(int port)
+{
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(uint16_t(port));
+
+    if (::bind(fd, (sockaddr*)&addr, sizeof addr) || listen(fd, 8))
+    {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    thread = std::thread([this]() { serve(); });
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    if (fd >= 0)
+    {
+        // wakes up accept()
+        shutdown(fd, SHUT_RDWR);
+        thread.join();
+        close(fd);
+        fd = -1;
+    }
+}
+
+void MetricsServer::serve()
+{
+    for (;;)
+    {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            return;
+        }
+
+        // the request itself is irrelevant, every path returns the metrics
+        timeval timeout = { 1, 0 };
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+        char request[1024];
+        ssize_t r = recv(conn, request, sizeof request, 0);
+        (void)r;
+
+        string body;
+        {
+            std::unique_lock<std::mutex> g(mutex);
+            unsigned current = generation;
+            requested = true;
+            client->waiter->notify();
+
+            // a busy client may take a while, then the previous snapshot is served
+            cv.wait_for(g, std::chrono::seconds(2), [&]() { return generation != current; });
+            body = snapshot;
+        }
+
+        std::ostringstream response;
+        response << "HTTP/1.0 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: " << body.size() << "\r\n"
+                    "Connection: close\r\n\r\n" << body;
+        string out = response.str();
+
+        for (size_t sent = 0; sent < out.size(); )
+        {
+            ssize_t n = send(conn, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += size_t(n);
+        }
+        close(conn);
+    }
+}
+
+void MetricsServer::update()
+{
+    if (!requested.exchange(false))
+    {
+        return;
+    }
+
+    std::ostringstream s;
+    client->metrics(s);
+
+    s << "# HELP megasimplesync_nodes Remote nodes in memory, lazy: not read from the local cache yet\n"
+         "# TYPE megasimplesync_nodes gauge\n"
+         "megasimplesync_nodes{state=\"loaded\"} " << client->nodes.size() - client->lazynodecount << "\n"
+         "megasimplesync_nodes{state=\"lazy\"} " << client->lazynodecount << "\n"
+         "# HELP megasimplesync_restarts_total Restarts requested with SIGHUP\n"
+         "# TYPE megasimplesync_restarts_total counter\n"
+         "megasimplesync_restarts_total " << restarts << "\n";
+
+    std::lock_guard<std::mutex> g(mutex);
+    snapshot = s.str();
+    generation++;
+    cv.notify_all();
+}
+#endif
+
 class SyncApp : public MegaApp, public Logger
 {
-    string local_folder;
-    string remote_folder;
+    // local and remote folders of each sync
+    vector<pair<string, string>> folders;
     handle cwd;
     bool initial_fetch;
 
+    // daemon mode: keep running when a sync fails, keep the session in sessionfile
+    bool daemon = false;
+    string sessionfile;
+    bool resuming = false;
+
     void prelogin_result(int version, string* email, string *salt, error e);
 
     void login_result(error e);
@@ -111,15 +462,26 @@ class SyncApp : public MegaApp, public Logger
     Node* nodebypath(const char* ptr, string* user, string* namepart);
 public:
     SyncApp(string local_folder_, string remote_folder_);
+#ifndef _WIN32
+    // daemon mode, see configure()
+    SyncApp();
+
+    void configure(const DaemonConfig&);
+
+    // resumes the saved session, or logs in with MEGA_EMAIL and MEGA_PWD
+    void start();
+
+    // saves the sync state and the session, then logs out locally
+    void stop();
+
+    void savesession();
+#endif
 
     // Logger interface
 public:
     void log(const char *time, int loglevel, const char *source, const char *message);
 };
 
-// globals
-MegaClient* client;
-
 // returns node pointer determined by path relative to cwd
 // Path naming conventions:
 // path is relative to cwd
@@ -341,9 +703,101 @@ Node* SyncApp::nodebypath(const char* ptr, string* user = NULL, string* namepart
 }
 
 SyncApp:: SyncApp(string local_folder_, string remote_folder_) :
-    local_folder(local_folder_), remote_folder(remote_folder_), cwd(UNDEF), initial_fetch(true)
+    cwd(UNDEF), initial_fetch(true)
+{
+    folders.push_back(make_pair(local_folder_, remote_folder_));
+}
+
+#ifndef _WIN32
+SyncApp::SyncApp() :
+    cwd(UNDEF), initial_fetch(true), daemon(true)
 {}
 
+// takes effect on the next start()
+void SyncApp::configure(const DaemonConfig& config)
+{
+    folders = config.syncs;
+    sessionfile = config.sessionfile;
+}
+
+void SyncApp::start()
+{
+    initial_fetch = true;
+    resuming = false;
+
+    string session;
+    if (!sessionfile.empty())
+    {
+        std::ifstream file(sessionfile.c_str());
+        string line;
+        if (std::getline(file, line))
+        {
+            session = Base64::atob(line);
+        }
+    }
+
+    if (!session.empty())
+    {
+        LOG_info << "Resuming the session of " << sessionfile;
+        resuming = true;
+        client->login((const byte*)session.data(), int(session.size()));
+    }
+    else if (!login.email.empty())
+    {
+        client->prelogin(login.email.c_str());
+    }
+    else
+    {
+        LOG_err << "FATAL: No session to resume and MEGA_EMAIL / MEGA_PWD not set, exiting";
+        exit(1);
+    }
+}
+
+void SyncApp::savesession()
+{
+    byte session[64];
+    int size = client->dumpsession(session, sizeof session);
+    if (sessionfile.empty() || size <= 0)
+    {
+        return;
+    }
+
+    // the session gives full access to the account
+    int fd = open(sessionfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        LOG_err << "Unable to save the session to " << sessionfile;
+        return;
+    }
+
+    string line = Base64::btoa(string((const char*)session, size)) + "\n";
+    if (write(fd, line.data(), line.size()) != ssize_t(line.size()))
+    {
+        LOG_err << "Unable to save the session to " << sessionfile;
+    }
+    close(fd);
+}
+
+void SyncApp::stop()
+{
+#ifdef ENABLE_SYNC
+    // the state caches of the syncs are kept, so that they resume without a full rescan
+    for (Sync* sync : client->syncs)
+    {
+        size_t pending;
+        do
+        {
+            pending = sync->insertq.size() + sync->deleteq.size();
+            sync->cachenodes();
+        } while (sync->insertq.size() + sync->deleteq.size() && sync->insertq.size() + sync->deleteq.size() < pending);
+    }
+#endif
+
+    savesession();
+    client->locallogout();
+}
+#endif
+
 void SyncApp::log(const char *time, int loglevel, const char *source, const char *message)
 {
     if (!time)
@@ -391,6 +845,15 @@ void SyncApp::prelogin_result(int version, std::string* email, std::string *salt
 // TODO: check for errors
 void SyncApp::login_result(error e)
 {
+    if (e != API_OK && resuming && !login.email.empty())
+    {
+        LOG_warn << "The saved session could not be resumed (" << e << "), logging in again";
+        resuming = false;
+        client->locallogout();
+        client->prelogin(login.email.c_str());
+        return;
+    }
+
     if (e != API_OK)
     {
         LOG_err << "FATAL: Failed to get login result, exiting";
@@ -416,40 +879,54 @@ void SyncApp::fetchnodes_result(error e)
             cwd = client->rootnodes[0];
         }
 
-        Node* n = nodebypath(remote_folder.c_str());
-        if (client->checkaccess(n, FULL))
+#ifndef _WIN32
+        if (daemon)
         {
-            string localname;
+            savesession();
+        }
+#endif
 
-            client->fsaccess->path2local(&local_folder, &localname);
+        for (size_t i = 0; i < folders.size(); i++)
+        {
+            string local_folder = folders[i].first;
+            string remote_folder = folders[i].second;
 
-            if (!n)
+            Node* n = nodebypath(remote_folder.c_str());
+            if (client->checkaccess(n, FULL))
             {
-                LOG_err << remote_folder << ": Not found.";
-                exit(1);
-            }
-            else if (n->type == FILENODE)
-            {
-                LOG_err << remote_folder << ": Remote sync root must be folder.";
-                exit(1);
+                string localname;
+
+                client->fsaccess->path2local(&local_folder, &localname);
+
+                if (!n)
+                {
+                    LOG_err << remote_folder << ": Not found.";
+                }
+                else if (n->type == FILENODE)
+                {
+                    LOG_err << remote_folder << ": Remote sync root must be folder.";
+                }
+                else if (client->addsync(&localname, DEBRISFOLDER, NULL, n, 0, int(i + 1)))
+                {
+                    LOG_err << local_folder << ": Sync could not be added! ";
+                }
+                else
+                {
+                    LOG_info << local_folder << ": Sync started !";
+                    continue;
+                }
             }
             else
             {
-                error err = client->addsync(&localname, DEBRISFOLDER, NULL, n, 0);
-                if (err)
-                {
-                    LOG_err << "Sync could not be added! ";
-                    exit(1);
-                }
+                LOG_err << remote_folder << ": Syncing requires full access to path.";
+            }
 
-                LOG_info << "Sync started !";
+            // in daemon mode, the other syncs go on
+            if (!daemon)
+            {
+                exit(1);
             }
         }
-        else
-        {
-            LOG_err << remote_folder << ": Syncing requires full access to path.";
-            exit(1);
-        }
     }
 }
 
@@ -461,9 +938,21 @@ void SyncApp::request_error(error e)
 }
 
 #ifdef ENABLE_SYNC
-void SyncApp::syncupdate_state(Sync*, syncstate_t state)
+void SyncApp::syncupdate_state(Sync* sync, syncstate_t state)
 {
-    if (( state == SYNC_CANCELED ) || ( state == SYNC_FAILED ))
+    if (daemon)
+    {
+        // the syncs are canceled by a local logout (see stop())
+        if (state == SYNC_FAILED)
+        {
+            LOG_err << "Sync " << sync->tag << " failed: " << sync->errorcode;
+        }
+        else if (state == SYNC_ACTIVE)
+        {
+            LOG_info << "Sync " << sync->tag << " is now active";
+        }
+    }
+    else if (( state == SYNC_CANCELED ) || ( state == SYNC_FAILED ))
     {
         LOG_err << "FATAL: Sync failed !";
         exit(1);
@@ -578,6 +1067,153 @@ void SyncApp::syncupdate_treestate(LocalNode* l)
 }
 
 #endif
+
+static MegaClient* createclient(SyncApp* app, string* dbpath = NULL)
+{
+    // create MegaClient, providing our custom MegaApp and Waiter classes
+    return new MegaClient(app, new WAIT_CLASS, new HTTPIO_CLASS, new FSACCESS_CLASS,
+                        #ifdef DBACCESS_CLASS
+                                                    new DBACCESS_CLASS(dbpath),
+                        #else
+                                                    NULL,
+                        #endif
+                        #ifdef GFX_CLASS
+                                                    new GFX_CLASS,
+                        #else
+                                                    NULL,
+                        #endif
+                            "N9tSBJDC", "megasimplesync");
+}
+
+#ifndef _WIN32
+static std::atomic<bool> daemonstop(false);
+static std::atomic<bool> daemonrestart(false);
+
+static void applyconfig(const DaemonConfig& config)
+{
+    SimpleLogger::setLogLevel(LogLevel(config.loglevel));
+
+#ifdef ENABLE_SYNC
+    client->syncscanthreads = config.scanthreads;
+#endif
+
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        if (config.connections[d])
+        {
+            client->setmaxconnections(direction_t(d), config.connections[d]);
+        }
+        client->httpio->setconnectioncache(direction_t(d), config.connectioncache);
+    }
+
+    if (client->dbaccess)
+    {
+        client->dbaccess->config.synchronous = config.dbsynchronous;
+        client->dbaccess->config.cacheSizeKiB = config.dbcachekib;
+        client->dbaccess->config.compressRecords = config.dbcompress;
+    }
+
+    // keeps the memory bounded by the nodes in use rather than the whole account
+    client->setlazynodeloading(config.lazynodes);
+    client->pipelinedstartup = true;
+}
+
+// runs the syncs of a configuration file until SIGTERM or SIGINT; SIGHUP
+// reloads it and resumes the session and the syncs from the local caches
+static int daemonmain(const char* configpath)
+{
+    SyncApp* app = new SyncApp;
+    SimpleLogger::setOutputClass(app);
+
+    DaemonConfig config;
+    if (!config.load(configpath))
+    {
+        return 1;
+    }
+    app->configure(config);
+
+    // only needed when there is no session to resume
+    if (getenv("MEGA_EMAIL") && getenv("MEGA_PWD"))
+    {
+        login.email = getenv("MEGA_EMAIL");
+        login.password = getenv("MEGA_PWD");
+    }
+
+    // the signals are taken by a dedicated thread: blocked before any other thread starts
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    client = createclient(app, config.cachedir.empty() ? NULL : &config.cachedir);
+    applyconfig(config);
+
+    MetricsServer metrics;
+    if (config.metricsport && !metrics.start(config.metricsport))
+    {
+        LOG_err << "Unable to listen on port " << config.metricsport;
+        return 1;
+    }
+
+    std::thread([signals]() {
+        for (;;)
+        {
+            int sig;
+            if (!sigwait(&signals, &sig))
+            {
+                (sig == SIGHUP ? daemonrestart : daemonstop) = true;
+                client->waiter->notify();
+            }
+        }
+    }).detach();
+
+    app->start();
+
+    while (!daemonstop)
+    {
+        client->exec();
+
+        if (daemonrestart.exchange(false))
+        {
+            LOG_info << "Restarting";
+            app->stop();
+
+            DaemonConfig reloaded;
+            if (reloaded.load(configpath))
+            {
+                if (reloaded.cachedir != config.cachedir || reloaded.metricsport != config.metricsport)
+                {
+                    LOG_warn << "cachedir and metricsport only change when the process is restarted";
+                }
+                reloaded.cachedir = config.cachedir;
+                reloaded.metricsport = config.metricsport;
+                config = reloaded;
+
+                app->configure(config);
+                applyconfig(config);
+            }
+            else
+            {
+                LOG_warn << "Keeping the previous configuration";
+            }
+
+            metrics.restarts++;
+            app->start();
+        }
+
+        metrics.update();
+        client->wait();
+    }
+
+    LOG_info << "Shutting down";
+    app->stop();
+    metrics.stop();
+    return 0;
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 #ifndef ENABLE_SYNC
@@ -597,9 +1233,20 @@ int main(int argc, char *argv[])
     {
         cerr << "Usage: " << argv[0] << " [local folder] [remote folder]" << endl;
         cerr << "   (set MEGA_DEBUG to 1 or 2 to see debug output." << endl;
+#ifndef _WIN32
+        cerr << "       " << argv[0] << " --config [configuration file]" << endl;
+        cerr << "   (daemon mode, see DaemonConfig for the settings)" << endl;
+#endif
         return 1;
     }
 
+#ifndef _WIN32
+    if (!strcmp(argv[1], "--config"))
+    {
+        return daemonmain(argv[2]);
+    }
+#endif
+
     app = new SyncApp(argv[1], argv[2]);
     SimpleLogger::setOutputClass(app);
 
@@ -609,19 +1256,7 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // create MegaClient, providing our custom MegaApp and Waiter classes
-    client = new MegaClient(app, new WAIT_CLASS, new HTTPIO_CLASS, new FSACCESS_CLASS,
-                        #ifdef DBACCESS_CLASS
-                                                    new DBACCESS_CLASS,
-                        #else
-                                                    NULL,
-                        #endif
-                        #ifdef GFX_CLASS
-                                                    new GFX_CLASS,
-                        #else
-                                                    NULL,
-                        #endif
-                            "N9tSBJDC", "megasimplesync");
+    client = createclient(app);
 
     // if MEGA_DEBUG env variable is set
     if (getenv("MEGA_DEBUG"))
@@ -57,6 +57,7 @@
 #include "mega/pendingcontactrequest.h"
 #include "mega/utils.h"
 #include "mega/logging.h"
+#include "mega/trace.h"
 #include "mega/waiter.h"
 
 #include "mega/node.h"
@@ -78,6 +79,7 @@
 #include "megaconsole.h"
 #include "megaconsolewaiter.h"
 
+#include "mega/db/lmdb.h"
 #include "mega/db/sqlite.h"
 #include "mega/db/bdb.h"
 
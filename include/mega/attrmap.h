@@ -27,7 +27,48 @@
 namespace mega {
 
 // maps attribute names to attribute values
-typedef map<nameid, string> attr_map;
+// kept as a vector sorted by name, with the interface of the std::map it
+// replaces: a node has a handful of attributes, and millions of nodes would
+// spend more on the tree nodes than on the values. Unlike with a std::map,
+// inserting or erasing invalidates the iterators
+class MEGA_API attr_map
+{
+public:
+    typedef nameid key_type;
+    typedef string mapped_type;
+    typedef std::pair<nameid, string> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_t size() const { return entries.size(); }
+    size_t capacity() const { return entries.capacity(); }
+    bool empty() const { return entries.empty(); }
+    void clear() { entries.clear(); }
+    void swap(attr_map& other) { entries.swap(other.entries); }
+
+    iterator find(nameid);
+    const_iterator find(nameid) const;
+    size_t count(nameid id) const { return find(id) != end(); }
+
+    string& operator[](nameid);
+    std::pair<iterator, bool> insert(const value_type&);
+
+    size_t erase(nameid);
+    iterator erase(const_iterator);
+
+    bool operator==(const attr_map& other) const { return entries == other.entries; }
+    bool operator!=(const attr_map& other) const { return entries != other.entries; }
+
+private:
+    std::vector<value_type> entries;
+
+    iterator lowerbound(nameid);
+};
 
 struct MEGA_API AttrMap
 {
@@ -25,6 +25,8 @@
 #include "types.h"
 
 namespace mega {
+class TimerWheel;
+
 // generic timer facility with exponential backoff
 class MEGA_API BackoffTimer
 {
@@ -32,6 +34,18 @@ class MEGA_API BackoffTimer
     dstime delta;
     dstime base;
     PrnGen &rng;
+    uint64_t backoffs;
+
+    // place in the TimerWheel that keeps the trigger time, if any
+    friend class TimerWheel;
+    TimerWheel* wheel = nullptr;
+    void* wheelowner = nullptr;
+    BackoffTimer* wheelprev = nullptr;
+    BackoffTimer* wheelnext = nullptr;
+    int wheelslot = -1;
+
+    // move the timer to the slot of its new trigger time
+    void reschedule();
 
 public:
     // reset timer
@@ -64,7 +78,66 @@ public:
     // update time to wait
     void update(dstime*);
 
+    // number of exponential backoffs (retries) triggered
+    uint64_t backoffcount(bool resetcount = false);
+
+    // keep the trigger time in a wheel, along with the object owning the timer
+    void schedule(TimerWheel*, void* owner);
+    void* owner() const;
+
     BackoffTimer(PrnGen &rng);
+    BackoffTimer(const BackoffTimer&);
+    ~BackoffTimer();
+};
+
+// hierarchical timer wheel holding the trigger times of many BackoffTimers, so
+// that the next one is found without visiting all of them: each of the SLOTS
+// slots of a level spans a whole turn of the level below, and timers move down
+// the levels as their trigger time approaches
+class MEGA_API TimerWheel
+{
+public:
+    static const int SLOTBITS = 6;
+    static const int SLOTS = 1 << SLOTBITS;
+    static const int LEVELS = 4;
+
+    // move the timers triggering up to now to the due list
+    void advance(dstime now);
+
+    // iterate the due list: timers stay in it until they are reset, set or
+    // backed off again
+    BackoffTimer* firstdue() const;
+    BackoffTimer* nextdue(const BackoffTimer*) const;
+
+    // next time at which advance() has work to do: a trigger time, or the time
+    // to move the timers of a slot down a level - NEVER if there are none
+    // (the due list is not considered)
+    dstime nextevent() const;
+
+    // scheduled timers with a trigger time, due ones included
+    size_t size() const;
+
+    // the wheel must outlive the timers scheduled in it
+    TimerWheel();
+    ~TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+private:
+    friend class BackoffTimer;
+
+    static const int DUE = LEVELS * SLOTS;
+
+    void insert(BackoffTimer*);
+    void remove(BackoffTimer*);
+    void cascade(int slot);
+
+    // time up to which the slots have been processed
+    dstime now;
+
+    size_t count;
+    BackoffTimer* slots[DUE + 1];
+    uint64_t occupied[LEVELS];
 };
 
 
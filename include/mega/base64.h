@@ -39,6 +39,15 @@ public:
     static string atob(const string&);
     static int atob(const char*, byte*, int);   // deprecated
 
+    // btoa() and atob() with the length of the input run 12 bytes (16 characters) at a
+    // time where vectorized; btoaScalar() and atob() without a length are the references
+    static int btoaScalar(const byte*, int, char*);
+    static int atob(const char*, size_t, byte*, int);
+
+    // a handle of size bytes (MegaClient::NODEHANDLE, USERHANDLE...) without allocating:
+    // false if the string doesn't hold that many
+    static bool atohandle(const char*, handle*, int size);
+
     static void itoa(int64_t, string *);
     static int64_t atoi(string *);
 };
@@ -60,6 +60,14 @@ public:
     // some commands are guaranteed to work if we query without specifying a SID (eg. gmf)
     bool suppressSID;
 
+    // reads whose outcome doesn't depend on the commands queued before them (eg. uga), which
+    // can go out in a pipelined batch instead of waiting for the ordered ones
+    bool orderIndependent;
+
+    // make room for the expected size of the arguments still to be added,
+    // so that bulk commands are built without repeated reallocations
+    void reserve(size_t);
+
     void cmd(const char*);
     void notself(MegaClient*);
     virtual void cancel(void);
@@ -88,6 +96,7 @@ public:
     virtual void procresult();
 
     const char* getstring() const;
+    const string& getjson() const;
 
     Command();
     virtual ~Command() = default;
@@ -304,6 +313,19 @@ public:
     void procresult();
 };
 
+// one of the attributes requested by MegaClient::getuas(): the value is only
+// cached, the last one to complete reports the result of all of them
+class MEGA_API CommandGetUAsItem : public CommandGetUA
+{
+    std::shared_ptr<size_t> pending;
+    int batchtag;
+
+public:
+    CommandGetUAsItem(MegaClient*, const char*, attr_t, const std::shared_ptr<size_t>&, int);
+
+    void procresult();
+};
+
 #ifdef DEBUG
 class MEGA_API CommandDelUA : public Command
 {
@@ -339,10 +361,34 @@ public:
 // reload nodes/shares/contacts
 class MEGA_API CommandFetchNodes : public Command
 {
+    // the node array ("f") can be parsed while the rest of the response is still arriving
+    enum { STREAM_START, STREAM_NODES, STREAM_DONE, STREAM_OFF } streamstate;
+    size_t streampos;
+    node_vector streamdp;
+
 public:
     void procresult();
 
-    CommandFetchNodes(MegaClient*, bool nocache = false);
+    // consume the complete node objects received so far; once the response is
+    // complete, rebuild it without the streamed nodes for procresult()
+    void procpartial(HttpReq*, bool complete);
+
+    // the request is being (re)sent
+    void resetstream();
+
+    // not recursive: the root and its children only (lazy folder links)
+    CommandFetchNodes(MegaClient*, bool nocache = false, bool recursive = true);
+};
+
+// fetch the children of a folder of a lazily loaded folder link
+class MEGA_API CommandFetchFolder : public Command
+{
+    handle h;
+
+public:
+    void procresult();
+
+    CommandFetchFolder(MegaClient*, handle);
 };
 
 // update own node keys
@@ -467,6 +513,22 @@ public:
     void procresult();
 
     CommandPutFile(MegaClient *client, TransferSlot*, int);
+
+    // roots of the trees the files of an upload go to
+    static void targetroots(Command*, MegaClient*, Transfer*);
+};
+
+// tempurls of a queued transfer, requested ahead of its dispatch (see
+// MegaClient::prefetchtransferurls())
+class MEGA_API CommandPrefetchTransferUrls : public Command
+{
+    Transfer* transfer;
+
+public:
+    void cancel();
+    void procresult();
+
+    CommandPrefetchTransferUrls(MegaClient*, Transfer*, int);
 };
 
 class MEGA_API CommandPutFileBackgroundURL : public Command
@@ -506,7 +568,12 @@ class MEGA_API CommandPutNodes : public Command
     putsource_t source;
     handle targethandle;
 
+    void batchresult(error);
+
 public:
+    // tags of the uploads of a batch (MegaClient::batchputnode), one per new node
+    vector<int> batchtags;
+
     void procresult();
 
     CommandPutNodes(MegaClient*, handle, const char*, NewNode*, int, int, putsource_t = PUTNODES_APP, const char *cauth = NULL);
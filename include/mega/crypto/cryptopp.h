@@ -78,6 +78,9 @@ private:
     CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption aescbc_e;
     CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption aescbc_d;
 
+    // keystream for ctr_crypt(), processes many counter blocks per call
+    CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption aesctr_e;
+
     CryptoPP::CCM<CryptoPP::AES, 16>::Encryption aesccm16_e;
     CryptoPP::CCM<CryptoPP::AES, 16>::Decryption aesccm16_d;
 
@@ -243,6 +246,9 @@ public:
 
     void ctr_crypt(byte *, unsigned, m_off_t, ctr_iv, byte *, bool, bool initmac = true);
 
+    // CBC-MAC of len bytes (a multiple of BLOCKSIZE), chained from and stored to mac
+    void cbc_mac(const byte *, size_t, byte *);
+
     static void setint64(int64_t, byte*);
 
     static void xorblock(const byte*, byte*);
@@ -263,6 +269,12 @@ class MEGA_API AsymmCipher
 {
     int decodeintarray(CryptoPP::Integer*, int, const byte*, int);
 
+    // CRT exponents d mod (p - 1) and d mod (q - 1) of the private key, zero
+    // if not known. Once set, decryption only reads the object, so the same
+    // private key can decrypt from several threads at once
+    CryptoPP::Integer crtdp, crtdq;
+    void precomputecrt();
+
 public:
     enum { PRIV_P, PRIV_Q, PRIV_D, PRIV_U };
     enum { PUB_PQ, PUB_E };
@@ -399,13 +411,19 @@ public:
     void get(std::string*);
 };
 
+// same result as CryptoPP::CRC32, accelerated with PCLMULQDQ (detected at
+// runtime) or the ARMv8 CRC32 instructions (if enabled at build time)
 class MEGA_API HashCRC32
 {
-    CryptoPP::CRC32 hash;
+    uint32_t crc = 0xFFFFFFFF;
 
 public:
     void add(const byte*, unsigned);
     void get(byte*);
+
+    // CRC register update, and the portable implementation it falls back to
+    static uint32_t update(uint32_t crc, const byte*, size_t);
+    static uint32_t updatescalar(uint32_t crc, const byte*, size_t);
 };
 
 /**
@@ -22,6 +22,11 @@
 #ifndef MEGA_DB_H
 #define MEGA_DB_H 1
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 #include "filesystem.h"
 
 namespace mega {
@@ -33,6 +38,21 @@ class MEGA_API DbTable
     static const int IDSPACING = 16;
     PrnGen &rng;
 
+    // serialize, compress, pad and encrypt (false if the record can't be serialized)
+    bool encode(uint32_t, Cachable *, SymmCipher*, DbRecord*);
+
+    // zlib streams and preset dictionaries, created on first use
+    struct Compressor;
+    std::unique_ptr<Compressor> compressor;
+    Compressor* getcompressor();
+
+    // records shorter than this aren't worth compressing
+    static const size_t MINCOMPRESSSIZE = 64;
+
+    // false if the record of the type doesn't get any smaller
+    bool compress(uint32_t, string*);
+    bool decompress(uint32_t, string*);
+
 protected:
     bool mCheckAlwaysTransacted = false;
     DBTableTransactionCommitter* mCurrentTransactionCommiter = nullptr;
@@ -40,24 +60,65 @@ protected:
     void checkTransaction();
 
 public:
+    // the record type is kept in the low bits of the id
+    static const uint32_t TYPEMASK = IDSPACING - 1;
+
     // for a full sequential get: rewind to first record
     virtual void rewind() = 0;
 
+    // sequential get restricted to one record type, or to the records put with
+    // the given parent key (false if the backend can't filter this way)
+    virtual bool rewindtype(uint32_t) { return false; }
+    virtual bool rewindchildren(int64_t) { return false; }
+
+    // key under which the records of a parent's children are indexed: node handles
+    // aren't stored in clear, the record data itself is encrypted as well
+    static int64_t parentkey(handle, SymmCipher*);
+
     // get next record in sequence
     virtual bool next(uint32_t*, string*) = 0;
     bool next(uint32_t*, string*, SymmCipher*);
 
+    // decrypt and unpad a record read by next(uint32_t*, string*)
+    bool decryptnext(uint32_t, string*, SymmCipher*);
+
+    // decrypt, unpad and decompress a record read with its id
+    bool decode(uint32_t, string*, SymmCipher*);
+
+    // compress the records put from now on - the padding tells both kinds
+    // apart, so the records written before are still read
+    bool compressrecords = false;
+
+    // preset dictionary for the records of a type, to be set before any of
+    // them is read or written: records compressed with a dictionary can only
+    // be read with the same one, so it can't change afterwards
+    void setdictionary(uint32_t, const string&);
+
     // get specific record by key
     virtual bool get(uint32_t, string*) = 0;
+    bool get(uint32_t, string*, SymmCipher*);
 
     // update or add specific record
     virtual bool put(uint32_t, char*, unsigned) = 0;
     bool put(uint32_t, string*);
     bool put(uint32_t, Cachable *, SymmCipher*);
 
+    // update or add a record together with its parent key (if the backend keeps them)
+    virtual bool putrecord(const DbRecord&);
+
+    // add or update a batch of records (stops at the first failure)
+    virtual bool putmany(const dbrecord_vector&);
+
+    // serialize, pad and encrypt a record and append it to a putmany() batch
+    // (assigns the record's dbid right away, like put())
+    void addbatch(dbrecord_vector*, uint32_t, Cachable *, SymmCipher*);
+
     // delete specific record
     virtual bool del(uint32_t) = 0;
 
+    // delete a batch of records (stops at the first failure)
+    virtual bool delmany(const vector<uint32_t>&);
+
     // delete all records
     virtual void truncate() = 0;
 
@@ -75,11 +136,91 @@ public:
 
     void checkCommitter(DBTableTransactionCommitter*);
 
+    // wait until all queued operations have been written (asynchronous tables only)
+    virtual void flush() { }
+
+    // false while a commit() issued earlier hasn't reached storage yet
+    virtual bool committed() { return true; }
+
+    // a queued operation failed - the table is no longer consistent
+    virtual bool writefailed() { return false; }
+
+    // page cache hits, misses and writes since the last reset (if the backend tracks them)
+    virtual bool cachestats(int64_t* hits, int64_t* misses, int64_t* writes, bool reset) { return false; }
+
     // autoincrement
     uint32_t nextid;
 
+    // allocate a dbid for a new record of the given type
+    uint32_t newid(uint32_t type) { return (nextid += IDSPACING) | type; }
+
     DbTable(PrnGen &rng, bool alwaysTransacted);
-    virtual ~DbTable() { }
+    virtual ~DbTable();
+};
+
+// runs the operations of another DbTable on a dedicated writer thread, in order.
+// Records are serialized and encrypted by the caller, so the writer only does I/O.
+// Reads are answered from the still queued records or, failing that, after
+// flush(); the wrapped table is never used from two threads at the same time.
+class MEGA_API AsyncDbTable : public DbTable
+{
+    struct Op
+    {
+        enum { PUT, PUTMANY, DEL, DELMANY, TRUNCATE, BEGIN, COMMIT, ABORT } type;
+        DbRecord record;
+        dbrecord_vector records;
+        vector<uint32_t> ids;
+    };
+
+    // the queued operation writing each record and its data (NULL: deletion)
+    typedef map<uint32_t, pair<const Op*, const string*> > pendingrecord_map;
+
+    std::unique_ptr<DbTable> mTable;
+    Waiter* mWaiter;
+
+    std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::deque<Op> mQueue;
+    pendingrecord_map mPending;
+    uint64_t mCommitsQueued = 0;
+    uint64_t mCommitsDone = 0;
+    bool mFailed = false;
+    bool mExit = false;
+
+    // page cache hits, misses and writes, accumulated by the writer thread at each commit
+    int64_t mStats[3] = { 0, 0, 0 };
+    bool mStatsSampled = false;
+    std::thread mThread;
+
+    void enqueue(Op&& op);
+    bool execute(const Op& op);
+    void loop();
+
+public:
+    void rewind() override;
+    bool rewindtype(uint32_t) override;
+    bool rewindchildren(int64_t) override;
+    bool next(uint32_t*, string*) override;
+    bool get(uint32_t, string*) override;
+    bool put(uint32_t, char*, unsigned) override;
+    bool putrecord(const DbRecord&) override;
+    bool putmany(const dbrecord_vector&) override;
+    bool del(uint32_t) override;
+    bool delmany(const vector<uint32_t>&) override;
+    void truncate() override;
+    void begin() override;
+    void commit() override;
+    void abort() override;
+    void remove() override;
+
+    void flush() override;
+    bool committed() override;
+    bool writefailed() override;
+    bool cachestats(int64_t* hits, int64_t* misses, int64_t* writes, bool reset) override;
+
+    // takes ownership of table; waiter is woken up whenever a commit completes
+    AsyncDbTable(PrnGen &rng, DbTable* table, Waiter* waiter);
+    ~AsyncDbTable();
 };
 
 class MEGA_API DBTableTransactionCommitter
@@ -126,6 +267,35 @@ public:
     }
 };
 
+// durability/memory trade-offs for the tables opened by a DbAccess; applied by
+// the backends that support them, -1 keeps the backend's default
+struct MEGA_API DbConfig
+{
+    // 0: off, 1: normal, 2: full, 3: extra (sqlite PRAGMA synchronous)
+    int synchronous = -1;
+
+    // page cache size in KiB
+    int cacheSizeKiB = -1;
+
+    // bytes of the database file to memory-map (0 disables memory-mapped I/O)
+    int64_t mmapSize = -1;
+
+    // page size in bytes (only for newly created databases)
+    int pageSize = -1;
+
+    // temporary tables and indices: 0: default, 1: file, 2: memory
+    int tempStore = -1;
+
+    // WAL size in pages that triggers an automatic checkpoint (0 disables them)
+    int walAutoCheckpoint = -1;
+
+    // run a passive WAL checkpoint right after every commit
+    bool walCheckpointOnCommit = false;
+
+    // compress the records before encrypting them (see DbTable::compressrecords)
+    bool compressRecords = false;
+};
+
 struct MEGA_API DbAccess
 {
     static const int LEGACY_DB_VERSION = 11;
@@ -137,6 +307,9 @@ struct MEGA_API DbAccess
     virtual ~DbAccess() { }
 
     int currentDbVersion;
+
+    // used for tables opened from now on
+    DbConfig config;
 };
 } // namespace
 
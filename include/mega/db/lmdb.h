@@ -0,0 +1,102 @@
+/**
+ * @file lmdb.h
+ * @brief LMDB DB access layer
+ *
+ * (c) 2013-2014 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifdef USE_LMDB
+#ifndef DBACCESS_CLASS
+#define DBACCESS_CLASS LmdbDbAccess
+
+#include <lmdb.h>
+
+namespace mega {
+// environment shared by all the LmdbDbAccess instances with the same base path
+struct LmdbEnv;
+
+// all tables live in a single LMDB environment per base path (one file, one
+// page cache, one fsync per commit), one named database per table, so many
+// clients in the same process don't each keep their own database files
+class MEGA_API LmdbDbAccess : public DbAccess
+{
+    string dbpath;
+    LmdbEnv* env = nullptr;
+
+public:
+    // upper bound on the number of tables in one environment
+    static const unsigned MAXTABLES = 4096;
+
+    DbTable* open(PrnGen &rng, FileSystemAccess*, string*, bool recycleLegacyDB, bool checkAlwaysTransacted) override;
+
+    LmdbDbAccess(string* = NULL);
+    ~LmdbDbAccess();
+};
+
+// LMDB allows a single write transaction per environment, so changes are kept
+// in memory between begin() and commit() and written in one short transaction:
+// a client with a transaction open doesn't block the others
+class MEGA_API LmdbDbTable : public DbTable
+{
+    LmdbEnv* env;
+    MDB_dbi dbi;
+    string name;
+    bool removed = false;
+
+    // changes of the current transaction (a record without value is deleted)
+    struct PendingRecord
+    {
+        bool deleted;
+        string data;
+    };
+    std::map<uint32_t, PendingRecord> pending;
+    bool truncated = false;
+    bool transacted = false;
+
+    // a commit could not be written (reported through writefailed())
+    bool failed = false;
+
+    // sequential read state: read transaction, cursor and last key returned
+    MDB_txn* readtxn = nullptr;
+    MDB_cursor* cursor = nullptr;
+    bool started = false;
+    uint32_t lastkey = 0;
+
+    void endread();
+    bool write();
+    bool change(uint32_t, const char*, size_t, bool deleted);
+
+public:
+    void rewind();
+    bool next(uint32_t*, string*);
+    bool get(uint32_t, string*);
+    bool put(uint32_t, char*, unsigned);
+    bool del(uint32_t);
+    void truncate();
+    void begin();
+    void commit();
+    void abort();
+    void remove();
+    bool writefailed();
+
+    LmdbDbTable(PrnGen &rng, LmdbEnv*, MDB_dbi, const string& name, bool checkAlwaysTransacted);
+    ~LmdbDbTable();
+};
+} // namespace
+
+#endif
+#endif
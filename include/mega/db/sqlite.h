@@ -30,6 +30,8 @@ class MEGA_API SqliteDbAccess : public DbAccess
 {
     string dbpath;
 
+    static void pragma(sqlite3*, const char* name, int64_t value);
+
 public:
     DbTable* open(PrnGen &rng, FileSystemAccess*, string*, bool recycleLegacyDB, bool checkAlwaysTransacted) override;
 
@@ -44,17 +46,50 @@ class MEGA_API SqliteDbTable : public DbTable
     string dbfile;
     FileSystemAccess *fsaccess;
 
+    // rows per multi-row INSERT in putmany() and DELETE in delmany()
+    static const int BATCHROWS = 64;
+
+    // statements prepared on first use and reset after each use
+    sqlite3_stmt* pGetStmt = nullptr;
+    sqlite3_stmt* pPutStmt = nullptr;
+    sqlite3_stmt* pPutBatchStmt = nullptr;
+    sqlite3_stmt* pDelStmt = nullptr;
+    sqlite3_stmt* pDelBatchStmt = nullptr;
+
+    sqlite3_stmt* prepared(sqlite3_stmt** stmt, const char* sql);
+    void finalizestatements();
+
+    // (re)start the sequential cursor with the given query and optional filter
+    bool rewindquery(const char* sql, bool filtered, int64_t value);
+
+    bool putrow(uint32_t index, const char* data, unsigned len, const int64_t* parent);
+
 public:
+    // parent column of the rows that predate it, until they're rewritten
+    static const int64_t UNKNOWNPARENT = INT64_MIN;
+
+    // add the type/parent columns and their indexes to caches written by older versions
+    static bool migrate(sqlite3*);
+
     void rewind();
+    bool rewindtype(uint32_t);
+    bool rewindchildren(int64_t);
     bool next(uint32_t*, string*);
     bool get(uint32_t, string*);
     bool put(uint32_t, char*, unsigned);
+    bool putrecord(const DbRecord&);
+    bool putmany(const dbrecord_vector&);
     bool del(uint32_t);
+    bool delmany(const vector<uint32_t>&);
     void truncate();
     void begin();
     void commit();
     void abort();
     void remove();
+    bool cachestats(int64_t* hits, int64_t* misses, int64_t* writes, bool reset);
+
+    // see DbConfig::walCheckpointOnCommit
+    bool checkpointOnCommit = false;
 
     SqliteDbTable(PrnGen &rng, sqlite3*, FileSystemAccess *fs, string *filepath, bool checkAlwaysTransacted);
     ~SqliteDbTable();
@@ -23,6 +23,7 @@
 #define MEGA_FILE_H 1
 
 #include "filefingerprint.h"
+#include "attrmap.h"
 
 namespace mega {
 
@@ -92,6 +93,13 @@ struct MEGA_API File: public FileFingerprint
     // for remote file drops: uid or e-mail address of recipient
     string targetuser;
 
+    // attributes of the node of an upload besides its name and fingerprint
+    attr_map uploadattrs;
+
+    // for uploads read from a stream rather than from localname (not serialized:
+    // the stream can't be read again after a restart)
+    std::shared_ptr<UploadStream> uploadstream;
+
     // transfer linkage
     Transfer* transfer;
     file_list::iterator file_it;
@@ -22,13 +22,18 @@
 #ifndef MEGA_FILEATTRIBUTEFETCH_H
 #define MEGA_FILEATTRIBUTEFETCH_H 1
 
+#include <list>
+
 #include "backofftimer.h"
 #include "types.h"
 #include "http.h"
 
 namespace mega {
 
-// file attribute fetching for a specific source cluster
+struct FileSystemAccess;
+
+// file attribute fetching for a specific source cluster (one of the up to
+// MegaClient::FACHANNELS channels of the cluster)
 struct MEGA_API FileAttributeFetchChannel
 {
     MegaClient *client;
@@ -69,6 +74,46 @@ struct MEGA_API FileAttributeFetch
 
     FileAttributeFetch(handle, string, fatype, int);
 };
+
+// decrypted file attributes kept in a local folder by attribute handle, up
+// to a total size; the least recently used ones (those of previous sessions
+// first) are removed to make room
+class MEGA_API FileAttributeCache
+{
+public:
+    // localfolder is a local path to an existing folder
+    FileAttributeCache(FileSystemAccess*, const string& localfolder, m_off_t maxsize);
+
+    bool get(handle fah, string* data);
+    void put(handle fah, const char* data, size_t len);
+
+private:
+    struct Entry
+    {
+        m_off_t size;
+        std::list<handle>::iterator lru;
+    };
+
+    FileSystemAccess* fsaccess;
+    string folder;
+    m_off_t maxsize;
+    m_off_t size;
+
+    // most recently used last
+    std::list<handle> lru;
+    std::map<handle, Entry> entries;
+
+    void localpath(handle fah, string* path);
+    void remove(std::map<handle, Entry>::iterator);
+};
+
+// file attribute found in the FileAttributeCache, delivered by the next exec()
+struct MEGA_API FileAttributeCacheHit
+{
+    handle fah;
+    FileAttributeFetch fetch;
+    string data;
+};
 } // namespace
 
 #endif
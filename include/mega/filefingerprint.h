@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <mutex>
+
 #include "types.h"
 #include "filesystem.h"
 
@@ -59,4 +61,89 @@ struct MEGA_API FileFingerprintCmp
 
 bool operator==(const FileFingerprint& lhs, const FileFingerprint& rhs);
 
+// fingerprint of data read once, from the beginning to the end (an upload from
+// a stream): the bytes sampled by FileFingerprint::genfingerprint are kept as
+// they go by
+class MEGA_API StreamFingerprint
+{
+public:
+    explicit StreamFingerprint(m_off_t size);
+
+    // data at pos, after the data added before
+    void add(const byte* data, size_t len, m_off_t pos);
+
+    // the fingerprint, once all the sampled bytes have been added
+    bool get(FileFingerprint*, m_time_t mtime) const;
+
+private:
+    struct Range
+    {
+        m_off_t offset;
+        unsigned len;
+        size_t sample;  // position in samples
+    };
+
+    m_off_t size;
+    vector<Range> ranges;   // by offset
+    size_t next = 0;        // first range not added completely
+    string samples;
+};
+
+class DbTable;
+
+// fingerprints of local files by file system id, size and mtime, kept in a
+// table of the local cache, so that a file that hasn't changed isn't read
+// again (after a restart as well). Can be used from several threads
+class MEGA_API FingerprintCache
+{
+public:
+    // start over once there are this many files
+    static const size_t MAXENTRIES = 4000000;
+
+    // fingerprints kept in memory before they are written
+    static const size_t FLUSHENTRIES = 1024;
+
+    // takes ownership of the table, whose records are encrypted with the key
+    FingerprintCache(DbTable*, const SymmCipher& key);
+    ~FingerprintCache();
+
+    // the cached fingerprint of a file that hasn't changed since it was stored
+    bool lookup(FileAccess*, FileFingerprint*);
+    void store(FileAccess*, const FileFingerprint&);
+
+    // write the fingerprints stored since the last flush, in a single transaction
+    void flush();
+
+    // delete the table
+    void remove();
+
+    // fingerprint a file from the cache if possible (cache can be NULL), with
+    // the same return value as FileFingerprint::genfingerprint()
+    static bool genfingerprint(FingerprintCache*, FileFingerprint*, FileAccess*, bool ignoremtime = false);
+
+private:
+    struct Key
+    {
+        handle fsid;
+        m_off_t size;
+        m_time_t mtime;
+
+        bool operator<(const Key&) const;
+    };
+
+    struct Entry
+    {
+        int32_t crc[4];
+        uint32_t dbid;
+    };
+
+    std::mutex mMutex;
+    std::map<Key, Entry> mEntries;
+    std::vector<Key> mPending;
+    std::unique_ptr<DbTable> mTable;
+    std::unique_ptr<SymmCipher> mKey;
+
+    void flushlocked();
+};
+
 } // mega
@@ -130,6 +130,9 @@ struct MEGA_API FileAccess
     // absolute position write
     virtual bool fwrite(const byte *, unsigned, m_off_t) = 0;
 
+    // reserve the space of a file opened for writing, without changing its size (if supported and enabled)
+    virtual bool fpreallocate(m_off_t) { return false; }
+
     FileAccess(Waiter *waiter);
     virtual ~FileAccess();
 
@@ -169,14 +172,25 @@ struct MEGA_API InputStreamAccess
     virtual ~InputStreamAccess() { }
 };
 
+// attributes of an item reported along with its change notification or its
+// directory listing, on platforms that provide them (they spare opening the
+// item to learn them) - fsid is UNDEF when they are not known
+struct MEGA_API NotifyAttributes
+{
+    nodetype_t type;
+    m_off_t size;
+    m_time_t mtime;
+    handle fsid;
+};
+
 // generic host directory enumeration
 struct MEGA_API DirAccess
 {
     // open for scanning
     virtual bool dopen(string*, FileAccess*, bool) = 0;
 
-    // get next record
-    virtual bool dnext(string*, string*, bool = true, nodetype_t* = NULL) = 0;
+    // get next record, with its attributes if requested
+    virtual bool dnext(string*, string*, bool = true, nodetype_t* = NULL, NotifyAttributes* = NULL) = 0;
 
     virtual ~DirAccess() { }
 };
@@ -207,7 +221,21 @@ struct MEGA_API DirNotify
     virtual void addnotify(LocalNode*, string*) { }
     virtual void delnotify(LocalNode*) { }
 
-    void notify(notifyqueue, LocalNode *, const char*, size_t, bool = false);
+    // queue a notification for a path; while a non-immediate notification
+    // for the same path is still queued, the earlier one is dropped and the
+    // new one goes to the back, so the path is scanned once it has been quiet
+    // for the scanning delay; many pending DIREVENTS notifications for the
+    // children of one folder are collapsed into a rescan of that folder;
+    // the attributes of the item, if known, are trusted instead of opening it
+    // to tell whether the notification was caused by the sync itself
+    void notify(notifyqueue, LocalNode *, const char*, size_t, bool = false, const NotifyAttributes* = nullptr);
+
+    // remove the front notification of a queue
+    void pop(notifyqueue);
+
+    // pending DIREVENTS notifications for children of the same folder that
+    // are collapsed into a single rescan
+    static const unsigned COLLAPSE_CHILDREN = 64;
 
     // filesystem fingerprint
     virtual fsfp_t fsfingerprint() const;
@@ -216,6 +244,14 @@ struct MEGA_API DirNotify
     // This should return false for any FAT filesystem.
     virtual bool fsstableids() const;
 
+    // change journal of the filesystem, to learn what changed while the sync
+    // wasn't running: the current position (false if there is no journal)
+    virtual bool journalposition(string*) { return false; }
+
+    // queue the changes made after a position as DIREVENTS notifications
+    // (false if they can't be told, e.g. the journal was truncated since)
+    virtual bool journalchanges(const string&) { return false; }
+
     // ignore this
     string ignore;
 
@@ -223,6 +259,31 @@ struct MEGA_API DirNotify
 
     DirNotify(string*, string*);
     virtual ~DirNotify() {}
+
+private:
+    // number of notifications popped from each queue, so that a notification
+    // can be referred to by its position among all ever queued
+    uint64_t popped[NUMQUEUES];
+
+    // position of the queued non-immediate notification for each full path
+    // (EXTRA and DIREVENTS) and of the queued rescan of each folder (DIREVENTS)
+    std::unordered_map<string, uint64_t> pendingpaths[RETRY];
+    std::unordered_map<string, uint64_t> pendingrescans;
+
+    // queued non-immediate DIREVENTS notifications per parent folder
+    struct PendingChildren
+    {
+        unsigned count = 0;
+        vector<uint64_t> positions;
+    };
+    std::unordered_map<string, PendingChildren> pendingchildren;
+
+    bool pending(notifyqueue, const std::unordered_map<string, uint64_t>&, const string&, uint64_t*) const;
+    void append(notifyqueue, LocalNode*, const string&, const string&, bool, bool);
+    void unindex(notifyqueue, const Notification&, uint64_t);
+    void discard(notifyqueue, uint64_t);
+    void collapse(const string&);
+    string parentpath(const string&) const;
 };
 
 // generic host filesystem access interface
@@ -283,6 +344,9 @@ struct MEGA_API FileSystemAccess : public EventTrigger
     // copy file, overwrite target, set mtime
     virtual bool copylocal(string*, string*, m_time_t) = 0;
 
+    // hard link a file, overwrite target: false where links aren't supported
+    virtual bool linklocal(string*, string*) { return false; }
+
     // delete file
     virtual bool unlinklocal(string*) = 0;
 
@@ -327,6 +391,17 @@ struct MEGA_API FileSystemAccess : public EventTrigger
     int getdefaultfolderpermissions() { return 0700; }
     void setdefaultfolderpermissions(int) { }
 
+    // how files are written by downloads (FSWRITE_* flags, where supported)
+    enum { FSWRITE_PREALLOCATE = 1, FSWRITE_DIRECTIO = 2, FSWRITE_DROPCACHE = 4 };
+    int getwriteoptions() { return 0; }
+    void setwriteoptions(int) { }
+
+    // makes completed files and the directory entries pointing at them durable
+    // (fsync of the files, then of their parent directories). With wholefilesystem,
+    // the files are not flushed one by one: each file system holding them is.
+    // Runs on a worker thread, so it must not use the state of this object
+    virtual bool flushlocal(const vector<string>&, bool /*wholefilesystem*/) const { return false; }
+
     // set whenever an operation fails due to a transient condition (e.g. locking violation)
     bool transient_error;
     
@@ -349,6 +424,35 @@ struct MEGA_API FileSystemAccess : public EventTrigger
     FileSystemAccess();
     virtual ~FileSystemAccess() { }
 };
+
+// named memory region shared with the other processes of the user, mapped
+// read-write by the process that creates it and read-only by the others.
+// Implemented by the platform layer (not available on Android)
+class MEGA_API SharedMemory
+{
+public:
+    // fails if the name exists
+    bool create(const string& name, size_t size);
+    bool open(const string& name);
+    void close();
+
+    // the processes that mapped the region keep it, the name is free for
+    // another one (the region goes with its last handle on Windows)
+    static void remove(const string& name);
+
+    byte* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+    SharedMemory() = default;
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+    ~SharedMemory() { close(); }
+
+private:
+    byte* mData = nullptr;
+    size_t mSize = 0;
+    void* mHandle = nullptr;
+};
 } // namespace
 
 #endif
@@ -22,8 +22,13 @@
 #ifndef GFX_H
 #define GFX_H 1
 
+#include <condition_variable>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <thread>
 
+#include "filefingerprint.h"
 #include "megawaiter.h"
 #include "mega/thread/qtthread.h"
 #include "mega/thread/posixthread.h"
@@ -52,6 +57,12 @@ public:
     // flag related to the job
     bool flag;
 
+    // the job holds up an upload, serve it before the others
+    bool urgent;
+
+    // content of the image, to reuse the images of identical files
+    FileFingerprint fingerprint;
+
     // resulting images
     vector<string *> images;
 };
@@ -62,8 +73,13 @@ class MEGA_API GfxJobQueue
         std::deque<GfxJob *> jobs;
         std::mutex mutex;
 
+        // the first urgentjobs jobs are urgent
+        size_t urgentjobs;
+
     public:
         GfxJobQueue();
+
+        // urgent jobs go after the other urgent ones, ahead of the rest
         void push(GfxJob *job);
         GfxJob *pop();
 };
@@ -72,14 +88,34 @@ class MEGA_API GfxJobQueue
 class MEGA_API GfxProc
 {
     bool finished;
-    WAIT_CLASS waiter;
     std::mutex mutex;
-    THREAD_CLASS thread;
     SymmCipher mCheckEventsKey;
     GfxJobQueue requests;
     GfxJobQueue responses;
-    static void *threadEntryPoint(void *param);
-    void loop();
+
+    // worker threads, started with the first job. Each one works with its own
+    // processor from newprocessor(), or with this one (shared with savefa())
+    // if the implementation can't provide them
+    unsigned numworkers;
+    unsigned workerlimit;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<GfxProc> > processors;
+    std::mutex workmutex;
+    std::condition_variable workchanged;
+    void startworkers();
+    void stopworkers();
+    void loop(GfxProc* processor);
+    void process(GfxJob* job, GfxProc* processor);
+
+    // images generated for each content (by fingerprint), so that copies of a
+    // file are processed once. Most recently used first
+    typedef std::list<std::pair<FileFingerprint, std::map<fatype, string> > > gfxcache_list;
+    gfxcache_list cache;
+    std::map<const FileFingerprint*, gfxcache_list::iterator, FileFingerprintCmp> cacheindex;
+    size_t cachesize;
+    std::mutex cachemutex;
+    bool fromcache(GfxJob*);
+    void tocache(GfxJob*);
 
     // read and store bitmap
     virtual bool readbitmap(FileAccess*, string*, int) = 0;
@@ -100,6 +136,10 @@ protected:
     // list of supported video extensions (NULL if no pre-filtering is needed)
     virtual const char* supportedvideoformats();
 
+    // another processor of the same kind for a worker thread, with its own
+    // bitmap state (NULL if images can only be processed one at a time)
+    virtual GfxProc* newprocessor();
+
 public:
     virtual int checkevents(Waiter*);
 
@@ -113,7 +153,7 @@ public:
     // handle is uploadhandle or nodehandle
     // - must respect JPEG EXIF rotation tag
     // - must save at 85% quality (120*120 pixel result: ~4 KB)
-    int gendimensionsputfa(FileAccess*, string*, handle, SymmCipher*, int = -1, bool checkAccess = true);
+    int gendimensionsputfa(FileAccess*, string*, handle, SymmCipher*, int = -1, bool checkAccess = true, const FileFingerprint* = NULL);
 
     // FIXME: read dynamically from API server
     typedef enum { THUMBNAIL, PREVIEW } meta_t;
@@ -127,6 +167,19 @@ public:
     static const int dimensions[][2];
     static const int dimensionsavatar[][2];
 
+    // number of images processed at the same time, at most MAXWORKERS
+    // (the jobs in progress are completed first)
+    void setworkers(unsigned);
+    unsigned getworkers();
+
+    // caps the workers below the number set with setworkers() while the
+    // device saves power (0: no cap)
+    void setworkerlimit(unsigned);
+    static const unsigned MAXWORKERS = 16;
+
+    // memory used by the images kept for identical files
+    static const size_t MAXCACHESIZE = 16 * 1024 * 1024;
+
     MegaClient* client;
     int w, h;
 
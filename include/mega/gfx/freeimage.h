@@ -41,6 +41,7 @@ public:
 protected:
     string sformats;
     const char* supportedformats();
+    GfxProc* newprocessor();
 
 #ifdef HAVE_FFMPEG
     static std::mutex gfxMutex;
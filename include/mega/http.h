@@ -26,6 +26,11 @@
 #include "waiter.h"
 #include "backofftimer.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 #ifndef _WIN32
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -103,13 +108,15 @@ public:
     m_off_t getMeanSpeed();
 
     // interval to calculate the mean speed (ds)
-    static const int SPEED_MEAN_INTERVAL_DS;
+    static const int SPEED_MEAN_INTERVAL_DS = 50;
 
     // max values to calculate the mean speed
     static const int SPEED_MAX_VALUES;
 
 protected:
-    map<dstime, m_off_t> transferBytes;
+    // bytes transferred during each decisecond of the interval, indexed by
+    // time modulo SPEED_MEAN_INTERVAL_DS, and their sum
+    m_off_t transferBytes[SPEED_MEAN_INTERVAL_DS];
     m_off_t partialBytes;
 
     m_off_t meanSpeed;
@@ -117,6 +124,99 @@ protected:
     int speedCounter;
 };
 
+// TLS session exported by the network layer, to be resumed after a restart
+struct MEGA_API TlsSession : public Cachable
+{
+    // peer the session belongs to, as identified by the network layer
+    string peer;
+    string mac;
+    string data;
+
+    // expiration (Unix time)
+    m_time_t validuntil;
+
+    TlsSession();
+
+    bool serialize(string*) override;
+    static TlsSession* unserialize(string*);
+};
+
+// tuning of the sockets of a direction of the network layer (0 / empty: system default)
+struct MEGA_API SocketOptions
+{
+    // SO_RCVBUF / SO_SNDBUF
+    int rcvbuf = 0;
+    int sndbuf = 0;
+
+    // TCP_NOTSENT_LOWAT
+    int notsentlowat = 0;
+
+    // TCP_CONGESTION (e.g. "bbr")
+    string congestion;
+
+    // receive / upload buffer of the network library
+    int buffersize = 0;
+};
+
+// limits of the connection cache of a direction of the network layer (0: library default)
+struct MEGA_API ConnectionCacheOptions
+{
+    // connections kept open for reuse once idle
+    int maxconnects = 0;
+
+    // open connections to a host / in total (more requests wait for a free one)
+    int maxhostconnections = 0;
+    int maxtotalconnections = 0;
+
+    // idle connections older than this aren't reused
+    int maxidleseconds = 0;
+};
+
+// latencies in power-of-two millisecond buckets: < 1 ms, < 2 ms, < 4 ms ... >= 16 s
+struct MEGA_API LatencyHistogram
+{
+    static const int BUCKETS = 16;
+
+    uint64_t counts[BUCKETS];
+    uint64_t samples;
+    uint64_t totalms;
+
+    void add(int64_t ms);
+    void tojson(std::ostream&) const;
+
+    LatencyHistogram();
+};
+
+// network counters of the requests of a direction to a host
+struct MEGA_API HostNetworkStats
+{
+    // DNS resolution (cache misses), TCP connection and TLS handshake (new connections),
+    // and time to the first byte of the response since the request started to be sent
+    LatencyHistogram dns, connect, tls, ttfb;
+
+    // requests by HTTP status (0: no response) and new connections
+    std::map<int, uint64_t> statuses;
+    uint64_t connections = 0;
+
+    uint64_t bytesin = 0;
+    uint64_t bytesout = 0;
+
+    void tojson(std::ostream&) const;
+};
+
+// network counters by direction and host ("scheme://host:port")
+struct MEGA_API NetworkStats
+{
+    // storage hosts are many: the ones beyond this count are added up under "other"
+    static const size_t MAXHOSTS = 128;
+
+    std::map<string, HostNetworkStats> hosts[3];
+
+    HostNetworkStats& host(direction_t, const string&);
+    void tojson(std::ostream&) const;
+    void clear();
+};
+
 // generic host HTTP I/O interface
 struct MEGA_API HttpIO : public EventTrigger
 {
@@ -141,6 +241,12 @@ struct MEGA_API HttpIO : public EventTrigger
 
     virtual void disconnect() { }
 
+    // whether HttpReq::purge() can be used on a response that is still being received
+    virtual bool purgesinflight() { return false; }
+
+    // filled by network layers that can measure their requests
+    NetworkStats networkstats;
+
     // track Internet connectivity issues
     dstime noinetds;
     bool inetback;
@@ -178,9 +284,15 @@ struct MEGA_API HttpIO : public EventTrigger
     // get proxy settings from the system
     virtual Proxy *getautoproxy();
 
+    // use these proxy settings
+    virtual void setproxy(Proxy*) = 0;
+
     // get alternative DNS servers
     void getMEGADNSservers(string*, bool = true);
 
+    // resolve through these DNS servers (comma-separated)
+    virtual void setdnsservers(const char*) { }
+
     // set max download speed
     virtual bool setmaxdownloadspeed(m_off_t bpslimit);
 
@@ -193,10 +305,53 @@ struct MEGA_API HttpIO : public EventTrigger
     // get max upload speed
     virtual m_off_t getmaxuploadspeed();
 
+    // enable/disable HTTP/2 with request multiplexing
+    virtual bool sethttp2(bool enable);
+
+    // get HTTP/2 multiplexing state
+    virtual bool gethttp2();
+
+    // export the TLS sessions established so far / import sessions exported
+    // by a previous process (false if the network layer doesn't support it)
+    virtual bool gettlssessions(std::vector<TlsSession>*);
+    virtual bool settlssessions(const std::vector<TlsSession>&);
+
+    // move the data of the requests in flight on a dedicated thread while
+    // the client is busy (false if the network layer doesn't support it)
+    virtual bool setiothread(bool enable);
+    virtual bool getiothread();
+
+    // tune the sockets opened from now on for a direction
+    // (false if the network layer doesn't support it)
+    virtual bool setsocketoptions(direction_t, const SocketOptions&);
+
+    // limit the connections of a direction (false if the network layer doesn't support it)
+    virtual bool setconnectioncache(direction_t, const ConnectionCacheOptions&);
+
+    // open idle connections to the host of a URL in the pool of a direction,
+    // unless it was used recently (false if the network layer doesn't support it)
+    virtual bool preconnect(const string& url, direction_t, int connections);
+
+    // the client won't touch the requests in flight until acquireio() (see HttpIOReleaser)
+    virtual void releaseio() { }
+    virtual void acquireio() { }
+
     HttpIO();
     virtual ~HttpIO() { }
 };
 
+// lets the network thread (see HttpIO::setiothread) move data while the client
+// runs work that doesn't touch the requests in flight. Can be nested
+class MEGA_API HttpIOReleaser
+{
+public:
+    HttpIOReleaser(HttpIO* h) : httpio(h) { httpio->releaseio(); }
+    ~HttpIOReleaser() { httpio->acquireio(); }
+
+private:
+    HttpIO* httpio;
+};
+
 // outgoing HTTP request
 struct MEGA_API HttpReq
 {
@@ -220,6 +375,10 @@ struct MEGA_API HttpReq
     string* out;
     string in;
     size_t inpurge;
+
+    // allocate the whole Content-Length for the response up front
+    // (not wanted if it is purged while it arrives)
+    bool reserveresponse;
     size_t outpos;
 
     string outbuf;
@@ -227,6 +386,9 @@ struct MEGA_API HttpReq
     byte* buf;
     m_off_t buflen, bufpos, notifiedbufpos;
 
+    // size of buf if it comes from HttpBufferPool (0: allocated with new[])
+    size_t bufcapacity;
+
     // we assume that API responses are smaller than 4 GB
     m_off_t contentlength;
 
@@ -251,6 +413,7 @@ struct MEGA_API HttpReq
 
     // send POST request to the network
     void post(MegaClient*, const char* = NULL, unsigned = 0);
+    void post(HttpIO*, const char* = NULL, unsigned = 0);
 
     // send GET request to the network
     void get(MegaClient*);
@@ -265,6 +428,9 @@ struct MEGA_API HttpReq
     char* data();
     size_t size();
 
+    // approximate bytes held by the request and response buffers
+    size_t memoryusage() const;
+
     // a buffer that the HttpReq filled in.   This struct owns the buffer (so HttpReq no longer has it).
     struct http_buf_t 
     { 
@@ -274,13 +440,14 @@ struct MEGA_API HttpReq
         size_t start;
         size_t end;
 
-        http_buf_t(byte* b, size_t s, size_t e);  // takes ownership of the byte*, which must have been allocated with new[]
+        http_buf_t(byte* b, size_t s, size_t e, size_t capacity = 0);  // takes ownership of the byte*, which must have been allocated with new[] (capacity 0) or by HttpBufferPool
         ~http_buf_t();
         void swap(http_buf_t& other);
         bool isNull();
 
     private: 
         byte* buf;
+        size_t capacity;
     };
     
     // give up ownership of the buffer for client to use.  The caller is the new owner of the http_buf_t, and the HttpReq no longer has the buffer or any info about it.
@@ -355,6 +522,9 @@ public:
 
     bool encrypt(m_off_t pos, m_off_t npos, string& urlSuffix);
 
+    // CRC of the data encrypted so far, relative to the pos passed to encrypt()
+    const byte* getcrc() const { return crc; }
+
 private:
     SymmCipher* key;
     chunkmac_map* macs;
@@ -374,6 +544,121 @@ public:
     EncryptBufferByChunks(byte* b, SymmCipher* k, chunkmac_map* m, uint64_t iv);
 };
 
+// recycles the large buffers that downloaded data goes through (request
+// buffers, RAID parts and output pieces): allocating and page-faulting a few
+// MB per request costs about as much as the data copies at high speeds
+class MEGA_API HttpBufferPool
+{
+public:
+    // a buffer of at least size bytes; its capacity must be passed to release()
+    static byte* allocate(size_t size, size_t* capacity);
+    static void release(byte* buf, size_t capacity);
+
+    // bytes of the free buffers kept for reuse
+    static size_t pooledbytes();
+
+    // capacities are multiples of GRANULARITY, at most MAXPOOLED bytes are kept.
+    // Buffers are ALIGNMENT-aligned, so downloaded data can be written with direct I/O
+    static const size_t GRANULARITY = 65536;
+    static const size_t MAXPOOLED = 64 << 20;
+    static const size_t ALIGNMENT = 4096;
+};
+
+// encrypts and decrypts transfer data on worker threads. A job works with its
+// own copy of the key and doesn't touch the transfer: the chunk MACs are handed
+// over on the SDK thread once it has finished.
+// The threads are the instance's own, or a process-wide pool shared by all the
+// instances created while one is set (see setsharedthreads())
+class MEGA_API CryptoWorkers
+{
+    struct Pool;
+
+public:
+    class MEGA_API Job
+    {
+        std::mutex mMutex;
+        std::condition_variable mDone;
+        bool mFinished = false;
+        unsigned mParts = 1;
+        unsigned mPendingParts = 0;
+        CryptoWorkers* mOwner = nullptr;
+
+        friend class CryptoWorkers;
+
+    public:
+        virtual void run() = 0;
+
+        // one of the parts of a job submitted in several (see submit()),
+        // parts run concurrently and must not share mutable state
+        virtual void run(unsigned) { run(); }
+
+        bool finished();
+        void wait();
+
+        virtual ~Job() { }
+    };
+
+    // the job is finished once its parts have run, each on any worker
+    void submit(std::shared_ptr<Job>, unsigned parts = 1);
+
+    // waiter is woken up whenever a job completes
+    CryptoWorkers(unsigned threads, Waiter* waiter);
+
+    // completes the queued jobs
+    ~CryptoWorkers();
+
+    unsigned size() const;
+
+    // size of the pool shared by the instances created from now on (0: none,
+    // each one starts its own threads). Those created earlier keep theirs
+    static void setsharedthreads(unsigned threads);
+    static unsigned sharedthreads();
+
+private:
+    Waiter* mWaiter;
+    std::shared_ptr<Pool> mPool;
+
+    // jobs submitted and not finished yet
+    std::mutex mPendingMutex;
+    std::condition_variable mPendingDone;
+    unsigned mPending = 0;
+
+    void jobdone();
+
+    static std::mutex sSharedMutex;
+    static std::shared_ptr<Pool> sShared;
+};
+
+// encryption of the data of an upload request (HttpReqUL::prepareasync), owned
+// by the job so it doesn't depend on the request. The request is split in parts
+// of whole chunks, so that several workers can encrypt it at the same time
+struct MEGA_API EncryptChunksJob : public CryptoWorkers::Job
+{
+    struct Part
+    {
+        m_off_t pos;
+        m_off_t npos;
+        chunkmac_map macs;
+        byte crc[EncryptByChunks::CRCSIZE];
+    };
+
+    byte key[SymmCipher::KEYLENGTH];
+    uint64_t ctriv;
+    m_off_t pos;
+    m_off_t npos;
+    string data;
+    vector<Part> parts;
+
+    // splits [pos, npos) in up to maxparts parts of similar size
+    void split(unsigned maxparts);
+
+    // MACs of all the parts, in chunk order, and the URL suffix with the CRC
+    void result(chunkmac_map* macs, string* urlsuffix);
+
+    void run() override;
+    void run(unsigned part) override;
+};
+
 // file chunk I/O
 struct MEGA_API HttpReqXfer : public HttpReq
 {
@@ -389,6 +674,14 @@ struct MEGA_API HttpReqUL : public HttpReqXfer
 {
     void prepare(const char*, SymmCipher*, chunkmac_map*, uint64_t, m_off_t, m_off_t);
 
+    // as prepare(), but encrypting on a worker of the pool: the request is
+    // ready to post once encrypted() returns true
+    void prepareasync(CryptoWorkers*, const char*, SymmCipher*, uint64_t, m_off_t, m_off_t);
+    bool encrypted(chunkmac_map*);
+
+    std::shared_ptr<EncryptChunksJob> encryptjob;
+    string encrypturl;
+
     m_off_t transferred(MegaClient*);
 
     ~HttpReqUL() { }
@@ -411,6 +704,63 @@ struct MEGA_API HttpReqGetFA : public HttpReq
 {
     ~HttpReqGetFA() { }
 };
+
+// hands the chunk requests of transfers over to the app, which has them done
+// by the background transfer service of the OS (NSURLSession background
+// sessions, WorkManager...), so they go on while the app is suspended. The
+// encrypted chunks of uploads are written to files first, and downloads are
+// written to files by the OS, read back once the app reports them finished
+struct MEGA_API BackgroundHttpIO : public HttpIO
+{
+    struct Handler
+    {
+        // upload the file at path to url / download url to the file at path
+        // (false if the request can't be started)
+        virtual bool start(uint64_t id, bool upload, const string& url, const string& path) = 0;
+        virtual void cancel(uint64_t id) = 0;
+        virtual ~Handler() { }
+    };
+
+    // a request finished with an HTTP status (0 if it failed without one) and,
+    // for uploads, the response body. false if the request is unknown: cancelled
+    // meanwhile, or started by a previous process, whose transfers resume from
+    // the chunks they had completed
+    bool finished(uint64_t id, int httpstatus, const string& response);
+
+    void post(HttpReq*, const char* = NULL, unsigned = 0) override;
+    void cancel(HttpReq*) override;
+    m_off_t postpos(void*) override;
+    bool doio() override;
+    void addevents(Waiter*, int) override;
+    void setuseragent(string*) override;
+    void setproxy(Proxy*) override;
+
+    // the files of the requests are kept in folder (a local path), where the
+    // ones left by a previous process are removed
+    BackgroundHttpIO(Handler*, struct FileSystemAccess*, const string& folder);
+    ~BackgroundHttpIO();
+
+private:
+    struct Request
+    {
+        uint64_t id;
+        HttpReq* req;
+        bool upload;
+        string localpath;
+    };
+
+    Handler* handler;
+    struct FileSystemAccess* fsaccess;
+    string folder;
+    uint64_t nextid;
+
+    // by id, referred to by the httpiohandle of the HttpReq
+    std::map<uint64_t, Request> requests;
+
+    static const char* const FILEPREFIX;
+
+    void finish(std::map<uint64_t, Request>::iterator);
+};
 } // namespace
 
 #endif
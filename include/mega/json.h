@@ -60,6 +60,17 @@ struct MEGA_API JSON
 
     bool storeobject(string* = NULL);
 
+    // same, copying the value into the arena; NULL if there is none
+    const char* storeobject(TransientArena&);
+
+    // end of the complete object or array starting at ptr, or NULL if it
+    // isn't complete before end (for partially received data)
+    static const char* objectend(const char* ptr, const char* end);
+
+    // same for any value inside an array or object: scalars are only known
+    // to be complete once the following separator has been received
+    static const char* valueend(const char* ptr, const char* end);
+
     static void unescape(string*);
 
     /**
@@ -75,6 +86,9 @@ struct MEGA_API JSON
     inline int      getint32()  { return int(getint()); }
     inline unsigned getuint32() { return unsigned(getint()); }
     inline bool     getbool()   { return bool(getint()); }
+
+private:
+    bool skipobject(const char** begin, size_t* len);
 };
 
 } // namespace
@@ -86,17 +86,29 @@
 
     In performance mode, only outputting to a logger assigned through `setOutputClass` is supported.
     Output streams are not supported.
+
+    5) Asynchronous mode can be enabled at runtime (outside of performance mode):
+
+    SimpleLogger::setAsync(true);
+
+    Each thread then appends its messages to a ring buffer of its own, without locking nor
+    allocating, and a background thread formats them and passes them to the logger and the
+    output streams, in order. Numbers and pointers are only formatted by that thread, strings
+    are copied. Messages that don't fit in the buffer of their thread are dropped, and their
+    count is logged as a warning. Stream manipulators have no effect in this mode.
 */
 #pragma once
 
 #include <array>
 #include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 // define MEGA_QT_LOGGING to support QString
@@ -130,16 +142,125 @@ typedef std::vector<std::ostream *> OutputStreams;
 
 class OutputMap : public std::array<OutputStreams, unsigned(logMax)+1> {};
 
+#ifndef ENABLE_LOG_PERFORMANCE
+struct AsyncLogRing;
+
+// a message being appended to the ring buffer of the current thread, in asynchronous mode
+class AsyncLogRecord
+{
+public:
+    // types of the arguments, formatted by the flusher thread
+    enum Tag : unsigned char { STRING, CHAR, SIGNED, UNSIGNED, DOUBLE, POINTER };
+
+    // false if the message is to be logged synchronously
+    bool begin(int level, const char* filename, int line);
+    void commit();
+
+    void add(Tag tag, const void* data, size_t len);
+
+private:
+    AsyncLogRing* mRing = nullptr;
+    uint64_t mStart = 0;
+    uint64_t mPos = 0;
+    bool mOverflow = false;
+
+    void write(const void* data, size_t len);
+};
+#endif
+
 class SimpleLogger
 {
     enum LogLevel level;
 
 #ifndef ENABLE_LOG_PERFORMANCE
-    std::ostringstream ostr;
+    // the message is formatted into ostr (constructed in place) in synchronous
+    // mode, or its arguments are appended to mRecord in asynchronous mode
+    typename std::aligned_storage<sizeof(std::ostringstream), alignof(std::ostringstream)>::type ostrStorage;
+    std::ostringstream* ostr = nullptr;
+    AsyncLogRecord mRecord;
     std::string t;
     std::string fname;
 
-    std::string getTime();
+    static std::string getTime();
+
+    static std::atomic<bool> async;
+
+    void logAsync(const char* value)
+    {
+        mRecord.add(AsyncLogRecord::STRING, value, std::strlen(value));
+    }
+
+    void logAsync(const std::string& value)
+    {
+        mRecord.add(AsyncLogRecord::STRING, value.data(), value.size());
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type
+    logAsync(const T value)
+    {
+        if (std::is_floating_point<T>::value)
+        {
+            double d = double(value);
+            mRecord.add(AsyncLogRecord::DOUBLE, &d, sizeof d);
+        }
+        else if (isCharacter<T>::value)
+        {
+            char c = char(value);
+            mRecord.add(AsyncLogRecord::CHAR, &c, sizeof c);
+        }
+        else if (std::is_signed<T>::value)
+        {
+            int64_t i = int64_t(value);
+            mRecord.add(AsyncLogRecord::SIGNED, &i, sizeof i);
+        }
+        else
+        {
+            uint64_t u = uint64_t(value);
+            mRecord.add(AsyncLogRecord::UNSIGNED, &u, sizeof u);
+        }
+    }
+
+    template<typename T>
+    struct isCharacter : std::integral_constant<bool, std::is_same<typename std::remove_cv<T>::type, char>::value
+                                                    || std::is_same<typename std::remove_cv<T>::type, signed char>::value
+                                                    || std::is_same<typename std::remove_cv<T>::type, unsigned char>::value> {};
+
+    template<typename T>
+    typename std::enable_if<!std::is_function<T>::value && !isCharacter<T>::value>::type
+    logAsync(T* value)
+    {
+        const void* p = value;
+        mRecord.add(AsyncLogRecord::POINTER, &p, sizeof p);
+    }
+
+    // anything else is formatted right away
+    template<typename T>
+    typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_pointer<T>::value>::type
+    logAsync(const T& value)
+    {
+        logFormatted(value);
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_function<T>::value
+                            || (isCharacter<T>::value && !std::is_same<typename std::remove_cv<T>::type, char>::value)>::type
+    logAsync(T* value)
+    {
+        logFormatted(value);
+    }
+
+    template<typename T>
+    void logFormatted(const T& value)
+    {
+        std::ostringstream& s = formatStream();
+        s.str(std::string());
+        s.clear();
+        s << value;
+        logAsync(s.str());
+    }
+
+    static std::ostringstream& formatStream();
 
     // logging can occur from multiple threads, so we need to protect the lists of loggers to send to
     // though the loggers themselves are presumed to be owned elsewhere, and the pointers must remain valid
@@ -293,6 +414,13 @@ public:
         logValue(line);
         copyToBuffer(" ", 1);
 #else
+        if (async.load(std::memory_order_relaxed) && mRecord.begin(ll, filename, line))
+        {
+            return;
+        }
+
+        ostr = new (&ostrStorage) std::ostringstream;
+
         if (!logger)
         {
             return;
@@ -314,20 +442,14 @@ public:
 #ifdef ENABLE_LOG_PERFORMANCE
         outputBuffer();
 #else
-        OutputStreams::iterator iter;
-        OutputStreams vec;
-
-        if (logger)
-            logger->log(t.c_str(), level, fname.c_str(), ostr.str().c_str());
-
-        ostr << std::endl;
-
-        vec = getOutput(level);
-
-        for (iter = vec.begin(); iter != vec.end(); iter++)
+        if (!ostr)
         {
-            **iter << ostr.str();
+            mRecord.commit();
+            return;
         }
+
+        output(t.c_str(), level, fname.c_str(), ostr->str());
+        ostr->~basic_ostringstream();
 #endif
     }
 
@@ -359,13 +481,18 @@ public:
             copyToBuffer("(NULL)", 6);
         }
 #else
-        if (obj != NULL)
+        if (obj == NULL)
+        {
+            return *this << "(NULL)";
+        }
+
+        if (ostr)
         {
-            ostr << obj;
+            *ostr << obj;
         }
         else
         {
-            ostr << "(NULL)";
+            logAsync(obj);
         }
 #endif
         return *this;
@@ -377,7 +504,14 @@ public:
 #ifdef ENABLE_LOG_PERFORMANCE
         logValue(obj);
 #else
-        ostr << obj;
+        if (ostr)
+        {
+            *ostr << obj;
+        }
+        else
+        {
+            logAsync(obj);
+        }
 #endif
         return *this;
     }
@@ -388,7 +522,14 @@ public:
 #ifdef ENABLE_LOG_PERFORMANCE
         logValue(obj);
 #else
-        ostr << obj;
+        if (ostr)
+        {
+            *ostr << obj;
+        }
+        else
+        {
+            logAsync(obj);
+        }
 #endif
         return *this;
     }
@@ -399,7 +540,7 @@ public:
 #ifdef ENABLE_LOG_PERFORMANCE
         logValue(s.toUtf8().constData());
 #else
-        ostr << s.toUtf8().constData();
+        *this << s.toUtf8().constData();
 #endif
         return *this;
     }
@@ -425,7 +566,26 @@ public:
     static void setAllOutputs(std::ostream *os);
 
     // Synchronizes all registered stream buffers with their controlled output sequence
+    // (after passing on the messages pending in asynchronous mode)
     static void flush();
+
+    // pass a formatted message to the logger and the output streams of its level
+    static void output(const char* time, int loglevel, const char* source, const std::string& message);
+
+    // log through per-thread ring buffers of bufferSize bytes (for the threads that log
+    // after the call) and a background thread, see 5) above; disabling passes on the
+    // pending messages
+    static void setAsync(bool enable, size_t bufferSize = DEFAULT_ASYNC_BUFFER_SIZE);
+
+    static bool isAsync()
+    {
+        return async.load(std::memory_order_relaxed);
+    }
+
+    // messages dropped so far in asynchronous mode because their thread's buffer was full
+    static uint64_t asyncDropped();
+
+    static const size_t DEFAULT_ASYNC_BUFFER_SIZE = 1 << 18;
 #endif
 };
 
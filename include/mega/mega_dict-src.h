@@ -2438,7 +2438,7 @@ static const unsigned int DictNodes[36480] =
     1309874642,1309933940,37945813,  1309972947,795197652, 649019428, 1310054868,1310130239,11026461,  1310153173,1310195748,458622538, 1310212656,1310262289,1310294074,
     646791252, 181682260, 1310310835,1310349782,1310392375,1310408721,3211266,   4849728,   1310431703,1310523426,1310546392,4866112,   1310572578,1310595472,51779984
 };
-static unsigned char WordEndBits[4560] =
+static const unsigned char WordEndBits[4560] =
 {
     0,  0,  32, 0,  1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  4,  0,  0,  4,  0,  99, 0,  14, 32, 20, 0,  0,  0,  40, 213,0,  158,170,160,89, 135,15, 2,  8,  128,16, 
     1,  152,4,  0,  36, 37, 96, 34, 17, 33, 0,  0,  0,  0,  0,  80, 1,  0,  192,64, 129,136,67, 5,  84, 168,144,36, 0,  130,0,  225,32, 1,  8,  0,  0,  0,  0,  4,  4,  
@@ -113,6 +113,12 @@ struct MEGA_API MegaApp
     // node fetch result
     virtual void fetchnodes_result(error) { }
 
+    // children of a folder of a lazy folder link fetched
+    virtual void fetchfolder_result(handle, error) { }
+
+    // nodes loaded from the local cache, before catching up with the changes made meanwhile
+    virtual void nodes_cached() { }
+
     // nodes now (nearly) current
     virtual void nodes_current() { }
 
@@ -125,6 +131,9 @@ struct MEGA_API MegaApp
     // node addition has failed
     virtual void putnodes_result(error, targettype_t, NewNode*) { }
 
+    // result of one of the uploads put in a batch, restag is the upload's tag
+    virtual void putnodes_upload_result(error, handle) { }
+
     // share update result
     virtual void share_result(error) { }
     virtual void share_result(int, error) { }
@@ -165,6 +174,9 @@ struct MEGA_API MegaApp
     virtual void getua_result(error) { }
     virtual void getua_result(byte*, unsigned, attr_t) { }
     virtual void getua_result(TLVstore *, attr_t) { }
+
+    // attribute of several users retrieved and cached
+    virtual void getuas_result(error) { }
 #ifdef DEBUG
     virtual void delua_result(error) { }
 #endif
@@ -271,6 +283,10 @@ struct MEGA_API MegaApp
     virtual void transfer_added(Transfer*) { }
     virtual void transfer_removed(Transfer*) { }
     virtual void transfer_prepare(Transfer*) { }
+
+    // class of a transfer for the fair transfer schedule
+    // (by default, each transfer is a class on its own)
+    virtual int transfer_class(Transfer*);
     virtual void transfer_failed(Transfer*, error, dstime = 0) { }
     virtual void transfer_update(Transfer*) { }
     virtual void transfer_complete(Transfer*) { }
@@ -296,6 +312,9 @@ struct MEGA_API MegaApp
     virtual void syncupdate_remote_rename(Sync*, Node*, const char*) { }
     virtual void syncupdate_treestate(LocalNode*) { }
 
+    // LocalNode cache flush progress (records written so far, records still queued)
+    virtual void syncupdate_cachednodes(Sync*, size_t, size_t) { }
+
     // sync filename filter
     virtual bool sync_syncable(Sync*, const char*, string*, Node*)
     {
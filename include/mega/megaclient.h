@@ -22,6 +22,8 @@
 #ifndef MEGACLIENT_H
 #define MEGACLIENT_H 1
 
+#include <atomic>
+
 #include "json.h"
 #include "db.h"
 #include "gfx.h"
@@ -33,6 +35,7 @@
 #include "account.h"
 #include "backofftimer.h"
 #include "http.h"
+#include "fileattributefetch.h"
 #include "pubkeyaction.h"
 #include "pendingcontactrequest.h"
 #include "mediafileattribute.h"
@@ -176,6 +179,90 @@ public:
      * The resumption of transfers is done after the filesystem is current
      */
     dstime timeToTransfersResumed;
+
+    /////////////////////////////////////////////
+    // Time spent in processing stages (ds)    //
+    /////////////////////////////////////////////
+
+    /**
+     * @brief Time spent parsing the nodes of the fetchnodes response
+     */
+    dstime timeReadNodes;
+
+    /**
+     * @brief Time spent decrypting node keys and attributes after the fetchnodes response
+     */
+    dstime timeApplyKeys;
+
+    /**
+     * @brief Number of threads used to decrypt node keys and attributes
+     */
+    int decryptThreads;
+};
+
+// cooperative time slicing of MegaClient::exec(): the subsystems that can run
+// for long get a time budget per iteration and, once it's spent, carry the rest
+// of their work over to the next one, so that none of them starves the others
+struct MEGA_API ExecScheduler
+{
+    // action packets, transfer slots, direct reads, syncdown() of changed
+    // folders and state cache commits (the last two aren't split, only timed)
+    enum subsystem_t { SC, TRANSFERS, DIRECTREADS, SYNC, DBCOMMIT, SUBSYSTEMS };
+
+    // time budget of each subsystem per iteration (0: unbounded)
+    std::chrono::milliseconds budgets[SUBSYSTEMS];
+
+    // time spent by each subsystem per iteration, and iterations that it
+    // ended with work left for the next one
+    LatencyHistogram latencies[SUBSYSTEMS];
+    uint64_t yields[SUBSYSTEMS];
+
+    // waits skipped by preparewait(): because of overdue events / because
+    // of work carried over
+    uint64_t immediatewakeups;
+    uint64_t carriedwakeups;
+
+    void begin(subsystem_t);
+    bool expired(subsystem_t) const;
+    void end(subsystem_t, bool yielded = false);
+
+    void tojson(std::ostream&) const;
+    void reset();
+
+    ExecScheduler();
+
+private:
+    std::chrono::steady_clock::time_point starts[SUBSYSTEMS];
+};
+
+// resources used while the device runs low on battery or gets hot, from the
+// state reported by the app: the low power preset caps the connections per
+// transfer, the gfx workers and the sync scan threads, and spaces out the
+// state cache commits
+struct MEGA_API PowerPolicy
+{
+    enum policy_t { AUTO, UNRESTRICTED, LOWPOWER };
+    enum power_t { CHARGING, BATTERY, BATTERYLOW, POWERSAVER };
+    enum thermal_t { NOMINAL, FAIR, SERIOUS, CRITICAL };
+
+    policy_t policy = AUTO;
+    power_t power = CHARGING;
+    thermal_t thermal = NOMINAL;
+
+    static const int LOWPOWERCONNECTIONS = 1;
+    static const unsigned LOWPOWERGFXWORKERS = 1;
+    static const unsigned LOWPOWERSCANTHREADS = 2;
+
+    // minimum time between state cache commits (ds)
+    static const dstime LOWPOWERCOMMITINTERVAL = 300;
+
+    // AUTO picks the low power preset on a low battery, in power saving mode
+    // and from the SERIOUS thermal state
+    bool lowpower() const;
+
+    // changes of preset, and state cache commits postponed by the low power one
+    uint64_t switches = 0;
+    uint64_t deferredcommits = 0;
 };
 
 class MEGA_API MegaClient
@@ -294,6 +381,10 @@ public:
     // session login: binary session, bytecount
     void login(const byte*, int);
 
+    // read the local cache of a resumed session while its login request is in
+    // flight, so that fetchnodes() only has to decrypt and decode the records
+    bool pipelinedstartup = false;
+
     // check password
     error validatepwd(const byte *);
 
@@ -353,6 +444,18 @@ public:
     // load all trees: nodes, shares, contacts
     void fetchnodes(bool nocache = false);
 
+    // folder links can be loaded one folder at a time: fetchnodes() gets the
+    // root and its children only (without local cache), fetchfolder() the
+    // children of any other folder once they are needed
+    bool lazyfolderlinks = false;
+    bool lazyfolderlink();
+
+    // folders whose children have been fetched
+    handle_set fetchedfolders;
+
+    void fetchfolder(handle);
+    bool folderfetched(handle);
+
     // fetchnodes stats
     FetchNodesStats fnstats;
 
@@ -392,6 +495,20 @@ public:
     // check if the available bandwidth quota is enough to transfer an amount of bytes
     void querytransferquota(m_off_t size);
 
+    // transfer quota reported by the last account details that included it, and the
+    // bytes downloaded since then (downloads that can't finish within it are held back
+    // while others are in progress, see TransferList::nexttransfer)
+    m_off_t transferquotamax = 0;
+    m_off_t transferquotaused = 0;
+    m_off_t transferquotadownloaded = 0;
+    void settransferquota(m_off_t max, m_off_t used);
+
+    // estimated transfer quota left in bytes, -1 if unknown
+    m_off_t transferquotaleft() const;
+
+    // seconds until the transfer quota runs out at the current download speed, -1 if unknown
+    m_time_t transferquotatimeleft() const;
+
     // update node attributes
     error setattr(Node*, const char* prevattr = NULL);
 
@@ -424,12 +541,19 @@ public:
     // set max connections per transfer
     void setmaxconnections(direction_t, int);
 
+    // requeue the active transfers of a direction, to start them with new settings
+    void restartslots(direction_t);
+
     // enqueue/abort direct read
     void pread(Node*, m_off_t, m_off_t, void*);
     void pread(handle, SymmCipher* key, int64_t, m_off_t, m_off_t, void*, bool = false,  const char* = NULL, const char* = NULL, const char* = NULL);
     void preadabort(Node*, m_off_t = -1, m_off_t = -1);
     void preadabort(handle, m_off_t = -1, m_off_t = -1);
 
+    // get the tempurls of a file ahead of its reads (and, with readahead, its first
+    // data into the DirectReadCache), kept for DirectReadSlot::TEMPURL_TIMEOUT_DS
+    void prefetchread(Node*, bool readahead);
+
     // pause flags
     bool xferpaused[2];
 
@@ -439,6 +563,18 @@ public:
 
     // indicates whether all startup syncs have been fully scanned
     bool syncsup;
+
+    // workers listing the folders and fingerprinting the files of the syncs
+    // (see Sync::prefetch and Sync::fingerprintahead), created when first needed
+    std::unique_ptr<CryptoWorkers> syncscanworkers;
+    static const unsigned SYNCSCANTHREADS = 8;
+
+    // threads of syncscanworkers outside of the low power mode
+    unsigned syncscanthreads = SYNCSCANTHREADS;
+
+    // milliseconds a sync's notification queue is processed for before control
+    // returns to the application (0: after every file)
+    unsigned syncscanbudget = 20;
 #endif
 
     // if set, symlinks will be followed except in recursive deletions
@@ -448,6 +584,133 @@ public:
     // number of parallel connections per transfer (PUT/GET)
     unsigned char connections[2];
 
+    // connections of the new transfer slots of a direction, after the power policy
+    int transferconnections(direction_t) const;
+
+    // resources used as the battery and the temperature of the device allow
+    PowerPolicy powerpolicy;
+    void setpowerpolicy(PowerPolicy::policy_t, PowerPolicy::power_t, PowerPolicy::thermal_t);
+
+    // tune the request size and the connections of each transfer from its speed
+    bool adaptivetransfers = false;
+
+    // duplicate the download requests that are late compared with their peers
+    bool hedgedownloads = false;
+
+    // ranges read ahead per upload slot (at most one per connection), with async file access
+    unsigned uploadreadahead = 0;
+
+    // fingerprints of local files kept next to the transfer cache (see setfingerprintcache)
+    std::shared_ptr<FingerprintCache> fingerprintcache;
+    bool usefingerprintcache = false;
+    string fingerprintcachename;
+
+    // keep the fingerprints of the files uploaded or synced, so unchanged files
+    // aren't read again; takes effect when the transfer cache is opened
+    void setfingerprintcache(bool enable);
+
+    // open connections to storage hosts before the transfers need them
+    bool prewarmconnections = false;
+
+    // storage hosts (scheme://host:port) used recently, most recent first
+    std::deque<string> recentstoragehosts[2];
+    static const size_t MAXRECENTSTORAGEHOSTS = 4;
+
+    // queued transfers whose known storage hosts are warmed up
+    static const int PREWARMLOOKAHEAD = 2;
+
+    // remember the storage hosts of the tempurls of a transfer
+    void notestoragehosts(direction_t, const std::vector<string>& tempurls);
+
+    // request the tempurls of the next PREFETCHURLS queued transfers before
+    // they get a slot, and drop those not used within PREFETCHEDURLTTL_DS
+    bool prefetchurls = false;
+    static const int PREFETCHURLS = 8;
+    static const dstime PREFETCHEDURLTTL_DS = 3000;
+    void prefetchtransferurls(direction_t);
+
+    // open connections to the recent storage hosts and to those of the next queued transfers
+    void prewarmstoragehosts(direction_t);
+
+    // TLS sessions kept next to the transfer cache (see settlssessioncache)
+    DbTable* tlstable = NULL;
+    bool usetlssessioncache = false;
+    string tlssessioncachename;
+    dstime tlssessionssaved = 0;
+
+    // interval between writes of the TLS sessions to the table (ds)
+    static const dstime TLSSESSIONSAVEINTERVAL_DS = 600;
+
+    // keep the TLS sessions in the local cache, so that they are resumed after
+    // a restart; takes effect when the transfer cache is opened
+    void settlssessioncache(bool enable);
+
+    // open the table of TLS sessions and import them into the network layer
+    void opentlssessions();
+
+    // write the TLS sessions of the network layer to the table
+    void savetlssessions();
+
+    // network statistics by direction and host, and retries of the
+    // client's backoff timers, as JSON
+    string networkstats(bool reset);
+
+    // approximate memory held by the main structures of the client, by
+    // subsystem, as JSON; the intermediate layer can add its own entries
+    struct MemoryUsageEntry
+    {
+        const char* name;
+        size_t count;
+        size_t bytes;
+    };
+    string memoryusage(const vector<MemoryUsageEntry>& extra = vector<MemoryUsageEntry>());
+
+    // transfer, request queue, sync, network and code latency metrics in the
+    // Prometheus text exposition format (version 0.0.4)
+    void metrics(std::ostream&);
+
+    // how queued transfers are picked (see TransferList::nexttransfer)
+    transferschedule_t transferschedule = TRANSFERSCHEDULE_PRIORITY;
+
+    // weight of each transfer class (MegaApp::transfer_class), 1 if missing
+    map<int, unsigned> transferclassweights;
+
+    // bandwidth limits by File::tag of a transfer and by transfer class, applied
+    // by TransferSlot::doio on top of the global limits of the HttpIO
+    map<int, TransferRateLimit> transferratelimits;
+
+    // workers encrypting uploads and decrypting downloads off the SDK thread
+    // (none: done in TransferSlot::doio)
+    std::unique_ptr<CryptoWorkers> cryptoworkers;
+    void setcryptothreads(unsigned threads);
+
+    // put completed uploads into their target folder in batches (one putnodes
+    // for up to MAX_NEWNODES files, or for those completed within PUTNODES_BATCH_DS)
+    bool batchputnodes = false;
+    struct PutNodesBatch
+    {
+        vector<NewNode*> nodes;
+        vector<int> tags;
+        dstime since;
+    };
+    map<handle, PutNodesBatch> putnodesbatches;
+    static const dstime PUTNODES_BATCH_DS;
+    void batchputnode(handle target, NewNode*, int tag);
+    void flushputnodes(bool force);
+
+    // make completed downloads durable in batches: those completed within
+    // durabilityds are flushed together (FileSystemAccess::flushlocal) on a
+    // thread of their own, while the next batch is gathered
+    enum { DURABILITY_NONE = 0, DURABILITY_FILES = 1, DURABILITY_FILESYSTEM = 2 };
+    int downloaddurability = DURABILITY_NONE;
+    dstime durabilityds = 10;
+    vector<string> durablefiles;
+    dstime durablesince = 0;
+    std::thread durablethread;
+    std::atomic<bool> durablebusy{false};
+    void queuedurable(const string& localname);
+    void flushdurable(bool force);
+
     // generate & return next upload handle
     handle uploadhandle(int);
 
@@ -479,6 +742,9 @@ public:
     // queue a user attribute retrieval (for non-contacts)
     void getua(const char* email_handle, const attr_t at = ATTR_UNKNOWN, const char *ph = NULL, int ctag = -1);
 
+    // queue the retrieval of an attribute of several users, skipping the valid cached values
+    void getuas(const vector<User*>& users, attr_t at, int ctag = -1);
+
     // retrieve the email address of a user
     void getUserEmail(const char *uid);
 
@@ -702,6 +968,23 @@ public:
     // get max upload speed
     m_off_t getmaxuploadspeed();
 
+    // enable/disable HTTP/2 multiplexing
+    bool sethttp2(bool enable);
+
+    // get HTTP/2 multiplexing state
+    bool gethttp2();
+
+    // tune the sockets of a direction (API, GET, PUT)
+    bool setsocketoptions(direction_t d, const SocketOptions& options);
+
+    // limit the cached and open connections of a direction (API, GET, PUT)
+    bool setconnectioncache(direction_t d, const ConnectionCacheOptions& options);
+
+    // drive the network I/O on a dedicated thread during busy sections
+    // (action packets, local cache writes)
+    bool setnetworkthread(bool enable);
+    bool getnetworkthread();
+
     // get the handle of the older version for a NewNode
     handle getovhandle(Node *parent, string *name);
 
@@ -777,8 +1060,12 @@ public:
     // backoff for the expiration of cached user data
     BackoffTimer btugexpiration;
 
+    // trigger times of the backoff timers of the transfers
+    TimerWheel transferretries;
+
 private:
     BackoffTimer btcs;
+    BackoffTimer btpipelinedcs;
     BackoffTimer btbadhost;
     BackoffTimer btworkinglock;
 
@@ -801,6 +1088,9 @@ private:
     // unique request ID
     char reqid[10];
 
+    // move on to the next request ID, for a batch the server hasn't seen
+    void nextreqid();
+
     // auth URI component for API requests
     string auth;
 
@@ -823,6 +1113,12 @@ private:
     BackoffTimer btpfa;
     bool faretrying;
 
+    // file attributes stored and failed, and uploads halted by a full queue
+    // (reported with the network statistics)
+    uint64_t fauploaded;
+    uint64_t fafailed;
+    uint64_t fahalts;
+
     // next internal upload handle
     handle nextuh;
 
@@ -835,14 +1131,14 @@ private:
     // maximum number of concurrent transfers (uploads or downloads)
     static const unsigned MAXTRANSFERS;
 
-    // maximum number of queued putfa before halting the upload queue
-    static const int MAXQUEUEDFA;
+    // maximum size of the queued putfa before halting the upload queue
+    static const m_off_t MAXQUEUEDFABYTES;
 
     // maximum number of concurrent putfa
     static const int MAXPUTFA;
 
     // update time at which next deferred transfer retry kicks in
-    void nexttransferretry(direction_t d, dstime*);
+    void nexttransferretry(dstime*);
 
     // a TransferSlot chunk failed
     bool chunkfailed;
@@ -850,6 +1146,21 @@ private:
     // fetch state serialize from local cache
     bool fetchsc(DbTable*);
 
+    // the encrypted records of the cache of a resumed session, read once its
+    // first batch is sent (see pipelinedstartup); cachepreloaded: all of them
+    bool cachepreloadpending = false;
+    bool cachepreloaded = false;
+    std::map<uint32_t, string> preloadedsc;
+    void preloadsc();
+    bool getscrecord(DbTable*, uint32_t, string*);
+    bool nextscrecord(DbTable*, uint32_t*, string*);
+
+    // instantiate one state cache record
+    bool loadscrecord(uint32_t id, string* data, node_vector* dp);
+
+    // bulk-load the state cache from its snapshot (*loaded is false if there is no usable one)
+    bool loadsnapshot(DbTable*, node_vector* dp, bool* loaded);
+
     // close the local transfer cache
     void closetc(bool remove = false);
 
@@ -932,6 +1243,9 @@ public:
     // HTTP access
     HttpIO* httpio;
 
+    // chunk requests of transfers go through it when set, while the app runs in the background
+    HttpIO* backgroundhttpio = nullptr;
+
     // directory change notification
     struct FileSystemAccess* fsaccess;
 
@@ -940,6 +1254,9 @@ public:
 
     // enable / disable the gfx layer
     bool gfxdisabled;
+
+    // the extra copies of a download are hard links to the first one
+    bool hardlinkdownloads = false;
     
     // DB access
     DbAccess* dbaccess;
@@ -947,9 +1264,48 @@ public:
     // state cache table for logged in user
     DbTable* sctable;
 
+    // preset compression dictionaries of the node records (see DbTable::setdictionary)
+    static void setrecorddictionaries(DbTable*);
+
     // there is data to commit to the database when possible
     bool pendingsccommit;
 
+    // write the state cache through an AsyncDbTable (takes effect when it's next opened)
+    bool asyncdbwrites = false;
+
+    // while a batch of action packets is applied, the next one is already
+    // requested from the sequence number found at the end of the current one
+    bool scprefetch = false;
+    HttpReq* pendingscprefetch = nullptr;
+    string scprefetchsn;
+
+    // send the sc request that follows the current response, if there is one
+    void prefetchsc();
+
+    // drop the prefetched sc request
+    void cancelscprefetch();
+
+    // newest scsn whose commit is known to have reached storage; with asynchronous
+    // writes it trails cachedscsn until the writer thread completes the commit
+    handle durablescsn = UNDEF;
+
+    // a commit of committingscsn is in flight (asynchronous writes only)
+    handle committingscsn = UNDEF;
+    bool dbcommitpending = false;
+    bool dbcommitnotify = false;
+
+    // commit the current state cache transaction and start a new one
+    void commitsc(bool notify);
+
+    // the commit at the end of a batch of action packets waits for
+    // PowerPolicy::LOWPOWERCOMMITINTERVAL since the previous one
+    dstime lastsccommit = 0;
+    bool deferredsccommit = false;
+    bool sccommitdeferred();
+
+    // report commits completed by the asynchronous writer
+    void checkdbcommit();
+
     // transfer cache table
     DbTable* tctable;
 
@@ -967,8 +1323,12 @@ public:
     // have we just completed fetching new nodes?  (ie, caught up on all the historic actionpackets since the fetchnodes)
     bool statecurrent;
 
-    // pending file attribute writes
+    // pending file attribute writes, and their size
     putfa_list queuedfa;
+    m_off_t queuedfabytes;
+
+    // send the queued file attributes, up to MAXPUTFA at a time
+    void dispatchfa();
 
     // current file attributes being sent
     putfa_list activefa;
@@ -977,21 +1337,47 @@ public:
     // reqs[r] is open for adding commands
     // reqs[r^1] is being processed on the API server
     HttpReq* pendingcs;
+    std::chrono::high_resolution_clock::time_point pendingcssent;
+
+    // pipelined batches of order-independent commands being processed on the API server
+    struct PipelinedCs
+    {
+        int channel;
+        HttpReq* req;
+        std::chrono::high_resolution_clock::time_point sent;
+    };
+    vector<PipelinedCs> pipelinedcs;
+
+    // process the responses to pipelined batches and send new ones
+    void execpipelinedcs();
+
+    // discard the pipelined batches in flight
+    void abortpipelinedcs();
 
     // pending HTTP requests
     pendinghttp_map pendinghttp;
 
     // record type indicator for sctable
-    enum { CACHEDSCSN, CACHEDNODE, CACHEDUSER, CACHEDLOCALNODE, CACHEDPCR, CACHEDTRANSFER, CACHEDFILE, CACHEDCHAT } sctablerectype;
+    enum { CACHEDSCSN, CACHEDNODE, CACHEDUSER, CACHEDLOCALNODE, CACHEDPCR, CACHEDTRANSFER, CACHEDFILE, CACHEDCHAT, CACHEDSNAPSHOT, CACHEDCHUNKMACS } sctablerectype;
 
     // open/create state cache database table
     void opensctable();
 
     // initialize/update state cache referenced sctable
     void initsc();
+    static const size_t INITSCBATCHRECORDS;
+    static const size_t INITSCBATCHBYTES;
     void updatesc();
     void finalizesc(bool);
 
+    // state cache snapshot maintenance, within the current sctable transaction
+    void notesnapshot(uint32_t dbid);
+    bool updatesnapshot();
+    bool writesnapshot();
+    bool writesnapshotheader();
+    bool putsnapshotrecord(uint32_t id, string* data);
+    void dropsnapshot();
+
     // flag to pause / resume the processing of action packets
     bool scpaused;
 
@@ -1002,6 +1388,10 @@ public:
     JSON jsonsc;
     bool insca;
 
+    // procsc() ran out of its time budget - the remaining action packets
+    // are processed in the next exec()
+    bool scyielded;
+
     // no two interrelated client instances should ever have the same sessionid
     char sessionid[10];
 
@@ -1033,9 +1423,23 @@ public:
     // upload waiting for file attributes
     handletransfer_map faputcompletion;    
 
-    // file attribute fetch channels
+    // file attribute fetch channels, FACHANNELS per cluster (the one of
+    // cluster c and index i is fafcs[c * FACHANNELS + i])
     fafc_map fafcs;
 
+    // concurrent fetch channels per cluster, and the fetches that a channel
+    // gets before the next one of the cluster is opened
+    static const int FACHANNELS = 4;
+    static const size_t FACHANNELFETCHES = 16;
+
+    // local cache of fetched file attributes (NULL if disabled)
+    std::unique_ptr<FileAttributeCache> facache;
+    std::deque<FileAttributeCacheHit> facachehits;
+
+    // keep up to maxsize bytes of fetched file attributes in a local folder
+    // (NULL or 0 to disable)
+    void setfacache(const string* localfolder, m_off_t maxsize);
+
     // generate attribute string based on the pending attributes for this upload
     void pendingattrstring(handle, string*);
 
@@ -1044,6 +1448,7 @@ public:
     dsdrn_map dsdrns;      // indicates the time at which DRNs should be retried 
     dr_list drq;           // DirectReads that are in DirectReadNodes which have fectched URLs
     drs_list drss;         // DirectReadSlot for each DR in drq, up to Max
+    DirectReadCache drcache;   // data delivered to DirectReads, by DirectReadNode handle
 
     // merge newly received share into nodes
     void mergenewshares(bool);
@@ -1076,15 +1481,109 @@ public:
     // next TransferSlot to doio() on
     transferslot_list::iterator slotit;
 
+    // the slots ran out of their time budget - the next exec() resumes at slotit
+    bool slotsyielded;
+
+    // time budgets and latencies of the subsystems run by exec()
+    ExecScheduler execscheduler;
+
+    // short-lived allocations of the current exec() iteration, released
+    // after its final notifypurge()
+    TransientArena transientarena;
+
     // FileFingerprint to node mapping
     Fingerprints mFingerprints;
 
+    // optional name index for searches
+    NodeNameIndex mNodeNameIndex;
+
+    // file nodes ordered by ctime, for getRecentNodes()
+    recentnode_map mRecentNodes;
+
+    // nodes with outshares, pending outshares and public links, to list them
+    // without walking the whole tree
+    handle_set mOutShareNodes;
+    handle_set mPendingShareNodes;
+    handle_set mPublicLinkNodes;
+
+    // add a node to the sets above or remove it, after its shares or link changed
+    void indexsharing(Node*);
+
+    // enable/disable the name index (built from the current tree when enabled)
+    void setnodenameindex(bool enable);
+
+    // load only the skeleton of nodes from the local cache and read the rest of
+    // each node from its record on first use
+    bool lazynodeloading = false;
+
+    // number of nodes still waiting for loadrecord()
+    size_t lazynodecount = 0;
+
+    // enable/disable lazy loading (disabling loads all pending nodes)
+    void setlazynodeloading(bool enable);
+
+    // load all pending lazy nodes, for code that needs the whole tree in memory
+    void loadlazynodes();
+
+    // load the pending lazy children of a folder, for code that reads all of them
+    void loadlazychildren(Node*);
+
+    // keep a snapshot of the state cache that fetchsc() can bulk-load: every cached
+    // user, node, pcr and chat packed into a few large records, taken at a consistent
+    // scsn, plus the dbids changed since then (read from their own records instead)
+    bool scsnapshots = false;
+
+    // enable/disable snapshots (disabling drops the current one)
+    void setscsnapshots(bool enable);
+
+    // dbids written or removed since the snapshot was taken
+    std::set<uint32_t> snapshotdelta;
+
+    // chunk records of the current snapshot (0 if there is none) and records in them
+    uint32_t snapshotchunks = 0;
+    size_t snapshotrecords = 0;
+
+    static const uint32_t SNAPSHOTVERSION = 1;
+    static const size_t SNAPSHOTCHUNKSIZE = 1 << 20;
+    static const size_t SNAPSHOTMINDELTA = 1024;
+
+    // on a full reload (eg. too many pending action packets), keep the cached
+    // records of the nodes that didn't change instead of rewriting the cache
+    bool reloadreconciliation = false;
+
+    // enable/disable the reconciliation of full reloads
+    void setreloadreconciliation(bool enable);
+
+    // cached records of the purged tree, by node handle, with a hash of their contents
+    struct ReloadRecord
+    {
+        uint32_t dbid;
+        size_t hash;
+    };
+    typedef map<handle, ReloadRecord> reloadrecord_map;
+    reloadrecord_map reloadrecords;
+
+    // other records of the purged state, rewritten by the reload
+    vector<uint32_t> reloaddbids;
+
+    // the records above match the state cache
+    bool reloadreconciling = false;
+
+    void keepreloadrecords();
+
     // send updates to app when the storage size changes
     int64_t mNotifiedSumSize = 0;
 
-    // asymmetric to symmetric key rewriting
+    // asymmetric to symmetric key rewriting, and foreign keys of nodes leaving an outbound share
     handle_vector nodekeyrewrite;
     handle_vector sharekeyrewrite;
+    static const size_t KEYREWRITEBATCH;
+    void sendkeyrewrites(bool all = false);
+
+    // nodes whose key was found under the share key of an outbound share (Node::foreignkey),
+    // by the handle of the share node, for rewriteforeignkeys(): the handles of nodes gone
+    // or rewritten since are dropped there
+    map<handle, handle_set> foreignkeynodes;
 
     static const char* const EXPORTEDLINK;
 
@@ -1100,6 +1599,13 @@ public:
     // total number of Node objects
     long long totalNodes;
 
+    // source of Node::childrengeneration stamps (never reused)
+    uint64_t nodegeneration = 0;
+
+    // bumped whenever a cached path may have become stale: a folder with children
+    // is renamed or moved, or the email that prefixes the paths of an inshare changes
+    uint64_t pathgeneration = 1;
+
     // server-client request sequence number
     char scsn[12];
 
@@ -1137,16 +1643,55 @@ public:
 
 #ifdef USE_MEDIAINFO
     MediaFileInfo mediaFileInfo;
+
+    // extraction of the media attributes of transferred files off the SDK thread
+    // (see Transfer::addAnyMissingMediaFileAttributes), the workers are created when first needed
+    struct MediaJob : public CryptoWorkers::Job
+    {
+        FileSystemAccess* fsaccess;
+        string localpath;
+        string fingerprint;     // serialized, empty if not valid
+        bool upload;
+        handle h;               // upload handle or node handle
+        uint32_t fakey[4];
+        MediaProperties vp;
+
+        void run() override;
+    };
+    std::unique_ptr<CryptoWorkers> mediaworkers;
+    std::list<std::shared_ptr<MediaJob> > mediajobs;
+    static const unsigned MEDIATHREADS = 2;
+
+    // properties of the files extracted recently, by fingerprint: a file uploaded or
+    // downloaded again isn't read again (the oldest ones are evicted first)
+    map<string, MediaProperties> mediacache;
+    std::deque<string> mediacacheorder;
+    static const size_t MEDIACACHESIZE = 1000;
+
+    bool cachedmediaproperties(const FileFingerprint&, MediaProperties&);
+    void extractmediaproperties(const FileFingerprint&, string* localpath, bool upload, handle h, uint32_t fakey[4]);
+    void execmediajobs();
 #endif
 
     // write changed/added/deleted users to the DB cache and notify the
     // application
     void notifypurge();
 
+    // above this many removed nodes in one notification, the application is only
+    // told about the topmost ones, the roots of the subtrees removed
+    static const unsigned COALESCEDREMOVALS = 10000;
+
+    // nodes removed and detached by notifypurge(), whose memory is released up to
+    // PURGEBATCH at a time so that mass deletions don't stall a single exec()
+    std::deque<Node*> purgequeue;
+    static const unsigned PURGEBATCH = 10000;
+    void purgeremoved(size_t maxnodes = PURGEBATCH);
+
     // remove node subtree
     void deltree(handle);
 
-    Node* nodebyhandle(handle);
+    // pass load = false to look up lazy nodes without loading them
+    Node* nodebyhandle(handle, bool load = true);
     Node* nodebyfingerprint(FileFingerprint*);
     node_vector *nodesbyfingerprint(FileFingerprint* fingerprint);
     void nodesbyoriginalfingerprint(const char* fingerprint, Node* parent, node_vector *nv);
@@ -1173,9 +1718,19 @@ public:
     // minute of the last created folder in SyncDebris
     m_time_t syncdebrisminute;
 
+    // the last creation of SyncDebris folders failed (moves don't wait for the next one)
+    bool syncdebrisfailed;
+
+    // //bin/SyncDebris/yyyy-mm-dd folder last found, and its name
+    handle syncdebrisday;
+    string syncdebrisdayname;
+
     // activity flag
     bool syncactivity;
 
+    // a Sync::cachenodes() call stopped at its record limit and must be resumed
+    bool synccachepending;
+
     // syncops indicates that a sync-relevant tree update may be pending
     bool syncops;
 
@@ -1187,6 +1742,14 @@ public:
 
     bool syncuprequired;
 
+    // synced folders affected by remote changes: while no full syncdown() is
+    // required, only their subtrees are walked, and then synced up
+    localnode_set syncdowndirty;
+    localnode_set syncupdirty;
+
+    // more dirty folders than this are handled by a full syncdown()
+    static const size_t SYNCDOWNDIRTYMAX = 1000;
+
     // block local fs updates processing while locked ops are in progress
     bool syncfsopsfailed;
 
@@ -1217,6 +1780,9 @@ public:
     // maps local fsid to corresponding LocalNode*
     handlelocalnode_map fsidnode;
 
+    // maps (parent, name) to LocalNode*, mirrors children/schildren
+    localnode_index localnodeindex;
+
     // local nodes that need to be added remotely
     localnode_vector synccreate;
 
@@ -1246,6 +1812,18 @@ public:
     // start downloading/copy missing files, create missing directories
     bool syncdown(LocalNode*, string*, bool);
 
+    // mark the synced folders affected by a remote node change as dirty
+    void syncdownmark(Node*);
+
+    // syncdown() the subtrees of the dirty folders
+    bool syncdowndirtyfolders();
+
+    // syncup() the subtrees of the folders whose syncdown() was partial
+    bool syncupdirtyfolders(dstime*);
+
+    // the dirty folders not below another one of the set
+    static localnode_vector dirtyroots(const localnode_set&);
+
     // move nodes to //bin/SyncDebris/yyyy-mm-dd/ or unlink directly
     void movetosyncdebris(Node*, bool);
 
@@ -1286,6 +1864,10 @@ public:
     void defer(direction_t, int td, int = 0);
     void freeq(direction_t);
 
+    // set while all the nodes, local nodes or transfers are deleted: they don't
+    // unlink themselves from the indexes and from each other, which are dropped at once
+    bool tearingdown = false;
+
     dstime transferretrydelay();
 
     // client-server request double-buffering
@@ -1303,6 +1885,8 @@ public:
 
     // process object arrays by the API server
     int readnodes(JSON*, int, putsource_t = PUTNODES_APP, NewNode* = NULL, int = 0, int = 0);
+    int readnode(JSON*, int, putsource_t, NewNode*, int, int, node_vector&);
+    void linkdelayedparents(node_vector&);
 
     void readok(JSON*);
     void readokelement(JSON*);
@@ -1406,6 +1990,26 @@ public:
     // apply keys
     int applykeys();
 
+    // outside fetchnodes, applykeys() only tries the nodes with a new key and
+    // the ones waiting for a share key that just arrived, not the whole tree
+    handle_set keypendingnodes;
+    map<handle, handle_set> keywaitingnodes;
+    handle_set newsharekeys;
+
+    // the key of a node is to be decrypted by the next applykeys()
+    void keypending(Node*);
+
+    // the share key of a node is available
+    void sharekeyarrived(handle);
+
+    void waitforkey(Node*);
+
+    // during fetchnodes, keys and attributes of large node sets are decrypted
+    // by up to MAX_DECRYPT_THREADS threads
+    static const size_t PARALLEL_DECRYPT_MIN_NODES = 10000;
+    static const unsigned MAX_DECRYPT_THREADS = 8;
+    int applykeysparallel();
+
     // symmetric password challenge
     int checktsid(byte* sidbuf, unsigned len);
 
@@ -1468,6 +2072,92 @@ public:
     void exportDatabase(string filename);
     bool compareDatabases(string filename1, string filename2);
 
+    // per record type statistics of a state cache load (snapshot chunks count as
+    // CACHEDSNAPSHOT records, the records in them under their own type)
+    struct ScLoadStats
+    {
+        uint32_t records = 0;
+        uint64_t bytes = 0;
+
+        // time spent fetching and decrypting the records, and instantiating them
+        std::chrono::nanoseconds readtime{0};
+        std::chrono::nanoseconds decodetime{0};
+    };
+
+    // load the state cache of the current session the way fetchnodes() does, filling
+    // stats (DbTable::TYPEMASK + 1 entries indexed by record type) if not NULL
+    bool loadstatecache(ScLoadStats* stats);
+
+    // statistics of the fetchsc() in progress, if collected
+    ScLoadStats* scloadstats = nullptr;
+
+    std::chrono::steady_clock::time_point scloadmark;
+    void scloadread(uint32_t id, size_t bytes);
+    void scloaddecoded(uint32_t id);
+
+    // per action packet type statistics of procsc(), and the time spent purging
+    // the notifications that result from them
+    struct ScStats
+    {
+        struct Entry
+        {
+            uint64_t count = 0;
+            std::chrono::nanoseconds time{0};
+            std::chrono::nanoseconds max{0};
+
+            void add(std::chrono::nanoseconds t)
+            {
+                count++;
+                time += t;
+                max = std::max(max, t);
+            }
+        };
+
+        // accounts its lifetime to an entry, if not NULL
+        class Timer
+        {
+        public:
+            explicit Timer(Entry* entry)
+                : mEntry(entry)
+            {
+                if (mEntry)
+                {
+                    mStart = std::chrono::steady_clock::now();
+                }
+            }
+
+            ~Timer()
+            {
+                if (mEntry)
+                {
+                    mEntry->add(std::chrono::steady_clock::now() - mStart);
+                }
+            }
+
+            MEGA_DISABLE_COPY_MOVE(Timer)
+
+        private:
+            Entry* mEntry;
+            std::chrono::steady_clock::time_point mStart;
+        };
+
+        // by the "a" element of the action packets
+        std::map<nameid, Entry> actionpackets;
+
+        Entry notifypurge;
+    };
+
+    // statistics of the action packets processed, if collected
+    ScStats* scstats = nullptr;
+
+    // append the raw sc responses to the file at localpath, each after the scsn it
+    // was requested with, to be replayed with procsc() (NULL stops the recording)
+    bool recordsc(string* localpath);
+
+    std::unique_ptr<FileAccess> screcorder;
+    m_off_t screcorderpos = 0;
+    void screcord(const string& response);
+
     // request a link to recover account
     void getrecoverylink(const char *email, bool hasMasterkey);
 
@@ -1560,13 +2250,24 @@ public:
         CodeCounter::ScopeStats applyKeys = { "MegaClient_applyKeys" };
         CodeCounter::ScopeStats dispatchTransfers = { "dispatchTransfers" };
         CodeCounter::ScopeStats csResponseProcessingTime = { "cs batch response processing" };
+        CodeCounter::ScopeStats csBatchRoundTrip = { "cs batch round trip" };
+        CodeCounter::ScopeStats csPipelinedBatchRoundTrip = { "cs pipelined batch round trip" };
         CodeCounter::ScopeStats scProcessingTime = { "sc processing" };
+        CodeCounter::ScopeStats teardown = { "teardown" };
         uint64_t transferStarts = 0, transferFinishes = 0;
         uint64_t transferTempErrors = 0, transferFails = 0;
+        uint64_t scYields = 0;
         uint64_t prepwaitImmediate = 0, prepwaitZero = 0, prepwaitHttpio = 0, prepwaitFsaccess = 0, nonzeroWait = 0;
+        TransientArena::Stats transientArena;
         CodeCounter::DurationSum csRequestWaitTime;
         CodeCounter::DurationSum transfersActiveTime;
-        std::string report(bool reset, HttpIO* httpio, Waiter* waiter);
+        std::string report(bool reset, HttpIO* httpio, Waiter* waiter, DbTable* sctable = nullptr);
+
+        // percentiles of the sampled durations of each block (see CodeCounter::LatencySampler), as JSON
+        std::string latencies(bool reset);
+
+        // the blocks above that are sampled
+        std::vector<CodeCounter::ScopeStats*> sampled();
     } performanceStats;
 
     MegaClient(MegaApp*, Waiter*, HttpIO*, FileSystemAccess*, DbAccess*, GfxProc*, const char*, const char*);
@@ -67,6 +67,7 @@ struct MEGA_API NewNode : public NodeCore
     string* fileattributes;  // owned here, usually NULL
 
     bool added;
+    handle addedhandle;
 
     NewNode();
     ~NewNode();
@@ -85,27 +86,104 @@ struct MEGA_API PublicLink
     bool isExpired();
 };
 
-// Container storing FileFingerprint* (Node* in practice) ordered by fingerprint.
+// Container storing FileFingerprint* (Node* in practice) hashed by fingerprint.
+// Nodes are chained through Node::fingerprint_next, so indexing a node doesn't
+// allocate; nodes sharing a fingerprint are kept in insertion order.
 struct Fingerprints
 {
-    // maps FileFingerprints to node
-    using fingerprint_set = std::multiset<FileFingerprint*, FileFingerprintCmp>;
-    using iterator = fingerprint_set::iterator;
-
     void newnode(Node* n);
     void add(Node* n);
     void remove(Node* n);
     void clear();
     m_off_t getSumSizes();
+    size_t size() const { return mCount; }
+
+    // approximate bytes held (the nodes are chained through themselves)
+    size_t memoryusage() const;
 
     Node* nodebyfingerprint(FileFingerprint* fingerprint);
     node_vector *nodesbyfingerprint(FileFingerprint* fingerprint);
 
+    // 64-bit digest of size, mtime and sparse CRC
+    static uint64_t digest(const FileFingerprint* fingerprint);
+
 private:
-    fingerprint_set mFingerprints;
+    // chain heads; size is zero or a power of two
+    vector<Node*> mBuckets;
+    size_t mCount = 0;
     m_off_t mSumSizes = 0;
+
+    Node*& bucket(uint64_t digest) { return mBuckets[size_t(digest) & (mBuckets.size() - 1)]; }
+    void rehash(size_t buckets);
+    static bool samefingerprint(const FileFingerprint* a, const FileFingerprint* b);
 };
 
+// Optional in-memory index of file/folder names for fast substring searches.
+// Names are case-folded (ASCII, same as strcasestr()) and stored in a flat table,
+// with trigram posting lists pointing into it. Removed/renamed entries are
+// tombstoned and the table is compacted once they dominate.
+struct NodeNameIndex
+{
+    static const uint32_t NOSLOT = ~(uint32_t)0;
+
+    void setenabled(bool enable);
+    bool isenabled() const { return mEnabled; }
+
+    // (re)index a node whose name may have changed (no-op if disabled)
+    void update(Node* n);
+    void remove(Node* n);
+    void clear();
+
+    // append the indexed nodes whose name contains the search string
+    void search(const char* searchString, node_vector& results) const;
+
+    size_t size() const { return mEntries.size() - mTombstones; }
+
+    // approximate bytes held by the table and the posting lists
+    size_t memoryusage() const;
+
+private:
+    struct Entry
+    {
+        Node* node;
+        string name;    // case-folded; empty if tombstoned
+    };
+
+    vector<Entry> mEntries;
+    std::map<uint32_t, vector<uint32_t>> mTrigrams;
+    size_t mTombstones = 0;
+    bool mEnabled = false;
+
+    void add(Node* n, string&& name);
+    void compact();
+    static string foldname(const char* name);
+    static void trigrams(const string& name, vector<uint32_t>& t);
+};
+
+// Index of the children of a large folder by display name, so that looking up
+// a name doesn't compare it with every child. Built by the first lookup in a
+// folder with MINCHILDREN children or more, then kept up to date by
+// Node::setparent(), ~Node() and Node::namechanged(). Only hashes are kept:
+// the candidates are compared with the name on lookup.
+struct ChildNameIndex
+{
+    static const size_t MINCHILDREN = 1000;
+
+    explicit ChildNameIndex(const node_list& children);
+
+    void add(Node*);
+    void remove(Node*);
+
+    // the children with exactly this display name, in no particular order
+    void find(const char* name, vector<Node*>& results) const;
+
+    size_t memoryusage() const { return MemoryUsage::hash(mChildren); }
+
+    static uint32_t hash(const char* name);
+
+private:
+    std::unordered_multimap<uint32_t, Node*> mChildren;
+};
 
 // filesystem node
 struct MEGA_API Node : public NodeCore, FileFingerprint
@@ -124,18 +202,32 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     // try to resolve node key string
     bool applykey();
 
+    // first step of applykey(): locate the key that nodekey is encrypted with
+    // (returns false if the node needs no decryption or no key is available yet)
+    bool findkey(const char** k, SymmCipher** sc);
+
     // set up nodekey in a static SymmCipher
     SymmCipher* nodecipher();
 
     // decrypt attribute string and set fileattrs
     void setattr();
 
+    // second step of setattr(), once attrs holds the freshly decrypted attributes
+    void attrsdecrypted();
+
+    // decrypt and parse an attribute string without touching any client state
+    // (safe on worker threads); attrs is only replaced on success
+    static bool decryptattrs(SymmCipher*, const string* attrstring, AttrMap* attrs);
+
     // display name (UTF-8)
     const char* displayname() const;
 
     // display path from its root in the cloud (UTF-8)
     string displaypath() const;
 
+    // to be called when the display path of this node may have changed
+    void pathchanged();
+
     // node attributes
     AttrMap attrs;
 
@@ -188,6 +280,10 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
         bool parent : 1;
         bool publiclink : 1;
         bool newnode : 1;
+
+        // removed along with its subtree, whose removals were coalesced into this
+        // one in the notification to the app (MegaClient::COALESCEDREMOVALS)
+        bool removedtree : 1;
     } changed;
     
     void setkey(const byte* = NULL);
@@ -196,7 +292,11 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
 
     void faspec(string*);
 
-    NodeCounter subnodeCounts() const;
+    // counts for this node and its whole subtree, O(1)
+    NodeCounter subnodeCounts() const { return subtreecounts; }
+
+    // this node's own contribution to the counts (depends on the parent for file versions)
+    NodeCounter owncounts() const;
 
     // parent
     Node* parent;
@@ -204,11 +304,47 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     // children
     node_list children;
 
+    // restamped (from MegaClient::nodegeneration) whenever a child is added or
+    // removed or a child's attributes change, to validate cached child orderings
+    uint64_t childrengeneration;
+    void childrenchanged();
+
+    // aggregate of owncounts() over this subtree, maintained along the
+    // ancestor chain by setparent() and ~Node()
+    NodeCounter subtreecounts;
+
     // own position in parent's children
     node_list::iterator child_it;
 
-    // own position in fingerprint set (only valid for file nodes)
-    Fingerprints::iterator fingerprint_it;
+    // next node in the same Fingerprints bucket and the digest it was indexed
+    // with (only valid for file nodes)
+    Node* fingerprint_next;
+    uint64_t fingerprint_digest;
+
+    // own slot in the name index (NodeNameIndex::NOSLOT if not indexed)
+    uint32_t nameindex_slot;
+
+    // children by name, once looked up by name in a large folder (see ChildNameIndex)
+    unique_ptr<ChildNameIndex> childnameindex;
+
+    // hash of the display name this node is indexed with in its parent's childnameindex
+    uint32_t childname_hash;
+
+    // the children named so (appended), if this folder is large enough to be
+    // indexed by name; false if the children have to be scanned instead
+    bool childrennamed(const char* name, vector<Node*>& results);
+
+    // to be called when the display name may have changed
+    void namechanged();
+
+    // displaypath() as the prefix of the children's paths (empty for the root),
+    // memoized for folders until MegaClient::pathgeneration changes
+    string pathprefix() const;
+    mutable string cachedpath;
+    mutable uint64_t cachedpathgeneration = 0;
+
+    // own position in MegaClient::mRecentNodes (only valid for file nodes)
+    recentnode_map::iterator recent_it;
 
 #ifdef ENABLE_SYNC
     // related synced item or NULL
@@ -239,8 +375,41 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
 
     void setpubliclink(handle, m_time_t, m_time_t, bool);
 
+    // serialize() writes the fixed-layout RECORD_V2 format, unserialize() reads it in
+    // place and still accepts records written in the legacy layout
+    static const int64_t RECORD_V2 = -0x4e4f4432;
     bool serialize(string*);
+    bool dbparent(handle*) const;
     static Node* unserialize(MegaClient*, string*, node_vector*);
+    static Node* unserializerecord(MegaClient*, const char* ptr, const char* end, node_vector*);
+
+    // set while only the skeleton of a node loaded from the local cache in lazy
+    // mode is in memory: key, attributes and file attributes are still in its record
+    bool lazy;
+
+    // read the rest of a lazy node from the local cache (no-op otherwise)
+    void materialize() const
+    {
+        if (lazy)
+        {
+            const_cast<Node*>(this)->loadrecord();
+        }
+    }
+    bool loadrecord();
+
+    // same, from the record already read from the local cache
+    bool loadrecord(const string& data);
+
+    // handle of the node of a record in the current layout, UNDEF otherwise
+    static handle recordhandle(const string& data);
+
+    // approximate bytes held by the node and the objects it owns
+    size_t memoryusage() const;
+
+    // take the node out of its parent and of the indexes and counters of the client,
+    // leaving only its memory to be released (see MegaClient::purgeremoved())
+    void detach();
+    bool detached = false;
 
     Node(MegaClient*, vector<Node*>*, handle, handle, nodetype_t, m_off_t, handle, const char*, m_time_t);
     ~Node();
@@ -319,6 +488,15 @@ struct MEGA_API LocalNode : public File
 
     // build full local path to this node
     void getlocalpath(string*, bool sdisable = false) const;
+
+    // getlocalpath() of a folder with short names, memoized until
+    // MegaClient::pathgeneration changes
+    const string& cachedlocalpath() const;
+    mutable string cachedpath;
+    mutable uint64_t cachedpathgeneration = 0;
+
+    // to be called when the local path of this node may have changed
+    void pathchanged();
     void getlocalsubpath(string*) const;
     string localnodedisplaypath(FileSystemAccess& fsa) const;
 
@@ -340,6 +518,7 @@ struct MEGA_API LocalNode : public File
     void setfsid(handle);
 
     void setnameparent(LocalNode*, string*);
+    void indexchild(bool shortname);
 
     LocalNode();
     void init(Sync*, nodetype_t, LocalNode*, string*);
@@ -347,6 +526,9 @@ struct MEGA_API LocalNode : public File
     virtual bool serialize(string*);
     static LocalNode* unserialize( Sync* sync, string* sData );
 
+    // approximate bytes held by the node and its child maps (not the children)
+    size_t memoryusage() const;
+
     ~LocalNode();
 };
 #endif
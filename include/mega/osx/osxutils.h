@@ -3,10 +3,24 @@
 
 #include "mega/proxy.h"
 
+#include <functional>
+#include <vector>
+
 void path2localMac(std::string* path, std::string* local);
 
 #if defined(__APPLE__) && !(TARGET_OS_IPHONE)
 void getOSXproxy(mega::Proxy* proxy);
+
+// FSEvents stream of the changes below a folder, which, unlike /dev/fsevents,
+// doesn't need root privileges. The callback is called from the stream's own
+// queue with the paths of a batch of events, and with rescan set if events
+// were lost. Returns NULL if the stream can't be started.
+struct FsEventStream;
+FsEventStream* startFsEventStream(const std::string& path,
+                                  std::function<void(std::vector<std::string>& paths, bool rescan)> callback);
+
+// stops the stream, after the callback in progress, if any
+void stopFsEventStream(FsEventStream* stream);
 #endif
 
 #endif // OSXUTILS_H
@@ -36,12 +36,17 @@
 
 #ifdef HAVE_AIO_RT
 #include <aio.h>
+#include <sys/uio.h>
 #endif
 
 #include "mega.h"
 
 #define DEBRISFOLDER ".debris"
 
+#ifdef MEGA_FSEVENTSTREAM
+struct FsEventStream;
+#endif
+
 namespace mega {
 struct MEGA_API PosixDirAccess : public DirAccess
 {
@@ -51,7 +56,7 @@ struct MEGA_API PosixDirAccess : public DirAccess
     unsigned globindex;
 
     bool dopen(string*, FileAccess*, bool);
-    bool dnext(string*, string*, bool, nodetype_t*);
+    bool dnext(string*, string*, bool, nodetype_t*, NotifyAttributes*);
 
     PosixDirAccess();
     virtual ~PosixDirAccess();
@@ -72,6 +77,19 @@ public:
     string lastname;
 #endif
 
+#ifdef MEGA_FANOTIFY
+    // where permitted (CAP_SYS_ADMIN), the syncs' filesystems are marked as a
+    // whole, instead of adding an inotify watch per folder: the events name the
+    // folder by its filesystem id and file handle, looked up in fidnodes
+    int fanotifyfd;
+    typedef map<string, LocalNode*> fidlocalnode_map;
+    fidlocalnode_map fidnodes;
+    map<LocalNode*, fidlocalnode_map::iterator> nodefids;
+
+    // mark the filesystem of a sync
+    bool fanotifymark(string*);
+#endif
+
 #ifdef USE_IOS
     static char *appbasepath;
 #endif
@@ -79,6 +97,7 @@ public:
     bool notifyerr;
     int defaultfilepermissions;
     int defaultfolderpermissions;
+    int writeoptions;
 
     std::unique_ptr<FileAccess> newfileaccess(bool followSymLinks = true) override;
     DirAccess* newdiraccess() override;
@@ -93,6 +112,7 @@ public:
 
     bool renamelocal(string*, string*, bool) override;
     bool copylocal(string*, string*, m_time_t) override;
+    bool linklocal(string*, string*) override;
     bool rubbishlocal(string*);
     bool unlinklocal(string*) override;
     bool rmdirlocal(string*) override;
@@ -116,6 +136,15 @@ public:
     int getdefaultfolderpermissions();
     void setdefaultfolderpermissions(int);
 
+    // FileSystemAccess::FSWRITE_* flags for the files opened write-only (download targets).
+    // FSWRITE_DIRECTIO writes the page-aligned data bypassing the page cache (the rest of it is
+    // written as usual), FSWRITE_DROPCACHE evicts the data from the page cache once on disk
+    int getwriteoptions();
+    void setwriteoptions(int);
+
+    // syncfs() of each file system where available (Linux), fsync() of the directories elsewhere
+    bool flushlocal(const vector<string>&, bool wholefilesystem) const override;
+
     PosixFileSystemAccess(int = -1);
     ~PosixFileSystemAccess();
 };
@@ -128,6 +157,10 @@ struct MEGA_API PosixAsyncIOContext : public AsyncIOContext
     virtual void finish();
 
     struct aiocb *aiocb;
+
+    // submitted to the io_uring instead (see asyncsysread)
+    bool uring;
+    struct iovec iov;
 };
 #endif
 
@@ -135,6 +168,28 @@ class MEGA_API PosixFileAccess : public FileAccess
 {
 private:
     int fd;
+
+    // FileSystemAccess::FSWRITE_* flags applied to write-only files
+    int writeoptions;
+
+    // the same file opened with O_DIRECT, for the writes that meet its alignment
+    int directfd;
+    static const size_t DIRECTIO_ALIGNMENT = 4096;
+    int writefd(const void* data, size_t len, m_off_t pos) const;
+
+    // dropping a range from the page cache waits for its writeback, so it's done
+    // for the previous write while the current one is being written back
+    std::mutex dropmutex;
+    m_off_t droppos;
+    m_off_t droplen;
+    void dropwritten(m_off_t pos, m_off_t len);
+
+    // large files read in order (uploads, fingerprints) get the next window
+    // requested from the disk ahead of the reads (-1: no read yet)
+    static const m_off_t READAHEAD_WINDOW = 16 * 1024 * 1024;
+    m_off_t readaheadend;
+    void advisereadahead(m_off_t pos, unsigned len);
+
 public:
     int stealFileDescriptor();
     int defaultfilepermissions;
@@ -147,13 +202,14 @@ public:
     void updatelocalname(string*);
     bool fread(string *, unsigned, unsigned, m_off_t);
     bool fwrite(const byte *, unsigned, m_off_t);
+    bool fpreallocate(m_off_t) override;
 
     bool sysread(byte *, unsigned, m_off_t);
     bool sysstat(m_time_t*, m_off_t*);
     bool sysopen(bool async = false);
     void sysclose();
 
-    PosixFileAccess(Waiter *w, int defaultfilepermissions = 0600, bool followSymLinks = true);
+    PosixFileAccess(Waiter *w, int defaultfilepermissions = 0600, bool followSymLinks = true, int writeoptions = 0);
 
     // async interface
     virtual bool asyncavailable();
@@ -167,6 +223,10 @@ public:
 protected:
     virtual AsyncIOContext* newasynccontext();
     static void asyncopfinished(union sigval sigev_value);
+
+public:
+    // completion of an async operation, from aio or io_uring
+    static void asyncopcompleted(PosixAsyncIOContext* context, bool failed, bool retry);
 #endif
 
 private:
@@ -179,6 +239,22 @@ class MEGA_API PosixDirNotify : public DirNotify
 public:
     PosixFileSystemAccess* fsaccess;
 
+#ifdef MEGA_FANOTIFY
+    // set if the folders are identified with fanotify (see fidnodes)
+    bool fanotify = false;
+#endif
+
+#ifdef MEGA_FSEVENTSTREAM
+    // the sync's own FSEvents stream, if /dev/fsevents can't be opened: its
+    // paths are queued here and taken by PosixFileSystemAccess::checkevents()
+    ::FsEventStream* stream = nullptr;
+    std::mutex streammutex;
+    vector<string> streampaths;
+    bool streamrescan = false;
+
+    bool startstream();
+#endif
+
     void addnotify(LocalNode*, string*) override;
     void delnotify(LocalNode*) override;
 
@@ -186,6 +262,7 @@ public:
     bool fsstableids() const override;
 
     PosixDirNotify(string*, string*);
+    ~PosixDirNotify();
 };
 } // namespace
 
@@ -70,12 +70,29 @@ protected:
     string proxyusername;
     string proxypassword;
     int proxyinflight;
-    dstime ipv6deactivationtime;
     dstime lastdnspurge;
     bool ipv6proxyenabled;
     bool ipv6requestsenabled;
     std::queue<CurlHttpContext *> pendingrequests;
-    std::map<string, CurlDNSEntry> dnscache;
+
+    // addresses resolved by c-ares, of this instance or shared by all of them
+    // (see setsharedcaches()). Locked while in use, from any instance's thread
+    typedef std::map<string, CurlDNSEntry> DNSCache;
+    DNSCache owndnscache;
+    std::recursive_mutex owndnsmutex;
+    DNSCache& dnscache;
+    std::recursive_mutex& dnsmutex;
+
+    // DNS and TLS sessions of cURL, shared by the instances created while
+    // setsharedcaches() is enabled
+    static bool sharedcaches;
+    static CURLSH* sharedcurlsh;
+    static DNSCache shareddnscache;
+    static std::recursive_mutex shareddnsmutex;
+    static std::mutex sharedcurlshmutexes[CURL_LOCK_DATA_LAST];
+    static void sharedcurlshlock(CURL*, curl_lock_data, curl_lock_access, void*);
+    static void sharedcurlshunlock(CURL*, curl_lock_data, void*);
+    bool ownscurlsh;
     int pkpErrors;
 
     void send_pending_requests();
@@ -119,6 +136,8 @@ protected:
     static void proxy_ready_callback(void*, int, int, struct hostent*);
     static void ares_completed_callback(void*, int, int, struct hostent*);
     static void send_request(CurlHttpContext*);
+    void addconnectinfo(CurlHttpContext*, CURL*);
+    void addnetworkstats(CurlHttpContext*, CURL*);
     void request_proxy_ip();
     static struct curl_slist* clone_curl_slist(struct curl_slist*);
     static bool crackurl(string*, string*, string*, int*);
@@ -127,6 +146,9 @@ protected:
     void filterDNSservers();
 
     bool curlipv6;
+    bool curlhttp2;
+    bool curlsslsexport;
+    bool http2;
     bool reset;
     bool statechange;
     bool dnsok;
@@ -138,10 +160,16 @@ protected:
 
     void addaresevents(Waiter *waiter);
     void addcurlevents(Waiter *waiter, direction_t d);
+    void mutecurlevents(Waiter *waiter, direction_t d);
     void closearesevents();
     void closecurlevents(direction_t d);
     void processaresevents();
     void processcurlevents(direction_t d);
+    void setmultiplexing(direction_t d);
+#ifdef CURL_VERSION_SSLS_EXPORT
+    static CURLcode ssls_export_callback(CURL*, void*, const char*, const unsigned char*, size_t,
+                                         const unsigned char*, size_t, curl_off_t, int, const char*, size_t);
+#endif
     std::vector<SockInfo> aressockets;
     typedef std::map<curl_socket_t, SockInfo> SockInfoMap;
     SockInfoMap curlsockets[3];
@@ -151,10 +179,69 @@ protected:
     set<CURL *>pausedrequests[3];
     m_off_t partialdata[2];
     m_off_t maxspeed[2];
+    SocketOptions sockopts[3];
+    void tunesocket(curl_socket_t, direction_t);
+
+    // connection cache limits of each multi handle
+    ConnectionCacheOptions cacheopts[3];
+    void setcachelimits(direction_t d);
+
+    // requests opening connections ahead of time, with their direction
+    std::map<HttpReq*, direction_t> preconnects;
+
+    // last time each host (scheme://host:port) was used, per direction
+    std::map<string, dstime> hostsused[3];
+    static string hostkey(CurlHttpContext*);
+    void purgepreconnects();
     bool curlsocketsprocessed;
     m_time_t arestimeout;
 
+    // network thread: while the client has released the I/O, it reads and
+    // writes the sockets of cURL, so the data of the requests in flight keeps
+    // flowing. Completed requests are still processed by doio(). ioavailable
+    // tells which thread owns the I/O: it only changes with iomutex locked, which
+    // the network thread holds while it uses the I/O, and iocv signals it
+    std::thread iothread;
+    std::mutex iomutex;
+    std::condition_variable iocv;
+    bool iothreadenabled;
+    bool iothreadexit;
+    bool ioavailable;
+    int ioreleasecount;
+    bool ioreleased;
+    void iothreadloop();
+
+    // automatic proxy (Proxy::AUTO): the detection runs on a thread of its own while
+    // requests go direct, and its result is kept until it expires or the network
+    // changes. If the detected proxy fails to connect, requests go direct again
+    bool autoproxy;
+    bool autoproxyfailed;
+    bool autoproxyrunning;
+    std::thread autoproxythread;
+    std::mutex autoproxymutex;
+    bool autoproxydone;
+    std::unique_ptr<Proxy> autoproxyresult;
+    std::unique_ptr<Proxy> autoproxycached;
+    dstime autoproxytime;
+    void startautoproxy();
+    void checkautoproxy();
+    void applyproxy(Proxy*);
+
+    // takes the I/O back for an entry point called during a busy section
+    struct IOGuard
+    {
+        IOGuard(CurlHttpIO*);
+        ~IOGuard();
+
+        CurlHttpIO* httpio;
+        bool locked;
+    };
+
 public:
+    // share the DNS caches and the TLS sessions among the instances created from now on
+    static void setsharedcaches(bool);
+    static bool getsharedcaches();
+
     void post(HttpReq*, const char* = 0, unsigned = 0);
     void cancel(HttpReq*);
 
@@ -166,10 +253,13 @@ public:
     void addevents(Waiter*, int);
 
     void setuseragent(string*);
-    void setproxy(Proxy*);
-    void setdnsservers(const char*);
+    void setproxy(Proxy*) override;
+    void setdnsservers(const char*) override;
     void disconnect();
 
+    // put() releases purged data as new chunks arrive
+    bool purgesinflight() override { return true; }
+
     // set max download speed
     virtual bool setmaxdownloadspeed(m_off_t bpslimit);
 
@@ -182,6 +272,31 @@ public:
     // get max upload speed
     virtual m_off_t getmaxuploadspeed();
 
+    // enable/disable HTTP/2 with request multiplexing
+    virtual bool sethttp2(bool enable);
+
+    // get HTTP/2 multiplexing state
+    virtual bool gethttp2();
+
+    // export/import the TLS sessions of the shared session cache
+    virtual bool gettlssessions(std::vector<TlsSession>*);
+    virtual bool settlssessions(const std::vector<TlsSession>&);
+
+    // tune the sockets opened from now on for a direction
+    virtual bool setsocketoptions(direction_t, const SocketOptions&);
+
+    // limit the cached and open connections of a direction
+    virtual bool setconnectioncache(direction_t, const ConnectionCacheOptions&);
+
+    // open idle connections to the host of a URL with HEAD requests
+    virtual bool preconnect(const string& url, direction_t, int connections);
+
+    // drive the sockets of cURL on a dedicated thread during busy sections of the client
+    virtual bool setiothread(bool enable);
+    virtual bool getiothread();
+    virtual void releaseio();
+    virtual void acquireio();
+
     CurlHttpIO();
     ~CurlHttpIO();
 
@@ -212,6 +327,11 @@ struct MEGA_API CurlHttpContext
     unsigned len;
     const char* data;
     int ares_pending;
+    struct curl_slist *resolve;
+
+    // time of post() and time spent resolving the host for this request (-1: cached or proxied)
+    std::chrono::steady_clock::time_point posted;
+    int dnsms;
 };
 
 struct MEGA_API CurlDNSEntry
@@ -220,10 +340,43 @@ struct MEGA_API CurlDNSEntry
     bool isIPv4Expired();
     bool isIPv6Expired();
 
+    // replace the addresses of a family with a new DNS response
+    // (measurements of addresses still present are kept)
+    // returns false if the preferred address isn't in the response
+    bool setaddresses(bool isIPv6, const std::vector<string>& ips);
+
+    // record the time needed to connect to an address
+    void connected(const string& ip, int ms);
+
+    // record a failed connection to an address
+    void failed(const string& ip);
+
+    // set ipv4 / ipv6 to the preferred address of the family
+    void select(bool isIPv6);
+
+    // preferred addresses
     string ipv4;
     dstime ipv4timestamp;
     string ipv6;
     dstime ipv6timestamp;
+
+    struct Address
+    {
+        string ip;
+
+        // smoothed connection time in ms (-1 if not measured yet)
+        int rtt;
+
+        // time of the last failed connection (0 if none)
+        dstime failtime;
+    };
+
+    // all addresses received for each family
+    std::vector<Address> ipv4addrs;
+    std::vector<Address> ipv6addrs;
+
+protected:
+    Address* find(const string& ip, bool* isIPv6);
 };
 
 } // namespace
@@ -108,10 +108,33 @@
 
 #ifdef USE_INOTIFY
     #include <sys/inotify.h>
+
+// filesystem-wide fanotify marks that name the changed entries (Linux 5.9)
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/fanotify.h>)
+    #include <sys/fanotify.h>
+#ifdef FAN_REPORT_DFID_NAME
+#define MEGA_FANOTIFY 1
+#endif
+#endif
+#endif
+#endif
+
+#if defined(__MACH__) && !(TARGET_OS_IPHONE)
+#define MEGA_FSEVENTSTREAM 1
 #endif
 
 #include <sys/select.h>
 
+// persistent registration of the sockets waited on
+#if defined(__linux__)
+    #include <sys/epoll.h>
+#define MEGA_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+    #include <sys/event.h>
+#define MEGA_KQUEUE 1
+#endif
+
 #include <curl/curl.h>
 #include <stdexcept>
 
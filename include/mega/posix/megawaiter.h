@@ -24,6 +24,7 @@
 
 #include "mega/waiter.h"
 #include <mutex>
+#include <unordered_map>
 namespace mega {
 struct PosixWaiter : public Waiter
 {
@@ -42,10 +43,31 @@ struct PosixWaiter : public Waiter
 
     void notify();
 
+    // descriptors watched across waits, unlike the fd sets above that are
+    // rebuilt every time: only changes of their modes reach the kernel (epoll
+    // on Linux, kqueue on BSD and macOS) and they aren't bound by FD_SETSIZE
+    enum { WATCH_READ = 1, WATCH_WRITE = 2 };
+
+    // set the modes to wait for (0: stop watching - before closing the fd)
+    void watch(int fd, int mode);
+
+    // modes that the last wait() found ready
+    int ready(int fd) const;
+
 protected:
     int m_pipe[2];
     std::mutex mMutex;
     bool alreadyNotified = false;
+
+    // epoll/kqueue descriptor (-1: the watched fds go in the fd sets)
+    int pollfd;
+
+    mutable std::mutex watchMutex;
+    std::unordered_map<int, int> watched;
+    std::unordered_map<int, int> readyfds;
+
+    bool setkernelwatch(int fd, int oldmode, int mode);
+    void collectready();
 };
 } // namespace
 
@@ -46,9 +46,15 @@ namespace mega {
             HttpReq::http_buf_t buf;  // owned here
             chunkmac_map chunkmacs;
 
+            // decryption running on a worker thread (see TransferBufferManager::finalize)
+            std::shared_ptr<CryptoWorkers::Job> finalizing;
+            bool isFinalized();
+            void waitFinalized();
+
             FilePiece();
             FilePiece(m_off_t p, size_t len);    // makes a buffer of the specified size (with extra space for SymmCipher::ctr_crypt padding)
             FilePiece(m_off_t p, HttpReq::http_buf_t* b); // takes ownership of the buffer
+            ~FilePiece();
             void swap(FilePiece& other);
         };
 
@@ -91,6 +97,11 @@ namespace mega {
         // calculate the exact size of each of the 6 parts of a raid file.  Some may not have a full last sector
         static m_off_t raidPartSize(unsigned part, m_off_t fullfilesize);
 
+        // interleave partslen bytes (a multiple of RAIDSECTOR) of each of the 5 data parts into dest, rebuilding
+        // a missing (NULL) data part from the parity.  Vectorized where available; combinePartsScalar() is the reference
+        static void combineParts(byte* dest, byte* const inputbufs[RAIDPARTS], size_t partslen);
+        static void combinePartsScalar(byte* dest, byte* const inputbufs[RAIDPARTS], size_t partslen);
+
         // report a failed connection.  The function tries to switch to 5 connection raid or a different 5 connections.  Two fails without progress and we should fail the transfer as usual
         bool tryRaidHttpGetErrorRecovery(unsigned errorConnectionNum);
 
@@ -103,6 +114,21 @@ namespace mega {
         // returns how far we are through the file on average, including uncombined data
         m_off_t progress() const;
 
+        // approximate bytes held in the input parts, output pieces and leftover chunk
+        size_t bufferedBytes() const;
+
+        // a non-raid file can have several sources (temp URLs of the same data).  Each connection uses one, and after each request
+        // moves to the source with the best throughput per request (unmeasured ones first), so the faster sources take more of the
+        // ranges still to fetch.  1 for a raid file
+        unsigned sourceCount() const;
+        void sourceRequestDone(unsigned connectionNum, m_off_t bytes, dstime duration);
+
+        // report a failed request on a connection, excluding its source if unusable.  True if the connection moved to another source
+        bool sourceRequestFailed(unsigned connectionNum, bool unusable);
+
+        // the best source other than the one used by this connection (its own if there is no other)
+        const std::string& alternativeTempURL(unsigned connectionNum);
+
         RaidBufferManager();
         ~RaidBufferManager();
 
@@ -129,6 +155,18 @@ namespace mega {
         std::vector<std::string> tempurls;
         std::string emptyReturnString;
 
+        // for non-raid files with several temp URLs, the throughput of each (bytes/ds, negative until measured) and the source of each connection
+        struct Source
+        {
+            double rate = -1;
+            unsigned failures = 0;
+            bool unusable = false;
+        };
+        std::vector<Source> sources;
+        std::map<unsigned, unsigned> connectionsources;
+        unsigned connectionSource(unsigned connectionNum);
+        unsigned bestSource(unsigned excludedSource);
+
         // a connection is paused if it reads too far ahead of others.  This prevents excessive buffer usage
         bool connectionPaused[RAIDPARTS];
         
@@ -165,7 +203,7 @@ namespace mega {
         // take raid input part buffers and combine to form the asyncoutputbuffers
         void combineRaidParts(unsigned connectionNum);
         FilePiece* combineRaidParts(size_t partslen, size_t bufflen, m_off_t filepos, FilePiece& prevleftoverchunk);
-        void recoverSectorFromParity(byte* dest, byte* inputbufs[], unsigned offset);
+        static void recoverSectorFromParity(byte* dest, byte* const inputbufs[], size_t offset);
         void combineLastRaidLine(byte* dest, size_t nbytes);
         void rollInputBuffers(size_t dataToDiscard);
         virtual void bufferWriteCompletedAction(FilePiece& r);
@@ -200,7 +238,7 @@ namespace mega {
         // get the next pos to start transferring from/to on this connection, for non-raid
         m_off_t nextTransferPos();
 
-        // decrypt and mac downloaded chunk
+        // decrypt and mac downloaded chunk (on a worker thread if the client has them)
         void finalize(FilePiece& r) override;
         m_off_t calcOutputChunkPos(m_off_t acquiredpos) override;
         void bufferWriteCompletedAction(FilePiece& r) override;
@@ -37,22 +37,44 @@ private:
     JSON json;
     size_t processindex = 0;
 
+    // results consumed while the response was arriving: position in the
+    // unpurged response data and number of results seen
+    enum { STREAM_START, STREAM_ON, STREAM_OFF } streamstate = STREAM_START;
+    size_t streampos = 0;
+    size_t streamindex = 0;
+
+    // process the results of the commands before the one at index upto
+    void process(MegaClient* client, size_t upto);
+
 public:
     void add(Command*);
 
     size_t size() const;
 
+    // the command, if this request consists of a single one
+    Command* single() const;
+
     void get(string*, bool& suppressSID) const;
 
     void serverresponse(string&& movestring, MegaClient*);
     void servererror(error e, MegaClient* client);
 
+    // process the results completely received so far, except the last one, which is left
+    // for serverresponse() - once the response is complete, leave in it only what remains
+    void serverpartial(HttpReq*, MegaClient*, bool complete);
+
     void process(MegaClient* client);
 
     void clear();
     bool empty() const; 
     void swap(Request&);
 
+    // some results have been processed already (see serverpartial())
+    bool started() const;
+
+    // move the commands after the first n ones to the (empty) rest
+    void split(size_t n, Request& rest);
+
     bool stopProcessing = false;
 };
 
@@ -62,16 +84,37 @@ class MEGA_API RequestDispatcher
     // these ones have been sent to the server, but we haven't received the response yet
     Request inflightreq;
 
-    // client-server request double-buffering, in batches of up to MAX_COMMANDS
+    // client-server request double-buffering, in batches of up to batchlimit
     deque<Request> nextreqs;
 
+    // batch size, adapted to the observed response times: halved after a slow
+    // or rejected (-3/-4) batch, doubled again after fast full ones
+    size_t batchlimit = MAX_COMMANDS;
+
+    // the batch in flight was rejected for its size: split it when requeued
+    bool inflightrejected = false;
+
+    // order-independent commands, sent in batches of their own next to the ordered
+    // ones (maxpipelined at a time), and those batches in flight by channel
+    deque<Request> nextpipelinedreqs;
+    map<int, Request> inflightpipelinedreqs;
+    int lastchannel = 0;
+    unsigned maxpipelined = 0;
+
     // flags for dealing with resetting everything from a command in progress
     bool processing = false;
     bool clearWhenSafe = false;
+    Request* processingreq = nullptr;
 
-    static const int MAX_COMMANDS = 10000;
+    void process(Request&, MegaClient*);
 
 public:
+    static const size_t MAX_COMMANDS = 10000;
+    static const size_t MIN_BATCH_COMMANDS = 100;
+
+    // round trip above which a batch is considered too large
+    static const std::chrono::milliseconds SLOW_BATCH;
+
     RequestDispatcher();
 
     // Queue a command to be send to MEGA. Some commands must go in their own batch (in case other commands fail the whole batch), determined by the Command's `batchSeparately` field.
@@ -79,14 +122,42 @@ public:
 
     bool cmdspending() const;
 
+    // command whose response is being received, if it was sent in a batch of its own
+    Command* inflightsingle() const;
+
     // get the set of commands to be sent to the server (could be a retry)
     void serverrequest(string*, bool& suppressSID);
 
+    // feedback on the batch in flight, before its response is processed - a
+    // rejected batch is split to the new limit when requeued
+    void batchcompleted(std::chrono::milliseconds roundtrip);
+    void batchrejected();
+    size_t getbatchlimit() const { return batchlimit; }
+
+    // the response of the batch in flight is arriving (or has arrived, before serverresponse())
+    void serverpartial(HttpReq*, MegaClient*, bool complete);
+
     // once the server response is determined, call one of these to specify the results
-    void requeuerequest();
+    // (requeuerequest() returns true if the batch to resend isn't the one sent, because
+    // it was split, so it needs a new request ID: an unchanged one keeps the original)
+    bool requeuerequest();
     void serverresponse(string&& movestring, MegaClient*);
     void servererror(error, MegaClient*);
 
+    // number of pipelined batches allowed in flight (0 sends everything in order)
+    void setmaxpipelined(unsigned);
+    unsigned getmaxpipelined() const { return maxpipelined; }
+
+    // a pipelined batch can be sent now
+    bool pipelinedready() const;
+    size_t pipelinedinflight() const { return inflightpipelinedreqs.size(); }
+
+    // the next pipelined batch, and the channel to report its outcome with
+    int pipelinedrequest(string*, bool& suppressSID);
+    void requeuepipelined(int channel);
+    void pipelinedresponse(int channel, string&& movestring, MegaClient*);
+    void pipelinederror(int channel, error, MegaClient*);
+
     void clear();
 
 #ifdef MEGA_MEASURE_CODE
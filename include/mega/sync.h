@@ -39,7 +39,9 @@ void invalidateFilesystemIds(handlelocalnode_map& fsidnodes, LocalNode& l, size_
 int computeReversePathMatchScore(const string& path1, const string& path2, const string& localseparator);
 
 // Recursively iterates through the filesystem tree starting at the sync root and assigns
-// fs IDs to those local nodes that match the fingerprint retrieved from disk.
+// fs IDs to those local nodes that match by name (below folders with their recorded mtime,
+// or with matching size and mtime themselves), and to the remaining local nodes that match
+// the fingerprint retrieved from disk.
 bool assignFilesystemIds(Sync& sync, MegaApp& app, FileSystemAccess& fsaccess, handlelocalnode_map& fsidnodes,
                          const string& localdebris, const string& localseparator);
 
@@ -85,9 +87,13 @@ public:
     // recursively add children
     void addstatecachechildren(uint32_t, idlocalnode_map*, string*, LocalNode*, int);
     
-    // Caches all synchronized LocalNode
+    // Caches synchronized LocalNodes, parents first and at most CACHENODES_BATCH
+    // per call (MegaClient::exec() resumes the flush until insertq is drained)
     void cachenodes();
 
+    // records written since insertq was last empty, for progress reports
+    size_t cachednodes = 0;
+
     // change state, signal to application
     void changestate(syncstate_t);
 
@@ -98,11 +104,27 @@ public:
     void deletemissing(LocalNode*);
 
     // scan specific path
-    LocalNode* checkpath(LocalNode*, string*, string* = NULL, dstime* = NULL, bool wejustcreatedthisfolder = false);
+    LocalNode* checkpath(LocalNode*, string*, string* = NULL, dstime* = NULL, bool wejustcreatedthisfolder = false, const NotifyAttributes* = NULL);
 
     m_off_t localbytes;
     unsigned localnodes[2];
 
+    // performance counters (see MegaApi::getSyncStats)
+    struct Stats
+    {
+        // paths checked from the notification queues and files fingerprinted,
+        // in total and per second
+        uint64_t scanned = 0;
+        uint64_t fingerprinted = 0;
+        SpeedController scanspeed;
+        SpeedController fingerprintspeed;
+
+        // time spent in checkpath() and in the syncup()/syncdown() walks
+        std::chrono::steady_clock::duration checkpathtime = std::chrono::steady_clock::duration::zero();
+        std::chrono::steady_clock::duration syncuptime = std::chrono::steady_clock::duration::zero();
+        std::chrono::steady_clock::duration syncdowntime = std::chrono::steady_clock::duration::zero();
+    } stats;
+
     // look up LocalNode relative to localroot
     LocalNode* localnodebypath(LocalNode*, string*, LocalNode** = NULL, string* = NULL);
 
@@ -111,8 +133,37 @@ public:
     bool assignfsids();
 
     // scan items in specified path and add as children of the specified
-    // LocalNode
-    bool scan(string*, FileAccess*);
+    // LocalNode (optionally returns the names found)
+    bool scan(string*, FileAccess*, set<string>* = NULL);
+
+    // queue all children of a folder, present or known, for a rescan of a
+    // folder whose notifications were collapsed
+    void rescan(LocalNode*, string*);
+
+    // list the folders below localpath and fingerprint their new or changed
+    // files on MegaClient's sync scan workers, many at once; scan() and
+    // checkpath() then take the results instead of reading the file system
+    // on the SDK thread. Only starts the listing of localpath: prefetchahead()
+    // takes the results as they complete and goes on with the folders in it
+    void prefetch(string* localpath);
+    void prefetchahead();
+
+    // instead of the initial scan: take the changes made since the journal
+    // position of the state cache from the filesystem's change journal
+    bool resumefromjournal();
+
+    // store the journal position in the state cache, once every change up to
+    // it is known to be in the cache (called while no changes are pending)
+    void journalcheckpoint();
+
+    // fingerprint the files of the next items of a notification queue on the
+    // sync scan workers, and take the fingerprints completed since the last call
+    void fingerprintahead(int q);
+
+    // fingerprint a file from its prefetched result if it hasn't changed
+    // since, otherwise from the file itself (same return value as
+    // FileFingerprint::genfingerprint())
+    bool fingerprint(LocalNode*, FileAccess*, const string& localpath);
 
     // own position in session sync list
     sync_list::iterator sync_it;
@@ -164,10 +215,94 @@ public:
     static const int FILE_UPDATE_DELAY_DS;
     static const int FILE_UPDATE_MAX_DELAY_SECS;
     static const dstime RECENT_VERSION_INTERVAL_SECS;
+    static const size_t CACHENODES_BATCH;
+    static const size_t PREFETCH_FINGERPRINTS;
+    static const size_t FINGERPRINTS_AHEAD;
+    static const size_t FINGERPRINTS_AHEAD_BATCH;
+    static const dstime JOURNAL_CHECKPOINT_DS;
+    static const size_t NAMECACHE_SIZE;
+
+    // local2name() of a local name, remembered for a while: prefetch(), scan(),
+    // checkpath() and LocalNode::setnameparent() convert the same names in turn
+    // (the reference is only valid until the next call)
+    const string& localname2name(const string& localname);
+
+    // state cache record of the journal position (LocalNodes have nonzero ids)
+    static const uint32_t JOURNAL_RECORD = 0;
 
 protected :
     bool readstatecache();
 
+    struct ListJob : public CryptoWorkers::Job
+    {
+        FileSystemAccess* fsaccess;
+        bool followsymlinks;
+        string localpath;
+        bool opened = false;
+        vector<std::pair<string, nodetype_t> > entries;
+
+        void run() override;
+    };
+
+    struct FingerprintJob : public CryptoWorkers::Job
+    {
+        struct Entry
+        {
+            string localpath;
+
+            // the cached file: not fingerprinted again if it still matches
+            handle fsid = UNDEF;
+            m_off_t size = -1;
+            m_time_t mtime = 0;
+
+            bool fsidvalid = false;
+            FileFingerprint fingerprint;    // not valid if unchanged or unreadable
+        };
+
+        FileSystemAccess* fsaccess;
+        std::shared_ptr<FingerprintCache> cache;
+        vector<Entry> entries;
+
+        void run() override;
+    };
+
+    struct PrefetchedFingerprint
+    {
+        handle fsid;
+        bool fsidvalid;
+        FileFingerprint fingerprint;
+    };
+
+    // journal position stored in the state cache, and the one to be stored at
+    // the next checkpoint (notifications read up to it have been processed
+    // once a whole checkpoint interval has passed)
+    string journalposition;
+    string nextjournalposition;
+    dstime journaltime = 0;
+
+    // prefetched folder listings and fingerprints by local path, taken (and
+    // removed) as the scan gets to them, dropped once the scan queues drain
+    map<string, vector<string> > prefetchedlistings;
+    map<string, PrefetchedFingerprint> prefetchedfingerprints;
+
+    // localname2name() results, dropped when full and when the scan queues drain
+    std::unordered_map<string, string> namecache;
+
+    // fingerprints of queued items being done by fingerprintahead() and prefetchahead()
+    vector<std::shared_ptr<FingerprintJob> > fingerprintjobs;
+    set<string> fingerprinting;
+
+    // folder listings of prefetch() in progress, and their paths
+    vector<std::shared_ptr<ListJob> > prefetchlists;
+    set<string> listing;
+    size_t prefetchedfolders = 0;
+    void prefetchfolder(const string& localpath);
+
+    // full local path of a notification queue item
+    void notificationpath(const Notification&, string*);
+
+    CryptoWorkers* scanworkers();
+
 };
 } // namespace
 
@@ -0,0 +1,116 @@
+/**
+ * @file mega/trace.h
+ * @brief Lightweight tracing of the hot paths
+ *
+ * (c) 2013-2020 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_TRACE_H
+#define MEGA_TRACE_H 1
+
+#include <atomic>
+
+#include "types.h"
+
+namespace mega {
+
+// Begin/end events of the main loop and its subsystems, for correlating stalls
+// in production runs (unlike CodeCounter, always compiled in). Each thread
+// records into its own ring buffer, which keeps its most recent events, and
+// dump() renders the buffers of all threads as Chrome trace JSON, to be loaded
+// into chrome://tracing or Perfetto.
+//
+// Tracing is off by default, and then costs a relaxed atomic load per span.
+// Names must be string literals: only their pointers are recorded.
+class MEGA_API Trace
+{
+public:
+    // timed block on the current thread
+    class Span
+    {
+    public:
+        explicit Span(const char* name)
+            : mName(enabled() ? name : nullptr)
+        {
+            if (mName)
+            {
+                record('B', mName, nullptr);
+            }
+        }
+
+        ~Span()
+        {
+            if (mName)
+            {
+                record('E', mName, nullptr);
+            }
+        }
+
+        MEGA_DISABLE_COPY_MOVE(Span)
+
+    private:
+        const char* mName;
+    };
+
+    // operations that end on a later iteration or another thread (eg. HTTP
+    // requests), matched by name and id
+    static void asyncbegin(const char* name, const void* id)
+    {
+        if (enabled())
+        {
+            record('b', name, id);
+        }
+    }
+
+    static void asyncend(const char* name, const void* id)
+    {
+        if (enabled())
+        {
+            record('e', name, id);
+        }
+    }
+
+    static bool enabled()
+    {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    static void enable(bool enable);
+
+    // events kept per thread, for the buffers created after the call
+    static void setbuffersize(size_t events);
+
+    // label of the current thread in the dumps (a string literal too)
+    static void threadname(const char* name);
+
+    // Chrome trace JSON of the events in the buffers
+    static string dump();
+
+    // discard the recorded events
+    static void clear();
+
+    static const size_t DEFAULT_BUFFER_SIZE = 16384;
+
+private:
+    static std::atomic<bool> sEnabled;
+
+    static void record(char phase, const char* name, const void* id);
+};
+
+} // namespace
+
+#endif
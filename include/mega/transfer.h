@@ -32,6 +32,77 @@ namespace mega {
 
 class DBTableTransactionCommitter;
 
+// token bucket limiting the bandwidth of a transfer or of a transfer class: each
+// request takes its size from the bucket when it's posted and the next one waits
+// until the bucket is refilled (a request bigger than the burst leaves a debt)
+struct MEGA_API TransferRateLimit
+{
+    // bytes per second, 0 for no limit
+    m_off_t rate = 0;
+
+    // bytes that can be sent at once after an idle period
+    m_off_t burst = 0;
+
+    // rate for a period of the day, in minutes since local midnight [start, end),
+    // wrapping around midnight if start > end
+    struct Period
+    {
+        int start;
+        int end;
+        m_off_t rate;
+    };
+    vector<Period> periods;
+
+    // rate applying at a time, from the first period that includes it
+    m_off_t currentrate(m_time_t) const;
+
+    // deciseconds until a request can be posted (0: now)
+    dstime wait();
+
+    // take a posted request from the bucket
+    void consume(m_off_t bytes);
+
+private:
+    m_off_t tokens = 0;
+    dstime updated = NEVER;
+    m_off_t updatedrate = 0;
+
+    void refill();
+};
+
+// data of an upload read once from a stream, from the beginning to the end, as
+// the chunks are prepared: its fingerprint is known at the end
+struct MEGA_API UploadStream
+{
+    UploadStream(InputStreamAccess*, m_time_t);
+
+    std::unique_ptr<InputStreamAccess> stream;
+    m_off_t size;
+    m_time_t mtime;
+
+    // bytes read so far
+    m_off_t pos = 0;
+
+    StreamFingerprint fingerprint;
+};
+
+// the FileAccess a TransferSlot reads an UploadStream with: sequential reads only
+struct MEGA_API StreamFileAccess : public FileAccess
+{
+    std::shared_ptr<UploadStream> upload;
+
+    StreamFileAccess(std::shared_ptr<UploadStream>, Waiter*);
+
+    bool fopen(string*, bool read, bool write);
+    bool fwrite(const byte*, unsigned, m_off_t);
+    void updatelocalname(string*);
+
+    bool sysread(byte*, unsigned, m_off_t);
+    bool sysstat(m_time_t*, m_off_t*);
+    bool sysopen(bool async = false);
+    void sysclose();
+};
+
 // pending/active up/download ordered by file fingerprint (size - mtime - sparse CRC)
 struct MEGA_API Transfer : public FileFingerprint
 {
@@ -45,13 +116,16 @@ struct MEGA_API Transfer : public FileFingerprint
     // file is removed
     file_list files;
 
-    // failures/backoff
+    // failures/backoff (scheduled in MegaClient::transferretries)
     unsigned failcount;
     BackoffTimer bt;
 
     // representative local filename for this transfer
     string localfilename;
 
+    // source of an upload without a local file
+    std::shared_ptr<UploadStream> uploadstream;
+
     // progress completed
     m_off_t progresscompleted;
 
@@ -71,6 +145,10 @@ struct MEGA_API Transfer : public FileFingerprint
 
     chunkmac_map chunkmacs;
 
+    // file system id of the local file (the temporary file for downloads) when it was
+    // last opened: while it's the same file, a resumed transfer doesn't read it again
+    handle localfsid;
+
     // upload handle for file attribute attachment (only set if file attribute queued)
     handle uploadhandle;
 
@@ -124,6 +202,11 @@ struct MEGA_API Transfer : public FileFingerprint
     // downloads can have 6 for raid, 1 for non-raid.  Uploads always have 1
     std::vector<string> tempurls;
 
+    // tempurls requested ahead of the dispatch (see MegaClient::prefetchtransferurls()):
+    // the pending request, and when the last ones arrived
+    Command* urlprefetch = nullptr;
+    dstime urlprefetchds = 0;
+
     // context of the async fopen operation
     AsyncIOContext* asyncopencontext;
    
@@ -144,6 +227,22 @@ struct MEGA_API Transfer : public FileFingerprint
     // serialize the Transfer object
     virtual bool serialize(string*);
 
+    // serialize with the given chunk MACs (none if NULL)
+    bool serializerecord(string*, const chunkmac_map*);
+
+    // what the cached record holds: the other fields as serialized, the chunk MACs
+    // (including those appended in delta records) and the dbids of the delta records
+    string cachedfields;
+    chunkmac_map cachedchunkmacs;
+    vector<uint32_t> chunkmacdeltas;
+
+    // delta records appended before the record is rewritten with all chunk MACs
+    static const size_t MAXCHUNKMACDELTAS = 256;
+
+    // chunk MACs added or updated since they were cached (false if some were
+    // dropped, so a delta can't bring the cached record up to date)
+    bool changedchunkmacs(chunkmac_map*) const;
+
     // unserialize a Transfer and add it to the transfer map
     static Transfer* unserialize(MegaClient *, string*, transfer_map *);
 
@@ -151,6 +250,94 @@ struct MEGA_API Transfer : public FileFingerprint
     void addAnyMissingMediaFileAttributes(Node* node, std::string& localpath);
 };
 
+// transfers of one direction in priority order: a search tree by priority
+// (treap) whose nodes count their subtree, so that lookups, insertions,
+// removals and positional access are O(log n) and iterators stay valid until
+// their own transfer is removed
+class MEGA_API TransferTree
+{
+    struct Node
+    {
+        Transfer* transfer;
+        Node* parent;
+        Node* left;
+        Node* right;
+        size_t count;
+        uint32_t heap;
+    };
+
+    Node* root = nullptr;
+    uint32_t seed = 2463534242u;
+
+    static size_t count(Node* n) { return n ? n->count : 0; }
+    static void update(Node*);
+    static void split(Node*, uint64_t priority, Node*& lower, Node*& upper);
+    static Node* merge(Node* lower, Node* upper);
+    static void clear(Node*);
+    static Node* first(Node*);
+    static Node* last(Node*);
+    static Node* next(Node*);
+    static Node* prev(Node*);
+
+public:
+    class iterator
+    {
+        friend class TransferTree;
+        TransferTree* queue;
+        Node* node;
+
+        iterator(TransferTree* q, Node* n) : queue(q), node(n) { }
+
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Transfer* value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Transfer* const* pointer;
+        typedef Transfer* const& reference;
+
+        iterator() : queue(nullptr), node(nullptr) { }
+
+        reference operator*() const { return node->transfer; }
+        iterator& operator++() { node = next(node); return *this; }
+        iterator operator++(int) { iterator it = *this; node = next(node); return it; }
+        iterator& operator--() { node = node ? prev(node) : last(queue->root); return *this; }
+        iterator operator--(int) { iterator it = *this; --*this; return it; }
+        iterator operator+(difference_type n) const { return queue->at(size_t(difference_type(queue->index(*this)) + n)); }
+        iterator operator-(difference_type n) const { return *this + -n; }
+        difference_type operator-(const iterator& it) const { return difference_type(queue->index(*this)) - difference_type(queue->index(it)); }
+        bool operator==(const iterator& it) const { return node == it.node; }
+        bool operator!=(const iterator& it) const { return node != it.node; }
+    };
+
+    iterator begin() { return iterator(this, first(root)); }
+    iterator end() { return iterator(this, nullptr); }
+    size_t size() const { return count(root); }
+    bool empty() const { return !root; }
+
+    // the transfer at a position, or end()
+    iterator at(size_t position);
+    Transfer* operator[](size_t position) { return *at(position); }
+
+    // position of a transfer (size() for end())
+    size_t index(const iterator&) const;
+
+    // the first transfer with this priority or a later one
+    iterator lower_bound(uint64_t priority);
+
+    // insert a transfer by its priority, which must stay unchanged or keep
+    // the transfer's position while it is queued
+    iterator insert(Transfer*);
+    void erase(iterator);
+
+    // drop all the transfers at once
+    void clear();
+
+    TransferTree() = default;
+    TransferTree(const TransferTree&) = delete;
+    TransferTree& operator=(const TransferTree&) = delete;
+    ~TransferTree();
+};
+
 class MEGA_API TransferList
 {
 public:
@@ -178,6 +365,7 @@ public:
     transfer_list::iterator iterator(Transfer *transfer);
     Transfer *nexttransfer(direction_t direction);
     Transfer *transferat(direction_t direction, unsigned int position);
+    bool isReady(Transfer *transfer);
 
     transfer_list transfers[2];
     MegaClient *client;
@@ -185,8 +373,60 @@ public:
 
 private:
     void prepareIncreasePriority(Transfer *transfer, transfer_list::iterator srcit, transfer_list::iterator dstit, DBTableTransactionCommitter& committer);
-    void prepareDecreasePriority(Transfer *transfer, transfer_list::iterator it, transfer_list::iterator dstit);
-    bool isReady(Transfer *transfer);
+    void prepareDecreasePriority(Transfer *transfer, transfer_list::iterator nextit, transfer_list::iterator dstit);
+    uint64_t makeroom(transfer_list& list, transfer_list::iterator dstit, DBTableTransactionCommitter& committer);
+    uint64_t renumber(transfer_list& list, transfer_list::iterator dstit, DBTableTransactionCommitter& committer);
+    Transfer *scheduledtransfer(direction_t direction);
+    Transfer *smallesttransfer(direction_t direction);
+    Transfer *fairtransfer(direction_t direction);
+    Transfer *quotatransfer(Transfer *scheduled, m_off_t quotaleft);
+};
+
+// decrypted data of the files streamed recently, shared by the DirectReads of the
+// same file, in blocks evicted least recently used first
+struct MEGA_API DirectReadCache
+{
+    static const m_off_t BLOCKSIZE = 1048576;
+
+    // data read ahead after a sequential read (at most a quarter of the cache)
+    static const m_off_t READAHEAD = 4 * BLOCKSIZE;
+
+    // bytes kept at most (0: disabled)
+    void setmaxsize(m_off_t);
+    m_off_t getmaxsize() const { return maxsize; }
+
+    // bytes currently kept
+    m_off_t getsize() const { return size; }
+
+    // cached data of a DirectReadNode handle at a position, up to the end of its block
+    // (NULL if not cached)
+    const byte* find(handle, m_off_t pos, size_t* len);
+
+    // keep data delivered for a handle
+    void store(handle, m_off_t pos, const byte* data, size_t len);
+
+    void clear();
+
+private:
+    typedef pair<handle, m_off_t> BlockKey;
+
+    // a block holds contiguous data from start (relative to the block)
+    struct Block
+    {
+        size_t start;
+        string data;
+        list<BlockKey>::iterator lru_it;
+    };
+
+    map<BlockKey, Block> blocks;
+
+    // most recently used first
+    list<BlockKey> lru;
+
+    m_off_t maxsize = 0;
+    m_off_t size = 0;
+
+    void evict();
 };
 
 struct MEGA_API DirectReadSlot
@@ -199,8 +439,14 @@ struct MEGA_API DirectReadSlot
     static const int TIMEOUT_DS = 100;
     static const int TEMPURL_TIMEOUT_DS = 3000;
 
+    // a large read of a non-raid file is fetched in sub-ranges on parallel connections,
+    // delivered in order: each connection holds at most one sub-range ahead
+    static const unsigned MAX_CONNECTIONS = 4;
+    static const m_off_t SUBRANGE_SIZE = 1048576;
+
     DirectRead* dr;
     std::vector<HttpReq*> reqs;
+    bool parallel;
 
     drs_list::iterator drs_it;
     SpeedController speedController;
@@ -215,6 +461,7 @@ struct MEGA_API DirectReadSlot
 private:
     std::string adjustURLPort(std::string url);
     bool processAnyOutputPieces();
+    RaidBufferManager::FilePiece* nextOutputPiece(unsigned& connectionNum);
 };
 
 struct MEGA_API DirectRead
@@ -236,8 +483,18 @@ struct MEGA_API DirectRead
 
     int reqtag;
 
+    // read ahead into the DirectReadCache only, without an app request behind it
+    bool readahead;
+
     void abort();
 
+    // set up the read when it gets a slot, delivering the cached data first
+    // (false if it finished or the app aborted it: the DirectRead is deleted)
+    bool start();
+
+    // the whole range was delivered: delete the DirectRead and read ahead if sequential
+    void completed();
+
     DirectRead(DirectReadNode*, m_off_t, m_off_t, int, void*);
     ~DirectRead();
 };
@@ -256,6 +513,9 @@ struct MEGA_API DirectReadNode
 
     m_off_t size;
 
+    // end of the last read completed, to detect sequential access
+    m_off_t lastreadend;
+
     class CommandDirectRead* pendingcmd;
 
     int retries;
@@ -278,6 +538,9 @@ struct MEGA_API DirectReadNode
 
     // dispatch all reads
     void dispatch();
+
+    // fetch the next data following a sequential read into the DirectReadCache
+    void readahead(m_off_t pos);
     
     // schedule next event
     void schedule(dstime);
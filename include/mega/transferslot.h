@@ -87,6 +87,71 @@ struct MEGA_API TransferSlot
     int connections;
     HttpReqXfer** reqs;
 
+    // connections that take new requests (all unless the slot is adaptive)
+    int activeconnections;
+
+    // adaptive slots (non-raid, MegaClient::adaptivetransfers) tune the request
+    // size from the duration of the requests, and the connections in use by
+    // probing whether one more (or one less) changes the speed of the slot
+    bool adaptive;
+    vector<dstime> reqstart;
+    dstime adaptds;
+    m_off_t adaptprogress;
+    dstime adaptreqtime;
+    unsigned adaptrequests;
+    unsigned adaptfailures;
+    m_off_t adaptlastspeed;
+    int adaptstep;
+    unsigned adaptholds;
+
+    // measurement interval, request durations considered short/long, bounds
+    static const dstime ADAPT_INTERVAL;
+    static const dstime FAST_REQUEST;
+    static const dstime SLOW_REQUEST;
+    static const unsigned ADAPT_PROBE_INTERVALS;
+    static const m_off_t MIN_ADAPTIVE_REQ_SIZE;
+    static const m_off_t MAX_ADAPTIVE_REQ_SIZE;
+    static const int MAX_ADAPTIVE_CONNECTIONS;
+
+    // evaluate the last interval and adjust the request size and connections
+    void adapt(m_off_t progress);
+
+    // hedged downloads (MegaClient::hedgedownloads): a request still in flight
+    // past the p90 of the recent ones is duplicated, and the copy that completes
+    // first is used (reqstart holds the start of each request, hedgestart of its copy)
+    bool hedging;
+    vector<HttpReqDL*> hedges;
+    vector<dstime> hedgestart;
+    std::deque<dstime> reqtimes;
+
+    // durations kept, needed before hedging, minimum delay, copies in flight per slot
+    static const unsigned HEDGE_SAMPLES;
+    static const unsigned HEDGE_MIN_SAMPLES;
+    static const dstime HEDGE_MIN_DELAY;
+    static const unsigned MAX_HEDGES;
+
+    // upload read-ahead (MegaClient::uploadreadahead): once a connection sends its
+    // request, the range it sends next is read into a buffer of its own
+    struct ReadAhead
+    {
+        AsyncIOContext* io = nullptr;
+        string data;
+    };
+    static const size_t READAHEADMINCAPACITY;
+    vector<ReadAhead> readaheads;
+    void readahead(unsigned i);
+
+    // record the duration of a completed request
+    void requestdone(dstime duration);
+
+    // how long a request can be in flight before it's hedged (0: not yet known)
+    dstime hedgedelay() const;
+
+    // start, resolve (swapping the copy in if it completed first) and drop copies
+    void hedge(unsigned i);
+    void checkhedge(unsigned i);
+    void cancelhedge(unsigned i);
+
     // Manage download input buffers and file output buffers for file download.  Raid-aware, and automatically performs decryption and mac.
     TransferBufferManager transferbuf;
 
@@ -126,6 +191,8 @@ struct MEGA_API TransferSlot
 
 protected:
     void toggleport(HttpReqXfer* req);
+    string connectionurl(const string& tempurl);
+    void retarget(HttpReqXfer* req, const string& tempurl);
     bool tryRaidRecoveryFromHttpGetError(unsigned i);
 
 };
@@ -85,12 +85,6 @@ public:
     TreeProcShareKeys(Node* = NULL);
 };
 
-class MEGA_API TreeProcForeignKeys : public TreeProc
-{
-public:
-    void proc(MegaClient*, Node*);
-};
-
 #ifdef ENABLE_SYNC
 class MEGA_API TreeProcDelSyncGet : public TreeProc
 {
@@ -72,9 +72,12 @@ typedef unsigned char byte;
 
 #include "mega/crypto/sodium.h"
 
+#include <atomic>
+#include <iosfwd>
 #include <memory>
 #include <string>
 #include <chrono>
+#include <unordered_map>
 
 namespace mega {
 
@@ -118,6 +121,7 @@ struct NodeCore;
 class PubKeyAction;
 class Request;
 struct Transfer;
+struct UploadStream;
 class TreeProc;
 class LocalTreeProc;
 struct User;
@@ -125,6 +129,7 @@ struct Waiter;
 struct Proxy;
 struct PendingContactRequest;
 class TransferList;
+class TransientArena;
 struct Achievement;
 namespace UserAlert
 {
@@ -148,7 +153,7 @@ typedef uint32_t dstime;
 #define TOSTRING(x) STRINGIFY(x)
 
 // HttpReq states
-typedef enum { REQ_READY, REQ_PREPARED, REQ_INFLIGHT, REQ_SUCCESS, REQ_FAILURE, REQ_DONE, REQ_ASYNCIO } reqstatus_t;
+typedef enum { REQ_READY, REQ_PREPARED, REQ_INFLIGHT, REQ_SUCCESS, REQ_FAILURE, REQ_DONE, REQ_ASYNCIO, REQ_ENCRYPTING } reqstatus_t;
 
 typedef enum { USER_HANDLE, NODE_HANDLE } targettype_t;
 
@@ -251,6 +256,9 @@ struct Cachable
 {
     virtual bool serialize(string*) = 0;
 
+    // parent handle to index the record by (see DbTable::rewindchildren())
+    virtual bool dbparent(handle*) const { return false; }
+
     int32_t dbid;
 
     bool notified;
@@ -302,6 +310,9 @@ typedef multimap<int32_t, LocalNode*> idlocalnode_map;
 
 typedef set<Node*> node_set;
 
+// file nodes by creation time
+typedef multimap<m_time_t, Node*> recentnode_map;
+
 // enumerates a node's children
 // FIXME: switch to forward_list once C++11 becomes more widely available
 typedef list<Node*> node_list;
@@ -319,7 +330,9 @@ typedef list<HttpReqCommandPutFA*> putfa_list;
 // map a FileFingerprint to the transfer for that FileFingerprint
 typedef map<FileFingerprint*, Transfer*, FileFingerprintCmp> transfer_map;
 
-typedef deque<Transfer*> transfer_list;
+// transfers of one direction in priority order
+class TransferTree;
+typedef TransferTree transfer_list;
 
 // map a request tag with pending dbids of transfers and files
 typedef map<int, vector<uint32_t> > pendingdbid_map;
@@ -334,7 +347,117 @@ typedef map<int, vector<string> > pendingfiles_map;
 typedef map<handle, Transfer*> handletransfer_map;
 
 // maps node handles to Node pointers
-typedef map<handle, Node*> node_map;
+// open addressing (linear probing) over one contiguous array of handle/Node*
+// pairs, so that a lookup usually touches a single cache line.
+// iteration order is unspecified, and the map must not be modified while iterating.
+class MEGA_API node_map
+{
+public:
+    typedef pair<handle, Node*> value_type;
+
+    template<class V>
+    class basic_iterator
+    {
+        V* mSlot = nullptr;
+        V* mEnd = nullptr;
+
+        void skipfree()
+        {
+            while (mSlot != mEnd && ISUNDEF(mSlot->first))
+            {
+                ++mSlot;
+            }
+        }
+
+        template<class W> friend class basic_iterator;
+
+    public:
+        basic_iterator() { }
+        basic_iterator(V* slot, V* end) : mSlot(slot), mEnd(end) { skipfree(); }
+
+        // iterator -> const_iterator
+        template<class W>
+        basic_iterator(const basic_iterator<W>& it) : mSlot(it.mSlot), mEnd(it.mEnd) { }
+
+        V& operator*() const { return *mSlot; }
+        V* operator->() const { return mSlot; }
+        basic_iterator& operator++() { ++mSlot; skipfree(); return *this; }
+        basic_iterator operator++(int) { basic_iterator it = *this; ++*this; return it; }
+        bool operator==(const basic_iterator& o) const { return mSlot == o.mSlot; }
+        bool operator!=(const basic_iterator& o) const { return mSlot != o.mSlot; }
+    };
+
+    typedef basic_iterator<value_type> iterator;
+    typedef basic_iterator<const value_type> const_iterator;
+
+    iterator begin() { return iterator(mSlots.data(), mSlots.data() + mSlots.size()); }
+    iterator end() { return iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+    const_iterator begin() const { return const_iterator(mSlots.data(), mSlots.data() + mSlots.size()); }
+    const_iterator end() const { return const_iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+
+    iterator find(handle h)
+    {
+        size_t i = lookup(h);
+        return i == NOTFOUND ? end() : iterator(mSlots.data() + i, mSlots.data() + mSlots.size());
+    }
+
+    const_iterator find(handle h) const
+    {
+        size_t i = lookup(h);
+        return i == NOTFOUND ? end() : const_iterator(mSlots.data() + i, mSlots.data() + mSlots.size());
+    }
+
+    // inserts a NULL entry if the handle is not present yet
+    Node*& operator[](handle h);
+
+    size_t erase(handle h);
+    void clear();
+    void reserve(size_t n);
+
+    size_t size() const { return mCount; }
+    bool empty() const { return !mCount; }
+
+    // bytes allocated for the slots
+    size_t memoryusage() const { return mSlots.capacity() * sizeof(value_type); }
+
+private:
+    static const size_t NOTFOUND = ~(size_t)0;
+
+    // free slots have an UNDEF handle; capacity is zero or a power of two
+    vector<value_type> mSlots;
+    size_t mCount = 0;
+
+    size_t home(handle h) const
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return size_t(h) & (mSlots.size() - 1);
+    }
+
+    size_t lookup(handle h) const
+    {
+        if (!mCount || ISUNDEF(h))
+        {
+            return NOTFOUND;
+        }
+
+        for (size_t i = home(h); ; i = (i + 1) & (mSlots.size() - 1))
+        {
+            if (mSlots[i].first == h)
+            {
+                return i;
+            }
+
+            if (ISUNDEF(mSlots[i].first))
+            {
+                return NOTFOUND;
+            }
+        }
+    }
+
+    void rehash(size_t capacity);
+};
 
 struct NodeCounter
 {
@@ -358,6 +481,18 @@ typedef list<struct NewShare*> newshare_list;
 // generic handle vector
 typedef vector<handle> handle_vector;
 
+// encrypted database record, as stored by DbTable::putrecord()
+struct DbRecord
+{
+    uint32_t id = 0;
+    string data;
+
+    // obfuscated parent handle (see DbTable::parentkey())
+    bool hasparent = false;
+    int64_t parent = 0;
+};
+typedef vector<DbRecord> dbrecord_vector;
+
 // pairs of node handles
 typedef set<pair<handle, handle> > handlepair_set;
 
@@ -384,6 +519,13 @@ typedef map<int, FileAttributeFetchChannel*> fafc_map;
 // transfer type
 typedef enum { GET = 0, PUT, API, NONE } direction_t;
 
+// order in which queued transfers get a slot
+typedef enum {
+    TRANSFERSCHEDULE_PRIORITY = 0,  // queue order, few concurrent transfers
+    TRANSFERSCHEDULE_SMALLFIRST,    // smallest first, as many concurrent transfers as allowed
+    TRANSFERSCHEDULE_FAIR           // slots shared by transfer class, according to its weight
+} transferschedule_t;
+
 struct StringCmp
 {
     bool operator()(const string* a, const string* b) const
@@ -397,7 +539,128 @@ typedef multimap<dstime, DirectReadNode*> dsdrn_map;
 typedef list<DirectRead*> dr_list;
 typedef list<DirectReadSlot*> drs_list;
 
-typedef map<const string*, LocalNode*, StringCmp> localnode_map;
+// maps child names to LocalNode pointers
+// two sorted runs in one contiguous array instead of a tree node per child: new
+// names go into the (short) second run, which is merged into the first once it
+// outgrows the square root of the total, so lookups stay logarithmic without
+// shifting the whole directory on every insertion. erased entries are turned
+// into tombstones until the next insertion, so erasing while iterating (even
+// the current entry) doesn't disturb the iteration, as with a map; inserting
+// invalidates all iterators. iteration order is unspecified.
+class MEGA_API localnode_map
+{
+public:
+    typedef pair<const string*, LocalNode*> value_type;
+
+    template<class V>
+    class basic_iterator
+    {
+        V* mSlot = nullptr;
+        V* mEnd = nullptr;
+
+        void skiperased()
+        {
+            while (mSlot != mEnd && !mSlot->second)
+            {
+                ++mSlot;
+            }
+        }
+
+        template<class W> friend class basic_iterator;
+
+    public:
+        basic_iterator() { }
+        basic_iterator(V* slot, V* end) : mSlot(slot), mEnd(end) { skiperased(); }
+
+        // iterator -> const_iterator
+        template<class W>
+        basic_iterator(const basic_iterator<W>& it) : mSlot(it.mSlot), mEnd(it.mEnd) { }
+
+        V& operator*() const { return *mSlot; }
+        V* operator->() const { return mSlot; }
+        basic_iterator& operator++() { ++mSlot; skiperased(); return *this; }
+        basic_iterator operator++(int) { basic_iterator it = *this; ++*this; return it; }
+        bool operator==(const basic_iterator& o) const { return mSlot == o.mSlot; }
+        bool operator!=(const basic_iterator& o) const { return mSlot != o.mSlot; }
+    };
+
+    typedef basic_iterator<value_type> iterator;
+    typedef basic_iterator<const value_type> const_iterator;
+
+    iterator begin() { return iterator(mSlots.data(), mSlots.data() + mSlots.size()); }
+    iterator end() { return iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+    const_iterator begin() const { return const_iterator(mSlots.data(), mSlots.data() + mSlots.size()); }
+    const_iterator end() const { return const_iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+
+    iterator find(const string* name)
+    {
+        size_t i = lookup(name);
+        return i == NOTFOUND ? end() : iterator(mSlots.data() + i, mSlots.data() + mSlots.size());
+    }
+
+    const_iterator find(const string* name) const
+    {
+        size_t i = lookup(name);
+        return i == NOTFOUND ? end() : const_iterator(mSlots.data() + i, mSlots.data() + mSlots.size());
+    }
+
+    // inserts a NULL entry if the name is not present yet
+    LocalNode*& operator[](const string* name);
+
+    size_t erase(const string* name);
+    void erase(iterator it);
+    void clear();
+
+    size_t size() const { return mCount; }
+    bool empty() const { return !mCount; }
+
+    // bytes allocated for the slots
+    size_t memoryusage() const { return mSlots.capacity() * sizeof(value_type); }
+
+private:
+    static const size_t NOTFOUND = ~(size_t)0;
+
+    // the first run is [0, mSorted), the second one [mSorted, end);
+    // tombstones have NULL name and node
+    vector<value_type> mSlots;
+    size_t mSorted = 0;
+    size_t mCount = 0;
+
+    size_t lowerbound(size_t lo, size_t hi, const string* name) const;
+    size_t lookup(const string* name) const;
+    size_t lookup(size_t lo, size_t hi, const string* name) const;
+    void compact();
+};
+
+// (parent, name) -> LocalNode* over the local trees of all syncs, so that
+// resolving a path costs one hash probe per component instead of a search of
+// each directory level. the name points to the child's own (short) localname,
+// so an entry must be removed before that name changes.
+struct LocalNodeKey
+{
+    const LocalNode* parent;
+    const string* name;
+    bool shortname;
+};
+
+struct LocalNodeKeyHash
+{
+    size_t operator()(const LocalNodeKey& k) const
+    {
+        return std::hash<string>()(*k.name) ^ (std::hash<const void*>()(k.parent) * 31) ^ k.shortname;
+    }
+};
+
+struct LocalNodeKeyEq
+{
+    bool operator()(const LocalNodeKey& a, const LocalNodeKey& b) const
+    {
+        return a.parent == b.parent && a.shortname == b.shortname && *a.name == *b.name;
+    }
+};
+
+typedef std::unordered_map<LocalNodeKey, LocalNode*, LocalNodeKeyHash, LocalNodeKeyEq> localnode_index;
+
 typedef map<const string*, Node*, StringCmp> remotenode_map;
 
 typedef enum { TREESTATE_NONE = 0, TREESTATE_SYNCED, TREESTATE_PENDING, TREESTATE_SYNCING } treestate_t;
@@ -411,6 +674,12 @@ struct Notification
     dstime timestamp;
     string path;
     LocalNode* localnode;
+
+    // full path that repeated notifications are coalesced under (empty if none)
+    string fullpath;
+
+    // rescan the children of the folder at path (a full path)
+    bool rescan = false;
 };
 
 typedef deque<Notification> notify_deque;
@@ -595,19 +864,83 @@ namespace CodeCounter
     // Some classes that allow us to easily measure the number of times a block of code is called, and the sum of the time it takes.
     // Only enabled if MEGA_MEASURE_CODE is turned on.
     // Usage generally doesn't need to be protected by the macro as the classes and methods will be empty when not enabled.
+    //
+    // In all builds, the durations of one run in every LatencySampler::interval (0: never, the default)
+    // are also recorded in a histogram, for percentiles. Switched at runtime, and cheap enough to leave on.
 
     using namespace std::chrono;
 
+    struct MEGA_API LatencySampler
+    {
+        // log2-spaced microsecond ranges, each split in SUBBUCKETS linear ones (at most 25% wide)
+        static const int SUBBUCKETS = 4;
+        static const int BUCKETS = 36 * SUBBUCKETS;
+
+        // process-wide, every interval-th run is timed
+        static std::atomic<unsigned> interval;
+
+        // whether this run is to be timed. The counter isn't incremented atomically:
+        // a run missed by concurrent callers only shifts the sampling
+        inline bool sample()
+        {
+            unsigned n = interval.load(std::memory_order_relaxed);
+            if (!n)
+            {
+                return false;
+            }
+            uint64_t c = calls.load(std::memory_order_relaxed);
+            calls.store(c + 1, std::memory_order_relaxed);
+            return !(c % n);
+        }
+
+        void add(high_resolution_clock::duration d);
+
+        // estimated duration in microseconds below which a fraction p of the samples are
+        uint64_t percentile(double p) const;
+
+        // number of timed runs
+        uint64_t samples() const;
+
+        // {"samples":n,"p50us":...,"p99us":...,"maxus":...}
+        void tojson(std::ostream&) const;
+        void reset();
+
+        LatencySampler();
+
+    private:
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> maxus;
+        std::atomic<uint64_t> counts[BUCKETS];
+
+        static int bucket(uint64_t us);
+        static uint64_t bucketmid(int bucket);
+    };
+
     struct ScopeStats
     {
+        std::string name;
+        LatencySampler sampler;
+
 #ifdef MEGA_MEASURE_CODE
         uint64_t count = 0;
         uint64_t starts = 0;
         uint64_t finishes = 0;
         high_resolution_clock::duration timeSpent{};
-        std::string name;
         ScopeStats(std::string s) : name(std::move(s)) {}
 
+        // account one run of a block that isn't timed by a ScopeTimer (eg. overlapping ones)
+        inline void add(high_resolution_clock::duration d)
+        {
+            ++count;
+            ++starts;
+            ++finishes;
+            timeSpent += d;
+            if (sampler.sample())
+            {
+                sampler.add(d);
+            }
+        }
+
         inline string report(bool reset = false) 
         { 
             string s = " " + name + ": " + std::to_string(count) + " " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(timeSpent).count()); 
@@ -621,7 +954,15 @@ namespace CodeCounter
             return s;
         }
 #else
-        ScopeStats(std::string s) {}
+        ScopeStats(std::string s) : name(std::move(s)) {}
+
+        inline void add(high_resolution_clock::duration d)
+        {
+            if (sampler.sample())
+            {
+                sampler.add(d);
+            }
+        }
 #endif
     };
 
@@ -651,20 +992,41 @@ namespace CodeCounter
 #ifdef MEGA_MEASURE_CODE
         ScopeStats& scope;
         high_resolution_clock::time_point blockStart;
+        bool sampled;
 
-        ScopeTimer(ScopeStats& sm) : scope(sm), blockStart(high_resolution_clock::now())
+        ScopeTimer(ScopeStats& sm) : scope(sm), blockStart(high_resolution_clock::now()), sampled(sm.sampler.sample())
         {
             ++scope.starts;
         }
         ~ScopeTimer()
         {
+            high_resolution_clock::duration d = high_resolution_clock::now() - blockStart;
             ++scope.count;
             ++scope.finishes;
-            scope.timeSpent += high_resolution_clock::now() - blockStart;
+            scope.timeSpent += d;
+            if (sampled)
+            {
+                scope.sampler.add(d);
+            }
         }
 #else
-        ScopeTimer(ScopeStats& sm)
+        // only the sampled runs read the clock
+        ScopeStats* scope;
+        high_resolution_clock::time_point blockStart;
+
+        ScopeTimer(ScopeStats& sm) : scope(sm.sampler.sample() ? &sm : nullptr)
+        {
+            if (scope)
+            {
+                blockStart = high_resolution_clock::now();
+            }
+        }
+        ~ScopeTimer()
         {
+            if (scope)
+            {
+                scope->sampler.add(high_resolution_clock::now() - blockStart);
+            }
         }
 #endif
     };
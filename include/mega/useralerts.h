@@ -270,9 +270,20 @@ private:
     bool notingSharedNodes;
     handle ignoreNodesUnderShare;
 
+    // the latest NewSharedNodes alert of each user and folder, the next ones are merged into
+    map<pair<handle, handle>, UserAlert::NewSharedNodes*> lastSharedNodes;
+
     bool isUnwantedAlert(nameid type, int action);
 
+    // drop the oldest alert
+    void evict();
+
 public:
+    // alerts kept, the oldest ones are dropped beyond that
+    static const size_t MAXALERTS = 1000;
+
+    // NewSharedNodes alerts of the same user and folder within this time are merged
+    static const m_time_t MERGEINTERVAL = 300;
 
     // This is a separate class to encapsulate some MegaClient functionality
     // but it still needs to interact with other elements.
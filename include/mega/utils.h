@@ -337,6 +337,96 @@ private:
     ~TLVstore();
 };
 
+// Bump allocator for the short-lived objects of one iteration of the
+// client's loop (values copied out of action packets and responses, their
+// temporary lists). Memory is handed out from large blocks and reclaimed all
+// at once by reset(), so nothing allocated from it may outlive that call, and
+// destructors aren't run. Not thread-safe: use it from the SDK thread only.
+class MEGA_API TransientArena
+{
+public:
+    struct Stats
+    {
+        uint64_t allocations = 0;   // objects handed out
+        uint64_t bytes = 0;         // bytes handed out
+        uint64_t blocks = 0;        // blocks taken from the heap
+        size_t peak = 0;            // most bytes in use before a reset
+    };
+
+    // whatever is allocated while it exists is released when it goes out of
+    // scope, for loops that would otherwise grow the arena per element
+    class Scope
+    {
+    public:
+        explicit Scope(TransientArena& arena)
+            : mArena(arena), mCurrent(arena.mCurrent), mUsed(arena.mUsed), mFilled(arena.mFilled) { }
+
+        ~Scope()
+        {
+            mArena.mCurrent = mCurrent;
+            mArena.mUsed = mUsed;
+            mArena.mFilled = mFilled;
+        }
+
+    private:
+        TransientArena& mArena;
+        size_t mCurrent, mUsed, mFilled;
+    };
+
+    static const size_t BLOCKSIZE = 64 * 1024;
+
+    TransientArena() = default;
+    TransientArena(const TransientArena&) = delete;
+    TransientArena& operator=(const TransientArena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    // NUL-terminated copy of len bytes
+    char* copy(const char* data, size_t len);
+
+    // release everything, keeping the first block for the next iteration,
+    // and add what was allocated since the previous reset to totals
+    void reset(Stats* totals = nullptr);
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> mBlocks;
+    size_t mCurrent = 0;    // block being filled
+    size_t mUsed = 0;       // bytes used in it
+    size_t mFilled = 0;     // bytes of the blocks before it
+    Stats mStats;
+};
+
+// STL allocator on a TransientArena, e.g. for the temporary lists of one
+// action packet; deallocation is a no-op
+template<class T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    TransientArena* arena;
+
+    explicit ArenaAllocator(TransientArena& a) : arena(&a) { }
+    template<class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) { }
+
+    template<class U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<class U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template<class T> using transient_vector = std::vector<T, ArenaAllocator<T> >;
+
 class Utils {
 public:
     /**
@@ -463,6 +553,47 @@ struct CacheableReader
     void eraseused(string& d); // must be the same string, unchanged
 };
 
+// approximate heap memory of strings and standard containers, for
+// MegaClient::memoryusage(); the bookkeeping per element of node-based
+// containers is the usual one (tree links and color, list links)
+struct MemoryUsage
+{
+    static const size_t TREENODE = 4 * sizeof(void*);
+    static const size_t LISTNODE = 2 * sizeof(void*);
+
+    // nothing for strings short enough to be stored in the object itself
+    static size_t of(const string& s)
+    {
+        uintptr_t data = reinterpret_cast<uintptr_t>(s.data());
+        uintptr_t object = reinterpret_cast<uintptr_t>(&s);
+        return data >= object && data < object + sizeof s ? 0 : s.capacity() + 1;
+    }
+
+    template<typename Map>
+    static size_t tree(const Map& m)
+    {
+        return m.size() * (TREENODE + sizeof(typename Map::value_type));
+    }
+
+    template<typename List>
+    static size_t list(const List& l)
+    {
+        return l.size() * (LISTNODE + sizeof(typename List::value_type));
+    }
+
+    template<typename HashMap>
+    static size_t hash(const HashMap& m)
+    {
+        return m.size() * (LISTNODE + sizeof(typename HashMap::value_type)) + m.bucket_count() * sizeof(void*);
+    }
+
+    template<typename Vector>
+    static size_t vector(const Vector& v)
+    {
+        return v.capacity() * sizeof(typename Vector::value_type);
+    }
+};
+
 template<typename T, typename U>
 void hashCombine(T& seed, const U& v)
 {
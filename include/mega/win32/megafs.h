@@ -34,7 +34,7 @@ struct MEGA_API WinDirAccess : public DirAccess
 
 public:
     bool dopen(string*, FileAccess*, bool) override;
-    bool dnext(string*, string*, bool, nodetype_t*) override;
+    bool dnext(string*, string*, bool, nodetype_t*, NotifyAttributes*) override;
 
     WinDirAccess();
     virtual ~WinDirAccess();
@@ -61,6 +61,7 @@ public:
 
     bool renamelocal(string*, string*, bool) override;
     bool copylocal(string*, string*, m_time_t) override;
+    bool linklocal(string*, string*) override;
     bool unlinklocal(string*) override;
     bool rmdirlocal(string*) override;
     bool mkdirlocal(string*, bool) override;
@@ -86,6 +87,24 @@ public:
     std::set<WinDirNotify*> dirnotifys;
 };
 
+// one of the reads of change notifications queued for a WinDirNotify
+struct MEGA_API WinDirNotifyRead : public OVERLAPPED
+{
+    WinDirNotify* dirnotify;
+
+    // the directory handle it was queued on
+    HANDLE hDirectory;
+
+    // FILE_NOTIFY_EXTENDED_INFORMATION entries instead of FILE_NOTIFY_INFORMATION
+    bool extended;
+
+    string buffer;
+    DWORD dwBytes;
+
+    // position of the USN journal when it was queued (empty without journal)
+    string journalmark;
+};
+
 struct MEGA_API WinDirNotify : public DirNotify
 {
     WinFileSystemAccess* fsaccess;
@@ -96,35 +115,68 @@ struct MEGA_API WinDirNotify : public DirNotify
 
     HANDLE hDirectory;
 
-    bool enabled;
+    // reads queued at all times, so that one is still pending while the
+    // results of another are processed
+    static const int NUMREADS = 3;
+
+    // size of the read buffers: it grows after each overflow, up to the
+    // maximum (network shares don't take more than the minimum)
+    static const DWORD MINBUFFERSIZE = 65534;
+    static const DWORD INITIALBUFFERSIZE = 262144;
+    static const DWORD MAXBUFFERSIZE = 4194304;
+    DWORD buffersize;
+
+    // reads queued and not completed yet (also on replaced handles)
+    int pending;
+
     bool exit;
-    int active;
-    string notifybuf[2];
 
-    DWORD dwBytes;
-    OVERLAPPED overlapped;
+    // ReadDirectoryChangesExW with extended information is used if available
+    bool extended;
+
+    // handle to the volume to read the USN journal position, with which the
+    // changes lost by an overflow are recovered (needs an elevated process)
+    HANDLE hJournalVolume;
+
+    // journal position when the last successfully completed read was queued:
+    // the changes lost by an overflow happened later
+    string journalmark;
 
     void addnotify(LocalNode*, string*) override;
 
     static VOID CALLBACK completion(DWORD dwErrorCode, DWORD dwBytes, LPOVERLAPPED lpOverlapped);
-    void process(DWORD wNumberOfBytesTransfered);
-    void readchanges();
+    void process(WinDirNotifyRead*, DWORD wNumberOfBytesTransfered);
+    void overflow();
+    void readchanges(WinDirNotifyRead*);
+    bool reopen();
 
     fsfp_t fsfingerprint() const override;
     bool fsstableids() const override;
 
+    // USN journal of the volume (needs an elevated process)
+    bool journalposition(string*) override;
+    bool journalchanges(const string&) override;
+
     WinDirNotify(string*, string*);
     ~WinDirNotify();
 };
 
 #ifndef WINDOWS_PHONE
+struct WinAsyncIOContext;
+
+// the OVERLAPPED of an async operation, leading back to it on completion
+struct MEGA_API WinAsyncOverlapped : public OVERLAPPED
+{
+    WinAsyncIOContext *context;
+};
+
 struct MEGA_API WinAsyncIOContext : public AsyncIOContext
 {
     WinAsyncIOContext();
     virtual ~WinAsyncIOContext();
     virtual void finish();
 
-    OVERLAPPED *overlapped;
+    WinAsyncOverlapped *overlapped;
 };
 #endif
 
@@ -132,6 +184,9 @@ class MEGA_API WinFileAccess : public FileAccess
 {
     HANDLE hFile;
 
+    // hFile completes its async operations through the I/O completion port
+    bool completionport;
+
 public:
     HANDLE hFind;
     WIN32_FIND_DATAW ffd;
@@ -158,6 +213,11 @@ public:
     WinFileAccess(Waiter *w);
     ~WinFileAccess();
 
+#ifndef WINDOWS_PHONE
+    // from the thread of the I/O completion port, or as an APC on the SDK thread
+    static void asyncopcompleted(WinAsyncIOContext *context, DWORD error, DWORD transferred);
+#endif
+
 protected:
 #ifndef WINDOWS_PHONE
     AsyncIOContext* newasynccontext() override;
@@ -165,6 +225,10 @@ protected:
             DWORD        dwErrorCode,
             DWORD        dwNumberOfBytesTransfered,
             LPOVERLAPPED lpOverlapped);
+
+    // associate a handle just opened for async operations with the completion port
+    void bindcompletionport();
+    bool startasyncop(WinAsyncIOContext *context, bool write);
 #endif
 };
 } // namespace
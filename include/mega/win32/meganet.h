@@ -19,9 +19,14 @@
  * program.
  */
 
+#ifndef MEGA_WIN32_NET_H
+#define MEGA_WIN32_NET_H 1
+
+// builds with cURL (wincurl) offer this layer too, chosen at runtime
 #ifndef HTTPIO_CLASS
 #define HTTPIO_CLASS WinHttpIO
 #define DONT_RELEASE_HTTPIO
+#endif
 
 #include "zlib.h"
 #include "mega.h"
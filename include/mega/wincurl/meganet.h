@@ -1,6 +1,6 @@
 /**
  * @file mega/wincurl/meganet.h
- * @brief POSIX network access layer (using cURL)
+ * @brief Windows network access layer (using cURL, WinHTTP selectable at runtime)
  *
  * (c) 2013-2015 by Mega Limited, Wellsford, New Zealand
  *
@@ -20,3 +20,7 @@
  */
 
 #include "mega/posix/meganet.h"
+
+#ifndef WINDOWS_PHONE
+#include "mega/win32/meganet.h"
+#endif
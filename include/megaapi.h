@@ -69,8 +69,12 @@ class MegaEvent;
 class MegaTransfer;
 class MegaBackup;
 class MegaSync;
+class MegaSyncStats;
 class MegaStringList;
 class MegaNodeList;
+class MegaNodeChangeList;
+class MegaNodeSnapshot;
+class MegaSharedNodeTree;
 class MegaUserList;
 class MegaUserAlertList;
 class MegaContactRequestList;
@@ -80,7 +84,9 @@ class MegaFolderInfo;
 class MegaTimeZoneDetails;
 class MegaPushNotificationSettings;
 class MegaBackgroundMediaUpload;
+class MegaBackgroundTransferHandler;
 class MegaCancelToken;
+class MegaUploadBatch;
 class MegaApi;
 
 class MegaSemaphore;
@@ -2334,6 +2340,436 @@ class MegaNodeList
          * @param node MegaNode to be added. The node inserted is a copy from 'node'
          */
         virtual void addNode(MegaNode* node);
+
+        /**
+         * @brief Copies the handles of the nodes in the list to an array
+         *
+         * This function and the other bulk getters of this class read a whole column of
+         * the list in one call. From the bindings, that is much cheaper than calling
+         * MegaNodeList::get and a getter of MegaNode for each node. In Java and Python, the
+         * array is passed alone and its length is the count.
+         *
+         * The nodes that don't exist anymore get INVALID_HANDLE.
+         *
+         * @param handles Array to receive the handles, in the order of the list
+         * @param count Number of elements of the array
+         * @return Number of elements copied: the smallest of count and the size of the list
+         */
+        virtual int getHandles(MegaHandle *handles, int count) const;
+
+        /**
+         * @brief Copies the sizes of the nodes in the list to an array
+         *
+         * The values are the ones of MegaNode::getSize. The nodes that don't exist
+         * anymore get -1.
+         *
+         * @param sizes Array to receive the sizes, in the order of the list
+         * @param count Number of elements of the array
+         * @return Number of elements copied: the smallest of count and the size of the list
+         * @see MegaNodeList::getHandles
+         */
+        virtual int getSizes(int64_t *sizes, int count) const;
+
+        /**
+         * @brief Copies the modification times of the nodes in the list to an array
+         *
+         * The values are the ones of MegaNode::getModificationTime. The nodes that don't
+         * exist anymore get -1.
+         *
+         * @param mtimes Array to receive the modification times, in the order of the list
+         * @param count Number of elements of the array
+         * @return Number of elements copied: the smallest of count and the size of the list
+         * @see MegaNodeList::getHandles
+         */
+        virtual int getModificationTimes(int64_t *mtimes, int count) const;
+
+        /**
+         * @brief Copies the types of the nodes in the list to an array
+         *
+         * The values are the ones of MegaNode::getType. The nodes that don't exist
+         * anymore get MegaNode::TYPE_UNKNOWN.
+         *
+         * @param types Array to receive the types, in the order of the list
+         * @param count Number of elements of the array
+         * @return Number of elements copied: the smallest of count and the size of the list
+         * @see MegaNodeList::getHandles
+         */
+        virtual int getTypes(int *types, int count) const;
+
+        /**
+         * @brief Copies the names of the nodes in the list to a buffer, in UTF-8
+         *
+         * The names are concatenated, without separators nor terminating NULL characters.
+         * offsets[i] is where the name of the node at the position i starts in the buffer,
+         * and offsets[size()] is the length of all the names: offsets needs size() + 1
+         * elements to receive all of them.
+         *
+         * A buffer too small to receive all the names gets only the ones that fit. Call
+         * this function with a NULL buffer first to get the size to allocate.
+         *
+         * The nodes that don't exist anymore get an empty name.
+         *
+         * @param names Buffer to receive the names, or NULL
+         * @param namesSize Size of the buffer
+         * @param offsets Array to receive the offsets of the names, or NULL
+         * @param count Number of elements of the array of offsets
+         * @return Length of all the names, in bytes
+         * @see MegaNodeList::getHandles
+         */
+        virtual int getNames(char *names, int namesSize, int *offsets, int count) const;
+};
+
+/**
+ * @brief List of changed nodes, by handle
+ *
+ * Each element is the handle of a new, updated or removed node and the changes
+ * of that node, as a bit field of MegaNode::CHANGE_TYPE_* values. It doesn't
+ * contain MegaNode objects: use MegaApi::getNodeByHandle to get the current
+ * state of the nodes that still exist.
+ *
+ * Objects of this class are immutable.
+ *
+ * @see MegaListener::onNodesChanged, MegaApi::enableCompactNodeUpdates
+ */
+class MegaNodeChangeList
+{
+    protected:
+        MegaNodeChangeList();
+
+    public:
+        virtual ~MegaNodeChangeList();
+
+        /**
+         * @brief Creates a copy of this MegaNodeChangeList object
+         *
+         * You are the owner of the returned object
+         *
+         * @return Copy of the MegaNodeChangeList object
+         */
+        virtual MegaNodeChangeList *copy() const;
+
+        /**
+         * @brief Returns the handle of the node at the position i in the list
+         *
+         * If the index is >= the size of the list, this function returns INVALID_HANDLE.
+         *
+         * @param i Position in the list
+         * @return Handle of the node
+         */
+        virtual MegaHandle getHandle(int i) const;
+
+        /**
+         * @brief Returns the changes of the node at the position i in the list
+         *
+         * If the index is >= the size of the list, this function returns 0.
+         *
+         * @param i Position in the list
+         * @return Bit field of MegaNode::CHANGE_TYPE_* values
+         * @see MegaNode::getChanges
+         */
+        virtual int getChanges(int i) const;
+
+        /**
+         * @brief Returns the number of nodes in the list
+         * @return Number of nodes in the list
+         */
+        virtual int size() const;
+};
+
+/**
+ * @brief Consistent copy of the basic data of a tree of nodes
+ *
+ * The snapshot is taken in one step, so all its entries belong to the same
+ * state of the account, identified by its generation. Apps that keep their own
+ * index of the cloud tree can load it from a snapshot and then keep it current
+ * with MegaApi::getNodeChangesSince.
+ *
+ * Parents come before their children. The data is kept in one contiguous buffer,
+ * available through MegaNodeSnapshot::getBuffer for apps that parse it themselves.
+ *
+ * The name, modification time and fingerprint of the nodes that are still in the local
+ * cache only (see MegaApi::enableLazyNodeLoading) are read on first access. If such a node
+ * changes before that, its entry may already have the new values: the change is
+ * reported by MegaApi::getNodeChangesSince anyway.
+ *
+ * Objects of this class are immutable.
+ *
+ * @see MegaApi::getNodeSnapshot
+ */
+class MegaNodeSnapshot
+{
+    protected:
+        MegaNodeSnapshot();
+
+    public:
+        virtual ~MegaNodeSnapshot();
+
+        /**
+         * @brief Creates a copy of this MegaNodeSnapshot object
+         *
+         * You are the owner of the returned object
+         *
+         * @return Copy of the MegaNodeSnapshot object
+         */
+        virtual MegaNodeSnapshot *copy() const;
+
+        /**
+         * @brief Returns the generation of the nodes when the snapshot was taken
+         *
+         * Pass it to MegaApi::getNodeChangesSince to get the changes made after the snapshot.
+         *
+         * @return Generation of the snapshot
+         */
+        virtual long long getGeneration() const;
+
+        /**
+         * @brief Returns the sequence number of the account when the snapshot was taken
+         *
+         * The MegaNodeSnapshot keeps the ownership of the returned value.
+         *
+         * @return Sequence number, as returned by MegaApi::getSequenceNumber
+         */
+        virtual const char *getSequenceNumber() const;
+
+        /**
+         * @brief Returns the number of nodes in the snapshot
+         * @return Number of nodes
+         */
+        virtual int size() const;
+
+        /**
+         * @brief Returns the handle of the node at the position i
+         *
+         * If the index is >= the size of the snapshot, this function returns INVALID_HANDLE.
+         *
+         * @param i Position in the snapshot
+         * @return Handle of the node
+         */
+        virtual MegaHandle getHandle(int i) const;
+
+        /**
+         * @brief Returns the handle of the parent of the node at the position i
+         *
+         * If the index is >= the size of the snapshot, this function returns INVALID_HANDLE.
+         *
+         * @param i Position in the snapshot
+         * @return Handle of the parent node, INVALID_HANDLE for root nodes
+         */
+        virtual MegaHandle getParentHandle(int i) const;
+
+        /**
+         * @brief Returns the type of the node at the position i
+         *
+         * If the index is >= the size of the snapshot, this function returns MegaNode::TYPE_UNKNOWN.
+         *
+         * @param i Position in the snapshot
+         * @return Type of the node (MegaNode::TYPE_*)
+         */
+        virtual int getType(int i) const;
+
+        /**
+         * @brief Returns the size of the node at the position i
+         *
+         * @param i Position in the snapshot
+         * @return Size of the node (as MegaNode::getSize), 0 for invalid indexes
+         */
+        virtual int64_t getSize(int i) const;
+
+        /**
+         * @brief Returns the modification time of the node at the position i
+         *
+         * @param i Position in the snapshot
+         * @return Modification time of the node (as MegaNode::getModificationTime), 0 for invalid indexes
+         */
+        virtual int64_t getModificationTime(int i) const;
+
+        /**
+         * @brief Returns the name of the node at the position i
+         *
+         * The MegaNodeSnapshot keeps the ownership of the returned value.
+         *
+         * @param i Position in the snapshot
+         * @return Name of the node, NULL for invalid indexes
+         */
+        virtual const char *getName(int i) const;
+
+        /**
+         * @brief Returns the fingerprint of the node at the position i
+         *
+         * The MegaNodeSnapshot keeps the ownership of the returned value.
+         *
+         * @param i Position in the snapshot
+         * @return Fingerprint of the file (as MegaNode::getFingerprint), NULL if it has none
+         */
+        virtual const char *getFingerprint(int i) const;
+
+        /**
+         * @brief Returns the buffer with the data of the snapshot
+         *
+         * The buffer starts with one record of 48 bytes per node, in the order of the
+         * snapshot and with the byte order of the platform:
+         * - handle (8 bytes)
+         * - parent handle (8 bytes)
+         * - size (8 bytes, signed)
+         * - modification time (8 bytes, signed)
+         * - offset of the name (4 bytes, unsigned)
+         * - offset of the fingerprint (4 bytes, unsigned, 0 if none)
+         * - type (4 bytes, signed)
+         * - reserved (4 bytes)
+         *
+         * The offsets are relative to the start of the buffer, and point to the
+         * NUL-terminated strings that follow the records.
+         *
+         * The MegaNodeSnapshot keeps the ownership of the returned value.
+         *
+         * @return Buffer with the data of the snapshot
+         */
+        virtual const char *getBuffer() const;
+
+        /**
+         * @brief Returns the size of the buffer with the data of the snapshot
+         * @return Size of the buffer in bytes
+         * @see MegaNodeSnapshot::getBuffer
+         */
+        virtual size_t getBufferSize() const;
+};
+
+/**
+ * @brief Read-only view of the node tree exported by another process
+ *
+ * Helper processes, like the extension of a file manager, can answer queries about
+ * the nodes of the account from the node tree that the main app exports with
+ * MegaApi::startNodeTreeExport, without a MegaApi of their own and without asking the
+ * main app for each query. The view is kept in shared memory by the main app: the
+ * helper only builds an index of it.
+ *
+ * The view doesn't change by itself: call MegaSharedNodeTree::refresh to pick up the
+ * changes made since the last call, for example before answering each query.
+ *
+ * The nodes are the ones of the Cloud Drive, the Inbox and the Rubbish Bin, with the
+ * data of MegaNodeSnapshot.
+ *
+ * This class isn't available on Android.
+ */
+class MegaSharedNodeTree
+{
+    protected:
+        MegaSharedNodeTree();
+
+    public:
+        /**
+         * @brief Open the node tree exported by another process
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param name Name passed to MegaApi::startNodeTreeExport
+         * @return View of the node tree, or NULL if there is no export with that name
+         */
+        static MegaSharedNodeTree *open(const char *name);
+
+        virtual ~MegaSharedNodeTree();
+
+        /**
+         * @brief Apply the changes made since the last refresh
+         *
+         * The values returned by MegaSharedNodeTree::getName and
+         * MegaSharedNodeTree::getFingerprint are only valid until the next call.
+         *
+         * @return true if the view changed, otherwise false
+         */
+        virtual bool refresh();
+
+        /**
+         * @brief Returns the generation of the nodes of the view
+         *
+         * @return Generation, as MegaApi::getNodeGeneration in the exporting process
+         */
+        virtual long long getGeneration() const;
+
+        /**
+         * @brief Returns the number of nodes
+         * @return Number of nodes
+         */
+        virtual int size() const;
+
+        /**
+         * @brief Get the node in a path
+         *
+         * The paths follow the rules of MegaApi::getNodeByPath.
+         *
+         * @param path Path to check
+         * @param base Handle of the base node if the path is relative
+         * @return Handle of the node, INVALID_HANDLE if there is none in the path
+         */
+        virtual MegaHandle getNodeByPath(const char *path, MegaHandle base = INVALID_HANDLE) const;
+
+        /**
+         * @brief Get the path of a node
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param handle Handle of the node
+         * @return Path of the node, as MegaApi::getNodePath, NULL if the node isn't in the view
+         */
+        virtual char *getNodePath(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the handle of the parent of a node
+         * @param handle Handle of the node
+         * @return Handle of the parent, INVALID_HANDLE for root nodes and unknown nodes
+         */
+        virtual MegaHandle getParentHandle(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the type of a node
+         * @param handle Handle of the node
+         * @return Type of the node (MegaNode::TYPE_*), MegaNode::TYPE_UNKNOWN if it isn't in the view
+         */
+        virtual int getType(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the size of a node
+         * @param handle Handle of the node
+         * @return Size of the node (as MegaNode::getSize), 0 if it isn't in the view
+         */
+        virtual int64_t getSize(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the modification time of a node
+         * @param handle Handle of the node
+         * @return Modification time (as MegaNode::getModificationTime), 0 if it isn't in the view
+         */
+        virtual int64_t getModificationTime(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the name of a node
+         *
+         * The MegaSharedNodeTree keeps the ownership of the returned value.
+         *
+         * @param handle Handle of the node
+         * @return Name of the node, NULL if it isn't in the view
+         */
+        virtual const char *getName(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the fingerprint of a node
+         *
+         * The MegaSharedNodeTree keeps the ownership of the returned value.
+         *
+         * @param handle Handle of the node
+         * @return Fingerprint of the file (as MegaNode::getFingerprint), NULL if it has none
+         */
+        virtual const char *getFingerprint(MegaHandle handle) const;
+
+        /**
+         * @brief Returns the children of a node
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param handle Handle of the node
+         * @return Handles of the children, NULL if the node isn't in the view
+         */
+        virtual MegaHandleList *getChildren(MegaHandle handle) const;
 };
 
 /**
@@ -2745,6 +3181,8 @@ class MegaRequest
             TYPE_SEND_SMS_VERIFICATIONCODE, TYPE_CHECK_SMS_VERIFICATIONCODE,
             TYPE_GET_REGISTERED_CONTACTS, TYPE_GET_COUNTRY_CALLING_CODES,
             TYPE_VERIFY_CREDENTIALS, TYPE_GET_MISC_FLAGS,
+            TYPE_MOVE_NODES, TYPE_REMOVE_NODES, TYPE_SET_ATTR_NODES,
+            TYPE_FETCH_FOLDER, TYPE_GET_ATTR_USERS,
             TOTAL_OF_REQUEST_TYPES
         };
 
@@ -3424,6 +3862,21 @@ class MegaRequest
          * @return Object with information about the contents of a folder
          */
         virtual MegaBackgroundMediaUpload* getMegaBackgroundMediaUploadPtr() const;
+
+        /**
+         * @brief Returns the list of handles related to this request
+         *
+         * The SDK retains the ownership of the returned value. It will be valid until
+         * the MegaRequest object is deleted.
+         *
+         * This value is valid for these requests:
+         * - MegaApi::moveNodes - Returns the handles of the nodes to move
+         * - MegaApi::removeNodes - Returns the handles of the nodes to remove
+         * - MegaApi::setCustomNodesAttribute - Returns the handles of the nodes to update
+         *
+         * @return List of handles
+         */
+        virtual MegaHandleList* getMegaHandleList() const;
 };
 
 /**
@@ -3449,6 +3902,7 @@ public:
         EVENT_BUSINESS_STATUS           = 9,
         EVENT_KEY_MODIFIED              = 10,
         EVENT_MISC_FLAGS_READY          = 11,
+        EVENT_NODES_CACHED              = 12,
     };
 
     virtual ~MegaEvent();
@@ -4360,6 +4814,23 @@ public:
     virtual void enableChats(bool enable);
 };
 
+/**
+ * @brief Progress of a transfer, as returned by MegaApi::getTransferProgressSnapshot
+ *
+ * Plain data, with no ownership and no strings: use MegaApi::getTransferByTag for
+ * the rest of the data of a transfer.
+ */
+struct MegaTransferProgress
+{
+    int tag;                    // MegaTransfer::getTag
+    int type;                   // MegaTransfer::TYPE_*
+    int state;                  // MegaTransfer::STATE_*
+    int64_t transferredBytes;   // MegaTransfer::getTransferredBytes
+    int64_t totalBytes;         // MegaTransfer::getTotalBytes
+    int64_t speed;              // MegaTransfer::getSpeed, in bytes per second
+    int64_t meanSpeed;          // MegaTransfer::getMeanSpeed, in bytes per second
+};
+
 /**
  * @brief Provides information about transfer queues
  *
@@ -4841,41 +5312,166 @@ public:
     virtual int getState() const;
 };
 
-#endif
-
-
 /**
- * @brief Provides information about a backup
- *
- * Developers can use listeners (MegaListener, MegaBackupListener)
- * to track the progress of each backup. MegaBackup objects are provided in callbacks sent
- * to these listeners and allow developers to know the state of the backups and their parameters
- * and their results.
+ * @brief Performance counters of a synchronization
  *
- * The implementation will receive callbacks from an internal worker thread.
+ * Rates are averaged over the last few seconds, totals and times are counted
+ * since the synchronization was started. Comparing them between synchronizations
+ * shows which one is keeping the SDK busy.
  *
- **/
-class MegaBackupListener
+ * Objects of this class are snapshots, get a new one with MegaApi::getSyncStats
+ * to see updated values.
+ */
+class MegaSyncStats
 {
 public:
-
-    virtual ~MegaBackupListener();
+    virtual ~MegaSyncStats();
 
     /**
-     * @brief This function is called when the state of the backup changes
-     *
-     * The SDK calls this function when the state of the backup changes, for example
-     * from 'active' to 'ongoing' or 'removing exceeding'.
+     * @brief Creates a copy of this MegaSyncStats object
      *
-     * You can use MegaBackup::getState to get the new state.
+     * You are the owner of the returned object
      *
-     * @param api MegaApi object that is backing up files
-     * @param backup MegaBackup object that has changed the state
+     * @return Copy of the MegaSyncStats object
      */
-    virtual void onBackupStateChanged(MegaApi *api, MegaBackup *backup);
+    virtual MegaSyncStats *copy() const;
 
     /**
-     * @brief This function is called when a backup is about to start being processed
+     * @brief Returns the identifier of the synchronization
+     * @return Identifier of the synchronization (see MegaSync::getTag)
+     */
+    virtual int getTag() const;
+
+    /**
+     * @brief Get the number of local changes waiting to be scanned
+     * @return Number of notified local paths waiting to be scanned
+     */
+    virtual int getPendingScans() const;
+
+    /**
+     * @brief Get the number of local changes waiting for a delayed second scan
+     *
+     * Files in network folders are scanned again after a while, because their
+     * notifications are unreliable.
+     *
+     * @return Number of local paths waiting for a delayed scan
+     */
+    virtual int getDelayedScans() const;
+
+    /**
+     * @brief Get the number of local paths whose scan is retried after a transient error
+     * @return Number of local paths waiting for a retry
+     */
+    virtual int getRetryingScans() const;
+
+    /**
+     * @brief Get the number of local paths scanned
+     * @return Number of local paths scanned since the synchronization started
+     */
+    virtual long long getScannedPaths() const;
+
+    /**
+     * @brief Get the current scan rate
+     * @return Local paths scanned per second
+     */
+    virtual long long getScanRate() const;
+
+    /**
+     * @brief Get the number of local files fingerprinted
+     * @return Number of files fingerprinted since the synchronization started
+     */
+    virtual long long getFingerprints() const;
+
+    /**
+     * @brief Get the current fingerprinting rate
+     * @return Files fingerprinted per second
+     */
+    virtual long long getFingerprintRate() const;
+
+    /**
+     * @brief Get the number of uploads of the synchronization that haven't finished
+     * @return Number of pending uploads
+     */
+    virtual int getPendingUploads() const;
+
+    /**
+     * @brief Get the number of bytes of the synchronization that are still to be uploaded
+     * @return Pending upload bytes
+     */
+    virtual long long getPendingUploadBytes() const;
+
+    /**
+     * @brief Get the number of downloads of the synchronization that haven't finished
+     * @return Number of pending downloads
+     */
+    virtual int getPendingDownloads() const;
+
+    /**
+     * @brief Get the number of bytes of the synchronization that are still to be downloaded
+     * @return Pending download bytes
+     */
+    virtual long long getPendingDownloadBytes() const;
+
+    /**
+     * @brief Get the size of the local files of the synchronization
+     * @return Total size of the synced local files, in bytes
+     */
+    virtual long long getLocalBytes() const;
+
+    /**
+     * @brief Get the time spent scanning local paths
+     * @return Milliseconds spent scanning local paths since the synchronization started
+     */
+    virtual long long getScanTime() const;
+
+    /**
+     * @brief Get the time spent comparing the local tree with the remote one to upload changes
+     * @return Milliseconds spent since the synchronization started
+     */
+    virtual long long getSyncUpTime() const;
+
+    /**
+     * @brief Get the time spent comparing the remote tree with the local one to apply remote changes
+     * @return Milliseconds spent since the synchronization started
+     */
+    virtual long long getSyncDownTime() const;
+};
+
+#endif
+
+
+/**
+ * @brief Provides information about a backup
+ *
+ * Developers can use listeners (MegaListener, MegaBackupListener)
+ * to track the progress of each backup. MegaBackup objects are provided in callbacks sent
+ * to these listeners and allow developers to know the state of the backups and their parameters
+ * and their results.
+ *
+ * The implementation will receive callbacks from an internal worker thread.
+ *
+ **/
+class MegaBackupListener
+{
+public:
+
+    virtual ~MegaBackupListener();
+
+    /**
+     * @brief This function is called when the state of the backup changes
+     *
+     * The SDK calls this function when the state of the backup changes, for example
+     * from 'active' to 'ongoing' or 'removing exceeding'.
+     *
+     * You can use MegaBackup::getState to get the new state.
+     *
+     * @param api MegaApi object that is backing up files
+     * @param backup MegaBackup object that has changed the state
+     */
+    virtual void onBackupStateChanged(MegaApi *api, MegaBackup *backup);
+
+    /**
+     * @brief This function is called when a backup is about to start being processed
      *
      * The SDK retains the ownership of the backup parameter.
      * Don't use it after this functions returns.
@@ -4960,7 +5556,8 @@ public:
         BACKUP_ACTIVE,
         BACKUP_ONGOING,
         BACKUP_SKIPPING,
-        BACKUP_REMOVING_EXCEEDING
+        BACKUP_REMOVING_EXCEEDING,
+        BACKUP_QUEUED
     };
 
     virtual ~MegaBackup();
@@ -5084,6 +5681,9 @@ public:
      *
      * - BACKUP_REMOVING_EXCEEDING
      * The backup is active and an exceeding backup is being removed
+     *
+     * - BACKUP_QUEUED
+     * A backup is due but waits for another one to finish (see MegaApi::setMaxConcurrentBackups)
      * @return State of the backup
      */
     virtual int getState() const;
@@ -5138,6 +5738,11 @@ public:
 
     /**
      * @brief Returns the average speed of last backup
+     *
+     * The speed is the number of bytes transferred by the backup divided by the time since
+     * it started, in bytes per second, so it is the throughput of the whole backup and
+     * not of its last transfer.
+     *
      * @return Average speed of this backup
      */
     virtual long long getMeanSpeed() const;
@@ -5803,6 +6408,10 @@ class MegaGlobalListener
          * When the full account is reloaded or a large number of server notifications arrives at once, the
          * second parameter will be NULL.
          *
+         * When more than 10000 nodes are removed at once, only the removal of the topmost ones is
+         * notified: their descendants are implicitly removed as well. MegaApi::getNodeChangesSince
+         * still lists each of them.
+         *
          * The SDK retains the ownership of the MegaNodeList in the second parameter. The list and all the
          * MegaNode objects that it contains will be valid until this function returns. If you want to save the
          * list, use MegaNodeList::copy. If you want to save only some of the MegaNode objects, use MegaNode::copy
@@ -5813,6 +6422,21 @@ class MegaGlobalListener
          */
         virtual void onNodesUpdate(MegaApi* api, MegaNodeList *nodes);
 
+        /**
+         * @brief This function is called instead of onNodesUpdate when compact node updates are enabled
+         *
+         * It receives the handles and the changes of the nodes, without copies of the nodes.
+         * When the full account is reloaded, the second parameter will be NULL.
+         *
+         * The SDK retains the ownership of the MegaNodeChangeList in the second parameter. The list
+         * will be valid until this function returns. If you want to save it, use MegaNodeChangeList::copy.
+         *
+         * @param api MegaApi object connected to the account
+         * @param changes List of the changed nodes
+         * @see MegaApi::enableCompactNodeUpdates
+         */
+        virtual void onNodesChanged(MegaApi* api, MegaNodeChangeList *changes);
+
         /**
          * @brief This function is called when the account has been updated (confirmed/upgraded/downgraded)
          *
@@ -5979,6 +6603,9 @@ class MegaGlobalListener
          *
          * - MegaEvent::EVENT_MISC_FLAGS_READY: when the miscellaneous flags are available/updated.
          *
+         * - MegaEvent::EVENT_NODES_CACHED: when the nodes have been loaded from the local cache. They
+         * can be used already, the changes made meanwhile are received later (MegaEvent::EVENT_NODES_CURRENT).
+         *
          * @param api MegaApi object connected to the account
          * @param event Details about the event
          */
@@ -6171,6 +6798,10 @@ class MegaListener
          * When the full account is reloaded or a large number of server notifications arrives at once, the
          * second parameter will be NULL.
          *
+         * When more than 10000 nodes are removed at once, only the removal of the topmost ones is
+         * notified: their descendants are implicitly removed as well. MegaApi::getNodeChangesSince
+         * still lists each of them.
+         *
          * The SDK retains the ownership of the MegaNodeList in the second parameter. The list and all the
          * MegaNode objects that it contains will be valid until this function returns. If you want to save the
          * list, use MegaNodeList::copy. If you want to save only some of the MegaNode objects, use MegaNode::copy
@@ -6181,6 +6812,21 @@ class MegaListener
          */
         virtual void onNodesUpdate(MegaApi* api, MegaNodeList *nodes);
 
+        /**
+         * @brief This function is called instead of onNodesUpdate when compact node updates are enabled
+         *
+         * It receives the handles and the changes of the nodes, without copies of the nodes.
+         * When the full account is reloaded, the second parameter will be NULL.
+         *
+         * The SDK retains the ownership of the MegaNodeChangeList in the second parameter. The list
+         * will be valid until this function returns. If you want to save it, use MegaNodeChangeList::copy.
+         *
+         * @param api MegaApi object connected to the account
+         * @param changes List of the changed nodes
+         * @see MegaApi::enableCompactNodeUpdates
+         */
+        virtual void onNodesChanged(MegaApi* api, MegaNodeChangeList *changes);
+
         /**
          * @brief This function is called when the account has been updated (confirmed/upgraded/downgraded)
          *
@@ -6469,6 +7115,9 @@ class MegaListener
          *
          * - MegaEvent::EVENT_MISC_FLAGS_READY: when the miscellaneous flags are available/updated.
          *
+         * - MegaEvent::EVENT_NODES_CACHED: when the nodes have been loaded from the local cache. They
+         * can be used already, the changes made meanwhile are received later (MegaEvent::EVENT_NODES_CURRENT).
+         *
          * @param api MegaApi object connected to the account
          * @param event Details about the event
          */
@@ -6477,6 +7126,64 @@ class MegaListener
         virtual ~MegaListener();
 };
 
+/**
+ * @brief Interface to carry out the HTTP requests of transfers with a transfer service of the OS
+ *
+ * Mobile apps are suspended shortly after going to the background, which stops the transfers of
+ * the SDK. Instead, an app can implement this interface with the background transfer service of
+ * its platform (like NSURLSession background sessions on iOS or WorkManager on Android), that
+ * keeps going while the app is suspended, and enable it with MegaApi::setBackgroundTransferHandler
+ * and MegaApi::enableBackgroundTransfers.
+ *
+ * The SDK encrypts each chunk of the uploads into a file before handing its request to the
+ * handler, and decrypts the file written by each download request when it is reported. The
+ * handler only has to send files and to write responses to files.
+ *
+ * The methods of this interface are called by the SDK thread, with the SDK locked: they must
+ * only pass the request to the OS and return. The result of each request must be reported
+ * with MegaApi::backgroundTransferFinished, from any thread, when the app runs again.
+ */
+class MegaBackgroundTransferHandler
+{
+public:
+    /**
+     * @brief Start the upload of a chunk
+     *
+     * The request is a POST of the contents of the file to the URL. The body of the response
+     * has to be passed to MegaApi::backgroundTransferFinished.
+     *
+     * @param id Identifier of the request, for MegaApi::backgroundTransferFinished
+     * @param url URL of the request
+     * @param path Local path of the file to send. It is removed by the SDK when the request finishes.
+     * @return true if the request was started, otherwise false
+     */
+    virtual bool startUpload(int64_t id, const char* url, const char* path) = 0;
+
+    /**
+     * @brief Start the download of a chunk
+     *
+     * The request is a POST without body to the URL. The body of the response has to be written
+     * to the file. It is read and removed by the SDK when the request finishes.
+     *
+     * @param id Identifier of the request, for MegaApi::backgroundTransferFinished
+     * @param url URL of the request
+     * @param path Local path of the file to write
+     * @return true if the request was started, otherwise false
+     */
+    virtual bool startDownload(int64_t id, const char* url, const char* path) = 0;
+
+    /**
+     * @brief Cancel a request
+     *
+     * MegaApi::backgroundTransferFinished doesn't have to be called for it.
+     *
+     * @param id Identifier of the request
+     */
+    virtual void cancel(int64_t id) = 0;
+
+    virtual ~MegaBackgroundTransferHandler();
+};
+
 /**
  * @brief Stores information about a background photo/video upload, used in iOS to take advantage of power saving features
  *
@@ -6791,6 +7498,50 @@ class MegaApi
             TRANSFER_METHOD_AUTO_ALTERNATIVE = 4
         };
 
+        enum {
+            TRANSFER_SCHEDULE_PRIORITY = 0,
+            TRANSFER_SCHEDULE_SMALL_FIRST = 1,
+            TRANSFER_SCHEDULE_FAIR = 2
+        };
+
+        enum {
+            NETWORK_BACKEND_DEFAULT = 0,
+            NETWORK_BACKEND_CURL = 1,
+            NETWORK_BACKEND_WINHTTP = 2
+        };
+
+        enum {
+            POWER_POLICY_AUTO = 0,
+            POWER_POLICY_UNRESTRICTED = 1,
+            POWER_POLICY_LOW_POWER = 2
+        };
+
+        enum {
+            POWER_STATE_CHARGING = 0,
+            POWER_STATE_BATTERY = 1,
+            POWER_STATE_BATTERY_LOW = 2,
+            POWER_STATE_POWER_SAVER = 3
+        };
+
+        enum {
+            THERMAL_STATE_NOMINAL = 0,
+            THERMAL_STATE_FAIR = 1,
+            THERMAL_STATE_SERIOUS = 2,
+            THERMAL_STATE_CRITICAL = 3
+        };
+
+        enum {
+            DOWNLOAD_WRITE_PREALLOCATE = 1,
+            DOWNLOAD_WRITE_DIRECT_IO = 2,
+            DOWNLOAD_WRITE_DROP_CACHE = 4
+        };
+
+        enum {
+            DOWNLOAD_DURABILITY_NONE = 0,
+            DOWNLOAD_DURABILITY_FILES = 1,
+            DOWNLOAD_DURABILITY_FILESYSTEM = 2
+        };
+
         enum {
             PUSH_NOTIFICATION_ANDROID = 1,
             PUSH_NOTIFICATION_IOS_VOIP = 2,
@@ -6834,6 +7585,17 @@ class MegaApi
             BUSINESS_STATUS_GRACE_PERIOD = 2
         };
 
+        enum {
+            DB_OPTION_SYNCHRONOUS = 0,          // 0: off, 1: normal, 2: full, 3: extra
+            DB_OPTION_CACHE_SIZE_KB = 1,        // page cache size in KiB
+            DB_OPTION_MMAP_SIZE = 2,            // bytes to memory-map, 0 disables it
+            DB_OPTION_PAGE_SIZE = 3,            // bytes per page, new databases only
+            DB_OPTION_TEMP_STORE = 4,           // 0: default, 1: file, 2: memory
+            DB_OPTION_WAL_AUTOCHECKPOINT = 5,   // WAL pages per automatic checkpoint, 0 disables them
+            DB_OPTION_WAL_CHECKPOINT_ON_COMMIT = 6, // 1: passive checkpoint after every commit
+            DB_OPTION_COMPRESS_RECORDS = 7          // 1: compress the records before encrypting them
+        };
+
         /**
          * @brief Constructor suitable for most applications
          * @param appKey AppKey of your application
@@ -8111,6 +8873,12 @@ class MegaApi
          *
          * The SDK will start using the provided proxy settings as soon as this function returns.
          *
+         * With MegaProxy::PROXY_AUTO, the cURL-based network layer detects the proxy in the
+         * background while requests go direct, and switches to the detected proxy when the
+         * detection ends. The result is kept for 30 minutes, and detected again when the
+         * connections are reset (for example, after a network change). If the detected proxy
+         * fails to connect, requests go direct until the next detection.
+         *
          * @param proxySettings Proxy settings
          * @see MegaProxy
          */
@@ -8123,6 +8891,8 @@ class MegaApi
          * On other platforms, this fuction will return a MegaProxy object
          * of type MegaProxy::PROXY_NONE
          *
+         * The detection can take some seconds, but it doesn't block other calls to the SDK.
+         *
          * You take the ownership of the returned value.
          *
          * @return MegaProxy object with the detected proxy settings
@@ -8512,6 +9282,64 @@ class MegaApi
          */
         static void setLogToConsole(bool enable);
 
+        /**
+         * @brief Enable or disable the tracing of the internal loops of the SDK
+         *
+         * When enabled, the threads of the SDK record the start and the end of their main
+         * operations (the iterations of the engine, the network and transfer I/O, the
+         * processing of server-client packets and nodes, local cache commits, sync checks)
+         * and the lifetime of each HTTP request, in memory. Each thread keeps its most recent
+         * events. Use MegaApi::getTrace to get them, for example after the app noticed a stall.
+         *
+         * Tracing is process-wide, and disabled by default. When disabled, it has no
+         * noticeable cost.
+         *
+         * @param enable True to record traces
+         * @param eventsPerThread Number of recent events kept by each thread, 0 for the default (16384)
+         */
+        static void enableTracing(bool enable, int eventsPerThread = 0);
+
+        /**
+         * @brief Check if the tracing of the internal loops of the SDK is enabled
+         *
+         * @return True if tracing is enabled
+         * @see MegaApi::enableTracing
+         */
+        static bool isTracingEnabled();
+
+        /**
+         * @brief Get the recorded traces in Chrome trace event format
+         *
+         * The returned JSON can be opened in chrome://tracing or https://ui.perfetto.dev
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param clear True to discard the returned events
+         * @return JSON with the recorded events
+         * @see MegaApi::enableTracing
+         */
+        static char *getTrace(bool clear = false);
+
+        /**
+         * @brief Enable or disable the asynchronous logging of the SDK
+         *
+         * When enabled, the threads of the SDK don't format their log messages nor wait for the
+         * loggers: each thread copies its messages to a buffer of its own, without locking, and a
+         * background thread formats them and passes them to the MegaLogger objects and the console,
+         * in order, about every 20 ms. MegaLogger::log is then called from that background thread.
+         *
+         * When the buffer of a thread is full, its new messages are dropped and a warning with
+         * their count is logged. Fatal messages are still logged right away, after the pending ones.
+         *
+         * Disabling it passes on the pending messages. It has no effect in performance mode
+         * (ENABLE_LOG_PERFORMANCE), and is disabled by default.
+         *
+         * @param enable True to log asynchronously
+         * @param bufferSize Size in bytes of the buffer of each thread that logs afterwards,
+         * 0 for the default (256 KB)
+         */
+        static void setLogAsynchronous(bool enable, int bufferSize = 0);
+
         /**
          * @brief Add a MegaLogger implementation to receive SDK logs
          *
@@ -8619,6 +9447,31 @@ class MegaApi
          */
         void moveNode(MegaNode* node, MegaNode* newParent, MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Move several nodes in the MEGA account to the same folder
+         *
+         * All the moves are sent at once, in as few API requests as possible, and the
+         * request finishes when all of them have a result. Unlike MegaApi::moveNode,
+         * nodes that can't be moved are not copied and deleted: they fail.
+         *
+         * The associated request type with this request is MegaRequest::TYPE_MOVE_NODES
+         * Valid data in the MegaRequest object received on callbacks:
+         * - MegaRequest::getMegaHandleList - Returns the handles of the nodes to move
+         * - MegaRequest::getParentHandle - Returns the handle of the new parent for the nodes
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish:
+         * - MegaRequest::getTotalBytes - Returns the number of moves sent to MEGA
+         * - MegaRequest::getNumber - Returns the number of nodes that couldn't be moved
+         *
+         * onRequestFinish is called with the error of the first node that couldn't
+         * be moved, or MegaError::API_OK if all of them were moved.
+         *
+         * @param nodes Nodes to move
+         * @param newParent New parent for the nodes
+         * @param listener MegaRequestListener to track this request
+         */
+        void moveNodes(MegaNodeList* nodes, MegaNode* newParent, MegaRequestListener *listener = NULL);
+
         /**
          * @brief Copy a node in the MEGA account
          *
@@ -8632,6 +9485,13 @@ class MegaApi
          * is MegaError::API_OK:
          * - MegaRequest::getNodeHandle - Handle of the new node
          *
+         * Folders of the account with more than a few thousand nodes are copied in several batches.
+         * onRequestUpdate is called after each one, with:
+         * - MegaRequest::getTotalBytes - Number of nodes to copy
+         * - MegaRequest::getTransferredBytes - Number of nodes copied so far
+         *
+         * If a batch fails, the nodes copied by the previous ones are kept.
+         *
          * If the status of the business account is expired, onRequestFinish will be called with the error
          * code MegaError::API_EBUSINESSPASTDUE.
          *
@@ -8655,6 +9515,13 @@ class MegaApi
          * is MegaError::API_OK:
          * - MegaRequest::getNodeHandle - Handle of the new node
          *
+         * Folders of the account with more than a few thousand nodes are copied in several batches.
+         * onRequestUpdate is called after each one, with:
+         * - MegaRequest::getTotalBytes - Number of nodes to copy
+         * - MegaRequest::getTransferredBytes - Number of nodes copied so far
+         *
+         * If a batch fails, the nodes copied by the previous ones are kept.
+         *
          * If the status of the business account is expired, onRequestFinish will be called with the error
          * code MegaError::API_EBUSINESSPASTDUE.
          *
@@ -8703,6 +9570,30 @@ class MegaApi
          */
         void remove(MegaNode* node, MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Remove several nodes from the MEGA account
+         *
+         * This function doesn't move the nodes to the Rubbish Bin, it fully removes them,
+         * including their previous versions. All the deletions are sent at once, in as
+         * few API requests as possible, and the request finishes when all of them have
+         * a result. Nodes that are removed with one of their ancestors are not counted.
+         *
+         * The associated request type with this request is MegaRequest::TYPE_REMOVE_NODES
+         * Valid data in the MegaRequest object received on callbacks:
+         * - MegaRequest::getMegaHandleList - Returns the handles of the nodes to remove
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish:
+         * - MegaRequest::getTotalBytes - Returns the number of deletions sent to MEGA
+         * - MegaRequest::getNumber - Returns the number of nodes that couldn't be removed
+         *
+         * onRequestFinish is called with the error of the first node that couldn't
+         * be removed, or MegaError::API_OK if all of them were removed.
+         *
+         * @param nodes Nodes to remove
+         * @param listener MegaRequestListener to track this request
+         */
+        void removeNodes(MegaNodeList* nodes, MegaRequestListener *listener = NULL);
+
         /**
          * @brief Remove all versions from the MEGA account
          *
@@ -8950,6 +9841,22 @@ class MegaApi
          */
         void getPublicNode(const char* megaFileLink, MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Keep the thumbnails and previews that are downloaded in a local folder
+         *
+         * Thumbnails and previews requested with MegaApi::getThumbnail, MegaApi::getPreview and
+         * the related functions are then taken from that folder when they were downloaded before,
+         * also in previous sessions, without any network request. When the folder grows beyond
+         * \c maxSize bytes, the files that were used least recently are removed.
+         *
+         * The files in the folder are not encrypted, and are named after the file attribute
+         * they contain. The app should clear the folder when the user logs out.
+         *
+         * @param localFolder Path to an existing local folder, or NULL to stop using it
+         * @param maxSize Maximum size of the folder in bytes (0 to stop using it)
+         */
+        void setThumbnailCache(const char* localFolder, long long maxSize);
+
         /**
          * @brief Get the thumbnail of a node
          *
@@ -9293,6 +10200,30 @@ class MegaApi
          */
         void getUserAttribute(int type, MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Get an attribute of several users at once
+         *
+         * The attribute of all the users is requested together, instead of one request to the API
+         * per user. The users whose value is cached are skipped: the SDK keeps the version of the
+         * values it receives, and only discards them when the API notifies a different version.
+         *
+         * The values are not returned by this request. Once it finishes, MegaApi::getUserAttribute
+         * and MegaApi::getUserAvatar get them from the cache, without a request to the API. The users
+         * whose attribute couldn't be retrieved are requested again by those functions.
+         *
+         * Private attributes can only be retrieved for your own user.
+         *
+         * The associated request type with this request is MegaRequest::TYPE_GET_ATTR_USERS
+         * Valid data in the MegaRequest object received on callbacks:
+         * - MegaRequest::getParamType - Returns the attribute type
+         * - MegaRequest::getMegaHandleList - Returns the handles of the users
+         *
+         * @param users Users whose attribute is requested
+         * @param type Attribute type, as in MegaApi::getUserAttribute
+         * @param listener MegaRequestListener to track this request
+         */
+        void getUserAttributes(MegaUserList* users, int type, MegaRequestListener *listener = NULL);
+
         /**
          * @brief Get the name associated to a user attribute
          *
@@ -9593,6 +10524,37 @@ class MegaApi
          */
         void setCustomNodeAttribute(MegaNode *node, const char *attrName, const char* value, MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Set the same custom attribute for several nodes
+         *
+         * All the updates are sent at once, in as few API requests as possible, and the
+         * request finishes when all of them have a result.
+         *
+         * The associated request type with this request is MegaRequest::TYPE_SET_ATTR_NODES
+         * Valid data in the MegaRequest object received on callbacks:
+         * - MegaRequest::getMegaHandleList - Returns the handles of the nodes that receive the attribute
+         * - MegaRequest::getName - Returns the name of the custom attribute
+         * - MegaRequest::getText - Returns the text for the attribute
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish:
+         * - MegaRequest::getTotalBytes - Returns the number of updates sent to MEGA
+         * - MegaRequest::getNumber - Returns the number of nodes that couldn't be updated
+         *
+         * onRequestFinish is called with the error of the first node that couldn't
+         * be updated, or MegaError::API_OK if all of them were updated.
+         *
+         * The attribute name must be an UTF8 string with between 1 and 7 bytes
+         * If the attribute already has a value, it will be replaced
+         * If value is NULL, the attribute will be removed from the nodes
+         *
+         * @param nodes Nodes that will receive the attribute
+         * @param attrName Name of the custom attribute.
+         * The length of this parameter must be between 1 and 7 UTF8 bytes
+         * @param value Value for the attribute
+         * @param listener MegaRequestListener to track this request
+         */
+        void setCustomNodesAttribute(MegaNodeList *nodes, const char *attrName, const char* value, MegaRequestListener *listener = NULL);
+
         /**
          * @brief Set the duration of audio/video files as a node attribute.
          *
@@ -9743,6 +10705,35 @@ class MegaApi
          */
         void fetchNodes(MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Fetch the children of a folder of a lazily loaded folder link
+         *
+         * When lazy folder links are enabled (see MegaApi::enableLazyFolderLinks),
+         * MegaApi::fetchNodes only gets the root folder of the link and its children.
+         * This request gets the children of another folder, which are then available
+         * through MegaApi::getChildren and kept until logout.
+         *
+         * The request finishes immediately if the children of the folder were already
+         * fetched, or if the whole tree was fetched at once.
+         *
+         * The associated request type with this request is MegaRequest::TYPE_FETCH_FOLDER
+         * Valid data in the MegaRequest object received on callbacks:
+         * - MegaRequest::getNodeHandle - Returns the handle of the folder
+         *
+         * @param folder Folder whose children will be fetched
+         * @param listener MegaRequestListener to track this request
+         */
+        void fetchFolder(MegaNode *folder, MegaRequestListener *listener = NULL);
+
+        /**
+         * @brief Check if the children of a folder are available
+         *
+         * @param folder Folder to check
+         * @return False if the folder belongs to a lazily loaded folder link and its
+         * children were not fetched yet (see MegaApi::fetchFolder), otherwise true
+         */
+        bool isFolderFetched(MegaNode *folder);
+
         /**
          * @brief Get the sum of sizes of all the files stored in the MEGA cloud.
          *
@@ -10701,6 +11692,50 @@ class MegaApi
          */
         bool usingHttpsOnly();
 
+        /**
+         * @brief Hard link the extra copies of a download instead of copying them
+         *
+         * When the same file is downloaded to several places at once, it is transferred
+         * only once and copied to the other places. On file systems able to clone files
+         * (Btrfs, XFS, APFS, ReFS) the copies share the data of the first file and cost
+         * no time nor space. On the others, this option makes them hard links to the
+         * first file instead: a change to any of them is seen in all of them.
+         *
+         * The copies are made as usual where hard links aren't supported, and for syncs.
+         *
+         * The default value is false.
+         *
+         * @param enable True to hard link the extra copies of a download
+         * @see MegaApi::areDownloadHardLinksEnabled
+         */
+        void enableDownloadHardLinks(bool enable);
+
+        /**
+         * @brief Check if the extra copies of a download are hard links
+         * @return True if they are hard links. Otherwise false.
+         * @see MegaApi::enableDownloadHardLinks
+         */
+        bool areDownloadHardLinksEnabled();
+
+        /**
+         * @brief Record the updates received from MEGA servers to a file
+         *
+         * The raw responses of the persistent connection that receives the changes of the
+         * account (action packets) are appended to the file, each one with the sequence
+         * number it was requested from. The recording can be replayed against a copy of the
+         * local cache of the session with the tool_screplay tool, to reproduce stalls caused
+         * by bursts of updates.
+         *
+         * The recording stops when this function is called with NULL, and on logout.
+         *
+         * The file contains the data of the account as sent by MEGA (with the e-mail addresses
+         * of contacts in clear): handle it with the same care as the local cache.
+         *
+         * @param localPath Path of the file, which is overwritten, or NULL to stop recording
+         * @return True if the file could be opened
+         */
+        bool recordActionPackets(const char *localPath);
+
         ///////////////////   TRANSFERS ///////////////////
 
         /**
@@ -10875,6 +11910,55 @@ class MegaApi
          */
         void startUploadForChat(const char *localPath, MegaNode *parent, const char *appData, bool isSourceTemporary, MegaTransferListener *listener = nullptr);
 
+        /**
+         * @brief Upload a batch of files or folders
+         *
+         * The uploads are the same as with MegaApi::startUpload, but queueing many of them
+         * is cheaper: the batch is handed to the SDK at once, and the MegaTransfer of each
+         * upload is only created when the SDK gets to it, a chunk at a time with a single
+         * update of the local cache per chunk. Until then, an upload takes the memory of its
+         * paths only.
+         *
+         * Each upload is notified to the listener like a separate transfer. One whose parent
+         * is not a folder of the account finishes with the error API_EARGS.
+         *
+         * The SDK takes a copy of the batch, you can delete it after the call.
+         *
+         * @param batch Files or folders to upload
+         * @param listener MegaTransferListener to track the uploads
+         */
+        void startUploads(MegaUploadBatch* batch, MegaTransferListener *listener = NULL);
+
+        /**
+         * @brief Upload a file whose data is read from an input stream
+         *
+         * The data doesn't need to be in a local file: the SDK reads the stream once, from
+         * the beginning to the end, as it prepares the chunks of the upload. The fingerprint
+         * of the file is computed from the data as it is read and set in the new node
+         * when the upload finishes.
+         *
+         * MegaInputStream::getSize must return the exact number of bytes that the stream
+         * provides, and the stream must remain valid until MegaTransferListener::onTransferFinish
+         * is called. It's called from the SDK thread.
+         *
+         * As the data can't be read again, the upload can't be resumed: it isn't kept in the
+         * transfer cache, and it fails with API_EREAD if it has to be restarted after the first
+         * chunk was read (an error that requires a new upload URL, pausing it, a logout...).
+         * No thumbnail, preview or media attributes are generated for the new node.
+         *
+         * If the status of the business account is expired, onTransferFinish will be called with the error
+         * code MegaError::API_EBUSINESSPASTDUE. In this case, apps should show a warning message similar to
+         * "Your business account is overdue, please contact your administrator."
+         *
+         * @param inputStream Input stream that provides the data of the file
+         * @param parent Parent node for the file in the MEGA account
+         * @param fileName Name of the file in MEGA
+         * @param mtime Modification time for the file in MEGA (in seconds since the epoch), or -1
+         * to use the current time
+         * @param listener MegaTransferListener to track this transfer
+         */
+        void startUploadFromStream(MegaInputStream* inputStream, MegaNode* parent, const char* fileName, int64_t mtime = -1, MegaTransferListener *listener = NULL);
+
         /**
          * @brief Download a file or a folder from MEGA
          *
@@ -11468,6 +12552,175 @@ class MegaApi
          */
         bool setMaxUploadSpeed(long long bpslimit);
 
+        /**
+         * @brief Enable or disable HTTP/2 with request multiplexing
+         *
+         * When enabled, concurrent requests to the same host (API commands, file attributes,
+         * streaming reads, transfers) share a single HTTP/2 connection if the server supports
+         * it, instead of opening a new connection and doing a new TLS handshake for each one.
+         * Connections that are already established are not affected.
+         *
+         * Currently, this method is only available using the cURL-based network layer
+         * and requires cURL 7.47.0 or newer built with HTTP/2 support. You can check if
+         * the function will have effect by checking the return value.
+         *
+         * HTTP/2 multiplexing is disabled by default.
+         *
+         * @param enable True to enable HTTP/2 multiplexing, false to disable it
+         * @return true if the network layer allows to control HTTP/2, otherwise false
+         */
+        bool setHTTP2Enabled(bool enable);
+
+        /**
+         * @brief Check if HTTP/2 multiplexing is enabled
+         *
+         * @return true if HTTP/2 multiplexing is enabled, otherwise false
+         * @see MegaApi::setHTTP2Enabled
+         */
+        bool isHTTP2Enabled();
+
+        /**
+         * @brief Tune the sockets used by transfers
+         *
+         * On paths with a high bandwidth-delay product, the default socket buffers and
+         * congestion control of the system can limit the speed of each connection. These
+         * options are applied to the connections opened from now on, before connecting.
+         * The values actually in effect (the system may adjust or cap them) are logged
+         * for each connection.
+         *
+         * Currently, this method is only available using the cURL-based network layer.
+         * TCP_NOTSENT_LOWAT and the selection of the congestion control depend on the
+         * operating system (TCP_CONGESTION is Linux only).
+         *
+         * @param direction Direction of transfers
+         * Valid values for this parameter are:
+         * - MegaTransfer::TYPE_DOWNLOAD = 0
+         * - MegaTransfer::TYPE_UPLOAD = 1
+         * - -1 for both
+         * @param recvBufferSize SO_RCVBUF in bytes (0 for the system default)
+         * @param sendBufferSize SO_SNDBUF in bytes (0 for the system default)
+         * @param notSentLowat TCP_NOTSENT_LOWAT in bytes (0 for the system default)
+         * @param congestionControl TCP congestion control algorithm, for example "bbr"
+         * (NULL or empty for the system default)
+         * @param bufferSize Size of the receive and upload buffers of cURL in bytes
+         * (0 for the default)
+         * @return true if the options will be applied, otherwise false
+         */
+        bool setSocketOptions(int direction, int recvBufferSize, int sendBufferSize, int notSentLowat,
+                              const char* congestionControl = NULL, int bufferSize = 0);
+
+        /**
+         * @brief Limit the connections used by transfers
+         *
+         * Finished requests leave their connections open for reuse. With many instances
+         * of MegaApi in the same process, these idle connections can add up to a large
+         * number of sockets; on the other hand, a cache too small makes bursts of requests
+         * connect again. These limits apply to each instance of MegaApi.
+         *
+         * Currently, this method is only available using the cURL-based network layer.
+         * The limits per host and in total need cURL 7.30.0 and the age of idle connections
+         * cURL 7.65.0; with older versions, setting them makes this function return false.
+         *
+         * @param direction Direction of transfers
+         * Valid values for this parameter are:
+         * - MegaTransfer::TYPE_DOWNLOAD = 0
+         * - MegaTransfer::TYPE_UPLOAD = 1
+         * - -1 for both
+         * @param maxIdleConnections Connections kept open for reuse once they are idle
+         * (0 for the default)
+         * @param maxHostConnections Open connections to a single server; more requests wait
+         * for a free connection (0 for no limit)
+         * @param maxTotalConnections Open connections in total; more requests wait for a free
+         * connection (0 for no limit)
+         * @param maxIdleSeconds Idle connections older than this aren't reused (0 for the default)
+         * @return true if the limits will be applied, otherwise false
+         */
+        bool setConnectionCacheLimits(int direction, int maxIdleConnections, int maxHostConnections,
+                                      int maxTotalConnections, int maxIdleSeconds = 0);
+
+        /**
+         * @brief Keep moving network data on a dedicated thread while the SDK is busy
+         *
+         * Processing a large batch of changes from the server or writing the local cache
+         * can keep the SDK thread busy for a while. With this option, the sockets of the
+         * requests in flight (transfers, streaming, API requests) are read and written on
+         * a separate thread during that time, so the throughput doesn't drop. Completed
+         * requests are still processed by the SDK thread.
+         *
+         * Currently, this method is only available using the cURL-based network layer
+         * on POSIX systems and Windows Vista or later. You can check if the function will
+         * have effect by checking the return value.
+         *
+         * This option is disabled by default.
+         *
+         * @param enable True to use the network thread, false to stop it
+         * @return true if the network layer allows to use a network thread, otherwise false
+         */
+        bool setNetworkThreadEnabled(bool enable);
+
+        /**
+         * @brief Check if the network thread is used
+         *
+         * @return true if the network thread is enabled, otherwise false
+         * @see MegaApi::setNetworkThreadEnabled
+         */
+        bool isNetworkThreadEnabled();
+
+        /**
+         * @brief Set the handler of the background transfers
+         *
+         * The handler passes the HTTP requests of the transfers to a transfer service of the OS
+         * while the background transfers are enabled. See MegaBackgroundTransferHandler.
+         *
+         * The handler can only be set once, and it must live longer than this MegaApi object.
+         * The SDK doesn't take its ownership.
+         *
+         * The files of the requests are created in the folder. The files left there by a previous
+         * execution are removed: the responses of the requests that weren't reported before the
+         * app was killed are ignored, and those chunks are transferred again when the transfers
+         * are resumed.
+         *
+         * @param handler Handler of the background transfers
+         * @param folder Local path of a folder for the files of the requests. It must exist.
+         * @return true if the handler was set, otherwise false
+         */
+        bool setBackgroundTransferHandler(MegaBackgroundTransferHandler* handler, const char* folder);
+
+        /**
+         * @brief Pass the new requests of the transfers to the background transfer handler
+         *
+         * Call it with true when the app is about to go to the background, and with false when it
+         * comes back. The requests already in progress are completed by the handler that started
+         * them. The API requests and the streaming aren't affected.
+         *
+         * A handler must be set with MegaApi::setBackgroundTransferHandler beforehand.
+         * This option is disabled by default.
+         *
+         * @param enable True to use the background transfer handler, false to use the usual network layer
+         */
+        void enableBackgroundTransfers(bool enable);
+
+        /**
+         * @brief Check if the background transfers are enabled
+         *
+         * @return true if the background transfers are enabled, otherwise false
+         * @see MegaApi::enableBackgroundTransfers
+         */
+        bool areBackgroundTransfersEnabled();
+
+        /**
+         * @brief Report the result of a request of the background transfer handler
+         *
+         * This function can be called from any thread.
+         *
+         * @param id Identifier of the request
+         * @param httpStatus HTTP status of the response, or 0 if the request failed
+         * @param response Body of the response of an upload request. NULL for downloads.
+         * @return true if the request was known, false if it was started by a previous execution
+         * of the app or cancelled
+         */
+        bool backgroundTransferFinished(int64_t id, int httpStatus, const char* response);
+
         /**
          * @brief Get the maximum download speed in bytes per second
          *
@@ -11559,6 +12812,46 @@ class MegaApi
          */
         MegaTransferData *getTransferData(MegaTransferListener *listener = NULL);
 
+        /**
+         * @brief Get the progress of all the transfers at once
+         *
+         * For apps that show many transfers and poll their progress periodically,
+         * instead of receiving MegaTransferListener::onTransferUpdate for each one.
+         * Nothing is allocated: the progress is copied into the array passed by the
+         * app, in the order of the tags, up to its size.
+         *
+         * The return value is the number of transfers, which may be larger than the
+         * array: call it again with a larger one to get all of them.
+         *
+         * @param progress Array that receives the progress of the transfers
+         * @param size Number of elements of the array
+         * @return Number of transfers
+         * @see MegaApi::enableTransferUpdateCallbacks
+         */
+        int getTransferProgressSnapshot(MegaTransferProgress *progress, int size);
+
+        /**
+         * @brief Enable or disable the progress callbacks of transfers
+         *
+         * By default, MegaListener::onTransferUpdate and MegaTransferListener::onTransferUpdate
+         * are called up to once per decisecond for each active transfer. Apps that poll the
+         * progress with MegaApi::getTransferProgressSnapshot can disable them: the callbacks
+         * are then only called when the state or the priority of a transfer changes.
+         *
+         * The start and the end of transfers are always notified.
+         *
+         * @param enable False to only receive updates of the state and the priority
+         */
+        void enableTransferUpdateCallbacks(bool enable);
+
+        /**
+         * @brief Check if the progress callbacks of transfers are enabled
+         *
+         * @return True if progress callbacks are enabled
+         * @see MegaApi::enableTransferUpdateCallbacks
+         */
+        bool areTransferUpdateCallbacksEnabled();
+
         /**
          * @brief Get the first transfer in a transfer queue
          *
@@ -11733,6 +13026,68 @@ class MegaApi
          */
         void abortCurrentBackup(int tag, MegaRequestListener *listener=NULL);
 
+        /**
+         * @brief Copy the unchanged files of the last complete backup instead of uploading them
+         *
+         * When a backup starts, the local files are compared with those at the same path in the
+         * last backup of the same folder whose state is COMPLETE. The files with the same size
+         * and modification time are not read nor uploaded: the nodes of the previous backup
+         * are copied into the new one, in batches, with their keys.
+         *
+         * Files modified without changing their size and modification time are not detected.
+         * This option is disabled by default.
+         *
+         * @param enable True to make incremental backups
+         */
+        void enableIncrementalBackups(bool enable);
+
+        /**
+         * @brief Check if backups copy the unchanged files of the previous one
+         *
+         * @return True if the backups are incremental
+         * @see MegaApi::enableIncrementalBackups
+         */
+        bool isIncrementalBackupsEnabled();
+
+        /**
+         * @brief Limit the number of backups performed at once
+         *
+         * A backup due while the maximum number of backups are ongoing waits in the
+         * MegaBackup::BACKUP_QUEUED state, and the waiting backups start in the order they were
+         * due as the others finish. A backup that waits past its next scheduled time is
+         * skipped, as it would be when its previous one is still ongoing.
+         *
+         * There is no limit by default.
+         *
+         * @param maxBackups Maximum number of ongoing backups, or 0 for no limit
+         */
+        void setMaxConcurrentBackups(int maxBackups);
+
+        /**
+         * @brief Get the maximum number of backups performed at once
+         *
+         * @return Maximum number of ongoing backups, 0 if there is no limit
+         * @see MegaApi::setMaxConcurrentBackups
+         */
+        int getMaxConcurrentBackups();
+
+        /**
+         * @brief Limit the resources used by a backup
+         *
+         * The uploads of a backup beyond maxUploads wait for the previous ones to finish,
+         * so a large backup doesn't read many files at once nor fill the transfer queue ahead
+         * of the other transfers. The bandwidth limit is shared by the uploads of the backup,
+         * as the one of MegaApi::setTransferRateLimit for a folder transfer.
+         *
+         * The limits apply to the ongoing backup too, and to the next ones.
+         *
+         * @param backupTag Tag of the backup (see MegaBackup::getTag)
+         * @param maxUploads Maximum number of uploads in progress, or 0 for no limit
+         * @param bytesPerSecond Bandwidth limit, or 0 for no limit
+         * @return False if there is no backup with that tag
+         */
+        bool setBackupLimits(int backupTag, int maxUploads, long long bytesPerSecond);
+
         /**
          * @brief Starts a timer.
          *
@@ -12047,6 +13402,30 @@ class MegaApi
          */
         void setExclusionUpperSizeLimit(long long limit);
 
+        /**
+         * @brief Set the time the SDK spends processing local changes of synced folders in one go
+         *
+         * New and modified files are fingerprinted ahead of time in worker threads, and their
+         * results are applied to the synchronizations in batches for up to this time, before
+         * the SDK attends to other tasks.
+         *
+         * With 0, the SDK attends to other tasks after each file, which makes it more responsive
+         * but slows down the scans of folders with many changes.
+         *
+         * The default value is 20 milliseconds.
+         *
+         * @param milliseconds Time budget for the processing of local changes
+         */
+        void setSyncScanTimeBudget(int milliseconds);
+
+        /**
+         * @brief Get the time the SDK spends processing local changes of synced folders in one go
+         *
+         * @return Time budget in milliseconds
+         * @see MegaApi::setSyncScanTimeBudget
+         */
+        int getSyncScanTimeBudget();
+
         /**
          * @brief Move a local file to the local "Debris" folder
          *
@@ -12129,6 +13508,17 @@ class MegaApi
          */
         MegaSync *getSyncByPath(const char *localPath);
 
+        /**
+         * @brief Get the performance counters of a synchronization
+         *
+         * You take the ownership of the returned value
+         *
+         * @param tag Tag that identifies the synchronization
+         * @return Performance counters of the synchronization, or NULL if there is
+         * no active synchronization with that tag
+         */
+        MegaSyncStats *getSyncStats(int tag);
+
 #ifdef USE_PCRE
         /**
         * @brief Set a list of rules to exclude files and folders for a given synchronized folder
@@ -12496,6 +13886,30 @@ class MegaApi
          */
         MegaNodeList* getChildren(MegaNode *parent, int order = 1);
 
+        /**
+         * @brief Get a window of the children of a MegaNode
+         *
+         * This function returns the same nodes as MegaApi::getChildren, in the same order,
+         * but only the ones in the range [offset, offset + limit). It allows to display very
+         * big folders page by page without creating a MegaNode for every child.
+         *
+         * The SDK keeps the sorted children of recently listed folders, so consecutive
+         * calls for the same folder and order don't need to sort the children again, as
+         * long as the content of the folder doesn't change.
+         *
+         * If the parent node doesn't exist or it isn't a folder, or the offset is out of
+         * range, this function returns an empty list.
+         *
+         * You take the ownership of the returned value
+         *
+         * @param parent Parent node
+         * @param order Order for the returned list (see MegaApi::getChildren)
+         * @param offset Index (with the same order) of the first child to return
+         * @param limit Maximum number of children to return, or -1 to return all of them from offset
+         * @return List with the requested child MegaNode objects
+         */
+        MegaNodeList* getChildren(MegaNode *parent, int order, int offset, int limit);
+
         /**
          * @brief Get all versions of a file
          * @param node Node to check
@@ -12733,6 +14147,27 @@ class MegaApi
         */
         MegaUserAlertList* getUserAlerts();
 
+        /**
+        * @brief Get a range of the MegaUserAlerts for the logged in user
+        *
+        * The alerts are in the same order as in MegaApi::getUserAlerts, from the oldest one.
+        * Only the 1000 most recent alerts are kept.
+        *
+        * You take the ownership of the returned value
+        *
+        * @param start Position of the first alert to get
+        * @param count Maximum number of alerts to get
+        * @return List of MegaUserAlert objects
+        */
+        MegaUserAlertList* getUserAlerts(int start, int count);
+
+        /**
+         * @brief Get the number of user alerts for the logged in user
+         *
+         * @return Number of user alerts
+         */
+        int getNumUserAlerts();
+
         /**
          * @brief Get the number of unread user alerts for the logged in user
          *
@@ -13307,12 +14742,96 @@ class MegaApi
          */
         int getDefaultFolderPermissions();
 
+        /**
+         * @brief Set how downloaded files are written to disk
+         *
+         * The value is a combination of these flags (0 by default):
+         * - MegaApi::DOWNLOAD_WRITE_PREALLOCATE = 1
+         * Reserve the space of the whole file when its download starts, so that the
+         * filesystem can allocate it contiguously instead of as the data arrives.
+         *
+         * - MegaApi::DOWNLOAD_WRITE_DIRECT_IO = 2
+         * Write the data bypassing the page cache (O_DIRECT) where the filesystem supports
+         * it. Only the writes aligned to 4 KB go this way, which is most of them.
+         *
+         * - MegaApi::DOWNLOAD_WRITE_DROP_CACHE = 4
+         * Evict the downloaded data from the page cache once it is on disk, so that large
+         * downloads don't push out the data of other applications.
+         *
+         * Currently, this function only works on Linux (DOWNLOAD_WRITE_DROP_CACHE also
+         * partially on other platforms using the Posix filesystem layer). On other
+         * platforms, it doesn't have any effect.
+         *
+         * The options apply to the downloads started after the call.
+         *
+         * @param options Combination of DOWNLOAD_WRITE_* flags
+         */
+        void setDownloadWriteOptions(int options);
+
+        /**
+         * @brief Get how downloaded files are written to disk
+         *
+         * @return Combination of DOWNLOAD_WRITE_* flags, 0 on platforms without support
+         * @see MegaApi::setDownloadWriteOptions
+         */
+        int getDownloadWriteOptions();
+
+        /**
+         * @brief Set how completed downloads are made durable on disk
+         *
+         * Flushing each completed file to disk as soon as it is downloaded ruins the
+         * throughput of the downloads of many small files, while not flushing them at all
+         * leaves their durability to the operating system. With this function, the downloads
+         * completed within a time window are flushed together, off the SDK thread:
+         *
+         * - MegaApi::DOWNLOAD_DURABILITY_NONE = 0
+         * Don't flush the completed downloads (default value).
+         *
+         * - MegaApi::DOWNLOAD_DURABILITY_FILES = 1
+         * Flush each completed file (fsync), then each folder containing them, so that
+         * both their data and their names survive a crash or a power loss.
+         *
+         * - MegaApi::DOWNLOAD_DURABILITY_FILESYSTEM = 2
+         * Flush the whole filesystem of each folder containing them (syncfs) once per batch,
+         * instead of the files one by one. This is faster for large batches of small files,
+         * but it also flushes the pending writes of other applications to that filesystem.
+         * It works like DOWNLOAD_DURABILITY_FILES where the platform can't do it (not Linux).
+         *
+         * A download is reported as finished before it is flushed. The downloads pending
+         * to be flushed are flushed on logout.
+         *
+         * Currently, this function only works on OS X and Linux (or any other platform using
+         * the Posix filesystem layer). On other platforms, it doesn't have any effect.
+         *
+         * @param policy One of the DOWNLOAD_DURABILITY_* values
+         * @param windowMs Maximum time that a completed download waits for others
+         * to be flushed along with them, in milliseconds (1000 by default)
+         */
+        void setDownloadDurability(int policy, int windowMs = 1000);
+
         /**
          * @brief Get the time (in seconds) during which transfers will be stopped due to a bandwidth overquota
          * @return Time (in seconds) during which transfers will be stopped, otherwise 0
          */
         long long getBandwidthOverquotaDelay();
 
+        /**
+         * @brief Get the estimated time until the transfer quota runs out at the current download speed
+         *
+         * The estimation starts from the transfer quota received by the last call to
+         * MegaApi::getAccountDetails or MegaApi::getSpecificAccountDetails that included
+         * transfer details, minus the bytes downloaded since then. It's unknown before that,
+         * after a bandwidth overquota, and for accounts without a fixed transfer quota.
+         *
+         * While it's known, the SDK holds back the downloads that can't complete within the
+         * quota left after the ones in progress, and starts the queued downloads closest to
+         * completion that can instead.
+         *
+         * @return Time (in seconds) until the transfer quota runs out, or -1 if unknown
+         * or if nothing is being downloaded
+         */
+        long long getTransferQuotaTimeLeft();
+
         /**
          * @brief Search nodes containing a search string in their name
          *
@@ -13624,237 +15143,1355 @@ class MegaApi
          * @param recursive True if you want to recursively process the whole node tree.
          * False if you want to process the children of the node only
          *
-         * @return True if all nodes were processed. False otherwise (the operation can be
-         * cancelled by MegaTreeProcessor::processMegaNode())
+         * @return True if all nodes were processed. False otherwise (the operation can be
+         * cancelled by MegaTreeProcessor::processMegaNode())
+         */
+        bool processMegaTree(MegaNode* node, MegaTreeProcessor* processor, bool recursive = 1);
+
+        /**
+         * @brief Get a consistent snapshot of a tree of nodes
+         *
+         * Unlike walking the tree with MegaApi::getChildren, which reads each folder in a
+         * different moment, or MegaApi::processMegaTree, which keeps the SDK locked while the
+         * app processes each node, this function copies the handles, parents, types, sizes,
+         * modification times, names and fingerprints of the whole tree in one step, into a
+         * compact buffer.
+         *
+         * Keep the index current afterwards with MegaApi::getNodeChangesSince, passing
+         * MegaNodeSnapshot::getGeneration.
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param node Root of the tree, or NULL for the Cloud Drive, the Inbox and the Rubbish Bin
+         * @return Snapshot of the tree, or NULL if the node doesn't exist or the nodes are being fetched
+         */
+        MegaNodeSnapshot *getNodeSnapshot(MegaNode *node = NULL);
+
+        /**
+         * @brief Get the current generation of the nodes
+         *
+         * The generation grows each time the SDK notifies changes in the nodes.
+         *
+         * @return Current generation
+         * @see MegaApi::getNodeChangesSince
+         */
+        long long getNodeGeneration();
+
+        /**
+         * @brief Get the nodes that changed after a generation
+         *
+         * Each node is listed once, in the order of its first change, with all its
+         * changes since the generation. Removed nodes are listed with
+         * MegaNode::CHANGE_TYPE_REMOVED, including the descendants of removed folders
+         * whose removal was only notified through the folder.
+         *
+         * The SDK keeps a limited history of changes, and drops it when the account is
+         * reloaded or logged out. When the changes since the generation are no longer
+         * available, this function returns NULL: take a new snapshot with
+         * MegaApi::getNodeSnapshot instead.
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param generation Generation of a snapshot or a previous call to MegaApi::getNodeGeneration
+         * @return Changed nodes, or NULL if the changes since the generation aren't available
+         */
+        MegaNodeChangeList *getNodeChangesSince(long long generation);
+
+        /**
+         * @brief Export the node tree to shared memory, for other processes of the user
+         *
+         * The export is a MegaNodeSnapshot of the Cloud Drive, the Inbox and the Rubbish Bin
+         * followed by the log of the changes made after it, both kept up to date by the SDK.
+         * Other processes open it with MegaSharedNodeTree::open and the same name, and read
+         * it without copying the whole tree nor asking this process for each query.
+         *
+         * The export is stopped when this MegaApi object is deleted. Its contents follow the
+         * logins, logouts and reloads of this MegaApi object.
+         *
+         * The shared memory is readable by the other processes of the same user. This
+         * function isn't available on Android.
+         *
+         * @param name Name of the export, unique in the session of the user. It can't contain slashes.
+         * @return true if the export started, otherwise false
+         */
+        bool startNodeTreeExport(const char *name);
+
+        /**
+         * @brief Stop the export of the node tree
+         *
+         * The processes that opened it keep the last state that they refreshed.
+         *
+         * @see MegaApi::startNodeTreeExport
+         */
+        void stopNodeTreeExport();
+
+        /**
+         * @brief Create a MegaNode that represents a file of a different account
+         *
+         * The resulting node can be used in MegaApi::startDownload and MegaApi::startStreaming but
+         * can not be copied.
+         *
+         * At least the parameters handle, key, size, mtime and auth must be correct to be able to use the resulting node.
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param handle Handle of the node
+         * @param key Key of the node (Base64 encoded)
+         * @param name Name of the node (Base64 encoded)
+         * @param size Size of the node
+         * @param mtime Modification time of the node
+         * @param parentHandle Handle of the parent node
+         * @param privateAuth Private authentication token to access the node
+         * @param publicAuth Public authentication token to access the node
+         * @param chatAuth Chat authentication token to access the node
+         * @return MegaNode object
+         */
+        MegaNode *createForeignFileNode(MegaHandle handle, const char *key, const char *name,
+                                       int64_t size, int64_t mtime, MegaHandle parentHandle, const char *privateAuth, const char *publicAuth, const char *chatAuth);
+
+        /**
+         * @brief Create a MegaNode that represents a folder of a different account
+         *
+         * The resulting node can not be successfully used in any other function of MegaApi.
+         * The resulting object is only useful to store the values passed as parameters.
+         *
+         * You take the ownership of the returned value.
+
+         * @param handle Handle of the node
+         * @param name Name of the node (Base64 encoded)
+         * @param parentHandle Handle of the parent node
+         * @param privateAuth Private authentication token to access the node
+         * @param publicAuth Public authentication token to access the node
+         * @return MegaNode object
+         */
+        MegaNode *createForeignFolderNode(MegaHandle handle, const char *name, MegaHandle parentHandle, const char *privateAuth, const char *publicAuth);
+
+        /**
+         * @brief Returns a MegaNode that can be downloaded with any instance of MegaApi
+         *
+         * You can use MegaApi::startDownload with the resulting node with any instance
+         * of MegaApi, even if it's logged into another account, a public folder, or not
+         * logged in.
+         *
+         * If the first parameter is a public node or an already authorized node, this
+         * function returns a copy of the node, because it can be already downloaded
+         * with any MegaApi instance.
+         *
+         * If the node in the first parameter belongs to the account or public folder
+         * in which the current MegaApi object is logged in, this funtion returns an
+         * authorized node.
+         *
+         * If the first parameter is NULL or a node that is not a public node, is not
+         * already authorized and doesn't belong to the current MegaApi, this function
+         * returns NULL.
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param node MegaNode to authorize
+         * @return Authorized node, or NULL if the node can't be authorized
+         */
+        MegaNode *authorizeNode(MegaNode *node);
+
+#ifdef ENABLE_CHAT
+        /**
+         * @brief Returns a MegaNode that can be downloaded/copied with a chat-authorization
+         *
+         * During preview of chat-links, you need to call this method to authorize the MegaNode
+         * from a node-attachment message, so the API allows to access to it. The parameter to
+         * authorize the access can be retrieved from MegaChatRoom::getAuthorizationToken when
+         * the chatroom in in preview mode.
+         *
+         * You can use MegaApi::startDownload and/or MegaApi::copyNode with the resulting
+         * node with any instance of MegaApi, even if it's logged into another account,
+         * a public folder, or not logged in.
+         *
+         * You take the ownership of the returned value.
+         *
+         * @param node MegaNode to authorize
+         * @param cauth Authorization token (public handle of the chatroom in B64url encoding)
+         * @return Authorized node, or NULL if the node can't be authorized
+         */
+        MegaNode *authorizeChatNode(MegaNode *node, const char *cauth);
+#endif
+
+        /**
+         * @brief Get the SDK version
+         *
+         * The returned string is an statically allocated array.
+         * Do not delete it.
+         *
+         * @return SDK version
+         */
+        const char *getVersion();
+
+        /**
+         * @brief Get a string with the version of the operating system
+         *
+         * You take the ownership of the returned string
+         *
+         * @return Version of the operating system
+         */
+        char *getOperatingSystemVersion();
+
+        /**
+         * @brief Get the last available version of the app
+         *
+         * It returns the last available version corresponding to an app token
+         *
+         * The associated request type with this request is MegaRequest::TYPE_APP_VERSION
+         * Valid data in the MegaRequest object received on callbacks:
+         * - MegaRequest::getText - Returns the app token
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish when the error code
+         * is MegaError::API_OK:
+         * - MegaRequest::getNumber - Returns the last available version code of the app
+         * - MegaRequest::getName - Returns the last available version string of the app
+         *
+         * Usually, the version code is used to internally control updates, and the version
+         * string is intended to be shown to final users.
+         *
+         * @param appKey Token of the app to check or NULL to use the same value as in the
+         * initialization of the MegaApi object
+         * @param listener MegaRequestListener to track this request
+         */
+        void getLastAvailableVersion(const char *appKey = NULL, MegaRequestListener *listener = NULL);
+
+        /**
+         * @brief Get a SSL certificate for communications with the webclient
+         *
+         * The associated request type with this request is MegaRequest::TYPE_GET_LOCAL_SSL_CERT
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish when the error code
+         * is MegaError::API_OK:
+         * - MegaRequest::getNumber - Returns the expiration time of the certificate (in seconds since the Epoch)
+         * - MegaRequest::getMegaStringMap - Returns the data of the certificate
+         *
+         * The data returned in the string map is encoded in PEM format.
+         * The key "key" of the map contains the private key of the certificate.
+         * The key "cert" of the map contains the certificate.
+         * Intermediate certificates are provided in keys "intermediate_1" - "intermediate_X".
+         *
+         * @param listener MegaRequestListener to track this request
+         */
+        void getLocalSSLCertificate(MegaRequestListener *listener = NULL);
+
+        /**
+         * @brief Get the IP of a MegaChat server
+         *
+         * This function allows to get the correct IP to connect to a MEGAchat server
+         * using Websockets.
+         *
+         * The associated request type with this request is MegaRequest::TYPE_QUERY_DNS
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish when the error code
+         * is MegaError::API_OK:
+         * - MegaRequest::getText - Returns the IP of the hostname.
+         * IPv6 addresses are returned between brackets
+         *
+         * @param hostname Hostname to resolve
+         * @param listener MegaRequestListener to track this request
+         */
+        void queryDNS(const char *hostname, MegaRequestListener *listener = NULL);
+
+        /**
+         * @brief queryGeLB Query the GeLB server for a given service
+         *
+         * The associated request type with this request is MegaRequest::TYPE_QUERY_GELB
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish when the error code
+         * is MegaError::API_OK:
+         * - MegaRequest::getNumber - Return the HTTP status code from the GeLB server
+         * - MegaRequest::getText - Returns the JSON response from the GeLB server
+         * - MegaRequest::getTotalBytes - Returns the number of bytes in the response
+         *
+         * @param service Service to check
+         * @param timeoutds Timeout for the request, including all possible retries (in deciseconds)
+         * A value <= 0 means no (or infinite) timeout.
+         * @param maxretries Maximum number of retries for the request
+         * @param listener MegaRequestListener to track this request
+         */
+        void queryGeLB(const char *service, int timeoutds = 40, int maxretries = 4, MegaRequestListener *listener = NULL);
+
+        /**
+         * @brief Download a file using a HTTP GET request
+         *
+         * The associated request type with this request is MegaRequest::TYPE_DOWNLOAD_FILE
+         *
+         * Valid data in the MegaRequest object received in onRequestFinish when the error code
+         * is MegaError::API_OK:
+         * - MegaRequest::getNumber - Return the HTTP status code from the server
+         * - MegaRequest::getTotalBytes - Returns the number of bytes of the file
+         *
+         * If the request finishes with the error code MegaError::API_OK, the destination path
+         * contains the downloaded file. If it's not possible to write in the destination path
+         * the error code will be MegaError::API_EWRITE
+         *
+         * @param url URL of the file
+         * @param dstpath Destination path for the downloaded file
+         * @param listener MegaRequestListener to track this request
+         */
+        void downloadFile(const char *url, const char *dstpath, MegaRequestListener *listener = NULL);
+
+        /**
+         * @brief Get the User-Agent header used by the SDK
+         *
+         * The SDK retains the ownership of the returned value. It will be valid until
+         * the MegaApi object is deleted.
+         *
+         * @return User-Agent used by the SDK
+         */
+        const char *getUserAgent();
+
+        /**
+         * @brief Get the base path set during initialization
+         *
+         * The SDK retains the ownership of the returned value. It will be valid until
+         * the MegaApi object is deleted.
+         *
+         * @return Base path
+         */
+        const char *getBasePath();
+
+        /**
+         * @brief Enable or disable the in-memory index of node names
+         *
+         * When enabled, MegaApi::search (the variants without a parent node) uses an
+         * index of the names of all files and folders instead of walking the whole
+         * account, so searches take milliseconds even on very large accounts and the
+         * SDK is only locked briefly. The index is maintained incrementally as nodes
+         * are loaded, added, renamed and removed, at the cost of some extra memory.
+         *
+         * The index is built from the currently loaded nodes when this function is
+         * called with true, and discarded when it is called with false.
+         *
+         * By default, the index is disabled.
+         *
+         * @param enable True to enable the index, false to disable it
+         */
+        void enableSearchIndex(bool enable);
+
+        /**
+         * @brief Check if the in-memory index of node names is enabled
+         *
+         * @return True if the index is enabled
+         * @see MegaApi::enableSearchIndex
+         */
+        bool isSearchIndexEnabled();
+
+        /**
+         * @brief Enable or disable lazy loading of nodes from the local cache
+         *
+         * When enabled, resuming a session from the local cache only keeps the
+         * skeleton of each node in memory (handle, parent, type, size, owner and
+         * creation time). The key, name and other attributes of a node are read
+         * from the local cache the first time they are needed, for example when
+         * the node is returned to the app. This reduces the time and memory needed
+         * to resume sessions of large accounts.
+         *
+         * Shared and exported nodes are always loaded in full. Some features need
+         * the whole account in memory and load all pending nodes when used: syncs,
+         * the search index, and searches by fingerprint.
+         *
+         * This option only has an effect on the next session resumption, so it
+         * should be set before MegaApi::fetchNodes. Disabling it loads all the
+         * nodes that are still pending.
+         *
+         * By default, lazy loading is disabled.
+         *
+         * @param enable True to enable lazy loading, false to disable it
+         */
+        void enableLazyNodeLoading(bool enable);
+
+        /**
+         * @brief Check if lazy loading of nodes from the local cache is enabled
+         *
+         * @return True if lazy loading is enabled
+         * @see MegaApi::enableLazyNodeLoading
+         */
+        bool isLazyNodeLoadingEnabled();
+
+        /**
+         * @brief Enable or disable writing the local cache on a background thread
+         *
+         * By default, changes to the local cache are written to disk by the thread
+         * that processes requests and transfers, which can stall it on slow storage.
+         * When enabled, records are still prepared (serialized and encrypted) by that
+         * thread, but the disk writes run on a dedicated thread.
+         *
+         * MegaEvent::EVENT_COMMIT_DB is then sent once a commit has actually reached
+         * storage, rather than when it is issued.
+         *
+         * This option takes effect the next time the local cache is opened, so it
+         * should be set before logging in or resuming a session.
+         *
+         * @param enable True to write the local cache asynchronously
+         */
+        void enableAsyncDbWrites(bool enable);
+
+        /**
+         * @brief Check if the local cache is written on a background thread
+         *
+         * @return True if asynchronous writes are enabled
+         * @see MegaApi::enableAsyncDbWrites
+         */
+        bool areAsyncDbWritesEnabled();
+
+        /**
+         * @brief Enable or disable snapshots of the local cache
+         *
+         * By default, resuming a session rebuilds the account from the local cache
+         * one record at a time. When enabled, the SDK also keeps a snapshot of the
+         * whole cache in a few large records, refreshed from time to time once the
+         * account is up to date, and later changes are applied on top of it when the
+         * session is resumed. This speeds up the resumption of large accounts at the
+         * cost of some extra disk space.
+         *
+         * Snapshots are not refreshed while nodes are loaded lazily
+         * (see MegaApi::enableLazyNodeLoading). Disabling them removes the current one.
+         *
+         * @param enable True to keep a snapshot of the local cache
+         */
+        void enableStateCacheSnapshots(bool enable);
+
+        /**
+         * @brief Check if snapshots of the local cache are enabled
+         *
+         * @return True if snapshots are enabled
+         * @see MegaApi::enableStateCacheSnapshots
+         */
+        bool areStateCacheSnapshotsEnabled();
+
+        /**
+         * @brief Enable or disable the reconciliation of full reloads
+         *
+         * When the local cache is too far behind the account (eg. after a long time
+         * offline), MEGA asks the SDK to reload the whole account. By default, the
+         * local cache is then rewritten from scratch. When enabled, the reloaded nodes
+         * are compared with the ones in the local cache and only the records of the
+         * nodes that were added, changed or removed are written, which is much faster
+         * for large accounts where most nodes didn't change.
+         *
+         * The app is still notified that the whole account was reloaded.
+         *
+         * @param enable True to reconcile full reloads with the local cache
+         */
+        void enableReloadReconciliation(bool enable);
+
+        /**
+         * @brief Check if full reloads are reconciled with the local cache
+         *
+         * @return True if the reconciliation is enabled
+         * @see MegaApi::enableReloadReconciliation
+         */
+        bool isReloadReconciliationEnabled();
+
+        /**
+         * @brief Enable or disable the prefetch of action packets
+         *
+         * By default, the SDK requests the next batch of changes of the account
+         * (action packets) only after it has applied the current one. When catching up
+         * after a long time offline, with many batches queued in MEGA, most of the time
+         * is then spent waiting for the server. When enabled, the next batch is requested
+         * as soon as the current one is received, and is downloaded while the current
+         * one is applied.
+         *
+         * @param enable True to prefetch action packets
+         */
+        void enableActionPacketPrefetch(bool enable);
+
+        /**
+         * @brief Check if action packets are prefetched
+         *
+         * @return True if the prefetch is enabled
+         * @see MegaApi::enableActionPacketPrefetch
+         */
+        bool isActionPacketPrefetchEnabled();
+
+        /**
+         * @brief Coalesce the notifications of updated nodes
+         *
+         * By default, MegaListener::onNodesUpdate is called every time that a batch of
+         * changes is applied to the nodes of the account, which can happen many times per
+         * second (eg. while a sync uploads many small files). When a coalescing window is
+         * set, the changes are accumulated and delivered in a single notification once the
+         * window has elapsed since the first pending change, or earlier once maxNodes nodes
+         * are pending. A node that changes several times in the window is reported once,
+         * in its latest state, with all its changes.
+         *
+         * A full reload of the account drops any pending change and is notified as usual.
+         *
+         * @param milliseconds Coalescing window (0 to notify every change immediately)
+         * @param maxNodes Number of pending nodes that triggers the notification before the
+         * end of the window (0 for no limit)
+         */
+        void setNodeUpdateCoalescing(int milliseconds, int maxNodes);
+
+        /**
+         * @brief Get the coalescing window of the notifications of updated nodes
+         *
+         * @return Coalescing window in milliseconds (0 if changes are notified immediately)
+         * @see MegaApi::setNodeUpdateCoalescing
+         */
+        int getNodeUpdateCoalescingWindow();
+
+        /**
+         * @brief Enable or disable compact notifications of updated nodes
+         *
+         * By default, MegaListener::onNodesUpdate receives a copy of every updated node.
+         * When enabled, MegaListener::onNodesChanged is called instead, with only the handles
+         * and the changes of the nodes, which is much cheaper for apps that only need to know
+         * what to refresh.
+         *
+         * @param enable True to receive compact notifications
+         */
+        void enableCompactNodeUpdates(bool enable);
+
+        /**
+         * @brief Check if compact notifications of updated nodes are enabled
+         *
+         * @return True if compact notifications are enabled
+         * @see MegaApi::enableCompactNodeUpdates
+         */
+        bool areCompactNodeUpdatesEnabled();
+
+        /**
+         * @brief Enable or disable the lazy loading of folder links
+         *
+         * By default, MegaApi::fetchNodes gets and decrypts the whole tree of a folder link
+         * before any of it is available, which takes long for huge folder links. When
+         * enabled, it only gets the root folder of the link and its children, and the
+         * children of other folders are fetched when requested with MegaApi::fetchFolder.
+         * Lazily loaded folder links are not kept in the local cache.
+         *
+         * The setting applies from the next call to MegaApi::fetchNodes in a folder link.
+         * It doesn't affect accounts.
+         *
+         * @param enable True to load folder links lazily
+         */
+        void enableLazyFolderLinks(bool enable);
+
+        /**
+         * @brief Check if folder links are loaded lazily
+         *
+         * @return True if lazy folder links are enabled
+         * @see MegaApi::enableLazyFolderLinks
+         */
+        bool areLazyFolderLinksEnabled();
+
+        /**
+         * @brief Enable or disable the adaptive tuning of transfers
+         *
+         * When enabled, each transfer (except CloudRAID downloads and small files) starts
+         * with the number of connections set by MegaApi::setMaxConnections and adjusts it,
+         * up to 8, while doing so makes it faster. Downloads also grow the size of their
+         * requests (from 1 MB up to 16 MB) when they complete quickly, and shrink it when
+         * they are slow or fail.
+         *
+         * The setting applies to the transfers started after the call.
+         *
+         * @param enable True to tune transfers adaptively
+         */
+        void enableAdaptiveTransfers(bool enable);
+
+        /**
+         * @brief Check if transfers are tuned adaptively
+         *
+         * @return True if adaptive transfers are enabled
+         * @see MegaApi::enableAdaptiveTransfers
+         */
+        bool areAdaptiveTransfersEnabled();
+
+        /**
+         * @brief Set the order in which queued transfers are started
+         *
+         * Valid values are:
+         * - MegaApi::TRANSFER_SCHEDULE_PRIORITY = 0
+         * Transfers start in queue order and few of them run at the same time, so each
+         * one gets more bandwidth. This favours throughput and it's the default.
+         *
+         * - MegaApi::TRANSFER_SCHEDULE_SMALL_FIRST = 1
+         * The smallest queued transfer starts first and as many transfers as allowed run
+         * at the same time. This favours finishing many small files.
+         *
+         * - MegaApi::TRANSFER_SCHEDULE_FAIR = 2
+         * Transfers are grouped in classes: the transfers of a folder transfer are one class
+         * and any other transfer is a class on its own. The next transfer to start is the
+         * first one in queue order of the class with the fewest running transfers for its
+         * weight (see MegaApi::setTransferClassWeight), so a big transfer doesn't hold up
+         * the rest of the queue.
+         *
+         * The schedule applies to uploads and downloads, from the next transfer to start.
+         *
+         * @param schedule Transfer schedule
+         */
+        void setTransferSchedule(int schedule);
+
+        /**
+         * @brief Get the order in which queued transfers are started
+         *
+         * @return Transfer schedule
+         * @see MegaApi::setTransferSchedule
+         */
+        int getTransferSchedule();
+
+        /**
+         * @brief Set the weight of a class of transfers for MegaApi::TRANSFER_SCHEDULE_FAIR
+         *
+         * A class with weight 2 gets twice the running transfers of a class with weight 1.
+         * Classes have weight 1 unless set.
+         *
+         * @param transferTag Tag of the folder transfer, or of the transfer, of the class
+         * (see MegaTransfer::getTag)
+         * @param weight Weight of the class, or 0 to restore the default
+         */
+        void setTransferClassWeight(int transferTag, unsigned weight);
+
+        /**
+         * @brief Enable or disable the batched completion of uploads
+         *
+         * By default, each upload creates its node with a request of its own once the
+         * file data has been sent. When enabled, the uploads that finish within half a
+         * second of each other into the same folder create their nodes in a single
+         * request (up to 2000 nodes), which speeds up the upload of many small files.
+         * Uploads of synced files are not batched.
+         *
+         * MegaTransferListener::onTransferFinish is called for each upload as usual,
+         * when the request of its batch finishes.
+         *
+         * @param enable True to batch the completion of uploads
+         */
+        void enableUploadBatching(bool enable);
+
+        /**
+         * @brief Check if the completion of uploads is batched
+         *
+         * @return True if upload batching is enabled
+         * @see MegaApi::enableUploadBatching
+         */
+        bool isUploadBatchingEnabled();
+
+        /**
+         * @brief Set the number of threads that encrypt and decrypt the data of transfers
+         *
+         * By default (0), uploads are encrypted and downloads decrypted by the thread of
+         * the SDK, which limits the transfer speed to what a single core can process and
+         * delays everything else the SDK does in the meantime. With worker threads, each
+         * upload chunk is encrypted by one of them and sent when done, and each piece of
+         * downloaded data is decrypted and verified by one of them and written when done.
+         *
+         * The value applies to the data prepared after the call.
+         *
+         * @param threads Number of worker threads (0 to 16)
+         */
+        void setTransferCryptoThreads(int threads);
+
+        /**
+         * @brief Get the number of threads that encrypt and decrypt the data of transfers
+         *
+         * @return Number of worker threads, 0 if the SDK thread does it
+         * @see MegaApi::setTransferCryptoThreads
+         */
+        int getTransferCryptoThreads();
+
+        /**
+         * @brief Share one pool of worker threads among the MegaApi instances of the process
+         *
+         * Apps that keep many accounts logged in at once, one MegaApi instance each, would
+         * otherwise start a set of crypto worker threads per instance. With a shared pool,
+         * the instances created after this call queue their transfer encryption and
+         * decryption and their folder scans on the same threads, and each instance still
+         * waits only for its own jobs. Each instance enables its transfer workers with
+         * MegaApi::setTransferCryptoThreads as usual; the number passed there is then
+         * ignored in favour of the shared pool.
+         *
+         * Instances created before the call keep the threads they have. Setting 0 stops
+         * sharing for the instances created later; the old pool ends when the last
+         * instance using it is deleted.
+         *
+         * @param threads Number of threads of the shared pool (0 to 64)
+         */
+        static void setSharedWorkerThreads(int threads);
+
+        /**
+         * @brief Get the number of threads of the shared worker pool
+         *
+         * @return Number of threads, 0 if each instance has its own workers
+         * @see MegaApi::setSharedWorkerThreads
+         */
+        static int getSharedWorkerThreads();
+
+        /**
+         * @brief Share the DNS cache and the TLS sessions among the MegaApi instances of the process
+         *
+         * When enabled, the instances created after this call resolve the MEGA servers
+         * into one cache and resume each other's TLS sessions, so that an app with many
+         * accounts does not repeat the same lookups and full handshakes per account.
+         * Connections themselves are not shared.
+         *
+         * Instances created before the call keep their own caches.
+         *
+         * This option only has effect with the cURL network layer.
+         *
+         * @param enable True to share the caches with the instances created later
+         */
+        static void enableSharedNetworkCaches(bool enable);
+
+        /**
+         * @brief Check if new instances share the DNS cache and the TLS sessions
+         *
+         * @return True if the caches are shared
+         * @see MegaApi::enableSharedNetworkCaches
+         */
+        static bool areSharedNetworkCachesEnabled();
+
+        /**
+         * @brief Choose the network layer of the MegaApi instances created later
+         *
+         * Windows builds with cURL also include the WinHTTP layer of the builds without it.
+         * The cURL layer keeps its own DNS cache (c-ares), pools the connections of each
+         * kind of transfer, applies the speed limits and can move the data of transfers on
+         * a network thread (MegaApi::setNetworkThreadEnabled), so it is the default. WinHTTP uses
+         * the proxy settings and the certificate store of the system, which some managed
+         * environments require.
+         *
+         * Valid values for this parameter are:
+         * - MegaApi::NETWORK_BACKEND_DEFAULT = 0
+         * The layer the SDK was built with: cURL if it is available.
+         *
+         * - MegaApi::NETWORK_BACKEND_CURL = 1
+         * cURL with c-ares.
+         *
+         * - MegaApi::NETWORK_BACKEND_WINHTTP = 2
+         * WinHTTP (Windows only).
+         *
+         * Instances created before the call keep their network layer. Layers not included
+         * in the build are ignored.
+         *
+         * @param backend Network layer of the instances created later
+         */
+        static void setNetworkBackend(int backend);
+
+        /**
+         * @brief Get the network layer chosen for new MegaApi instances
+         *
+         * @return The value set with MegaApi::setNetworkBackend
+         * @see MegaApi::setNetworkBackend
+         */
+        static int getNetworkBackend();
+
+        /**
+         * @brief Set the number of threads that generate thumbnails and previews
+         *
+         * By default, the thumbnails and previews of uploaded files are generated one
+         * at a time. With more threads, several media files are processed at the same
+         * time, each one by its own thread. Thumbnails of uploads are generated before
+         * the ones of existing files.
+         *
+         * Only the FreeImage graphics processor supports more than one thread. With
+         * other processors this value has no effect.
+         *
+         * The media files being processed are completed before the change applies.
+         *
+         * @param threads Number of worker threads (1 to 16)
+         */
+        void setGfxWorkers(int threads);
+
+        /**
+         * @brief Get the number of threads that generate thumbnails and previews
+         *
+         * @return Number of worker threads, 0 if there is no graphics processor
+         * @see MegaApi::setGfxWorkers
+         */
+        int getGfxWorkers();
+
+        /**
+         * @brief Choose how the SDK adapts its use of resources to the power state of the device
+         *
+         * Encrypting and hashing transfers and synced files at full speed makes mobile devices
+         * drain their battery and heat up until the OS throttles them. The low power preset
+         * limits the work done at the same time:
+         * - Each new transfer uses one connection, without the extra connections of
+         * MegaApi::enableAdaptiveTransfers nor the duplicated requests of
+         * MegaApi::enableHedgedDownloads. The active transfers are restarted when the preset
+         * changes. The values set with MegaApi::setMaxConnections are kept.
+         * - One thumbnail or preview is generated at a time (see MegaApi::setGfxWorkers).
+         * - Two threads scan the synced folders, instead of eight, from the next scan.
+         * - The local cache is committed at most every 30 seconds while there are updates from
+         * the server.
+         *
+         * Valid values are:
+         * - MegaApi::POWER_POLICY_AUTO = 0: the low power preset applies with
+         * MegaApi::POWER_STATE_BATTERY_LOW, MegaApi::POWER_STATE_POWER_SAVER and from
+         * MegaApi::THERMAL_STATE_SERIOUS, as reported by MegaApi::setPowerState
+         * - MegaApi::POWER_POLICY_UNRESTRICTED = 1: the low power preset never applies
+         * - MegaApi::POWER_POLICY_LOW_POWER = 2: the low power preset always applies
+         *
+         * The default value is MegaApi::POWER_POLICY_AUTO. The preset in effect, the number of
+         * changes of preset and the number of postponed commits are included in the metrics
+         * as mega_power_low, mega_power_switches_total and mega_sc_commits_deferred_total
+         * (see MegaApi::httpServerEnableMetrics).
+         *
+         * @param policy Power policy
+         */
+        void setPowerPolicy(int policy);
+
+        /**
+         * @brief Get the power policy
+         *
+         * @return Power policy
+         * @see MegaApi::setPowerPolicy
+         */
+        int getPowerPolicy();
+
+        /**
+         * @brief Report the power and thermal state of the device
+         *
+         * Call it whenever the OS notifies a change, for MegaApi::POWER_POLICY_AUTO.
+         *
+         * Valid values for the power state are:
+         * - MegaApi::POWER_STATE_CHARGING = 0
+         * - MegaApi::POWER_STATE_BATTERY = 1
+         * - MegaApi::POWER_STATE_BATTERY_LOW = 2
+         * - MegaApi::POWER_STATE_POWER_SAVER = 3: the power saving mode of the OS is on
+         *
+         * The thermal states are the ones of iOS (ProcessInfo.ThermalState). On Android,
+         * PowerManager.THERMAL_STATUS_LIGHT maps to MegaApi::THERMAL_STATE_FAIR,
+         * THERMAL_STATUS_MODERATE and THERMAL_STATUS_SEVERE to MegaApi::THERMAL_STATE_SERIOUS
+         * and the higher ones to MegaApi::THERMAL_STATE_CRITICAL:
+         * - MegaApi::THERMAL_STATE_NOMINAL = 0
+         * - MegaApi::THERMAL_STATE_FAIR = 1
+         * - MegaApi::THERMAL_STATE_SERIOUS = 2
+         * - MegaApi::THERMAL_STATE_CRITICAL = 3
+         *
+         * The SDK assumes MegaApi::POWER_STATE_CHARGING and MegaApi::THERMAL_STATE_NOMINAL
+         * until this function is called.
+         *
+         * @param powerState Power state of the device
+         * @param thermalState Thermal state of the device
+         */
+        void setPowerState(int powerState, int thermalState);
+
+        /**
+         * @brief Check if the low power preset applies
+         *
+         * @return true if the SDK limits its use of resources, otherwise false
+         * @see MegaApi::setPowerPolicy
+         */
+        bool isLowPowerActive();
+
+        /**
+         * @brief Deliver the transfer callbacks from a thread of their own
+         *
+         * By default, the callbacks of MegaTransferListener and the transfer callbacks of
+         * MegaListener are called by the thread of the SDK, so a slow callback delays the
+         * network and the transfers. When enabled, MegaTransferListener::onTransferStart,
+         * MegaTransferListener::onTransferUpdate, MegaTransferListener::onTransferTemporaryError
+         * and MegaTransferListener::onTransferFinish (and those of MegaListener) are called in
+         * order by another thread, with a copy of the MegaTransfer object. When the app is
+         * slower than the updates of a transfer, it only gets the latest state of the transfer.
+         *
+         * MegaTransferListener::onTransferData is still called by the thread of the SDK.
+         * Transfer callbacks are no longer ordered with the callbacks of other kinds.
+         *
+         * Once a listener has been removed from a thread of the app it isn't called anymore.
+         * A listener removed from a callback of another kind may still get one more callback.
+         *
+         * When disabled, the callbacks already queued are delivered before this function returns.
+         * Don't disable it from a transfer callback.
+         *
+         * @param enable True to call the transfer callbacks from a thread of their own
+         */
+        void enableAsyncTransferCallbacks(bool enable);
+
+        /**
+         * @brief Check if the transfer callbacks are delivered from a thread of their own
+         *
+         * @return True if they are, false if they're called by the thread of the SDK
+         * @see MegaApi::enableAsyncTransferCallbacks
+         */
+        bool areAsyncTransferCallbacksEnabled();
+
+        /**
+         * @brief Enable or disable hedged download requests
+         *
+         * A download can stall on a single slow connection: the rest of the file waits
+         * for that piece. When enabled, a request that takes longer than 90% of the
+         * recent requests of the same download (and more than 2 seconds) is sent again
+         * on a new connection, and the data of the copy that finishes first is used.
+         * At most two copies are in flight per download, so the extra bandwidth is
+         * limited to the slowest requests.
+         *
+         * Cloudraid downloads keep switching away from a stalled part as usual.
+         *
+         * The setting applies to the downloads started after the call.
+         *
+         * @param enable True to hedge late download requests
+         */
+        void enableHedgedDownloads(bool enable);
+
+        /**
+         * @brief Check if late download requests are hedged
+         *
+         * @return True if hedged downloads are enabled
+         * @see MegaApi::enableHedgedDownloads
+         */
+        bool areHedgedDownloadsEnabled();
+
+        /**
+         * @brief Set how many chunks of each upload are read from disk ahead of time
+         *
+         * By default (0), each connection of an upload reads its next chunk from disk once
+         * the previous one has been sent. With read-ahead, the next chunk is read while the
+         * previous one is being encrypted and sent, so the upload doesn't wait for the disk.
+         * Each read-ahead chunk takes a buffer of up to the chunk size (1 MB).
+         *
+         * Read-ahead needs asynchronous file access, available on Linux and Windows. On
+         * Linux, io_uring is used for it where the kernel supports it.
+         *
+         * The value applies to the uploads started after the call.
+         *
+         * @param chunks Number of chunks read ahead per upload (0 to 8), at most one per connection
+         */
+        void setUploadReadAhead(int chunks);
+
+        /**
+         * @brief Get how many chunks of each upload are read from disk ahead of time
+         *
+         * @return Number of chunks read ahead per upload
+         * @see MegaApi::setUploadReadAhead
+         */
+        int getUploadReadAhead();
+
+        /**
+         * @brief Keep the fingerprints of local files in the local cache
+         *
+         * The fingerprint of a file is needed to upload it and, for syncs, to detect
+         * changes. Computing it reads part of the file. With this option, the fingerprints
+         * of the files uploaded or synced are kept, by file system id, size and modification
+         * time, so a file that hasn't changed isn't read again, even after a restart.
+         *
+         * The fingerprints are stored along with the transfers, so the transfer resumption
+         * must be enabled (see MegaApi::enableTransferResumption). They are encrypted with
+         * the key of the session and removed with the cache of the transfers, or when the
+         * option is disabled.
+         *
+         * This option is disabled by default.
+         *
+         * @param enable True to keep the fingerprints of local files
+         */
+        void enableFingerprintCache(bool enable);
+
+        /**
+         * @brief Check if the fingerprints of local files are kept in the local cache
+         *
+         * @return True if the fingerprint cache is enabled
+         * @see MegaApi::enableFingerprintCache
+         */
+        bool isFingerprintCacheEnabled();
+
+        /**
+         * @brief Open connections to storage servers before the transfers need them
+         *
+         * Each transfer gets a temporary URL from the API and then connects to the storage
+         * server (DNS, TCP and TLS) before any data flows. With this option, when a transfer
+         * starts, idle connections are opened to the storage servers used recently and to
+         * those of the next queued transfers whose URLs are already known (resumed transfers),
+         * so the connections are ready when the transfers need them. Servers used in the last
+         * seconds are skipped, since their connections are still open.
+         *
+         * Currently, this option only has effect using the cURL-based network layer and
+         * without a proxy.
+         *
+         * This option is disabled by default.
+         *
+         * @param enable True to open connections to storage servers ahead of time
+         */
+        void enableConnectionPrewarming(bool enable);
+
+        /**
+         * @brief Check if connections to storage servers are opened ahead of time
+         *
+         * @return True if the connection prewarming is enabled
+         * @see MegaApi::enableConnectionPrewarming
+         */
+        bool isConnectionPrewarmingEnabled();
+
+        /**
+         * @brief Request the temporary URLs of queued transfers before they start
+         *
+         * Each transfer requests its temporary URL from the API when it gets a transfer slot,
+         * so with many small files the round trip to the API comes before every file. With
+         * this option, the URLs of the next queued uploads and downloads are requested in
+         * advance, together in the same request to the API, and the transfers start with them
+         * as soon as they get a slot. URLs not used within a few minutes are requested again.
+         *
+         * With MegaApi::enableConnectionPrewarming, the connections to the storage servers
+         * of those URLs are opened in advance too.
+         *
+         * This option is disabled by default.
+         *
+         * @param enable True to request the URLs of queued transfers in advance
+         */
+        void enableTransferUrlPrefetching(bool enable);
+
+        /**
+         * @brief Check if the temporary URLs of queued transfers are requested in advance
+         *
+         * @return True if the URL prefetching is enabled
+         * @see MegaApi::enableTransferUrlPrefetching
+         */
+        bool isTransferUrlPrefetchingEnabled();
+
+        /**
+         * @brief Read the local cache of a resumed session while its login is in progress
+         *
+         * When a session is resumed with MegaApi::fastLogin, the local cache is read by
+         * MegaApi::fetchNodes, after the response of the login. With this option, the records of the
+         * local cache are read from disk while the login request waits for the response of the API,
+         * and MegaApi::fetchNodes only has to decrypt them. They are kept in memory until then.
+         *
+         * The commands of the startup that don't need the response of the login are sent in the
+         * same request as the login in any case.
+         *
+         * This option is disabled by default.
+         *
+         * @param enable True to read the local cache during the login of resumed sessions
+         */
+        void enablePipelinedStartup(bool enable);
+
+        /**
+         * @brief Check if the local cache of resumed sessions is read during their login
+         *
+         * @return True if the pipelined startup is enabled
+         * @see MegaApi::enablePipelinedStartup
+         */
+        bool isPipelinedStartupEnabled();
+
+        /**
+         * @brief Keep the TLS sessions in the local cache, to resume them after a restart
+         *
+         * With this option, the TLS sessions established with the API and the storage servers
+         * are saved periodically and when the SDK is closed, and resumed by the next instance,
+         * which saves a full TLS handshake per server after a restart.
+         *
+         * The sessions are stored along with the transfers, so the transfer resumption
+         * must be enabled (see MegaApi::enableTransferResumption). They are encrypted with
+         * the key of the session and removed with the cache of the transfers, or when the
+         * option is disabled.
+         *
+         * Currently, this option only has effect using the cURL-based network layer, with
+         * cURL 8.12.0 or newer built with support to export SSL sessions.
+         *
+         * This option is disabled by default.
+         *
+         * @param enable True to keep the TLS sessions in the local cache
+         */
+        void enableTlsSessionCache(bool enable);
+
+        /**
+         * @brief Check if the TLS sessions are kept in the local cache
+         *
+         * @return True if the TLS session cache is enabled
+         * @see MegaApi::enableTlsSessionCache
          */
-        bool processMegaTree(MegaNode* node, MegaTreeProcessor* processor, bool recursive = 1);
+        bool isTlsSessionCacheEnabled();
 
         /**
-         * @brief Create a MegaNode that represents a file of a different account
+         * @brief Get statistics of the network activity, as a JSON string
          *
-         * The resulting node can be used in MegaApi::startDownload and MegaApi::startStreaming but
-         * can not be copied.
+         * The statistics are grouped by direction ("get", "put" and "api") and host
+         * ("scheme://host:port", with the hosts beyond the first 128 of a direction added up
+         * under "other"). For each host they include:
+         * - "dns", "connect", "tls": time (ms) to resolve the host (when it wasn't in the DNS
+         * cache), to establish a TCP connection and to complete the TLS handshake (for new
+         * connections)
+         * - "ttfb": time (ms) since a request started to be sent until the first byte of the response
+         * - "status": number of requests by HTTP status (0 when there was no response)
+         * - "connections": number of new connections
+         * - "in", "out": bytes received and sent
          *
-         * At least the parameters handle, key, size, mtime and auth must be correct to be able to use the resulting node.
+         * Times are histograms: {"n": samples, "avg": average, "buckets": [...]}, with 16 buckets
+         * for < 1 ms, < 2 ms, < 4 ms ... and >= 16384 ms.
+         *
+         * The "retries" object has the number of retries with exponential backoff of the
+         * requests to the API ("cs", "cspipelined"), of the connection to receive server-client
+         * updates ("sc") and of other internal requests.
+         *
+         * The "fileattributes" object describes the uploads of thumbnails and previews:
+         * "queued" and "queuedbytes" waiting to be sent, "active" being sent, "uploaded" and
+         * "failed" since the last reset, and "uploadshalted", the number of times that file
+         * uploads waited because too many attributes were queued.
+         *
+         * The "exec" object describes the iterations of the SDK thread. For each of its
+         * subsystems ("sc" for the processing of server-client updates, "transfers",
+         * "directreads" for streaming, "sync" for the local updates of changed synced folders
+         * and "dbcommit" for the local cache commits) it includes its time budget per iteration
+         * ("budget", in ms, 0 when unbounded), the number of iterations that it ended with work
+         * left for the next one ("yields") and a histogram of the time it took per iteration
+         * ("time"). The "wakeups" object counts the waits skipped because some event was already
+         * overdue ("immediate") and because of work left by a previous iteration ("carried").
+         *
+         * Currently, only the cURL-based network layer collects host statistics.
          *
          * You take the ownership of the returned value.
          *
-         * @param handle Handle of the node
-         * @param key Key of the node (Base64 encoded)
-         * @param name Name of the node (Base64 encoded)
-         * @param size Size of the node
-         * @param mtime Modification time of the node
-         * @param parentHandle Handle of the parent node
-         * @param privateAuth Private authentication token to access the node
-         * @param publicAuth Public authentication token to access the node
-         * @param chatAuth Chat authentication token to access the node
-         * @return MegaNode object
+         * @param reset True to start counting from zero after this call
+         * @return JSON string with the network statistics
          */
-        MegaNode *createForeignFileNode(MegaHandle handle, const char *key, const char *name,
-                                       int64_t size, int64_t mtime, MegaHandle parentHandle, const char *privateAuth, const char *publicAuth, const char *chatAuth);
+        char* getNetworkStats(bool reset = false);
 
         /**
-         * @brief Create a MegaNode that represents a folder of a different account
+         * @brief Get an estimate of the memory used by the SDK, by subsystem
          *
-         * The resulting node can not be successfully used in any other function of MegaApi.
-         * The resulting object is only useful to store the values passed as parameters.
+         * The result is a JSON object with an entry per subsystem, each with the number of
+         * objects ("count") and the approximate bytes they hold ("bytes"), and the sum of
+         * the bytes ("total"):
+         * - "nodes": the nodes of the account, with their keys and attributes
+         * - "fingerprints", "nameindex", "recentnodes": the indexes of the nodes
+         * - "localnodes": the local nodes of the syncs and their indexes
+         * - "users": the contacts
+         * - "transfers": the queued and cached transfers, with their chunk MACs
+         * - "transferslots": the active transfers, with their pending data and requests
+         * - "directreads": the active streaming reads, with their pending data and requests
+         * - "directreadcache": the data kept for streaming reads (no count)
+         * - "useralerts": the user alerts
+         * - "requests": the requests to the API and their responses
+         * - "httpbufferpool": the free transfer buffers kept for reuse, shared by all the
+         * MegaApi instances (no count)
+         * - "streaming": the buffers of the local HTTP/FTP servers, shared by all the MegaApi
+         * instances
+         *
+         * The sizes are computed from the structures, which are walked for each call: it takes
+         * a few milliseconds per 100k nodes. Allocator overheads are not included.
          *
          * You take the ownership of the returned value.
-
-         * @param handle Handle of the node
-         * @param name Name of the node (Base64 encoded)
-         * @param parentHandle Handle of the parent node
-         * @param privateAuth Private authentication token to access the node
-         * @param publicAuth Public authentication token to access the node
-         * @return MegaNode object
+         *
+         * @return JSON string with the memory usage
          */
-        MegaNode *createForeignFolderNode(MegaHandle handle, const char *name, MegaHandle parentHandle, const char *privateAuth, const char *publicAuth);
+        char* getMemoryUsageReport();
 
         /**
-         * @brief Returns a MegaNode that can be downloaded with any instance of MegaApi
-         *
-         * You can use MegaApi::startDownload with the resulting node with any instance
-         * of MegaApi, even if it's logged into another account, a public folder, or not
-         * logged in.
+         * @brief Time one in every interval runs of the main internal operations of the SDK
          *
-         * If the first parameter is a public node or an already authorized node, this
-         * function returns a copy of the node, because it can be already downloaded
-         * with any MegaApi instance.
+         * The durations of the sampled runs are kept in histograms, see
+         * MegaApi::getPerformanceLatencies. Sampling is available in all builds, is process-wide
+         * and disabled by default. The runs that aren't sampled cost a counter update, so an
+         * interval of a few tens can be kept in production.
          *
-         * If the node in the first parameter belongs to the account or public folder
-         * in which the current MegaApi object is logged in, this funtion returns an
-         * authorized node.
+         * @param interval Every how many runs one is timed, 0 to disable sampling
+         */
+        static void setPerformanceSampling(int interval);
+
+        /**
+         * @brief Get percentiles of the sampled durations of the main internal operations
          *
-         * If the first parameter is NULL or a node that is not a public node, is not
-         * already authorized and doesn't belong to the current MegaApi, this function
-         * returns NULL.
+         * The result is a JSON object with the sampling interval ("interval", see
+         * MegaApi::setPerformanceSampling) and an entry per operation, such as
+         * "MegaClient_exec" (an iteration of the SDK engine), "MegaClient_doWait" (the wait
+         * for events), "cs batch round trip" (a request to the API) and "transfer_complete"
+         * (the completion of a transfer). Each entry has the number of samples ("samples"),
+         * the estimated 50th, 90th and 99th percentiles ("p50us", "p90us", "p99us") and the
+         * maximum ("maxus"), in microseconds. Percentiles are accurate to about 12%.
          *
          * You take the ownership of the returned value.
          *
-         * @param node MegaNode to authorize
-         * @return Authorized node, or NULL if the node can't be authorized
+         * @param reset True to discard the samples after this call
+         * @return JSON string with the latencies
          */
-        MegaNode *authorizeNode(MegaNode *node);
+        char* getPerformanceLatencies(bool reset = false);
 
-#ifdef ENABLE_CHAT
         /**
-         * @brief Returns a MegaNode that can be downloaded/copied with a chat-authorization
+         * @brief Don't upload again files whose content is the same as their previous version
          *
-         * During preview of chat-links, you need to call this method to authorize the MegaNode
-         * from a node-attachment message, so the API allows to access to it. The parameter to
-         * authorize the access can be retrieved from MegaChatRoom::getAuthorizationToken when
-         * the chatroom in in preview mode.
+         * When a file is uploaded over a previous version with the same size and the same
+         * fingerprint samples, but a different modification time, the whole local file is
+         * read and authenticated with the key of the previous version. If its MAC is the one
+         * of the previous version, a new version is created from the data already in the cloud,
+         * with the new modification time, and nothing is uploaded.
          *
-         * You can use MegaApi::startDownload and/or MegaApi::copyNode with the resulting
-         * node with any instance of MegaApi, even if it's logged into another account,
-         * a public folder, or not logged in.
+         * The files are compared on the threads that scan folder uploads, before the upload
+         * starts. A file that differs is uploaded in full: the data of each version is encrypted
+         * with its own key, so unchanged parts of a modified file can't be reused.
          *
-         * You take the ownership of the returned value.
+         * Uploads with a custom modification time are not compared. This option is disabled
+         * by default.
          *
-         * @param node MegaNode to authorize
-         * @param cauth Authorization token (public handle of the chatroom in B64url encoding)
-         * @return Authorized node, or NULL if the node can't be authorized
+         * @param enable True to compare the files with their previous version
+         * @see MegaApi::getUploadDeduplicatedBytes
          */
-        MegaNode *authorizeChatNode(MegaNode *node, const char *cauth);
-#endif
+        void enableUploadDeduplication(bool enable);
 
         /**
-         * @brief Get the SDK version
-         *
-         * The returned string is an statically allocated array.
-         * Do not delete it.
+         * @brief Check if files are compared with their previous version before being uploaded
          *
-         * @return SDK version
+         * @return True if the uploads are deduplicated
+         * @see MegaApi::enableUploadDeduplication
          */
-        const char *getVersion();
+        bool isUploadDeduplicationEnabled();
 
         /**
-         * @brief Get a string with the version of the operating system
+         * @brief Get the bytes not uploaded because the files were the same as their previous version
          *
-         * You take the ownership of the returned string
+         * The value is the sum of the sizes of those files since the MegaApi object was created.
          *
-         * @return Version of the operating system
+         * @return Bytes not uploaded
+         * @see MegaApi::enableUploadDeduplication
          */
-        char *getOperatingSystemVersion();
+        long long getUploadDeduplicatedBytes();
 
         /**
-         * @brief Get the last available version of the app
+         * @brief Compress the files before uploading them, and decompress them when they are read
          *
-         * It returns the last available version corresponding to an app token
+         * Each file of at least 4 KB is compressed (zlib, with a full flush every MB) into a
+         * temporary file in the base path of the MegaApi object, on the threads that scan folder
+         * uploads, and the compressed copy is uploaded. The file is uploaded as it is if it doesn't
+         * shrink by at least a tenth, judging from its first MB and then from the whole file.
          *
-         * The associated request type with this request is MegaRequest::TYPE_APP_VERSION
-         * Valid data in the MegaRequest object received on callbacks:
-         * - MegaRequest::getText - Returns the app token
+         * The nodes uploaded compressed get the custom attributes "z" and "zc" (see
+         * MegaNode::getCustomAttr), with the size and the fingerprint of the original file. The
+         * size and the fingerprint of the node itself are the ones of the compressed data, as are
+         * the size and the progress of the transfers.
          *
-         * Valid data in the MegaRequest object received in onRequestFinish when the error code
-         * is MegaError::API_OK:
-         * - MegaRequest::getNumber - Returns the last available version code of the app
-         * - MegaRequest::getName - Returns the last available version string of the app
+         * Only apps that read those nodes with this option enabled get their content: a download
+         * is finished once the file is restored and checked against the original fingerprint,
+         * and streaming delivers the content to MegaTransferListener::onTransferData. The range
+         * of a streaming transfer is then a range of the content, which is inflated from the
+         * start of the node, so reading the end of a large node downloads all of it. With the
+         * option disabled, or in other apps, the compressed data is transferred as it is. Enable
+         * it only if all the apps reading the files of the account do the same.
          *
-         * Usually, the version code is used to internally control updates, and the version
-         * string is intended to be shown to final users.
+         * This option needs a base path and zlib, and is disabled by default.
          *
-         * @param appKey Token of the app to check or NULL to use the same value as in the
-         * initialization of the MegaApi object
-         * @param listener MegaRequestListener to track this request
+         * @param enable True to compress the uploads and decompress the downloads
          */
-        void getLastAvailableVersion(const char *appKey = NULL, MegaRequestListener *listener = NULL);
+        void setCompressedTransfers(bool enable);
 
         /**
-         * @brief Get a SSL certificate for communications with the webclient
+         * @brief Check if the uploads are compressed and the downloads decompressed
          *
-         * The associated request type with this request is MegaRequest::TYPE_GET_LOCAL_SSL_CERT
+         * @return True if the compressed transfers are enabled
+         * @see MegaApi::setCompressedTransfers
+         */
+        bool areCompressedTransfersEnabled();
+
+        /**
+         * @brief Limit the bandwidth of a transfer or of a class of transfers
          *
-         * Valid data in the MegaRequest object received in onRequestFinish when the error code
-         * is MegaError::API_OK:
-         * - MegaRequest::getNumber - Returns the expiration time of the certificate (in seconds since the Epoch)
-         * - MegaRequest::getMegaStringMap - Returns the data of the certificate
+         * The limit is a token bucket: after an idle period, up to burstBytes are sent at
+         * full speed, then the transfer is paced at bytesPerSecond. Chunks are sent whole,
+         * so the speed averages the limit over a few chunks.
          *
-         * The data returned in the string map is encoded in PEM format.
-         * The key "key" of the map contains the private key of the certificate.
-         * The key "cert" of the map contains the certificate.
-         * Intermediate certificates are provided in keys "intermediate_1" - "intermediate_X".
+         * With the tag of a folder transfer, the limit is shared by all its transfers, like
+         * the weight of MegaApi::setTransferClassWeight. With the tag of a transfer of a
+         * folder transfer, it applies to that transfer in addition to the one of the folder.
+         * These limits apply on top of MegaApi::setMaxUploadSpeed and
+         * MegaApi::setMaxDownloadSpeed.
          *
-         * @param listener MegaRequestListener to track this request
+         * @param transferTag Tag of the transfer or of the folder transfer (see MegaTransfer::getTag)
+         * @param bytesPerSecond Bandwidth limit, or 0 to remove it (and its periods)
+         * @param burstBytes Bytes sent at full speed after an idle period, or 0 for one second of
+         * bandwidth
          */
-        void getLocalSSLCertificate(MegaRequestListener *listener = NULL);
+        void setTransferRateLimit(int transferTag, long long bytesPerSecond, long long burstBytes = 0);
 
         /**
-         * @brief Get the IP of a MegaChat server
-         *
-         * This function allows to get the correct IP to connect to a MEGAchat server
-         * using Websockets.
+         * @brief Use another rate limit during a period of the day
          *
-         * The associated request type with this request is MegaRequest::TYPE_QUERY_DNS
-         *
-         * Valid data in the MegaRequest object received in onRequestFinish when the error code
-         * is MegaError::API_OK:
-         * - MegaRequest::getText - Returns the IP of the hostname.
-         * IPv6 addresses are returned between brackets
+         * The period applies to a limit set by MegaApi::setTransferRateLimit, in local time.
+         * If periods overlap, the first one added applies. For example, to let a backup use
+         * 10 MB/s at night only: setTransferRateLimit(tag, 50 * 1024) and then
+         * addTransferRateLimitPeriod(tag, 22 * 60, 6 * 60, 10 * 1024 * 1024).
          *
-         * @param hostname Hostname to resolve
-         * @param listener MegaRequestListener to track this request
+         * @param transferTag Tag of the transfer or of the folder transfer (see MegaTransfer::getTag)
+         * @param startMinute Start of the period, in minutes since midnight
+         * @param endMinute End of the period (not included), in minutes since midnight. The period
+         * wraps around midnight if it is lower than startMinute
+         * @param bytesPerSecond Bandwidth limit during the period, or 0 for no limit
          */
-        void queryDNS(const char *hostname, MegaRequestListener *listener = NULL);
+        void addTransferRateLimitPeriod(int transferTag, int startMinute, int endMinute, long long bytesPerSecond);
 
         /**
-         * @brief queryGeLB Query the GeLB server for a given service
+         * @brief Set the size of the cache of streamed data
          *
-         * The associated request type with this request is MegaRequest::TYPE_QUERY_GELB
+         * The decrypted data delivered by MegaApi::startStreaming is kept in memory, in blocks of
+         * 1 MB dropped least recently used first, and the streaming of a range already cached
+         * delivers it without downloading it again, e.g. when a media player seeks back or several
+         * clients of the HTTP proxy server read the same file. After a read that continued the
+         * previous one of the same file, the next 4 MB (at most a quarter of the cache) are read
+         * ahead into the cache.
          *
-         * Valid data in the MegaRequest object received in onRequestFinish when the error code
-         * is MegaError::API_OK:
-         * - MegaRequest::getNumber - Return the HTTP status code from the GeLB server
-         * - MegaRequest::getText - Returns the JSON response from the GeLB server
-         * - MegaRequest::getTotalBytes - Returns the number of bytes in the response
+         * The cache is disabled by default.
          *
-         * @param service Service to check
-         * @param timeoutds Timeout for the request, including all possible retries (in deciseconds)
-         * A value <= 0 means no (or infinite) timeout.
-         * @param maxretries Maximum number of retries for the request
-         * @param listener MegaRequestListener to track this request
+         * @param bytes Maximum size of the cache, or 0 to disable it
          */
-        void queryGeLB(const char *service, int timeoutds = 40, int maxretries = 4, MegaRequestListener *listener = NULL);
+        void setStreamingCacheSize(long long bytes);
 
         /**
-         * @brief Download a file using a HTTP GET request
-         *
-         * The associated request type with this request is MegaRequest::TYPE_DOWNLOAD_FILE
+         * @brief Get the size of the cache of streamed data
          *
-         * Valid data in the MegaRequest object received in onRequestFinish when the error code
-         * is MegaError::API_OK:
-         * - MegaRequest::getNumber - Return the HTTP status code from the server
-         * - MegaRequest::getTotalBytes - Returns the number of bytes of the file
+         * @return Maximum size of the cache, 0 if it's disabled
+         * @see MegaApi::setStreamingCacheSize
+         */
+        long long getStreamingCacheSize();
+
+        /**
+         * @brief Set how many batches of independent requests can be sent in parallel
          *
-         * If the request finishes with the error code MegaError::API_OK, the destination path
-         * contains the downloaded file. If it's not possible to write in the destination path
-         * the error code will be MegaError::API_EWRITE
+         * By default, requests are sent to MEGA in batches one at a time, in order, so a
+         * slow request (eg. creating many nodes) delays everything queued after it.
+         * Requests that only read data and don't depend on the ones before them (user
+         * attributes, file attributes, public link information and streaming URLs) can
+         * instead be sent in separate batches, up to this number at a time, without
+         * waiting for the others. Requests that modify the account are still sent in order.
          *
-         * @param url URL of the file
-         * @param dstpath Destination path for the downloaded file
-         * @param listener MegaRequestListener to track this request
+         * @param maxBatches Maximum number of parallel batches (0 to send everything in order)
          */
-        void downloadFile(const char *url, const char *dstpath, MegaRequestListener *listener = NULL);
+        void setPipelinedRequests(int maxBatches);
 
         /**
-         * @brief Get the User-Agent header used by the SDK
+         * @brief Get how many batches of independent requests can be sent in parallel
          *
-         * The SDK retains the ownership of the returned value. It will be valid until
-         * the MegaApi object is deleted.
-         *
-         * @return User-Agent used by the SDK
+         * @return Maximum number of parallel batches (0 if everything is sent in order)
+         * @see MegaApi::setPipelinedRequests
          */
-        const char *getUserAgent();
+        int getPipelinedRequests();
 
         /**
-         * @brief Get the base path set during initialization
+         * @brief Tune the durability and memory use of the local cache database
          *
-         * The SDK retains the ownership of the returned value. It will be valid until
-         * the MegaApi object is deleted.
+         * The options map to the SQLite pragmas of the same name, so each app can
+         * choose its own trade-off between throughput and crash safety. For example,
+         * MegaApi::DB_OPTION_SYNCHRONOUS = 1 (normal) is usually enough with WAL
+         * journaling, which the SDK uses everywhere except on iOS.
          *
-         * @return Base path
+         * Valid values for the option parameter are:
+         * - MegaApi::DB_OPTION_SYNCHRONOUS = 0
+         * - MegaApi::DB_OPTION_CACHE_SIZE_KB = 1
+         * - MegaApi::DB_OPTION_MMAP_SIZE = 2
+         * - MegaApi::DB_OPTION_PAGE_SIZE = 3
+         * - MegaApi::DB_OPTION_TEMP_STORE = 4
+         * - MegaApi::DB_OPTION_WAL_AUTOCHECKPOINT = 5
+         * - MegaApi::DB_OPTION_WAL_CHECKPOINT_ON_COMMIT = 6
+         * - MegaApi::DB_OPTION_COMPRESS_RECORDS = 7
+         *
+         * MegaApi::DB_OPTION_COMPRESS_RECORDS isn't a pragma: with 1, the records of
+         * the local cache are compressed before being encrypted (it needs zlib). The
+         * records written without compression are still read, so it can be enabled
+         * for an existing cache, but previous versions of the SDK can't read the
+         * compressed ones: don't enable it if the app may be downgraded.
+         *
+         * A value of -1 restores the default of the database engine. Options apply
+         * to databases opened afterwards, so they should be set before logging in
+         * or resuming a session. They have no effect if the SDK was built without
+         * SQLite or without a local cache.
+         *
+         * With MEGA_MEASURE_CODE, the performance report includes the page cache
+         * hits, misses and writes of the local cache.
+         *
+         * @param option Option to set
+         * @param value New value for the option
          */
-        const char *getBasePath();
+        void setDatabaseOption(int option, long long value);
 
         /**
          * @brief Disable special features related to images and videos
@@ -14531,6 +17168,41 @@ class MegaApi
          */
         bool httpServerIsSubtitlesSupportEnabled();
 
+        /**
+         * @brief Enable/disable the /metrics endpoint of the HTTP proxy server
+         *
+         * When enabled, GET /metrics returns metrics of the SDK in the Prometheus text
+         * exposition format (version 0.0.4), to be scraped without going through the app:
+         * queued and active transfers, transfer speeds and bytes, API commands and requests
+         * waiting, syncs by state, the power policy (see MegaApi::setPowerPolicy),
+         * latency histograms of the HTTP requests by direction
+         * (see MegaApi::getNetworkStats) and the durations sampled by
+         * MegaApi::setPerformanceSampling.
+         *
+         * The metrics are collected by the SDK thread every second while this is enabled,
+         * and a request gets the last ones: it never waits for the SDK to be idle. The
+         * metric mega_metrics_age_seconds tells how old they are.
+         *
+         * The endpoint isn't affected by the restricted mode, so take into account that
+         * the metrics are available to anyone that can connect to the server.
+         *
+         * This feature is disabled by default.
+         *
+         * @param enable True to enable the /metrics endpoint, false to disable it
+         */
+        void httpServerEnableMetrics(bool enable);
+
+        /**
+         * @brief Check if the /metrics endpoint of the HTTP proxy server is enabled
+         *
+         * See MegaApi::httpServerEnableMetrics.
+         *
+         * This feature is disabled by default.
+         *
+         * @return true if the /metrics endpoint is enabled, otherwise false
+         */
+        bool httpServerIsMetricsEnabled();
+
         /**
          * @brief Add a listener to receive information about the HTTP proxy server
          *
@@ -14700,6 +17372,101 @@ class MegaApi
          */
         int httpServerGetMaxOutputSize();
 
+        /**
+         * @brief Set the number of event loops of the HTTP proxy server
+         *
+         * By default, all the connections of the HTTP proxy server are served by a single
+         * event loop running in its own thread. With a value greater than 1, the server runs
+         * that number of event loops, each one in its own thread and listening on the same
+         * port, and the operating system distributes the new connections among them. That
+         * allows many concurrent streams to use more than one core.
+         *
+         * Multiple event loops require SO_REUSEPORT. They are not available for servers
+         * using TLS, nor in platforms without that socket option; in that case the server
+         * uses a single event loop.
+         *
+         * The new value will be taken into account the next time the HTTP proxy server is
+         * started. It's possible to call this function before the server has been started, and
+         * the value will be still active even if the server is stopped and started again.
+         *
+         * @param loops Number of event loops of the server, or a number <= 0 to use a single one
+         */
+        void httpServerSetEventLoops(int loops);
+
+        /**
+         * @brief Get the number of event loops requested for the HTTP proxy server
+         *
+         * See MegaApi::httpServerSetEventLoops
+         *
+         * @return Number of event loops requested for the HTTP proxy server
+         */
+        int httpServerGetEventLoops();
+
+        /**
+         * @brief Set the playback time that the HTTP proxy server prefetches for media files
+         *
+         * By default, the HTTP proxy server reads the data of a file ahead of the client up to the
+         * maximum buffer size (MegaApi::httpServerSetMaxBufferSize), whatever the file is. With a
+         * prefetch time, the buffer of the streaming of a media file with a known duration holds
+         * that number of seconds of playback instead, at the average bitrate of the file (its size
+         * divided by its duration, see MegaNode::getDuration). A high bitrate video gets more data
+         * ahead of the player to cover variations of the speed of the connection, and an audio
+         * file doesn't download much more than what is going to be played.
+         *
+         * The buffer is kept between 256 KB and 64 MB, and the download is resumed when half of
+         * it has been sent to the client. Files without a duration keep using the maximum buffer
+         * size.
+         *
+         * The new value will be taken into account since the next request received by
+         * the HTTP proxy server, not for ongoing requests. It's possible and effective
+         * to call this function even before the server has been started, and the value
+         * will be still active even if the server is stopped and started again.
+         *
+         * @param seconds Seconds of playback to prefetch, or a number <= 0 to disable it
+         */
+        void httpServerSetMediaPrefetchTime(int seconds);
+
+        /**
+         * @brief Get the playback time that the HTTP proxy server prefetches for media files
+         *
+         * See MegaApi::httpServerSetMediaPrefetchTime
+         *
+         * @return Seconds of playback prefetched, 0 if it's disabled
+         */
+        int httpServerGetMediaPrefetchTime();
+
+        /**
+         * @brief Prefetch the next files of a folder read sequentially through the HTTP proxy server
+         *
+         * Media servers and backup tools reading a whole folder through the HTTP proxy server
+         * (or its WEBDAV interface) request its files one after another, and the first byte of
+         * each one waits for the SDK to get the URL to download it. When a client requests a
+         * file right after the previous file of the same folder (in the order of the listing
+         * of the folder), the SDK gets the URLs of the next files of the folder in advance.
+         *
+         * With readAhead, the SDK also starts downloading the beginning of those files into the
+         * streaming cache (see MegaApi::setStreamingCacheSize), which must be enabled for it.
+         *
+         * Only files of the account are prefetched, not files of public links.
+         *
+         * It's possible and effective to call this function even before the server has been
+         * started, and the value will be still active even if the server is stopped and
+         * started again.
+         *
+         * @param files Number of files to prefetch (up to 16), or a number <= 0 to disable it
+         * @param readAhead true to also start downloading the beginning of the files
+         */
+        void httpServerSetFolderPrefetch(int files, bool readAhead = false);
+
+        /**
+         * @brief Get the number of files that the HTTP proxy server prefetches in folders read sequentially
+         *
+         * See MegaApi::httpServerSetFolderPrefetch
+         *
+         * @return Number of files prefetched, 0 if it's disabled
+         */
+        int httpServerGetFolderPrefetch();
+
         /**
          * @brief Start an FTP server in specified port
          *
@@ -16792,6 +19559,53 @@ public:
     virtual bool isCancelled() const;
 };
 
+/**
+ * @brief List of files to upload with MegaApi::startUploads
+ */
+class MegaUploadBatch
+{
+protected:
+    MegaUploadBatch();
+
+public:
+    /**
+     * @brief Creates a new, empty, instance of MegaUploadBatch
+     *
+     * You take ownership of the returned value.
+     *
+     * @return A pointer to the new object
+     */
+    static MegaUploadBatch* createInstance();
+
+    virtual ~MegaUploadBatch();
+
+    /**
+     * @brief Creates a copy of this MegaUploadBatch object
+     *
+     * You are the owner of the returned object
+     *
+     * @return Copy of the MegaUploadBatch object
+     */
+    virtual MegaUploadBatch* copy() const;
+
+    /**
+     * @brief Add a file or a folder to upload
+     *
+     * @param localPath Local path of the file or folder
+     * @param parent Handle of the parent node in the MEGA account
+     * @param fileName Custom name in MEGA, or NULL to keep the local name
+     * @param mtime Custom modification time (in seconds since the epoch), or -1 to keep
+     * the one of the local file
+     */
+    virtual void add(const char* localPath, MegaHandle parent, const char* fileName = NULL, int64_t mtime = -1);
+
+    /**
+     * @brief Returns the number of uploads in the batch
+     * @return Number of uploads in the batch
+     */
+    virtual unsigned int size() const;
+};
+
 }
 
 #endif //MEGAAPI_H
@@ -23,7 +23,9 @@
 #define MEGAAPI_IMPL_H
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <thread>
 
 #include "mega.h"
 #include "mega/gfx/external.h"
@@ -95,6 +97,8 @@ class MegaGfxProc : public GfxProcExternal {};
     #ifndef WINDOWS_PHONE
     #ifdef USE_CURL
     class MegaHttpIO : public CurlHttpIO {};
+    // also included, see MegaApi::setNetworkBackend
+    class MegaWinHttpIO : public WinHttpIO {};
     #else
     class MegaHttpIO : public WinHttpIO {};
     #endif
@@ -121,11 +125,19 @@ class MegaHTTPServer;
 class MegaFTPServer;
 #endif
 
+#ifdef USE_LMDB
+class MegaDbAccess : public LmdbDbAccess
+{
+	public:
+		MegaDbAccess(string *basePath = NULL) : LmdbDbAccess(basePath){}
+};
+#else
 class MegaDbAccess : public SqliteDbAccess
 {
 	public:
 		MegaDbAccess(string *basePath = NULL) : SqliteDbAccess(basePath){}
 };
+#endif
 
 class ExternalLogger : public Logger
 {
@@ -146,6 +158,44 @@ private:
 };
 
 class MegaTransferPrivate;
+
+// inflates a zlib stream received in pieces, keeping the content between the offsets start and end
+// (see MegaApi::setCompressedTransfers)
+class ZlibInflater
+{
+public:
+    ZlibInflater(m_off_t start = 0, m_off_t end = -1);
+    ~ZlibInflater();
+
+    // the data inflated from the next piece, false if the stream is not valid
+    bool inflate(const byte *data, size_t len, string *out);
+
+    // all the content up to end is inflated
+    bool done() const;
+
+private:
+    struct Stream;
+    unique_ptr<Stream> stream;
+    m_off_t start;
+    m_off_t end;
+    m_off_t pos = 0;
+};
+
+// deflates the pieces of a zlib stream, ending each of them on a full flush
+class ZlibDeflater
+{
+public:
+    ZlibDeflater();
+    ~ZlibDeflater();
+
+    // the data deflated from the next piece, the last one finishing the stream, false on errors
+    bool deflate(const byte *data, size_t len, bool last, string *out);
+
+private:
+    struct Stream;
+    unique_ptr<Stream> stream;
+};
+
 class MegaTreeProcCopy : public MegaTreeProcessor
 {
 public:
@@ -195,12 +245,55 @@ protected:
 class MegaFolderUploadController : public MegaRequestListener, public MegaTransferListener, public MegaRecursiveOperation
 {
 public:
+    // files opened and fingerprinted by a job
+    static const size_t FINGERPRINT_BATCH = 16;
+
     MegaFolderUploadController(MegaApiImpl *megaApi, MegaTransferPrivate *transfer);
+    ~MegaFolderUploadController();
     void start(MegaNode* node) override;
     void cancel() override;
 
+    // queue the uploads of the folders whose scan has finished (SDK thread)
+    void checkScans();
+
 protected:
+    // the local folders are listed, and their files opened and fingerprinted,
+    // on MegaApiImpl's scan workers: many folders and files are read at once,
+    // instead of one after the other on the SDK thread
+    struct ListJob : public CryptoWorkers::Job
+    {
+        FileSystemAccess* fsaccess;
+        bool followsymlinks;
+        string localpath;
+        bool opened = false;
+        vector<std::pair<string, nodetype_t> > entries;
+
+        void run() override;
+    };
+
+    struct FingerprintJob : public CryptoWorkers::Job
+    {
+        FileSystemAccess* fsaccess;
+        string localpath;
+        vector<string> names;
+        vector<FileFingerprint> fingerprints;   // not valid for the files that can't be read
+        std::shared_ptr<FingerprintCache> cache;
+
+        void run() override;
+    };
+
+    struct FolderScan
+    {
+        MegaHandle parent;
+        string localpath;
+        std::shared_ptr<ListJob> list;
+        bool fingerprinting = false;
+        vector<std::shared_ptr<FingerprintJob> > fingerprints;
+    };
+    std::list<FolderScan> scans;
+
     void onFolderAvailable(MegaHandle handle);
+    void uploadFolder(FolderScan &scan);
     void checkCompletion();
 
     std::list<std::string> pendingFolders;
@@ -225,6 +318,11 @@ public:
     void removeexceeding(bool currentoneOK);
     void abortCurrent();
 
+    // uploads of this backup in flight at once (0: no limit), the others wait in queuedUploads
+    int getMaxUploads() const;
+    void setMaxUploads(int value);
+    void cancelQueuedUploads();
+
     // MegaBackup interface
     MegaBackup *copy() override;
     const char *getLocalFolder() const override;
@@ -298,6 +396,18 @@ protected:
     int recursive;
     int pendingTransfers;
     int pendingTags;
+
+    // incremental backups: the folders of the last complete backup matching the local
+    // folders still to be backed up, and the copies of its unchanged files in flight
+    std::map<std::string, handle> previousFolders;
+    int pendingCopies;
+    int failedCopies;
+
+    // files waiting for an upload slot (path, target folder)
+    std::deque<std::pair<std::string, MegaHandle>> queuedUploads;
+    int activeUploads;
+    int maxUploads;
+
     // backup instance stats
     int64_t currentBKStartTime;
     int64_t updateTime;
@@ -315,7 +425,11 @@ protected:
     bool checkCompletion();
     bool isBusy() const;
     int64_t getLastBackupTime();
+    handle getLastCompleteBackup();
     long long getNextStartTimeDs(long long oldStartTimeds = -1) const;
+    void queueUpload(const std::string &path, MegaHandle target);
+    void startQueuedUploads();
+    void updateMeanSpeed();
 
     std::string epochdsToString(int64_t rawtimeds) const;
     int64_t stringTimeTods(string stime) const;
@@ -358,12 +472,29 @@ public:
 class MegaFolderDownloadController : public MegaTransferListener, public MegaRecursiveOperation
 {
 public:
+    // file downloads started and not finished yet: the rest of the tree is
+    // walked as they finish, so a large folder doesn't queue all its files at once
+    static const int MAX_PENDING_DOWNLOADS = 1000;
+
     MegaFolderDownloadController(MegaApiImpl *megaApi, MegaTransferPrivate *transfer);
     void start(MegaNode *node) override;
     void cancel() override;
 
 protected:
-    void downloadFolderNode(MegaNode *node, string *path);
+    // a folder of the walk: its children, the next one to visit and its local path (with separator)
+    struct Folder
+    {
+        std::unique_ptr<MegaNodeList> ownedChildren;
+        MegaNodeList *children;
+        int next;
+        string localpath;
+    };
+
+    // the folders from the top one down to the one being walked
+    std::vector<Folder> folders;
+
+    void openFolder(MegaNode *node, string *path);
+    void downloadNext();
     void checkCompletion();
 
 public:
@@ -372,9 +503,65 @@ public:
     void onTransferFinish(MegaApi*, MegaTransfer *t, MegaError *e) override;
 };
 
+// keeps the memory of up to MAXFREE deleted objects of a size for the next
+// ones, for the objects created and deleted by the thousand (node lists,
+// transfer callbacks). Objects of other sizes (derived classes) use the
+// global allocator. The state is never destroyed, as objects may outlive
+// the static destructors.
+template <size_t SIZE, size_t MAXFREE = 1024>
+class ObjectPool
+{
+    struct State
+    {
+        std::mutex mutex;
+        std::vector<void*> free;
+    };
+
+    static State& state()
+    {
+        static State* s = new State;
+        return *s;
+    }
+
+public:
+    static void* allocate(size_t size)
+    {
+        if (size == SIZE)
+        {
+            State& s = state();
+            std::lock_guard<std::mutex> g(s.mutex);
+            if (!s.free.empty())
+            {
+                void* p = s.free.back();
+                s.free.pop_back();
+                return p;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    static void release(void* p, size_t size)
+    {
+        if (p && size == SIZE)
+        {
+            State& s = state();
+            std::lock_guard<std::mutex> g(s.mutex);
+            if (s.free.size() < MAXFREE)
+            {
+                s.free.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+};
+
 class MegaNodePrivate : public MegaNode, public Cachable
 {
     public:
+        static void* operator new(size_t size) { return ObjectPool<sizeof(MegaNodePrivate)>::allocate(size); }
+        static void operator delete(void* p, size_t size) { ObjectPool<sizeof(MegaNodePrivate)>::release(p, size); }
+
         MegaNodePrivate(const char *name, int type, int64_t size, int64_t ctime, int64_t mtime,
                         MegaHandle nodeMegaHandle, std::string *nodekey, std::string *attrstring, std::string *fileattrstring,
                         const char *fingerprint, const char *originalFingerprint, MegaHandle owner, MegaHandle parentHandle = INVALID_HANDLE,
@@ -449,6 +636,10 @@ class MegaNodePrivate : public MegaNode, public Cachable
 #endif
 
         static MegaNode *fromNode(Node *node);
+
+        // MegaNode::CHANGE_TYPE_* flags of the pending changes of a node
+        static int changesOf(Node *node);
+        void addChanges(int changes);
         MegaNode *copy() override;
 
         char *serialize() override;
@@ -458,9 +649,15 @@ class MegaNodePrivate : public MegaNode, public Cachable
     protected:
         MegaNodePrivate(Node *node);
         int type;
+
+        // name, fingerprint and original fingerprint, one after another in a
+        // single allocation (strings)
         const char *name;
         const char *fingerprint;
         const char *originalfingerprint;
+        char *strings;
+        void setStrings(const char *name, const char *fingerprint, const char *originalfingerprint);
+
         attr_map *customAttrs;
         int64_t size;
         int64_t ctime;
@@ -588,6 +785,248 @@ private:
     std::vector<MegaHandle> mList;
 };
 
+class MegaNodeChangeListPrivate : public MegaNodeChangeList
+{
+public:
+    MegaNodeChangeListPrivate();
+    MegaNodeChangeListPrivate(Node** newlist, int size);
+    MegaNodeChangeListPrivate(const MegaNodeChangeListPrivate *changeList);
+
+    MegaNodeChangeList *copy() const override;
+    MegaHandle getHandle(int i) const override;
+    int getChanges(int i) const override;
+    int size() const override;
+
+    void add(MegaHandle h, int changes);
+
+private:
+    std::vector<std::pair<MegaHandle, int>> mList;
+};
+
+// Base of the objects handed to the app that only keep the handles of their nodes, and
+// read the rest of each node from the MegaClient on first access. Live ones are tracked by
+// MegaApiImpl, which loads their entries for the nodes reported as updated (before removed
+// nodes are purged), and loads and detaches them on logout and on destruction, so they
+// never outlive the nodes they refer to.
+class LazyNodeEntries
+{
+public:
+    virtual ~LazyNodeEntries() { }
+
+protected:
+    LazyNodeEntries() : api(NULL) { }
+
+    virtual size_t entryCount() const = 0;
+    virtual handle entryHandle(size_t i) const = 0;
+    virtual bool entryLoaded(size_t i) const = 0;
+
+    // read entry i from its node, if it still exists (sdkMutex locked, api set)
+    virtual void loadEntry(size_t i) const = 0;
+
+    // register the entries not loaded yet with the MegaApiImpl (sdkMutex locked)
+    void attach(MegaApiImpl *currentApi);
+
+    // unregister, from the destructor of the subclass
+    void release();
+
+    // load all pending entries and stop using the MegaApiImpl (sdkMutex locked)
+    void detach();
+
+    std::atomic<MegaApiImpl *> api;
+
+    friend class MegaApiImpl;
+};
+
+class MegaNodeSnapshotPrivate : public MegaNodeSnapshot, protected LazyNodeEntries
+{
+public:
+    // the nodes must be in the order of the snapshot (parents first). With an api (and
+    // sdkMutex locked), the data of nodes still in the local cache is read on first access
+    MegaNodeSnapshotPrivate(MegaApiImpl *api, long long generation, const char *scsn, const node_vector &nodes);
+    MegaNodeSnapshotPrivate(const MegaNodeSnapshotPrivate &snapshot);
+    ~MegaNodeSnapshotPrivate() override;
+
+    MegaNodeSnapshot *copy() const override;
+    long long getGeneration() const override;
+    const char *getSequenceNumber() const override;
+    int size() const override;
+    MegaHandle getHandle(int i) const override;
+    MegaHandle getParentHandle(int i) const override;
+    int getType(int i) const override;
+    int64_t getSize(int i) const override;
+    int64_t getModificationTime(int i) const override;
+    const char *getName(int i) const override;
+    const char *getFingerprint(int i) const override;
+    const char *getBuffer() const override;
+    size_t getBufferSize() const override;
+
+    // layout documented in MegaNodeSnapshot::getBuffer
+    struct Record
+    {
+        MegaHandle handle;
+        MegaHandle parenthandle;
+        int64_t size;
+        int64_t mtime;
+        uint32_t name;
+        uint32_t fingerprint;
+        int32_t type;
+        int32_t reserved;
+    };
+    static_assert(sizeof(Record) == 48, "MegaNodeSnapshot records are 48 bytes");
+
+    // the strings of the node are appended, at offset base from their start
+    static void fillRecord(Node *n, Record &r, size_t base, string *strings);
+
+private:
+    const Record *record(int i) const;
+
+    // loads the entry first if needed
+    const Record *loadedRecord(int i) const;
+
+    size_t entryCount() const override;
+    handle entryHandle(size_t i) const override;
+    bool entryLoaded(size_t i) const override;
+    void loadEntry(size_t i) const override;
+
+    // builds mFullBuffer if some entries have their strings in mLateStrings
+    const string &buffer() const;
+
+    long long mGeneration;
+    string mScsn;
+    int mCount;
+
+    // the records, followed by the strings of the entries loaded up front
+    mutable string mBuffer;
+
+    // entries read on first access: name and fingerprint, at the offsets of their record
+    mutable vector<char> mPending;
+    mutable vector<std::unique_ptr<string>> mLateStrings;
+
+    // the buffer with all the strings, once requested
+    mutable string mFullBuffer;
+    mutable std::mutex mFullBufferMutex;
+};
+
+// export of the node tree to shared memory (MegaApi::startNodeTreeExport), for
+// MegaSharedNodeTree in other processes. The control region <name> tells the
+// current data region <name>.<segment>: a header, a MegaNodeSnapshot buffer and
+// the log of the changes made after the snapshot. Data regions are append-only,
+// each entry is published by advancing logsize; when the log is full or the
+// nodes are reloaded, the writer moves on to a new region with a new snapshot
+struct SharedNodeTreeControl
+{
+    static const uint32_t MAGIC = 0x544e534d;   // "MSNT"
+    static const uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> segment;              // 0: the export stopped
+};
+
+struct SharedNodeTreeHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t generation;                         // of the snapshot
+    uint64_t snapshotoffset;
+    uint64_t snapshotsize;
+    uint64_t logoffset;
+    uint64_t logcapacity;
+    uint32_t nodes;
+    uint32_t reserved;
+    std::atomic<uint64_t> logsize;              // bytes of published entries
+};
+
+// a node that changed, followed by its strings
+struct SharedNodeTreeLogEntry
+{
+    uint32_t size;                              // with the strings, a multiple of 8
+    int32_t changes;                            // MegaNode::CHANGE_TYPE_*
+    int64_t generation;
+    MegaNodeSnapshotPrivate::Record record;     // string offsets from the start of the entry
+};
+
+class SharedNodeTreeExport
+{
+public:
+    // creates the control region
+    bool start(const string &name);
+
+    // moves on to a new data region with the snapshot
+    bool publish(const MegaNodeSnapshotPrivate &snapshot);
+
+    // false if the log is full
+    bool append(Node *n, int changes, long long generation);
+
+    // a new snapshot is due
+    bool stale = true;
+
+    // the regions are removed
+    ~SharedNodeTreeExport();
+
+private:
+    string mName;
+    SharedMemory mControl;
+    std::unique_ptr<SharedMemory> mData;
+    uint64_t mSegment = 0;
+
+    // minimum room for the log of a data region
+    static const size_t MINLOGCAPACITY = 1 << 20;
+
+    SharedNodeTreeControl *control() const;
+    SharedNodeTreeHeader *header() const;
+};
+
+class MegaSharedNodeTreePrivate : public MegaSharedNodeTree
+{
+public:
+    static MegaSharedNodeTreePrivate *open(const char *name);
+
+    bool refresh() override;
+    long long getGeneration() const override;
+    int size() const override;
+    MegaHandle getNodeByPath(const char *path, MegaHandle base) const override;
+    char *getNodePath(MegaHandle handle) const override;
+    MegaHandle getParentHandle(MegaHandle handle) const override;
+    int getType(MegaHandle handle) const override;
+    int64_t getSize(MegaHandle handle) const override;
+    int64_t getModificationTime(MegaHandle handle) const override;
+    const char *getName(MegaHandle handle) const override;
+    const char *getFingerprint(MegaHandle handle) const override;
+    MegaHandleList *getChildren(MegaHandle handle) const override;
+
+private:
+    // the strings stay in the mapped data region
+    struct Entry
+    {
+        MegaHandle parent;
+        int type;
+        int64_t size;
+        int64_t mtime;
+        const char *name;
+        const char *fingerprint;
+    };
+
+    string mName;
+    SharedMemory mControl;
+    std::unique_ptr<SharedMemory> mData;
+    uint64_t mSegment = 0;
+    uint64_t mLogRead = 0;
+    long long mGeneration = 0;
+    std::unordered_map<MegaHandle, Entry> mNodes;
+
+    // by parent, also for the parents not known yet
+    std::unordered_map<MegaHandle, vector<MegaHandle>> mChildren;
+
+    // Cloud Drive, Inbox and Rubbish Bin
+    MegaHandle mRoots[3] = { INVALID_HANDLE, INVALID_HANDLE, INVALID_HANDLE };
+
+    bool load(uint64_t segment);
+    void apply(const MegaNodeSnapshotPrivate::Record &r, const char *base, size_t size, bool removed);
+    void detach(MegaHandle handle, MegaHandle parent);
+    const Entry *entry(MegaHandle handle) const;
+};
+
 class MegaSharePrivate : public MegaShare
 {
 	public:
@@ -614,6 +1053,9 @@ class MegaSharePrivate : public MegaShare
 class MegaTransferPrivate : public MegaTransfer, public Cachable
 {
 	public:
+        static void* operator new(size_t size) { return ObjectPool<sizeof(MegaTransferPrivate)>::allocate(size); }
+        static void operator delete(void* p, size_t size) { ObjectPool<sizeof(MegaTransferPrivate)>::release(p, size); }
+
 		MegaTransferPrivate(int type, MegaTransferListener *listener = NULL);
         MegaTransferPrivate(const MegaTransferPrivate *transfer);
         virtual ~MegaTransferPrivate();
@@ -654,6 +1096,32 @@ class MegaTransferPrivate : public MegaTransfer, public Cachable
         void setNotificationNumber(long long notificationNumber);
         void setListener(MegaTransferListener *listener);
 
+        // fingerprint of the local file of an upload, when computed before it is queued
+        void setLocalFingerprint(const FileFingerprint &fingerprint);
+        const FileFingerprint *getLocalFingerprint() const;
+
+        // the content of an upload was compared with the previous version (see MegaApi::enableUploadDeduplication)
+        void setContentChecked(bool checked);
+        bool isContentChecked() const;
+
+        // an upload of a compressed copy of the local file, or a download of a node uploaded
+        // compressed, with the size and the fingerprint of the content before compression, the size
+        // being -1 otherwise (see MegaApi::setCompressedTransfers)
+        void setCompressionChecked(bool checked);
+        bool isCompressionChecked() const;
+        void setCompressedLocalPath(const string &localpath);
+        const string &getCompressedLocalPath() const;
+        void setUncompressedFingerprint(const FileFingerprint &fp);
+        const FileFingerprint &getUncompressedFingerprint() const;
+
+        // decompression of the data of a streaming download
+        void setInflater(ZlibInflater *inflater);
+        ZlibInflater *getInflater() const;
+
+        // source of an upload without a local file (see MegaApi::startUploadFromStream)
+        void setInputStream(MegaInputStream *inputStream);
+        MegaInputStream *getInputStream() const;
+
         virtual int getType() const;
         virtual const char * getTransferString() const;
         virtual const char* toString() const;
@@ -747,6 +1215,13 @@ class MegaTransferPrivate : public MegaTransfer, public Cachable
         int folderTransferTag;
         const char* appData;
         unique_ptr<MegaRecursiveOperation> recursiveOperation;
+        unique_ptr<FileFingerprint> localFingerprint;
+        bool contentChecked = false;
+        bool compressionChecked = false;
+        string compressedLocalPath;
+        FileFingerprint uncompressedFingerprint;
+        unique_ptr<ZlibInflater> inflater;
+        MegaInputStream *inputStream = nullptr;
 };
 
 class MegaTransferDataPrivate : public MegaTransferData
@@ -1022,6 +1497,49 @@ protected:
     int state; 
 };
 
+class MegaSyncStatsPrivate : public MegaSyncStats
+{
+public:
+    MegaSyncStatsPrivate(MegaClient *client, Sync *sync);
+
+    virtual MegaSyncStats *copy() const;
+
+    virtual int getTag() const;
+    virtual int getPendingScans() const;
+    virtual int getDelayedScans() const;
+    virtual int getRetryingScans() const;
+    virtual long long getScannedPaths() const;
+    virtual long long getScanRate() const;
+    virtual long long getFingerprints() const;
+    virtual long long getFingerprintRate() const;
+    virtual int getPendingUploads() const;
+    virtual long long getPendingUploadBytes() const;
+    virtual int getPendingDownloads() const;
+    virtual long long getPendingDownloadBytes() const;
+    virtual long long getLocalBytes() const;
+    virtual long long getScanTime() const;
+    virtual long long getSyncUpTime() const;
+    virtual long long getSyncDownTime() const;
+
+protected:
+    int tag;
+    int pendingScans;
+    int delayedScans;
+    int retryingScans;
+    long long scannedPaths;
+    long long scanRate;
+    long long fingerprints;
+    long long fingerprintRate;
+    int pendingUploads;
+    long long pendingUploadBytes;
+    int pendingDownloads;
+    long long pendingDownloadBytes;
+    long long localBytes;
+    long long scanTime;
+    long long syncUpTime;
+    long long syncDownTime;
+};
+
 #endif
 
 
@@ -1118,6 +1636,15 @@ class MegaRequestPrivate : public MegaRequest
         void setMegaPushNotificationSettings(const MegaPushNotificationSettings *settings);
         MegaBackgroundMediaUpload *getMegaBackgroundMediaUploadPtr() const override;
         void setMegaBackgroundMediaUploadPtr(MegaBackgroundMediaUpload *);  // non-owned pointer
+        MegaHandleList *getMegaHandleList() const override;
+        void setMegaHandleList(const MegaHandleList *handleList);
+
+        // bulk node requests: count the result of one of the commands sent (getTotalBytes()),
+        // returns true once all of them are in - the first error of the nodes that failed,
+        // locally or in their command (getNumber()), is kept for the request
+        bool addBulkResult(error e);
+        void addBulkError(error e);
+        error getBulkError() const;
 
 #ifdef ENABLE_SYNC
         void setSyncListener(MegaSyncListener *syncListener);
@@ -1176,6 +1703,8 @@ protected:
         MegaFolderInfo *folderInfo;
         MegaPushNotificationSettings *settings;
         MegaBackgroundMediaUpload* backgroundMediaUpload;  // non-owned pointer
+        MegaHandleList *mHandleList;
+        error bulkError;
 };
 
 class MegaEventPrivate : public MegaEvent
@@ -1407,6 +1936,25 @@ private:
     std::atomic_bool cancelFlag { false };
 };
 
+class MegaUploadBatchPrivate : public MegaUploadBatch
+{
+public:
+    struct Entry
+    {
+        string localPath;
+        MegaHandle parent;
+        string fileName;
+        int64_t mtime;
+    };
+
+    // taken from the front as the uploads are queued
+    std::deque<Entry> entries;
+
+    MegaUploadBatch* copy() const override;
+    void add(const char* localPath, MegaHandle parent, const char* fileName, int64_t mtime) override;
+    unsigned int size() const override;
+};
+
 #ifdef ENABLE_CHAT
 class MegaTextChatPeerListPrivate : public MegaTextChatPeerList
 {
@@ -1569,6 +2117,8 @@ class MegaNodeListPrivate : public MegaNodeList
         MegaNodeListPrivate();
         MegaNodeListPrivate(node_vector& v);
         MegaNodeListPrivate(Node** newlist, int size);
+        // takes the ownership of the nodes
+        MegaNodeListPrivate(vector<std::unique_ptr<MegaNode>>&& nodes);
         MegaNodeListPrivate(const MegaNodeListPrivate *nodeList, bool copyChildren = false);
         virtual ~MegaNodeListPrivate();
         MegaNodeList *copy() const override;
@@ -1582,6 +2132,41 @@ class MegaNodeListPrivate : public MegaNodeList
 		int s;
 };
 
+// Node list that only stores handles and creates each MegaNodePrivate on the first get(i)
+class MegaNodeListLazy : public MegaNodeList, protected LazyNodeEntries
+{
+    public:
+        MegaNodeListLazy(MegaApiImpl *api, Node** newlist, int size);
+        MegaNodeListLazy(const MegaNodeListLazy *nodeList);
+        ~MegaNodeListLazy() override;
+        MegaNodeList *copy() const override;
+        MegaNode* get(int i) const override;
+        int size() const override;
+
+        void addNode(MegaNode* node) override;
+
+        // the bulk getters read the nodes not created yet from the Node, without creating them
+        int getHandles(MegaHandle *handles, int count) const override;
+        int getSizes(int64_t *sizes, int count) const override;
+        int getModificationTimes(int64_t *mtimes, int count) const override;
+        int getTypes(int *types, int count) const override;
+        int getNames(char *names, int namesSize, int *offsets, int count) const override;
+
+    protected:
+        vector<handle> handles;
+        mutable vector<std::unique_ptr<MegaNode>> nodes;
+
+        MegaNode* materialize(size_t i) const;
+
+        size_t entryCount() const override;
+        handle entryHandle(size_t i) const override;
+        bool entryLoaded(size_t i) const override;
+        void loadEntry(size_t i) const override;
+
+        template<typename T, typename FromMegaNode, typename FromNode>
+        int getColumn(T *values, int count, T missing, FromMegaNode fromMegaNode, FromNode fromNode) const;
+};
+
 class MegaChildrenListsPrivate : public MegaChildrenLists
 {
     public:
@@ -1807,8 +2392,12 @@ struct MegaFilePut : public MegaFile
     virtual bool serialize(string*);
     static MegaFilePut* unserialize(string*);
 
+    // the local file is a compressed copy of a file with this fingerprint
+    void setUncompressedFingerprint(const FileFingerprint &fp);
+
 protected:
     int64_t customMtime;
+    FileFingerprint uncompressedFingerprint;
 
 private:
     MegaFilePut() {}
@@ -1902,12 +2491,154 @@ class TreeProcFolderInfo : public TreeProc
         long long versionsSize;
 };
 
+// Multi-producer single-consumer queue: producers push onto a lock-free stack,
+// which the consumer (the SDK thread) takes all at once and appends, in order,
+// to a list of its own. Listeners removed by the app are recorded with the
+// sequence number of the next push, so that the consumer clears them from the
+// older items as it gets to them instead of scanning the queue
+template<typename T>
+class MpscQueue
+{
+    struct Node
+    {
+        T value;
+        uint64_t seq;
+        Node* next;
+    };
+
+    std::atomic<Node*> head{ nullptr };
+    std::atomic<uint64_t> assigned{ 1 };
+    std::atomic<uint64_t> linked{ 1 };
+
+    // consumer side, with the sequence number of each item (0: requeued)
+    std::deque<std::pair<T, uint64_t> > pending;
+
+    std::mutex removalsMutex;
+    std::map<const void*, uint64_t> removals;
+    std::atomic<bool> anyRemovals{ false };
+
+    void collect()
+    {
+        Node* node = head.exchange(nullptr);
+        if (!node)
+        {
+            return;
+        }
+
+        // the stack has the newest first
+        std::vector<Node*> nodes;
+        for (; node; node = node->next)
+        {
+            nodes.push_back(node);
+        }
+
+        for (auto it = nodes.rbegin(); it != nodes.rend(); it++)
+        {
+            pending.emplace_back(std::move((*it)->value), (*it)->seq);
+            delete *it;
+        }
+    }
+
+    void pruneRemovals()
+    {
+        // nothing in flight and nothing queued: all the items of removed
+        // listeners are gone
+        std::lock_guard<std::mutex> g(removalsMutex);
+        uint64_t l = linked;
+        if (l == assigned && !head.load() && pending.empty())
+        {
+            removals.clear();
+            anyRemovals = false;
+        }
+    }
+
+public:
+    MpscQueue() = default;
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        for (Node* node = head.exchange(nullptr); node; )
+        {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    // any thread
+    void push(T value)
+    {
+        Node* node = new Node{ std::move(value), assigned++, head.load() };
+        while (!head.compare_exchange_weak(node->next, node));
+        linked++;
+    }
+
+    void removed(const void* listener)
+    {
+        std::lock_guard<std::mutex> g(removalsMutex);
+        removals[listener] = assigned;
+        anyRemovals = true;
+    }
+
+    // consumer only
+    bool empty()
+    {
+        if (pending.empty())
+        {
+            collect();
+
+            if (pending.empty() && anyRemovals)
+            {
+                pruneRemovals();
+            }
+        }
+        return pending.empty();
+    }
+
+    T& front()
+    {
+        return pending.front().first;
+    }
+
+    uint64_t frontSeq()
+    {
+        return pending.front().second;
+    }
+
+    void pop_front()
+    {
+        pending.pop_front();
+    }
+
+    void push_front(T value)
+    {
+        pending.emplace_front(std::move(value), 0);
+    }
+
+    // whether the listener was removed after an item with that sequence number was pushed
+    bool isRemoved(const void* listener, uint64_t seq)
+    {
+        if (!listener || !anyRemovals)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> g(removalsMutex);
+        auto it = removals.find(listener);
+        return it != removals.end() && seq < it->second;
+    }
+};
+
 //Thread safe request queue
 class RequestQueue
 {
     protected:
-        std::deque<MegaRequestPrivate *> requests;
-        std::mutex mutex;
+        MpscQueue<MegaRequestPrivate *> requests;
+
+        // clear the listeners removed since the request was queued
+        void clearRemovedListeners(MegaRequestPrivate *request, uint64_t seq);
 
     public:
         RequestQueue();
@@ -1927,12 +2658,27 @@ class RequestQueue
 class TransferQueue
 {
     protected:
-        std::deque<MegaTransferPrivate *> transfers;
-        std::mutex mutex;
+    public:
+        struct UploadBatch
+        {
+            std::deque<MegaUploadBatchPrivate::Entry> entries;
+            MegaTransferListener* listener;
+            int maxRetries;
+        };
+
+    protected:
+        // a transfer, or a batch whose transfers are created as they are popped
+        struct Item
+        {
+            MegaTransferPrivate *transfer;
+            std::unique_ptr<UploadBatch> batch;
+        };
+        MpscQueue<Item> transfers;
 
     public:
         TransferQueue();
         void push(MegaTransferPrivate *transfer);
+        void push(UploadBatch&& batch);
         void push_front(MegaTransferPrivate *transfer);
         MegaTransferPrivate * pop();
         void removeListener(MegaTransferListener *listener);
@@ -2065,6 +2811,10 @@ class MegaApiImpl : public MegaApp
         static void addLoggerClass(MegaLogger *megaLogger);
         static void removeLoggerClass(MegaLogger *megaLogger);
         static void setLogToConsole(bool enable);
+        static void enableTracing(bool enable, int eventsPerThread);
+        static bool isTracingEnabled();
+        static char *getTrace(bool clear);
+        static void setLogAsynchronous(bool enable, int bufferSize);
         static void log(int logLevel, const char* message, const char *filename = NULL, int line = -1);
 
         void setLoggingName(const char* loggingName);
@@ -2072,10 +2822,12 @@ class MegaApiImpl : public MegaApp
         void createFolder(const char* name, MegaNode *parent, MegaRequestListener *listener = NULL);
         bool createLocalFolder(const char *path);
         void moveNode(MegaNode* node, MegaNode* newParent, MegaRequestListener *listener = NULL);
+        void moveNodes(MegaNodeList* nodes, MegaNode* newParent, MegaRequestListener *listener = NULL);
         void copyNode(MegaNode* node, MegaNode *newParent, MegaRequestListener *listener = NULL);
         void copyNode(MegaNode* node, MegaNode *newParent, const char* newName, MegaRequestListener *listener = NULL);
         void renameNode(MegaNode* node, const char* newName, MegaRequestListener *listener = NULL);
         void remove(MegaNode* node, bool keepversions = false, MegaRequestListener *listener = NULL);
+        void removeNodes(MegaNodeList* nodes, MegaRequestListener *listener = NULL);
         void removeVersions(MegaRequestListener *listener = NULL);
         void restoreVersion(MegaNode *version, MegaRequestListener *listener = NULL);
         void cleanRubbishBin(MegaRequestListener *listener = NULL);
@@ -2088,6 +2840,7 @@ class MegaApiImpl : public MegaApp
         void decryptPasswordProtectedLink(const char* link, const char* password, MegaRequestListener *listener = NULL);
         void encryptLinkWithPassword(const char* link, const char* password, MegaRequestListener *listener = NULL);
         void getPublicNode(const char* megaFileLink, MegaRequestListener *listener = NULL);
+        void setThumbnailCache(const char* localFolder, long long maxSize);
         void getThumbnail(MegaNode* node, const char *dstFilePath, MegaRequestListener *listener = NULL);
 		void cancelGetThumbnail(MegaNode* node, MegaRequestListener *listener = NULL);
         void setThumbnail(MegaNode* node, const char *srcFilePath, MegaRequestListener *listener = NULL);
@@ -2106,6 +2859,7 @@ class MegaApiImpl : public MegaApp
         bool testAllocation(unsigned allocCount, size_t allocSize);
         void getUserAttribute(MegaUser* user, int type, MegaRequestListener *listener = NULL);
         void getUserAttribute(const char* email_or_handle, int type, MegaRequestListener *listener = NULL);
+        void getUserAttributes(MegaUserList* users, int type, MegaRequestListener *listener = NULL);
         void getChatUserAttribute(const char* email_or_handle, int type, const char* ph, MegaRequestListener *listener = NULL);
         void getUserAttr(const char* email_or_handle, int type, const char *dstFilePath, int number = 0, MegaRequestListener *listener = NULL);
         void getChatUserAttr(const char* email_or_handle, int type, const char *dstFilePath, const char *ph = NULL, int number = 0, MegaRequestListener *listener = NULL);
@@ -2115,11 +2869,14 @@ class MegaApiImpl : public MegaApp
         void setRubbishBinAutopurgePeriod(int days, MegaRequestListener *listener = NULL);
         void getUserEmail(MegaHandle handle, MegaRequestListener *listener = NULL);
         void setCustomNodeAttribute(MegaNode *node, const char *attrName, const char *value, MegaRequestListener *listener = NULL);
+        void setCustomNodesAttribute(MegaNodeList *nodes, const char *attrName, const char *value, MegaRequestListener *listener = NULL);
         void setNodeDuration(MegaNode *node, int secs, MegaRequestListener *listener = NULL);
         void setNodeCoordinates(MegaNode *node, bool unshareable, double latitude, double longitude, MegaRequestListener *listener = NULL);
         void exportNode(MegaNode *node, int64_t expireTime, MegaRequestListener *listener = NULL);
         void disableExport(MegaNode *node, MegaRequestListener *listener = NULL);
         void fetchNodes(MegaRequestListener *listener = NULL);
+        void fetchFolder(MegaNode *folder, MegaRequestListener *listener = NULL);
+        bool isFolderFetched(MegaNode *folder);
         void getPricing(MegaRequestListener *listener = NULL);
         void getPaymentId(handle productHandle, handle lastPublicHandle, MegaRequestListener *listener = NULL);
         void upgradeAccount(MegaHandle productHandle, int paymentMethod, MegaRequestListener *listener = NULL);
@@ -2153,12 +2910,29 @@ class MegaApiImpl : public MegaApp
 
         void useHttpsOnly(bool httpsOnly, MegaRequestListener *listener = NULL);
         bool usingHttpsOnly();
+        void enableDownloadHardLinks(bool enable);
+        bool areDownloadHardLinksEnabled();
+        bool recordActionPackets(const char *localPath);
 
         //Backups
         MegaStringList *getBackupFolders(int backuptag);
         void setBackup(const char* localPath, MegaNode *parent, bool attendPastBackups, int64_t period, string periodstring, int numBackups, MegaRequestListener *listener=NULL);
         void removeBackup(int tag, MegaRequestListener *listener=NULL);
         void abortCurrentBackup(int tag, MegaRequestListener *listener=NULL);
+        void enableIncrementalBackups(bool enable);
+        bool isIncrementalBackupsEnabled();
+        void setMaxConcurrentBackups(int maxBackups);
+        int getMaxConcurrentBackups();
+        bool setBackupLimits(int backupTag, int maxUploads, long long bytesPerSecond);
+
+        // a backup due to start gets one of the maxConcurrentBackups slots, or waits
+        // in backupQueue (first come, first served)
+        bool acquireBackupSlot(int backupTag);
+        void leaveBackupQueue(int backupTag);
+
+        // copies file nodes into a folder in a single putnodes, keeping their keys
+        // (TYPE_COPY request, MegaRequest::getNumber is the number of nodes)
+        void putNodeCopies(handle target, const vector<Node*>& nodes, MegaRequestListener *listener);
 
         //Timer
         void startTimer( int64_t period, MegaRequestListener *listener=NULL);
@@ -2167,10 +2941,15 @@ class MegaApiImpl : public MegaApp
         void startUpload(const char* localPath, MegaNode *parent, MegaTransferListener *listener=NULL);
         void startUpload(const char* localPath, MegaNode *parent, int64_t mtime, MegaTransferListener *listener=NULL);
         void startUpload(const char* localPath, MegaNode* parent, const char* fileName, MegaTransferListener *listener = NULL);
-        void startUpload(bool startFirst, const char* localPath, MegaNode* parent, const char* fileName, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, MegaTransferListener *listener);
+        void startUpload(bool startFirst, const char* localPath, MegaNode* parent, const char* fileName, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, MegaTransferListener *listener, const FileFingerprint *fingerprint = nullptr);
+        void startUploads(MegaUploadBatch* batch, MegaTransferListener *listener);
+        void startUploadFromStream(MegaInputStream *inputStream, MegaNode *parent, const char *fileName, int64_t mtime, MegaTransferListener *listener);
         void startDownload(MegaNode* node, const char* localPath, MegaTransferListener *listener = NULL);
         void startDownload(bool startFirst, MegaNode *node, const char* target, int folderTransferTag, const char *appData, MegaTransferListener *listener);
         void startStreaming(MegaNode* node, m_off_t startPos, m_off_t size, MegaTransferListener *listener);
+
+        // get the tempurls of files of the account (and their first data, with readAhead) before they are streamed
+        void prefetchStreaming(const std::vector<MegaHandle>& handles, bool readAhead);
         void setStreamingMinimumRate(int bytesPerSecond);
         void retryTransfer(MegaTransfer *transfer, MegaTransferListener *listener = NULL);
         void cancelTransfer(MegaTransfer *transfer, MegaRequestListener *listener=NULL);
@@ -2192,6 +2971,16 @@ class MegaApiImpl : public MegaApp
         void setUploadMethod(int method);
         bool setMaxDownloadSpeed(m_off_t bpslimit);
         bool setMaxUploadSpeed(m_off_t bpslimit);
+        bool setHTTP2Enabled(bool enable);
+        bool isHTTP2Enabled();
+        bool setSocketOptions(int direction, int recvBufferSize, int sendBufferSize, int notSentLowat, const char* congestionControl, int bufferSize);
+        bool setConnectionCacheLimits(int direction, int maxIdleConnections, int maxHostConnections, int maxTotalConnections, int maxIdleSeconds);
+        bool setNetworkThreadEnabled(bool enable);
+        bool isNetworkThreadEnabled();
+        bool setBackgroundTransferHandler(MegaBackgroundTransferHandler* handler, const char* folder);
+        void enableBackgroundTransfers(bool enable);
+        bool areBackgroundTransfersEnabled();
+        bool backgroundTransferFinished(int64_t id, int httpStatus, const char* response);
         int getMaxDownloadSpeed();
         int getMaxUploadSpeed();
         int getCurrentDownloadSpeed();
@@ -2200,6 +2989,9 @@ class MegaApiImpl : public MegaApp
         int getDownloadMethod();
         int getUploadMethod();
         MegaTransferData *getTransferData(MegaTransferListener *listener = NULL);
+        int getTransferProgressSnapshot(MegaTransferProgress *progress, int size);
+        void enableTransferUpdateCallbacks(bool enable);
+        bool areTransferUpdateCallbacksEnabled();
         MegaTransfer *getFirstTransfer(int type);
         void notifyTransfer(int transferTag, MegaTransferListener *listener = NULL);
         MegaTransferList *getTransfers();
@@ -2225,6 +3017,8 @@ class MegaApiImpl : public MegaApp
         void setExcludedPaths(vector<string> *excludedPaths);
         void setExclusionLowerSizeLimit(long long limit);
         void setExclusionUpperSizeLimit(long long limit);
+        void setSyncScanTimeBudget(int milliseconds);
+        int getSyncScanTimeBudget();
         bool moveToLocalDebris(const char *path);
         string getLocalPath(MegaNode *node);
         long long getNumLocalNodes();
@@ -2237,6 +3031,7 @@ class MegaApiImpl : public MegaApp
         MegaSync *getSyncByTag(int tag);
         MegaSync *getSyncByNode(MegaNode *node);
         MegaSync *getSyncByPath(const char * localPath);
+        MegaSyncStats *getSyncStats(int tag);
         char *getBlockedPath();
         void setExcludedRegularExpressions(MegaSync *sync, MegaRegExp *regExp);
 #endif
@@ -2268,6 +3063,7 @@ class MegaApiImpl : public MegaApp
 		int getNumChildFiles(MegaNode* parent);
 		int getNumChildFolders(MegaNode* parent);
         MegaNodeList* getChildren(MegaNode *parent, int order=1);
+        MegaNodeList* getChildren(MegaNode *parent, int order, int offset, int limit);
         MegaNodeList* getVersions(MegaNode *node);
         int getNumVersions(MegaNode *node);
         bool hasVersions(MegaNode *node);
@@ -2284,6 +3080,8 @@ class MegaApiImpl : public MegaApp
         MegaUserList* getContacts();
         MegaUser* getContact(const char* uid);
         MegaUserAlertList* getUserAlerts();
+        MegaUserAlertList* getUserAlerts(int start, int count);
+        int getNumUserAlerts();
         int getNumUnreadUserAlerts();
         MegaNodeList *getInShares(MegaUser* user, int order);
         MegaNodeList *getInShares(int order);
@@ -2334,13 +3132,22 @@ class MegaApiImpl : public MegaApp
         int getDefaultFilePermissions();
         void setDefaultFolderPermissions(int permissions);
         int getDefaultFolderPermissions();
+        void setDownloadWriteOptions(int options);
+        int getDownloadWriteOptions();
+        void setDownloadDurability(int policy, int windowMs);
 
         long long getBandwidthOverquotaDelay();
+        long long getTransferQuotaTimeLeft();
 
         MegaRecentActionBucketList* getRecentActions(unsigned days = 90, unsigned maxnodes = 10000);
 
         MegaNodeList* search(MegaNode* node, const char* searchString, MegaCancelToken *cancelToken, bool recursive = 1, int order = MegaApi::ORDER_NONE);
         bool processMegaTree(MegaNode* node, MegaTreeProcessor* processor, bool recursive = 1);
+        MegaNodeSnapshot *getNodeSnapshot(MegaNode *node);
+        long long getNodeGeneration();
+        MegaNodeChangeList *getNodeChangesSince(long long generation);
+        bool startNodeTreeExport(const char *name);
+        void stopNodeTreeExport();
         MegaNodeList* search(const char* searchString, MegaCancelToken *cancelToken, int order = MegaApi::ORDER_NONE);
 
         MegaNode *createForeignFileNode(MegaHandle handle, const char *key, const char *name, m_off_t size, m_off_t mtime,
@@ -2372,6 +3179,75 @@ class MegaApiImpl : public MegaApp
         void getPSA(MegaRequestListener *listener = NULL);
         void setPSA(int id, MegaRequestListener *listener = NULL);
 
+        void enableSearchIndex(bool enable);
+        bool isSearchIndexEnabled();
+        void enableLazyNodeLoading(bool enable);
+        bool isLazyNodeLoadingEnabled();
+        void enableAsyncDbWrites(bool enable);
+        bool areAsyncDbWritesEnabled();
+        void enableStateCacheSnapshots(bool enable);
+        bool areStateCacheSnapshotsEnabled();
+        void enableReloadReconciliation(bool enable);
+        bool isReloadReconciliationEnabled();
+        void enableActionPacketPrefetch(bool enable);
+        bool isActionPacketPrefetchEnabled();
+        void setNodeUpdateCoalescing(int milliseconds, int maxNodes);
+        int getNodeUpdateCoalescingWindow();
+        void enableCompactNodeUpdates(bool enable);
+        bool areCompactNodeUpdatesEnabled();
+        void enableLazyFolderLinks(bool enable);
+        bool areLazyFolderLinksEnabled();
+        void enableAdaptiveTransfers(bool enable);
+        bool areAdaptiveTransfersEnabled();
+        void setTransferSchedule(int schedule);
+        int getTransferSchedule();
+        void setTransferClassWeight(int transferTag, unsigned weight);
+        void enableUploadBatching(bool enable);
+        bool isUploadBatchingEnabled();
+        void setTransferCryptoThreads(int threads);
+        int getTransferCryptoThreads();
+        static void setSharedWorkerThreads(int threads);
+        static int getSharedWorkerThreads();
+        static void enableSharedNetworkCaches(bool enable);
+        static bool areSharedNetworkCachesEnabled();
+        static void setNetworkBackend(int backend);
+        static int getNetworkBackend();
+        void setGfxWorkers(int threads);
+        int getGfxWorkers();
+        void setPowerPolicy(int policy);
+        int getPowerPolicy();
+        void setPowerState(int powerState, int thermalState);
+        bool isLowPowerActive();
+        void enableHedgedDownloads(bool enable);
+        bool areHedgedDownloadsEnabled();
+        void setUploadReadAhead(int chunks);
+        int getUploadReadAhead();
+        void enableFingerprintCache(bool enable);
+        bool isFingerprintCacheEnabled();
+        void enableConnectionPrewarming(bool enable);
+        bool isConnectionPrewarmingEnabled();
+        void enableTransferUrlPrefetching(bool enable);
+        bool isTransferUrlPrefetchingEnabled();
+        void enablePipelinedStartup(bool enable);
+        bool isPipelinedStartupEnabled();
+        void enableTlsSessionCache(bool enable);
+        bool isTlsSessionCacheEnabled();
+        char* getNetworkStats(bool reset);
+        char* getMemoryUsageReport();
+        static void setPerformanceSampling(int interval);
+        char* getPerformanceLatencies(bool reset);
+        void enableUploadDeduplication(bool enable);
+        bool isUploadDeduplicationEnabled();
+        long long getUploadDeduplicatedBytes();
+        void setCompressedTransfers(bool enable);
+        bool areCompressedTransfersEnabled();
+        void setTransferRateLimit(int transferTag, long long bytesPerSecond, long long burstBytes);
+        void addTransferRateLimitPeriod(int transferTag, int startMinute, int endMinute, long long bytesPerSecond);
+        void setStreamingCacheSize(long long bytes);
+        long long getStreamingCacheSize();
+        void setPipelinedRequests(int maxBatches);
+        int getPipelinedRequests();
+        void setDatabaseOption(int option, long long value);
         void disableGfxFeatures(bool disable);
         bool areGfxFeaturesDisabled();
 
@@ -2445,6 +3321,12 @@ class MegaApiImpl : public MegaApp
         int httpServerGetMaxBufferSize();
         void httpServerSetMaxOutputSize(int outputSize);
         int httpServerGetMaxOutputSize();
+        void httpServerSetEventLoops(int loops);
+        int httpServerGetEventLoops();
+        void httpServerSetMediaPrefetchTime(int seconds);
+        int httpServerGetMediaPrefetchTime();
+        void httpServerSetFolderPrefetch(int files, bool readAhead);
+        int httpServerGetFolderPrefetch();
 
         // permissions
         void httpServerEnableFileServer(bool enable);
@@ -2458,6 +3340,11 @@ class MegaApiImpl : public MegaApp
         void httpServerEnableOfflineAttribute(bool enable);
         void httpServerEnableSubtitlesSupport(bool enable);
         bool httpServerIsSubtitlesSupportEnabled();
+        void httpServerEnableMetrics(bool enable);
+        bool httpServerIsMetricsEnabled();
+
+        // the last metrics refreshed by the SDK thread, with their age (empty if none yet)
+        string getMetricsSnapshot();
 
         void httpServerAddListener(MegaTransferListener *listener);
         void httpServerRemoveListener(MegaTransferListener *listener);
@@ -2558,10 +3445,15 @@ class MegaApiImpl : public MegaApp
 
         void fireOnTransferStart(MegaTransferPrivate *transfer);
         void fireOnTransferFinish(MegaTransferPrivate *transfer, MegaError e, DBTableTransactionCommitter& committer);
-        void fireOnTransferUpdate(MegaTransferPrivate *transfer);
+        void finishUpload(MegaTransferPrivate *transfer, error e, Node *n, handle h);
+        // without appListeners, only an internal listener of the transfer is called
+        void fireOnTransferUpdate(MegaTransferPrivate *transfer, bool appListeners = true);
         void fireOnTransferTemporaryError(MegaTransferPrivate *transfer, MegaError e);
         map<int, MegaTransferPrivate *> transferMap;
 
+        void enableAsyncTransferCallbacks(bool enable);
+        bool areAsyncTransferCallbacksEnabled();
+
         MegaClient *getMegaClient();
         static FileFingerprint *getFileFingerprintInternal(const char *fingerprint);
 
@@ -2599,6 +3491,7 @@ protected:
         void fireOnUsersUpdate(MegaUserList *users);
         void fireOnUserAlertsUpdate(MegaUserAlertList *alerts);
         void fireOnNodesUpdate(MegaNodeList *nodes);
+        void fireOnNodesChanged(MegaNodeChangeList *changes);
         void fireOnAccountUpdate();
         void fireOnContactRequestsUpdate(MegaContactRequestList *requests);
         void fireOnReloadNeeded();
@@ -2624,7 +3517,26 @@ protected:
         MegaApi *api;
         MegaThread thread;
         MegaClient *client;
-        MegaHttpIO *httpio;
+        HttpIO *httpio;
+
+        // httpio is a WinHttpIO, which takes the proxy settings in UTF-16
+        bool winHttp;
+
+        // network layer of the instances created later (MegaApi::setNetworkBackend)
+        static std::atomic<int> networkBackend;
+
+        // passes the requests of the transfers to the MegaBackgroundTransferHandler of the app
+        struct BackgroundTransferHandler : public BackgroundHttpIO::Handler
+        {
+            MegaBackgroundTransferHandler* handler;
+
+            bool start(uint64_t id, bool upload, const string& url, const string& path) override;
+            void cancel(uint64_t id) override;
+        };
+
+        BackgroundTransferHandler backgroundTransferHandler;
+        std::unique_ptr<BackgroundHttpIO> backgroundHttpIO;
+
         MegaWaiter *waiter;
         MegaFileSystemAccess *fsAccess;
         MegaDbAccess *dbAccess;
@@ -2636,13 +3548,28 @@ protected:
         MegaHTTPServer *httpServer;
         int httpServerMaxBufferSize;
         int httpServerMaxOutputSize;
+        int httpServerEventLoops;
+        int httpServerMediaPrefetchTime;
+        int httpServerFolderPrefetchFiles;
+        bool httpServerFolderPrefetchReadAhead;
         bool httpServerEnableFiles;
         bool httpServerEnableFolders;
         bool httpServerOfflineAttributeEnabled;
         int httpServerRestrictedMode;
         bool httpServerSubtitlesSupportEnabled;
+        bool httpServerMetricsEnabled;
         set<MegaTransferListener *> httpServerListeners;
 
+        // metrics served on /metrics, rebuilt by the SDK thread every METRICS_REFRESH_DS
+        // while enabled: a scrape only copies them and never waits for sdkMutex
+        static const dstime METRICS_REFRESH_DS = 10;
+        std::mutex metricsMutex;
+        string metricsSnapshot;
+        std::chrono::steady_clock::time_point metricsSnapshotTime;
+
+        // rebuilds the snapshot if it's due, returns the deciseconds until the next one
+        dstime refreshMetrics();
+
         MegaFTPServer *ftpServer;
         int ftpServerMaxBufferSize;
         int ftpServerMaxOutputSize;
@@ -2652,6 +3579,132 @@ protected:
 		
         map<int, MegaBackupController *> backupsMap;
 
+        // folder uploads, to be given their finished scans, and the threads that scan
+        std::set<MegaFolderUploadController *> folderUploads;
+        std::unique_ptr<CryptoWorkers> scanWorkers;
+        static const unsigned SCAN_THREADS = 8;
+        CryptoWorkers *getScanWorkers();
+
+        // compares a local file with a version in the cloud through the MAC of its content,
+        // computed with the key of that version
+        struct ContentCheckJob : public CryptoWorkers::Job
+        {
+            FileSystemAccess* fsaccess;
+            string localpath;
+            m_off_t size;
+            string nodekey;
+            bool same = false;
+
+            // bytes read and authenticated at a time
+            static const unsigned READSIZE = 16 * 1024 * 1024;
+
+            void run() override;
+        };
+
+        // uploads waiting for the comparison of the file with its previous version
+        std::list<std::pair<MegaTransferPrivate *, std::shared_ptr<ContentCheckJob> > > contentChecks;
+        bool uploadDeduplication = false;
+        bool incrementalBackups = false;
+        int maxConcurrentBackups = 0;
+        std::deque<int> backupQueue;
+        long long deduplicatedBytes = 0;
+
+        // compresses the local file of an upload into a temporary file, as a zlib stream
+        // with a full flush every FRAMESIZE bytes of input
+        struct CompressJob : public CryptoWorkers::Job
+        {
+            FileSystemAccess* fsaccess;
+            string localpath;
+            string tmppath;
+            bool compressed = false;
+            FileFingerprint original;       // of the local file
+            FileFingerprint fingerprint;    // of the temporary file, with the mtime of the local file
+
+            static const unsigned FRAMESIZE = 1024 * 1024;
+
+            void run() override;
+        };
+
+        // restores the content of a compressed node once it is downloaded
+        struct DecompressJob : public CryptoWorkers::Job
+        {
+            FileSystemAccess* fsaccess;
+            string localpath;
+            string tmppath;
+            FileFingerprint original;       // the size, and the CRCs if valid, of the content
+            bool decompressed = false;
+
+            void run() override;
+        };
+
+        // uploads waiting for their file to be compressed, downloads waiting for it to be decompressed
+        std::list<std::pair<MegaTransferPrivate *, std::shared_ptr<CompressJob> > > compressions;
+        std::list<std::pair<MegaTransferPrivate *, std::shared_ptr<DecompressJob> > > decompressions;
+        bool compressedTransfers = false;
+
+        // smaller files are uploaded as they are
+        static const m_off_t MIN_COMPRESSED_SIZE = 4096;
+
+        void discardCompressedUpload(MegaTransferPrivate *transfer);
+
+        // the nodes of a putnodes batch of a tree copy, whose attributes are encrypted
+        // by the workers, in parts, before the batch is put into its target folder
+        struct TreeCopyBatch : public CryptoWorkers::Job
+        {
+            const MegaClient* client;
+            handle target;
+            bool first = false;         // the root is its first node
+            NewNode* nn = nullptr;      // owned until the batch is put
+            unsigned nc = 0;
+            bool put = false;
+            vector<AttrMap> attrs;      // of each node, encrypted into nn[i].attrstring
+            unsigned parts = 1;
+
+            // folders of the batch whose children are left for later batches: source, index in nn
+            vector<std::pair<handle, unsigned> > deferred;
+
+            void run() override;
+            void run(unsigned part) override;
+            ~TreeCopyBatch();
+        };
+
+        // copy of a folder tree in batches of up to MegaClient::MAX_NEWNODES nodes, up to
+        // TREE_COPY_INFLIGHT of them being encrypted or put at a time. The children of the
+        // folders that don't fit in a batch are copied once the handle of their copy is known
+        struct TreeCopy
+        {
+            MegaRequestPrivate* request;
+            string newname;             // of the copy of the root, if not the one of the source
+            handle root = UNDEF;        // copy of the root, once put
+
+            // folders copied, with the children still to be copied into them
+            struct Folder
+            {
+                handle copy;
+                vector<handle> children;
+                size_t next = 0;
+            };
+            std::deque<Folder> folders;
+
+            std::deque<std::shared_ptr<TreeCopyBatch> > encrypting;
+            std::vector<std::shared_ptr<TreeCopyBatch> > putting;
+            unsigned batches = 0;
+
+            long long total = 0;
+            long long copied = 0;
+            error e = API_OK;
+        };
+
+        static const unsigned TREE_COPY_INFLIGHT = 4;
+
+        // tree copies, by request tag
+        map<int, std::unique_ptr<TreeCopy> > treeCopies;
+
+        void startTreeCopy(MegaRequestPrivate *request, Node *node, handle target, const string *newname, long long total);
+        void nextTreeCopyBatch(TreeCopy &copy);
+        void continueTreeCopy(int tag);
+        void treeCopyResult(TreeCopy &copy, error e, NewNode *nn);
+
         RequestQueue requestQueue;
         TransferQueue transferQueue;
         map<int, MegaRequestPrivate *> requestMap;
@@ -2687,8 +3740,110 @@ protected:
         vector<string> excludedPaths;
         long long syncLowerSizeLimit;
         long long syncUpperSizeLimit;
+
+        // sorted children of recently listed folders, reused while Node::childrengeneration doesn't change
+        struct SortedChildren
+        {
+            handle parent;
+            int order;
+            uint64_t generation;
+            node_vector nodes;
+        };
+        static const size_t MAX_SORTED_CHILDREN_VIEWS = 16;
+        std::deque<SortedChildren> sortedChildrenViews;
+        const node_vector& getSortedChildren(Node *parent, int order);
+
+        // MegaNodeListLazy and MegaNodeSnapshotPrivate instances with entries not loaded
+        // yet, and those entries by node handle, so an update only touches those
+        std::set<LazyNodeEntries *> lazyNodeLists;
+        std::multimap<handle, std::pair<LazyNodeEntries *, size_t>> lazyNodeEntries;
+        void detachLazyNodeLists();
+        void materializeLazyNodes(Node* const* nodes, size_t count);
+
+        // node updates waiting for the end of the coalescing window, in order of
+        // their first change (the copy is only kept without compact notifications)
+        struct PendingNodeUpdate
+        {
+            MegaHandle handle;
+            int changes;
+            std::unique_ptr<MegaNode> node;
+        };
+        vector<PendingNodeUpdate> pendingNodeUpdates;
+        map<MegaHandle, size_t> pendingNodeUpdateIndex;
+        std::chrono::steady_clock::time_point pendingNodeUpdatesSince;
+        int nodeUpdateWindow = 0;
+        int nodeUpdateMaxNodes = 0;
+        bool compactNodeUpdates = false;
+
+        // onTransferUpdate is only fired for changes of state or priority when disabled
+        bool transferUpdateCallbacks = true;
+
+        // deliver the pending node updates if the window is over (or right away if forced)
+        void flushNodeUpdates(bool force);
+
+        // generation of the nodes, bumped on each notification of changes, and the
+        // recent changes by generation; getNodeChangesSince() can answer for any
+        // generation from nodeChangeLogFloor on
+        struct NodeChange
+        {
+            long long generation;
+            MegaHandle handle;
+            int changes;
+        };
+        static const size_t MAX_NODE_CHANGE_LOG = 100000;
+        long long nodeGeneration = 0;
+        long long nodeChangeLogFloor = 0;
+        std::deque<NodeChange> nodeChangeLog;
+        void resetNodeChangeLog();
+
+        // node tree in shared memory (MegaApi::startNodeTreeExport), snapshotted
+        // again by the SDK thread when stale
+        std::unique_ptr<SharedNodeTreeExport> nodeTreeExport;
+        void publishNodeTreeExport();
+        MegaNodeSnapshotPrivate *takeNodeSnapshot(Node *root, bool lazy);
+
         std::recursive_timed_mutex sdkMutex;
         using SdkMutexGuard = std::unique_lock<std::recursive_timed_mutex>;   // (equivalent to typedef)
+        std::thread::id sdkThreadId;
+
+        // transfer callbacks (but onTransferData) delivered in order by a thread of
+        // their own, with copies of the transfers; an update that hasn't been
+        // delivered yet is replaced by the next one of the same transfer
+        struct TransferEvent
+        {
+            int type;
+            std::unique_ptr<MegaTransferPrivate> transfer;
+            std::unique_ptr<MegaError> error;
+            MegaTransferListener *listener = nullptr;   // of the transfer, unless internal
+        };
+        enum { TRANSFER_EVENT_START, TRANSFER_EVENT_UPDATE, TRANSFER_EVENT_TEMPORARY_ERROR, TRANSFER_EVENT_FINISH };
+        std::atomic<bool> asyncTransferEvents{ false };
+        std::deque<TransferEvent> transferEvents;
+        std::map<int, TransferEvent*> transferEventUpdates;
+        std::mutex transferEventsMutex;
+        std::condition_variable transferEventsChanged;
+        std::thread transferEventsThread;
+        bool transferEventsExit = false;
+        bool transferEventDispatching = false;
+        void queueTransferEvent(int type, MegaTransferPrivate *transfer, MegaError *e = NULL);
+        void dispatchTransferEvents();
+
+        // listeners of the SDK itself (folder transfers, backups, HTTP/FTP server): they get
+        // the transfer callbacks on the SDK thread with sdkMutex locked, even when async
+        static bool isInternalTransferListener(MegaTransferListener *listener);
+        void stopTransferEvents();
+
+        // wait until the callback being delivered (if any) returns, so that a
+        // listener that has been removed isn't called anymore
+        void waitTransferEvent();
+
+        // read-only queries of the app threads (node lookups, listings, searches)
+        // take sdkMutex through lockSdkMutexForReading(), and the SDK thread lets
+        // them in with yieldToReaders() before it takes the mutex again, instead
+        // of winning the race for it loop after loop (waiting 20 ms at most)
+        std::atomic<int> sdkMutexReaders{ 0 };
+        void lockSdkMutexForReading();
+        void yieldToReaders();
         std::atomic<bool> syncPathStateLockTimeout{ false };
         MegaTransferPrivate *currentTransfer;
         MegaRequestPrivate *activeRequest;
@@ -2788,12 +3943,16 @@ protected:
         // user attribute update notification
         void userattr_update(User*, int, const char*) override;
 
+        void nodes_cached() override;
         void nodes_current() override;
         void catchup_result() override;
         void key_modified(handle, attr_t) override;
 
         void fetchnodes_result(error) override;
+        void fetchfolder_result(handle, error) override;
+        void getuas_result(error) override;
         void putnodes_result(error, targettype_t, NewNode*) override;
+        void putnodes_upload_result(error, handle) override;
 
         // share update result
         void share_result(error) override;
@@ -2860,6 +4019,7 @@ protected:
         File* file_resume(string*, direction_t *type) override;
 
         void transfer_prepare(Transfer*) override;
+        int transfer_class(Transfer*) override;
         void transfer_failed(Transfer*, error error, dstime timeleft) override;
         void transfer_update(Transfer*) override;
 
@@ -2978,6 +4138,10 @@ protected:
         void sendPendingRequests();
         unsigned sendPendingTransfers();
         void updateBackups();
+        void updateFolderUploads();
+        void updateContentChecks();
+        void updateCompressions();
+        void updateTreeCopies();
         char *stringToArray(string &buffer);
 
         //Internal
@@ -2985,6 +4149,7 @@ protected:
         Node *getNodeByFingerprintInternal(const char *fingerprint, Node *parent);
 
         bool processTree(Node* node, TreeProcessor* processor, bool recursive = 1, MegaCancelToken* cancelToken = nullptr);
+        void processIndexedNodes(const handle_set& index, TreeProcessor* processor, const handle_set* exclude = nullptr);
         void getNodeAttribute(MegaNode* node, int type, const char *dstFilePath, MegaRequestListener *listener = NULL);
 		    void cancelGetNodeAttribute(MegaNode *node, int type, MegaRequestListener *listener = NULL);
         void setNodeAttribute(MegaNode* node, int type, const char *srcFilePath, MegaHandle attributehandle, MegaRequestListener *listener = NULL);
@@ -3002,6 +4167,10 @@ protected:
         bool hasToForceUpload(const Node &node, const MegaTransferPrivate &transfer) const;
 
         friend class MegaBackgroundMediaUploadPrivate;
+        friend class LazyNodeEntries;
+        friend class MegaNodeListLazy;
+        friend class MegaNodeSnapshotPrivate;
+        friend class MegaFolderUploadController;
 };
 
 class MegaHashSignatureImpl
@@ -3052,12 +4221,20 @@ public:
     unsigned int availableSpace();
     unsigned int availableCapacity();
     uv_buf_t nextBuffer();
+
+    // up to maxOutputSize bytes of data in the (one or two) segments of the ring, for a single
+    // vectored write. The data stays in the buffer until freed; returns the number of segments
+    unsigned int nextBuffers(uv_buf_t bufs[2]);
     void freeData(unsigned int len);
     void setMaxBufferSize(unsigned int bufferSize);
     void setMaxOutputSize(unsigned int outputSize);
 
     static const unsigned int MAX_BUFFER_SIZE = 2097152;
-    static const unsigned int MAX_OUTPUT_SIZE = 16384;
+    static const unsigned int MAX_OUTPUT_SIZE = 131072;
+
+    // buffers allocated by all the instances, for the memory usage report
+    static std::atomic<size_t> allocatedBuffers;
+    static std::atomic<size_t> allocatedBytes;
 
 protected:
     char *buffer;
@@ -3141,6 +4318,28 @@ protected:
     bool closing;
     int remainingcloseevents;
 
+    // additional event loops (see setEventLoops), each on its own thread with a listening
+    // socket of its own on the port, shared with SO_REUSEPORT so that the kernel spreads the
+    // connections over the loops. A connection and its uv_async_t belong to the loop that
+    // accepted it. uv_loop_t::data is the ExtraLoop of a loop, NULL for uv_loop
+    struct ExtraLoop
+    {
+        MegaTCPServer *tcpServer;
+        uv_loop_t loop;
+        uv_tcp_t listener;
+        uv_async_t exit_handle;
+        MegaThread thread;
+        list<MegaTCPContext*> connections;
+    };
+    vector<ExtraLoop*> extraLoops;
+    int eventLoops;
+
+    void startExtraLoops(const struct sockaddr *address, uv_connection_cb onNewClientCB);
+    void stopExtraLoops();
+    static void *extraLoopEntryPoint(void *param);
+    static void onExtraLoopCloseRequested(uv_async_t* handle);
+    list<MegaTCPContext*>& loopConnections(uv_loop_t *loop);
+
 #ifdef ENABLE_EVT_TLS
     // TLS
     bool evtrequirescleaning;
@@ -3212,6 +4411,8 @@ public:
     void setMaxOutputSize(int outputSize);
     int getMaxBufferSize();
     int getMaxOutputSize();
+    void setEventLoops(int loops);
+    int getEventLoops();
     void setRestrictedMode(int mode);
     int getRestrictedMode();
     bool isHandleAllowed(handle h);
@@ -3276,9 +4477,23 @@ public:
     MegaHandle nodeToMove; //node to be moved after delete
     MegaHandle newParentNode; //parent node for moved after delete
 
+    // PROPFIND responses, produced while they are sent
+    bool propFind; // part of the response is still to be buffered
+    bool propFindListing; // part of the response is still to be produced
+    bool propFindChunked;
+    std::string propFindBody; // produced, but not buffered yet
+    std::string propFindURL; // URL of the folder being listed
+    std::vector<MegaHandle> propFindChildren; // children of the folder being listed
+    size_t propFindIndex;
+    std::deque<std::pair<MegaHandle, std::string>> propFindFolders; // folders to list next (Depth: infinity)
+
     uv_mutex_t mutex_responses;
     std::list<std::string> responses;
 
+    // Persistent connections
+    bool keepAlive;
+    std::string pendingInput; // pipelined requests received while answering the current one
+
     virtual void onTransferStart(MegaApi *, MegaTransfer *transfer);
     virtual bool onTransferData(MegaApi *, MegaTransfer *transfer, char *buffer, size_t size);
     virtual void onTransferFinish(MegaApi* api, MegaTransfer *transfer, MegaError *e);
@@ -3288,12 +4503,58 @@ public:
 class MegaHTTPServer: public MegaTCPServer
 {
 protected:
+    // maximum size of the pipelined requests kept while answering a previous one
+    static const size_t MAX_PENDING_INPUT = 65536;
+
+    // size of the buffer of a PROPFIND response, that is filled as the connection drains
+    static const unsigned int PROPFIND_BUFFER_SIZE = 131072;
+
+    // room kept in that buffer for the framing of a chunk
+    static const unsigned int PROPFIND_CHUNK_MARGIN = 32;
+
+    // limits of the buffer of a media file sized for its prefetch time
+    static const m_off_t MIN_MEDIA_BUFFER_SIZE = 262144;
+    static const m_off_t MAX_MEDIA_BUFFER_SIZE = 67108864;
+
+    // the WEBDAV cache is emptied when it would grow beyond this number of nodes
+    static const size_t MAX_WEBDAV_CACHED_NODES = 20000;
+
+    // files prefetched at most after one read sequentially, and files streamed recently
+    // kept to detect it
+    static const int MAX_FOLDER_PREFETCH_FILES = 16;
+    static const size_t MAX_RECENT_STREAMS = 16;
+
     set<handle> allowedWebDavHandles;
 
+    // properties of a node for PROPFIND responses, but its href
+    struct WebDavNodeProps
+    {
+        std::string name;
+        std::string props;
+        bool folder;
+        MegaHandle parent; // folder listing the node when it was cached
+    };
+
+    // properties of nodes and children of folders already served, until they change
+    uv_mutex_t webDavCacheMutex;
+    std::map<MegaHandle, WebDavNodeProps> webDavNodeCache;
+    std::map<MegaHandle, std::vector<MegaHandle>> webDavListingCache;
+    unsigned int webDavCacheGeneration;
+
     bool fileServerEnabled;
     bool folderServerEnabled;
     bool offlineAttribute;
     bool subtitlesSupportEnabled;
+    bool metricsEnabled;
+    int mediaPrefetchTime;
+
+    // a file streamed right after the previous file of its folder (in listing order) gets
+    // the next files of the folder prefetched (see MegaApi::httpServerSetFolderPrefetch)
+    uv_mutex_t folderPrefetchMutex;
+    int folderPrefetchFiles;
+    bool folderPrefetchReadAhead;
+    std::deque<MegaHandle> recentStreams;
+    void prefetchFolder(MegaNode *node);
 
     //virtual methods:
     virtual void processReceivedData(MegaTCPContext *ftpctx, ssize_t nread, const uv_buf_t * buf);
@@ -3318,14 +4579,25 @@ protected:
     static void sendNextBytes(MegaHTTPContext *httpctx);
     static int streamNode(MegaHTTPContext *httpctx);
 
+    // buffer holding the prefetch time of a media file (0 if not applicable)
+    unsigned int getMediaBufferSize(MegaNode *node);
+
+    // reuse the context of a persistent connection for its next request
+    void startNextRequest(MegaHTTPContext *httpctx);
+
     //Utility funcitons
     static std::string getHTTPMethodName(int httpmethod);
     static std::string getHTTPErrorString(int errorcode);
     static std::string getResponseForNode(MegaNode *node, MegaHTTPContext* httpctx);
 
     // WEBDAV related
-    static std::string getWebDavPropFindResponseForNode(std::string baseURL, std::string subnodepath, MegaNode *node, MegaHTTPContext* httpctx);
-    static std::string getWebDavProfFindNodeContents(MegaNode *node, std::string baseURL, bool offlineAttribute);
+    static void sendWebDavPropFindResponseForNode(std::string baseURL, std::string subnodepath, MegaNode *node, MegaHTTPContext* httpctx);
+    static void continuePropFindResponse(MegaHTTPContext* httpctx);
+    static bool nextPropFindFragment(MegaHTTPContext* httpctx);
+    static std::string getWebDavPropFindNodeProps(MegaNode *node, bool offlineAttribute);
+    bool getWebDavNodeProps(MegaHandle h, WebDavNodeProps *props);
+    void getWebDavListing(MegaHandle h, std::vector<MegaHandle> *children);
+    void clearWebDavCache();
 
     static void returnHttpCodeBasedOnRequestError(MegaHTTPContext* httpctx, MegaError *e, bool synchronous = true);
     static void returnHttpCode(MegaHTTPContext* httpctx, int errorCode, std::string errorMessage = string(), bool synchronous = true);
@@ -3351,7 +4623,15 @@ public:
     bool isOfflineAttributeEnabled();
     bool isSubtitlesSupportEnabled();
     void enableSubtitlesSupport(bool enable);
-
+    bool isMetricsEnabled();
+    void enableMetrics(bool enable);
+    void setMediaPrefetchTime(int seconds);
+    int getMediaPrefetchTime();
+    void setFolderPrefetch(int files, bool readAhead);
+    int getFolderPrefetch();
+
+    // drops the cached WEBDAV data of updated nodes (all of it for NULL)
+    void onNodesUpdated(Node** n, int count);
 };
 
 class MegaFTPServer;
@@ -3448,6 +4728,14 @@ protected:
     int dataportBegin;
     int dataPortEnd;
 
+    // maximum number of idle data servers kept for new control connections
+    static const size_t MAX_IDLE_DATA_SERVERS = 4;
+
+    // data servers of closed control connections, still listening on their ports
+    // (each one with its thread and event loop) to serve the next PASV/EPSV
+    uv_mutex_t mutex_idleDataServers;
+    std::list<MegaFTPDataServer *> idleDataServers;
+
     std::string getListingLineFromNode(MegaNode *child, std::string nameToShow = string());
 
     MegaNode *getBaseFolderNode(std::string path);
@@ -3482,6 +4770,10 @@ public:
     std::string cdup(handle parentHandle, MegaFTPContext* ftpctx);
     std::string cd(string newpath, MegaFTPContext* ftpctx);
     std::string shortenpath(std::string path);
+
+    // data servers are pooled when their control connection closes
+    MegaFTPDataServer *takeIdleDataServer(MegaFTPContext* ftpctx);
+    void releaseDataServer(MegaFTPDataServer *fds);
 };
 
 class MegaFTPDataContext;
@@ -3516,6 +4808,12 @@ public:
     MegaFTPDataServer(MegaApiImpl *megaApi, string basePath, MegaFTPContext * controlftpctx, bool useTLS = false, std::string certificatepath = std::string(), std::string keypath = std::string());
     virtual ~MegaFTPDataServer();
     string getListingLineFromNode(MegaNode *child);
+
+    // whether it can serve another control connection (no data connections, not stopping)
+    bool isIdle();
+
+    // attaches the server to a control connection (NULL while pooled), with a clean state
+    void setControlContext(MegaFTPContext *controlftpctx);
 };
 
 class MegaFTPDataServer;
@@ -22,6 +22,59 @@
 #include "mega/attrmap.h"
 
 namespace mega {
+attr_map::iterator attr_map::lowerbound(nameid id)
+{
+    return std::lower_bound(entries.begin(), entries.end(), id,
+                            [](const value_type& entry, nameid id) { return entry.first < id; });
+}
+
+attr_map::iterator attr_map::find(nameid id)
+{
+    iterator it = lowerbound(id);
+    return it != entries.end() && it->first == id ? it : entries.end();
+}
+
+attr_map::const_iterator attr_map::find(nameid id) const
+{
+    return const_cast<attr_map*>(this)->find(id);
+}
+
+string& attr_map::operator[](nameid id)
+{
+    iterator it = lowerbound(id);
+    if (it == entries.end() || it->first != id)
+    {
+        it = entries.insert(it, value_type(id, string()));
+    }
+    return it->second;
+}
+
+std::pair<attr_map::iterator, bool> attr_map::insert(const value_type& value)
+{
+    iterator it = lowerbound(value.first);
+    if (it != entries.end() && it->first == value.first)
+    {
+        return std::make_pair(it, false);
+    }
+    return std::make_pair(entries.insert(it, value), true);
+}
+
+size_t attr_map::erase(nameid id)
+{
+    iterator it = find(id);
+    if (it == entries.end())
+    {
+        return 0;
+    }
+    entries.erase(it);
+    return 1;
+}
+
+attr_map::iterator attr_map::erase(const_iterator it)
+{
+    return entries.erase(it);
+}
+
 // approximate raw storage size of serialized AttrMap, not taking JSON escaping
 // or name length into account
 unsigned AttrMap::storagesize(int perrecord) const
@@ -23,24 +23,45 @@
 #include "mega/backofftimer.h"
 #include "mega/logging.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace mega {
 // timer with capped exponential backoff
 BackoffTimer::BackoffTimer(PrnGen &rng)
     : rng(rng)
 {
+    backoffs = 0;
     reset();
 }
 
+// copies don't belong to the wheel of the original
+BackoffTimer::BackoffTimer(const BackoffTimer& other)
+    : next(other.next), delta(other.delta), base(other.base), rng(other.rng), backoffs(other.backoffs)
+{
+}
+
+BackoffTimer::~BackoffTimer()
+{
+    if (wheelslot >= 0)
+    {
+        wheel->remove(this);
+    }
+}
+
 void BackoffTimer::reset()
 {
     next = 0;
     delta = 1;
     base = 1;
+    reschedule();
 }
 
 void BackoffTimer::backoff()
 {
     next = Waiter::ds + delta;
+    backoffs++;
 
     base <<= 1;
 
@@ -50,6 +71,7 @@ void BackoffTimer::backoff()
     }
 
     delta = base + (dstime)((base / 2.0) * (rng.genuint32(RAND_MAX)/(float)RAND_MAX));
+    reschedule();
 }
 
 void BackoffTimer::backoff(dstime newdelta)
@@ -57,6 +79,7 @@ void BackoffTimer::backoff(dstime newdelta)
     next = (newdelta == NEVER) ? NEVER : (Waiter::ds + newdelta);
     delta = newdelta;
     base = newdelta;
+    reschedule();
 }
 
 bool BackoffTimer::armed() const
@@ -71,6 +94,7 @@ bool BackoffTimer::arm()
         next = Waiter::ds;
         delta = 1;
         base = 1;
+        reschedule();
 
         return true;
     }
@@ -83,6 +107,7 @@ void BackoffTimer::set(dstime newds)
     if (newds < next)
     {
         next = newds;
+        reschedule();
     }
 }
 
@@ -122,6 +147,7 @@ void BackoffTimer::update(dstime* waituntil)
         {
             *waituntil = (next == 1) ? Waiter::ds + 1 : 0;
             next = 1;
+            reschedule();
         }
         else if (next < *waituntil)
         {
@@ -130,10 +156,241 @@ void BackoffTimer::update(dstime* waituntil)
     }
 }
 
+uint64_t BackoffTimer::backoffcount(bool resetcount)
+{
+    uint64_t count = backoffs;
+    if (resetcount)
+    {
+        backoffs = 0;
+    }
+    return count;
+}
+
+void BackoffTimer::schedule(TimerWheel* w, void* o)
+{
+    if (wheelslot >= 0)
+    {
+        wheel->remove(this);
+    }
+
+    wheel = w;
+    wheelowner = o;
+    reschedule();
+}
+
+void* BackoffTimer::owner() const
+{
+    return wheelowner;
+}
+
+// timers without a pending trigger time (unset, fired or NEVER) stay out of the wheel
+void BackoffTimer::reschedule()
+{
+    if (!wheel)
+    {
+        return;
+    }
+
+    if (wheelslot >= 0)
+    {
+        wheel->remove(this);
+    }
+
+    if (next > 1 && next != NEVER)
+    {
+        wheel->insert(this);
+    }
+}
+
 TimerWithBackoff::TimerWithBackoff(PrnGen &rng, int tag)
     : BackoffTimer(rng)
 {
     this->tag = tag;
 }
 
+static inline unsigned lowestbit(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+#ifdef _WIN64
+    _BitScanForward64(&i, mask);
+#else
+    if (!_BitScanForward(&i, (unsigned long)mask))
+    {
+        _BitScanForward(&i, (unsigned long)(mask >> 32));
+        i += 32;
+    }
+#endif
+    return unsigned(i);
+#else
+    return unsigned(__builtin_ctzll(mask));
+#endif
+}
+
+TimerWheel::TimerWheel()
+{
+    now = Waiter::ds;
+    count = 0;
+    memset(slots, 0, sizeof slots);
+    memset(occupied, 0, sizeof occupied);
+}
+
+TimerWheel::~TimerWheel()
+{
+    for (int i = 0; i <= DUE; i++)
+    {
+        for (BackoffTimer* t = slots[i]; t; t = t->wheelnext)
+        {
+            t->wheelslot = -1;
+            t->wheel = nullptr;
+        }
+    }
+}
+
+void TimerWheel::insert(BackoffTimer* t)
+{
+    int slot = DUE;
+
+    if (t->next > now)
+    {
+        dstime deadline = t->next;
+        dstime delta = deadline - now;
+
+        int level = 0;
+        while (level < LEVELS - 1 && delta >> (SLOTBITS * (level + 1)))
+        {
+            level++;
+        }
+
+        // beyond the last level, the timer waits in its farthest slot and goes
+        // around again when that slot is processed
+        if (delta >> (SLOTBITS * LEVELS))
+        {
+            deadline = now + (dstime(1) << (SLOTBITS * LEVELS)) - 1;
+        }
+
+        int index = int(deadline >> (SLOTBITS * level)) & (SLOTS - 1);
+        occupied[level] |= uint64_t(1) << index;
+        slot = level * SLOTS + index;
+    }
+
+    t->wheelprev = nullptr;
+    t->wheelnext = slots[slot];
+    if (t->wheelnext)
+    {
+        t->wheelnext->wheelprev = t;
+    }
+    slots[slot] = t;
+    t->wheelslot = slot;
+    count++;
+}
+
+void TimerWheel::remove(BackoffTimer* t)
+{
+    if (t->wheelprev)
+    {
+        t->wheelprev->wheelnext = t->wheelnext;
+    }
+    else
+    {
+        slots[t->wheelslot] = t->wheelnext;
+        if (!t->wheelnext && t->wheelslot < DUE)
+        {
+            occupied[t->wheelslot / SLOTS] &= ~(uint64_t(1) << (t->wheelslot % SLOTS));
+        }
+    }
+
+    if (t->wheelnext)
+    {
+        t->wheelnext->wheelprev = t->wheelprev;
+    }
+
+    t->wheelprev = t->wheelnext = nullptr;
+    t->wheelslot = -1;
+    count--;
+}
+
+// place the timers of a slot again, relative to the current time
+void TimerWheel::cascade(int slot)
+{
+    BackoffTimer* t = slots[slot];
+    slots[slot] = nullptr;
+    occupied[slot / SLOTS] &= ~(uint64_t(1) << (slot % SLOTS));
+
+    while (t)
+    {
+        BackoffTimer* next = t->wheelnext;
+        count--;
+        insert(t);
+        t = next;
+    }
+}
+
+dstime TimerWheel::nextevent() const
+{
+    dstime first = NEVER;
+
+    for (int level = 0; level < LEVELS; level++)
+    {
+        if (occupied[level])
+        {
+            // slots are processed when the level ticks over them, after the current one
+            dstime tick = (now >> (SLOTBITS * level)) + 1;
+            unsigned offset = unsigned(tick) & (SLOTS - 1);
+            uint64_t rotated = offset ? (occupied[level] >> offset) | (occupied[level] << (SLOTS - offset)) : occupied[level];
+            dstime t = (tick + lowestbit(rotated)) << (SLOTBITS * level);
+
+            if (t < first)
+            {
+                first = t;
+            }
+        }
+    }
+
+    return first;
+}
+
+void TimerWheel::advance(dstime until)
+{
+    dstime t;
+
+    while ((t = nextevent()) <= until)
+    {
+        now = t;
+
+        // higher levels first: their timers may land in the slot of a lower one
+        for (int level = LEVELS - 1; level >= 0; level--)
+        {
+            if (!(now & ((dstime(1) << (SLOTBITS * level)) - 1)))
+            {
+                int index = int(now >> (SLOTBITS * level)) & (SLOTS - 1);
+                if (occupied[level] & (uint64_t(1) << index))
+                {
+                    cascade(level * SLOTS + index);
+                }
+            }
+        }
+    }
+
+    if (until > now)
+    {
+        now = until;
+    }
+}
+
+BackoffTimer* TimerWheel::firstdue() const
+{
+    return slots[DUE];
+}
+
+BackoffTimer* TimerWheel::nextdue(const BackoffTimer* t) const
+{
+    return t->wheelnext;
+}
+
+size_t TimerWheel::size() const
+{
+    return count;
+}
+
 } // namespace
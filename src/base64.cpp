@@ -21,87 +21,189 @@
 
 #include "mega/base64.h"
 
+#ifndef MEGA_BASE64_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MEGA_BASE64_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MEGA_BASE64_NEON 1
+#endif
+#endif
+
 namespace mega {
 // modified base64 conversion (no trailing '=' and '-_' instead of '+/')
+static const char base64chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// value of each character, 255 if not in the alphabet ('+' and '/' are accepted too)
+static const byte base64values[256] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255,  62, 255,  63,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255,  63,
+    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
 unsigned char Base64::to64(byte c)
 {
-    c &= 63;
- 
-    if (c < 26)
-    {
-        return c + 'A';
-    }
- 
-    if (c < 52)
-    {
-        return c - 26 + 'a';
-    }
-
-    if (c < 62)
-    {
-        return c - 52 + '0';
-    }
-
-    if (c == 62)
-    {
-        return '-';
-    }
-
-    return '_';
+    return base64chars[c & 63];
 }
 
 unsigned char Base64::from64(byte c)
 {
-    if ((c >= 'A') && (c <= 'Z'))
-    {
-        return c - 'A';
-    }
+    return base64values[c];
+}
 
-    if ((c >= 'a') && (c <= 'z'))
-    {
-        return c - 'a' + 26;
-    }
+#if defined(MEGA_BASE64_SSE2) || defined(MEGA_BASE64_NEON)
+// 12 bytes to 16 characters and back. Each 32-bit lane holds three bytes, big
+// endian, which are split into (or joined from) four six-bit groups with shifts
+// and masks, as SSE2 has no byte shuffle; the mapping between the groups and
+// the characters is done by range comparisons, 16 at a time
+static inline uint32_t load24(const byte* b)
+{
+    return uint32_t(b[0]) << 16 | uint32_t(b[1]) << 8 | b[2];
+}
 
-    if ((c >= '0') && (c <= '9'))
+static void encode12(const byte* b, char* a)
+{
+#if defined(MEGA_BASE64_SSE2)
+    __m128i x = _mm_setr_epi32(int(load24(b)), int(load24(b + 3)), int(load24(b + 6)), int(load24(b + 9)));
+
+    __m128i groups = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 18), _mm_set1_epi32(0x3f)),
+                                               _mm_and_si128(_mm_srli_epi32(x, 4), _mm_set1_epi32(0x3f00))),
+                                  _mm_or_si128(_mm_and_si128(_mm_slli_epi32(x, 10), _mm_set1_epi32(0x3f0000)),
+                                               _mm_and_si128(_mm_slli_epi32(x, 24), _mm_set1_epi32(0x3f000000))));
+
+    // 'A' - 0, then 'a' - 26, '0' - 52, '-' - 62 and '_' - 63
+    __m128i offset = _mm_set1_epi8(65);
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(groups, _mm_set1_epi8(25)), _mm_set1_epi8(6)));
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(groups, _mm_set1_epi8(51)), _mm_set1_epi8(-75)));
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpeq_epi8(groups, _mm_set1_epi8(62)), _mm_set1_epi8(-13)));
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpeq_epi8(groups, _mm_set1_epi8(63)), _mm_set1_epi8(36)));
+
+    _mm_storeu_si128((__m128i*)a, _mm_add_epi8(groups, offset));
+#else
+    const uint32_t lanes[4] = { load24(b), load24(b + 3), load24(b + 6), load24(b + 9) };
+    uint32x4_t x = vld1q_u32(lanes);
+
+    uint32x4_t g = vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(x, 18), vdupq_n_u32(0x3f)),
+                                       vandq_u32(vshrq_n_u32(x, 4), vdupq_n_u32(0x3f00))),
+                             vorrq_u32(vandq_u32(vshlq_n_u32(x, 10), vdupq_n_u32(0x3f0000)),
+                                       vandq_u32(vshlq_n_u32(x, 24), vdupq_n_u32(0x3f000000))));
+    uint8x16_t groups = vreinterpretq_u8_u32(g);
+
+    uint8x16_t offset = vdupq_n_u8(65);
+    offset = vaddq_u8(offset, vandq_u8(vcgtq_u8(groups, vdupq_n_u8(25)), vdupq_n_u8(6)));
+    offset = vaddq_u8(offset, vandq_u8(vcgtq_u8(groups, vdupq_n_u8(51)), vdupq_n_u8(uint8_t(-75))));
+    offset = vaddq_u8(offset, vandq_u8(vceqq_u8(groups, vdupq_n_u8(62)), vdupq_n_u8(uint8_t(-13))));
+    offset = vaddq_u8(offset, vandq_u8(vceqq_u8(groups, vdupq_n_u8(63)), vdupq_n_u8(36)));
+
+    vst1q_u8((uint8_t*)a, vaddq_u8(groups, offset));
+#endif
+}
+
+// false if any of the 16 characters is not in the alphabet
+static bool decode16(const char* a, byte* b)
+{
+    uint32_t lanes[4];
+
+#if defined(MEGA_BASE64_SSE2)
+    __m128i v = _mm_loadu_si128((const __m128i*)a);
+
+    // signed comparisons: the bytes >= 0x80 are in no range
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i minus = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+    __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+
+    __m128i valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, minus)),
+                                 _mm_or_si128(_mm_or_si128(plus, underscore), slash));
+    if (_mm_movemask_epi8(valid) != 0xffff)
     {
-        return c - '0' + 52;
+        return false;
     }
 
-    if (c == '-' || c == '+')
+    // the ranges don't overlap: one offset per character
+    __m128i offset = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                                                            _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+                                               _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                                                            _mm_and_si128(minus, _mm_set1_epi8(62 - '-')))),
+                                  _mm_or_si128(_mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+                                                            _mm_and_si128(underscore, _mm_set1_epi8(63 - '_'))),
+                                               _mm_and_si128(slash, _mm_set1_epi8(63 - '/'))));
+    __m128i g = _mm_add_epi8(v, offset);
+
+    __m128i x = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(0x3f)), 18),
+                                          _mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(0x3f00)), 4)),
+                             _mm_or_si128(_mm_srli_epi32(_mm_and_si128(g, _mm_set1_epi32(0x3f0000)), 10),
+                                          _mm_srli_epi32(g, 24)));
+    _mm_storeu_si128((__m128i*)lanes, x);
+#else
+    uint8x16_t v = vld1q_u8((const uint8_t*)a);
+
+    uint8x16_t upper = vandq_u8(vcgeq_u8(v, vdupq_n_u8('A')), vcleq_u8(v, vdupq_n_u8('Z')));
+    uint8x16_t lower = vandq_u8(vcgeq_u8(v, vdupq_n_u8('a')), vcleq_u8(v, vdupq_n_u8('z')));
+    uint8x16_t digit = vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9')));
+    uint8x16_t minus = vceqq_u8(v, vdupq_n_u8('-'));
+    uint8x16_t plus = vceqq_u8(v, vdupq_n_u8('+'));
+    uint8x16_t underscore = vceqq_u8(v, vdupq_n_u8('_'));
+    uint8x16_t slash = vceqq_u8(v, vdupq_n_u8('/'));
+
+    uint8x16_t valid = vorrq_u8(vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, minus)),
+                                vorrq_u8(vorrq_u8(plus, underscore), slash));
+    uint64x2_t valid64 = vreinterpretq_u64_u8(valid);
+    if ((vgetq_lane_u64(valid64, 0) & vgetq_lane_u64(valid64, 1)) != ~uint64_t(0))
     {
-        return 62;
+        return false;
     }
 
-    if (c == '_' || c == '/')
+    uint8x16_t offset = vorrq_u8(vorrq_u8(vorrq_u8(vandq_u8(upper, vdupq_n_u8(uint8_t(-'A'))),
+                                                   vandq_u8(lower, vdupq_n_u8(uint8_t(26 - 'a')))),
+                                          vorrq_u8(vandq_u8(digit, vdupq_n_u8(uint8_t(52 - '0'))),
+                                                   vandq_u8(minus, vdupq_n_u8(uint8_t(62 - '-'))))),
+                                 vorrq_u8(vorrq_u8(vandq_u8(plus, vdupq_n_u8(uint8_t(62 - '+'))),
+                                                   vandq_u8(underscore, vdupq_n_u8(uint8_t(63 - '_')))),
+                                          vandq_u8(slash, vdupq_n_u8(uint8_t(63 - '/')))));
+    uint32x4_t g = vreinterpretq_u32_u8(vaddq_u8(v, offset));
+
+    uint32x4_t x = vorrq_u32(vorrq_u32(vshlq_n_u32(vandq_u32(g, vdupq_n_u32(0x3f)), 18),
+                                       vshlq_n_u32(vandq_u32(g, vdupq_n_u32(0x3f00)), 4)),
+                             vorrq_u32(vshrq_n_u32(vandq_u32(g, vdupq_n_u32(0x3f0000)), 10),
+                                       vshrq_n_u32(g, 24)));
+    vst1q_u32(lanes, x);
+#endif
+
+    for (int i = 0; i < 4; i++)
     {
-        return 63;
+        b[0] = byte(lanes[i] >> 16);
+        b[1] = byte(lanes[i] >> 8);
+        b[2] = byte(lanes[i]);
+        b += 3;
     }
 
-    return 255;
-}
-
-
-int Base64::atob(const string &in, string &out)
-{
-    out.resize(in.size() * 3 / 4 + 3);
-    out.resize(Base64::atob(in.data(), (byte *) out.data(), (int)out.size()));
-
-    return (int)out.size();
-}
-
-std::string Base64::atob(const std::string &in)
-{
-    string out;
-    out.resize(in.size() * 3 / 4 + 3);
-    out.resize(Base64::atob(in.data(), (byte *) out.data(), (int)out.size()));
-
-    return out;
+    return true;
 }
+#endif
 
-int Base64::atob(const char* a, byte* b, int blen)
+// at most alen characters, up to the first one not in the alphabet
+static int decode(const char* a, size_t alen, byte* b, int blen)
 {
     byte c[4];
-    int i;
+    size_t i;
     int p = 0;
 
     c[3] = 0;
@@ -110,35 +212,87 @@ int Base64::atob(const char* a, byte* b, int blen)
     {
         for (i = 0; i < 4; i++)
         {
-            if ((c[i] = from64(*a++)) == 255)
+            if (i >= alen || (c[i] = base64values[byte(a[i])]) == 255)
             {
                 break;
             }
         }
 
+        a += i;
+        alen -= i;
+
         if ((p >= blen) || !i)
         {
             return p;
         }
 
-        b[p++] = (c[0] << 2) | ((c[1] & 0x30) >> 4);
+        b[p++] = byte((c[0] << 2) | ((c[1] & 0x30) >> 4));
 
         if ((p >= blen) || (i < 3))
         {
             return p;
         }
 
-        b[p++] = (c[1] << 4) | ((c[2] & 0x3c) >> 2);
+        b[p++] = byte((c[1] << 4) | ((c[2] & 0x3c) >> 2));
 
         if ((p >= blen) || (i < 4))
         {
             return p;
         }
 
-        b[p++] = (c[2] << 6) | c[3];
+        b[p++] = byte((c[2] << 6) | c[3]);
     }
 }
 
+int Base64::atob(const string &in, string &out)
+{
+    out.resize(in.size() * 3 / 4 + 3);
+    out.resize(Base64::atob(in.data(), in.size(), (byte *) out.data(), (int)out.size()));
+
+    return (int)out.size();
+}
+
+std::string Base64::atob(const std::string &in)
+{
+    string out;
+    out.resize(in.size() * 3 / 4 + 3);
+    out.resize(Base64::atob(in.data(), in.size(), (byte *) out.data(), (int)out.size()));
+
+    return out;
+}
+
+int Base64::atob(const char* a, byte* b, int blen)
+{
+    // the terminator (or any other character not in the alphabet) ends it
+    return decode(a, size_t(-1), b, blen);
+}
+
+int Base64::atob(const char* a, size_t alen, byte* b, int blen)
+{
+    int p = 0;
+
+#if defined(MEGA_BASE64_SSE2) || defined(MEGA_BASE64_NEON)
+    while (alen >= 16 && blen - p >= 12 && decode16(a, b + p))
+    {
+        a += 16;
+        alen -= 16;
+        p += 12;
+    }
+#endif
+
+    return p + decode(a, alen, b + p, blen - p);
+}
+
+bool Base64::atohandle(const char* a, handle* h, int size)
+{
+    assert(size > 0 && size <= int(sizeof(handle)));
+
+    byte buf[sizeof(handle)] = { 0 };
+    int n = decode(a, size_t(-1), buf, size);
+    memcpy(h, buf, sizeof buf);
+    return n == size;
+}
+
 void Base64::itoa(int64_t val, string *result)
 {
     byte c;
@@ -221,6 +375,23 @@ std::string Base64::btoa(const string &in)
 }
 
 int Base64::btoa(const byte* b, int blen, char* a)
+{
+    int p = 0;
+
+#if defined(MEGA_BASE64_SSE2) || defined(MEGA_BASE64_NEON)
+    while (blen >= 12)
+    {
+        encode12(b, a + p);
+        b += 12;
+        blen -= 12;
+        p += 16;
+    }
+#endif
+
+    return p + btoaScalar(b, blen, a + p);
+}
+
+int Base64::btoaScalar(const byte* b, int blen, char* a)
 {
     int p = 0;
 
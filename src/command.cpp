@@ -34,6 +34,7 @@ Command::Command()
     tag = 0;
     batchSeparately = false;
     suppressSID = false;
+    orderIndependent = false;
 }
 
 void Command::cancel()
@@ -47,6 +48,16 @@ const char* Command::getstring() const
     return json.c_str();
 }
 
+const string& Command::getjson() const
+{
+    return json;
+}
+
+void Command::reserve(size_t len)
+{
+    json.reserve(json.size() + len);
+}
+
 // add opcode
 void Command::cmd(const char* cmd)
 {
@@ -85,16 +96,20 @@ void Command::arg(const char* name, const char* value, int quotes)
     }
 }
 
-// binary data
+// binary data (encoded on the stack unless large)
 void Command::arg(const char* name, const byte* value, int len)
 {
-    char* buf = new char[len * 4 / 3 + 4];
+    char stackbuf[256];
+    char* buf = len * 4 / 3 + 4 <= int(sizeof stackbuf) ? stackbuf : new char[len * 4 / 3 + 4];
 
     Base64::btoa(value, len, buf);
 
     arg(name, buf);
 
-    delete[] buf;
+    if (buf != stackbuf)
+    {
+        delete[] buf;
+    }
 }
 
 // 64-bit signed integer
@@ -194,14 +209,18 @@ void Command::element(handle h, int len)
 // add binary data
 void Command::element(const byte* data, int len)
 {
-    char* buf = new char[len * 4 / 3 + 4];
+    char stackbuf[256];
+    char* buf = len * 4 / 3 + 4 <= int(sizeof stackbuf) ? stackbuf : new char[len * 4 / 3 + 4];
 
     len = Base64::btoa(data, len, buf);
 
     json.append(elements() ? ",\"" : "\"");
     json.append(buf, len);
 
-    delete[] buf;
+    if (buf != stackbuf)
+    {
+        delete[] buf;
+    }
 
     json.append("\"");
 }
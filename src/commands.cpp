@@ -147,7 +147,7 @@ m_off_t HttpReqCommandPutFA::transferred(MegaClient *client)
 {
     if (httpiohandle)
     {
-        return client->httpio->postpos(httpiohandle);
+        return httpio->postpos(httpiohandle);
     }
 
     return 0;
@@ -166,6 +166,8 @@ CommandGetFA::CommandGetFA(MegaClient *client, int p, handle fahref)
     }
 
     arg("r", 1);
+
+    orderIndependent = true;
 }
 
 void CommandGetFA::procresult()
@@ -325,10 +327,15 @@ CommandPutFile::CommandPutFile(MegaClient* client, TransferSlot* ctslot, int ms)
     arg("s", tslot->fa->size);
     arg("ms", ms);
 
-    // send minimum set of different tree's roots for API to check overquota
+    targetroots(this, client, tslot->transfer);
+}
+
+// send minimum set of different tree's roots for API to check overquota
+void CommandPutFile::targetroots(Command* cmd, MegaClient* client, Transfer* transfer)
+{
     set<handle> targetRoots;
-    beginarray("t");
-    for (auto &file : tslot->transfer->files)
+    cmd->beginarray("t");
+    for (auto &file : transfer->files)
     {
         if (!ISUNDEF(file->h))
         {
@@ -344,10 +351,10 @@ CommandPutFile::CommandPutFile(MegaClient* client, TransferSlot* ctslot, int ms)
                 targetRoots.insert(rootnode);
             }
 
-            element((byte*)&file->h, MegaClient::NODEHANDLE);
+            cmd->element((byte*)&file->h, MegaClient::NODEHANDLE);
         }
     }
-    endarray();
+    cmd->endarray();
 }
 
 void CommandPutFile::cancel()
@@ -393,6 +400,7 @@ void CommandPutFile::procresult()
 
                 if (tempurls.size() == 1)
                 {
+                    client->notestoragehosts(PUT, tempurls);
                     tslot->transfer->tempurls = tempurls;
                     tslot->transferbuf.setIsRaid(tslot->transfer, tempurls, tslot->transfer->pos, tslot->maxRequestSize);
                     tslot->starttime = tslot->lastdata = client->waiter->ds;
@@ -418,6 +426,175 @@ void CommandPutFile::procresult()
 }
 
 // request upload target URL for application to upload photo to using eg. iOS background upload feature
+// same request as CommandPutFile and CommandGetFile, without file access or transfer slot
+CommandPrefetchTransferUrls::CommandPrefetchTransferUrls(MegaClient* client, Transfer* t, int ms)
+{
+    transfer = t;
+
+    if (t->type == PUT)
+    {
+        cmd("u");
+
+        if (client->usehttps)
+        {
+            arg("ssl", 2);
+        }
+
+        arg("v", 2);
+        arg("s", t->size);
+        arg("ms", ms);
+
+        CommandPutFile::targetroots(this, client, t);
+        return;
+    }
+
+    // the file the download is requested for (see MegaClient::dispatch())
+    File* f = NULL;
+    for (file_list::iterator it = t->files.begin(); it != t->files.end(); it++)
+    {
+        if (!(*it)->hprivate || (*it)->hforeign || client->nodebyhandle((*it)->h))
+        {
+            f = *it;
+            break;
+        }
+    }
+
+    cmd("g");
+
+    if (f)
+    {
+        arg(f->hprivate ? "n" : "p", (byte*)&f->h, MegaClient::NODEHANDLE);
+    }
+
+    arg("g", 1);
+    arg("v", 2);
+
+    if (client->usehttps)
+    {
+        arg("ssl", 2);
+    }
+
+    if (f && f->privauth.size())
+    {
+        arg("esid", f->privauth.c_str());
+    }
+
+    if (f && f->pubauth.size())
+    {
+        arg("en", f->pubauth.c_str());
+    }
+
+    if (f && f->chatauth)
+    {
+        arg("cauth", f->chatauth);
+    }
+}
+
+void CommandPrefetchTransferUrls::cancel()
+{
+    Command::cancel();
+    transfer = NULL;
+}
+
+// keep the URLs for the dispatch of the transfer: errors are left to the
+// request sent then, if the transfer doesn't get URLs meanwhile
+void CommandPrefetchTransferUrls::procresult()
+{
+    if (transfer)
+    {
+        transfer->urlprefetch = NULL;
+    }
+
+    if (client->json.isnumeric())
+    {
+        client->json.getint();
+        return;
+    }
+
+    std::vector<string> tempurls;
+    bool ok = false;
+    bool unusable = false;
+
+    for (;;)
+    {
+        switch (client->json.getnameid())
+        {
+            case 'p':
+                if (transfer && transfer->type == PUT)
+                {
+                    tempurls.push_back("");
+                    client->json.storeobject(&tempurls.back());
+                    ok = true;
+                }
+                else
+                {
+                    client->json.storeobject();
+                }
+                break;
+
+            case 'g':
+                if (client->json.enterarray())
+                {
+                    for (;;)
+                    {
+                        string tu;
+                        if (!client->json.storeobject(&tu))
+                        {
+                            break;
+                        }
+                        tempurls.push_back(tu);
+                    }
+                    client->json.leavearray();
+                }
+                else
+                {
+                    string tu;
+                    if (client->json.storeobject(&tu))
+                    {
+                        tempurls.push_back(tu);
+                    }
+                }
+                ok = true;
+                break;
+
+            case 's':
+                // the size of a download, which the dispatch doesn't check again
+                if (transfer && client->json.getint() != transfer->size)
+                {
+                    unusable = true;
+                }
+                break;
+
+            case 'd':
+            case 'e':
+                unusable = true;
+                client->json.storeobject();
+                break;
+
+            case EOO:
+                if (canceled || !transfer || !ok || unusable || transfer->slot || transfer->tempurls.size())
+                {
+                    return;
+                }
+
+                // one URL for uploads, one or six for downloads
+                if (tempurls.size() == 1 || (transfer->type == GET && tempurls.size() == RAIDPARTS))
+                {
+                    LOG_debug << "Transfer URLs prefetched";
+                    transfer->tempurls.swap(tempurls);
+                    transfer->urlprefetchds = Waiter::ds;
+                }
+                return;
+
+            default:
+                if (!client->json.storeobject())
+                {
+                    return;
+                }
+        }
+    }
+}
+
 CommandPutFileBackgroundURL::CommandPutFileBackgroundURL(m_off_t size, int putmbpscap, int ctag)
 {
     cmd("u");
@@ -480,6 +657,8 @@ CommandDirectRead::CommandDirectRead(MegaClient *client, DirectReadNode* cdrn)
     arg(drn->p ? "n" : "p", (byte*)&drn->h, MegaClient::NODEHANDLE);
     arg("g", 1);
     arg("v", 2);  // version 2: server can supply details for cloudraid files
+
+    orderIndependent = true;
 	
     if (drn->privateauth.size())
     {
@@ -866,8 +1045,10 @@ void CommandGetFile::procresult()
 
                                         tslot->starttime = tslot->lastdata = client->waiter->ds;
 
-                                        if ((tempurls.size() == 1 || tempurls.size() == RAIDPARTS) && s >= 0)
+                                        // one URL, six for a raid file, or several sources of a non-raid file
+                                        if (tempurls.size() && s >= 0)
                                         {
+                                            client->notestoragehosts(GET, tempurls);
                                             tslot->transfer->tempurls = tempurls;
                                             tslot->transferbuf.setIsRaid(tslot->transfer, tempurls, tslot->transfer->pos, tslot->maxRequestSize);
                                             return tslot->progress();
@@ -1012,6 +1193,15 @@ CommandPutNodes::CommandPutNodes(MegaClient* client, handle th,
     type = userhandle ? USER_HANDLE : NODE_HANDLE;
     source = csource;
 
+    // per node: handles and type (~80 bytes), Base64 of the key and attributes
+    size_t estimate = 64;
+    for (i = 0; i < numnodes; i++)
+    {
+        estimate += 80 + (newnodes[i].attrstring ? newnodes[i].attrstring->size() * 4 / 3 : 0)
+                       + newnodes[i].nodekey.size() * 4 / 3;
+    }
+    reserve(estimate);
+
     cmd("p");
     notself(client);
 
@@ -1142,31 +1332,36 @@ void CommandPutNodes::procresult()
 {
     error e;
 
-    pendingdbid_map::iterator it = client->pendingtcids.find(tag);
-    if (it != client->pendingtcids.end())
+    // the transfers whose uploads this command puts (just one unless batched)
+    vector<int> tags = batchtags.size() ? batchtags : vector<int>(1, tag);
+    for (size_t t = 0; t < tags.size(); t++)
     {
-        if (client->tctable)
+        pendingdbid_map::iterator it = client->pendingtcids.find(tags[t]);
+        if (it != client->pendingtcids.end())
         {
-            vector<uint32_t> &ids = it->second;
-            for (unsigned int i = 0; i < ids.size(); i++)
+            if (client->tctable)
             {
-                if (ids[i])
+                vector<uint32_t> &ids = it->second;
+                for (unsigned int i = 0; i < ids.size(); i++)
                 {
-                    client->tctable->del(ids[i]);
+                    if (ids[i])
+                    {
+                        client->tctable->del(ids[i]);
+                    }
                 }
             }
+            client->pendingtcids.erase(it);
         }
-        client->pendingtcids.erase(it);
-    }
-    pendingfiles_map::iterator pit = client->pendingfiles.find(tag);
-    if (pit != client->pendingfiles.end())
-    {
-        vector<string> &pfs = pit->second;
-        for (unsigned int i = 0; i < pfs.size(); i++)
+        pendingfiles_map::iterator pit = client->pendingfiles.find(tags[t]);
+        if (pit != client->pendingfiles.end())
         {
-            client->fsaccess->unlinklocal(&pfs[i]);
+            vector<string> &pfs = pit->second;
+            for (unsigned int i = 0; i < pfs.size(); i++)
+            {
+                client->fsaccess->unlinklocal(&pfs[i]);
+            }
+            client->pendingfiles.erase(pit);
         }
-        client->pendingfiles.erase(pit);
     }
 
     if (client->json.isnumeric())
@@ -1203,6 +1398,11 @@ void CommandPutNodes::procresult()
         else
         {
 #endif
+            if (batchtags.size())
+            {
+                return batchresult(e);
+            }
+
             if (source == PUTNODES_APP)
             {
                 return client->app->putnodes_result(e, type, nn);
@@ -1288,6 +1488,11 @@ void CommandPutNodes::procresult()
             }
         }
 #endif
+        if (batchtags.size())
+        {
+            return batchresult(e);
+        }
+
         client->app->putnodes_result((!e && empty) ? API_ENOENT : e, type, nn);
     }
 #ifdef ENABLE_SYNC
@@ -1298,6 +1503,22 @@ void CommandPutNodes::procresult()
 #endif
 }
 
+// report the result of each upload of a batch to its own transfer
+void CommandPutNodes::batchresult(error e)
+{
+    int creqtag = client->restag;
+
+    for (int i = 0; i < nnsize; i++)
+    {
+        client->restag = batchtags[i];
+        client->app->putnodes_upload_result(nn[i].added ? API_OK : (e ? e : API_ENOENT),
+                                            nn[i].added ? nn[i].addedhandle : UNDEF);
+    }
+
+    client->restag = creqtag;
+    delete [] nn;
+}
+
 CommandMoveNode::CommandMoveNode(MegaClient* client, Node* n, Node* t, syncdel_t csyncdel, handle prevparent)
 {
     h = n->nodehandle;
@@ -1949,6 +2170,9 @@ CommandShareKeyUpdate::CommandShareKeyUpdate(MegaClient* client, handle_vector*
     Node* n;
     byte sharekey[SymmCipher::KEYLENGTH];
 
+    // share handle, user handle and key per share
+    reserve(v->size() * 48);
+
     cmd("k");
     beginarray("sr");
 
@@ -2916,6 +3140,26 @@ CommandGetUA::CommandGetUA(MegaClient* /*client*/, const char* uid, attr_t at, c
     arg("ua", User::attr2string(at).c_str());
     arg("v", 1);
     tag = ctag;
+
+    orderIndependent = true;
+}
+
+CommandGetUAsItem::CommandGetUAsItem(MegaClient* client, const char* uid, attr_t at, const std::shared_ptr<size_t>& pending, int ctag)
+    : CommandGetUA(client, uid, at, NULL, 0)
+    , pending(pending)
+    , batchtag(ctag)
+{
+}
+
+void CommandGetUAsItem::procresult()
+{
+    CommandGetUA::procresult();
+
+    if (!--*pending)
+    {
+        client->restag = batchtag;
+        client->app->getuas_result(API_OK);
+    }
 }
 
 void CommandGetUA::procresult()
@@ -3365,6 +3609,9 @@ CommandNodeKeyUpdate::CommandNodeKeyUpdate(MegaClient* client, handle_vector* v)
 {
     byte nodekey[FILENODEKEYLENGTH];
 
+    // node handle and key per node
+    reserve(v->size() * 60);
+
     cmd("k");
     beginarray("nk");
 
@@ -3374,7 +3621,9 @@ CommandNodeKeyUpdate::CommandNodeKeyUpdate(MegaClient* client, handle_vector* v)
 
         Node* n;
 
-        if ((n = client->nodebyhandle(h)))
+        // only keys already decrypted (they might have changed since they were queued)
+        if ((n = client->nodebyhandle(h))
+                && n->nodekey.size() == unsigned((n->type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH))
         {
             client->key.ecb_encrypt((byte*)n->nodekey.data(), nodekey, n->nodekey.size());
 
@@ -4169,6 +4418,11 @@ void CommandGetUserQuota::procresult()
                     }
                 }
 
+                if (mTransfer)
+                {
+                    client->settransferquota(details->transfer_max, details->transfer_own_used + details->transfer_srv_used);
+                }
+
                 client->app->account_details(details, mStorage, mTransfer, mPro, false, false, false);
                 return;
 
@@ -4379,6 +4633,8 @@ CommandGetPH::CommandGetPH(MegaClient* client, handle cph, const byte* ckey, int
     }
     tag = client->reqtag;
     op = cop;
+
+    orderIndependent = true;
 }
 
 void CommandGetPH::procresult()
@@ -4804,27 +5060,141 @@ void CommandSetKeyPair::procresult()
 }
 
 // fetch full node tree
-CommandFetchNodes::CommandFetchNodes(MegaClient* client, bool nocache)
+CommandFetchNodes::CommandFetchNodes(MegaClient* client, bool nocache, bool recursive)
 {
     cmd("f");
     arg("c", 1);
-    arg("r", 1);
+    arg("r", recursive ? 1 : 0);
 
     if (!nocache)
     {
         arg("ca", 1);
     }
 
+    // a response of its own, so that the node array can be streamed
+    batchSeparately = true;
+    streamstate = STREAM_START;
+    streampos = 0;
+
     tag = client->reqtag;
 }
 
+void CommandFetchNodes::resetstream()
+{
+    streamstate = STREAM_START;
+    streampos = 0;
+    streamdp.clear();
+}
+
+void CommandFetchNodes::procpartial(HttpReq* req, bool complete)
+{
+    static const char prefix[] = "[{\"f\":[";
+    const size_t prefixlen = sizeof prefix - 1;
+
+    if (streamstate == STREAM_OFF)
+    {
+        return;
+    }
+
+    const char* data = req->data();
+    const char* end = data + req->size();
+    const char* ptr = data + streampos;
+
+    if (streamstate == STREAM_START)
+    {
+        // only the usual layout, with the nodes first, is streamed
+        size_t len = std::min(prefixlen, size_t(end - ptr));
+        if (memcmp(ptr, prefix, len) || (len < prefixlen && complete))
+        {
+            streamstate = STREAM_OFF;
+            return;
+        }
+
+        if (len < prefixlen)
+        {
+            return;
+        }
+
+        client->purgenodesusersabortsc();
+        streamstate = STREAM_NODES;
+        ptr += prefixlen;
+    }
+
+    if (streamstate == STREAM_NODES)
+    {
+        WAIT_CLASS::bumpds();
+        dstime start = Waiter::ds;
+
+        for (;;)
+        {
+            const char* node = (ptr < end && *ptr == ',') ? ptr + 1 : ptr;
+            if (node == end)
+            {
+                break;
+            }
+
+            if (*node == ']')
+            {
+                ptr = node;
+                client->linkdelayedparents(streamdp);
+                streamdp.clear();
+                streamstate = STREAM_DONE;
+                break;
+            }
+
+            const char* nodeend = JSON::objectend(node, end);
+            if (!nodeend)
+            {
+                break;
+            }
+
+            JSON json;
+            json.begin(node);
+            if (!json.enterobject() || !client->readnode(&json, 0, PUTNODES_APP, NULL, 0, 0, streamdp))
+            {
+                // leave the node in place, procresult() will fail on it
+                ptr = node;
+                streamstate = STREAM_DONE;
+                break;
+            }
+
+            ptr = nodeend;
+        }
+
+        WAIT_CLASS::bumpds();
+        client->fnstats.timeReadNodes += Waiter::ds - start;
+    }
+
+    streampos = size_t(ptr - data);
+
+    if (complete)
+    {
+        // what's left starts right after the streamed nodes
+        string response(prefix, prefixlen);
+        response.append(ptr, size_t(end - ptr));
+        req->in.swap(response);
+        req->inpurge = 0;
+        streampos = 0;
+    }
+    else if (streampos > 65536 && req->httpio && req->httpio->purgesinflight())
+    {
+        // release the parsed part of the response
+        req->purge(streampos);
+        streampos = 0;
+    }
+}
+
 // purge and rebuild node/user tree
 void CommandFetchNodes::procresult()
 {
     WAIT_CLASS::bumpds();
     client->fnstats.timeToLastByte = Waiter::ds - client->fnstats.startTime;
 
-    client->purgenodesusersabortsc();
+    // streamed nodes have been loaded already, after purging the old ones
+    if (client->json.isnumeric() || (streamstate != STREAM_NODES && streamstate != STREAM_DONE))
+    {
+        client->purgenodesusersabortsc();
+    }
 
     if (client->json.isnumeric())
     {
@@ -4838,19 +5208,31 @@ void CommandFetchNodes::procresult()
         {
             case 'f':
                 // nodes
-                if (!client->readnodes(&client->json, 0))
                 {
-                    client->fetchingnodes = false;
-                    return client->app->fetchnodes_result(API_EINTERNAL);
+                    WAIT_CLASS::bumpds();
+                    dstime start = Waiter::ds;
+                    if (!client->readnodes(&client->json, 0))
+                    {
+                        client->fetchingnodes = false;
+                        return client->app->fetchnodes_result(API_EINTERNAL);
+                    }
+                    WAIT_CLASS::bumpds();
+                    client->fnstats.timeReadNodes += Waiter::ds - start;
                 }
                 break;
 
             case MAKENAMEID2('f', '2'):
                 // old versions
-                if (!client->readnodes(&client->json, 0))
                 {
-                    client->fetchingnodes = false;
-                    return client->app->fetchnodes_result(API_EINTERNAL);
+                    WAIT_CLASS::bumpds();
+                    dstime start = Waiter::ds;
+                    if (!client->readnodes(&client->json, 0))
+                    {
+                        client->fetchingnodes = false;
+                        return client->app->fetchnodes_result(API_EINTERNAL);
+                    }
+                    WAIT_CLASS::bumpds();
+                    client->fnstats.timeReadNodes += Waiter::ds - start;
                 }
                 break;
 
@@ -4930,7 +5312,13 @@ void CommandFetchNodes::procresult()
                 }
 
                 client->mergenewshares(0);
-                client->applykeys();
+                {
+                    WAIT_CLASS::bumpds();
+                    dstime start = Waiter::ds;
+                    client->applykeys();
+                    WAIT_CLASS::bumpds();
+                    client->fnstats.timeApplyKeys = Waiter::ds - start;
+                }
                 client->initsc();
                 client->pendingsccommit = false;
                 client->fetchnodestag = tag;
@@ -4950,6 +5338,50 @@ void CommandFetchNodes::procresult()
     }
 }
 
+CommandFetchFolder::CommandFetchFolder(MegaClient* client, handle folder)
+{
+    cmd("f");
+    arg("c", 1);
+    arg("r", (m_off_t)0);
+    arg("n", (byte*)&folder, MegaClient::NODEHANDLE);
+
+    h = folder;
+    tag = client->reqtag;
+}
+
+void CommandFetchFolder::procresult()
+{
+    if (client->json.isnumeric())
+    {
+        return client->app->fetchfolder_result(h, (error)client->json.getint());
+    }
+
+    for (;;)
+    {
+        switch (client->json.getnameid())
+        {
+            case 'f':
+                if (!client->readnodes(&client->json, 1))
+                {
+                    return client->app->fetchfolder_result(h, API_EINTERNAL);
+                }
+                break;
+
+            case EOO:
+                client->applykeys();
+                client->fetchedfolders.insert(h);
+                client->notifypurge();
+                return client->app->fetchfolder_result(h, API_OK);
+
+            default:
+                if (!client->json.storeobject())
+                {
+                    return client->app->fetchfolder_result(h, API_EINTERNAL);
+                }
+        }
+    }
+}
+
 // report event to server logging facility
 CommandReportEvent::CommandReportEvent(MegaClient *client, const char *event, const char *details)
 {
@@ -21,6 +21,22 @@
 
 #include "mega.h"
 
+#ifndef MEGA_CRC32_NO_SIMD
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MEGA_CRC32_PCLMUL 1
+#define MEGA_CRC32_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define MEGA_CRC32_PCLMUL 1
+#define MEGA_CRC32_PCLMUL_TARGET
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define MEGA_CRC32_ARMV8 1
+#endif
+#endif
+
 namespace mega {
 #ifndef htobe64
 #define htobe64(x) (((uint64_t)htonl((uint32_t)((x) >> 32))) | (((uint64_t)htonl((uint32_t)x)) << 32))
@@ -66,6 +82,8 @@ void SymmCipher::setkey(const byte* newkey, int type)
     aescbc_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
     aescbc_d.SetKeyWithIV(key, KEYLENGTH, zeroiv);
 
+    aesctr_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
+
     aesccm8_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
     aesccm8_d.SetKeyWithIV(key, KEYLENGTH, zeroiv);
 
@@ -270,7 +288,7 @@ void SymmCipher::ctr_crypt(byte* data, unsigned len, m_off_t pos, ctr_iv ctriv,
 {
     assert(!(pos & (KEYLENGTH - 1)));
 
-    byte ctr[BLOCKSIZE], tmp[BLOCKSIZE];
+    byte ctr[BLOCKSIZE];
 
     MemAccess::set<int64_t>(ctr,ctriv);
     setint64(pos / BLOCKSIZE, ctr + sizeof ctriv);
@@ -281,43 +299,52 @@ void SymmCipher::ctr_crypt(byte* data, unsigned len, m_off_t pos, ctr_iv ctriv,
         memcpy(mac + sizeof ctriv, ctr, sizeof ctriv);
     }
 
-    while ((int)len > 0)
+    if ((int)len <= 0)
     {
-        if (encrypt)
-        {
-            if(mac)
-            {
-                xorblock(data, mac);
-                ecb_encrypt(mac);
-            }
+        return;
+    }
 
-            ecb_encrypt(ctr, tmp);
-            xorblock(tmp, data);
-        }
-        else
-        {
-            ecb_encrypt(ctr, tmp);
-            xorblock(tmp, data);
+    // whole blocks are processed, the padding included
+    size_t padded = (len + BLOCKSIZE - 1) & ~size_t(BLOCKSIZE - 1);
 
-            if (mac)
-            {
-                if (len >= (unsigned)BLOCKSIZE)
-                {
-                    xorblock(data, mac);
-                }
-                else
-                {
-                    xorblock(data, mac, len);
-                }
-
-                ecb_encrypt(mac);
-            }
-        }
+    // the MAC is a CBC-MAC of the plaintext - before encryption, after decryption
+    if (mac && encrypt)
+    {
+        cbc_mac(data, padded, mac);
+    }
 
-        len -= BLOCKSIZE;
-        data += BLOCKSIZE;
+    // the keystream of all the blocks in a single call, so that the AES
+    // implementation can pipeline them (AES-NI / ARMv8 when available)
+    aesctr_e.Resynchronize(ctr);
+    aesctr_e.ProcessData(data, data, padded);
 
-        incblock(ctr);
+    if (mac && !encrypt)
+    {
+        // a partial last block enters the MAC NUL-padded
+        memset(data + len, 0, padded - len);
+        cbc_mac(data, padded, mac);
+    }
+}
+
+void SymmCipher::cbc_mac(const byte* data, size_t len, byte* mac)
+{
+    byte out[64 * BLOCKSIZE];
+
+    aescbc_e.Resynchronize(mac);
+
+    while (len)
+    {
+        size_t n = std::min(len, sizeof out);
+
+        aescbc_e.ProcessData(out, data, n);
+
+        data += n;
+        len -= n;
+
+        if (!len)
+        {
+            memcpy(mac, out + n - BLOCKSIZE, BLOCKSIZE);
+        }
     }
 }
 
@@ -383,13 +410,13 @@ int AsymmCipher::encrypt(PrnGen &rng, const byte* plain, size_t plainlen, byte*
     return int(ptr - buf);
 }
 
-static void rsadecrypt(Integer* key, Integer* m)
+static void rsadecrypt(const Integer* key, const Integer& dp, const Integer& dq, Integer* m)
 {
     Integer xp = a_exp_b_mod_c(*m % key[AsymmCipher::PRIV_P],
-                               key[AsymmCipher::PRIV_D] % (key[AsymmCipher::PRIV_P] - Integer::One()),
+                               dp.IsZero() ? key[AsymmCipher::PRIV_D] % (key[AsymmCipher::PRIV_P] - Integer::One()) : dp,
                                key[AsymmCipher::PRIV_P]);
     Integer xq = a_exp_b_mod_c(*m % key[AsymmCipher::PRIV_Q],
-                               key[AsymmCipher::PRIV_D] % (key[AsymmCipher::PRIV_Q] - Integer::One()),
+                               dq.IsZero() ? key[AsymmCipher::PRIV_D] % (key[AsymmCipher::PRIV_Q] - Integer::One()) : dq,
                                key[AsymmCipher::PRIV_Q]);
 
     if (xp > xq)
@@ -408,7 +435,7 @@ unsigned AsymmCipher::rawdecrypt(const byte* cipher, size_t cipherlen, byte* buf
 {
     Integer m(cipher, cipherlen);
 
-    rsadecrypt(key, &m);
+    rsadecrypt(key, crtdp, crtdq, &m);
 
     unsigned i = m.ByteCount();
 
@@ -434,7 +461,7 @@ int AsymmCipher::decrypt(const byte* cipher, size_t cipherlen, byte* out, size_t
         return 0;
     }
 
-    rsadecrypt(key, &m);
+    rsadecrypt(key, crtdp, crtdq, &m);
 
     size_t l = key[AsymmCipher::PRIV_P].ByteCount() + key[AsymmCipher::PRIV_Q].ByteCount() - 2;
 
@@ -457,6 +484,7 @@ int AsymmCipher::setkey(int numints, const byte* data, int len)
 {
     int ret = decodeintarray(key, numints, data, len);
     padding = (numints == PUBKEY && ret) ? (len - key[PUB_PQ].ByteCount() - key[PUB_E].ByteCount() - 4) : 0;
+    precomputecrt();
     return ret;
 }
 
@@ -467,6 +495,21 @@ void AsymmCipher::resetkey()
         key[i] = Integer::Zero();
         padding = 0;
     }
+    precomputecrt();
+}
+
+void AsymmCipher::precomputecrt()
+{
+    if (isvalid(PRIVKEY))
+    {
+        crtdp = key[PRIV_D] % (key[PRIV_P] - Integer::One());
+        crtdq = key[PRIV_D] % (key[PRIV_Q] - Integer::One());
+    }
+    else
+    {
+        crtdp = Integer::Zero();
+        crtdq = Integer::Zero();
+    }
 }
 
 void AsymmCipher::serializekeyforjs(string& d)
@@ -617,6 +660,11 @@ void AsymmCipher::genkeypair(PrnGen &rng, Integer* privk, Integer* pubk, int siz
     privk[PRIV_D] = pubk[PUB_E].InverseMod(LCM(privk[PRIV_P] - Integer::One(), privk[PRIV_Q] - Integer::One()));
     pubk[PUB_PQ] = privk[PRIV_P] * privk[PRIV_Q];
     privk[PRIV_U] = privk[PRIV_P].InverseMod(privk[PRIV_Q]);
+
+    if (privk == key)
+    {
+        precomputecrt();
+    }
 }
 
 void Hash::add(const byte* data, unsigned len)
@@ -641,14 +689,229 @@ void HashSHA256::get(std::string *retStr)
     hash.Final((byte*)retStr->data());
 }
 
+// CRC-32 (IEEE 802.3, reflected) as computed by CryptoPP::CRC32: slicing-by-8
+// tables, and carry-less multiplication folding where the CPU has it
+static const uint32_t* crc32tables()
+{
+    static uint32_t* tables = []()
+    {
+        static uint32_t t[8][256];
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+            }
+            t[0][i] = c;
+        }
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+            {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+
+        return &t[0][0];
+    }();
+
+    return tables;
+}
+
+uint32_t HashCRC32::updatescalar(uint32_t crc, const byte* data, size_t len)
+{
+    const uint32_t* t = crc32tables();
+
+    while (len >= 8)
+    {
+        uint32_t lo = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+        uint32_t hi = uint32_t(data[4]) | uint32_t(data[5]) << 8 | uint32_t(data[6]) << 16 | uint32_t(data[7]) << 24;
+
+        crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + ((lo >> 8) & 0xFF)]
+            ^ t[5 * 256 + ((lo >> 16) & 0xFF)] ^ t[4 * 256 + (lo >> 24)]
+            ^ t[3 * 256 + (hi & 0xFF)] ^ t[2 * 256 + ((hi >> 8) & 0xFF)]
+            ^ t[1 * 256 + ((hi >> 16) & 0xFF)] ^ t[0 * 256 + (hi >> 24)];
+
+        data += 8;
+        len -= 8;
+    }
+
+    while (len--)
+    {
+        crc = t[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(MEGA_CRC32_PCLMUL)
+// folds 64-byte blocks with the constants of Intel's "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ Instruction" (bit-reflected domain), then
+// a Barrett reduction to 32 bits. len must be a multiple of 16, at least 64
+MEGA_CRC32_PCLMUL_TARGET
+static uint32_t crc32pclmul(uint32_t crc, const byte* buf, size_t len)
+{
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+
+    buf += 64;
+    len -= 64;
+
+    // four 128-bit lanes in parallel
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    // fold the lanes into one
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 16-byte blocks
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    // 128 to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return uint32_t(_mm_extract_epi32(x1, 1));
+}
+
+static bool haspclmul()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) && (info[2] & (1 << 19));
+#else
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+#endif
+
+uint32_t HashCRC32::update(uint32_t crc, const byte* data, size_t len)
+{
+#if defined(MEGA_CRC32_PCLMUL)
+    static const bool pclmul = haspclmul();
+
+    if (pclmul && len >= 64)
+    {
+        size_t blocks = len & ~size_t(15);
+        crc = crc32pclmul(crc, data, blocks);
+        data += blocks;
+        len -= blocks;
+    }
+#elif defined(MEGA_CRC32_ARMV8)
+    while (len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, data, sizeof v);
+        crc = __crc32d(crc, v);
+        data += 8;
+        len -= 8;
+    }
+
+    while (len--)
+    {
+        crc = __crc32b(crc, *data++);
+    }
+#endif
+
+    return updatescalar(crc, data, len);
+}
+
 void HashCRC32::add(const byte* data, unsigned len)
 {
-    hash.Update(data, len);
+    crc = update(crc, data, len);
 }
 
+// little-endian, as CryptoPP::CRC32 outputs it, and restart
 void HashCRC32::get(byte* out)
 {
-    hash.Final(out);
+    uint32_t value = crc ^ 0xFFFFFFFF;
+
+    out[0] = byte(value);
+    out[1] = byte(value >> 8);
+    out[2] = byte(value >> 16);
+    out[3] = byte(value >> 24);
+
+    crc = 0xFFFFFFFF;
 }
 
 HMACSHA256::HMACSHA256(const byte *key, size_t length)
@@ -23,61 +23,698 @@
 #include "mega/utils.h"
 #include "mega/logging.h"
 
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
 namespace mega {
+
+// the padding of a record starts with a terminator (see PaddedCBC), the
+// records that were compressed have their own one
+static const char PLAINRECORD = 'E';
+static const char COMPRESSEDRECORD = 'Z';
+
+struct DbTable::Compressor
+{
+#ifdef USE_ZLIB
+    // raw deflate with a small window: records are short, and the streams are
+    // reset for each one
+    static const int WINDOWBITS = 12;
+    static const int MEMLEVEL = 5;
+
+    z_stream deflater;
+    z_stream inflater;
+    bool deflating = false;
+    bool inflating = false;
+
+    ~Compressor()
+    {
+        if (deflating)
+        {
+            deflateEnd(&deflater);
+        }
+        if (inflating)
+        {
+            inflateEnd(&inflater);
+        }
+    }
+#endif
+
+    std::map<uint32_t, string> dictionaries;
+};
+
 DbTable::DbTable(PrnGen &rng, bool checkAlwaysTransacted)
     : rng(rng), mCheckAlwaysTransacted(checkAlwaysTransacted)
 {
     nextid = 0;
 }
 
+DbTable::~DbTable()
+{
+}
+
+DbTable::Compressor* DbTable::getcompressor()
+{
+    if (!compressor)
+    {
+        compressor.reset(new Compressor);
+    }
+    return compressor.get();
+}
+
+void DbTable::setdictionary(uint32_t type, const string& dictionary)
+{
+    getcompressor()->dictionaries[type & TYPEMASK] = dictionary;
+}
+
+bool DbTable::compress(uint32_t type, string* data)
+{
+#ifdef USE_ZLIB
+    if (data->size() < MINCOMPRESSSIZE)
+    {
+        return false;
+    }
+
+    Compressor* c = getcompressor();
+    z_stream* zs = &c->deflater;
+
+    if (!c->deflating)
+    {
+        memset(zs, 0, sizeof *zs);
+        if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -Compressor::WINDOWBITS,
+                         Compressor::MEMLEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return false;
+        }
+        c->deflating = true;
+    }
+    else
+    {
+        deflateReset(zs);
+    }
+
+    std::map<uint32_t, string>::iterator it = c->dictionaries.find(type & TYPEMASK);
+    if (it != c->dictionaries.end())
+    {
+        deflateSetDictionary(zs, (const Bytef*)it->second.data(), uInt(it->second.size()));
+    }
+
+    string out(deflateBound(zs, uLong(data->size())), '\0');
+    zs->next_in = (Bytef*)data->data();
+    zs->avail_in = uInt(data->size());
+    zs->next_out = (Bytef*)out.data();
+    zs->avail_out = uInt(out.size());
+
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out >= data->size())
+    {
+        return false;
+    }
+
+    out.resize(zs->total_out);
+    data->swap(out);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool DbTable::decompress(uint32_t type, string* data)
+{
+#ifdef USE_ZLIB
+    Compressor* c = getcompressor();
+    z_stream* zs = &c->inflater;
+
+    if (!c->inflating)
+    {
+        memset(zs, 0, sizeof *zs);
+        if (inflateInit2(zs, -Compressor::WINDOWBITS) != Z_OK)
+        {
+            return false;
+        }
+        c->inflating = true;
+    }
+    else
+    {
+        inflateReset(zs);
+    }
+
+    std::map<uint32_t, string>::iterator it = c->dictionaries.find(type & TYPEMASK);
+    if (it != c->dictionaries.end())
+    {
+        inflateSetDictionary(zs, (const Bytef*)it->second.data(), uInt(it->second.size()));
+    }
+
+    string out(data->size() * 4, '\0');
+    zs->next_in = (Bytef*)data->data();
+    zs->avail_in = uInt(data->size());
+    zs->next_out = (Bytef*)out.data();
+    zs->avail_out = uInt(out.size());
+
+    for (;;)
+    {
+        int e = inflate(zs, Z_FINISH);
+
+        if (e == Z_STREAM_END)
+        {
+            break;
+        }
+
+        if ((e != Z_BUF_ERROR && e != Z_OK) || zs->avail_out)
+        {
+            LOG_err << "Unable to decompress a cached record of type " << (type & TYPEMASK);
+            return false;
+        }
+
+        // the output buffer is full
+        size_t used = out.size();
+        out.resize(used * 2);
+        zs->next_out = (Bytef*)out.data() + used;
+        zs->avail_out = uInt(out.size() - used);
+    }
+
+    out.resize(zs->total_out);
+    data->swap(out);
+    return true;
+#else
+    LOG_err << "Compressed cached record without zlib support";
+    return false;
+#endif
+}
+
+bool DbTable::decode(uint32_t id, string* data, SymmCipher* key)
+{
+    if (data->size() & (SymmCipher::BLOCKSIZE - 1))
+    {
+        return false;
+    }
+
+    key->cbc_decrypt((byte*)data->data(), data->size());
+
+    size_t p = data->find_last_not_of('P');
+    if (p == string::npos)
+    {
+        return false;
+    }
+
+    char terminator = (*data)[p];
+    data->resize(p);
+
+    return terminator == PLAINRECORD
+        || (terminator == COMPRESSEDRECORD && decompress(id, data));
+}
+
 // add or update record from string
 bool DbTable::put(uint32_t index, string* data)
 {
     return put(index, (char*)data->data(), unsigned(data->size()));
 }
 
+bool DbTable::encode(uint32_t type, Cachable* record, SymmCipher* key, DbRecord* r)
+{
+    if (!record->serialize(&r->data))
+    {
+        LOG_warn << "Serialization failed: " << type;
+        return false;
+    }
+
+    if (compressrecords && compress(type, &r->data))
+    {
+        // same padding as PaddedCBC, with its own terminator
+        r->data.push_back(COMPRESSEDRECORD);
+        r->data.resize((r->data.size() + SymmCipher::BLOCKSIZE - 1) & - SymmCipher::BLOCKSIZE, 'P');
+        key->cbc_encrypt((byte*)r->data.data(), r->data.size());
+    }
+    else
+    {
+        PaddedCBC::encrypt(rng, &r->data, key);
+    }
+
+    if (!record->dbid)
+    {
+        record->dbid = newid(type);
+    }
+
+    r->id = record->dbid;
+
+    handle parent;
+    if ((r->hasparent = record->dbparent(&parent)))
+    {
+        r->parent = parentkey(parent, key);
+    }
+
+    return true;
+}
+
 // add or update record with padding and encryption
 bool DbTable::put(uint32_t type, Cachable* record, SymmCipher* key)
 {
-    string data;
+    DbRecord r;
 
-    if (!record->serialize(&data))
+    if (!encode(type, record, key, &r))
     {
         //Don't return false if there are errors in the serialization
         //to let the SDK continue and save the rest of records
-        LOG_warn << "Serialization failed: " << type;
         return true;
     }
 
-    PaddedCBC::encrypt(rng, &data, key);
+    return putrecord(r);
+}
 
-    if (!record->dbid)
+bool DbTable::putrecord(const DbRecord& r)
+{
+    return put(r.id, (char*)r.data.data(), unsigned(r.data.size()));
+}
+
+bool DbTable::putmany(const dbrecord_vector& records)
+{
+    for (dbrecord_vector::const_iterator it = records.begin(); it != records.end(); it++)
+    {
+        if (!putrecord(*it))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool DbTable::delmany(const vector<uint32_t>& ids)
+{
+    for (vector<uint32_t>::const_iterator it = ids.begin(); it != ids.end(); it++)
+    {
+        if (!del(*it))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DbTable::addbatch(dbrecord_vector* records, uint32_t type, Cachable* record, SymmCipher* key)
+{
+    DbRecord r;
+
+    // same as put(): skip records that can't be serialized, keep the rest
+    if (encode(type, record, key, &r))
     {
-        record->dbid = (nextid += IDSPACING) | type;
+        records->push_back(std::move(r));
     }
+}
 
-    return put(record->dbid, &data);
+int64_t DbTable::parentkey(handle h, SymmCipher* key)
+{
+    byte block[SymmCipher::BLOCKSIZE] = { 0 };
+    memcpy(block, &h, sizeof h);
+    key->ecb_encrypt(block);
+
+    int64_t k;
+    memcpy(&k, block, sizeof k);
+    return k;
 }
 
 // get next record, decrypt and unpad
 bool DbTable::next(uint32_t* type, string* data, SymmCipher* key)
 {
-    if (next(type, data))
+    return next(type, data) && decryptnext(*type, data, key);
+}
+
+bool DbTable::decryptnext(uint32_t type, string* data, SymmCipher* key)
+{
+    if (!type)
+    {
+        return true;
+    }
+
+    if (type > nextid)
+    {
+        nextid = type & - IDSPACING;
+    }
+
+    return decode(type, data, key);
+}
+
+// get specific record, decrypt and unpad
+bool DbTable::get(uint32_t index, string* data, SymmCipher* key)
+{
+    return get(index, data) && decode(index, data, key);
+}
+
+AsyncDbTable::AsyncDbTable(PrnGen &rng, DbTable* table, Waiter* waiter)
+    : DbTable(rng, false)
+    , mTable(table)
+    , mWaiter(waiter)
+{
+    nextid = table->nextid;
+    compressrecords = table->compressrecords;
+    mThread = std::thread([this]() { loop(); });
+}
+
+AsyncDbTable::~AsyncDbTable()
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mExit = true;
+    }
+    mQueueChanged.notify_all();
+    mThread.join();
+}
+
+void AsyncDbTable::loop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (;;)
     {
-        if (!*type)
+        mQueueChanged.wait(lock, [this]() { return mExit || !mQueue.empty(); });
+
+        if (mQueue.empty())
         {
-            return true;
+            // exit only once everything queued has been written
+            return;
+        }
+
+        // deque references stay valid while the SDK thread appends
+        const Op& op = mQueue.front();
+        bool failed = mFailed;
+        lock.unlock();
+
+        // after a failure, only a rollback is still meaningful
+        bool ok = (failed && op.type != Op::ABORT) || execute(op);
+
+        // sample the cache counters here, while the queue still holds the op and
+        // readers wait for it, so that cachestats() does not have to flush
+        int64_t stats[3];
+        bool sampled = op.type == Op::COMMIT && mTable->cachestats(&stats[0], &stats[1], &stats[2], true);
+
+        lock.lock();
+        if (sampled)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                mStats[i] += stats[i];
+            }
+            mStatsSampled = true;
+        }
+        if (!ok)
+        {
+            LOG_err << "Asynchronous DB write failed";
+            mFailed = true;
+        }
+
+        pendingrecord_map::iterator it;
+        if (op.type == Op::PUT || op.type == Op::DEL)
+        {
+            if ((it = mPending.find(op.record.id)) != mPending.end() && it->second.first == &op)
+            {
+                mPending.erase(it);
+            }
+        }
+        else if (op.type == Op::PUTMANY)
+        {
+            for (dbrecord_vector::const_iterator r = op.records.begin(); r != op.records.end(); r++)
+            {
+                if ((it = mPending.find(r->id)) != mPending.end() && it->second.first == &op)
+                {
+                    mPending.erase(it);
+                }
+            }
+        }
+        else if (op.type == Op::DELMANY)
+        {
+            for (vector<uint32_t>::const_iterator id = op.ids.begin(); id != op.ids.end(); id++)
+            {
+                if ((it = mPending.find(*id)) != mPending.end() && it->second.first == &op)
+                {
+                    mPending.erase(it);
+                }
+            }
         }
 
-        if (*type > nextid)
+        bool notify = false;
+        if (op.type == Op::COMMIT)
         {
-            nextid = *type & - IDSPACING;
+            mCommitsDone++;
+            notify = mCommitsDone == mCommitsQueued;
         }
 
-        return PaddedCBC::decrypt(data, key);
+        mQueue.pop_front();
+        mQueueChanged.notify_all();
+
+        if (notify && mWaiter)
+        {
+            mWaiter->notify();
+        }
     }
+}
 
-    return false;
+bool AsyncDbTable::execute(const Op& op)
+{
+    switch (op.type)
+    {
+        case Op::PUT:
+            return mTable->putrecord(op.record);
+
+        case Op::PUTMANY:
+            return mTable->putmany(op.records);
+
+        case Op::DEL:
+            return mTable->del(op.record.id);
+
+        case Op::DELMANY:
+            return mTable->delmany(op.ids);
+
+        case Op::TRUNCATE:
+            mTable->truncate();
+            break;
+
+        case Op::BEGIN:
+            mTable->begin();
+            break;
+
+        case Op::COMMIT:
+            mTable->commit();
+            return !mTable->writefailed();
+
+        case Op::ABORT:
+            mTable->abort();
+            break;
+    }
+
+    return true;
+}
+
+void AsyncDbTable::enqueue(Op&& op)
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+
+        mQueue.push_back(std::move(op));
+        const Op& queued = mQueue.back();
+
+        switch (queued.type)
+        {
+            case Op::PUT:
+                mPending[queued.record.id] = std::make_pair(&queued, &queued.record.data);
+                break;
+
+            case Op::DEL:
+                mPending[queued.record.id] = std::make_pair(&queued, (const string*)NULL);
+                break;
+
+            case Op::DELMANY:
+                for (vector<uint32_t>::const_iterator id = queued.ids.begin(); id != queued.ids.end(); id++)
+                {
+                    mPending[*id] = std::make_pair(&queued, (const string*)NULL);
+                }
+                break;
+
+            case Op::PUTMANY:
+                for (dbrecord_vector::const_iterator r = queued.records.begin(); r != queued.records.end(); r++)
+                {
+                    mPending[r->id] = std::make_pair(&queued, &r->data);
+                }
+                break;
+
+            case Op::TRUNCATE:
+                // get() must not see anything queued before the truncation
+                // (older operations then own no entries and erase none)
+                mPending.clear();
+                break;
+
+            case Op::COMMIT:
+                mCommitsQueued++;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    mQueueChanged.notify_all();
+}
+
+void AsyncDbTable::flush()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQueueChanged.wait(lock, [this]() { return mQueue.empty(); });
+}
+
+bool AsyncDbTable::committed()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return mCommitsDone == mCommitsQueued;
+}
+
+bool AsyncDbTable::writefailed()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return mFailed;
+}
+
+// counters as of the last completed commit
+bool AsyncDbTable::cachestats(int64_t* hits, int64_t* misses, int64_t* writes, bool reset)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    if (!mStatsSampled)
+    {
+        return false;
+    }
+
+    *hits = mStats[0];
+    *misses = mStats[1];
+    *writes = mStats[2];
+
+    if (reset)
+    {
+        mStats[0] = mStats[1] = mStats[2] = 0;
+    }
+    return true;
+}
+
+void AsyncDbTable::rewind()
+{
+    flush();
+    mTable->rewind();
+}
+
+bool AsyncDbTable::rewindtype(uint32_t type)
+{
+    flush();
+    return mTable->rewindtype(type);
+}
+
+bool AsyncDbTable::rewindchildren(int64_t parent)
+{
+    flush();
+    return mTable->rewindchildren(parent);
+}
+
+bool AsyncDbTable::next(uint32_t* index, string* data)
+{
+    return mTable->next(index, data);
+}
+
+bool AsyncDbTable::get(uint32_t index, string* data)
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+
+        pendingrecord_map::iterator it = mPending.find(index);
+        if (it != mPending.end())
+        {
+            if (!it->second.second)
+            {
+                return false;
+            }
+
+            *data = *it->second.second;
+            return true;
+        }
+    }
+
+    flush();
+    return mTable->get(index, data);
+}
+
+bool AsyncDbTable::put(uint32_t index, char* data, unsigned len)
+{
+    Op op;
+    op.type = Op::PUT;
+    op.record.id = index;
+    op.record.data.assign(data, len);
+    enqueue(std::move(op));
+    return !writefailed();
+}
+
+bool AsyncDbTable::putrecord(const DbRecord& record)
+{
+    Op op;
+    op.type = Op::PUT;
+    op.record = record;
+    enqueue(std::move(op));
+    return !writefailed();
+}
+
+bool AsyncDbTable::putmany(const dbrecord_vector& records)
+{
+    Op op;
+    op.type = Op::PUTMANY;
+    op.records = records;
+    enqueue(std::move(op));
+    return !writefailed();
+}
+
+bool AsyncDbTable::del(uint32_t index)
+{
+    Op op;
+    op.type = Op::DEL;
+    op.record.id = index;
+    enqueue(std::move(op));
+    return !writefailed();
+}
+
+bool AsyncDbTable::delmany(const vector<uint32_t>& ids)
+{
+    Op op;
+    op.type = Op::DELMANY;
+    op.ids = ids;
+    enqueue(std::move(op));
+    return !writefailed();
+}
+
+void AsyncDbTable::truncate()
+{
+    Op op;
+    op.type = Op::TRUNCATE;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::begin()
+{
+    Op op;
+    op.type = Op::BEGIN;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::commit()
+{
+    Op op;
+    op.type = Op::COMMIT;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::abort()
+{
+    Op op;
+    op.type = Op::ABORT;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::remove()
+{
+    flush();
+    mTable->remove();
 }
 
 void DbTable::checkTransaction()
@@ -0,0 +1,516 @@
+/**
+ * @file lmdb.cpp
+ * @brief LMDB DB access layer
+ *
+ * (c) 2013-2014 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega.h"
+
+#ifdef USE_LMDB
+#include <mutex>
+
+namespace mega {
+struct LmdbEnv
+{
+    MDB_env* env = nullptr;
+    string path;
+    int refs = 0;
+
+    static LmdbEnv* acquire(const string& path, const DbConfig& config);
+    static void release(LmdbEnv*);
+};
+
+// environments by path - LMDB must not open the same one twice in a process
+static std::mutex lmdbEnvsMutex;
+static std::map<string, LmdbEnv*> lmdbEnvs;
+
+LmdbEnv* LmdbEnv::acquire(const string& path, const DbConfig& config)
+{
+    std::lock_guard<std::mutex> g(lmdbEnvsMutex);
+
+    std::map<string, LmdbEnv*>::iterator it = lmdbEnvs.find(path);
+    if (it != lmdbEnvs.end())
+    {
+        it->second->refs++;
+        return it->second;
+    }
+
+    MDB_env* env;
+    if (mdb_env_create(&env) != MDB_SUCCESS)
+    {
+        return NULL;
+    }
+
+    // the map is only address space: reserve plenty of it
+    size_t mapsize = config.mmapSize > 0 ? size_t(config.mmapSize)
+                                         : (sizeof(size_t) > 4 ? size_t(1) << 40 : size_t(1) << 29);
+
+    // readers don't use thread-local slots: a client may read a table from
+    // whichever thread it runs on, and several tables from the same thread
+    unsigned flags = MDB_NOSUBDIR | MDB_NOTLS;
+    if (config.synchronous == 0)
+    {
+        flags |= MDB_NOSYNC;
+    }
+    else if (config.synchronous == 1)
+    {
+        flags |= MDB_NOMETASYNC;
+    }
+
+    int rc;
+    if ((rc = mdb_env_set_maxdbs(env, LmdbDbAccess::MAXTABLES)) != MDB_SUCCESS
+     || (rc = mdb_env_set_mapsize(env, mapsize)) != MDB_SUCCESS
+     || (rc = mdb_env_open(env, path.c_str(), flags, 0600)) != MDB_SUCCESS)
+    {
+        LOG_err << "Unable to open LMDB environment " << path << ": " << mdb_strerror(rc);
+        mdb_env_close(env);
+        return NULL;
+    }
+
+    LOG_debug << "LMDB environment opened " << path;
+
+    LmdbEnv* e = new LmdbEnv;
+    e->env = env;
+    e->path = path;
+    e->refs = 1;
+    lmdbEnvs[path] = e;
+    return e;
+}
+
+void LmdbEnv::release(LmdbEnv* e)
+{
+    std::lock_guard<std::mutex> g(lmdbEnvsMutex);
+
+    if (!--e->refs)
+    {
+        LOG_debug << "LMDB environment closed " << e->path;
+        mdb_env_close(e->env);
+        lmdbEnvs.erase(e->path);
+        delete e;
+    }
+}
+
+LmdbDbAccess::LmdbDbAccess(string* path)
+{
+    if (path)
+    {
+        dbpath = *path;
+    }
+}
+
+LmdbDbAccess::~LmdbDbAccess()
+{
+    if (env)
+    {
+        LmdbEnv::release(env);
+    }
+}
+
+DbTable* LmdbDbAccess::open(PrnGen &rng, FileSystemAccess*, string* name, bool, bool checkAlwaysTransacted)
+{
+    // durability and map size settings apply when the environment is created
+    if (!env)
+    {
+        ostringstream oss;
+        oss << dbpath << "megaclient_statecache" << DB_VERSION << ".mdb";
+
+        if (!(env = LmdbEnv::acquire(oss.str(), config)))
+        {
+            return NULL;
+        }
+    }
+
+    currentDbVersion = DB_VERSION;
+
+    string dbname = "statecache_" + *name;
+    MDB_txn* txn;
+    MDB_dbi dbi;
+    int rc;
+
+    if ((rc = mdb_txn_begin(env->env, NULL, 0, &txn)) == MDB_SUCCESS)
+    {
+        if ((rc = mdb_dbi_open(txn, dbname.c_str(), MDB_CREATE | MDB_INTEGERKEY, &dbi)) == MDB_SUCCESS)
+        {
+            rc = mdb_txn_commit(txn);
+        }
+        else
+        {
+            mdb_txn_abort(txn);
+        }
+    }
+
+    if (rc != MDB_SUCCESS)
+    {
+        LOG_err << "Unable to open LMDB table " << dbname << ": " << mdb_strerror(rc);
+        return NULL;
+    }
+
+    return new LmdbDbTable(rng, env, dbi, dbname, checkAlwaysTransacted);
+}
+
+LmdbDbTable::LmdbDbTable(PrnGen &rng, LmdbEnv* cenv, MDB_dbi cdbi, const string& cname, bool checkAlwaysTransacted)
+    : DbTable(rng, checkAlwaysTransacted)
+{
+    env = cenv;
+    dbi = cdbi;
+    name = cname;
+
+    // the table keeps the environment open even if its DbAccess goes first
+    std::lock_guard<std::mutex> g(lmdbEnvsMutex);
+    env->refs++;
+}
+
+LmdbDbTable::~LmdbDbTable()
+{
+    endread();
+    abort();
+    LmdbEnv::release(env);
+    LOG_debug << "Database closed " << name;
+}
+
+void LmdbDbTable::endread()
+{
+    if (cursor)
+    {
+        mdb_cursor_close(cursor);
+        cursor = nullptr;
+    }
+
+    if (readtxn)
+    {
+        mdb_txn_abort(readtxn);
+        readtxn = nullptr;
+    }
+}
+
+// set cursor to first record
+void LmdbDbTable::rewind()
+{
+    endread();
+
+    if (removed)
+    {
+        return;
+    }
+
+    if (mdb_txn_begin(env->env, NULL, MDB_RDONLY, &readtxn) != MDB_SUCCESS)
+    {
+        readtxn = nullptr;
+        return;
+    }
+
+    if (mdb_cursor_open(readtxn, dbi, &cursor) != MDB_SUCCESS)
+    {
+        cursor = nullptr;
+        endread();
+        return;
+    }
+
+    started = false;
+}
+
+// retrieve next record through cursor, in key order, merging the
+// records stored with the changes not committed yet
+bool LmdbDbTable::next(uint32_t* index, string* data)
+{
+    if (!cursor)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        if (started && lastkey == UINT32_MAX)
+        {
+            break;
+        }
+
+        uint32_t from = started ? lastkey + 1 : 0;
+
+        MDB_val key = { sizeof from, &from };
+        MDB_val value;
+        uint32_t storedkey = 0;
+        bool stored = !truncated && mdb_cursor_get(cursor, &key, &value, MDB_SET_RANGE) == MDB_SUCCESS;
+
+        if (stored)
+        {
+            memcpy(&storedkey, key.mv_data, sizeof storedkey);
+        }
+
+        std::map<uint32_t, PendingRecord>::iterator it = pending.lower_bound(from);
+
+        if (it != pending.end() && (!stored || it->first <= storedkey))
+        {
+            started = true;
+            lastkey = it->first;
+
+            if (it->second.deleted)
+            {
+                continue;
+            }
+
+            *index = it->first;
+            *data = it->second.data;
+            return true;
+        }
+
+        if (!stored)
+        {
+            break;
+        }
+
+        started = true;
+        lastkey = storedkey;
+        *index = storedkey;
+        data->assign((char*)value.mv_data, value.mv_size);
+        return true;
+    }
+
+    endread();
+    return false;
+}
+
+// retrieve record by index
+bool LmdbDbTable::get(uint32_t index, string* data)
+{
+    std::map<uint32_t, PendingRecord>::iterator it = pending.find(index);
+    if (it != pending.end())
+    {
+        if (it->second.deleted)
+        {
+            return false;
+        }
+
+        *data = it->second.data;
+        return true;
+    }
+
+    if (truncated || removed)
+    {
+        return false;
+    }
+
+    MDB_txn* txn;
+    if (mdb_txn_begin(env->env, NULL, MDB_RDONLY, &txn) != MDB_SUCCESS)
+    {
+        return false;
+    }
+
+    MDB_val key = { sizeof index, &index };
+    MDB_val value;
+    bool result = mdb_get(txn, dbi, &key, &value) == MDB_SUCCESS;
+
+    if (result)
+    {
+        data->assign((char*)value.mv_data, value.mv_size);
+    }
+
+    mdb_txn_abort(txn);
+    return result;
+}
+
+bool LmdbDbTable::change(uint32_t index, const char* data, size_t len, bool deleted)
+{
+    if (removed)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    PendingRecord& record = pending[index];
+    record.deleted = deleted;
+    record.data.assign(data ? data : "", len);
+
+    return transacted || write();
+}
+
+// add/update record by index
+bool LmdbDbTable::put(uint32_t index, char* data, unsigned len)
+{
+    return change(index, data, len, false);
+}
+
+// delete record by index
+bool LmdbDbTable::del(uint32_t index)
+{
+    return change(index, NULL, 0, true);
+}
+
+// truncate table
+void LmdbDbTable::truncate()
+{
+    if (removed)
+    {
+        return;
+    }
+
+    checkTransaction();
+
+    pending.clear();
+    truncated = true;
+
+    if (!transacted)
+    {
+        write();
+    }
+}
+
+// apply the changes kept in memory in a single write transaction
+bool LmdbDbTable::write()
+{
+    if (!truncated && pending.empty())
+    {
+        return true;
+    }
+
+    MDB_txn* txn;
+    int rc;
+
+    if ((rc = mdb_txn_begin(env->env, NULL, 0, &txn)) == MDB_SUCCESS)
+    {
+        if (truncated)
+        {
+            rc = mdb_drop(txn, dbi, 0);
+        }
+
+        for (std::map<uint32_t, PendingRecord>::iterator it = pending.begin(); rc == MDB_SUCCESS && it != pending.end(); it++)
+        {
+            MDB_val key = { sizeof it->first, (void*)&it->first };
+
+            if (it->second.deleted)
+            {
+                if ((rc = mdb_del(txn, dbi, &key, NULL)) == MDB_NOTFOUND)
+                {
+                    rc = MDB_SUCCESS;
+                }
+            }
+            else
+            {
+                MDB_val value = { it->second.data.size(), (void*)it->second.data.data() };
+                rc = mdb_put(txn, dbi, &key, &value, 0);
+            }
+        }
+
+        if (rc == MDB_SUCCESS)
+        {
+            rc = mdb_txn_commit(txn);
+        }
+        else
+        {
+            mdb_txn_abort(txn);
+        }
+    }
+
+    if (rc != MDB_SUCCESS)
+    {
+        // the changes stay pending (and readable) so that the next write retries them
+        LOG_err << "LMDB write failed " << name << ": " << mdb_strerror(rc);
+        return false;
+    }
+
+    pending.clear();
+    truncated = false;
+
+    // a sequential read in progress continues on the new data
+    if (cursor)
+    {
+        mdb_txn_reset(readtxn);
+
+        if (mdb_txn_renew(readtxn) != MDB_SUCCESS || mdb_cursor_renew(readtxn, cursor) != MDB_SUCCESS)
+        {
+            endread();
+        }
+    }
+
+    return true;
+}
+
+// begin transaction
+void LmdbDbTable::begin()
+{
+    LOG_debug << "DB transaction BEGIN " << name;
+    transacted = true;
+}
+
+// commit transaction
+void LmdbDbTable::commit()
+{
+    LOG_debug << "DB transaction COMMIT " << name;
+
+    if (!write())
+    {
+        failed = true;
+    }
+    transacted = false;
+}
+
+bool LmdbDbTable::writefailed()
+{
+    return failed;
+}
+
+// abort transaction
+void LmdbDbTable::abort()
+{
+    if (transacted)
+    {
+        LOG_debug << "DB transaction ROLLBACK " << name;
+    }
+
+    pending.clear();
+    truncated = false;
+    transacted = false;
+}
+
+// remove table: the other tables of the environment are not affected
+void LmdbDbTable::remove()
+{
+    endread();
+    abort();
+
+    if (removed)
+    {
+        return;
+    }
+
+    MDB_txn* txn;
+    int rc;
+
+    if ((rc = mdb_txn_begin(env->env, NULL, 0, &txn)) == MDB_SUCCESS)
+    {
+        if ((rc = mdb_drop(txn, dbi, 1)) == MDB_SUCCESS)
+        {
+            rc = mdb_txn_commit(txn);
+        }
+        else
+        {
+            mdb_txn_abort(txn);
+        }
+    }
+
+    if (rc != MDB_SUCCESS)
+    {
+        LOG_err << "Unable to remove LMDB table " << name << ": " << mdb_strerror(rc);
+    }
+
+    removed = true;
+}
+} // namespace
+
+#endif
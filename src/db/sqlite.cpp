@@ -121,11 +121,43 @@ DbTable* SqliteDbAccess::open(PrnGen &rng, FileSystemAccess* fsaccess, string* n
         return NULL;
     }
 
+    // page_size has to be set before the journal mode (and only affects new databases)
+    if (config.pageSize > 0)
+    {
+        pragma(db, "page_size", config.pageSize);
+    }
+
 #if !(TARGET_OS_IPHONE)
     sqlite3_exec(db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
 #endif
 
-    const char *sql = "CREATE TABLE IF NOT EXISTS statecache (id INTEGER PRIMARY KEY ASC NOT NULL, content BLOB NOT NULL)";
+    if (config.synchronous >= 0)
+    {
+        pragma(db, "synchronous", config.synchronous);
+    }
+
+    if (config.cacheSizeKiB >= 0)
+    {
+        // negative values are in KiB rather than pages
+        pragma(db, "cache_size", -int64_t(config.cacheSizeKiB));
+    }
+
+    if (config.mmapSize >= 0)
+    {
+        pragma(db, "mmap_size", config.mmapSize);
+    }
+
+    if (config.tempStore >= 0)
+    {
+        pragma(db, "temp_store", config.tempStore);
+    }
+
+    if (config.walAutoCheckpoint >= 0)
+    {
+        pragma(db, "wal_autocheckpoint", config.walAutoCheckpoint);
+    }
+
+    const char *sql = "CREATE TABLE IF NOT EXISTS statecache (id INTEGER PRIMARY KEY ASC NOT NULL, content BLOB NOT NULL, type INTEGER, parent INTEGER)";
 
     rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
 
@@ -134,7 +166,26 @@ DbTable* SqliteDbAccess::open(PrnGen &rng, FileSystemAccess* fsaccess, string* n
         return NULL;
     }
 
-    return new SqliteDbTable(rng, db, fsaccess, &dbfile, checkAlwaysTransacted);
+    if (!SqliteDbTable::migrate(db))
+    {
+        LOG_warn << "Unable to index the local cache: " << sqlite3_errmsg(db);
+    }
+
+    SqliteDbTable* table = new SqliteDbTable(rng, db, fsaccess, &dbfile, checkAlwaysTransacted);
+    table->checkpointOnCommit = config.walCheckpointOnCommit;
+    table->compressrecords = config.compressRecords;
+    return table;
+}
+
+void SqliteDbAccess::pragma(sqlite3* db, const char* name, int64_t value)
+{
+    std::ostringstream sql;
+    sql << "PRAGMA " << name << " = " << value << ";";
+
+    if (sqlite3_exec(db, sql.str().c_str(), NULL, NULL, NULL) != SQLITE_OK)
+    {
+        LOG_warn << "Unable to set " << name << ": " << sqlite3_errmsg(db);
+    }
 }
 
 SqliteDbTable::SqliteDbTable(PrnGen &rng, sqlite3* cdb, FileSystemAccess *fs, string *filepath, bool checkAlwaysTransacted)
@@ -153,31 +204,132 @@ SqliteDbTable::~SqliteDbTable()
         return;
     }
 
-    if (pStmt)
-    {
-        sqlite3_finalize(pStmt);
-    }
+    finalizestatements();
     abort();
     sqlite3_close(db);
     LOG_debug << "Database closed " << dbfile;
 }
 
-// set cursor to first record
-void SqliteDbTable::rewind()
+bool SqliteDbTable::migrate(sqlite3* db)
+{
+    bool hastype = false;
+    bool hasparent = false;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA table_info(statecache)", -1, &stmt, NULL) != SQLITE_OK)
+    {
+        return false;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char* column = (const char*)sqlite3_column_text(stmt, 1);
+        if (column)
+        {
+            hastype = hastype || !strcmp(column, "type");
+            hasparent = hasparent || !strcmp(column, "parent");
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if ((!hastype && sqlite3_exec(db, "ALTER TABLE statecache ADD COLUMN type INTEGER", NULL, NULL, NULL) != SQLITE_OK)
+     || (!hasparent && sqlite3_exec(db, "ALTER TABLE statecache ADD COLUMN parent INTEGER", NULL, NULL, NULL) != SQLITE_OK))
+    {
+        return false;
+    }
+
+    // rows left by older versions (and by older versions running on a migrated
+    // cache) get their type, and are flagged as having an unknown parent
+    std::ostringstream sql;
+    sql << "UPDATE statecache SET type = id & " << TYPEMASK << ", parent = " << UNKNOWNPARENT << " WHERE type IS NULL";
+
+    return sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS statecache_type ON statecache (type)", NULL, NULL, NULL) == SQLITE_OK
+        && sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS statecache_parent ON statecache (parent)", NULL, NULL, NULL) == SQLITE_OK
+        && sqlite3_exec(db, sql.str().c_str(), NULL, NULL, NULL) == SQLITE_OK;
+}
+
+// return the cached statement, preparing it first if needed
+sqlite3_stmt* SqliteDbTable::prepared(sqlite3_stmt** stmt, const char* sql)
+{
+    if (!*stmt && sqlite3_prepare_v2(db, sql, -1, stmt, NULL) != SQLITE_OK)
+    {
+        sqlite3_finalize(*stmt);
+        *stmt = NULL;
+    }
+
+    return *stmt;
+}
+
+void SqliteDbTable::finalizestatements()
+{
+    sqlite3_stmt** stmts[] = { &pStmt, &pGetStmt, &pPutStmt, &pPutBatchStmt, &pDelStmt, &pDelBatchStmt };
+
+    for (sqlite3_stmt** stmt : stmts)
+    {
+        if (*stmt)
+        {
+            sqlite3_finalize(*stmt);
+            *stmt = NULL;
+        }
+    }
+}
+
+bool SqliteDbTable::rewindquery(const char* sql, bool filtered, int64_t value)
 {
     if (!db)
     {
-        return;
+        return false;
     }
 
     if (pStmt)
     {
-        sqlite3_reset(pStmt);
+        sqlite3_finalize(pStmt);
+        pStmt = NULL;
     }
-    else
+
+    if (sqlite3_prepare_v2(db, sql, -1, &pStmt, NULL) != SQLITE_OK
+     || (filtered && sqlite3_bind_int64(pStmt, 1, value) != SQLITE_OK))
     {
-        sqlite3_prepare(db, "SELECT id, content FROM statecache", -1, &pStmt, NULL);
+        sqlite3_finalize(pStmt);
+        pStmt = NULL;
+        return false;
     }
+
+    return true;
+}
+
+// set cursor to first record
+void SqliteDbTable::rewind()
+{
+    rewindquery("SELECT id, content FROM statecache", false, 0);
+}
+
+// set cursor to the first record of the given type
+bool SqliteDbTable::rewindtype(uint32_t type)
+{
+    return rewindquery("SELECT id, content FROM statecache WHERE type = ?", true, type & TYPEMASK);
+}
+
+// set cursor to the first record stored with the given parent key
+bool SqliteDbTable::rewindchildren(int64_t parent)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    // the filter would miss the rows whose parent isn't known yet
+    sqlite3_stmt *stmt;
+    bool complete = false;
+
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM statecache WHERE parent = ? LIMIT 1", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        complete = sqlite3_bind_int64(stmt, 1, UNKNOWNPARENT) == SQLITE_OK
+                && sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    sqlite3_finalize(stmt);
+
+    return complete && rewindquery("SELECT id, content FROM statecache WHERE parent = ?", true, parent);
 }
 
 // retrieve next record through cursor
@@ -222,7 +374,7 @@ bool SqliteDbTable::get(uint32_t index, string* data)
     sqlite3_stmt *stmt;
     bool result = false;
 
-    if (sqlite3_prepare(db, "SELECT content FROM statecache WHERE id = ?", -1, &stmt, NULL) == SQLITE_OK)
+    if ((stmt = prepared(&pGetStmt, "SELECT content FROM statecache WHERE id = ?")))
     {
         if (sqlite3_bind_int(stmt, 1, index) == SQLITE_OK)
         {
@@ -233,14 +385,36 @@ bool SqliteDbTable::get(uint32_t index, string* data)
                 result = true;
             }
         }
+
+        sqlite3_reset(stmt);
     }
 
-    sqlite3_finalize(stmt);
     return result;
 }
 
+// bind the columns of a record, starting at the given parameter
+static bool bindrecord(sqlite3_stmt* stmt, int column, uint32_t index, const char* data, unsigned len, const int64_t* parent)
+{
+    return sqlite3_bind_int(stmt, column, index) == SQLITE_OK
+        && sqlite3_bind_blob(stmt, column + 1, data, int(len), SQLITE_STATIC) == SQLITE_OK
+        && sqlite3_bind_int(stmt, column + 2, index & DbTable::TYPEMASK) == SQLITE_OK
+        && (parent ? sqlite3_bind_int64(stmt, column + 3, *parent)
+                   : sqlite3_bind_null(stmt, column + 3)) == SQLITE_OK;
+}
+
 // add/update record by index
 bool SqliteDbTable::put(uint32_t index, char* data, unsigned len)
+{
+    return putrow(index, data, len, NULL);
+}
+
+// add/update record by index, with its parent key
+bool SqliteDbTable::putrecord(const DbRecord& record)
+{
+    return putrow(record.id, record.data.data(), unsigned(record.data.size()), record.hasparent ? &record.parent : NULL);
+}
+
+bool SqliteDbTable::putrow(uint32_t index, const char* data, unsigned len, const int64_t* parent)
 {
     if (!db)
     {
@@ -252,22 +426,73 @@ bool SqliteDbTable::put(uint32_t index, char* data, unsigned len)
     sqlite3_stmt *stmt;
     bool result = false;
 
-    if (sqlite3_prepare(db, "INSERT OR REPLACE INTO statecache (id, content) VALUES (?, ?)", -1, &stmt, NULL) == SQLITE_OK)
+    if ((stmt = prepared(&pPutStmt, "INSERT OR REPLACE INTO statecache (id, content, type, parent) VALUES (?, ?, ?, ?)")))
     {
-        if (sqlite3_bind_int(stmt, 1, index) == SQLITE_OK)
+        result = bindrecord(stmt, 1, index, data, len, parent)
+              && sqlite3_step(stmt) == SQLITE_DONE;
+
+        sqlite3_reset(stmt);
+    }
+
+    return result;
+}
+
+// add/update records, BATCHROWS per statement
+bool SqliteDbTable::putmany(const dbrecord_vector& records)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    size_t i = 0;
+
+    if (records.size() >= BATCHROWS)
+    {
+        string sql = "INSERT OR REPLACE INTO statecache (id, content, type, parent) VALUES (?, ?, ?, ?)";
+        for (int row = 1; row < BATCHROWS; row++)
+        {
+            sql.append(", (?, ?, ?, ?)");
+        }
+
+        sqlite3_stmt *stmt = prepared(&pPutBatchStmt, sql.c_str());
+        if (!stmt)
+        {
+            return false;
+        }
+
+        for (; i + BATCHROWS <= records.size(); i += BATCHROWS)
         {
-            if (sqlite3_bind_blob(stmt, 2, data, len, SQLITE_STATIC) == SQLITE_OK)
+            bool result = true;
+
+            for (int row = 0; result && row < BATCHROWS; row++)
             {
-                if (sqlite3_step(stmt) == SQLITE_DONE)
-                {
-                    result = true;
-                }
+                const DbRecord& r = records[i + row];
+
+                result = bindrecord(stmt, 4 * row + 1, r.id, r.data.data(), unsigned(r.data.size()), r.hasparent ? &r.parent : NULL);
+            }
+
+            result = result && sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+
+            if (!result)
+            {
+                return false;
             }
         }
     }
 
-    sqlite3_finalize(stmt);
-    return result;
+    for (; i < records.size(); i++)
+    {
+        if (!putrecord(records[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 // delete record by index
@@ -280,11 +505,75 @@ bool SqliteDbTable::del(uint32_t index)
 
     checkTransaction();
 
-    char buf[64];
+    sqlite3_stmt *stmt;
+    bool result = false;
+
+    if ((stmt = prepared(&pDelStmt, "DELETE FROM statecache WHERE id = ?")))
+    {
+        result = sqlite3_bind_int(stmt, 1, index) == SQLITE_OK
+              && sqlite3_step(stmt) == SQLITE_DONE;
+
+        sqlite3_reset(stmt);
+    }
+
+    return result;
+}
+
+// delete records by index, BATCHROWS per statement
+bool SqliteDbTable::delmany(const vector<uint32_t>& ids)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    size_t i = 0;
 
-    sprintf(buf, "DELETE FROM statecache WHERE id = %" PRIu32, index);
+    if (ids.size() >= BATCHROWS)
+    {
+        string sql = "DELETE FROM statecache WHERE id IN (?";
+        for (int row = 1; row < BATCHROWS; row++)
+        {
+            sql.append(", ?");
+        }
+        sql.append(")");
+
+        sqlite3_stmt *stmt = prepared(&pDelBatchStmt, sql.c_str());
+        if (!stmt)
+        {
+            return false;
+        }
 
-    return !sqlite3_exec(db, buf, 0, 0, NULL);
+        for (; i + BATCHROWS <= ids.size(); i += BATCHROWS)
+        {
+            bool result = true;
+
+            for (int row = 0; result && row < BATCHROWS; row++)
+            {
+                result = sqlite3_bind_int(stmt, row + 1, ids[i + row]) == SQLITE_OK;
+            }
+
+            result = result && sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+
+            if (!result)
+            {
+                return false;
+            }
+        }
+    }
+
+    for (; i < ids.size(); i++)
+    {
+        if (!del(ids[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 // truncate table
@@ -322,6 +611,34 @@ void SqliteDbTable::commit()
 
     LOG_debug << "DB transaction COMMIT " << dbfile;
     sqlite3_exec(db, "COMMIT", 0, 0, NULL);
+
+    if (checkpointOnCommit)
+    {
+        sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+    }
+}
+
+bool SqliteDbTable::cachestats(int64_t* hits, int64_t* misses, int64_t* writes, bool reset)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    int current, highwater;
+    int64_t* counters[] = { hits, misses, writes };
+    int ops[] = { SQLITE_DBSTATUS_CACHE_HIT, SQLITE_DBSTATUS_CACHE_MISS, SQLITE_DBSTATUS_CACHE_WRITE };
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (sqlite3_db_status(db, ops[i], &current, &highwater, reset) != SQLITE_OK)
+        {
+            return false;
+        }
+        *counters[i] = current;
+    }
+
+    return true;
 }
 
 // abort transaction
@@ -343,10 +660,7 @@ void SqliteDbTable::remove()
         return;
     }
 
-    if (pStmt)
-    {
-        sqlite3_finalize(pStmt);
-    }
+    finalizestatements();
     abort();
     sqlite3_close(db);
 
@@ -318,6 +318,11 @@ void File::completed(Transfer* t, LocalNode* l)
         // store fingerprint
         t->serializefingerprint(&attrs.map['c']);
 
+        for (attr_map::iterator it = uploadattrs.begin(); it != uploadattrs.end(); it++)
+        {
+            attrs.map[it->first] = it->second;
+        }
+
         string tattrstring;
 
         attrs.getjson(&tattrstring);
@@ -367,6 +372,12 @@ void File::completed(Transfer* t, LocalNode* l)
                 newnode->ovhandle = t->client->getovhandle(t->client->nodebyhandle(th), &name);
             }
 
+            if (t->client->batchputnodes && !l)
+            {
+                t->client->batchputnode(th, newnode, tag);
+                return;
+            }
+
             t->client->reqs.add(new CommandPutNodes(t->client,
                                                                   th, NULL,
                                                                   newnode, 1,
@@ -389,6 +400,12 @@ void File::terminated()
 // failuresup to 16 times, except I/O errors (6 times)
 bool File::failed(error e)
 {
+    if (transfer->uploadstream && transfer->uploadstream->pos)
+    {
+        // the data already read from the stream can't be read again
+        return false;
+    }
+
     if (e == API_EKEY)
     {
         if (!transfer->hascurrentmetamac)
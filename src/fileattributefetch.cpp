@@ -23,6 +23,8 @@
 #include "mega/megaclient.h"
 #include "mega/megaapp.h"
 #include "mega/logging.h"
+#include "mega/filesystem.h"
+#include "mega/base64.h"
 
 namespace mega {
 FileAttributeFetchChannel::FileAttributeFetchChannel(MegaClient* client)
@@ -110,7 +112,16 @@ void FileAttributeFetchChannel::parse(int /*fac*/, bool final)
     // attributes are CBC-encrypted with the file's key
     for (;;)
     {
-        if (ptr == endptr) break;
+        if (ptr == endptr)
+        {
+            // don't go over the delivered attributes again with the next part
+            if (!final)
+            {
+                req.purge(ptr - req.data());
+            }
+
+            break;
+        }
 
         if (ptr + sizeof(FaHeader) > endptr || ptr + sizeof(FaHeader) + (falen = ((FaHeader*)ptr)->len) > endptr)
         {
@@ -140,6 +151,12 @@ void FileAttributeFetchChannel::parse(int /*fac*/, bool final)
                 if (client->tmpnodecipher.setkey(&it->second->nodekey))
                 {
                     client->tmpnodecipher.cbc_decrypt((byte*)ptr, falen);
+
+                    if (client->facache)
+                    {
+                        client->facache->put(it->first, ptr, falen);
+                    }
+
                     client->app->fa_complete(it->second->nodehandle, it->second->type, ptr, falen);
                 }
 
@@ -177,4 +194,134 @@ void FileAttributeFetchChannel::failed()
         }
     }
 }
+
+FileAttributeCache::FileAttributeCache(FileSystemAccess* fs, const string& localfolder, m_off_t max)
+{
+    fsaccess = fs;
+    folder = localfolder;
+    maxsize = max;
+    size = 0;
+
+    // the attributes of previous sessions, in no particular order
+    std::unique_ptr<DirAccess> da(fsaccess->newdiraccess());
+    string path = folder;
+    if (da->dopen(&path, NULL, false))
+    {
+        string localname, name, filepath;
+        nodetype_t type;
+
+        while (da->dnext(&path, &localname, false, &type))
+        {
+            handle fah = UNDEF;
+            fsaccess->local2path(&localname, &name);
+
+            if (type != FILENODE || name.size() != 11
+                    || Base64::atob(name.c_str(), (byte*)&fah, sizeof fah) != sizeof fah)
+            {
+                continue;
+            }
+
+            localpath(fah, &filepath);
+            auto fa = fsaccess->newfileaccess();
+            if (fa->fopen(&filepath, true, false) && !entries.count(fah))
+            {
+                Entry& entry = entries[fah];
+                entry.size = fa->size;
+                entry.lru = lru.insert(lru.end(), fah);
+                size += fa->size;
+            }
+        }
+    }
+
+    while (size > maxsize && !lru.empty())
+    {
+        remove(entries.find(lru.front()));
+    }
+
+    LOG_debug << "File attribute cache: " << entries.size() << " attributes, " << size << " bytes";
+}
+
+void FileAttributeCache::localpath(handle fah, string* path)
+{
+    char buf[12];
+    string name(buf, Base64::btoa((const byte*)&fah, sizeof fah, buf));
+    string localname;
+    fsaccess->path2local(&name, &localname);
+
+    *path = folder;
+    path->append(fsaccess->localseparator);
+    path->append(localname);
+}
+
+void FileAttributeCache::remove(std::map<handle, Entry>::iterator it)
+{
+    string path;
+    localpath(it->first, &path);
+    fsaccess->unlinklocal(&path);
+
+    size -= it->second.size;
+    lru.erase(it->second.lru);
+    entries.erase(it);
+}
+
+bool FileAttributeCache::get(handle fah, string* data)
+{
+    auto it = entries.find(fah);
+    if (it == entries.end())
+    {
+        return false;
+    }
+
+    string path;
+    localpath(fah, &path);
+    auto fa = fsaccess->newfileaccess();
+    if (!fa->fopen(&path, true, false) || fa->size != it->second.size
+            || !fa->fread(data, unsigned(fa->size), 0, 0))
+    {
+        fa.reset();
+        remove(it);
+        return false;
+    }
+
+    lru.splice(lru.end(), lru, it->second.lru);
+    return true;
+}
+
+void FileAttributeCache::put(handle fah, const char* data, size_t len)
+{
+    if (m_off_t(len) > maxsize / 16)
+    {
+        return;
+    }
+
+    auto it = entries.find(fah);
+    if (it != entries.end())
+    {
+        // same handle, same content
+        lru.splice(lru.end(), lru, it->second.lru);
+        return;
+    }
+
+    while (size + m_off_t(len) > maxsize && !lru.empty())
+    {
+        remove(entries.find(lru.front()));
+    }
+
+    string path;
+    localpath(fah, &path);
+    fsaccess->unlinklocal(&path);
+
+    auto fa = fsaccess->newfileaccess();
+    if (!fa->fopen(&path, false, true) || !fa->fwrite((const byte*)data, unsigned(len), 0))
+    {
+        fa.reset();
+        fsaccess->unlinklocal(&path);
+        return;
+    }
+
+    Entry& entry = entries[fah];
+    entry.size = m_off_t(len);
+    entry.lru = lru.insert(lru.end(), fah);
+    size += m_off_t(len);
+}
 } // namespace
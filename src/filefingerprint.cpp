@@ -20,6 +20,7 @@
  */
 
 #include "mega/filefingerprint.h"
+#include "mega/db.h"
 #include "mega/serialize64.h"
 #include "mega/base64.h"
 #include "mega/logging.h"
@@ -412,4 +413,340 @@ bool FileFingerprintCmp::operator()(const FileFingerprint* a, const FileFingerpr
 
     return memcmp(a->crc, b->crc, sizeof a->crc) < 0;
 }
+
+StreamFingerprint::StreamFingerprint(m_off_t csize)
+    : size(csize)
+{
+    // the ranges read by genfingerprint(InputStreamAccess*)
+    const unsigned crcs = sizeof(FileFingerprint::crc) / sizeof(*FileFingerprint::crc);
+    if (size <= MAXFULL)
+    {
+        if (size > 0)
+        {
+            ranges.push_back(Range{ 0, unsigned(size), 0 });
+        }
+    }
+    else
+    {
+        const unsigned blocksize = 4 * sizeof(FileFingerprint::crc);
+        const unsigned blocks = MAXFULL / (blocksize * crcs);
+        for (unsigned i = 0; i < crcs * blocks; i++)
+        {
+            m_off_t offset = (size - blocksize) * i / (crcs * blocks - 1);
+            ranges.push_back(Range{ offset, blocksize, size_t(i) * blocksize });
+        }
+    }
+
+    samples.resize(ranges.size() ? ranges.back().sample + ranges.back().len : 0);
+}
+
+void StreamFingerprint::add(const byte* data, size_t len, m_off_t pos)
+{
+    m_off_t end = pos + m_off_t(len);
+    for (size_t i = next; i < ranges.size() && ranges[i].offset < end; i++)
+    {
+        const Range& r = ranges[i];
+        m_off_t from = std::max(r.offset, pos);
+        m_off_t to = std::min(r.offset + m_off_t(r.len), end);
+        if (from < to)
+        {
+            memcpy(&samples[r.sample + size_t(from - r.offset)], data + (from - pos), size_t(to - from));
+        }
+    }
+
+    while (next < ranges.size() && ranges[next].offset + m_off_t(ranges[next].len) <= end)
+    {
+        next++;
+    }
+}
+
+bool StreamFingerprint::get(FileFingerprint* fp, m_time_t mtime) const
+{
+    if (next < ranges.size())
+    {
+        return false;
+    }
+
+    // replays the sampled bytes to genfingerprint, which skips the others
+    struct Samples : public InputStreamAccess
+    {
+        const StreamFingerprint& sf;
+        m_off_t pos = 0;
+        size_t range = 0;
+
+        Samples(const StreamFingerprint& csf) : sf(csf) { }
+
+        m_off_t size() override
+        {
+            return sf.size;
+        }
+
+        bool read(byte* buf, unsigned len) override
+        {
+            if (buf)
+            {
+                while (range < sf.ranges.size() && sf.ranges[range].offset + m_off_t(sf.ranges[range].len) <= pos)
+                {
+                    range++;
+                }
+
+                if (len && (range == sf.ranges.size() || sf.ranges[range].offset > pos
+                            || pos + len > sf.ranges[range].offset + sf.ranges[range].len))
+                {
+                    return false;
+                }
+
+                if (len)
+                {
+                    memcpy(buf, sf.samples.data() + sf.ranges[range].sample + size_t(pos - sf.ranges[range].offset), len);
+                }
+            }
+            pos += len;
+            return true;
+        }
+    } is(*this);
+
+    *fp = FileFingerprint();
+    fp->genfingerprint(&is, mtime);
+    return fp->isvalid;
+}
+
+namespace {
+// fsid, size, mtime and CRCs of a FingerprintCache record
+struct CachedFingerprint : public Cachable
+{
+    handle fsid;
+    m_off_t size;
+    m_time_t mtime;
+    int32_t crc[4];
+
+    static const size_t SIZE = sizeof(handle) + sizeof(m_off_t) + sizeof(m_time_t) + sizeof(int32_t[4]);
+
+    bool serialize(string* d) override
+    {
+        d->append((const char*)&fsid, sizeof fsid);
+        d->append((const char*)&size, sizeof size);
+        d->append((const char*)&mtime, sizeof mtime);
+        d->append((const char*)crc, sizeof crc);
+        return true;
+    }
+};
+
+} // anonymous
+
+bool FingerprintCache::Key::operator<(const Key& other) const
+{
+    if (fsid != other.fsid)
+    {
+        return fsid < other.fsid;
+    }
+
+    if (size != other.size)
+    {
+        return size < other.size;
+    }
+
+    return mtime < other.mtime;
+}
+
+FingerprintCache::FingerprintCache(DbTable* table, const SymmCipher& key)
+    : mTable(table)
+    , mKey(new SymmCipher)
+{
+    mKey->setkey(key.key);
+
+    uint32_t id;
+    string data;
+
+    mTable->rewind();
+    while (mTable->next(&id, &data, mKey.get()))
+    {
+        if (data.size() != CachedFingerprint::SIZE)
+        {
+            continue;
+        }
+
+        const char* ptr = data.data();
+        Key k;
+        Entry e;
+
+        k.fsid = MemAccess::get<handle>(ptr);
+        ptr += sizeof k.fsid;
+        k.size = MemAccess::get<m_off_t>(ptr);
+        ptr += sizeof k.size;
+        k.mtime = MemAccess::get<m_time_t>(ptr);
+        ptr += sizeof k.mtime;
+        memcpy(e.crc, ptr, sizeof e.crc);
+        e.dbid = id;
+
+        mEntries[k] = e;
+    }
+
+    LOG_debug << "Fingerprint cache loaded: " << mEntries.size() << " files";
+}
+
+FingerprintCache::~FingerprintCache()
+{
+    flush();
+}
+
+bool FingerprintCache::lookup(FileAccess* fa, FileFingerprint* fp)
+{
+    if (!fa->fsidvalid)
+    {
+        return false;
+    }
+
+    Key k = { fa->fsid, fa->size, fa->mtime };
+
+    std::lock_guard<std::mutex> g(mMutex);
+    std::map<Key, Entry>::iterator it = mEntries.find(k);
+    if (it == mEntries.end())
+    {
+        return false;
+    }
+
+    fp->size = k.size;
+    fp->mtime = k.mtime;
+    memcpy(fp->crc, it->second.crc, sizeof fp->crc);
+    fp->isvalid = true;
+    return true;
+}
+
+void FingerprintCache::store(FileAccess* fa, const FileFingerprint& fp)
+{
+    if (!fa->fsidvalid || !fp.isvalid || fp.size != fa->size || fp.mtime != fa->mtime)
+    {
+        return;
+    }
+
+    Key k = { fa->fsid, fp.size, fp.mtime };
+
+    std::lock_guard<std::mutex> g(mMutex);
+
+    if (mEntries.size() >= MAXENTRIES)
+    {
+        LOG_debug << "Fingerprint cache full, starting over";
+        mEntries.clear();
+        mPending.clear();
+        mTable->truncate();
+    }
+
+    std::pair<std::map<Key, Entry>::iterator, bool> r = mEntries.insert(std::make_pair(k, Entry()));
+    if (!r.second && !memcmp(r.first->second.crc, fp.crc, sizeof fp.crc))
+    {
+        return;
+    }
+
+    if (r.second)
+    {
+        r.first->second.dbid = 0;
+    }
+    memcpy(r.first->second.crc, fp.crc, sizeof fp.crc);
+
+    mPending.push_back(k);
+    if (mPending.size() >= FLUSHENTRIES)
+    {
+        flushlocked();
+    }
+}
+
+void FingerprintCache::flush()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    flushlocked();
+}
+
+void FingerprintCache::flushlocked()
+{
+    if (mPending.empty())
+    {
+        return;
+    }
+
+    dbrecord_vector records;
+    records.reserve(mPending.size());
+
+    for (size_t i = 0; i < mPending.size(); i++)
+    {
+        std::map<Key, Entry>::iterator it = mEntries.find(mPending[i]);
+        if (it == mEntries.end())
+        {
+            continue;
+        }
+
+        CachedFingerprint record;
+        record.fsid = it->first.fsid;
+        record.size = it->first.size;
+        record.mtime = it->first.mtime;
+        memcpy(record.crc, it->second.crc, sizeof record.crc);
+        record.dbid = int32_t(it->second.dbid);
+
+        mTable->addbatch(&records, 0, &record, mKey.get());
+        it->second.dbid = uint32_t(record.dbid);
+    }
+    mPending.clear();
+
+    mTable->begin();
+    if (mTable->putmany(records))
+    {
+        mTable->commit();
+    }
+    else
+    {
+        LOG_err << "Unable to write the fingerprint cache";
+        mTable->abort();
+    }
+}
+
+void FingerprintCache::remove()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    mPending.clear();
+    mEntries.clear();
+    mTable->remove();
+}
+
+bool FingerprintCache::genfingerprint(FingerprintCache* cache, FileFingerprint* fp, FileAccess* fa, bool ignoremtime)
+{
+    FileFingerprint cached;
+    if (!cache || !cache->lookup(fa, &cached))
+    {
+        bool changed = fp->genfingerprint(fa, ignoremtime);
+        if (cache)
+        {
+            cache->store(fa, *fp);
+        }
+        return changed;
+    }
+
+    // as FileFingerprint::genfingerprint() would have found it
+    bool changed = false;
+
+    if (fp->mtime != cached.mtime)
+    {
+        fp->mtime = cached.mtime;
+        changed = !ignoremtime;
+    }
+
+    if (fp->size != cached.size)
+    {
+        fp->size = cached.size;
+        changed = true;
+    }
+
+    if (memcmp(fp->crc, cached.crc, sizeof fp->crc))
+    {
+        memcpy(fp->crc, cached.crc, sizeof fp->crc);
+        changed = true;
+    }
+
+    if (!fp->isvalid)
+    {
+        fp->isvalid = true;
+        changed = true;
+    }
+
+    return changed;
+}
 } // namespace
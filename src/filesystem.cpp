@@ -121,13 +121,84 @@ void FileSystemAccess::name2local(string* filename) const
     path2local(&t, filename);
 }
 
+// whether NFC leaves the string as it is: ASCII, and code points that NFC
+// recomposes to themselves (no decomposition, or one not excluded from
+// composition) and can't combine with the previous one. Conservative: a
+// string that fails this, including invalid UTF-8, goes through utf8proc_NFC()
+static bool isnfc(const char* s, size_t size)
+{
+    size_t i = 0;
+
+    // eight bytes at a time while they're ASCII
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof word);
+        if (word & 0x8080808080808080ULL)
+        {
+            break;
+        }
+    }
+
+    while (i < size)
+    {
+        if (!(s[i] & 0x80))
+        {
+            i++;
+            continue;
+        }
+
+        utf8proc_int32_t c;
+        utf8proc_ssize_t n = utf8proc_iterate((const utf8proc_uint8_t*)s + i, utf8proc_ssize_t(size - i), &c);
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        // marks, second characters of a composition and Hangul vowels and final consonants
+        const utf8proc_property_t* p = utf8proc_get_property(c);
+        if (p->combining_class
+                || (p->comb_index != UINT16_MAX && p->comb_index >= 0x8000)
+                || (c >= 0x1160 && c < 0x1200))
+        {
+            return false;
+        }
+
+        // canonical decompositions that aren't composed back: excluded, singletons
+        // and the ones starting with a mark
+        if (p->decomp_seqindex != UINT16_MAX && !p->decomp_type)
+        {
+            utf8proc_int32_t decomposed[4];
+            int boundclass = 0;
+            if (p->comp_exclusion || !(p->decomp_seqindex >> 13)
+                    || utf8proc_decompose_char(c, decomposed, 4, UTF8PROC_DECOMPOSE, &boundclass) > 4
+                    || utf8proc_get_property(decomposed[0])->combining_class)
+            {
+                return false;
+            }
+        }
+
+        i += size_t(n);
+    }
+
+    return true;
+}
+
 void FileSystemAccess::normalize(string* filename) const
 {
     if (!filename) return;
 
     const char* cfilename = filename->c_str();
     size_t fnsize = filename->size();
+
+    // most names need no change
+    if (isnfc(cfilename, fnsize))
+    {
+        return;
+    }
+
     string result;
+    result.reserve(fnsize);
 
     for (size_t i = 0; i < fnsize; )
     {
@@ -154,7 +225,7 @@ void FileSystemAccess::normalize(string* filename) const
         i += strlen(substring);
     }
 
-    *filename = result;
+    filename->swap(result);
 }
 
 // convert from local encoding, then unescape escaped forbidden characters
@@ -177,56 +248,107 @@ DirNotify::DirNotify(string* clocalbasepath, string* cignore)
     failreason = "Not initialized";
     error = 0;
     sync = NULL;
+
+    for (int q = 0; q < NUMQUEUES; q++)
+    {
+        popped[q] = 0;
+    }
 }
 
 // notify base LocalNode + relative path/filename
-void DirNotify::notify(notifyqueue q, LocalNode* l, const char* localpath, size_t len, bool immediate)
+void DirNotify::notify(notifyqueue q, LocalNode* l, const char* localpath, size_t len, bool immediate, const NotifyAttributes* attributes)
 {
     string path;
     path.assign(localpath, len);
 
+    string fullpath;
+
 #ifdef ENABLE_SYNC
-    if ((q == DirNotify::DIREVENTS || q == DirNotify::EXTRA)
-            && notifyq[q].size()
-            && notifyq[q].back().localnode == l
-            && notifyq[q].back().path == path)
+    if (q == DirNotify::DIREVENTS || q == DirNotify::EXTRA)
     {
-        if (notifyq[q].back().timestamp)
+        if (immediate)
         {
-            notifyq[q].back().timestamp = immediate ? 0 : Waiter::ds;
+            if (notifyq[q].size()
+                    && notifyq[q].back().localnode == l
+                    && notifyq[q].back().path == path)
+            {
+                if (notifyq[q].back().timestamp)
+                {
+                    notifyq[q].back().timestamp = 0;
+                }
+                LOG_debug << "Repeated notification skipped";
+                return;
+            }
+        }
+        else
+        {
+            if (l)
+            {
+                l->getlocalpath(&fullpath);
+            }
+
+            if (localpath)
+            {
+                if (fullpath.size())
+                {
+                    fullpath.append(sync->client->fsaccess->localseparator);
+                }
+
+                fullpath.append(path);
+            }
+
+            uint64_t position;
+            string parent = parentpath(fullpath);
+
+            if (q == DirNotify::DIREVENTS && parent.size() && pending(q, pendingrescans, parent, &position))
+            {
+                // the folder's children are going to be rescanned anyway:
+                // just restart the quiet period of the rescan
+                LOG_verbose << "Notification merged into a folder rescan";
+                discard(q, position);
+                append(q, NULL, parent, string(), false, true);
+                sync->client->syncactivity = true;
+                return;
+            }
+
+            if (pending(q, pendingpaths[q], fullpath, &position))
+            {
+                LOG_verbose << "Repeated notification coalesced";
+                discard(q, position);
+            }
         }
-        LOG_debug << "Repeated notification skipped";
-        return;
     }
 
     if (!immediate && sync && !sync->initializing && q == DirNotify::DIREVENTS)
     {
-        string tmppath;
-        if (l)
-        {
-            l->getlocalpath(&tmppath);
-        }
-
-        if (localpath)
+        attr_map::iterator ait;
+        NotifyAttributes opened;
+        bool deleted = false;
+        if (!attributes)
         {
-            if (tmppath.size())
+            auto fa = sync->client->fsaccess->newfileaccess(false);
+            if (fa->fopen(&fullpath, false, false))
             {
-                tmppath.append(sync->client->fsaccess->localseparator);
+                opened.type = fa->type;
+                opened.size = fa->size;
+                opened.mtime = fa->mtime;
+                opened.fsid = fa->fsidvalid ? fa->fsid : UNDEF;
+                attributes = &opened;
+            }
+            else
+            {
+                deleted = !fa->retry;
             }
-
-            tmppath.append(path);
         }
-        attr_map::iterator ait;
-        auto fa = sync->client->fsaccess->newfileaccess(false);
-        bool success = fa->fopen(&tmppath, false, false);
+
         LocalNode *ll = sync->localnodebypath(l, &path);
-        if ((!ll && !success && !fa->retry) // deleted file
-            || (ll && success && ll->node && ll->node->localnode == ll
+        if ((!ll && deleted) // deleted file
+            || (ll && attributes && ll->node && ll->node->localnode == ll
                 && (ll->type != FILENODE || (*(FileFingerprint *)ll) == (*(FileFingerprint *)ll->node))
                 && (ait = ll->node->attrs.map.find('n')) != ll->node->attrs.map.end()
                 && ait->second == ll->name
-                && fa->fsidvalid && fa->fsid == ll->fsid && fa->type == ll->type
-                && (ll->type != FILENODE || (ll->mtime == fa->mtime && ll->size == fa->size))))
+                && attributes->fsid != UNDEF && attributes->fsid == ll->fsid && attributes->type == ll->type
+                && (ll->type != FILENODE || (ll->mtime == attributes->mtime && ll->size == attributes->size))))
         {
             LOG_debug << "Self filesystem notification skipped";
             return;
@@ -239,10 +361,158 @@ void DirNotify::notify(notifyqueue q, LocalNode* l, const char* localpath, size_
     }
 #endif
 
+    append(q, l, path, fullpath, immediate, false);
+}
+
+void DirNotify::pop(notifyqueue q)
+{
+    unindex(q, notifyq[q].front(), popped[q]);
+
+    notifyq[q].pop_front();
+    popped[q]++;
+}
+
+void DirNotify::append(notifyqueue q, LocalNode* l, const string& path, const string& fullpath, bool immediate, bool rescan)
+{
     notifyq[q].resize(notifyq[q].size() + 1);
     notifyq[q].back().timestamp = immediate ? 0 : Waiter::ds;
     notifyq[q].back().localnode = l;
     notifyq[q].back().path = path;
+    notifyq[q].back().fullpath = fullpath;
+    notifyq[q].back().rescan = rescan;
+
+    uint64_t position = popped[q] + notifyq[q].size() - 1;
+
+    if (rescan)
+    {
+        pendingrescans[path] = position;
+    }
+    else if (fullpath.size())
+    {
+        pendingpaths[q][fullpath] = position;
+
+        string parent;
+        if (q == DirNotify::DIREVENTS && (parent = parentpath(fullpath)).size())
+        {
+            PendingChildren& children = pendingchildren[parent];
+            children.count++;
+            children.positions.push_back(position);
+
+            if (children.count >= COLLAPSE_CHILDREN)
+            {
+                collapse(parent);
+            }
+        }
+    }
+}
+
+// is a live notification queued under this key? returns its position
+bool DirNotify::pending(notifyqueue q, const std::unordered_map<string, uint64_t>& index, const string& key, uint64_t* position) const
+{
+    std::unordered_map<string, uint64_t>::const_iterator it = index.find(key);
+    if (it == index.end())
+    {
+        return false;
+    }
+
+    assert(it->second >= popped[q] && it->second - popped[q] < notifyq[q].size());
+
+    // deactivated by the deletion of its LocalNode
+    if (notifyq[q][size_t(it->second - popped[q])].localnode == (LocalNode*)~0)
+    {
+        return false;
+    }
+
+    *position = it->second;
+    return true;
+}
+
+// forget a notification that leaves the queue or gets discarded
+void DirNotify::unindex(notifyqueue q, const Notification& n, uint64_t position)
+{
+    std::unordered_map<string, uint64_t>::iterator it;
+
+    if (n.rescan)
+    {
+        if ((it = pendingrescans.find(n.path)) != pendingrescans.end() && it->second == position)
+        {
+            pendingrescans.erase(it);
+        }
+        return;
+    }
+
+    if (n.fullpath.empty())
+    {
+        return;
+    }
+
+    if ((it = pendingpaths[q].find(n.fullpath)) != pendingpaths[q].end() && it->second == position)
+    {
+        pendingpaths[q].erase(it);
+    }
+
+    if (q == DirNotify::DIREVENTS)
+    {
+        std::unordered_map<string, PendingChildren>::iterator cit = pendingchildren.find(parentpath(n.fullpath));
+        if (cit != pendingchildren.end() && !--cit->second.count)
+        {
+            pendingchildren.erase(cit);
+        }
+    }
+}
+
+// discarded notifications stay in the queue, deactivated, until popped
+void DirNotify::discard(notifyqueue q, uint64_t position)
+{
+    Notification& n = notifyq[q][size_t(position - popped[q])];
+
+    unindex(q, n, position);
+
+    n.localnode = (LocalNode*)~0;
+    n.rescan = false;
+    string().swap(n.path);
+    string().swap(n.fullpath);
+}
+
+// replace the queued notifications for the children of a folder with a
+// single rescan of the folder
+void DirNotify::collapse(const string& parent)
+{
+    std::unordered_map<string, PendingChildren>::iterator it = pendingchildren.find(parent);
+    vector<uint64_t> positions = std::move(it->second.positions);
+    unsigned count = it->second.count;
+    pendingchildren.erase(it);
+
+    for (size_t i = positions.size(); i--; )
+    {
+        // (already discarded or popped otherwise)
+        if (positions[i] >= popped[DIREVENTS] && notifyq[DIREVENTS][size_t(positions[i] - popped[DIREVENTS])].fullpath.size())
+        {
+            discard(DIREVENTS, positions[i]);
+        }
+    }
+
+    LOG_debug << "Folder notifications collapsed into a rescan: " << count;
+    append(DIREVENTS, NULL, parent, string(), false, true);
+}
+
+// full path of the folder containing a full path (empty if none)
+string DirNotify::parentpath(const string& fullpath) const
+{
+#ifdef ENABLE_SYNC
+    const string& separator = sync->client->fsaccess->localseparator;
+
+    for (size_t p = fullpath.size(); p >= separator.size() && p; )
+    {
+        p -= separator.size();
+        if (!memcmp(fullpath.data() + p, separator.data(), separator.size()))
+        {
+            return fullpath.substr(0, p);
+        }
+    }
+#endif
+
+    return string();
 }
 
 // default: no fingerprint
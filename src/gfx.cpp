@@ -90,83 +90,258 @@ const char* GfxProc::supportedvideoformats()
     return NULL;
 }
 
-void *GfxProc::threadEntryPoint(void *param)
+GfxProc* GfxProc::newprocessor()
 {
-    GfxProc* gfxProcessor = (GfxProc*)param;
-    gfxProcessor->loop();
     return NULL;
 }
 
-void GfxProc::loop()
+void GfxProc::setworkers(unsigned n)
 {
-    GfxJob *job = NULL;
-    while (!finished)
+    if (n < 1 || n > MAXWORKERS)
+    {
+        return;
+    }
+
+    bool started = !workers.empty();
+    stopworkers();
+    numworkers = n;
+
+    if (started)
     {
-        waiter.init(NEVER);
-        waiter.wait();
-        while ((job = requests.pop()))
+        startworkers();
+    }
+}
+
+unsigned GfxProc::getworkers()
+{
+    return numworkers;
+}
+
+void GfxProc::setworkerlimit(unsigned n)
+{
+    if (n == workerlimit)
+    {
+        return;
+    }
+
+    bool started = !workers.empty();
+    stopworkers();
+    workerlimit = n;
+
+    if (started)
+    {
+        startworkers();
+    }
+}
+
+void GfxProc::startworkers()
+{
+    unsigned n = workerlimit && workerlimit < numworkers ? workerlimit : numworkers;
+    for (unsigned i = 0; i < n; i++)
+    {
+        GfxProc* processor = newprocessor();
+        if (!processor)
         {
-            if (finished)
+            break;
+        }
+        processor->client = client;
+        processors.emplace_back(processor);
+    }
+
+    if (processors.empty())
+    {
+        LOG_debug << "Processing media files one at a time";
+        workers.emplace_back([this]() { loop(this); });
+        return;
+    }
+
+    LOG_debug << "Processing media files with " << processors.size() << " workers";
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        GfxProc* processor = processors[i].get();
+        workers.emplace_back([this, processor]() { loop(processor); });
+    }
+}
+
+// completes the jobs in progress, the queued ones stay for the next workers
+void GfxProc::stopworkers()
+{
+    {
+        std::lock_guard<std::mutex> g(workmutex);
+        finished = true;
+    }
+    workchanged.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    workers.clear();
+    processors.clear();
+
+    std::lock_guard<std::mutex> g(workmutex);
+    finished = false;
+}
+
+void GfxProc::loop(GfxProc* processor)
+{
+    for (;;)
+    {
+        GfxJob *job = NULL;
+
+        {
+            std::unique_lock<std::mutex> lock(workmutex);
+            workchanged.wait(lock, [this, &job]() { return finished || (job = requests.pop()); });
+
+            if (!job)
             {
-                delete job;
-                break;
+                return;
             }
+        }
 
-            mutex.lock();
-            LOG_debug << "Processing media file: " << job->h;
+        process(job, processor);
 
-            // (this assumes that the width of the largest dimension is max)
-            if (readbitmap(NULL, &job->localfilename, dimensions[sizeof dimensions/sizeof dimensions[0]-1][0]))
-            {
-                for (unsigned i = 0; i < job->imagetypes.size(); i++)
-                {
-                    // successively downscale the original image
-                    string* jpeg = new string();
-                    int w = dimensions[job->imagetypes[i]][0];
-                    int h = dimensions[job->imagetypes[i]][1];
+        responses.push(job);
+        client->waiter->notify();
+    }
+}
 
-                    if (job->imagetypes[i] == PREVIEW && this->w < w && this->h < h )
-                    {
-                        LOG_debug << "Skipping upsizing of preview";
-                        w = this->w;
-                        h = this->h;
-                    }
+void GfxProc::process(GfxJob* job, GfxProc* processor)
+{
+    std::lock_guard<std::mutex> g(processor->mutex);
+    LOG_debug << "Processing media file: " << job->h;
 
-                    if (!resizebitmap(w, h, jpeg))
-                    {
-                        delete jpeg;
-                        jpeg = NULL;
-                    }
-                    job->images.push_back(jpeg);
-                }
-                freebitmap();
+    // decode only as large as the largest requested image (they are produced
+    // from this one bitmap, each one downscaled from the previous one)
+    int size = 0;
+    for (unsigned i = 0; i < job->imagetypes.size(); i++)
+    {
+        size = std::max(size, dimensions[job->imagetypes[i]][0]);
+    }
+
+    if (processor->readbitmap(NULL, &job->localfilename, size))
+    {
+        for (unsigned i = 0; i < job->imagetypes.size(); i++)
+        {
+            // successively downscale the original image
+            string* jpeg = new string();
+            int w = dimensions[job->imagetypes[i]][0];
+            int h = dimensions[job->imagetypes[i]][1];
+
+            if (job->imagetypes[i] == PREVIEW && processor->w < w && processor->h < h )
+            {
+                LOG_debug << "Skipping upsizing of preview";
+                w = processor->w;
+                h = processor->h;
             }
-            else
+
+            if (!processor->resizebitmap(w, h, jpeg))
             {
-                for (unsigned i = 0; i < job->imagetypes.size(); i++)
-                {
-                    job->images.push_back(NULL);
-                }
+                delete jpeg;
+                jpeg = NULL;
             }
+            job->images.push_back(jpeg);
+        }
+        processor->freebitmap();
 
-            mutex.unlock();
-            responses.push(job);
-            client->waiter->notify();
+        tocache(job);
+    }
+    else
+    {
+        for (unsigned i = 0; i < job->imagetypes.size(); i++)
+        {
+            job->images.push_back(NULL);
         }
     }
+}
 
-    while ((job = requests.pop()))
+bool GfxProc::fromcache(GfxJob* job)
+{
+    std::lock_guard<std::mutex> g(cachemutex);
+
+    auto it = cacheindex.find(&job->fingerprint);
+    if (it == cacheindex.end())
     {
-        delete job;
+        return false;
     }
 
-    while ((job = responses.pop()))
+    const std::map<fatype, string>& images = it->second->second;
+    for (unsigned i = 0; i < job->imagetypes.size(); i++)
     {
-        for (unsigned i = 0; i < job->imagetypes.size(); i++)
+        if (images.find(job->imagetypes[i]) == images.end())
         {
-            delete job->images[i];
+            return false;
         }
-        delete job;
+    }
+
+    for (unsigned i = 0; i < job->imagetypes.size(); i++)
+    {
+        job->images.push_back(new string(images.find(job->imagetypes[i])->second));
+    }
+
+    cache.splice(cache.begin(), cache, it->second);
+    return true;
+}
+
+void GfxProc::tocache(GfxJob* job)
+{
+    if (!job->fingerprint.isvalid)
+    {
+        return;
+    }
+
+    std::map<fatype, string> images;
+    size_t size = 0;
+    for (unsigned i = 0; i < job->images.size(); i++)
+    {
+        if (!job->images[i])
+        {
+            return;
+        }
+
+        images[job->imagetypes[i]] = *job->images[i];
+        size += job->images[i]->size();
+    }
+
+    if (size > MAXCACHESIZE / 16)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(cachemutex);
+
+    auto it = cacheindex.find(&job->fingerprint);
+    if (it != cacheindex.end())
+    {
+        // keep the images of the other types too
+        gfxcache_list::iterator entry = it->second;
+        for (auto& image : entry->second)
+        {
+            cachesize -= image.second.size();
+            if (images.find(image.first) == images.end())
+            {
+                size += image.second.size();
+                images[image.first] = std::move(image.second);
+            }
+        }
+
+        cacheindex.erase(it);
+        cache.erase(entry);
+    }
+
+    cache.emplace_front(job->fingerprint, std::move(images));
+    cacheindex[&cache.front().first] = cache.begin();
+    cachesize += size;
+
+    while (cachesize > MAXCACHESIZE)
+    {
+        for (auto& image : cache.back().second)
+        {
+            cachesize -= image.second.size();
+        }
+
+        cacheindex.erase(&cache.back().first);
+        cache.pop_back();
     }
 }
 
@@ -283,7 +458,7 @@ void GfxProc::transform(int& w, int& h, int& rw, int& rh, int& px, int& py)
 
 // load bitmap image, generate all designated sizes, attach to specified upload/node handle
 // FIXME: move to a worker thread to keep the engine nonblocking
-int GfxProc::gendimensionsputfa(FileAccess* /*fa*/, string* localfilename, handle th, SymmCipher* key, int missing, bool checkAccess)
+int GfxProc::gendimensionsputfa(FileAccess* /*fa*/, string* localfilename, handle th, SymmCipher* key, int missing, bool checkAccess, const FileFingerprint* fingerprint)
 {
     if (SimpleLogger::logCurrentLevel >= logDebug)
     {
@@ -311,8 +486,33 @@ int GfxProc::gendimensionsputfa(FileAccess* /*fa*/, string* localfilename, handl
         return 0;
     }
 
-    requests.push(job);
-    waiter.notify();
+    // uploads wait for their attributes, existing nodes don't
+    job->urgent = !checkAccess;
+
+    if (fingerprint && fingerprint->isvalid)
+    {
+        job->fingerprint = *fingerprint;
+
+        if (fromcache(job))
+        {
+            LOG_debug << "Reusing the images of an identical file: " << th;
+            int count = int(job->imagetypes.size());
+            responses.push(job);
+            client->waiter->notify();
+            return count;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> g(workmutex);
+        requests.push(job);
+    }
+    workchanged.notify_one();
+
+    if (workers.empty())
+    {
+        startworkers();
+    }
     return int(job->imagetypes.size());
 }
 
@@ -368,25 +568,48 @@ GfxProc::GfxProc()
 {
     client = NULL;
     finished = false;
-    thread.start(threadEntryPoint, this);
+    numworkers = 1;
+    workerlimit = 0;
+    cachesize = 0;
 }
 
 GfxProc::~GfxProc()
 {
-    finished = true;
-    waiter.notify();
-    thread.join();
+    stopworkers();
+
+    GfxJob *job = NULL;
+    while ((job = requests.pop()))
+    {
+        delete job;
+    }
+
+    while ((job = responses.pop()))
+    {
+        for (unsigned i = 0; i < job->images.size(); i++)
+        {
+            delete job->images[i];
+        }
+        delete job;
+    }
 }
 
 GfxJobQueue::GfxJobQueue()
 {
-
+    urgentjobs = 0;
 }
 
 void GfxJobQueue::push(GfxJob *job)
 {
     mutex.lock();
-    jobs.push_back(job);
+    if (job->urgent)
+    {
+        jobs.insert(jobs.begin() + urgentjobs, job);
+        urgentjobs++;
+    }
+    else
+    {
+        jobs.push_back(job);
+    }
     mutex.unlock();
 }
 
@@ -400,13 +623,17 @@ GfxJob *GfxJobQueue::pop()
     }
     GfxJob *job = jobs.front();
     jobs.pop_front();
+    if (urgentjobs)
+    {
+        urgentjobs--;
+    }
     mutex.unlock();
     return job;
 }
 
 GfxJob::GfxJob()
 {
-
+    urgent = false;
 }
 
 } // namespace
@@ -103,18 +103,87 @@ const char *GfxProcFreeImage::supportedformatsFfmpeg()
             ".qt.sls.tmf.trp.ts.ty.vc1.vob.vr.webm.wmv.";
 }
 
+// give up on the videos that take longer than this to open, seek and decode
+static const int FFMPEG_TIMEOUT_SECS = 10;
+
+// interrupts the blocking calls of libavformat once the deadline has passed
+static int ffmpegInterrupt(void* deadline)
+{
+    return std::chrono::steady_clock::now() > *static_cast<std::chrono::steady_clock::time_point*>(deadline);
+}
+
+// convert a decoded frame to a 24-bit bitmap, downscaled so that its shorter side
+// still covers size (as thumbnails are cropped squares)
+static FIBITMAP* frameToBitmap(AVFrame* frame, int size)
+{
+    int width = frame->width;
+    int height = frame->height;
+    int shorter = std::min(width, height);
+    if (shorter <= 0)
+    {
+        LOG_warn << "Invalid frame dimensions: " << width << ", " << height;
+        return NULL;
+    }
+
+    int targetWidth = width;
+    int targetHeight = height;
+    if (size > 0 && shorter > size)
+    {
+        targetWidth = std::max(1, int(int64_t(width) * size / shorter));
+        targetHeight = std::max(1, int(int64_t(height) * size / shorter));
+    }
+
+    AVPixelFormat sourcePixelFormat = AVPixelFormat(frame->format);
+    AVPixelFormat targetPixelFormat = AV_PIX_FMT_BGR24; //raw data expected by freeimage is in this format
+    SwsContext* swsContext = sws_getContext(width, height, sourcePixelFormat,
+                                            targetWidth, targetHeight, targetPixelFormat,
+                                            targetWidth == width ? SWS_FAST_BILINEAR : SWS_AREA, NULL, NULL, NULL);
+    if (!swsContext)
+    {
+        LOG_warn << "SWS Context not found: " << sourcePixelFormat;
+        return NULL;
+    }
+
+    FIBITMAP* dib = FreeImage_Allocate(targetWidth, targetHeight, 24);
+    if (!dib)
+    {
+        LOG_warn << "Error allocating bitmap";
+        sws_freeContext(swsContext);
+        return NULL;
+    }
+
+    // scale straight into the bitmap, whose rows are stored bottom-up
+    uint8_t* data[4] = { FreeImage_GetScanLine(dib, targetHeight - 1), NULL, NULL, NULL };
+    int linesize[4] = { -int(FreeImage_GetPitch(dib)), 0, 0, 0 };
+    int scalingResult = sws_scale(swsContext, frame->data, frame->linesize, 0, height, data, linesize);
+    sws_freeContext(swsContext);
+
+    if (scalingResult <= 0)
+    {
+        LOG_warn << "Error scaling frame";
+        FreeImage_Unload(dib);
+        return NULL;
+    }
+
+    return dib;
+}
+
 bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int size)
 {
 #ifndef DEBUG
     av_log_set_level(AV_LOG_PANIC);
 #endif
 
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(FFMPEG_TIMEOUT_SECS);
+
     // Open video file
     AVFormatContext* formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = ffmpegInterrupt;
+    formatContext->interrupt_callback.opaque = &deadline;
     if (avformat_open_input(&formatContext, imagePath->data(), NULL, NULL))
     {
         LOG_warn << "Error opening video: " << imagePath;
-        return NULL;
+        return false;
     }
 
     // Get stream information
@@ -122,7 +191,7 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int s
     {
         LOG_warn << "Stream info not found: " << imagePath;
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
     // Find first video stream type
@@ -142,7 +211,7 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int s
     {
         LOG_warn << "Video stream not found: " << imagePath;
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
     // Get codec context to determine video frame dimensions
@@ -153,26 +222,14 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int s
     {
         LOG_warn << "Invalid video dimensions: " << width << ", " << height;
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
     if (codecContext.pix_fmt == AV_PIX_FMT_NONE)
     {
         LOG_warn << "Invalid pixel format: " << codecContext.pix_fmt;
         avformat_close_input(&formatContext);
-        return NULL;
-    }
-
-    AVPixelFormat sourcePixelFormat = codecContext.pix_fmt;
-    AVPixelFormat targetPixelFormat = AV_PIX_FMT_BGR24; //raw data expected by freeimage is in this format
-    SwsContext* swsContext = sws_getContext(width, height, sourcePixelFormat,
-                                            width, height, targetPixelFormat,
-                                            SWS_FAST_BILINEAR, NULL, NULL, NULL);
-    if (!swsContext)
-    {
-        LOG_warn << "SWS Context not found: " << sourcePixelFormat;
-        avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
     // Find decoder for video stream
@@ -181,59 +238,48 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int s
     if (!decoder)
     {
         LOG_warn << "Codec not found: " << codecId;
-        sws_freeContext(swsContext);
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
-    // Force seeking to key frames
+    // Force seeking to key frames, and decode nothing else: the frame taken is the
+    // keyframe at or before the seeking point
     formatContext->seek2any = false;
     videoStream->skip_to_keyframe = true;
+    codecContext.skip_frame = AVDISCARD_NONKEY;
     if (decoder->capabilities & CAP_TRUNCATED)
     {
         codecContext.flags |= CAP_TRUNCATED;
     }
 
-    // Open codec
-    if (avcodec_open2(&codecContext, decoder, NULL) < 0)
+    // let the decoder downscale by powers of two (only some codecs can) while the
+    // shorter side still covers the requested size
+    int lowres = 0;
+    while (size > 0 && lowres < decoder->max_lowres && (std::min(width, height) >> (lowres + 1)) >= size)
     {
-        LOG_warn << "Error opening codec: " << codecId;
-        sws_freeContext(swsContext);
-        avformat_close_input(&formatContext);
-        return NULL;
+        lowres++;
     }
+    codecContext.lowres = lowres;
 
-    //Allocate video frames
-    AVFrame* videoFrame = av_frame_alloc();
-    AVFrame* targetFrame = av_frame_alloc();
-    if (!videoFrame || !targetFrame)
+    // Open codec (not thread safe on older libavcodec versions)
+    gfxMutex.lock();
+    int opened = avcodec_open2(&codecContext, decoder, NULL);
+    gfxMutex.unlock();
+    if (opened < 0)
     {
-        LOG_warn << "Error allocating video frames";
-        if (videoFrame)
-        {
-            av_frame_free(&videoFrame);
-        }
-        if (targetFrame)
-        {
-            av_frame_free(&targetFrame);
-        }
-        sws_freeContext(swsContext);
+        LOG_warn << "Error opening codec: " << codecId;
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
-    targetFrame->format = targetPixelFormat;
-    targetFrame->width = width;
-    targetFrame->height = height;
-    if (av_image_alloc(targetFrame->data, targetFrame->linesize, targetFrame->width, targetFrame->height, targetPixelFormat, 32) < 0)
+    //Allocate video frame
+    AVFrame* videoFrame = av_frame_alloc();
+    if (!videoFrame)
     {
-        LOG_warn << "Error allocating frame";
-        av_frame_free(&videoFrame);
-        av_frame_free(&targetFrame);
+        LOG_warn << "Error allocating video frame";
         avcodec_close(&codecContext);
-        sws_freeContext(swsContext);
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
     // Calculation of seeking point. We need to rescale time units (seconds) to AVStream.time_base units to perform the seeking
@@ -258,12 +304,9 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int s
     {
         LOG_warn << "Error seeking video";
         av_frame_free(&videoFrame);
-        av_freep(&targetFrame->data[0]);
-        av_frame_free(&targetFrame);
         avcodec_close(&codecContext);
-        sws_freeContext(swsContext);
         avformat_close_input(&formatContext);
-        return NULL;
+        return false;
     }
 
     AVPacket packet;
@@ -271,116 +314,80 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, string* imagePath, int s
     packet.data = NULL;
     packet.size = 0;
 
-    int decodedBytes;
-    int scalingResult;
     int actualNumFrames = 0;
     int frameExtracted  = 0;
 
     // Read frames until succesfull decodification or reach limit of 220 frames
-    while (actualNumFrames < 220 && av_read_frame(formatContext, &packet) >= 0)
-    {
-       if (packet.stream_index == videoStream->index)
-       {
-           decodedBytes = avcodec_decode_video2(&codecContext, videoFrame, &frameExtracted, &packet);
-           if (frameExtracted && decodedBytes >= 0)
-           {
-                if (sourcePixelFormat != codecContext.pix_fmt)
-                {
-                    LOG_warn << "Error: pixel format changed from " << sourcePixelFormat << " to " << codecContext.pix_fmt;
-                    av_packet_unref(&packet);
-                    av_frame_free(&videoFrame);
-                    avcodec_close(&codecContext);
-                    av_freep(&targetFrame->data[0]);
-                    av_frame_free(&targetFrame);
-                    sws_freeContext(swsContext);
-                    avformat_close_input(&formatContext);
-                    return NULL;
-                }
-
-                scalingResult = sws_scale(swsContext, videoFrame->data, videoFrame->linesize,
-                                     0, codecContext.height, targetFrame->data, targetFrame->linesize);
-
-                if (scalingResult > 0)
-                {
-                    int fav = targetPixelFormat;
-                    int imagesize = avpicture_get_size((enum AVPixelFormat)fav, width, height);
-                    FIMEMORY fmemory;
-                    fmemory.data = malloc(imagesize);
-
-                    if (avpicture_layout((AVPicture *)targetFrame, (enum AVPixelFormat)fav,
-                                    width, height, (unsigned char*)fmemory.data, imagesize) <= 0)
-                    {
-                        LOG_warn << "Error copying frame";
-                        av_packet_unref(&packet);
-                        av_frame_free(&videoFrame);
-                        avcodec_close(&codecContext);
-                        av_freep(&targetFrame->data[0]);
-                        av_frame_free(&targetFrame);
-                        sws_freeContext(swsContext);
-                        avformat_close_input(&formatContext);
-                        free (fmemory.data);
-                        return NULL;
-                    }
-
-                    //int pitch = imagesize/height;
-                    int pitch = width*3;
-
-                    if (!(dib = FreeImage_ConvertFromRawBits((BYTE*)fmemory.data,width,height,
-                                                             pitch, 24, FI_RGBA_RED_SHIFT, FI_RGBA_GREEN_MASK,
-                                                             FI_RGBA_BLUE_MASK | 0xFFFF, TRUE) ) )
-                    {
-                        LOG_warn << "Error loading freeimage from memory: " << imagePath;
-                    }
-                    else
-                    {
-                        LOG_verbose << "SUCCESS loading freeimage from memory: "<< imagePath;
-                    }
-
-                    free (fmemory.data);
-
-                    LOG_debug << "Video image ready";
-
-                    av_packet_unref(&packet);
-                    av_frame_free(&videoFrame);
-                    avcodec_close(&codecContext);
-                    av_freep(&targetFrame->data[0]);
-                    av_frame_free(&targetFrame);
-                    sws_freeContext(swsContext);
-                    avformat_close_input(&formatContext);
-
-                    w = FreeImage_GetWidth(dib);
-                    h = FreeImage_GetHeight(dib);
-
-                    if (!w || !h)
-                    {
-                        return false;
-                    }
-
-                    return true;
-                }
-           }
+    // (reading is interrupted at the deadline, the decoding is checked after each frame)
+    while (!frameExtracted && actualNumFrames < 220
+           && std::chrono::steady_clock::now() < deadline
+           && av_read_frame(formatContext, &packet) >= 0)
+    {
+        if (packet.stream_index == videoStream->index)
+        {
+            if (avcodec_decode_video2(&codecContext, videoFrame, &frameExtracted, &packet) < 0)
+            {
+                frameExtracted = 0;
+            }
+            actualNumFrames++;
+        }
 
-           actualNumFrames++;
-       }
+        av_packet_unref(&packet);
+    }
 
-       av_packet_unref(&packet);
+    // decoders that reorder frames hold the keyframe until the next one arrives,
+    // unless they are drained
+    if (!frameExtracted && std::chrono::steady_clock::now() < deadline)
+    {
+        packet.data = NULL;
+        packet.size = 0;
+        if (avcodec_decode_video2(&codecContext, videoFrame, &frameExtracted, &packet) < 0)
+        {
+            frameExtracted = 0;
+        }
     }
 
+    FIBITMAP* bitmap = frameExtracted ? frameToBitmap(videoFrame, size) : NULL;
 
-    LOG_warn << "Error reading frame";
-    av_packet_unref(&packet);
     av_frame_free(&videoFrame);
     avcodec_close(&codecContext);
-    av_freep(&targetFrame->data[0]);
-    av_frame_free(&targetFrame);
-    sws_freeContext(swsContext);
     avformat_close_input(&formatContext);
-    return NULL;
+
+    if (!bitmap)
+    {
+        if (std::chrono::steady_clock::now() < deadline)
+        {
+            LOG_warn << "Error reading frame: " << *imagePath;
+        }
+        else
+        {
+            LOG_warn << "Timeout reading frame: " << *imagePath;
+        }
+        return false;
+    }
+
+    dib = bitmap;
+    w = FreeImage_GetWidth(dib);
+    h = FreeImage_GetHeight(dib);
+
+    LOG_debug << "Video image ready: " << w << "x" << h << " from " << width << "x" << height << " (lowres " << lowres << ")";
+
+    if (!w || !h)
+    {
+        return false;
+    }
+
+    return true;
 }
 
 #endif
 
 
+GfxProc* GfxProcFreeImage::newprocessor()
+{
+    return new GfxProcFreeImage();
+}
+
 const char* GfxProcFreeImage::supportedformats()
 {
     if (!sformats.size())
@@ -398,6 +405,81 @@ const char* GfxProcFreeImage::supportedformats()
     return sformats.c_str();
 }
 
+#ifndef OLD_FREEIMAGE
+#ifdef FIF_LOAD_NOPIXELS
+// the embedded EXIF thumbnail of a JPEG header, upright as the image is
+static FIBITMAP* exifthumbnail(FIBITMAP* header)
+{
+    FIBITMAP* thumbnail = FreeImage_GetThumbnail(header);
+    if (!thumbnail)
+    {
+        return NULL;
+    }
+
+    WORD orientation = 1;
+    FITAG* tag = NULL;
+    if (FreeImage_GetMetadata(FIMD_EXIF_MAIN, header, "Orientation", &tag) && tag
+            && FreeImage_GetTagType(tag) == FIDT_SHORT)
+    {
+        orientation = *(const WORD*)FreeImage_GetTagValue(tag);
+    }
+
+    switch (orientation)
+    {
+        case 1:
+            return FreeImage_Clone(thumbnail);
+        case 3:
+            return FreeImage_Rotate(thumbnail, 180);
+        case 6:
+            return FreeImage_Rotate(thumbnail, -90);
+        case 8:
+            return FreeImage_Rotate(thumbnail, 90);
+        default:
+            // mirrored, let the decoder handle it
+            return NULL;
+    }
+}
+#endif
+
+// decode a JPEG at the smallest DCT scale (1/2, 1/4 or 1/8) whose shorter side
+// still covers size, as thumbnails are cropped squares, or take its EXIF
+// thumbnail if that one is large enough
+static FIBITMAP* loadjpeg(FREE_IMAGE_FORMAT fif, freeimage_filename_char_t* name, int size)
+{
+    // FreeImage scales so that the longer side is at least the hint
+    unsigned hint = unsigned(size);
+
+#ifdef FIF_LOAD_NOPIXELS
+    if (FIBITMAP* header = FreeImage_LoadX(fif, name, FIF_LOAD_NOPIXELS))
+    {
+        unsigned iw = FreeImage_GetWidth(header);
+        unsigned ih = FreeImage_GetHeight(header);
+        FIBITMAP* thumbnail = FreeImage_GetThumbnail(header);
+
+        if (thumbnail && std::min(FreeImage_GetWidth(thumbnail), FreeImage_GetHeight(thumbnail)) >= unsigned(size))
+        {
+            if ((thumbnail = exifthumbnail(header)))
+            {
+                LOG_debug << "Using the EXIF thumbnail: " << FreeImage_GetWidth(thumbnail) << "x" << FreeImage_GetHeight(thumbnail);
+                FreeImage_Unload(header);
+                return thumbnail;
+            }
+        }
+
+        if (iw && ih)
+        {
+            unsigned longer = std::max(iw, ih);
+            hint = unsigned(std::min<uint64_t>(longer, uint64_t(size) * longer / std::min(iw, ih)));
+        }
+
+        FreeImage_Unload(header);
+    }
+#endif
+
+    return FreeImage_LoadX(fif, name, JPEG_EXIFROTATE | JPEG_FAST | (std::min(hint, 0xFFFFu) << 16));
+}
+#endif
+
 bool GfxProcFreeImage::readbitmap(FileAccess* fa, string* localname, int size)
 {
 #ifdef _WIN32
@@ -444,8 +526,7 @@ bool GfxProcFreeImage::readbitmap(FileAccess* fa, string* localname, int size)
     if (fif == FIF_JPEG)
     {
         // load JPEG (scale & EXIF-rotate)
-        if (!(dib = FreeImage_LoadX(fif, (freeimage_filename_char_t*) localname->data(),
-                                    JPEG_EXIFROTATE | JPEG_FAST | (size << 16))))
+        if (!(dib = loadjpeg(fif, (freeimage_filename_char_t*) localname->data(), size)))
         {
 #ifdef _WIN32
             localname->resize(localname->size()-1);
@@ -25,6 +25,7 @@
 #include "mega/proxy.h"
 #include "mega/base64.h"
 #include "mega/testhooks.h"
+#include "mega/trace.h"
 
 #if defined(WIN32) && !defined(WINDOWS_PHONE)
 #include <winhttp.h>
@@ -37,7 +38,7 @@
 namespace mega {
 
 // interval to calculate the mean speed (ds)
-const int SpeedController::SPEED_MEAN_INTERVAL_DS = 50;
+const int SpeedController::SPEED_MEAN_INTERVAL_DS;
 
 // max time to calculate the mean speed
 const int SpeedController::SPEED_MAX_VALUES = 10000;
@@ -336,7 +337,184 @@ m_off_t HttpIO::getmaxuploadspeed()
     return 0;
 }
 
+bool HttpIO::sethttp2(bool)
+{
+    return false;
+}
+
+bool HttpIO::gethttp2()
+{
+    return false;
+}
+
+bool HttpIO::gettlssessions(std::vector<TlsSession>*)
+{
+    return false;
+}
+
+bool HttpIO::settlssessions(const std::vector<TlsSession>&)
+{
+    return false;
+}
+
+bool HttpIO::setiothread(bool)
+{
+    return false;
+}
+
+bool HttpIO::setsocketoptions(direction_t, const SocketOptions&)
+{
+    return false;
+}
+
+bool HttpIO::setconnectioncache(direction_t, const ConnectionCacheOptions&)
+{
+    return false;
+}
+
+bool HttpIO::preconnect(const string&, direction_t, int)
+{
+    return false;
+}
+
+bool HttpIO::getiothread()
+{
+    return false;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    memset(counts, 0, sizeof counts);
+    samples = 0;
+    totalms = 0;
+}
+
+void LatencyHistogram::add(int64_t ms)
+{
+    if (ms < 0)
+    {
+        return;
+    }
+
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && ms >= (int64_t(1) << bucket))
+    {
+        bucket++;
+    }
+
+    counts[bucket]++;
+    samples++;
+    totalms += uint64_t(ms);
+}
+
+void LatencyHistogram::tojson(std::ostream& s) const
+{
+    s << "{\"n\":" << samples << ",\"avg\":" << (samples ? totalms / samples : 0) << ",\"buckets\":[";
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        s << (i ? "," : "") << counts[i];
+    }
+    s << "]}";
+}
+
+void HostNetworkStats::tojson(std::ostream& s) const
+{
+    s << "{\"dns\":";
+    dns.tojson(s);
+    s << ",\"connect\":";
+    connect.tojson(s);
+    s << ",\"tls\":";
+    tls.tojson(s);
+    s << ",\"ttfb\":";
+    ttfb.tojson(s);
+    s << ",\"status\":{";
+    for (std::map<int, uint64_t>::const_iterator it = statuses.begin(); it != statuses.end(); it++)
+    {
+        s << (it == statuses.begin() ? "\"" : ",\"") << it->first << "\":" << it->second;
+    }
+    s << "},\"connections\":" << connections
+      << ",\"in\":" << bytesin
+      << ",\"out\":" << bytesout << "}";
+}
+
+HostNetworkStats& NetworkStats::host(direction_t d, const string& key)
+{
+    std::map<string, HostNetworkStats>::iterator it = hosts[d].find(key);
+    if (it != hosts[d].end())
+    {
+        return it->second;
+    }
+
+    return hosts[d][hosts[d].size() < MAXHOSTS ? key : string("other")];
+}
+
+void NetworkStats::tojson(std::ostream& s) const
+{
+    static const char* names[] = { "get", "put", "api" };
+
+    s << "{";
+    for (int d = 0; d < 3; d++)
+    {
+        s << (d ? ",\"" : "\"") << names[d] << "\":{";
+        for (std::map<string, HostNetworkStats>::const_iterator it = hosts[d].begin(); it != hosts[d].end(); it++)
+        {
+            s << (it == hosts[d].begin() ? "\"" : ",\"") << it->first << "\":";
+            it->second.tojson(s);
+        }
+        s << "}";
+    }
+    s << "}";
+}
+
+void NetworkStats::clear()
+{
+    for (int d = 0; d < 3; d++)
+    {
+        hosts[d].clear();
+    }
+}
+
+TlsSession::TlsSession()
+{
+    validuntil = 0;
+}
+
+bool TlsSession::serialize(string* d)
+{
+    CacheableWriter w(*d);
+    w.serializestring(peer);
+    w.serializestring(mac);
+    w.serializestring(data);
+    w.serializei64(validuntil);
+    w.serializeexpansionflags();
+    return true;
+}
+
+TlsSession* TlsSession::unserialize(string* d)
+{
+    TlsSession* session = new TlsSession();
+    CacheableReader r(*d);
+    unsigned char expansions[8];
+    int64_t validuntil;
+    if (!r.unserializestring(session->peer)
+            || !r.unserializestring(session->mac)
+            || !r.unserializestring(session->data)
+            || !r.unserializei64(validuntil)
+            || !r.unserializeexpansionflags(expansions, 0))
+    {
+        delete session;
+        return NULL;
+    }
+    session->validuntil = validuntil;
+    return session;
+}
+
 void HttpReq::post(MegaClient* client, const char* data, unsigned len)
+{
+    post(client->httpio, data, len);
+}
+
+void HttpReq::post(HttpIO* io, const char* data, unsigned len)
 {
     if (httpio)
     {
@@ -345,7 +523,7 @@ void HttpReq::post(MegaClient* client, const char* data, unsigned len)
         init();
     }
 
-    httpio = client->httpio;
+    httpio = io;
     bufpos = 0;
     outpos = 0;
     notifiedbufpos = 0;
@@ -356,6 +534,7 @@ void HttpReq::post(MegaClient* client, const char* data, unsigned len)
 
     DEBUG_TEST_HOOK_HTTPREQ_POST(this)
 
+    Trace::asyncbegin("http", this);
     httpio->post(this, data, len);
 }
 
@@ -377,6 +556,7 @@ void HttpReq::get(MegaClient *client)
     contentlength = -1;
     lastdata = Waiter::ds;
 
+    Trace::asyncbegin("http", this);
     httpio->post(this);
 }
 
@@ -416,6 +596,7 @@ HttpReq::HttpReq(bool b)
     binary = b;
     status = REQ_READY;
     buf = NULL;
+    bufcapacity = 0;
     httpio = NULL;
     httpiohandle = NULL;
     out = &outbuf;
@@ -425,6 +606,7 @@ HttpReq::HttpReq(bool b)
     buflen = 0;
     protect = false;
     minspeed = false;
+    reserveresponse = true;
 
     init();
 }
@@ -436,7 +618,26 @@ HttpReq::~HttpReq()
         httpio->cancel(this);
     }
 
-    delete[] buf;
+    if (bufcapacity)
+    {
+        HttpBufferPool::release(buf, bufcapacity);
+    }
+    else
+    {
+        delete[] buf;
+    }
+}
+
+size_t HttpReq::memoryusage() const
+{
+    size_t bytes = MemoryUsage::of(in) + MemoryUsage::of(outbuf) + MemoryUsage::of(posturl);
+
+    if (buf)
+    {
+        bytes += bufcapacity ? bufcapacity : size_t(buflen);
+    }
+
+    return bytes;
 }
 
 void HttpReq::init()
@@ -491,19 +692,27 @@ void HttpReq::put(void* data, unsigned len, bool purge)
 }
 
 
-HttpReq::http_buf_t::http_buf_t(byte* b, size_t s, size_t e)
-    : start(s), end(e), buf(b)
+HttpReq::http_buf_t::http_buf_t(byte* b, size_t s, size_t e, size_t c)
+    : start(s), end(e), buf(b), capacity(c)
 {
 }
 
 HttpReq::http_buf_t::~http_buf_t()
 {
-    delete[] buf;
+    if (capacity)
+    {
+        HttpBufferPool::release(buf, capacity);
+    }
+    else
+    {
+        delete[] buf;
+    }
 }
 
 void HttpReq::http_buf_t::swap(http_buf_t& other)
 {
     byte* tb = buf; buf = other.buf; other.buf = tb;
+    size_t tc = capacity; capacity = other.capacity; other.capacity = tc;
     size_t ts = start; start = other.start; other.start = ts;
     size_t te = end; end = other.end; other.end = te;
 }
@@ -527,8 +736,9 @@ size_t HttpReq::http_buf_t::datalen()
 // give up ownership of the buffer for client to use.  
 struct HttpReq::http_buf_t* HttpReq::release_buf()
 {
-    HttpReq::http_buf_t* result = new HttpReq::http_buf_t(buf, inpurge, (size_t)bufpos);
+    HttpReq::http_buf_t* result = new HttpReq::http_buf_t(buf, inpurge, (size_t)bufpos, bufcapacity);
     buf = NULL;
+    bufcapacity = 0;
     inpurge = 0;
     buflen = 0;
     bufpos = 0;
@@ -559,7 +769,7 @@ void HttpReq::purge(size_t numbytes)
 // set total response size
 void HttpReq::setcontentlength(m_off_t len)
 {
-    if (!buf && type != REQ_BINARY)
+    if (!buf && type != REQ_BINARY && reserveresponse)
     {
         in.reserve(static_cast<size_t>(len));
     }
@@ -633,21 +843,116 @@ void HttpReqDL::prepare(const char* tempurl, SymmCipher* /*key*/,
     size = (unsigned)(npos - pos);
     buffer_released = false;
 
-    if (!buf || buflen != size)
+    size_t padded = (size + SymmCipher::BLOCKSIZE - 1) & - SymmCipher::BLOCKSIZE;
+    if (!buf || (bufcapacity ? bufcapacity < padded : buflen != size))
     {
         // (re)allocate buffer
         if (buf)
         {
-            delete[] buf;
+            if (bufcapacity)
+            {
+                HttpBufferPool::release(buf, bufcapacity);
+            }
+            else
+            {
+                delete[] buf;
+            }
             buf = NULL;
+            bufcapacity = 0;
         }
 
         if (size)
         {
-            buf = new byte[(size + SymmCipher::BLOCKSIZE - 1) & - SymmCipher::BLOCKSIZE];
+            buf = HttpBufferPool::allocate(padded, &bufcapacity);
         }
-        buflen = size;
     }
+    buflen = size;
+}
+
+// free buffers by capacity. Never destroyed: buffers may be released by
+// objects destroyed at exit
+struct HttpBufferPoolState
+{
+    std::mutex mutex;
+    std::multimap<size_t, byte*> buffers;
+    size_t bytes = 0;
+};
+
+static HttpBufferPoolState& httpBufferPool()
+{
+    static HttpBufferPoolState* state = new HttpBufferPoolState;
+    return *state;
+}
+
+static byte* allocatealigned(size_t size)
+{
+    void* buf;
+#ifdef _WIN32
+    if (!(buf = _aligned_malloc(size, HttpBufferPool::ALIGNMENT)))
+#else
+    if (posix_memalign(&buf, HttpBufferPool::ALIGNMENT, size))
+#endif
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<byte*>(buf);
+}
+
+static void freealigned(byte* buf)
+{
+#ifdef _WIN32
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+}
+
+byte* HttpBufferPool::allocate(size_t size, size_t* capacity)
+{
+    *capacity = (size + GRANULARITY - 1) / GRANULARITY * GRANULARITY;
+
+    {
+        HttpBufferPoolState& pool = httpBufferPool();
+        std::lock_guard<std::mutex> g(pool.mutex);
+        std::multimap<size_t, byte*>::iterator it = pool.buffers.find(*capacity);
+        if (it != pool.buffers.end())
+        {
+            byte* buf = it->second;
+            pool.bytes -= it->first;
+            pool.buffers.erase(it);
+            return buf;
+        }
+    }
+
+    return allocatealigned(*capacity);
+}
+
+void HttpBufferPool::release(byte* buf, size_t capacity)
+{
+    if (!buf)
+    {
+        return;
+    }
+
+    {
+        HttpBufferPoolState& pool = httpBufferPool();
+        std::lock_guard<std::mutex> g(pool.mutex);
+        if (pool.bytes + capacity <= MAXPOOLED)
+        {
+            pool.buffers.insert(std::make_pair(capacity, buf));
+            pool.bytes += capacity;
+            return;
+        }
+    }
+
+    freealigned(buf);
+}
+
+size_t HttpBufferPool::pooledbytes()
+{
+    HttpBufferPoolState& pool = httpBufferPool();
+    std::lock_guard<std::mutex> g(pool.mutex);
+    return pool.bytes;
 }
 
 
@@ -760,12 +1065,315 @@ void HttpReqUL::prepare(const char* tempurl, SymmCipher* key,
     setreq((tempurl + urlSuffix).c_str(), REQ_BINARY);
 }
 
+void HttpReqUL::prepareasync(CryptoWorkers* encryptor, const char* tempurl, SymmCipher* key,
+                             uint64_t ctriv, m_off_t pos, m_off_t npos)
+{
+    encryptjob = std::make_shared<EncryptChunksJob>();
+    memcpy(encryptjob->key, key->key, sizeof encryptjob->key);
+    encryptjob->ctriv = ctriv;
+    encryptjob->pos = pos;
+    encryptjob->npos = npos;
+    encryptjob->data.swap(*out);
+    encryptjob->split(encryptor->size());
+    encrypturl = tempurl;
+
+    encryptor->submit(encryptjob, unsigned(encryptjob->parts.size()));
+}
+
+// take the encrypted data back once the job is done, MACs in chunk order
+bool HttpReqUL::encrypted(chunkmac_map* macs)
+{
+    if (!encryptjob || !encryptjob->finished())
+    {
+        return false;
+    }
+
+    string urlsuffix;
+    encryptjob->result(macs, &urlsuffix);
+
+    out->swap(encryptjob->data);
+
+    // unpad for POSTing
+    size = (unsigned)(encryptjob->npos - encryptjob->pos);
+    out->resize(size);
+
+    setreq((encrypturl + urlsuffix).c_str(), REQ_BINARY);
+
+    encryptjob.reset();
+    return true;
+}
+
+void EncryptChunksJob::split(unsigned maxparts)
+{
+    parts.clear();
+
+    m_off_t partsize = (npos - pos) / (maxparts ? maxparts : 1);
+    m_off_t startpos = pos;
+    m_off_t endpos = pos;
+
+    // cut at chunk boundaries, once a part has its share of the bytes
+    while (endpos < npos)
+    {
+        endpos = ChunkedHash::chunkceil(endpos, npos);
+
+        if (endpos - startpos >= partsize || endpos == npos)
+        {
+            parts.push_back(Part());
+            parts.back().pos = startpos;
+            parts.back().npos = endpos;
+            startpos = endpos;
+        }
+    }
+
+    if (parts.empty())
+    {
+        parts.push_back(Part());
+        parts.back().pos = pos;
+        parts.back().npos = npos;
+    }
+}
+
+void EncryptChunksJob::result(chunkmac_map* macs, string* urlsuffix)
+{
+    byte crc[EncryptByChunks::CRCSIZE] = { 0 };
+
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        for (chunkmac_map::iterator it = parts[i].macs.begin(); it != parts[i].macs.end(); it++)
+        {
+            (*macs)[it->first] = it->second;
+        }
+
+        // the CRC of a part is relative to its own start
+        unsigned offset = unsigned((parts[i].pos - pos) % EncryptByChunks::CRCSIZE);
+        for (unsigned j = 0; j < EncryptByChunks::CRCSIZE; j++)
+        {
+            crc[(j + offset) % EncryptByChunks::CRCSIZE] ^= parts[i].crc[j];
+        }
+    }
+
+    ostringstream s;
+    s << "/" << pos << "?c=" << Base64Str<EncryptByChunks::CRCSIZE>(crc);
+    *urlsuffix = s.str();
+}
+
+void EncryptChunksJob::run()
+{
+    for (unsigned i = 0; i < parts.size(); i++)
+    {
+        run(i);
+    }
+}
+
+void EncryptChunksJob::run(unsigned part)
+{
+    SymmCipher cipher;
+    cipher.setkey(key);
+
+    Part& p = parts[part];
+    EncryptBufferByChunks eb((byte*)data.data() + (p.pos - pos), &cipher, &p.macs, ctriv);
+
+    string urlsuffix;
+    eb.encrypt(p.pos, p.npos, urlsuffix);
+    memcpy(p.crc, eb.getcrc(), sizeof p.crc);
+}
+
+bool CryptoWorkers::Job::finished()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return mFinished;
+}
+
+void CryptoWorkers::Job::wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this]() { return mFinished; });
+}
+
+// the threads and the queue of the jobs of one or more CryptoWorkers
+struct CryptoWorkers::Pool
+{
+    std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::deque<std::pair<std::shared_ptr<Job>, unsigned> > mQueue;
+    std::vector<std::thread> mThreads;
+    bool mExit = false;
+
+    explicit Pool(unsigned threads)
+    {
+        for (unsigned i = 0; i < threads; i++)
+        {
+            mThreads.push_back(std::thread([this]() { loop(); }));
+        }
+    }
+
+    ~Pool()
+    {
+        {
+            std::lock_guard<std::mutex> g(mMutex);
+            mExit = true;
+        }
+        mQueueChanged.notify_all();
+
+        for (size_t i = 0; i < mThreads.size(); i++)
+        {
+            mThreads[i].join();
+        }
+    }
+
+    void loop();
+};
+
+std::mutex CryptoWorkers::sSharedMutex;
+std::shared_ptr<CryptoWorkers::Pool> CryptoWorkers::sShared;
+
+CryptoWorkers::CryptoWorkers(unsigned threads, Waiter* waiter)
+    : mWaiter(waiter)
+{
+    {
+        std::lock_guard<std::mutex> g(sSharedMutex);
+        mPool = sShared;
+    }
+
+    if (!mPool)
+    {
+        mPool = std::make_shared<Pool>(threads);
+    }
+}
+
+CryptoWorkers::~CryptoWorkers()
+{
+    // the jobs of other instances on a shared pool aren't waited for
+    std::unique_lock<std::mutex> lock(mPendingMutex);
+    mPendingDone.wait(lock, [this]() { return !mPending; });
+}
+
+unsigned CryptoWorkers::size() const
+{
+    return unsigned(mPool->mThreads.size());
+}
+
+void CryptoWorkers::setsharedthreads(unsigned threads)
+{
+    std::shared_ptr<Pool> previous;
+    {
+        std::lock_guard<std::mutex> g(sSharedMutex);
+        if (threads == (sShared ? sShared->mThreads.size() : 0))
+        {
+            return;
+        }
+
+        previous = std::move(sShared);
+        if (threads)
+        {
+            sShared = std::make_shared<Pool>(threads);
+        }
+    }
+
+    LOG_debug << "Shared worker threads: " << threads;
+}
+
+unsigned CryptoWorkers::sharedthreads()
+{
+    std::lock_guard<std::mutex> g(sSharedMutex);
+    return sShared ? unsigned(sShared->mThreads.size()) : 0;
+}
+
+void CryptoWorkers::submit(std::shared_ptr<Job> job, unsigned parts)
+{
+    job->mParts = job->mPendingParts = parts ? parts : 1;
+    job->mOwner = this;
+
+    {
+        std::lock_guard<std::mutex> g(mPendingMutex);
+        mPending++;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(mPool->mMutex);
+        for (unsigned i = 0; i < job->mParts; i++)
+        {
+            mPool->mQueue.push_back(std::make_pair(job, i));
+        }
+    }
+
+    if (parts > 1)
+    {
+        mPool->mQueueChanged.notify_all();
+    }
+    else
+    {
+        mPool->mQueueChanged.notify_one();
+    }
+}
+
+// the owner may go away as soon as the lock is released
+void CryptoWorkers::jobdone()
+{
+    std::lock_guard<std::mutex> g(mPendingMutex);
+
+    if (mWaiter)
+    {
+        mWaiter->notify();
+    }
+
+    mPending--;
+    mPendingDone.notify_all();
+}
+
+void CryptoWorkers::Pool::loop()
+{
+    Trace::threadname("CryptoWorkers");
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (;;)
+    {
+        mQueueChanged.wait(lock, [this]() { return mExit || !mQueue.empty(); });
+
+        if (mQueue.empty())
+        {
+            // exit only once every queued job has been done
+            return;
+        }
+
+        std::shared_ptr<Job> job = mQueue.front().first;
+        unsigned part = mQueue.front().second;
+        mQueue.pop_front();
+        lock.unlock();
+
+        if (job->mParts > 1)
+        {
+            job->run(part);
+        }
+        else
+        {
+            job->run();
+        }
+
+        bool finished;
+        {
+            std::lock_guard<std::mutex> g(job->mMutex);
+            finished = !--job->mPendingParts;
+            job->mFinished = finished;
+        }
+
+        if (finished)
+        {
+            job->mDone.notify_all();
+            job->mOwner->jobdone();
+        }
+
+        lock.lock();
+    }
+}
+
 // number of bytes sent in this request
 m_off_t HttpReqUL::transferred(MegaClient* client)
 {
     if (httpiohandle)
     {
-        return client->httpio->postpos(httpiohandle);
+        return httpio->postpos(httpiohandle);
     }
 
     return 0;
@@ -773,6 +1381,7 @@ m_off_t HttpReqUL::transferred(MegaClient* client)
 
 SpeedController::SpeedController()
 {
+    memset(transferBytes, 0, sizeof transferBytes);
     partialBytes = 0;
     meanSpeed = 0;
     lastUpdate = 0;
@@ -787,22 +1396,26 @@ m_off_t SpeedController::calculateSpeed(long long numBytes)
         return (partialBytes * 10) / SPEED_MEAN_INTERVAL_DS;
     }
 
-    while (transferBytes.size())
+    // the slots of the deciseconds elapsed since the last update held the
+    // bytes of one interval earlier, which have expired
+    if (currentTime < lastUpdate || currentTime - lastUpdate >= dstime(SPEED_MEAN_INTERVAL_DS))
+    {
+        memset(transferBytes, 0, sizeof transferBytes);
+        partialBytes = 0;
+    }
+    else
     {
-        map<dstime, m_off_t>::iterator it = transferBytes.begin();
-        dstime deltaTime = currentTime - it->first;
-        if (deltaTime < SPEED_MEAN_INTERVAL_DS)
+        for (dstime t = lastUpdate + 1; t <= currentTime; t++)
         {
-            break;
+            m_off_t& slot = transferBytes[t % SPEED_MEAN_INTERVAL_DS];
+            partialBytes -= slot;
+            slot = 0;
         }
-
-        partialBytes -= it->second;
-        transferBytes.erase(it);
     }
 
     if (numBytes > 0)
     {
-        transferBytes[currentTime] += numBytes;
+        transferBytes[currentTime % SPEED_MEAN_INTERVAL_DS] += numBytes;
         partialBytes += numBytes;
     }
 
@@ -826,6 +1439,194 @@ m_off_t SpeedController::getMeanSpeed()
     return meanSpeed;
 }
 
+const char* const BackgroundHttpIO::FILEPREFIX = "megabg_";
+
+BackgroundHttpIO::BackgroundHttpIO(Handler* h, FileSystemAccess* fa, const string& f)
+    : handler(h), fsaccess(fa), folder(f)
+{
+    // unique across processes, so that the requests of a previous one are not
+    // taken for new ones
+    nextid = uint64_t(m_time()) << 24;
+
+    string pattern = folder;
+    string name = FILEPREFIX;
+    string localname;
+    name.append("*");
+    fsaccess->path2local(&name, &localname);
+    pattern.append(fsaccess->localseparator);
+    pattern.append(localname);
+
+    std::unique_ptr<DirAccess> da(fsaccess->newdiraccess());
+    string localpath;
+    nodetype_t type;
+    if (da->dopen(&pattern, NULL, true))
+    {
+        while (da->dnext(NULL, &localpath, false, &type))
+        {
+            if (type == FILENODE)
+            {
+                fsaccess->unlinklocal(&localpath);
+            }
+        }
+    }
+}
+
+BackgroundHttpIO::~BackgroundHttpIO()
+{
+    // the requests are cancelled by their HttpReq, this is only for the leftovers
+    for (auto& it : requests)
+    {
+        handler->cancel(it.first);
+        fsaccess->unlinklocal(&it.second.localpath);
+        it.second.req->httpiohandle = NULL;
+        it.second.req->httpio = NULL;
+    }
+}
+
+void BackgroundHttpIO::post(HttpReq* req, const char* data, unsigned len)
+{
+    uint64_t id = nextid++;
+    Request& r = requests[id];
+    r.id = id;
+    r.req = req;
+
+    if (!data)
+    {
+        data = req->out->data();
+        len = unsigned(req->out->size());
+    }
+    r.upload = len > 0;
+
+    ostringstream oss;
+    oss << FILEPREFIX << id;
+    string name = oss.str();
+    string localname;
+    fsaccess->path2local(&name, &localname);
+    r.localpath = folder;
+    r.localpath.append(fsaccess->localseparator);
+    r.localpath.append(localname);
+
+    string path;
+    fsaccess->local2path(&r.localpath, &path);
+
+    // the encrypted chunk of an upload goes in its file
+    bool ok = true;
+    if (r.upload)
+    {
+        auto fa = fsaccess->newfileaccess();
+        ok = fa->fopen(&r.localpath, false, true) && fa->fwrite((const byte*)data, len, 0);
+    }
+
+    req->httpiohandle = &r;
+    req->status = REQ_INFLIGHT;
+
+    if (!ok || !handler->start(id, r.upload, req->posturl, path))
+    {
+        LOG_warn << "Unable to start a background request: " << req->posturl;
+        fsaccess->unlinklocal(&r.localpath);
+        requests.erase(id);
+        req->httpiohandle = NULL;
+        req->httpstatus = 0;
+        req->status = REQ_FAILURE;
+        return;
+    }
+
+    LOG_debug << "Background request " << id << ": " << req->posturl;
+}
+
+bool BackgroundHttpIO::finished(uint64_t id, int httpstatus, const string& response)
+{
+    std::map<uint64_t, Request>::iterator it = requests.find(id);
+    if (it == requests.end())
+    {
+        LOG_debug << "Unknown background request " << id;
+        return false;
+    }
+
+    HttpReq* req = it->second.req;
+    req->httpstatus = httpstatus;
+    req->lastdata = Waiter::ds;
+
+    bool ok = httpstatus == 200;
+    if (ok && !it->second.upload)
+    {
+        // the OS wrote the response to the file
+        auto fa = fsaccess->newfileaccess();
+        string data;
+        ok = fa->fopen(&it->second.localpath, true, false)
+                && (!fa->size || fa->fread(&data, unsigned(fa->size), 0, 0));
+        if (ok)
+        {
+            req->setcontentlength(m_off_t(data.size()));
+            req->put((void*)data.data(), unsigned(data.size()));
+        }
+        else
+        {
+            LOG_warn << "Unable to read the response of background request " << id;
+        }
+    }
+    else
+    {
+        req->put((void*)response.data(), unsigned(response.size()));
+    }
+
+    LOG_debug << "Background request " << id << " finished. Status: " << httpstatus;
+
+    if (ok)
+    {
+        success = true;
+        lastdata = Waiter::ds;
+    }
+
+    req->status = ok ? REQ_SUCCESS : REQ_FAILURE;
+    finish(it);
+    return true;
+}
+
+void BackgroundHttpIO::cancel(HttpReq* req)
+{
+    Request* r = static_cast<Request*>(req->httpiohandle);
+    if (!r)
+    {
+        return;
+    }
+
+    LOG_debug << "Cancelling background request " << r->id;
+    handler->cancel(r->id);
+    finish(requests.find(r->id));
+}
+
+void BackgroundHttpIO::finish(std::map<uint64_t, Request>::iterator it)
+{
+    fsaccess->unlinklocal(&it->second.localpath);
+    it->second.req->httpiohandle = NULL;
+    requests.erase(it);
+}
+
+// the progress of a request is only known when it finishes
+m_off_t BackgroundHttpIO::postpos(void*)
+{
+    return 0;
+}
+
+bool BackgroundHttpIO::doio()
+{
+    return false;
+}
+
+void BackgroundHttpIO::addevents(Waiter*, int)
+{
+}
+
+// the OS applies its own settings
+void BackgroundHttpIO::setuseragent(string*)
+{
+}
+
+void BackgroundHttpIO::setproxy(Proxy*)
+{
+}
+
 GenericHttpReq::GenericHttpReq(PrnGen &rng, bool binary)
     : HttpReq(binary), bt(rng), maxbt(rng)
 {
@@ -24,14 +24,168 @@
 #include "mega/megaclient.h"
 #include "mega/logging.h"
 
+// the vectorized string scan reads whole aligned blocks, past the end of the
+// string: harmless, but not for AddressSanitizer
+#if defined(__SANITIZE_ADDRESS__)
+#define MEGA_JSON_NO_SIMD 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define MEGA_JSON_NO_SIMD 1
+#endif
+#endif
+
+#ifndef MEGA_JSON_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MEGA_JSON_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MEGA_JSON_NEON 1
+#endif
+#endif
+
+#if defined(_MSC_VER) && (defined(MEGA_JSON_SSE2) || defined(MEGA_JSON_NEON))
+#include <intrin.h>
+#endif
+
 namespace mega {
+#if defined(MEGA_JSON_SSE2) || defined(MEGA_JSON_NEON)
+static inline unsigned lowestbit(unsigned long long mask)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+#ifdef _WIN64
+    _BitScanForward64(&i, mask);
+#else
+    if (!_BitScanForward(&i, (unsigned long)mask))
+    {
+        _BitScanForward(&i, (unsigned long)(mask >> 32));
+        i += 32;
+    }
+#endif
+    return unsigned(i);
+#else
+    return unsigned(__builtin_ctzll(mask));
+#endif
+}
+#endif
+
+// first '"', '\\' or NUL at or after ptr, 16 bytes at a time: the loads are
+// aligned, so they never cross into a page the string doesn't touch
+static const char* findquote(const char* ptr)
+{
+#if defined(MEGA_JSON_SSE2)
+    const char* block = (const char*)((uintptr_t)ptr & ~(uintptr_t)15);
+    unsigned skip = unsigned(ptr - block);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i zero = _mm_setzero_si128();
+
+    for (;;)
+    {
+        __m128i v = _mm_load_si128((const __m128i*)block);
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                                             _mm_cmpeq_epi8(v, backslash)),
+                                                                _mm_cmpeq_epi8(v, zero))));
+        mask &= ~0u << skip;
+
+        if (mask)
+        {
+            return block + lowestbit(mask);
+        }
+
+        block += 16;
+        skip = 0;
+    }
+#elif defined(MEGA_JSON_NEON)
+    const char* block = (const char*)((uintptr_t)ptr & ~(uintptr_t)15);
+    unsigned skip = unsigned(ptr - block);
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t zero = vdupq_n_u8(0);
+
+    for (;;)
+    {
+        uint8x16_t v = vld1q_u8((const uint8_t*)block);
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)), vceqq_u8(v, zero));
+
+        // four bits per byte
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        mask &= ~0ull << (skip * 4);
+
+        if (mask)
+        {
+            return block + lowestbit(mask) / 4;
+        }
+
+        block += 16;
+        skip = 0;
+    }
+#else
+    while (*ptr && *ptr != '"' && *ptr != '\\')
+    {
+        ptr++;
+    }
+
+    return ptr;
+#endif
+}
+
+// closing quote of the string whose contents start at ptr, or its NUL
+// terminator if unterminated
+static const char* stringend(const char* ptr)
+{
+    for (;;)
+    {
+        ptr = findquote(ptr);
+
+        if (*ptr != '\\')
+        {
+            return ptr;
+        }
+
+        if (!*++ptr)
+        {
+            return ptr;
+        }
+
+        ptr++;
+    }
+}
+
 // store array or object in string s
 // reposition after object
 bool JSON::storeobject(string* s)
+{
+    const char* begin;
+    size_t len;
+
+    if (!skipobject(&begin, &len))
+    {
+        return false;
+    }
+
+    if (s)
+    {
+        s->assign(begin, len);
+    }
+
+    return true;
+}
+
+const char* JSON::storeobject(TransientArena& arena)
+{
+    const char* begin;
+    size_t len;
+
+    return skipobject(&begin, &len) ? arena.copy(begin, len) : NULL;
+}
+
+// skip the next value, returning its extent (without the quotes of strings)
+bool JSON::skipobject(const char** begin, size_t* len)
 {
     int openobject[2] = { 0 };
     const char* ptr;
-    bool escaped = false;
 
     while (*(const signed char*)pos > 0 && *pos <= ' ')
     {
@@ -66,13 +220,7 @@ bool JSON::storeobject(string* s)
         }
         else if (*ptr == '"')
         {
-            ptr++;
-
-            while (*ptr && (escaped || *ptr != '"'))
-            {
-                escaped = *ptr == '\\' && !escaped;
-                ptr++;
-            }
+            ptr = stringend(ptr + 1);
 
             if (!*ptr)
             {
@@ -101,16 +249,15 @@ bool JSON::storeobject(string* s)
 
         if (!openobject[0] && !openobject[1])
         {
-            if (s)
+            if (*pos == '"')
             {
-                if (*pos == '"')
-                {
-                    s->assign(pos + 1, ptr - pos - 2);
-                }
-                else
-                {
-                    s->assign(pos, ptr - pos);
-                }
+                *begin = pos + 1;
+                *len = ptr - pos - 2;
+            }
+            else
+            {
+                *begin = pos;
+                *len = ptr - pos;
             }
 
             pos = ptr;
@@ -119,6 +266,78 @@ bool JSON::storeobject(string* s)
     }
 }
 
+// end of the object or array starting at ptr, NULL if incomplete before end
+const char* JSON::objectend(const char* ptr, const char* end)
+{
+    int depth = 0;
+
+    while (ptr < end)
+    {
+        if (*ptr == '"')
+        {
+            // skip string, including escaped quotes
+            for (ptr++; ptr < end && *ptr != '"'; ptr++)
+            {
+                if (*ptr == '\\')
+                {
+                    ptr++;
+                }
+            }
+        }
+        else if (*ptr == '[' || *ptr == '{')
+        {
+            depth++;
+        }
+        else if (*ptr == ']' || *ptr == '}')
+        {
+            if (--depth <= 0)
+            {
+                return ptr + 1;
+            }
+        }
+
+        ptr++;
+    }
+
+    return NULL;
+}
+
+// end of the value starting at ptr, NULL if incomplete before end
+const char* JSON::valueend(const char* ptr, const char* end)
+{
+    if (ptr < end && (*ptr == '[' || *ptr == '{'))
+    {
+        return objectend(ptr, end);
+    }
+
+    bool instring = false;
+
+    for (; ptr < end; ptr++)
+    {
+        if (instring)
+        {
+            if (*ptr == '\\')
+            {
+                ptr++;
+            }
+            else if (*ptr == '"')
+            {
+                instring = false;
+            }
+        }
+        else if (*ptr == '"')
+        {
+            instring = true;
+        }
+        else if (*ptr == ',' || *ptr == ']' || *ptr == '}')
+        {
+            return ptr;
+        }
+    }
+
+    return NULL;
+}
+
 bool JSON::isnumeric()
 {
     if (*pos == ',')
@@ -270,7 +489,7 @@ bool JSON::storebinary(string* dst)
         }
 
         dst->resize((ptr - pos - 1) / 4 * 3 + 3);
-        dst->resize(Base64::atob(pos + 1, (byte*)dst->data(), int(dst->size())));
+        dst->resize(Base64::atob(pos + 1, size_t(ptr - pos - 1), (byte*)dst->data(), int(dst->size())));
 
         // skip string
         storeobject();
@@ -486,61 +705,87 @@ bool JSON::leaveobject()
     return false;
 }
 
-// unescape JSON string (non-strict)
+// unescape JSON string (non-strict), in place and in a single pass
 void JSON::unescape(string* s)
 {
-    char c;
-    int l;
+    size_t w = s->find('\\');
+
+    if (w == string::npos)
+    {
+        return;
+    }
 
-    for (unsigned i = 0; i + 1 < s->size(); i++)
+    char* d = &(*s)[0];
+    size_t n = s->size();
+    size_t i = w;
+
+    while (i + 1 < n)
     {
-        if ((*s)[i] == '\\')
+        if (d[i] != '\\')
         {
-            switch ((*s)[i + 1])
-            {
-                case 'n':
-                    c = '\n';
-                    l = 2;
-                    break;
+            // copy up to the next escape sequence
+            const char* next = (const char*)memchr(d + i, '\\', n - i);
+            size_t run = (next ? size_t(next - d) : n) - i;
+
+            memmove(d + w, d + i, run);
+            w += run;
+            i += run;
+            continue;
+        }
 
-                case 'r':
-                    c = '\r';
-                    l = 2;
-                    break;
+        char c;
+        size_t l = 2;
 
-                case 'b':
-                    c = '\b';
-                    l = 2;
-                    break;
+        switch (d[i + 1])
+        {
+            case 'n':
+                c = '\n';
+                break;
 
-                case 'f':
-                    c = '\f';
-                    l = 2;
-                    break;
+            case 'r':
+                c = '\r';
+                break;
 
-                case 't':
-                    c = '\t';
-                    l = 2;
-                    break;
+            case 'b':
+                c = '\b';
+                break;
 
-                case '\\':
-                    c = '\\';
-                    l = 2;
-                    break;
+            case 'f':
+                c = '\f';
+                break;
+
+            case 't':
+                c = '\t';
+                break;
 
-                case 'u':
-                    c = static_cast<char>((MegaClient::hexval((*s)[i + 4]) << 4) | MegaClient::hexval((*s)[i + 5]));
+            case '\\':
+                c = '\\';
+                break;
+
+            case 'u':
+                if (i + 5 < n)
+                {
+                    c = static_cast<char>((MegaClient::hexval(d[i + 4]) << 4) | MegaClient::hexval(d[i + 5]));
                     l = 6;
                     break;
+                }
+                // fall through
 
-                default:
-                    c = (*s)[i + 1];
-                    l = 2;
-            }
-
-            s->replace(i, l, &c, 1);
+            default:
+                c = d[i + 1];
         }
+
+        d[w++] = c;
+        i += l;
     }
+
+    // a trailing lone backslash is kept
+    if (i < n)
+    {
+        d[w++] = d[i];
+    }
+
+    s->resize(w);
 }
 
 bool JSON::extractstringvalue(const string &json, const string &name, string *value)
@@ -28,7 +28,14 @@
 
 #include "mega/logging.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <ctime>
+#include <limits>
+#include <memory>
+#include <thread>
 
 #if defined(WINDOWS_PHONE)
 #include <stdint.h>
@@ -45,11 +52,11 @@ enum LogLevel SimpleLogger::logCurrentLevel = logInfo;
 // static member initialization
 std::mutex SimpleLogger::outputs_mutex;
 OutputMap SimpleLogger::outputs;
+std::atomic<bool> SimpleLogger::async{false};
 
-std::string SimpleLogger::getTime()
+static std::string formatTime(time_t t)
 {
     char ts[50];
-    time_t t = std::time(NULL);
 
     if (!std::strftime(ts, sizeof(ts), "%H:%M:%S", std::gmtime(&t))) {
         ts[0] = '\0';
@@ -57,8 +64,463 @@ std::string SimpleLogger::getTime()
     return ts;
 }
 
+std::string SimpleLogger::getTime()
+{
+    return formatTime(std::time(NULL));
+}
+
+// Single-producer single-consumer ring of the messages of one thread: the thread
+// appends records at head, the flusher consumes them up to head and advances tail.
+// Positions only grow, the buffer is indexed by position & mask.
+struct AsyncLogRing
+{
+    std::vector<char> buffer;
+    uint64_t mask;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> ended{false};
+
+    explicit AsyncLogRing(size_t size)
+        : buffer(size), mask(size - 1)
+    {
+    }
+
+    void put(uint64_t pos, const void* data, size_t len)
+    {
+        size_t offset = size_t(pos & mask);
+        size_t first = std::min(len, buffer.size() - offset);
+        memcpy(&buffer[offset], data, first);
+        memcpy(&buffer[0], static_cast<const char*>(data) + first, len - first);
+    }
+
+    void get(uint64_t pos, void* data, size_t len) const
+    {
+        size_t offset = size_t(pos & mask);
+        size_t first = std::min(len, buffer.size() - offset);
+        memcpy(data, &buffer[offset], first);
+        memcpy(static_cast<char*>(data) + first, &buffer[0], len - first);
+    }
+};
+
+namespace {
+
+// fixed part of each record, followed by its arguments as a tag, then either
+// a uint32_t length and the bytes of a string or the value
+struct AsyncLogHeader
+{
+    uint32_t size;
+    int32_t level;
+    int32_t line;
+    uint64_t seq;
+    int64_t time;
+    const char* filename;   // __FILE__, never freed
+};
+
+struct AsyncLogging
+{
+    // rings of all threads, ended ones are released once drained
+    std::mutex ringsMutex;
+    std::vector<std::shared_ptr<AsyncLogRing>> rings;
+    std::atomic<size_t> ringSize{SimpleLogger::DEFAULT_ASYNC_BUFFER_SIZE};
+
+    // messages are output in the order of their sequence numbers
+    std::atomic<uint64_t> seq{0};
+    std::atomic<uint64_t> dropped{0};
+
+    std::mutex drainMutex;
+
+    std::mutex flusherMutex;
+    std::condition_variable flusherCondition;
+    std::thread flusher;
+    bool stop = false;
+
+    std::mutex controlMutex;
+
+    void drain();
+    void run();
+    void stopFlusher();
+};
+
+// never destroyed, so that threads exiting late can still release their rings
+AsyncLogging& asyncLogging = *new AsyncLogging;
+
+const std::chrono::milliseconds FLUSH_INTERVAL(20);
+
+struct RingHolder
+{
+    std::shared_ptr<AsyncLogRing> ring;
+
+    AsyncLogRing* get()
+    {
+        if (!ring)
+        {
+            size_t size = 4096;
+            while (size < asyncLogging.ringSize.load(std::memory_order_relaxed))
+            {
+                size <<= 1;
+            }
+
+            ring = std::make_shared<AsyncLogRing>(size);
+            std::lock_guard<std::mutex> g(asyncLogging.ringsMutex);
+            asyncLogging.rings.push_back(ring);
+        }
+        return ring.get();
+    }
+
+    ~RingHolder()
+    {
+        if (ring)
+        {
+            ring->ended = true;
+        }
+    }
+};
+
+thread_local RingHolder ringHolder;
+
+// set while a message of this thread is being appended: messages logged
+// meanwhile (by an operator<< for instance) are logged synchronously
+thread_local bool appending = false;
+
+// set while this thread outputs pending messages, for loggers that log themselves
+thread_local bool draining = false;
+
+thread_local std::ostringstream formatter;
+
+// joins the flusher before static destruction completes; pending messages are
+// left alone, as the logger may be gone by then
+struct AsyncLoggingGuard
+{
+    ~AsyncLoggingGuard()
+    {
+        asyncLogging.stopFlusher();
+    }
+} asyncLoggingGuard;
+
+struct PendingMessage
+{
+    uint64_t seq;
+    time_t time;
+    int level;
+    std::string source;
+    std::string message;
+};
+
+// formats the record at pos of ring into m, returns its size
+uint32_t decode(const AsyncLogRing& ring, uint64_t pos, PendingMessage& m, std::ostringstream& oss)
+{
+    AsyncLogHeader header;
+    ring.get(pos, &header, sizeof header);
+
+    m.seq = header.seq;
+    m.time = time_t(header.time);
+    m.level = header.level;
+
+    oss.str(std::string());
+    oss.clear();
+    oss << header.filename;
+    if (header.line >= 0)
+    {
+        oss << ":" << header.line;
+    }
+    m.source = oss.str();
+
+    oss.str(std::string());
+    uint64_t end = pos + header.size;
+    for (pos += sizeof header; pos < end; )
+    {
+        unsigned char tag;
+        ring.get(pos++, &tag, sizeof tag);
+
+        switch (tag)
+        {
+            case AsyncLogRecord::STRING:
+            {
+                uint32_t len;
+                ring.get(pos, &len, sizeof len);
+                pos += sizeof len;
+                std::string value(len, '\0');
+                ring.get(pos, &value[0], len);
+                pos += len;
+                oss << value;
+                break;
+            }
+            case AsyncLogRecord::CHAR:
+            {
+                char value;
+                ring.get(pos, &value, sizeof value);
+                pos += sizeof value;
+                oss << value;
+                break;
+            }
+            case AsyncLogRecord::SIGNED:
+            {
+                int64_t value;
+                ring.get(pos, &value, sizeof value);
+                pos += sizeof value;
+                oss << value;
+                break;
+            }
+            case AsyncLogRecord::UNSIGNED:
+            {
+                uint64_t value;
+                ring.get(pos, &value, sizeof value);
+                pos += sizeof value;
+                oss << value;
+                break;
+            }
+            case AsyncLogRecord::DOUBLE:
+            {
+                double value;
+                ring.get(pos, &value, sizeof value);
+                pos += sizeof value;
+                oss << value;
+                break;
+            }
+            case AsyncLogRecord::POINTER:
+            {
+                const void* value;
+                ring.get(pos, &value, sizeof value);
+                pos += sizeof value;
+                oss << value;
+                break;
+            }
+            default:
+                assert(false);
+                pos = end;
+        }
+    }
+    m.message = oss.str();
+
+    return header.size;
+}
+
+void AsyncLogging::drain()
+{
+    if (draining)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(drainMutex);
+    draining = true;
+
+    std::vector<std::shared_ptr<AsyncLogRing>> current;
+    {
+        std::lock_guard<std::mutex> rg(ringsMutex);
+        current = rings;
+    }
+
+    std::vector<PendingMessage> pending;
+    std::ostringstream oss;
+    uint64_t droppedNow = 0;
+
+    for (auto& ring : current)
+    {
+        // read ended before head: a ring seen ended is complete once drained
+        bool ended = ring->ended.load();
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t pos = ring->tail.load(std::memory_order_relaxed);
+
+        while (pos < head)
+        {
+            pending.emplace_back();
+            pos += decode(*ring, pos, pending.back(), oss);
+        }
+        ring->tail.store(pos, std::memory_order_release);
+        droppedNow += ring->dropped.exchange(0);
+
+        if (ended)
+        {
+            std::lock_guard<std::mutex> rg(ringsMutex);
+            rings.erase(std::remove(rings.begin(), rings.end(), ring), rings.end());
+        }
+    }
+
+    std::sort(pending.begin(), pending.end(), [](const PendingMessage& a, const PendingMessage& b) {
+        return a.seq < b.seq;
+    });
+
+    for (auto& m : pending)
+    {
+        SimpleLogger::output(formatTime(m.time).c_str(), m.level, m.source.c_str(), m.message);
+    }
+
+    if (droppedNow)
+    {
+        dropped += droppedNow;
+        oss.str(std::string());
+        oss << droppedNow << " log messages dropped: the buffers of their threads were full";
+        SimpleLogger::output(formatTime(std::time(NULL)).c_str(), logWarning, "", oss.str());
+    }
+
+    draining = false;
+}
+
+void AsyncLogging::run()
+{
+    std::unique_lock<std::mutex> lock(flusherMutex);
+    while (!stop)
+    {
+        flusherCondition.wait_for(lock, FLUSH_INTERVAL);
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+void AsyncLogging::stopFlusher()
+{
+    if (flusher.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> g(flusherMutex);
+            stop = true;
+        }
+        flusherCondition.notify_one();
+        flusher.join();
+        stop = false;
+    }
+}
+
+} // namespace
+
+bool AsyncLogRecord::begin(int level, const char* filename, int line)
+{
+    if (appending)
+    {
+        return false;
+    }
+
+    if (level == logFatal)
+    {
+        // output what precedes it, then the message itself right away
+        asyncLogging.drain();
+        return false;
+    }
+
+    appending = true;
+    mRing = ringHolder.get();
+    mStart = mRing->head.load(std::memory_order_relaxed);
+    mPos = mStart;
+    mOverflow = false;
+
+    AsyncLogHeader header;
+    header.size = 0;
+    header.level = level;
+    header.line = line;
+    header.seq = 0;
+    header.time = int64_t(std::time(NULL));
+    header.filename = filename;
+    write(&header, sizeof header);
+    return true;
+}
+
+void AsyncLogRecord::add(Tag tag, const void* data, size_t len)
+{
+    unsigned char t = tag;
+    write(&t, sizeof t);
+    if (tag == STRING)
+    {
+        uint32_t l = uint32_t(len);
+        write(&l, sizeof l);
+    }
+    write(data, len);
+}
+
+void AsyncLogRecord::write(const void* data, size_t len)
+{
+    if (mOverflow)
+    {
+        return;
+    }
+
+    if (mPos + len - mRing->tail.load(std::memory_order_acquire) > mRing->buffer.size()
+            || mPos + len - mStart > std::numeric_limits<uint32_t>::max())
+    {
+        mOverflow = true;
+        return;
+    }
+
+    mRing->put(mPos, data, len);
+    mPos += len;
+}
+
+void AsyncLogRecord::commit()
+{
+    appending = false;
+
+    if (mOverflow)
+    {
+        mRing->dropped++;
+        return;
+    }
+
+    uint32_t size = uint32_t(mPos - mStart);
+    uint64_t seq = asyncLogging.seq++;
+    mRing->put(mStart + offsetof(AsyncLogHeader, size), &size, sizeof size);
+    mRing->put(mStart + offsetof(AsyncLogHeader, seq), &seq, sizeof seq);
+    mRing->head.store(mPos, std::memory_order_release);
+
+    // wake the flusher early when the ring gets busy
+    if (mPos - mRing->tail.load(std::memory_order_relaxed) > mRing->buffer.size() / 2)
+    {
+        asyncLogging.flusherCondition.notify_one();
+    }
+}
+
+std::ostringstream& SimpleLogger::formatStream()
+{
+    return formatter;
+}
+
+void SimpleLogger::output(const char* time, int loglevel, const char* source, const std::string& message)
+{
+    if (logger)
+    {
+        logger->log(time, loglevel, source, message.c_str());
+    }
+
+    OutputStreams vec = getOutput(LogLevel(loglevel));
+
+    for (OutputStreams::iterator iter = vec.begin(); iter != vec.end(); iter++)
+    {
+        **iter << message << '\n';
+    }
+}
+
+void SimpleLogger::setAsync(bool enable, size_t bufferSize)
+{
+    std::lock_guard<std::mutex> g(asyncLogging.controlMutex);
+
+    asyncLogging.ringSize = bufferSize;
+
+    if (enable)
+    {
+        if (!asyncLogging.flusher.joinable())
+        {
+            asyncLogging.flusher = std::thread([]() { asyncLogging.run(); });
+        }
+        async = true;
+    }
+    else
+    {
+        async = false;
+        asyncLogging.stopFlusher();
+        asyncLogging.drain();
+    }
+}
+
+uint64_t SimpleLogger::asyncDropped()
+{
+    return asyncLogging.dropped.load();
+}
+
 void SimpleLogger::flush()
 {
+    asyncLogging.drain();
+
     for (auto& o : outputs)
     {
         OutputStreams::iterator iter;
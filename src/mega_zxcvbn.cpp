@@ -444,7 +444,8 @@ void ZxcvbnUnInit()
 
 #else
 
-/* Include the source file containing the dictionary data */
+/* Include the source file containing the dictionary data. It is a prebuilt trie in */
+/* constant tables: nothing is built at runtime and the pages are shared read-only. */
 #include "mega/mega_dict-src.h"
 
 #endif
@@ -216,6 +216,258 @@ void MegaNodeList::addNode(MegaNode *node)
 
 }
 
+int MegaNodeList::getHandles(MegaHandle *handles, int count) const
+{
+    int n = std::min(count, size());
+    for (int i = 0; i < n; i++)
+    {
+        MegaNode *node = get(i);
+        handles[i] = node ? node->getHandle() : INVALID_HANDLE;
+    }
+    return n;
+}
+
+int MegaNodeList::getSizes(int64_t *sizes, int count) const
+{
+    int n = std::min(count, size());
+    for (int i = 0; i < n; i++)
+    {
+        MegaNode *node = get(i);
+        sizes[i] = node ? node->getSize() : -1;
+    }
+    return n;
+}
+
+int MegaNodeList::getModificationTimes(int64_t *mtimes, int count) const
+{
+    int n = std::min(count, size());
+    for (int i = 0; i < n; i++)
+    {
+        MegaNode *node = get(i);
+        mtimes[i] = node ? node->getModificationTime() : -1;
+    }
+    return n;
+}
+
+int MegaNodeList::getTypes(int *types, int count) const
+{
+    int n = std::min(count, size());
+    for (int i = 0; i < n; i++)
+    {
+        MegaNode *node = get(i);
+        types[i] = node ? node->getType() : MegaNode::TYPE_UNKNOWN;
+    }
+    return n;
+}
+
+int MegaNodeList::getNames(char *names, int namesSize, int *offsets, int count) const
+{
+    int n = size();
+    int total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        MegaNode *node = get(i);
+        const char *name = node ? node->getName() : NULL;
+        int length = name ? int(strlen(name)) : 0;
+
+        if (offsets && i < count)
+        {
+            offsets[i] = total;
+        }
+        if (names && length <= namesSize - total)
+        {
+            memcpy(names + total, name, length);
+        }
+        total += length;
+    }
+
+    if (offsets && n < count)
+    {
+        offsets[n] = total;
+    }
+    return total;
+}
+
+MegaNodeChangeList::MegaNodeChangeList()
+{
+
+}
+
+MegaNodeChangeList::~MegaNodeChangeList()
+{
+
+}
+
+MegaNodeChangeList *MegaNodeChangeList::copy() const
+{
+    return NULL;
+}
+
+MegaHandle MegaNodeChangeList::getHandle(int i) const
+{
+    return INVALID_HANDLE;
+}
+
+int MegaNodeChangeList::getChanges(int i) const
+{
+    return 0;
+}
+
+int MegaNodeChangeList::size() const
+{
+    return 0;
+}
+
+MegaNodeSnapshot::MegaNodeSnapshot()
+{
+
+}
+
+MegaNodeSnapshot::~MegaNodeSnapshot()
+{
+
+}
+
+MegaNodeSnapshot *MegaNodeSnapshot::copy() const
+{
+    return NULL;
+}
+
+long long MegaNodeSnapshot::getGeneration() const
+{
+    return 0;
+}
+
+const char *MegaNodeSnapshot::getSequenceNumber() const
+{
+    return NULL;
+}
+
+int MegaNodeSnapshot::size() const
+{
+    return 0;
+}
+
+MegaHandle MegaNodeSnapshot::getHandle(int i) const
+{
+    return INVALID_HANDLE;
+}
+
+MegaHandle MegaNodeSnapshot::getParentHandle(int i) const
+{
+    return INVALID_HANDLE;
+}
+
+int MegaNodeSnapshot::getType(int i) const
+{
+    return MegaNode::TYPE_UNKNOWN;
+}
+
+int64_t MegaNodeSnapshot::getSize(int i) const
+{
+    return 0;
+}
+
+int64_t MegaNodeSnapshot::getModificationTime(int i) const
+{
+    return 0;
+}
+
+const char *MegaNodeSnapshot::getName(int i) const
+{
+    return NULL;
+}
+
+const char *MegaNodeSnapshot::getFingerprint(int i) const
+{
+    return NULL;
+}
+
+const char *MegaNodeSnapshot::getBuffer() const
+{
+    return NULL;
+}
+
+size_t MegaNodeSnapshot::getBufferSize() const
+{
+    return 0;
+}
+
+MegaSharedNodeTree::MegaSharedNodeTree()
+{
+
+}
+
+MegaSharedNodeTree::~MegaSharedNodeTree()
+{
+
+}
+
+MegaSharedNodeTree *MegaSharedNodeTree::open(const char *name)
+{
+    return MegaSharedNodeTreePrivate::open(name);
+}
+
+bool MegaSharedNodeTree::refresh()
+{
+    return false;
+}
+
+long long MegaSharedNodeTree::getGeneration() const
+{
+    return 0;
+}
+
+int MegaSharedNodeTree::size() const
+{
+    return 0;
+}
+
+MegaHandle MegaSharedNodeTree::getNodeByPath(const char *, MegaHandle) const
+{
+    return INVALID_HANDLE;
+}
+
+char *MegaSharedNodeTree::getNodePath(MegaHandle) const
+{
+    return NULL;
+}
+
+MegaHandle MegaSharedNodeTree::getParentHandle(MegaHandle) const
+{
+    return INVALID_HANDLE;
+}
+
+int MegaSharedNodeTree::getType(MegaHandle) const
+{
+    return MegaNode::TYPE_UNKNOWN;
+}
+
+int64_t MegaSharedNodeTree::getSize(MegaHandle) const
+{
+    return 0;
+}
+
+int64_t MegaSharedNodeTree::getModificationTime(MegaHandle) const
+{
+    return 0;
+}
+
+const char *MegaSharedNodeTree::getName(MegaHandle) const
+{
+    return NULL;
+}
+
+const char *MegaSharedNodeTree::getFingerprint(MegaHandle) const
+{
+    return NULL;
+}
+
+MegaHandleList *MegaSharedNodeTree::getChildren(MegaHandle) const
+{
+    return NULL;
+}
+
 MegaTransferList::~MegaTransferList() { }
 
 MegaTransfer *MegaTransferList::get(int)
@@ -1028,6 +1280,11 @@ MegaBackgroundMediaUpload* MegaRequest::getMegaBackgroundMediaUploadPtr() const
     return NULL;
 }
 
+MegaHandleList* MegaRequest::getMegaHandleList() const
+{
+    return NULL;
+}
+
 MegaTransfer::~MegaTransfer() { }
 
 MegaTransfer *MegaTransfer::copy()
@@ -1596,6 +1853,8 @@ void MegaGlobalListener::onUserAlertsUpdate(MegaApi *api, MegaUserAlertList *ale
 { }
 void MegaGlobalListener::onNodesUpdate(MegaApi *, MegaNodeList *)
 { }
+void MegaGlobalListener::onNodesChanged(MegaApi *, MegaNodeChangeList *)
+{ }
 void MegaGlobalListener::onAccountUpdate(MegaApi *)
 { }
 void MegaGlobalListener::onContactRequestsUpdate(MegaApi *, MegaContactRequestList *)
@@ -1630,6 +1889,8 @@ void MegaListener::onUserAlertsUpdate(MegaApi *, MegaUserAlertList *)
 { }
 void MegaListener::onNodesUpdate(MegaApi *, MegaNodeList *)
 { }
+void MegaListener::onNodesChanged(MegaApi *, MegaNodeChangeList *)
+{ }
 void MegaListener::onAccountUpdate(MegaApi *)
 { }
 void MegaListener::onContactRequestsUpdate(MegaApi *, MegaContactRequestList *)
@@ -1828,6 +2089,26 @@ void MegaApi::setLogToConsole(bool enable)
     MegaApiImpl::setLogToConsole(enable);
 }
 
+void MegaApi::enableTracing(bool enable, int eventsPerThread)
+{
+    MegaApiImpl::enableTracing(enable, eventsPerThread);
+}
+
+bool MegaApi::isTracingEnabled()
+{
+    return MegaApiImpl::isTracingEnabled();
+}
+
+char *MegaApi::getTrace(bool clear)
+{
+    return MegaApiImpl::getTrace(clear);
+}
+
+void MegaApi::setLogAsynchronous(bool enable, int bufferSize)
+{
+    MegaApiImpl::setLogAsynchronous(enable, bufferSize);
+}
+
 void MegaApi::addLoggerObject(MegaLogger *megaLogger)
 {
     MegaApiImpl::addLoggerClass(megaLogger);
@@ -2170,6 +2451,11 @@ void MegaApi::moveNode(MegaNode *node, MegaNode *newParent, MegaRequestListener
     pImpl->moveNode(node, newParent, listener);
 }
 
+void MegaApi::moveNodes(MegaNodeList *nodes, MegaNode *newParent, MegaRequestListener *listener)
+{
+    pImpl->moveNodes(nodes, newParent, listener);
+}
+
 void MegaApi::copyNode(MegaNode *node, MegaNode* target, MegaRequestListener *listener)
 {
     pImpl->copyNode(node, target, listener);
@@ -2190,6 +2476,11 @@ void MegaApi::remove(MegaNode *node, MegaRequestListener *listener)
     pImpl->remove(node, false, listener);
 }
 
+void MegaApi::removeNodes(MegaNodeList *nodes, MegaRequestListener *listener)
+{
+    pImpl->removeNodes(nodes, listener);
+}
+
 void MegaApi::removeVersions(MegaRequestListener *listener)
 {
     pImpl->removeVersions(listener);
@@ -2255,6 +2546,11 @@ void MegaApi::getPublicNode(const char* megaFileLink, MegaRequestListener *liste
     pImpl->getPublicNode(megaFileLink, listener);
 }
 
+void MegaApi::setThumbnailCache(const char* localFolder, long long maxSize)
+{
+    pImpl->setThumbnailCache(localFolder, maxSize);
+}
+
 void MegaApi::getThumbnail(MegaNode* node, const char *dstFilePath, MegaRequestListener *listener)
 {
     pImpl->getThumbnail(node, dstFilePath, listener);
@@ -2355,6 +2651,11 @@ void MegaApi::getUserAttribute(int type, MegaRequestListener *listener)
     pImpl->getUserAttribute((MegaUser*)NULL, type, listener);
 }
 
+void MegaApi::getUserAttributes(MegaUserList* users, int type, MegaRequestListener *listener)
+{
+    pImpl->getUserAttributes(users, type, listener);
+}
+
 const char *MegaApi::userAttributeToString(int attr)
 {
     return MegaApi::strdup(pImpl->userAttributeToString(attr).c_str());
@@ -2395,6 +2696,11 @@ void MegaApi::setCustomNodeAttribute(MegaNode *node, const char *attrName, const
     pImpl->setCustomNodeAttribute(node, attrName, value, listener);
 }
 
+void MegaApi::setCustomNodesAttribute(MegaNodeList *nodes, const char *attrName, const char *value, MegaRequestListener *listener)
+{
+    pImpl->setCustomNodesAttribute(nodes, attrName, value, listener);
+}
+
 void MegaApi::setNodeDuration(MegaNode *node, int secs, MegaRequestListener *listener)
 {
     pImpl->setNodeDuration(node, secs, listener);
@@ -2430,6 +2736,16 @@ void MegaApi::fetchNodes(MegaRequestListener *listener)
     pImpl->fetchNodes(listener);
 }
 
+void MegaApi::fetchFolder(MegaNode *folder, MegaRequestListener *listener)
+{
+    pImpl->fetchFolder(folder, listener);
+}
+
+bool MegaApi::isFolderFetched(MegaNode *folder)
+{
+    return pImpl->isFolderFetched(folder);
+}
+
 void MegaApi::getCloudStorageUsed(MegaRequestListener *listener)
 {
     pImpl->getCloudStorageUsed(listener);
@@ -2692,6 +3008,21 @@ bool MegaApi::usingHttpsOnly()
     return pImpl->usingHttpsOnly();
 }
 
+void MegaApi::enableDownloadHardLinks(bool enable)
+{
+    pImpl->enableDownloadHardLinks(enable);
+}
+
+bool MegaApi::areDownloadHardLinksEnabled()
+{
+    return pImpl->areDownloadHardLinksEnabled();
+}
+
+bool MegaApi::recordActionPackets(const char *localPath)
+{
+    return pImpl->recordActionPackets(localPath);
+}
+
 void MegaApi::inviteContact(const char *email, const char *message, int action, MegaRequestListener *listener)
 {
     pImpl->inviteContact(email, message, action, UNDEF, listener);
@@ -2793,72 +3124,137 @@ bool MegaApi::setMaxUploadSpeed(long long bpslimit)
     return pImpl->setMaxUploadSpeed(bpslimit);
 }
 
-int MegaApi::getCurrentDownloadSpeed()
+bool MegaApi::setHTTP2Enabled(bool enable)
 {
-    return pImpl->getCurrentDownloadSpeed();
+    return pImpl->setHTTP2Enabled(enable);
 }
 
-int MegaApi::getCurrentUploadSpeed()
+bool MegaApi::isHTTP2Enabled()
 {
-    return pImpl->getCurrentUploadSpeed();
+    return pImpl->isHTTP2Enabled();
 }
 
-int MegaApi::getCurrentSpeed(int type)
+bool MegaApi::setSocketOptions(int direction, int recvBufferSize, int sendBufferSize, int notSentLowat, const char* congestionControl, int bufferSize)
 {
-    return pImpl->getCurrentSpeed(type);
+    return pImpl->setSocketOptions(direction, recvBufferSize, sendBufferSize, notSentLowat, congestionControl, bufferSize);
 }
 
-int MegaApi::getDownloadMethod()
+bool MegaApi::setConnectionCacheLimits(int direction, int maxIdleConnections, int maxHostConnections, int maxTotalConnections, int maxIdleSeconds)
 {
-    return pImpl->getDownloadMethod();
+    return pImpl->setConnectionCacheLimits(direction, maxIdleConnections, maxHostConnections, maxTotalConnections, maxIdleSeconds);
 }
 
-int MegaApi::getUploadMethod()
+bool MegaApi::setNetworkThreadEnabled(bool enable)
 {
-    return pImpl->getUploadMethod();
+    return pImpl->setNetworkThreadEnabled(enable);
 }
 
-MegaTransferData *MegaApi::getTransferData(MegaTransferListener *listener)
+bool MegaApi::isNetworkThreadEnabled()
 {
-    return pImpl->getTransferData(listener);
+    return pImpl->isNetworkThreadEnabled();
 }
 
-MegaTransfer *MegaApi::getFirstTransfer(int type)
+bool MegaApi::setBackgroundTransferHandler(MegaBackgroundTransferHandler* handler, const char* folder)
 {
-    return pImpl->getFirstTransfer(type);
+    return pImpl->setBackgroundTransferHandler(handler, folder);
 }
 
-void MegaApi::notifyTransfer(MegaTransfer *transfer, MegaTransferListener *listener)
+void MegaApi::enableBackgroundTransfers(bool enable)
 {
-    pImpl->notifyTransfer(transfer ? transfer->getTag() : 0, listener);
+    pImpl->enableBackgroundTransfers(enable);
 }
 
-void MegaApi::notifyTransferByTag(int transferTag, MegaTransferListener *listener)
+bool MegaApi::areBackgroundTransfersEnabled()
 {
-    pImpl->notifyTransfer(transferTag, listener);
+    return pImpl->areBackgroundTransfersEnabled();
 }
 
-MegaTransferList *MegaApi::getTransfers()
+bool MegaApi::backgroundTransferFinished(int64_t id, int httpStatus, const char* response)
 {
-    return pImpl->getTransfers();
+    return pImpl->backgroundTransferFinished(id, httpStatus, response);
 }
 
-MegaTransferList *MegaApi::getStreamingTransfers()
+int MegaApi::getCurrentDownloadSpeed()
 {
-    return pImpl->getStreamingTransfers();
+    return pImpl->getCurrentDownloadSpeed();
 }
 
-MegaTransfer *MegaApi::getTransferByTag(int transferTag)
+int MegaApi::getCurrentUploadSpeed()
 {
-    return pImpl->getTransferByTag(transferTag);
+    return pImpl->getCurrentUploadSpeed();
 }
 
-MegaTransferList *MegaApi::getTransfers(int type)
+int MegaApi::getCurrentSpeed(int type)
 {
-    return pImpl->getTransfers(type);
+    return pImpl->getCurrentSpeed(type);
 }
 
-MegaTransferList *MegaApi::getChildTransfers(int transferTag)
+int MegaApi::getDownloadMethod()
+{
+    return pImpl->getDownloadMethod();
+}
+
+int MegaApi::getUploadMethod()
+{
+    return pImpl->getUploadMethod();
+}
+
+MegaTransferData *MegaApi::getTransferData(MegaTransferListener *listener)
+{
+    return pImpl->getTransferData(listener);
+}
+
+int MegaApi::getTransferProgressSnapshot(MegaTransferProgress *progress, int size)
+{
+    return pImpl->getTransferProgressSnapshot(progress, size);
+}
+
+void MegaApi::enableTransferUpdateCallbacks(bool enable)
+{
+    pImpl->enableTransferUpdateCallbacks(enable);
+}
+
+bool MegaApi::areTransferUpdateCallbacksEnabled()
+{
+    return pImpl->areTransferUpdateCallbacksEnabled();
+}
+
+MegaTransfer *MegaApi::getFirstTransfer(int type)
+{
+    return pImpl->getFirstTransfer(type);
+}
+
+void MegaApi::notifyTransfer(MegaTransfer *transfer, MegaTransferListener *listener)
+{
+    pImpl->notifyTransfer(transfer ? transfer->getTag() : 0, listener);
+}
+
+void MegaApi::notifyTransferByTag(int transferTag, MegaTransferListener *listener)
+{
+    pImpl->notifyTransfer(transferTag, listener);
+}
+
+MegaTransferList *MegaApi::getTransfers()
+{
+    return pImpl->getTransfers();
+}
+
+MegaTransferList *MegaApi::getStreamingTransfers()
+{
+    return pImpl->getStreamingTransfers();
+}
+
+MegaTransfer *MegaApi::getTransferByTag(int transferTag)
+{
+    return pImpl->getTransferByTag(transferTag);
+}
+
+MegaTransferList *MegaApi::getTransfers(int type)
+{
+    return pImpl->getTransfers(type);
+}
+
+MegaTransferList *MegaApi::getChildTransfers(int transferTag)
 {
     return pImpl->getChildTransfers(transferTag);
 }
@@ -2889,6 +3285,31 @@ void MegaApi::abortCurrentBackup(int tag, MegaRequestListener *listener)
     pImpl->abortCurrentBackup(tag, listener);
 }
 
+void MegaApi::enableIncrementalBackups(bool enable)
+{
+    pImpl->enableIncrementalBackups(enable);
+}
+
+bool MegaApi::isIncrementalBackupsEnabled()
+{
+    return pImpl->isIncrementalBackupsEnabled();
+}
+
+void MegaApi::setMaxConcurrentBackups(int maxBackups)
+{
+    pImpl->setMaxConcurrentBackups(maxBackups);
+}
+
+int MegaApi::getMaxConcurrentBackups()
+{
+    return pImpl->getMaxConcurrentBackups();
+}
+
+bool MegaApi::setBackupLimits(int backupTag, int maxUploads, long long bytesPerSecond)
+{
+    return pImpl->setBackupLimits(backupTag, maxUploads, bytesPerSecond);
+}
+
 void MegaApi::startTimer( int64_t period, MegaRequestListener *listener)
 {
     pImpl->startTimer(period, listener);
@@ -2924,11 +3345,21 @@ void MegaApi::startUpload(const char* localPath, MegaNode* parent, const char* f
     pImpl->startUpload(localPath, parent, fileName, listener);
 }
 
+void MegaApi::startUploads(MegaUploadBatch* batch, MegaTransferListener *listener)
+{
+    pImpl->startUploads(batch, listener);
+}
+
 void MegaApi::startUpload(const char *localPath, MegaNode *parent, const char *fileName, int64_t mtime, MegaTransferListener *listener)
 {
     pImpl->startUpload(false, localPath, parent, fileName, mtime, 0, false, NULL, false, false, listener);
 }
 
+void MegaApi::startUploadFromStream(MegaInputStream *inputStream, MegaNode *parent, const char *fileName, int64_t mtime, MegaTransferListener *listener)
+{
+    pImpl->startUploadFromStream(inputStream, parent, fileName, mtime, listener);
+}
+
 void MegaApi::startUploadForChat(const char *localPath, MegaNode *parent, const char *appData, bool isSourceTemporary, MegaTransferListener *listener)
 {
     pImpl->startUpload(false, localPath, parent, nullptr, -1, 0, false, appData, isSourceTemporary, true, listener);
@@ -3129,6 +3560,11 @@ MegaSync *MegaApi::getSyncByPath(const char *localPath)
     return pImpl->getSyncByPath(localPath);
 }
 
+MegaSyncStats *MegaApi::getSyncStats(int tag)
+{
+    return pImpl->getSyncStats(tag);
+}
+
 bool MegaApi::isScanning()
 {
     return pImpl->isIndexing();
@@ -3174,6 +3610,16 @@ void MegaApi::setExclusionUpperSizeLimit(long long limit)
     pImpl->setExclusionUpperSizeLimit(limit);
 }
 
+void MegaApi::setSyncScanTimeBudget(int milliseconds)
+{
+    pImpl->setSyncScanTimeBudget(milliseconds);
+}
+
+int MegaApi::getSyncScanTimeBudget()
+{
+    return pImpl->getSyncScanTimeBudget();
+}
+
 #ifdef USE_PCRE
 void MegaApi::setExcludedRegularExpressions(MegaSync *sync, MegaRegExp *regExp)
 {
@@ -3188,303 +3634,713 @@ MegaBackup *MegaApi::getBackupByTag(int tag)
     return pImpl->getBackupByTag(tag);
 }
 
-MegaBackup *MegaApi::getBackupByNode(MegaNode *node)
+MegaBackup *MegaApi::getBackupByNode(MegaNode *node)
+{
+    return pImpl->getBackupByNode(node);
+}
+
+MegaBackup *MegaApi::getBackupByPath(const char *localPath)
+{
+    return pImpl->getBackupByPath(localPath);
+}
+
+int MegaApi::getNumPendingUploads()
+{
+    return pImpl->getNumPendingUploads();
+}
+
+int MegaApi::getNumPendingDownloads()
+{
+    return pImpl->getNumPendingDownloads();
+}
+
+int MegaApi::getTotalUploads()
+{
+    return pImpl->getTotalUploads();
+}
+
+int MegaApi::getTotalDownloads()
+{
+    return pImpl->getTotalDownloads();
+}
+
+void MegaApi::resetTotalDownloads()
+{
+    pImpl->resetTotalDownloads();
+}
+
+void MegaApi::resetTotalUploads()
+{
+    pImpl->resetTotalUploads();
+}
+
+MegaNode *MegaApi::getRootNode()
+{
+    return pImpl->getRootNode();
+}
+
+MegaNode* MegaApi::getInboxNode()
+{
+    return pImpl->getInboxNode();
+}
+
+MegaNode* MegaApi::getRubbishNode()
+{
+    return pImpl->getRubbishNode();
+}
+
+MegaNode *MegaApi::getRootNode(MegaNode *node)
+{
+    return pImpl->getRootNode(node);
+}
+
+bool MegaApi::isInCloud(MegaNode *node)
+{
+    return pImpl->isInRootnode(node, 0);
+}
+
+bool MegaApi::isInRubbish(MegaNode *node)
+{
+    return pImpl->isInRootnode(node, 2);
+}
+
+bool MegaApi::isInInbox(MegaNode *node)
+{
+    return pImpl->isInRootnode(node, 1);
+}
+
+void MegaApi::setDefaultFilePermissions(int permissions)
+{
+    pImpl->setDefaultFilePermissions(permissions);
+}
+
+int MegaApi::getDefaultFilePermissions()
+{
+    return pImpl->getDefaultFilePermissions();
+}
+
+void MegaApi::setDefaultFolderPermissions(int permissions)
+{
+    pImpl->setDefaultFolderPermissions(permissions);
+}
+
+int MegaApi::getDefaultFolderPermissions()
+{
+    return pImpl->getDefaultFolderPermissions();
+}
+
+void MegaApi::setDownloadWriteOptions(int options)
+{
+    pImpl->setDownloadWriteOptions(options);
+}
+
+int MegaApi::getDownloadWriteOptions()
+{
+    return pImpl->getDownloadWriteOptions();
+}
+
+void MegaApi::setDownloadDurability(int policy, int windowMs)
+{
+    pImpl->setDownloadDurability(policy, windowMs);
+}
+
+long long MegaApi::getBandwidthOverquotaDelay()
+{
+    return pImpl->getBandwidthOverquotaDelay();
+}
+
+long long MegaApi::getTransferQuotaTimeLeft()
+{
+    return pImpl->getTransferQuotaTimeLeft();
+}
+
+MegaUserList* MegaApi::getContacts()
+{
+    return pImpl->getContacts();
+}
+
+MegaUser* MegaApi::getContact(const char* user)
+{
+    return pImpl->getContact(user);
+}
+
+MegaUserAlertList* MegaApi::getUserAlerts()
+{
+    return pImpl->getUserAlerts();
+}
+
+MegaUserAlertList* MegaApi::getUserAlerts(int start, int count)
+{
+    return pImpl->getUserAlerts(start, count);
+}
+
+int MegaApi::getNumUserAlerts()
+{
+    return pImpl->getNumUserAlerts();
+}
+
+int MegaApi::getNumUnreadUserAlerts()
+{
+    return pImpl->getNumUnreadUserAlerts();
+}
+
+MegaNodeList* MegaApi::getInShares(MegaUser *megaUser, int order)
+{
+    return pImpl->getInShares(megaUser, order);
+}
+
+MegaNodeList* MegaApi::getInShares(int order)
+{
+    return pImpl->getInShares(order);
+}
+
+MegaShareList* MegaApi::getInSharesList(int order)
+{
+    return pImpl->getInSharesList(order);
+}
+
+MegaUser *MegaApi::getUserFromInShare(MegaNode *node)
+{
+    return pImpl->getUserFromInShare(node);
+}
+
+bool MegaApi::isShared(MegaNode *node)
+{
+    if (!node)
+    {
+        return false;
+    }
+
+    return node->isShared();
+}
+
+bool MegaApi::isOutShare(MegaNode *node)
+{
+    if (!node)
+    {
+        return false;
+    }
+
+    return node->isOutShare();
+}
+
+bool MegaApi::isInShare(MegaNode *node)
+{
+    if (!node)
+    {
+        return false;
+    }
+
+    return node->isInShare();
+}
+
+bool MegaApi::isPendingShare(MegaNode *node)
+{
+    return pImpl->isPendingShare(node);
+}
+
+MegaShareList *MegaApi::getOutShares(int order)
+{
+    return pImpl->getOutShares(order);
+}
+
+MegaShareList* MegaApi::getOutShares(MegaNode *megaNode)
+{
+    return pImpl->getOutShares(megaNode);
+}
+
+MegaShareList *MegaApi::getPendingOutShares()
+{
+    return pImpl->getPendingOutShares();
+}
+
+MegaShareList *MegaApi::getPendingOutShares(MegaNode *node)
+{
+    return pImpl->getPendingOutShares(node);
+}
+
+MegaNodeList *MegaApi::getPublicLinks(int order)
+{
+    return pImpl->getPublicLinks(order);
+}
+
+MegaContactRequestList *MegaApi::getIncomingContactRequests()
+{
+    return pImpl->getIncomingContactRequests();
+}
+
+MegaContactRequestList *MegaApi::getOutgoingContactRequests()
+{
+    return pImpl->getOutgoingContactRequests();
+}
+
+int MegaApi::getAccess(MegaNode* megaNode)
+{
+    return pImpl->getAccess(megaNode);
+}
+
+MegaRecentActionBucketList* MegaApi::getRecentActions(unsigned days, unsigned maxnodes)
+{
+    return pImpl->getRecentActions(days, maxnodes);
+}
+
+MegaRecentActionBucketList* MegaApi::getRecentActions()
+{
+    return pImpl->getRecentActions();
+}
+
+bool MegaApi::processMegaTree(MegaNode* n, MegaTreeProcessor* processor, bool recursive)
+{
+    return pImpl->processMegaTree(n, processor, recursive);
+}
+
+MegaNodeSnapshot *MegaApi::getNodeSnapshot(MegaNode *node)
+{
+    return pImpl->getNodeSnapshot(node);
+}
+
+long long MegaApi::getNodeGeneration()
+{
+    return pImpl->getNodeGeneration();
+}
+
+MegaNodeChangeList *MegaApi::getNodeChangesSince(long long generation)
+{
+    return pImpl->getNodeChangesSince(generation);
+}
+
+bool MegaApi::startNodeTreeExport(const char *name)
+{
+    return pImpl->startNodeTreeExport(name);
+}
+
+void MegaApi::stopNodeTreeExport()
+{
+    pImpl->stopNodeTreeExport();
+}
+
+MegaNode *MegaApi::createForeignFileNode(MegaHandle handle, const char *key,
+                                    const char *name, int64_t size, int64_t mtime,
+                                        MegaHandle parentHandle, const char *privateAuth, const char *publicAuth, const char *chatAuth)
+{
+    return pImpl->createForeignFileNode(handle, key, name, size, mtime, parentHandle, privateAuth, publicAuth, chatAuth);
+}
+
+void MegaApi::getLastAvailableVersion(const char *appKey, MegaRequestListener *listener)
+{
+    pImpl->getLastAvailableVersion(appKey, listener);
+}
+
+void MegaApi::getLocalSSLCertificate(MegaRequestListener *listener)
+{
+    pImpl->getLocalSSLCertificate(listener);
+}
+
+void MegaApi::queryDNS(const char *hostname, MegaRequestListener *listener)
+{
+    pImpl->queryDNS(hostname, listener);
+}
+
+void MegaApi::queryGeLB(const char *service, int timeoutds, int maxretries, MegaRequestListener *listener)
+{
+    pImpl->queryGeLB(service, timeoutds, maxretries, listener);
+}
+
+void MegaApi::downloadFile(const char *url, const char *dstpath, MegaRequestListener *listener)
+{
+    pImpl->downloadFile(url, dstpath, listener);
+}
+
+MegaNode *MegaApi::createForeignFolderNode(MegaHandle handle, const char *name, MegaHandle parentHandle, const char *privateAuth, const char *publicAuth)
+{
+    return pImpl->createForeignFolderNode(handle, name, parentHandle, privateAuth, publicAuth);
+}
+
+MegaNode *MegaApi::authorizeNode(MegaNode *node)
+{
+    return pImpl->authorizeNode(node);
+}
+
+#ifdef ENABLE_CHAT
+MegaNode *MegaApi::authorizeChatNode(MegaNode *node, const char *cauth)
+{
+    return pImpl->authorizeChatNode(node, cauth);
+}
+#endif
+
+const char *MegaApi::getVersion()
+{
+    return pImpl->getVersion();
+}
+
+char *MegaApi::getOperatingSystemVersion()
+{
+    return pImpl->getOperatingSystemVersion();
+}
+
+const char *MegaApi::getUserAgent()
+{
+    return pImpl->getUserAgent();
+}
+
+const char *MegaApi::getBasePath()
+{
+    return pImpl->getBasePath();
+}
+
+void MegaApi::enableSearchIndex(bool enable)
+{
+    pImpl->enableSearchIndex(enable);
+}
+
+bool MegaApi::isSearchIndexEnabled()
+{
+    return pImpl->isSearchIndexEnabled();
+}
+
+void MegaApi::enableLazyNodeLoading(bool enable)
+{
+    pImpl->enableLazyNodeLoading(enable);
+}
+
+bool MegaApi::isLazyNodeLoadingEnabled()
+{
+    return pImpl->isLazyNodeLoadingEnabled();
+}
+
+void MegaApi::enableAsyncDbWrites(bool enable)
+{
+    pImpl->enableAsyncDbWrites(enable);
+}
+
+bool MegaApi::areAsyncDbWritesEnabled()
+{
+    return pImpl->areAsyncDbWritesEnabled();
+}
+
+void MegaApi::enableStateCacheSnapshots(bool enable)
+{
+    pImpl->enableStateCacheSnapshots(enable);
+}
+
+bool MegaApi::areStateCacheSnapshotsEnabled()
+{
+    return pImpl->areStateCacheSnapshotsEnabled();
+}
+
+void MegaApi::enableReloadReconciliation(bool enable)
+{
+    pImpl->enableReloadReconciliation(enable);
+}
+
+bool MegaApi::isReloadReconciliationEnabled()
+{
+    return pImpl->isReloadReconciliationEnabled();
+}
+
+void MegaApi::enableActionPacketPrefetch(bool enable)
+{
+    pImpl->enableActionPacketPrefetch(enable);
+}
+
+bool MegaApi::isActionPacketPrefetchEnabled()
+{
+    return pImpl->isActionPacketPrefetchEnabled();
+}
+
+void MegaApi::setNodeUpdateCoalescing(int milliseconds, int maxNodes)
 {
-    return pImpl->getBackupByNode(node);
+    pImpl->setNodeUpdateCoalescing(milliseconds, maxNodes);
 }
 
-MegaBackup *MegaApi::getBackupByPath(const char *localPath)
+int MegaApi::getNodeUpdateCoalescingWindow()
 {
-    return pImpl->getBackupByPath(localPath);
+    return pImpl->getNodeUpdateCoalescingWindow();
 }
 
-int MegaApi::getNumPendingUploads()
+void MegaApi::enableCompactNodeUpdates(bool enable)
 {
-    return pImpl->getNumPendingUploads();
+    pImpl->enableCompactNodeUpdates(enable);
 }
 
-int MegaApi::getNumPendingDownloads()
+bool MegaApi::areCompactNodeUpdatesEnabled()
 {
-    return pImpl->getNumPendingDownloads();
+    return pImpl->areCompactNodeUpdatesEnabled();
 }
 
-int MegaApi::getTotalUploads()
+void MegaApi::enableLazyFolderLinks(bool enable)
 {
-    return pImpl->getTotalUploads();
+    pImpl->enableLazyFolderLinks(enable);
 }
 
-int MegaApi::getTotalDownloads()
+bool MegaApi::areLazyFolderLinksEnabled()
 {
-    return pImpl->getTotalDownloads();
+    return pImpl->areLazyFolderLinksEnabled();
 }
 
-void MegaApi::resetTotalDownloads()
+void MegaApi::enableAdaptiveTransfers(bool enable)
 {
-    pImpl->resetTotalDownloads();
+    pImpl->enableAdaptiveTransfers(enable);
 }
 
-void MegaApi::resetTotalUploads()
+bool MegaApi::areAdaptiveTransfersEnabled()
 {
-    pImpl->resetTotalUploads();
+    return pImpl->areAdaptiveTransfersEnabled();
 }
 
-MegaNode *MegaApi::getRootNode()
+void MegaApi::setTransferSchedule(int schedule)
 {
-    return pImpl->getRootNode();
+    pImpl->setTransferSchedule(schedule);
 }
 
-MegaNode* MegaApi::getInboxNode()
+int MegaApi::getTransferSchedule()
 {
-    return pImpl->getInboxNode();
+    return pImpl->getTransferSchedule();
 }
 
-MegaNode* MegaApi::getRubbishNode()
+void MegaApi::setTransferClassWeight(int transferTag, unsigned weight)
 {
-    return pImpl->getRubbishNode();
+    pImpl->setTransferClassWeight(transferTag, weight);
 }
 
-MegaNode *MegaApi::getRootNode(MegaNode *node)
+void MegaApi::enableUploadBatching(bool enable)
 {
-    return pImpl->getRootNode(node);
+    pImpl->enableUploadBatching(enable);
 }
 
-bool MegaApi::isInCloud(MegaNode *node)
+bool MegaApi::isUploadBatchingEnabled()
 {
-    return pImpl->isInRootnode(node, 0);
+    return pImpl->isUploadBatchingEnabled();
 }
 
-bool MegaApi::isInRubbish(MegaNode *node)
+void MegaApi::setTransferCryptoThreads(int threads)
 {
-    return pImpl->isInRootnode(node, 2);
+    pImpl->setTransferCryptoThreads(threads);
 }
 
-bool MegaApi::isInInbox(MegaNode *node)
+int MegaApi::getTransferCryptoThreads()
 {
-    return pImpl->isInRootnode(node, 1);
+    return pImpl->getTransferCryptoThreads();
 }
 
-void MegaApi::setDefaultFilePermissions(int permissions)
+void MegaApi::setSharedWorkerThreads(int threads)
 {
-    pImpl->setDefaultFilePermissions(permissions);
+    MegaApiImpl::setSharedWorkerThreads(threads);
 }
 
-int MegaApi::getDefaultFilePermissions()
+int MegaApi::getSharedWorkerThreads()
 {
-    return pImpl->getDefaultFilePermissions();
+    return MegaApiImpl::getSharedWorkerThreads();
 }
 
-void MegaApi::setDefaultFolderPermissions(int permissions)
+void MegaApi::enableSharedNetworkCaches(bool enable)
 {
-    pImpl->setDefaultFolderPermissions(permissions);
+    MegaApiImpl::enableSharedNetworkCaches(enable);
 }
 
-int MegaApi::getDefaultFolderPermissions()
+bool MegaApi::areSharedNetworkCachesEnabled()
 {
-    return pImpl->getDefaultFolderPermissions();
+    return MegaApiImpl::areSharedNetworkCachesEnabled();
 }
 
-long long MegaApi::getBandwidthOverquotaDelay()
+void MegaApi::setNetworkBackend(int backend)
 {
-    return pImpl->getBandwidthOverquotaDelay();
+    MegaApiImpl::setNetworkBackend(backend);
 }
 
-MegaUserList* MegaApi::getContacts()
+int MegaApi::getNetworkBackend()
 {
-    return pImpl->getContacts();
+    return MegaApiImpl::getNetworkBackend();
 }
 
-MegaUser* MegaApi::getContact(const char* user)
+void MegaApi::setGfxWorkers(int threads)
 {
-    return pImpl->getContact(user);
+    pImpl->setGfxWorkers(threads);
 }
 
-MegaUserAlertList* MegaApi::getUserAlerts()
+int MegaApi::getGfxWorkers()
 {
-    return pImpl->getUserAlerts();
+    return pImpl->getGfxWorkers();
 }
 
-int MegaApi::getNumUnreadUserAlerts()
+void MegaApi::setPowerPolicy(int policy)
 {
-    return pImpl->getNumUnreadUserAlerts();
+    pImpl->setPowerPolicy(policy);
 }
 
-MegaNodeList* MegaApi::getInShares(MegaUser *megaUser, int order)
+int MegaApi::getPowerPolicy()
 {
-    return pImpl->getInShares(megaUser, order);
+    return pImpl->getPowerPolicy();
 }
 
-MegaNodeList* MegaApi::getInShares(int order)
+void MegaApi::setPowerState(int powerState, int thermalState)
 {
-    return pImpl->getInShares(order);
+    pImpl->setPowerState(powerState, thermalState);
 }
 
-MegaShareList* MegaApi::getInSharesList(int order)
+bool MegaApi::isLowPowerActive()
 {
-    return pImpl->getInSharesList(order);
+    return pImpl->isLowPowerActive();
 }
 
-MegaUser *MegaApi::getUserFromInShare(MegaNode *node)
+void MegaApi::enableAsyncTransferCallbacks(bool enable)
 {
-    return pImpl->getUserFromInShare(node);
+    pImpl->enableAsyncTransferCallbacks(enable);
 }
 
-bool MegaApi::isShared(MegaNode *node)
+bool MegaApi::areAsyncTransferCallbacksEnabled()
 {
-    if (!node)
-    {
-        return false;
-    }
+    return pImpl->areAsyncTransferCallbacksEnabled();
+}
 
-    return node->isShared();
+void MegaApi::enableHedgedDownloads(bool enable)
+{
+    pImpl->enableHedgedDownloads(enable);
 }
 
-bool MegaApi::isOutShare(MegaNode *node)
+bool MegaApi::areHedgedDownloadsEnabled()
 {
-    if (!node)
-    {
-        return false;
-    }
+    return pImpl->areHedgedDownloadsEnabled();
+}
 
-    return node->isOutShare();
+void MegaApi::setUploadReadAhead(int chunks)
+{
+    pImpl->setUploadReadAhead(chunks);
 }
 
-bool MegaApi::isInShare(MegaNode *node)
+int MegaApi::getUploadReadAhead()
 {
-    if (!node)
-    {
-        return false;
-    }
+    return pImpl->getUploadReadAhead();
+}
 
-    return node->isInShare();
+void MegaApi::enableFingerprintCache(bool enable)
+{
+    pImpl->enableFingerprintCache(enable);
 }
 
-bool MegaApi::isPendingShare(MegaNode *node)
+bool MegaApi::isFingerprintCacheEnabled()
 {
-    return pImpl->isPendingShare(node);
+    return pImpl->isFingerprintCacheEnabled();
 }
 
-MegaShareList *MegaApi::getOutShares(int order)
+void MegaApi::enableConnectionPrewarming(bool enable)
 {
-    return pImpl->getOutShares(order);
+    pImpl->enableConnectionPrewarming(enable);
 }
 
-MegaShareList* MegaApi::getOutShares(MegaNode *megaNode)
+bool MegaApi::isConnectionPrewarmingEnabled()
 {
-    return pImpl->getOutShares(megaNode);
+    return pImpl->isConnectionPrewarmingEnabled();
 }
 
-MegaShareList *MegaApi::getPendingOutShares()
+void MegaApi::enableTransferUrlPrefetching(bool enable)
 {
-    return pImpl->getPendingOutShares();
+    pImpl->enableTransferUrlPrefetching(enable);
 }
 
-MegaShareList *MegaApi::getPendingOutShares(MegaNode *node)
+bool MegaApi::isTransferUrlPrefetchingEnabled()
 {
-    return pImpl->getPendingOutShares(node);
+    return pImpl->isTransferUrlPrefetchingEnabled();
 }
 
-MegaNodeList *MegaApi::getPublicLinks(int order)
+void MegaApi::enablePipelinedStartup(bool enable)
 {
-    return pImpl->getPublicLinks(order);
+    pImpl->enablePipelinedStartup(enable);
 }
 
-MegaContactRequestList *MegaApi::getIncomingContactRequests()
+bool MegaApi::isPipelinedStartupEnabled()
 {
-    return pImpl->getIncomingContactRequests();
+    return pImpl->isPipelinedStartupEnabled();
 }
 
-MegaContactRequestList *MegaApi::getOutgoingContactRequests()
+void MegaApi::enableTlsSessionCache(bool enable)
 {
-    return pImpl->getOutgoingContactRequests();
+    pImpl->enableTlsSessionCache(enable);
 }
 
-int MegaApi::getAccess(MegaNode* megaNode)
+bool MegaApi::isTlsSessionCacheEnabled()
 {
-    return pImpl->getAccess(megaNode);
+    return pImpl->isTlsSessionCacheEnabled();
 }
 
-MegaRecentActionBucketList* MegaApi::getRecentActions(unsigned days, unsigned maxnodes)
+char* MegaApi::getNetworkStats(bool reset)
 {
-    return pImpl->getRecentActions(days, maxnodes);
+    return pImpl->getNetworkStats(reset);
 }
 
-MegaRecentActionBucketList* MegaApi::getRecentActions()
+char* MegaApi::getMemoryUsageReport()
 {
-    return pImpl->getRecentActions();
+    return pImpl->getMemoryUsageReport();
 }
 
-bool MegaApi::processMegaTree(MegaNode* n, MegaTreeProcessor* processor, bool recursive)
+void MegaApi::setPerformanceSampling(int interval)
 {
-    return pImpl->processMegaTree(n, processor, recursive);
+    MegaApiImpl::setPerformanceSampling(interval);
 }
 
-MegaNode *MegaApi::createForeignFileNode(MegaHandle handle, const char *key,
-                                    const char *name, int64_t size, int64_t mtime,
-                                        MegaHandle parentHandle, const char *privateAuth, const char *publicAuth, const char *chatAuth)
+char* MegaApi::getPerformanceLatencies(bool reset)
 {
-    return pImpl->createForeignFileNode(handle, key, name, size, mtime, parentHandle, privateAuth, publicAuth, chatAuth);
+    return pImpl->getPerformanceLatencies(reset);
 }
 
-void MegaApi::getLastAvailableVersion(const char *appKey, MegaRequestListener *listener)
+void MegaApi::enableUploadDeduplication(bool enable)
 {
-    pImpl->getLastAvailableVersion(appKey, listener);
+    pImpl->enableUploadDeduplication(enable);
 }
 
-void MegaApi::getLocalSSLCertificate(MegaRequestListener *listener)
+bool MegaApi::isUploadDeduplicationEnabled()
 {
-    pImpl->getLocalSSLCertificate(listener);
+    return pImpl->isUploadDeduplicationEnabled();
 }
 
-void MegaApi::queryDNS(const char *hostname, MegaRequestListener *listener)
+long long MegaApi::getUploadDeduplicatedBytes()
 {
-    pImpl->queryDNS(hostname, listener);
+    return pImpl->getUploadDeduplicatedBytes();
 }
 
-void MegaApi::queryGeLB(const char *service, int timeoutds, int maxretries, MegaRequestListener *listener)
+void MegaApi::setCompressedTransfers(bool enable)
 {
-    pImpl->queryGeLB(service, timeoutds, maxretries, listener);
+    pImpl->setCompressedTransfers(enable);
 }
 
-void MegaApi::downloadFile(const char *url, const char *dstpath, MegaRequestListener *listener)
+bool MegaApi::areCompressedTransfersEnabled()
 {
-    pImpl->downloadFile(url, dstpath, listener);
+    return pImpl->areCompressedTransfersEnabled();
 }
 
-MegaNode *MegaApi::createForeignFolderNode(MegaHandle handle, const char *name, MegaHandle parentHandle, const char *privateAuth, const char *publicAuth)
+void MegaApi::setTransferRateLimit(int transferTag, long long bytesPerSecond, long long burstBytes)
 {
-    return pImpl->createForeignFolderNode(handle, name, parentHandle, privateAuth, publicAuth);
+    pImpl->setTransferRateLimit(transferTag, bytesPerSecond, burstBytes);
 }
 
-MegaNode *MegaApi::authorizeNode(MegaNode *node)
+void MegaApi::addTransferRateLimitPeriod(int transferTag, int startMinute, int endMinute, long long bytesPerSecond)
 {
-    return pImpl->authorizeNode(node);
+    pImpl->addTransferRateLimitPeriod(transferTag, startMinute, endMinute, bytesPerSecond);
 }
 
-#ifdef ENABLE_CHAT
-MegaNode *MegaApi::authorizeChatNode(MegaNode *node, const char *cauth)
+void MegaApi::setStreamingCacheSize(long long bytes)
 {
-    return pImpl->authorizeChatNode(node, cauth);
+    pImpl->setStreamingCacheSize(bytes);
 }
-#endif
 
-const char *MegaApi::getVersion()
+long long MegaApi::getStreamingCacheSize()
 {
-    return pImpl->getVersion();
+    return pImpl->getStreamingCacheSize();
 }
 
-char *MegaApi::getOperatingSystemVersion()
+void MegaApi::setPipelinedRequests(int maxBatches)
 {
-    return pImpl->getOperatingSystemVersion();
+    pImpl->setPipelinedRequests(maxBatches);
 }
 
-const char *MegaApi::getUserAgent()
+int MegaApi::getPipelinedRequests()
 {
-    return pImpl->getUserAgent();
+    return pImpl->getPipelinedRequests();
 }
 
-const char *MegaApi::getBasePath()
+void MegaApi::setDatabaseOption(int option, long long value)
 {
-    return pImpl->getBasePath();
+    pImpl->setDatabaseOption(option, value);
 }
 
 void MegaApi::disableGfxFeatures(bool disable)
@@ -3805,6 +4661,11 @@ MegaNodeList *MegaApi::getChildren(MegaNode* p, int order)
     return pImpl->getChildren(p, order);
 }
 
+MegaNodeList *MegaApi::getChildren(MegaNode *p, int order, int offset, int limit)
+{
+    return pImpl->getChildren(p, order, offset, limit);
+}
+
 MegaNodeList *MegaApi::getVersions(MegaNode *node)
 {
     return pImpl->getVersions(node);
@@ -4042,6 +4903,16 @@ bool MegaApi::httpServerIsSubtitlesSupportEnabled()
     return pImpl->httpServerIsSubtitlesSupportEnabled();
 }
 
+void MegaApi::httpServerEnableMetrics(bool enable)
+{
+    pImpl->httpServerEnableMetrics(enable);
+}
+
+bool MegaApi::httpServerIsMetricsEnabled()
+{
+    return pImpl->httpServerIsMetricsEnabled();
+}
+
 void MegaApi::httpServerAddListener(MegaTransferListener *listener)
 {
     pImpl->httpServerAddListener(listener);
@@ -4102,6 +4973,36 @@ int MegaApi::httpServerGetMaxOutputSize()
     return pImpl->httpServerGetMaxOutputSize();
 }
 
+void MegaApi::httpServerSetEventLoops(int loops)
+{
+    pImpl->httpServerSetEventLoops(loops);
+}
+
+int MegaApi::httpServerGetEventLoops()
+{
+    return pImpl->httpServerGetEventLoops();
+}
+
+void MegaApi::httpServerSetMediaPrefetchTime(int seconds)
+{
+    pImpl->httpServerSetMediaPrefetchTime(seconds);
+}
+
+int MegaApi::httpServerGetMediaPrefetchTime()
+{
+    return pImpl->httpServerGetMediaPrefetchTime();
+}
+
+void MegaApi::httpServerSetFolderPrefetch(int files, bool readAhead)
+{
+    pImpl->httpServerSetFolderPrefetch(files, readAhead);
+}
+
+int MegaApi::httpServerGetFolderPrefetch()
+{
+    return pImpl->httpServerGetFolderPrefetch();
+}
+
 //FTP Server:
 bool MegaApi::ftpServerStart(bool localOnly, int port, int dataportBegin, int dataPortEnd, bool useTLS, const char * certificatepath, const char * keypath)
 {
@@ -5340,6 +6241,93 @@ int MegaSync::getState() const
     return MegaSync::SYNC_FAILED;
 }
 
+MegaSyncStats::~MegaSyncStats() { }
+
+MegaSyncStats *MegaSyncStats::copy() const
+{
+    return NULL;
+}
+
+int MegaSyncStats::getTag() const
+{
+    return 0;
+}
+
+int MegaSyncStats::getPendingScans() const
+{
+    return 0;
+}
+
+int MegaSyncStats::getDelayedScans() const
+{
+    return 0;
+}
+
+int MegaSyncStats::getRetryingScans() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getScannedPaths() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getScanRate() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getFingerprints() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getFingerprintRate() const
+{
+    return 0;
+}
+
+int MegaSyncStats::getPendingUploads() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getPendingUploadBytes() const
+{
+    return 0;
+}
+
+int MegaSyncStats::getPendingDownloads() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getPendingDownloadBytes() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getLocalBytes() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getScanTime() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getSyncUpTime() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getSyncDownTime() const
+{
+    return 0;
+}
+
 
 void MegaSyncListener::onSyncFileStateChanged(MegaApi *, MegaSync *, string *, int)
 { }
@@ -5721,6 +6709,10 @@ MegaBackgroundMediaUpload::~MegaBackgroundMediaUpload()
 {
 }
 
+MegaBackgroundTransferHandler::~MegaBackgroundTransferHandler()
+{
+}
+
 int64_t MegaInputStream::getSize()
 {
     return 0;
@@ -6437,4 +7429,34 @@ bool MegaCancelToken::isCancelled() const
     return false;
 }
 
+MegaUploadBatch *MegaUploadBatch::createInstance()
+{
+    return new MegaUploadBatchPrivate;
+}
+
+MegaUploadBatch::MegaUploadBatch()
+{
+
+}
+
+MegaUploadBatch::~MegaUploadBatch()
+{
+
+}
+
+MegaUploadBatch *MegaUploadBatch::copy() const
+{
+    return NULL;
+}
+
+void MegaUploadBatch::add(const char*, MegaHandle, const char*, int64_t)
+{
+
+}
+
+unsigned int MegaUploadBatch::size() const
+{
+    return 0;
+}
+
 }
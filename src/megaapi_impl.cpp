@@ -69,16 +69,210 @@
 
 #include "mega/mega_zxcvbn.h"
 
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
 namespace mega {
 
+// attributes of the nodes uploaded compressed, with the size and the fingerprint of their content
+static const nameid compressedAttrName = AttrMap::string2nameid("_z");
+static const nameid compressedFingerprintAttrName = AttrMap::string2nameid("_zc");
+
+#ifdef USE_ZLIB
+struct ZlibInflater::Stream
+{
+    z_stream z;
+    bool valid;
+    bool ended = false;
+};
+#else
+struct ZlibInflater::Stream
+{
+};
+#endif
+
+ZlibInflater::ZlibInflater(m_off_t start, m_off_t end)
+    : stream(new Stream), start(start), end(end)
+{
+#ifdef USE_ZLIB
+    memset(&stream->z, 0, sizeof stream->z);
+    stream->valid = inflateInit(&stream->z) == Z_OK;
+#endif
+}
+
+ZlibInflater::~ZlibInflater()
+{
+#ifdef USE_ZLIB
+    if (stream->valid)
+    {
+        inflateEnd(&stream->z);
+    }
+#endif
+}
+
+bool ZlibInflater::inflate(const byte *data, size_t len, string *out)
+{
+    out->clear();
+#ifdef USE_ZLIB
+    z_stream &z = stream->z;
+    z.next_in = (Bytef *)data;
+    z.avail_in = uInt(len);
+
+    while (stream->valid && !stream->ended && !done() && z.avail_in)
+    {
+        byte buf[65536];
+        z.next_out = buf;
+        z.avail_out = sizeof buf;
+
+        int rc = ::inflate(&z, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+        {
+            stream->valid = false;
+            break;
+        }
+
+        // the content before start is inflated and dropped
+        m_off_t n = m_off_t(sizeof buf - z.avail_out);
+        m_off_t from = std::max<m_off_t>(start - pos, 0);
+        m_off_t to = end < 0 ? n : std::min<m_off_t>(end - pos, n);
+        if (from < to)
+        {
+            out->append((const char *)buf + from, size_t(to - from));
+        }
+        pos += n;
+        stream->ended = rc == Z_STREAM_END;
+    }
+
+    return stream->valid;
+#else
+    (void)data;
+    (void)len;
+    return false;
+#endif
+}
+
+bool ZlibInflater::done() const
+{
+    return end >= 0 && pos >= end;
+}
+
+#ifdef USE_ZLIB
+struct ZlibDeflater::Stream
+{
+    z_stream z;
+    bool valid;
+};
+#else
+struct ZlibDeflater::Stream
+{
+};
+#endif
+
+ZlibDeflater::ZlibDeflater()
+    : stream(new Stream)
+{
+#ifdef USE_ZLIB
+    memset(&stream->z, 0, sizeof stream->z);
+    stream->valid = deflateInit(&stream->z, Z_DEFAULT_COMPRESSION) == Z_OK;
+#endif
+}
+
+ZlibDeflater::~ZlibDeflater()
+{
+#ifdef USE_ZLIB
+    if (stream->valid)
+    {
+        deflateEnd(&stream->z);
+    }
+#endif
+}
+
+bool ZlibDeflater::deflate(const byte *data, size_t len, bool last, string *out)
+{
+    out->clear();
+#ifdef USE_ZLIB
+    z_stream &z = stream->z;
+    z.next_in = (Bytef *)data;
+    z.avail_in = uInt(len);
+
+    // each piece ends on a full flush, from which the stream can be inflated on its own
+    int flush = last ? Z_FINISH : Z_FULL_FLUSH;
+    while (stream->valid)
+    {
+        byte buf[65536];
+        z.next_out = buf;
+        z.avail_out = sizeof buf;
+
+        if (::deflate(&z, flush) == Z_STREAM_ERROR)
+        {
+            stream->valid = false;
+            break;
+        }
+
+        out->append((const char *)buf, sizeof buf - z.avail_out);
+        if (z.avail_out)
+        {
+            break;
+        }
+    }
+
+    return stream->valid;
+#else
+    (void)data;
+    (void)len;
+    (void)last;
+    return false;
+#endif
+}
+
+// size and fingerprint of the content of a node uploaded compressed, with a size of -1 if it wasn't
+static FileFingerprint uncompressedFingerprint(Node *node, MegaNode *publicNode)
+{
+    FileFingerprint fp;
+    string fingerprint;
+    if (node)
+    {
+        attr_map::iterator it = node->attrs.map.find(compressedAttrName);
+        if (it != node->attrs.map.end())
+        {
+            fp.size = atoll(it->second.c_str());
+        }
+
+        it = node->attrs.map.find(compressedFingerprintAttrName);
+        if (it != node->attrs.map.end())
+        {
+            fingerprint = it->second;
+        }
+    }
+    else if (publicNode)
+    {
+        const char *size = publicNode->getCustomAttr("z");
+        const char *crc = publicNode->getCustomAttr("zc");
+        if (size)
+        {
+            fp.size = atoll(size);
+        }
+        if (crc)
+        {
+            fingerprint = crc;
+        }
+    }
+
+    if (fp.size >= 0 && fingerprint.size())
+    {
+        fp.unserializefingerprint(&fingerprint);
+    }
+    return fp;
+}
+
 MegaNodePrivate::MegaNodePrivate(const char *name, int type, int64_t size, int64_t ctime, int64_t mtime, uint64_t nodehandle,
                                  string *nodekey, string *attrstring, string *fileattrstring, const char *fingerprint, const char *originalFingerprint, MegaHandle owner, MegaHandle parentHandle,
                                  const char *privateauth, const char *publicauth, bool ispublic, bool isForeign, const char *chatauth)
 : MegaNode()
 {
-    this->name = MegaApi::strdup(name);
-    this->fingerprint = MegaApi::strdup(fingerprint);
-    this->originalfingerprint = MegaApi::strdup(originalFingerprint);
+    this->strings = NULL;
+    setStrings(name, fingerprint, originalFingerprint);
     this->customAttrs = NULL;
     this->duration = -1;
     this->width = -1;
@@ -130,9 +324,8 @@ MegaNodePrivate::MegaNodePrivate(const char *name, int type, int64_t size, int64
 MegaNodePrivate::MegaNodePrivate(MegaNode *node)
 : MegaNode()
 {
-    this->name = MegaApi::strdup(node->getName());
-    this->fingerprint = MegaApi::strdup(node->getFingerprint());
-    this->originalfingerprint = MegaApi::strdup(node->getOriginalFingerprint());
+    this->strings = NULL;
+    setStrings(node->getName(), node->getFingerprint(), node->getOriginalFingerprint());
     this->customAttrs = NULL;
 
     MegaNodePrivate *np = dynamic_cast<MegaNodePrivate *>(node);
@@ -227,30 +420,97 @@ MegaNodePrivate::MegaNodePrivate(MegaNode *node)
 #endif
 }
 
+int MegaNodePrivate::changesOf(Node *node)
+{
+    int changed = 0;
+    if(node->changed.attrs)
+    {
+        changed |= MegaNode::CHANGE_TYPE_ATTRIBUTES;
+    }
+    if(node->changed.ctime)
+    {
+        changed |= MegaNode::CHANGE_TYPE_TIMESTAMP;
+    }
+    if(node->changed.fileattrstring)
+    {
+        changed |= MegaNode::CHANGE_TYPE_FILE_ATTRIBUTES;
+    }
+    if(node->changed.inshare)
+    {
+        changed |= MegaNode::CHANGE_TYPE_INSHARE;
+    }
+    if(node->changed.outshares)
+    {
+        changed |= MegaNode::CHANGE_TYPE_OUTSHARE;
+    }
+    if(node->changed.pendingshares)
+    {
+        changed |= MegaNode::CHANGE_TYPE_PENDINGSHARE;
+    }
+    if(node->changed.owner)
+    {
+        changed |= MegaNode::CHANGE_TYPE_OWNER;
+    }
+    if(node->changed.parent)
+    {
+        changed |= MegaNode::CHANGE_TYPE_PARENT;
+    }
+    if(node->changed.removed)
+    {
+        changed |= MegaNode::CHANGE_TYPE_REMOVED;
+    }
+    if(node->changed.publiclink)
+    {
+        changed |= MegaNode::CHANGE_TYPE_PUBLIC_LINK;
+    }
+    if(node->changed.newnode)
+    {
+        changed |= MegaNode::CHANGE_TYPE_NEW;
+    }
+
+    return changed;
+}
+
+void MegaNodePrivate::addChanges(int changes)
+{
+    this->changed |= changes;
+}
+
+// fingerprint of a node with a valid one, in the format of MegaNode::getFingerprint
+// (its size in front of the serialized FileFingerprint)
+static string megaFingerprintOf(const Node *node)
+{
+    string fingerprint;
+    node->serializefingerprint(&fingerprint);
+    m_off_t size = node->size;
+    char bsize[sizeof(size)+1];
+    int l = Serialize64::serialize((byte *)bsize, size);
+    char *buf = new char[l * 4 / 3 + 4];
+    char ssize = static_cast<char>('A' + Base64::btoa((const byte *)bsize, l, buf));
+    string result(1, ssize);
+    result.append(buf);
+    result.append(fingerprint);
+    delete [] buf;
+
+    return result;
+}
+
 MegaNodePrivate::MegaNodePrivate(Node *node)
 : MegaNode()
 {
-    this->name = MegaApi::strdup(node->displayname());
-    this->fingerprint = NULL;
-    this->originalfingerprint = NULL;
+    // the attributes, fingerprint and mtime of a lazy node are still in its record
+    node->materialize();
+
+    this->strings = NULL;
     this->children = NULL;
     this->chatAuth = NULL;
 
+    string nodefingerprint;
+    const string* attrfingerprint = NULL;
+    const string* attroriginalfingerprint = NULL;
     if (node->isvalid)
     {
-        string fingerprint;
-        node->serializefingerprint(&fingerprint);
-        m_off_t size = node->size;
-        char bsize[sizeof(size)+1];
-        int l = Serialize64::serialize((byte *)bsize, size);
-        char *buf = new char[l * 4 / 3 + 4];
-        char ssize = static_cast<char>('A' + Base64::btoa((const byte *)bsize, l, buf));
-        string result(1, ssize);
-        result.append(buf);
-        result.append(fingerprint);
-        delete [] buf;
-
-        this->fingerprint = MegaApi::strdup(result.c_str());
+        nodefingerprint = megaFingerprintOf(node);
     }
 
     this->duration = -1;
@@ -363,17 +623,21 @@ MegaNodePrivate::MegaNodePrivate(Node *node)
                     restorehandle = rr;
                 }
             }
-            else if (it->first == AttrMap::string2nameid("c") && !fingerprint)
+            else if (it->first == AttrMap::string2nameid("c"))
             {
-                fingerprint = MegaApi::strdup(it->second.c_str());
+                attrfingerprint = &it->second;
             }
             else if (it->first == AttrMap::string2nameid("c0"))
             {
-                originalfingerprint = MegaApi::strdup(it->second.c_str());
+                attroriginalfingerprint = &it->second;
             }
         }
     }
 
+    setStrings(node->displayname(),
+               node->isvalid ? nodefingerprint.c_str() : (attrfingerprint ? attrfingerprint->c_str() : NULL),
+               attroriginalfingerprint ? attroriginalfingerprint->c_str() : NULL);
+
     this->type = node->type;
     this->size = node->size;
     this->ctime = node->ctime;
@@ -389,51 +653,7 @@ MegaNodePrivate::MegaNodePrivate(Node *node)
     this->fileattrstring = node->fileattrstring;
     this->nodekey.assign(node->nodekey.data(),node->nodekey.size());
 
-    this->changed = 0;
-    if(node->changed.attrs)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_ATTRIBUTES;
-    }
-    if(node->changed.ctime)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_TIMESTAMP;
-    }
-    if(node->changed.fileattrstring)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_FILE_ATTRIBUTES;
-    }
-    if(node->changed.inshare)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_INSHARE;
-    }
-    if(node->changed.outshares)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_OUTSHARE;
-    }
-    if(node->changed.pendingshares)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_PENDINGSHARE;
-    }
-    if(node->changed.owner)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_OWNER;
-    }
-    if(node->changed.parent)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_PARENT;
-    }
-    if(node->changed.removed)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_REMOVED;
-    }
-    if(node->changed.publiclink)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_PUBLIC_LINK;
-    }
-    if(node->changed.newnode)
-    {
-        this->changed |= MegaNode::CHANGE_TYPE_NEW;
-    }
+    this->changed = changesOf(node);
 
 
 #ifdef ENABLE_SYNC
@@ -468,6 +688,26 @@ MegaNodePrivate::MegaNodePrivate(Node *node)
     }
 }
 
+void MegaNodePrivate::setStrings(const char *name, const char *fingerprint, const char *originalfingerprint)
+{
+    size_t namelen = name ? strlen(name) + 1 : 0;
+    size_t fingerprintlen = fingerprint ? strlen(fingerprint) + 1 : 0;
+    size_t originallen = originalfingerprint ? strlen(originalfingerprint) + 1 : 0;
+
+    // the new strings may point into the current block
+    char *block = (namelen + fingerprintlen + originallen) ? new char[namelen + fingerprintlen + originallen] : NULL;
+    char *p = block;
+
+    this->name = namelen ? static_cast<const char*>(memcpy(p, name, namelen)) : NULL;
+    p += namelen;
+    this->fingerprint = fingerprintlen ? static_cast<const char*>(memcpy(p, fingerprint, fingerprintlen)) : NULL;
+    p += fingerprintlen;
+    this->originalfingerprint = originallen ? static_cast<const char*>(memcpy(p, originalfingerprint, originallen)) : NULL;
+
+    delete [] strings;
+    strings = block;
+}
+
 string* MegaNodePrivate::getSharekey()
 {
     return sharekey;
@@ -1409,6 +1649,23 @@ MegaSync *MegaApiImpl::getSyncByPath(const char *localPath)
     return result;
 }
 
+MegaSyncStats *MegaApiImpl::getSyncStats(int tag)
+{
+    MegaSyncStats *result = NULL;
+    sdkMutex.lock();
+    for (sync_list::iterator it = client->syncs.begin(); it != client->syncs.end(); it++)
+    {
+        if ((*it)->tag == tag)
+        {
+            result = new MegaSyncStatsPrivate(client, *it);
+            break;
+        }
+    }
+
+    sdkMutex.unlock();
+    return result;
+}
+
 char *MegaApiImpl::getBlockedPath()
 {
     char *path = NULL;
@@ -1596,10 +1853,7 @@ void MegaNodePrivate::setChildren(MegaNodeList *children)
 
 void MegaNodePrivate::setName(const char *newName)
 {
-    if (name)
-        delete [] name;
-
-    name = MegaApi::strdup(newName);
+    setStrings(newName, fingerprint, originalfingerprint);
 }
 
 string *MegaNodePrivate::getPublicAuth()
@@ -1614,9 +1868,7 @@ const char *MegaNodePrivate::getChatAuth()
 
 MegaNodePrivate::~MegaNodePrivate()
 {
-    delete[] name;
-    delete[] fingerprint;
-    delete[] originalfingerprint;
+    delete [] strings;
     delete [] chatAuth;
     delete customAttrs;
     delete plink;
@@ -2747,6 +2999,76 @@ void MegaTransferPrivate::setNotificationNumber(long long notificationNumber)
     this->notificationNumber = notificationNumber;
 }
 
+void MegaTransferPrivate::setLocalFingerprint(const FileFingerprint &fingerprint)
+{
+    localFingerprint.reset(new FileFingerprint(fingerprint));
+}
+
+const FileFingerprint *MegaTransferPrivate::getLocalFingerprint() const
+{
+    return localFingerprint.get();
+}
+
+void MegaTransferPrivate::setContentChecked(bool checked)
+{
+    contentChecked = checked;
+}
+
+bool MegaTransferPrivate::isContentChecked() const
+{
+    return contentChecked;
+}
+
+void MegaTransferPrivate::setCompressionChecked(bool checked)
+{
+    compressionChecked = checked;
+}
+
+bool MegaTransferPrivate::isCompressionChecked() const
+{
+    return compressionChecked;
+}
+
+void MegaTransferPrivate::setCompressedLocalPath(const string &localpath)
+{
+    compressedLocalPath = localpath;
+}
+
+const string &MegaTransferPrivate::getCompressedLocalPath() const
+{
+    return compressedLocalPath;
+}
+
+void MegaTransferPrivate::setUncompressedFingerprint(const FileFingerprint &fp)
+{
+    uncompressedFingerprint = fp;
+}
+
+const FileFingerprint &MegaTransferPrivate::getUncompressedFingerprint() const
+{
+    return uncompressedFingerprint;
+}
+
+void MegaTransferPrivate::setInflater(ZlibInflater *inflater)
+{
+    this->inflater.reset(inflater);
+}
+
+ZlibInflater *MegaTransferPrivate::getInflater() const
+{
+    return inflater.get();
+}
+
+void MegaTransferPrivate::setInputStream(MegaInputStream *inputStream)
+{
+    this->inputStream = inputStream;
+}
+
+MegaInputStream *MegaTransferPrivate::getInputStream() const
+{
+    return inputStream;
+}
+
 void MegaTransferPrivate::setListener(MegaTransferListener *listener)
 {
     this->listener = listener;
@@ -3092,6 +3414,8 @@ MegaRequestPrivate::MegaRequestPrivate(int type, MegaRequestListener *listener)
     folderInfo = NULL;
     settings = NULL;
     backgroundMediaUpload = NULL;
+    mHandleList = NULL;
+    bulkError = API_OK;
 }
 
 MegaRequestPrivate::MegaRequestPrivate(MegaRequestPrivate *request)
@@ -3167,6 +3491,8 @@ MegaRequestPrivate::MegaRequestPrivate(MegaRequestPrivate *request)
     this->folderInfo = request->getMegaFolderInfo() ? request->folderInfo->copy() : NULL;
     this->settings = request->getMegaPushNotificationSettings() ? request->settings->copy() : NULL;
     this->backgroundMediaUpload = NULL;
+    this->mHandleList = request->getMegaHandleList() ? request->mHandleList->copy() : NULL;
+    this->bulkError = request->bulkError;
 }
 
 AccountDetails *MegaRequestPrivate::getAccountDetails() const
@@ -3306,6 +3632,42 @@ void MegaRequestPrivate::setMegaBackgroundMediaUploadPtr(MegaBackgroundMediaUplo
     backgroundMediaUpload = p;
 }
 
+MegaHandleList *MegaRequestPrivate::getMegaHandleList() const
+{
+    return mHandleList;
+}
+
+void MegaRequestPrivate::setMegaHandleList(const MegaHandleList *handleList)
+{
+    delete mHandleList;
+    mHandleList = handleList ? handleList->copy() : NULL;
+}
+
+bool MegaRequestPrivate::addBulkResult(error e)
+{
+    transferredBytes++;
+    if (e)
+    {
+        addBulkError(e);
+    }
+
+    return transferredBytes >= totalBytes;
+}
+
+void MegaRequestPrivate::addBulkError(error e)
+{
+    number++;
+    if (!bulkError)
+    {
+        bulkError = e;
+    }
+}
+
+error MegaRequestPrivate::getBulkError() const
+{
+    return bulkError;
+}
+
 
 #ifdef ENABLE_SYNC
 void MegaRequestPrivate::setSyncListener(MegaSyncListener *syncListener)
@@ -3380,6 +3742,7 @@ MegaRequestPrivate::~MegaRequestPrivate()
     delete folderInfo;
     delete timeZoneDetails;
     delete settings;
+    delete mHandleList;
 
 #ifdef ENABLE_SYNC
     delete regExp;
@@ -3817,6 +4180,11 @@ const char *MegaRequestPrivate::getRequestString() const
         case TYPE_GET_COUNTRY_CALLING_CODES: return "GET_COUNTRY_CALLING_CODES";
         case TYPE_VERIFY_CREDENTIALS: return "VERIFY_CREDENTIALS";
         case TYPE_GET_MISC_FLAGS: return "GET_MISC_FLAGS";
+        case TYPE_MOVE_NODES: return "MOVE_NODES";
+        case TYPE_REMOVE_NODES: return "REMOVE_NODES";
+        case TYPE_SET_ATTR_NODES: return "SET_ATTR_NODES";
+        case TYPE_FETCH_FOLDER: return "FETCH_FOLDER";
+        case TYPE_GET_ATTR_USERS: return "GET_ATTR_USERS";
     }
     return "UNKNOWN";
 }
@@ -4125,6 +4493,16 @@ MegaNodeListPrivate::MegaNodeListPrivate(Node** newlist, int size)
         list[i] = MegaNodePrivate::fromNode(newlist[i]);
 }
 
+MegaNodeListPrivate::MegaNodeListPrivate(vector<std::unique_ptr<MegaNode>>&& nodes)
+{
+    list = NULL; s = int(nodes.size());
+    if(!s) return;
+
+    list = new MegaNode*[s];
+    for(int i=0; i<s; i++)
+        list[i] = nodes[i].release();
+}
+
 MegaNodeListPrivate::MegaNodeListPrivate(const MegaNodeListPrivate *nodeList, bool copyChildren)
 {
     s = nodeList->size();
@@ -4194,6 +4572,271 @@ void MegaNodeListPrivate::addNode(MegaNode *node)
     }
 }
 
+void LazyNodeEntries::attach(MegaApiImpl *currentApi)
+{
+    api = currentApi;
+    currentApi->lazyNodeLists.insert(this);
+    for (size_t i = 0; i < entryCount(); i++)
+    {
+        if (!entryLoaded(i))
+        {
+            currentApi->lazyNodeEntries.emplace(entryHandle(i), std::make_pair(this, i));
+        }
+    }
+}
+
+void LazyNodeEntries::release()
+{
+    MegaApiImpl *currentApi = api;
+    if (!currentApi)
+    {
+        return;
+    }
+
+    MegaApiImpl::SdkMutexGuard g(currentApi->sdkMutex);
+    if (!api)
+    {
+        return;  // detached meanwhile
+    }
+
+    currentApi->lazyNodeLists.erase(this);
+    for (size_t i = 0; i < entryCount(); i++)
+    {
+        auto range = currentApi->lazyNodeEntries.equal_range(entryHandle(i));
+        for (auto it = range.first; it != range.second; )
+        {
+            if (it->second.first == this)
+            {
+                currentApi->lazyNodeEntries.erase(it++);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+    api = NULL;
+}
+
+void LazyNodeEntries::detach()
+{
+    for (size_t i = 0; i < entryCount(); i++)
+    {
+        loadEntry(i);
+    }
+    api = NULL;
+}
+
+MegaNodeListLazy::MegaNodeListLazy(MegaApiImpl *api, Node **newlist, int size)
+{
+    handles.reserve(size);
+    for (int i = 0; i < size; i++)
+    {
+        handles.push_back(newlist[i]->nodehandle);
+    }
+    nodes.resize(handles.size());
+
+    if (!handles.empty())
+    {
+        // called from MegaApiImpl with sdkMutex locked
+        attach(api);
+    }
+}
+
+MegaNodeListLazy::MegaNodeListLazy(const MegaNodeListLazy *nodeList)
+{
+    MegaApiImpl *sourceApi = nodeList->api;
+    std::unique_lock<std::recursive_timed_mutex> g;
+    if (sourceApi)
+    {
+        g = std::unique_lock<std::recursive_timed_mutex>(sourceApi->sdkMutex);
+        sourceApi = nodeList->api;  // may have been detached meanwhile
+    }
+
+    handles = nodeList->handles;
+    nodes.resize(handles.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodeList->nodes[i])
+        {
+            nodes[i].reset(nodeList->nodes[i]->copy());
+        }
+    }
+
+    if (sourceApi)
+    {
+        attach(sourceApi);
+    }
+}
+
+MegaNodeListLazy::~MegaNodeListLazy()
+{
+    release();
+}
+
+size_t MegaNodeListLazy::entryCount() const
+{
+    return handles.size();
+}
+
+handle MegaNodeListLazy::entryHandle(size_t i) const
+{
+    return handles[i];
+}
+
+bool MegaNodeListLazy::entryLoaded(size_t i) const
+{
+    return bool(nodes[i]);
+}
+
+void MegaNodeListLazy::loadEntry(size_t i) const
+{
+    materialize(i);
+}
+
+MegaNodeList *MegaNodeListLazy::copy() const
+{
+    return new MegaNodeListLazy(this);
+}
+
+MegaNode *MegaNodeListLazy::get(int i) const
+{
+    if ((i < 0) || (size_t(i) >= handles.size()))
+    {
+        return NULL;
+    }
+
+    MegaApiImpl *currentApi = api;
+    if (!currentApi)
+    {
+        return nodes[i].get();
+    }
+
+    MegaApiImpl::SdkMutexGuard g(currentApi->sdkMutex);
+    return materialize(i);
+}
+
+MegaNode *MegaNodeListLazy::materialize(size_t i) const
+{
+    MegaApiImpl *currentApi = api;
+    if (!nodes[i] && currentApi)
+    {
+        // handle lookup rather than a stored Node*, so a node purged in the meantime can't dangle
+        if (Node *n = currentApi->client->nodebyhandle(handles[i]))
+        {
+            nodes[i].reset(MegaNodePrivate::fromNode(n));
+        }
+    }
+    return nodes[i].get();
+}
+
+int MegaNodeListLazy::size() const
+{
+    return int(handles.size());
+}
+
+void MegaNodeListLazy::addNode(MegaNode *node)
+{
+    handles.push_back(node->getHandle());
+    nodes.emplace_back(node->copy());
+}
+
+int MegaNodeListLazy::getHandles(MegaHandle *values, int count) const
+{
+    int n = std::min(count, size());
+    std::copy(handles.begin(), handles.begin() + n, values);
+    return n;
+}
+
+template<typename T, typename FromMegaNode, typename FromNode>
+int MegaNodeListLazy::getColumn(T *values, int count, T missing, FromMegaNode fromMegaNode, FromNode fromNode) const
+{
+    int n = std::min(count, size());
+
+    MegaApiImpl *currentApi = api;
+    std::unique_lock<std::recursive_timed_mutex> g;
+    if (currentApi)
+    {
+        g = std::unique_lock<std::recursive_timed_mutex>(currentApi->sdkMutex);
+        currentApi = api;  // may have been detached meanwhile
+    }
+
+    // fromNode reads the Node directly: the fields that are not in the skeleton
+    // of a lazy node (all but the type, size and ctime) need materialize() first
+    for (int i = 0; i < n; i++)
+    {
+        if (nodes[i])
+        {
+            values[i] = fromMegaNode(nodes[i].get());
+        }
+        else
+        {
+            Node *node = currentApi ? currentApi->client->nodebyhandle(handles[i]) : NULL;
+            values[i] = node ? fromNode(node) : missing;
+        }
+    }
+    return n;
+}
+
+int MegaNodeListLazy::getSizes(int64_t *sizes, int count) const
+{
+    return getColumn(sizes, count, int64_t(-1),
+                     [](MegaNode *node) { return node->getSize(); },
+                     [](Node *node) { return int64_t(node->size); });
+}
+
+int MegaNodeListLazy::getModificationTimes(int64_t *mtimes, int count) const
+{
+    return getColumn(mtimes, count, int64_t(-1),
+                     [](MegaNode *node) { return node->getModificationTime(); },
+                     [](Node *node) { node->materialize(); return int64_t(node->mtime); });
+}
+
+int MegaNodeListLazy::getTypes(int *types, int count) const
+{
+    return getColumn(types, count, int(MegaNode::TYPE_UNKNOWN),
+                     [](MegaNode *node) { return node->getType(); },
+                     [](Node *node) { return int(node->type); });
+}
+
+int MegaNodeListLazy::getNames(char *names, int namesSize, int *offsets, int count) const
+{
+    // the names of the Nodes are only valid while sdkMutex is locked
+    MegaApiImpl *currentApi = api;
+    std::unique_lock<std::recursive_timed_mutex> g;
+    if (currentApi)
+    {
+        g = std::unique_lock<std::recursive_timed_mutex>(currentApi->sdkMutex);
+    }
+
+    int n = size();
+    vector<const char *> values(n);
+    getColumn(values.data(), n, (const char *)NULL,
+              [](MegaNode *node) { return (const char *)node->getName(); },
+              [](Node *node) { return node->displayname(); });
+
+    int total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int length = values[i] ? int(strlen(values[i])) : 0;
+        if (offsets && i < count)
+        {
+            offsets[i] = total;
+        }
+        if (names && length <= namesSize - total)
+        {
+            memcpy(names + total, values[i], length);
+        }
+        total += length;
+    }
+
+    if (offsets && n < count)
+    {
+        offsets[n] = total;
+    }
+    return total;
+}
+
 MegaUserListPrivate::MegaUserListPrivate()
 {
     list = NULL;
@@ -4665,6 +5308,7 @@ MegaFile *MegaFile::unserialize(string *d)
 
 MegaFileGet::MegaFileGet(MegaClient *client, Node *n, string dstPath) : MegaFile()
 {
+    n->materialize();
     h = n->nodehandle;
     *(FileFingerprint*)this = *n;
 
@@ -4882,11 +5526,28 @@ bool MegaFilePut::serialize(string *d)
     }
 
     d->append((char*)&customMtime, sizeof(customMtime));
-    d->append("\0\0\0\0\0\0\0", 8);
+
+    // the first byte tells if the fingerprint before compression follows
+    d->append(1, char(uncompressedFingerprint.isvalid));
+    d->append("\0\0\0\0\0\0", 7);
+    if (uncompressedFingerprint.isvalid)
+    {
+        uncompressedFingerprint.serialize(d);
+    }
 
     return true;
 }
 
+void MegaFilePut::setUncompressedFingerprint(const FileFingerprint &fp)
+{
+    uncompressedFingerprint = fp;
+
+    ostringstream oss;
+    oss << fp.size;
+    uploadattrs[compressedAttrName] = oss.str();
+    fp.serializefingerprint(&uploadattrs[compressedFingerprintAttrName]);
+}
+
 MegaFilePut *MegaFilePut::unserialize(string *d)
 {
     MegaFile *file = MegaFile::unserialize(d);
@@ -4908,14 +5569,30 @@ MegaFilePut *MegaFilePut::unserialize(string *d)
     int64_t customMtime = MemAccess::get<int64_t>(ptr);
     ptr += sizeof(customMtime);
 
-    if (memcmp(ptr, "\0\0\0\0\0\0\0", 8))
+    if ((ptr[0] != 0 && ptr[0] != 1) || memcmp(ptr + 1, "\0\0\0\0\0\0", 7))
     {
         LOG_err << "MegaFilePut unserialization failed - invalid version";
         delete file;
         return NULL;
     }
 
+    bool compressed = ptr[0] == 1;
     ptr += 8;
+
+    std::unique_ptr<FileFingerprint> uncompressedFingerprint;
+    if (compressed)
+    {
+        string data(ptr, end - ptr);
+        uncompressedFingerprint.reset(FileFingerprint::unserialize(&data));
+        if (!uncompressedFingerprint || !uncompressedFingerprint->isvalid)
+        {
+            LOG_err << "MegaFilePut unserialization failed - invalid fingerprint before compression";
+            delete file;
+            return NULL;
+        }
+        ptr = end - data.size();
+    }
+
     if (ptr != end)
     {
         LOG_err << "MegaFilePut unserialization failed - wrong size";
@@ -4929,6 +5606,10 @@ MegaFilePut *MegaFilePut::unserialize(string *d)
     delete file;
 
     megaFile->customMtime = customMtime;
+    if (uncompressedFingerprint)
+    {
+        megaFile->setUncompressedFingerprint(*uncompressedFingerprint);
+    }
     return megaFile;
 }
 
@@ -4965,6 +5646,8 @@ void *MegaApiImpl::threadEntryPoint(void *param)
     ::sigaction(SIGPIPE, &noaction, 0);
 #endif
 
+    Trace::threadname("MegaApi");
+
     MegaApiImpl *megaApiImpl = (MegaApiImpl *)param;
     megaApiImpl->loop();
     return 0;
@@ -5026,11 +5709,16 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     httpServer = NULL;
     httpServerMaxBufferSize = 0;
     httpServerMaxOutputSize = 0;
+    httpServerEventLoops = 0;
+    httpServerMediaPrefetchTime = 0;
+    httpServerFolderPrefetchFiles = 0;
+    httpServerFolderPrefetchReadAhead = false;
     httpServerEnableFiles = true;
     httpServerEnableFolders = false;
     httpServerOfflineAttributeEnabled = false;
     httpServerRestrictedMode = MegaApi::TCP_SERVER_ALLOW_CREATED_LOCAL_LINKS;
     httpServerSubtitlesSupportEnabled = false;
+    httpServerMetricsEnabled = false;
 
     ftpServer = NULL;
     ftpServerMaxBufferSize = 0;
@@ -5041,7 +5729,21 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     mPushSettings = NULL;
     mTimezones = NULL;
 
-    httpio = new MegaHttpIO();
+#if defined(WIN32) && !defined(WINDOWS_PHONE) && defined(USE_CURL)
+    winHttp = networkBackend == MegaApi::NETWORK_BACKEND_WINHTTP;
+    if (winHttp)
+    {
+        httpio = new MegaWinHttpIO();
+    }
+    else
+#elif defined(WIN32) && !defined(WINDOWS_PHONE)
+    winHttp = true;
+#else
+    winHttp = false;
+#endif
+    {
+        httpio = new MegaHttpIO();
+    }
     waiter = new MegaWaiter();
 
 #ifndef __APPLE__
@@ -5107,9 +5809,31 @@ MegaApiImpl::~MegaApiImpl()
     waiter->notify();
     thread.join();
 
+    // deliver the transfer callbacks already queued
+    asyncTransferEvents = false;
+    stopTransferEvents();
+
+    {
+        SdkMutexGuard g(sdkMutex);
+        detachLazyNodeLists();
+    }
+
     delete mPushSettings;
     delete mTimezones;
 
+    // completes the scans in progress, which use fsaccess
+    scanWorkers.reset();
+
+    for (auto it = contentChecks.begin(); it != contentChecks.end(); it++)
+    {
+        delete it->first;
+    }
+
+    for (auto it = compressions.begin(); it != compressions.end(); it++)
+    {
+        delete it->first;
+    }
+
     requestMap.erase(request->getTag());
 
     for (std::map<int, MegaBackupController *>::iterator it = backupsMap.begin(); it != backupsMap.end(); ++it)
@@ -5127,12 +5851,19 @@ MegaApiImpl::~MegaApiImpl()
         delete it->second;
     }
 
+    // it uses fsAccess
+    backgroundHttpIO.reset();
+
     delete gfxAccess;
     delete fsAccess;
     delete waiter;
 
 #ifndef DONT_RELEASE_HTTPIO
-    delete httpio;
+    // like in the builds with WinHTTP only, its layer is not released
+    if (!winHttp)
+    {
+        delete httpio;
+    }
 #endif
 
     fireOnRequestFinish(request, MegaError(API_OK));
@@ -5391,6 +6122,44 @@ void MegaApiImpl::setLogToConsole(bool enable)
     externalLogger.setLogToConsole(enable);
 }
 
+void MegaApiImpl::enableTracing(bool enable, int eventsPerThread)
+{
+    if (eventsPerThread < 0)
+    {
+        return;
+    }
+
+    Trace::setbuffersize(eventsPerThread ? size_t(eventsPerThread) : Trace::DEFAULT_BUFFER_SIZE);
+    Trace::enable(enable);
+}
+
+bool MegaApiImpl::isTracingEnabled()
+{
+    return Trace::enabled();
+}
+
+char *MegaApiImpl::getTrace(bool clear)
+{
+    string trace = Trace::dump();
+    if (clear)
+    {
+        Trace::clear();
+    }
+    return MegaApi::strdup(trace.c_str());
+}
+
+void MegaApiImpl::setLogAsynchronous(bool enable, int bufferSize)
+{
+#ifndef ENABLE_LOG_PERFORMANCE
+    if (bufferSize < 0)
+    {
+        return;
+    }
+
+    SimpleLogger::setAsync(enable, bufferSize ? size_t(bufferSize) : SimpleLogger::DEFAULT_ASYNC_BUFFER_SIZE);
+#endif
+}
+
 void MegaApiImpl::log(int logLevel, const char *message, const char *filename, int line)
 {
     externalLogger.postLog(logLevel, message, filename, line);
@@ -5482,8 +6251,8 @@ handle MegaApiImpl::base64ToHandle(const char* base64Handle)
 {
     if(!base64Handle) return UNDEF;
 
-    handle h = 0;
-    Base64::atob(base64Handle,(byte*)&h,MegaClient::NODEHANDLE);
+    handle h;
+    Base64::atohandle(base64Handle, &h, MegaClient::NODEHANDLE);
     return h;
 }
 
@@ -5491,8 +6260,8 @@ handle MegaApiImpl::base64ToUserHandle(const char *base64Handle)
 {
     if(!base64Handle) return UNDEF;
 
-    handle h = 0;
-    Base64::atob(base64Handle,(byte*)&h,MegaClient::USERHANDLE);
+    handle h;
+    Base64::atohandle(base64Handle, &h, MegaClient::USERHANDLE);
     return h;
 }
 
@@ -6030,17 +6799,27 @@ void MegaApiImpl::setProxySettings(MegaProxy *proxySettings)
     Proxy *localProxySettings = new Proxy();
     localProxySettings->setProxyType(proxySettings->getProxyType());
 
+    // the cURL layer of Windows takes the settings in UTF-8
+#if defined(WINDOWS_PHONE) || (defined(_WIN32) && defined(USE_CURL))
+    bool utf8 = !winHttp;
+#else
+    bool utf8 = false;
+#endif
+
     string url;
     if(proxySettings->getProxyURL())
         url = proxySettings->getProxyURL();
 
     string localurl;
 
-#if defined(WINDOWS_PHONE) || (defined(_WIN32) && defined(USE_CURL))
-    localurl = url;
-#else
-    fsAccess->path2local(&url, &localurl);
-#endif
+    if (utf8)
+    {
+        localurl = url;
+    }
+    else
+    {
+        fsAccess->path2local(&url, &localurl);
+    }
 
     localProxySettings->setProxyURL(&localurl);
 
@@ -6052,11 +6831,14 @@ void MegaApiImpl::setProxySettings(MegaProxy *proxySettings)
 
         string localusername;
 
-#if defined(WINDOWS_PHONE) || (defined(_WIN32) && defined(USE_CURL))
-        localusername = username;
-#else
-        fsAccess->path2local(&username, &localusername);
-#endif
+        if (utf8)
+        {
+            localusername = username;
+        }
+        else
+        {
+            fsAccess->path2local(&username, &localusername);
+        }
 
         string password;
         if(proxySettings->getPassword())
@@ -6064,11 +6846,14 @@ void MegaApiImpl::setProxySettings(MegaProxy *proxySettings)
 
         string localpassword;
 
-#if defined(WINDOWS_PHONE) || (defined(_WIN32) && defined(USE_CURL))
-        localpassword = password;
-#else
-        fsAccess->path2local(&password, &localpassword);
-#endif
+        if (utf8)
+        {
+            localpassword = password;
+        }
+        else
+        {
+            fsAccess->path2local(&password, &localpassword);
+        }
 
         localProxySettings->setCredentials(&localusername, &localpassword);
     }
@@ -6082,9 +6867,9 @@ void MegaApiImpl::setProxySettings(MegaProxy *proxySettings)
 MegaProxy *MegaApiImpl::getAutoProxySettings()
 {
     MegaProxy *proxySettings = new MegaProxy;
-    sdkMutex.lock();
+
+    // the detection can take seconds (WPAD): don't block the SDK meanwhile
     Proxy *localProxySettings = httpio->getautoproxy();
-    sdkMutex.unlock();
     proxySettings->setProxyType(localProxySettings->getProxyType());
     if(localProxySettings->getProxyType() == Proxy::CUSTOM)
     {
@@ -6101,6 +6886,8 @@ MegaProxy *MegaApiImpl::getAutoProxySettings()
 
 void MegaApiImpl::loop()
 {
+    sdkThreadId = std::this_thread::get_id();
+
 #if defined(WINDOWS_PHONE) || TARGET_OS_IPHONE
     // Workaround to get the IP of valid DNS servers on Windows Phone/iOS
     string servers;
@@ -6167,12 +6954,35 @@ void MegaApiImpl::loop()
 
     while(true)
     {
+        yieldToReaders();
         sdkMutex.lock();
         int r = client->preparewait();
+        if (!r && !pendingNodeUpdates.empty())
+        {
+            // wake up at the end of the coalescing window
+            std::chrono::milliseconds left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        pendingNodeUpdatesSince + std::chrono::milliseconds(nodeUpdateWindow) - std::chrono::steady_clock::now());
+            dstime ds = left.count() > 0 ? dstime((left.count() + 99) / 100) : 0;
+            if (client->waiter->maxds > ds)
+            {
+                client->waiter->maxds = ds;
+            }
+        }
+#ifdef HAVE_LIBUV
+        if (httpServerMetricsEnabled)
+        {
+            dstime ds = refreshMetrics();
+            if (!r && client->waiter->maxds > ds)
+            {
+                client->waiter->maxds = ds;
+            }
+        }
+#endif
         sdkMutex.unlock();
         if (!r)
         {
             r = client->dowait();
+            yieldToReaders();
             sdkMutex.lock();
             r |= client->checkevents();
             sdkMutex.unlock();
@@ -6182,6 +6992,10 @@ void MegaApiImpl::loop()
         {
             WAIT_CLASS::bumpds();
             updateBackups();
+            updateFolderUploads();
+            updateContentChecks();
+            updateCompressions();
+            updateTreeCopies();
             if (sendPendingTransfers())
             {
                 yield();
@@ -6191,13 +7005,17 @@ void MegaApiImpl::loop()
             if(threadExit)
                 break;
 
+            yieldToReaders();
             sdkMutex.lock();
             client->exec();
+            flushNodeUpdates(false);
+            publishNodeTreeExport();
             sdkMutex.unlock();
         }
     }
 
     sdkMutex.lock();
+    nodeTreeExport.reset();
     delete client;
     sdkMutex.unlock();
 }
@@ -6245,6 +7063,23 @@ void MegaApiImpl::moveNode(MegaNode *node, MegaNode *newParent, MegaRequestListe
     waiter->notify();
 }
 
+void MegaApiImpl::moveNodes(MegaNodeList *nodes, MegaNode *newParent, MegaRequestListener *listener)
+{
+    MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_MOVE_NODES, listener);
+    if (nodes)
+    {
+        MegaHandleListPrivate handles;
+        for (int i = 0; i < nodes->size(); i++)
+        {
+            handles.addMegaHandle(nodes->get(i)->getHandle());
+        }
+        request->setMegaHandleList(&handles);
+    }
+    if(newParent) request->setParentHandle(newParent->getHandle());
+    requestQueue.push(request);
+    waiter->notify();
+}
+
 void MegaApiImpl::copyNode(MegaNode *node, MegaNode* target, MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_COPY, listener);
@@ -6290,6 +7125,22 @@ void MegaApiImpl::remove(MegaNode *node, bool keepversions, MegaRequestListener
     waiter->notify();
 }
 
+void MegaApiImpl::removeNodes(MegaNodeList *nodes, MegaRequestListener *listener)
+{
+    MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_REMOVE_NODES, listener);
+    if (nodes)
+    {
+        MegaHandleListPrivate handles;
+        for (int i = 0; i < nodes->size(); i++)
+        {
+            handles.addMegaHandle(nodes->get(i)->getHandle());
+        }
+        request->setMegaHandleList(&handles);
+    }
+    requestQueue.push(request);
+    waiter->notify();
+}
+
 void MegaApiImpl::removeVersions(MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_REMOVE_VERSIONS, listener);
@@ -6393,6 +7244,19 @@ void MegaApiImpl::getPublicNode(const char* megaFileLink, MegaRequestListener *l
     waiter->notify();
 }
 
+void MegaApiImpl::setThumbnailCache(const char* localFolder, long long maxSize)
+{
+    string localPath;
+    if (localFolder)
+    {
+        string path(localFolder);
+        fsAccess->path2local(&path, &localPath);
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    client->setfacache(localFolder ? &localPath : NULL, maxSize);
+}
+
 void MegaApiImpl::getThumbnail(MegaNode* node, const char *dstFilePath, MegaRequestListener *listener)
 {
     getNodeAttribute(node, GfxProc::THUMBNAIL, dstFilePath, listener);
@@ -6483,6 +7347,25 @@ void MegaApiImpl::getUserAttribute(MegaUser* user, int type, MegaRequestListener
     getUserAttr(email, type ? type : -1, NULL, 0, listener);
 }
 
+void MegaApiImpl::getUserAttributes(MegaUserList* users, int type, MegaRequestListener *listener)
+{
+    MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_GET_ATTR_USERS, listener);
+
+    if (users)
+    {
+        MegaHandleListPrivate handles;
+        for (int i = 0; i < users->size(); i++)
+        {
+            handles.addMegaHandle(users->get(i)->getHandle());
+        }
+        request->setMegaHandleList(&handles);
+    }
+
+    request->setParamType(type);
+    requestQueue.push(request);
+    waiter->notify();
+}
+
 bool MegaApiImpl::testAllocation(unsigned allocCount, size_t allocSize)
 {
     bool success = true;
@@ -6571,6 +7454,24 @@ void MegaApiImpl::setCustomNodeAttribute(MegaNode *node, const char *attrName, c
     waiter->notify();
 }
 
+void MegaApiImpl::setCustomNodesAttribute(MegaNodeList *nodes, const char *attrName, const char *value, MegaRequestListener *listener)
+{
+    MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_SET_ATTR_NODES, listener);
+    if (nodes)
+    {
+        MegaHandleListPrivate handles;
+        for (int i = 0; i < nodes->size(); i++)
+        {
+            handles.addMegaHandle(nodes->get(i)->getHandle());
+        }
+        request->setMegaHandleList(&handles);
+    }
+    request->setName(attrName);
+    request->setText(value);
+    requestQueue.push(request);
+    waiter->notify();
+}
+
 void MegaApiImpl::setNodeDuration(MegaNode *node, int secs, MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_SET_ATTR_NODE, listener);
@@ -6644,6 +7545,25 @@ void MegaApiImpl::fetchNodes(MegaRequestListener *listener)
     waiter->notify();
 }
 
+void MegaApiImpl::fetchFolder(MegaNode *folder, MegaRequestListener *listener)
+{
+    MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_FETCH_FOLDER, listener);
+    if (folder) request->setNodeHandle(folder->getHandle());
+    requestQueue.push(request);
+    waiter->notify();
+}
+
+bool MegaApiImpl::isFolderFetched(MegaNode *folder)
+{
+    if (!folder)
+    {
+        return false;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    return client->folderfetched(folder->getHandle());
+}
+
 void MegaApiImpl::getPricing(MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_GET_PRICING, listener);
@@ -6968,6 +7888,31 @@ bool MegaApiImpl::usingHttpsOnly()
     return client->usehttps;
 }
 
+void MegaApiImpl::enableDownloadHardLinks(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->hardlinkdownloads = enable;
+}
+
+bool MegaApiImpl::areDownloadHardLinksEnabled()
+{
+    return client->hardlinkdownloads;
+}
+
+bool MegaApiImpl::recordActionPackets(const char *localPath)
+{
+    SdkMutexGuard g(sdkMutex);
+
+    if (!localPath)
+    {
+        return client->recordsc(NULL);
+    }
+
+    string path(localPath), localpath;
+    fsAccess->path2local(&path, &localpath);
+    return client->recordsc(&localpath);
+}
+
 void MegaApiImpl::getNodeAttribute(MegaNode *node, int type, const char *dstFilePath, MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_GET_ATTR_FILE, listener);
@@ -7238,6 +8183,10 @@ void MegaApiImpl::abortPendingActions(error preverror)
         delete it.second;
     }
     backupsMap.clear();
+    backupQueue.clear();
+
+    // their requests are finished below, the batches in flight are dropped with the commands
+    treeCopies.clear();
 
     deque<MegaRequestPrivate*> requests;
     for (auto requestPair : requestMap)
@@ -7526,6 +8475,166 @@ bool MegaApiImpl::setMaxUploadSpeed(m_off_t bpslimit)
     return result;
 }
 
+bool MegaApiImpl::setHTTP2Enabled(bool enable)
+{
+    sdkMutex.lock();
+    bool result = client->sethttp2(enable);
+    sdkMutex.unlock();
+    return result;
+}
+
+bool MegaApiImpl::isHTTP2Enabled()
+{
+    sdkMutex.lock();
+    bool result = client->gethttp2();
+    sdkMutex.unlock();
+    return result;
+}
+
+bool MegaApiImpl::setSocketOptions(int direction, int recvBufferSize, int sendBufferSize, int notSentLowat, const char* congestionControl, int bufferSize)
+{
+    if ((direction != MegaTransfer::TYPE_DOWNLOAD && direction != MegaTransfer::TYPE_UPLOAD && direction != -1)
+            || recvBufferSize < 0 || sendBufferSize < 0 || notSentLowat < 0 || bufferSize < 0)
+    {
+        return false;
+    }
+
+    SocketOptions options;
+    options.rcvbuf = recvBufferSize;
+    options.sndbuf = sendBufferSize;
+    options.notsentlowat = notSentLowat;
+    options.congestion = congestionControl ? congestionControl : "";
+    options.buffersize = bufferSize;
+
+    bool result = true;
+    sdkMutex.lock();
+    if (direction != MegaTransfer::TYPE_UPLOAD)
+    {
+        result = client->setsocketoptions(GET, options);
+    }
+    if (result && direction != MegaTransfer::TYPE_DOWNLOAD)
+    {
+        result = client->setsocketoptions(PUT, options);
+    }
+    sdkMutex.unlock();
+    return result;
+}
+
+bool MegaApiImpl::setConnectionCacheLimits(int direction, int maxIdleConnections, int maxHostConnections, int maxTotalConnections, int maxIdleSeconds)
+{
+    if ((direction != MegaTransfer::TYPE_DOWNLOAD && direction != MegaTransfer::TYPE_UPLOAD && direction != -1)
+            || maxIdleConnections < 0 || maxHostConnections < 0 || maxTotalConnections < 0 || maxIdleSeconds < 0)
+    {
+        return false;
+    }
+
+    ConnectionCacheOptions options;
+    options.maxconnects = maxIdleConnections;
+    options.maxhostconnections = maxHostConnections;
+    options.maxtotalconnections = maxTotalConnections;
+    options.maxidleseconds = maxIdleSeconds;
+
+    bool result = true;
+    sdkMutex.lock();
+    if (direction != MegaTransfer::TYPE_UPLOAD)
+    {
+        result = client->setconnectioncache(GET, options);
+    }
+    if (result && direction != MegaTransfer::TYPE_DOWNLOAD)
+    {
+        result = client->setconnectioncache(PUT, options);
+    }
+    sdkMutex.unlock();
+    return result;
+}
+
+bool MegaApiImpl::setNetworkThreadEnabled(bool enable)
+{
+    sdkMutex.lock();
+    bool result = client->setnetworkthread(enable);
+    sdkMutex.unlock();
+    return result;
+}
+
+bool MegaApiImpl::isNetworkThreadEnabled()
+{
+    sdkMutex.lock();
+    bool result = client->getnetworkthread();
+    sdkMutex.unlock();
+    return result;
+}
+
+bool MegaApiImpl::setBackgroundTransferHandler(MegaBackgroundTransferHandler* handler, const char* folder)
+{
+    if (!handler || !folder)
+    {
+        return false;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    if (backgroundHttpIO)
+    {
+        LOG_warn << "The background transfer handler is already set";
+        return false;
+    }
+
+    string path = folder;
+    string localfolder;
+    fsAccess->path2local(&path, &localfolder);
+
+    backgroundTransferHandler.handler = handler;
+    backgroundHttpIO.reset(new BackgroundHttpIO(&backgroundTransferHandler, fsAccess, localfolder));
+    return true;
+}
+
+void MegaApiImpl::enableBackgroundTransfers(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    if (enable && !backgroundHttpIO)
+    {
+        LOG_warn << "Background transfers without handler";
+        return;
+    }
+
+    LOG_debug << "Background transfers " << (enable ? "enabled" : "disabled");
+    client->backgroundhttpio = enable ? backgroundHttpIO.get() : nullptr;
+}
+
+bool MegaApiImpl::areBackgroundTransfersEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->backgroundhttpio != nullptr;
+}
+
+bool MegaApiImpl::backgroundTransferFinished(int64_t id, int httpStatus, const char* response)
+{
+    bool result = false;
+    {
+        SdkMutexGuard g(sdkMutex);
+        if (backgroundHttpIO)
+        {
+            result = backgroundHttpIO->finished(uint64_t(id), httpStatus, response ? response : "");
+        }
+    }
+
+    if (result)
+    {
+        waiter->notify();
+    }
+    return result;
+}
+
+bool MegaApiImpl::BackgroundTransferHandler::start(uint64_t id, bool upload, const string& url, const string& path)
+{
+    return upload ? handler->startUpload(int64_t(id), url.c_str(), path.c_str())
+                  : handler->startDownload(int64_t(id), url.c_str(), path.c_str());
+}
+
+void MegaApiImpl::BackgroundTransferHandler::cancel(uint64_t id)
+{
+    handler->cancel(int64_t(id));
+}
+
 int MegaApiImpl::getMaxDownloadSpeed()
 {
     return int(client->getmaxdownloadspeed());
@@ -7616,6 +8725,40 @@ MegaTransferData *MegaApiImpl::getTransferData(MegaTransferListener *listener)
     return data;
 }
 
+int MegaApiImpl::getTransferProgressSnapshot(MegaTransferProgress *progress, int size)
+{
+    lockSdkMutexForReading();
+    SdkMutexGuard g(sdkMutex, std::adopt_lock);
+
+    int i = 0;
+    for (map<int, MegaTransferPrivate *>::iterator it = transferMap.begin(); it != transferMap.end() && i < size; it++, i++)
+    {
+        MegaTransferPrivate *transfer = it->second;
+        MegaTransferProgress &p = progress[i];
+        p.tag = transfer->getTag();
+        p.type = transfer->getType();
+        p.state = transfer->getState();
+        p.transferredBytes = transfer->getTransferredBytes();
+        p.totalBytes = transfer->getTotalBytes();
+        p.speed = transfer->getSpeed();
+        p.meanSpeed = transfer->getMeanSpeed();
+    }
+
+    return int(transferMap.size());
+}
+
+void MegaApiImpl::enableTransferUpdateCallbacks(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    transferUpdateCallbacks = enable;
+}
+
+bool MegaApiImpl::areTransferUpdateCallbacksEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return transferUpdateCallbacks;
+}
+
 MegaTransfer *MegaApiImpl::getFirstTransfer(int type)
 {
     if (type != MegaTransfer::TYPE_DOWNLOAD && type != MegaTransfer::TYPE_UPLOAD)
@@ -7907,7 +9050,7 @@ void MegaApiImpl::startTimer( int64_t period, MegaRequestListener *listener)
     waiter->notify();
 }
 
-void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *parent, const char *fileName, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, MegaTransferListener *listener)
+void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *parent, const char *fileName, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, MegaTransferListener *listener, const FileFingerprint *fingerprint)
 {
     MegaTransferPrivate* transfer = new MegaTransferPrivate(MegaTransfer::TYPE_UPLOAD, listener);
     if(localPath)
@@ -7946,6 +9089,58 @@ void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *
 
     transfer->setStreamingTransfer(forceNewUpload);
 
+    if (fingerprint)
+    {
+        transfer->setLocalFingerprint(*fingerprint);
+    }
+
+    transferQueue.push(transfer);
+    waiter->notify();
+}
+
+void MegaApiImpl::startUploads(MegaUploadBatch* batch, MegaTransferListener *listener)
+{
+    if (!batch)
+    {
+        return;
+    }
+
+    TransferQueue::UploadBatch uploads;
+    uploads.entries = static_cast<MegaUploadBatchPrivate*>(batch)->entries;
+    uploads.listener = listener;
+    uploads.maxRetries = maxRetries;
+
+#if defined(_WIN32) && !defined(WINDOWS_PHONE)
+    for (std::deque<MegaUploadBatchPrivate::Entry>::iterator it = uploads.entries.begin(); it != uploads.entries.end(); it++)
+    {
+        string& path = it->localPath;
+        if(!PathIsRelativeA(path.c_str()) && ((path.size()<2) || path.compare(0, 2, "\\\\")))
+            path.insert(0, "\\\\?\\");
+    }
+#endif
+
+    transferQueue.push(std::move(uploads));
+    waiter->notify();
+}
+
+void MegaApiImpl::startUploadFromStream(MegaInputStream *inputStream, MegaNode *parent, const char *fileName, int64_t mtime, MegaTransferListener *listener)
+{
+    MegaTransferPrivate* transfer = new MegaTransferPrivate(MegaTransfer::TYPE_UPLOAD, listener);
+    transfer->setInputStream(inputStream);
+
+    if (parent)
+    {
+        transfer->setParentHandle(parent->getHandle());
+    }
+
+    if (fileName)
+    {
+        transfer->setFileName(fileName);
+    }
+
+    transfer->setMaxRetries(maxRetries);
+    transfer->setTime(mtime);
+
     transferQueue.push(transfer);
     waiter->notify();
 }
@@ -8050,6 +9245,20 @@ void MegaApiImpl::startStreaming(MegaNode* node, m_off_t startPos, m_off_t size,
     waiter->notify();
 }
 
+void MegaApiImpl::prefetchStreaming(const std::vector<MegaHandle>& handles, bool readAhead)
+{
+    SdkMutexGuard g(sdkMutex);
+    for (size_t i = 0; i < handles.size(); i++)
+    {
+        Node *node = client->nodebyhandle(handles[i]);
+        if (node)
+        {
+            client->prefetchread(node, readAhead);
+        }
+    }
+    waiter->notify();
+}
+
 void MegaApiImpl::setStreamingMinimumRate(int bytesPerSecond)
 {
     SdkMutexGuard g(sdkMutex);
@@ -8458,6 +9667,18 @@ void MegaApiImpl::setExclusionUpperSizeLimit(long long limit)
     syncUpperSizeLimit = limit;
 }
 
+void MegaApiImpl::setSyncScanTimeBudget(int milliseconds)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->syncscanbudget = milliseconds > 0 ? unsigned(milliseconds) : 0;
+}
+
+int MegaApiImpl::getSyncScanTimeBudget()
+{
+    SdkMutexGuard g(sdkMutex);
+    return int(client->syncscanbudget);
+}
+
 void MegaApiImpl::setExcludedRegularExpressions(MegaSync *sync, MegaRegExp *regExp)
 {
     if (!sync)
@@ -8616,7 +9837,7 @@ void MegaApiImpl::resetTotalUploads()
 
 MegaNode *MegaApiImpl::getRootNode()
 {
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     MegaNode *result = MegaNodePrivate::fromNode(client->nodebyhandle(client->rootnodes[0]));
     sdkMutex.unlock();
     return result;
@@ -8624,7 +9845,7 @@ MegaNode *MegaApiImpl::getRootNode()
 
 MegaNode* MegaApiImpl::getInboxNode()
 {
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     MegaNode *result = MegaNodePrivate::fromNode(client->nodebyhandle(client->rootnodes[1]));
     sdkMutex.unlock();
     return result;
@@ -8632,7 +9853,7 @@ MegaNode* MegaApiImpl::getInboxNode()
 
 MegaNode* MegaApiImpl::getRubbishNode()
 {
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     MegaNode *result = MegaNodePrivate::fromNode(client->nodebyhandle(client->rootnodes[2]));
     sdkMutex.unlock();
     return result;
@@ -8642,7 +9863,7 @@ MegaNode *MegaApiImpl::getRootNode(MegaNode *node)
 {
     MegaNode *rootnode = NULL;
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
 
     Node *n;
     if (node && (n = client->nodebyhandle(node->getHandle())))
@@ -8695,12 +9916,40 @@ int MegaApiImpl::getDefaultFolderPermissions()
     return fsAccess->getdefaultfolderpermissions();
 }
 
+void MegaApiImpl::setDownloadWriteOptions(int options)
+{
+    fsAccess->setwriteoptions(options & (FileSystemAccess::FSWRITE_PREALLOCATE | FileSystemAccess::FSWRITE_DIRECTIO | FileSystemAccess::FSWRITE_DROPCACHE));
+}
+
+int MegaApiImpl::getDownloadWriteOptions()
+{
+    return fsAccess->getwriteoptions();
+}
+
+void MegaApiImpl::setDownloadDurability(int policy, int windowMs)
+{
+    if (policy < MegaApi::DOWNLOAD_DURABILITY_NONE || policy > MegaApi::DOWNLOAD_DURABILITY_FILESYSTEM)
+    {
+        return;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    client->downloaddurability = policy;
+    client->durabilityds = dstime(std::max(0, windowMs) / 100);
+}
+
 long long MegaApiImpl::getBandwidthOverquotaDelay()
 {
     long long result = client->overquotauntil;
     return result > Waiter::ds ? (result - Waiter::ds) / 10 : 0;
 }
 
+long long MegaApiImpl::getTransferQuotaTimeLeft()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->transferquotatimeleft();
+}
+
 bool MegaApiImpl::userComparatorDefaultASC (User *i, User *j)
 {
     if(strcasecmp(i->email.c_str(), j->email.c_str())<=0) return 1;
@@ -8891,11 +10140,15 @@ bool MegaApiImpl::httpServerStart(bool localOnly, int port, bool useTLS, const c
     httpServer = new MegaHTTPServer(this, basePath, useTLS, certificatepath ? certificatepath : string(), keypath ? keypath : string(), useIPv6);
     httpServer->setMaxBufferSize(httpServerMaxBufferSize);
     httpServer->setMaxOutputSize(httpServerMaxOutputSize);
+    httpServer->setEventLoops(httpServerEventLoops);
+    httpServer->setMediaPrefetchTime(httpServerMediaPrefetchTime);
+    httpServer->setFolderPrefetch(httpServerFolderPrefetchFiles, httpServerFolderPrefetchReadAhead);
     httpServer->enableFileServer(httpServerEnableFiles);
     httpServer->enableOfflineAttribute(httpServerOfflineAttributeEnabled);
     httpServer->enableFolderServer(httpServerEnableFolders);
     httpServer->setRestrictedMode(httpServerRestrictedMode);
     httpServer->enableSubtitlesSupport(httpServerRestrictedMode);
+    httpServer->enableMetrics(httpServerMetricsEnabled);
 
     bool result = httpServer->start(port, localOnly);
     if (!result)
@@ -9100,6 +10353,67 @@ void MegaApiImpl::httpServerSetMaxOutputSize(int outputSize)
     sdkMutex.unlock();
 }
 
+void MegaApiImpl::httpServerSetEventLoops(int loops)
+{
+    sdkMutex.lock();
+    httpServerEventLoops = loops <= 0 ? 0 : loops;
+    if (httpServer)
+    {
+        httpServer->setEventLoops(httpServerEventLoops);
+    }
+    sdkMutex.unlock();
+}
+
+int MegaApiImpl::httpServerGetEventLoops()
+{
+    int value;
+    sdkMutex.lock();
+    value = httpServerEventLoops ? httpServerEventLoops : 1;
+    sdkMutex.unlock();
+    return value;
+}
+
+void MegaApiImpl::httpServerSetMediaPrefetchTime(int seconds)
+{
+    sdkMutex.lock();
+    httpServerMediaPrefetchTime = seconds <= 0 ? 0 : seconds;
+    if (httpServer)
+    {
+        httpServer->setMediaPrefetchTime(httpServerMediaPrefetchTime);
+    }
+    sdkMutex.unlock();
+}
+
+int MegaApiImpl::httpServerGetMediaPrefetchTime()
+{
+    int value;
+    sdkMutex.lock();
+    value = httpServerMediaPrefetchTime;
+    sdkMutex.unlock();
+    return value;
+}
+
+void MegaApiImpl::httpServerSetFolderPrefetch(int files, bool readAhead)
+{
+    sdkMutex.lock();
+    httpServerFolderPrefetchFiles = files <= 0 ? 0 : files;
+    httpServerFolderPrefetchReadAhead = readAhead;
+    if (httpServer)
+    {
+        httpServer->setFolderPrefetch(httpServerFolderPrefetchFiles, httpServerFolderPrefetchReadAhead);
+    }
+    sdkMutex.unlock();
+}
+
+int MegaApiImpl::httpServerGetFolderPrefetch()
+{
+    int value;
+    sdkMutex.lock();
+    value = httpServerFolderPrefetchFiles;
+    sdkMutex.unlock();
+    return value;
+}
+
 int MegaApiImpl::httpServerGetMaxOutputSize()
 {
     int value;
@@ -9204,6 +10518,79 @@ bool MegaApiImpl::httpServerIsSubtitlesSupportEnabled()
     return httpServerSubtitlesSupportEnabled;
 }
 
+void MegaApiImpl::httpServerEnableMetrics(bool enable)
+{
+    sdkMutex.lock();
+    httpServerMetricsEnabled = enable;
+    if (httpServer)
+    {
+        httpServer->enableMetrics(httpServerMetricsEnabled);
+    }
+
+    if (!enable)
+    {
+        std::lock_guard<std::mutex> g(metricsMutex);
+        metricsSnapshot.clear();
+    }
+    sdkMutex.unlock();
+
+    // first snapshot
+    waiter->notify();
+}
+
+bool MegaApiImpl::httpServerIsMetricsEnabled()
+{
+    return httpServerMetricsEnabled;
+}
+
+string MegaApiImpl::getMetricsSnapshot()
+{
+    std::lock_guard<std::mutex> g(metricsMutex);
+    if (metricsSnapshot.empty())
+    {
+        return string();
+    }
+
+    std::ostringstream s;
+    s << metricsSnapshot
+      << "# HELP mega_metrics_age_seconds Time since these metrics were collected\n"
+         "# TYPE mega_metrics_age_seconds gauge\n"
+         "mega_metrics_age_seconds "
+      << std::chrono::duration<double>(std::chrono::steady_clock::now() - metricsSnapshotTime).count() << "\n";
+    return s.str();
+}
+
+dstime MegaApiImpl::refreshMetrics()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::milliseconds age = std::chrono::duration_cast<std::chrono::milliseconds>(now - metricsSnapshotTime);
+    if (!metricsSnapshot.empty() && age.count() < int64_t(METRICS_REFRESH_DS) * 100)
+    {
+        return dstime((int64_t(METRICS_REFRESH_DS) * 100 - age.count() + 99) / 100);
+    }
+
+    std::ostringstream s;
+    client->metrics(s);
+
+    s << "# HELP mega_transfers_started_total Transfers started through the API\n"
+         "# TYPE mega_transfers_started_total counter\n"
+         "mega_transfers_started_total{direction=\"get\"} " << totalDownloads << "\n"
+         "mega_transfers_started_total{direction=\"put\"} " << totalUploads << "\n"
+         "# HELP mega_transfer_bytes_total Bytes transferred through the API\n"
+         "# TYPE mega_transfer_bytes_total counter\n"
+         "mega_transfer_bytes_total{direction=\"get\"} " << totalDownloadedBytes << "\n"
+         "mega_transfer_bytes_total{direction=\"put\"} " << totalUploadedBytes << "\n"
+         "# HELP mega_requests_pending Requests started through the API and not finished yet\n"
+         "# TYPE mega_requests_pending gauge\n"
+         "mega_requests_pending " << requestMap.size() << "\n";
+
+    string snapshot = s.str();
+    std::lock_guard<std::mutex> g(metricsMutex);
+    metricsSnapshot.swap(snapshot);
+    metricsSnapshotTime = now;
+    return METRICS_REFRESH_DS;
+}
+
 bool MegaApiImpl::httpServerIsLocalOnly()
 {
     bool localOnly = true;
@@ -10142,6 +11529,28 @@ MegaUserAlertList* MegaApiImpl::getUserAlerts()
     return alertList;
 }
 
+MegaUserAlertList* MegaApiImpl::getUserAlerts(int start, int count)
+{
+    SdkMutexGuard g(sdkMutex);
+
+    UserAlerts::Alerts& alerts = client->useralerts.alerts;
+    size_t first = size_t(std::max(start, 0));
+    size_t last = std::min(alerts.size(), first + size_t(std::max(count, 0)));
+
+    vector<UserAlert::Base*> v;
+    if (first < last)
+    {
+        v.assign(alerts.begin() + first, alerts.begin() + last);
+    }
+    return new MegaUserAlertListPrivate(v.data(), int(v.size()), client);
+}
+
+int MegaApiImpl::getNumUserAlerts()
+{
+    SdkMutexGuard g(sdkMutex);
+    return int(client->useralerts.alerts.size());
+}
+
 int MegaApiImpl::getNumUnreadUserAlerts()
 {
     int result = 0;
@@ -10300,7 +11709,8 @@ MegaShareList *MegaApiImpl::getOutShares(int order)
     sdkMutex.lock();
 
     OutShareProcessor shareProcessor(*client);
-    processTree(client->nodebyhandle(client->rootnodes[0]), &shareProcessor, true);
+    processIndexedNodes(client->mOutShareNodes, &shareProcessor);
+    processIndexedNodes(client->mPendingShareNodes, &shareProcessor, &client->mOutShareNodes);
     shareProcessor.sortShares(order);
     MegaShareList *shareList = new MegaShareListPrivate(shareProcessor.getShares().data(), shareProcessor.getHandles().data(), int(shareProcessor.getShares().size()));
 
@@ -10361,7 +11771,7 @@ MegaShareList *MegaApiImpl::getPendingOutShares()
     sdkMutex.lock();
 
     PendingOutShareProcessor shareProcessor;
-    processTree(client->nodebyhandle(client->rootnodes[0]), &shareProcessor, true);
+    processIndexedNodes(client->mPendingShareNodes, &shareProcessor);
     MegaShareList *shareList = new MegaShareListPrivate(shareProcessor.getShares().data(), shareProcessor.getHandles().data(), int(shareProcessor.getShares().size()), true);
 
     sdkMutex.unlock();
@@ -10401,7 +11811,7 @@ MegaNodeList *MegaApiImpl::getPublicLinks(int order)
     sdkMutex.lock();
 
     PublicLinkProcessor linkProcessor;
-    processTree(client->nodebyhandle(client->rootnodes[0]), &linkProcessor, true);
+    processIndexedNodes(client->mPublicLinkNodes, &linkProcessor);
     node_vector nodes = linkProcessor.getNodes();
     sortByComparatorFunction(nodes, order, *client);
     MegaNodeList *nodeList = new MegaNodeListPrivate(nodes.data(), int(nodes.size()));
@@ -10582,6 +11992,165 @@ bool MegaApiImpl::processMegaTree(MegaNode* n, MegaTreeProcessor* processor, boo
     return result;
 }
 
+MegaNodeSnapshot *MegaApiImpl::getNodeSnapshot(MegaNode *n)
+{
+    lockSdkMutexForReading();
+    SdkMutexGuard g(sdkMutex, std::adopt_lock);
+
+    if (client->fetchingnodes)
+    {
+        return NULL;
+    }
+
+    Node *root = NULL;
+    if (n && !(root = client->nodebyhandle(n->getHandle())))
+    {
+        return NULL;
+    }
+
+    // the nodes still in the local cache are read as the app accesses them
+    return takeNodeSnapshot(root, true);
+}
+
+MegaNodeSnapshotPrivate *MegaApiImpl::takeNodeSnapshot(Node *root, bool lazy)
+{
+    node_vector nodes;
+    if (root)
+    {
+        nodes.push_back(root);
+    }
+    else
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (Node *node = client->nodebyhandle(client->rootnodes[i]))
+            {
+                nodes.push_back(node);
+            }
+        }
+
+        if (nodes.empty())
+        {
+            return NULL;
+        }
+    }
+
+    // breadth first, so that parents come before their children
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        Node *node = nodes[i];
+        if (node->type != FILENODE)
+        {
+            nodes.insert(nodes.end(), node->children.begin(), node->children.end());
+        }
+    }
+
+    return new MegaNodeSnapshotPrivate(lazy ? this : NULL, nodeGeneration, client->scsn, nodes);
+}
+
+long long MegaApiImpl::getNodeGeneration()
+{
+    SdkMutexGuard g(sdkMutex);
+    return nodeGeneration;
+}
+
+MegaNodeChangeList *MegaApiImpl::getNodeChangesSince(long long generation)
+{
+    SdkMutexGuard g(sdkMutex);
+
+    if (generation < nodeChangeLogFloor || generation > nodeGeneration)
+    {
+        return NULL;
+    }
+
+    // the log is ordered by generation
+    std::deque<NodeChange>::const_iterator it = std::upper_bound(nodeChangeLog.begin(), nodeChangeLog.end(), generation,
+        [](long long gen, const NodeChange &change) { return gen < change.generation; });
+
+    vector<std::pair<MegaHandle, int>> changes;
+    map<MegaHandle, size_t> index;
+    for (; it != nodeChangeLog.end(); it++)
+    {
+        auto inserted = index.emplace(it->handle, changes.size());
+        if (inserted.second)
+        {
+            changes.push_back(std::make_pair(it->handle, it->changes));
+        }
+        else
+        {
+            changes[inserted.first->second].second |= it->changes;
+        }
+    }
+
+    MegaNodeChangeListPrivate *list = new MegaNodeChangeListPrivate();
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        list->add(changes[i].first, changes[i].second);
+    }
+    return list;
+}
+
+void MegaApiImpl::resetNodeChangeLog()
+{
+    nodeGeneration++;
+    nodeChangeLog.clear();
+    nodeChangeLogFloor = nodeGeneration;
+
+    if (nodeTreeExport)
+    {
+        nodeTreeExport->stale = true;
+    }
+}
+
+bool MegaApiImpl::startNodeTreeExport(const char *name)
+{
+    if (!name || !*name || strchr(name, '/') || strchr(name, '\\'))
+    {
+        return false;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    nodeTreeExport.reset();
+
+    std::unique_ptr<SharedNodeTreeExport> e(new SharedNodeTreeExport());
+    if (!e->start(name))
+    {
+        return false;
+    }
+
+    // the SDK thread takes the snapshot
+    nodeTreeExport = std::move(e);
+    waiter->notify();
+    return true;
+}
+
+void MegaApiImpl::stopNodeTreeExport()
+{
+    SdkMutexGuard g(sdkMutex);
+    nodeTreeExport.reset();
+}
+
+void MegaApiImpl::publishNodeTreeExport()
+{
+    if (!nodeTreeExport || !nodeTreeExport->stale || client->fetchingnodes)
+    {
+        return;
+    }
+
+    std::unique_ptr<MegaNodeSnapshotPrivate> snapshot(takeNodeSnapshot(NULL, false));
+    if (!snapshot)
+    {
+        // logged out
+        snapshot.reset(new MegaNodeSnapshotPrivate(NULL, nodeGeneration, client->scsn, node_vector()));
+    }
+
+    if (!nodeTreeExport->publish(*snapshot))
+    {
+        LOG_err << "Unable to export the node tree, stopping the export";
+        nodeTreeExport.reset();
+    }
+}
+
 MegaNodeList *MegaApiImpl::search(const char *searchString, MegaCancelToken *cancelToken, int order)
 {
     if(!searchString)
@@ -10594,7 +12163,8 @@ MegaNodeList *MegaApiImpl::search(const char *searchString, MegaCancelToken *can
         return new MegaNodeListPrivate();
     }
 
-    SdkMutexGuard g(sdkMutex);
+    lockSdkMutexForReading();
+    SdkMutexGuard g(sdkMutex, std::adopt_lock);
 
     if (cancelToken && cancelToken->isCancelled())
     {
@@ -10604,6 +12174,35 @@ MegaNodeList *MegaApiImpl::search(const char *searchString, MegaCancelToken *can
     node_vector result;
     Node *node;
 
+    if (client->mNodeNameIndex.isenabled())
+    {
+        node_vector candidates;
+        client->mNodeNameIndex.search(searchString, candidates);
+
+        // same scope as the tree walk below: no file versions, only nodes
+        // reachable from the root nodes or an inshare
+        for (node_vector::iterator it = candidates.begin(); it != candidates.end(); it++)
+        {
+            node = *it;
+            if (node->parent && node->parent->type == FILENODE)
+            {
+                continue;
+            }
+
+            Node *ancestor = node->firstancestor();
+            if (ancestor->inshare
+                    || ancestor->nodehandle == client->rootnodes[0]
+                    || ancestor->nodehandle == client->rootnodes[1]
+                    || ancestor->nodehandle == client->rootnodes[2])
+            {
+                result.push_back(node);
+            }
+        }
+
+        sortByComparatorFunction(result, order, *client);
+        return new MegaNodeListLazy(this, result.data(), int(result.size()));
+    }
+
     // rootnodes
     for (unsigned int i = 0; i < (sizeof client->rootnodes / sizeof *client->rootnodes)
           && !(cancelToken && cancelToken->isCancelled()); i++)
@@ -10632,7 +12231,7 @@ MegaNodeList *MegaApiImpl::search(const char *searchString, MegaCancelToken *can
     delete shares;
 
     sortByComparatorFunction(result, order, *client);
-    MegaNodeList *nodeList = new MegaNodeListPrivate(result.data(), int(result.size()));
+    MegaNodeList *nodeList = new MegaNodeListLazy(this, result.data(), int(result.size()));
     
     return nodeList;
 }
@@ -10839,6 +12438,672 @@ void MegaApiImpl::acknowledgeUserAlerts(MegaRequestListener *listener)
     waiter->notify();
 }
 
+void MegaApiImpl::enableSearchIndex(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setnodenameindex(enable);
+}
+
+bool MegaApiImpl::isSearchIndexEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->mNodeNameIndex.isenabled();
+}
+
+void MegaApiImpl::enableLazyNodeLoading(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setlazynodeloading(enable);
+}
+
+bool MegaApiImpl::isLazyNodeLoadingEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->lazynodeloading;
+}
+
+void MegaApiImpl::enableAsyncDbWrites(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->asyncdbwrites = enable;
+}
+
+bool MegaApiImpl::areAsyncDbWritesEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->asyncdbwrites;
+}
+
+void MegaApiImpl::enableStateCacheSnapshots(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setscsnapshots(enable);
+}
+
+bool MegaApiImpl::areStateCacheSnapshotsEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->scsnapshots;
+}
+
+void MegaApiImpl::enableReloadReconciliation(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setreloadreconciliation(enable);
+}
+
+bool MegaApiImpl::isReloadReconciliationEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->reloadreconciliation;
+}
+
+void MegaApiImpl::enableActionPacketPrefetch(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->scprefetch = enable;
+
+    if (!enable)
+    {
+        client->cancelscprefetch();
+    }
+}
+
+bool MegaApiImpl::isActionPacketPrefetchEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->scprefetch;
+}
+
+void MegaApiImpl::setNodeUpdateCoalescing(int milliseconds, int maxNodes)
+{
+    SdkMutexGuard g(sdkMutex);
+    flushNodeUpdates(true);
+    nodeUpdateWindow = milliseconds;
+    nodeUpdateMaxNodes = maxNodes;
+}
+
+int MegaApiImpl::getNodeUpdateCoalescingWindow()
+{
+    SdkMutexGuard g(sdkMutex);
+    return nodeUpdateWindow;
+}
+
+void MegaApiImpl::enableCompactNodeUpdates(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    flushNodeUpdates(true);
+    compactNodeUpdates = enable;
+}
+
+bool MegaApiImpl::areCompactNodeUpdatesEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return compactNodeUpdates;
+}
+
+void MegaApiImpl::enableLazyFolderLinks(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->lazyfolderlinks = enable;
+}
+
+bool MegaApiImpl::areLazyFolderLinksEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->lazyfolderlinks;
+}
+
+void MegaApiImpl::enableAdaptiveTransfers(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->adaptivetransfers = enable;
+}
+
+bool MegaApiImpl::areAdaptiveTransfersEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->adaptivetransfers;
+}
+
+void MegaApiImpl::setTransferSchedule(int schedule)
+{
+    SdkMutexGuard g(sdkMutex);
+    if (schedule >= MegaApi::TRANSFER_SCHEDULE_PRIORITY && schedule <= MegaApi::TRANSFER_SCHEDULE_FAIR)
+    {
+        client->transferschedule = transferschedule_t(schedule);
+    }
+}
+
+int MegaApiImpl::getTransferSchedule()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->transferschedule;
+}
+
+void MegaApiImpl::setTransferClassWeight(int transferTag, unsigned weight)
+{
+    SdkMutexGuard g(sdkMutex);
+    if (weight)
+    {
+        client->transferclassweights[transferTag] = weight;
+    }
+    else
+    {
+        client->transferclassweights.erase(transferTag);
+    }
+}
+
+void MegaApiImpl::enableUploadBatching(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->batchputnodes = enable;
+    if (!enable)
+    {
+        client->flushputnodes(true);
+    }
+}
+
+bool MegaApiImpl::isUploadBatchingEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->batchputnodes;
+}
+
+void MegaApiImpl::setTransferCryptoThreads(int threads)
+{
+    if (threads < 0 || threads > 16)
+    {
+        return;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    client->setcryptothreads(unsigned(threads));
+}
+
+int MegaApiImpl::getTransferCryptoThreads()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->cryptoworkers ? int(client->cryptoworkers->size()) : 0;
+}
+
+void MegaApiImpl::setSharedWorkerThreads(int threads)
+{
+    if (threads < 0 || threads > 64)
+    {
+        return;
+    }
+
+    CryptoWorkers::setsharedthreads(unsigned(threads));
+}
+
+int MegaApiImpl::getSharedWorkerThreads()
+{
+    return int(CryptoWorkers::sharedthreads());
+}
+
+void MegaApiImpl::enableSharedNetworkCaches(bool enable)
+{
+#ifdef USE_CURL
+    CurlHttpIO::setsharedcaches(enable);
+#endif
+}
+
+bool MegaApiImpl::areSharedNetworkCachesEnabled()
+{
+#ifdef USE_CURL
+    return CurlHttpIO::getsharedcaches();
+#else
+    return false;
+#endif
+}
+
+std::atomic<int> MegaApiImpl::networkBackend{MegaApi::NETWORK_BACKEND_DEFAULT};
+
+void MegaApiImpl::setNetworkBackend(int backend)
+{
+    if (backend < MegaApi::NETWORK_BACKEND_DEFAULT || backend > MegaApi::NETWORK_BACKEND_WINHTTP)
+    {
+        return;
+    }
+
+    networkBackend = backend;
+}
+
+int MegaApiImpl::getNetworkBackend()
+{
+    return networkBackend;
+}
+
+void MegaApiImpl::setGfxWorkers(int threads)
+{
+    if (threads < 1 || threads > int(GfxProc::MAXWORKERS))
+    {
+        return;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    if (gfxAccess)
+    {
+        gfxAccess->setworkers(unsigned(threads));
+    }
+}
+
+int MegaApiImpl::getGfxWorkers()
+{
+    SdkMutexGuard g(sdkMutex);
+    return gfxAccess ? int(gfxAccess->getworkers()) : 0;
+}
+
+void MegaApiImpl::setPowerPolicy(int policy)
+{
+    if (policy < MegaApi::POWER_POLICY_AUTO || policy > MegaApi::POWER_POLICY_LOW_POWER)
+    {
+        return;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    client->setpowerpolicy(PowerPolicy::policy_t(policy), client->powerpolicy.power, client->powerpolicy.thermal);
+}
+
+int MegaApiImpl::getPowerPolicy()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->powerpolicy.policy;
+}
+
+void MegaApiImpl::setPowerState(int powerState, int thermalState)
+{
+    if (powerState < MegaApi::POWER_STATE_CHARGING || powerState > MegaApi::POWER_STATE_POWER_SAVER
+            || thermalState < MegaApi::THERMAL_STATE_NOMINAL || thermalState > MegaApi::THERMAL_STATE_CRITICAL)
+    {
+        return;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    client->setpowerpolicy(client->powerpolicy.policy, PowerPolicy::power_t(powerState), PowerPolicy::thermal_t(thermalState));
+}
+
+bool MegaApiImpl::isLowPowerActive()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->powerpolicy.lowpower();
+}
+
+void MegaApiImpl::enableHedgedDownloads(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->hedgedownloads = enable;
+}
+
+bool MegaApiImpl::areHedgedDownloadsEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->hedgedownloads;
+}
+
+void MegaApiImpl::setUploadReadAhead(int chunks)
+{
+    if (chunks < 0 || chunks > 8)
+    {
+        return;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    client->uploadreadahead = unsigned(chunks);
+}
+
+int MegaApiImpl::getUploadReadAhead()
+{
+    SdkMutexGuard g(sdkMutex);
+    return int(client->uploadreadahead);
+}
+
+void MegaApiImpl::enableFingerprintCache(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setfingerprintcache(enable);
+}
+
+bool MegaApiImpl::isFingerprintCacheEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->usefingerprintcache;
+}
+
+void MegaApiImpl::enableConnectionPrewarming(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->prewarmconnections = enable;
+}
+
+bool MegaApiImpl::isConnectionPrewarmingEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->prewarmconnections;
+}
+
+void MegaApiImpl::enableTransferUrlPrefetching(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->prefetchurls = enable;
+}
+
+bool MegaApiImpl::isTransferUrlPrefetchingEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->prefetchurls;
+}
+
+void MegaApiImpl::enablePipelinedStartup(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->pipelinedstartup = enable;
+}
+
+bool MegaApiImpl::isPipelinedStartupEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->pipelinedstartup;
+}
+
+void MegaApiImpl::enableTlsSessionCache(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->settlssessioncache(enable);
+}
+
+bool MegaApiImpl::isTlsSessionCacheEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->usetlssessioncache;
+}
+
+char* MegaApiImpl::getNetworkStats(bool reset)
+{
+    SdkMutexGuard g(sdkMutex);
+    return MegaApi::strdup(client->networkstats(reset).c_str());
+}
+
+char* MegaApiImpl::getMemoryUsageReport()
+{
+    vector<MegaClient::MemoryUsageEntry> extra;
+#ifdef HAVE_LIBUV
+    extra.push_back({ "streaming", StreamingBuffer::allocatedBuffers.load(), StreamingBuffer::allocatedBytes.load() });
+#endif
+
+    SdkMutexGuard g(sdkMutex);
+    return MegaApi::strdup(client->memoryusage(extra).c_str());
+}
+
+void MegaApiImpl::setPerformanceSampling(int interval)
+{
+    if (interval < 0)
+    {
+        return;
+    }
+
+    CodeCounter::LatencySampler::interval = unsigned(interval);
+}
+
+char* MegaApiImpl::getPerformanceLatencies(bool reset)
+{
+    // the histograms are atomic: no need to wait for the SDK thread
+    return MegaApi::strdup(client->performanceStats.latencies(reset).c_str());
+}
+
+void MegaApiImpl::enableUploadDeduplication(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    uploadDeduplication = enable;
+}
+
+bool MegaApiImpl::isUploadDeduplicationEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return uploadDeduplication;
+}
+
+void MegaApiImpl::enableIncrementalBackups(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    incrementalBackups = enable;
+}
+
+bool MegaApiImpl::isIncrementalBackupsEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return incrementalBackups;
+}
+
+void MegaApiImpl::setMaxConcurrentBackups(int maxBackups)
+{
+    SdkMutexGuard g(sdkMutex);
+    maxConcurrentBackups = maxBackups > 0 ? maxBackups : 0;
+}
+
+int MegaApiImpl::getMaxConcurrentBackups()
+{
+    SdkMutexGuard g(sdkMutex);
+    return maxConcurrentBackups;
+}
+
+bool MegaApiImpl::setBackupLimits(int backupTag, int maxUploads, long long bytesPerSecond)
+{
+    SdkMutexGuard g(sdkMutex);
+    map<int, MegaBackupController *>::iterator it = backupsMap.find(backupTag);
+    if (it == backupsMap.end())
+    {
+        return false;
+    }
+
+    // the uploads of a backup share the class of its folder transfer tag
+    setTransferRateLimit(it->second->getFolderTransferTag(), bytesPerSecond, 0);
+    it->second->setMaxUploads(maxUploads);
+    return true;
+}
+
+bool MegaApiImpl::acquireBackupSlot(int backupTag)
+{
+    SdkMutexGuard g(sdkMutex);
+    if (!maxConcurrentBackups)
+    {
+        backupQueue.clear();
+        return true;
+    }
+
+    // forget the backups removed while waiting
+    backupQueue.erase(std::remove_if(backupQueue.begin(), backupQueue.end(), [this](int tag) {
+        return backupsMap.find(tag) == backupsMap.end();
+    }), backupQueue.end());
+
+    int ongoing = 0;
+    for (std::map<int, MegaBackupController *>::iterator it = backupsMap.begin(); it != backupsMap.end(); ++it)
+    {
+        if (it->second->getState() == MegaBackup::BACKUP_ONGOING)
+        {
+            ongoing++;
+        }
+    }
+
+    // the backups queued before this one go first
+    std::deque<int>::iterator it = std::find(backupQueue.begin(), backupQueue.end(), backupTag);
+    if (ongoing + int(it - backupQueue.begin()) < maxConcurrentBackups)
+    {
+        if (it != backupQueue.end())
+        {
+            backupQueue.erase(it);
+        }
+        return true;
+    }
+
+    if (it == backupQueue.end())
+    {
+        backupQueue.push_back(backupTag);
+    }
+    return false;
+}
+
+void MegaApiImpl::leaveBackupQueue(int backupTag)
+{
+    SdkMutexGuard g(sdkMutex);
+    backupQueue.erase(std::remove(backupQueue.begin(), backupQueue.end(), backupTag), backupQueue.end());
+}
+
+void MegaApiImpl::putNodeCopies(handle target, const vector<Node*>& nodes, MegaRequestListener *listener)
+{
+    MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_COPY, listener);
+    int nextTag = client->nextreqtag();
+    request->setTag(nextTag);
+    request->setParentHandle(target);
+    request->setNumber(nodes.size());
+    requestMap[nextTag] = request;
+    fireOnRequestStart(request);
+
+    NewNode *nn = new NewNode[nodes.size()];
+    nameid rrname = AttrMap::string2nameid("rr");
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        Node *n = nodes[i];
+        NewNode *t = nn + i;
+
+        t->source = NEW_NODE;
+        t->type = n->type;
+        t->nodehandle = n->nodehandle;
+        t->parenthandle = UNDEF;
+        t->nodekey = n->nodekey;
+        t->attrstring = new string;
+
+        SymmCipher key;
+        AttrMap attrs = n->attrs;
+        string attrstring;
+        key.setkey((const byte*)t->nodekey.data(), n->type);
+        attrs.map.erase(rrname);
+        attrs.getjson(&attrstring);
+        client->makeattr(&key, t->attrstring, attrstring.c_str());
+    }
+
+    int creqtag = client->reqtag;
+    client->reqtag = nextTag;
+    client->putnodes(target, nn, int(nodes.size()));
+    client->reqtag = creqtag;
+}
+
+long long MegaApiImpl::getUploadDeduplicatedBytes()
+{
+    SdkMutexGuard g(sdkMutex);
+    return deduplicatedBytes;
+}
+
+void MegaApiImpl::setCompressedTransfers(bool enable)
+{
+#ifdef USE_ZLIB
+    SdkMutexGuard g(sdkMutex);
+    compressedTransfers = enable;
+#else
+    (void)enable;
+#endif
+}
+
+bool MegaApiImpl::areCompressedTransfersEnabled()
+{
+    SdkMutexGuard g(sdkMutex);
+    return compressedTransfers;
+}
+
+void MegaApiImpl::setTransferRateLimit(int transferTag, long long bytesPerSecond, long long burstBytes)
+{
+    SdkMutexGuard g(sdkMutex);
+    if (bytesPerSecond > 0)
+    {
+        TransferRateLimit& limit = client->transferratelimits[transferTag];
+        limit.rate = bytesPerSecond;
+        limit.burst = burstBytes > 0 ? burstBytes : bytesPerSecond;
+    }
+    else
+    {
+        client->transferratelimits.erase(transferTag);
+    }
+}
+
+void MegaApiImpl::addTransferRateLimitPeriod(int transferTag, int startMinute, int endMinute, long long bytesPerSecond)
+{
+    SdkMutexGuard g(sdkMutex);
+    map<int, TransferRateLimit>::iterator it = client->transferratelimits.find(transferTag);
+    if (it != client->transferratelimits.end()
+            && startMinute >= 0 && startMinute < 24 * 60
+            && endMinute >= 0 && endMinute <= 24 * 60 && startMinute != endMinute)
+    {
+        TransferRateLimit::Period period = { startMinute, endMinute, bytesPerSecond > 0 ? bytesPerSecond : 0 };
+        it->second.periods.push_back(period);
+    }
+}
+
+void MegaApiImpl::setStreamingCacheSize(long long bytes)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->drcache.setmaxsize(bytes);
+}
+
+long long MegaApiImpl::getStreamingCacheSize()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->drcache.getmaxsize();
+}
+
+void MegaApiImpl::setPipelinedRequests(int maxBatches)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->reqs.setmaxpipelined(maxBatches > 0 ? unsigned(maxBatches) : 0);
+}
+
+int MegaApiImpl::getPipelinedRequests()
+{
+    SdkMutexGuard g(sdkMutex);
+    return int(client->reqs.getmaxpipelined());
+}
+
+void MegaApiImpl::setDatabaseOption(int option, long long value)
+{
+    SdkMutexGuard g(sdkMutex);
+    if (!dbAccess)
+    {
+        return;
+    }
+
+    DbConfig& config = dbAccess->config;
+    switch (option)
+    {
+        case MegaApi::DB_OPTION_SYNCHRONOUS:
+            config.synchronous = int(value);
+            break;
+        case MegaApi::DB_OPTION_CACHE_SIZE_KB:
+            config.cacheSizeKiB = int(value);
+            break;
+        case MegaApi::DB_OPTION_MMAP_SIZE:
+            config.mmapSize = value;
+            break;
+        case MegaApi::DB_OPTION_PAGE_SIZE:
+            config.pageSize = int(value);
+            break;
+        case MegaApi::DB_OPTION_TEMP_STORE:
+            config.tempStore = int(value);
+            break;
+        case MegaApi::DB_OPTION_WAL_AUTOCHECKPOINT:
+            config.walAutoCheckpoint = int(value);
+            break;
+        case MegaApi::DB_OPTION_WAL_CHECKPOINT_ON_COMMIT:
+            config.walCheckpointOnCommit = value > 0;
+            break;
+        case MegaApi::DB_OPTION_COMPRESS_RECORDS:
+            config.compressRecords = value > 0;
+            break;
+        default:
+            LOG_warn << "Unknown database option: " << option;
+            break;
+    }
+}
+
 void MegaApiImpl::disableGfxFeatures(bool disable)
 {
     client->gfxdisabled = disable;
@@ -11080,6 +13345,23 @@ void MegaApiImpl::resumeActionPackets()
     sdkMutex.unlock();
 }
 
+// process the nodes of an index of the client that are in the cloud drive, like
+// processTree() from its root would, without walking the whole tree
+void MegaApiImpl::processIndexedNodes(const handle_set& index, TreeProcessor* processor, const handle_set* exclude)
+{
+    SdkMutexGuard g(sdkMutex);
+
+    Node* root = client->nodebyhandle(client->rootnodes[0]);
+    for (handle h : index)
+    {
+        Node* node;
+        if ((!exclude || !exclude->count(h)) && (node = client->nodebyhandle(h)) && node->isbelow(root))
+        {
+            processor->processNode(node);
+        }
+    }
+}
+
 bool MegaApiImpl::processTree(Node* node, TreeProcessor* processor, bool recursive, MegaCancelToken *cancelToken)
 {
     if (!node)
@@ -11137,7 +13419,8 @@ MegaNodeList* MegaApiImpl::search(MegaNode* n, const char* searchString, MegaCan
         return new MegaNodeListPrivate();
     }
     
-    SdkMutexGuard g(sdkMutex);
+    lockSdkMutexForReading();
+    SdkMutexGuard g(sdkMutex, std::adopt_lock);
 
     if (cancelToken && cancelToken->isCancelled())
     {
@@ -11187,9 +13470,9 @@ long long MegaApiImpl::getSize(MegaNode *n)
         sdkMutex.unlock();
         return 0;
     }
-    SizeProcessor sizeProcessor;
-    processTree(node, &sizeProcessor);
-    long long result = sizeProcessor.getTotalBytes();
+    // same as a SizeProcessor walk, which doesn't descend into file versions
+    NodeCounter nc = node->subnodeCounts();
+    long long result = nc.storage - nc.versionStorage;
     sdkMutex.unlock();
 
     return result;
@@ -11665,6 +13948,20 @@ void MegaApiImpl::transfer_prepare(Transfer *t)
     }
 }
 
+int MegaApiImpl::transfer_class(Transfer *t)
+{
+    // the transfers of a folder transfer share a class
+    if (t->files.size())
+    {
+        MegaTransferPrivate* transfer = getMegaTransferPrivate(t->files.front()->tag);
+        if (transfer)
+        {
+            return transfer->getFolderTransferTag() > 0 ? transfer->getFolderTransferTag() : transfer->getTag();
+        }
+    }
+    return t->tag;
+}
+
 void MegaApiImpl::transfer_update(Transfer *t)
 {
     for (file_list::iterator it = t->files.begin(); it != t->files.end(); it++)
@@ -11803,13 +14100,37 @@ bool MegaApiImpl::pread_data(byte *buffer, m_off_t len, m_off_t, m_off_t speed,
     transfer->setMeanSpeed(meanSpeed);
 
     bool end = (transfer->getTransferredBytes() == transfer->getTotalBytes());
+    bool more = !end;
     fireOnTransferUpdate(transfer);
+
+    // the listener gets the requested range of the content of a node uploaded compressed
+    string inflated;
+    if (ZlibInflater *inflater = transfer->getInflater())
+    {
+        if (!inflater->inflate(buffer, size_t(len), &inflated) || (end && !inflater->done()))
+        {
+            transfer->setState(MegaTransfer::STATE_FAILED);
+            DBTableTransactionCommitter committer(client->tctable);
+            fireOnTransferFinish(transfer, MegaError(API_EREAD), committer);
+            return false;
+        }
+
+        // the rest of the stream isn't needed once the range is inflated
+        end = inflater->done();
+        if (inflated.empty() && !end)
+        {
+            return true;
+        }
+        transfer->setLastBytes((char *)inflated.data());
+        transfer->setDeltaSize(inflated.size());
+    }
+
     if (!fireOnTransferData(transfer) || end)
     {
         transfer->setState(end ? MegaTransfer::STATE_COMPLETED : MegaTransfer::STATE_CANCELLED);
         DBTableTransactionCommitter committer(client->tctable);
         fireOnTransferFinish(transfer, end ? MegaError(API_OK) : MegaError(API_EINCOMPLETE), committer);
-        return end;
+        return end && !more;
     }
     return true;
 }
@@ -12845,6 +15166,15 @@ void MegaApiImpl::setattr_result(handle h, error e)
     MegaError megaError(e);
     if(requestMap.find(client->restag) == requestMap.end()) return;
     MegaRequestPrivate* request = requestMap.at(client->restag);
+    if (request && request->getType() == MegaRequest::TYPE_SET_ATTR_NODES)
+    {
+        if (request->addBulkResult(e))
+        {
+            fireOnRequestFinish(request, MegaError(request->getBulkError()));
+        }
+        return;
+    }
+
     if (!request || ((request->getType() != MegaRequest::TYPE_RENAME)
             && request->getType() != MegaRequest::TYPE_SET_ATTR_NODE))
     {
@@ -12860,12 +15190,22 @@ void MegaApiImpl::rename_result(handle h, error e)
     MegaError megaError(e);
     if(requestMap.find(client->restag) == requestMap.end()) return;
     MegaRequestPrivate* request = requestMap.at(client->restag);
-    if(!request || (request->getType() != MegaRequest::TYPE_MOVE)) return;
+    if(!request || (request->getType() != MegaRequest::TYPE_MOVE
+                    && request->getType() != MegaRequest::TYPE_MOVE_NODES)) return;
 
 #ifdef ENABLE_SYNC
     client->syncdownrequired = true;
 #endif
 
+    if (request->getType() == MegaRequest::TYPE_MOVE_NODES)
+    {
+        if (request->addBulkResult(e))
+        {
+            fireOnRequestFinish(request, MegaError(request->getBulkError()));
+        }
+        return;
+    }
+
     request->setNodeHandle(h);
     fireOnRequestFinish(request, megaError);
 }
@@ -12876,7 +15216,8 @@ void MegaApiImpl::unlink_result(handle h, error e)
     if(requestMap.find(client->restag) == requestMap.end()) return;
     MegaRequestPrivate* request = requestMap.at(client->restag);
     if(!request || ((request->getType() != MegaRequest::TYPE_REMOVE) &&
-                    (request->getType() != MegaRequest::TYPE_MOVE)))
+                    (request->getType() != MegaRequest::TYPE_MOVE) &&
+                    (request->getType() != MegaRequest::TYPE_REMOVE_NODES)))
     {
         return;
     }
@@ -12885,6 +15226,15 @@ void MegaApiImpl::unlink_result(handle h, error e)
     client->syncdownrequired = true;
 #endif
 
+    if (request->getType() == MegaRequest::TYPE_REMOVE_NODES)
+    {
+        if (request->addBulkResult(e))
+        {
+            fireOnRequestFinish(request, MegaError(request->getBulkError()));
+        }
+        return;
+    }
+
     if (request->getType() != MegaRequest::TYPE_MOVE)
     {
         request->setNodeHandle(h);
@@ -12909,6 +15259,24 @@ void MegaApiImpl::unlinkversions_result(error e)
     fireOnRequestFinish(request, MegaError(e));
 }
 
+void MegaApiImpl::fetchfolder_result(handle h, error e)
+{
+    if (requestMap.find(client->restag) == requestMap.end()) return;
+    MegaRequestPrivate* request = requestMap.at(client->restag);
+    if (!request || (request->getType() != MegaRequest::TYPE_FETCH_FOLDER)) return;
+
+    fireOnRequestFinish(request, MegaError(e));
+}
+
+void MegaApiImpl::getuas_result(error e)
+{
+    if (requestMap.find(client->restag) == requestMap.end()) return;
+    MegaRequestPrivate* request = requestMap.at(client->restag);
+    if (!request || (request->getType() != MegaRequest::TYPE_GET_ATTR_USERS)) return;
+
+    fireOnRequestFinish(request, MegaError(e));
+}
+
 void MegaApiImpl::fetchnodes_result(error e)
 {    
     MegaError megaError(e);
@@ -13052,6 +15420,60 @@ void MegaApiImpl::fetchnodes_result(error e)
     }
 }
 
+void MegaApiImpl::finishUpload(MegaTransferPrivate* transfer, error e, Node* n, handle h)
+{
+    if(pendingUploads > 0)
+    {
+        pendingUploads--;
+    }
+
+    //scale to get the handle of the new node
+    Node *ntmp;
+    if (n)
+    {
+        handle ph = transfer->getParentHandle();
+        for (ntmp = n; ((ntmp->parent != NULL) && (ntmp->parent->nodehandle != ph) ); ntmp = ntmp->parent);
+        if ((ntmp->parent != NULL) && (ntmp->parent->nodehandle == ph))
+        {
+            h = ntmp->nodehandle;
+        }
+    }
+
+    transfer->setNodeHandle(h);
+    transfer->setTransferredBytes(transfer->getTotalBytes());
+
+    if (!e)
+    {
+        transfer->setState(MegaTransfer::STATE_COMPLETED);
+    }
+    else
+    {
+        transfer->setState(MegaTransfer::STATE_FAILED);
+    }
+
+    MegaError megaError(e);
+    DBTableTransactionCommitter committer(client->tctable);
+    fireOnTransferFinish(transfer, megaError, committer);
+}
+
+void MegaApiImpl::putnodes_upload_result(error e, handle h)
+{
+    MegaTransferPrivate* transfer = getMegaTransferPrivate(client->restag);
+    if (!transfer || transfer->getType() == MegaTransfer::TYPE_DOWNLOAD)
+    {
+        return;
+    }
+
+    Node* n = NULL;
+    if (!e && (n = client->nodebyhandle(h)))
+    {
+        n->applykey();
+        n->setattr();
+    }
+
+    finishUpload(transfer, e, n, h);
+}
+
 void MegaApiImpl::putnodes_result(error e, targettype_t t, NewNode* nn)
 {
     handle h = UNDEF;
@@ -13076,43 +15498,19 @@ void MegaApiImpl::putnodes_result(error e, targettype_t t, NewNode* nn)
     MegaTransferPrivate* transfer = getMegaTransferPrivate(client->restag);
     if (transfer)
     {
-        if (transfer->getType() == MegaTransfer::TYPE_DOWNLOAD)
+        if (transfer->getType() != MegaTransfer::TYPE_DOWNLOAD)
         {
-            return;
-        }
-
-        if(pendingUploads > 0)
-        {
-            pendingUploads--;
-        }
-
-        //scale to get the handle of the new node
-        Node *ntmp;
-        if (n)
-        {
-            handle ph = transfer->getParentHandle();
-            for (ntmp = n; ((ntmp->parent != NULL) && (ntmp->parent->nodehandle != ph) ); ntmp = ntmp->parent);
-            if ((ntmp->parent != NULL) && (ntmp->parent->nodehandle == ph))
-            {
-                h = ntmp->nodehandle;
-            }
-        }
-
-        transfer->setNodeHandle(h);
-        transfer->setTransferredBytes(transfer->getTotalBytes());
-
-        if (!e)
-        {
-            transfer->setState(MegaTransfer::STATE_COMPLETED);
-        }
-        else
-        {
-            transfer->setState(MegaTransfer::STATE_FAILED);
+            finishUpload(transfer, e, n, h);
+            delete [] nn;
         }
+        return;
+    }
 
-        DBTableTransactionCommitter committer(client->tctable);
-        fireOnTransferFinish(transfer, megaError, committer);
-        delete [] nn;
+    int tag = client->restag;
+    if (treeCopies.find(tag) != treeCopies.end())
+    {
+        treeCopyResult(*treeCopies[tag], e, nn);
+        continueTreeCopy(tag);
         return;
     }
 
@@ -13569,6 +15967,14 @@ void MegaApiImpl::copysession_result(string *session, error e)
 
 void MegaApiImpl::clearing()
 {
+    sortedChildrenViews.clear();
+    detachLazyNodeLists();
+
+    // the reload that follows reports every node
+    pendingNodeUpdates.clear();
+    pendingNodeUpdateIndex.clear();
+    resetNodeChangeLog();
+
 #ifdef ENABLE_SYNC
     map<int, MegaSyncPrivate *>::iterator it;
     for (it = syncMap.begin(); it != syncMap.end(); )
@@ -13605,8 +16011,10 @@ void MegaApiImpl::notify_retry(dstime dsdelta, retryreason_t reason)
 
 void MegaApiImpl::notify_dbcommit()
 {
+    // the sequence number of the commit that reached storage: with asynchronous writes,
+    // client->scsn may have moved on while the writer thread completed it
     MegaEventPrivate *event = new MegaEventPrivate(MegaEvent::EVENT_COMMIT_DB);
-    event->setText(client->scsn);
+    event->setText(Base64Str<sizeof(handle)>(client->durablescsn));
     fireOnEvent(event);
 }
 
@@ -14243,17 +16651,176 @@ void MegaApiImpl::nodes_updated(Node** n, int count)
         return;
     }
 
-    MegaNodeList *nodeList = NULL;
-    if (n != NULL)
+    if (n)
+    {
+        nodeGeneration++;
+
+        // the change log and the export list every removed node, including those
+        // whose removal only reached the app through the root of their subtree
+        vector<Node*> removedDescendants;
+        for (int i = 0; i < count; i++)
+        {
+            nodeChangeLog.push_back(NodeChange{ nodeGeneration, n[i]->nodehandle, MegaNodePrivate::changesOf(n[i]) });
+
+            if (n[i]->changed.removedtree)
+            {
+                size_t first = removedDescendants.size();
+                removedDescendants.insert(removedDescendants.end(), n[i]->children.begin(), n[i]->children.end());
+                for (size_t j = first; j < removedDescendants.size(); j++)
+                {
+                    Node *descendant = removedDescendants[j];
+                    removedDescendants.insert(removedDescendants.end(), descendant->children.begin(), descendant->children.end());
+                    nodeChangeLog.push_back(NodeChange{ nodeGeneration, descendant->nodehandle, MegaNodePrivate::changesOf(descendant) });
+                }
+            }
+        }
+
+        // removed nodes are purged right after this notification
+        materializeLazyNodes(n, size_t(count));
+        materializeLazyNodes(removedDescendants.data(), removedDescendants.size());
+
+        // older generations can't be answered anymore
+        while (nodeChangeLog.size() > MAX_NODE_CHANGE_LOG)
+        {
+            nodeChangeLogFloor = std::max(nodeChangeLogFloor, nodeChangeLog.front().generation);
+            nodeChangeLog.pop_front();
+        }
+
+        // a full log is replaced by a new snapshot
+        if (nodeTreeExport && !nodeTreeExport->stale)
+        {
+            for (int i = 0; i < count && !nodeTreeExport->stale; i++)
+            {
+                nodeTreeExport->stale = !nodeTreeExport->append(n[i], MegaNodePrivate::changesOf(n[i]), nodeGeneration);
+            }
+
+            for (size_t i = 0; i < removedDescendants.size() && !nodeTreeExport->stale; i++)
+            {
+                Node *descendant = removedDescendants[i];
+                nodeTreeExport->stale = !nodeTreeExport->append(descendant, MegaNodePrivate::changesOf(descendant), nodeGeneration);
+            }
+        }
+    }
+    else
+    {
+        // every node may have been replaced. The lazy lists stay attached: they look their
+        // nodes up by handle when read, which gives the same data as reading them all now
+        resetNodeChangeLog();
+    }
+
+#ifdef HAVE_LIBUV
+    if (httpServer)
+    {
+        httpServer->onNodesUpdated(n, count);
+    }
+#endif
+
+    if (n == NULL)
+    {
+        // a full reload supersedes whatever is pending
+        pendingNodeUpdates.clear();
+        pendingNodeUpdateIndex.clear();
+
+        if (compactNodeUpdates)
+        {
+            fireOnNodesChanged(NULL);
+        }
+        else
+        {
+            fireOnNodesUpdate(NULL);
+        }
+        return;
+    }
+
+    if (nodeUpdateWindow <= 0)
     {
-        nodeList = new MegaNodeListPrivate(n, count);
-        fireOnNodesUpdate(nodeList);
+        if (compactNodeUpdates)
+        {
+            MegaNodeChangeListPrivate changes(n, count);
+            fireOnNodesChanged(&changes);
+        }
+        else
+        {
+            MegaNodeListPrivate nodeList(n, count);
+            fireOnNodesUpdate(&nodeList);
+        }
+        return;
+    }
+
+    if (pendingNodeUpdates.empty())
+    {
+        pendingNodeUpdatesSince = std::chrono::steady_clock::now();
+    }
+
+    // a node changed again in the window is kept in its latest state, with all its changes
+    for (int i = 0; i < count; i++)
+    {
+        int changes = MegaNodePrivate::changesOf(n[i]);
+        MegaNodePrivate *node = compactNodeUpdates ? NULL : static_cast<MegaNodePrivate *>(MegaNodePrivate::fromNode(n[i]));
+
+        map<MegaHandle, size_t>::iterator it = pendingNodeUpdateIndex.find(n[i]->nodehandle);
+        if (it == pendingNodeUpdateIndex.end())
+        {
+            pendingNodeUpdateIndex[n[i]->nodehandle] = pendingNodeUpdates.size();
+            pendingNodeUpdates.push_back(PendingNodeUpdate{ n[i]->nodehandle, changes, std::unique_ptr<MegaNode>(node) });
+        }
+        else
+        {
+            PendingNodeUpdate& update = pendingNodeUpdates[it->second];
+            update.changes |= changes;
+            if (node)
+            {
+                node->addChanges(update.changes);
+                update.node.reset(node);
+            }
+        }
+    }
+
+    flushNodeUpdates(false);
+}
+
+void MegaApiImpl::flushNodeUpdates(bool force)
+{
+    if (pendingNodeUpdates.empty())
+    {
+        return;
+    }
+
+    if (!force
+            && std::chrono::steady_clock::now() - pendingNodeUpdatesSince < std::chrono::milliseconds(nodeUpdateWindow)
+            && (nodeUpdateMaxNodes <= 0 || pendingNodeUpdates.size() < size_t(nodeUpdateMaxNodes)))
+    {
+        return;
+    }
+
+    // listeners may cause new updates
+    vector<PendingNodeUpdate> updates;
+    updates.swap(pendingNodeUpdates);
+    pendingNodeUpdateIndex.clear();
+
+    LOG_debug << "Delivering " << updates.size() << " coalesced node updates";
+
+    if (compactNodeUpdates)
+    {
+        MegaNodeChangeListPrivate changes;
+        for (size_t i = 0; i < updates.size(); i++)
+        {
+            changes.add(updates[i].handle, updates[i].changes);
+        }
+        fireOnNodesChanged(&changes);
     }
     else
     {
-        fireOnNodesUpdate(NULL);
+        vector<std::unique_ptr<MegaNode>> nodes;
+        nodes.reserve(updates.size());
+        for (size_t i = 0; i < updates.size(); i++)
+        {
+            nodes.push_back(std::move(updates[i].node));
+        }
+
+        MegaNodeListPrivate nodeList(std::move(nodes));
+        fireOnNodesUpdate(&nodeList);
     }
-    delete nodeList;
 }
 
 void MegaApiImpl::account_details(AccountDetails*, bool, bool, bool, bool, bool, bool)
@@ -14684,8 +17251,8 @@ void MegaApiImpl::getua_result(TLVstore *tlv, attr_t type)
                 }
                 else
                 {
-                   handle nodehandle = 0;  // make sure top two bytes are 0
-                   Base64::atob(value, (byte*) &nodehandle, MegaClient::NODEHANDLE);
+                   handle nodehandle;   // the top two bytes are 0
+                   Base64::atohandle(value, &nodehandle, MegaClient::NODEHANDLE);
                    request->setNodeHandle(nodehandle);
                 }
                 break;
@@ -14750,6 +17317,12 @@ void MegaApiImpl::userattr_update(User*, int, const char*)
 {
 }
 
+void MegaApiImpl::nodes_cached()
+{
+    MegaEventPrivate *event = new MegaEventPrivate(MegaEvent::EVENT_NODES_CACHED);
+    fireOnEvent(event);
+}
+
 void MegaApiImpl::nodes_current()
 {
     MegaEventPrivate *event = new MegaEventPrivate(MegaEvent::EVENT_NODES_CURRENT);
@@ -15427,6 +18000,8 @@ void MegaApiImpl::removeListener(MegaListener* listener)
     sdkMutex.lock();
     listeners.erase(listener);
     sdkMutex.unlock();
+
+    waitTransferEvent();
 }
 
 void MegaApiImpl::removeRequestListener(MegaRequestListener* listener)
@@ -15469,6 +18044,18 @@ void MegaApiImpl::removeTransferListener(MegaTransferListener* listener)
 
     transferQueue.removeListener(listener);
     sdkMutex.unlock();
+
+    {
+        std::lock_guard<std::mutex> g(transferEventsMutex);
+        for (auto it = transferEvents.begin(); it != transferEvents.end(); it++)
+        {
+            if (it->transfer->getListener() == listener)
+            {
+                it->transfer->setListener(NULL);
+            }
+        }
+    }
+    waitTransferEvent();
 }
 
 void MegaApiImpl::removeBackupListener(MegaBackupListener* listener)
@@ -15642,6 +18229,23 @@ void MegaApiImpl::fireOnRequestTemporaryError(MegaRequestPrivate *request, MegaE
 
 void MegaApiImpl::fireOnTransferStart(MegaTransferPrivate *transfer)
 {
+    if (asyncTransferEvents)
+    {
+        notificationNumber++;
+        transfer->setNotificationNumber(notificationNumber);
+
+        MegaTransferListener* listener = transfer->getListener();
+        if (listener && isInternalTransferListener(listener))
+        {
+            activeTransfer = transfer;
+            listener->onTransferStart(api, transfer);
+            activeTransfer = NULL;
+        }
+
+        queueTransferEvent(TRANSFER_EVENT_START, transfer);
+        return;
+    }
+
     activeTransfer = transfer;
     notificationNumber++;
     transfer->setNotificationNumber(notificationNumber);
@@ -15684,6 +18288,23 @@ void MegaApiImpl::fireOnTransferFinish(MegaTransferPrivate *transfer, MegaError
         LOG_info << "Transfer (" << transfer->getTransferString() << ") finished. File: " << transfer->getFileName();
     }
 
+    if (asyncTransferEvents)
+    {
+        MegaTransferListener* listener = transfer->getListener();
+        if (listener && isInternalTransferListener(listener))
+        {
+            listener->onTransferFinish(api, transfer, megaError);
+        }
+
+        queueTransferEvent(TRANSFER_EVENT_FINISH, transfer, megaError);
+        transferMap.erase(transfer->getTag());
+        activeTransfer = NULL;
+        activeError = NULL;
+        delete transfer;  // committer needs to be present for this one, db updated
+        delete megaError;
+        return;
+    }
+
     for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
     {
         (*it++)->onTransferFinish(api, transfer, megaError);
@@ -15718,6 +18339,21 @@ void MegaApiImpl::fireOnTransferTemporaryError(MegaTransferPrivate *transfer, Me
 
     transfer->setNumRetry(transfer->getNumRetry() + 1);
 
+    if (asyncTransferEvents)
+    {
+        MegaTransferListener* listener = transfer->getListener();
+        if (listener && isInternalTransferListener(listener))
+        {
+            listener->onTransferTemporaryError(api, transfer, megaError);
+        }
+
+        queueTransferEvent(TRANSFER_EVENT_TEMPORARY_ERROR, transfer, megaError);
+        activeTransfer = NULL;
+        activeError = NULL;
+        delete megaError;
+        return;
+    }
+
     for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
     {
         (*it++)->onTransferTemporaryError(api, transfer, megaError);
@@ -15744,8 +18380,28 @@ MegaClient *MegaApiImpl::getMegaClient()
     return client;
 }
 
-void MegaApiImpl::fireOnTransferUpdate(MegaTransferPrivate *transfer)
+void MegaApiImpl::fireOnTransferUpdate(MegaTransferPrivate *transfer, bool appListeners)
 {
+    if (asyncTransferEvents || !appListeners)
+    {
+        notificationNumber++;
+        transfer->setNotificationNumber(notificationNumber);
+
+        MegaTransferListener* listener = transfer->getListener();
+        if (listener && isInternalTransferListener(listener))
+        {
+            activeTransfer = transfer;
+            listener->onTransferUpdate(api, transfer);
+            activeTransfer = NULL;
+        }
+
+        if (appListeners)
+        {
+            queueTransferEvent(TRANSFER_EVENT_UPDATE, transfer);
+        }
+        return;
+    }
+
     activeTransfer = transfer;
     notificationNumber++;
     transfer->setNotificationNumber(notificationNumber);
@@ -15786,6 +18442,235 @@ bool MegaApiImpl::fireOnTransferData(MegaTransferPrivate *transfer)
     return result;
 }
 
+void MegaApiImpl::enableAsyncTransferCallbacks(bool enable)
+{
+    if (enable == asyncTransferEvents)
+    {
+        return;
+    }
+
+    if (enable)
+    {
+        transferEventsExit = false;
+        transferEventsThread = std::thread([this]() { dispatchTransferEvents(); });
+
+        SdkMutexGuard g(sdkMutex);
+        asyncTransferEvents = true;
+        return;
+    }
+
+    if (std::this_thread::get_id() == transferEventsThread.get_id())
+    {
+        LOG_err << "Transfer callbacks can't be made synchronous from a transfer callback";
+        return;
+    }
+
+    {
+        SdkMutexGuard g(sdkMutex);
+        asyncTransferEvents = false;
+    }
+
+    // deliver the callbacks already queued
+    stopTransferEvents();
+}
+
+bool MegaApiImpl::areAsyncTransferCallbacksEnabled()
+{
+    return asyncTransferEvents;
+}
+
+bool MegaApiImpl::isInternalTransferListener(MegaTransferListener *listener)
+{
+    return dynamic_cast<MegaRecursiveOperation*>(listener)
+            || dynamic_cast<MegaBackupController*>(listener)
+#ifdef HAVE_LIBUV
+            || dynamic_cast<MegaTCPContext*>(listener)
+#endif
+            ;
+}
+
+void MegaApiImpl::queueTransferEvent(int type, MegaTransferPrivate *transfer, MegaError *e)
+{
+    // the listener of the transfer is only read here: an internal one may be gone when dispatched
+    MegaTransferListener *listener = transfer->getListener();
+    if (listener && isInternalTransferListener(listener))
+    {
+        listener = NULL;
+    }
+
+    std::unique_lock<std::mutex> lock(transferEventsMutex);
+
+    if (type == TRANSFER_EVENT_UPDATE)
+    {
+        auto it = transferEventUpdates.find(transfer->getTag());
+        if (it != transferEventUpdates.end())
+        {
+            // latest state wins
+            it->second->transfer.reset(static_cast<MegaTransferPrivate*>(transfer->copy()));
+            return;
+        }
+    }
+    else
+    {
+        // the updates after this one go after it
+        transferEventUpdates.erase(transfer->getTag());
+    }
+
+    transferEvents.emplace_back();
+    TransferEvent& event = transferEvents.back();
+    event.type = type;
+    event.listener = listener;
+    event.transfer.reset(static_cast<MegaTransferPrivate*>(transfer->copy()));
+    if (e)
+    {
+        event.error.reset(e->copy());
+    }
+
+    if (type == TRANSFER_EVENT_UPDATE)
+    {
+        transferEventUpdates[transfer->getTag()] = &event;
+    }
+
+    lock.unlock();
+    transferEventsChanged.notify_all();
+}
+
+void MegaApiImpl::dispatchTransferEvents()
+{
+    for (;;)
+    {
+        TransferEvent event;
+
+        {
+            std::unique_lock<std::mutex> lock(transferEventsMutex);
+            transferEventDispatching = false;
+            transferEventsChanged.notify_all();
+
+            transferEventsChanged.wait(lock, [this]() { return transferEventsExit || !transferEvents.empty(); });
+            if (transferEvents.empty())
+            {
+                return;
+            }
+
+            auto it = transferEventUpdates.find(transferEvents.front().transfer->getTag());
+            if (it != transferEventUpdates.end() && it->second == &transferEvents.front())
+            {
+                transferEventUpdates.erase(it);
+            }
+
+            event = std::move(transferEvents.front());
+            transferEvents.pop_front();
+
+            transferEventDispatching = true;
+        }
+
+        // the listeners registered now (removing one waits for the callback in progress)
+        vector<MegaTransferListener*> transferListenersNow;
+        vector<MegaListener*> listenersNow;
+        {
+            SdkMutexGuard g(sdkMutex);
+            transferListenersNow.assign(transferListeners.begin(), transferListeners.end());
+            listenersNow.assign(listeners.begin(), listeners.end());
+        }
+
+        MegaTransferPrivate *transfer = event.transfer.get();
+        MegaError *e = event.error.get();
+        MegaTransferListener* listener = event.listener;
+
+        switch (event.type)
+        {
+            case TRANSFER_EVENT_START:
+                for (auto it = transferListenersNow.begin(); it != transferListenersNow.end(); it++)
+                {
+                    (*it)->onTransferStart(api, transfer);
+                }
+                for (auto it = listenersNow.begin(); it != listenersNow.end(); it++)
+                {
+                    (*it)->onTransferStart(api, transfer);
+                }
+                if (listener)
+                {
+                    listener->onTransferStart(api, transfer);
+                }
+                break;
+
+            case TRANSFER_EVENT_UPDATE:
+                for (auto it = transferListenersNow.begin(); it != transferListenersNow.end(); it++)
+                {
+                    (*it)->onTransferUpdate(api, transfer);
+                }
+                for (auto it = listenersNow.begin(); it != listenersNow.end(); it++)
+                {
+                    (*it)->onTransferUpdate(api, transfer);
+                }
+                if (listener)
+                {
+                    listener->onTransferUpdate(api, transfer);
+                }
+                break;
+
+            case TRANSFER_EVENT_TEMPORARY_ERROR:
+                for (auto it = transferListenersNow.begin(); it != transferListenersNow.end(); it++)
+                {
+                    (*it)->onTransferTemporaryError(api, transfer, e);
+                }
+                for (auto it = listenersNow.begin(); it != listenersNow.end(); it++)
+                {
+                    (*it)->onTransferTemporaryError(api, transfer, e);
+                }
+                if (listener)
+                {
+                    listener->onTransferTemporaryError(api, transfer, e);
+                }
+                break;
+
+            case TRANSFER_EVENT_FINISH:
+                for (auto it = transferListenersNow.begin(); it != transferListenersNow.end(); it++)
+                {
+                    (*it)->onTransferFinish(api, transfer, e);
+                }
+                for (auto it = listenersNow.begin(); it != listenersNow.end(); it++)
+                {
+                    (*it)->onTransferFinish(api, transfer, e);
+                }
+                if (listener)
+                {
+                    listener->onTransferFinish(api, transfer, e);
+                }
+                break;
+        }
+    }
+}
+
+void MegaApiImpl::stopTransferEvents()
+{
+    if (!transferEventsThread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(transferEventsMutex);
+        transferEventsExit = true;
+    }
+    transferEventsChanged.notify_all();
+    transferEventsThread.join();
+}
+
+void MegaApiImpl::waitTransferEvent()
+{
+    // from the SDK thread, the dispatcher could be waiting for sdkMutex
+    if (!transferEventsThread.joinable()
+            || std::this_thread::get_id() == transferEventsThread.get_id()
+            || std::this_thread::get_id() == sdkThreadId)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(transferEventsMutex);
+    transferEventsChanged.wait(lock, [this]() { return !transferEventDispatching; });
+}
+
 void MegaApiImpl::fireOnUsersUpdate(MegaUserList *users)
 {
     activeUsers = users;
@@ -15850,6 +18735,18 @@ void MegaApiImpl::fireOnNodesUpdate(MegaNodeList *nodes)
     activeNodes = NULL;
 }
 
+void MegaApiImpl::fireOnNodesChanged(MegaNodeChangeList *changes)
+{
+    for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
+    {
+        (*it++)->onNodesChanged(api, changes);
+    }
+    for(set<MegaListener *>::iterator it = listeners.begin(); it != listeners.end() ;)
+    {
+        (*it++)->onNodesChanged(api, changes);
+    }
+}
+
 void MegaApiImpl::fireOnAccountUpdate()
 {
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
@@ -16126,10 +19023,16 @@ void MegaApiImpl::processTransferUpdate(Transfer *tr, MegaTransferPrivate *trans
         transfer->setMeanSpeed(0);
     }
 
+    // with polled progress, only changes of state and priority are notified to the app:
+    // the internal listeners, like the folder transfers adding up deltaSize, get them all
+    bool notify = transferUpdateCallbacks
+            || transfer->getState() != tr->state
+            || transfer->getPriority() != tr->priority;
+
     transfer->setState(tr->state);
     transfer->setPriority(tr->priority);
     transfer->setUpdateTime(currentTime);
-    fireOnTransferUpdate(transfer);
+    fireOnTransferUpdate(transfer, notify);
 }
 
 void MegaApiImpl::processTransferComplete(Transfer *tr, MegaTransferPrivate *transfer)
@@ -16153,6 +19056,26 @@ void MegaApiImpl::processTransferComplete(Transfer *tr, MegaTransferPrivate *tra
             pendingDownloads--;
         }
 
+        if (transfer->getUncompressedFingerprint().size >= 0 && transfer->getPath())
+        {
+            // the node was uploaded compressed: finished once the file is restored
+            string path = transfer->getPath();
+            string suffix = ".megaz";
+            std::shared_ptr<DecompressJob> job = std::make_shared<DecompressJob>();
+            job->fsaccess = client->fsaccess;
+            client->fsaccess->path2local(&path, &job->localpath);
+            client->fsaccess->path2local(&suffix, &job->tmppath);
+            job->tmppath.insert(0, job->localpath);
+            job->original = transfer->getUncompressedFingerprint();
+
+            transfer->setTransfer(NULL);
+            transfer->setState(MegaTransfer::STATE_COMPLETING);
+            fireOnTransferUpdate(transfer);
+            decompressions.push_back(std::make_pair(transfer, job));
+            getScanWorkers()->submit(job);
+            return;
+        }
+
         transfer->setState(MegaTransfer::STATE_COMPLETED);
         DBTableTransactionCommitter committer(client->tctable);
         fireOnTransferFinish(transfer, MegaError(API_OK), committer);
@@ -16424,6 +19347,17 @@ void MegaApiImpl::sortByComparatorFunction(node_vector& v, int order, MegaClient
 {
     if (auto f = getComparatorFunction(order, mc))
     {
+        // these orders compare mtimes, not kept in the skeleton of lazy nodes
+        if (order == MegaApi::ORDER_MODIFICATION_ASC || order == MegaApi::ORDER_MODIFICATION_DESC
+                || order == MegaApi::ORDER_PHOTO_ASC || order == MegaApi::ORDER_PHOTO_DESC
+                || order == MegaApi::ORDER_VIDEO_ASC || order == MegaApi::ORDER_VIDEO_DESC)
+        {
+            for (Node* n : v)
+            {
+                n->materialize();
+            }
+        }
+
         std::sort(v.begin(), v.end(), f);
     }
 }
@@ -16712,7 +19646,7 @@ int MegaApiImpl::getNumChildren(MegaNode* p)
         return 0;
     }
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
@@ -16733,7 +19667,7 @@ int MegaApiImpl::getNumChildFiles(MegaNode* p)
         return 0;
     }
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
@@ -16759,7 +19693,7 @@ int MegaApiImpl::getNumChildFolders(MegaNode* p)
         return 0;
     }
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
@@ -16779,49 +19713,118 @@ int MegaApiImpl::getNumChildFolders(MegaNode* p)
 }
 
 
+const node_vector& MegaApiImpl::getSortedChildren(Node *parent, int order)
+{
+    for (std::deque<SortedChildren>::iterator it = sortedChildrenViews.begin(); it != sortedChildrenViews.end(); it++)
+    {
+        if (it->parent == parent->nodehandle && it->order == order)
+        {
+            if (it->generation == parent->childrengeneration)
+            {
+                if (it != sortedChildrenViews.begin())
+                {
+                    // keep the most recently used views at the front
+                    std::rotate(sortedChildrenViews.begin(), it, it + 1);
+                }
+                return sortedChildrenViews.front().nodes;
+            }
+
+            sortedChildrenViews.erase(it);
+            break;
+        }
+    }
+
+    if (sortedChildrenViews.size() >= MAX_SORTED_CHILDREN_VIEWS)
+    {
+        sortedChildrenViews.pop_back();
+    }
+
+    sortedChildrenViews.emplace_front();
+    SortedChildren& view = sortedChildrenViews.front();
+    view.parent = parent->nodehandle;
+    view.order = order;
+    view.generation = parent->childrengeneration;
+    view.nodes.assign(parent->children.begin(), parent->children.end());
+
+    // the names and mtimes of all the children are compared
+    client->loadlazychildren(parent);
+    sortByComparatorFunction(view.nodes, order, *client);
+    return view.nodes;
+}
+
 MegaNodeList *MegaApiImpl::getChildren(MegaNode* p, int order)
 {
-    if (!p || p->getType() == MegaNode::TYPE_FILE)
+    return getChildren(p, order, 0, -1);
+}
+
+MegaNodeList *MegaApiImpl::getChildren(MegaNode *p, int order, int offset, int limit)
+{
+    if (!p || p->getType() == MegaNode::TYPE_FILE || offset < 0)
     {
         return new MegaNodeListPrivate();
     }
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
+    SdkMutexGuard g(sdkMutex, std::adopt_lock);
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
-        sdkMutex.unlock();
         return new MegaNodeListPrivate();
     }
 
-    node_vector childrenNodes;
-
-    if (std::function<bool(Node*, Node*)> comparatorFunction = getComparatorFunction(order, *client))
+    node_vector unsortedNodes;
+    const node_vector *childrenNodes = &unsortedNodes;
+    if (getComparatorFunction(order, *client))
     {
-        for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
-        {
-            Node *n = *it++;
-            const node_vector::iterator i = std::lower_bound(childrenNodes.begin(), childrenNodes.end(), n, comparatorFunction);
-            childrenNodes.insert(i, n);
-        }
+        childrenNodes = &getSortedChildren(parent, order);
     }
     else
     {
-        for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
-            childrenNodes.push_back(*it++);
+        unsortedNodes.assign(parent->children.begin(), parent->children.end());
     }
 
-    MegaNodeListPrivate *result = NULL;
-    if (childrenNodes.size())
+    size_t first = std::min<size_t>(size_t(offset), childrenNodes->size());
+    size_t count = childrenNodes->size() - first;
+    if (limit >= 0 && size_t(limit) < count)
     {
-        result = new MegaNodeListPrivate(childrenNodes.data(), int(childrenNodes.size()));
+        count = size_t(limit);
     }
-    else
+
+    if (!count)
     {
-        result = new MegaNodeListPrivate();
+        return new MegaNodeListPrivate();
+    }
+
+    // MegaNodePrivate objects are only created for the entries the app actually reads
+    return new MegaNodeListLazy(this, const_cast<Node**>(childrenNodes->data()) + first, int(count));
+}
+
+void MegaApiImpl::detachLazyNodeLists()
+{
+    for (LazyNodeEntries *nodeList : lazyNodeLists)
+    {
+        nodeList->detach();
+    }
+    lazyNodeLists.clear();
+    lazyNodeEntries.clear();
+}
+
+void MegaApiImpl::materializeLazyNodes(Node* const* nodes, size_t count)
+{
+    if (lazyNodeEntries.empty())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto range = lazyNodeEntries.equal_range(nodes[i]->nodehandle);
+        for (auto it = range.first; it != range.second; it++)
+        {
+            it->second.first->loadEntry(it->second.second);
+        }
+        lazyNodeEntries.erase(range.first, range.second);
     }
-    sdkMutex.unlock();
-    return result;
 }
 
 MegaNodeList *MegaApiImpl::getVersions(MegaNode *node)
@@ -16934,20 +19937,18 @@ MegaChildrenLists *MegaApiImpl::getFileFolderChildren(MegaNode *p, int order)
     node_vector files;
     node_vector folders;
 
-    if (std::function<bool(Node*, Node*)> comparatorFunction = getComparatorFunction(order, *client))
+    if (getComparatorFunction(order, *client))
     {
-        for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
+        const node_vector& sortedNodes = getSortedChildren(parent, order);
+        for (node_vector::const_iterator it = sortedNodes.begin(); it != sortedNodes.end(); it++)
         {
-            Node *n = *it++;
-            if (n->type == FILENODE)
+            if ((*it)->type == FILENODE)
             {
-                const node_vector::iterator i = std::lower_bound(files.begin(), files.end(), n, comparatorFunction);
-                files.insert(i, n);
+                files.push_back(*it);
             }
-            else // if (n->type == FOLDERNODE)
+            else // if ((*it)->type == FOLDERNODE)
             {
-                const node_vector::iterator i = std::lower_bound(folders.begin(), folders.end(), n, comparatorFunction);
-                folders.insert(i, n);
+                folders.push_back(*it);
             }
         }
     }
@@ -17034,15 +20035,8 @@ int MegaApiImpl::getIndex(MegaNode *n, int order)
 
     if (std::function<bool(Node*, Node*)> comparatorFunction = getComparatorFunction(order, *client))
     {
-        node_vector childrenNodes;
-        for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
-        {
-            Node *temp = *it++;
-            const node_vector::iterator i = std::lower_bound(childrenNodes.begin(), childrenNodes.end(), temp, comparatorFunction);
-            childrenNodes.insert(i, temp);
-        }
-
-        const node_vector::iterator i = std::lower_bound(childrenNodes.begin(), childrenNodes.end(), node, comparatorFunction);
+        const node_vector& childrenNodes = getSortedChildren(parent, order);
+        const node_vector::const_iterator i = std::lower_bound(childrenNodes.begin(), childrenNodes.end(), node, comparatorFunction);
 
         return int(i - childrenNodes.begin());
     }
@@ -17059,7 +20053,7 @@ MegaNode *MegaApiImpl::getChildNode(MegaNode *parent, const char* name)
         return NULL;
     }
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     Node *parentNode = client->nodebyhandle(parent->getHandle());
     if (!parentNode || parentNode->type == FILENODE)
     {
@@ -17215,7 +20209,7 @@ MegaNode* MegaApiImpl::getParentNode(MegaNode* n)
 {
     if(!n) return NULL;
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     Node *node = client->nodebyhandle(n->getHandle());
     if(!node)
     {
@@ -17251,7 +20245,7 @@ MegaNode* MegaApiImpl::getNodeByPath(const char *path, MegaNode* node)
 {
     if(!path) return NULL;
 
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     Node *cwd = NULL;
     if(node) cwd = client->nodebyhandle(node->getHandle());
 
@@ -17459,7 +20453,7 @@ MegaNode* MegaApiImpl::getNodeByPath(const char *path, MegaNode* node)
 MegaNode* MegaApiImpl::getNodeByHandle(handle handle)
 {
     if(handle == UNDEF) return NULL;
-    sdkMutex.lock();
+    lockSdkMutexForReading();
     MegaNode *result = MegaNodePrivate::fromNode(client->nodebyhandle(handle));
     sdkMutex.unlock();
     return result;
@@ -17478,6 +20472,677 @@ MegaContactRequest *MegaApiImpl::getContactRequestByHandle(MegaHandle handle)
     return request;
 }
 
+CryptoWorkers *MegaApiImpl::getScanWorkers()
+{
+    if (!scanWorkers)
+    {
+        scanWorkers.reset(new CryptoWorkers(SCAN_THREADS, waiter));
+    }
+    return scanWorkers.get();
+}
+
+void MegaApiImpl::updateFolderUploads()
+{
+    SdkMutexGuard g(sdkMutex);
+
+    // a controller may finish, and be deleted, while its scans are handed over
+    std::set<MegaFolderUploadController *> controllers = folderUploads;
+    for (std::set<MegaFolderUploadController *>::iterator it = controllers.begin(); it != controllers.end(); it++)
+    {
+        if (folderUploads.find(*it) != folderUploads.end())
+        {
+            (*it)->checkScans();
+        }
+    }
+}
+
+void MegaApiImpl::ContentCheckJob::run()
+{
+    auto fa = fsaccess->newfileaccess();
+    if (!fa->fopen(&localpath, true, false) || fa->size != size)
+    {
+        return;
+    }
+
+    SymmCipher key;
+    key.setkey((const byte*)nodekey.data(), FILENODE);
+    int64_t ctriv = MemAccess::get<int64_t>(nodekey.data() + SymmCipher::KEYLENGTH);
+    int64_t metamac = MemAccess::get<int64_t>(nodekey.data() + SymmCipher::KEYLENGTH + sizeof(int64_t));
+
+    chunkmac_map macs;
+    string buffer;
+    string urlsuffix;
+    for (m_off_t pos = 0; pos < size; )
+    {
+        // whole chunks, as the MACs are by chunk
+        m_off_t npos = ChunkedHash::chunkceil(pos, size);
+        while (npos < size && npos - pos < READSIZE)
+        {
+            npos = ChunkedHash::chunkceil(npos, size);
+        }
+
+        unsigned len = unsigned(npos - pos);
+        buffer.assign(len + SymmCipher::BLOCKSIZE, '\0');
+        if (!fa->frawread((byte*)buffer.data(), len, pos, true))
+        {
+            return;
+        }
+
+        EncryptBufferByChunks eb((byte*)buffer.data(), &key, &macs, ctriv);
+        if (!eb.encrypt(pos, npos, urlsuffix))
+        {
+            return;
+        }
+        pos = npos;
+    }
+
+    same = macs.macsmac(&key) == metamac;
+}
+
+void MegaApiImpl::updateContentChecks()
+{
+    SdkMutexGuard g(sdkMutex);
+
+    for (auto it = contentChecks.begin(); it != contentChecks.end(); )
+    {
+        if (!it->second->finished())
+        {
+            it++;
+            continue;
+        }
+
+        MegaTransferPrivate *transfer = it->first;
+        std::shared_ptr<ContentCheckJob> job = it->second;
+        it = contentChecks.erase(it);
+
+        // the previous version must still be the one the file was compared with
+        Node *parent = client->nodebyhandle(transfer->getParentHandle());
+        Node *previousNode = parent ? client->childnodebyname(parent, transfer->getFileName(), true) : NULL;
+        const FileFingerprint *fp = transfer->getLocalFingerprint();
+        if (!job->same || !previousNode || previousNode->type != FILENODE || previousNode->nodekey != job->nodekey || !fp)
+        {
+            transferQueue.push(transfer);
+            continue;
+        }
+
+        LOG_debug << "Same content as the previous version, not uploaded again: " << transfer->getPath();
+
+        int nextTag = client->nextreqtag();
+        pendingUploads++;
+        transfer->setState(MegaTransfer::STATE_QUEUED);
+        transferMap[nextTag] = transfer;
+        transfer->setTag(nextTag);
+        transfer->setTotalBytes(previousNode->size);
+        transfer->setStartTime(Waiter::ds);
+        transfer->setUpdateTime(Waiter::ds);
+        fireOnTransferStart(transfer);
+
+        // a new version with the key of the previous one, and the new modification time
+        TreeProcCopy tc;
+        client->proctree(previousNode, &tc, false, true);
+        tc.allocnodes();
+        client->proctree(previousNode, &tc, false, true);
+        tc.nn->parenthandle = UNDEF;
+
+        SymmCipher key;
+        AttrMap attrs;
+        string attrstring;
+        key.setkey((const byte*)tc.nn[0].nodekey.data(), previousNode->type);
+        attrs = previousNode->attrs;
+        string sname = transfer->getFileName();
+        fsAccess->normalize(&sname);
+        attrs.map['n'] = sname;
+        fp->serializefingerprint(&attrs.map['c']);
+        attrs.getjson(&attrstring);
+        client->makeattr(&key, tc.nn[0].attrstring, attrstring.c_str());
+        if (!client->versions_disabled)
+        {
+            tc.nn->ovhandle = previousNode->nodehandle;
+        }
+        client->putnodes(parent->nodehandle, tc.nn, tc.nc);
+
+        deduplicatedBytes += previousNode->size;
+
+        transfer->setDeltaSize(previousNode->size);
+        transfer->setSpeed(0);
+        transfer->setMeanSpeed(0);
+        transfer->setState(MegaTransfer::STATE_COMPLETING);
+        fireOnTransferUpdate(transfer);
+    }
+}
+
+void MegaApiImpl::CompressJob::run()
+{
+#ifdef USE_ZLIB
+    auto in = fsaccess->newfileaccess();
+    auto out = fsaccess->newfileaccess();
+    if (!in->fopen(&localpath, true, false))
+    {
+        return;
+    }
+
+    if (!out->fopen(&tmppath, false, true))
+    {
+        fsaccess->unlinklocal(&tmppath);
+        return;
+    }
+
+    if (!original.genfingerprint(in.get()))
+    {
+        out.reset();
+        fsaccess->unlinklocal(&tmppath);
+        return;
+    }
+
+    m_off_t size = original.size;
+    ZlibDeflater deflater;
+    string inbuf;
+    string outbuf;
+    m_off_t inpos = 0;
+    m_off_t outpos = 0;
+    bool failed = false;
+
+    do
+    {
+        unsigned len = unsigned(std::min<m_off_t>(FRAMESIZE, size - inpos));
+        inbuf.resize(len);
+        if ((len && !in->frawread((byte *)inbuf.data(), len, inpos, true))
+                || !deflater.deflate((const byte *)inbuf.data(), len, inpos + len == size, &outbuf)
+                || (outbuf.size() && !out->fwrite((const byte *)outbuf.data(), unsigned(outbuf.size()), outpos)))
+        {
+            failed = true;
+            break;
+        }
+        inpos += len;
+        outpos += outbuf.size();
+
+        // not worth it if the data doesn't shrink by a tenth, judging from the first frame too
+        if ((inpos == len || inpos == size) && outpos * 10 > inpos * 9)
+        {
+            LOG_debug << "Upload not compressed, ratio " << outpos << "/" << inpos;
+            failed = true;
+        }
+    } while (!failed && inpos < size);
+
+    in.reset();
+    out.reset();
+
+    if (!failed)
+    {
+        auto fa = fsaccess->newfileaccess();
+        if (fa->fopen(&tmppath, true, false))
+        {
+            fingerprint.genfingerprint(fa.get());
+            fingerprint.mtime = original.mtime;
+            compressed = fingerprint.isvalid;
+        }
+    }
+
+    if (!compressed)
+    {
+        fsaccess->unlinklocal(&tmppath);
+    }
+#endif
+}
+
+void MegaApiImpl::DecompressJob::run()
+{
+#ifdef USE_ZLIB
+    auto in = fsaccess->newfileaccess();
+    auto out = fsaccess->newfileaccess();
+    if (!in->fopen(&localpath, true, false))
+    {
+        return;
+    }
+
+    if (!out->fopen(&tmppath, false, true))
+    {
+        fsaccess->unlinklocal(&tmppath);
+        return;
+    }
+
+    m_time_t mtime = in->mtime;
+    ZlibInflater inflater;
+    string inbuf;
+    string outbuf;
+    m_off_t inpos = 0;
+    m_off_t outpos = 0;
+    bool failed = false;
+
+    while (inpos < in->size)
+    {
+        unsigned len = unsigned(std::min<m_off_t>(CompressJob::FRAMESIZE, in->size - inpos));
+        inbuf.resize(len);
+        if (!in->frawread((byte *)inbuf.data(), len, inpos, true)
+                || !inflater.inflate((const byte *)inbuf.data(), len, &outbuf)
+                || (outbuf.size() && !out->fwrite((const byte *)outbuf.data(), unsigned(outbuf.size()), outpos)))
+        {
+            failed = true;
+            break;
+        }
+        inpos += len;
+        outpos += outbuf.size();
+    }
+
+    in.reset();
+    out.reset();
+
+    if (failed || outpos != original.size)
+    {
+        LOG_err << "Unable to decompress the download, " << outpos << " of " << original.size << " bytes";
+        fsaccess->unlinklocal(&tmppath);
+        return;
+    }
+
+    // the content must be the one that was compressed, whatever its modification time
+    if (original.isvalid)
+    {
+        FileFingerprint fp;
+        auto fa = fsaccess->newfileaccess();
+        if (!fa->fopen(&tmppath, true, false) || !fp.genfingerprint(fa.get())
+                || memcmp(fp.crc, original.crc, sizeof fp.crc))
+        {
+            LOG_err << "The decompressed download doesn't match its fingerprint";
+            fa.reset();
+            fsaccess->unlinklocal(&tmppath);
+            return;
+        }
+    }
+
+    decompressed = fsaccess->renamelocal(&tmppath, &localpath, true);
+    if (decompressed)
+    {
+        fsaccess->setmtimelocal(&localpath, mtime);
+    }
+    else
+    {
+        fsaccess->unlinklocal(&tmppath);
+    }
+#endif
+}
+
+void MegaApiImpl::discardCompressedUpload(MegaTransferPrivate *transfer)
+{
+    string localpath = transfer->getCompressedLocalPath();
+    if (localpath.size())
+    {
+        client->fsaccess->unlinklocal(&localpath);
+        transfer->setCompressedLocalPath(string());
+    }
+}
+
+void MegaApiImpl::updateCompressions()
+{
+    SdkMutexGuard g(sdkMutex);
+
+    for (auto it = compressions.begin(); it != compressions.end(); )
+    {
+        if (!it->second->finished())
+        {
+            it++;
+            continue;
+        }
+
+        MegaTransferPrivate *transfer = it->first;
+        std::shared_ptr<CompressJob> job = it->second;
+        it = compressions.erase(it);
+
+        if (job->compressed)
+        {
+            transfer->setCompressedLocalPath(job->tmppath);
+            transfer->setUncompressedFingerprint(job->original);
+            transfer->setLocalFingerprint(job->fingerprint);
+        }
+        transferQueue.push(transfer);
+    }
+
+    for (auto it = decompressions.begin(); it != decompressions.end(); )
+    {
+        if (!it->second->finished())
+        {
+            it++;
+            continue;
+        }
+
+        MegaTransferPrivate *transfer = it->first;
+        bool decompressed = it->second->decompressed;
+        it = decompressions.erase(it);
+
+        transfer->setState(decompressed ? MegaTransfer::STATE_COMPLETED : MegaTransfer::STATE_FAILED);
+        DBTableTransactionCommitter committer(client->tctable);
+        fireOnTransferFinish(transfer, MegaError(decompressed ? API_OK : API_EWRITE), committer);
+    }
+}
+
+void MegaApiImpl::TreeCopyBatch::run()
+{
+    for (unsigned part = 0; part < parts; part++)
+    {
+        run(part);
+    }
+}
+
+void MegaApiImpl::TreeCopyBatch::run(unsigned part)
+{
+    unsigned end = unsigned(uint64_t(nc) * (part + 1) / parts);
+    string attrstring;
+
+    for (unsigned i = unsigned(uint64_t(nc) * part / parts); i < end; i++)
+    {
+        if (nn[i].nodekey.size())
+        {
+            SymmCipher key;
+            key.setkey((const byte*)nn[i].nodekey.data(), nn[i].type);
+            attrs[i].getjson(&attrstring);
+            client->makeattr(&key, nn[i].attrstring, attrstring.c_str());
+        }
+        attrs[i] = AttrMap();
+    }
+}
+
+MegaApiImpl::TreeCopyBatch::~TreeCopyBatch()
+{
+    if (!put)
+    {
+        delete [] nn;
+    }
+}
+
+void MegaApiImpl::startTreeCopy(MegaRequestPrivate *request, Node *node, handle target, const string *newname, long long total)
+{
+    TreeCopy *copy = new TreeCopy;
+    copy->request = request;
+    copy->total = total;
+    if (newname)
+    {
+        copy->newname = *newname;
+    }
+
+    TreeCopy::Folder folder;
+    folder.copy = target;
+    folder.children.push_back(node->nodehandle);
+    copy->folders.push_back(folder);
+
+    treeCopies[request->getTag()].reset(copy);
+
+    LOG_debug << "Copying " << total << " nodes in batches of up to " << MegaClient::MAX_NEWNODES;
+    request->setTotalBytes(total);
+    request->setTransferredBytes(0);
+    continueTreeCopy(request->getTag());
+}
+
+// a node with the versions that travel with it, if it's a file
+static size_t withVersions(const Node *n)
+{
+    size_t count = 1;
+    if (n->type == FILENODE)
+    {
+        for (const Node *version : n->children)
+        {
+            count += withVersions(version);
+        }
+    }
+    return count;
+}
+
+void MegaApiImpl::nextTreeCopyBatch(TreeCopy &copy)
+{
+    TreeCopy::Folder &folder = copy.folders.front();
+    handle target = folder.copy;
+    size_t budget = MegaClient::MAX_NEWNODES;
+
+    // parents before their children, with the handle of the parent in the batch
+    // (UNDEF: the target folder)
+    vector<Node*> nodes;
+    vector<handle> parents;
+    vector<std::pair<handle, unsigned> > deferred;
+
+    // nodes in the batch once the versions of its files are added
+    size_t count = 0;
+
+    while (folder.next < folder.children.size())
+    {
+        Node *n = client->nodebyhandle(folder.children[folder.next]);
+        size_t weight = n ? withVersions(n) : 0;
+
+        // the first node always goes: a file can't be split from its versions
+        if (count && count + weight > budget)
+        {
+            break;
+        }
+
+        folder.next++;
+        if (n)
+        {
+            nodes.push_back(n);
+            parents.push_back(UNDEF);
+            count += weight;
+        }
+    }
+
+    if (folder.next == folder.children.size())
+    {
+        copy.folders.pop_front();
+    }
+
+    // the children of a folder go along with it if they all fit in the batch,
+    // the versions of a file always do
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        Node *n = nodes[i];
+        if (n->children.empty())
+        {
+            continue;
+        }
+
+        // versions are counted with their file already
+        if (n->type != FILENODE)
+        {
+            size_t weight = 0;
+            for (Node *child : n->children)
+            {
+                weight += withVersions(child);
+            }
+
+            if (count + weight > budget)
+            {
+                deferred.push_back(std::make_pair(n->nodehandle, unsigned(i)));
+                continue;
+            }
+            count += weight;
+        }
+
+        for (Node *child : n->children)
+        {
+            nodes.push_back(child);
+            parents.push_back(n->nodehandle);
+        }
+    }
+
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    std::shared_ptr<TreeCopyBatch> batch = std::make_shared<TreeCopyBatch>();
+    batch->client = client;
+    batch->target = target;
+    batch->first = !copy.batches++;
+    batch->nc = unsigned(nodes.size());
+    batch->nn = new NewNode[batch->nc];
+    batch->attrs.resize(batch->nc);
+    batch->deferred.swap(deferred);
+
+    nameid rrname = AttrMap::string2nameid("rr");
+    for (unsigned i = 0; i < batch->nc; i++)
+    {
+        Node *n = nodes[i];
+        NewNode *t = batch->nn + i;
+
+        t->source = NEW_NODE;
+        t->type = n->type;
+        t->nodehandle = n->nodehandle;
+        t->parenthandle = parents[i];
+
+        // the key of a file is kept, folders get a new one
+        if (n->type == FILENODE)
+        {
+            t->nodekey = n->nodekey;
+        }
+        else
+        {
+            byte buf[FOLDERNODEKEYLENGTH];
+            client->rng.genblock(buf, sizeof buf);
+            t->nodekey.assign((char*)buf, FOLDERNODEKEYLENGTH);
+        }
+
+        t->attrstring = new string;
+        batch->attrs[i] = n->attrs;
+        batch->attrs[i].map.erase(rrname);
+    }
+
+    if (batch->first && copy.newname.size())
+    {
+        batch->attrs[0].map['n'] = copy.newname;
+    }
+
+    CryptoWorkers *workers = getScanWorkers();
+    batch->parts = std::min(workers->size(), batch->nc / 256 + 1);
+    workers->submit(batch, batch->parts);
+    copy.encrypting.push_back(batch);
+}
+
+void MegaApiImpl::continueTreeCopy(int tag)
+{
+    auto it = treeCopies.find(tag);
+    if (it == treeCopies.end())
+    {
+        return;
+    }
+
+    TreeCopy &copy = *it->second;
+
+    // batches are put in the order they were made, while the previous ones are in flight
+    while (copy.encrypting.size() && copy.encrypting.front()->finished())
+    {
+        std::shared_ptr<TreeCopyBatch> batch = copy.encrypting.front();
+        copy.encrypting.pop_front();
+
+        if (copy.e)
+        {
+            continue;
+        }
+
+        int creqtag = client->reqtag;
+        client->reqtag = tag;
+        client->putnodes(batch->target, batch->nn, int(batch->nc));
+        client->reqtag = creqtag;
+
+        batch->put = true;
+        copy.putting.push_back(batch);
+    }
+
+    while (!copy.e && copy.folders.size() && copy.encrypting.size() + copy.putting.size() < TREE_COPY_INFLIGHT)
+    {
+        nextTreeCopyBatch(copy);
+    }
+
+    if (copy.encrypting.empty() && copy.putting.empty() && (copy.e || copy.folders.empty()))
+    {
+        std::unique_ptr<TreeCopy> done = std::move(it->second);
+        treeCopies.erase(it);
+
+#ifdef ENABLE_SYNC
+        client->syncdownrequired = true;
+#endif
+
+        LOG_debug << "Tree copy finished: " << done->copied << " of " << done->total << " nodes copied";
+        done->request->setNodeHandle(done->root);
+        fireOnRequestFinish(done->request, MegaError(done->e));
+    }
+}
+
+void MegaApiImpl::treeCopyResult(TreeCopy &copy, error e, NewNode *nn)
+{
+    std::shared_ptr<TreeCopyBatch> batch;
+    for (auto it = copy.putting.begin(); it != copy.putting.end(); it++)
+    {
+        if ((*it)->nn == nn)
+        {
+            batch = *it;
+            copy.putting.erase(it);
+            break;
+        }
+    }
+
+    if (!batch)
+    {
+        delete [] nn;
+        return;
+    }
+
+    if (e)
+    {
+        LOG_err << "Tree copy batch of " << batch->nc << " nodes failed: " << e;
+        if (!copy.e)
+        {
+            copy.e = e;
+        }
+    }
+    else
+    {
+        for (unsigned i = 0; i < batch->nc; i++)
+        {
+            copy.copied += nn[i].added;
+        }
+
+        if (batch->first && nn[0].added)
+        {
+            copy.root = nn[0].addedhandle;
+        }
+
+        for (auto& d : batch->deferred)
+        {
+            Node *source = client->nodebyhandle(d.first);
+            if (!nn[d.second].added || !source)
+            {
+                LOG_warn << "Children of a folder not copied: " << Base64Str<MegaClient::NODEHANDLE>(d.first);
+                continue;
+            }
+
+            TreeCopy::Folder folder;
+            folder.copy = nn[d.second].addedhandle;
+            folder.children.reserve(source->children.size());
+            for (Node *child : source->children)
+            {
+                folder.children.push_back(child->nodehandle);
+            }
+            copy.folders.push_back(std::move(folder));
+        }
+
+        copy.request->setTransferredBytes(copy.copied);
+        fireOnRequestUpdate(copy.request);
+    }
+
+    delete [] nn;
+}
+
+void MegaApiImpl::updateTreeCopies()
+{
+    SdkMutexGuard g(sdkMutex);
+
+    vector<int> tags;
+    for (auto& it : treeCopies)
+    {
+        tags.push_back(it.first);
+    }
+
+    for (int tag : tags)
+    {
+        continueTreeCopy(tag);
+    }
+}
+
 void MegaApiImpl::updateBackups()
 {
     for (std::map<int, MegaBackupController *>::iterator it = backupsMap.begin(); it != backupsMap.end(); ++it)
@@ -17512,6 +21177,38 @@ unsigned MegaApiImpl::sendPendingTransfers()
                 Node *parent = client->nodebyhandle(transfer->getParentHandle());
                 bool startFirst = transfer->shouldStartFirst();
 
+                if (MegaInputStream *inputStream = transfer->getInputStream())
+                {
+                    if (!parent || parent->type == FILENODE || !fileName || !(*fileName) || inputStream->getSize() < 0)
+                    {
+                        e = API_EARGS;
+                        break;
+                    }
+
+                    // the data is read once, as the chunks are prepared: no deduplication nor
+                    // thumbnails, and a placeholder fingerprint (a random CRC keeps it apart from
+                    // other uploads) until Transfer::complete has the real one
+                    currentTransfer = transfer;
+                    string wLocalPath;
+                    string wFileName = fileName;
+                    MegaFilePut *f = new MegaFilePut(client, &wLocalPath, &wFileName, transfer->getParentHandle(), "", mtime, false);
+                    f->uploadstream = std::make_shared<UploadStream>(new ExternalInputStream(inputStream), mtime >= 0 ? mtime : m_time());
+                    f->size = f->uploadstream->size;
+                    f->mtime = f->uploadstream->mtime;
+                    client->rng.genblock((byte*)f->crc, sizeof f->crc);
+                    f->isvalid = true;
+                    f->setTransfer(transfer);
+
+                    // not persisted: the stream can't be resumed in another session
+                    if (!client->startxfer(PUT, f, committer, false, startFirst, true))
+                    {
+                        delete f;
+                        e = API_EINTERNAL;
+                    }
+                    currentTransfer = NULL;
+                    break;
+                }
+
                 if (!localPath || !parent || parent->type == FILENODE || !fileName || !(*fileName))
                 {
                     e = API_EARGS;
@@ -17522,21 +21219,43 @@ unsigned MegaApiImpl::sendPendingTransfers()
                 string wLocalPath;
                 client->fsaccess->path2local(&tmpString, &wLocalPath);
 
-                auto fa = fsAccess->newfileaccess();
-                if (!fa->fopen(&wLocalPath, true, false))
+                nodetype_t type;
+                m_off_t size;
+                FileFingerprint fp;
+                if (const FileFingerprint *localfp = transfer->getLocalFingerprint())
                 {
-                    e = API_EREAD;
-                    break;
+                    // the file was read when its folder was scanned
+                    type = FILENODE;
+                    size = localfp->size;
+                    fp = *localfp;
+                }
+                else
+                {
+                    auto fa = fsAccess->newfileaccess();
+                    if (!fa->fopen(&wLocalPath, true, false))
+                    {
+                        e = API_EREAD;
+                        break;
+                    }
+
+                    type = fa->type;
+                    size = fa->size;
+                    if (type == FILENODE)
+                    {
+                        FingerprintCache::genfingerprint(client->fingerprintcache.get(), &fp, fa.get());
+                    }
                 }
 
-                nodetype_t type = fa->type;
-                m_off_t size = fa->size;
-                FileFingerprint fp;
-                if (type == FILENODE)
+                // a compressed copy of the file was made (see MegaApi::setCompressedTransfers)
+                if (transfer->getCompressedLocalPath().size())
                 {
-                    fp.genfingerprint(fa.get());
+                    wLocalPath = transfer->getCompressedLocalPath();
+                    isSourceTemporary = true;
+                    if (mtime == -1)
+                    {
+                        mtime = fp.mtime;
+                    }
                 }
-                fa.reset();
 
                 if (type == FILENODE)
                 {
@@ -17545,7 +21264,15 @@ unsigned MegaApiImpl::sendPendingTransfers()
                     bool forceToUpload = false;
                     if (previousNode && previousNode->type == type)
                     {
-                        if (fp.isvalid && previousNode->isvalid && fp == *((FileFingerprint *)previousNode))
+                        // a previous version uploaded compressed is compared by the fingerprint of its content
+                        FileFingerprint previousContent;
+                        if (compressedTransfers && !transfer->getCompressedLocalPath().size())
+                        {
+                            previousContent = uncompressedFingerprint(previousNode, NULL);
+                        }
+
+                        if (fp.isvalid && ((previousNode->isvalid && fp == *((FileFingerprint *)previousNode))
+                                           || (previousContent.isvalid && fp == previousContent)))
                         {
                             forceToUpload= hasToForceUpload(*previousNode, *transfer);
                             if (!forceToUpload)
@@ -17563,12 +21290,63 @@ unsigned MegaApiImpl::sendPendingTransfers()
                                 transfer->setSpeed(0);
                                 transfer->setMeanSpeed(0);
                                 transfer->setState(MegaTransfer::STATE_COMPLETED);
+                                discardCompressedUpload(transfer);
                                 fireOnTransferFinish(transfer, MegaError(API_OK), committer);
                                 break;
                             }
                         }
                     }
 
+                    // compress the file first, on the scan workers
+                    if (compressedTransfers && !transfer->isCompressionChecked() && !isSourceTemporary
+                            && fp.isvalid && fp.size >= MIN_COMPRESSED_SIZE && basePath.size())
+                    {
+                        handle tmpid;
+                        client->rng.genblock((byte *)&tmpid, sizeof tmpid);
+
+                        string tmppath = basePath;
+                        if (tmppath[tmppath.size() - 1] != '/' && tmppath[tmppath.size() - 1] != '\\')
+                        {
+                            string utf8Separator;
+                            fsAccess->local2path(&fsAccess->localseparator, &utf8Separator);
+                            tmppath.append(utf8Separator);
+                        }
+                        tmppath.append(".megaz.");
+                        tmppath.append(Base64Str<sizeof tmpid>((const byte *)&tmpid).chars);
+
+                        std::shared_ptr<CompressJob> job = std::make_shared<CompressJob>();
+                        job->fsaccess = client->fsaccess;
+                        job->localpath = wLocalPath;
+                        client->fsaccess->path2local(&tmppath, &job->tmppath);
+
+                        transfer->setCompressionChecked(true);
+                        transfer->setLocalFingerprint(fp);
+                        compressions.push_back(std::make_pair(transfer, job));
+                        getScanWorkers()->submit(job);
+                        break;
+                    }
+
+                    // same size and samples as the previous version, only the modification time differs:
+                    // compare the whole content before uploading it again
+                    if (uploadDeduplication && !forceToUpload && !transfer->isContentChecked() && mtime == -1
+                            && previousNode && previousNode->type == FILENODE
+                            && previousNode->nodekey.size() == FILENODEKEYLENGTH
+                            && fp.isvalid && previousNode->isvalid && fp.size > 0 && fp.size == previousNode->size
+                            && !memcmp(fp.crc, previousNode->crc, sizeof fp.crc))
+                    {
+                        std::shared_ptr<ContentCheckJob> job = std::make_shared<ContentCheckJob>();
+                        job->fsaccess = client->fsaccess;
+                        job->localpath = wLocalPath;
+                        job->size = fp.size;
+                        job->nodekey = previousNode->nodekey;
+
+                        transfer->setContentChecked(true);
+                        transfer->setLocalFingerprint(fp);
+                        contentChecks.push_back(std::make_pair(transfer, job));
+                        getScanWorkers()->submit(job);
+                        break;
+                    }
+
                     // If has been found by name and it's necessary force upload, it isn't necessary look for it again
                     if (!forceToUpload)
                     {
@@ -17612,6 +21390,7 @@ unsigned MegaApiImpl::sendPendingTransfers()
                             transfer->setSpeed(0);
                             transfer->setMeanSpeed(0);
                             transfer->setState(MegaTransfer::STATE_COMPLETING);
+                            discardCompressedUpload(transfer);
                             fireOnTransferUpdate(transfer);
                             break;
                         }
@@ -17621,11 +21400,21 @@ unsigned MegaApiImpl::sendPendingTransfers()
                     currentTransfer = transfer;                    
                     string wFileName = fileName;
                     MegaFilePut *f = new MegaFilePut(client, &wLocalPath, &wFileName, transfer->getParentHandle(), "", mtime, isSourceTemporary);
+                    if (fp.isvalid)
+                    {
+                        // startxfer doesn't need to read the file again
+                        *(FileFingerprint*)f = fp;
+                    }
+                    if (transfer->getCompressedLocalPath().size())
+                    {
+                        f->setUncompressedFingerprint(transfer->getUncompressedFingerprint());
+                    }
                     f->setTransfer(transfer);
                     bool started = client->startxfer(PUT, f, committer, true, startFirst, transfer->isBackupTransfer());
                     if (!started)
                     {
                         transfer->setState(MegaTransfer::STATE_QUEUED);
+                        discardCompressedUpload(transfer);
                         if (!f->isvalid)
                         {
                             //Unable to read the file
@@ -17857,6 +21646,10 @@ unsigned MegaApiImpl::sendPendingTransfers()
                     }
 
                     transfer->setPath(path.c_str());
+                    if (compressedTransfers)
+                    {
+                        transfer->setUncompressedFingerprint(uncompressedFingerprint(node, publicNode));
+                    }
                     f->setTransfer(transfer);
                     bool ok = client->startxfer(GET, f, committer, true, startFirst);
                     if (!ok)
@@ -17890,6 +21683,22 @@ unsigned MegaApiImpl::sendPendingTransfers()
                         break;
                     }
 
+                    // the range of a node uploaded compressed is in its content: the stream is read
+                    // from the start, and inflated up to the end of the range
+                    m_off_t contentSize = compressedTransfers ? uncompressedFingerprint(node, publicNode).size : -1;
+                    if (contentSize >= 0)
+                    {
+                        if (startPos >= contentSize || endPos >= contentSize)
+                        {
+                            e = API_EARGS;
+                            break;
+                        }
+
+                        transfer->setInflater(new ZlibInflater(startPos, endPos + 1));
+                        startPos = 0;
+                        endPos = (node ? node->size : publicNode->getSize()) - 1;
+                    }
+
                     if (node)
                     {
                         transfer->setFileName(node->displayname());
@@ -17943,6 +21752,7 @@ unsigned MegaApiImpl::sendPendingTransfers()
 
         if (e)
         {
+            discardCompressedUpload(transfer);
             transferMap[nextTag] = transfer;
             transfer->setTag(nextTag);
             transfer->setState(MegaTransfer::STATE_QUEUED);
@@ -17995,6 +21805,7 @@ error MegaApiImpl::processAbortBackupRequest(MegaRequestPrivate *request, error
         {
             if (backup->getState() == MegaBackup::BACKUP_ONGOING)
             {
+                backup->cancelQueuedUploads();
                 for (std::map<int, MegaTransferPrivate *>::iterator it = transferMap.begin(); it != transferMap.end(); it++)
                 {
                     MegaTransferPrivate *t = it->second;
@@ -18026,6 +21837,27 @@ error MegaApiImpl::processAbortBackupRequest(MegaRequestPrivate *request, error
     return e;
 }
 
+void MegaApiImpl::lockSdkMutexForReading()
+{
+    sdkMutexReaders++;
+    sdkMutex.lock();
+    sdkMutexReaders--;
+}
+
+void MegaApiImpl::yieldToReaders()
+{
+    if (!sdkMutexReaders)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+    while (sdkMutexReaders && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+}
+
 void MegaApiImpl::yield()
 {
 #if __cplusplus >= 201100L
@@ -18407,6 +22239,61 @@ void MegaApiImpl::sendPendingRequests()
             e = client->rename(node, newParent);
             break;
         }
+        case MegaRequest::TYPE_MOVE_NODES:
+        {
+            MegaHandleList *handles = request->getMegaHandleList();
+            Node *newParent = client->nodebyhandle(request->getParentHandle());
+            if (!handles || !newParent)
+            {
+                e = API_EARGS;
+                break;
+            }
+
+            if (newParent->type == FILENODE || !client->checkaccess(newParent, RDWR))
+            {
+                e = API_EACCESS;
+                break;
+            }
+
+            // all the moves go to the dispatcher at once, to be sent in full batches
+            long long sent = 0;
+            for (unsigned i = 0; i < handles->size(); i++)
+            {
+                Node *node = client->nodebyhandle(handles->get(i));
+                error ne;
+
+                if (!node)
+                {
+                    ne = API_ENOENT;
+                }
+                else if (node->parent == newParent)
+                {
+                    continue;
+                }
+                else if (node->type == ROOTNODE
+                         || node->type == INCOMINGNODE
+                         || node->type == RUBBISHNODE
+                         || !node->parent
+                         || node->parent->type == FILENODE)
+                {
+                    ne = API_EACCESS;
+                }
+                else if (!(ne = client->rename(node, newParent)))
+                {
+                    sent++;
+                    continue;
+                }
+
+                request->addBulkError(ne);
+            }
+
+            request->setTotalBytes(sent);
+            if (!sent)
+            {
+                fireOnRequestFinish(request, MegaError(request->getBulkError()));
+            }
+            break;
+        }
         case MegaRequest::TYPE_COPY:
         {
             Node *node = NULL;
@@ -18564,6 +22451,14 @@ void MegaApiImpl::sendPendingRequests()
 
                 // determine number of nodes to be copied
                 client->proctree(node, &tc, false, ovhandle != UNDEF);
+
+                // larger trees are copied a batch at a time
+                if (target && tc.nc > unsigned(MegaClient::MAX_NEWNODES))
+                {
+                    startTreeCopy(request, node, target->nodehandle, newName ? &sname : NULL, tc.nc);
+                    break;
+                }
+
                 tc.allocnodes();
                 nc = tc.nc;
 
@@ -18688,6 +22583,52 @@ void MegaApiImpl::sendPendingRequests()
             e = client->unlink(node, keepversions);
             break;
         }
+        case MegaRequest::TYPE_REMOVE_NODES:
+        {
+            MegaHandleList *handles = request->getMegaHandleList();
+            if (!handles)
+            {
+                e = API_EARGS;
+                break;
+            }
+
+            long long sent = 0;
+            for (unsigned i = 0; i < handles->size(); i++)
+            {
+                Node *node = client->nodebyhandle(handles->get(i));
+                error ne;
+
+                if (!node)
+                {
+                    ne = API_ENOENT;
+                }
+                else if (node->changed.removed)
+                {
+                    // already removed with one of its ancestors
+                    continue;
+                }
+                else if (node->type == ROOTNODE
+                         || node->type == INCOMINGNODE
+                         || node->type == RUBBISHNODE)
+                {
+                    ne = API_EACCESS;
+                }
+                else if (!(ne = client->unlink(node, false)))
+                {
+                    sent++;
+                    continue;
+                }
+
+                request->addBulkError(ne);
+            }
+
+            request->setTotalBytes(sent);
+            if (!sent)
+            {
+                fireOnRequestFinish(request, MegaError(request->getBulkError()));
+            }
+            break;
+        }
         case MegaRequest::TYPE_REMOVE_VERSIONS:
         {
             client->unlinkversions();
@@ -18802,6 +22743,24 @@ void MegaApiImpl::sendPendingRequests()
             client->fetchnodes();
             break;
         }
+        case MegaRequest::TYPE_FETCH_FOLDER:
+        {
+            Node *node = client->nodebyhandle(request->getNodeHandle());
+            if (!node || node->type == FILENODE)
+            {
+                e = API_EARGS;
+                break;
+            }
+
+            if (client->folderfetched(node->nodehandle))
+            {
+                fireOnRequestFinish(request, MegaError(API_OK));
+                break;
+            }
+
+            client->fetchfolder(node->nodehandle);
+            break;
+        }
         case MegaRequest::TYPE_GET_CLOUD_STORAGE_USED:
         {
             if (client->loggedin() != FULLACCOUNT)
@@ -18810,6 +22769,7 @@ void MegaApiImpl::sendPendingRequests()
                 break;
             }
 
+            client->loadlazynodes();
             request->setNumber(client->mFingerprints.getSumSizes());
             fireOnRequestFinish(request, API_OK);
             break;
@@ -19006,6 +22966,37 @@ void MegaApiImpl::sendPendingRequests()
             client->getua(user, type);
             break;
         }
+        case MegaRequest::TYPE_GET_ATTR_USERS:
+        {
+            attr_t type = static_cast<attr_t>(request->getParamType());
+            const MegaHandleList *handles = request->getMegaHandleList();
+
+            if (!handles || MegaApiImpl::userAttributeToString(type).empty())
+            {
+                e = API_EARGS;
+                break;
+            }
+
+            if (client->loggedin() != FULLACCOUNT)
+            {
+                e = API_EACCESS;
+                break;
+            }
+
+            // the users that aren't known can't cache the values
+            vector<User*> users;
+            for (unsigned i = 0; i < handles->size(); i++)
+            {
+                User *user = client->finduser(handles->get(i), 0);
+                if (user && (MegaApiImpl::userAttributeToScope(type) != '*' || user->userhandle == client->me))
+                {
+                    users.push_back(user);
+                }
+            }
+
+            client->getuas(users, type);
+            break;
+        }
         case MegaRequest::TYPE_SET_ATTR_USER:
         {
             const char* file = request->getFile();
@@ -19395,6 +23386,72 @@ void MegaApiImpl::sendPendingRequests()
 
             break;
         }
+        case MegaRequest::TYPE_SET_ATTR_NODES:
+        {
+            MegaHandleList *handles = request->getMegaHandleList();
+            const char* attrName = request->getName();
+            const char* attrValue = request->getText();
+
+            if (!handles || !attrName || !attrName[0] || strlen(attrName) > 7)
+            {
+                e = API_EARGS;
+                break;
+            }
+
+            string sname = attrName;
+            fsAccess->normalize(&sname);
+            sname.insert(0, "_");
+            nameid attr = AttrMap::string2nameid(sname.c_str());
+
+            string svalue;
+            if (attrValue)
+            {
+                svalue = attrValue;
+                fsAccess->normalize(&svalue);
+            }
+
+            long long sent = 0;
+            for (unsigned i = 0; i < handles->size(); i++)
+            {
+                Node *node = client->nodebyhandle(handles->get(i));
+                error ne;
+
+                if (!node)
+                {
+                    ne = API_ENOENT;
+                }
+                else if (!client->checkaccess(node, FULL))
+                {
+                    ne = API_EACCESS;
+                }
+                else
+                {
+                    if (attrValue)
+                    {
+                        node->attrs.map[attr] = svalue;
+                    }
+                    else
+                    {
+                        node->attrs.map.erase(attr);
+                    }
+
+                    if (!(ne = client->setattr(node)))
+                    {
+                        sent++;
+                        continue;
+                    }
+                }
+
+                request->addBulkError(ne);
+            }
+
+            request->setTotalBytes(sent);
+            if (!sent)
+            {
+                fireOnRequestFinish(request, MegaError(request->getBulkError()));
+            }
+            break;
+        }
         case MegaRequest::TYPE_CANCEL_ATTR_FILE:
         {
             int type = request->getParamType();
@@ -21239,9 +25296,14 @@ void MegaApiImpl::sendPendingRequests()
                 break;
             }
 
-            TreeProcFolderInfo folderProcessor;
-            client->proctree(node, &folderProcessor, false, false);
-            MegaFolderInfo *folderInfo = folderProcessor.getResult();
+            // aggregated counters give the same result as a TreeProcFolderInfo walk
+            // (versions aren't included in files/size; the node itself isn't a subfolder)
+            NodeCounter nc = node->subnodeCounts();
+            MegaFolderInfo *folderInfo = new MegaFolderInfoPrivate(int(nc.files - nc.versions),
+                                                                   int(nc.folders - (node->type == FOLDERNODE ? 1 : 0)),
+                                                                   int(nc.versions),
+                                                                   nc.storage - nc.versionStorage,
+                                                                   nc.versionStorage);
             request->setMegaFolderInfo(folderInfo);
             delete folderInfo;
 
@@ -21652,46 +25714,73 @@ TransferQueue::TransferQueue()
 
 void TransferQueue::push(MegaTransferPrivate *transfer)
 {
-    mutex.lock();
-    transfers.push_back(transfer);
-    mutex.unlock();
+    transfers.push(Item{ transfer, nullptr });
+}
+
+void TransferQueue::push(UploadBatch&& batch)
+{
+    if (batch.entries.empty())
+    {
+        return;
+    }
+
+    transfers.push(Item{ NULL, std::unique_ptr<UploadBatch>(new UploadBatch(std::move(batch))) });
 }
 
 void TransferQueue::push_front(MegaTransferPrivate *transfer)
 {
-    mutex.lock();
-    transfers.push_front(transfer);
-    mutex.unlock();
+    transfers.push_front(Item{ transfer, nullptr });
 }
 
 MegaTransferPrivate *TransferQueue::pop()
 {
-    mutex.lock();
-    if(transfers.empty())
+    if (transfers.empty())
     {
-        mutex.unlock();
         return NULL;
     }
-    MegaTransferPrivate *transfer = transfers.front();
-    transfers.pop_front();
-    mutex.unlock();
-    return transfer;
-}
-
-void TransferQueue::removeListener(MegaTransferListener *listener)
-{
-    mutex.lock();
 
-    std::deque<MegaTransferPrivate *>::iterator it = transfers.begin();
-    while(it != transfers.end())
+    Item& item = transfers.front();
+    uint64_t seq = transfers.frontSeq();
+    MegaTransferPrivate *transfer = item.transfer;
+    if (transfer)
     {
-        MegaTransferPrivate *transfer = (*it);
-        if(transfer->getListener() == listener)
+        transfers.pop_front();
+        if (transfers.isRemoved(transfer->getListener(), seq))
+        {
             transfer->setListener(NULL);
-        it++;
+        }
+        return transfer;
     }
 
-    mutex.unlock();
+    UploadBatch& batch = *item.batch;
+    if (transfers.isRemoved(batch.listener, seq))
+    {
+        batch.listener = NULL;
+    }
+
+    MegaUploadBatchPrivate::Entry& entry = batch.entries.front();
+
+    transfer = new MegaTransferPrivate(MegaTransfer::TYPE_UPLOAD, batch.listener);
+    transfer->setPath(entry.localPath.c_str());
+    transfer->setParentHandle(entry.parent);
+    transfer->setMaxRetries(batch.maxRetries);
+    if (entry.fileName.size())
+    {
+        transfer->setFileName(entry.fileName.c_str());
+    }
+    transfer->setTime(entry.mtime);
+
+    batch.entries.pop_front();
+    if (batch.entries.empty())
+    {
+        transfers.pop_front();
+    }
+    return transfer;
+}
+
+void TransferQueue::removeListener(MegaTransferListener *listener)
+{
+    transfers.removed(listener);
 }
 
 RequestQueue::RequestQueue()
@@ -21700,93 +25789,74 @@ RequestQueue::RequestQueue()
 
 void RequestQueue::push(MegaRequestPrivate *request)
 {
-    mutex.lock();
-    requests.push_back(request);
-    mutex.unlock();
+    requests.push(request);
 }
 
 void RequestQueue::push_front(MegaRequestPrivate *request)
 {
-    mutex.lock();
     requests.push_front(request);
-    mutex.unlock();
+}
+
+void RequestQueue::clearRemovedListeners(MegaRequestPrivate *request, uint64_t seq)
+{
+    if (requests.isRemoved(request->getListener(), seq))
+    {
+        request->setListener(NULL);
+    }
+
+#ifdef ENABLE_SYNC
+    if (requests.isRemoved(request->getSyncListener(), seq))
+    {
+        request->setSyncListener(NULL);
+    }
+#endif
+
+    if (requests.isRemoved(request->getBackupListener(), seq))
+    {
+        request->setBackupListener(NULL);
+    }
 }
 
 MegaRequestPrivate *RequestQueue::pop()
 {
-    mutex.lock();
-    if(requests.empty())
+    if (requests.empty())
     {
-        mutex.unlock();
         return NULL;
     }
+
     MegaRequestPrivate *request = requests.front();
+    clearRemovedListeners(request, requests.frontSeq());
     requests.pop_front();
-    mutex.unlock();
     return request;
 }
 
 MegaRequestPrivate *RequestQueue::front()
 {
-    mutex.lock();
-    if(requests.empty())
+    if (requests.empty())
     {
-        mutex.unlock();
         return NULL;
     }
+
     MegaRequestPrivate *request = requests.front();
-    mutex.unlock();
+    clearRemovedListeners(request, requests.frontSeq());
     return request;
 }
 
 void RequestQueue::removeListener(MegaRequestListener *listener)
 {
-    mutex.lock();
-
-    std::deque<MegaRequestPrivate *>::iterator it = requests.begin();
-    while(it != requests.end())
-    {
-        MegaRequestPrivate *request = (*it);
-        if(request->getListener()==listener)
-            request->setListener(NULL);
-        it++;
-    }
-
-    mutex.unlock();
+    requests.removed(listener);
 }
 
 #ifdef ENABLE_SYNC
 void RequestQueue::removeListener(MegaSyncListener *listener)
 {
-    mutex.lock();
-
-    std::deque<MegaRequestPrivate *>::iterator it = requests.begin();
-    while(it != requests.end())
-    {
-        MegaRequestPrivate *request = (*it);
-        if(request->getSyncListener()==listener)
-            request->setSyncListener(NULL);
-        it++;
-    }
-
-    mutex.unlock();
+    requests.removed(listener);
 }
 #endif
 
 void RequestQueue::removeListener(MegaBackupListener *listener)
 {
-    mutex.lock();
-
-    std::deque<MegaRequestPrivate *>::iterator it = requests.begin();
-    while(it != requests.end())
-    {
-        MegaRequestPrivate *request = (*it);
-        if(request->getBackupListener()==listener)
-            request->setBackupListener(NULL);
-        it++;
-    }
-
-    mutex.unlock();
+    requests.removed(listener);
 }
 
 MegaHashSignatureImpl::MegaHashSignatureImpl(const char *base64Key)
@@ -22737,6 +26807,145 @@ void MegaSyncPrivate::setRegExp(MegaRegExp *regExp)
     }
 }
 
+MegaSyncStatsPrivate::MegaSyncStatsPrivate(MegaClient *client, Sync *sync)
+{
+    tag = sync->tag;
+    pendingScans = int(sync->dirnotify->notifyq[DirNotify::DIREVENTS].size());
+    delayedScans = int(sync->dirnotify->notifyq[DirNotify::EXTRA].size());
+    retryingScans = int(sync->dirnotify->notifyq[DirNotify::RETRY].size());
+    scannedPaths = sync->stats.scanned;
+    scanRate = sync->stats.scanspeed.calculateSpeed();
+    fingerprints = sync->stats.fingerprinted;
+    fingerprintRate = sync->stats.fingerprintspeed.calculateSpeed();
+    localBytes = sync->localbytes;
+    scanTime = std::chrono::duration_cast<std::chrono::milliseconds>(sync->stats.checkpathtime).count();
+    syncUpTime = std::chrono::duration_cast<std::chrono::milliseconds>(sync->stats.syncuptime).count();
+    syncDownTime = std::chrono::duration_cast<std::chrono::milliseconds>(sync->stats.syncdowntime).count();
+
+    pendingUploads = 0;
+    pendingUploadBytes = 0;
+    pendingDownloads = 0;
+    pendingDownloadBytes = 0;
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        for (transfer_map::iterator it = client->transfers[d].begin(); it != client->transfers[d].end(); it++)
+        {
+            Transfer *transfer = it->second;
+            for (file_list::iterator fit = transfer->files.begin(); fit != transfer->files.end(); fit++)
+            {
+                if (!(*fit)->syncxfer)
+                {
+                    continue;
+                }
+
+                // sync uploads are the LocalNodes themselves, sync downloads are SyncFileGets
+                Sync *owner = (d == PUT) ? static_cast<LocalNode *>(*fit)->sync : static_cast<SyncFileGet *>(*fit)->sync;
+                if (owner != sync)
+                {
+                    continue;
+                }
+
+                if (d == PUT)
+                {
+                    pendingUploads++;
+                    pendingUploadBytes += transfer->size - transfer->progresscompleted;
+                }
+                else
+                {
+                    pendingDownloads++;
+                    pendingDownloadBytes += transfer->size - transfer->progresscompleted;
+                }
+                break;
+            }
+        }
+    }
+}
+
+MegaSyncStats *MegaSyncStatsPrivate::copy() const
+{
+    return new MegaSyncStatsPrivate(*this);
+}
+
+int MegaSyncStatsPrivate::getTag() const
+{
+    return tag;
+}
+
+int MegaSyncStatsPrivate::getPendingScans() const
+{
+    return pendingScans;
+}
+
+int MegaSyncStatsPrivate::getDelayedScans() const
+{
+    return delayedScans;
+}
+
+int MegaSyncStatsPrivate::getRetryingScans() const
+{
+    return retryingScans;
+}
+
+long long MegaSyncStatsPrivate::getScannedPaths() const
+{
+    return scannedPaths;
+}
+
+long long MegaSyncStatsPrivate::getScanRate() const
+{
+    return scanRate;
+}
+
+long long MegaSyncStatsPrivate::getFingerprints() const
+{
+    return fingerprints;
+}
+
+long long MegaSyncStatsPrivate::getFingerprintRate() const
+{
+    return fingerprintRate;
+}
+
+int MegaSyncStatsPrivate::getPendingUploads() const
+{
+    return pendingUploads;
+}
+
+long long MegaSyncStatsPrivate::getPendingUploadBytes() const
+{
+    return pendingUploadBytes;
+}
+
+int MegaSyncStatsPrivate::getPendingDownloads() const
+{
+    return pendingDownloads;
+}
+
+long long MegaSyncStatsPrivate::getPendingDownloadBytes() const
+{
+    return pendingDownloadBytes;
+}
+
+long long MegaSyncStatsPrivate::getLocalBytes() const
+{
+    return localBytes;
+}
+
+long long MegaSyncStatsPrivate::getScanTime() const
+{
+    return scanTime;
+}
+
+long long MegaSyncStatsPrivate::getSyncUpTime() const
+{
+    return syncUpTime;
+}
+
+long long MegaSyncStatsPrivate::getSyncDownTime() const
+{
+    return syncDownTime;
+}
+
 MegaSyncEventPrivate::MegaSyncEventPrivate(int type)
 {
     this->type = type;
@@ -23163,6 +27372,13 @@ MegaFolderUploadController::MegaFolderUploadController(MegaApiImpl *megaApi, Meg
     this->recursive = 0;
     this->pendingTransfers = 0;
     this->tag = transfer->getTag();
+    megaApi->folderUploads.insert(this);
+}
+
+MegaFolderUploadController::~MegaFolderUploadController()
+{
+    // the jobs in progress don't refer to the controller, they are just discarded
+    megaApi->folderUploads.erase(this);
 }
 
 void MegaFolderUploadController::start(MegaNode*)
@@ -23217,68 +27433,179 @@ void MegaFolderUploadController::cancel()
     }
 }
 
+void MegaFolderUploadController::ListJob::run()
+{
+    std::unique_ptr<DirAccess> da(fsaccess->newdiraccess());
+    string path = localpath;
+    if (!(opened = da->dopen(&path, NULL, false)))
+    {
+        return;
+    }
+
+    string name;
+    nodetype_t type;
+    while (da->dnext(&path, &name, followsymlinks, &type))
+    {
+        entries.push_back(std::make_pair(name, type));
+    }
+}
+
+void MegaFolderUploadController::FingerprintJob::run()
+{
+    fingerprints.resize(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        string path = localpath + names[i];
+        auto fa = fsaccess->newfileaccess();
+        if (fa->fopen(&path, true, false) && fa->type == FILENODE)
+        {
+            FingerprintCache::genfingerprint(cache.get(), &fingerprints[i], fa.get());
+        }
+    }
+}
+
 void MegaFolderUploadController::onFolderAvailable(MegaHandle handle)
 {
-    recursive++;
-    string localPath = pendingFolders.front();
+    FolderScan scan;
+    scan.parent = handle;
+    scan.localpath = pendingFolders.front();
     pendingFolders.pop_front();
 
-    MegaNode *parent = megaApi->getNodeByHandle(handle);
+    // the file system access only creates the file and folder objects, which
+    // is safe from several threads
+    scan.list = std::make_shared<ListJob>();
+    scan.list->fsaccess = client->fsaccess;
+    scan.list->followsymlinks = client->followsymlinks;
+    scan.list->localpath = scan.localpath;
+
+    recursive++;
+    megaApi->getScanWorkers()->submit(scan.list);
+    scans.push_back(std::move(scan));
+}
+
+void MegaFolderUploadController::checkScans()
+{
+    bool uploaded = false;
 
-    string localname;
-    DirAccess* da;
-    da = client->fsaccess->newdiraccess();
-    if (da->dopen(&localPath, NULL, false))
+    for (std::list<FolderScan>::iterator it = scans.begin(); it != scans.end(); )
     {
-        size_t t = localPath.size();
+        FolderScan &scan = *it;
+        if (!scan.list->finished())
+        {
+            it++;
+            continue;
+        }
 
-        while (da->dnext(&localPath, &localname, client->followsymlinks))
+        if (!scan.fingerprinting)
         {
-            if (t)
+            scan.fingerprinting = true;
+
+            string prefix = scan.localpath;
+            if (prefix.size())
             {
-                localPath.append(client->fsaccess->localseparator);
+                prefix.append(client->fsaccess->localseparator);
             }
 
-            localPath.append(localname);
-
-            auto fa = client->fsaccess->newfileaccess();
-            if (fa->fopen(&localPath, true, false))
+            std::shared_ptr<FingerprintJob> job;
+            for (size_t i = 0; i < scan.list->entries.size(); i++)
             {
-                string name = localname;
-                client->fsaccess->local2name(&name);
-                if (fa->type == FILENODE)
+                if (scan.list->entries[i].second != FILENODE)
                 {
-                    pendingTransfers++;
-                    string utf8path;
-                    client->fsaccess->local2path(&localPath, &utf8path);
-                    megaApi->startUpload(false, utf8path.c_str(), parent, (const char *)NULL, -1, tag, false, NULL, false, false, this);
+                    continue;
                 }
-                else
+
+                if (!job || job->names.size() == FINGERPRINT_BATCH)
                 {
-                    MegaNode *child = megaApi->getChildNode(parent, name.c_str());
-                    if(!child || !child->isFolder())
-                    {
-                        pendingFolders.push_back(localPath);
-                        megaApi->createFolder(name.c_str(), parent, this);
-                    }
-                    else
-                    {
-                        pendingFolders.push_front(localPath);
-                        onFolderAvailable(child->getHandle());
-                    }
-                    delete child;
+                    job = std::make_shared<FingerprintJob>();
+                    job->fsaccess = client->fsaccess;
+                    job->localpath = prefix;
+                    job->cache = client->fingerprintcache;
+                    scan.fingerprints.push_back(job);
                 }
+                job->names.push_back(scan.list->entries[i].first);
             }
 
-            localPath.resize(t);
+            for (size_t i = 0; i < scan.fingerprints.size(); i++)
+            {
+                megaApi->getScanWorkers()->submit(scan.fingerprints[i]);
+            }
         }
+
+        bool fingerprinted = true;
+        for (size_t i = 0; i < scan.fingerprints.size() && fingerprinted; i++)
+        {
+            fingerprinted = scan.fingerprints[i]->finished();
+        }
+
+        if (!fingerprinted)
+        {
+            it++;
+            continue;
+        }
+
+        uploadFolder(scan);
+        it = scans.erase(it);
+        recursive--;
+        uploaded = true;
     }
 
-    delete da;
-    delete parent;
-    recursive--;
+    if (uploaded)
+    {
+        checkCompletion();
+    }
+}
 
-    checkCompletion();
+// queue the uploads and the subfolders of a scanned folder, in the order listed
+void MegaFolderUploadController::uploadFolder(FolderScan &scan)
+{
+    MegaNode *parent = megaApi->getNodeByHandle(scan.parent);
+
+    string localPath = scan.localpath;
+    size_t t = localPath.size();
+    size_t file = 0;
+
+    for (size_t i = 0; i < scan.list->entries.size(); i++)
+    {
+        const string &localname = scan.list->entries[i].first;
+        if (t)
+        {
+            localPath.append(client->fsaccess->localseparator);
+        }
+
+        localPath.append(localname);
+
+        string name = localname;
+        client->fsaccess->local2name(&name);
+        if (scan.list->entries[i].second == FILENODE)
+        {
+            const FileFingerprint &fp = scan.fingerprints[file / FINGERPRINT_BATCH]->fingerprints[file % FINGERPRINT_BATCH];
+            file++;
+
+            pendingTransfers++;
+            string utf8path;
+            client->fsaccess->local2path(&localPath, &utf8path);
+            megaApi->startUpload(false, utf8path.c_str(), parent, (const char *)NULL, -1, tag, false, NULL, false, false, this, fp.isvalid ? &fp : nullptr);
+        }
+        else
+        {
+            MegaNode *child = megaApi->getChildNode(parent, name.c_str());
+            if(!child || !child->isFolder())
+            {
+                pendingFolders.push_back(localPath);
+                megaApi->createFolder(name.c_str(), parent, this);
+            }
+            else
+            {
+                pendingFolders.push_front(localPath);
+                onFolderAvailable(child->getHandle());
+            }
+            delete child;
+        }
+
+        localPath.resize(t);
+    }
+
+    delete parent;
 }
 
 void MegaFolderUploadController::checkCompletion()
@@ -23328,13 +27655,17 @@ void MegaFolderUploadController::onTransferUpdate(MegaApi *, MegaTransfer *t)
 {
     if (transfer)
     {
+        bool notify = megaApi->areTransferUpdateCallbacksEnabled()
+                || transfer->getState() != t->getState()
+                || transfer->getPriority() != t->getPriority();
+
         transfer->setState(t->getState());
         transfer->setPriority(t->getPriority());
         transfer->setTransferredBytes(transfer->getTransferredBytes() + t->getDeltaSize());
         transfer->setUpdateTime(Waiter::ds);
         transfer->setSpeed(t->getSpeed());
         transfer->setMeanSpeed(t->getMeanSpeed());
-        megaApi->fireOnTransferUpdate(transfer);
+        megaApi->fireOnTransferUpdate(transfer, notify);
     }
 }
 
@@ -23382,6 +27713,8 @@ MegaBackupController::MegaBackupController(MegaApiImpl *megaApi, int tag, int fo
     this->attendPastBackups = attendPastBackups;
 
     this->pendingTags = 0;
+    this->pendingCopies = 0;
+    this->maxUploads = 0;
 
     clearCurrentBackupData();
 
@@ -23437,6 +27770,12 @@ MegaBackupController::MegaBackupController(MegaBackupController *backup)
     this->recursive = backup->recursive;
     this->pendingTransfers = backup->pendingTransfers;
     this->pendingTags = backup->pendingTags;
+    this->previousFolders = backup->previousFolders;
+    this->pendingCopies = backup->pendingCopies;
+    this->failedCopies = backup->failedCopies;
+    this->queuedUploads = backup->queuedUploads;
+    this->activeUploads = backup->activeUploads;
+    this->maxUploads = backup->maxUploads;
     for (std::list<string>::iterator it = backup->pendingFolders.begin(); it != backup->pendingFolders.end(); it++)
     {
         this->pendingFolders.push_back(*it);
@@ -23535,11 +27874,27 @@ void MegaBackupController::update()
 
             if (nextStartTime > Waiter::ds)
             {
+                if (!megaApi->acquireBackupSlot(tag))
+                {
+                    if (state != BACKUP_QUEUED)
+                    {
+                        LOG_debug << "Backup queued (too many ongoing backups): " << basepath;
+                        state = BACKUP_QUEUED;
+                        megaApi->fireOnBackupStateChanged(this);
+                    }
+                    if ((lastwakeuptime+10) < Waiter::ds )
+                    {
+                        megaApi->startTimer(10); //check again in a while
+                        lastwakeuptime = Waiter::ds+10;
+                    }
+                    return;
+                }
                 start();
             }
             else
             {
                 LOG_warn << " BACKUP discarded (too soon, time for the next): " << basepath;
+                megaApi->leaveBackupQueue(tag);
                 start(true);
                 megaApi->startTimer(1); //wake sdk
             }
@@ -23684,6 +28039,37 @@ int64_t MegaBackupController::getLastBackupTime()
     return latesttime;
 }
 
+// the most recent backup of this folder whose state is COMPLETE
+handle MegaBackupController::getLastCompleteBackup()
+{
+    handle latest = UNDEF;
+    int64_t latesttime = 0;
+
+    MegaNode *parentNode = megaApi->getNodeByHandle(parenthandle);
+    if (parentNode)
+    {
+        MegaNodeList *children = megaApi->getChildren(parentNode);
+        for (int i = 0; children && i < children->size(); i++)
+        {
+            MegaNode *childNode = children->get(i);
+            string childname = childNode->getName();
+            const char *backstvalue = childNode->getCustomAttr("BACKST");
+            if (isBackup(childname, backupName) && backstvalue && !strcmp(backstvalue, "COMPLETE"))
+            {
+                int64_t timeofbackup = getTimeOfBackup(childname);
+                if (timeofbackup > latesttime)
+                {
+                    latesttime = timeofbackup;
+                    latest = childNode->getHandle();
+                }
+            }
+        }
+        delete children;
+        delete parentNode;
+    }
+    return latest;
+}
+
 bool MegaBackupController::isBackup(string localname, string backupname) const
 {
     return ( localname.compare(0, backupname.length(), backupname) == 0) && (localname.find("_bk_") != string::npos);
@@ -23907,6 +28293,10 @@ void MegaBackupController::clearCurrentBackupData()
     this->recursive = 0;
     this->pendingTransfers = 0;
     this->pendingFolders.clear();
+    this->previousFolders.clear();
+    this->failedCopies = 0;
+    this->queuedUploads.clear();
+    this->activeUploads = 0;
     for (std::vector<MegaTransfer *>::iterator it = failedTransfers.begin(); it != failedTransfers.end(); it++)
     {
         delete *it;
@@ -23974,6 +28364,12 @@ void MegaBackupController::start(bool skip)
 
         if(!child || !child->isFolder())
         {
+            handle previous = megaApi->isIncrementalBackupsEnabled() ? getLastCompleteBackup() : UNDEF;
+            if (!ISUNDEF(previous))
+            {
+                previousFolders[localpath] = previous;
+            }
+
             pendingFolders.push_back(localpath);
             megaApi->createFolder(backupname.c_str(), parent, this);
         }
@@ -24015,8 +28411,18 @@ void MegaBackupController::onFolderAvailable(MegaHandle handle)
     string localPath = pendingFolders.front();
     pendingFolders.pop_front();
 
+    // the same folder in the last complete backup, if any
+    Node *previousNode = NULL;
+    std::map<std::string, mega::handle>::iterator pit = previousFolders.find(localPath);
+    if (pit != previousFolders.end())
+    {
+        previousNode = client->nodebyhandle(pit->second);
+        previousFolders.erase(pit);
+    }
+
     if (state == BACKUP_ONGOING)
     {
+        vector<Node*> unchanged;
         string localname;
         DirAccess* da;
         da = client->fsaccess->newdiraccess();
@@ -24040,17 +28446,30 @@ void MegaBackupController::onFolderAvailable(MegaHandle handle)
                 {
                     string name = localname;
                     client->fsaccess->local2name(&name);
+                    Node *previousChild = previousNode ? client->childnodebyname(previousNode, name.c_str()) : NULL;
                     if(fa->type == FILENODE)
                     {
-                        pendingTransfers++;
-                        string utf8path;
-                        client->fsaccess->local2path(&localPath, &utf8path);
-
                         totalFiles++;
-                        megaApi->startUpload(false, utf8path.c_str(), parent, (const char *)NULL, -1, folderTransferTag, true, NULL, false, false, this);
+                        if (previousChild && previousChild->type == FILENODE && previousChild->isvalid
+                                && previousChild->size == fa->size && previousChild->mtime == fa->mtime)
+                        {
+                            // unchanged since the previous backup
+                            unchanged.push_back(previousChild);
+                        }
+                        else
+                        {
+                            string utf8path;
+                            client->fsaccess->local2path(&localPath, &utf8path);
+                            queueUpload(utf8path, handle);
+                        }
                     }
                     else
                     {
+                        if (previousChild && previousChild->type == FOLDERNODE)
+                        {
+                            previousFolders[localPath] = previousChild->nodehandle;
+                        }
+
                         MegaNode *child = megaApi->getChildNode(parent, name.c_str());
                         if(!child || !child->isFolder())
                         {
@@ -24071,6 +28490,14 @@ void MegaBackupController::onFolderAvailable(MegaHandle handle)
         }
 
         delete da;
+
+        // the unchanged files are copied from the previous backup, in batches
+        for (size_t i = 0; i < unchanged.size(); i += MegaClient::MAX_NEWNODES)
+        {
+            vector<Node*> batch(unchanged.begin() + i, unchanged.begin() + std::min(unchanged.size(), i + MegaClient::MAX_NEWNODES));
+            pendingCopies++;
+            megaApi->putNodeCopies(handle, batch, this);
+        }
     }
     else if (state == BACKUP_SKIPPING)
     {
@@ -24089,14 +28516,16 @@ void MegaBackupController::onFolderAvailable(MegaHandle handle)
 
 bool MegaBackupController::checkCompletion()
 {
-    if(!recursive && !pendingFolders.size() && !pendingTransfers && !pendingTags)
+    if(!recursive && !pendingFolders.size() && !pendingTransfers && !pendingTags && !pendingCopies)
     {
         error e = API_OK;
-        LOG_debug << "Folder transfer finished - " << this->getTransferredBytes() << " of " << this->getTotalBytes();
+        updateMeanSpeed();
+        LOG_debug << "Folder transfer finished - " << this->getTransferredBytes() << " of " << this->getTotalBytes()
+                  << " in " << (Waiter::ds - currentBKStartTime) / 10 << " s (" << meanSpeed << " B/s)";
         MegaNode *node = megaApi->getNodeByHandle(currentHandle);
         if (node)
         {
-            if (failedTransfers.size())
+            if (failedTransfers.size() || failedCopies)
             {
                 this->pendingTags++;
                 megaApi->setCustomNodeAttribute(node, "BACKST", "INCOMPLETE", this);
@@ -24150,6 +28579,55 @@ void MegaBackupController::setOffsetds(const int64_t &value)
     offsetds = value;
 }
 
+int MegaBackupController::getMaxUploads() const
+{
+    return maxUploads;
+}
+
+void MegaBackupController::setMaxUploads(int value)
+{
+    maxUploads = value > 0 ? value : 0;
+    startQueuedUploads();
+}
+
+void MegaBackupController::cancelQueuedUploads()
+{
+    pendingTransfers -= int(queuedUploads.size());
+    queuedUploads.clear();
+}
+
+void MegaBackupController::queueUpload(const string &path, MegaHandle target)
+{
+    pendingTransfers++;
+    queuedUploads.push_back(std::make_pair(path, target));
+    startQueuedUploads();
+}
+
+void MegaBackupController::startQueuedUploads()
+{
+    while (queuedUploads.size() && (!maxUploads || activeUploads < maxUploads))
+    {
+        std::pair<string, MegaHandle> upload = queuedUploads.front();
+        queuedUploads.pop_front();
+        activeUploads++;
+
+        // a target folder removed meanwhile fails the transfer
+        MegaNode *parent = megaApi->getNodeByHandle(upload.second);
+        megaApi->startUpload(false, upload.first.c_str(), parent, (const char *)NULL, -1, folderTransferTag, true, NULL, false, false, this);
+        delete parent;
+    }
+}
+
+// throughput of the backup since it started, not of its last transfer
+void MegaBackupController::updateMeanSpeed()
+{
+    int64_t elapsed = Waiter::ds - currentBKStartTime;
+    if (elapsed > 0)
+    {
+        meanSpeed = transferredBytes * 10 / elapsed;
+    }
+}
+
 void MegaBackupController::abortCurrent()
 {
     LOG_debug << "Setting backup as aborted: " << currentName;
@@ -24197,6 +28675,21 @@ void MegaBackupController::onRequestFinish(MegaApi *, MegaRequest *request, Mega
             checkCompletion();
         }
     }
+    else if(type == MegaRequest::TYPE_COPY)
+    {
+        pendingCopies--;
+        if (!errorCode)
+        {
+            numberFiles += request->getNumber();
+        }
+        else
+        {
+            LOG_err << "Failed to copy " << request->getNumber() << " unchanged files from the previous backup: " << errorCode;
+            failedCopies += int(request->getNumber());
+        }
+        megaApi->fireOnBackupUpdate(this);
+        checkCompletion();
+    }
     else if(type == MegaRequest::TYPE_REMOVE)
     {
         pendingremovals--;
@@ -24251,7 +28744,7 @@ void MegaBackupController::onTransferUpdate(MegaApi *, MegaTransfer *t)
     this->setTransferredBytes(this->getTransferredBytes() + t->getDeltaSize());
     this->setUpdateTime(Waiter::ds);
     this->setSpeed(t->getSpeed());
-    this->setMeanSpeed(t->getMeanSpeed());
+    updateMeanSpeed();
 
     megaApi->fireOnBackupUpdate(this);
 }
@@ -24267,10 +28760,14 @@ void MegaBackupController::onTransferFinish(MegaApi *, MegaTransfer *t, MegaErro
     LOG_verbose << " at MegaackupController::onTransferFinish";
 
     pendingTransfers--;
+    if (activeUploads)
+    {
+        activeUploads--;
+    }
 //    this->setTransferredBytes(this->getTransferredBytes() + t->getDeltaSize()); //TODO: THIS was in MegaUploaderController (which seems wrong)
     this->setUpdateTime(Waiter::ds);
     this->setSpeed(t->getSpeed());
-    this->setMeanSpeed(t->getMeanSpeed());
+    updateMeanSpeed();
 
     if (e->getErrorCode() != MegaError::API_OK)
     {
@@ -24283,6 +28780,7 @@ void MegaBackupController::onTransferFinish(MegaApi *, MegaTransfer *t, MegaErro
 
     megaApi->fireOnBackupUpdate(this);
 
+    startQueuedUploads();
     checkCompletion();
 }
 
@@ -24525,12 +29023,18 @@ void MegaFolderDownloadController::start(MegaNode *node)
 #endif
 
     transfer->setPath(path.c_str());
-    downloadFolderNode(node, &path);
 
+    // the files are started as the walk goes, so the total is known from the start
+    transfer->setTotalBytes(megaApi->getSize(node));
+
+    openFolder(node, &path);
     if (deleteNode)
     {
         delete node;
     }
+
+    downloadNext();
+    checkCompletion();
 }
 
 void MegaFolderDownloadController::cancel()
@@ -24547,10 +29051,9 @@ void MegaFolderDownloadController::cancel()
 }
 
 
-void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, string *path)
+// create the local folder and add it to the walk
+void MegaFolderDownloadController::openFolder(MegaNode *node, string *path)
 {
-    recursive++;
-
     string localpath;
     client->fsaccess->path2local(path, &localpath);
     auto da = client->fsaccess->newfileaccess();
@@ -24561,10 +29064,8 @@ void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, string *pa
             da.reset();
             LOG_err << "Unable to create folder: " << *path;
 
-            recursive--;
             mLastError = API_EWRITE;
             mIncompleteTransfers++;
-            checkCompletion();
             return;
         }
     }
@@ -24577,42 +29078,53 @@ void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, string *pa
         da.reset();
         LOG_err << "Local file detected where there should be a folder: " << *path;
 
-        recursive--;
         mLastError = API_EEXIST;
         mIncompleteTransfers++;
-        checkCompletion();
         return;
     }
     da.reset();
 
-    localpath.append(client->fsaccess->localseparator);
-    MegaNodeList *children = NULL;
-    bool deleteChildren = false;
+    Folder folder;
     if (node->isForeign())
     {
-        children = node->getChildren();
+        // owned by the node, which is owned by its parent's list or by the transfer
+        folder.children = node->getChildren();
     }
     else
     {
-        children = megaApi->getChildren(node);
-        deleteChildren = true;
+        folder.ownedChildren.reset(megaApi->getChildren(node));
+        folder.children = folder.ownedChildren.get();
     }
 
-    if (!children)
+    if (!folder.children)
     {
         LOG_err << "Child nodes not found: " << *path;
-        recursive--;
         mLastError = API_ENOENT;
         mIncompleteTransfers++;
-        checkCompletion();
         return;
     }
 
-    for (int i = 0; i < children->size(); i++)
+    folder.next = 0;
+    folder.localpath = localpath;
+    folder.localpath.append(client->fsaccess->localseparator);
+    folders.push_back(std::move(folder));
+}
+
+// walk the tree depth first until the window of pending downloads is full
+void MegaFolderDownloadController::downloadNext()
+{
+    while (!folders.empty() && pendingTransfers < MAX_PENDING_DOWNLOADS)
     {
-        MegaNode *child = children->get(i);
-        size_t l = localpath.size();
+        Folder &folder = folders.back();
+        if (folder.next >= folder.children->size())
+        {
+            folders.pop_back();
+            continue;
+        }
 
+        MegaNode *child = folder.children->get(folder.next++);
+
+        string localpath = folder.localpath;
         string name = child->getName();
         client->fsaccess->name2local(&name);
         localpath.append(name);
@@ -24627,23 +29139,14 @@ void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, string *pa
         }
         else
         {
-            downloadFolderNode(child, &utf8path);
+            openFolder(child, &utf8path);
         }
-
-        localpath.resize(l);
     }
-
-    recursive--;
-    checkCompletion();
-    if (deleteChildren)
-    {
-        delete children;
-    } 
 }
 
 void MegaFolderDownloadController::checkCompletion()
 {
-    if (!recursive && !pendingTransfers)
+    if (folders.empty() && !pendingTransfers)
     {
         LOG_debug << "Folder download finished - " << transfer->getTransferredBytes() << " of " << transfer->getTotalBytes();
         transfer->setState(MegaTransfer::STATE_COMPLETED);
@@ -24658,7 +29161,6 @@ void MegaFolderDownloadController::onTransferStart(MegaApi *, MegaTransfer *t)
     subTransfers.insert(static_cast<MegaTransferPrivate*>(t));
     transfer->setState(t->getState());
     transfer->setPriority(t->getPriority());
-    transfer->setTotalBytes(transfer->getTotalBytes() + t->getTotalBytes());
     transfer->setUpdateTime(Waiter::ds);
     megaApi->fireOnTransferUpdate(transfer);
 }
@@ -24667,13 +29169,17 @@ void MegaFolderDownloadController::onTransferUpdate(MegaApi *, MegaTransfer *t)
 {
     if (transfer)
     {
+        bool notify = megaApi->areTransferUpdateCallbacksEnabled()
+                || transfer->getState() != t->getState()
+                || transfer->getPriority() != t->getPriority();
+
         transfer->setState(t->getState());
         transfer->setPriority(t->getPriority());
         transfer->setTransferredBytes(transfer->getTransferredBytes() + t->getDeltaSize());
         transfer->setUpdateTime(Waiter::ds);
         transfer->setSpeed(t->getSpeed());
         transfer->setMeanSpeed(t->getMeanSpeed());
-        megaApi->fireOnTransferUpdate(transfer);
+        megaApi->fireOnTransferUpdate(transfer, notify);
     }
 }
 
@@ -24695,11 +29201,15 @@ void MegaFolderDownloadController::onTransferFinish(MegaApi *, MegaTransfer *t,
             mLastError = e->getErrorCode();
             mIncompleteTransfers++;
         }
+        downloadNext();
         checkCompletion();
     }
 }
 
 #ifdef HAVE_LIBUV
+std::atomic<size_t> StreamingBuffer::allocatedBuffers{0};
+std::atomic<size_t> StreamingBuffer::allocatedBytes{0};
+
 StreamingBuffer::StreamingBuffer()
 {
     this->capacity = 0;
@@ -24714,6 +29224,11 @@ StreamingBuffer::StreamingBuffer()
 
 StreamingBuffer::~StreamingBuffer()
 {
+    if (buffer)
+    {
+        allocatedBuffers--;
+        allocatedBytes -= capacity;
+    }
     delete [] buffer;
 }
 
@@ -24724,8 +29239,16 @@ void StreamingBuffer::init(unsigned int capacity)
         capacity = maxBufferSize;
     }
 
+    if (this->buffer)
+    {
+        allocatedBuffers--;
+        allocatedBytes -= this->capacity;
+    }
+    delete [] this->buffer;
     this->capacity = capacity;
     this->buffer = new char[capacity];
+    allocatedBuffers++;
+    allocatedBytes += capacity;
     this->inpos = 0;
     this->outpos = 0;
     this->size = 0;
@@ -24809,6 +29332,29 @@ uv_buf_t StreamingBuffer::nextBuffer()
     return uv_buf_init(outbuf, len);
 }
 
+unsigned int StreamingBuffer::nextBuffers(uv_buf_t bufs[2])
+{
+    unsigned int len = size < maxOutputSize ? size : maxOutputSize;
+    if (!len)
+    {
+        return 0;
+    }
+
+    // data up to the end of the ring, then the rest from its start
+    unsigned int first = (outpos + len > capacity) ? capacity - outpos : len;
+    bufs[0] = uv_buf_init(buffer + outpos, first);
+    unsigned int count = 1;
+    if (first < len)
+    {
+        bufs[1] = uv_buf_init(buffer, len - first);
+        count = 2;
+    }
+
+    size -= len;
+    outpos = (outpos + len) % capacity;
+    return count;
+}
+
 void StreamingBuffer::freeData(unsigned int len)
 {
     // update the internal state
@@ -24860,6 +29406,7 @@ MegaTCPServer::MegaTCPServer(MegaApiImpl *megaApi, string basePath, bool tls, st
     this->lastHandle = INVALID_HANDLE;
     this->remainingcloseevents = 0;
     this->closing = false;
+    this->eventLoops = 1;
     this->thread = new MegaThread();
 #ifdef ENABLE_EVT_TLS
     this->certificatepath = certificatepath;
@@ -24982,11 +29529,38 @@ void MegaTCPServer::run()
 #endif
 
     uv_loop_init(&uv_loop);
+    uv_loop.data = NULL;
 
     uv_async_init(&uv_loop, &exit_handle, onCloseRequested);
     exit_handle.data = this;
 
-    uv_tcp_init(&uv_loop, &server);
+    bool reuseport = false;
+#ifdef SO_REUSEPORT
+    // the other loops listen on the same port (TLS connections share the evt_ctx of the server)
+    if (eventLoops > 1 && !useTLS)
+    {
+        uv_os_fd_t fd;
+        int on = 1;
+        if (uv_tcp_init_ex(&uv_loop, &server, useIPv6 ? AF_INET6 : AF_INET))
+        {
+            uv_tcp_init(&uv_loop, &server);
+        }
+        else
+        {
+            reuseport = !uv_fileno((uv_handle_t*)&server, &fd)
+                    && !setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+        }
+
+        if (!reuseport)
+        {
+            LOG_warn << "Unable to share the port between event loops. Using a single one";
+        }
+    }
+    else
+#endif
+    {
+        uv_tcp_init(&uv_loop, &server);
+    }
     server.data = this;
 
     uv_tcp_keepalive(&server, 0, 0);
@@ -25047,7 +29621,12 @@ void MegaTCPServer::run()
         return;
     }
 
-    LOG_info << "TCP" << (useTLS ? "(tls)" : "") << " server started on port " << port;
+    if (reuseport)
+    {
+        startExtraLoops((const struct sockaddr*)&address, onNewClientCB);
+    }
+
+    LOG_info << "TCP" << (useTLS ? "(tls)" : "") << " server started on port " << port << " (" << (extraLoops.size() + 1) << " event loops)";
     started = true;
     uv_sem_post(&semaphoreStartup);
 
@@ -25068,6 +29647,106 @@ void MegaTCPServer::run()
     LOG_debug << "UV loop thread exit";
 }
 
+void MegaTCPServer::startExtraLoops(const struct sockaddr *address, uv_connection_cb onNewClientCB)
+{
+#ifdef SO_REUSEPORT
+    for (int i = 1; i < eventLoops; i++)
+    {
+        ExtraLoop *el = new ExtraLoop();
+        el->tcpServer = this;
+
+        uv_loop_init(&el->loop);
+        el->loop.data = el;
+
+        uv_async_init(&el->loop, &el->exit_handle, onExtraLoopCloseRequested);
+        el->exit_handle.data = el;
+
+        bool listening = false;
+        if (!uv_tcp_init_ex(&el->loop, &el->listener, address->sa_family))
+        {
+            el->listener.data = this;
+
+            uv_os_fd_t fd;
+            int on = 1;
+            listening = !uv_fileno((uv_handle_t*)&el->listener, &fd)
+                    && !setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on)
+                    && !uv_tcp_bind(&el->listener, address, 0)
+                    && !uv_listen((uv_stream_t*)&el->listener, 32, onNewClientCB);
+
+            if (!listening)
+            {
+                uv_close((uv_handle_t *)&el->listener, NULL);
+            }
+        }
+
+        if (!listening)
+        {
+            LOG_warn << "Unable to start an additional event loop on port " << port;
+            uv_close((uv_handle_t *)&el->exit_handle, NULL);
+            uv_run(&el->loop, UV_RUN_DEFAULT);
+            uv_loop_close(&el->loop);
+            delete el;
+            break;
+        }
+
+        uv_tcp_keepalive(&el->listener, 0, 0);
+
+        extraLoops.push_back(el);
+        el->thread.start(extraLoopEntryPoint, el);
+    }
+#endif
+}
+
+void *MegaTCPServer::extraLoopEntryPoint(void *param)
+{
+#ifndef _WIN32
+    struct sigaction noaction;
+    memset(&noaction, 0, sizeof(noaction));
+    noaction.sa_handler = SIG_IGN;
+    ::sigaction(SIGPIPE, &noaction, 0);
+#endif
+
+    ExtraLoop *el = (ExtraLoop *)param;
+    uv_run(&el->loop, UV_RUN_DEFAULT);
+    uv_loop_close(&el->loop);
+    LOG_debug << "Additional UV loop ended. Port = " << el->tcpServer->port;
+    return NULL;
+}
+
+// close the connections and the handles of an additional loop, that ends then
+void MegaTCPServer::onExtraLoopCloseRequested(uv_async_t *handle)
+{
+    ExtraLoop *el = (ExtraLoop *)handle->data;
+
+    for (list<MegaTCPContext*>::iterator it = el->connections.begin(); it != el->connections.end(); it++)
+    {
+        closeTCPConnection(*it);
+    }
+
+    uv_close((uv_handle_t *)&el->listener, NULL);
+    uv_close((uv_handle_t *)&el->exit_handle, NULL);
+}
+
+void MegaTCPServer::stopExtraLoops()
+{
+    for (size_t i = 0; i < extraLoops.size(); i++)
+    {
+        uv_async_send(&extraLoops[i]->exit_handle);
+    }
+
+    for (size_t i = 0; i < extraLoops.size(); i++)
+    {
+        extraLoops[i]->thread.join();
+        delete extraLoops[i];
+    }
+    extraLoops.clear();
+}
+
+list<MegaTCPContext*>& MegaTCPServer::loopConnections(uv_loop_t *loop)
+{
+    return loop->data ? ((ExtraLoop *)loop->data)->connections : connections;
+}
+
 void MegaTCPServer::initializeAndStartListening()
 {
 #ifdef ENABLE_EVT_TLS
@@ -25087,6 +29766,7 @@ void MegaTCPServer::initializeAndStartListening()
 #endif
 
     uv_loop_init(&uv_loop);
+    uv_loop.data = NULL;
 
     uv_async_init(&uv_loop, &exit_handle, onCloseRequested);
     exit_handle.data = this;
@@ -25164,6 +29844,7 @@ void MegaTCPServer::stop(bool doNotWait)
     }
 
     LOG_debug << "Stopping MegaTCPServer port = " << port;
+    stopExtraLoops();
     uv_async_send(&exit_handle);
     if (!doNotWait)
     {
@@ -25204,6 +29885,16 @@ int MegaTCPServer::getMaxBufferSize()
     return StreamingBuffer::MAX_BUFFER_SIZE;
 }
 
+void MegaTCPServer::setEventLoops(int loops)
+{
+    this->eventLoops = loops <= 1 ? 1 : loops;
+}
+
+int MegaTCPServer::getEventLoops()
+{
+    return eventLoops;
+}
+
 int MegaTCPServer::getMaxOutputSize()
 {
     if (maxOutputSize)
@@ -25384,16 +30075,16 @@ void MegaTCPServer::onNewClient_tls(uv_stream_t *server_handle, int status)
     // Create an object to save context information
     MegaTCPContext* tcpctx = ((MegaTCPServer *)server_handle->data)->initializeContext(server_handle);
 
-    LOG_debug << "Connection received at port " << tcpctx->server->port << " ! " << tcpctx->server->connections.size();
+    LOG_debug << "Connection received at port " << tcpctx->server->port << " ! " << tcpctx->server->loopConnections(server_handle->loop).size();
 
     // Mutex to protect the data buffer
     uv_mutex_init(&tcpctx->mutex);
 
     // Async handle to perform writes
-    uv_async_init(&tcpctx->server->uv_loop, &tcpctx->asynchandle, onAsyncEvent);
+    uv_async_init(server_handle->loop, &tcpctx->asynchandle, onAsyncEvent);
 
     // Accept the connection
-    uv_tcp_init(&tcpctx->server->uv_loop, &tcpctx->tcphandle);
+    uv_tcp_init(server_handle->loop, &tcpctx->tcphandle);
     if (uv_accept(server_handle, (uv_stream_t*)&tcpctx->tcphandle))
     {
         LOG_err << "uv_accept failed";
@@ -25411,7 +30102,7 @@ void MegaTCPServer::onNewClient_tls(uv_stream_t *server_handle, int status)
         return;
     }
 
-    tcpctx->server->connections.push_back(tcpctx);
+    tcpctx->server->loopConnections(server_handle->loop).push_back(tcpctx);
 
     tcpctx->server->readData(tcpctx);
 }
@@ -25443,16 +30134,16 @@ void MegaTCPServer::onNewClient(uv_stream_t* server_handle, int status)
     // Create an object to save context information
     MegaTCPContext* tcpctx = ((MegaTCPServer *)server_handle->data)->initializeContext(server_handle);
 
-    LOG_debug << "Connection received at port " << tcpctx->server->port << "! " << tcpctx->server->connections.size() << " tcpctx = " << tcpctx;
+    LOG_debug << "Connection received at port " << tcpctx->server->port << "! " << tcpctx->server->loopConnections(server_handle->loop).size() << " tcpctx = " << tcpctx;
 
     // Mutex to protect the data buffer
     uv_mutex_init(&tcpctx->mutex);
 
     // Async handle to perform writes
-    uv_async_init(&tcpctx->server->uv_loop, &tcpctx->asynchandle, onAsyncEvent);
+    uv_async_init(server_handle->loop, &tcpctx->asynchandle, onAsyncEvent);
 
     // Accept the connection
-    uv_tcp_init(&tcpctx->server->uv_loop, &tcpctx->tcphandle);
+    uv_tcp_init(server_handle->loop, &tcpctx->tcphandle);
     if (uv_accept(server_handle, (uv_stream_t*)&tcpctx->tcphandle))
     {
         LOG_err << "uv_accept failed";
@@ -25460,7 +30151,7 @@ void MegaTCPServer::onNewClient(uv_stream_t* server_handle, int status)
         return;
     }
 
-    tcpctx->server->connections.push_back(tcpctx);
+    tcpctx->server->loopConnections(server_handle->loop).push_back(tcpctx);
     if (tcpctx->server->respondNewConnection(tcpctx))
     {
         // Start reading
@@ -25523,8 +30214,9 @@ void MegaTCPServer::onClose(uv_handle_t* handle)
     tcpctx->megaApi->removeTransferListener(tcpctx);
     tcpctx->megaApi->removeRequestListener(tcpctx);
 
-    tcpctx->server->connections.remove(tcpctx);
-    LOG_debug << "Connection closed: " << tcpctx->server->connections.size() << " port = " << tcpctx->server->port << " closing async handle";
+    list<MegaTCPContext*>& connections = tcpctx->server->loopConnections(handle->loop);
+    connections.remove(tcpctx);
+    LOG_debug << "Connection closed: " << connections.size() << " port = " << tcpctx->server->port << " closing async handle";
     uv_close((uv_handle_t *)&tcpctx->asynchandle, onAsyncEventClose);
 }
 
@@ -25535,12 +30227,17 @@ void MegaTCPServer::onAsyncEventClose(uv_handle_t *handle)
 
     int port = tcpctx->server->port;
 
-    tcpctx->server->remainingcloseevents--;
+    // close events are counted for the connections of the server loop only
+    bool extraloop = handle->loop->data != NULL;
+    if (!extraloop)
+    {
+        tcpctx->server->remainingcloseevents--;
+    }
     tcpctx->server->processOnAsyncEventClose(tcpctx);
 
     LOG_verbose << "At onAsyncEventClose port = " << tcpctx->server->port << " remaining=" << tcpctx->server->remainingcloseevents;
 
-    if (!tcpctx->server->remainingcloseevents && tcpctx->server->closing && !tcpctx->server->semaphoresdestroyed)
+    if (!extraloop && !tcpctx->server->remainingcloseevents && tcpctx->server->closing && !tcpctx->server->semaphoresdestroyed)
     {
         uv_sem_post(&tcpctx->server->semaphoreStartup);
         uv_sem_post(&tcpctx->server->semaphoreEnd);
@@ -25724,7 +30421,10 @@ void MegaTCPServer::closeTCPConnection(MegaTCPContext *tcpctx)
     tcpctx->finished = true;
     if (!uv_is_closing((uv_handle_t*)&tcpctx->tcphandle))
     {
-        tcpctx->server->remainingcloseevents++;
+        if (!tcpctx->tcphandle.loop->data)
+        {
+            tcpctx->server->remainingcloseevents++;
+        }
         LOG_verbose << "At closeTCPConnection port = " << tcpctx->server->port << " remainingcloseevent = " << tcpctx->server->remainingcloseevents;
         uv_close((uv_handle_t*)&tcpctx->tcphandle, onClose);
     }
@@ -25770,6 +30470,13 @@ MegaHTTPServer::MegaHTTPServer(MegaApiImpl *megaApi, string basePath, bool useTL
     this->folderServerEnabled = true;
     this->offlineAttribute = false;
     this->subtitlesSupportEnabled = false;
+    this->metricsEnabled = false;
+    this->mediaPrefetchTime = 0;
+    this->webDavCacheGeneration = 0;
+    uv_mutex_init(&webDavCacheMutex);
+    this->folderPrefetchFiles = 0;
+    this->folderPrefetchReadAhead = false;
+    uv_mutex_init(&folderPrefetchMutex);
 }
 
 MegaTCPContext * MegaHTTPServer::initializeContext(uv_stream_t *server_handle)
@@ -25800,6 +30507,19 @@ void MegaHTTPServer::processReceivedData(MegaTCPContext *tcpctx, ssize_t nread,
     ssize_t parsed = -1;
     if (nread >= 0)
     {
+        if (HTTP_PARSER_ERRNO(&httpctx->parser) == HPE_PAUSED)
+        {
+            // pipelined request, parsed once the current one has been answered
+            if (httpctx->pendingInput.size() + nread > MAX_PENDING_INPUT)
+            {
+                LOG_warn << "Finishing request. Too much pipelined data";
+                closeConnection(httpctx);
+                return;
+            }
+            httpctx->pendingInput.append(buf->base, nread);
+            return;
+        }
+
         if (nread == 0 && httpctx->parser.method == HTTP_PUT) //otherwise it will fail for files >65k in GVFS-DAV
         {
             LOG_debug << " Skipping parsing 0 length data for HTTP_PUT";
@@ -25809,6 +30529,12 @@ void MegaHTTPServer::processReceivedData(MegaTCPContext *tcpctx, ssize_t nread,
         {
             parsed = http_parser_execute(&httpctx->parser, &parsercfg, buf->base, nread);
         }
+
+        if (parsed < nread && HTTP_PARSER_ERRNO(&httpctx->parser) == HPE_PAUSED)
+        {
+            httpctx->pendingInput.append(buf->base + parsed, nread - parsed);
+            parsed = nread;
+        }
     }
 
     LOG_verbose << " at onDataReceived, received " << nread << " parsed = " << parsed;
@@ -25833,7 +30559,7 @@ void MegaHTTPServer::processWriteFinished(MegaTCPContext* tcpctx, int status)
     LOG_verbose << "Bytes written: " << httpctx->lastBufferLen << " Remaining: " << (httpctx->size - httpctx->bytesWritten);
     httpctx->lastBuffer = NULL;
 
-    if (status < 0 || httpctx->size == httpctx->bytesWritten)
+    if (status < 0 || (httpctx->size == httpctx->bytesWritten && !httpctx->propFind))
     {
         if (status < 0)
         {
@@ -25846,6 +30572,12 @@ void MegaHTTPServer::processWriteFinished(MegaTCPContext* tcpctx, int status)
             {
                 httpctx->resultCode = API_OK;
             }
+
+            if (httpctx->keepAlive)
+            {
+                startNextRequest(httpctx);
+                return;
+            }
         }
 
         closeConnection(httpctx);
@@ -25875,6 +30607,11 @@ void MegaHTTPServer::processWriteFinished(MegaTCPContext* tcpctx, int status)
     }
     uv_mutex_unlock(&httpctx->mutex);
 
+    if (httpctx->propFind)
+    {
+        continuePropFindResponse(httpctx);
+    }
+
     uv_async_send(&httpctx->asynchandle);
 }
 
@@ -25897,6 +30634,83 @@ void MegaHTTPServer::processOnAsyncEventClose(MegaTCPContext* tcpctx)
     httpctx->node = NULL;
 }
 
+void MegaHTTPServer::startNextRequest(MegaHTTPContext *httpctx)
+{
+    LOG_debug << "Response sent. Waiting for the next request on the connection";
+
+    // nothing from the previous request reports to this context anymore
+    httpctx->megaApi->removeTransferListener(httpctx);
+    httpctx->megaApi->removeRequestListener(httpctx);
+    if (httpctx->transfer)
+    {
+        httpctx->megaApi->fireOnStreamingFinish(httpctx->transfer.release(), MegaError(httpctx->resultCode)); // transfer will be deleted in fireOnStreamingFinish
+    }
+
+    delete httpctx->node;
+    httpctx->node = NULL;
+
+    uv_mutex_lock(&httpctx->mutex);
+    if (httpctx->lastBufferLen)
+    {
+        httpctx->streamingBuffer.freeData(httpctx->lastBufferLen);
+        httpctx->lastBufferLen = 0;
+    }
+    uv_mutex_unlock(&httpctx->mutex);
+
+    uv_mutex_lock(&httpctx->mutex_responses);
+    httpctx->responses.clear();
+    uv_mutex_unlock(&httpctx->mutex_responses);
+
+    httpctx->bytesWritten = 0;
+    httpctx->size = 0;
+    httpctx->lastBuffer = NULL;
+    httpctx->rangeStart = -1;
+    httpctx->rangeEnd = -1;
+    httpctx->rangeWritten = -1;
+    httpctx->range = false;
+    httpctx->failed = false;
+    httpctx->pause = false;
+    httpctx->nodereceived = false;
+    httpctx->resultCode = API_EINTERNAL;
+    httpctx->path.clear();
+    httpctx->nodehandle.clear();
+    httpctx->nodekey.clear();
+    httpctx->nodename.clear();
+    httpctx->nodesize = -1;
+    httpctx->nodepubauth.clear();
+    httpctx->nodeprivauth.clear();
+    httpctx->nodechatauth.clear();
+    httpctx->depth = -1;
+    httpctx->lastheader.clear();
+    httpctx->subpathrelative.clear();
+    delete [] httpctx->messageBody;
+    httpctx->messageBody = NULL;
+    httpctx->messageBodySize = 0;
+    httpctx->host.clear();
+    httpctx->destination.clear();
+    httpctx->overwrite = true;
+    httpctx->newname.clear();
+    httpctx->nodeToMove = UNDEF;
+    httpctx->newParentNode = UNDEF;
+    httpctx->propFind = false;
+    httpctx->propFindListing = false;
+    httpctx->propFindBody.clear();
+    httpctx->propFindChildren.clear();
+    httpctx->propFindFolders.clear();
+    httpctx->keepAlive = false;
+
+    http_parser_init(&httpctx->parser, HTTP_REQUEST);
+    httpctx->parser.data = httpctx;
+
+    if (httpctx->pendingInput.size())
+    {
+        string input;
+        input.swap(httpctx->pendingInput);
+        uv_buf_t buf = uv_buf_init((char *)input.data(), unsigned(input.size()));
+        processReceivedData(httpctx, ssize_t(input.size()), &buf);
+    }
+}
+
 bool MegaHTTPServer::respondNewConnection(MegaTCPContext* tcpctx)
 {
     return true;
@@ -25911,6 +30725,8 @@ MegaHTTPServer::~MegaHTTPServer()
     // if not stopped, the uv thread might want to access a pointer to this.
     // though this is done in the parent destructor, it could try to access it after vtable has been erased
     stop();
+    uv_mutex_destroy(&webDavCacheMutex);
+    uv_mutex_destroy(&folderPrefetchMutex);
 }
 
 bool MegaHTTPServer::isHandleWebDavAllowed(handle h)
@@ -25947,6 +30763,7 @@ void MegaHTTPServer::enableFolderServer(bool enable)
 void MegaHTTPServer::enableOfflineAttribute(bool enable)
 {
     this->offlineAttribute = enable;
+    clearWebDavCache();
 }
 
 bool MegaHTTPServer::isFileServerEnabled()
@@ -25974,6 +30791,136 @@ void MegaHTTPServer::enableSubtitlesSupport(bool enable)
     this->subtitlesSupportEnabled = enable;
 }
 
+bool MegaHTTPServer::isMetricsEnabled()
+{
+    return metricsEnabled;
+}
+
+void MegaHTTPServer::enableMetrics(bool enable)
+{
+    this->metricsEnabled = enable;
+}
+
+void MegaHTTPServer::setMediaPrefetchTime(int seconds)
+{
+    this->mediaPrefetchTime = seconds <= 0 ? 0 : seconds;
+}
+
+int MegaHTTPServer::getMediaPrefetchTime()
+{
+    return mediaPrefetchTime;
+}
+
+void MegaHTTPServer::setFolderPrefetch(int files, bool readAhead)
+{
+    uv_mutex_lock(&folderPrefetchMutex);
+    folderPrefetchFiles = files <= 0 ? 0 : std::min(files, int(MAX_FOLDER_PREFETCH_FILES));
+    folderPrefetchReadAhead = readAhead;
+    uv_mutex_unlock(&folderPrefetchMutex);
+}
+
+int MegaHTTPServer::getFolderPrefetch()
+{
+    uv_mutex_lock(&folderPrefetchMutex);
+    int files = folderPrefetchFiles;
+    uv_mutex_unlock(&folderPrefetchMutex);
+    return files;
+}
+
+void MegaHTTPServer::prefetchFolder(MegaNode *node)
+{
+    MegaHandle h = node->getHandle();
+    MegaHandle parent = node->getParentHandle();
+
+    // only the first request of each file counts (players request several ranges)
+    uv_mutex_lock(&folderPrefetchMutex);
+    int files = folderPrefetchFiles;
+    bool readAhead = folderPrefetchReadAhead;
+    bool recent = std::find(recentStreams.begin(), recentStreams.end(), h) != recentStreams.end();
+    if (!recent)
+    {
+        recentStreams.push_back(h);
+        if (recentStreams.size() > MAX_RECENT_STREAMS)
+        {
+            recentStreams.pop_front();
+        }
+    }
+    uv_mutex_unlock(&folderPrefetchMutex);
+
+    if (!files || recent || node->isPublic() || node->isForeign() || parent == INVALID_HANDLE)
+    {
+        return;
+    }
+
+    std::vector<MegaHandle> children;
+    getWebDavListing(parent, &children);
+    std::vector<MegaHandle>::iterator it = std::find(children.begin(), children.end(), h);
+    if (it == children.end())
+    {
+        return;
+    }
+
+    // sequential if the previous file of the folder was streamed recently
+    WebDavNodeProps props;
+    MegaHandle previous = INVALID_HANDLE;
+    for (std::vector<MegaHandle>::iterator p = it; p != children.begin(); )
+    {
+        if (getWebDavNodeProps(*--p, &props) && !props.folder)
+        {
+            previous = *p;
+            break;
+        }
+    }
+    if (previous == INVALID_HANDLE)
+    {
+        return;
+    }
+
+    uv_mutex_lock(&folderPrefetchMutex);
+    recent = std::find(recentStreams.begin(), recentStreams.end(), previous) != recentStreams.end();
+    uv_mutex_unlock(&folderPrefetchMutex);
+    if (!recent)
+    {
+        return;
+    }
+
+    std::vector<MegaHandle> next;
+    while (++it != children.end() && int(next.size()) < files)
+    {
+        if (getWebDavNodeProps(*it, &props) && !props.folder)
+        {
+            next.push_back(*it);
+        }
+    }
+
+    if (next.size())
+    {
+        LOG_debug << "Sequential reading of a folder, prefetching " << next.size() << " files";
+        megaApi->prefetchStreaming(next, readAhead);
+    }
+}
+
+unsigned int MegaHTTPServer::getMediaBufferSize(MegaNode *node)
+{
+    int duration = node->getDuration();
+    if (mediaPrefetchTime <= 0 || duration <= 0)
+    {
+        return 0;
+    }
+
+    // the average bitrate of the file gives the bytes played per second
+    m_off_t size = node->getSize() / duration * mediaPrefetchTime;
+    if (size < MIN_MEDIA_BUFFER_SIZE)
+    {
+        size = MIN_MEDIA_BUFFER_SIZE;
+    }
+    else if (size > MAX_MEDIA_BUFFER_SIZE)
+    {
+        size = MAX_MEDIA_BUFFER_SIZE;
+    }
+    return unsigned(size);
+}
+
 char *MegaHTTPServer::getWebDavLink(MegaNode *node)
 {
     allowedWebDavHandles.insert(node->getHandle());
@@ -26116,7 +31063,8 @@ int MegaHTTPServer::onHeaderValue(http_parser *parser, const char *at, size_t le
     LOG_verbose << " onHeaderValue: " << httpctx->lastheader << " = " << value;
     if (httpctx->lastheader == "depth")
     {
-        httpctx->depth = atoi(value.c_str());
+        // -1 (as when the header is missing) for infinity
+        httpctx->depth = (value == "infinity") ? -1 : atoi(value.c_str());
     }
     else if (httpctx->lastheader == "host")
     {
@@ -26212,13 +31160,11 @@ int MegaHTTPServer::onBody(http_parser *parser, const char *b, size_t n)
     return 0;
 }
 
-string MegaHTTPServer::getWebDavProfFindNodeContents(MegaNode *node, string baseURL, bool offlineAttribute)
+string MegaHTTPServer::getWebDavPropFindNodeProps(MegaNode *node, bool offlineAttribute)
 {
     std::ostringstream web;
 
-    web << "<d:response>\r\n"
-           "<d:href>" << webdavurlescape(baseURL) << "</d:href>\r\n"
-           "<d:propstat>\r\n"
+    web << "<d:propstat>\r\n"
            "<d:status>HTTP/1.1 200 OK</d:status>\r\n"
            "<d:prop>\r\n"
            "<d:displayname>"<< webdavnameescape(node->getName()) << "</d:displayname>\r\n"
@@ -26251,46 +31197,297 @@ string MegaHTTPServer::getWebDavProfFindNodeContents(MegaNode *node, string base
     return web.str();
 }
 
-string MegaHTTPServer::getWebDavPropFindResponseForNode(string baseURL, string subnodepath, MegaNode *node, MegaHTTPContext* httpctx)
+void MegaHTTPServer::sendWebDavPropFindResponseForNode(string baseURL, string subnodepath, MegaNode *node, MegaHTTPContext* httpctx)
 {
-    std::ostringstream response;
-    std::ostringstream web;
-
-    web << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
-           "<d:multistatus xmlns:d=\"DAV:\" xmlns:Z=\"urn:schemas-microsoft-com::\">\r\n";
+    MegaHTTPServer* httpserver = dynamic_cast<MegaHTTPServer *>(httpctx->server);
 
     string subbaseURL = baseURL + subnodepath;
     if (node->isFolder() && subbaseURL.size() && subbaseURL.at(subbaseURL.size() - 1) != '/')
     {
         subbaseURL.append("/");
     }
-    MegaHTTPServer* httpserver = dynamic_cast<MegaHTTPServer *>(httpctx->server);
 
-    web << getWebDavProfFindNodeContents(node, subbaseURL, httpserver->isOfflineAttributeEnabled());
+    // the multistatus is produced as the connection drains, instead of being built whole:
+    // chunked for HTTP/1.1 clients, delimited by the end of the connection for older ones
+    httpctx->propFind = true;
+    httpctx->propFindListing = true;
+    httpctx->propFindChunked = httpctx->parser.http_major > 1
+            || (httpctx->parser.http_major == 1 && httpctx->parser.http_minor >= 1);
+    httpctx->propFindBody = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+                            "<d:multistatus xmlns:d=\"DAV:\" xmlns:Z=\"urn:schemas-microsoft-com::\">\r\n";
+    httpctx->propFindURL.clear();
+    httpctx->propFindChildren.clear();
+    httpctx->propFindIndex = 0;
+    httpctx->propFindFolders.clear();
+
+    WebDavNodeProps props;
+    if (httpserver->getWebDavNodeProps(node->getHandle(), &props))
+    {
+        httpctx->propFindBody.append("<d:response>\r\n<d:href>");
+        httpctx->propFindBody.append(webdavurlescape(subbaseURL));
+        httpctx->propFindBody.append("</d:href>\r\n");
+        httpctx->propFindBody.append(props.props);
+    }
+
     if (node->isFolder() && (httpctx->depth != 0))
     {
-        MegaNodeList *children = httpctx->megaApi->getChildren(node);
-        for (int i = 0; i < children->size(); i++)
+        httpctx->propFindFolders.push_back(std::make_pair(node->getHandle(), subbaseURL));
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 207 Multi-Status\r\n"
+                "content-type: application/xml; charset=utf-8\r\n"
+             << (httpctx->propFindChunked ? "transfer-encoding: chunked\r\n" : "")
+             << "connection: close\r\n"
+                "server: MEGAsdk\r\n"
+                "\r\n";
+
+    httpctx->resultCode = API_OK;
+    httpctx->lastBuffer = NULL;
+    httpctx->lastBufferLen = 0;
+    httpctx->streamingBuffer.init(PROPFIND_BUFFER_SIZE);
+
+    string resstr = response.str();
+    sendHeaders(httpctx, &resstr);
+    continuePropFindResponse(httpctx);
+}
+
+void MegaHTTPServer::continuePropFindResponse(MegaHTTPContext *httpctx)
+{
+    uv_mutex_lock(&httpctx->mutex);
+    unsigned int space = httpctx->streamingBuffer.availableSpace();
+    uv_mutex_unlock(&httpctx->mutex);
+
+    if (!httpctx->propFind || space < 2 * PROPFIND_CHUNK_MARGIN)
+    {
+        return;
+    }
+
+    // produce no more than what fits in the buffer; the rest waits for the connection to drain
+    size_t budget = space - PROPFIND_CHUNK_MARGIN;
+    while (httpctx->propFindBody.size() < budget)
+    {
+        if (!nextPropFindFragment(httpctx))
         {
-            MegaNode *child = children->get(i);
-            string childURL = subbaseURL + child->getName();
-            web << getWebDavProfFindNodeContents(child, childURL, httpserver->isOfflineAttributeEnabled());
+            break;
         }
-        delete children;
     }
 
-    web << "</d:multistatus>"
-           "\r\n";
+    size_t len = std::min(httpctx->propFindBody.size(), budget);
+    string chunk;
+    if (len && httpctx->propFindChunked)
+    {
+        std::ostringstream header;
+        header << std::hex << len << "\r\n";
+        chunk = header.str();
+    }
+    chunk.append(httpctx->propFindBody, 0, len);
+    httpctx->propFindBody.erase(0, len);
+    if (len && httpctx->propFindChunked)
+    {
+        chunk.append("\r\n");
+    }
 
-    string sweb = web.str();
-    response << "HTTP/1.1 207 Multi-Status\r\n"
-                "content-length: " << sweb.size() << "\r\n"
-                                                     "content-type: application/xml; charset=utf-8\r\n"
-                                                     "server: MEGAsdk\r\n"
-                                                     "\r\n";
-    response << sweb;
-    httpctx->resultCode = API_OK;
-    return response.str();
+    if (!httpctx->propFindListing && httpctx->propFindBody.empty())
+    {
+        if (httpctx->propFindChunked)
+        {
+            chunk.append("0\r\n\r\n");
+        }
+        httpctx->propFind = false;
+    }
+
+    if (chunk.empty())
+    {
+        return;
+    }
+
+    // written by sendNextBytes, on the next async event
+    uv_mutex_lock(&httpctx->mutex);
+    httpctx->streamingBuffer.append(chunk.data(), unsigned(chunk.size()));
+    httpctx->size += chunk.size();
+    uv_mutex_unlock(&httpctx->mutex);
+}
+
+bool MegaHTTPServer::nextPropFindFragment(MegaHTTPContext *httpctx)
+{
+    if (!httpctx->propFindListing)
+    {
+        return false;
+    }
+
+    MegaHTTPServer* httpserver = dynamic_cast<MegaHTTPServer *>(httpctx->server);
+    if (httpctx->propFindIndex < httpctx->propFindChildren.size())
+    {
+        WebDavNodeProps props;
+        if (!httpserver->getWebDavNodeProps(httpctx->propFindChildren[httpctx->propFindIndex++], &props))
+        {
+            // removed after the folder was listed
+            return true;
+        }
+
+        string childURL = httpctx->propFindURL + props.name;
+        if (props.folder && httpctx->depth < 0)
+        {
+            childURL.append("/");
+            httpctx->propFindFolders.push_back(std::make_pair(httpctx->propFindChildren[httpctx->propFindIndex - 1], childURL));
+        }
+
+        httpctx->propFindBody.append("<d:response>\r\n<d:href>");
+        httpctx->propFindBody.append(webdavurlescape(childURL));
+        httpctx->propFindBody.append("</d:href>\r\n");
+        httpctx->propFindBody.append(props.props);
+        return true;
+    }
+
+    if (httpctx->propFindFolders.size())
+    {
+        httpctx->propFindURL = httpctx->propFindFolders.front().second;
+        httpserver->getWebDavListing(httpctx->propFindFolders.front().first, &httpctx->propFindChildren);
+        httpctx->propFindIndex = 0;
+        httpctx->propFindFolders.pop_front();
+        return true;
+    }
+
+    httpctx->propFindBody.append("</d:multistatus>\r\n");
+    httpctx->propFindListing = false;
+    return false;
+}
+
+bool MegaHTTPServer::getWebDavNodeProps(MegaHandle h, WebDavNodeProps *props)
+{
+    uv_mutex_lock(&webDavCacheMutex);
+    map<MegaHandle, WebDavNodeProps>::iterator it = webDavNodeCache.find(h);
+    if (it != webDavNodeCache.end())
+    {
+        *props = it->second;
+        uv_mutex_unlock(&webDavCacheMutex);
+        return true;
+    }
+    unsigned int generation = webDavCacheGeneration;
+    uv_mutex_unlock(&webDavCacheMutex);
+
+    MegaNode *node = megaApi->getNodeByHandle(h);
+    if (!node)
+    {
+        return false;
+    }
+
+    props->name = node->getName() ? node->getName() : "";
+    props->props = getWebDavPropFindNodeProps(node, isOfflineAttributeEnabled());
+    props->folder = node->isFolder();
+    props->parent = node->getParentHandle();
+    delete node;
+
+    // not kept if the node might have changed meanwhile
+    uv_mutex_lock(&webDavCacheMutex);
+    if (generation == webDavCacheGeneration)
+    {
+        if (webDavNodeCache.size() >= MAX_WEBDAV_CACHED_NODES)
+        {
+            webDavNodeCache.clear();
+            webDavListingCache.clear();
+        }
+        webDavNodeCache[h] = *props;
+    }
+    uv_mutex_unlock(&webDavCacheMutex);
+    return true;
+}
+
+void MegaHTTPServer::getWebDavListing(MegaHandle h, std::vector<MegaHandle> *children)
+{
+    children->clear();
+
+    uv_mutex_lock(&webDavCacheMutex);
+    map<MegaHandle, std::vector<MegaHandle>>::iterator it = webDavListingCache.find(h);
+    if (it != webDavListingCache.end())
+    {
+        *children = it->second;
+        uv_mutex_unlock(&webDavCacheMutex);
+        return;
+    }
+    unsigned int generation = webDavCacheGeneration;
+    uv_mutex_unlock(&webDavCacheMutex);
+
+    MegaNode *node = megaApi->getNodeByHandle(h);
+    if (!node)
+    {
+        return;
+    }
+
+    // the properties of the children are produced at once, to have them ready for the listing
+    MegaNodeList *nodes = megaApi->getChildren(node);
+    std::vector<std::pair<MegaHandle, WebDavNodeProps>> entries;
+    entries.reserve(nodes->size());
+    children->reserve(nodes->size());
+    bool offline = isOfflineAttributeEnabled();
+    for (int i = 0; i < nodes->size(); i++)
+    {
+        MegaNode *child = nodes->get(i);
+        WebDavNodeProps props;
+        props.name = child->getName() ? child->getName() : "";
+        props.props = getWebDavPropFindNodeProps(child, offline);
+        props.folder = child->isFolder();
+        props.parent = h;
+        entries.push_back(std::make_pair(child->getHandle(), std::move(props)));
+        children->push_back(child->getHandle());
+    }
+    delete nodes;
+    delete node;
+
+    uv_mutex_lock(&webDavCacheMutex);
+    if (generation == webDavCacheGeneration)
+    {
+        if (webDavNodeCache.size() + entries.size() > MAX_WEBDAV_CACHED_NODES)
+        {
+            webDavNodeCache.clear();
+            webDavListingCache.clear();
+        }
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            webDavNodeCache[entries[i].first] = std::move(entries[i].second);
+        }
+        webDavListingCache[h] = *children;
+    }
+    uv_mutex_unlock(&webDavCacheMutex);
+}
+
+void MegaHTTPServer::clearWebDavCache()
+{
+    uv_mutex_lock(&webDavCacheMutex);
+    webDavNodeCache.clear();
+    webDavListingCache.clear();
+    webDavCacheGeneration++;
+    uv_mutex_unlock(&webDavCacheMutex);
+}
+
+void MegaHTTPServer::onNodesUpdated(Node **n, int count)
+{
+    if (!n)
+    {
+        clearWebDavCache();
+        return;
+    }
+
+    uv_mutex_lock(&webDavCacheMutex);
+    for (int i = 0; i < count; i++)
+    {
+        // the node itself, its listing, and those of its current and previous parents
+        handle h = n[i]->nodehandle;
+        map<MegaHandle, WebDavNodeProps>::iterator it = webDavNodeCache.find(h);
+        if (it != webDavNodeCache.end())
+        {
+            webDavListingCache.erase(it->second.parent);
+            webDavNodeCache.erase(it);
+        }
+        webDavListingCache.erase(h);
+        if (n[i]->parent)
+        {
+            webDavListingCache.erase(n[i]->parent->nodehandle);
+        }
+    }
+    webDavCacheGeneration++;
+    uv_mutex_unlock(&webDavCacheMutex);
 }
 
 string MegaHTTPServer::getResponseForNode(MegaNode *node, MegaHTTPContext* httpctx)
@@ -26646,6 +31843,12 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
     MegaNode *node = NULL;
     std::ostringstream response;
     MegaHTTPContext* httpctx = (MegaHTTPContext*) parser->data;
+
+    // on a persistent connection, the next request is parsed once this one has been answered
+    if (http_should_keep_alive(parser))
+    {
+        http_parser_pause(parser, 1);
+    }
     httpctx->bytesWritten = 0;
     httpctx->size = 0;
     httpctx->streamingBuffer.setMaxBufferSize(httpctx->server->getMaxBufferSize());
@@ -26682,6 +31885,33 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         return 0;
     }
 
+    if (httpctx->path == "/metrics" && httpserver->isMetricsEnabled()
+            && (parser->method == HTTP_GET || parser->method == HTTP_HEAD))
+    {
+        // the snapshot kept by the SDK thread, not to wait for it
+        string metrics = httpctx->megaApi->getMetricsSnapshot();
+        if (metrics.empty())
+        {
+            returnHttpCode(httpctx, 503);
+            return 0;
+        }
+
+        response << "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                    "Content-Length: " << metrics.size() << "\r\n"
+                    "Connection: close\r\n"
+                    "\r\n";
+        if (parser->method == HTTP_GET)
+        {
+            response << metrics;
+        }
+
+        httpctx->resultCode = API_OK;
+        string resstr = response.str();
+        sendHeaders(httpctx, &resstr);
+        return 0;
+    }
+
     if (httpctx->path == "/favicon.ico")
     {
         LOG_debug << "Favicon requested";
@@ -26904,8 +32134,7 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
     {
         string baseURL = string("http") + (httpctx->server->useTLS ? "s" : "") + "://"
                 + httpctx->host + "/" + httpctx->nodehandle + "/" + httpctx->nodename + "/";
-        string resstr = getWebDavPropFindResponseForNode(baseURL, httpctx->subpathrelative, node, httpctx);
-        sendHeaders(httpctx, &resstr);
+        sendWebDavPropFindResponseForNode(baseURL, httpctx->subpathrelative, node, httpctx);
         delete node;
         delete baseNode;
         return 0;
@@ -27513,8 +32742,12 @@ int MegaHTTPServer::streamNode(MegaHTTPContext *httpctx)
         response << "HTTP/1.1 200 OK\r\n";
     }
 
+    // ranges of files are served on persistent connections, the rest of responses close them
+    httpctx->keepAlive = len > 0 && http_should_keep_alive(&httpctx->parser)
+            && (httpctx->parser.method == HTTP_GET || httpctx->parser.method == HTTP_HEAD);
+
     response << "Content-Type: " << mimeType << "\r\n"
-        << "Connection: close\r\n"
+        << (httpctx->keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n")
         << "Content-Length: " << len << "\r\n"
         << "Access-Control-Allow-Origin: *\r\n"
         << "Accept-Ranges: bytes\r\n"
@@ -27533,6 +32766,13 @@ int MegaHTTPServer::streamNode(MegaHTTPContext *httpctx)
     string resstr = response.str();
     if (httpctx->parser.method != HTTP_HEAD)
     {
+        MegaHTTPServer *httpserver = ((MegaHTTPServer *)httpctx->server);
+        unsigned int mediaBufferSize = httpserver->getMediaBufferSize(node);
+        if (mediaBufferSize)
+        {
+            LOG_debug << "Media buffer of " << mediaBufferSize << " bytes";
+            httpctx->streamingBuffer.setMaxBufferSize(mediaBufferSize);
+        }
         httpctx->streamingBuffer.init(len + resstr.size());
         httpctx->size = len;
     }
@@ -27548,6 +32788,7 @@ int MegaHTTPServer::streamNode(MegaHTTPContext *httpctx)
     if (start || len)
     {
         httpctx->megaApi->startStreaming(node, start, len, httpctx);
+        ((MegaHTTPServer *)httpctx->server)->prefetchFolder(node);
     }
     else
     {
@@ -27680,25 +32921,45 @@ void MegaHTTPServer::sendNextBytes(MegaHTTPContext *httpctx)
         return;
     }
 
-    uv_buf_t resbuf = httpctx->streamingBuffer.nextBuffer();
+    // the data is written from the ring buffer itself, across its end if needed, and
+    // released by processWriteFinished once the write has finished
+    uv_buf_t resbufs[2];
+    unsigned int count;
+#ifdef ENABLE_EVT_TLS
+    if (httpctx->server->useTLS)
+    {
+        resbufs[0] = httpctx->streamingBuffer.nextBuffer();
+        count = resbufs[0].len ? 1 : 0;
+    }
+    else
+#endif
+    {
+        count = httpctx->streamingBuffer.nextBuffers(resbufs);
+    }
     uv_mutex_unlock(&httpctx->mutex);
 
-    if (!resbuf.len)
+    if (!count)
     {
         LOG_verbose << "Skipping write. No data available";
         return;
     }
 
-    LOG_verbose << "Writing " << resbuf.len << " bytes";
-    httpctx->rangeWritten += resbuf.len;
-    httpctx->lastBuffer = resbuf.base;
-    httpctx->lastBufferLen = resbuf.len;
+    unsigned int len = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        len += unsigned(resbufs[i].len);
+    }
+
+    LOG_verbose << "Writing " << len << " bytes";
+    httpctx->rangeWritten += len;
+    httpctx->lastBuffer = resbufs[0].base;
+    httpctx->lastBufferLen = len;
 
 #ifdef ENABLE_EVT_TLS
     if (httpctx->server->useTLS)
     {
         //notice this, contrary to !useTLS is synchronous
-        int err = evt_tls_write(httpctx->evt_tls, resbuf.base, resbuf.len, onWriteFinished_tls);
+        int err = evt_tls_write(httpctx->evt_tls, resbufs[0].base, resbufs[0].len, onWriteFinished_tls);
         if (err <= 0)
         {
             LOG_warn << "Finishing due to an error sending the response: " << err;
@@ -27711,7 +32972,7 @@ void MegaHTTPServer::sendNextBytes(MegaHTTPContext *httpctx)
         uv_write_t *req = new uv_write_t();
         req->data = httpctx;
 
-        if (int err = uv_write(req, (uv_stream_t*)&httpctx->tcphandle, &resbuf, 1, onWriteFinished))
+        if (int err = uv_write(req, (uv_stream_t*)&httpctx->tcphandle, resbufs, count, onWriteFinished))
         {
             delete req;
             LOG_warn << "Finishing due to an error in uv_write: " << err;
@@ -27747,6 +33008,11 @@ MegaHTTPContext::MegaHTTPContext()
     overwrite = true; //GVFS-DAV via command line does not include this header (assumed true)
     lastBuffer = NULL;
     lastBufferLen = 0;
+    keepAlive = false;
+    propFind = false;
+    propFindListing = false;
+    propFindChunked = false;
+    propFindIndex = 0;
 
     // Mutex to protect the data buffer
     uv_mutex_init(&mutex_responses);
@@ -27979,6 +33245,7 @@ MegaFTPServer::MegaFTPServer(MegaApiImpl *megaApi, string basePath, int dataport
     this->dataPortEnd = dataPortEnd;
 
     crlfout = "\r\n";
+    uv_mutex_init(&mutex_idleDataServers);
 }
 
 MegaFTPServer::~MegaFTPServer()
@@ -27986,6 +33253,59 @@ MegaFTPServer::~MegaFTPServer()
     // if not stopped, the uv thread might want to access a pointer to this.
     // though this is done in the parent destructor, it could try to access it after vtable has been erased
     stop();
+
+    for (list<MegaFTPDataServer *>::iterator it = idleDataServers.begin(); it != idleDataServers.end(); it++)
+    {
+        delete *it;
+    }
+    idleDataServers.clear();
+    uv_mutex_destroy(&mutex_idleDataServers);
+}
+
+MegaFTPDataServer *MegaFTPServer::takeIdleDataServer(MegaFTPContext *ftpctx)
+{
+    MegaFTPDataServer *fds = NULL;
+    uv_mutex_lock(&mutex_idleDataServers);
+    while (!fds && idleDataServers.size())
+    {
+        fds = idleDataServers.front();
+        idleDataServers.pop_front();
+        if (!fds->isIdle())
+        {
+            // a client connected to its port while it was pooled
+            delete fds;
+            fds = NULL;
+        }
+    }
+    uv_mutex_unlock(&mutex_idleDataServers);
+
+    if (fds)
+    {
+        fds->setControlContext(ftpctx);
+    }
+    return fds;
+}
+
+void MegaFTPServer::releaseDataServer(MegaFTPDataServer *fds)
+{
+    if (!closing && fds->isIdle())
+    {
+        uv_mutex_lock(&mutex_idleDataServers);
+        if (idleDataServers.size() < MAX_IDLE_DATA_SERVERS)
+        {
+            LOG_verbose << "Keeping idle MegaFTPDataServer on port " << fds->getPort();
+            fds->setControlContext(NULL);
+            idleDataServers.push_back(fds);
+            fds = NULL;
+        }
+        uv_mutex_unlock(&mutex_idleDataServers);
+    }
+
+    if (fds)
+    {
+        LOG_verbose << "Deleting ftpDataServer associated with ftp context";
+        delete fds;
+    }
 }
 
 MegaTCPContext* MegaFTPServer::initializeContext(uv_stream_t *server_handle)
@@ -28896,6 +34216,17 @@ void MegaFTPServer::processReceivedData(MegaTCPContext *tcpctx, ssize_t nread, c
         case FTP_CMD_PASV:
         case FTP_CMD_EPSV:
         {
+            if (!ftpctx->ftpDataServer)
+            {
+                // a data server of a closed control connection is already listening on its port
+                ftpctx->ftpDataServer = takeIdleDataServer(ftpctx);
+                if (ftpctx->ftpDataServer)
+                {
+                    ftpctx->pasiveport = ftpctx->ftpDataServer->getPort();
+                    LOG_debug << "Reusing idle MegaFTPDataServer on port " << ftpctx->pasiveport;
+                }
+            }
+
             if (!ftpctx->ftpDataServer)
             {
                 if (pport > (dataPortEnd))
@@ -29577,8 +34908,7 @@ MegaFTPContext::~MegaFTPContext()
 {
     if (ftpDataServer)
     {
-        LOG_verbose << "Deleting ftpDataServer associated with ftp context";
-        delete ftpDataServer;
+        dynamic_cast<MegaFTPServer *>(server)->releaseDataServer(ftpDataServer);
     }
     if (tmpFileName.size())
     {
@@ -29774,6 +35104,24 @@ MegaFTPDataServer::~MegaFTPDataServer()
     LOG_verbose << "MegaFTPDataServer::~MegaFTPDataServer. end";
 }
 
+bool MegaFTPDataServer::isIdle()
+{
+    return started && !closing && connections.empty();
+}
+
+void MegaFTPDataServer::setControlContext(MegaFTPContext *controlftpctx)
+{
+    this->controlftpctx = controlftpctx;
+    delete nodeToDownload;
+    nodeToDownload = NULL;
+    resultmsj.clear();
+    remotePathToUpload.clear();
+    newNameToUpload.clear();
+    newParentNodeHandle = UNDEF;
+    rangeStartREST = 0;
+    notifyNewConnectionRequired = false;
+}
+
 MegaTCPContext* MegaFTPDataServer::initializeContext(uv_stream_t *server_handle)
 {
     MegaFTPDataContext* ftpctx = new MegaFTPDataContext();
@@ -30031,6 +35379,12 @@ void MegaFTPDataServer::processAsyncEvent(MegaTCPContext *tcpctx)
         return;
     }
 
+    if (!fds->controlftpctx)
+    {
+        LOG_debug << "FTP DATA server pooled, closing connection";
+        closeConnection(ftpdatactx);
+        return;
+    }
 
     uv_mutex_lock(&fds->controlftpctx->mutex_nodeToDownload);
 
@@ -30154,7 +35508,7 @@ void MegaFTPDataServer::processOnAsyncEventClose(MegaTCPContext* tcpctx)
         fds->stop(true);
     }
 
-    if (!ftpdatactx->controlRespondedElsewhere && fds->started && !this->controlftpctx->finished)
+    if (!ftpdatactx->controlRespondedElsewhere && fds->started && this->controlftpctx && !this->controlftpctx->finished)
     {
         LOG_debug << "MegaFTPDataServer::processOnAsyncEventClose port = " << fds->port << ". Responding " << ftpdatactx->controlResponseCode << ". " << ftpdatactx->controlResponseMessage;
         MegaFTPServer* ftpControlServer = dynamic_cast<MegaFTPServer *>(fds->controlftpctx->server);
@@ -30207,25 +35561,45 @@ void MegaFTPDataServer::sendNextBytes(MegaFTPDataContext *ftpdatactx)
         return;
     }
 
-    uv_buf_t resbuf = ftpdatactx->streamingBuffer.nextBuffer();
+    // as for HTTP, the data is written from the ring buffer itself, across its end if needed,
+    // and released by processWriteFinished once the write has finished
+    uv_buf_t resbufs[2];
+    unsigned int count;
+#ifdef ENABLE_EVT_TLS
+    if (ftpdatactx->server->useTLS)
+    {
+        resbufs[0] = ftpdatactx->streamingBuffer.nextBuffer();
+        count = resbufs[0].len ? 1 : 0;
+    }
+    else
+#endif
+    {
+        count = ftpdatactx->streamingBuffer.nextBuffers(resbufs);
+    }
     uv_mutex_unlock(&ftpdatactx->mutex);
 
-    if (!resbuf.len)
+    if (!count)
     {
         LOG_verbose << "Skipping write. No data available." << " buffered = " << ftpdatactx->streamingBuffer.availableData();
         return;
     }
 
-    LOG_verbose << "Writing " << resbuf.len << " bytes" << " buffered = " << ftpdatactx->streamingBuffer.availableData();
-    ftpdatactx->rangeWritten += resbuf.len;
-    ftpdatactx->lastBuffer = resbuf.base;
-    ftpdatactx->lastBufferLen = resbuf.len;
+    unsigned int len = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        len += unsigned(resbufs[i].len);
+    }
+
+    LOG_verbose << "Writing " << len << " bytes" << " buffered = " << ftpdatactx->streamingBuffer.availableData();
+    ftpdatactx->rangeWritten += len;
+    ftpdatactx->lastBuffer = resbufs[0].base;
+    ftpdatactx->lastBufferLen = len;
 
 #ifdef ENABLE_EVT_TLS
     if (ftpdatactx->server->useTLS)
     {
         //notice this, contrary to !useTLS is synchronous
-        int err = evt_tls_write(ftpdatactx->evt_tls, resbuf.base, resbuf.len, onWriteFinished_tls);
+        int err = evt_tls_write(ftpdatactx->evt_tls, resbufs[0].base, resbufs[0].len, onWriteFinished_tls);
         if (err <= 0)
         {
             LOG_warn << "Finishing due to an error sending the response: " << err;
@@ -30238,7 +35612,7 @@ void MegaFTPDataServer::sendNextBytes(MegaFTPDataContext *ftpdatactx)
         uv_write_t *req = new uv_write_t();
         req->data = ftpdatactx;
 
-        if (int err = uv_write(req, (uv_stream_t*)&ftpdatactx->tcphandle, &resbuf, 1, onWriteFinished))
+        if (int err = uv_write(req, (uv_stream_t*)&ftpdatactx->tcphandle, resbufs, count, onWriteFinished))
         {
             delete req;
             LOG_warn << "Finishing due to an error in uv_write: " << err;
@@ -30854,6 +36228,7 @@ const char *MegaEventPrivate::getEventString(int type)
         case MegaEvent::EVENT_BUSINESS_STATUS: return "BUSINESS_STATUS";
         case MegaEvent::EVENT_KEY_MODIFIED: return "KEY_MODIFIED";
         case MegaEvent::EVENT_MISC_FLAGS_READY: return "MISC_FLAGS_READY";
+        case MegaEvent::EVENT_NODES_CACHED: return "EVENT_NODES_CACHED";
     }
 
     return "UNKNOWN";
@@ -30906,6 +36281,864 @@ void MegaHandleListPrivate::addMegaHandle(MegaHandle h)
     mList.push_back(h);
 }
 
+MegaNodeChangeListPrivate::MegaNodeChangeListPrivate()
+{
+
+}
+
+MegaNodeChangeListPrivate::MegaNodeChangeListPrivate(Node** newlist, int size)
+{
+    mList.reserve(size);
+    for (int i = 0; i < size; i++)
+    {
+        add(newlist[i]->nodehandle, MegaNodePrivate::changesOf(newlist[i]));
+    }
+}
+
+MegaNodeChangeListPrivate::MegaNodeChangeListPrivate(const MegaNodeChangeListPrivate *changeList)
+{
+    mList = changeList->mList;
+}
+
+MegaNodeChangeList *MegaNodeChangeListPrivate::copy() const
+{
+    return new MegaNodeChangeListPrivate(this);
+}
+
+MegaHandle MegaNodeChangeListPrivate::getHandle(int i) const
+{
+    return (i >= 0 && size_t(i) < mList.size()) ? mList[i].first : INVALID_HANDLE;
+}
+
+int MegaNodeChangeListPrivate::getChanges(int i) const
+{
+    return (i >= 0 && size_t(i) < mList.size()) ? mList[i].second : 0;
+}
+
+int MegaNodeChangeListPrivate::size() const
+{
+    return int(mList.size());
+}
+
+void MegaNodeChangeListPrivate::add(MegaHandle h, int changes)
+{
+    mList.push_back(std::make_pair(h, changes));
+}
+
+MegaNodeSnapshotPrivate::MegaNodeSnapshotPrivate(MegaApiImpl *api, long long generation, const char *scsn, const node_vector &nodes)
+    : mGeneration(generation), mScsn(scsn), mCount(int(nodes.size()))
+{
+    vector<Record> records(nodes.size());
+    string strings;
+    size_t base = nodes.size() * sizeof(Record);
+    bool pending = false;
+
+    mPending.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        Node *n = nodes[i];
+        if (api && n->lazy)
+        {
+            // the skeleton has all but the strings and the modification time
+            Record &r = records[i];
+            r.handle = n->nodehandle;
+            r.parenthandle = n->parent ? n->parent->nodehandle : INVALID_HANDLE;
+            r.size = n->size;
+            r.mtime = 0;
+            r.name = 0;
+            r.fingerprint = 0;
+            r.type = n->type;
+            r.reserved = 0;
+            mPending[i] = 1;
+            pending = true;
+        }
+        else
+        {
+            fillRecord(n, records[i], base, &strings);
+        }
+    }
+
+    mBuffer.reserve(base + strings.size());
+    mBuffer.assign(reinterpret_cast<const char *>(records.data()), base);
+    mBuffer.append(strings);
+
+    if (pending)
+    {
+        mLateStrings.resize(nodes.size());
+        attach(api);
+    }
+    else
+    {
+        mPending.clear();
+    }
+}
+
+MegaNodeSnapshotPrivate::MegaNodeSnapshotPrivate(const MegaNodeSnapshotPrivate &snapshot)
+    : MegaNodeSnapshot(), LazyNodeEntries()
+{
+    MegaApiImpl *sourceApi = snapshot.api;
+    std::unique_lock<std::recursive_timed_mutex> g;
+    if (sourceApi)
+    {
+        g = std::unique_lock<std::recursive_timed_mutex>(sourceApi->sdkMutex);
+        sourceApi = snapshot.api;  // may have been detached meanwhile
+    }
+
+    mGeneration = snapshot.mGeneration;
+    mScsn = snapshot.mScsn;
+    mCount = snapshot.mCount;
+    mBuffer = snapshot.mBuffer;
+    mPending = snapshot.mPending;
+    mLateStrings.resize(snapshot.mLateStrings.size());
+    for (size_t i = 0; i < mLateStrings.size(); i++)
+    {
+        if (snapshot.mLateStrings[i])
+        {
+            mLateStrings[i].reset(new string(*snapshot.mLateStrings[i]));
+        }
+    }
+
+    if (sourceApi)
+    {
+        attach(sourceApi);
+    }
+}
+
+MegaNodeSnapshotPrivate::~MegaNodeSnapshotPrivate()
+{
+    release();
+}
+
+size_t MegaNodeSnapshotPrivate::entryCount() const
+{
+    return mPending.size();
+}
+
+handle MegaNodeSnapshotPrivate::entryHandle(size_t i) const
+{
+    return record(int(i))->handle;
+}
+
+bool MegaNodeSnapshotPrivate::entryLoaded(size_t i) const
+{
+    return !mPending[i];
+}
+
+void MegaNodeSnapshotPrivate::loadEntry(size_t i) const
+{
+    MegaApiImpl *currentApi = api;
+    if (!mPending[i] || !currentApi)
+    {
+        return;
+    }
+
+    Record &r = *reinterpret_cast<Record *>(&mBuffer[0] + i * sizeof(Record));
+    if (Node *n = currentApi->client->nodebyhandle(r.handle))
+    {
+        // offsets from the start of the strings of the entry
+        Record filled;
+        string *strings = new string();
+        fillRecord(n, filled, 0, strings);
+        r.mtime = filled.mtime;
+        r.name = filled.name;
+        r.fingerprint = filled.fingerprint;
+        mLateStrings[i].reset(strings);
+    }
+    else
+    {
+        // gone before its entry was read: no name
+        mLateStrings[i].reset(new string(1, '\0'));
+    }
+    mPending[i] = 0;
+}
+
+const MegaNodeSnapshotPrivate::Record *MegaNodeSnapshotPrivate::loadedRecord(int i) const
+{
+    const Record *r = record(i);
+    if (r && !mPending.empty())
+    {
+        MegaApiImpl *currentApi = api;
+        if (currentApi)
+        {
+            MegaApiImpl::SdkMutexGuard g(currentApi->sdkMutex);
+            loadEntry(size_t(i));
+        }
+    }
+    return r;
+}
+
+const string &MegaNodeSnapshotPrivate::buffer() const
+{
+    if (mPending.empty())
+    {
+        return mBuffer;
+    }
+
+    std::lock_guard<std::mutex> fg(mFullBufferMutex);
+    if (mFullBuffer.empty())
+    {
+        MegaApiImpl *currentApi = api;
+        if (currentApi)
+        {
+            MegaApiImpl::SdkMutexGuard g(currentApi->sdkMutex);
+            for (int i = 0; i < mCount; i++)
+            {
+                loadEntry(size_t(i));
+            }
+        }
+
+        // the strings read on first access go after the others, with the offsets updated
+        size_t base = mCount * sizeof(Record);
+        string strings = mBuffer.substr(base);
+        vector<Record> records(reinterpret_cast<const Record *>(mBuffer.data()),
+                               reinterpret_cast<const Record *>(mBuffer.data()) + mCount);
+        for (int i = 0; i < mCount; i++)
+        {
+            if (const string *late = mLateStrings[i].get())
+            {
+                uint32_t offset = uint32_t(base + strings.size());
+                records[i].name += offset;
+                if (records[i].fingerprint)
+                {
+                    records[i].fingerprint += offset;
+                }
+                strings.append(*late);
+            }
+        }
+
+        mFullBuffer.reserve(base + strings.size());
+        mFullBuffer.assign(reinterpret_cast<const char *>(records.data()), base);
+        mFullBuffer.append(strings);
+    }
+    return mFullBuffer;
+}
+
+void MegaNodeSnapshotPrivate::fillRecord(Node *n, Record &r, size_t base, string *strings)
+{
+    n->materialize();
+
+    r.handle = n->nodehandle;
+    r.parenthandle = n->parent ? n->parent->nodehandle : INVALID_HANDLE;
+    r.size = n->size;
+    r.mtime = n->mtime;
+    r.type = n->type;
+    r.reserved = 0;
+
+    r.name = uint32_t(base + strings->size());
+    strings->append(n->displayname());
+    strings->push_back('\0');
+
+    string fingerprint;
+    if (n->isvalid)
+    {
+        fingerprint = megaFingerprintOf(n);
+    }
+    else
+    {
+        attr_map::const_iterator it = n->attrs.map.find('c');
+        if (it != n->attrs.map.end())
+        {
+            fingerprint = it->second;
+        }
+    }
+
+    r.fingerprint = 0;
+    if (!fingerprint.empty())
+    {
+        r.fingerprint = uint32_t(base + strings->size());
+        strings->append(fingerprint);
+        strings->push_back('\0');
+    }
+}
+
+MegaNodeSnapshot *MegaNodeSnapshotPrivate::copy() const
+{
+    return new MegaNodeSnapshotPrivate(*this);
+}
+
+const MegaNodeSnapshotPrivate::Record *MegaNodeSnapshotPrivate::record(int i) const
+{
+    return (i >= 0 && i < mCount) ? reinterpret_cast<const Record *>(mBuffer.data()) + i : NULL;
+}
+
+long long MegaNodeSnapshotPrivate::getGeneration() const
+{
+    return mGeneration;
+}
+
+const char *MegaNodeSnapshotPrivate::getSequenceNumber() const
+{
+    return mScsn.c_str();
+}
+
+int MegaNodeSnapshotPrivate::size() const
+{
+    return mCount;
+}
+
+MegaHandle MegaNodeSnapshotPrivate::getHandle(int i) const
+{
+    const Record *r = record(i);
+    return r ? r->handle : INVALID_HANDLE;
+}
+
+MegaHandle MegaNodeSnapshotPrivate::getParentHandle(int i) const
+{
+    const Record *r = record(i);
+    return r ? r->parenthandle : INVALID_HANDLE;
+}
+
+int MegaNodeSnapshotPrivate::getType(int i) const
+{
+    const Record *r = record(i);
+    return r ? r->type : MegaNode::TYPE_UNKNOWN;
+}
+
+int64_t MegaNodeSnapshotPrivate::getSize(int i) const
+{
+    const Record *r = record(i);
+    return r ? r->size : 0;
+}
+
+int64_t MegaNodeSnapshotPrivate::getModificationTime(int i) const
+{
+    const Record *r = loadedRecord(i);
+    return r ? r->mtime : 0;
+}
+
+const char *MegaNodeSnapshotPrivate::getName(int i) const
+{
+    const Record *r = loadedRecord(i);
+    if (!r)
+    {
+        return NULL;
+    }
+
+    if (!mLateStrings.empty() && mLateStrings[i])
+    {
+        return mLateStrings[i]->c_str() + r->name;
+    }
+    return mBuffer.data() + r->name;
+}
+
+const char *MegaNodeSnapshotPrivate::getFingerprint(int i) const
+{
+    const Record *r = loadedRecord(i);
+    if (!r || !r->fingerprint)
+    {
+        return NULL;
+    }
+
+    if (!mLateStrings.empty() && mLateStrings[i])
+    {
+        return mLateStrings[i]->c_str() + r->fingerprint;
+    }
+    return mBuffer.data() + r->fingerprint;
+}
+
+const char *MegaNodeSnapshotPrivate::getBuffer() const
+{
+    return buffer().data();
+}
+
+size_t MegaNodeSnapshotPrivate::getBufferSize() const
+{
+    return buffer().size();
+}
+
+static string sharedNodeTreeSegment(const string &name, uint64_t segment)
+{
+    return name + "." + std::to_string(segment);
+}
+
+SharedNodeTreeControl *SharedNodeTreeExport::control() const
+{
+    return reinterpret_cast<SharedNodeTreeControl *>(mControl.data());
+}
+
+SharedNodeTreeHeader *SharedNodeTreeExport::header() const
+{
+    return mData ? reinterpret_cast<SharedNodeTreeHeader *>(mData->data()) : NULL;
+}
+
+bool SharedNodeTreeExport::start(const string &name)
+{
+    // left behind by a process that didn't stop its export
+    SharedMemory::remove(name);
+
+    if (!mControl.create(name, sizeof(SharedNodeTreeControl)))
+    {
+        return false;
+    }
+
+    mName = name;
+    SharedNodeTreeControl *c = new (mControl.data()) SharedNodeTreeControl();
+    c->magic = SharedNodeTreeControl::MAGIC;
+    c->version = SharedNodeTreeControl::VERSION;
+    c->segment.store(0);
+
+    // readers tell the regions of different exports apart by their number
+    mSegment = uint64_t(m_time()) << 20;
+
+    LOG_info << "Exporting the node tree to " << name;
+    return true;
+}
+
+bool SharedNodeTreeExport::publish(const MegaNodeSnapshotPrivate &snapshot)
+{
+    size_t snapshotoffset = (sizeof(SharedNodeTreeHeader) + 63) & ~size_t(63);
+    size_t snapshotsize = snapshot.getBufferSize();
+    size_t logoffset = snapshotoffset + ((snapshotsize + 7) & ~size_t(7));
+    size_t logcapacity = std::max(size_t(MINLOGCAPACITY), snapshotsize / 4) & ~size_t(7);
+
+    uint64_t segment = mSegment + 1;
+    string name = sharedNodeTreeSegment(mName, segment);
+    SharedMemory::remove(name);
+
+    std::unique_ptr<SharedMemory> data(new SharedMemory());
+    if (!data->create(name, logoffset + logcapacity))
+    {
+        return false;
+    }
+
+    SharedNodeTreeHeader *h = new (data->data()) SharedNodeTreeHeader();
+    h->magic = SharedNodeTreeControl::MAGIC;
+    h->version = SharedNodeTreeControl::VERSION;
+    h->generation = snapshot.getGeneration();
+    h->snapshotoffset = snapshotoffset;
+    h->snapshotsize = snapshotsize;
+    h->logoffset = logoffset;
+    h->logcapacity = logcapacity;
+    h->nodes = uint32_t(snapshot.size());
+    h->reserved = 0;
+    h->logsize.store(0);
+    memcpy(data->data() + snapshotoffset, snapshot.getBuffer(), snapshotsize);
+
+    // the readers move to the new region, and keep the previous one mapped
+    // until then
+    control()->segment.store(segment, std::memory_order_release);
+    if (mData)
+    {
+        SharedMemory::remove(sharedNodeTreeSegment(mName, mSegment));
+    }
+
+    mData = std::move(data);
+    mSegment = segment;
+    stale = false;
+
+    LOG_debug << "Node tree exported: " << snapshot.size() << " nodes, " << snapshotsize << " bytes";
+    return true;
+}
+
+bool SharedNodeTreeExport::append(Node *n, int changes, long long generation)
+{
+    SharedNodeTreeHeader *h = header();
+    if (!h)
+    {
+        return false;
+    }
+
+    SharedNodeTreeLogEntry entry;
+    string strings;
+    MegaNodeSnapshotPrivate::fillRecord(n, entry.record, sizeof entry, &strings);
+    entry.changes = changes;
+    entry.generation = generation;
+    entry.size = uint32_t((sizeof entry + strings.size() + 7) & ~size_t(7));
+
+    uint64_t logsize = h->logsize.load(std::memory_order_relaxed);
+    if (logsize + entry.size > h->logcapacity)
+    {
+        return false;
+    }
+
+    byte *p = mData->data() + h->logoffset + logsize;
+    memcpy(p, &entry, sizeof entry);
+    memcpy(p + sizeof entry, strings.data(), strings.size());
+    h->logsize.store(logsize + entry.size, std::memory_order_release);
+    return true;
+}
+
+SharedNodeTreeExport::~SharedNodeTreeExport()
+{
+    if (!mControl.data())
+    {
+        return;
+    }
+
+    control()->segment.store(0, std::memory_order_release);
+    if (mData)
+    {
+        SharedMemory::remove(sharedNodeTreeSegment(mName, mSegment));
+    }
+    SharedMemory::remove(mName);
+
+    LOG_info << "Node tree export stopped: " << mName;
+}
+
+MegaSharedNodeTreePrivate *MegaSharedNodeTreePrivate::open(const char *name)
+{
+    if (!name)
+    {
+        return NULL;
+    }
+
+    std::unique_ptr<MegaSharedNodeTreePrivate> tree(new MegaSharedNodeTreePrivate());
+    tree->mName = name;
+    if (!tree->mControl.open(name) || tree->mControl.size() < sizeof(SharedNodeTreeControl))
+    {
+        return NULL;
+    }
+
+    const SharedNodeTreeControl *c = reinterpret_cast<const SharedNodeTreeControl *>(tree->mControl.data());
+    if (c->magic != SharedNodeTreeControl::MAGIC || c->version != SharedNodeTreeControl::VERSION)
+    {
+        return NULL;
+    }
+
+    tree->refresh();
+    return tree.release();
+}
+
+bool MegaSharedNodeTreePrivate::refresh()
+{
+    const SharedNodeTreeControl *c = reinterpret_cast<const SharedNodeTreeControl *>(mControl.data());
+    bool changed = false;
+
+    // the writer can move on again before the new region is opened
+    for (int i = 3; i--; )
+    {
+        uint64_t segment = c->segment.load(std::memory_order_acquire);
+        if (!segment || segment == mSegment)
+        {
+            break;
+        }
+
+        if (load(segment))
+        {
+            changed = true;
+            break;
+        }
+    }
+
+    if (!mData)
+    {
+        return changed;
+    }
+
+    const SharedNodeTreeHeader *h = reinterpret_cast<const SharedNodeTreeHeader *>(mData->data());
+    const char *log = reinterpret_cast<const char *>(mData->data()) + h->logoffset;
+    uint64_t logsize = std::min(h->logsize.load(std::memory_order_acquire), h->logcapacity);
+
+    while (mLogRead + sizeof(SharedNodeTreeLogEntry) <= logsize)
+    {
+        const SharedNodeTreeLogEntry *e = reinterpret_cast<const SharedNodeTreeLogEntry *>(log + mLogRead);
+        if (e->size < sizeof(SharedNodeTreeLogEntry) || mLogRead + e->size > logsize)
+        {
+            LOG_err << "Invalid entry in the shared node tree " << mName;
+            break;
+        }
+
+        apply(e->record, reinterpret_cast<const char *>(e), e->size, (e->changes & MegaNode::CHANGE_TYPE_REMOVED) != 0);
+        mGeneration = e->generation;
+        mLogRead += e->size;
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool MegaSharedNodeTreePrivate::load(uint64_t segment)
+{
+    std::unique_ptr<SharedMemory> data(new SharedMemory());
+    if (!data->open(sharedNodeTreeSegment(mName, segment)) || data->size() < sizeof(SharedNodeTreeHeader))
+    {
+        return false;
+    }
+
+    typedef MegaNodeSnapshotPrivate::Record Record;
+    const SharedNodeTreeHeader *h = reinterpret_cast<const SharedNodeTreeHeader *>(data->data());
+    if (h->magic != SharedNodeTreeControl::MAGIC || h->version != SharedNodeTreeControl::VERSION
+            || h->snapshotoffset + h->snapshotsize > data->size()
+            || h->logoffset + h->logcapacity > data->size()
+            || uint64_t(h->nodes) * sizeof(Record) > h->snapshotsize)
+    {
+        LOG_err << "Invalid shared node tree " << mName;
+        return false;
+    }
+
+    mNodes.clear();
+    mChildren.clear();
+    std::fill(mRoots, mRoots + 3, INVALID_HANDLE);
+
+    const char *snapshot = reinterpret_cast<const char *>(data->data()) + h->snapshotoffset;
+    const Record *records = reinterpret_cast<const Record *>(snapshot);
+    mNodes.reserve(h->nodes);
+    for (uint32_t i = 0; i < h->nodes; i++)
+    {
+        apply(records[i], snapshot, size_t(h->snapshotsize), false);
+    }
+
+    mData = std::move(data);
+    mSegment = segment;
+    mLogRead = 0;
+    mGeneration = h->generation;
+    return true;
+}
+
+void MegaSharedNodeTreePrivate::apply(const MegaNodeSnapshotPrivate::Record &r, const char *base, size_t size, bool removed)
+{
+    auto it = mNodes.find(r.handle);
+    if (it != mNodes.end() && (removed || it->second.parent != r.parenthandle))
+    {
+        detach(r.handle, it->second.parent);
+    }
+
+    if (removed)
+    {
+        if (it != mNodes.end())
+        {
+            mNodes.erase(it);
+        }
+
+        for (MegaHandle &root : mRoots)
+        {
+            if (root == r.handle)
+            {
+                root = INVALID_HANDLE;
+            }
+        }
+        return;
+    }
+
+    // strings out of their area are dropped
+    auto str = [base, size](uint32_t offset) -> const char * {
+        return offset && offset < size && memchr(base + offset, 0, size - offset) ? base + offset : NULL;
+    };
+
+    if (it == mNodes.end() || it->second.parent != r.parenthandle)
+    {
+        if (r.parenthandle != INVALID_HANDLE)
+        {
+            mChildren[r.parenthandle].push_back(r.handle);
+        }
+    }
+
+    Entry &e = mNodes[r.handle];
+    e.parent = r.parenthandle;
+    e.type = r.type;
+    e.size = r.size;
+    e.mtime = r.mtime;
+    e.name = str(r.name);
+    e.fingerprint = str(r.fingerprint);
+    if (!e.name)
+    {
+        e.name = "";
+    }
+
+    if (r.type >= MegaNode::TYPE_ROOT && r.type <= MegaNode::TYPE_RUBBISH)
+    {
+        mRoots[r.type - MegaNode::TYPE_ROOT] = r.handle;
+    }
+}
+
+void MegaSharedNodeTreePrivate::detach(MegaHandle handle, MegaHandle parent)
+{
+    auto it = mChildren.find(parent);
+    if (it != mChildren.end())
+    {
+        vector<MegaHandle> &children = it->second;
+        children.erase(std::remove(children.begin(), children.end(), handle), children.end());
+        if (children.empty())
+        {
+            mChildren.erase(it);
+        }
+    }
+}
+
+const MegaSharedNodeTreePrivate::Entry *MegaSharedNodeTreePrivate::entry(MegaHandle handle) const
+{
+    auto it = mNodes.find(handle);
+    return it != mNodes.end() ? &it->second : NULL;
+}
+
+long long MegaSharedNodeTreePrivate::getGeneration() const
+{
+    return mGeneration;
+}
+
+int MegaSharedNodeTreePrivate::size() const
+{
+    return int(mNodes.size());
+}
+
+MegaHandle MegaSharedNodeTreePrivate::getNodeByPath(const char *path, MegaHandle base) const
+{
+    if (!path)
+    {
+        return INVALID_HANDLE;
+    }
+
+    MegaHandle h = base;
+    if (!strncmp(path, "//in", 4) && (path[4] == '/' || !path[4]))
+    {
+        h = mRoots[MegaNode::TYPE_INCOMING - MegaNode::TYPE_ROOT];
+        path += 4;
+    }
+    else if (!strncmp(path, "//bin", 5) && (path[5] == '/' || !path[5]))
+    {
+        h = mRoots[MegaNode::TYPE_RUBBISH - MegaNode::TYPE_ROOT];
+        path += 5;
+    }
+    else if (*path == '/')
+    {
+        h = mRoots[0];
+    }
+
+    if (!entry(h))
+    {
+        return INVALID_HANDLE;
+    }
+
+    while (*path)
+    {
+        const char *end = strchr(path, '/');
+        size_t length = end ? size_t(end - path) : strlen(path);
+
+        if (length)
+        {
+            auto it = mChildren.find(h);
+            if (it == mChildren.end())
+            {
+                return INVALID_HANDLE;
+            }
+
+            MegaHandle found = INVALID_HANDLE;
+            for (MegaHandle child : it->second)
+            {
+                const Entry *e = entry(child);
+                if (e && !strncmp(e->name, path, length) && !e->name[length])
+                {
+                    found = child;
+                    break;
+                }
+            }
+
+            if ((h = found) == INVALID_HANDLE)
+            {
+                return INVALID_HANDLE;
+            }
+        }
+
+        path += length;
+        if (*path)
+        {
+            path++;
+        }
+    }
+
+    return h;
+}
+
+char *MegaSharedNodeTreePrivate::getNodePath(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    vector<const char *> names;
+
+    // bounded, in case the log of the writer was cut short
+    while (e && e->parent != INVALID_HANDLE && names.size() <= mNodes.size())
+    {
+        names.push_back(e->name);
+        e = entry(e->parent);
+    }
+
+    if (!e || e->parent != INVALID_HANDLE)
+    {
+        return NULL;
+    }
+
+    string path;
+    switch (e->type)
+    {
+        case MegaNode::TYPE_ROOT:
+            break;
+        case MegaNode::TYPE_INCOMING:
+            path = "//in";
+            break;
+        case MegaNode::TYPE_RUBBISH:
+            path = "//bin";
+            break;
+        default:
+            return NULL;
+    }
+
+    for (auto it = names.rbegin(); it != names.rend(); it++)
+    {
+        path.push_back('/');
+        path.append(*it);
+    }
+
+    if (path.empty())
+    {
+        path = "/";
+    }
+    return MegaApi::strdup(path.c_str());
+}
+
+MegaHandle MegaSharedNodeTreePrivate::getParentHandle(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    return e ? e->parent : INVALID_HANDLE;
+}
+
+int MegaSharedNodeTreePrivate::getType(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    return e ? e->type : MegaNode::TYPE_UNKNOWN;
+}
+
+int64_t MegaSharedNodeTreePrivate::getSize(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    return e ? e->size : 0;
+}
+
+int64_t MegaSharedNodeTreePrivate::getModificationTime(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    return e ? e->mtime : 0;
+}
+
+const char *MegaSharedNodeTreePrivate::getName(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    return e ? e->name : NULL;
+}
+
+const char *MegaSharedNodeTreePrivate::getFingerprint(MegaHandle handle) const
+{
+    const Entry *e = entry(handle);
+    return e ? e->fingerprint : NULL;
+}
+
+MegaHandleList *MegaSharedNodeTreePrivate::getChildren(MegaHandle handle) const
+{
+    if (!entry(handle))
+    {
+        return NULL;
+    }
+
+    MegaHandleListPrivate *list = new MegaHandleListPrivate();
+    auto it = mChildren.find(handle);
+    if (it != mChildren.end())
+    {
+        for (MegaHandle child : it->second)
+        {
+            list->addMegaHandle(child);
+        }
+    }
+    return list;
+}
+
 MegaChildrenListsPrivate::MegaChildrenListsPrivate(MegaChildrenLists *list)
 {
     files = list->getFileList()->copy();
@@ -31883,4 +38116,29 @@ bool MegaCancelTokenPrivate::isCancelled() const
     return cancelFlag;
 }
 
+MegaUploadBatch* MegaUploadBatchPrivate::copy() const
+{
+    return new MegaUploadBatchPrivate(*this);
+}
+
+void MegaUploadBatchPrivate::add(const char* localPath, MegaHandle parent, const char* fileName, int64_t mtime)
+{
+    if (!localPath)
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.localPath = localPath;
+    entry.parent = parent;
+    entry.fileName = fileName ? fileName : "";
+    entry.mtime = mtime;
+    entries.push_back(std::move(entry));
+}
+
+unsigned int MegaUploadBatchPrivate::size() const
+{
+    return unsigned(entries.size());
+}
+
 }
@@ -23,6 +23,7 @@
 #include "mega/mediafileattribute.h"
 #include <cctype>
 #include <algorithm>
+#include <thread>
 
 #undef min // avoid issues with std::min and std::max
 #undef max
@@ -51,12 +52,24 @@ const unsigned MegaClient::MAXTOTALTRANSFERS = 30;
 // maximum number of concurrent transfers (uploads or downloads)
 const unsigned MegaClient::MAXTRANSFERS = 20;
 
-// maximum number of queued putfa before halting the upload queue
-const int MegaClient::MAXQUEUEDFA = 30;
+// how long a completed upload may wait for others to the same folder
+const dstime MegaClient::PUTNODES_BATCH_DS = 5;
+
+// maximum size of the queued putfa before halting the upload queue (the
+// attributes of thousands of images, instead of a fixed count that the
+// thumbnails of a folder of photos would fill up right away)
+const m_off_t MegaClient::MAXQUEUEDFABYTES = 64 * 1024 * 1024;
 
 // maximum number of concurrent putfa
 const int MegaClient::MAXPUTFA = 10;
 
+// node keys per key rewrite command
+const size_t MegaClient::KEYREWRITEBATCH = 1000;
+
+// node records (or bytes of them) buffered by initsc() before they're written
+const size_t MegaClient::INITSCBATCHRECORDS = 4096;
+const size_t MegaClient::INITSCBATCHBYTES = 4 * 1024 * 1024;
+
 #ifdef ENABLE_SYNC
 // //bin/SyncDebris/yyyy-mm-dd base folder name
 const char* const MegaClient::SYNCDEBRISFOLDERNAME = "SyncDebris";
@@ -83,21 +96,31 @@ dstime MegaClient::USER_DATA_EXPIRATION_BACKOFF_SECS = 86400; // 1 day
 // stats id
 char* MegaClient::statsid = NULL;
 
-// decrypt key (symmetric or asymmetric), rewrite asymmetric to symmetric key
-bool MegaClient::decryptkey(const char* sk, byte* tk, int tl, SymmCipher* sc, int type, handle node)
+// length of a key string up to its terminator
+static int keystringlength(const char* sk)
 {
-    int sl;
     const char* ptr = sk;
 
-    // measure key length
     while (*ptr && *ptr != '"' && *ptr != '/')
     {
         ptr++;
     }
 
-    sl = int(ptr - sk);
+    return int(ptr - sk);
+}
+
+// symmetric keys fit in FILENODEKEYLENGTH bytes, longer ones are RSA-encrypted
+static bool isasymmetrickey(int sl)
+{
+    return sl > 4 * FILENODEKEYLENGTH / 3 + 1;
+}
+
+// decrypt key (symmetric or asymmetric), rewrite asymmetric to symmetric key
+bool MegaClient::decryptkey(const char* sk, byte* tk, int tl, SymmCipher* sc, int type, handle node)
+{
+    int sl = keystringlength(sk);
 
-    if (sl > 4 * FILENODEKEYLENGTH / 3 + 1)
+    if (isasymmetrickey(sl))
     {
         // RSA-encrypted key - decrypt and update on the server to save space & client CPU time
         sl = sl / 4 * 3 + 3;
@@ -147,6 +170,36 @@ bool MegaClient::decryptkey(const char* sk, byte* tk, int tl, SymmCipher* sc, in
     return true;
 }
 
+void MegaClient::indexsharing(Node* n)
+{
+    if (n->outshares)
+    {
+        mOutShareNodes.insert(n->nodehandle);
+    }
+    else
+    {
+        mOutShareNodes.erase(n->nodehandle);
+    }
+
+    if (n->pendingshares)
+    {
+        mPendingShareNodes.insert(n->nodehandle);
+    }
+    else
+    {
+        mPendingShareNodes.erase(n->nodehandle);
+    }
+
+    if (n->plink)
+    {
+        mPublicLinkNodes.insert(n->nodehandle);
+    }
+    else
+    {
+        mPublicLinkNodes.erase(n->nodehandle);
+    }
+}
+
 // apply queued new shares
 void MegaClient::mergenewshares(bool notify)
 {
@@ -208,6 +261,7 @@ void MegaClient::mergenewshare(NewShare *s, bool notify)
                     delete n->sharekey;
                 }
                 n->sharekey = new SymmCipher(s->key);
+                sharekeyarrived(n->nodehandle);
                 skreceived = true;
             }
         }
@@ -289,6 +343,7 @@ void MegaClient::mergenewshare(NewShare *s, bool notify)
                         n->inshare->user->sharing.erase(n->nodehandle);
                         notifyuser(n->inshare->user);
                         n->inshare = NULL;
+                        n->pathchanged();
                     }
                 }
             }
@@ -414,6 +469,7 @@ void MegaClient::mergenewshare(NewShare *s, bool notify)
                                 n->inshare = new Share(finduser(s->peer, 1), s->access, s->ts, NULL);
                                 n->inshare->user->sharing.insert(n->nodehandle);
                                 mNodeCounters[n->nodehandle] = n->subnodeCounts();
+                                n->pathchanged();
                             }
 
                             if (notify)
@@ -442,6 +498,8 @@ void MegaClient::mergenewshare(NewShare *s, bool notify)
                 }
             }
         }
+
+        indexsharing(n);
 #ifdef ENABLE_SYNC
         if (n->inshare && s->access != FULL)
         {
@@ -677,6 +735,64 @@ bool MegaClient::compareDatabases(string filename1, string filename2)
     return true;
 }
 
+bool MegaClient::loadstatecache(ScLoadStats* stats)
+{
+    if (!sctable || ISUNDEF(cachedscsn))
+    {
+        return false;
+    }
+
+    scloadstats = stats;
+    bool loaded = fetchsc(sctable);
+    scloadstats = nullptr;
+
+    return loaded;
+}
+
+bool MegaClient::recordsc(string* localpath)
+{
+    screcorder.reset();
+    screcorderpos = 0;
+
+    if (!localpath)
+    {
+        return true;
+    }
+
+    // start from an empty file
+    fsaccess->unlinklocal(localpath);
+
+    screcorder = fsaccess->newfileaccess();
+    if (!screcorder->fopen(localpath, false, true))
+    {
+        LOG_err << "Unable to open the sc recording file";
+        screcorder.reset();
+        return false;
+    }
+
+    LOG_info << "Recording sc responses from SCSN " << scsn;
+    return true;
+}
+
+// records are "sc <scsn> <length>\n<response>\n"
+void MegaClient::screcord(const string& response)
+{
+    ostringstream header;
+    header << "sc " << scsn << " " << response.size() << "\n";
+
+    string record = header.str();
+    record.append(response).append("\n");
+
+    if (!screcorder->fwrite((const byte*)record.data(), unsigned(record.size()), screcorderpos))
+    {
+        LOG_err << "Unable to write to the sc recording file, stopping";
+        screcorder.reset();
+        return;
+    }
+
+    screcorderpos += m_off_t(record.size());
+}
+
 void MegaClient::getrecoverylink(const char *email, bool hasMasterkey)
 {
     reqs.add(new CommandGetRecoveryLink(this, email,
@@ -906,6 +1022,9 @@ void MegaClient::activateoverquota(dstime timeleft)
     {
         LOG_warn << "Bandwidth overquota";
         overquotauntil = Waiter::ds + timeleft;
+
+        // the quota is reset meanwhile, the account details have to be fetched again
+        settransferquota(0, 0);
         for (int d = GET; d == GET || d == PUT; d += PUT - GET)
         {
             for (transfer_map::iterator it = transfers[d].begin(); it != transfers[d].end(); it++)
@@ -972,6 +1091,14 @@ Node* MegaClient::childnodebyname(Node* p, const char* name, bool skipfolders)
 
     fsaccess->normalize(&nname);
 
+    // large folders are indexed by name: clashing names are still looked up in
+    // the children, as the first match is returned
+    vector<Node*> named;
+    if (p->childrennamed(nname.c_str(), named) && named.size() < 2)
+    {
+        return named.empty() ? NULL : named[0];
+    }
+
     for (node_list::iterator it = p->children.begin(); it != p->children.end(); it++)
     {
         if (!strcmp(nname.c_str(), (*it)->displayname()))
@@ -1005,6 +1132,16 @@ vector<Node*> MegaClient::childnodesbyname(Node* p, const char* name, bool skipf
 
     fsaccess->normalize(&nname);
 
+    vector<Node*> named;
+    if (p->childrennamed(nname.c_str(), named) && named.size() < 2)
+    {
+        if (named.size() && (named[0]->type == FILENODE || !skipfolders))
+        {
+            found.push_back(named[0]);
+        }
+        return found;
+    }
+
     for (node_list::iterator it = p->children.begin(); it != p->children.end(); it++)
     {
         if (nname == (*it)->displayname())
@@ -1027,12 +1164,20 @@ void MegaClient::init()
     statecurrent = false;
     totalNodes = 0;
     faretrying = false;
+    fauploaded = 0;
+    fafailed = 0;
+    fahalts = 0;
+    queuedfabytes = 0;
 
 #ifdef ENABLE_SYNC
     syncactivity = false;
+    synccachepending = false;
     syncops = false;
     syncdebrisadding = false;
     syncdebrisminute = 0;
+    syncdebrisfailed = false;
+    syncdebrisday = UNDEF;
+    syncdebrisdayname.clear();
     syncscanfailed = false;
     syncfslockretry = false;
     syncfsopsfailed = false;
@@ -1057,6 +1202,7 @@ void MegaClient::init()
 
     delete pendingsc;
     pendingsc = NULL;
+    cancelscprefetch();
     stopsc = false;
 
     btcs.reset();
@@ -1068,6 +1214,7 @@ void MegaClient::init()
 
     jsonsc.pos = NULL;
     insca = false;
+    scyielded = false;
     scnotifyurl.clear();
     *scsn = 0;
 
@@ -1077,7 +1224,7 @@ void MegaClient::init()
 }
 
 MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, DbAccess* d, GfxProc* g, const char* k, const char* u)
-    : useralerts(*this), btugexpiration(rng), btcs(rng), btbadhost(rng), btworkinglock(rng), btsc(rng), btpfa(rng)
+    : useralerts(*this), btugexpiration(rng), btcs(rng), btpipelinedcs(rng), btbadhost(rng), btworkinglock(rng), btsc(rng), btpfa(rng)
 #ifdef ENABLE_SYNC
     ,syncfslockretrybt(rng), syncdownbt(rng), syncnaglebt(rng), syncextrabt(rng), syncscanbt(rng)
 #endif
@@ -1093,6 +1240,7 @@ MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, Db
     retryessl = false;
     workinglockcs = NULL;
     scpaused = false;
+    scyielded = false;
     asyncfopens = 0;
     achievements_enabled = false;
     isNewSession = false;
@@ -1140,6 +1288,7 @@ MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, Db
     xferpaused[GET] = false;
     putmbpscap = 0;
     overquotauntil = 0;
+    settransferquota(0, 0);
     mBizGracePeriodTs = 0;
     mBizExpirationTs = 0;
     mBizMode = BIZ_MODE_UNKNOWN;
@@ -1175,6 +1324,7 @@ MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, Db
     }
 
     slotit = tslots.end();
+    slotsyielded = false;
 
     userid = 0;
 
@@ -1228,8 +1378,15 @@ MegaClient::~MegaClient()
 {
     locallogout();
 
+    // no job may wake up the waiter after this point
+    cryptoworkers.reset();
+#ifdef USE_MEDIAINFO
+    mediaworkers.reset();
+#endif
+
     delete pendingcs;
     delete pendingsc;
+    delete pendingscprefetch;
     delete badhostcs;
     delete workinglockcs;
     delete sctable;
@@ -1269,6 +1426,7 @@ std::string MegaClient::getPublicLink(bool newLinkFormat, nodetype_t type, handl
 void MegaClient::exec()
 {
     CodeCounter::ScopeTimer ccst(performanceStats.execFunction);
+    Trace::Span ts("exec");
 
     WAIT_CLASS::bumpds();
 
@@ -1324,6 +1482,22 @@ void MegaClient::exec()
         }
     }
 
+    execscheduler.begin(ExecScheduler::DBCOMMIT);
+    checkdbcommit();
+    if (deferredsccommit && pendingsccommit && sctable && !jsonsc.pos
+            && !pendingcs && !csretrying && !reqs.cmdspending() && !sccommitdeferred())
+    {
+        LOG_debug << "Executing deferred DB commit";
+        commitsc(true);
+    }
+    execscheduler.end(ExecScheduler::DBCOMMIT);
+
+    // the first batch of a resumed session is on its way: read the cache meanwhile
+    if (cachepreloadpending && pendingcs)
+    {
+        preloadsc();
+    }
+
     bool first = true;
     do
     {
@@ -1507,6 +1681,15 @@ void MegaClient::exec()
                             }
                         }
 
+                        if (fa->in.size() == sizeof(handle))
+                        {
+                            fauploaded++;
+                        }
+                        else
+                        {
+                            fafailed++;
+                        }
+
                         delete fa;
                         curfa = activefa.erase(curfa);
                         LOG_debug << "Remaining file attributes: " << activefa.size() << " active, " << queuedfa.size() << " queued";
@@ -1520,6 +1703,7 @@ void MegaClient::exec()
                         curfa = activefa.erase(curfa);
                         fa->status = REQ_READY;
                         queuedfa.push_back(fa);
+                        queuedfabytes += fa->data->size();
                         btpfa.backoff();
                         faretrying = true;
                         break;
@@ -1533,18 +1717,17 @@ void MegaClient::exec()
         if (btpfa.armed())
         {
             faretrying = false;
-            while (queuedfa.size() && activefa.size() < MAXPUTFA)
-            {
-                // dispatch most recent file attribute put
-                putfa_list::iterator curfa = queuedfa.begin();
-                HttpReqCommandPutFA* fa = *curfa;
-                queuedfa.erase(curfa);
-                activefa.push_back(fa);
+            dispatchfa();
+        }
 
-                LOG_debug << "Adding file attribute to the request queue";
-                fa->status = REQ_INFLIGHT;
-                reqs.add(fa);
-            }
+        // file attributes found in the local cache
+        while (facachehits.size())
+        {
+            FileAttributeCacheHit hit = std::move(facachehits.front());
+            facachehits.pop_front();
+
+            restag = hit.fetch.tag;
+            app->fa_complete(hit.fetch.nodehandle, hit.fetch.type, hit.data.data(), uint32_t(hit.data.size()));
         }
 
         if (fafcs.size())
@@ -1663,6 +1846,7 @@ void MegaClient::exec()
                 if (pendingcs->status == REQ_SUCCESS || pendingcs->status == REQ_FAILURE)
                 {
                     performanceStats.csRequestWaitTime.stop();
+                    performanceStats.csBatchRoundTrip.add(std::chrono::high_resolution_clock::now() - pendingcssent);
                 }
 
                 switch (pendingcs->status)
@@ -1687,12 +1871,33 @@ void MegaClient::exec()
                                 pendingcs->notifiedbufpos = pendingcs->bufpos;
                             }
                         }
+
+                        if (fetchingnodes)
+                        {
+                            if (CommandFetchNodes* fetch = dynamic_cast<CommandFetchNodes*>(reqs.inflightsingle()))
+                            {
+                                fetch->procpartial(pendingcs, false);
+                            }
+                        }
+
+                        // results of a batch can be processed before the whole response is in
+                        reqs.serverpartial(pendingcs, this, false);
                         break;
 
                     case REQ_SUCCESS:
                         abortlockrequest();
                         app->request_response_progress(pendingcs->bufpos, -1);
 
+                        if (fetchingnodes)
+                        {
+                            if (CommandFetchNodes* fetch = dynamic_cast<CommandFetchNodes*>(reqs.inflightsingle()))
+                            {
+                                fetch->procpartial(pendingcs, true);
+                            }
+                        }
+
+                        reqs.serverpartial(pendingcs, this, true);
+
                         if (pendingcs->in != "-3" && pendingcs->in != "-4")
                         {
                             if (*pendingcs->in.c_str() == '[')
@@ -1710,6 +1915,8 @@ void MegaClient::exec()
                                 }
 
                                 // request succeeded, process result array
+                                reqs.batchcompleted(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                        std::chrono::high_resolution_clock::now() - pendingcssent));
                                 reqs.serverresponse(std::move(pendingcs->in), this);
 
                                 WAIT_CLASS::bumpds();
@@ -1718,27 +1925,13 @@ void MegaClient::exec()
                                 pendingcs = NULL;
 
                                 notifypurge();
-                                if (sctable && pendingsccommit && !reqs.cmdspending())
+                                if (sctable && pendingsccommit && !reqs.cmdspending() && !sccommitdeferred())
                                 {
                                     LOG_debug << "Executing postponed DB commit";
-                                    sctable->commit();
-                                    sctable->begin();
-                                    app->notify_dbcommit();
-                                    pendingsccommit = false;
+                                    commitsc(true);
                                 }
 
-                                // increment unique request ID
-                                for (int i = sizeof reqid; i--; )
-                                {
-                                    if (reqid[i]++ < 'z')
-                                    {
-                                        break;
-                                    }
-                                    else
-                                    {
-                                        reqid[i] = 'a';
-                                    }
-                                }
+                                nextreqid();
 
                                 if (loggedout)
                                 {
@@ -1779,6 +1972,9 @@ void MegaClient::exec()
                             {
                                 reason = RETRY_RATE_LIMIT;
                             }
+
+                            // retry with smaller batches
+                            reqs.batchrejected();
                             if (fetchingnodes)
                             {
                                 fnstats.eAgainCount++;
@@ -1843,7 +2039,12 @@ void MegaClient::exec()
                         app->notify_retry(btcs.retryin(), reason);
                         csretrying = true;
 
-                        reqs.requeuerequest();
+                        // the server may have the response of the batch sent: a split
+                        // batch is a different one, which can't be sent under its ID
+                        if (reqs.requeuerequest())
+                        {
+                            nextreqid();
+                        }
 
                     default:
                         ;
@@ -1863,9 +2064,17 @@ void MegaClient::exec()
                     pendingcs->protect = true;
                     pendingcs->logname = clientname + "cs ";
 
+                    // the response is consumed while it arrives
+                    pendingcs->reserveresponse = !httpio->purgesinflight();
+
                     bool suppressSID = true;
                     reqs.serverrequest(pendingcs->out, suppressSID);
 
+                    if (CommandFetchNodes* fetch = dynamic_cast<CommandFetchNodes*>(reqs.inflightsingle()))
+                    {
+                        fetch->resetstream();
+                    }
+
                     pendingcs->posturl = APIURL;
 
                     pendingcs->posturl.append("cs?id=");
@@ -1882,6 +2091,7 @@ void MegaClient::exec()
                     pendingcs->type = REQ_JSON;
 
                     performanceStats.csRequestWaitTime.start();
+                    pendingcssent = std::chrono::high_resolution_clock::now();
                     pendingcs->post(this);
                     continue;
                 }
@@ -1893,6 +2103,9 @@ void MegaClient::exec()
             break;
         }
 
+        // API client-server requests that don't need to wait for the ones above
+        execpipelinedcs();
+
         // handle API server-client requests
         if (!jsonsc.pos && pendingsc && !loggingout)
         {
@@ -1912,8 +2125,18 @@ void MegaClient::exec()
 
                 if (*pendingsc->in.c_str() == '{')
                 {
+                    if (screcorder && !useralerts.begincatchup)
+                    {
+                        screcord(pendingsc->in);
+                    }
+
                     jsonsc.begin(pendingsc->in.c_str());
                     jsonsc.enterobject();
+
+                    if (scprefetch && !useralerts.begincatchup)
+                    {
+                        prefetchsc();
+                    }
                     break;
                 }
                 else
@@ -2019,11 +2242,13 @@ void MegaClient::exec()
 
         // do not process the SC result until all preconfigured syncs are up and running
         // except if SC packets are required to complete a fetchnodes
-        if (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownrequired && !syncdownretry)
+        if (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownrequired && !syncdowndirty.size() && !syncdownretry)
 #else
         if (!scpaused && jsonsc.pos)
 #endif
         {
+            execscheduler.begin(ExecScheduler::SC);
+
             // FIXME: reload in case of bad JSON
             bool r;
             if (useralerts.begincatchup)
@@ -2037,6 +2262,8 @@ void MegaClient::exec()
             }
             else
             {
+                // sockets keep being drained while the action packets are processed
+                HttpIOReleaser releaser(httpio);
                 r = procsc();
             }
 
@@ -2047,15 +2274,42 @@ void MegaClient::exec()
                 pendingsc = NULL;
 
                 btsc.reset();
+
+                // or continue with the one already sent, if it's still the right one
+                if (pendingscprefetch)
+                {
+                    if (!useralerts.begincatchup && scprefetchsn == scsn)
+                    {
+                        LOG_debug << "Continuing with the prefetched sc request";
+                        pendingsc = pendingscprefetch;
+                        pendingscprefetch = NULL;
+                        jsonsc.pos = NULL;
+                    }
+                    else
+                    {
+                        cancelscprefetch();
+                    }
+                }
+            }
+            else if (scyielded)
+            {
+                // out of time: let transfers and the app run, then resume
+                performanceStats.scYields++;
             }
 #ifdef ENABLE_SYNC
             else
             {
-                // remote changes require immediate attention of syncdown()
-                syncdownrequired = true;
+                // remote changes require immediate attention of syncdown(),
+                // of the folders they affect unless there are too many
+                if (syncdowndirty.size() > SYNCDOWNDIRTYMAX)
+                {
+                    syncdownrequired = true;
+                }
                 syncactivity = true;
             }
 #endif
+
+            execscheduler.end(ExecScheduler::SC, scyielded);
         }
 
         if (!pendingsc && *scsn && btsc.armed() && !stopsc)
@@ -2157,12 +2411,18 @@ void MegaClient::exec()
         assert(!asyncfopens);
 #endif
 
-        slotit = tslots.begin();
+        // handle active unpaused transfers, from where the previous iteration
+        // stopped if it ran out of time
+        if (!slotsyielded)
+        {
+            slotit = tslots.begin();
+        }
+        slotsyielded = false;
 
-        // handle active unpaused transfers
         {
             DBTableTransactionCommitter committer(tctable);
 
+            execscheduler.begin(ExecScheduler::TRANSFERS);
             while (slotit != tslots.end())
             {
                 transferslot_list::iterator it = slotit;
@@ -2173,9 +2433,25 @@ void MegaClient::exec()
                 {
                     (*it)->doio(this, committer);
                 }
+
+                if (slotit != tslots.end() && execscheduler.expired(ExecScheduler::TRANSFERS))
+                {
+                    slotsyielded = true;
+                    break;
+                }
             }
+            execscheduler.end(ExecScheduler::TRANSFERS, slotsyielded);
         }
 
+        flushputnodes(false);
+        flushdurable(false);
+
+        sendkeyrewrites();
+
+#ifdef USE_MEDIAINFO
+        execmediajobs();
+#endif
+
 #ifdef ENABLE_SYNC
         // verify filesystem fingerprints, disable deviating syncs
         // (this covers mountovers, some device removals and some failures)
@@ -2243,10 +2519,21 @@ void MegaClient::exec()
             syncfslockretrybt.backoff(Sync::SCANNING_DELAY_DS);
         }
 
+        // resume LocalNode cache flushes that were capped in the previous iteration
+        if (synccachepending)
+        {
+            synccachepending = false;
+
+            for (it = syncs.begin(); it != syncs.end(); it++)
+            {
+                (*it)->cachenodes();
+            }
+        }
+
         // halt all syncing while the local filesystem is pending a lock-blocked operation
         // or while we are fetching nodes
         // FIXME: indicate by callback
-        if (!syncdownretry && !syncadding && statecurrent && !syncdownrequired && !fetchingnodes)
+        if (!syncdownretry && !syncadding && statecurrent && !syncdownrequired && !syncdowndirty.size() && !fetchingnodes)
         {
             // process active syncs, stop doing so while transient local fs ops are pending
             if (syncs.size() || syncactivity)
@@ -2282,10 +2569,13 @@ void MegaClient::exec()
                             Notification &notification = sync->dirnotify->notifyq[DirNotify::EXTRA].front();
                             if (notification.timestamp <= dsmin)
                             {
-                                LOG_debug << "Processing extra fs notification";
-                                sync->dirnotify->notify(DirNotify::DIREVENTS, notification.localnode,
-                                                        notification.path.data(), notification.path.size());
-                                sync->dirnotify->notifyq[DirNotify::EXTRA].pop_front();
+                                if (notification.localnode != (LocalNode*)~0)
+                                {
+                                    LOG_debug << "Processing extra fs notification";
+                                    sync->dirnotify->notify(DirNotify::DIREVENTS, notification.localnode,
+                                                            notification.path.data(), notification.path.size());
+                                }
+                                sync->dirnotify->pop(DirNotify::EXTRA);
                             }
                             else
                             {
@@ -2533,11 +2823,24 @@ void MegaClient::exec()
                                  && !syncadding && syncuprequired && !syncnagleretry)
                                 {
                                     LOG_debug << "Running syncup on demand";
+                                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
                                     repeatsyncup |= !syncup(&(*it)->localroot, &nds);
+                                    (*it)->stats.syncuptime += std::chrono::steady_clock::now() - start;
                                     syncupdone = true;
                                     (*it)->cachenodes();
                                 }
                             }
+
+                            if (syncupdone)
+                            {
+                                syncupdirty.clear();
+                            }
+                            else if (syncupdirty.size() && !syncadding && !syncnagleretry)
+                            {
+                                LOG_debug << "Running syncup on changed folders";
+                                repeatsyncup |= !syncupdirtyfolders(&nds);
+                                syncupdone = true;
+                            }
                             syncuprequired = !syncupdone || repeatsyncup;
 
                             if (EVER(nds))
@@ -2592,6 +2895,7 @@ void MegaClient::exec()
                                         if (sync->state == SYNC_ACTIVE)
                                         {
                                             sync->fullscan = false;
+                                            sync->journalcheckpoint();
 
                                             if (syncscanbt.armed()
                                                     && (sync->dirnotify->failed || fsaccess->notifyfailed
@@ -2650,38 +2954,52 @@ void MegaClient::exec()
                 syncdownrequired = true;
             }
 
-            if (syncdownrequired)
+            if (syncdownrequired || (syncdowndirty.size() && !fetchingnodes))
             {
+                bool full = syncdownrequired;
                 syncdownrequired = false;
                 if (!fetchingnodes)
                 {
-                    LOG_verbose << "Running syncdown";
+                    execscheduler.begin(ExecScheduler::SYNC);
+
                     bool success = true;
-                    for (it = syncs.begin(); it != syncs.end(); it++)
+                    if (!full)
                     {
-                        // make sure that the remote synced folder still exists
-                        if (!(*it)->localroot.node)
-                        {
-                            LOG_err << "The remote root node doesn't exist";
-                            (*it)->errorcode = API_ENOENT;
-                            (*it)->changestate(SYNC_FAILED);
-                        }
-                        else
+                        LOG_verbose << "Running syncdown on " << syncdowndirty.size() << " changed folders";
+                        success = syncdowndirtyfolders();
+                    }
+                    else
+                    {
+                        LOG_verbose << "Running syncdown";
+                        syncdowndirty.clear();
+                        for (it = syncs.begin(); it != syncs.end(); it++)
                         {
-                            string localpath = (*it)->localroot.localname;
-                            if ((*it)->state == SYNC_ACTIVE || (*it)->state == SYNC_INITIALSCAN)
+                            // make sure that the remote synced folder still exists
+                            if (!(*it)->localroot.node)
+                            {
+                                LOG_err << "The remote root node doesn't exist";
+                                (*it)->errorcode = API_ENOENT;
+                                (*it)->changestate(SYNC_FAILED);
+                            }
+                            else
                             {
-                                LOG_debug << "Running syncdown on demand";
-                                if (!syncdown(&(*it)->localroot, &localpath, true))
+                                string localpath = (*it)->localroot.localname;
+                                if ((*it)->state == SYNC_ACTIVE || (*it)->state == SYNC_INITIALSCAN)
                                 {
-                                    // a local filesystem item was locked - schedule periodic retry
-                                    // and force a full rescan afterwards as the local item may
-                                    // be subject to changes that are notified with obsolete paths
-                                    success = false;
-                                    (*it)->dirnotify->error = true;
-                                }
+                                    LOG_debug << "Running syncdown on demand";
+                                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                                    if (!syncdown(&(*it)->localroot, &localpath, true))
+                                    {
+                                        // a local filesystem item was locked - schedule periodic retry
+                                        // and force a full rescan afterwards as the local item may
+                                        // be subject to changes that are notified with obsolete paths
+                                        success = false;
+                                        (*it)->dirnotify->error = true;
+                                    }
+                                    (*it)->stats.syncdowntime += std::chrono::steady_clock::now() - start;
 
-                                (*it)->cachenodes();
+                                    (*it)->cachenodes();
+                                }
                             }
                         }
                     }
@@ -2689,7 +3007,11 @@ void MegaClient::exec()
                     // notify the app if a lock is being retried
                     if (success)
                     {
-                        syncuprequired = true;
+                        // (the folders of a partial syncdown() are synced up on their own)
+                        if (full)
+                        {
+                            syncuprequired = true;
+                        }
                         syncdownretry = false;
                         syncactivity = true;
 
@@ -2710,6 +3032,8 @@ void MegaClient::exec()
                         syncdownretry = true;
                         syncdownbt.backoff(50);
                     }
+
+                    execscheduler.end(ExecScheduler::SYNC, !syncdowndirty.empty());
                 }
                 else
                 {
@@ -2721,6 +3045,12 @@ void MegaClient::exec()
 
         notifypurge();
 
+        // the rest of the nodes removed by earlier iterations
+        purgeremoved();
+
+        // nothing allocated from the arena in this iteration is referenced anymore
+        transientarena.reset(&performanceStats.transientArena);
+
         if (!badhostcs && badhosts.size() && btbadhost.armed())
         {
             // report hosts affected by failed requests
@@ -2765,8 +3095,18 @@ void MegaClient::exec()
 
         httpio->updatedownloadspeed();
         httpio->updateuploadspeed();
-    } while (httpio->doio() || execdirectreads() || (!pendingcs && reqs.cmdspending() && btcs.armed()) || looprequested);
+    } while (httpio->doio() || execdirectreads() || (!pendingcs && reqs.cmdspending() && btcs.armed())
+             || (reqs.pipelinedready() && btpipelinedcs.armed()) || looprequested);
 
+    if (fingerprintcache)
+    {
+        fingerprintcache->flush();
+    }
+
+    if (tlstable && Waiter::ds - tlssessionssaved > TLSSESSIONSAVEINTERVAL_DS)
+    {
+        savetlssessions();
+    }
 
     NodeCounter storagesum;
     for (auto& nc : mNodeCounters)
@@ -2790,11 +3130,108 @@ void MegaClient::exec()
     if (Waiter::ds > lasttime + 1200)
     {
         lasttime = Waiter::ds;
-        LOG_info << performanceStats.report(false, httpio, waiter);
+        LOG_info << performanceStats.report(false, httpio, waiter, sctable);
     }
 #endif
 }
 
+void MegaClient::execpipelinedcs()
+{
+    for (size_t i = 0; i < pipelinedcs.size(); )
+    {
+        PipelinedCs p = pipelinedcs[i];
+        HttpReq* req = p.req;
+
+        if (req->status != REQ_SUCCESS && req->status != REQ_FAILURE)
+        {
+            i++;
+            continue;
+        }
+
+        // processing the response may send, or abort, the other batches
+        pipelinedcs.erase(pipelinedcs.begin() + i);
+        performanceStats.csPipelinedBatchRoundTrip.add(std::chrono::high_resolution_clock::now() - p.sent);
+
+        if (req->status == REQ_SUCCESS && req->in != "-3" && req->in != "-4")
+        {
+            btpipelinedcs.reset();
+
+            if (*req->in.c_str() == '[')
+            {
+                reqs.pipelinedresponse(p.channel, std::move(req->in), this);
+                notifypurge();
+            }
+            else
+            {
+                error e = (error)atoi(req->in.c_str());
+
+                if (!e)
+                {
+                    e = API_EINTERNAL;
+                }
+
+                app->request_error(e);
+                reqs.pipelinederror(p.channel, e, this);
+            }
+        }
+        else
+        {
+            // these batches are only reads: retry them ahead of the newer ones
+            LOG_debug << "Retrying pipelined cs batch";
+            btpipelinedcs.backoff();
+            reqs.requeuepipelined(p.channel);
+        }
+
+        delete req;
+    }
+
+    while (reqs.pipelinedready() && btpipelinedcs.armed())
+    {
+        PipelinedCs p;
+        p.req = new HttpReq();
+        p.req->protect = true;
+        p.req->logname = clientname + "cs+ ";
+
+        bool suppressSID = true;
+        p.channel = reqs.pipelinedrequest(p.req->out, suppressSID);
+
+        // each batch has its own request ID: retrying a read under a new one is harmless
+        char id[sizeof reqid];
+        for (size_t i = sizeof id; i--; )
+        {
+            id[i] = static_cast<char>('a' + rng.genuint32(26));
+        }
+
+        p.req->posturl = APIURL;
+        p.req->posturl.append("cs?id=");
+        p.req->posturl.append(id, sizeof id);
+        if (!suppressSID)
+        {
+            p.req->posturl.append(auth);
+        }
+        p.req->posturl.append(appkey);
+        if (lang.size())
+        {
+            p.req->posturl.append(lang);
+        }
+        p.req->type = REQ_JSON;
+
+        p.sent = std::chrono::high_resolution_clock::now();
+        p.req->post(this);
+        pipelinedcs.push_back(p);
+    }
+}
+
+void MegaClient::abortpipelinedcs()
+{
+    for (size_t i = 0; i < pipelinedcs.size(); i++)
+    {
+        delete pipelinedcs[i].req;
+    }
+    pipelinedcs.clear();
+    btpipelinedcs.reset();
+}
+
 // get next event time from all subsystems, then invoke the waiter if needed
 // returns true if an engine-relevant event has occurred, false otherwise
 int MegaClient::wait()
@@ -2821,7 +3258,7 @@ int MegaClient::preparewait()
 #ifdef ENABLE_SYNC
     // sync directory scans in progress or still processing sc packet without having
     // encountered a locally locked item? don't wait.
-    if (syncactivity || syncdownrequired || (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownretry))
+    if (syncactivity || synccachepending || syncdownrequired || syncdowndirty.size() || (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownretry))
     {
         nds = Waiter::ds;
     }
@@ -2831,16 +3268,56 @@ int MegaClient::preparewait()
         // next retry of a failed transfer
         nds = NEVER;
 
-        if (httpio->success && chunkfailed)
+#ifndef ENABLE_SYNC
+        if (!scpaused && jsonsc.pos && scyielded)
         {
-            // there is a pending transfer retry, don't wait
+            // action packets left unprocessed by a time-bounded procsc()
             nds = Waiter::ds;
         }
+#endif
 
-        nexttransferretry(PUT, &nds);
-        nexttransferretry(GET, &nds);
-
-        // retry transferslots
+        if (slotsyielded)
+        {
+            // transfer slots skipped by a time-bounded exec()
+            nds = Waiter::ds;
+        }
+
+        if (purgequeue.size())
+        {
+            // removed nodes still to be released
+            nds = Waiter::ds;
+        }
+
+        if (nodekeyrewrite.size() || sharekeyrewrite.size())
+        {
+            // key rewrites left for the next batches
+            nds = Waiter::ds;
+        }
+
+        if (httpio->success && chunkfailed)
+        {
+            // there is a pending transfer retry, don't wait
+            nds = Waiter::ds;
+        }
+
+        nexttransferretry(&nds);
+
+        // uploads waiting to be put in a batch
+        for (map<handle, PutNodesBatch>::iterator it = putnodesbatches.begin(); it != putnodesbatches.end(); it++)
+        {
+            if (it->second.since + PUTNODES_BATCH_DS < nds)
+            {
+                nds = it->second.since + PUTNODES_BATCH_DS;
+            }
+        }
+
+        // downloads waiting to be flushed (once the previous batch is, which wakes us up)
+        if (!durablefiles.empty() && !durablebusy && durablesince + durabilityds < nds)
+        {
+            nds = durablesince + durabilityds;
+        }
+
+        // retry transferslots
         for (transferslot_list::iterator it = tslots.begin(); it != tslots.end(); it++)
         {
             if (!(*it)->retrybt.armed())
@@ -2868,6 +3345,11 @@ int MegaClient::preparewait()
             btcs.update(&nds);
         }
 
+        if (reqs.pipelinedready())
+        {
+            btpipelinedcs.update(&nds);
+        }
+
         // retry failed server-client requests
         if (!pendingsc && *scsn && !stopsc)
         {
@@ -2930,6 +3412,12 @@ int MegaClient::preparewait()
             btugexpiration.update(&nds);
         }
 
+        // state cache commit deferred by the power policy
+        if (deferredsccommit && pendingsccommit && lastsccommit + PowerPolicy::LOWPOWERCOMMITINTERVAL < nds)
+        {
+            nds = lastsccommit + PowerPolicy::LOWPOWERCOMMITINTERVAL;
+        }
+
 #ifdef ENABLE_SYNC
         // sync rescan
         if (syncscanfailed)
@@ -2939,7 +3427,7 @@ int MegaClient::preparewait()
 
         // retrying of transient failed read ops
         if (syncfslockretry && !syncdownretry && !syncadding
-                && statecurrent && !syncdownrequired && !syncfsopsfailed)
+                && statecurrent && !syncdownrequired && !syncdowndirty.size() && !syncfsopsfailed)
         {
             LOG_debug << "Waiting for a temporary error checking filesystem notification";
             syncfslockretrybt.update(&nds);
@@ -3051,6 +3539,7 @@ int MegaClient::preparewait()
     if (!nds)
     {
         ++performanceStats.prepwaitImmediate;
+        ++execscheduler.immediatewakeups;
         return Waiter::NEEDEXEC;
     }
 
@@ -3060,6 +3549,15 @@ int MegaClient::preparewait()
         nds -= Waiter::ds;
     }
 
+#ifdef ENABLE_SYNC
+    if (!nds && (slotsyielded || scyielded || !syncdowndirty.empty()))
+#else
+    if (!nds && (slotsyielded || scyielded))
+#endif
+    {
+        ++execscheduler.carriedwakeups;
+    }
+
 #ifdef MEGA_MEASURE_CODE
     bool reasonGiven = false;
     if (nds == 0)
@@ -3168,6 +3666,11 @@ bool MegaClient::abortbackoff(bool includexfers)
         r = true;
     }
 
+    if (btpipelinedcs.arm())
+    {
+        r = true;
+    }
+
     if (btbadhost.arm())
     {
         r = true;
@@ -3212,9 +3715,10 @@ bool MegaClient::dispatch(direction_t d)
     }
 
     // file attribute jam? halt uploads.
-    if (d == PUT && queuedfa.size() > MAXQUEUEDFA)
+    if (d == PUT && queuedfabytes > MAXQUEUEDFABYTES)
     {
-        LOG_warn << "Attribute queue full: " << queuedfa.size();
+        LOG_warn << "Attribute queue full: " << queuedfa.size() << " (" << queuedfabytes << " bytes)";
+        fahalts++;
         return false;
     }
 
@@ -3303,8 +3807,8 @@ bool MegaClient::dispatch(direction_t d)
         bool openok = false;
         bool openfinished = false;
 
-        // verify that a local path was given and start/resume transfer
-        if (nexttransfer->localfilename.size())
+        // verify that a local path (or an upload stream) was given and start/resume transfer
+        if (nexttransfer->localfilename.size() || nexttransfer->uploadstream)
         {
             if (!nexttransfer->slot)
             {
@@ -3361,6 +3865,13 @@ bool MegaClient::dispatch(direction_t d)
 
             if (openfinished && openok)
             {
+                if (d == GET)
+                {
+                    ts->fa->fpreallocate(nexttransfer->size);
+                }
+
+                nexttransfer->localfsid = ts->fa->fsidvalid ? ts->fa->fsid : UNDEF;
+
                 handle h = UNDEF;
                 bool hprivate = true;
                 const char *privauth = NULL;
@@ -3409,14 +3920,14 @@ bool MegaClient::dispatch(direction_t d)
                     }
 
                     // create thumbnail/preview imagery, if applicable (FIXME: do not re-create upon restart)
-                    if (nexttransfer->localfilename.size() && !nexttransfer->uploadhandle)
+                    if (!nexttransfer->uploadhandle)
                     {
                         nexttransfer->uploadhandle = getuploadhandle();
 
-                        if (!gfxdisabled && gfx && gfx->isgfx(&nexttransfer->localfilename))
+                        if (nexttransfer->localfilename.size() && !gfxdisabled && gfx && gfx->isgfx(&nexttransfer->localfilename))
                         {
                             // we want all imagery to be safely tucked away before completing the upload, so we bump minfa
-                            nexttransfer->minfa += gfx->gendimensionsputfa(ts->fa.get(), &nexttransfer->localfilename, nexttransfer->uploadhandle, nexttransfer->transfercipher(), -1, false);
+                            nexttransfer->minfa += gfx->gendimensionsputfa(ts->fa.get(), &nexttransfer->localfilename, nexttransfer->uploadhandle, nexttransfer->transfercipher(), -1, false, nexttransfer);
                         }
                     }
                 }
@@ -3441,9 +3952,25 @@ bool MegaClient::dispatch(direction_t d)
                     }
                 }
 
+                // prefetched URLs that waited too long for a slot may have expired,
+                // and those still on their way are not needed anymore
+                if (nexttransfer->urlprefetchds && Waiter::ds - nexttransfer->urlprefetchds > PREFETCHEDURLTTL_DS)
+                {
+                    LOG_debug << "Discarding prefetched transfer URLs";
+                    nexttransfer->tempurls.clear();
+                }
+                nexttransfer->urlprefetchds = 0;
+
+                if (nexttransfer->urlprefetch)
+                {
+                    nexttransfer->urlprefetch->cancel();
+                    nexttransfer->urlprefetch = NULL;
+                }
+
                 // dispatch request for temporary source/target URL
                 if (nexttransfer->tempurls.size())
                 {
+                    notestoragehosts(d, nexttransfer->tempurls);
                     ts->transferbuf.setIsRaid(nexttransfer, nexttransfer->tempurls, nexttransfer->pos, ts->maxRequestSize);
                     app->transfer_prepare(nexttransfer);
                 }
@@ -3454,6 +3981,9 @@ bool MegaClient::dispatch(direction_t d)
                           : (Command*)new CommandGetFile(this, ts, NULL, h, hprivate, privauth, pubauth, chatauth)));
                 }
 
+                // while the tempurl is on its way, get connections ready
+                prewarmstoragehosts(d);
+
                 LOG_debug << "Activating transfer";
                 ts->slots_it = tslots.insert(tslots.begin(), ts);
 
@@ -3497,6 +4027,71 @@ bool MegaClient::dispatch(direction_t d)
     }
 }
 
+void MegaClient::notestoragehosts(direction_t d, const std::vector<string>& tempurls)
+{
+    for (size_t i = 0; i < tempurls.size(); i++)
+    {
+        const string& url = tempurls[i];
+        size_t start = url.find("://");
+        if (start == string::npos)
+        {
+            continue;
+        }
+
+        size_t end = url.find('/', start + 3);
+        string host = url.substr(0, end);
+
+        std::deque<string>& hosts = recentstoragehosts[d];
+        std::deque<string>::iterator it = std::find(hosts.begin(), hosts.end(), host);
+        if (it != hosts.end())
+        {
+            hosts.erase(it);
+        }
+        hosts.push_front(host);
+        if (hosts.size() > MAXRECENTSTORAGEHOSTS)
+        {
+            hosts.pop_back();
+        }
+    }
+}
+
+void MegaClient::prewarmstoragehosts(direction_t d)
+{
+    if (!prewarmconnections)
+    {
+        return;
+    }
+
+    // the next tempurl is likely to be on a host used recently
+    for (size_t i = 0; i < recentstoragehosts[d].size(); i++)
+    {
+        httpio->preconnect(recentstoragehosts[d][i], d, 1);
+    }
+
+    // queued transfers that already know their tempurls (resumed ones)
+    int lookahead = 0;
+    transfer_list::iterator end = transferlist.end(d);
+    for (transfer_list::iterator it = transferlist.begin(d); it != end && lookahead < PREWARMLOOKAHEAD; it++)
+    {
+        Transfer* t = *it;
+        if (t->slot || t->state == TRANSFERSTATE_PAUSED || !t->tempurls.size())
+        {
+            continue;
+        }
+
+        // a raid download uses one connection per part
+        int n = t->tempurls.size() > 1 ? 1 : transferconnections(d);
+        for (size_t i = 0; i < t->tempurls.size(); i++)
+        {
+            if (t->tempurls[i].size())
+            {
+                httpio->preconnect(t->tempurls[i], d, n);
+            }
+        }
+        lookahead++;
+    }
+}
+
 // generate upload handle for this upload
 // (after 65536 uploads, a node handle clash is possible, but far too unlikely
 // to be of real-world concern)
@@ -3575,30 +4170,48 @@ void MegaClient::checkfacompletion(handle th, Transfer* t)
 void MegaClient::freeq(direction_t d)
 {
     DBTableTransactionCommitter committer(tctable);
-    for (transfer_map::iterator it = transfers[d].begin(); it != transfers[d].end(); )
+
+    tearingdown = true;
+    for (transfer_map::iterator it = transfers[d].begin(); it != transfers[d].end(); it++)
     {
-        delete it++->second;
+        delete it->second;
     }
+    tearingdown = false;
+
+    transfers[d].clear();
+    transferlist.transfers[d].clear();
 }
 
-// determine next scheduled transfer retry
-// FIXME: make this an ordered set and only check the first element instead of
-// scanning the full map!
-void MegaClient::nexttransferretry(direction_t d, dstime* dsmin)
+// determine next scheduled transfer retry: only the transfers whose backoff
+// is due are visited, the wheel knows when the next one will be
+void MegaClient::nexttransferretry(dstime* dsmin)
 {
-    for (transfer_map::iterator it = transfers[d].begin(); it != transfers[d].end(); it++)
+    transferretries.advance(Waiter::ds);
+
+    for (BackoffTimer* bt = transferretries.firstdue(); bt; )
     {
-        if ((!it->second->slot || !it->second->slot->fa)
-         && it->second->bt.nextset())
+        Transfer* t = static_cast<Transfer*>(bt->owner());
+        BackoffTimer* next = transferretries.nextdue(bt);
+
+        // transfers with an open file wait in the due list until it is closed
+        if (!t->slot || !t->slot->fa)
         {
-            it->second->bt.update(dsmin);
-            if (it->second->bt.armed())
+            bt->update(dsmin);
+            if (bt->armed())
             {
                 // fire the timer only once but keeping it armed
-                it->second->bt.set(0);
+                bt->set(0);
                 LOG_debug << "Disabling armed transfer backoff";
             }
         }
+
+        bt = next;
+    }
+
+    dstime next = transferretries.nextevent();
+    if (next < *dsmin)
+    {
+        *dsmin = next;
     }
 }
 
@@ -3611,6 +4224,15 @@ void MegaClient::disconnect()
         pendingcs->disconnect();
     }
 
+    // pipelined batches are only reads: send them again on new connections
+    for (size_t i = 0; i < pipelinedcs.size(); i++)
+    {
+        pipelinedcs[i].req->disconnect();
+        delete pipelinedcs[i].req;
+        reqs.requeuepipelined(pipelinedcs[i].channel);
+    }
+    pipelinedcs.clear();
+
     if (pendingsc)
     {
         pendingsc->disconnect();
@@ -3670,10 +4292,26 @@ void MegaClient::catchup()
         delete pendingsc;
         pendingsc = NULL;
     }
+    cancelscprefetch();
     btcs.reset();
     scnotifyurl.clear();
 }
 
+void MegaClient::nextreqid()
+{
+    for (int i = sizeof reqid; i--; )
+    {
+        if (reqid[i]++ < 'z')
+        {
+            break;
+        }
+        else
+        {
+            reqid[i] = 'a';
+        }
+    }
+}
+
 void MegaClient::abortlockrequest()
 {
     delete workinglockcs;
@@ -3704,12 +4342,36 @@ void MegaClient::locallogout()
     delete sctable;
     sctable = NULL;
     pendingsccommit = false;
+    reloadrecords.clear();
+    reloaddbids.clear();
+    reloadreconciling = false;
+
+    // a recording only covers one session
+    screcorder.reset();
+    screcorderpos = 0;
+
+    fetchedfolders.clear();
+
+    for (map<handle, PutNodesBatch>::iterator it = putnodesbatches.begin(); it != putnodesbatches.end(); it++)
+    {
+        for (size_t i = 0; i < it->second.nodes.size(); i++)
+        {
+            delete [] it->second.nodes[i];
+        }
+    }
+    putnodesbatches.clear();
+
+    // the downloads completed so far stay durable across sessions
+    flushdurable(true);
 
     me = UNDEF;
     uid.clear();
     unshareablekey.clear();
     publichandle = UNDEF;
     cachedscsn = UNDEF;
+    cachepreloadpending = false;
+    preloadedsc.clear();
+    cachepreloaded = false;
     achievements_enabled = false;
     isNewSession = false;
     tsLogin = 0;
@@ -3726,10 +4388,21 @@ void MegaClient::locallogout()
     loggedout = false;
     cachedug = false;
     minstreamingrate = -1;
+    nodekeyrewrite.clear();
+    sharekeyrewrite.clear();
+    foreignkeynodes.clear();
 #ifdef USE_MEDIAINFO
     mediaFileInfo = MediaFileInfo();
+
+    // the jobs still running complete unnoticed
+    mediajobs.clear();
+    mediacache.clear();
+    mediacacheorder.clear();
 #endif
 
+    std::chrono::high_resolution_clock::time_point teardownstart = std::chrono::high_resolution_clock::now();
+    size_t teardownnodes = nodes.size();
+
     freeq(GET);
     freeq(PUT);
 
@@ -3738,10 +4411,16 @@ void MegaClient::locallogout()
 
     purgenodesusersabortsc();
 
+    std::chrono::high_resolution_clock::duration teardowntime = std::chrono::high_resolution_clock::now() - teardownstart;
+    performanceStats.teardown.add(teardowntime);
+    LOG_debug << "Account state released in " << std::chrono::duration_cast<std::chrono::milliseconds>(teardowntime).count()
+              << " ms (" << teardownnodes << " nodes)";
+
     reqs.clear();
 
     delete pendingcs;
     pendingcs = NULL;
+    abortpipelinedcs();
     stopsc = false;
 
     for (putfa_list::iterator it = queuedfa.begin(); it != queuedfa.end(); it++)
@@ -3765,6 +4444,7 @@ void MegaClient::locallogout()
     }
 
     queuedfa.clear();
+    queuedfabytes = 0;
     activefa.clear();
     pendinghttp.clear();
     bttimers.clear();
@@ -3795,6 +4475,7 @@ void MegaClient::locallogout()
     }
 
     fafcs.clear();
+    facachehits.clear();
 
     pendingfa.clear();
 
@@ -3967,6 +4648,7 @@ void MegaClient::httprequest(const char *url, int method, bool binary, const cha
 bool MegaClient::procsc()
 {
     CodeCounter::ScopeTimer ccst(performanceStats.scProcessingTime);
+    Trace::Span ts("procsc");
 
     nameid name;
 
@@ -3978,6 +4660,11 @@ bool MegaClient::procsc()
 #endif
     Node* dn = NULL;
 
+    // at least one action packet is processed per run, and processing never
+    // pauses right after a deletion: it may be the first half of a move
+    bool yieldable = false;
+    scyielded = false;
+
     for (;;)
     {
         if (!insca)
@@ -3994,12 +4681,13 @@ bool MegaClient::procsc()
                     notifypurge();
                     if (sctable)
                     {
-                        if (!pendingcs && !csretrying && !reqs.cmdspending())
+                        if (!pendingcs && !csretrying && !reqs.cmdspending() && !sccommitdeferred())
+                        {
+                            commitsc(true);
+                        }
+                        else if (deferredsccommit)
                         {
-                            sctable->commit();
-                            sctable->begin();
-                            app->notify_dbcommit();
-                            pendingsccommit = false;
+                            pendingsccommit = true;
                         }
                         else
                         {
@@ -4021,9 +4709,7 @@ bool MegaClient::procsc()
                             notifypurge();
                             if (sctable)
                             {
-                                sctable->commit();
-                                sctable->begin();
-                                pendingsccommit = false;
+                                commitsc(false);
                             }
 
                             WAIT_CLASS::bumpds();
@@ -4034,7 +4720,15 @@ bool MegaClient::procsc()
                             restag = fetchnodestag;
                             fetchnodestag = 0;
                             app->fetchnodes_result(API_OK);
-                            app->notify_dbcommit();
+                            if (dbcommitpending)
+                            {
+                                // report it once the asynchronous write makes it durable
+                                dbcommitnotify = true;
+                            }
+                            else
+                            {
+                                app->notify_dbcommit();
+                            }
 
                             WAIT_CLASS::bumpds();
                             fnstats.timeToSyncsResumed = Waiter::ds - fnstats.startTime;
@@ -4130,9 +4824,24 @@ bool MegaClient::procsc()
 
         if (insca)
         {
+            if (yieldable && execscheduler.expired(ExecScheduler::SC))
+            {
+                LOG_debug << "Action packet processing paused, resuming in the next iteration";
+                applykeys();
+#ifdef ENABLE_SYNC
+                // new nodes pending for syncdown() are not forgotten
+                scyielded = fetchingnodes || !newnodes;
+#else
+                scyielded = true;
+#endif
+                return false;
+            }
+
             if (jsonsc.enterobject())
             {
                 // the "a" attribute is guaranteed to be the first in the object
+                yieldable = true;
+
                 if (jsonsc.getnameid() == 'a')
                 {
                     if (!statecurrent)
@@ -4142,6 +4851,8 @@ bool MegaClient::procsc()
 
                     name = jsonsc.getnameid();
 
+                    ScStats::Timer apt(scstats ? &scstats->actionpackets[name] : nullptr);
+
                     // only process server-client request if not marked as
                     // self-originating ("i" marker element guaranteed to be following
                     // "a" element if present)
@@ -4210,6 +4921,7 @@ bool MegaClient::procsc()
                             case 'd':
                                 // node deletion
                                 dn = sc_deltree();
+                                yieldable = false;
 
 #ifdef ENABLE_SYNC
                                 if (fetchingnodes)
@@ -4376,16 +5088,43 @@ void MegaClient::initsc()
 {
     if (sctable)
     {
+        // the table is rewritten from memory
+        loadlazynodes();
+
         bool complete;
 
         sctable->begin();
-        sctable->truncate();
+
+        // after a full reload, records of unchanged nodes are kept as they are
+        bool reconcile = reloadreconciling;
+        reloadreconciling = false;
+
+        if (reconcile)
+        {
+            dropsnapshot();
+        }
+        else
+        {
+            sctable->truncate();
+
+            // the snapshot went with the rest; the next updatesc() takes a new one
+            snapshotchunks = 0;
+            snapshotrecords = 0;
+            snapshotdelta.clear();
+        }
 
         // 1. write current scsn
         handle tscsn;
         Base64::atob(scsn, (byte*)&tscsn, sizeof tscsn);
         complete = sctable->put(CACHEDSCSN, (char*)&tscsn, sizeof tscsn);
 
+        // users, pcrs and chats are rewritten anyway: drop their old records
+        for (size_t i = 0; complete && i < reloaddbids.size(); i++)
+        {
+            complete = sctable->del(reloaddbids[i]);
+        }
+        reloaddbids.clear();
+
         if (complete)
         {
             // 2. write all users
@@ -4401,15 +5140,75 @@ void MegaClient::initsc()
         if (complete)
         {
             // 3. write new or modified nodes, purge deleted nodes
-            for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+            // written in bounded batches, all within the same transaction
+            dbrecord_vector records;
+            records.reserve(std::min(nodes.size(), INITSCBATCHRECORDS));
+
+            size_t unchanged = 0;
+            size_t written = 0;
+            size_t batchbytes = 0;
+            string d;
+
+            for (node_map::iterator it = nodes.begin(); complete && it != nodes.end(); it++)
             {
-                if (!(complete = sctable->put(CACHEDNODE, it->second, &key)))
+                Node* n = it->second;
+
+                if (reconcile)
                 {
-                    break;
+                    reloadrecord_map::iterator rit = reloadrecords.find(n->nodehandle);
+                    if (rit != reloadrecords.end())
+                    {
+                        // same record id, rewritten only if the node changed
+                        n->dbid = rit->second.dbid;
+                        size_t hash = rit->second.hash;
+                        reloadrecords.erase(rit);
+
+                        d.clear();
+                        if (n->serialize(&d) && std::hash<string>()(d) == hash)
+                        {
+                            unchanged++;
+                            continue;
+                        }
+                    }
+                }
+
+                size_t count = records.size();
+                sctable->addbatch(&records, CACHEDNODE, n, &key);
+                if (records.size() > count)
+                {
+                    batchbytes += records.back().data.size();
+                }
+
+                if (records.size() >= INITSCBATCHRECORDS || batchbytes >= INITSCBATCHBYTES)
+                {
+                    complete = sctable->putmany(records);
+                    written += records.size();
+                    records.clear();
+                    batchbytes = 0;
+                }
+            }
+
+            if (complete)
+            {
+                complete = sctable->putmany(records);
+                written += records.size();
+            }
+
+            if (reconcile)
+            {
+                LOG_debug << "Full reload reconciled: " << unchanged << " nodes unchanged, "
+                          << written << " written, " << reloadrecords.size() << " removed";
+
+                // nodes that are gone
+                for (reloadrecord_map::iterator it = reloadrecords.begin(); complete && it != reloadrecords.end(); it++)
+                {
+                    complete = sctable->del(it->second.dbid);
                 }
             }
         }
 
+        reloadrecords.clear();
+
         if (complete)
         {
             // 4. write new or modified pcrs, purge deleted pcrs
@@ -4446,8 +5245,11 @@ void MegaClient::initsc()
 // erase and and fill user's local state cache
 void MegaClient::updatesc()
 {
+    Trace::Span ts("updatesc");
+
     if (sctable)
     {
+        HttpIOReleaser releaser(httpio);
         string t;
 
         sctable->get(CACHEDSCSN, &t);
@@ -4483,6 +5285,7 @@ void MegaClient::updatesc()
                         {
                             break;
                         }
+                        notesnapshot((*it)->dbid);
                     }
                 }
                 else
@@ -4492,6 +5295,7 @@ void MegaClient::updatesc()
                     {
                         break;
                     }
+                    notesnapshot((*it)->dbid);
                 }
             }
         }
@@ -4499,6 +5303,9 @@ void MegaClient::updatesc()
         if (complete)
         {
             // 3. write new or modified nodes, purge deleted nodes
+            dbrecord_vector records;
+            vector<uint32_t> removed;
+
             for (node_vector::iterator it = nodenotify.begin(); it != nodenotify.end(); it++)
             {
                 char base64[12];
@@ -4507,21 +5314,19 @@ void MegaClient::updatesc()
                     if ((*it)->dbid)
                     {
                         LOG_verbose << "Removing node from database: " << (Base64::btoa((byte*)&((*it)->nodehandle),MegaClient::NODEHANDLE,base64) ? base64 : "");
-                        if (!(complete = sctable->del((*it)->dbid)))
-                        {
-                            break;
-                        }
+                        removed.push_back((*it)->dbid);
+                        notesnapshot((*it)->dbid);
                     }
                 }
                 else
                 {
                     LOG_verbose << "Adding node to database: " << (Base64::btoa((byte*)&((*it)->nodehandle),MegaClient::NODEHANDLE,base64) ? base64 : "");
-                    if (!(complete = sctable->put(CACHEDNODE, *it, &key)))
-                    {
-                        break;
-                    }
+                    sctable->addbatch(&records, CACHEDNODE, *it, &key);
+                    notesnapshot((*it)->dbid);
                 }
             }
+
+            complete = sctable->delmany(removed) && sctable->putmany(records);
         }
 
         if (complete)
@@ -4539,6 +5344,7 @@ void MegaClient::updatesc()
                         {
                             break;
                         }
+                        notesnapshot((*it)->dbid);
                     }
                 }
                 else if (!(*it)->removed())
@@ -4548,6 +5354,7 @@ void MegaClient::updatesc()
                     {
                         break;
                     }
+                    notesnapshot((*it)->dbid);
                 }
             }
         }
@@ -4564,75 +5371,314 @@ void MegaClient::updatesc()
                 {
                     break;
                 }
+                notesnapshot(it->second->dbid);
             }
         }
         LOG_debug << "Saving SCSN " << scsn << " with " << nodenotify.size() << " modified nodes, " << usernotify.size() << " users, " << pcrnotify.size() << " pcrs and " << chatnotify.size() << " chats to local cache (" << complete << ")";
 #else
         LOG_debug << "Saving SCSN " << scsn << " with " << nodenotify.size() << " modified nodes, " << usernotify.size() << " users and " << pcrnotify.size() << " pcrs to local cache (" << complete << ")";
 #endif
+        complete = complete && updatesnapshot();
+
         finalizesc(complete);
     }
 }
 
-// commit or purge local state cache
-void MegaClient::finalizesc(bool complete)
+void MegaClient::notesnapshot(uint32_t dbid)
 {
-    if (complete)
+    if (snapshotchunks && dbid)
     {
-        Base64::atob(scsn, (byte*)&cachedscsn, sizeof cachedscsn);
+        snapshotdelta.insert(dbid);
     }
-    else
+}
+
+// take a new snapshot once the changes since the last one would make its
+// header costly to rewrite, or just record the changes of this update
+bool MegaClient::updatesnapshot()
+{
+    if (!scsnapshots)
     {
-        sctable->remove();
+        return true;
+    }
 
-        LOG_err << "Cache update DB write error - disabling caching";
+    size_t maxdelta = std::max(SNAPSHOTMINDELTA, snapshotrecords / 64);
 
-        delete sctable;
-        sctable = NULL;
-        pendingsccommit = false;
+    // serializing lazy nodes would load them all
+    if (statecurrent && !lazynodecount && (!snapshotchunks || snapshotdelta.size() > maxdelta))
+    {
+        return writesnapshot();
     }
+
+    return !snapshotchunks || writesnapshotheader();
 }
 
-// queue node file attribute for retrieval or cancel retrieval
-error MegaClient::getfa(handle h, string *fileattrstring, string *nodekey, fatype t, int cancel)
+bool MegaClient::putsnapshotrecord(uint32_t id, string* data)
 {
-    // locate this file attribute type in the nodes's attribute string
-    handle fah;
-    int p, pp;
+    PaddedCBC::encrypt(rng, data, &key);
+    return sctable->put(id, (char*)data->data(), unsigned(data->size()));
+}
 
-    // find position of file attribute or 0 if not present
-    if (!(p = Node::hasfileattribute(fileattrstring, t)))
+bool MegaClient::writesnapshot()
+{
+    uint32_t chunks = 0;
+    size_t records = 0;
+    string chunk, data;
+    std::set<uint32_t> delta;
+
+    // records that have a dbid but can't be part of the snapshot are read from
+    // their own record (if any) when loading
+    auto add = [&](Cachable* c, bool include) -> bool
     {
-        return API_ENOENT;
-    }
+        if (!c->dbid)
+        {
+            return true;
+        }
 
-    pp = p - 1;
+        data.clear();
+        if (!include || !c->serialize(&data))
+        {
+            delta.insert(c->dbid);
+            return true;
+        }
 
-    while (pp && fileattrstring->at(pp - 1) >= '0' && fileattrstring->at(pp - 1) <= '9')
+        uint32_t len = uint32_t(data.size());
+        chunk.append((const char*)&c->dbid, sizeof c->dbid);
+        chunk.append((const char*)&len, sizeof len);
+        chunk.append(data);
+        records++;
+
+        if (chunk.size() < SNAPSHOTCHUNKSIZE)
+        {
+            return true;
+        }
+
+        chunks++;
+        bool result = putsnapshotrecord(CACHEDSNAPSHOT + chunks * (DbTable::TYPEMASK + 1), &chunk);
+        chunk.clear();
+        return result;
+    };
+
+    bool complete = true;
+
+    for (user_map::iterator it = users.begin(); complete && it != users.end(); it++)
     {
-        pp--;
+        complete = add(&it->second, it->second.show != INACTIVE || it->second.userhandle == me);
     }
 
-    if (p == pp)
+    for (node_map::iterator it = nodes.begin(); complete && it != nodes.end(); it++)
     {
-        return API_ENOENT;
+        complete = add(it->second, true);
     }
 
-    if (Base64::atob(strchr(fileattrstring->c_str() + p, '*') + 1, (byte*)&fah, sizeof(fah)) != sizeof(fah))
+    for (handlepcr_map::iterator it = pcrindex.begin(); complete && it != pcrindex.end(); it++)
     {
-        return API_ENOENT;
+        complete = add(it->second, !it->second->removed());
     }
 
-    int c = atoi(fileattrstring->c_str() + pp);
-
-    if (cancel)
+#ifdef ENABLE_CHAT
+    for (textchat_map::iterator it = chats.begin(); complete && it != chats.end(); it++)
     {
-        // cancel pending request
-        fafc_map::iterator cit;
+        complete = add(it->second, true);
+    }
+#endif
 
-        if ((cit = fafcs.find(c)) != fafcs.end())
-        {
-            faf_map::iterator it;
+    if (complete && (chunk.size() || !chunks))
+    {
+        chunks++;
+        complete = putsnapshotrecord(CACHEDSNAPSHOT + chunks * (DbTable::TYPEMASK + 1), &chunk);
+    }
+
+    // chunks of the previous, longer snapshot
+    for (uint32_t i = chunks + 1; complete && i <= snapshotchunks; i++)
+    {
+        complete = sctable->del(CACHEDSNAPSHOT + i * (DbTable::TYPEMASK + 1));
+    }
+
+    if (!complete)
+    {
+        return false;
+    }
+
+    LOG_debug << "State cache snapshot taken: " << records << " records in " << chunks << " chunks";
+
+    snapshotchunks = chunks;
+    snapshotrecords = records;
+    snapshotdelta.swap(delta);
+    return writesnapshotheader();
+}
+
+bool MegaClient::writesnapshotheader()
+{
+    handle tscsn;
+    Base64::atob(scsn, (byte*)&tscsn, sizeof tscsn);
+
+    string header;
+    CacheableWriter w(header);
+    w.serializeu32(SNAPSHOTVERSION);
+    w.serializehandle(tscsn);
+    w.serializeu32(snapshotchunks);
+    w.serializeu32(uint32_t(snapshotrecords));
+    w.serializeu32(uint32_t(snapshotdelta.size()));
+
+    for (std::set<uint32_t>::iterator it = snapshotdelta.begin(); it != snapshotdelta.end(); it++)
+    {
+        w.serializeu32(*it);
+    }
+
+    return putsnapshotrecord(CACHEDSNAPSHOT, &header);
+}
+
+void MegaClient::dropsnapshot()
+{
+    if (sctable && snapshotchunks)
+    {
+        for (uint32_t i = 0; i <= snapshotchunks; i++)
+        {
+            sctable->del(CACHEDSNAPSHOT + i * (DbTable::TYPEMASK + 1));
+        }
+
+        pendingsccommit = true;
+    }
+
+    snapshotchunks = 0;
+    snapshotrecords = 0;
+    snapshotdelta.clear();
+}
+
+void MegaClient::commitsc(bool notify)
+{
+    {
+        HttpIOReleaser releaser(httpio);
+        sctable->commit();
+    }
+    sctable->begin();
+    pendingsccommit = false;
+    deferredsccommit = false;
+    lastsccommit = Waiter::ds;
+
+    committingscsn = cachedscsn;
+    dbcommitpending = true;
+    dbcommitnotify |= notify;
+    checkdbcommit();
+}
+
+bool MegaClient::sccommitdeferred()
+{
+    if (!powerpolicy.lowpower() || Waiter::ds - lastsccommit >= PowerPolicy::LOWPOWERCOMMITINTERVAL)
+    {
+        return false;
+    }
+
+    if (!deferredsccommit)
+    {
+        LOG_debug << "Deferring DB commit to save power";
+        deferredsccommit = true;
+        powerpolicy.deferredcommits++;
+    }
+    return true;
+}
+
+void MegaClient::checkdbcommit()
+{
+    if (!dbcommitpending || !sctable || !sctable->committed())
+    {
+        return;
+    }
+
+    dbcommitpending = false;
+
+    if (sctable->writefailed())
+    {
+        finalizesc(false);
+        dbcommitnotify = false;
+        return;
+    }
+
+    durablescsn = committingscsn;
+
+    if (dbcommitnotify)
+    {
+        dbcommitnotify = false;
+        app->notify_dbcommit();
+    }
+}
+
+// commit or purge local state cache
+void MegaClient::finalizesc(bool complete)
+{
+    if (complete)
+    {
+        Base64::atob(scsn, (byte*)&cachedscsn, sizeof cachedscsn);
+    }
+    else
+    {
+        // the cache is about to go, and with it the records of lazy nodes
+        loadlazynodes();
+
+        sctable->remove();
+
+        LOG_err << "Cache update DB write error - disabling caching";
+
+        delete sctable;
+        sctable = NULL;
+        pendingsccommit = false;
+    }
+}
+
+// queue node file attribute for retrieval or cancel retrieval
+error MegaClient::getfa(handle h, string *fileattrstring, string *nodekey, fatype t, int cancel)
+{
+    // locate this file attribute type in the nodes's attribute string
+    handle fah;
+    int p, pp;
+
+    // find position of file attribute or 0 if not present
+    if (!(p = Node::hasfileattribute(fileattrstring, t)))
+    {
+        return API_ENOENT;
+    }
+
+    pp = p - 1;
+
+    while (pp && fileattrstring->at(pp - 1) >= '0' && fileattrstring->at(pp - 1) <= '9')
+    {
+        pp--;
+    }
+
+    if (p == pp)
+    {
+        return API_ENOENT;
+    }
+
+    if (Base64::atob(strchr(fileattrstring->c_str() + p, '*') + 1, (byte*)&fah, sizeof(fah)) != sizeof(fah))
+    {
+        return API_ENOENT;
+    }
+
+    int c = atoi(fileattrstring->c_str() + pp);
+
+    if (cancel)
+    {
+        // cancel pending request
+        for (auto hit = facachehits.begin(); hit != facachehits.end(); hit++)
+        {
+            if (hit->fah == fah)
+            {
+                facachehits.erase(hit);
+                return API_OK;
+            }
+        }
+
+        fafc_map::iterator cit;
+
+        for (int k = 0; k < FACHANNELS; k++)
+        {
+            if ((cit = fafcs.find(c * FACHANNELS + k)) == fafcs.end())
+            {
+                continue;
+            }
+
+            faf_map::iterator it;
 
             for (int i = 2; i--; )
             {
@@ -4656,42 +5702,91 @@ error MegaClient::getfa(handle h, string *fileattrstring, string *nodekey, fatyp
     }
     else
     {
-        // add file attribute cluster channel and set cluster reference node handle
-        FileAttributeFetchChannel** fafcp = &fafcs[c];
-
-        if (!*fafcp)
+        // already requested?
+        for (auto hit = facachehits.begin(); hit != facachehits.end(); hit++)
         {
-            *fafcp = new FileAttributeFetchChannel(this);
+            if (hit->fah == fah)
+            {
+                restag = hit->fetch.tag;
+                return API_EEXIST;
+            }
         }
 
-        if (!(*fafcp)->fafs[1].count(fah))
-        {
-            (*fafcp)->fahref = fah;
+        FileAttributeFetchChannel* fc = NULL;
+        size_t fcfetches = 0;
 
-            // map returned handle to type/node upon retrieval response
-            FileAttributeFetch** fafp = &(*fafcp)->fafs[0][fah];
+        for (int k = 0; k < FACHANNELS; k++)
+        {
+            fafc_map::iterator cit = fafcs.find(c * FACHANNELS + k);
+            if (cit == fafcs.end())
+            {
+                continue;
+            }
 
-            if (!*fafp)
+            for (int i = 2; i--; )
             {
-                *fafp = new FileAttributeFetch(h, *nodekey, t, reqtag);
+                faf_map::iterator it = cit->second->fafs[i].find(fah);
+                if (it != cit->second->fafs[i].end())
+                {
+                    restag = it->second->tag;
+                    return API_EEXIST;
+                }
             }
-            else
+
+            // the least busy channel of the cluster
+            size_t fetches = cit->second->fafs[0].size() + cit->second->fafs[1].size();
+            if (!fc || fetches < fcfetches)
             {
-                restag = (*fafp)->tag;
-                return API_EEXIST;
+                fc = cit->second;
+                fcfetches = fetches;
             }
         }
-        else
+
+        string data;
+        if (facache && facache->get(fah, &data))
+        {
+            LOG_debug << "File attribute found in the local cache";
+            facachehits.push_back(FileAttributeCacheHit{ fah, FileAttributeFetch(h, *nodekey, t, reqtag), std::move(data) });
+            looprequested = true;
+            return API_OK;
+        }
+
+        // add file attribute cluster channel (another one of the cluster, so
+        // that large batches are fetched in parallel, if the ones there are
+        // have enough work) and set cluster reference node handle
+        if (!fc || fcfetches >= FACHANNELFETCHES)
         {
-            FileAttributeFetch** fafp = &(*fafcp)->fafs[1][fah];
-            restag = (*fafp)->tag;
-            return API_EEXIST;
+            for (int k = 0; k < FACHANNELS; k++)
+            {
+                FileAttributeFetchChannel** fafcp = &fafcs[c * FACHANNELS + k];
+
+                if (!*fafcp)
+                {
+                    fc = *fafcp = new FileAttributeFetchChannel(this);
+                    break;
+                }
+            }
         }
 
+        fc->fahref = fah;
+
+        // map returned handle to type/node upon retrieval response
+        fc->fafs[0][fah] = new FileAttributeFetch(h, *nodekey, t, reqtag);
+
         return API_OK;
     }
 }
 
+void MegaClient::setfacache(const string* localfolder, m_off_t maxsize)
+{
+    facache.reset();
+
+    if (localfolder && maxsize > 0)
+    {
+        facache.reset(new FileAttributeCache(fsaccess, *localfolder, maxsize));
+    }
+}
+
 // build pending attribute string for this handle and remove
 void MegaClient::pendingattrstring(handle h, string* fa)
 {
@@ -4720,15 +5815,30 @@ void MegaClient::putfa(handle th, fatype t, SymmCipher* key, string* data, bool
     key->cbc_encrypt((byte*)data->data(), data->size());
 
     queuedfa.push_back(new HttpReqCommandPutFA(this, th, t, data, checkAccess));
+    queuedfabytes += data->size();
     LOG_debug << "File attribute added to queue - " << th << " : " << queuedfa.size() << " queued, " << activefa.size() << " active";
 
     // no other file attribute storage request currently in progress? POST this one.
-    while (activefa.size() < MAXPUTFA && queuedfa.size())
+    if (!faretrying)
+    {
+        dispatchfa();
+    }
+}
+
+// the ufa commands sent together travel in the same API request, the
+// attribute data is then POSTed to the storage server one attribute at a time
+void MegaClient::dispatchfa()
+{
+    while (queuedfa.size() && activefa.size() < MAXPUTFA)
     {
+        // dispatch most recent file attribute put
         putfa_list::iterator curfa = queuedfa.begin();
-        HttpReqCommandPutFA *fa = *curfa;
+        HttpReqCommandPutFA* fa = *curfa;
         queuedfa.erase(curfa);
+        queuedfabytes -= fa->data->size();
         activefa.push_back(fa);
+
+        LOG_debug << "Adding file attribute to the request queue";
         fa->status = REQ_INFLIGHT;
         reqs.add(fa);
     }
@@ -4781,6 +5891,12 @@ bool MegaClient::moretransfers(direction_t d)
         return true;
     }
 
+    // small files and fair sharing need the slots to be used concurrently
+    if (transferschedule != TRANSFERSCHEDULE_PRIORITY)
+    {
+        return true;
+    }
+
     // otherwise, don't allow more than two concurrent transfers
     if (total >= 2)
     {
@@ -4844,75 +5960,356 @@ error MegaClient::smsverificationcheck(const std::string &verificationCode)
     return API_OK;
 }
 
-void MegaClient::dispatchmore(direction_t d)
+// replace the pool of transfer crypto workers (0: on the SDK thread); the
+// previous pool completes its jobs before going away
+void MegaClient::setcryptothreads(unsigned threads)
 {
-    // keep pipeline full by dispatching additional queued transfers, if
-    // appropriate and available
-    while (moretransfers(d) && dispatch(d));
+    if (threads == (cryptoworkers ? cryptoworkers->size() : 0))
+    {
+        return;
+    }
+
+    cryptoworkers.reset(threads ? new CryptoWorkers(threads, waiter) : NULL);
+    LOG_debug << "Transfer crypto threads: " << threads;
 }
 
-// server-client node update processing
-void MegaClient::sc_updatenode()
+// queue a completed upload (a single NewNode, taken over) to be put into the target folder
+void MegaClient::batchputnode(handle target, NewNode* newnode, int tag)
 {
-    handle h = UNDEF;
-    handle u = 0;
-    const char* a = NULL;
-    m_time_t ts = -1;
-
-    for (;;)
+    PutNodesBatch& batch = putnodesbatches[target];
+    if (batch.nodes.empty())
     {
-        switch (jsonsc.getnameid())
-        {
-            case 'n':
-                h = jsonsc.gethandle();
-                break;
+        batch.since = Waiter::ds;
+    }
 
-            case 'u':
-                u = jsonsc.gethandle(USERHANDLE);
-                break;
+    batch.nodes.push_back(newnode);
+    batch.tags.push_back(tag);
 
-            case MAKENAMEID2('a', 't'):
-                a = jsonsc.getvalue();
-                break;
+    if (batch.nodes.size() >= size_t(MAX_NEWNODES))
+    {
+        flushputnodes(true);
+    }
+}
 
-            case MAKENAMEID2('t', 's'):
-                ts = jsonsc.getint();
-                break;
+// send the batches that are full or have waited long enough (all of them if forced)
+#ifdef USE_MEDIAINFO
+void MegaClient::MediaJob::run()
+{
+    vp.extractMediaPropertyFileAttributes(localpath, fsaccess);
+}
 
-            case EOO:
-                if (!ISUNDEF(h))
-                {
-                    Node* n;
-                    bool notify = false;
+bool MegaClient::cachedmediaproperties(const FileFingerprint& fp, MediaProperties& vp)
+{
+    if (!fp.isvalid)
+    {
+        return false;
+    }
 
-                    if ((n = nodebyhandle(h)))
-                    {
-                        if (u && n->owner != u)
-                        {
-                            n->owner = u;
-                            n->changed.owner = true;
-                            notify = true;
-                        }
+    string key;
+    fp.serializefingerprint(&key);
+    map<string, MediaProperties>::iterator it = mediacache.find(key);
+    if (it == mediacache.end())
+    {
+        return false;
+    }
 
-                        if (a && ((n->attrstring && strcmp(n->attrstring->c_str(), a)) || !n->attrstring))
-                        {
-                            if (!n->attrstring)
-                            {
-                                n->attrstring = new string;
-                            }
-                            Node::copystring(n->attrstring, a);
-                            n->changed.attrs = true;
-                            notify = true;
-                        }
+    LOG_debug << "Media attributes found by fingerprint";
+    vp = it->second;
+    return true;
+}
 
-                        if (ts != -1 && n->ctime != ts)
-                        {
-                            n->ctime = ts;
-                            n->changed.ctime = true;
-                            notify = true;
-                        }
+void MegaClient::extractmediaproperties(const FileFingerprint& fp, string* localpath, bool upload, handle h, uint32_t fakey[4])
+{
+    if (!mediaworkers)
+    {
+        mediaworkers.reset(new CryptoWorkers(MEDIATHREADS, waiter));
+    }
 
-                        n->applykey();
+    std::shared_ptr<MediaJob> job = std::make_shared<MediaJob>();
+    job->fsaccess = fsaccess;
+    job->localpath = *localpath;
+    if (fp.isvalid)
+    {
+        fp.serializefingerprint(&job->fingerprint);
+    }
+    job->upload = upload;
+    job->h = h;
+    memcpy(job->fakey, fakey, sizeof job->fakey);
+
+    mediajobs.push_back(job);
+    mediaworkers->submit(job);
+}
+
+// the media attributes extracted by the workers, in any order
+void MegaClient::execmediajobs()
+{
+    for (std::list<std::shared_ptr<MediaJob> >::iterator it = mediajobs.begin(); it != mediajobs.end(); )
+    {
+        MediaJob& job = **it;
+        if (!job.finished())
+        {
+            it++;
+            continue;
+        }
+
+        if (job.fingerprint.size() && job.vp.isPopulated() && !mediacache.count(job.fingerprint))
+        {
+            if (mediacache.size() >= MEDIACACHESIZE)
+            {
+                mediacache.erase(mediacacheorder.front());
+                mediacacheorder.pop_front();
+            }
+            mediacache[job.fingerprint] = job.vp;
+            mediacacheorder.push_back(job.fingerprint);
+        }
+
+        if (job.upload)
+        {
+            // the upload is on hold until its attributes are ready (see checkfacompletion)
+            handletransfer_map::iterator htit = faputcompletion.find(job.h);
+            if (htit == faputcompletion.end())
+            {
+                LOG_debug << "Transfer related to media file not found: " << job.h;
+            }
+            else
+            {
+                if (!mediaFileInfo.queueMediaPropertiesFileAttributesForUpload(job.vp, job.fakey, this, job.h))
+                {
+                    // no attribute after all: let the upload complete without it
+                    htit->second->minfa--;
+                }
+                checkfacompletion(job.h);
+            }
+        }
+        else
+        {
+            mediaFileInfo.sendOrQueueMediaPropertiesFileAttributesForExistingFile(job.vp, job.fakey, this, job.h);
+        }
+
+        it = mediajobs.erase(it);
+    }
+}
+#endif
+
+void MegaClient::flushputnodes(bool force)
+{
+    for (map<handle, PutNodesBatch>::iterator it = putnodesbatches.begin(); it != putnodesbatches.end(); )
+    {
+        PutNodesBatch& batch = it->second;
+        if (!force && batch.nodes.size() < size_t(MAX_NEWNODES) && Waiter::ds < batch.since + PUTNODES_BATCH_DS)
+        {
+            it++;
+            continue;
+        }
+
+        int count = int(batch.nodes.size());
+        NewNode* newnodes = new NewNode[count];
+
+        for (int i = 0; i < count; i++)
+        {
+            NewNode* src = batch.nodes[i];
+            NewNode* dst = newnodes + i;
+
+            dst->source = src->source;
+            dst->type = src->type;
+            dst->parenthandle = src->parenthandle;
+            dst->nodekey.swap(src->nodekey);
+            dst->ovhandle = src->ovhandle;
+            dst->uploadhandle = src->uploadhandle;
+            memcpy(dst->uploadtoken, src->uploadtoken, sizeof dst->uploadtoken);
+            std::swap(dst->attrstring, src->attrstring);
+            std::swap(dst->fileattributes, src->fileattributes);
+
+            delete [] src;
+        }
+
+        LOG_debug << "Putting " << count << " uploads into " << toNodeHandle(it->first);
+
+        CommandPutNodes* cmd = new CommandPutNodes(this, it->first, NULL, newnodes, count, 0);
+        cmd->batchtags.swap(batch.tags);
+        reqs.add(cmd);
+
+        putnodesbatches.erase(it++);
+    }
+}
+
+void MegaClient::queuedurable(const string& localname)
+{
+    if (downloaddurability == DURABILITY_NONE)
+    {
+        return;
+    }
+
+    if (durablefiles.empty())
+    {
+        durablesince = Waiter::ds;
+    }
+    durablefiles.push_back(localname);
+}
+
+void MegaClient::flushdurable(bool force)
+{
+    if (!force && (durablefiles.empty() || durablebusy || Waiter::ds < durablesince + durabilityds))
+    {
+        return;
+    }
+
+    if (durablethread.joinable())
+    {
+        durablethread.join();
+    }
+
+    if (durablefiles.empty())
+    {
+        return;
+    }
+
+    bool wholefilesystem = downloaddurability == DURABILITY_FILESYSTEM;
+    vector<string> files;
+    files.swap(durablefiles);
+
+    LOG_debug << "Flushing " << files.size() << " downloads" << (wholefilesystem ? " (file systems)" : "");
+
+    if (force)
+    {
+        fsaccess->flushlocal(files, wholefilesystem);
+        return;
+    }
+
+    durablebusy = true;
+    FileSystemAccess* fs = fsaccess;
+    Waiter* w = waiter;
+    durablethread = std::thread([this, fs, w, wholefilesystem](const vector<string>& files)
+    {
+        fs->flushlocal(files, wholefilesystem);
+        durablebusy = false;
+        w->notify();
+    }, std::move(files));
+}
+
+void MegaClient::dispatchmore(direction_t d)
+{
+    // keep pipeline full by dispatching additional queued transfers, if
+    // appropriate and available
+    while (moretransfers(d) && dispatch(d));
+
+    prefetchtransferurls(d);
+}
+
+// request the tempurls of the next queued transfers, so that they can start
+// as soon as they get a slot: the requests go in the same client-server batch
+void MegaClient::prefetchtransferurls(direction_t d)
+{
+    if (!prefetchurls)
+    {
+        return;
+    }
+
+    int lookahead = 0;
+    unsigned requested = 0;
+    transfer_list::iterator end = transferlist.end(d);
+    for (transfer_list::iterator it = transferlist.begin(d); it != end && lookahead < PREFETCHURLS; it++)
+    {
+        Transfer* t = *it;
+        if (t->slot || !transferlist.isReady(t))
+        {
+            continue;
+        }
+
+        lookahead++;
+
+        // transfers with URLs already, on their way or failed recently
+        if (t->urlprefetch || (t->tempurls.size() && !t->urlprefetchds)
+                || (t->urlprefetchds && Waiter::ds - t->urlprefetchds <= PREFETCHEDURLTTL_DS))
+        {
+            continue;
+        }
+
+        // the size of the file is part of the request
+        if (t->size < 0)
+        {
+            continue;
+        }
+
+        t->tempurls.clear();
+        t->urlprefetchds = Waiter::ds;
+        reqs.add(t->urlprefetch = new CommandPrefetchTransferUrls(this, t, putmbpscap));
+        requested++;
+    }
+
+    if (requested)
+    {
+        LOG_debug << "Prefetching the URLs of " << requested << (d == PUT ? " uploads" : " downloads");
+    }
+}
+
+// server-client node update processing
+void MegaClient::sc_updatenode()
+{
+    handle h = UNDEF;
+    handle u = 0;
+    const char* a = NULL;
+    m_time_t ts = -1;
+
+    for (;;)
+    {
+        switch (jsonsc.getnameid())
+        {
+            case 'n':
+                h = jsonsc.gethandle();
+                break;
+
+            case 'u':
+                u = jsonsc.gethandle(USERHANDLE);
+                break;
+
+            case MAKENAMEID2('a', 't'):
+                a = jsonsc.getvalue();
+                break;
+
+            case MAKENAMEID2('t', 's'):
+                ts = jsonsc.getint();
+                break;
+
+            case EOO:
+                if (!ISUNDEF(h))
+                {
+                    Node* n;
+                    bool notify = false;
+
+                    if ((n = nodebyhandle(h)))
+                    {
+                        if (u && n->owner != u)
+                        {
+                            n->owner = u;
+                            n->changed.owner = true;
+                            notify = true;
+                        }
+
+                        if (a && ((n->attrstring && strcmp(n->attrstring->c_str(), a)) || !n->attrstring))
+                        {
+                            if (!n->attrstring)
+                            {
+                                n->attrstring = new string;
+                            }
+                            Node::copystring(n->attrstring, a);
+                            n->changed.attrs = true;
+                            notify = true;
+                        }
+
+                        if (ts != -1 && n->ctime != ts)
+                        {
+                            n->ctime = ts;
+                            if (n->type == FILENODE)
+                            {
+                                mRecentNodes.erase(n->recent_it);
+                                n->recent_it = mRecentNodes.insert(std::make_pair(ts, n));
+                            }
+                            n->changed.ctime = true;
+                            notify = true;
+                        }
+
+                        n->applykey();
                         n->setattr();
 
                         if (notify)
@@ -5366,10 +6763,11 @@ void MegaClient::sc_userattr()
     handle uh = UNDEF;
     User *u = NULL;
 
-    string ua, uav;
-    string_vector ualist;    // stores attribute names
-    string_vector uavlist;   // stores attribute versions
-    string_vector::const_iterator itua, ituav;
+    const char* ua;
+    const char* uav;
+    transient_vector<const char*> ualist((ArenaAllocator<const char*>(transientarena)));    // stores attribute names
+    transient_vector<const char*> uavlist((ArenaAllocator<const char*>(transientarena)));   // stores attribute versions
+    transient_vector<const char*>::const_iterator itua, ituav;
 
     for (;;)
     {
@@ -5382,7 +6780,7 @@ void MegaClient::sc_userattr()
             case MAKENAMEID2('u', 'a'):
                 if (jsonsc.enterarray())
                 {
-                    while (jsonsc.storeobject(&ua))
+                    while ((ua = jsonsc.storeobject(transientarena)))
                     {
                         ualist.push_back(ua);
                     }
@@ -5393,7 +6791,7 @@ void MegaClient::sc_userattr()
             case 'v':
                 if (jsonsc.enterarray())
                 {
-                    while (jsonsc.storeobject(&uav))
+                    while ((uav = jsonsc.storeobject(transientarena)))
                     {
                         uavlist.push_back(uav);
                     }
@@ -5419,7 +6817,7 @@ void MegaClient::sc_userattr()
                          itua != ualist.end();
                          itua++, ituav++)
                     {
-                        attr_t type = User::string2attr(itua->c_str());
+                        attr_t type = User::string2attr(*itua);
                         const string *cacheduav = u->getattrversion(type);
                         if (cacheduav)
                         {
@@ -5907,6 +7305,7 @@ void MegaClient::sc_ph()
                     {
                         delete n->plink;
                         n->plink = NULL;
+                        indexsharing(n);
                     }
                 }
                 else
@@ -6418,6 +7817,15 @@ void MegaClient::sc_ub()
 
 }
 
+void MegaClient::purgeremoved(size_t maxnodes)
+{
+    for (; maxnodes && purgequeue.size(); maxnodes--)
+    {
+        delete purgequeue.front();
+        purgequeue.pop_front();
+    }
+}
+
 // scan notified nodes for
 // - name differences with an existing LocalNode
 // - appearance of new folders
@@ -6426,6 +7834,8 @@ void MegaClient::sc_ub()
 // purge removed nodes after notification
 void MegaClient::notifypurge(void)
 {
+    ScStats::Timer npt(scstats ? &scstats->notifypurge : nullptr);
+
     int i, t;
 
     handle tscsn = cachedscsn;
@@ -6461,12 +7871,46 @@ void MegaClient::notifypurge(void)
                 delsync(*it);
             }
         }
+
+        if (syncs.size() && !fetchingnodes)
+        {
+            for (i = 0; i < t; i++)
+            {
+                syncdownmark(nodenotify[i]);
+            }
+        }
 #endif
         applykeys();
 
         if (!fetchingnodes)
         {
-            app->nodes_updated(&nodenotify[0], t);
+            size_t removed = 0;
+            for (i = 0; i < t; i++)
+            {
+                removed += nodenotify[i]->changed.removed;
+            }
+
+            if (removed > COALESCEDREMOVALS)
+            {
+                // the removal of a subtree is notified through its root only
+                node_vector coalesced;
+                for (i = 0; i < t; i++)
+                {
+                    Node* n = nodenotify[i];
+                    if (!n->changed.removed || !n->parent || !n->parent->changed.removed)
+                    {
+                        n->changed.removedtree = n->changed.removed;
+                        coalesced.push_back(n);
+                    }
+                }
+
+                LOG_debug << removed << " nodes removed, " << coalesced.size() << " nodes notified";
+                app->nodes_updated(coalesced.data(), int(coalesced.size()));
+            }
+            else
+            {
+                app->nodes_updated(&nodenotify[0], t);
+            }
         }
 
         // check all notified nodes for removed status and purge
@@ -6494,7 +7938,8 @@ void MegaClient::notifypurge(void)
                 }
 
                 nodes.erase(n->nodehandle);
-                delete n;
+                n->detach();
+                purgequeue.push_back(n);
             }
             else
             {
@@ -6505,6 +7950,7 @@ void MegaClient::notifypurge(void)
         }
 
         nodenotify.clear();
+        purgeremoved();
     }
 
     if ((t = int(pcrnotify.size())))
@@ -6609,12 +8055,16 @@ void MegaClient::notifypurge(void)
 }
 
 // return node pointer derived from node handle
-Node* MegaClient::nodebyhandle(handle h)
+Node* MegaClient::nodebyhandle(handle h, bool load)
 {
     node_map::iterator it;
 
     if ((it = nodes.find(h)) != nodes.end())
     {
+        if (load)
+        {
+            it->second->materialize();
+        }
         return it->second;
     }
 
@@ -6718,6 +8168,9 @@ error MegaClient::setattr(Node* n, const char *prevattr)
     n->tag = reqtag;
     notifynode(n);
 
+    mNodeNameIndex.update(n);
+    n->namechanged();
+
     reqs.add(new CommandSetAttr(this, n, cipher, prevattr));
 
     return API_OK;
@@ -7121,311 +8574,501 @@ uint64_t MegaClient::stringhash64(string* s, SymmCipher* c)
 // read and add/verify node array
 int MegaClient::readnodes(JSON* j, int notify, putsource_t source, NewNode* nn, int nnsize, int tag)
 {
+    Trace::Span ts("readnodes");
+
     if (!j->enterarray())
     {
         return 0;
     }
 
     node_vector dp;
-    Node* n;
 
     while (j->enterobject())
     {
-        handle h = UNDEF, ph = UNDEF;
-        handle u = 0, su = UNDEF;
-        nodetype_t t = TYPE_UNKNOWN;
-        const char* a = NULL;
-        const char* k = NULL;
-        const char* fa = NULL;
-        const char *sk = NULL;
-        accesslevel_t rl = ACCESS_UNKNOWN;
-        m_off_t s = NEVER;
-        m_time_t ts = -1, sts = -1;
-        nameid name;
-        int nni = -1;
-
-        while ((name = j->getnameid()) != EOO)
+        if (!readnode(j, notify, source, nn, nnsize, tag, dp))
         {
-            switch (name)
-            {
-                case 'h':   // new node: handle
-                    h = j->gethandle();
-                    break;
+            return 0;
+        }
+    }
 
-                case 'p':   // parent node
-                    ph = j->gethandle();
-                    break;
+    linkdelayedparents(dp);
 
-                case 'u':   // owner user
-                    u = j->gethandle(USERHANDLE);
-                    break;
+    return j->leavearray();
+}
 
-                case 't':   // type
-                    t = (nodetype_t)j->getint();
-                    break;
+// read a single node object (the JSON must be positioned inside it)
+int MegaClient::readnode(JSON* j, int notify, putsource_t source, NewNode* nn, int nnsize, int tag, node_vector& dp)
+{
+    Node* n;
 
-                case 'a':   // attributes
-                    a = j->getvalue();
-                    break;
+    handle h = UNDEF, ph = UNDEF;
+    handle u = 0, su = UNDEF;
+    nodetype_t t = TYPE_UNKNOWN;
+    const char* a = NULL;
+    const char* k = NULL;
+    const char* fa = NULL;
+    const char *sk = NULL;
+    accesslevel_t rl = ACCESS_UNKNOWN;
+    m_off_t s = NEVER;
+    m_time_t ts = -1, sts = -1;
+    nameid name;
+    int nni = -1;
 
-                case 'k':   // key(s)
-                    k = j->getvalue();
-                    break;
+    while ((name = j->getnameid()) != EOO)
+    {
+        switch (name)
+        {
+            case 'h':   // new node: handle
+                h = j->gethandle();
+                break;
 
-                case 's':   // file size
-                    s = j->getint();
-                    break;
+            case 'p':   // parent node
+                ph = j->gethandle();
+                break;
 
-                case 'i':   // related source NewNode index
-                    nni = int(j->getint());
-                    break;
+            case 'u':   // owner user
+                u = j->gethandle(USERHANDLE);
+                break;
 
-                case MAKENAMEID2('t', 's'):  // actual creation timestamp
-                    ts = j->getint();
-                    break;
+            case 't':   // type
+                t = (nodetype_t)j->getint();
+                break;
 
-                case MAKENAMEID2('f', 'a'):  // file attributes
-                    fa = j->getvalue();
-                    break;
+            case 'a':   // attributes
+                a = j->getvalue();
+                break;
 
-                    // inbound share attributes
-                case 'r':   // share access level
-                    rl = (accesslevel_t)j->getint();
-                    break;
+            case 'k':   // key(s)
+                k = j->getvalue();
+                break;
 
-                case MAKENAMEID2('s', 'k'):  // share key
-                    sk = j->getvalue();
-                    break;
+            case 's':   // file size
+                s = j->getint();
+                break;
 
-                case MAKENAMEID2('s', 'u'):  // sharing user
-                    su = j->gethandle(USERHANDLE);
-                    break;
+            case 'i':   // related source NewNode index
+                nni = int(j->getint());
+                break;
 
-                case MAKENAMEID3('s', 't', 's'):  // share timestamp
-                    sts = j->getint();
-                    break;
+            case MAKENAMEID2('t', 's'):  // actual creation timestamp
+                ts = j->getint();
+                break;
 
-                default:
-                    if (!j->storeobject())
-                    {
-                        return 0;
-                    }
-            }
+            case MAKENAMEID2('f', 'a'):  // file attributes
+                fa = j->getvalue();
+                break;
+
+                // inbound share attributes
+            case 'r':   // share access level
+                rl = (accesslevel_t)j->getint();
+                break;
+
+            case MAKENAMEID2('s', 'k'):  // share key
+                sk = j->getvalue();
+                break;
+
+            case MAKENAMEID2('s', 'u'):  // sharing user
+                su = j->gethandle(USERHANDLE);
+                break;
+
+            case MAKENAMEID3('s', 't', 's'):  // share timestamp
+                sts = j->getint();
+                break;
+
+            default:
+                if (!j->storeobject())
+                {
+                    return 0;
+                }
         }
+    }
 
-        if (ISUNDEF(h))
+    if (ISUNDEF(h))
+    {
+        warn("Missing node handle");
+    }
+    else
+    {
+        if (t == TYPE_UNKNOWN)
         {
-            warn("Missing node handle");
+            warn("Unknown node type");
         }
-        else
+        else if (t == FILENODE || t == FOLDERNODE)
+        {
+            if (ISUNDEF(ph))
+            {
+                warn("Missing parent");
+            }
+            else if (!a)
+            {
+                warn("Missing node attributes");
+            }
+            else if (!k)
+            {
+                warn("Missing node key");
+            }
+
+            if (t == FILENODE && ISUNDEF(s))
+            {
+                warn("File node without file size");
+            }
+        }
+    }
+
+    if (fa && t != FILENODE)
+    {
+        warn("Spurious file attributes");
+    }
+
+    if (!warnlevel())
+    {
+        if ((n = nodebyhandle(h)))
         {
-            if (t == TYPE_UNKNOWN)
+            Node* p = NULL;
+            if (!ISUNDEF(ph))
+            {
+                p = nodebyhandle(ph);
+            }
+
+            if (n->changed.removed)
             {
-                warn("Unknown node type");
+                // node marked for deletion is being resurrected, possibly
+                // with a new parent (server-client move operation)
+                n->changed.removed = false;
             }
-            else if (t == FILENODE || t == FOLDERNODE)
+            else
             {
-                if (ISUNDEF(ph))
+                // node already present - check for race condition
+                if ((n->parent && ph != n->parent->nodehandle && p &&  p->type != FILENODE) || n->type != t)
                 {
-                    warn("Missing parent");
+                    app->reload("Node inconsistency");
+
+                    static bool reloadnotified = false;
+                    if (!reloadnotified)
+                    {
+                        sendevent(99437, "Node inconsistency", 0);
+                        reloadnotified = true;
+                    }
                 }
-                else if (!a)
+            }
+
+            if (!ISUNDEF(ph))
+            {
+                if (p)
                 {
-                    warn("Missing node attributes");
+                    n->setparent(p);
+                    n->changed.parent = true;
                 }
-                else if (!k)
+                else
                 {
-                    warn("Missing node key");
+                    n->setparent(NULL);
+                    n->parenthandle = ph;
+                    dp.push_back(n);
                 }
+            }
 
-                if (t == FILENODE && ISUNDEF(s))
-                {
-                    warn("File node without file size");
-                }
+            if (a && k && n->attrstring)
+            {
+                LOG_warn << "Updating the key of a NO_KEY node";
+                Node::copystring(n->attrstring, a);
+                Node::copystring(&n->nodekey, k);
+                keypending(n);
             }
         }
-
-        if (fa && t != FILENODE)
+        else
         {
-            warn("Spurious file attributes");
-        }
+            byte buf[SymmCipher::KEYLENGTH];
 
-        if (!warnlevel())
-        {
-            if ((n = nodebyhandle(h)))
+            if (!ISUNDEF(su))
             {
-                Node* p = NULL;
-                if (!ISUNDEF(ph))
+                if (t != FOLDERNODE)
                 {
-                    p = nodebyhandle(ph);
+                    warn("Invalid share node type");
                 }
 
-                if (n->changed.removed)
+                if (rl == ACCESS_UNKNOWN)
                 {
-                    // node marked for deletion is being resurrected, possibly
-                    // with a new parent (server-client move operation)
-                    n->changed.removed = false;
+                    warn("Missing access level");
                 }
-                else
-                {
-                    // node already present - check for race condition
-                    if ((n->parent && ph != n->parent->nodehandle && p &&  p->type != FILENODE) || n->type != t)
-                    {
-                        app->reload("Node inconsistency");
 
-                        static bool reloadnotified = false;
-                        if (!reloadnotified)
-                        {
-                            sendevent(99437, "Node inconsistency", 0);
-                            reloadnotified = true;
-                        }
-                    }
+                if (!sk)
+                {
+                    LOG_warn << "Missing share key for inbound share";
                 }
 
-                if (!ISUNDEF(ph))
+                if (warnlevel())
                 {
-                    if (p)
-                    {
-                        n->setparent(p);
-                        n->changed.parent = true;
-                    }
-                    else
+                    su = UNDEF;
+                }
+                else
+                {
+                    if (sk)
                     {
-                        n->setparent(NULL);
-                        n->parenthandle = ph;
-                        dp.push_back(n);
+                        decryptkey(sk, buf, sizeof buf, &key, 1, h);
                     }
                 }
+            }
 
-                if (a && k && n->attrstring)
-                {
-                    LOG_warn << "Updating the key of a NO_KEY node";
-                    Node::copystring(n->attrstring, a);
-                    Node::copystring(&n->nodekey, k);
-                }
+            // fallback timestamps
+            if (!(ts + 1))
+            {
+                ts = m_time();
             }
-            else
+
+            if (!(sts + 1))
+            {
+                sts = ts;
+            }
+
+            // the Node copies the file attributes up to their closing quote
+            n = new Node(this, &dp, h, ph, t, s, u, fa, ts);
+
+            n->tag = tag;
+
+            n->attrstring = new string;
+            Node::copystring(n->attrstring, a);
+            Node::copystring(&n->nodekey, k);
+            keypending(n);
+
+            if (!ISUNDEF(su))
+            {
+                newshares.push_back(new NewShare(h, 0, su, rl, sts, sk ? buf : NULL));
+            }
+
+            if (u != me && !ISUNDEF(u) && !fetchingnodes)
             {
-                byte buf[SymmCipher::KEYLENGTH];
+                useralerts.noteSharedNode(u, t, ts, n);
+            }
+
+            if (nn && nni >= 0 && nni < nnsize)
+            {
+                nn[nni].added = true;
+                nn[nni].addedhandle = h;
 
-                if (!ISUNDEF(su))
+#ifdef ENABLE_SYNC
+                if (source == PUTNODES_SYNC)
                 {
-                    if (t != FOLDERNODE)
+                    if (nn[nni].localnode)
                     {
-                        warn("Invalid share node type");
-                    }
+                        // overwrites/updates: associate LocalNode with newly created Node
+                        nn[nni].localnode->setnode(n);
+                        nn[nni].localnode->newnode = NULL;
+                        nn[nni].localnode->treestate(TREESTATE_SYNCED);
 
-                    if (rl == ACCESS_UNKNOWN)
-                    {
-                        warn("Missing access level");
+                        // updates cache with the new node associated
+                        nn[nni].localnode->sync->statecacheadd(nn[nni].localnode);
                     }
+                }
+#endif
 
-                    if (!sk)
-                    {
-                        LOG_warn << "Missing share key for inbound share";
-                    }
+                if (nn[nni].source == NEW_UPLOAD)
+                {
+                    handle uh = nn[nni].uploadhandle;
 
-                    if (warnlevel())
-                    {
-                        su = UNDEF;
-                    }
-                    else
+                    // do we have pending file attributes for this upload? set them.
+                    for (fa_map::iterator it = pendingfa.lower_bound(pair<handle, fatype>(uh, fatype(0)));
+                         it != pendingfa.end() && it->first.first == uh; )
                     {
-                        if (sk)
-                        {
-                            decryptkey(sk, buf, sizeof buf, &key, 1, h);
-                        }
+                        reqs.add(new CommandAttachFA(this, h, it->first.second, it->second.first, it->second.second));
+                        pendingfa.erase(it++);
                     }
+
+                    // FIXME: only do this for in-flight FA writes
+                    uhnh.insert(pair<handle, handle>(uh, h));
                 }
+            }
+        }
 
-                string fas;
+        if (notify)
+        {
+            notifynode(n);
+        }
+    }
 
-                Node::copystring(&fas, fa);
+    return 1;
+}
 
-                // fallback timestamps
-                if (!(ts + 1))
-                {
-                    ts = m_time();
-                }
+// any child nodes that arrived before their parents?
+void MegaClient::linkdelayedparents(node_vector& dp)
+{
+    Node* n;
 
-                if (!(sts + 1))
-                {
-                    sts = ts;
-                }
+    for (size_t i = dp.size(); i--; )
+    {
+        if ((n = nodebyhandle(dp[i]->parenthandle, false)))
+        {
+            dp[i]->setparent(n);
+        }
+    }
+}
 
-                n = new Node(this, &dp, h, ph, t, s, u, fas.c_str(), ts);
+// same as calling applykey() on every node, but the decryption of node keys
+// and attributes is sharded across threads. Key lookup (which needs other
+// nodes' share keys) and applying the results stay on this thread. RSA-encrypted
+// keys are decrypted by the same threads, one at a time as they are much slower
+int MegaClient::applykeysparallel()
+{
+    struct KeyJob
+    {
+        Node* node;
+        const char* k;
+        SymmCipher* sc;
+        int keylength;
+        bool asymmetric;
+        byte key[FILENODEKEYLENGTH];
+        bool keyok;
+        bool attrsok;
+        AttrMap attrs;
+    };
 
-                n->tag = tag;
+    int t = 0;
+    vector<KeyJob> jobs;
+    vector<size_t> asymmetricjobs;
 
-                n->attrstring = new string;
-                Node::copystring(n->attrstring, a);
-                Node::copystring(&n->nodekey, k);
+    for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+    {
+        Node* n = it->second;
+        const char* k;
+        SymmCipher* sc;
 
-                if (!ISUNDEF(su))
-                {
-                    newshares.push_back(new NewShare(h, 0, su, rl, sts, sk ? buf : NULL));
-                }
+        if (!n->findkey(&k, &sc))
+        {
+            continue;
+        }
 
-                if (u != me && !ISUNDEF(u) && !fetchingnodes)
-                {
-                    useralerts.noteSharedNode(u, t, ts, n);
-                }
+        t++;
 
-                if (nn && nni >= 0 && nni < nnsize)
-                {
-                    nn[nni].added = true;
+        jobs.emplace_back();
+        KeyJob& job = jobs.back();
+        job.node = n;
+        job.k = k;
+        job.sc = sc;
+        job.keylength = (n->type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+        job.asymmetric = isasymmetrickey(keystringlength(k));
+        job.keyok = false;
+        job.attrsok = false;
 
-#ifdef ENABLE_SYNC
-                    if (source == PUTNODES_SYNC)
-                    {
-                        if (nn[nni].localnode)
-                        {
-                            // overwrites/updates: associate LocalNode with newly created Node
-                            nn[nni].localnode->setnode(n);
-                            nn[nni].localnode->newnode = NULL;
-                            nn[nni].localnode->treestate(TREESTATE_SYNCED);
+        if (job.asymmetric)
+        {
+            asymmetricjobs.push_back(jobs.size() - 1);
+        }
+    }
 
-                            // updates cache with the new node associated
-                            nn[nni].localnode->sync->statecacheadd(nn[nni].localnode);
-                        }
-                    }
-#endif
+    // workers only read the jobs' node key/attribute strings, the cipher keys
+    // and the RSA private key, which don't change until they are joined
+    const size_t CHUNK = 256;
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> nextasymmetric(0);
+    AsymmCipher* privkey = &asymkey;
+    auto worker = [&jobs, &asymmetricjobs, &next, &nextasymmetric, privkey, CHUNK]()
+    {
+        SymmCipher keycipher, attrcipher;
+        const SymmCipher* current = nullptr;
+        string nodekey;
+        string buf;
 
-                    if (nn[nni].source == NEW_UPLOAD)
-                    {
-                        handle uh = nn[nni].uploadhandle;
+        auto decryptattrs = [&attrcipher, &nodekey](KeyJob& job)
+        {
+            nodekey.assign((const char*)job.key, job.keylength);
+            if (job.node->attrstring && attrcipher.setkey(&nodekey))
+            {
+                job.attrsok = Node::decryptattrs(&attrcipher, job.node->attrstring, &job.attrs);
+            }
+        };
 
-                        // do we have pending file attributes for this upload? set them.
-                        for (fa_map::iterator it = pendingfa.lower_bound(pair<handle, fatype>(uh, fatype(0)));
-                             it != pendingfa.end() && it->first.first == uh; )
-                        {
-                            reqs.add(new CommandAttachFA(this, h, it->first.second, it->second.first, it->second.second));
-                            pendingfa.erase(it++);
-                        }
+        for (size_t i; (i = nextasymmetric.fetch_add(1)) < asymmetricjobs.size(); )
+        {
+            KeyJob& job = jobs[asymmetricjobs[i]];
 
-                        // FIXME: only do this for in-flight FA writes
-                        uhnh.insert(pair<handle, handle>(uh, h));
-                    }
-                }
+            size_t l = keystringlength(job.k) / 4 * 3 + 3;
+            if (l > 4096)
+            {
+                continue;
             }
 
-            if (notify)
+            buf.resize(l);
+            l = Base64::atob(job.k, (byte*)buf.data(), int(l));
+
+            if (privkey->decrypt((const byte*)buf.data(), l, job.key, job.keylength))
             {
-                notifynode(n);
+                job.keyok = true;
+                decryptattrs(job);
+            }
+        }
+
+        for (size_t first; (first = next.fetch_add(CHUNK)) < jobs.size(); )
+        {
+            size_t last = std::min(first + CHUNK, jobs.size());
+            for (size_t i = first; i < last; i++)
+            {
+                KeyJob& job = jobs[i];
+
+                if (job.asymmetric || Base64::atob(job.k, job.key, job.keylength) != job.keylength)
+                {
+                    continue;
+                }
+
+                if (job.sc != current)
+                {
+                    keycipher.setkey(job.sc->key);
+                    current = job.sc;
+                }
+                keycipher.ecb_decrypt(job.key, job.keylength);
+                job.keyok = true;
+
+                decryptattrs(job);
             }
         }
+    };
+
+    unsigned numthreads = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_DECRYPT_THREADS));
+    numthreads = unsigned(std::min<size_t>(numthreads, jobs.size() / CHUNK + 1 + asymmetricjobs.size()));
+
+    vector<std::thread> threads;
+    for (unsigned i = 1; i < numthreads; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
     }
 
-    // any child nodes that arrived before their parents?
-    for (size_t i = dp.size(); i--; )
+    for (KeyJob& job : jobs)
     {
-        if ((n = nodebyhandle(dp[i]->parenthandle)))
+        if (!job.keyok)
         {
-            dp[i]->setparent(n);
+            if (job.asymmetric)
+            {
+                LOG_warn << "Corrupt or invalid RSA node key";
+            }
+            else
+            {
+                LOG_warn << "Corrupt or invalid symmetric node key";
+            }
+            continue;
+        }
+
+        Node* n = job.node;
+        n->nodekey.assign((const char*)job.key, job.keylength);
+        if (job.attrsok)
+        {
+            n->attrs.map.swap(job.attrs.map);
+            n->attrsdecrypted();
+        }
+
+        if (job.asymmetric)
+        {
+            // update on the server to save space & client CPU time, as decryptkey() does
+            nodekeyrewrite.push_back(n->nodehandle);
         }
     }
 
-    return j->leavearray();
+    LOG_debug << "Decrypted " << jobs.size() << " node keys (" << asymmetricjobs.size() << " RSA) with " << numthreads << " threads";
+    fnstats.decryptThreads = int(numthreads);
+
+    return t;
 }
 
 // decrypt and set encrypted sharekey
@@ -7873,50 +9516,132 @@ int MegaClient::applykeys()
 {
     int t = 0;
 
-    // FIXME: rather than iterating through the whole node set, maintain subset
-    // with missing keys
-    for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+    if (fetchingnodes)
     {
-        if (it->second->applykey())
+        // the whole tree is being loaded: try every node
+        if (nodes.size() >= PARALLEL_DECRYPT_MIN_NODES)
         {
-            t++;
+            t = applykeysparallel();
+        }
+        else
+        {
+            for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+            {
+                if (it->second->applykey())
+                {
+                    t++;
+                }
+            }
         }
-    }
 
-    if (sharekeyrewrite.size())
-    {
-        reqs.add(new CommandShareKeyUpdate(this, &sharekeyrewrite));
-        sharekeyrewrite.clear();
-    }
+        // and index the ones still waiting for a share key
+        keypendingnodes.clear();
+        keywaitingnodes.clear();
+        newsharekeys.clear();
 
-    if (nodekeyrewrite.size())
+        for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+        {
+            waitforkey(it->second);
+        }
+    }
+    else
     {
-        reqs.add(new CommandNodeKeyUpdate(this, &nodekeyrewrite));
-        nodekeyrewrite.clear();
+        // only the new nodes and the ones waiting for the share keys that just arrived
+        for (handle_set::iterator it = newsharekeys.begin(); it != newsharekeys.end(); it++)
+        {
+            map<handle, handle_set>::iterator wit = keywaitingnodes.find(*it);
+            if (wit != keywaitingnodes.end())
+            {
+                keypendingnodes.insert(wit->second.begin(), wit->second.end());
+                keywaitingnodes.erase(wit);
+            }
+        }
+        newsharekeys.clear();
+
+        handle_set pending;
+        pending.swap(keypendingnodes);
+
+        for (handle_set::iterator it = pending.begin(); it != pending.end(); it++)
+        {
+            Node* n = nodebyhandle(*it);
+            if (!n)
+            {
+                continue;
+            }
+
+            if (n->applykey())
+            {
+                t++;
+            }
+
+            waitforkey(n);
+        }
     }
 
+    // the key rewrites are sent by exec()
     return t;
 }
 
-// user/contact list
-bool MegaClient::readusers(JSON* j, bool actionpackets)
+void MegaClient::keypending(Node* n)
 {
-    if (!j->enterarray())
+    // fetchnodes tries the whole tree anyway
+    if (!fetchingnodes)
     {
-        return 0;
+        keypendingnodes.insert(n->nodehandle);
     }
+}
 
-    while (j->enterobject())
+void MegaClient::sharekeyarrived(handle h)
+{
+    if (keywaitingnodes.find(h) != keywaitingnodes.end())
     {
-        handle uh = 0;
-        visibility_t v = VISIBILITY_UNKNOWN;    // new share objects do not override existing visibility
-        m_time_t ts = 0;
-        const char* m = NULL;
-        nameid name;
+        newsharekeys.insert(h);
+    }
+}
 
-        while ((name = j->getnameid()) != EOO)
-        {
-            switch (name)
+// file the node under the share handles of its compound key, if the key is still encrypted
+void MegaClient::waitforkey(Node* n)
+{
+    size_t keylength = (n->type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+    if (n->type > FOLDERNODE || !n->nodekey.size() || n->nodekey.size() == keylength)
+    {
+        return;
+    }
+
+    size_t t = 0;
+    while ((t = n->nodekey.find_first_of(':', t)) != string::npos)
+    {
+        handle h = 0;
+        int l = Base64::atob(n->nodekey.c_str() + (n->nodekey.find_last_of('/', t) + 1), (byte*)&h, sizeof h);
+        t++;
+
+        // user handles are either ours (no share key needed) or useless
+        if (l == NODEHANDLE)
+        {
+            keywaitingnodes[h].insert(n->nodehandle);
+        }
+    }
+}
+
+// user/contact list
+bool MegaClient::readusers(JSON* j, bool actionpackets)
+{
+    if (!j->enterarray())
+    {
+        return 0;
+    }
+
+    while (j->enterobject())
+    {
+        handle uh = 0;
+        visibility_t v = VISIBILITY_UNKNOWN;    // new share objects do not override existing visibility
+        m_time_t ts = 0;
+        const char* m = NULL;
+        nameid name;
+
+        while ((name = j->getnameid()) != EOO)
+        {
+            switch (name)
             {
                 case 'u':   // new node: handle
                     uh = j->gethandle(USERHANDLE);
@@ -8167,6 +9892,13 @@ void MegaClient::login(const byte* session, int size)
         reqs.add(new CommandLogin(this, NULL, NULL, 0, sek, sessionversion));
         getuserdata();
         fetchtimezone();
+
+        // the rest of the startup needs the user handle from the login response,
+        // but the local cache can be read meanwhile
+        if (pipelinedstartup && sctable && !ISUNDEF(cachedscsn) && !nodes.size())
+        {
+            cachepreloadpending = true;
+        }
     }
     else
     {
@@ -8321,10 +10053,49 @@ void MegaClient::opensctable()
         {
             sctable = dbaccess->open(rng, fsaccess, &dbname, false, false);
             pendingsccommit = false;
+            dbcommitpending = false;
+            dbcommitnotify = false;
+            snapshotchunks = 0;
+            snapshotrecords = 0;
+            snapshotdelta.clear();
+
+            if (sctable && asyncdbwrites)
+            {
+                LOG_debug << "Writing the state cache asynchronously";
+                sctable = new AsyncDbTable(rng, sctable, waiter);
+            }
+
+            if (sctable)
+            {
+                setrecorddictionaries(sctable);
+            }
         }
     }
 }
 
+void MegaClient::setrecorddictionaries(DbTable* table)
+{
+    // frequent pieces of file and folder names, the most frequent ones last
+    // (never change them: the records compressed with them must remain readable)
+    static const char names[] =
+        "Camera Uploads My chat files Documents Downloads Pictures Desktop Videos Music "
+        "New folder Untitled Copy of WhatsApp Image Screenshot _final_v2 (2) (1) "
+        "IMG_ VID_ DSC_ PXL_ .apk.dmg.exe.iso.tar.gz.7z.rar.zip.log.md.java.py.cpp.js.css.htm.html"
+        ".xml.json.csv.txt.odt.ppt.xls.doc.pptx.xlsx.docx.ogg.flac.wav.m4a.mp3.webm.mkv.avi"
+        ".mov.MOV.MP4.mp4.heic.HEIC.gif.GIF.PNG.png.jpeg.JPG.jpg.pdf";
+
+    // attributes as written by AttrMap::serialize(): name length, name, value length
+    static const char attrs[] =
+        "\x03" "fav" "\x01" "\x00" "1" "\x03" "lbl" "\x01" "\x00" "\x02" "rr" "\x08" "\x00"
+        "\x01" "c" "\x01" "n";
+
+    string dictionary(names, sizeof names - 1);
+    table->setdictionary(CACHEDLOCALNODE, dictionary);
+
+    dictionary.append(attrs, sizeof attrs - 1);
+    table->setdictionary(CACHEDNODE, dictionary);
+}
+
 // verify a static symmetric password challenge
 int MegaClient::checktsid(byte* sidbuf, unsigned len)
 {
@@ -8472,6 +10243,12 @@ void MegaClient::mapuser(handle uh, const char* email)
             }
 
             Node::copystring(&u->email, nuid.c_str());
+
+            // the email prefixes the paths of the user's inshares
+            if (!u->sharing.empty())
+            {
+                pathgeneration++;
+            }
         }
 
         umindex[nuid] = hit->second;
@@ -8663,6 +10440,8 @@ void MegaClient::proctree(Node* n, TreeProc* tp, bool skipinshares, bool skipver
         }
     }
 
+    // tree processors work on keys and attributes
+    n->materialize();
     tp->proc(this, n);
 }
 
@@ -8723,14 +10502,104 @@ void MegaClient::queuepubkeyreq(const char *uid, PubKeyAction *pka)
 // rewrite keys of foreign nodes due to loss of underlying shareufskey
 void MegaClient::rewriteforeignkeys(Node* n)
 {
-    TreeProcForeignKeys rewrite;
-    proctree(n, &rewrite);
+    // only the nodes keyed under a share enclosing n or nested in it can be below n: the
+    // nodes of the other outbound shares are skipped without walking up from each of them
+    for (map<handle, handle_set>::iterator sit = foreignkeynodes.begin(); sit != foreignkeynodes.end(); )
+    {
+        Node* s = nodebyhandle(sit->first);
+        bool enclosing = false;
+        bool nested = false;
+
+        if (s)
+        {
+            for (Node* p = n; p && !enclosing; p = p->parent)
+            {
+                enclosing = p == s;
+            }
+
+            for (Node* p = s->parent; p && !enclosing && !nested; p = p->parent)
+            {
+                nested = p == n;
+            }
+        }
+
+        if (s && !enclosing && !nested)
+        {
+            sit++;
+            continue;
+        }
+
+        handle_set& fs = sit->second;
+        for (handle_set::iterator it = fs.begin(); it != fs.end(); )
+        {
+            Node* f = nodebyhandle(*it);
+            if (!f || !f->foreignkey)
+            {
+                fs.erase(it++);
+                continue;
+            }
+
+            Node* p = f;
+            while (p && p != n)
+            {
+                p = p->parent;
+            }
+
+            if (p)
+            {
+                nodekeyrewrite.push_back(f->nodehandle);
+                f->foreignkey = false;
+                fs.erase(it++);
+            }
+            else
+            {
+                it++;
+            }
+        }
+
+        if (fs.empty())
+        {
+            foreignkeynodes.erase(sit++);
+        }
+        else
+        {
+            sit++;
+        }
+    }
+
+    // ahead of the command removing the share or moving the node
+    sendkeyrewrites(true);
+}
+
+// send the pending key rewrites without duplicates, KEYREWRITEBATCH node keys per
+// command: unless all, a single batch of them per exec() iteration
+void MegaClient::sendkeyrewrites(bool all)
+{
+    if (sharekeyrewrite.size())
+    {
+        std::sort(sharekeyrewrite.begin(), sharekeyrewrite.end());
+        sharekeyrewrite.erase(std::unique(sharekeyrewrite.begin(), sharekeyrewrite.end()), sharekeyrewrite.end());
+
+        reqs.add(new CommandShareKeyUpdate(this, &sharekeyrewrite));
+        sharekeyrewrite.clear();
+    }
 
-    if (nodekeyrewrite.size())
+    if (nodekeyrewrite.empty())
     {
-        reqs.add(new CommandNodeKeyUpdate(this, &nodekeyrewrite));
-        nodekeyrewrite.clear();
+        return;
     }
+
+    std::sort(nodekeyrewrite.begin(), nodekeyrewrite.end());
+    nodekeyrewrite.erase(std::unique(nodekeyrewrite.begin(), nodekeyrewrite.end()), nodekeyrewrite.end());
+
+    do
+    {
+        size_t count = std::min(nodekeyrewrite.size(), KEYREWRITEBATCH);
+        handle_vector batch(nodekeyrewrite.end() - count, nodekeyrewrite.end());
+        nodekeyrewrite.resize(nodekeyrewrite.size() - count);
+
+        reqs.add(new CommandNodeKeyUpdate(this, &batch));
+    } while (all && nodekeyrewrite.size());
 }
 
 // if user has a known public key, complete instantly
@@ -9066,6 +10935,40 @@ void MegaClient::getua(User* u, const attr_t at, int ctag)
     }
 }
 
+// the attributes of all the users go in the same batch (the API takes one user and
+// attribute per command). Cached values stay valid while the version notified by
+// the API for them is the one they were received with
+void MegaClient::getuas(const vector<User*>& users, attr_t at, int ctag)
+{
+    int tag = (ctag != -1) ? ctag : reqtag;
+    handle_set requested;
+    vector<User*> fetch;
+
+    for (User* u : users)
+    {
+        if ((fetchingkeys || !u->getattr(at) || !u->isattrvalid(at))
+                && requested.insert(u->userhandle).second)
+        {
+            fetch.push_back(u);
+        }
+    }
+
+    LOG_debug << "Requesting " << User::attr2string(at) << " of " << fetch.size() << " users (" << (users.size() - fetch.size()) << " cached)";
+
+    if (fetch.empty())
+    {
+        restag = tag;
+        app->getuas_result(API_OK);
+        return;
+    }
+
+    std::shared_ptr<size_t> pending = std::make_shared<size_t>(fetch.size());
+    for (User* u : fetch)
+    {
+        reqs.add(new CommandGetUAsItem(this, u->uid.c_str(), at, pending, tag));
+    }
+}
+
 void MegaClient::getua(const char *email_handle, const attr_t at, const char *ph, int ctag)
 {
     if (email_handle && at != ATTR_UNKNOWN)
@@ -9094,6 +10997,12 @@ void MegaClient::notifynode(Node* n)
 {
     n->applykey();
 
+    // any change can affect the ordering of the parent's children (ctime, attributes...)
+    if (n->parent)
+    {
+        n->parent->childrenchanged();
+    }
+
     if (!fetchingnodes)
     {
         if (n->tag && !n->changed.removed && n->attrstring)
@@ -9208,9 +11117,55 @@ void MegaClient::transfercacheadd(Transfer *transfer, DBTableTransactionCommitte
 {
     if (tctable && !transfer->skipserialization)
     {
-        LOG_debug << "Caching transfer";
         tctable->checkCommitter(committer);
-        tctable->put(MegaClient::CACHEDTRANSFER, transfer, &tckey);
+
+        string fields;
+        chunkmac_map changed;
+
+        // while only chunk MACs change, append them in a delta record rather
+        // than rewriting the transfer with all of them
+        if (transfer->dbid && transfer->chunkmacdeltas.size() < Transfer::MAXCHUNKMACDELTAS
+         && transfer->serializerecord(&fields, NULL) && fields == transfer->cachedfields
+         && transfer->changedchunkmacs(&changed))
+        {
+            if (changed.size())
+            {
+                LOG_debug << "Caching transfer chunk MACs: " << changed.size();
+
+                string data((const char*)&transfer->dbid, sizeof transfer->dbid);
+                changed.serialize(data);
+                PaddedCBC::encrypt(rng, &data, &tckey);
+
+                uint32_t id = tctable->newid(CACHEDCHUNKMACS);
+                if (tctable->put(id, &data))
+                {
+                    transfer->chunkmacdeltas.push_back(id);
+
+                    for (chunkmac_map::iterator it = changed.begin(); it != changed.end(); it++)
+                    {
+                        transfer->cachedchunkmacs[it->first] = it->second;
+                    }
+                }
+            }
+            return;
+        }
+
+        LOG_debug << "Caching transfer";
+        for (size_t i = 0; i < transfer->chunkmacdeltas.size(); i++)
+        {
+            tctable->del(transfer->chunkmacdeltas[i]);
+        }
+        transfer->chunkmacdeltas.clear();
+
+        if (tctable->put(MegaClient::CACHEDTRANSFER, transfer, &tckey) && (fields.size() || transfer->serializerecord(&fields, NULL)))
+        {
+            transfer->cachedfields.swap(fields);
+            transfer->cachedchunkmacs = transfer->chunkmacs;
+        }
+        else
+        {
+            transfer->cachedfields.clear();
+        }
     }
 }
 
@@ -9221,6 +11176,12 @@ void MegaClient::transfercachedel(Transfer *transfer, DBTableTransactionCommitte
         LOG_debug << "Removing cached transfer";
         tctable->checkCommitter(committer);
         tctable->del(transfer->dbid);
+
+        for (size_t i = 0; i < transfer->chunkmacdeltas.size(); i++)
+        {
+            tctable->del(transfer->chunkmacdeltas[i]);
+        }
+        transfer->chunkmacdeltas.clear();
     }
 }
 
@@ -9922,6 +11883,35 @@ void MegaClient::querytransferquota(m_off_t size)
     reqs.add(new CommandQueryTransferQuota(this, size));
 }
 
+void MegaClient::settransferquota(m_off_t max, m_off_t used)
+{
+    transferquotamax = max;
+    transferquotaused = used;
+    transferquotadownloaded = 0;
+}
+
+m_off_t MegaClient::transferquotaleft() const
+{
+    if (transferquotamax <= 0)
+    {
+        return -1;
+    }
+
+    m_off_t left = transferquotamax - transferquotaused - transferquotadownloaded;
+    return left > 0 ? left : 0;
+}
+
+m_time_t MegaClient::transferquotatimeleft() const
+{
+    m_off_t left = transferquotaleft();
+    if (left < 0 || httpio->downloadSpeed <= 0)
+    {
+        return -1;
+    }
+
+    return left / httpio->downloadSpeed;
+}
+
 // export node link
 error MegaClient::exportnode(Node* n, int del, m_time_t ets)
 {
@@ -10518,107 +12508,351 @@ void MegaClient::setkeypair()
                                       unsigned(pubks.size())));
 }
 
-bool MegaClient::fetchsc(DbTable* sctable)
+bool MegaClient::loadscrecord(uint32_t id, string* data, node_vector* dp)
 {
-    uint32_t id;
-    string data;
     Node* n;
     User* u;
     PendingContactRequest* pcr;
-    node_vector dp;
 
-    LOG_info << "Loading session from local cache";
+    switch (id & 15)
+    {
+        case CACHEDSCSN:
+            if (data->size() != sizeof cachedscsn)
+            {
+                return false;
+            }
+            break;
 
-    sctable->rewind();
+        case CACHEDNODE:
+            if ((n = Node::unserialize(this, data, dp)))
+            {
+                n->dbid = id;
+            }
+            else
+            {
+                LOG_err << "Failed - node record read error";
+                return false;
+            }
+            break;
 
-    bool hasNext = sctable->next(&id, &data, &key);
-    WAIT_CLASS::bumpds();
-    fnstats.timeToFirstByte = Waiter::ds - fnstats.startTime;
+        case CACHEDPCR:
+            if ((pcr = PendingContactRequest::unserialize(this, data)))
+            {
+                pcr->dbid = id;
+            }
+            else
+            {
+                LOG_err << "Failed - pcr record read error";
+                return false;
+            }
+            break;
 
-    while (hasNext)
-    {
-        switch (id & 15)
-        {
-            case CACHEDSCSN:
-                if (data.size() != sizeof cachedscsn)
-                {
-                    return false;
-                }
-                break;
+        case CACHEDUSER:
+            if ((u = User::unserialize(this, data)))
+            {
+                u->dbid = id;
+            }
+            else
+            {
+                LOG_err << "Failed - user record read error";
+                return false;
+            }
+            break;
 
-            case CACHEDNODE:
-                if ((n = Node::unserialize(this, &data, &dp)))
+        case CACHEDCHAT:
+#ifdef ENABLE_CHAT
+            {
+                TextChat *chat;
+                if ((chat = TextChat::unserialize(this, data)))
                 {
-                    n->dbid = id;
+                    chat->dbid = id;
                 }
                 else
                 {
-                    LOG_err << "Failed - node record read error";
+                    LOG_err << "Failed - chat record read error";
                     return false;
                 }
-                break;
+            }
+#endif
+            break;
+    }
 
-            case CACHEDPCR:
-                if ((pcr = PendingContactRequest::unserialize(this, &data)))
-                {
-                    pcr->dbid = id;
-                }
-                else
-                {
-                    LOG_err << "Failed - pcr record read error";
-                    return false;
-                }
-                break;
+    return true;
+}
 
-            case CACHEDUSER:
-                if ((u = User::unserialize(this, &data)))
-                {
-                    u->dbid = id;
-                }
-                else
-                {
-                    LOG_err << "Failed - user record read error";
-                    return false;
-                }
-                break;
+bool MegaClient::fetchsc(DbTable* sctable)
+{
+    uint32_t id;
+    string data;
+    node_vector dp;
+    bool loaded = false;
 
-            case CACHEDCHAT:
-#ifdef ENABLE_CHAT
-                {
-                    TextChat *chat;
-                    if ((chat = TextChat::unserialize(this, &data)))
-                    {
-                        chat->dbid = id;
-                    }
-                    else
-                    {
-                        LOG_err << "Failed - chat record read error";
-                        return false;
-                    }
-                }
-#endif
-                break;
-        }
-        hasNext = sctable->next(&id, &data, &key);
+    LOG_info << "Loading session from local cache";
+
+    if (scloadstats)
+    {
+        scloadmark = std::chrono::steady_clock::now();
     }
 
-    WAIT_CLASS::bumpds();
-    fnstats.timeToLastByte = Waiter::ds - fnstats.startTime;
+    if (scsnapshots && !loadsnapshot(sctable, &dp, &loaded))
+    {
+        return false;
+    }
 
-    // any child nodes arrived before their parents?
-    for (size_t i = dp.size(); i--; )
+    if (!loaded)
     {
-        if ((n = nodebyhandle(dp[i]->parenthandle)))
+        if (!cachepreloaded)
         {
-            dp[i]->setparent(n);
+            sctable->rewind();
+        }
+
+        bool hasNext = nextscrecord(sctable, &id, &data);
+        WAIT_CLASS::bumpds();
+        fnstats.timeToFirstByte = Waiter::ds - fnstats.startTime;
+
+        while (hasNext)
+        {
+            scloadread(id, data.size());
+
+            if (!loadscrecord(id, &data, &dp))
+            {
+                return false;
+            }
+
+            scloaddecoded(id);
+            hasNext = nextscrecord(sctable, &id, &data);
         }
     }
 
+    WAIT_CLASS::bumpds();
+    fnstats.timeToLastByte = Waiter::ds - fnstats.startTime;
+
+    // any child nodes arrived before their parents?
+    linkdelayedparents(dp);
+
+    if (lazynodecount)
+    {
+        LOG_info << "Nodes loaded lazily: " << lazynodecount << " of " << nodes.size();
+    }
+
     mergenewshares(0);
 
+    preloadedsc.clear();
+    cachepreloaded = false;
+
+    return true;
+}
+
+// read the cache of a resumed session while the server processes its login.
+// The records are decrypted by fetchsc(): the master key of sessions with a
+// session key is only known after the login response
+void MegaClient::preloadsc()
+{
+    cachepreloadpending = false;
+
+    if (loggedin() || !sctable || ISUNDEF(cachedscsn) || nodes.size())
+    {
+        return;
+    }
+
+    uint32_t id;
+    string data;
+
+    // a snapshot is loaded from its own records (and a few others read later)
+    bool snapshot = scsnapshots && sctable->get(CACHEDSNAPSHOT, &data) && sctable->rewindtype(CACHEDSNAPSHOT);
+    if (!snapshot)
+    {
+        sctable->rewind();
+    }
+
+    while (sctable->next(&id, &data))
+    {
+        preloadedsc[id].swap(data);
+    }
+
+    cachepreloaded = !snapshot;
+
+    LOG_debug << "Session cache read during the login: " << preloadedsc.size() << " records";
+}
+
+// a record of the state cache, if it was read during the login, or from the table
+bool MegaClient::getscrecord(DbTable* table, uint32_t id, string* data)
+{
+    std::map<uint32_t, string>::iterator it = preloadedsc.find(id);
+    if (it == preloadedsc.end())
+    {
+        return table->get(id, data, &key);
+    }
+
+    data->swap(it->second);
+    preloadedsc.erase(it);
+    return table->decode(id, data, &key);
+}
+
+// the next record of the state cache, from the ones read during the login if they are all there
+bool MegaClient::nextscrecord(DbTable* table, uint32_t* id, string* data)
+{
+    if (!cachepreloaded)
+    {
+        return table->next(id, data, &key);
+    }
+
+    if (preloadedsc.empty())
+    {
+        return false;
+    }
+
+    std::map<uint32_t, string>::iterator it = preloadedsc.begin();
+    *id = it->first;
+    data->swap(it->second);
+    preloadedsc.erase(it);
+    return table->decryptnext(*id, data, &key);
+}
+
+bool MegaClient::loadsnapshot(DbTable* sctable, node_vector* dp, bool* loaded)
+{
+    *loaded = false;
+    snapshotchunks = 0;
+    snapshotrecords = 0;
+    snapshotdelta.clear();
+
+    string header;
+    if (!getscrecord(sctable, CACHEDSNAPSHOT, &header))
+    {
+        return true;
+    }
+
+    // a snapshot left behind by a session that stopped maintaining it is stale
+    CacheableReader r(header);
+    uint32_t version, chunks, records, ndelta;
+    handle snapshotscsn;
+
+    if (!r.unserializeu32(version) || version != SNAPSHOTVERSION
+     || !r.unserializehandle(snapshotscsn) || snapshotscsn != cachedscsn
+     || !r.unserializeu32(chunks) || !chunks
+     || !r.unserializeu32(records)
+     || !r.unserializeu32(ndelta))
+    {
+        LOG_debug << "Ignoring outdated state cache snapshot";
+        return true;
+    }
+
+    std::set<uint32_t> delta;
+    for (uint32_t i = 0; i < ndelta; i++)
+    {
+        uint32_t id;
+        if (!r.unserializeu32(id))
+        {
+            LOG_warn << "Ignoring corrupt state cache snapshot";
+            return true;
+        }
+        delta.insert(id);
+    }
+
+    LOG_debug << "Loading state cache snapshot: " << records << " records, " << delta.size() << " changed";
+
+    string chunk, data;
+    bool first = true;
+
+    for (uint32_t i = 1; i <= chunks; i++)
+    {
+        if (!getscrecord(sctable, CACHEDSNAPSHOT + i * (DbTable::TYPEMASK + 1), &chunk))
+        {
+            LOG_err << "Failed - snapshot chunk " << i << " missing";
+            return false;
+        }
+
+        scloadread(CACHEDSNAPSHOT, chunk.size());
+        scloaddecoded(CACHEDSNAPSHOT);
+
+        if (first)
+        {
+            WAIT_CLASS::bumpds();
+            fnstats.timeToFirstByte = Waiter::ds - fnstats.startTime;
+            first = false;
+        }
+
+        const char* ptr = chunk.data();
+        const char* end = ptr + chunk.size();
+
+        while (ptr + 2 * sizeof(uint32_t) <= end)
+        {
+            uint32_t id = MemAccess::get<uint32_t>(ptr);
+            uint32_t len = MemAccess::get<uint32_t>(ptr + sizeof(uint32_t));
+            ptr += 2 * sizeof(uint32_t);
+
+            if (len > size_t(end - ptr))
+            {
+                LOG_err << "Failed - snapshot chunk " << i << " truncated";
+                return false;
+            }
+
+            if (!delta.count(id))
+            {
+                data.assign(ptr, len);
+                scloadread(id, len);
+
+                if (!loadscrecord(id, &data, dp))
+                {
+                    return false;
+                }
+
+                scloaddecoded(id);
+            }
+
+            ptr += len;
+        }
+    }
+
+    // the records changed since the snapshot was taken (or removed: no record)
+    for (std::set<uint32_t>::iterator it = delta.begin(); it != delta.end(); it++)
+    {
+        if (getscrecord(sctable, *it, &data))
+        {
+            scloadread(*it, data.size());
+
+            if (!loadscrecord(*it, &data, dp))
+            {
+                return false;
+            }
+
+            scloaddecoded(*it);
+        }
+    }
+
+    snapshotchunks = chunks;
+    snapshotrecords = records;
+    snapshotdelta.swap(delta);
+    *loaded = true;
     return true;
 }
 
+// account the time since the previous record to reading or decoding this one
+void MegaClient::scloadread(uint32_t id, size_t bytes)
+{
+    if (scloadstats)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        ScLoadStats& stats = scloadstats[id & DbTable::TYPEMASK];
+
+        stats.records++;
+        stats.bytes += bytes;
+        stats.readtime += now - scloadmark;
+        scloadmark = now;
+    }
+}
+
+void MegaClient::scloaddecoded(uint32_t id)
+{
+    if (scloadstats)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        scloadstats[id & DbTable::TYPEMASK].decodetime += now - scloadmark;
+        scloadmark = now;
+    }
+}
+
 void MegaClient::closetc(bool remove)
 {
     bool purgeOrphanTransfers = statecurrent;
@@ -10642,35 +12876,566 @@ void MegaClient::closetc(bool remove)
             }
         }
     }
-#endif
+#endif
+
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        while (cachedtransfers[d].size())
+        {
+            transfer_map::iterator it = cachedtransfers[d].begin();
+            Transfer *transfer = it->second;
+            if (remove || (purgeOrphanTransfers && (m_time() - transfer->lastaccesstime) >= 172500))
+            {
+                LOG_warn << "Purging orphan transfer";
+                transfer->finished = true;
+            }
+
+            delete transfer;
+            cachedtransfers[d].erase(it);
+        }
+    }
+
+    pendingtcids.clear();
+    cachedfiles.clear();
+    cachedfilesdbids.clear();
+
+    if (remove && tctable)
+    {
+        tctable->remove();
+    }
+    delete tctable;
+    tctable = NULL;
+
+    if (fingerprintcache)
+    {
+        if (remove)
+        {
+            fingerprintcache->remove();
+        }
+        fingerprintcache.reset();
+    }
+
+    if (tlstable)
+    {
+        if (remove)
+        {
+            tlstable->remove();
+        }
+        else
+        {
+            savetlssessions();
+        }
+        delete tlstable;
+        tlstable = NULL;
+    }
+}
+
+void MegaClient::setfingerprintcache(bool enable)
+{
+    usefingerprintcache = enable;
+
+    if (!enable && fingerprintcache)
+    {
+        fingerprintcache->remove();
+        fingerprintcache.reset();
+    }
+    else if (enable && !fingerprintcache && tctable)
+    {
+        if (DbTable* fptable = dbaccess->open(rng, fsaccess, &fingerprintcachename, false, false))
+        {
+            fingerprintcache = std::make_shared<FingerprintCache>(fptable, tckey);
+        }
+    }
+}
+
+void MegaClient::settlssessioncache(bool enable)
+{
+    usetlssessioncache = enable;
+
+    if (!enable && tlstable)
+    {
+        tlstable->remove();
+        delete tlstable;
+        tlstable = NULL;
+    }
+    else if (enable && !tlstable && tctable)
+    {
+        opentlssessions();
+    }
+}
+
+void MegaClient::opentlssessions()
+{
+    if (!(tlstable = dbaccess->open(rng, fsaccess, &tlssessioncachename, false, false)))
+    {
+        return;
+    }
+
+    std::vector<TlsSession> sessions;
+    uint32_t id;
+    string data;
+
+    tlstable->rewind();
+    while (tlstable->next(&id, &data, &tckey))
+    {
+        if (TlsSession* session = TlsSession::unserialize(&data))
+        {
+            sessions.push_back(*session);
+            delete session;
+        }
+    }
+
+    if (sessions.size() && !httpio->settlssessions(sessions))
+    {
+        LOG_debug << "The network layer can't resume TLS sessions";
+    }
+    tlssessionssaved = Waiter::ds;
+}
+
+void MegaClient::savetlssessions()
+{
+    tlssessionssaved = Waiter::ds;
+
+    std::vector<TlsSession> sessions;
+    if (!httpio->gettlssessions(&sessions))
+    {
+        return;
+    }
+
+    dbrecord_vector records;
+    records.reserve(sessions.size());
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        tlstable->addbatch(&records, 0, &sessions[i], &tckey);
+    }
+
+    // the table holds the sessions of the last export only
+    tlstable->begin();
+    tlstable->truncate();
+    if (tlstable->putmany(records))
+    {
+        tlstable->commit();
+    }
+    else
+    {
+        LOG_err << "Unable to write the TLS sessions";
+        tlstable->abort();
+    }
+}
+
+ExecScheduler::ExecScheduler()
+{
+    budgets[SC] = std::chrono::milliseconds(100);
+    budgets[TRANSFERS] = std::chrono::milliseconds(50);
+    budgets[DIRECTREADS] = std::chrono::milliseconds(0);
+    budgets[SYNC] = std::chrono::milliseconds(100);
+    budgets[DBCOMMIT] = std::chrono::milliseconds(0);
+
+    reset();
+}
+
+void ExecScheduler::begin(subsystem_t s)
+{
+    starts[s] = std::chrono::steady_clock::now();
+}
+
+bool ExecScheduler::expired(subsystem_t s) const
+{
+    return budgets[s].count() && std::chrono::steady_clock::now() - starts[s] >= budgets[s];
+}
+
+void ExecScheduler::end(subsystem_t s, bool yielded)
+{
+    latencies[s].add(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - starts[s]).count());
+
+    if (yielded)
+    {
+        yields[s]++;
+    }
+}
+
+void ExecScheduler::tojson(std::ostream& s) const
+{
+    static const char* names[SUBSYSTEMS] = { "sc", "transfers", "directreads", "sync", "dbcommit" };
+
+    s << "{";
+    for (int i = 0; i < SUBSYSTEMS; i++)
+    {
+        s << "\"" << names[i] << "\":{\"budget\":" << budgets[i].count()
+          << ",\"yields\":" << yields[i] << ",\"time\":";
+        latencies[i].tojson(s);
+        s << "},";
+    }
+    s << "\"wakeups\":{\"immediate\":" << immediatewakeups
+      << ",\"carried\":" << carriedwakeups << "}}";
+}
+
+void ExecScheduler::reset()
+{
+    for (int i = 0; i < SUBSYSTEMS; i++)
+    {
+        latencies[i] = LatencyHistogram();
+        yields[i] = 0;
+    }
+
+    immediatewakeups = 0;
+    carriedwakeups = 0;
+}
+
+string MegaClient::networkstats(bool reset)
+{
+    std::ostringstream s;
+    s << "{\"hosts\":";
+    httpio->networkstats.tojson(s);
+    s << ",\"retries\":{\"cs\":" << btcs.backoffcount(reset)
+      << ",\"cspipelined\":" << btpipelinedcs.backoffcount(reset)
+      << ",\"sc\":" << btsc.backoffcount(reset)
+      << ",\"badhost\":" << btbadhost.backoffcount(reset)
+      << ",\"workinglock\":" << btworkinglock.backoffcount(reset)
+      << ",\"pfa\":" << btpfa.backoffcount(reset) << "}"
+      << ",\"fileattributes\":{\"queued\":" << queuedfa.size()
+      << ",\"queuedbytes\":" << queuedfabytes
+      << ",\"active\":" << activefa.size()
+      << ",\"uploaded\":" << fauploaded
+      << ",\"failed\":" << fafailed
+      << ",\"uploadshalted\":" << fahalts << "}"
+      << ",\"exec\":";
+    execscheduler.tojson(s);
+    s << "}";
+
+    if (reset)
+    {
+        httpio->networkstats.clear();
+        execscheduler.reset();
+        fauploaded = 0;
+        fafailed = 0;
+        fahalts = 0;
+    }
+    return s.str();
+}
+
+static void metricheader(std::ostream& s, const char* name, const char* type, const char* help)
+{
+    s << "# HELP " << name << " " << help << "\n"
+         "# TYPE " << name << " " << type << "\n";
+}
+
+static const char* metricdirection(int d)
+{
+    return d == GET ? "get" : d == PUT ? "put" : "api";
+}
+
+void MegaClient::metrics(std::ostream& s)
+{
+    // transfers
+    size_t slots[2] = { 0, 0 };
+    for (TransferSlot* ts : tslots)
+    {
+        if (ts->transfer->type == GET || ts->transfer->type == PUT)
+        {
+            slots[ts->transfer->type]++;
+        }
+    }
+
+    metricheader(s, "mega_transfers_queued", "gauge", "Transfers not finished yet, including the active ones");
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        s << "mega_transfers_queued{direction=\"" << metricdirection(d) << "\"} " << transfers[d].size() << "\n";
+    }
+
+    metricheader(s, "mega_transfers_active", "gauge", "Transfers holding a slot");
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        s << "mega_transfers_active{direction=\"" << metricdirection(d) << "\"} " << slots[d] << "\n";
+    }
+
+    metricheader(s, "mega_transfer_speed_bytes", "gauge", "Current transfer speed, in bytes per second");
+    s << "mega_transfer_speed_bytes{direction=\"get\"} " << httpio->downloadSpeed << "\n"
+         "mega_transfer_speed_bytes{direction=\"put\"} " << httpio->uploadSpeed << "\n";
+
+    metricheader(s, "mega_transfer_events_total", "counter", "Transfer slot starts and finishes, temporary errors and failed transfers");
+    s << "mega_transfer_events_total{event=\"start\"} " << performanceStats.transferStarts << "\n"
+         "mega_transfer_events_total{event=\"finish\"} " << performanceStats.transferFinishes << "\n"
+         "mega_transfer_events_total{event=\"temperror\"} " << performanceStats.transferTempErrors << "\n"
+         "mega_transfer_events_total{event=\"fail\"} " << performanceStats.transferFails << "\n";
+
+    // API requests and file attributes
+    metricheader(s, "mega_cs_commands_pending", "gauge", "Whether API commands wait to be sent");
+    s << "mega_cs_commands_pending " << (reqs.cmdspending() ? 1 : 0) << "\n";
+
+    metricheader(s, "mega_cs_pipelined_inflight", "gauge", "Pipelined API batches awaiting their response");
+    s << "mega_cs_pipelined_inflight " << reqs.pipelinedinflight() << "\n";
+
+    metricheader(s, "mega_fileattributes_queued", "gauge", "File attributes waiting to be uploaded");
+    s << "mega_fileattributes_queued " << queuedfa.size() << "\n";
+
+    metricheader(s, "mega_fileattributes_active", "gauge", "File attributes being uploaded");
+    s << "mega_fileattributes_active " << activefa.size() << "\n";
+
+    metricheader(s, "mega_sc_yields_total", "counter", "Action packet processing interrupted to let other work run");
+    s << "mega_sc_yields_total " << performanceStats.scYields << "\n";
+
+    // power policy
+    metricheader(s, "mega_power_low", "gauge", "Whether the low power preset applies");
+    s << "mega_power_low " << (powerpolicy.lowpower() ? 1 : 0) << "\n";
+
+    metricheader(s, "mega_power_switches_total", "counter", "Changes between the unrestricted and the low power presets");
+    s << "mega_power_switches_total " << powerpolicy.switches << "\n";
+
+    metricheader(s, "mega_sc_commits_deferred_total", "counter", "State cache commits postponed by the low power preset");
+    s << "mega_sc_commits_deferred_total " << powerpolicy.deferredcommits << "\n";
+
+#ifdef ENABLE_SYNC
+    // syncs
+    size_t states[4] = { 0, 0, 0, 0 };
+    for (Sync* sync : syncs)
+    {
+        states[sync->state - SYNC_FAILED]++;
+    }
+
+    metricheader(s, "mega_syncs", "gauge", "Syncs by state");
+    s << "mega_syncs{state=\"failed\"} " << states[SYNC_FAILED - SYNC_FAILED] << "\n"
+         "mega_syncs{state=\"canceled\"} " << states[SYNC_CANCELED - SYNC_FAILED] << "\n"
+         "mega_syncs{state=\"initialscan\"} " << states[SYNC_INITIALSCAN - SYNC_FAILED] << "\n"
+         "mega_syncs{state=\"active\"} " << states[SYNC_ACTIVE - SYNC_FAILED] << "\n";
+#endif
+
+    // network, added up over the hosts of each direction
+    HostNetworkStats network[3];
+    for (int d = GET; d <= API; d++)
+    {
+        for (auto& it : httpio->networkstats.hosts[d])
+        {
+            const HostNetworkStats& host = it.second;
+            HostNetworkStats& total = network[d];
+            const LatencyHistogram* from[] = { &host.dns, &host.connect, &host.tls, &host.ttfb };
+            LatencyHistogram* to[] = { &total.dns, &total.connect, &total.tls, &total.ttfb };
+            for (int i = 0; i < 4; i++)
+            {
+                for (int b = 0; b < LatencyHistogram::BUCKETS; b++)
+                {
+                    to[i]->counts[b] += from[i]->counts[b];
+                }
+                to[i]->samples += from[i]->samples;
+                to[i]->totalms += from[i]->totalms;
+            }
+
+            for (auto& status : host.statuses)
+            {
+                total.statuses[status.first] += status.second;
+            }
+            total.connections += host.connections;
+            total.bytesin += host.bytesin;
+            total.bytesout += host.bytesout;
+        }
+    }
+
+    // a LatencyHistogram bucket holds the durations below its bound, the last one the rest
+    metricheader(s, "mega_http_latency_seconds", "histogram", "DNS resolution, TCP connection, TLS handshake and time to the first byte of HTTP requests");
+    for (int d = GET; d <= API; d++)
+    {
+        const char* phases[] = { "dns", "connect", "tls", "ttfb" };
+        const LatencyHistogram* histograms[] = { &network[d].dns, &network[d].connect, &network[d].tls, &network[d].ttfb };
+        for (int i = 0; i < 4; i++)
+        {
+            std::ostringstream labels;
+            labels << "direction=\"" << metricdirection(d) << "\",phase=\"" << phases[i] << "\"";
+
+            uint64_t cumulative = 0;
+            for (int b = 0; b < LatencyHistogram::BUCKETS - 1; b++)
+            {
+                cumulative += histograms[i]->counts[b];
+                s << "mega_http_latency_seconds_bucket{" << labels.str() << ",le=\"" << double(uint64_t(1) << b) / 1000 << "\"} " << cumulative << "\n";
+            }
+            s << "mega_http_latency_seconds_bucket{" << labels.str() << ",le=\"+Inf\"} " << histograms[i]->samples << "\n"
+                 "mega_http_latency_seconds_sum{" << labels.str() << "} " << double(histograms[i]->totalms) / 1000 << "\n"
+                 "mega_http_latency_seconds_count{" << labels.str() << "} " << histograms[i]->samples << "\n";
+        }
+    }
+
+    metricheader(s, "mega_http_responses_total", "counter", "HTTP requests by status (0: no response)");
+    for (int d = GET; d <= API; d++)
+    {
+        for (auto& status : network[d].statuses)
+        {
+            s << "mega_http_responses_total{direction=\"" << metricdirection(d) << "\",status=\"" << status.first << "\"} " << status.second << "\n";
+        }
+    }
+
+    metricheader(s, "mega_http_connections_total", "counter", "New HTTP connections");
+    for (int d = GET; d <= API; d++)
+    {
+        s << "mega_http_connections_total{direction=\"" << metricdirection(d) << "\"} " << network[d].connections << "\n";
+    }
+
+    metricheader(s, "mega_http_received_bytes_total", "counter", "Bytes received by HTTP requests");
+    for (int d = GET; d <= API; d++)
+    {
+        s << "mega_http_received_bytes_total{direction=\"" << metricdirection(d) << "\"} " << network[d].bytesin << "\n";
+    }
+
+    metricheader(s, "mega_http_sent_bytes_total", "counter", "Bytes sent by HTTP requests");
+    for (int d = GET; d <= API; d++)
+    {
+        s << "mega_http_sent_bytes_total{direction=\"" << metricdirection(d) << "\"} " << network[d].bytesout << "\n";
+    }
+
+    // sampled durations of the main blocks of code (see MegaApi::setPerformanceSampling)
+    metricheader(s, "mega_code_duration_seconds", "summary", "Sampled durations of blocks of the SDK");
+    for (CodeCounter::ScopeStats* stats : performanceStats.sampled())
+    {
+        for (double q : { 0.5, 0.9, 0.99 })
+        {
+            s << "mega_code_duration_seconds{block=\"" << stats->name << "\",quantile=\"" << q << "\"} "
+              << double(stats->sampler.percentile(q)) / 1000000 << "\n";
+        }
+        s << "mega_code_duration_seconds_count{block=\"" << stats->name << "\"} " << stats->sampler.samples() << "\n";
+    }
+}
+
+#ifdef ENABLE_SYNC
+static void localtreememoryusage(const LocalNode* l, size_t& count, size_t& bytes)
+{
+    count++;
+    bytes += l->memoryusage();
+
+    for (localnode_map::const_iterator it = l->children.begin(); it != l->children.end(); it++)
+    {
+        localtreememoryusage(it->second, count, bytes);
+    }
+}
+#endif
+
+string MegaClient::memoryusage(const vector<MemoryUsageEntry>& extra)
+{
+    vector<MemoryUsageEntry> entries;
+
+    size_t bytes = nodes.memoryusage();
+    for (node_map::const_iterator it = nodes.begin(); it != nodes.end(); it++)
+    {
+        bytes += it->second->memoryusage();
+    }
+    entries.push_back({ "nodes", nodes.size(), bytes });
+    entries.push_back({ "fingerprints", mFingerprints.size(), mFingerprints.memoryusage() });
+    entries.push_back({ "nameindex", mNodeNameIndex.size(), mNodeNameIndex.memoryusage() });
+    entries.push_back({ "recentnodes", mRecentNodes.size(), MemoryUsage::tree(mRecentNodes) });
+
+    size_t count = 0;
+#ifdef ENABLE_SYNC
+    bytes = MemoryUsage::tree(fsidnode) + MemoryUsage::hash(localnodeindex);
+    for (sync_list::const_iterator it = syncs.begin(); it != syncs.end(); it++)
+    {
+        localtreememoryusage(&(*it)->localroot, count, bytes);
+    }
+    entries.push_back({ "localnodes", count, bytes });
+#endif
+
+    bytes = MemoryUsage::tree(users);
+    for (user_map::const_iterator it = users.begin(); it != users.end(); it++)
+    {
+        bytes += MemoryUsage::of(it->second.email);
+    }
+    entries.push_back({ "users", users.size(), bytes });
+
+    count = 0;
+    bytes = 0;
+    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    {
+        for (const transfer_map* m : { &transfers[d], &cachedtransfers[d] })
+        {
+            bytes += MemoryUsage::tree(*m);
+            for (transfer_map::const_iterator it = m->begin(); it != m->end(); it++)
+            {
+                const Transfer* t = it->second;
+                bytes += sizeof(Transfer) + MemoryUsage::list(t->files) + MemoryUsage::of(t->localfilename)
+                       + MemoryUsage::tree(t->chunkmacs) + MemoryUsage::tree(t->cachedchunkmacs)
+                       + MemoryUsage::vector(t->tempurls) + MemoryUsage::of(t->cachedfields)
+                       + MemoryUsage::vector(t->chunkmacdeltas);
+                for (const string& url : t->tempurls)
+                {
+                    bytes += MemoryUsage::of(url);
+                }
+            }
+            count += m->size();
+        }
+    }
+    entries.push_back({ "transfers", count, bytes });
+
+    bytes = 0;
+    for (transferslot_list::const_iterator it = tslots.begin(); it != tslots.end(); it++)
+    {
+        const TransferSlot* ts = *it;
+        bytes += sizeof(TransferSlot) + ts->transferbuf.bufferedBytes();
+        for (int i = 0; ts->reqs && i < ts->connections; i++)
+        {
+            bytes += ts->reqs[i] ? ts->reqs[i]->memoryusage() : 0;
+        }
+        for (const HttpReqDL* req : ts->hedges)
+        {
+            bytes += req ? req->memoryusage() : 0;
+        }
+    }
+    entries.push_back({ "transferslots", tslots.size(), bytes });
 
-    for (int d = GET; d == GET || d == PUT; d += PUT - GET)
+    bytes = 0;
+    for (dr_list::const_iterator it = drq.begin(); it != drq.end(); it++)
     {
-        while (cachedtransfers[d].size())
+        const DirectRead* dr = *it;
+        bytes += sizeof(DirectRead) + dr->drbuf.bufferedBytes();
+        if (dr->drs)
         {
-            transfer_map::iterator it = cachedtransfers[d].begin();
-            Transfer *transfer = it->second;
-            if (remove || (purgeOrphanTransfers && (m_time() - transfer->lastaccesstime) >= 172500))
+            for (const HttpReq* req : dr->drs->reqs)
             {
-                LOG_warn << "Purging orphan transfer";
-                transfer->finished = true;
+                bytes += req ? req->memoryusage() : 0;
             }
+        }
+    }
+    entries.push_back({ "directreads", drq.size(), bytes });
+    entries.push_back({ "directreadcache", 0, size_t(drcache.getsize()) });
 
-            delete transfer;
-            cachedtransfers[d].erase(it);
+    bytes = 0;
+    for (UserAlerts::Alerts::const_iterator it = useralerts.alerts.begin(); it != useralerts.alerts.end(); it++)
+    {
+        bytes += sizeof(void*) + sizeof(UserAlert::Base) + MemoryUsage::of((*it)->userEmail);
+    }
+    entries.push_back({ "useralerts", useralerts.alerts.size(), bytes });
+
+    count = 0;
+    bytes = 0;
+    vector<const HttpReq*> requests = { pendingcs, pendingsc, badhostcs, workinglockcs };
+    for (const PipelinedCs& p : pipelinedcs)
+    {
+        requests.push_back(p.req);
+    }
+    for (pendinghttp_map::const_iterator it = pendinghttp.begin(); it != pendinghttp.end(); it++)
+    {
+        requests.push_back(it->second);
+    }
+    for (const HttpReq* req : requests)
+    {
+        if (req)
+        {
+            count++;
+            bytes += sizeof(HttpReq) + req->memoryusage();
         }
     }
+    entries.push_back({ "requests", count, bytes });
 
-    pendingtcids.clear();
-    cachedfiles.clear();
-    cachedfilesdbids.clear();
+    // process-wide
+    entries.push_back({ "httpbufferpool", 0, HttpBufferPool::pooledbytes() });
 
-    if (remove && tctable)
+    entries.insert(entries.end(), extra.begin(), extra.end());
+
+    std::ostringstream s;
+    size_t total = 0;
+    s << "{";
+    for (const MemoryUsageEntry& e : entries)
     {
-        tctable->remove();
+        s << "\"" << e.name << "\":{\"count\":" << e.count << ",\"bytes\":" << e.bytes << "},";
+        total += e.bytes;
     }
-    delete tctable;
-    tctable = NULL;
+    s << "\"total\":" << total << "}";
+    return s.str();
 }
 
 void MegaClient::enabletransferresumption(const char *loggedoutid)
@@ -10704,6 +13469,8 @@ void MegaClient::enabletransferresumption(const char *loggedoutid)
         tckey.setkey((const byte*)lok.data());
     }
 
+    fingerprintcachename = "fingerprints_" + dbname;
+    tlssessioncachename = "tlssessions_" + dbname;
     dbname.insert(0, "transfers_");
 
     tctable = dbaccess->open(rng, fsaccess, &dbname, true, true);
@@ -10712,9 +13479,24 @@ void MegaClient::enabletransferresumption(const char *loggedoutid)
         return;
     }
 
+    if (usefingerprintcache)
+    {
+        if (DbTable* fptable = dbaccess->open(rng, fsaccess, &fingerprintcachename, false, false))
+        {
+            fingerprintcache = std::make_shared<FingerprintCache>(fptable, tckey);
+        }
+    }
+
+    if (usetlssessioncache)
+    {
+        opentlssessions();
+    }
+
     uint32_t id;
     string data;
     Transfer* t;
+    std::map<uint32_t, Transfer*> transfersbydbid;
+    std::map<uint32_t, string> chunkmacdeltas;
 
     LOG_info << "Loading transfers from local cache";
     tctable->rewind();
@@ -10726,6 +13508,7 @@ void MegaClient::enabletransferresumption(const char *loggedoutid)
                 if ((t = Transfer::unserialize(this, &data, cachedtransfers)))
                 {
                     t->dbid = id;
+                    transfersbydbid[id] = t;
                     if (t->priority > transferlist.currentpriority)
                     {
                         transferlist.currentpriority = t->priority;
@@ -10743,7 +13526,46 @@ void MegaClient::enabletransferresumption(const char *loggedoutid)
                 cachedfilesdbids.push_back(id);
                 LOG_debug << "Cached file loaded";
                 break;
+            case CACHEDCHUNKMACS:
+                chunkmacdeltas[id].swap(data);
+                break;
+        }
+    }
+
+    // chunk MACs cached after their transfer's record was written, oldest first
+    for (std::map<uint32_t, string>::iterator it = chunkmacdeltas.begin(); it != chunkmacdeltas.end(); it++)
+    {
+        const char* ptr = it->second.data();
+        const char* end = ptr + it->second.size();
+        std::map<uint32_t, Transfer*>::iterator tit = transfersbydbid.end();
+
+        if (ptr + sizeof(uint32_t) <= end)
+        {
+            tit = transfersbydbid.find(MemAccess::get<uint32_t>(ptr));
+            ptr += sizeof(uint32_t);
+        }
+
+        if (tit == transfersbydbid.end() || !tit->second->chunkmacs.unserialize(ptr, end))
+        {
+            LOG_warn << "Discarding orphan or invalid chunk MAC record";
+            tctable->del(it->first);
+            continue;
+        }
+
+        tit->second->chunkmacdeltas.push_back(it->first);
+    }
+
+    for (std::map<uint32_t, Transfer*>::iterator it = transfersbydbid.begin(); it != transfersbydbid.end(); it++)
+    {
+        t = it->second;
+
+        if (t->chunkmacdeltas.size())
+        {
+            t->chunkmacs.calcprogress(t->size, t->pos, t->progresscompleted);
         }
+
+        t->serializerecord(&t->cachedfields, NULL);
+        t->cachedchunkmacs = t->chunkmacs;
     }
 
     // if we are logged in but the filesystem is not current yet
@@ -10797,6 +13619,22 @@ void MegaClient::disabletransferresumption(const char *loggedoutid)
     {
         dbname = loggedoutid ? loggedoutid : "default";
     }
+
+    // the fingerprints and the TLS sessions are only kept along with the transfers
+    string fpname = "fingerprints_" + dbname;
+    if (DbTable* fptable = dbaccess->open(rng, fsaccess, &fpname, false, false))
+    {
+        fptable->remove();
+        delete fptable;
+    }
+
+    string tlsname = "tlssessions_" + dbname;
+    if (DbTable* table = dbaccess->open(rng, fsaccess, &tlsname, false, false))
+    {
+        table->remove();
+        delete table;
+    }
+
     dbname.insert(0, "transfers_");
 
     tctable = dbaccess->open(rng, fsaccess, &dbname, true, true);
@@ -10815,6 +13653,8 @@ void MegaClient::fetchnodes(bool nocache)
         return;
     }
 
+    cachepreloadpending = false;
+
     WAIT_CLASS::bumpds();
     fnstats.init();
     if (sid.size() >= SIDLEN)
@@ -10826,11 +13666,16 @@ void MegaClient::fetchnodes(bool nocache)
         fnstats.type = FetchNodesStats::TYPE_FOLDER;
     }
 
-    opensctable();
+    // lazily loaded folder links are partial trees: they are not cached
+    if (!lazyfolderlink())
+    {
+        opensctable();
+    }
 
     if (sctable && cachedscsn == UNDEF)
     {
         sctable->truncate();
+        reloadreconciling = false;
     }
 
     // only initial load from local cache
@@ -10852,6 +13697,7 @@ void MegaClient::fetchnodes(bool nocache)
         Base64::btoa((byte*)&cachedscsn, sizeof cachedscsn, scsn);
         LOG_info << "Session loaded from local cache. SCSN: " << scsn;
 
+        app->nodes_cached();
         app->fetchnodes_result(API_OK);
 
         // if don't know fileversioning is enabled or disabled...
@@ -10900,10 +13746,13 @@ void MegaClient::fetchnodes(bool nocache)
         fnstats.cache = nocache ? FetchNodesStats::API_NO_CACHE : FetchNodesStats::API_CACHE;
         fetchingnodes = true;
         pendingsccommit = false;
+        preloadedsc.clear();
+        cachepreloaded = false;
 
         // prevent the processing of previous sc requests
         delete pendingsc;
         pendingsc = NULL;
+        cancelscprefetch();
         jsonsc.pos = NULL;
         scnotifyurl.clear();
         insca = false;
@@ -10935,7 +13784,8 @@ void MegaClient::fetchnodes(bool nocache)
             reqs.add(new CommandGetUA(this, uid.c_str(), ATTR_PUSH_SETTINGS, NULL, 0));
         }
 
-        reqs.add(new CommandFetchNodes(this, nocache));
+        fetchedfolders.clear();
+        reqs.add(new CommandFetchNodes(this, nocache, !lazyfolderlink()));
 
         if (!loggedinfolderlink())
         {
@@ -10949,6 +13799,28 @@ void MegaClient::fetchnodes(bool nocache)
     }
 }
 
+bool MegaClient::lazyfolderlink()
+{
+    return lazyfolderlinks && loggedinfolderlink();
+}
+
+void MegaClient::fetchfolder(handle h)
+{
+    reqs.add(new CommandFetchFolder(this, h));
+}
+
+bool MegaClient::folderfetched(handle h)
+{
+    // everything is fetched at once unless the folder link is lazy
+    if (!lazyfolderlink())
+    {
+        return true;
+    }
+
+    // the root comes with its children
+    return h == rootnodes[0] || fetchedfolders.find(h) != fetchedfolders.end();
+}
+
 void MegaClient::fetchkeys()
 {
     fetchingkeys = true;
@@ -11645,10 +14517,16 @@ void MegaClient::purgenodesusersabortsc()
 {
     app->clearing();
 
+    keepreloadrecords();
+
     while (!hdrns.empty())
     {
         delete hdrns.begin()->second;
     }
+    drcache.clear();
+
+    // local nodes and nodes don't unlink themselves one by one
+    tearingdown = true;
 
 #ifdef ENABLE_SYNC
     for (sync_list::iterator it = syncs.begin(); it != syncs.end(); )
@@ -11658,19 +14536,38 @@ void MegaClient::purgenodesusersabortsc()
     }
 
     syncs.clear();
+
+    fsidnode.clear();
+    localnodeindex.clear();
+    localsyncnotseen.clear();
+    syncdowndirty.clear();
+    syncupdirty.clear();
+    totalLocalNodes = 0;
 #endif
 
+    purgeremoved(purgequeue.size());
+
     for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
     {
         delete it->second;
     }
 
+    tearingdown = false;
+
+    // drop the whole indexes at once rather than node by node
     nodes.clear();
+    mNodeNameIndex.clear();
+    mOutShareNodes.clear();
+    mPendingShareNodes.clear();
+    mPublicLinkNodes.clear();
+    mRecentNodes.clear();
+    mNodeCounters.clear();
+    mFingerprints.clear();
+    lazynodecount = 0;
 
 #ifdef ENABLE_SYNC
     todebris.clear();
     tounlink.clear();
-    mFingerprints.clear();
 #endif
 
     for (fafc_map::iterator cit = fafcs.begin(); cit != fafcs.end(); cit++)
@@ -11686,6 +14583,8 @@ void MegaClient::purgenodesusersabortsc()
         }
     }
 
+    facachehits.clear();
+
     for (newshare_list::iterator it = newshares.begin(); it != newshares.end(); it++)
     {
         delete *it;
@@ -11698,6 +14597,10 @@ void MegaClient::purgenodesusersabortsc()
     pcrnotify.clear();
     useralerts.clear();
 
+    keypendingnodes.clear();
+    keywaitingnodes.clear();
+    newsharekeys.clear();
+
 #ifdef ENABLE_CHAT
     for (textchat_map::iterator it = chats.begin(); it != chats.end();)
     {
@@ -11739,10 +14642,82 @@ void MegaClient::purgenodesusersabortsc()
         app->request_response_progress(-1, -1);
         pendingsc->disconnect();
     }
+    cancelscprefetch();
 
     init();
 }
 
+void MegaClient::prefetchsc()
+{
+    cancelscprefetch();
+
+    // the response is skipped through to find out how it ends: a wait URL
+    // means that there is nothing else to fetch yet
+    JSON json;
+    json.begin(pendingsc->in.c_str());
+    if (!json.enterobject())
+    {
+        return;
+    }
+
+    string sn;
+    bool packets = false;
+
+    for (;;)
+    {
+        switch (json.getnameid())
+        {
+            case 'a':
+                packets = json.pos[0] == '[' && json.pos[1] != ']';
+                if (!json.storeobject())
+                {
+                    return;
+                }
+                break;
+
+            case MAKENAMEID2('s', 'n'):
+                if (!json.storeobject(&sn))
+                {
+                    return;
+                }
+                break;
+
+            case EOO:
+                if (packets && sn.size() && sn.size() < sizeof scsn)
+                {
+                    scprefetchsn = sn;
+
+                    pendingscprefetch = new HttpReq();
+                    pendingscprefetch->logname = clientname + "sc ";
+                    pendingscprefetch->posturl = APIURL;
+                    pendingscprefetch->posturl.append("wsc?sn=");
+                    pendingscprefetch->posturl.append(sn);
+                    pendingscprefetch->posturl.append(auth);
+                    pendingscprefetch->protect = true;
+                    pendingscprefetch->type = REQ_JSON;
+                    LOG_debug << "Prefetching action packets from " << sn;
+                    pendingscprefetch->post(this);
+                }
+                return;
+
+            default:
+                // 'w' and anything unexpected: don't guess
+                return;
+        }
+    }
+}
+
+void MegaClient::cancelscprefetch()
+{
+    if (pendingscprefetch)
+    {
+        pendingscprefetch->disconnect();
+        delete pendingscprefetch;
+        pendingscprefetch = NULL;
+    }
+    scprefetchsn.clear();
+}
+
 // request direct read by node pointer
 void MegaClient::pread(Node* n, m_off_t count, m_off_t offset, void* appdata)
 {
@@ -11755,6 +14730,41 @@ void MegaClient::pread(handle ph, SymmCipher* key, int64_t ctriv, m_off_t count,
     queueread(ph, isforeign, key, ctriv, count, offset, appdata, privauth, pubauth, cauth);
 }
 
+void MegaClient::prefetchread(Node* n, bool readahead)
+{
+    if (n->type != FILENODE || !n->size || (overquotauntil && overquotauntil > Waiter::ds))
+    {
+        return;
+    }
+
+    handle h = n->nodehandle;
+    encodehandletype(&h, true);
+
+    if (hdrns.find(h) != hdrns.end())
+    {
+        // already being read, or its tempurls are known
+        return;
+    }
+
+    DirectReadNode* drn = new DirectReadNode(this, h, true, n->nodecipher(), MemAccess::get<int64_t>((const char*)n->nodekey.data() + SymmCipher::KEYLENGTH), NULL, NULL, NULL);
+    drn->hdrn_it = hdrns.insert(hdrns.end(), pair<handle, DirectReadNode*>(h, drn));
+    drn->size = n->size;
+
+    m_off_t count = std::min(std::min(DirectReadCache::READAHEAD, drcache.getmaxsize() / 4), n->size);
+    if (readahead && count > 0)
+    {
+        DirectRead* dr = new DirectRead(drn, count, 0, 0, NULL);
+        dr->readahead = true;
+    }
+
+    LOG_debug << "Prefetching streaming of " << toNodeHandle(n->nodehandle) << (readahead ? " (read ahead)" : "");
+
+    // without reads, the node is kept by the result of the command (see DirectReadNode::cmdresult)
+    drn->schedule(DirectReadSlot::TIMEOUT_DS);
+    drn->pendingcmd = new CommandDirectRead(this, drn);
+    reqs.add(drn->pendingcmd);
+}
+
 // since only the first six bytes of a handle are in use, we use the seventh to encode its type
 void MegaClient::encodehandletype(handle* hp, bool p)
 {
@@ -11832,7 +14842,7 @@ void MegaClient::abortreads(handle h, bool p, m_off_t offset, m_off_t count)
 
         for (dr_list::iterator it = drn->reads.begin(); it != drn->reads.end(); )
         {
-            if ((offset < 0 || offset == (*it)->offset) && (count < 0 || count == (*it)->count))
+            if (!(*it)->readahead && (offset < 0 || offset == (*it)->offset) && (count < 0 || count == (*it)->count))
             {
                 app->pread_failure(API_EINCOMPLETE, (*it)->drn->retries, (*it)->appdata, 0);
 
@@ -11848,19 +14858,33 @@ bool MegaClient::execdirectreads()
 {
     CodeCounter::ScopeTimer ccst(performanceStats.execdirectreads);
 
+    if (drq.empty() && dsdrns.empty())
+    {
+        return false;
+    }
+
+    execscheduler.begin(ExecScheduler::DIRECTREADS);
+
     bool r = false;
     DirectReadSlot* drs;
 
     if (drq.size() < MAXDRSLOTS)
     {
         // fill slots
-        for (dr_list::iterator it = drq.begin(); it != drq.end(); it++)
+        for (dr_list::iterator it = drq.begin(); it != drq.end(); )
         {
-            if (!(*it)->drs)
+            DirectRead* dr = *(it++);
+            if (!dr->drs)
             {
-                drs = new DirectReadSlot(*it);
-                (*it)->drs = drs;
                 r = true;
+                if (!dr->start())
+                {
+                    // served from the cache
+                    continue;
+                }
+
+                drs = new DirectReadSlot(dr);
+                dr->drs = drs;
 
                 if (drq.size() >= MAXDRSLOTS) break;
             }
@@ -11891,6 +14915,7 @@ bool MegaClient::execdirectreads()
         }
     }
 
+    execscheduler.end(ExecScheduler::DIRECTREADS);
     return r;
 }
 
@@ -12013,6 +15038,9 @@ error MegaClient::addsync(string* rootpath, const char* debris, string* localdeb
         return e;
     }
 
+    // syncs match names and fingerprints across the whole tree
+    loadlazynodes();
+
     if (rootpath->size() >= fsaccess->localseparator.size()
      && !memcmp(rootpath->data() + (int(rootpath->size()) & -int(fsaccess->localseparator.size())) - fsaccess->localseparator.size(),
                 fsaccess->localseparator.data(),
@@ -12052,7 +15080,13 @@ error MegaClient::addsync(string* rootpath, const char* debris, string* localdeb
                 }
             }
 
-            if (sync->scan(rootpath, fa.get()))
+            bool journaled = sync->resumefromjournal();
+            if (!journaled)
+            {
+                sync->prefetch(rootpath);
+            }
+
+            if (journaled || sync->scan(rootpath, fa.get()))
             {
                 syncsup = false;
                 e = API_OK;
@@ -12365,10 +15399,13 @@ bool MegaClient::syncdown(LocalNode* l, string* localpath, bool rubbish)
         localpath->append(fsaccess->localseparator);
         localpath->append(localname);
 
-        string utf8path;
-        fsaccess->local2path(localpath, &utf8path);
-        LOG_debug << "Unsynced remote node in syncdown: " << utf8path << " Nsize: " << rit->second->size
-                  << " Nmtime: " << rit->second->mtime << " Nhandle: " << LOG_NODEHANDLE(rit->second->nodehandle);
+        if (SimpleLogger::logCurrentLevel >= logDebug)
+        {
+            string utf8path;
+            fsaccess->local2path(localpath, &utf8path);
+            LOG_debug << "Unsynced remote node in syncdown: " << utf8path << " Nsize: " << rit->second->size
+                      << " Nmtime: " << rit->second->mtime << " Nhandle: " << LOG_NODEHANDLE(rit->second->nodehandle);
+        }
 
         // does this node already have a corresponding LocalNode under
         // a different name or elsewhere in the filesystem?
@@ -12498,10 +15535,170 @@ bool MegaClient::syncdown(LocalNode* l, string* localpath, bool rubbish)
             }
         }
 
-        localpath->resize(t);
+        localpath->resize(t);
+    }
+
+    return success;
+}
+
+// the folder that held a changed node locally and the synced folder it is in
+// now (its nearest synced ancestor, if its own parent isn't synced yet)
+void MegaClient::syncdownmark(Node* n)
+{
+    if (n->localnode && n->localnode != (LocalNode*)~0)
+    {
+        syncdowndirty.insert(n->localnode->parent ? n->localnode->parent : n->localnode);
+    }
+
+    for (Node* p = n->parent; p; p = p->parent)
+    {
+        if (p->localnode && p->localnode != (LocalNode*)~0)
+        {
+            syncdowndirty.insert(p->localnode);
+            break;
+        }
+    }
+}
+
+localnode_vector MegaClient::dirtyroots(const localnode_set& dirty)
+{
+    localnode_vector roots;
+
+    for (localnode_set::const_iterator it = dirty.begin(); it != dirty.end(); it++)
+    {
+        LocalNode* p = (*it)->parent;
+        while (p && !dirty.count(p))
+        {
+            p = p->parent;
+        }
+
+        if (!p)
+        {
+            roots.push_back(*it);
+        }
+    }
+
+    return roots;
+}
+
+bool MegaClient::syncdowndirtyfolders()
+{
+    bool success = true;
+    set<Sync*> walked;
+
+    localnode_vector roots = dirtyroots(syncdowndirty);
+    localnode_vector::iterator it;
+    for (it = roots.begin(); it != roots.end(); it++)
+    {
+        // LocalNodes deleted by an earlier walk leave the set
+        if (!syncdowndirty.count(*it))
+        {
+            continue;
+        }
+
+        // the rest of the folders are walked in the next exec() - at least
+        // one per run
+        if (walked.size() && execscheduler.expired(ExecScheduler::SYNC))
+        {
+            break;
+        }
+
+        LocalNode* l = *it;
+        if (l->sync->state != SYNC_ACTIVE && l->sync->state != SYNC_INITIALSCAN)
+        {
+            continue;
+        }
+
+        string localpath;
+        l->getlocalpath(&localpath);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!syncdown(l, &localpath, true))
+        {
+            // as for a full syncdown(), rescan afterwards
+            success = false;
+            l->sync->dirnotify->error = true;
+        }
+        l->sync->stats.syncdowntime += std::chrono::steady_clock::now() - start;
+
+        syncupdirty.insert(l);
+        walked.insert(l->sync);
+    }
+
+    if (it == roots.end())
+    {
+        syncdowndirty.clear();
+    }
+    else
+    {
+        // forget the folders already walked and the ones below them
+        localnode_set done(roots.begin(), it);
+        for (localnode_set::iterator dit = syncdowndirty.begin(); dit != syncdowndirty.end(); )
+        {
+            LocalNode* p = *dit;
+            while (p && !done.count(p))
+            {
+                p = p->parent;
+            }
+
+            if (p)
+            {
+                syncdowndirty.erase(dit++);
+            }
+            else
+            {
+                dit++;
+            }
+        }
+    }
+
+    for (set<Sync*>::iterator it = walked.begin(); it != walked.end(); it++)
+    {
+        (*it)->cachenodes();
+    }
+
+    return success;
+}
+
+bool MegaClient::syncupdirtyfolders(dstime* nds)
+{
+    bool insync = true;
+    set<Sync*> walked;
+
+    localnode_vector roots = dirtyroots(syncupdirty);
+    for (localnode_vector::iterator it = roots.begin(); it != roots.end(); it++)
+    {
+        if (!syncupdirty.count(*it))
+        {
+            continue;
+        }
+
+        // syncup() needs the folder on both sides
+        LocalNode* l = *it;
+        if ((l->sync->state != SYNC_ACTIVE && l->sync->state != SYNC_INITIALSCAN)
+                || l->type != FOLDERNODE || !l->node)
+        {
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!syncup(l, nds))
+        {
+            insync = false;
+        }
+        l->sync->stats.syncuptime += std::chrono::steady_clock::now() - start;
+
+        walked.insert(l->sync);
+    }
+
+    syncupdirty.clear();
+
+    for (set<Sync*>::iterator it = walked.begin(); it != walked.end(); it++)
+    {
+        (*it)->cachenodes();
     }
 
-    return success;
+    return insync;
 }
 
 // recursively traverse tree of LocalNodes and match with remote Nodes
@@ -12679,7 +15876,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds)
                                         string localpath;
                                         ll->getlocalpath(&localpath);
                                         SymmCipher *symmcipher = ll->node->nodecipher();
-                                        gfx->gendimensionsputfa(NULL, &localpath, ll->node->nodehandle, symmcipher, missingattr);
+                                        gfx->gendimensionsputfa(NULL, &localpath, ll->node->nodehandle, symmcipher, missingattr, true, ll);
                                     }
                                 }
                             }
@@ -12916,7 +16113,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds)
                     if (t)
                     {
                         ll->sync->localbytes -= ll->size;
-                        ll->genfingerprint(fa.get());
+                        FingerprintCache::genfingerprint(fingerprintcache.get(), ll, fa.get());
                         ll->sync->localbytes += ll->size;                        
 
                         ll->sync->statecacheadd(ll);
@@ -13034,7 +16231,9 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds)
 void MegaClient::syncupdate()
 {
     // split synccreate[] in separate subtrees and send off to putnodes() for
-    // creation on the server
+    // creation on the server - all subtrees beneath the same existing node
+    // go in a single putnodes(), the nodes of a new subtree reference their
+    // new parents by syncid
     unsigned i, start, end;
     SymmCipher tkey;
     string tattrstring;
@@ -13044,6 +16243,11 @@ void MegaClient::syncupdate()
     NewNode* nnp;
     LocalNode* l;
 
+    // subtrees grouped by their existing parent node, in order of appearance
+    typedef vector<pair<unsigned, unsigned> > subtree_vector;
+    vector<pair<Node*, subtree_vector> > targets;
+    map<Node*, size_t> targetindex;
+
     for (start = 0; start < synccreate.size(); start = end)
     {
         // determine length of distinct subtree beneath existing node
@@ -13055,89 +16259,115 @@ void MegaClient::syncupdate()
             }
         }
 
+        Node* target = synccreate[start]->parent->node;
+        map<Node*, size_t>::iterator it = targetindex.find(target);
+        if (it == targetindex.end())
+        {
+            it = targetindex.insert(pair<Node*, size_t>(target, targets.size())).first;
+            targets.push_back(pair<Node*, subtree_vector>(target, subtree_vector()));
+        }
+        targets[it->second].second.push_back(pair<unsigned, unsigned>(start, end));
+    }
+
+    for (size_t t = 0; t < targets.size(); t++)
+    {
+        subtree_vector& subtrees = targets[t].second;
+
+        unsigned count = 0;
+        for (size_t s = 0; s < subtrees.size(); s++)
+        {
+            count += subtrees[s].second - subtrees[s].first;
+        }
+
         // add nodes that can be created immediately: folders & existing files;
         // start uploads of new files
-        nn = nnp = new NewNode[end - start];
+        nn = nnp = new NewNode[count];
 
         DBTableTransactionCommitter committer(tctable);
-        for (i = start; i < end; i++)
+        for (size_t s = 0; s < subtrees.size(); s++)
         {
-            n = NULL;
-            l = synccreate[i];
+            start = subtrees[s].first;
+            end = subtrees[s].second;
 
-            if (l->type == FOLDERNODE || (n = nodebyfingerprint(l)))
+            for (i = start; i < end; i++)
             {
-                // create remote folder or copy file if it already exists
-                nnp->source = NEW_NODE;
-                nnp->type = l->type;
-                nnp->syncid = l->syncid;
-                nnp->localnode = l;
-                l->newnode = nnp;
-                nnp->nodehandle = n ? n->nodehandle : l->syncid;
-                nnp->parenthandle = i > start ? l->parent->syncid : UNDEF;
+                n = NULL;
+                l = synccreate[i];
 
-                if (n)
+                if (l->type == FOLDERNODE || (n = nodebyfingerprint(l)))
                 {
-                    // overwriting an existing remote node? tag it as the previous version or move to SyncDebris
-                    if (l->node && l->node->parent && l->node->parent->localnode)
+                    // create remote folder or copy file if it already exists
+                    nnp->source = NEW_NODE;
+                    nnp->type = l->type;
+                    nnp->syncid = l->syncid;
+                    nnp->localnode = l;
+                    l->newnode = nnp;
+                    nnp->nodehandle = n ? n->nodehandle : l->syncid;
+                    nnp->parenthandle = i > start ? l->parent->syncid : UNDEF;
+
+                    if (n)
                     {
-                        if (versions_disabled)
+                        // overwriting an existing remote node? tag it as the previous version or move to SyncDebris
+                        if (l->node && l->node->parent && l->node->parent->localnode)
                         {
-                            movetosyncdebris(l->node, l->sync->inshare);
+                            if (versions_disabled)
+                            {
+                                movetosyncdebris(l->node, l->sync->inshare);
+                            }
+                            else
+                            {
+                                nnp->ovhandle = l->node->nodehandle;
+                            }
                         }
-                        else
+
+                        // this is a file - copy, use original key & attributes
+                        // FIXME: move instead of creating a copy if it is in
+                        // rubbish to reduce node creation load
+                        nnp->nodekey = n->nodekey;
+                        tattrs.map = n->attrs.map;
+
+                        nameid rrname = AttrMap::string2nameid("rr");
+                        attr_map::iterator it = tattrs.map.find(rrname);
+                        if (it != tattrs.map.end())
                         {
-                            nnp->ovhandle = l->node->nodehandle;
+                            LOG_debug << "Removing rr attribute";
+                            tattrs.map.erase(it);
                         }
-                    }
 
-                    // this is a file - copy, use original key & attributes
-                    // FIXME: move instead of creating a copy if it is in
-                    // rubbish to reduce node creation load
-                    nnp->nodekey = n->nodekey;
-                    tattrs.map = n->attrs.map;
-
-                    nameid rrname = AttrMap::string2nameid("rr");
-                    attr_map::iterator it = tattrs.map.find(rrname);
-                    if (it != tattrs.map.end())
+                        app->syncupdate_remote_copy(l->sync, l->name.c_str());
+                    }
+                    else
                     {
-                        LOG_debug << "Removing rr attribute";
-                        tattrs.map.erase(it);
+                        // this is a folder - create, use fresh key & attributes
+                        nnp->nodekey.resize(FOLDERNODEKEYLENGTH);
+                        rng.genblock((byte*)nnp->nodekey.data(), FOLDERNODEKEYLENGTH);
+                        tattrs.map.clear();
                     }
 
-                    app->syncupdate_remote_copy(l->sync, l->name.c_str());
+                    // set new name, encrypt and attach attributes
+                    tattrs.map['n'] = l->name;
+                    tattrs.getjson(&tattrstring);
+                    tkey.setkey((const byte*)nnp->nodekey.data(), nnp->type);
+                    nnp->attrstring = new string;
+                    makeattr(&tkey, nnp->attrstring, tattrstring.c_str());
+
+                    l->treestate(TREESTATE_SYNCING);
+                    nnp++;
                 }
-                else
+                else if (l->type == FILENODE)
                 {
-                    // this is a folder - create, use fresh key & attributes
-                    nnp->nodekey.resize(FOLDERNODEKEYLENGTH);
-                    rng.genblock((byte*)nnp->nodekey.data(), FOLDERNODEKEYLENGTH);
-                    tattrs.map.clear();
-                }
+                    l->treestate(TREESTATE_PENDING);
 
-                // set new name, encrypt and attach attributes
-                tattrs.map['n'] = l->name;
-                tattrs.getjson(&tattrstring);
-                tkey.setkey((const byte*)nnp->nodekey.data(), nnp->type);
-                nnp->attrstring = new string;
-                makeattr(&tkey, nnp->attrstring, tattrstring.c_str());
+                    // the overwrite will happen upon PUT completion
+                    string tmppath, tmplocalpath;
 
-                l->treestate(TREESTATE_SYNCING);
-                nnp++;
-            }
-            else if (l->type == FILENODE)
-            {
-                l->treestate(TREESTATE_PENDING);
-
-                // the overwrite will happen upon PUT completion
-                string tmppath, tmplocalpath;
-
-                nextreqtag();
-                startxfer(PUT, l, committer);
+                    nextreqtag();
+                    startxfer(PUT, l, committer);
 
-                l->getlocalpath(&tmplocalpath, true);
-                fsaccess->local2path(&tmplocalpath, &tmppath);
-                app->syncupdate_put(l->sync, l, tmppath.c_str());
+                    l->getlocalpath(&tmplocalpath, true);
+                    fsaccess->local2path(&tmplocalpath, &tmppath);
+                    app->syncupdate_put(l->sync, l, tmppath.c_str());
+                }
             }
         }
 
@@ -13148,14 +16378,14 @@ void MegaClient::syncupdate()
         else
         {
             // add nodes unless parent node has been deleted
-            if (synccreate[start]->parent->node)
+            if (targets[t].first)
             {
                 syncadding++;
 
                 reqs.add(new CommandPutNodes(this,
-                                                synccreate[start]->parent->node->nodehandle,
+                                                targets[t].first->nodehandle,
                                                 NULL, nn, int(nnp - nn),
-                                                synccreate[start]->sync->tag,
+                                                synccreate[subtrees[0].first]->sync->tag,
                                                 PUTNODES_SYNC));
 
                 syncactivity = true;
@@ -13358,8 +16588,19 @@ void MegaClient::execmovetosyncdebris()
     sprintf(buf, "%04d-%02d-%02d", ptm->tm_year + 1900, ptm->tm_mon + 1, ptm->tm_mday);
     m_time_t currentminute = ts / 60;
 
+    // the folder of the day found last time, unless it was moved or renamed since
+    Node* bin = tn;
+    if (syncdebrisdayname == buf
+            && (n = nodebyhandle(syncdebrisday)) && n->type == FOLDERNODE
+            && n->parent && n->parent->parent == bin
+            && !strcmp(n->parent->displayname(), SYNCDEBRISFOLDERNAME)
+            && !strcmp(n->displayname(), buf))
+    {
+        tn = n;
+        target = SYNCDEL_DEBRISDAY;
+    }
     // locate //bin/SyncDebris
-    if ((n = childnodebyname(tn, SYNCDEBRISFOLDERNAME)) && n->type == FOLDERNODE)
+    else if ((n = childnodebyname(tn, SYNCDEBRISFOLDERNAME)) && n->type == FOLDERNODE)
     {
         tn = n;
         target = SYNCDEL_DEBRIS;
@@ -13369,13 +16610,21 @@ void MegaClient::execmovetosyncdebris()
         {
             tn = n;
             target = SYNCDEL_DEBRISDAY;
+            syncdebrisday = n->nodehandle;
+            syncdebrisdayname = buf;
         }
     }
 
+    // the folder of the day is created below, or already on its way: the
+    // deleted nodes wait for it instead of being moved twice
+    bool waitforday = target != SYNCDEL_DEBRISDAY && !syncdebrisfailed
+            && (syncdebrisadding || target == SYNCDEL_BIN || syncdebrisminute != currentminute);
+
     // in order to reduce the API load, we move
     // - SYNCDEL_DELETED nodes to any available target
     // - SYNCDEL_BIN/SYNCDEL_DEBRIS nodes to SYNCDEL_DEBRISDAY
-    // (move top-level nodes only)
+    // (move top-level nodes only: the nodes below are dropped once their
+    // ancestor is in the rubbish bin)
     for (it = todebris.begin(); it != todebris.end(); )
     {
         n = *it;
@@ -13384,13 +16633,28 @@ void MegaClient::execmovetosyncdebris()
          || n->syncdeleted == SYNCDEL_BIN
          || n->syncdeleted == SYNCDEL_DEBRIS)
         {
-            while ((n = n->parent) && n->syncdeleted == SYNCDEL_NONE);
+            Node* top = n;
+            while ((n = n->parent) && n->syncdeleted == SYNCDEL_NONE)
+            {
+                top = n;
+            }
 
             if (!n)
             {
                 n = *it;
 
-                if (n->syncdeleted == SYNCDEL_DELETED
+                if (n->syncdeleted == SYNCDEL_DELETED && top == bin)
+                {
+                    LOG_debug << "Moved to SyncDebris with an ancestor: " << n->displayname();
+                    n->syncdeleted = SYNCDEL_NONE;
+                    n->todebris_it = todebris.end();
+                    todebris.erase(it++);
+                }
+                else if (n->syncdeleted == SYNCDEL_DELETED && waitforday)
+                {
+                    it++;
+                }
+                else if (n->syncdeleted == SYNCDEL_DELETED
                  || ((n->syncdeleted == SYNCDEL_BIN
                    || n->syncdeleted == SYNCDEL_DEBRIS)
                       && target == SYNCDEL_DEBRISDAY))
@@ -13488,11 +16752,12 @@ void MegaClient::delsync(Sync* sync, bool deletecache)
     syncactivity = true;
 }
 
-void MegaClient::putnodes_syncdebris_result(error, NewNode* nn)
+void MegaClient::putnodes_syncdebris_result(error e, NewNode* nn)
 {
     delete[] nn;
 
     syncdebrisadding = false;
+    syncdebrisfailed = e != API_OK;
 }
 #endif
 
@@ -13512,7 +16777,7 @@ bool MegaClient::startxfer(direction_t d, File* f, DBTableTransactionCommitter&
 
                 if (fa->fopen(&f->localname, d == PUT, d == GET))
                 {
-                    f->genfingerprint(fa.get());
+                    FingerprintCache::genfingerprint(fingerprintcache.get(), f, fa.get());
                 }
             }
 
@@ -13524,7 +16789,10 @@ bool MegaClient::startxfer(direction_t d, File* f, DBTableTransactionCommitter&
             }
 
             #ifdef USE_MEDIAINFO
-            mediaFileInfo.requestCodecMappingsOneTime(this, &f->localname);  
+            if (!f->uploadstream)
+            {
+                mediaFileInfo.requestCodecMappingsOneTime(this, &f->localname);
+            }
             #endif
         }
         else
@@ -13628,9 +16896,17 @@ bool MegaClient::startxfer(direction_t d, File* f, DBTableTransactionCommitter&
                 }
                 else
                 {
+                    bool samefile = t->localfsid != UNDEF && fa->fsidvalid && fa->fsid == t->localfsid;
+
                     if (d == PUT)
                     {
-                        if (f->genfingerprint(fa.get()))
+                        if (samefile && fa->size == t->size && fa->mtime == t->mtime)
+                        {
+                            // the file the transfer was cached for, with the same size and mtime:
+                            // its fingerprint is trusted without reading it
+                            LOG_debug << "Resuming upload of an unchanged file";
+                        }
+                        else if (FingerprintCache::genfingerprint(fingerprintcache.get(), f, fa.get()))
                         {
                             LOG_warn << "The local file has been modified";
                             t->tempurls.clear();
@@ -13643,7 +16919,14 @@ bool MegaClient::startxfer(direction_t d, File* f, DBTableTransactionCommitter&
                     }
                     else
                     {
-                        if (t->progresscompleted > fa->size)
+                        if (t->localfsid != UNDEF && fa->fsidvalid && !samefile)
+                        {
+                            LOG_warn << "Replaced temporary file";
+                            t->chunkmacs.clear();
+                            t->progresscompleted = 0;
+                            t->pos = 0;
+                        }
+                        else if (t->progresscompleted > fa->size)
                         {
                             LOG_warn << "Truncated temporary file";
                             t->chunkmacs.clear();
@@ -13660,6 +16943,7 @@ bool MegaClient::startxfer(direction_t d, File* f, DBTableTransactionCommitter&
             {
                 t = new Transfer(this, d);
                 *(FileFingerprint*)t = *(FileFingerprint*)f;
+                t->uploadstream = f->uploadstream;
             }
 
             t->skipserialization = donotpersist;
@@ -13785,39 +17069,287 @@ void MegaClient::setmaxconnections(direction_t d, int num)
         if (connections[d] != num)
         {
             connections[d] = (unsigned char)num;
-            for (transferslot_list::iterator it = tslots.begin(); it != tslots.end(); )
+            restartslots(d);
+        }
+    }
+}
+
+void MegaClient::restartslots(direction_t d)
+{
+    for (transferslot_list::iterator it = tslots.begin(); it != tslots.end(); )
+    {
+        TransferSlot *slot = *it++;
+        if (slot->transfer->type == d)
+        {
+            slot->transfer->state = TRANSFERSTATE_QUEUED;
+            if (slot->transfer->client->ststatus != STORAGE_RED || slot->transfer->type == GET)
             {
-                TransferSlot *slot = *it++;
-                if (slot->transfer->type == d)
-                {
-                    slot->transfer->state = TRANSFERSTATE_QUEUED;
-                    if (slot->transfer->client->ststatus != STORAGE_RED || slot->transfer->type == GET)
-                    {
-                        slot->transfer->bt.arm();
-                    }
-                    delete slot;
-                }
+                slot->transfer->bt.arm();
+            }
+            delete slot;
+        }
+    }
+}
+
+int MegaClient::transferconnections(direction_t d) const
+{
+    if (powerpolicy.lowpower() && connections[d] > PowerPolicy::LOWPOWERCONNECTIONS)
+    {
+        return PowerPolicy::LOWPOWERCONNECTIONS;
+    }
+    return connections[d];
+}
+
+void MegaClient::setpowerpolicy(PowerPolicy::policy_t policy, PowerPolicy::power_t power, PowerPolicy::thermal_t thermal)
+{
+    bool lowpower = powerpolicy.lowpower();
+    int previous[2] = { transferconnections(GET), transferconnections(PUT) };
+
+    powerpolicy.policy = policy;
+    powerpolicy.power = power;
+    powerpolicy.thermal = thermal;
+
+    if (powerpolicy.lowpower() == lowpower)
+    {
+        return;
+    }
+
+    lowpower = !lowpower;
+    powerpolicy.switches++;
+    LOG_info << "Power policy: " << (lowpower ? "low power" : "unrestricted")
+             << " (power state " << power << ", thermal state " << thermal << ")";
+
+    if (gfx)
+    {
+        gfx->setworkerlimit(lowpower ? PowerPolicy::LOWPOWERGFXWORKERS : 0);
+    }
+
+    for (direction_t d : { GET, PUT })
+    {
+        if (transferconnections(d) != previous[d])
+        {
+            restartslots(d);
+        }
+    }
+
+    // the sync scan threads follow once the scans in progress finish (see Sync::scanworkers)
+    // and the commits wait for the interval from the next batch of action packets
+    if (!lowpower && deferredsccommit && pendingsccommit && sctable && !jsonsc.pos
+            && !pendingcs && !csretrying && !reqs.cmdspending())
+    {
+        commitsc(true);
+    }
+}
+
+bool PowerPolicy::lowpower() const
+{
+    switch (policy)
+    {
+        case UNRESTRICTED:
+            return false;
+        case LOWPOWER:
+            return true;
+        default:
+            return power >= BATTERYLOW || thermal >= SERIOUS;
+    }
+}
+
+void MegaClient::setnodenameindex(bool enable)
+{
+    if (enable == mNodeNameIndex.isenabled())
+    {
+        return;
+    }
+
+    mNodeNameIndex.setenabled(enable);
+
+    if (enable)
+    {
+        loadlazynodes();
+
+        for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+        {
+            mNodeNameIndex.update(it->second);
+        }
+
+        LOG_debug << "Node name index enabled: " << mNodeNameIndex.size() << " names";
+    }
+}
+
+void MegaClient::setscsnapshots(bool enable)
+{
+    scsnapshots = enable;
+
+    if (!enable)
+    {
+        dropsnapshot();
+    }
+}
+
+void MegaClient::setreloadreconciliation(bool enable)
+{
+    reloadreconciliation = enable;
+
+    if (!enable)
+    {
+        reloadrecords.clear();
+        reloaddbids.clear();
+        reloadreconciling = false;
+    }
+}
+
+// remember the cached records of the tree about to be purged, so that the
+// initsc() that follows a full reload can tell which ones are still valid
+void MegaClient::keepreloadrecords()
+{
+    reloadrecords.clear();
+    reloaddbids.clear();
+    reloadreconciling = false;
+
+    if (!reloadreconciliation || !sctable || ISUNDEF(cachedscsn) || nodes.empty())
+    {
+        return;
+    }
+
+    // unloaded nodes have records too
+    loadlazynodes();
+
+    string d;
+
+    for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+    {
+        Node* n = it->second;
+        if (!n->dbid)
+        {
+            continue;
+        }
+
+        d.clear();
+        if (n->serialize(&d))
+        {
+            ReloadRecord& r = reloadrecords[n->nodehandle];
+            r.dbid = n->dbid;
+            r.hash = std::hash<string>()(d);
+        }
+        else
+        {
+            reloaddbids.push_back(n->dbid);
+        }
+    }
+
+    for (user_map::iterator it = users.begin(); it != users.end(); it++)
+    {
+        if (it->second.dbid)
+        {
+            reloaddbids.push_back(it->second.dbid);
+        }
+    }
+
+    for (handlepcr_map::iterator it = pcrindex.begin(); it != pcrindex.end(); it++)
+    {
+        if (it->second->dbid)
+        {
+            reloaddbids.push_back(it->second->dbid);
+        }
+    }
+
+#ifdef ENABLE_CHAT
+    for (textchat_map::iterator it = chats.begin(); it != chats.end(); it++)
+    {
+        if (it->second->dbid)
+        {
+            reloaddbids.push_back(it->second->dbid);
+        }
+    }
+#endif
+
+    reloadreconciling = true;
+}
+
+void MegaClient::setlazynodeloading(bool enable)
+{
+    lazynodeloading = enable;
+
+    if (!enable)
+    {
+        loadlazynodes();
+    }
+}
+
+void MegaClient::loadlazynodes()
+{
+    if (!lazynodecount)
+    {
+        return;
+    }
+
+    LOG_debug << "Loading " << lazynodecount << " lazy nodes";
+
+    for (node_map::iterator it = nodes.begin(); lazynodecount && it != nodes.end(); it++)
+    {
+        it->second->loadrecord();
+    }
+}
+
+// the records of the children are read with one query on the parent index of the cache, not
+// one lookup each. Those it misses (records written before the index existed) are read one by one
+void MegaClient::loadlazychildren(Node* parent)
+{
+    size_t pending = 0;
+    if (lazynodecount)
+    {
+        for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); it++)
+        {
+            pending += (*it)->lazy;
+        }
+    }
+
+    if (!pending)
+    {
+        return;
+    }
+
+    if (pending > 1 && sctable && sctable->rewindchildren(DbTable::parentkey(parent->nodehandle, &key)))
+    {
+        uint32_t id;
+        string data;
+
+        while (pending && sctable->next(&id, &data, &key))
+        {
+            Node* n;
+            if ((id & DbTable::TYPEMASK) == CACHEDNODE
+                    && (n = nodebyhandle(Node::recordhandle(data), false))
+                    && n->lazy && n->parent == parent)
+            {
+                n->loadrecord(data);
+                pending--;
             }
         }
     }
+
+    for (node_list::iterator it = parent->children.begin(); pending && it != parent->children.end(); it++)
+    {
+        if ((*it)->lazy)
+        {
+            (*it)->loadrecord();
+            pending--;
+        }
+    }
 }
 
 Node* MegaClient::nodebyfingerprint(FileFingerprint* fingerprint)
 {
+    // lazy nodes are not in the fingerprint index yet
+    loadlazynodes();
     return mFingerprints.nodebyfingerprint(fingerprint);
 }
 
 node_vector *MegaClient::nodesbyfingerprint(FileFingerprint* fingerprint)
 {
+    loadlazynodes();
     return mFingerprints.nodesbyfingerprint(fingerprint);
 }
 
-static bool nodes_ctime_less(const Node* a, const Node* b)
-{
-    // heaps return the largest element
-    return a->ctime < b->ctime;
-}
-
 static bool nodes_ctime_greater(const Node* a, const Node* b)
 {
     return a->ctime > b->ctime;
@@ -13825,36 +17357,23 @@ static bool nodes_ctime_greater(const Node* a, const Node* b)
 
 node_vector MegaClient::getRecentNodes(unsigned maxcount, m_time_t since, bool includerubbishbin)
 {
-    // 1. Get nodes added/modified not older than `since`
+    // walk the file nodes from the most recent one, down to `since`
     node_vector v;
-    v.reserve(nodes.size());
-    for (node_map::iterator i = nodes.begin(); i != nodes.end(); ++i)
+    for (recentnode_map::reverse_iterator it = mRecentNodes.rbegin(); it != mRecentNodes.rend() && v.size() < maxcount; ++it)
     {
-        if (i->second->type == FILENODE && i->second->ctime >= since &&  // recent files only 
-            (!i->second->parent || i->second->parent->type != FILENODE)) // excluding versions
+        if (it->first < since)
         {
-            v.push_back(i->second);
+            break;
         }
-    }
-
-    // heaps use a 'less' function, and pop_heap returns the largest item stored.
-    std::make_heap(v.begin(), v.end(), nodes_ctime_less);
 
-    // 2. Order them chronologically and restrict them to a maximum of `maxcount`
-    node_vector v2;
-    unsigned maxItems = std::min(maxcount, unsigned(v.size()));
-    v2.reserve(maxItems);
-    while (v2.size() < maxItems && !v.empty())
-    {
-        std::pop_heap(v.begin(), v.end(), nodes_ctime_less);
-        Node* n = v.back();
-        v.pop_back();
-        if (includerubbishbin || n->firstancestor()->type != RUBBISHNODE)
+        Node* n = it->second;
+        if ((!n->parent || n->parent->type != FILENODE) &&  // excluding versions
+            (includerubbishbin || n->firstancestor()->type != RUBBISHNODE))
         {
-            v2.push_back(n);
+            v.push_back(n);
         }
     }
-    return v2;
+    return v;
 }
 
 
@@ -14017,10 +17536,12 @@ void MegaClient::nodesbyoriginalfingerprint(const char* originalfingerprint, Nod
 {
     if (parent)
     {
+        loadlazychildren(parent);
         for (node_list::iterator i = parent->children.begin(); i != parent->children.end(); ++i)
         {
             if ((*i)->type == FILENODE)
             {
+                (*i)->materialize();
                 attr_map::const_iterator a = (*i)->attrs.map.find(MAKENAMEID2('c', '0'));
                 if (a != (*i)->attrs.map.end() && !a->second.compare(originalfingerprint))
                 {
@@ -14039,6 +17560,7 @@ void MegaClient::nodesbyoriginalfingerprint(const char* originalfingerprint, Nod
         {
             if (i->second->type == FILENODE)
             {
+                i->second->materialize();
                 attr_map::const_iterator a = i->second->attrs.map.find(MAKENAMEID2('c', '0'));
                 if (a != i->second->attrs.map.end() && !a->second.compare(originalfingerprint))
                 {
@@ -14122,6 +17644,36 @@ m_off_t MegaClient::getmaxuploadspeed()
     return httpio->getmaxuploadspeed();
 }
 
+bool MegaClient::sethttp2(bool enable)
+{
+    return httpio->sethttp2(enable);
+}
+
+bool MegaClient::gethttp2()
+{
+    return httpio->gethttp2();
+}
+
+bool MegaClient::setsocketoptions(direction_t d, const SocketOptions& options)
+{
+    return httpio->setsocketoptions(d, options);
+}
+
+bool MegaClient::setconnectioncache(direction_t d, const ConnectionCacheOptions& options)
+{
+    return httpio->setconnectioncache(d, options);
+}
+
+bool MegaClient::setnetworkthread(bool enable)
+{
+    return httpio->setiothread(enable);
+}
+
+bool MegaClient::getnetworkthread()
+{
+    return httpio->getiothread();
+}
+
 handle MegaClient::getovhandle(Node *parent, string *name)
 {
     handle ovhandle = UNDEF;
@@ -14329,7 +17881,7 @@ void MegaClient::getwelcomepdf()
 }
 
 #ifdef MEGA_MEASURE_CODE
-std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Waiter* waiter)
+std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Waiter* waiter, DbTable* sctable)
 {
     std::ostringstream s;
     s << prepareWait.report(reset) << "\n"
@@ -14342,12 +17894,17 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
         << dispatchTransfers.report(reset) << "\n"
         << applyKeys.report(reset) << "\n"
         << scProcessingTime.report(reset) << "\n"
+        << teardown.report(reset) << "\n"
         << csResponseProcessingTime.report(reset) << "\n"
+        << csBatchRoundTrip.report(reset) << "\n"
+        << csPipelinedBatchRoundTrip.report(reset) << "\n"
         << " cs Request waiting time: " << csRequestWaitTime.report(reset) << "\n"
         << " transfers active time: " << transfersActiveTime.report(reset) << "\n"
         << " transfer starts/finishes: " << transferStarts << " " << transferFinishes << "\n"
         << " transfer temperror/fails: " << transferTempErrors << " " << transferFails << "\n"
-        << " nowait reason: immedate: " << prepwaitImmediate << " zero: " << prepwaitZero << " httpio: " << prepwaitHttpio << " fsaccess: " << prepwaitFsaccess << " nonzero waits: " << nonzeroWait << "\n";
+        << " sc processing yields: " << scYields << "\n"
+        << " nowait reason: immedate: " << prepwaitImmediate << " zero: " << prepwaitZero << " httpio: " << prepwaitHttpio << " fsaccess: " << prepwaitFsaccess << " nonzero waits: " << nonzeroWait << "\n"
+        << " transient arena allocations/bytes/blocks/peak: " << transientArena.allocations << " " << transientArena.bytes << " " << transientArena.blocks << " " << transientArena.peak << "\n";
 #ifdef USE_CURL
     if (auto curlhttpio = dynamic_cast<CurlHttpIO*>(httpio))
     {
@@ -14358,6 +17915,11 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
             << curlhttpio->countProcessCurlEventsCode.report(reset) << "\n";
     }
 #endif
+    int64_t hits, misses, writes;
+    if (sctable && sctable->cachestats(&hits, &misses, &writes, reset))
+    {
+        s << " state cache pages hit/miss/write: " << hits << " " << misses << " " << writes << "\n";
+    }
 #ifdef WIN32
     s << " waiter nonzero timeout: " << static_cast<WinWaiter*>(waiter)->performanceStats.waitTimedoutNonzero 
       << " zero timeout: " << static_cast<WinWaiter*>(waiter)->performanceStats.waitTimedoutZero
@@ -14367,12 +17929,41 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
     if (reset)
     {
         transferStarts = transferFinishes = transferTempErrors = transferFails = 0;
+        scYields = 0;
         prepwaitImmediate = prepwaitZero = prepwaitHttpio = prepwaitFsaccess = nonzeroWait = 0;
+        transientArena = TransientArena::Stats();
     }
     return s.str();
 }
 #endif
 
+std::vector<CodeCounter::ScopeStats*> MegaClient::PerformanceStats::sampled()
+{
+    return { &execFunction, &prepareWait, &doWait, &checkEvents,
+             &transferslotDoio, &execdirectreads, &transferComplete,
+             &dispatchTransfers, &applyKeys, &csResponseProcessingTime,
+             &csBatchRoundTrip, &csPipelinedBatchRoundTrip, &scProcessingTime, &teardown };
+}
+
+std::string MegaClient::PerformanceStats::latencies(bool reset)
+{
+    std::ostringstream s;
+    s << "{\"interval\":" << CodeCounter::LatencySampler::interval.load();
+
+    for (CodeCounter::ScopeStats* stats : sampled())
+    {
+        s << ",\"" << stats->name << "\":";
+        stats->sampler.tojson(s);
+        if (reset)
+        {
+            stats->sampler.reset();
+        }
+    }
+
+    s << "}";
+    return s.str();
+}
+
 FetchNodesStats::FetchNodesStats()
 {
     init();
@@ -14399,6 +17990,10 @@ void FetchNodesStats::init()
     timeToSyncsResumed = NEVER;
     timeToCurrent = NEVER;
     timeToTransfersResumed = NEVER;
+
+    timeReadNodes = 0;
+    timeApplyKeys = 0;
+    decryptThreads = 0;
 }
 
 void FetchNodesStats::toJsonArray(string *json)
@@ -14415,7 +18010,8 @@ void FetchNodesStats::toJsonArray(string *json)
         << timeToFirstByte << "," << timeToLastByte << ","
         << timeToCached << "," << timeToResult << ","
         << timeToSyncsResumed << "," << timeToCurrent << ","
-        << timeToTransfersResumed << "," << cache << "]";
+        << timeToTransfersResumed << "," << cache << ","
+        << timeReadNodes << "," << timeApplyKeys << "," << decryptThreads << "]";
     json->append(oss.str());
 }
 
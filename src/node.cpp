@@ -36,6 +36,7 @@ NewNode::NewNode()
 {
     syncid = UNDEF;
     added = false;
+    addedhandle = UNDEF;
     source = NEW_NODE;
     ovhandle = UNDEF;
     uploadhandle = UNDEF;
@@ -87,8 +88,18 @@ Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
 
     plink = NULL;
 
+    nameindex_slot = NodeNameIndex::NOSLOT;
+    childname_hash = 0;
+
+    lazy = false;
+
+    childrengeneration = 0;
+
+    subtreecounts = owncounts();
+
     memset(&changed,-1,sizeof changed);
     changed.removed = false;
+    changed.removedtree = false;
 
     if (client)
     {
@@ -110,7 +121,7 @@ Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
 
         // set parent linkage or queue for delayed parent linkage in case of
         // out-of-order delivery
-        if ((p = client->nodebyhandle(ph)))
+        if ((p = client->nodebyhandle(ph, false)))
         {
             setparent(p);
         }
@@ -120,30 +131,17 @@ Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
         }
 
         client->mFingerprints.newnode(this);
+
+        if (t == FILENODE)
+        {
+            recent_it = client->mRecentNodes.insert(std::make_pair(ctime, this));
+        }
     }
 }
 
 Node::~Node()
 {
-    // abort pending direct reads
-    client->preadabort(this);
-
-    // remove node's fingerprint from hash
-    client->mFingerprints.remove(this);
-
-#ifdef ENABLE_SYNC
-    // remove from todebris node_set
-    if (todebris_it != client->todebris.end())
-    {
-        client->todebris.erase(todebris_it);
-    }
-
-    // remove from tounlink node_set
-    if (tounlink_it != client->tounlink.end())
-    {
-        client->tounlink.erase(tounlink_it);
-    }
-#endif
+    detach();
 
     if (outshares)
     {
@@ -165,11 +163,90 @@ Node::~Node()
         delete pendingshares;
     }
 
+    delete plink;
+    delete inshare;
+    delete sharekey;
+}
+
+void Node::detach()
+{
+    if (detached)
+    {
+        return;
+    }
+    detached = true;
+
+    // the whole tree goes: the indexes are dropped at once by the client
+    if (client->tearingdown)
+    {
+#ifdef ENABLE_SYNC
+        if (localnode)
+        {
+            localnode->deleted = true;
+            localnode->node = NULL;
+        }
+
+        delete syncget;
+        syncget = NULL;
+#endif
+        return;
+    }
+
+    // abort pending direct reads
+    client->preadabort(this);
+
+    // remove node's fingerprint from hash
+    client->mFingerprints.remove(this);
+
+    // remove node's name from the search index
+    client->mNodeNameIndex.remove(this);
+
+    // remove node from the outshare and public link indexes
+    if (outshares || pendingshares || plink)
+    {
+        client->mOutShareNodes.erase(nodehandle);
+        client->mPendingShareNodes.erase(nodehandle);
+        client->mPublicLinkNodes.erase(nodehandle);
+    }
+
+    if (type == FILENODE)
+    {
+        client->mRecentNodes.erase(recent_it);
+    }
+
+    if (lazy)
+    {
+        client->lazynodecount--;
+    }
+
+#ifdef ENABLE_SYNC
+    // remove from todebris node_set
+    if (todebris_it != client->todebris.end())
+    {
+        client->todebris.erase(todebris_it);
+    }
+
+    // remove from tounlink node_set
+    if (tounlink_it != client->tounlink.end())
+    {
+        client->tounlink.erase(tounlink_it);
+    }
+#endif
 
     // remove from parent's children
     if (parent)
     {
         parent->children.erase(child_it);
+        parent->childrenchanged();
+        if (parent->childnameindex)
+        {
+            parent->childnameindex->remove(this);
+        }
+
+        for (Node* a = parent; a; a = a->parent)
+        {
+            a->subtreecounts -= subtreecounts;
+        }
     }
 
     Node* fa = firstancestor();
@@ -190,10 +267,8 @@ Node::~Node()
     {
         (*it)->parent = NULL;
     }
-
-    delete plink;
-    delete inshare;
-    delete sharekey;
+    children.clear();
+    parent = NULL;
 
 #ifdef ENABLE_SYNC
     // sync: remove reference from local filesystem node
@@ -205,9 +280,104 @@ Node::~Node()
 
     // in case this node is currently being transferred for syncing: abort transfer
     delete syncget;
+    syncget = NULL;
 #endif
 }
 
+void Node::childrenchanged()
+{
+    childrengeneration = ++client->nodegeneration;
+}
+
+bool Node::childrennamed(const char* name, vector<Node*>& results)
+{
+    if (!childnameindex)
+    {
+        if (children.size() < ChildNameIndex::MINCHILDREN)
+        {
+            return false;
+        }
+
+        childnameindex.reset(new ChildNameIndex(children));
+    }
+
+    childnameindex->find(name, results);
+    return true;
+}
+
+void Node::namechanged()
+{
+    if (parent && parent->childnameindex)
+    {
+        parent->childnameindex->remove(this);
+        parent->childnameindex->add(this);
+    }
+
+    pathchanged();
+}
+
+void Node::pathchanged()
+{
+    cachedpathgeneration = 0;
+
+    // the paths cached below this node are stale too
+    if (!children.empty())
+    {
+        client->pathgeneration++;
+    }
+}
+
+ChildNameIndex::ChildNameIndex(const node_list& children)
+{
+    mChildren.reserve(children.size());
+    for (Node* child : children)
+    {
+        add(child);
+    }
+}
+
+uint32_t ChildNameIndex::hash(const char* name)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *name; name++)
+    {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h;
+}
+
+void ChildNameIndex::add(Node* n)
+{
+    n->childname_hash = hash(n->displayname());
+    mChildren.emplace(n->childname_hash, n);
+}
+
+void ChildNameIndex::remove(Node* n)
+{
+    auto range = mChildren.equal_range(n->childname_hash);
+    for (auto it = range.first; it != range.second; it++)
+    {
+        if (it->second == n)
+        {
+            mChildren.erase(it);
+            return;
+        }
+    }
+}
+
+void ChildNameIndex::find(const char* name, vector<Node*>& results) const
+{
+    auto range = mChildren.equal_range(hash(name));
+    for (auto it = range.first; it != range.second; it++)
+    {
+        if (!strcmp(name, it->second->displayname()))
+        {
+            results.push_back(it->second);
+        }
+    }
+}
+
 // update node key and decrypt attributes
 void Node::setkey(const byte* newkey)
 {
@@ -219,10 +389,42 @@ void Node::setkey(const byte* newkey)
     setattr();
 }
 
+// fixed part of a RECORD_V2 node record, followed by the node key, the file
+// attribute string, the share key and shares, the attributes, the public link
+// (if EXPORTED) and expansion flags
+#pragma pack(push,1)
+struct NodeRecordHeader
+{
+    enum
+    {
+        EXPORTED = 1,
+        TAKENDOWN = 2,
+        NAMES_NORMALIZED = 4
+    };
+
+    int64_t marker;
+    int64_t size;
+    handle nodehandle;
+    handle parenthandle;
+    handle owner;
+    int64_t ctime;
+    int8_t type;
+    uint8_t flags;
+    int16_t numshares;
+    uint16_t keylen;
+    uint16_t fileattrlen;
+};
+#pragma pack(pop)
+
 // parse serialized node and return Node object - updates nodes hash and parent
 // mismatch vector
 Node* Node::unserialize(MegaClient* client, string* d, node_vector* dp)
 {
+    if (d->size() >= sizeof(NodeRecordHeader) && MemAccess::get<int64_t>(d->data()) == RECORD_V2)
+    {
+        return unserializerecord(client, d->data(), d->data() + d->size(), dp);
+    }
+
     handle h, ph;
     nodetype_t t;
     m_off_t s;
@@ -413,9 +615,15 @@ Node* Node::unserialize(MegaClient* client, string* d, node_vector* dp)
         plink = new PublicLink(ph, cts, ets, takendown);
     }
     n->plink = plink;
+    if (plink)
+    {
+        client->indexsharing(n);
+    }
 
     n->setfingerprint();
 
+    client->mNodeNameIndex.update(n);
+
     if (ptr == end)
     {
         return n;
@@ -427,9 +635,253 @@ Node* Node::unserialize(MegaClient* client, string* d, node_vector* dp)
     }
 }
 
+// read everything after the header of a RECORD_V2 record into n
+static bool readrecordbody(Node* n, const NodeRecordHeader& header, const char* ptr, const char* end)
+{
+    MegaClient* client = n->client;
+    nodetype_t t = n->type;
+
+    const char* k = ptr;
+    const char* fa = k + header.keylen;
+    ptr = fa + header.fileattrlen;
+
+    const byte* skey = NULL;
+    if (header.numshares)
+    {
+        skey = (const byte*)ptr;
+        ptr += SymmCipher::KEYLENGTH;
+    }
+
+    if (ptr > end || !header.fileattrlen || fa[header.fileattrlen - 1]
+            || header.keylen != ((t == FILENODE) ? FILENODEKEYLENGTH : (t == FOLDERNODE) ? FOLDERNODEKEYLENGTH : 0))
+    {
+        return false;
+    }
+
+    n->fileattrstring.assign(fa, header.fileattrlen - 1);
+
+    if (header.keylen)
+    {
+        n->setkey((const byte*)k);
+    }
+
+    short numshares = header.numshares;
+    if (numshares)
+    {
+        // read inshare, outshares, or pending shares
+        while (Share::unserialize(client,
+                                  (numshares > 0) ? -1 : 0,
+                                  header.nodehandle, skey, &ptr, end)
+               && numshares > 0
+               && --numshares);
+    }
+
+    attr_map::iterator it;
+    ptr = n->attrs.unserialize(ptr, end);
+    if (!ptr)
+    {
+        return false;
+    }
+
+    if (!(header.flags & NodeRecordHeader::NAMES_NORMALIZED)
+            && (it = n->attrs.map.find('n')) != n->attrs.map.end())
+    {
+        client->fsaccess->normalize(&(it->second));
+    }
+
+    if (header.flags & NodeRecordHeader::EXPORTED)
+    {
+        handle ph;
+        m_time_t ets, cts;
+
+        if (ptr + sizeof ph + sizeof ets + sizeof cts > end)
+        {
+            return false;
+        }
+
+        ph = MemAccess::get<handle>(ptr);
+        ptr += sizeof ph;
+        ets = MemAccess::get<m_time_t>(ptr);
+        ptr += sizeof ets;
+        cts = MemAccess::get<m_time_t>(ptr);
+        ptr += sizeof cts;
+
+        n->plink = new PublicLink(ph, cts, ets, header.flags & NodeRecordHeader::TAKENDOWN);
+        client->indexsharing(n);
+    }
+
+    // expansion flags (see CacheableWriter::serializeexpansionflags), none in use yet
+    static const char noexpansion[8] = { 0 };
+    if (end - ptr != sizeof noexpansion || memcmp(ptr, noexpansion, sizeof noexpansion))
+    {
+        return false;
+    }
+
+    n->setfingerprint();
+
+    client->mNodeNameIndex.update(n);
+
+    return true;
+}
+
+// read a RECORD_V2 record directly from the buffer
+Node* Node::unserializerecord(MegaClient* client, const char* ptr, const char* end, node_vector* dp)
+{
+    NodeRecordHeader header;
+    memcpy(&header, ptr, sizeof header);
+    ptr += sizeof header;
+
+    nodetype_t t = (nodetype_t)header.type;
+    if (t < FILENODE || t > RUBBISHNODE)
+    {
+        return NULL;
+    }
+
+    Node* n = new Node(client, dp, header.nodehandle, header.parenthandle, t, header.size, header.owner, NULL, header.ctime);
+
+    // in lazy mode, only the skeleton of plain nodes is kept in memory; shared and
+    // exported nodes are needed in full by the share and public link bookkeeping
+    if (client->lazynodeloading && !client->mNodeNameIndex.isenabled()
+            && !header.numshares && !(header.flags & NodeRecordHeader::EXPORTED))
+    {
+        n->lazy = true;
+        client->lazynodecount++;
+        return n;
+    }
+
+    if (!readrecordbody(n, header, ptr, end))
+    {
+        delete n;
+        return NULL;
+    }
+
+    return n;
+}
+
+size_t Node::memoryusage() const
+{
+    size_t bytes = sizeof(Node) + MemoryUsage::of(nodekey) + MemoryUsage::of(fileattrstring)
+                 + MemoryUsage::vector(attrs.map) + MemoryUsage::list(children) + MemoryUsage::of(cachedpath);
+
+    if (childnameindex)
+    {
+        bytes += sizeof(ChildNameIndex) + childnameindex->memoryusage();
+    }
+
+    for (attr_map::const_iterator it = attrs.map.begin(); it != attrs.map.end(); it++)
+    {
+        bytes += MemoryUsage::of(it->second);
+    }
+
+    if (attrstring)
+    {
+        bytes += sizeof(string) + MemoryUsage::of(*attrstring);
+    }
+
+    if (sharekey)
+    {
+        bytes += sizeof(SymmCipher);
+    }
+
+    if (inshare)
+    {
+        bytes += sizeof(Share);
+    }
+
+    for (share_map* shares : { outshares, pendingshares })
+    {
+        if (shares)
+        {
+            bytes += sizeof(share_map) + MemoryUsage::tree(*shares) + shares->size() * sizeof(Share);
+        }
+    }
+
+    if (plink)
+    {
+        bytes += sizeof(PublicLink);
+    }
+
+    return bytes;
+}
+
+// read the key, attributes and file attributes of a lazy node from its record
+bool Node::loadrecord()
+{
+    if (!lazy)
+    {
+        return true;
+    }
+
+    string data;
+    if (!client->sctable || !dbid || !client->sctable->get(dbid, &data, &client->key)
+            || data.size() < sizeof(NodeRecordHeader))
+    {
+        lazy = false;
+        client->lazynodecount--;
+        LOG_err << "Failed to load node " << Base64Str<MegaClient::NODEHANDLE>(nodehandle) << " from the local cache";
+        return false;
+    }
+
+    return loadrecord(data);
+}
+
+bool Node::loadrecord(const string& data)
+{
+    if (!lazy)
+    {
+        return true;
+    }
+
+    lazy = false;
+    client->lazynodecount--;
+
+    NodeRecordHeader header;
+    if (data.size() < sizeof header)
+    {
+        LOG_err << "Corrupt cache record for node " << Base64Str<MegaClient::NODEHANDLE>(nodehandle);
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof header);
+
+    if (header.marker != RECORD_V2 || header.nodehandle != nodehandle
+            || !readrecordbody(this, header, data.data() + sizeof header, data.data() + data.size()))
+    {
+        LOG_err << "Corrupt cache record for node " << Base64Str<MegaClient::NODEHANDLE>(nodehandle);
+        return false;
+    }
+
+    return true;
+}
+
+handle Node::recordhandle(const string& data)
+{
+    NodeRecordHeader header;
+    if (data.size() < sizeof header)
+    {
+        return UNDEF;
+    }
+
+    memcpy(&header, data.data(), sizeof header);
+    return header.marker == RECORD_V2 ? header.nodehandle : UNDEF;
+}
+
+// parent handle to index the node's record under in the local cache
+bool Node::dbparent(handle* h) const
+{
+    *h = parent ? parent->nodehandle : parenthandle;
+    return true;
+}
+
 // serialize node - nodes with pending or RSA keys are unsupported
 bool Node::serialize(string* d)
 {
+    // the record in the cache is the only copy of a lazy node's attributes
+    if (!loadrecord())
+    {
+        return false;
+    }
+
     // do not serialize encrypted nodes
     if (attrstring)
     {
@@ -469,50 +921,7 @@ bool Node::serialize(string* d)
             }
     }
 
-    unsigned short ll;
     short numshares;
-    m_off_t s;
-
-    s = type ? -type : size;
-
-    d->append((char*)&s, sizeof s);
-
-    d->append((char*)&nodehandle, MegaClient::NODEHANDLE);
-
-    if (parent)
-    {
-        d->append((char*)&parent->nodehandle, MegaClient::NODEHANDLE);
-    }
-    else
-    {
-        d->append("\0\0\0\0\0", MegaClient::NODEHANDLE);
-    }
-
-    d->append((char*)&owner, MegaClient::USERHANDLE);
-
-    // FIXME: use Serialize64
-    time_t ts = 0;  // we don't want to break backward compatibiltiy by changing the size (where m_time_t differs)
-    d->append((char*)&ts, sizeof(ts));
-
-    ts = (time_t)ctime; 
-    d->append((char*)&ts, sizeof(ts));
-
-    d->append(nodekey);
-
-    if (type == FILENODE)
-    {
-        ll = (short)fileattrstring.size() + 1;
-        d->append((char*)&ll, sizeof ll);
-        d->append(fileattrstring.c_str(), ll);
-    }
-
-    char isExported = plink ? 1 : 0;
-    d->append((char*)&isExported, 1);
-
-    char hasLinkCreationTs = plink ? 1 : 0;
-    d->append((char*)&hasLinkCreationTs, 1);
-
-    d->append("\0\0\0\0\0", 6);
 
     if (inshare)
     {
@@ -531,7 +940,47 @@ bool Node::serialize(string* d)
         }
     }
 
-    d->append((char*)&numshares, sizeof numshares);
+    // store names in their current normalized form, so they don't need to be
+    // normalized again on every load (the node itself is left as it is)
+    const AttrMap* recordattrs = &attrs;
+    AttrMap normalizedattrs;
+    attr_map::const_iterator it = attrs.map.find('n');
+    if (it != attrs.map.end())
+    {
+        string name = it->second;
+        client->fsaccess->normalize(&name);
+        if (name != it->second)
+        {
+            normalizedattrs = attrs;
+            normalizedattrs.map['n'] = name;
+            recordattrs = &normalizedattrs;
+        }
+    }
+
+    NodeRecordHeader header;
+    header.marker = RECORD_V2;
+    header.size = size;
+    header.nodehandle = nodehandle;
+    header.parenthandle = parent ? parent->nodehandle : UNDEF;
+    header.owner = owner;
+    header.ctime = ctime;
+    header.type = (int8_t)type;
+    header.flags = NodeRecordHeader::NAMES_NORMALIZED;
+    if (plink)
+    {
+        header.flags |= NodeRecordHeader::EXPORTED;
+        if (plink->takendown)
+        {
+            header.flags |= NodeRecordHeader::TAKENDOWN;
+        }
+    }
+    header.numshares = numshares;
+    header.keylen = (uint16_t)nodekey.size();
+    header.fileattrlen = (uint16_t)(fileattrstring.size() + 1);
+
+    d->append((const char*)&header, sizeof header);
+    d->append(nodekey);
+    d->append(fileattrstring.c_str(), header.fileattrlen);   // including the terminator
 
     if (numshares)
     {
@@ -560,19 +1009,18 @@ bool Node::serialize(string* d)
         }
     }
 
-    attrs.serialize(d);
+    recordattrs->serialize(d);
 
-    if (isExported)
+    if (plink)
     {
-        d->append((char*) &plink->ph, MegaClient::NODEHANDLE);
-        d->append((char*) &plink->ets, sizeof(plink->ets));
-        d->append((char*) &plink->takendown, sizeof(plink->takendown));
-        if (hasLinkCreationTs)
-        {
-            d->append((char*) &plink->cts, sizeof(plink->cts));
-        }
+        d->append((char*)&plink->ph, sizeof plink->ph);
+        d->append((char*)&plink->ets, sizeof plink->ets);
+        d->append((char*)&plink->cts, sizeof plink->cts);
     }
 
+    CacheableWriter w(*d);
+    w.serializeexpansionflags();
+
     return true;
 }
 
@@ -672,6 +1120,8 @@ void Node::parseattr(byte *bufattr, AttrMap &attrs, m_off_t size, m_time_t &mtim
 // return temporary SymmCipher for this nodekey
 SymmCipher* Node::nodecipher()
 {
+    materialize();
+
     if (client->tmpnodecipher.setkey(&nodekey))
     {
         return &client->tmpnodecipher;
@@ -683,34 +1133,57 @@ SymmCipher* Node::nodecipher()
 // decrypt attributes and build attribute hash
 void Node::setattr()
 {
-    byte* buf;
     SymmCipher* cipher;
 
-    if (attrstring && (cipher = nodecipher()) && (buf = decryptattr(cipher, attrstring->c_str(), attrstring->size())))
+    if (attrstring && (cipher = nodecipher()) && decryptattrs(cipher, attrstring, &attrs))
     {
-        JSON json;
-        nameid name;
-        string* t;
+        attrsdecrypted();
+    }
+}
 
-        attrs.map.clear();
-        json.begin((char*)buf + 5);
+bool Node::decryptattrs(SymmCipher* cipher, const string* attrstring, AttrMap* attrs)
+{
+    byte* buf = decryptattr(cipher, attrstring->c_str(), attrstring->size());
+    if (!buf)
+    {
+        return false;
+    }
 
-        while ((name = json.getnameid()) != EOO && json.storeobject((t = &attrs.map[name])))
-        {
-            JSON::unescape(t);
+    JSON json;
+    nameid name;
+    string* t;
 
-            if (name == 'n')
-            {
-                client->fsaccess->normalize(t);
-            }
-        }
+    attrs->map.clear();
+    json.begin((char*)buf + 5);
 
-        setfingerprint();
+    while ((name = json.getnameid()) != EOO && json.storeobject((t = &attrs->map[name])))
+    {
+        JSON::unescape(t);
+    }
 
-        delete[] buf;
+    delete[] buf;
+    return true;
+}
 
-        delete attrstring;
-        attrstring = NULL;
+void Node::attrsdecrypted()
+{
+    attr_map::iterator it = attrs.map.find('n');
+    if (it != attrs.map.end())
+    {
+        client->fsaccess->normalize(&it->second);
+    }
+
+    setfingerprint();
+
+    delete attrstring;
+    attrstring = NULL;
+
+    client->mNodeNameIndex.update(this);
+    namechanged();
+
+    if (parent)
+    {
+        parent->childrenchanged();
     }
 }
 
@@ -747,6 +1220,8 @@ void Node::setfingerprint()
 // return file/folder name or special status strings
 const char* Node::displayname() const
 {
+    materialize();
+
     // not yet decrypted
     if (attrstring)
     {
@@ -797,66 +1272,93 @@ const char* Node::displayname() const
 string Node::displaypath() const
 {
     // factored from nearly identical functions in megapi_impl and megacli
-    string path;
-    const Node* n = this;
-    for (; n; n = n->parent)
+    return type == ROOTNODE ? "/" : pathprefix();
+}
+
+string Node::pathprefix() const
+{
+    if (type == FILENODE || type == TYPE_UNKNOWN)
     {
-        switch (n->type)
+        // not cached: file versions are the only children of files
+        string path = parent ? parent->pathprefix() : string();
+        return path.append("/").append(displayname());
+    }
+
+    if (cachedpathgeneration != client->pathgeneration)
+    {
+        switch (type)
         {
         case FOLDERNODE:
-            path.insert(0, n->displayname());
-
-            if (n->inshare)
+            if (inshare)
             {
-                path.insert(0, ":");
-                if (n->inshare->user)
-                {
-                    path.insert(0, n->inshare->user->email);
-                }
-                else
-                {
-                    path.insert(0, "UNKNOWN");
-                }
-                return path;
+                cachedpath = inshare->user ? inshare->user->email : "UNKNOWN";
+                cachedpath.append(":");
             }
+            else
+            {
+                cachedpath = parent ? parent->pathprefix() : string();
+                cachedpath.append("/");
+            }
+            cachedpath.append(displayname());
             break;
 
         case INCOMINGNODE:
-            path.insert(0, "//in");
-            return path;
-
-        case ROOTNODE:
-            return path.empty() ? "/" : path;
+            cachedpath = "//in";
+            break;
 
         case RUBBISHNODE:
-            path.insert(0, "//bin");
-            return path;
+            cachedpath = "//bin";
+            break;
 
-        case TYPE_UNKNOWN:
-        case FILENODE:
-            path.insert(0, n->displayname());
+        default:
+            cachedpath.clear();
         }
-        path.insert(0, "/");
+
+        cachedpathgeneration = client->pathgeneration;
     }
-    return path;
+
+    return cachedpath;
 }
 
 // returns position of file attribute or 0 if not present
 int Node::hasfileattribute(fatype t) const
 {
+    materialize();
     return Node::hasfileattribute(&fileattrstring, t);
 }
 
-int Node::hasfileattribute(const string *fileattrstring, fatype t)
-{
-    char buf[24];
+int Node::hasfileattribute(const string *fileattrstring, fatype t)
+{
+    char buf[24];
+
+    sprintf(buf, ":%u*", t);
+    return static_cast<int>(fileattrstring->find(buf) + 1);
+}
+
+// attempt to apply node key - sets nodekey to a raw key if successful
+bool Node::applykey()
+{
+    const char* k;
+    SymmCipher* sc;
+
+    if (!findkey(&k, &sc))
+    {
+        return false;
+    }
+
+    int keylength = (type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+    byte key[FILENODEKEYLENGTH];
+
+    if (client->decryptkey(k, key, keylength, sc, 0, nodehandle))
+    {
+        nodekey.assign((const char*)key, keylength);
+        setattr();
+    }
 
-    sprintf(buf, ":%u*", t);
-    return static_cast<int>(fileattrstring->find(buf) + 1);
+    return true;
 }
 
-// attempt to apply node key - sets nodekey to a raw key if successful
-bool Node::applykey()
+bool Node::findkey(const char** keystring, SymmCipher** keycipher)
 {
     unsigned int keylength = (type == FILENODE)
                    ? FILENODEKEYLENGTH + 0
@@ -915,6 +1417,7 @@ bool Node::applykey()
 
                 // this key will be rewritten when the node leaves the outbound share
                 foreignkey = true;
+                client->foreignkeynodes[h].insert(nodehandle);
             }
         }
 
@@ -936,24 +1439,14 @@ bool Node::applykey()
         }
     }
 
-    byte key[FILENODEKEYLENGTH];
-
-    if (client->decryptkey(k, key, keylength, sc, 0, nodehandle))
-    {
-        nodekey.assign((const char*)key, keylength);
-        setattr();
-    }
-
+    *keystring = k;
+    *keycipher = sc;
     return true;
 }
 
-NodeCounter Node::subnodeCounts() const
+NodeCounter Node::owncounts() const
 {
     NodeCounter nc;
-    for (Node *child : children)
-    {
-        nc += child->subnodeCounts();
-    }
     if (type == FILENODE)
     {
         nc.files += 1;
@@ -979,46 +1472,61 @@ bool Node::setparent(Node* p)
         return false;
     }
 
-    NodeCounter nc;
-    bool gotnc = false;
-
     Node *originalancestor = firstancestor();
     handle oah = originalancestor->nodehandle;
     if (oah == client->rootnodes[0] || oah == client->rootnodes[1] || oah == client->rootnodes[2] || originalancestor->inshare)
     {
-        nc = subnodeCounts();
-        gotnc = true;
-
         // nodes moving from cloud drive to rubbish for example, or between inshares from the same user.
-        client->mNodeCounters[oah] -= nc;
+        client->mNodeCounters[oah] -= subtreecounts;
     }
 
     if (parent)
     {
         parent->children.erase(child_it);
+        parent->childrenchanged();
+        if (parent->childnameindex)
+        {
+            parent->childnameindex->remove(this);
+        }
+
+        for (Node* a = parent; a; a = a->parent)
+        {
+            a->subtreecounts -= subtreecounts;
+        }
     }
 
+    // a file stops or starts being a version depending on its new parent
+    subtreecounts -= owncounts();
+
 #ifdef ENABLE_SYNC
     Node *oldparent = parent;
 #endif
 
     parent = p;
+    pathchanged();
+
+    subtreecounts += owncounts();
 
     if (parent)
     {
         child_it = parent->children.insert(parent->children.end(), this);
+        parent->childrenchanged();
+        if (parent->childnameindex)
+        {
+            parent->childnameindex->add(this);
+        }
+
+        for (Node* a = parent; a; a = a->parent)
+        {
+            a->subtreecounts += subtreecounts;
+        }
     }
 
     Node* newancestor = firstancestor();
     handle nah = newancestor->nodehandle;
     if (nah == client->rootnodes[0] || nah == client->rootnodes[1] || nah == client->rootnodes[2] || newancestor->inshare)
     {
-        if (!gotnc)
-        {
-            nc = subnodeCounts();
-        }
-
-        client->mNodeCounters[nah] += nc;
+        client->mNodeCounters[nah] += subtreecounts;
     }
 
 #ifdef ENABLE_SYNC
@@ -1088,6 +1596,7 @@ void Node::setpubliclink(handle ph, m_time_t cts, m_time_t ets, bool takendown)
     if (!plink) // creation
     {
         plink = new PublicLink(ph, cts, ets, takendown);
+        client->indexsharing(this);
     }
     else            // update
     {
@@ -1137,6 +1646,16 @@ bool PublicLink::isExpired()
 }
 
 #ifdef ENABLE_SYNC
+// (re)insert this node into the client's path index under its parent; a
+// previous entry for the same name may still point to the displaced node's name
+void LocalNode::indexchild(bool shortname)
+{
+    LocalNodeKey key = { parent, shortname ? slocalname : &localname, shortname };
+
+    sync->client->localnodeindex.erase(key);
+    sync->client->localnodeindex[key] = this;
+}
+
 // set, change or remove LocalNode's parent and name/localname/slocalname.
 // newlocalpath must be a full path and must not point to an empty string.
 // no shortname allowed as the last path component.
@@ -1158,10 +1677,12 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
     {
         // remove existing child linkage
         parent->children.erase(&localname);
+        sync->client->localnodeindex.erase({ parent, &localname, false });
 
         if (slocalname)
         {
             parent->schildren.erase(slocalname);
+            sync->client->localnodeindex.erase({ parent, slocalname, true });
             delete slocalname;
             slocalname = NULL;
         }
@@ -1190,8 +1711,7 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
             // set new name
             localname.assign(newlocalpath->data() + p, newlocalpath->size() - p);
 
-            name = localname;
-            sync->client->fsaccess->local2name(&name);
+            name = sync->localname2name(localname);
 
             if (node)
             {
@@ -1270,6 +1790,7 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
 
         // (we don't construct a UTF-8 or sname for the root path)
         parent->children[&localname] = this;
+        indexchild(false);
 
         if (!slocalname)
         {
@@ -1278,6 +1799,7 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
         if (sync->client->fsaccess->getsname(newlocalpath, slocalname) && *slocalname != localname)
         {
             parent->schildren[slocalname] = this;
+            indexchild(true);
         }
         else
         {
@@ -1285,6 +1807,7 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
             slocalname = NULL;
         }
 
+        pathchanged();
         treestate(TREESTATE_NONE);
 
         if (todelete)
@@ -1311,6 +1834,8 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
         }
     }
 
+    pathchanged();
+
     if (newlocalpath)
     {
         LocalTreeProcUpdateTransfers tput;
@@ -1318,6 +1843,17 @@ void LocalNode::setnameparent(LocalNode* newparent, string* newlocalpath)
     }
 }
 
+void LocalNode::pathchanged()
+{
+    cachedpathgeneration = 0;
+
+    // the paths cached below this node are stale too
+    if (!children.empty())
+    {
+        sync->client->pathgeneration++;
+    }
+}
+
 // delay uploads by 1.1 s to prevent server flooding while a file is still being written
 void LocalNode::bumpnagleds()
 {
@@ -1531,6 +2067,19 @@ void LocalNode::setfsid(handle newfsid)
     }
 }
 
+size_t LocalNode::memoryusage() const
+{
+    size_t bytes = sizeof(LocalNode) + MemoryUsage::of(name) + MemoryUsage::of(localname)
+                 + MemoryUsage::of(cachedpath) + children.memoryusage() + schildren.memoryusage();
+
+    if (slocalname)
+    {
+        bytes += sizeof(string) + MemoryUsage::of(*slocalname);
+    }
+
+    return bytes;
+}
+
 LocalNode::~LocalNode()
 {
     if (!sync)
@@ -1540,6 +2089,34 @@ LocalNode::~LocalNode()
         return;
     }
 
+    // the syncs go as a whole: only the watches and the remote nodes outlive them
+    if (sync->client->tearingdown)
+    {
+        if (newnode)
+        {
+            newnode->localnode = NULL;
+        }
+
+        if (type == FOLDERNODE && sync->dirnotify.get())
+        {
+            sync->dirnotify->delnotify(this);
+        }
+
+        for (localnode_map::iterator it = children.begin(); it != children.end(); )
+        {
+            delete it++->second;
+        }
+
+        if (node)
+        {
+            node->localnode = NULL;
+        }
+
+        delete slocalname;
+        slocalname = NULL;
+        return;
+    }
+
     if (sync->state == SYNC_ACTIVE || sync->state == SYNC_INITIALSCAN)
     {
         sync->statecachedel(this);
@@ -1585,6 +2162,9 @@ LocalNode::~LocalNode()
     sync->client->totalLocalNodes--;
     sync->localnodes[type]--;
 
+    sync->client->syncdowndirty.erase(this);
+    sync->client->syncupdirty.erase(this);
+
     if (type == FILENODE && size > 0)
     {
         sync->localbytes -= size;
@@ -1639,33 +2219,30 @@ void LocalNode::getlocalpath(string* path, bool sdisable) const
         return;
     }
 
-    const LocalNode* l = this;
-
-    path->erase();
-
-    while (l)
+    // the ancestors use their short names, if available (less likely to overflow
+    // MAXPATH, perhaps faster?) - sdisable only applies to the last component
+    if (parent)
     {
-        // use short name, if available (less likely to overflow MAXPATH,
-        // perhaps faster?) and sdisable not set
-        if (!sdisable && l->slocalname)
-        {
-            path->insert(0, *(l->slocalname));
-        }
-        else
-        {
-            path->insert(0, l->localname);
-        }
+        *path = parent->cachedlocalpath();
+        path->append(sync->client->fsaccess->localseparator);
+    }
+    else
+    {
+        path->erase();
+    }
 
-        if ((l = l->parent))
-        {
-            path->insert(0, sync->client->fsaccess->localseparator);
-        }
+    path->append(!sdisable && slocalname ? *slocalname : localname);
+}
 
-        if (sdisable)
-        {
-            sdisable = false;
-        }
+const string& LocalNode::cachedlocalpath() const
+{
+    if (cachedpathgeneration != sync->client->pathgeneration)
+    {
+        getlocalpath(&cachedpath);
+        cachedpathgeneration = sync->client->pathgeneration;
     }
+
+    return cachedpath;
 }
 
 string LocalNode::localnodedisplaypath(FileSystemAccess& fsa) const
@@ -1785,6 +2362,13 @@ bool LocalNode::serialize(string* d)
 
         d->append((const char*)buf, Serialize64::serialize(buf, mtime));
     }
+    else
+    {
+        // folder mtime (absent in older records)
+        byte buf[sizeof mtime+1];
+
+        d->append((const char*)buf, Serialize64::serialize(buf, mtime));
+    }
 
     return true;
 }
@@ -1861,6 +2445,12 @@ LocalNode* LocalNode::unserialize(Sync* sync, string* d)
             return NULL;
         }
     }
+    else if (ptr < end
+             && Serialize64::unserialize((byte*)ptr, static_cast<int>(end - ptr), &mtime) < 0)
+    {
+        LOG_err << "LocalNode unserialization failed - malformed folder mtime";
+        return NULL;
+    }
 
     LocalNode* l = new LocalNode();
 
@@ -1898,7 +2488,8 @@ void Fingerprints::newnode(Node* n)
 {
     if (n->type == FILENODE)
     {
-        n->fingerprint_it = mFingerprints.end();
+        n->fingerprint_next = nullptr;
+        n->fingerprint_digest = 0;
     }
 }
 
@@ -1906,24 +2497,49 @@ void Fingerprints::add(Node* n)
 {
     if (n->type == FILENODE)
     {
-        n->fingerprint_it = mFingerprints.insert(n);
+        if (mCount >= mBuckets.size())
+        {
+            rehash(mBuckets.empty() ? 1024 : mBuckets.size() * 2);
+        }
+
+        n->fingerprint_digest = digest(n);
+        n->fingerprint_next = nullptr;
+
+        // append, so that nodebyfingerprint() keeps returning the oldest match
+        Node** link = &bucket(n->fingerprint_digest);
+        while (*link)
+        {
+            link = &(*link)->fingerprint_next;
+        }
+        *link = n;
+
+        mCount++;
         mSumSizes += n->size;
     }
 }
 
 void Fingerprints::remove(Node* n)
 {
-    if (n->type == FILENODE && n->fingerprint_it != mFingerprints.end())
+    if (n->type == FILENODE && mCount)
     {
-        mSumSizes -= n->size;
-        mFingerprints.erase(n->fingerprint_it);
-        n->fingerprint_it = mFingerprints.end();
+        for (Node** link = &bucket(n->fingerprint_digest); *link; link = &(*link)->fingerprint_next)
+        {
+            if (*link == n)
+            {
+                *link = n->fingerprint_next;
+                n->fingerprint_next = nullptr;
+                mCount--;
+                mSumSizes -= n->size;
+                return;
+            }
+        }
     }
 }
 
 void Fingerprints::clear()
 {
-    mFingerprints.clear();
+    mBuckets.clear();
+    mCount = 0;
     mSumSizes = 0;
 }
 
@@ -1932,21 +2548,271 @@ m_off_t Fingerprints::getSumSizes()
     return mSumSizes;
 }
 
+size_t Fingerprints::memoryusage() const
+{
+    return MemoryUsage::vector(mBuckets);
+}
+
 Node* Fingerprints::nodebyfingerprint(FileFingerprint* fingerprint)
 {
-    fingerprint_set::iterator it = mFingerprints.find(fingerprint);
-    return it == mFingerprints.end() ? nullptr : static_cast<Node*>(*it);
+    if (mCount)
+    {
+        for (Node* n = bucket(digest(fingerprint)); n; n = n->fingerprint_next)
+        {
+            if (samefingerprint(n, fingerprint))
+            {
+                return n;
+            }
+        }
+    }
+    return nullptr;
 }
 
 node_vector *Fingerprints::nodesbyfingerprint(FileFingerprint* fingerprint)
 {
     node_vector *nodes = new node_vector();
-    auto p = mFingerprints.equal_range(fingerprint);
-    for (iterator it = p.first; it != p.second; ++it)
+    if (mCount)
     {
-        nodes->push_back(static_cast<Node*>(*it));
+        for (Node* n = bucket(digest(fingerprint)); n; n = n->fingerprint_next)
+        {
+            if (samefingerprint(n, fingerprint))
+            {
+                nodes->push_back(n);
+            }
+        }
     }
     return nodes;
 }
 
+uint64_t Fingerprints::digest(const FileFingerprint* fingerprint)
+{
+    uint64_t h = uint64_t(fingerprint->size) * 0x9e3779b97f4a7c15ULL;
+    h ^= uint64_t(fingerprint->mtime) + 0x632be59bd9b4e019ULL + (h << 6) + (h >> 2);
+    for (int32_t c : fingerprint->crc)
+    {
+        h ^= uint64_t(uint32_t(c)) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool Fingerprints::samefingerprint(const FileFingerprint* a, const FileFingerprint* b)
+{
+    // same equivalence as FileFingerprintCmp
+    return a->size == b->size && a->mtime == b->mtime && !memcmp(a->crc, b->crc, sizeof a->crc);
+}
+
+void Fingerprints::rehash(size_t buckets)
+{
+    vector<Node*> old(buckets, nullptr);
+    old.swap(mBuckets);
+
+    // walking each old chain in order and appending keeps insertion order per fingerprint
+    vector<Node*> tails(buckets, nullptr);
+    for (Node* n : old)
+    {
+        while (n)
+        {
+            Node* next = n->fingerprint_next;
+            size_t i = size_t(n->fingerprint_digest) & (buckets - 1);
+            n->fingerprint_next = nullptr;
+            if (tails[i])
+            {
+                tails[i]->fingerprint_next = n;
+            }
+            else
+            {
+                mBuckets[i] = n;
+            }
+            tails[i] = n;
+            n = next;
+        }
+    }
+}
+
+void NodeNameIndex::setenabled(bool enable)
+{
+    if (!enable)
+    {
+        clear();
+    }
+    mEnabled = enable;
+}
+
+string NodeNameIndex::foldname(const char* name)
+{
+    string folded(name);
+    for (string::iterator it = folded.begin(); it != folded.end(); it++)
+    {
+        *it = static_cast<char>(tolower(static_cast<unsigned char>(*it)));
+    }
+    return folded;
+}
+
+void NodeNameIndex::trigrams(const string& name, vector<uint32_t>& t)
+{
+    t.clear();
+    for (size_t i = 0; i + 3 <= name.size(); i++)
+    {
+        t.push_back((uint32_t(static_cast<unsigned char>(name[i])) << 16)
+                  | (uint32_t(static_cast<unsigned char>(name[i + 1])) << 8)
+                  |  uint32_t(static_cast<unsigned char>(name[i + 2])));
+    }
+    std::sort(t.begin(), t.end());
+    t.erase(std::unique(t.begin(), t.end()), t.end());
+}
+
+void NodeNameIndex::add(Node* n, string&& name)
+{
+    uint32_t slot = uint32_t(mEntries.size());
+
+    // slots only grow until the next compact(), so posting lists stay sorted
+    vector<uint32_t> t;
+    trigrams(name, t);
+    for (vector<uint32_t>::iterator it = t.begin(); it != t.end(); it++)
+    {
+        mTrigrams[*it].push_back(slot);
+    }
+
+    mEntries.push_back(Entry{ n, std::move(name) });
+    n->nameindex_slot = slot;
+}
+
+void NodeNameIndex::update(Node* n)
+{
+    if (!mEnabled || n->type > FOLDERNODE)
+    {
+        return;
+    }
+
+    string name = foldname(n->displayname());
+
+    if (n->nameindex_slot != NOSLOT)
+    {
+        if (mEntries[n->nameindex_slot].name == name)
+        {
+            return;
+        }
+
+        remove(n);
+    }
+
+    add(n, std::move(name));
+}
+
+void NodeNameIndex::remove(Node* n)
+{
+    if (n->nameindex_slot == NOSLOT)
+    {
+        return;
+    }
+
+    Entry& e = mEntries[n->nameindex_slot];
+    e.node = NULL;
+    e.name.clear();
+    n->nameindex_slot = NOSLOT;
+
+    if (++mTombstones > 1024 && mTombstones > mEntries.size() / 2)
+    {
+        compact();
+    }
+}
+
+void NodeNameIndex::compact()
+{
+    vector<Entry> entries;
+    entries.swap(mEntries);
+    mTrigrams.clear();
+    mTombstones = 0;
+
+    for (vector<Entry>::iterator it = entries.begin(); it != entries.end(); it++)
+    {
+        if (it->node)
+        {
+            add(it->node, std::move(it->name));
+        }
+    }
+}
+
+size_t NodeNameIndex::memoryusage() const
+{
+    size_t bytes = MemoryUsage::vector(mEntries) + MemoryUsage::tree(mTrigrams);
+
+    for (vector<Entry>::const_iterator it = mEntries.begin(); it != mEntries.end(); it++)
+    {
+        bytes += MemoryUsage::of(it->name);
+    }
+
+    for (std::map<uint32_t, vector<uint32_t>>::const_iterator it = mTrigrams.begin(); it != mTrigrams.end(); it++)
+    {
+        bytes += MemoryUsage::vector(it->second);
+    }
+
+    return bytes;
+}
+
+void NodeNameIndex::clear()
+{
+    for (vector<Entry>::iterator it = mEntries.begin(); it != mEntries.end(); it++)
+    {
+        if (it->node)
+        {
+            it->node->nameindex_slot = NOSLOT;
+        }
+    }
+
+    mEntries.clear();
+    mTrigrams.clear();
+    mTombstones = 0;
+}
+
+void NodeNameIndex::search(const char* searchString, node_vector& results) const
+{
+    string needle = foldname(searchString);
+
+    vector<uint32_t> t;
+    trigrams(needle, t);
+
+    if (t.empty())
+    {
+        // too short for the trigram index: scan the flat table instead of the tree
+        for (vector<Entry>::const_iterator it = mEntries.begin(); it != mEntries.end(); it++)
+        {
+            if (it->node && it->name.find(needle) != string::npos)
+            {
+                results.push_back(it->node);
+            }
+        }
+        return;
+    }
+
+    // every match must be in all posting lists: verify the candidates of the shortest one
+    const vector<uint32_t>* candidates = NULL;
+    for (vector<uint32_t>::iterator it = t.begin(); it != t.end(); it++)
+    {
+        std::map<uint32_t, vector<uint32_t>>::const_iterator pit = mTrigrams.find(*it);
+        if (pit == mTrigrams.end())
+        {
+            return;
+        }
+
+        if (!candidates || pit->second.size() < candidates->size())
+        {
+            candidates = &pit->second;
+        }
+    }
+
+    for (vector<uint32_t>::const_iterator it = candidates->begin(); it != candidates->end(); it++)
+    {
+        const Entry& e = mEntries[*it];
+        if (e.node && e.name.find(needle) != string::npos)
+        {
+            results.push_back(e.node);
+        }
+    }
+}
+
 } // namespace
@@ -135,4 +135,96 @@ void getOSXproxy(Proxy* proxy)
     }
     CFRelease(proxySettings);
 }
+
+struct FsEventStream
+{
+    FSEventStreamRef stream;
+    dispatch_queue_t queue;
+    std::function<void(vector<string>&, bool)> callback;
+};
+
+static void fsEventStreamCallback(ConstFSEventStreamRef, void* info, size_t count, void* eventPaths,
+                                  const FSEventStreamEventFlags flags[], const FSEventStreamEventId[])
+{
+    FsEventStream* s = (FsEventStream*)info;
+    char** paths = (char**)eventPaths;
+    vector<string> changed;
+    bool rescan = false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (flags[i] & (kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagUserDropped
+                        | kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagRootChanged))
+        {
+            rescan = true;
+        }
+
+        if (!(flags[i] & kFSEventStreamEventFlagHistoryDone))
+        {
+            changed.push_back(paths[i]);
+        }
+    }
+
+    s->callback(changed, rescan);
+}
+
+static void fsEventStreamDrained(void*)
+{
+}
+
+FsEventStream* startFsEventStream(const string& path, std::function<void(vector<string>&, bool)> callback)
+{
+    CFStringRef cfpath = CFStringCreateWithCString(NULL, path.c_str(), kCFStringEncodingUTF8);
+    if (!cfpath)
+    {
+        return NULL;
+    }
+    CFArrayRef cfpaths = CFArrayCreate(NULL, (const void**)&cfpath, 1, &kCFTypeArrayCallBacks);
+    CFRelease(cfpath);
+
+    FsEventStream* s = new FsEventStream;
+    s->callback = std::move(callback);
+
+    FSEventStreamContext context = { 0, s, NULL, NULL, NULL };
+
+    // per-file events, delivered without coalescing delay
+    s->stream = FSEventStreamCreate(NULL, fsEventStreamCallback, &context, cfpaths,
+                                    kFSEventStreamEventIdSinceNow, 0.05,
+                                    kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer
+                                    | kFSEventStreamCreateFlagWatchRoot);
+    CFRelease(cfpaths);
+
+    if (!s->stream)
+    {
+        delete s;
+        return NULL;
+    }
+
+    s->queue = dispatch_queue_create("mega.fseventstream", DISPATCH_QUEUE_SERIAL);
+    FSEventStreamSetDispatchQueue(s->stream, s->queue);
+
+    if (!FSEventStreamStart(s->stream))
+    {
+        LOG_err << "Unable to start the FSEvents stream of " << path;
+        stopFsEventStream(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+void stopFsEventStream(FsEventStream* s)
+{
+    FSEventStreamStop(s->stream);
+    FSEventStreamInvalidate(s->stream);
+    FSEventStreamRelease(s->stream);
+
+    // no callback runs after this
+    dispatch_sync_f(s->queue, NULL, fsEventStreamDrained);
+#if !__has_feature(objc_arc)
+    dispatch_release(s->queue);
+#endif
+
+    delete s;
+}
 #endif
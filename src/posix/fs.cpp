@@ -26,6 +26,7 @@
 #include "mega.h"
 #include <sys/utsname.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #ifdef TARGET_OS_MAC
 #include "mega/osx/osxutils.h"
 #endif
@@ -39,6 +40,39 @@ extern JavaVM *MEGAjvm;
 #include <uuid/uuid.h>
 #endif
 
+// copies share the extents of their source where the file system can (Btrfs,
+// XFS, APFS...): FICLONE and copy_file_range() on Linux, clonefile() on Apple
+#if defined(__linux__) && !defined(MEGA_NO_REFLINK)
+#include <sys/syscall.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#define MEGA_FICLONE 1
+#elif defined(__APPLE__) && !defined(MEGA_NO_REFLINK) && defined(__has_include)
+#if __has_include(<sys/clonefile.h>)
+#include <sys/clonefile.h>
+#define MEGA_CLONEFILE 1
+#endif
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// async file operations go through an io_uring where the kernel has one
+// (Linux 5.1), without liburing: the raw interface is small enough
+#if defined(HAVE_AIO_RT) && defined(__linux__) && !defined(MEGA_NO_IOURING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define MEGA_IOURING 1
+#endif
+#endif
+#endif
+
 namespace mega {
 using namespace std;
 
@@ -50,6 +84,7 @@ using namespace std;
 PosixAsyncIOContext::PosixAsyncIOContext() : AsyncIOContext()
 {
     aiocb = NULL;
+    uring = false;
 }
 
 PosixAsyncIOContext::~PosixAsyncIOContext()
@@ -60,7 +95,7 @@ PosixAsyncIOContext::~PosixAsyncIOContext()
 
 void PosixAsyncIOContext::finish()
 {
-    if (aiocb)
+    if (aiocb || uring)
     {
         if (!finished)
         {
@@ -69,15 +104,171 @@ void PosixAsyncIOContext::finish()
         }
         delete aiocb;
         aiocb = NULL;
+        uring = false;
     }
     assert(finished);
 }
 #endif
 
-PosixFileAccess::PosixFileAccess(Waiter *w, int defaultfilepermissions, bool followSymLinks) : FileAccess(w)
+#ifdef MEGA_IOURING
+// A single ring for the process, with a thread reaping the completions: unlike
+// aio with SIGEV_THREAD, no thread is started per operation. Submissions that
+// can't be queued (ring full, or no io_uring in the kernel) go through aio.
+class IoUring
+{
+public:
+    // NULL if the kernel doesn't support it. Never destroyed, like the thread
+    static IoUring* instance()
+    {
+        static IoUring* ring = create();
+        return ring;
+    }
+
+    bool submit(PosixAsyncIOContext* context, int fd, bool write)
+    {
+        std::lock_guard<std::mutex> g(mutex);
+
+        unsigned tail = *sqtail;
+        if (tail - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE) >= entries)
+        {
+            return false;
+        }
+
+        context->uring = true;
+        context->iov.iov_base = context->buffer;
+        context->iov.iov_len = context->len;
+
+        unsigned index = tail & *sqmask;
+        struct io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof *sqe);
+        sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->off = uint64_t(context->pos);
+        sqe->addr = uint64_t(uintptr_t(&context->iov));
+        sqe->len = 1;
+        sqe->user_data = uint64_t(uintptr_t(context));
+        sqarray[index] = index;
+        __atomic_store_n(sqtail, tail + 1, __ATOMIC_RELEASE);
+
+        // including any left by a failed enter
+        unsigned pending = tail + 1 - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE);
+
+        int r;
+        while ((r = int(syscall(__NR_io_uring_enter, ringfd, pending, 0, 0, NULL, 0))) < 0 && errno == EINTR);
+        if (r < 0)
+        {
+            // queued, and taken by the kernel with the next submission
+            LOG_warn << "io_uring submission delayed: " << errno;
+        }
+        return true;
+    }
+
+private:
+    static const unsigned ENTRIES = 128;
+
+    int ringfd;
+    unsigned entries;
+    std::mutex mutex;
+
+    unsigned* sqhead;
+    unsigned* sqtail;
+    unsigned* sqmask;
+    unsigned* sqarray;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cqhead;
+    unsigned* cqtail;
+    unsigned* cqmask;
+    struct io_uring_cqe* cqes;
+
+    static IoUring* create()
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof params);
+
+        int fd = int(syscall(__NR_io_uring_setup, ENTRIES, &params));
+        if (fd < 0)
+        {
+            LOG_debug << "io_uring not available: " << errno;
+            return NULL;
+        }
+
+        size_t sqsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+        {
+            sqsize = cqsize = std::max(sqsize, cqsize);
+        }
+
+        void* sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        void* cq = single ? sq : mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        void* sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            LOG_warn << "Unable to map the io_uring: " << errno;
+            close(fd);  // also releases the mappings made
+            return NULL;
+        }
+
+        IoUring* ring = new IoUring;
+        ring->ringfd = fd;
+        ring->entries = params.sq_entries;
+        ring->sqhead = (unsigned*)((char*)sq + params.sq_off.head);
+        ring->sqtail = (unsigned*)((char*)sq + params.sq_off.tail);
+        ring->sqmask = (unsigned*)((char*)sq + params.sq_off.ring_mask);
+        ring->sqarray = (unsigned*)((char*)sq + params.sq_off.array);
+        ring->sqes = (struct io_uring_sqe*)sqes;
+        ring->cqhead = (unsigned*)((char*)cq + params.cq_off.head);
+        ring->cqtail = (unsigned*)((char*)cq + params.cq_off.tail);
+        ring->cqmask = (unsigned*)((char*)cq + params.cq_off.ring_mask);
+        ring->cqes = (struct io_uring_cqe*)((char*)cq + params.cq_off.cqes);
+
+        std::thread(&IoUring::reap, ring).detach();
+
+        LOG_debug << "Using io_uring for async file operations";
+        return ring;
+    }
+
+    void reap()
+    {
+        for (;;)
+        {
+            if (syscall(__NR_io_uring_enter, ringfd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            {
+                LOG_err << "io_uring wait failed: " << errno;
+                usleep(100000);
+            }
+
+            unsigned head = *cqhead;
+            unsigned tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+            while (head != tail)
+            {
+                struct io_uring_cqe* cqe = &cqes[head & *cqmask];
+                PosixAsyncIOContext* context = reinterpret_cast<PosixAsyncIOContext*>(uintptr_t(cqe->user_data));
+                int res = cqe->res;
+                __atomic_store_n(cqhead, ++head, __ATOMIC_RELEASE);
+
+                if (res < 0)
+                {
+                    LOG_warn << "Async operation finished with error: " << -res;
+                }
+                PosixFileAccess::asyncopcompleted(context, res < 0 || unsigned(res) != context->len, res == -EAGAIN);
+            }
+        }
+    }
+};
+#endif
+
+PosixFileAccess::PosixFileAccess(Waiter *w, int defaultfilepermissions, bool followSymLinks, int writeoptions) : FileAccess(w)
 {
     fd = -1;
+    directfd = -1;
+    readaheadend = -1;
+    droppos = 0;
+    droplen = 0;
     this->defaultfilepermissions = defaultfilepermissions;
+    this->writeoptions = writeoptions;
 
 #ifndef HAVE_FDOPENDIR
     dp = NULL;
@@ -96,8 +287,20 @@ PosixFileAccess::~PosixFileAccess()
     }
 #endif
 
+    if (directfd >= 0)
+    {
+        close(directfd);
+    }
+
     if (fd >= 0)
     {
+#ifdef POSIX_FADV_DONTNEED
+        if (writeoptions & FileSystemAccess::FSWRITE_DROPCACHE)
+        {
+            dropwritten(0, 0);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#endif
         close(fd);
     }
 }
@@ -176,6 +379,7 @@ void PosixFileAccess::sysclose()
         close(fd);
         fd = -1;
     }
+    readaheadend = -1;
 }
 
 bool PosixFileAccess::asyncavailable()
@@ -203,24 +407,39 @@ void PosixFileAccess::asyncopfinished(sigval sigev_value)
     struct aiocb *aiocbp = context->aiocb;
     int e = aio_error(aiocbp);
     assert (e != EINPROGRESS);
-    context->retry = (e == EAGAIN);
-    context->failed = (aio_return(aiocbp) < 0);
+    bool failed = (aio_return(aiocbp) < 0);
+    if (failed)
+    {
+        LOG_warn << "Async operation finished with error: " << e;
+    }
+    asyncopcompleted(context, failed, e == EAGAIN);
+}
+
+void PosixFileAccess::asyncopcompleted(PosixAsyncIOContext* context, bool failed, bool retry)
+{
+    context->retry = retry;
+    context->failed = failed;
     if (!context->failed)
     {
         if (context->op == AsyncIOContext::READ && context->pad)
         {
-            memset((void *)(((char *)(aiocbp->aio_buf)) + aiocbp->aio_nbytes), 0, context->pad);
+            memset(context->buffer + context->len, 0, context->pad);
             LOG_verbose << "Async read finished OK";
         }
         else
         {
             LOG_verbose << "Async write finished OK";
+
+            if (context->op == AsyncIOContext::WRITE)
+            {
+                PosixFileAccess* fa = static_cast<PosixFileAccess*>(context->fa);
+                if (fa->writeoptions & FileSystemAccess::FSWRITE_DROPCACHE)
+                {
+                    fa->dropwritten(context->pos, context->len);
+                }
+            }
         }
     }
-    else
-    {
-        LOG_warn << "Async operation finished with error: " << e;
-    }
 
     asyncfscallback userCallback = context->userCallback;
     void *userData = context->userData;
@@ -269,6 +488,18 @@ void PosixFileAccess::asyncsysread(AsyncIOContext *context)
         return;
     }
 
+    advisereadahead(context->pos, context->len);
+
+#ifdef MEGA_IOURING
+    if (IoUring* ring = IoUring::instance())
+    {
+        if (ring->submit(posixContext, fd, false))
+        {
+            return;
+        }
+    }
+#endif
+
     struct aiocb *aiocbp = new struct aiocb;
     memset(aiocbp, 0, sizeof (struct aiocb));
 
@@ -318,10 +549,20 @@ void PosixFileAccess::asyncsyswrite(AsyncIOContext *context)
         return;
     }
 
+#ifdef MEGA_IOURING
+    if (IoUring* ring = IoUring::instance())
+    {
+        if (ring->submit(posixContext, writefd(posixContext->buffer, posixContext->len, posixContext->pos), true))
+        {
+            return;
+        }
+    }
+#endif
+
     struct aiocb *aiocbp = new struct aiocb;
     memset(aiocbp, 0, sizeof (struct aiocb));
 
-    aiocbp->aio_fildes = fd;
+    aiocbp->aio_fildes = writefd(posixContext->buffer, posixContext->len, posixContext->pos);
     aiocbp->aio_buf = (void *)posixContext->buffer;
     aiocbp->aio_nbytes = posixContext->len;
     aiocbp->aio_offset = posixContext->pos;
@@ -359,6 +600,7 @@ void PosixFileAccess::updatelocalname(string* name)
 bool PosixFileAccess::sysread(byte* dst, unsigned len, m_off_t pos)
 {
     retry = false;
+    advisereadahead(pos, len);
 #ifndef __ANDROID__
     return pread(fd, (char*)dst, len, pos) == len;
 #else
@@ -371,13 +613,109 @@ bool PosixFileAccess::fwrite(const byte* data, unsigned len, m_off_t pos)
 {
     retry = false;
 #ifndef __ANDROID__
-    return pwrite(fd, data, len, pos) == len;
+    if (pwrite(writefd(data, len, pos), data, len, pos) != len)
+    {
+        return false;
+    }
+
+    if (writeoptions & FileSystemAccess::FSWRITE_DROPCACHE)
+    {
+        dropwritten(pos, len);
+    }
+    return true;
 #else
     lseek64(fd, pos, SEEK_SET);
     return write(fd, data, len) == len;
 #endif
 }
 
+void PosixFileAccess::advisereadahead(m_off_t pos, unsigned len)
+{
+#ifdef POSIX_FADV_WILLNEED
+    if (size < READAHEAD_WINDOW)
+    {
+        return;
+    }
+
+    if (readaheadend < 0)
+    {
+        // a larger read-ahead of the kernel, and pages dropped sooner behind the reads
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        readaheadend = 0;
+    }
+
+    // the next window is requested once the reads are halfway through the current one
+    m_off_t end = pos + len;
+    if (end < size && end + READAHEAD_WINDOW / 2 > readaheadend)
+    {
+        m_off_t from = std::max(end, readaheadend);
+        m_off_t to = std::min(end + READAHEAD_WINDOW, size);
+        if (to > from)
+        {
+            posix_fadvise(fd, from, to - from, POSIX_FADV_WILLNEED);
+        }
+        readaheadend = to;
+    }
+#endif
+}
+
+int PosixFileAccess::writefd(const void* data, size_t len, m_off_t pos) const
+{
+    if (directfd >= 0 && !((uintptr_t(data) | len | size_t(pos)) & (DIRECTIO_ALIGNMENT - 1)))
+    {
+        return directfd;
+    }
+    return fd;
+}
+
+void PosixFileAccess::dropwritten(m_off_t pos, m_off_t len)
+{
+    std::lock_guard<std::mutex> g(dropmutex);
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (len)
+    {
+        // start the writeback of this range
+        sync_file_range(fd, pos, len, SYNC_FILE_RANGE_WRITE);
+    }
+
+    if (droplen)
+    {
+        // the previous range is clean once written back: evict it
+        sync_file_range(fd, droppos, droplen, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, droppos, droplen, POSIX_FADV_DONTNEED);
+    }
+#elif defined(POSIX_FADV_DONTNEED)
+    // no control of the writeback: pages still dirty aren't evicted
+    if (droplen)
+    {
+        posix_fadvise(fd, droppos, droplen, POSIX_FADV_DONTNEED);
+    }
+#endif
+
+    droppos = pos;
+    droplen = len;
+}
+
+bool PosixFileAccess::fpreallocate(m_off_t len)
+{
+    if (!(writeoptions & FileSystemAccess::FSWRITE_PREALLOCATE) || fd < 0 || len <= 0)
+    {
+        return false;
+    }
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    // the file keeps its size (and any data already downloaded), only the extents are reserved
+    if (!fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, len))
+    {
+        LOG_debug << "Preallocated " << len << " bytes";
+        return true;
+    }
+    LOG_warn << "Unable to preallocate " << len << " bytes: " << errno;
+#endif
+    return false;
+}
+
 int PosixFileAccess::stealFileDescriptor()
 {
     int toret = fd;
@@ -530,6 +868,22 @@ bool PosixFileAccess::fopen(string* f, bool read, bool write)
 
             FileSystemAccess::captimestamp(&mtime);
 
+#if defined(__linux__) && defined(O_DIRECT)
+            if (write && !read && (writeoptions & FileSystemAccess::FSWRITE_DIRECTIO) && type == FILENODE)
+            {
+                if (directfd >= 0)
+                {
+                    close(directfd);
+                }
+
+                // some filesystems (tmpfs) don't support it: the writes just go through fd
+                if ((directfd = open(f->c_str(), O_WRONLY | O_DIRECT)) < 0)
+                {
+                    LOG_debug << "Direct I/O not available for " << *f << ": " << errno;
+                }
+            }
+#endif
+
             return true;
         }
 
@@ -553,6 +907,7 @@ PosixFileSystemAccess::PosixFileSystemAccess(int fseventsfd)
 
     defaultfilepermissions = 0600;
     defaultfolderpermissions = 0700;
+    writeoptions = 0;
 
     localseparator = "/";
 
@@ -578,6 +933,19 @@ PosixFileSystemAccess::PosixFileSystemAccess(int fseventsfd)
     }
 #endif
 
+#ifdef MEGA_FANOTIFY
+    // unprivileged processes get the group (Linux 5.13), but can't mark
+    // filesystems: their syncs use inotify
+    if ((fanotifyfd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY)) >= 0)
+    {
+        notifyfailed = false;
+    }
+    else
+    {
+        LOG_debug << "fanotify not available. Error code: " << errno;
+    }
+#endif
+
 #ifdef __MACH__
 #if __LP64__
     typedef struct fsevent_clone_args {
@@ -638,6 +1006,7 @@ PosixFileSystemAccess::PosixFileSystemAccess(int fseventsfd)
             else
             {
                 close(notifyfd);
+                notifyfd = -1;
             }
         }
         else
@@ -645,6 +1014,11 @@ PosixFileSystemAccess::PosixFileSystemAccess(int fseventsfd)
             close(fd);
         }
     }
+
+#ifdef MEGA_FSEVENTSTREAM
+    // otherwise, each sync gets its own FSEvents stream (see PosixDirNotify::startstream)
+    notifyfailed = false;
+#endif
 #else
     (void)fseventsfd;  // suppress warning
 #endif
@@ -656,26 +1030,229 @@ PosixFileSystemAccess::~PosixFileSystemAccess()
     {
         close(notifyfd);
     }
+
+#ifdef MEGA_FANOTIFY
+    if (fanotifyfd >= 0)
+    {
+        close(fanotifyfd);
+    }
+#endif
 }
 
 // wake up from filesystem updates
 void PosixFileSystemAccess::addevents(Waiter* w, int /*flags*/)
 {
+    PosixWaiter* pw = (PosixWaiter*)w;
+
     if (notifyfd >= 0)
     {
-        PosixWaiter* pw = (PosixWaiter*)w;
-
         FD_SET(notifyfd, &pw->rfds);
         FD_SET(notifyfd, &pw->ignorefds);
 
         pw->bumpmaxfd(notifyfd);
     }
+
+#ifdef MEGA_FANOTIFY
+    if (fanotifyfd >= 0)
+    {
+        FD_SET(fanotifyfd, &pw->rfds);
+        FD_SET(fanotifyfd, &pw->ignorefds);
+
+        pw->bumpmaxfd(fanotifyfd);
+    }
+#endif
 }
 
+#ifdef MEGA_FANOTIFY
+// the key of a folder in fidnodes, as its fanotify events identify it
+static void fanotifyfid(const void* fsid, const file_handle* fh, string* fid)
+{
+    fid->assign((const char*)fsid, sizeof(fsid_t));
+    fid->append((const char*)&fh->handle_type, sizeof fh->handle_type);
+    fid->append((const char*)fh->f_handle, fh->handle_bytes);
+}
+
+static bool fanotifyfid(const char* path, string* fid)
+{
+    struct statfs statfsbuf;
+    union
+    {
+        file_handle fh;
+        char buf[sizeof(file_handle) + MAX_HANDLE_SZ];
+    } h;
+    int mountid;
+
+    h.fh.handle_bytes = MAX_HANDLE_SZ;
+    if (statfs(path, &statfsbuf) || name_to_handle_at(AT_FDCWD, path, &h.fh, &mountid, AT_SYMLINK_FOLLOW))
+    {
+        return false;
+    }
+
+    fanotifyfid(&statfsbuf.f_fsid, &h.fh, fid);
+    return true;
+}
+
+// entries created, deleted, moved or written anywhere in the filesystem;
+// those outside the synced folders are skipped by checkevents()
+bool PosixFileSystemAccess::fanotifymark(string* localpath)
+{
+    if (fanotifyfd < 0)
+    {
+        return false;
+    }
+
+    if (fanotify_mark(fanotifyfd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR,
+                      AT_FDCWD, localpath->c_str()))
+    {
+        LOG_debug << "Unable to mark the filesystem with fanotify. Error code: " << errno;
+        return false;
+    }
+
+    return true;
+}
+#endif
+
 // read all pending inotify events and queue them for processing
 int PosixFileSystemAccess::checkevents(Waiter* w)
 {
     int r = 0;
+#ifdef ENABLE_SYNC
+#ifdef MEGA_FANOTIFY
+    if (fanotifyfd >= 0 && FD_ISSET(fanotifyfd, &((PosixWaiter*)w)->rfds))
+    {
+        alignas(fanotify_event_metadata) char buf[16384];
+        fanotify_event_metadata* m;
+        fanotify_event_info_fid* info;
+        file_handle* fh;
+        fidlocalnode_map::iterator it;
+        string fid;
+        ssize_t l;
+
+        while ((l = read(fanotifyfd, buf, sizeof buf)) > 0)
+        {
+            for (m = (fanotify_event_metadata*)buf; FAN_EVENT_OK(m, l); m = FAN_EVENT_NEXT(m, l))
+            {
+                if (m->mask & FAN_Q_OVERFLOW)
+                {
+                    notifyerr = true;
+                    continue;
+                }
+
+                info = (fanotify_event_info_fid*)(m + 1);
+                if (m->event_len < sizeof *m + sizeof *info
+                 || info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+                {
+                    continue;
+                }
+
+                // the folder's handle is followed by the entry's name
+                fh = (file_handle*)info->handle;
+                const char* name = (const char*)fh->f_handle + fh->handle_bytes;
+
+                fanotifyfid(&info->fsid, fh, &fid);
+                if ((it = fidnodes.find(fid)) == fidnodes.end() || !strcmp(name, "."))
+                {
+                    continue;
+                }
+
+                // a move is notified at both ends: its source is found missing
+                // and its target is matched by fsid
+                string* ignore = &it->second->sync->dirnotify->ignore;
+                size_t namesize = strlen(name);
+
+                if (namesize < ignore->size()
+                 || memcmp(name, ignore->data(), ignore->size())
+                 || (namesize > ignore->size()
+                  && memcmp(name + ignore->size(), localseparator.c_str(), localseparator.size())))
+                {
+                    LOG_debug << "Filesystem notification. Root: " << it->second->name << "   Path: " << name;
+                    it->second->sync->dirnotify->notify(DirNotify::DIREVENTS,
+                                                        it->second, name,
+                                                        namesize);
+
+                    r |= Waiter::NEEDEXEC;
+                }
+            }
+        }
+    }
+#endif
+
+#ifdef MEGA_FSEVENTSTREAM
+    for (sync_list::iterator it = client->syncs.begin(); it != client->syncs.end(); it++)
+    {
+        PosixDirNotify* dirnotify = (PosixDirNotify*)(*it)->dirnotify.get();
+        if (!dirnotify->stream)
+        {
+            continue;
+        }
+
+        vector<string> paths;
+        {
+            std::lock_guard<std::mutex> g(dirnotify->streammutex);
+            paths.swap(dirnotify->streampaths);
+            if (dirnotify->streamrescan)
+            {
+                dirnotify->streamrescan = false;
+                notifyerr = true;
+            }
+        }
+
+        const string& ignore = dirnotify->ignore;
+        static const char rsrc[] = "/..namedfork/rsrc";
+        static const size_t rsrcsize = sizeof(rsrc) - 1;
+        struct stat statbuf;
+
+        // paths below the sync's root, with or without the /System/Volumes/Data prefix
+        auto below = [](const string& path, const string& root)
+        {
+            return root.size() && path.size() > root.size() + 1
+                && !path.compare(0, root.size(), root) && path[root.size()] == '/';
+        };
+
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            const string& path = paths[i];
+            size_t rsize;
+
+            if (below(path, (*it)->localroot.localname))
+            {
+                rsize = (*it)->localroot.localname.size();
+            }
+            else if (below(path, (*it)->mFsEventsPath))
+            {
+                rsize = (*it)->mFsEventsPath.size();
+            }
+            else
+            {
+                continue;
+            }
+
+            // skip paths in the sync-local rubbish folder, resource forks and symlinks
+            if ((!path.compare(rsize + 1, ignore.size(), ignore)
+              && (path.size() == rsize + 1 + ignore.size() || path[rsize + 1 + ignore.size()] == '/'))
+             || (path.size() >= rsrcsize && !path.compare(path.size() - rsrcsize, rsrcsize, rsrc)))
+            {
+                continue;
+            }
+
+            if (!lstat(path.c_str(), &statbuf) && S_ISLNK(statbuf.st_mode))
+            {
+                LOG_debug << "Link skipped:  " << path;
+                continue;
+            }
+
+            LOG_debug << "Filesystem notification. Root: " << (*it)->localroot.name << "   Path: " << path.c_str() + rsize + 1;
+            dirnotify->notify(DirNotify::DIREVENTS, &(*it)->localroot,
+                              path.data() + rsize + 1,
+                              path.size() - rsize - 1);
+
+            r |= Waiter::NEEDEXEC;
+        }
+    }
+#endif
+#endif
+
     if (notifyfd < 0)
     {
         return r;
@@ -1012,24 +1589,74 @@ bool PosixFileSystemAccess::renamelocal(string* oldname, string* newname, bool o
             newname = &absolutenewname;
         }
     }
-#endif
+#endif
+
+    bool existingandcare = !override && (0 == access(newname->c_str(), F_OK));
+    if (!existingandcare && !rename(oldname->c_str(), newname->c_str()))
+    {
+        LOG_verbose << "Successfully moved file: " << oldname->c_str() << " to " << newname->c_str();
+        return true;
+    }
+
+    target_exists = existingandcare  || errno == EEXIST || errno == EISDIR || errno == ENOTEMPTY || errno == ENOTDIR;
+    transient_error = !existingandcare && (errno == ETXTBSY || errno == EBUSY);
+
+    int e = errno;
+    if (!skip_errorreport)
+    {
+        LOG_warn << "Unable to move file: " << oldname->c_str() << " to " << newname->c_str() << ". Error code: " << e;
+    }
+    return false;
+}
+
+// clone a file where the file system supports it, or copy it within the kernel:
+// false leaves it to copylocal() to copy it by hand
+static bool clonelocal(const char* oldname, const char* newname, mode_t permissions)
+{
+#if defined(MEGA_CLONEFILE)
+    // clonefile() doesn't overwrite
+    unlink(newname);
+    return !clonefile(oldname, newname, 0);
+#elif defined(MEGA_FICLONE)
+    int sfd, tfd;
+    if ((sfd = open(oldname, O_RDONLY)) < 0)
+    {
+        return false;
+    }
 
-    bool existingandcare = !override && (0 == access(newname->c_str(), F_OK));
-    if (!existingandcare && !rename(oldname->c_str(), newname->c_str()))
+    mode_t mode = umask(0);
+    tfd = open(newname, O_WRONLY | O_CREAT | O_TRUNC, permissions);
+    umask(mode);
+    if (tfd < 0)
     {
-        LOG_verbose << "Successfully moved file: " << oldname->c_str() << " to " << newname->c_str();
-        return true;
+        close(sfd);
+        return false;
     }
 
-    target_exists = existingandcare  || errno == EEXIST || errno == EISDIR || errno == ENOTEMPTY || errno == ENOTDIR;
-    transient_error = !existingandcare && (errno == ETXTBSY || errno == EBUSY);
+    bool done = !ioctl(tfd, FICLONE, sfd);
 
-    int e = errno;
-    if (!skip_errorreport)
+#ifdef __NR_copy_file_range
+    struct stat statbuf;
+    if (!done && !fstat(sfd, &statbuf))
     {
-        LOG_warn << "Unable to move file: " << oldname->c_str() << " to " << newname->c_str() << ". Error code: " << e;
+        // no extent sharing: across file systems (EXDEV) or without reflinks,
+        // some of them still copy on the server (NFS 4.2, CIFS)
+        off_t left = statbuf.st_size;
+        ssize_t t = 0;
+        while (left > 0 && (t = syscall(__NR_copy_file_range, sfd, NULL, tfd, NULL, size_t(left), 0)) > 0)
+        {
+            left -= t;
+        }
+        done = !left;
     }
+#endif
+
+    close(tfd);
+    close(sfd);
+    return done;
+#else
     return false;
+#endif
 }
 
 bool PosixFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t mtime)
@@ -1058,9 +1685,14 @@ bool PosixFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t
     int sfd, tfd;
     ssize_t t = -1;
 
+    if (clonelocal(oldname->c_str(), newname->c_str(), defaultfilepermissions))
+    {
+        LOG_verbose << "Copied by cloning";
+        t = 0;
+    }
 #ifdef HAVE_SENDFILE
     // Linux-specific - kernel 2.6.33+ required
-    if ((sfd = open(oldname->c_str(), O_RDONLY | O_DIRECT)) >= 0)
+    else if ((sfd = open(oldname->c_str(), O_RDONLY | O_DIRECT)) >= 0)
     {
         LOG_verbose << "Copying via sendfile";
         mode_t mode = umask(0);
@@ -1069,15 +1701,14 @@ bool PosixFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t
             umask(mode);
             while ((t = sendfile(tfd, sfd, NULL, 1024 * 1024 * 1024)) > 0);
 #else
-    char buf[16384];
-
-    if ((sfd = open(oldname->c_str(), O_RDONLY)) >= 0)
+    else if ((sfd = open(oldname->c_str(), O_RDONLY)) >= 0)
     {
         LOG_verbose << "Copying via read/write";
         mode_t mode = umask(0);
         if ((tfd = open(newname->c_str(), O_WRONLY | O_CREAT | O_TRUNC, defaultfilepermissions)) >= 0)
         {
             umask(mode);
+            char buf[16384];
             while (((t = read(sfd, buf, sizeof buf)) > 0) && write(tfd, buf, t) == t);
 #endif
             close(tfd);
@@ -1113,6 +1744,41 @@ bool PosixFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t
     return !t;
 }
 
+bool PosixFileSystemAccess::linklocal(string* oldname, string* newname)
+{
+#ifdef USE_IOS
+    string absoluteoldname;
+    string absolutenewname;
+    if (appbasepath)
+    {
+        if (oldname->size() && oldname->at(0) != '/')
+        {
+            absoluteoldname = appbasepath;
+            absoluteoldname.append(*oldname);
+            oldname = &absoluteoldname;
+        }
+
+        if (newname->size() && newname->at(0) != '/')
+        {
+            absolutenewname = appbasepath;
+            absolutenewname.append(*newname);
+            newname = &absolutenewname;
+        }
+    }
+#endif
+
+    if (!link(oldname->c_str(), newname->c_str())
+            || (errno == EEXIST && !unlink(newname->c_str()) && !link(oldname->c_str(), newname->c_str())))
+    {
+        return true;
+    }
+
+    int e = errno;
+    LOG_debug << "Unable to link file: " << oldname->c_str() << " to " << newname->c_str() << ". Error code: " << e;
+    transient_error = e == ETXTBSY || e == EBUSY;
+    return false;
+}
+
 // FIXME: add platform support for recycle bins
 bool PosixFileSystemAccess::rubbishlocal(string* /*name*/)
 {
@@ -1225,6 +1891,87 @@ void PosixFileSystemAccess::setdefaultfilepermissions(int permissions)
     defaultfilepermissions = permissions | 0600;
 }
 
+int PosixFileSystemAccess::getwriteoptions()
+{
+    return writeoptions;
+}
+
+void PosixFileSystemAccess::setwriteoptions(int options)
+{
+    writeoptions = options;
+}
+
+bool PosixFileSystemAccess::flushlocal(const vector<string>& files, bool wholefilesystem) const
+{
+    bool success = true;
+    set<string> dirs;
+
+#ifdef SYS_syncfs
+    set<dev_t> devices;
+#else
+    // no syncfs(): flush the files one by one
+    wholefilesystem = false;
+#endif
+
+    for (const string& file : files)
+    {
+        size_t sep = file.find_last_of('/');
+        dirs.insert(sep == string::npos ? string(".") : sep ? file.substr(0, sep) : string("/"));
+
+        if (wholefilesystem)
+        {
+            continue;
+        }
+
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            // removed or moved away since it was completed
+            LOG_debug << "Unable to open file to flush it: " << file << " (" << errno << ")";
+            continue;
+        }
+
+        if (fsync(fd))
+        {
+            LOG_warn << "Unable to flush file: " << file << " (" << errno << ")";
+            success = false;
+        }
+        close(fd);
+    }
+
+    for (const string& dir : dirs)
+    {
+        int fd = open(dir.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            LOG_debug << "Unable to open folder to flush it: " << dir << " (" << errno << ")";
+            continue;
+        }
+
+        int r;
+#ifdef SYS_syncfs
+        struct stat statbuf;
+        if (wholefilesystem)
+        {
+            r = (!fstat(fd, &statbuf) && !devices.insert(statbuf.st_dev).second) ? 0 : int(syscall(SYS_syncfs, fd));
+        }
+        else
+#endif
+        {
+            r = fsync(fd);
+        }
+
+        if (r)
+        {
+            LOG_warn << "Unable to flush folder: " << dir << " (" << errno << ")";
+            success = false;
+        }
+        close(fd);
+    }
+
+    return success;
+}
+
 int PosixFileSystemAccess::getdefaultfolderpermissions()
 {
     return defaultfolderpermissions;
@@ -1748,9 +2495,51 @@ PosixDirNotify::PosixDirNotify(string* localbasepath, string* ignore) : DirNotif
     fsaccess = NULL;
 }
 
+PosixDirNotify::~PosixDirNotify()
+{
+#ifdef MEGA_FSEVENTSTREAM
+    if (stream)
+    {
+        stopFsEventStream(stream);
+    }
+#endif
+}
+
+#ifdef MEGA_FSEVENTSTREAM
+bool PosixDirNotify::startstream()
+{
+    stream = startFsEventStream(localbasepath, [this](vector<string>& paths, bool rescan)
+    {
+        {
+            std::lock_guard<std::mutex> g(streammutex);
+            streampaths.insert(streampaths.end(), paths.begin(), paths.end());
+            streamrescan = streamrescan || rescan;
+        }
+        fsaccess->waiter->notify();
+    });
+
+    return stream != nullptr;
+}
+#endif
+
 void PosixDirNotify::addnotify(LocalNode* l, string* path)
 {
 #ifdef ENABLE_SYNC
+#ifdef MEGA_FANOTIFY
+    string fid;
+    if (fanotify && fanotifyfid(path->c_str(), &fid))
+    {
+        std::pair<PosixFileSystemAccess::fidlocalnode_map::iterator, bool> r = fsaccess->fidnodes.insert(std::make_pair(fid, l));
+        if (!r.second)
+        {
+            fsaccess->nodefids.erase(r.first->second);
+            r.first->second = l;
+        }
+        fsaccess->nodefids[l] = r.first;
+        return;
+    }
+#endif
+
 #ifdef USE_INOTIFY
     int wd;
 
@@ -1774,6 +2563,16 @@ void PosixDirNotify::addnotify(LocalNode* l, string* path)
 void PosixDirNotify::delnotify(LocalNode* l)
 {
 #ifdef ENABLE_SYNC
+#ifdef MEGA_FANOTIFY
+    map<LocalNode*, PosixFileSystemAccess::fidlocalnode_map::iterator>::iterator it = fsaccess->nodefids.find(l);
+    if (it != fsaccess->nodefids.end())
+    {
+        fsaccess->fidnodes.erase(it->second);
+        fsaccess->nodefids.erase(it);
+        return;
+    }
+#endif
+
 #ifdef USE_INOTIFY
     if (fsaccess->wdnodes.erase((int)(long)l->dirnotifytag))
     {
@@ -1816,7 +2615,7 @@ bool PosixDirNotify::fsstableids() const
 
 std::unique_ptr<FileAccess> PosixFileSystemAccess::newfileaccess(bool followSymLinks)
 {
-    return std::unique_ptr<FileAccess>{new PosixFileAccess{waiter, defaultfilepermissions, followSymLinks}};
+    return std::unique_ptr<FileAccess>{new PosixFileAccess{waiter, defaultfilepermissions, followSymLinks, writeoptions}};
 }
 
 DirAccess* PosixFileSystemAccess::newdiraccess()
@@ -1830,6 +2629,19 @@ DirNotify* PosixFileSystemAccess::newdirnotify(string* localpath, string* ignore
 
     dirnotify->fsaccess = this;
 
+#if defined(ENABLE_SYNC) && defined(MEGA_FANOTIFY)
+    dirnotify->fanotify = fanotifymark(localpath);
+    LOG_debug << "Filesystem notifications: " << (dirnotify->fanotify ? "fanotify" : "inotify");
+#endif
+
+#if defined(ENABLE_SYNC) && defined(MEGA_FSEVENTSTREAM)
+    if (notifyfd < 0 && !dirnotify->startstream())
+    {
+        dirnotify->failed = 1;
+        dirnotify->failreason = "Unable to start the FSEvents stream";
+    }
+#endif
+
     return dirnotify;
 }
 
@@ -1878,21 +2690,8 @@ bool PosixDirAccess::dopen(string* path, FileAccess* f, bool doglob)
     return dp != NULL;
 }
 
-bool PosixDirAccess::dnext(string* path, string* name, bool followsymlinks, nodetype_t* type)
+bool PosixDirAccess::dnext(string* /*path*/, string* name, bool followsymlinks, nodetype_t* type, NotifyAttributes* attributes)
 {
-#ifdef USE_IOS
-    string absolutepath;
-    if (PosixFileSystemAccess::appbasepath)
-    {
-        if (path->size() && path->at(0) != '/')
-        {
-            absolutepath = PosixFileSystemAccess::appbasepath;
-            absolutepath.append(*path);
-            path = &absolutepath;
-        }
-    }
-#endif
-
     if (globbing)
     {
         struct stat statbuf;
@@ -1915,38 +2714,108 @@ bool PosixDirAccess::dnext(string* path, string* name, bool followsymlinks, node
     }
 
     dirent* d;
-    size_t pathsize = path->size();
-    struct stat statbuf;
-
-    path->append("/");
 
     while ((d = readdir(dp)))
     {
-        if (*d->d_name != '.' || (d->d_name[1] && (d->d_name[1] != '.' || d->d_name[2])))
+        if (*d->d_name == '.' && (!d->d_name[1] || (d->d_name[1] == '.' && !d->d_name[2])))
         {
-            path->append(d->d_name);
+            continue;
+        }
+
+        nodetype_t t;
 
-            if (followsymlinks ? !stat(path->c_str(), &statbuf) : !lstat(path->c_str(), &statbuf))
+#ifdef DT_UNKNOWN
+        // the type in the record spares a stat() of each entry, unless
+        // the attributes are needed anyway or the file system doesn't fill it
+        if (d->d_type != DT_UNKNOWN && (d->d_type != DT_LNK || !followsymlinks))
+        {
+            if (d->d_type != DT_REG && d->d_type != DT_DIR)
             {
-                if (S_ISREG(statbuf.st_mode) || S_ISDIR(statbuf.st_mode))
-                {
-                    path->resize(pathsize);
-                    *name = d->d_name;
+                continue;
+            }
 
-                    if (type)
-                    {
-                        *type = S_ISREG(statbuf.st_mode) ? FILENODE : FOLDERNODE;
-                    }
+            t = d->d_type == DT_REG ? FILENODE : FOLDERNODE;
 
-                    return true;
+            if (!attributes)
+            {
+                *name = d->d_name;
+
+                if (type)
+                {
+                    *type = t;
                 }
+
+                return true;
             }
+        }
+#endif
+
+        // stat relative to the directory, without resolving its path again
+        int flags = followsymlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+        NotifyAttributes found;
 
-            path->resize(pathsize+1);
+#if defined(__linux__) && defined(STATX_TYPE)
+        struct statx statxbuf;
+
+        if (statx(dirfd(dp), d->d_name, flags | AT_STATX_DONT_SYNC,
+                  STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &statxbuf))
+        {
+            continue;
+        }
+
+        if (!S_ISREG(statxbuf.stx_mode) && !S_ISDIR(statxbuf.stx_mode))
+        {
+            continue;
+        }
+
+        t = S_ISREG(statxbuf.stx_mode) ? FILENODE : FOLDERNODE;
+        found.size = statxbuf.stx_size;
+        found.mtime = statxbuf.stx_mtime.tv_sec;
+        found.fsid = (handle)statxbuf.stx_ino;
+#else
+        struct stat statbuf;
+
+        if (fstatat(dirfd(dp), d->d_name, &statbuf, flags))
+        {
+            continue;
+        }
+
+        if (!S_ISREG(statbuf.st_mode) && !S_ISDIR(statbuf.st_mode))
+        {
+            continue;
+        }
+
+        t = S_ISREG(statbuf.st_mode) ? FILENODE : FOLDERNODE;
+        found.size = statbuf.st_size;
+        found.mtime = statbuf.st_mtime;
+        found.fsid = (handle)statbuf.st_ino;
+
+#ifdef __MACH__
+        // busy files (see PosixFileAccess::fopen()) must be opened to be checked
+        if (statbuf.st_birthtimespec.tv_sec == -2082844800)
+        {
+            found.fsid = UNDEF;
+        }
+#endif
+#endif
+
+        *name = d->d_name;
+
+        if (type)
+        {
+            *type = t;
+        }
+
+        if (attributes)
+        {
+            // the same values that PosixFileAccess::fopen() reports
+            found.type = t;
+            FileSystemAccess::captimestamp(&found.mtime);
+            *attributes = found;
         }
-    }
 
-    path->resize(pathsize);
+        return true;
+    }
 
     return false;
 }
@@ -1971,4 +2840,103 @@ PosixDirAccess::~PosixDirAccess()
         globfree(&globbuf);
     }
 }
+
+#ifndef __ANDROID__
+// the names of POSIX shared memory objects start with a slash
+static string sharedmemoryname(const string& name)
+{
+    return name.size() && name[0] == '/' ? name : "/" + name;
+}
+
+bool SharedMemory::create(const string& name, size_t size)
+{
+    close();
+
+    int fd = shm_open(sharedmemoryname(name).c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        LOG_err << "Unable to create shared memory " << name << ": " << errno;
+        return false;
+    }
+
+    void* data = MAP_FAILED;
+    if (!ftruncate(fd, off_t(size)))
+    {
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        LOG_err << "Unable to map shared memory " << name << ": " << errno;
+        shm_unlink(sharedmemoryname(name).c_str());
+        return false;
+    }
+
+    mData = static_cast<byte*>(data);
+    mSize = size;
+    return true;
+}
+
+bool SharedMemory::open(const string& name)
+{
+    close();
+
+    int fd = shm_open(sharedmemoryname(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0)
+    {
+        data = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    mData = static_cast<byte*>(data);
+    mSize = size_t(st.st_size);
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if (mData)
+    {
+        munmap(mData, mSize);
+        mData = nullptr;
+        mSize = 0;
+    }
+}
+
+void SharedMemory::remove(const string& name)
+{
+    shm_unlink(sharedmemoryname(name).c_str());
+}
+#else
+bool SharedMemory::create(const string&, size_t)
+{
+    return false;
+}
+
+bool SharedMemory::open(const string&)
+{
+    return false;
+}
+
+void SharedMemory::close()
+{
+}
+
+void SharedMemory::remove(const string&)
+{
+}
+#endif
 } // namespace
@@ -23,19 +23,38 @@
 #include "mega/posix/meganet.h"
 #include "mega/logging.h"
 
+#ifndef _WIN32
+#include <poll.h>
+#include <netinet/tcp.h>
+#endif
+
+// the network thread polls the sockets with WSAPoll() on Windows (Vista or later)
+#if !defined(_WIN32) || (!defined(WINDOWS_PHONE) && defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600)
+#define MEGA_IOTHREAD_POLL
+#endif
+
 #if defined(__ANDROID__) && ARES_VERSION >= 0x010F00
 #include <jni.h>
 extern JavaVM *MEGAjvm;
 #endif
 
-#define IPV6_RETRY_INTERVAL_DS 72000
+#define FAILED_IP_RETRY_INTERVAL_DS 6000
+#define HAPPY_EYEBALLS_DELAY_MS 250
 #define DNS_CACHE_TIMEOUT_DS 18000
 #define DNS_CACHE_EXPIRES 0
 #define MAX_SPEED_CONTROL_TIMEOUT_MS 500
+#define IOTHREAD_POLL_MS 10
+#define PRECONNECT_IDLE_DS 150
+#define AUTOPROXY_TTL_DS 18000
 
 namespace mega {
 
 std::mutex CurlHttpIO::curlMutex;
+bool CurlHttpIO::sharedcaches = false;
+CURLSH* CurlHttpIO::sharedcurlsh = NULL;
+CurlHttpIO::DNSCache CurlHttpIO::shareddnscache;
+std::recursive_mutex CurlHttpIO::shareddnsmutex;
+std::mutex CurlHttpIO::sharedcurlshmutexes[CURL_LOCK_DATA_LAST];
 
 #if defined(USE_OPENSSL) && !defined(OPENSSL_IS_BORINGSSL)
 
@@ -80,6 +99,8 @@ unsigned long CurlHttpIO::id_function()
 #endif
 
 CurlHttpIO::CurlHttpIO()
+    : dnscache(getsharedcaches() ? shareddnscache : owndnscache)
+    , dnsmutex(getsharedcaches() ? shareddnsmutex : owndnsmutex)
 {
     curl_version_info_data* data = curl_version_info(CURLVERSION_NOW);
     if (data->version)
@@ -134,6 +155,20 @@ CurlHttpIO::CurlHttpIO()
     curlipv6 = data->features & CURL_VERSION_IPV6;
     LOG_debug << "IPv6 enabled: " << curlipv6;
 
+#if LIBCURL_VERSION_NUM >= 0x072f00 // At least cURL 7.47.0
+    curlhttp2 = (data->features & CURL_VERSION_HTTP2) != 0;
+#else
+    curlhttp2 = false;
+#endif
+    LOG_debug << "HTTP/2 available: " << curlhttp2;
+
+#ifdef CURL_VERSION_SSLS_EXPORT // At least cURL 8.12.0
+    curlsslsexport = (data->features & CURL_VERSION_SSLS_EXPORT) != 0;
+#else
+    curlsslsexport = false;
+#endif
+    http2 = false;
+
     dnsok = false;
     reset = false;
     statechange = false;
@@ -141,6 +176,16 @@ CurlHttpIO::CurlHttpIO()
     maxspeed[GET] = 0;
     maxspeed[PUT] = 0;
     pkpErrors = 0;
+    iothreadenabled = false;
+    iothreadexit = false;
+    ioavailable = false;
+    ioreleasecount = 0;
+    ioreleased = false;
+    autoproxy = false;
+    autoproxyfailed = false;
+    autoproxyrunning = false;
+    autoproxydone = false;
+    autoproxytime = 0;
 
     WAIT_CLASS::bumpds();
     lastdnspurge = Waiter::ds + DNS_CACHE_TIMEOUT_DS / 2;
@@ -205,9 +250,6 @@ CurlHttpIO::CurlHttpIO()
     curl_multi_setopt(curlm[GET], CURLMOPT_SOCKETDATA, this);
     curl_multi_setopt(curlm[GET], CURLMOPT_TIMERFUNCTION, download_timer_callback);
     curl_multi_setopt(curlm[GET], CURLMOPT_TIMERDATA, this);
-#ifdef _WIN32
-    curl_multi_setopt(curlm[GET], CURLMOPT_MAXCONNECTS, 200);
-#endif
     curltimeoutreset[GET] = -1;
     arerequestspaused[GET] = false;
 
@@ -215,16 +257,37 @@ CurlHttpIO::CurlHttpIO()
     curl_multi_setopt(curlm[PUT], CURLMOPT_SOCKETDATA, this);
     curl_multi_setopt(curlm[PUT], CURLMOPT_TIMERFUNCTION, upload_timer_callback);
     curl_multi_setopt(curlm[PUT], CURLMOPT_TIMERDATA, this);
-#ifdef _WIN32
-    curl_multi_setopt(curlm[PUT], CURLMOPT_MAXCONNECTS, 200);
-#endif
 
     curltimeoutreset[PUT] = -1;
     arerequestspaused[PUT] = false;
 
-    curlsh = curl_share_init();
-    curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
-    curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    setmultiplexing(API);
+    setmultiplexing(GET);
+    setmultiplexing(PUT);
+    setcachelimits(API);
+    setcachelimits(GET);
+    setcachelimits(PUT);
+
+    curlMutex.lock();
+    ownscurlsh = &dnscache == &owndnscache;
+    if (!ownscurlsh && !sharedcurlsh)
+    {
+        // kept for the life of the process, so cURL stays initialized for it
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        sharedcurlsh = curl_share_init();
+        curl_share_setopt(sharedcurlsh, CURLSHOPT_LOCKFUNC, sharedcurlshlock);
+        curl_share_setopt(sharedcurlsh, CURLSHOPT_UNLOCKFUNC, sharedcurlshunlock);
+        curl_share_setopt(sharedcurlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(sharedcurlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    curlsh = ownscurlsh ? curl_share_init() : sharedcurlsh;
+    curlMutex.unlock();
+
+    if (ownscurlsh)
+    {
+        curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
 
     contenttypejson = curl_slist_append(NULL, "Content-Type: application/json");
     contenttypejson = curl_slist_append(contenttypejson, "Expect:");
@@ -235,7 +298,6 @@ CurlHttpIO::CurlHttpIO()
     proxyinflight = 0;
     ipv6requestsenabled = false;
     ipv6proxyenabled = ipv6requestsenabled;
-    ipv6deactivationtime = Waiter::ds;
     waiter = NULL;
     proxyport = 0;
 }
@@ -457,27 +519,17 @@ void CurlHttpIO::addcurlevents(Waiter *waiter, direction_t d)
         }
 #endif
 
+#if defined(_WIN32)
         if (info.mode & SockInfo::READ)
         {
-#if defined(_WIN32)
             events |= FD_READ;
-#else
-            FD_SET(info.fd, &((PosixWaiter *)waiter)->rfds);
-            ((PosixWaiter *)waiter)->bumpmaxfd(info.fd);
-#endif
         }
 
         if (info.mode & SockInfo::WRITE)
         {
-#if defined(_WIN32)
             events |= FD_WRITE;
-#else
-            FD_SET(info.fd, &((PosixWaiter *)waiter)->wfds);
-            ((PosixWaiter *)waiter)->bumpmaxfd(info.fd);
-#endif
         }
 
-#if defined(_WIN32)
         if (WSAEventSelect(info.fd, info.handle, events))
         {
             LOG_err << "Error associating curl handle " << info.fd << ": " << GetLastError();
@@ -487,10 +539,29 @@ void CurlHttpIO::addcurlevents(Waiter *waiter, direction_t d)
         }
 
         ((WinWaiter *)waiter)->addhandle(info.handle, Waiter::NEEDEXEC);
+#else
+        // the sockets stay watched between waits: this only catches up with
+        // modes that the socket callback couldn't set (paused directions)
+        ((PosixWaiter *)waiter)->watch(info.fd, info.mode);
 #endif
     }
 }
 
+// stop waking up for the sockets of a paused direction
+void CurlHttpIO::mutecurlevents(Waiter *waiter, direction_t d)
+{
+#if defined(_WIN32)
+    (void)waiter;
+    (void)d;
+#else
+    SockInfoMap &socketmap = curlsockets[d];
+    for (SockInfoMap::iterator it = socketmap.begin(); it != socketmap.end(); it++)
+    {
+        ((PosixWaiter *)waiter)->watch(it->second.fd, 0);
+    }
+#endif
+}
+
 void CurlHttpIO::closearesevents()
 {
 #if defined(_WIN32)
@@ -517,6 +588,12 @@ void CurlHttpIO::closecurlevents(direction_t d)
             WSACloseEvent(info.handle);
         }
     }
+#else
+    // the fds are closed, and their numbers can be reused
+    if (waiter)
+    {
+        mutecurlevents(waiter, d);
+    }
 #endif
     socketmap.clear();
 }
@@ -571,11 +648,6 @@ void CurlHttpIO::processcurlevents(direction_t d)
 {
     CodeCounter::ScopeTimer ccst(countProcessCurlEventsCode);
 
-#ifndef _WIN32
-    fd_set *rfds = &((PosixWaiter *)waiter)->rfds;
-    fd_set *wfds = &((PosixWaiter *)waiter)->wfds;
-#endif
-
     int dummy = 0;
     SockInfoMap *socketmap = &curlsockets[d];
     m_time_t *timeout = &curltimeoutreset[d];
@@ -604,11 +676,12 @@ void CurlHttpIO::processcurlevents(direction_t d)
                                      &dummy);
         }
 #else
-        if (((info.mode & SockInfo::READ) && FD_ISSET(info.fd, rfds)) || ((info.mode & SockInfo::WRITE) && FD_ISSET(info.fd, wfds)))
+        int ready = ((PosixWaiter *)waiter)->ready(info.fd) & info.mode;
+        if (ready)
         {
             curl_multi_socket_action(curlm[d], info.fd,
-                                     (((info.mode & SockInfo::READ) && FD_ISSET(info.fd, rfds)) ? CURL_CSELECT_IN : 0)
-                                     | (((info.mode & SockInfo::WRITE) && FD_ISSET(info.fd, wfds)) ? CURL_CSELECT_OUT : 0),
+                                     ((ready & SockInfo::READ) ? CURL_CSELECT_IN : 0)
+                                     | ((ready & SockInfo::WRITE) ? CURL_CSELECT_OUT : 0),
                                      &dummy);
         }
 #endif
@@ -638,12 +711,32 @@ void CurlHttpIO::processcurlevents(direction_t d)
 
 CurlHttpIO::~CurlHttpIO()
 {
+    setiothread(false);
+
+    // the waiter may be gone already, and the sockets are closed with the multi handles
+    waiter = NULL;
+
+    if (autoproxythread.joinable())
+    {
+        // the system calls of the detection can't be interrupted
+        autoproxythread.join();
+    }
+
+    for (std::map<HttpReq*, direction_t>::iterator it = preconnects.begin(); it != preconnects.end(); it++)
+    {
+        delete it->first;
+    }
+    preconnects.clear();
+
     disconnecting = true;
     ares_destroy(ares);
     curl_multi_cleanup(curlm[API]);
     curl_multi_cleanup(curlm[GET]);
     curl_multi_cleanup(curlm[PUT]);
-    curl_share_cleanup(curlsh);
+    if (ownscurlsh)
+    {
+        curl_share_cleanup(curlsh);
+    }
 
     closearesevents();
     closecurlevents(API);
@@ -661,16 +754,43 @@ CurlHttpIO::~CurlHttpIO()
 
 void CurlHttpIO::setuseragent(string* u)
 {
+    IOGuard g(this);
     useragent = *u;
 }
 
+// the connection caches stay per instance: cURL can't share them among
+// multi handles used from several threads
+void CurlHttpIO::setsharedcaches(bool enable)
+{
+    std::lock_guard<std::mutex> g(curlMutex);
+    sharedcaches = enable;
+}
+
+bool CurlHttpIO::getsharedcaches()
+{
+    std::lock_guard<std::mutex> g(curlMutex);
+    return sharedcaches;
+}
+
+void CurlHttpIO::sharedcurlshlock(CURL*, curl_lock_data data, curl_lock_access, void*)
+{
+    sharedcurlshmutexes[data].lock();
+}
+
+void CurlHttpIO::sharedcurlshunlock(CURL*, curl_lock_data data, void*)
+{
+    sharedcurlshmutexes[data].unlock();
+}
+
 void CurlHttpIO::setdnsservers(const char* servers)
 {
+    IOGuard g(this);
     if (servers)
     {
         lastdnspurge = Waiter::ds + DNS_CACHE_TIMEOUT_DS / 2;
         if (DNS_CACHE_EXPIRES)
         {
+            std::lock_guard<std::recursive_mutex> dnsguard(dnsmutex);
             dnscache.clear();
         }
 
@@ -683,6 +803,7 @@ void CurlHttpIO::setdnsservers(const char* servers)
 
 void CurlHttpIO::disconnect()
 {
+    IOGuard g(this);
     LOG_debug << "Reinitializing the network layer";
     disconnecting = true;
     assert(!numconnections[API] && !numconnections[GET] && !numconnections[PUT]);
@@ -708,6 +829,7 @@ void CurlHttpIO::disconnect()
     lastdnspurge = Waiter::ds + DNS_CACHE_TIMEOUT_DS / 2;
     if (DNS_CACHE_EXPIRES)
     {
+        std::lock_guard<std::recursive_mutex> dnsguard(dnsmutex);
         dnscache.clear();
     }
 
@@ -730,9 +852,6 @@ void CurlHttpIO::disconnect()
     curl_multi_setopt(curlm[GET], CURLMOPT_SOCKETDATA, this);
     curl_multi_setopt(curlm[GET], CURLMOPT_TIMERFUNCTION, download_timer_callback);
     curl_multi_setopt(curlm[GET], CURLMOPT_TIMERDATA, this);
-#ifdef _WIN32
-    curl_multi_setopt(curlm[GET], CURLMOPT_MAXCONNECTS, 200);
-#endif
     curltimeoutreset[GET] = -1;
     arerequestspaused[GET] = false;
 
@@ -741,12 +860,16 @@ void CurlHttpIO::disconnect()
     curl_multi_setopt(curlm[PUT], CURLMOPT_SOCKETDATA, this);
     curl_multi_setopt(curlm[PUT], CURLMOPT_TIMERFUNCTION, upload_timer_callback);
     curl_multi_setopt(curlm[PUT], CURLMOPT_TIMERDATA, this);
-#ifdef _WIN32
-    curl_multi_setopt(curlm[PUT], CURLMOPT_MAXCONNECTS, 200);
-#endif
     curltimeoutreset[PUT] = -1;
     arerequestspaused[PUT] = false;
 
+    setmultiplexing(API);
+    setmultiplexing(GET);
+    setmultiplexing(PUT);
+    setcachelimits(API);
+    setcachelimits(GET);
+    setcachelimits(PUT);
+
     disconnecting = false;
     if (dnsservers.size())
     {
@@ -763,16 +886,25 @@ void CurlHttpIO::disconnect()
         LOG_debug << "Unresolved proxy name. Resolving...";
         request_proxy_ip();
     }
+
+    if (autoproxy)
+    {
+        // the network may have changed: detect the proxy again,
+        // keeping the current path until the result is known
+        startautoproxy();
+    }
 }
 
 bool CurlHttpIO::setmaxdownloadspeed(m_off_t bpslimit)
 {
+    IOGuard g(this);
     maxspeed[GET] = bpslimit;
     return true;
 }
 
 bool CurlHttpIO::setmaxuploadspeed(m_off_t bpslimit)
 {
+    IOGuard g(this);
     maxspeed[PUT] = bpslimit;
     return true;
 }
@@ -787,9 +919,471 @@ m_off_t CurlHttpIO::getmaxuploadspeed()
     return maxspeed[PUT];
 }
 
+bool CurlHttpIO::sethttp2(bool enable)
+{
+    IOGuard g(this);
+    if (enable && !curlhttp2)
+    {
+        LOG_warn << "cURL built without HTTP/2 support";
+        return false;
+    }
+
+    if (http2 != enable)
+    {
+        LOG_debug << "HTTP/2 multiplexing " << (enable ? "enabled" : "disabled");
+        http2 = enable;
+
+        // already established connections keep their protocol,
+        // new requests are multiplexed from now on
+        setmultiplexing(API);
+        setmultiplexing(GET);
+        setmultiplexing(PUT);
+    }
+    return true;
+}
+
+bool CurlHttpIO::gethttp2()
+{
+    return http2;
+}
+
+bool CurlHttpIO::gettlssessions(std::vector<TlsSession>* sessions)
+{
+    IOGuard g(this);
+#ifdef CURL_VERSION_SSLS_EXPORT
+    if (!curlsslsexport)
+    {
+        return false;
+    }
+
+    // the sessions are taken from the cache shared by all requests
+    CURL* curl = curl_easy_init();
+    if (!curl)
+    {
+        return false;
+    }
+    curl_easy_setopt(curl, CURLOPT_SHARE, curlsh);
+    CURLcode res = curl_easy_ssls_export(curl, ssls_export_callback, sessions);
+    curl_easy_cleanup(curl);
+
+    if (res != CURLE_OK)
+    {
+        LOG_warn << "Unable to export TLS sessions: " << res;
+        return false;
+    }
+
+    LOG_debug << "TLS sessions exported: " << sessions->size();
+    return true;
+#else
+    return HttpIO::gettlssessions(sessions);
+#endif
+}
+
+bool CurlHttpIO::settlssessions(const std::vector<TlsSession>& sessions)
+{
+    IOGuard g(this);
+#ifdef CURL_VERSION_SSLS_EXPORT
+    if (!curlsslsexport)
+    {
+        return false;
+    }
+
+    CURL* curl = curl_easy_init();
+    if (!curl)
+    {
+        return false;
+    }
+    curl_easy_setopt(curl, CURLOPT_SHARE, curlsh);
+
+    int imported = 0;
+    m_time_t now = m_time();
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        const TlsSession& session = sessions[i];
+        if (session.validuntil <= now)
+        {
+            continue;
+        }
+
+        if (curl_easy_ssls_import(curl, session.peer.size() ? session.peer.c_str() : NULL,
+                                  (const unsigned char*)session.mac.data(), session.mac.size(),
+                                  (const unsigned char*)session.data.data(), session.data.size()) == CURLE_OK)
+        {
+            imported++;
+        }
+    }
+    curl_easy_cleanup(curl);
+
+    LOG_debug << "TLS sessions imported: " << imported << " of " << sessions.size();
+    return true;
+#else
+    return HttpIO::settlssessions(sessions);
+#endif
+}
+
+#ifdef CURL_VERSION_SSLS_EXPORT
+CURLcode CurlHttpIO::ssls_export_callback(CURL*, void* userptr, const char* sessionkey,
+                                          const unsigned char* shmac, size_t shmaclen,
+                                          const unsigned char* sdata, size_t sdatalen,
+                                          curl_off_t validuntil, int, const char*, size_t)
+{
+    std::vector<TlsSession>* sessions = (std::vector<TlsSession>*)userptr;
+
+    // the length of the fields of a record is limited to 16 bits
+    if (shmaclen > 0xFFFF || sdatalen > 0xFFFF || (sessionkey && strlen(sessionkey) > 0xFFFF))
+    {
+        return CURLE_OK;
+    }
+
+    TlsSession session;
+    if (sessionkey)
+    {
+        session.peer = sessionkey;
+    }
+    session.mac.assign((const char*)shmac, shmaclen);
+    session.data.assign((const char*)sdata, sdatalen);
+    session.validuntil = validuntil;
+    sessions->push_back(session);
+    return CURLE_OK;
+}
+#endif
+
+bool CurlHttpIO::setsocketoptions(direction_t d, const SocketOptions& options)
+{
+    IOGuard g(this);
+    sockopts[d] = options;
+    LOG_debug << "Socket options set for direction " << d << ": rcvbuf " << options.rcvbuf
+              << " sndbuf " << options.sndbuf << " notsentlowat " << options.notsentlowat
+              << " congestion " << (options.congestion.size() ? options.congestion : "default")
+              << " buffersize " << options.buffersize;
+    return true;
+}
+
+bool CurlHttpIO::setconnectioncache(direction_t d, const ConnectionCacheOptions& options)
+{
+    IOGuard g(this);
+#if LIBCURL_VERSION_NUM < 0x071e00 // cURL 7.30.0
+    if (options.maxhostconnections || options.maxtotalconnections)
+    {
+        LOG_warn << "cURL too old to limit the connections per host or in total";
+        return false;
+    }
+#endif
+#if LIBCURL_VERSION_NUM < 0x074100 // cURL 7.65.0
+    if (options.maxidleseconds)
+    {
+        LOG_warn << "cURL too old to limit the age of idle connections";
+        return false;
+    }
+#endif
+
+    cacheopts[d] = options;
+    setcachelimits(d);
+    LOG_debug << "Connection cache for direction " << d << ": maxconnects " << options.maxconnects
+              << " per host " << options.maxhostconnections << " total " << options.maxtotalconnections
+              << " max idle " << options.maxidleseconds << " s";
+    return true;
+}
+
+bool CurlHttpIO::preconnect(const string& url, direction_t d, int connections)
+{
+    IOGuard g(this);
+
+    // requests through a proxy don't go to the host directly
+    if (proxyurl.size())
+    {
+        return false;
+    }
+
+    string scheme, hostname;
+    int port;
+    if (!crackurl((string*)&url, &scheme, &hostname, &port))
+    {
+        return false;
+    }
+
+    std::ostringstream oss;
+    oss << scheme << "://" << hostname << ":" << port;
+    string key = oss.str();
+
+    std::map<string, dstime>::iterator it = hostsused[d].find(key);
+    if (it != hostsused[d].end() && Waiter::ds - it->second < PRECONNECT_IDLE_DS)
+    {
+        // connections to this host are likely open, or being opened
+        return true;
+    }
+    hostsused[d][key] = Waiter::ds;
+
+    LOG_debug << "Opening " << connections << " connection(s) to " << key << " ahead of time";
+    for (int i = 0; i < connections; i++)
+    {
+        HttpReq* req = new HttpReq(true);
+        req->posturl = key + "/";
+        req->protect = false;
+        req->httpio = this;
+        req->method = METHOD_NONE;
+        req->contentlength = -1;
+        req->lastdata = Waiter::ds;
+        req->logname = "preconnect ";
+        preconnects[req] = d;
+        post(req);
+    }
+    return true;
+}
+
+string CurlHttpIO::hostkey(CurlHttpContext* httpctx)
+{
+    std::ostringstream oss;
+    oss << httpctx->scheme << "://" << httpctx->hostname << ":" << httpctx->port;
+    return oss.str();
+}
+
+// delete the requests that opened connections ahead of time once they finish
+void CurlHttpIO::purgepreconnects()
+{
+    for (std::map<HttpReq*, direction_t>::iterator it = preconnects.begin(); it != preconnects.end();)
+    {
+        if (it->first->status != REQ_INFLIGHT)
+        {
+            delete it->first;
+            preconnects.erase(it++);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+bool CurlHttpIO::setiothread(bool enable)
+{
+#ifndef MEGA_IOTHREAD_POLL
+    return !enable;
+#else
+    if (enable == iothreadenabled)
+    {
+        return true;
+    }
+
+    if (ioreleasecount)
+    {
+        LOG_err << "The network thread can't be changed during a busy section";
+        return false;
+    }
+
+    if (enable)
+    {
+        LOG_debug << "Starting the network thread";
+        iothreadexit = false;
+        ioavailable = false;
+        iothreadenabled = true;
+        iothread = std::thread(&CurlHttpIO::iothreadloop, this);
+        return true;
+    }
+
+    LOG_debug << "Stopping the network thread";
+    {
+        std::lock_guard<std::mutex> g(iomutex);
+        iothreadexit = true;
+    }
+    iocv.notify_all();
+    iothread.join();
+    iothreadenabled = false;
+    return true;
+#endif
+}
+
+bool CurlHttpIO::getiothread()
+{
+    return iothreadenabled;
+}
+
+void CurlHttpIO::releaseio()
+{
+    if (!iothreadenabled || ioreleasecount++)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(iomutex);
+        ioavailable = true;
+        ioreleased = true;
+    }
+    iocv.notify_one();
+}
+
+void CurlHttpIO::acquireio()
+{
+    if (!iothreadenabled || !ioreleasecount || --ioreleasecount)
+    {
+        return;
+    }
+
+    // waits for the current iteration of the network thread
+    std::lock_guard<std::mutex> g(iomutex);
+    ioavailable = false;
+    ioreleased = false;
+}
+
+CurlHttpIO::IOGuard::IOGuard(CurlHttpIO* h)
+{
+    httpio = h;
+    locked = httpio->ioreleased;
+    if (locked)
+    {
+        std::lock_guard<std::mutex> g(httpio->iomutex);
+        httpio->ioavailable = false;
+        httpio->ioreleased = false;
+    }
+}
+
+CurlHttpIO::IOGuard::~IOGuard()
+{
+    if (locked)
+    {
+        {
+            std::lock_guard<std::mutex> g(httpio->iomutex);
+            httpio->ioavailable = true;
+            httpio->ioreleased = true;
+        }
+        httpio->iocv.notify_one();
+    }
+}
+
+void CurlHttpIO::iothreadloop()
+{
+    Trace::threadname("CurlHttpIO");
+
+#ifdef MEGA_IOTHREAD_POLL
+    std::vector<struct pollfd> fds;
+    std::vector<direction_t> dirs;
+
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(iomutex);
+        iocv.wait(lock, [this]() { return ioavailable || iothreadexit; });
+        if (iothreadexit)
+        {
+            return;
+        }
+
+        fds.clear();
+        dirs.clear();
+        for (int d = API; d <= PUT; d++)
+        {
+            if (arerequestspaused[d])
+            {
+                continue;
+            }
+
+            for (SockInfoMap::iterator it = curlsockets[d].begin(); it != curlsockets[d].end(); it++)
+            {
+                const SockInfo& info = it->second;
+                if (!info.mode)
+                {
+                    continue;
+                }
+
+                struct pollfd pfd;
+                pfd.fd = info.fd;
+                pfd.events = short(((info.mode & SockInfo::READ) ? POLLIN : 0)
+                                 | ((info.mode & SockInfo::WRITE) ? POLLOUT : 0));
+                pfd.revents = 0;
+                fds.push_back(pfd);
+                dirs.push_back(direction_t(d));
+            }
+        }
+
+        // the client can take the I/O back while waiting
+        lock.unlock();
+#ifdef _WIN32
+        // unlike poll(), WSAPoll() fails right away without sockets
+        int ready = 0;
+        if (fds.empty())
+        {
+            Sleep(IOTHREAD_POLL_MS);
+        }
+        else
+        {
+            ready = WSAPoll(fds.data(), ULONG(fds.size()), IOTHREAD_POLL_MS);
+        }
+#else
+        int ready = poll(fds.data(), nfds_t(fds.size()), IOTHREAD_POLL_MS);
+#endif
+        lock.lock();
+
+        if (ready <= 0 || !ioavailable || iothreadexit)
+        {
+            continue;
+        }
+
+        int dummy = 0;
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLOUT | POLLERR | POLLHUP)) || arerequestspaused[dirs[i]])
+            {
+                continue;
+            }
+
+            // the socket may have been closed by a request cancelled meanwhile
+            SockInfoMap::iterator it = curlsockets[dirs[i]].find(fds[i].fd);
+            if (it == curlsockets[dirs[i]].end() || !it->second.mode)
+            {
+                continue;
+            }
+
+            curl_multi_socket_action(curlm[dirs[i]], fds[i].fd,
+                                     ((fds[i].revents & (POLLIN | POLLERR | POLLHUP)) ? CURL_CSELECT_IN : 0)
+                                     | ((fds[i].revents & (POLLOUT | POLLERR)) ? CURL_CSELECT_OUT : 0),
+                                     &dummy);
+        }
+    }
+#endif
+}
+
+// allow concurrent requests to the same host to share a single HTTP/2 connection
+void CurlHttpIO::setmultiplexing(direction_t d)
+{
+#if LIBCURL_VERSION_NUM >= 0x072f00 // At least cURL 7.47.0
+    if (!curlhttp2 || !curlm[d])
+    {
+        return;
+    }
+
+    curl_multi_setopt(curlm[d], CURLMOPT_PIPELINING, http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#else
+    (void)d;
+#endif
+}
+
+// bound the connections of a multi handle (idle ones kept, per host and in total)
+void CurlHttpIO::setcachelimits(direction_t d)
+{
+    if (!curlm[d])
+    {
+        return;
+    }
+
+    long maxconnects = cacheopts[d].maxconnects;
+#ifdef _WIN32
+    if (!maxconnects && d != API)
+    {
+        maxconnects = 200;
+    }
+#endif
+    curl_multi_setopt(curlm[d], CURLMOPT_MAXCONNECTS, maxconnects);
+
+#if LIBCURL_VERSION_NUM >= 0x071e00 // At least cURL 7.30.0
+    curl_multi_setopt(curlm[d], CURLMOPT_MAX_HOST_CONNECTIONS, long(cacheopts[d].maxhostconnections));
+    curl_multi_setopt(curlm[d], CURLMOPT_MAX_TOTAL_CONNECTIONS, long(cacheopts[d].maxtotalconnections));
+#endif
+}
+
 // wake up from cURL I/O
 void CurlHttpIO::addevents(Waiter* w, int)
 {
+    IOGuard g(this);
     CodeCounter::ScopeTimer ccst(countCurlHttpIOAddevents);
 
     waiter = (WAIT_CLASS*)w;
@@ -817,6 +1411,7 @@ void CurlHttpIO::addevents(Waiter* w, int)
     {
         if (arerequestspaused[d])
         {
+            mutecurlevents(waiter, (direction_t)d);
             if (curltimeoutms < 0 || curltimeoutms > 100)
             {
                 curltimeoutms = 100;
@@ -1010,78 +1605,58 @@ void CurlHttpIO::ares_completed_callback(void* arg, int status, int, struct host
     // check if result is valid
     if (status == ARES_SUCCESS && host && host->h_addr_list[0])
     {
-        char ip[INET6_ADDRSTRLEN];
-        mega_inet_ntop(host->h_addrtype, host->h_addr_list[0], ip, sizeof(ip));
+        bool isIPv6 = host->h_addrtype == PF_INET6;
+        std::vector<string> ips;
+        for (int i = 0; host->h_addr_list[i] != NULL; i++)
+        {
+            char ip[INET6_ADDRSTRLEN];
+            mega_inet_ntop(host->h_addrtype, host->h_addr_list[i], ip, sizeof(ip));
+            ips.push_back(ip);
+        }
 
-        LOG_debug << "Received a valid IP for "<< httpctx->hostname << ": " << ip;
+        LOG_debug << "Received " << ips.size() << " valid IP(s) for "<< httpctx->hostname << ": " << ips[0];
 
         httpio->inetstatus(true);
 
         // add to DNS cache
-        CurlDNSEntry& dnsEntry = httpio->dnscache[httpctx->hostname];
-
-        int i = 0;
-        bool incache = false;
-        if ((host->h_addrtype == PF_INET6 && dnsEntry.ipv6.size())
-                || (host->h_addrtype != PF_INET6 && dnsEntry.ipv4.size()))
+        string ip;
         {
-            invalidcache = true;
-            while (host->h_addr_list[i] != NULL)
+            std::lock_guard<std::recursive_mutex> dnsguard(httpio->dnsmutex);
+            CurlDNSEntry& dnsEntry = httpio->dnscache[httpctx->hostname];
+            bool cached = isIPv6 ? dnsEntry.ipv6.size() : dnsEntry.ipv4.size();
+            if (dnsEntry.setaddresses(isIPv6, ips))
             {
-                char checkip[INET6_ADDRSTRLEN];
-                mega_inet_ntop(host->h_addrtype, host->h_addr_list[i], checkip, sizeof(checkip));
-                if (host->h_addrtype == PF_INET6)
-                {
-                    if (!strcmp(dnsEntry.ipv6.c_str(), checkip))
-                    {
-                        incache = true;
-                        invalidcache = false;
-                        break;
-                    }
-                }
-                else
-                {
-                    if (!strcmp(dnsEntry.ipv4.c_str(), checkip))
-                    {
-                        incache = true;
-                        invalidcache = false;
-                        break;
-                    }
-                }
-                i++;
+                LOG_debug << "The current DNS cache record is still valid";
+            }
+            else if (cached)
+            {
+                LOG_warn << "The current DNS cache record is invalid";
+                invalidcache = true;
             }
-        }
-
-        if (incache)
-        {
-            LOG_debug << "The current DNS cache record is still valid";
-        }
-        else if (invalidcache)
-        {
-            LOG_warn << "The current DNS cache record is invalid";
-        }
 
-        if (host->h_addrtype == PF_INET6)
-        {
-            if (!incache)
+            if (isIPv6)
+            {
+                dnsEntry.ipv6timestamp = Waiter::ds;
+            }
+            else
             {
-                dnsEntry.ipv6 = ip;
+                dnsEntry.ipv4timestamp = Waiter::ds;
             }
-            dnsEntry.ipv6timestamp = Waiter::ds;
+
+            // use the preferred address of the family. If all of them failed recently,
+            // skip IPv6 and use the first IPv4 address anyway
+            ip = isIPv6 ? dnsEntry.ipv6 : dnsEntry.ipv4;
         }
-        else
+
+        if (!ip.size() && !isIPv6)
         {
-            if (!incache)
-            {
-                dnsEntry.ipv4 = ip;
-            }
-            dnsEntry.ipv4timestamp = Waiter::ds;
+            ip = ips[0];
         }
 
         // IPv6 takes precedence over IPv4
-        if (!httpctx->hostip.size() || (host->h_addrtype == PF_INET6 && !httpctx->curl))
+        if (ip.size() && (!httpctx->hostip.size() || (isIPv6 && !httpctx->curl)))
         {
-            httpctx->isIPv6 = host->h_addrtype == PF_INET6;
+            httpctx->isIPv6 = isIPv6;
 
             //save the IP for this request
             std::ostringstream oss;
@@ -1096,6 +1671,10 @@ void CurlHttpIO::ares_completed_callback(void* arg, int status, int, struct host
 
             httpctx->hostip = oss.str();
         }
+        else if (!ip.size())
+        {
+            LOG_debug << "Skipping IPv6 for " << httpctx->hostname << " due to recent failures";
+        }
     }
     else if (status != ARES_SUCCESS)
     {
@@ -1136,6 +1715,7 @@ void CurlHttpIO::ares_completed_callback(void* arg, int status, int, struct host
         {
             req->status = REQ_FAILURE;
             httpio->statechange = true;
+            Trace::asyncend("http", req);
 
             if (!httpctx->ares_pending && !httpctx->hostip.size())
             {
@@ -1206,6 +1786,94 @@ void CurlHttpIO::ares_completed_callback(void* arg, int status, int, struct host
     }
 }
 
+// learn which address was used by a finished request and how long it took to connect
+void CurlHttpIO::addconnectinfo(CurlHttpContext* httpctx, CURL* curl)
+{
+    char *ip = NULL;
+    if (proxyip.size() || !httpctx->hostip.size()
+            || curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) != CURLE_OK
+            || !ip || !*ip)
+    {
+        return;
+    }
+
+    bool isIPv6 = strchr(ip, ':') != NULL;
+    if (httpctx->resolve && isIPv6 != httpctx->isIPv6)
+    {
+        LOG_debug << "Happy eyeballs: connected using " << (isIPv6 ? "IPv6 " : "IPv4 ") << ip;
+        httpctx->isIPv6 = isIPv6;
+        httpctx->hostip = isIPv6 ? (string("[") + ip + "]") : string(ip);
+    }
+
+    long numconnects = 0;
+    double connecttime = 0;
+    double namelookuptime = 0;
+    if (!httpctx->req->httpstatus
+            || curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &numconnects) != CURLE_OK
+            || !numconnects // reused connection, nothing measured
+            || curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connecttime) != CURLE_OK
+            || curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &namelookuptime) != CURLE_OK)
+    {
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> dnsguard(dnsmutex);
+    map<string, CurlDNSEntry>::iterator it = dnscache.find(httpctx->hostname);
+    if (it != dnscache.end())
+    {
+        it->second.connected(ip, int((connecttime - namelookuptime) * 1000));
+    }
+}
+
+// account a finished request in the statistics of its host
+void CurlHttpIO::addnetworkstats(CurlHttpContext* httpctx, CURL* curl)
+{
+    HostNetworkStats& stats = networkstats.host(httpctx->d, hostkey(httpctx));
+    stats.statuses[httpctx->req->httpstatus]++;
+
+    long numconnects = 0;
+    double namelookuptime = 0, connecttime = 0, appconnecttime = 0;
+    double pretransfertime = 0, starttransfertime = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &numconnects);
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &namelookuptime);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connecttime);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &appconnecttime);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME, &pretransfertime);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &starttransfertime);
+#if LIBCURL_VERSION_NUM >= 0x073700 // At least cURL 7.55.0
+    curl_off_t downloaded = 0, uploaded = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+#else
+    double downloaded = 0, uploaded = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD, &uploaded);
+#endif
+
+    if (httpctx->dnsms >= 0)
+    {
+        stats.dns.add(httpctx->dnsms);
+    }
+
+    if (numconnects > 0 && connecttime > 0)
+    {
+        stats.connections++;
+        stats.connect.add(int64_t((connecttime - namelookuptime) * 1000));
+        if (appconnecttime > 0)
+        {
+            stats.tls.add(int64_t((appconnecttime - connecttime) * 1000));
+        }
+    }
+
+    if (starttransfertime > 0)
+    {
+        stats.ttfb.add(int64_t((starttransfertime - pretransfertime) * 1000));
+    }
+
+    stats.bytesin += uint64_t(downloaded);
+    stats.bytesout += uint64_t(uploaded);
+}
+
 struct curl_slist* CurlHttpIO::clone_curl_slist(struct curl_slist* inlist)
 {
     struct curl_slist* outlist = NULL;
@@ -1268,6 +1936,12 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
         }
     }
 
+    if (!httpctx->isCachedIp && !httpio->proxyip.size())
+    {
+        httpctx->dnsms = int(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::steady_clock::now() - httpctx->posted).count());
+    }
+
     httpctx->headers = clone_curl_slist(req->type == REQ_JSON ? httpio->contenttypejson : httpio->contenttypebinary);
     httpctx->posturl = req->posturl;
 
@@ -1278,15 +1952,51 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
     else if(httpctx->hostip.size())
     {
         LOG_debug << "Using the IP of the hostname: " << httpctx->hostip;
-        httpctx->posturl.replace(httpctx->posturl.find(httpctx->hostname), httpctx->hostname.size(), httpctx->hostip);
-        httpctx->headers = curl_slist_append(httpctx->headers, httpctx->hostheader.c_str());
+
+    #if LIBCURL_VERSION_NUM >= 0x073b00 // At least cURL 7.59.0
+        std::lock_guard<std::recursive_mutex> dnsguard(httpio->dnsmutex);
+        map<string, CurlDNSEntry>::iterator it = httpio->dnscache.find(httpctx->hostname);
+        if ((req->method != METHOD_NONE || httpio->preconnects.count(req))
+                && httpio->ipv6requestsenabled && it != httpio->dnscache.end()
+                && it->second.ipv4.size() && !it->second.isIPv4Expired()
+                && it->second.ipv6.size() && !it->second.isIPv6Expired())
+        {
+            // both families are available: let cURL race them (happy eyeballs),
+            // starting with the address chosen for this request
+            std::ostringstream oss;
+            oss << httpctx->hostname << ":" << httpctx->port << ":" << httpctx->hostip << ",";
+            if (httpctx->isIPv6)
+            {
+                oss << it->second.ipv4;
+            }
+            else
+            {
+                oss << "[" << it->second.ipv6 << "]";
+            }
+
+            // replace the previous entry in the shared DNS cache of cURL
+            std::ostringstream remove;
+            remove << "-" << httpctx->hostname << ":" << httpctx->port;
+            httpctx->resolve = curl_slist_append(NULL, remove.str().c_str());
+            httpctx->resolve = curl_slist_append(httpctx->resolve, oss.str().c_str());
+            LOG_debug << "Racing IPv4 and IPv6: " << oss.str();
+        }
+    #endif
+
+        if (!httpctx->resolve)
+        {
+            httpctx->posturl.replace(httpctx->posturl.find(httpctx->hostname), httpctx->hostname.size(), httpctx->hostip);
+            httpctx->headers = curl_slist_append(httpctx->headers, httpctx->hostheader.c_str());
+        }
     }
     else
     {
         LOG_err << "No IP nor proxy available";
         req->status = REQ_FAILURE;
         req->httpiohandle = NULL;
+        Trace::asyncend("http", req);
         curl_slist_free_all(httpctx->headers);
+        curl_slist_free_all(httpctx->resolve);
 
         httpctx->req = NULL;
         if (!httpctx->ares_pending)
@@ -1342,6 +2052,39 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
         curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_callback);
         curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, (void*)req);
 
+    #if LIBCURL_VERSION_NUM >= 0x073b00 // At least cURL 7.59.0
+        if (httpctx->resolve)
+        {
+            curl_easy_setopt(curl, CURLOPT_RESOLVE, httpctx->resolve);
+            curl_easy_setopt(curl, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS, (long)HAPPY_EYEBALLS_DELAY_MS);
+        }
+    #endif
+
+    #if LIBCURL_VERSION_NUM >= 0x072f00 // At least cURL 7.47.0
+        if (httpio->http2)
+        {
+            // negotiate HTTP/2 via ALPN and wait for an existing connection
+            // to the same host rather than opening a new one
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        }
+    #endif
+
+    #if LIBCURL_VERSION_NUM >= 0x074100 // At least cURL 7.65.0
+        if (httpio->cacheopts[httpctx->d].maxidleseconds)
+        {
+            curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, long(httpio->cacheopts[httpctx->d].maxidleseconds));
+        }
+    #endif
+
+        if (httpio->sockopts[httpctx->d].buffersize)
+        {
+            curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, long(httpio->sockopts[httpctx->d].buffersize));
+        #if LIBCURL_VERSION_NUM >= 0x073e00 // At least cURL 7.62.0
+            curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, long(httpio->sockopts[httpctx->d].buffersize));
+        #endif
+        }
+
         if (httpio->maxspeed[GET] && httpio->maxspeed[GET] <= 102400)
         {
             curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 4096L);
@@ -1446,7 +2189,9 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
     {
         req->status = REQ_FAILURE;
         req->httpiohandle = NULL;
+        Trace::asyncend("http", req);
         curl_slist_free_all(httpctx->headers);
+        curl_slist_free_all(httpctx->resolve);
 
         httpctx->req = NULL;
         if (!httpctx->ares_pending)
@@ -1632,6 +2377,7 @@ int CurlHttpIO::debug_callback(CURL*, curl_infotype type, char* data, size_t siz
 // POST request to URL
 void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
 {
+    IOGuard g(this);
     CurlHttpContext* httpctx = new CurlHttpContext;
     httpctx->curl = NULL;
     httpctx->httpio = this;
@@ -1639,10 +2385,15 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
     httpctx->len = len;
     httpctx->data = data;
     httpctx->headers = NULL;
+    httpctx->resolve = NULL;
     httpctx->isIPv6 = false;
     httpctx->isCachedIp = false;
     httpctx->ares_pending = 0;
-    httpctx->d = (req->type == REQ_JSON || req->method == METHOD_NONE) ? API : ((data ? len : req->out->size()) ? PUT : GET);
+    httpctx->posted = std::chrono::steady_clock::now();
+    httpctx->dnsms = -1;
+    std::map<HttpReq*, direction_t>::iterator pit = preconnects.find(req);
+    httpctx->d = (pit != preconnects.end()) ? pit->second
+               : ((req->type == REQ_JSON || req->method == METHOD_NONE) ? API : ((data ? len : req->out->size()) ? PUT : GET));
     req->httpiohandle = (void*)httpctx;    
 
     bool validrequest = true;
@@ -1662,10 +2413,11 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
         req->httpiohandle = NULL;
         req->status = REQ_FAILURE;
         statechange = true;
+        Trace::asyncend("http", req);
         return;
     }
 
-    if (!ipv6requestsenabled && ipv6available() && Waiter::ds - ipv6deactivationtime > IPV6_RETRY_INTERVAL_DS)
+    if (!ipv6requestsenabled && ipv6available())
     {
         ipv6requestsenabled = true;
     }
@@ -1700,6 +2452,7 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
     // purge DNS cache if needed
     if (DNS_CACHE_EXPIRES && (Waiter::ds - lastdnspurge) > DNS_CACHE_TIMEOUT_DS)
     {
+        std::lock_guard<std::recursive_mutex> dnsguard(dnsmutex);
         std::map<string, CurlDNSEntry>::iterator it = dnscache.begin();
 
         while (it != dnscache.end())
@@ -1710,12 +2463,14 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
             {
                 entry.ipv6timestamp = 0;
                 entry.ipv6.clear();
+                entry.ipv6addrs.clear();
             }
 
             if (entry.ipv4.size() && entry.isIPv4Expired())
             {
                 entry.ipv4timestamp = 0;
                 entry.ipv4.clear();
+                entry.ipv4addrs.clear();
             }
 
             if (!entry.ipv6.size() && !entry.ipv4.size())
@@ -1755,22 +2510,43 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
     httpctx->hostheader.append(httpctx->hostname);
     httpctx->ares_pending = 1;
 
-    CurlDNSEntry* dnsEntry = NULL;
-    map<string, CurlDNSEntry>::iterator it = dnscache.find(httpctx->hostname);
-    if (it != dnscache.end())
+    // the valid cached addresses (the entry may be shared with other instances)
+    bool useipv6 = ipv6requestsenabled;
+    string cachedipv6, cachedipv4;
     {
-        dnsEntry = &it->second;
+        std::lock_guard<std::recursive_mutex> dnsguard(dnsmutex);
+        map<string, CurlDNSEntry>::iterator it = dnscache.find(httpctx->hostname);
+        if (it != dnscache.end())
+        {
+            CurlDNSEntry* dnsEntry = &it->second;
+            if (useipv6 && dnsEntry->ipv6addrs.size() && !dnsEntry->ipv6.size())
+            {
+                // all IPv6 addresses of this host failed recently, check if they can be retried
+                dnsEntry->select(true);
+                useipv6 = dnsEntry->ipv6.size() != 0;
+            }
+
+            if (dnsEntry->ipv6.size() && !dnsEntry->isIPv6Expired())
+            {
+                cachedipv6 = dnsEntry->ipv6;
+            }
+
+            if (dnsEntry->ipv4.size() && !dnsEntry->isIPv4Expired())
+            {
+                cachedipv4 = dnsEntry->ipv4;
+            }
+        }
     }
 
-    if (ipv6requestsenabled)
+    if (useipv6)
     {
-        if (dnsEntry && dnsEntry->ipv6.size() && !dnsEntry->isIPv6Expired())
+        if (cachedipv6.size())
         {
-            LOG_debug << "DNS cache hit for " << httpctx->hostname << " (IPv6) " << dnsEntry->ipv6;
+            LOG_debug << "DNS cache hit for " << httpctx->hostname << " (IPv6) " << cachedipv6;
             std::ostringstream oss;
             httpctx->isIPv6 = true;
             httpctx->isCachedIp = true;
-            oss << "[" << dnsEntry->ipv6 << "]";
+            oss << "[" << cachedipv6 << "]";
             httpctx->hostip = oss.str();
             httpctx->ares_pending = 0;
             send_request(httpctx);
@@ -1783,12 +2559,12 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
     }
     else
     {
-        if (dnsEntry && dnsEntry->ipv4.size() && !dnsEntry->isIPv4Expired())
+        if (cachedipv4.size())
         {
-            LOG_debug << "DNS cache hit for " << httpctx->hostname << " (IPv4) " << dnsEntry->ipv4;
+            LOG_debug << "DNS cache hit for " << httpctx->hostname << " (IPv4) " << cachedipv4;
             httpctx->isIPv6 = false;
             httpctx->isCachedIp = true;
-            httpctx->hostip = dnsEntry->ipv4;
+            httpctx->hostip = cachedipv4;
             httpctx->ares_pending = 0;
             send_request(httpctx);
             return;
@@ -1800,13 +2576,117 @@ void CurlHttpIO::post(HttpReq* req, const char* data, unsigned len)
 }
 
 void CurlHttpIO::setproxy(Proxy* proxy)
+{
+    IOGuard g(this);
+    autoproxy = proxy->getProxyType() == Proxy::AUTO;
+    if (!autoproxy)
+    {
+        applyproxy(proxy);
+        return;
+    }
+
+    if (autoproxycached && Waiter::ds - autoproxytime < AUTOPROXY_TTL_DS)
+    {
+        applyproxy(autoproxyfailed ? NULL : autoproxycached.get());
+        return;
+    }
+
+    // don't hold the requests while the proxy is detected
+    autoproxyfailed = false;
+    applyproxy(NULL);
+    startautoproxy();
+}
+
+void CurlHttpIO::startautoproxy()
+{
+    if (autoproxyrunning)
+    {
+        return;
+    }
+
+    if (autoproxythread.joinable())
+    {
+        autoproxythread.join();
+    }
+
+    LOG_debug << "Detecting the proxy";
+    autoproxyrunning = true;
+    autoproxydone = false;
+
+    // no wakeup when it ends: requests go direct meanwhile, so the
+    // result can wait for the next call to doio()
+    autoproxythread = std::thread([this]()
+    {
+        Proxy* proxy = getautoproxy();
+
+        std::lock_guard<std::mutex> g(autoproxymutex);
+        autoproxyresult.reset(proxy);
+        autoproxydone = true;
+    });
+}
+
+// use the result of the proxy detection, or go direct after a failure of the detected proxy
+void CurlHttpIO::checkautoproxy()
+{
+    if (autoproxyrunning)
+    {
+        std::unique_ptr<Proxy> proxy;
+        {
+            std::lock_guard<std::mutex> g(autoproxymutex);
+            if (!autoproxydone)
+            {
+                return;
+            }
+            proxy = std::move(autoproxyresult);
+        }
+
+        autoproxythread.join();
+        autoproxyrunning = false;
+        autoproxytime = Waiter::ds;
+        autoproxycached = std::move(proxy);
+
+    #if defined(_WIN32) && !defined(WINDOWS_PHONE)
+        if (autoproxycached && autoproxycached->getProxyType() == Proxy::CUSTOM)
+        {
+            // the system returns a wide string
+            string url = autoproxycached->getProxyURL();
+            int wlen = int(wcsnlen((const wchar_t*)url.data(), url.size() / sizeof(wchar_t)));
+            string utf8;
+            utf8.resize(size_t(WideCharToMultiByte(CP_UTF8, 0, (LPCWSTR)url.data(), wlen, NULL, 0, NULL, NULL)));
+            WideCharToMultiByte(CP_UTF8, 0, (LPCWSTR)url.data(), wlen, (LPSTR)utf8.data(), int(utf8.size()), NULL, NULL);
+            autoproxycached->setProxyURL(&utf8);
+        }
+    #endif
+
+        bool found = autoproxycached && autoproxycached->getProxyType() == Proxy::CUSTOM;
+        string url = found ? autoproxycached->getProxyURL() : string();
+        LOG_info << (found ? "Detected proxy: " + url : string("No proxy detected"));
+
+        // a new detection gives the proxy another chance
+        autoproxyfailed = false;
+        if (url != proxyurl)
+        {
+            applyproxy(found ? autoproxycached.get() : NULL);
+        }
+    }
+    else if (autoproxyfailed && proxyurl.size())
+    {
+        LOG_warn << "The detected proxy is failing. Going direct";
+        applyproxy(NULL);
+    }
+    else if (Waiter::ds - autoproxytime >= AUTOPROXY_TTL_DS)
+    {
+        startautoproxy();
+    }
+}
+
+void CurlHttpIO::applyproxy(Proxy* proxy)
 {
     // clear the previous proxy IP
     proxyip.clear();
 
-    if (proxy->getProxyType() != Proxy::CUSTOM || !proxy->getProxyURL().size())
+    if (!proxy || proxy->getProxyType() != Proxy::CUSTOM || !proxy->getProxyURL().size())
     {
-        // automatic proxy is not supported
         // invalidate inflight proxy changes
         proxyscheme.clear();
         proxyhost.clear();
@@ -1848,6 +2728,7 @@ void CurlHttpIO::setproxy(Proxy* proxy)
 // cancel pending HTTP request
 void CurlHttpIO::cancel(HttpReq* req)
 {
+    IOGuard g(this);
     if (req->httpiohandle)
     {
         CurlHttpContext* httpctx = (CurlHttpContext*)req->httpiohandle;
@@ -1858,6 +2739,7 @@ void CurlHttpIO::cancel(HttpReq* req)
             curl_multi_remove_handle(curlm[httpctx->d], httpctx->curl);
             curl_easy_cleanup(httpctx->curl);
             curl_slist_free_all(httpctx->headers);
+            curl_slist_free_all(httpctx->resolve);
         }
 
         httpctx->req = NULL;
@@ -1869,6 +2751,11 @@ void CurlHttpIO::cancel(HttpReq* req)
 
         req->httpstatus = 0;
 
+        if (req->status == REQ_INFLIGHT)
+        {
+            Trace::asyncend("http", req);
+        }
+
         if (req->status != REQ_FAILURE)
         {
             req->status = REQ_FAILURE;
@@ -1882,6 +2769,7 @@ void CurlHttpIO::cancel(HttpReq* req)
 // real-time progress information on POST data
 m_off_t CurlHttpIO::postpos(void* handle)
 {
+    IOGuard g(this);
     double bytes = 0;
     CurlHttpContext* httpctx = (CurlHttpContext*)handle;
 
@@ -1896,9 +2784,16 @@ m_off_t CurlHttpIO::postpos(void* handle)
 // process events
 bool CurlHttpIO::doio()
 {
+    Trace::Span ts("doio");
+    IOGuard g(this);
     bool result;
     statechange = false;
 
+    if (autoproxy)
+    {
+        checkautoproxy();
+    }
+
     processaresevents();
     closearesevents();
 
@@ -1941,6 +2836,11 @@ bool CurlHttpIO::doio()
         }
     }
 
+    if (preconnects.size())
+    {
+        purgepreconnects();
+    }
+
     curlsocketsprocessed = true;
     return result;
 }
@@ -2027,6 +2927,17 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
                 curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &httpstatus);
                 req->httpstatus = int(httpstatus);
 
+                if (req->httpiohandle)
+                {
+                    CurlHttpContext* httpctx = (CurlHttpContext*)req->httpiohandle;
+                    addconnectinfo(httpctx, msg->easy_handle);
+                    addnetworkstats(httpctx, msg->easy_handle);
+                    if (httpctx->d != API)
+                    {
+                        hostsused[httpctx->d][hostkey(httpctx)] = Waiter::ds;
+                    }
+                }
+
                 LOG_debug << "CURLMSG_DONE with HTTP status: " << req->httpstatus << " from "
                           << (req->httpiohandle ? (((CurlHttpContext*)req->httpiohandle)->hostname + " - " + ((CurlHttpContext*)req->httpiohandle)->hostip) : "(unknown) ");
                 if (req->httpstatus)
@@ -2068,7 +2979,7 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
                 // check httpstatus and response length
                 req->status = (req->httpstatus == 200
                                && (req->contentlength < 0
-                                   || req->contentlength == (req->buf ? req->bufpos : (int)req->in.size())))
+                                   || req->contentlength == req->bufpos))
                         ? REQ_SUCCESS : REQ_FAILURE;
 
                 if (req->status == REQ_SUCCESS)
@@ -2094,39 +3005,51 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
             }
 
             statechange = true;
+            Trace::asyncend("http", req);
 
             if (req->status == REQ_FAILURE && !req->httpstatus)
             {
                 CurlHttpContext* httpctx = (CurlHttpContext*)req->httpiohandle;
                 if (httpctx)
                 {
-                    // remove the IP from the DNS cache
+                    // penalize the IP in the DNS cache, so that the next
+                    // preferred address of the host is used
+                    std::lock_guard<std::recursive_mutex> dnsguard(dnsmutex);
                     CurlDNSEntry &dnsEntry = dnscache[httpctx->hostname];
+                    string failedip = httpctx->hostip;
+                    if (httpctx->isIPv6 && failedip.size() > 2)
+                    {
+                        failedip = failedip.substr(1, failedip.size() - 2);
+                    }
+                    dnsEntry.failed(failedip);
 
                     if (httpctx->isIPv6)
                     {
-                        dnsEntry.ipv6.clear();
-                        dnsEntry.ipv6timestamp = 0;
+                        if (!dnsEntry.ipv6.size())
+                        {
+                            dnsEntry.ipv6timestamp = 0;
+                        }
                     }
-                    else
+                    else if (!dnsEntry.ipv4.size())
                     {
-                        dnsEntry.ipv4.clear();
                         dnsEntry.ipv4timestamp = 0;
                     }
 
-                    ipv6requestsenabled = !httpctx->isIPv6 && ipv6available();
+                    if (autoproxy && proxyurl.size())
+                    {
+                        // the next requests go direct (see checkautoproxy)
+                        autoproxyfailed = true;
+                    }
 
-                    if (ipv6requestsenabled)
+                    if (!httpctx->isIPv6 && ipv6available())
                     {
                         // change the protocol of the proxy after fails contacting
                         // MEGA servers with both protocols (IPv4 and IPv6)
-                        ipv6proxyenabled = !ipv6proxyenabled && ipv6available();
+                        ipv6proxyenabled = !ipv6proxyenabled;
                         request_proxy_ip();
                     }
                     else if (httpctx->isIPv6)
                     {
-                        ipv6deactivationtime = Waiter::ds;
-
                         // for IPv6 errors, try IPv4 before sending an error to the engine
                         if ((dnsEntry.ipv4.size() && !dnsEntry.isIPv4Expired())
                                 || (!httpctx->isCachedIp && httpctx->ares_pending))
@@ -2136,12 +3059,15 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
                             curl_multi_remove_handle(curlmhandle, msg->easy_handle);
                             curl_easy_cleanup(msg->easy_handle);
                             curl_slist_free_all(httpctx->headers);
+                            curl_slist_free_all(httpctx->resolve);
                             httpctx->isCachedIp = false;
                             httpctx->headers = NULL;
+                            httpctx->resolve = NULL;
                             httpctx->curl = NULL;
                             req->httpio = this;
                             req->in.clear();
                             req->status = REQ_INFLIGHT;
+                            Trace::asyncbegin("http", req);
 
                             if (dnsEntry.ipv4.size() && !dnsEntry.isIPv4Expired())
                             {
@@ -2180,6 +3106,7 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
                 pausedrequests[httpctx->d].erase(httpctx->curl);
 
                 curl_slist_free_all(httpctx->headers);
+                curl_slist_free_all(httpctx->resolve);
                 req->httpiohandle = NULL;
 
                 httpctx->req = NULL;
@@ -2225,6 +3152,7 @@ void CurlHttpIO::drop_pending_requests()
             httpctx->req->status = REQ_FAILURE;
             httpctx->req->httpiohandle = NULL;
             statechange = true;
+            Trace::asyncend("http", httpctx->req);
         }
 
         httpctx->req = NULL;
@@ -2446,6 +3374,11 @@ int CurlHttpIO::socket_callback(CURL *, curl_socket_t s, int what, void *userp,
             WSACloseEvent(handle);
             socketmap[s].handle = WSA_INVALID_EVENT;
         }
+#else
+        if (httpio->waiter)
+        {
+            httpio->waiter->watch(s, 0);
+        }
 #endif
         socketmap[s].mode = 0;
     }
@@ -2462,6 +3395,12 @@ int CurlHttpIO::socket_callback(CURL *, curl_socket_t s, int what, void *userp,
             WSACloseEvent (it->second.handle);
         }
         info.handle = WSA_INVALID_EVENT;
+#else
+        // registered right away, unless the direction is paused
+        if (httpio->waiter && !httpio->arerequestspaused[d])
+        {
+            httpio->waiter->watch(s, what);
+        }
 #endif
         socketmap[s] = info;
     }
@@ -2469,11 +3408,17 @@ int CurlHttpIO::socket_callback(CURL *, curl_socket_t s, int what, void *userp,
     return 0;
 }
 
-int CurlHttpIO::sockopt_callback(void *clientp, curl_socket_t, curlsocktype)
+int CurlHttpIO::sockopt_callback(void *clientp, curl_socket_t curlfd, curlsocktype purpose)
 {
     HttpReq *req = (HttpReq*)clientp;
     CurlHttpIO* httpio = (CurlHttpIO*)req->httpio;
     CurlHttpContext* httpctx = (CurlHttpContext*)req->httpiohandle;
+
+    if (httpio && httpctx && purpose == CURLSOCKTYPE_IPCXN)
+    {
+        httpio->tunesocket(curlfd, httpctx->d);
+    }
+
     if (httpio && !httpio->disconnecting
             && httpctx && httpctx->isCachedIp && !httpctx->ares_pending)
     {
@@ -2492,6 +3437,78 @@ int CurlHttpIO::sockopt_callback(void *clientp, curl_socket_t, curlsocktype)
     return CURL_SOCKOPT_OK;
 }
 
+// apply the socket options of the direction before connecting, and log the values
+// that are actually in effect (the kernel may adjust or cap them)
+void CurlHttpIO::tunesocket(curl_socket_t s, direction_t d)
+{
+    const SocketOptions& options = sockopts[d];
+    if (!options.rcvbuf && !options.sndbuf && !options.notsentlowat && !options.congestion.size())
+    {
+        return;
+    }
+
+    std::ostringstream oss;
+    int value;
+    socklen_t len;
+
+    if (options.rcvbuf)
+    {
+        value = options.rcvbuf;
+        setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&value, sizeof value);
+        len = sizeof value;
+        if (!getsockopt(s, SOL_SOCKET, SO_RCVBUF, (char*)&value, &len))
+        {
+            oss << " SO_RCVBUF=" << value;
+        }
+    }
+
+    if (options.sndbuf)
+    {
+        value = options.sndbuf;
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&value, sizeof value);
+        len = sizeof value;
+        if (!getsockopt(s, SOL_SOCKET, SO_SNDBUF, (char*)&value, &len))
+        {
+            oss << " SO_SNDBUF=" << value;
+        }
+    }
+
+    if (options.notsentlowat)
+    {
+#ifdef TCP_NOTSENT_LOWAT
+        value = options.notsentlowat;
+        setsockopt(s, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (const char*)&value, sizeof value);
+        len = sizeof value;
+        if (!getsockopt(s, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (char*)&value, &len))
+        {
+            oss << " TCP_NOTSENT_LOWAT=" << value;
+        }
+#else
+        oss << " TCP_NOTSENT_LOWAT=unsupported";
+#endif
+    }
+
+    if (options.congestion.size())
+    {
+#ifdef TCP_CONGESTION
+        char algorithm[16] = { 0 };
+        if (setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, options.congestion.c_str(), socklen_t(options.congestion.size())))
+        {
+            oss << " (" << options.congestion << " rejected)";
+        }
+        len = sizeof algorithm - 1;
+        if (!getsockopt(s, IPPROTO_TCP, TCP_CONGESTION, algorithm, &len))
+        {
+            oss << " TCP_CONGESTION=" << algorithm;
+        }
+#else
+        oss << " TCP_CONGESTION=unsupported";
+#endif
+    }
+
+    LOG_debug << "Socket options (" << (d == API ? "API" : (d == GET ? "GET" : "PUT")) << "):" << oss.str();
+}
+
 int CurlHttpIO::api_socket_callback(CURL *e, curl_socket_t s, int what, void *userp, void *socketp)
 {
     return socket_callback(e, s, what, userp, socketp, API);
@@ -2687,6 +3704,127 @@ bool CurlDNSEntry::isIPv6Expired()
     return (DNS_CACHE_EXPIRES && (Waiter::ds - ipv6timestamp) >= DNS_CACHE_TIMEOUT_DS);
 }
 
+bool CurlDNSEntry::setaddresses(bool isIPv6, const std::vector<string>& ips)
+{
+    std::vector<Address>& addrs = isIPv6 ? ipv6addrs : ipv4addrs;
+    const string& preferred = isIPv6 ? ipv6 : ipv4;
+    std::vector<Address> newaddrs;
+    bool found = false;
+
+    for (size_t i = 0; i < ips.size(); i++)
+    {
+        Address addr;
+        addr.ip = ips[i];
+        addr.rtt = -1;
+        addr.failtime = 0;
+
+        for (size_t j = 0; j < addrs.size(); j++)
+        {
+            if (addrs[j].ip == ips[i])
+            {
+                addr = addrs[j];
+                break;
+            }
+        }
+
+        if (ips[i] == preferred)
+        {
+            found = true;
+        }
+        newaddrs.push_back(addr);
+    }
+
+    addrs.swap(newaddrs);
+    select(isIPv6);
+    return found;
+}
+
+CurlDNSEntry::Address* CurlDNSEntry::find(const string& ip, bool* isIPv6)
+{
+    for (int f = 0; f < 2; f++)
+    {
+        std::vector<Address>& addrs = f ? ipv6addrs : ipv4addrs;
+        for (size_t i = 0; i < addrs.size(); i++)
+        {
+            if (addrs[i].ip == ip)
+            {
+                *isIPv6 = f != 0;
+                return &addrs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+void CurlDNSEntry::connected(const string& ip, int ms)
+{
+    bool isIPv6;
+    Address* addr = find(ip, &isIPv6);
+    if (!addr || ms < 0)
+    {
+        return;
+    }
+
+    // smoothed like TCP's SRTT
+    addr->rtt = addr->rtt < 0 ? ms : (addr->rtt * 7 + ms) / 8;
+    addr->failtime = 0;
+    select(isIPv6);
+}
+
+void CurlDNSEntry::failed(const string& ip)
+{
+    bool isIPv6;
+    Address* addr = find(ip, &isIPv6);
+    if (!addr)
+    {
+        return;
+    }
+
+    LOG_debug << "Connection to " << ip << " failed. Avoiding it for a while";
+    addr->failtime = Waiter::ds ? Waiter::ds : 1;
+    select(isIPv6);
+}
+
+void CurlDNSEntry::select(bool isIPv6)
+{
+    std::vector<Address>& addrs = isIPv6 ? ipv6addrs : ipv4addrs;
+    string& preferred = isIPv6 ? ipv6 : ipv4;
+    const Address* current = NULL;
+    const Address* best = NULL;
+
+    for (size_t i = 0; i < addrs.size(); i++)
+    {
+        const Address& addr = addrs[i];
+        if (addr.failtime && Waiter::ds - addr.failtime < FAILED_IP_RETRY_INTERVAL_DS)
+        {
+            continue;
+        }
+
+        if (addr.ip == preferred)
+        {
+            current = &addr;
+        }
+
+        // addresses not measured yet are tried first, then the fastest one is used
+        if (!best
+                || (addr.rtt < 0 && best->rtt >= 0)
+                || (addr.rtt >= 0 && best->rtt >= 0 && addr.rtt < best->rtt))
+        {
+            best = &addr;
+        }
+    }
+
+    // keep the current address (and its open connections) unless another
+    // one is clearly faster
+    if (current && best && current->rtt >= 0 && best->rtt >= 0
+            && best->rtt * 4 > current->rtt * 3)
+    {
+        best = current;
+    }
+
+    preferred = best ? best->ip : string();
+}
+
 SockInfo::SockInfo()
 {
     fd = curl_socket_t(-1);
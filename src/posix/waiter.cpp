@@ -39,12 +39,32 @@ PosixWaiter::PosixWaiter()
     }
 
     maxfd = -1;
+
+#if defined(MEGA_EPOLL)
+    pollfd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(MEGA_KQUEUE)
+    pollfd = kqueue();
+#else
+    pollfd = -1;
+#endif
+
+#if defined(MEGA_EPOLL) || defined(MEGA_KQUEUE)
+    if (pollfd < 0)
+    {
+        LOG_warn << "Unable to create the socket poller: " << errno << ". Using select()";
+    }
+#endif
 }
 
 PosixWaiter::~PosixWaiter()
 {
     close(m_pipe[0]);
     close(m_pipe[1]);
+
+    if (pollfd >= 0)
+    {
+        close(pollfd);
+    }
 }
 
 void PosixWaiter::init(dstime ds)
@@ -57,6 +77,161 @@ void PosixWaiter::init(dstime ds)
     FD_ZERO(&wfds);
     FD_ZERO(&efds);
     FD_ZERO(&ignorefds);
+
+    std::lock_guard<std::mutex> g(watchMutex);
+    readyfds.clear();
+}
+
+void PosixWaiter::watch(int fd, int mode)
+{
+    std::lock_guard<std::mutex> g(watchMutex);
+
+    std::unordered_map<int, int>::iterator it = watched.find(fd);
+    int oldmode = it == watched.end() ? 0 : it->second;
+    if (mode == oldmode)
+    {
+        return;
+    }
+
+    if (pollfd >= 0 && !setkernelwatch(fd, oldmode, mode))
+    {
+        // not recorded: the next call for this fd tries again
+        LOG_err << "Unable to watch fd " << fd << ": " << errno;
+        return;
+    }
+
+    if (mode)
+    {
+        watched[fd] = mode;
+    }
+    else
+    {
+        watched.erase(it);
+        readyfds.erase(fd);
+    }
+}
+
+int PosixWaiter::ready(int fd) const
+{
+    std::lock_guard<std::mutex> g(watchMutex);
+
+    std::unordered_map<int, int>::const_iterator it = readyfds.find(fd);
+    return it == readyfds.end() ? 0 : it->second;
+}
+
+// the kernel drops the fds closed since they were added, so their numbers may
+// come back as new fds: an unexpected (non-)registration is retried the other way
+bool PosixWaiter::setkernelwatch(int fd, int oldmode, int mode)
+{
+#if defined(MEGA_EPOLL)
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof ev);
+    if (mode & WATCH_READ)
+    {
+        ev.events |= EPOLLIN;
+    }
+    if (mode & WATCH_WRITE)
+    {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = fd;
+
+    if (!mode)
+    {
+        return !epoll_ctl(pollfd, EPOLL_CTL_DEL, fd, &ev) || errno == ENOENT || errno == EBADF;
+    }
+
+    if (!epoll_ctl(pollfd, oldmode ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev))
+    {
+        return true;
+    }
+
+    if (errno == ENOENT)
+    {
+        return !epoll_ctl(pollfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    if (errno == EEXIST)
+    {
+        return !epoll_ctl(pollfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    return false;
+#elif defined(MEGA_KQUEUE)
+    // EV_ADD also updates an existing filter, and deletions of filters that
+    // are gone with their fd don't matter
+    static const int filters[] = { EVFILT_READ, EVFILT_WRITE };
+    static const int modes[] = { WATCH_READ, WATCH_WRITE };
+
+    struct kevent changes[2];
+    int n = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        if (mode & modes[i])
+        {
+            EV_SET(&changes[n++], fd, filters[i], EV_ADD, 0, 0, 0);
+        }
+        else if (oldmode & modes[i])
+        {
+            struct kevent change;
+            EV_SET(&change, fd, filters[i], EV_DELETE, 0, 0, 0);
+            kevent(pollfd, &change, 1, NULL, 0, NULL);
+        }
+    }
+
+    return !n || !kevent(pollfd, changes, n, NULL, 0, NULL);
+#else
+    (void)fd;
+    (void)oldmode;
+    (void)mode;
+    return false;
+#endif
+}
+
+// harvest the watched fds that a wait() found ready
+void PosixWaiter::collectready()
+{
+    std::lock_guard<std::mutex> g(watchMutex);
+
+    if (pollfd < 0)
+    {
+        for (std::unordered_map<int, int>::iterator it = watched.begin(); it != watched.end(); it++)
+        {
+            int mode = (FD_ISSET(it->first, &rfds) ? WATCH_READ : 0) | (FD_ISSET(it->first, &wfds) ? WATCH_WRITE : 0);
+            if (mode)
+            {
+                readyfds[it->first] = mode;
+            }
+        }
+        return;
+    }
+
+    if (!FD_ISSET(pollfd, &rfds))
+    {
+        return;
+    }
+
+#if defined(MEGA_EPOLL)
+    std::vector<struct epoll_event> events(watched.size() + 1);
+    int n = epoll_wait(pollfd, events.data(), int(events.size()), 0);
+    for (int i = 0; i < n; i++)
+    {
+        int mode = ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ? WATCH_READ : 0)
+                 | ((events[i].events & (EPOLLOUT | EPOLLERR)) ? WATCH_WRITE : 0);
+        readyfds[events[i].data.fd] |= mode;
+    }
+#elif defined(MEGA_KQUEUE)
+    std::vector<struct kevent> events(2 * watched.size() + 1);
+    struct timespec zero = { 0, 0 };
+    int n = kevent(pollfd, NULL, 0, events.data(), int(events.size()), &zero);
+    for (int i = 0; i < n; i++)
+    {
+        if (!(events[i].flags & EV_ERROR))
+        {
+            readyfds[int(events[i].ident)] |= events[i].filter == EVFILT_WRITE ? WATCH_WRITE : WATCH_READ;
+        }
+    }
+#endif
 }
 
 // update monotonously increasing timestamp in deciseconds
@@ -102,6 +277,31 @@ int PosixWaiter::wait()
     FD_SET(m_pipe[0], &rfds);
     bumpmaxfd(m_pipe[0]);
 
+    // the watched fds, through the poller if there is one
+    {
+        std::lock_guard<std::mutex> g(watchMutex);
+        if (pollfd >= 0)
+        {
+            FD_SET(pollfd, &rfds);
+            bumpmaxfd(pollfd);
+        }
+        else
+        {
+            for (std::unordered_map<int, int>::iterator it = watched.begin(); it != watched.end(); it++)
+            {
+                if (it->second & WATCH_READ)
+                {
+                    FD_SET(it->first, &rfds);
+                }
+                if (it->second & WATCH_WRITE)
+                {
+                    FD_SET(it->first, &wfds);
+                }
+                bumpmaxfd(it->first);
+            }
+        }
+    }
+
     if (maxds + 1)
     {
         dstime us = 1000000 / 10 * maxds;
@@ -112,6 +312,11 @@ int PosixWaiter::wait()
 
     numfd = select(maxfd + 1, &rfds, &wfds, &efds, maxds + 1 ? &tv : NULL);
 
+    if (numfd > 0)
+    {
+        collectready();
+    }
+
     // empty pipe
     uint8_t buf;
     bool external = false;
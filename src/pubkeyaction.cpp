@@ -105,6 +105,7 @@ void PubKeyActionCreateShare::proc(MegaClient* client, User* u)
         client->rng.genblock(key, sizeof key);
 
         n->sharekey = new SymmCipher(key);
+        client->sharekeyarrived(n->nodehandle);
     }
 
     // we have all ingredients ready: the target user's public key, the share
@@ -27,6 +27,17 @@
 
 #undef min //avoids issues with std::min
 
+// a raid sector is exactly one 128-bit register
+#ifndef MEGA_RAID_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MEGA_RAID_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MEGA_RAID_NEON 1
+#endif
+#endif
+
 namespace mega
 {
 
@@ -114,8 +125,13 @@ RaidBufferManager::FilePiece::FilePiece()
 
 RaidBufferManager::FilePiece::FilePiece(m_off_t p, size_t len)
     : pos(p)
-    , buf(new byte[len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR)], 0, len)   // SymmCipher::ctr_crypt requirement: decryption: data must be padded to BLOCKSIZE.  Also make sure we can xor up to RAIDSECTOR more for convenience
+    , buf(NULL, 0, 0)
 {
+    // SymmCipher::ctr_crypt requirement: decryption: data must be padded to BLOCKSIZE.  Also make sure we can xor up to RAIDSECTOR more for convenience
+    size_t capacity;
+    byte* b = HttpBufferPool::allocate(len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR), &capacity);
+    HttpReq::http_buf_t pooled(b, 0, len, capacity);
+    buf.swap(pooled);
 }
 
 
@@ -127,11 +143,32 @@ RaidBufferManager::FilePiece::FilePiece(m_off_t p, HttpReq::http_buf_t* b) // ta
     delete b;  // client no longer owns it so we must delete.  Similar to move semantics where we would just assign
 }
 
+RaidBufferManager::FilePiece::~FilePiece()
+{
+    // the worker may still be writing to the buffer
+    waitFinalized();
+}
+
+bool RaidBufferManager::FilePiece::isFinalized()
+{
+    return !finalizing || finalizing->finished();
+}
+
+void RaidBufferManager::FilePiece::waitFinalized()
+{
+    if (finalizing)
+    {
+        finalizing->wait();
+        finalizing.reset();
+    }
+}
+
 void RaidBufferManager::FilePiece::swap(FilePiece& other)
 {
     m_off_t tp = pos; pos = other.pos; other.pos = tp;
     chunkmacs.swap(other.chunkmacs);
     buf.swap(other.buf);
+    finalizing.swap(other.finalizing);
 }
 
 RaidBufferManager::RaidBufferManager()
@@ -176,7 +213,7 @@ RaidBufferManager::~RaidBufferManager()
 
 void RaidBufferManager::setIsRaid(const std::vector<std::string>& tempUrls, m_off_t resumepos, m_off_t readtopos, m_off_t filesize, m_off_t maxRequestSize)
 {
-    assert(tempUrls.size() == RAIDPARTS || tempUrls.size() == 1);
+    assert(!tempUrls.empty());
     assert(0 <= resumepos && resumepos <= readtopos && readtopos <= filesize);
     assert(!raidKnown);
 
@@ -184,6 +221,8 @@ void RaidBufferManager::setIsRaid(const std::vector<std::string>& tempUrls, m_of
 
     is_raid = tempurls.size() == RAIDPARTS;
     raidKnown = true;
+    sources.assign(is_raid ? 0 : tempurls.size(), Source());
+    connectionsources.clear();
     fullfilesize = filesize;
     deliverlimitpos = readtopos;
     acquirelimitpos = deliverlimitpos + RAIDLINE - 1;
@@ -250,6 +289,10 @@ const std::string& RaidBufferManager::tempURL(unsigned connectionNum)
         assert(connectionNum < tempurls.size());
         return tempurls[connectionNum];
     }
+    else if (tempurls.size() > 1)
+    {
+        return tempurls[connectionSource(connectionNum)];
+    }
     else if (!tempurls.empty())
     {
         return tempurls[0];
@@ -266,6 +309,109 @@ const std::vector<std::string>& RaidBufferManager::tempUrlVector() const
     return tempurls;
 }
 
+unsigned RaidBufferManager::sourceCount() const
+{
+    return sources.empty() ? 1 : unsigned(sources.size());
+}
+
+unsigned RaidBufferManager::connectionSource(unsigned connectionNum)
+{
+    std::map<unsigned, unsigned>::iterator it = connectionsources.find(connectionNum);
+    if (it == connectionsources.end())
+    {
+        // spread the connections over the sources to start with
+        unsigned source = connectionNum % unsigned(sources.size());
+        if (sources[source].unusable)
+        {
+            source = bestSource(source);
+        }
+        it = connectionsources.insert(std::make_pair(connectionNum, source)).first;
+    }
+    return it->second;
+}
+
+unsigned RaidBufferManager::bestSource(unsigned excludedSource)
+{
+    unsigned best = excludedSource;
+    for (unsigned i = 0; i < sources.size(); i++)
+    {
+        if (i == excludedSource || sources[i].unusable)
+        {
+            continue;
+        }
+
+        // unmeasured first, then by throughput, then by fewer recent failures
+        if (best == excludedSource
+         || (sources[i].rate < 0 && sources[best].rate >= 0)
+         || ((sources[i].rate < 0) == (sources[best].rate < 0)
+             && (sources[i].rate > sources[best].rate
+                 || (sources[i].rate == sources[best].rate && sources[i].failures < sources[best].failures))))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void RaidBufferManager::sourceRequestDone(unsigned connectionNum, m_off_t bytes, dstime duration)
+{
+    if (sources.size() < 2)
+    {
+        return;
+    }
+
+    unsigned source = connectionSource(connectionNum);
+    Source& s = sources[source];
+    double rate = double(bytes) / std::max<dstime>(duration, 1);
+    s.rate = s.rate < 0 ? rate : (s.rate * 3 + rate) / 4;
+    s.failures = 0;
+
+    // move on if another source does clearly better (or hasn't been tried yet)
+    unsigned best = bestSource(source);
+    if (best != source && (sources[best].rate < 0 || sources[best].rate > s.rate * 3 / 2))
+    {
+        LOG_debug << "Connection " << connectionNum << " switching from source " << source << " (" << m_off_t(s.rate * 10) << " B/s) to "
+                  << best << " (" << m_off_t(sources[best].rate * 10) << " B/s)";
+        connectionsources[connectionNum] = best;
+    }
+}
+
+bool RaidBufferManager::sourceRequestFailed(unsigned connectionNum, bool unusable)
+{
+    if (sources.size() < 2)
+    {
+        return false;
+    }
+
+    unsigned source = connectionSource(connectionNum);
+    Source& s = sources[source];
+    s.failures++;
+    s.rate = s.rate < 0 ? 0 : s.rate / 2;
+    if (unusable)
+    {
+        s.unusable = true;
+    }
+
+    unsigned best = bestSource(source);
+    if (best == source)
+    {
+        return false;
+    }
+
+    LOG_debug << "Connection " << connectionNum << " leaving source " << source << " after a failure" << (unusable ? " (unusable)" : "");
+    connectionsources[connectionNum] = best;
+    return true;
+}
+
+const std::string& RaidBufferManager::alternativeTempURL(unsigned connectionNum)
+{
+    if (isRaid() || sources.size() < 2)
+    {
+        return tempURL(connectionNum);
+    }
+    return tempurls[bestSource(connectionSource(connectionNum))];
+}
+
 // takes ownership of the buffer
 void RaidBufferManager::submitBuffer(unsigned connectionNum, FilePiece* piece)
 {
@@ -537,30 +683,107 @@ RaidBufferManager::FilePiece* RaidBufferManager::combineRaidParts(size_t partsle
         }
 
         byte* b = result->buf.datastart() + prevleftoverchunk.buf.datalen();
-        byte* endpos = b + partslen * (RAIDPARTS-1);
+        assert(b + partslen * (RAIDPARTS-1) <= result->buf.datastart() + result->buf.datalen());
+
+        combineParts(b, inputbufs, partslen);
+    }
+    return result;
+}
+
+void RaidBufferManager::combineParts(byte* dest, byte* const inputbufs[], size_t partslen)
+{
+    assert(partslen % RAIDSECTOR == 0);
 
-        for (unsigned i = 0; b < endpos; i += RAIDSECTOR)
+#if defined(MEGA_RAID_SSE2) || defined(MEGA_RAID_NEON)
+    // at most one part is missing: it's either the parity, and the data parts are just
+    // interleaved, or a data part, rebuilt as the XOR of the other five parts
+    unsigned missing = 0;
+    for (unsigned j = 1; j < RAIDPARTS; ++j)
+    {
+        if (!inputbufs[j])
+        {
+            missing = j;
+        }
+    }
+
+    if (!missing)
+    {
+        for (size_t i = 0; i < partslen; i += RAIDSECTOR)
         {
             for (unsigned j = 1; j < RAIDPARTS; ++j)
             {
-                assert(b + RAIDSECTOR <= result->buf.datastart() + result->buf.datalen());
-                if (inputbufs[j])
-                {
-                    memcpy(b, inputbufs[j] + i, RAIDSECTOR);
-                }
-                else
-                {
-                    recoverSectorFromParity(b, inputbufs, i);
-                }
-                b += RAIDSECTOR;
+#if defined(MEGA_RAID_SSE2)
+                _mm_storeu_si128((__m128i*)dest, _mm_loadu_si128((const __m128i*)(inputbufs[j] + i)));
+#else
+                vst1q_u8(dest, vld1q_u8(inputbufs[j] + i));
+#endif
+                dest += RAIDSECTOR;
             }
         }
-        assert(b == endpos);
+        return;
+    }
+
+    const byte* present[RAIDPARTS - 1];
+    for (unsigned j = 0, k = 0; j < RAIDPARTS; ++j)
+    {
+        if (j != missing)
+        {
+            assert(inputbufs[j]);
+            present[k++] = inputbufs[j];
+        }
+    }
+
+    for (size_t i = 0; i < partslen; i += RAIDSECTOR)
+    {
+#if defined(MEGA_RAID_SSE2)
+        __m128i recovered = _mm_loadu_si128((const __m128i*)(present[0] + i));
+        for (unsigned k = 1; k < RAIDPARTS - 1; ++k)
+        {
+            recovered = _mm_xor_si128(recovered, _mm_loadu_si128((const __m128i*)(present[k] + i)));
+        }
+#else
+        uint8x16_t recovered = vld1q_u8(present[0] + i);
+        for (unsigned k = 1; k < RAIDPARTS - 1; ++k)
+        {
+            recovered = veorq_u8(recovered, vld1q_u8(present[k] + i));
+        }
+#endif
+
+        for (unsigned j = 1; j < RAIDPARTS; ++j)
+        {
+#if defined(MEGA_RAID_SSE2)
+            _mm_storeu_si128((__m128i*)dest, j == missing ? recovered : _mm_loadu_si128((const __m128i*)(inputbufs[j] + i)));
+#else
+            vst1q_u8(dest, j == missing ? recovered : vld1q_u8(inputbufs[j] + i));
+#endif
+            dest += RAIDSECTOR;
+        }
+    }
+#else
+    combinePartsScalar(dest, inputbufs, partslen);
+#endif
+}
+
+void RaidBufferManager::combinePartsScalar(byte* dest, byte* const inputbufs[], size_t partslen)
+{
+    for (size_t i = 0; i < partslen; i += RAIDSECTOR)
+    {
+        for (unsigned j = 1; j < RAIDPARTS; ++j)
+        {
+            if (inputbufs[j])
+            {
+                memcpy(dest, inputbufs[j] + i, RAIDSECTOR);
+            }
+            else
+            {
+                recoverSectorFromParity(dest, inputbufs, i);
+            }
+            dest += RAIDSECTOR;
+        }
     }
-    return result;
 }
 
-void RaidBufferManager::recoverSectorFromParity(byte* dest, byte* inputbufs[], unsigned offset)
+void RaidBufferManager::recoverSectorFromParity(byte* dest, byte* const inputbufs[], size_t offset)
 {
     assert(sizeof(m_off_t)*2 == RAIDSECTOR);
     bool set = false;
@@ -641,6 +864,95 @@ m_off_t TransferBufferManager::calcOutputChunkPos(m_off_t acquiredpos)
 }
 
 // decrypt, mac downloaded chunk
+// decryption of a downloaded piece: the MACs of its chunks start from the state
+// the transfer had when the piece was finalized, and are stored in the piece
+struct DecryptPieceJob : public CryptoWorkers::Job
+{
+    struct Segment
+    {
+        byte* data;
+        m_off_t startpos;
+        m_off_t endpos;
+        bool lastinchunk;
+        ChunkMAC* chunkmac;
+    };
+
+    byte key[SymmCipher::KEYLENGTH];
+    uint64_t ctriv;
+    vector<Segment> segments;
+
+    // first segment of each part: every segment has its own ChunkMAC, so
+    // parts can be decrypted concurrently
+    vector<size_t> parts;
+
+    // splits the segments in up to maxparts parts of similar size
+    void split(unsigned maxparts)
+    {
+        m_off_t total = 0;
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            total += segments[i].endpos - segments[i].startpos;
+        }
+
+        m_off_t partsize = total / (maxparts ? maxparts : 1);
+        m_off_t size = 0;
+
+        parts.clear();
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            if (i == 0 || size >= partsize)
+            {
+                parts.push_back(i);
+                size = 0;
+            }
+            size += segments[i].endpos - segments[i].startpos;
+        }
+    }
+
+    void decrypt(SymmCipher* cipher)
+    {
+        decrypt(cipher, 0, segments.size());
+    }
+
+    void decrypt(SymmCipher* cipher, size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            Segment& s = segments[i];
+            ChunkMAC& chunkmac = *s.chunkmac;
+            unsigned chunksize = static_cast<unsigned>(s.endpos - s.startpos);
+
+            cipher->ctr_crypt(s.data, chunksize, s.startpos, ctriv, chunkmac.mac, false, !chunkmac.finished && !chunkmac.offset);
+            if (s.lastinchunk)
+            {
+                LOG_debug << "Finished chunk: " << s.startpos << " - " << s.endpos << "   Size: " << chunksize;
+                chunkmac.finished = true;
+                chunkmac.offset = 0;
+            }
+            else
+            {
+                LOG_debug << "Decrypted partial chunk: " << s.startpos << " - " << s.endpos << "   Size: " << chunksize;
+                chunkmac.finished = false;
+                chunkmac.offset += chunksize;
+            }
+        }
+    }
+
+    void run() override
+    {
+        SymmCipher cipher;
+        cipher.setkey(key);
+        decrypt(&cipher);
+    }
+
+    void run(unsigned part) override
+    {
+        SymmCipher cipher;
+        cipher.setkey(key);
+        decrypt(&cipher, parts[part], part + 1 < parts.size() ? parts[part + 1] : segments.size());
+    }
+};
+
 void TransferBufferManager::finalize(FilePiece& r)
 {
     byte *chunkstart = r.buf.datastart();
@@ -652,9 +964,12 @@ void TransferBufferManager::finalize(FilePiece& r)
         finalpos &= -SymmCipher::BLOCKSIZE;
     }
 
+    std::shared_ptr<DecryptPieceJob> job = std::make_shared<DecryptPieceJob>();
+    job->ctriv = transfer->ctriv;
+
+    // the transfer's MACs are only read here, on the SDK thread
     m_off_t endpos = ChunkedHash::chunkceil(startpos, finalpos);
     unsigned chunksize = static_cast<unsigned>(endpos - startpos);
-    SymmCipher *cipher = transfer->transfercipher();
     while (chunksize)
     {
         m_off_t chunkid = ChunkedHash::chunkfloor(startpos);
@@ -662,25 +977,28 @@ void TransferBufferManager::finalize(FilePiece& r)
         if (!chunkmac.finished)
         {
             chunkmac = transfer->chunkmacs[chunkid];
-            cipher->ctr_crypt(chunkstart, chunksize, startpos, transfer->ctriv, chunkmac.mac, false, !chunkmac.finished && !chunkmac.offset);
-            if (endpos == ChunkedHash::chunkceil(chunkid, transfer->size))
-            {
-                LOG_debug << "Finished chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
-                chunkmac.finished = true;
-                chunkmac.offset = 0;
-            }
-            else
-            {
-                LOG_debug << "Decrypted partial chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
-                chunkmac.finished = false;
-                chunkmac.offset += chunksize;
-            }
+
+            DecryptPieceJob::Segment s = { chunkstart, startpos, endpos,
+                                           endpos == ChunkedHash::chunkceil(chunkid, transfer->size), &chunkmac };
+            job->segments.push_back(s);
         }
         chunkstart += chunksize;
         startpos = endpos;
         endpos = ChunkedHash::chunkceil(startpos, finalpos);
         chunksize = static_cast<unsigned>(endpos - startpos);
     }
+
+    CryptoWorkers* workers = transfer->client->cryptoworkers.get();
+    if (!workers || job->segments.empty())
+    {
+        job->decrypt(transfer->transfercipher());
+        return;
+    }
+
+    memcpy(job->key, transfer->transfercipher()->key, sizeof job->key);
+    job->split(workers->size());
+    r.finalizing = job;
+    workers->submit(job, unsigned(job->parts.size()));
 }
 
 
@@ -793,6 +1111,33 @@ m_off_t RaidBufferManager::progress() const
     return reportPos;
 }
 
+size_t RaidBufferManager::bufferedBytes() const
+{
+    auto piecebytes = [](const FilePiece& p) {
+        return sizeof(FilePiece) + p.buf.end + MemoryUsage::tree(p.chunkmacs);
+    };
+
+    size_t bytes = piecebytes(leftoverchunk) - sizeof(FilePiece);
+
+    for (unsigned j = RAIDPARTS; j--; )
+    {
+        for (const FilePiece* p : raidinputparts[j])
+        {
+            bytes += piecebytes(*p);
+        }
+    }
+
+    for (auto& it : asyncoutputbuffers)
+    {
+        if (it.second)
+        {
+            bytes += piecebytes(*it.second);
+        }
+    }
+
+    return bytes;
+}
+
 
 TransferBufferManager::TransferBufferManager()
     : transfer(NULL)
@@ -36,15 +36,32 @@ size_t Request::size() const
     return cmds.size();
 }
 
+Command* Request::single() const
+{
+    return cmds.size() == 1 ? cmds[0] : nullptr;
+}
+
 void Request::get(string* req, bool& suppressSID) const
 {
-    // concatenate all command objects, resulting in an API request
-    *req = "[";
+    // concatenate all command objects, resulting in an API request,
+    // written straight into the outgoing buffer sized up front
+    size_t len = 2;
 
     for (int i = 0; i < (int)cmds.size(); i++)
     {
+        len += cmds[i]->getjson().size() + 3;
+    }
+
+    req->clear();
+    req->reserve(len);
+    req->append("[");
+
+    for (int i = 0; i < (int)cmds.size(); i++)
+    {
+        const string& json = cmds[i]->getjson();
+
         req->append(i ? ",{" : "{");
-        req->append(cmds[i]->getstring());
+        req->append(json.data(), json.size());
         req->append("}");
         suppressSID = suppressSID && cmds[i]->suppressSID;
     }
@@ -53,12 +70,17 @@ void Request::get(string* req, bool& suppressSID) const
 }
 
 void Request::process(MegaClient* client)
+{
+    process(client, cmds.size());
+}
+
+void Request::process(MegaClient* client, size_t upto)
 {
     DBTableTransactionCommitter committer(client->tctable);
     client->mTctableRequestCommitter = &committer;
 
     client->json = json;
-    for (; processindex < cmds.size() && !stopProcessing; processindex++)
+    for (; processindex < upto && processindex < cmds.size() && !stopProcessing; processindex++)
     {
         Command* cmd = cmds[processindex];
 
@@ -101,7 +123,7 @@ void Request::process(MegaClient* client)
 
 void Request::serverresponse(std::string&& movestring, MegaClient* client)
 {
-    assert(processindex == 0);
+    // the results before processindex were consumed by serverpartial()
     jsonresponse = std::move(movestring);
     json.begin(jsonresponse.c_str());
 
@@ -111,6 +133,91 @@ void Request::serverresponse(std::string&& movestring, MegaClient* client)
     }
 }
 
+void Request::serverpartial(HttpReq* req, MegaClient* client, bool complete)
+{
+    if (streamstate == STREAM_OFF || cmds.size() < 2 || (complete && streamstate == STREAM_START && !processindex))
+    {
+        return;
+    }
+
+    const char* data = req->data();
+    const char* end = data + req->size();
+    const char* ptr = data + streampos;
+
+    if (streamstate == STREAM_START)
+    {
+        if (ptr == end)
+        {
+            return;
+        }
+
+        if (*ptr != '[')
+        {
+            // an error for the whole batch
+            streamstate = STREAM_OFF;
+            return;
+        }
+
+        streamstate = STREAM_ON;
+        ptr++;
+    }
+
+    // a resent batch gets the same response again: the results processed
+    // already are skipped, the new ones are gathered for processing
+    string results;
+    while (streamindex + 1 < cmds.size() && (!complete || streamindex < processindex))
+    {
+        const char* value = (ptr < end && *ptr == ',') ? ptr + 1 : ptr;
+        const char* valueend = (value < end && *value != ']') ? JSON::valueend(value, end) : NULL;
+        if (!valueend)
+        {
+            break;
+        }
+
+        if (streamindex >= processindex)
+        {
+            results.append(results.empty() ? "[" : ",");
+            results.append(value, size_t(valueend - value));
+        }
+
+        ptr = valueend;
+        streamindex++;
+    }
+
+    if (complete)
+    {
+        string response("[");
+        response.append((ptr < end && *ptr == ',') ? ptr + 1 : ptr, end);
+        req->in.swap(response);
+        req->inpurge = 0;
+        streamstate = STREAM_START;
+        streampos = 0;
+        streamindex = 0;
+        return;
+    }
+
+    streampos = size_t(ptr - data);
+    if (streampos > 65536 && req->httpio && req->httpio->purgesinflight())
+    {
+        // release the consumed part of the response
+        req->purge(streampos);
+        streampos = 0;
+    }
+
+    if (results.size())
+    {
+        results.append("]");
+        jsonresponse = std::move(results);
+        json.begin(jsonresponse.c_str());
+        json.enterarray();
+
+        process(client, streamindex);
+
+        jsonresponse.clear();
+        json.pos = NULL;
+    }
+}
+
 void Request::servererror(error e, MegaClient* client)
 {
     ostringstream s;
@@ -136,6 +243,9 @@ void Request::clear()
     jsonresponse.clear();
     json.pos = NULL;
     processindex = 0;
+    streamstate = STREAM_START;
+    streampos = 0;
+    streamindex = 0;
     stopProcessing = false;
 }
 
@@ -144,15 +254,34 @@ bool Request::empty() const
     return cmds.empty();
 }
 
+void Request::split(size_t n, Request& rest)
+{
+    assert(rest.empty() && n <= cmds.size());
+    rest.cmds.assign(cmds.begin() + n, cmds.end());
+    cmds.resize(n);
+}
+
 void Request::swap(Request& r)
 {
     // we use swap to move between queues, but process only after it gets into the completedreqs
+    // (a batch requeued after a partially processed response keeps its position, to skip the
+    // results already processed when the response is received again)
     cmds.swap(r.cmds);
+    std::swap(processindex, r.processindex);
     assert(jsonresponse.empty() && r.jsonresponse.empty());
     assert(json.pos == NULL && r.json.pos == NULL);
-    assert(processindex == 0 && r.processindex == 0);
+    streamstate = r.streamstate = STREAM_START;
+    streampos = r.streampos = 0;
+    streamindex = r.streamindex = 0;
 }
 
+bool Request::started() const
+{
+    return processindex > 0;
+}
+
+const std::chrono::milliseconds RequestDispatcher::SLOW_BATCH(20000);
+
 RequestDispatcher::RequestDispatcher()
 {
     nextreqs.push_back(Request());
@@ -179,9 +308,19 @@ void RequestDispatcher::add(Command *c)
     }
 #endif
 
-    if (nextreqs.back().size() >= MAX_COMMANDS)
+    if (maxpipelined && c->orderIndependent && !c->batchSeparately)
+    {
+        if (nextpipelinedreqs.empty() || nextpipelinedreqs.back().size() >= MAX_COMMANDS)
+        {
+            nextpipelinedreqs.push_back(Request());
+        }
+        nextpipelinedreqs.back().add(c);
+        return;
+    }
+
+    if (nextreqs.back().size() >= batchlimit)
     {
-        LOG_debug << "Starting an additional Request due to MAX_COMMANDS";
+        LOG_debug << "Starting an additional Request due to the batch size limit (" << batchlimit << ")";
         nextreqs.push_back(Request());
     }
     if (c->batchSeparately && !nextreqs.back().empty())
@@ -201,6 +340,11 @@ bool RequestDispatcher::cmdspending() const
     return !nextreqs.front().empty();
 }
 
+Command* RequestDispatcher::inflightsingle() const
+{
+    return inflightreq.single();
+}
+
 void RequestDispatcher::serverrequest(string *out, bool& suppressSID)
 {
     assert(inflightreq.empty());
@@ -217,7 +361,7 @@ void RequestDispatcher::serverrequest(string *out, bool& suppressSID)
 #endif
 }
 
-void RequestDispatcher::requeuerequest()
+bool RequestDispatcher::requeuerequest()
 {
 #ifdef MEGA_MEASURE_CODE
     csBatchesReceived += 1;
@@ -228,6 +372,56 @@ void RequestDispatcher::requeuerequest()
         nextreqs.push_front(Request());
     }
     nextreqs.front().swap(inflightreq);
+
+    // new commands go after it, so that it's resent as it was
+    if (nextreqs.size() == 1)
+    {
+        nextreqs.push_back(Request());
+    }
+
+    bool rejected = inflightrejected;
+    inflightrejected = false;
+
+    // only one rejected for its size is split, unless it has results processed already
+    if (!rejected || nextreqs.front().size() <= batchlimit || nextreqs.front().started())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; nextreqs[i].size() > batchlimit; i++)
+    {
+        nextreqs.insert(nextreqs.begin() + i + 1, Request());
+        nextreqs[i].split(batchlimit, nextreqs[i + 1]);
+    }
+    return true;
+}
+
+void RequestDispatcher::batchcompleted(std::chrono::milliseconds roundtrip)
+{
+    size_t size = inflightreq.size();
+
+    if (roundtrip > SLOW_BATCH && size > MIN_BATCH_COMMANDS)
+    {
+        batchlimit = std::max(size_t(MIN_BATCH_COMMANDS), std::min(batchlimit, size) / 2);
+        LOG_debug << "Slow batch of " << size << " commands (" << roundtrip.count() << " ms), limit now " << batchlimit;
+    }
+    else if (roundtrip < SLOW_BATCH / 4 && size >= batchlimit && batchlimit < MAX_COMMANDS)
+    {
+        batchlimit = std::min(size_t(MAX_COMMANDS), batchlimit * 2);
+        LOG_debug << "Batch size limit raised to " << batchlimit;
+    }
+}
+
+void RequestDispatcher::batchrejected()
+{
+    size_t size = inflightreq.size();
+    inflightrejected = true;
+
+    if (size > MIN_BATCH_COMMANDS)
+    {
+        batchlimit = std::max(size_t(MIN_BATCH_COMMANDS), std::min(batchlimit, size) / 2);
+        LOG_debug << "Batch of " << size << " commands rejected, limit now " << batchlimit;
+    }
 }
 
 void RequestDispatcher::serverresponse(std::string&& movestring, MegaClient *client)
@@ -238,11 +432,22 @@ void RequestDispatcher::serverresponse(std::string&& movestring, MegaClient *cli
     csBatchesReceived += 1;
     csRequestsCompleted += inflightreq.size();
 #endif
-    processing = true;
     inflightreq.serverresponse(std::move(movestring), client);
-    inflightreq.process(client);
-    assert(inflightreq.empty());
+    process(inflightreq, client);
+}
+
+void RequestDispatcher::serverpartial(HttpReq* req, MegaClient* client, bool complete)
+{
+    if (inflightreq.empty())
+    {
+        return;
+    }
+
+    processing = true;
+    processingreq = &inflightreq;
+    inflightreq.serverpartial(req, client, complete);
     processing = false;
+    processingreq = nullptr;
     if (clearWhenSafe)
     {
         clear();
@@ -253,24 +458,130 @@ void RequestDispatcher::servererror(error e, MegaClient *client)
 {
     // notify all the commands in the batch of the failure
     // so that they can deallocate memory, take corrective action etc.
-    processing = true;
     inflightreq.servererror(e, client);
-    inflightreq.process(client);
-    assert(inflightreq.empty());
+    process(inflightreq, client);
+}
+
+void RequestDispatcher::process(Request& r, MegaClient* client)
+{
+    processing = true;
+    processingreq = &r;
+    r.process(client);
+    assert(r.empty());
     processing = false;
+    processingreq = nullptr;
     if (clearWhenSafe)
     {
         clear();
     }
 }
 
+void RequestDispatcher::setmaxpipelined(unsigned n)
+{
+    maxpipelined = n;
+
+    if (!n)
+    {
+        // whatever was waiting for a pipelined batch goes in order
+        while (!nextpipelinedreqs.empty())
+        {
+            if (!nextreqs.back().empty())
+            {
+                nextreqs.push_back(Request());
+            }
+            nextreqs.back().swap(nextpipelinedreqs.front());
+            nextpipelinedreqs.pop_front();
+        }
+    }
+}
+
+bool RequestDispatcher::pipelinedready() const
+{
+    return inflightpipelinedreqs.size() < maxpipelined && !nextpipelinedreqs.empty();
+}
+
+int RequestDispatcher::pipelinedrequest(string *out, bool& suppressSID)
+{
+    assert(!nextpipelinedreqs.empty());
+    int channel = ++lastchannel;
+    Request& r = inflightpipelinedreqs[channel];
+    r.swap(nextpipelinedreqs.front());
+    nextpipelinedreqs.pop_front();
+    r.get(out, suppressSID);
+#ifdef MEGA_MEASURE_CODE
+    csRequestsSent += r.size();
+    csBatchesSent += 1;
+#endif
+    return channel;
+}
+
+void RequestDispatcher::requeuepipelined(int channel)
+{
+    map<int, Request>::iterator it = inflightpipelinedreqs.find(channel);
+    if (it == inflightpipelinedreqs.end())
+    {
+        return;
+    }
+
+#ifdef MEGA_MEASURE_CODE
+    csBatchesReceived += 1;
+#endif
+    nextpipelinedreqs.push_front(Request());
+    nextpipelinedreqs.front().swap(it->second);
+    inflightpipelinedreqs.erase(it);
+
+    if (!maxpipelined)
+    {
+        setmaxpipelined(0);
+    }
+}
+
+void RequestDispatcher::pipelinedresponse(int channel, string&& movestring, MegaClient* client)
+{
+    CodeCounter::ScopeTimer ccst(client->performanceStats.csResponseProcessingTime);
+
+    // the batch is gone if everything was cleared (eg. by a logout) while it was in flight
+    map<int, Request>::iterator it = inflightpipelinedreqs.find(channel);
+    if (it == inflightpipelinedreqs.end())
+    {
+        return;
+    }
+
+#ifdef MEGA_MEASURE_CODE
+    csBatchesReceived += 1;
+    csRequestsCompleted += it->second.size();
+#endif
+    Request r;
+    r.swap(it->second);
+    inflightpipelinedreqs.erase(it);
+
+    r.serverresponse(std::move(movestring), client);
+    process(r, client);
+}
+
+void RequestDispatcher::pipelinederror(int channel, error e, MegaClient* client)
+{
+    map<int, Request>::iterator it = inflightpipelinedreqs.find(channel);
+    if (it == inflightpipelinedreqs.end())
+    {
+        return;
+    }
+
+    Request r;
+    r.swap(it->second);
+    inflightpipelinedreqs.erase(it);
+
+    r.servererror(e, client);
+    process(r, client);
+}
+
 void RequestDispatcher::clear()
 {
     if (processing)
     {
         // we are being called from a command that is in progress (eg. logout) - delay wiping the data structure until that call ends.
         clearWhenSafe = true;
-        inflightreq.stopProcessing = true;
+        processingreq->stopProcessing = true;
     }
     else
     {
@@ -281,6 +592,18 @@ void RequestDispatcher::clear()
         }
         nextreqs.clear();
         nextreqs.push_back(Request());
+        for (auto& r : nextpipelinedreqs)
+        {
+            r.clear();
+        }
+        nextpipelinedreqs.clear();
+        for (auto& r : inflightpipelinedreqs)
+        {
+            r.second.clear();
+        }
+        inflightpipelinedreqs.clear();
+        batchlimit = MAX_COMMANDS;
+        inflightrejected = false;
         processing = false;
         clearWhenSafe = false;
     }
@@ -35,6 +35,12 @@ const int Sync::EXTRA_SCANNING_DELAY_DS = 150;
 const int Sync::FILE_UPDATE_DELAY_DS = 30;
 const int Sync::FILE_UPDATE_MAX_DELAY_SECS = 60;
 const dstime Sync::RECENT_VERSION_INTERVAL_SECS = 10800;
+const size_t Sync::CACHENODES_BATCH = 25000;
+const size_t Sync::PREFETCH_FINGERPRINTS = 64;
+const size_t Sync::FINGERPRINTS_AHEAD = 512;
+const size_t Sync::FINGERPRINTS_AHEAD_BATCH = 16;
+const dstime Sync::JOURNAL_CHECKPOINT_DS = 600;
+const size_t Sync::NAMECACHE_SIZE = 4096;
 
 namespace {
 
@@ -216,14 +222,17 @@ struct FileFingerprintComparator
 
 using FingerprintMap = std::multimap<FileFingerprint, LocalNode*, FileFingerprintComparator>;
 
-// Collects all LocalNodes by storing them in `fingerprints`, keyed by FileFingerprint
+// Collects all LocalNodes without an fs ID by storing them in `fingerprints`, keyed by FileFingerprint
 void collectAllFingerprints(FingerprintMap& fingerprints, LocalNode& l)
 {
-    FileFingerprint ffp;
-    computeFingerprint(ffp, l);
-    if (ffp.isvalid)
+    if (l.fsid == mega::UNDEF)
     {
-        fingerprints.insert(std::make_pair(ffp, &l));
+        FileFingerprint ffp;
+        computeFingerprint(ffp, l);
+        if (ffp.isvalid)
+        {
+            fingerprints.insert(std::make_pair(ffp, &l));
+        }
     }
     if (l.type == FILENODE)
     {
@@ -291,43 +300,62 @@ void assignFilesystemId(FileSystemAccess& fsaccess, FileAccess& fa, handlelocaln
     }
 }
 
-// Recursively assigns fs IDs
-void assignFilesystemIdsImpl(bool& success, Sync& sync, MegaApp& app, handlelocalnode_map& fsidnodes,
-                             FileSystemAccess& fsaccess, string localpath, const string& localdebris,
-                             const string& localseparator, FingerprintMap& fingerprints)
+// Recursively assigns the fs IDs of the items in the folder at `localpath` to the
+// children of `l` (its LocalNode, if any) by name. Below a folder whose mtime is
+// the recorded one, a child of the same type keeps its identity; otherwise a file
+// must also have the recorded size and mtime, and a folder the recorded mtime.
+// Everything else is left in `unmatched` for matching by fingerprint.
+void assignFilesystemIdsByName(bool& success, Sync& sync, MegaApp& app, FileSystemAccess& fsaccess,
+                               string localpath, LocalNode* l, bool unchanged, const string& localdebris,
+                               const string& localseparator, vector<string>& unmatched, size_t& matched)
 {
-    auto fa = fsaccess.newfileaccess(false);
-    if (!(success = fa->fopen(&localpath, true, false)))
-    {
-        LOG_err << "Unable to open path: " << localpath;
-        return;
-    }
-    if (fa->mIsSymLink)
-    {
-        LOG_debug << "Ignoring symlink: " << localpath;
-        return;
-    }
+    const auto paths = collectAllPathsInFolder(sync, app, fsaccess, localpath, localdebris, localseparator);
+    const size_t nameOffset = localpath.size() + (localpath.size() ? localseparator.size() : 0);
 
-    if (fa->type == FILENODE)
-    {
-        assignFilesystemId(fsaccess, *fa, fsidnodes, fingerprints, localpath, localseparator);
-    }
-    else if (fa->type == FOLDERNODE)
+    for (const auto& path : paths)
     {
-        const auto paths = collectAllPathsInFolder(sync, app, fsaccess, localpath, localdebris, localseparator);
-        assignFilesystemId(fsaccess, *fa, fsidnodes, fingerprints, localpath, localseparator, paths);
-        fa.reset();
-        for (const auto& path : paths)
+        auto fa = fsaccess.newfileaccess(false);
+        if (!fa->fopen(const_cast<string*>(&path), true, false))
         {
-            assignFilesystemIdsImpl(success, sync, app, fsidnodes, fsaccess, path,
-                                    localdebris, localseparator, fingerprints);
+            LOG_err << "Unable to open path: " << path;
+            success = false;
+            continue;
+        }
+        if (fa->mIsSymLink)
+        {
+            LOG_debug << "Ignoring symlink: " << path;
+            continue;
+        }
+
+        LocalNode* child = nullptr;
+        if (l)
+        {
+            const string name = path.substr(nameOffset);
+            const auto it = l->children.find(&name);
+            if (it != l->children.end() && it->second->type == fa->type)
+            {
+                child = it->second;
+            }
+        }
+
+        const bool sameMtime = child && child->mtime == fa->mtime;
+        if (child && fa->fsidvalid
+                && (unchanged || (sameMtime && (fa->type != FILENODE || child->size == fa->size))))
+        {
+            child->setfsid(fa->fsid);
+            ++matched;
+        }
+        else
+        {
+            unmatched.push_back(path);
+        }
+
+        if (fa->type == FOLDERNODE)
+        {
+            fa.reset();
+            assignFilesystemIdsByName(success, sync, app, fsaccess, path, child, sameMtime,
+                                      localdebris, localseparator, unmatched, matched);
         }
-    }
-    else
-    {
-        assert(false && "Invalid file type");
-        success = false;
-        return;
     }
 }
 
@@ -439,13 +467,44 @@ bool assignFilesystemIds(Sync& sync, MegaApp& app, FileSystemAccess& fsaccess, h
     invalidateFilesystemIds(fsidnodes, sync.localroot, invalidatedCount);
     LOG_info << "Number of invalidated fs IDs: " << invalidatedCount;
 
+    // the root's mtime isn't recorded, so its children are always verified
+    bool success = true;
+    size_t matchedCount = 0;
+    vector<string> unmatched;
+    assignFilesystemIdsByName(success, sync, app, fsaccess, rootpath, &sync.localroot, false,
+                              localdebris, localseparator, unmatched, matchedCount);
+    LOG_info << "Number of fs IDs assigned by name: " << matchedCount << "  Unmatched: " << unmatched.size();
+
+    if (unmatched.empty())
+    {
+        return success;
+    }
+
+    // the fingerprints are only needed for the nodes left over
     FingerprintMap fingerprints;
     collectAllFingerprints(fingerprints, sync.localroot);
     LOG_info << "Number of fingerprints before assignment: " << fingerprints.size();
 
-    bool success = true;
-    assignFilesystemIdsImpl(success, sync, app, fsidnodes, fsaccess, rootpath,
-                            localdebris, localseparator, fingerprints);
+    for (auto& path : unmatched)
+    {
+        auto fa = fsaccess.newfileaccess(false);
+        if (!fa->fopen(&path, true, false))
+        {
+            LOG_err << "Unable to open path: " << path;
+            success = false;
+            continue;
+        }
+
+        if (fa->type == FILENODE)
+        {
+            assignFilesystemId(fsaccess, *fa, fsidnodes, fingerprints, path, localseparator);
+        }
+        else
+        {
+            const auto paths = collectAllPathsInFolder(sync, app, fsaccess, path, localdebris, localseparator);
+            assignFilesystemId(fsaccess, *fa, fsidnodes, fingerprints, path, localseparator, paths);
+        }
+    }
     LOG_info << "Number of fingerprints after assignment: " << fingerprints.size();
 
     return success;
@@ -564,6 +623,10 @@ Sync::Sync(MegaClient* cclient, string* crootpath, const char* cdebris,
             dbname.resize(Base64::btoa((byte*)tableid, sizeof tableid, (char*)dbname.c_str()));
 
             statecachetable = client->dbaccess->open(client->rng, client->fsaccess, &dbname, false, false);
+            if (statecachetable)
+            {
+                MegaClient::setrecorddictionaries(statecachetable);
+            }
 
             readstatecache();
         }
@@ -646,6 +709,12 @@ bool Sync::readstatecache()
         // bulk-load cached nodes into tmap
         while (statecachetable->next(&cid, &cachedata, &client->key))
         {
+            if (cid == JOURNAL_RECORD)
+            {
+                journalposition = cachedata;
+                continue;
+            }
+
             if ((l = LocalNode::unserialize(this, &cachedata)))
             {
                 l->dbid = cid;
@@ -666,6 +735,65 @@ bool Sync::readstatecache()
     return false;
 }
 
+// the cached nodes are current except for the journaled changes, which are
+// queued like filesystem notifications: no full scan needed
+bool Sync::resumefromjournal()
+{
+    if (journalposition.empty() || !dirnotify->journalchanges(journalposition))
+    {
+        return false;
+    }
+
+    // as the scan would have counted them
+    std::function<void(LocalNode*)> countbytes = [&](LocalNode* l)
+    {
+        for (localnode_map::iterator it = l->children.begin(); it != l->children.end(); it++)
+        {
+            if (it->second->type == FILENODE)
+            {
+                localbytes += it->second->size;
+            }
+            else
+            {
+                countbytes(it->second);
+            }
+        }
+    };
+    countbytes(&localroot);
+
+    // no missing nodes to look for in bulk: deletions are journaled
+    fullscan = false;
+
+    LOG_debug << "Sync resumed from the change journal. Changes: " << dirnotify->notifyq[DirNotify::DIREVENTS].size();
+    return true;
+}
+
+void Sync::journalcheckpoint()
+{
+    if (!statecachetable || insertq.size() || deleteq.size()
+     || (journaltime && Waiter::ds - journaltime < JOURNAL_CHECKPOINT_DS))
+    {
+        return;
+    }
+
+    journaltime = Waiter::ds;
+
+    if (nextjournalposition.size() && nextjournalposition != journalposition)
+    {
+        statecachetable->begin();
+        if (statecachetable->put(JOURNAL_RECORD, (char*)nextjournalposition.data(), unsigned(nextjournalposition.size())))
+        {
+            journalposition = nextjournalposition;
+        }
+        statecachetable->commit();
+    }
+
+    if (!dirnotify->journalposition(&nextjournalposition))
+    {
+        nextjournalposition.clear();
+    }
+}
+
 // remove LocalNode from DB cache
 void Sync::statecachedel(LocalNode* l)
 {
@@ -713,29 +841,65 @@ void Sync::cachenodes()
 
         deleteq.clear();
 
-        // additions - we iterate until completion or until we get stuck
-        bool added;
+        // additions - each node is preceded by its queued ancestors, which get their
+        // dbids from addbatch() right away; nodes whose parent can't be written
+        // are put back and retried in the next call
+        dbrecord_vector records;
+        vector<LocalNode*> chain, stuck;
 
-        do {
-            added = false;
+        while (insertq.size() && records.size() < CACHENODES_BATCH)
+        {
+            LocalNode* l = *insertq.begin();
+            chain.clear();
+            chain.push_back(l);
 
-            for (set<LocalNode*>::iterator it = insertq.begin(); it != insertq.end(); )
+            while (!l->parent->dbid && l->parent != &localroot && insertq.count(l->parent))
             {
-                if ((*it)->parent->dbid || (*it)->parent == &localroot)
+                l = l->parent;
+                chain.push_back(l);
+            }
+
+            bool ready = l->parent->dbid || l->parent == &localroot;
+
+            for (vector<LocalNode*>::reverse_iterator it = chain.rbegin(); it != chain.rend(); it++)
+            {
+                insertq.erase(*it);
+
+                if (ready)
                 {
-                    statecachetable->put(MegaClient::CACHEDLOCALNODE, *it, &client->key);
-                    insertq.erase(it++);
-                    added = true;
+                    statecachetable->addbatch(&records, MegaClient::CACHEDLOCALNODE, *it, &client->key);
+                    ready = (*it)->dbid != 0;
+                }
+
+                if (!ready)
+                {
+                    stuck.push_back(*it);
                 }
-                else it++;
             }
-        } while (added);
+        }
+
+        statecachetable->putmany(records);
 
         statecachetable->commit();
 
-        if (insertq.size())
+        insertq.insert(stuck.begin(), stuck.end());
+        cachednodes += records.size();
+
+        client->app->syncupdate_cachednodes(this, cachednodes, insertq.size());
+
+        if (insertq.size() > stuck.size())
         {
-            LOG_err << "LocalNode caching did not complete";
+            LOG_debug << "LocalNode caching in progress: " << cachednodes << " saved, " << insertq.size() << " pending";
+            client->synccachepending = true;
+        }
+        else
+        {
+            if (insertq.size())
+            {
+                LOG_err << "LocalNode caching did not complete";
+            }
+
+            cachednodes = 0;
         }
     }
 }
@@ -795,7 +959,7 @@ LocalNode* Sync::localnodebypath(LocalNode* l, string* localpath, LocalNode** pa
     }
 
     const char* nptr = ptr;
-    localnode_map::iterator it;
+    localnode_index::iterator it;
     string t;
 
     for (;;)
@@ -822,8 +986,8 @@ LocalNode* Sync::localnodebypath(LocalNode* l, string* localpath, LocalNode** pa
             }
 
             t.assign(ptr, nptr - ptr);
-            if ((it = l->children.find(&t)) == l->children.end()
-             && (it = l->schildren.find(&t)) == l->schildren.end())
+            if ((it = client->localnodeindex.find({ l, &t, false })) == client->localnodeindex.end()
+             && (it = client->localnodeindex.find({ l, &t, true })) == client->localnodeindex.end())
             {
                 // no full match: store residual path, return NULL with the
                 // matching component LocalNode in parent
@@ -866,7 +1030,7 @@ bool Sync::assignfsids()
 
 // scan localpath, add or update child nodes, call recursively for folder nodes
 // localpath must be prefixed with Sync
-bool Sync::scan(string* localpath, FileAccess* fa)
+bool Sync::scan(string* localpath, FileAccess* fa, set<string>* listed)
 {
     if (fa)
     {
@@ -885,17 +1049,50 @@ bool Sync::scan(string* localpath, FileAccess* fa)
             LOG_debug << "Scanning folder: " << utf8path;
         }
 
-        da = client->fsaccess->newdiraccess();
+        vector<string> localnames;
+        vector<NotifyAttributes> attributes;
+        map<string, vector<string> >::iterator listing = prefetchedlistings.find(*localpath);
+        if (listing != prefetchedlistings.end())
+        {
+            localnames = std::move(listing->second);
+            prefetchedlistings.erase(listing);
+            success = true;
+        }
+        else
+        {
+            da = client->fsaccess->newdiraccess();
+
+            if ((success = da->dopen(localpath, fa, false)))
+            {
+                // the attributes of the listing spare checkpath() reopening the cached items
+                NotifyAttributes attrs;
+                while (da->dnext(localpath, &localname, client->followsymlinks, NULL, initializing ? &attrs : NULL))
+                {
+                    localnames.push_back(localname);
+                    if (initializing)
+                    {
+                        attributes.push_back(attrs);
+                    }
+                }
+            }
+
+            delete da;
+        }
 
         // scan the dir, mark all items with a unique identifier
-        if ((success = da->dopen(localpath, fa, false)))
+        if (success)
         {
             size_t t = localpath->size();
 
-            while (da->dnext(localpath, &localname, client->followsymlinks))
+            for (size_t i = 0; i < localnames.size(); i++)
             {
-                name = localname;
-                client->fsaccess->local2name(&name);
+                localname = localnames[i];
+                if (listed)
+                {
+                    listed->insert(localname);
+                }
+
+                name = localname2name(localname);
 
                 if (t)
                 {
@@ -914,7 +1111,7 @@ bool Sync::scan(string* localpath, FileAccess* fa)
                         if (initializing)
                         {
                             // preload all cached LocalNodes
-                            l = checkpath(NULL, localpath);
+                            l = checkpath(NULL, localpath, NULL, NULL, false, i < attributes.size() ? &attributes[i] : NULL);
                         }
 
                         if (!l || l == (LocalNode*)~0)
@@ -933,21 +1130,373 @@ bool Sync::scan(string* localpath, FileAccess* fa)
             }
         }
 
-        delete da;
-
         return success;
     }
     else return false;
 }
 
+void Sync::rescan(LocalNode* l, string* localpath)
+{
+    set<string> listed;
+
+    if (!scan(localpath, NULL, &listed))
+    {
+        // gone or inaccessible: check the folder itself
+        dirnotify->notify(DirNotify::DIREVENTS, NULL, localpath->data(), localpath->size(), true);
+        return;
+    }
+
+    // known children that weren't listed may have been deleted or moved away
+    for (localnode_map::iterator it = l->children.begin(); it != l->children.end(); it++)
+    {
+        if (!listed.count(it->second->localname))
+        {
+            dirnotify->notify(DirNotify::DIREVENTS, l, it->second->localname.data(), it->second->localname.size(), true);
+        }
+    }
+}
+
+void Sync::ListJob::run()
+{
+    std::unique_ptr<DirAccess> da(fsaccess->newdiraccess());
+    string path = localpath;
+    if (!(opened = da->dopen(&path, NULL, false)))
+    {
+        return;
+    }
+
+    string name;
+    nodetype_t type;
+    while (da->dnext(&path, &name, followsymlinks, &type))
+    {
+        entries.push_back(std::make_pair(name, type));
+    }
+}
+
+void Sync::FingerprintJob::run()
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        Entry& e = entries[i];
+        auto fa = fsaccess->newfileaccess(false);
+        if (fa->fopen(&e.localpath, true, false) && fa->type == FILENODE
+         && !(fa->fsidvalid && fa->fsid == e.fsid && fa->size == e.size && fa->mtime == e.mtime))
+        {
+            e.fsid = fa->fsid;
+            e.fsidvalid = fa->fsidvalid;
+            FingerprintCache::genfingerprint(cache.get(), &e.fingerprint, fa.get());
+        }
+    }
+}
+
+// the listings and fingerprints are done by the workers, while the SDK thread
+// filters the entries (sync_syncable() is only called from it) and matches
+// them with the cached LocalNodes, so that unchanged files are not read
+void Sync::prefetch(string* localpath)
+{
+    prefetchedfolders = 0;
+    prefetchfolder(*localpath);
+}
+
+void Sync::prefetchfolder(const string& localpath)
+{
+    auto job = std::make_shared<ListJob>();
+    job->fsaccess = client->fsaccess;
+    job->followsymlinks = client->followsymlinks;
+    job->localpath = localpath;
+    scanworkers()->submit(job);
+    prefetchlists.push_back(job);
+    listing.insert(localpath);
+}
+
+// called from the exec loop: the workers wake up the SDK thread as they complete
+void Sync::prefetchahead()
+{
+    const string& separator = client->fsaccess->localseparator;
+    std::shared_ptr<FingerprintJob> batch;
+    bool consumed = false;
+
+    // the folders found are appended, and taken on a later call
+    for (size_t i = 0, n = prefetchlists.size(); i < n; )
+    {
+        std::shared_ptr<ListJob> job = prefetchlists[i];
+        if (!job->finished())
+        {
+            i++;
+            continue;
+        }
+
+        prefetchlists.erase(prefetchlists.begin() + i);
+        n--;
+        listing.erase(job->localpath);
+        consumed = true;
+
+        if (!job->opened)
+        {
+            continue;
+        }
+        prefetchedfolders++;
+
+        // the LocalNodes may have changed since the listing was requested
+        LocalNode* l = job->localpath == localroot.localname ? &localroot : localnodebypath(NULL, &job->localpath);
+        if (l && l->type != FOLDERNODE)
+        {
+            l = NULL;
+        }
+
+        // the root was listed by the initial scan() already
+        vector<string> unused;
+        vector<string>& localnames = l == &localroot ? unused : prefetchedlistings[job->localpath];
+
+        for (size_t j = 0; j < job->entries.size(); j++)
+        {
+            string& localname = job->entries[j].first;
+            string path = job->localpath + separator + localname;
+            string name = localname2name(localname);
+
+            localnames.push_back(localname);
+
+            if (!client->app->sync_syncable(this, name.c_str(), &path)
+             || !isPathSyncable(path, localdebris, separator))
+            {
+                continue;
+            }
+
+            LocalNode* cl = l ? l->childbyname(&localname) : NULL;
+
+            if (job->entries[j].second == FOLDERNODE)
+            {
+                prefetchfolder(path);
+            }
+            else if (job->entries[j].second == FILENODE)
+            {
+                if (prefetchedfingerprints.count(path) || !fingerprinting.insert(path).second)
+                {
+                    continue;
+                }
+
+                if (!batch)
+                {
+                    batch = std::make_shared<FingerprintJob>();
+                    batch->fsaccess = client->fsaccess;
+                    batch->cache = client->fingerprintcache;
+                }
+
+                FingerprintJob::Entry e;
+                e.localpath = std::move(path);
+                if (cl && cl->type == FILENODE)
+                {
+                    e.fsid = cl->fsid;
+                    e.size = cl->size;
+                    e.mtime = cl->mtime;
+                }
+                batch->entries.push_back(std::move(e));
+
+                if (batch->entries.size() >= PREFETCH_FINGERPRINTS)
+                {
+                    scanworkers()->submit(batch);
+                    fingerprintjobs.push_back(std::move(batch));
+                }
+            }
+        }
+    }
+
+    // fingerprintahead() takes the results
+    if (batch)
+    {
+        scanworkers()->submit(batch);
+        fingerprintjobs.push_back(std::move(batch));
+    }
+
+    if (consumed && prefetchlists.empty())
+    {
+        LOG_debug << "Prefetched folders: " << prefetchedfolders;
+    }
+}
+
+CryptoWorkers* Sync::scanworkers()
+{
+    unsigned threads = client->powerpolicy.lowpower() ? PowerPolicy::LOWPOWERSCANTHREADS : client->syncscanthreads;
+
+    if (client->syncscanworkers && client->syncscanworkers->size() != threads && !CryptoWorkers::sharedthreads())
+    {
+        // the power policy or syncscanthreads changed: start over once no sync waits for the workers
+        // (a pool shared by the instances is kept as is)
+        bool idle = true;
+        for (Sync* sync : client->syncs)
+        {
+            idle = idle && sync->fingerprintjobs.empty() && sync->prefetchlists.empty();
+        }
+
+        if (idle)
+        {
+            client->syncscanworkers.reset();
+        }
+    }
+
+    if (!client->syncscanworkers)
+    {
+        client->syncscanworkers.reset(new CryptoWorkers(threads, client->waiter));
+    }
+    return client->syncscanworkers.get();
+}
+
+// the same path as checkpath() builds for the item
+const string& Sync::localname2name(const string& localname)
+{
+    auto it = namecache.find(localname);
+    if (it != namecache.end())
+    {
+        return it->second;
+    }
+
+    if (namecache.size() >= NAMECACHE_SIZE)
+    {
+        namecache.clear();
+    }
+
+    string& name = namecache[localname];
+    name = localname;
+    client->fsaccess->local2name(&name);
+    return name;
+}
+
+void Sync::notificationpath(const Notification& n, string* path)
+{
+    path->clear();
+
+    if (n.localnode)
+    {
+        n.localnode->getlocalpath(path);
+    }
+
+    if (n.path.size())
+    {
+        if (path->size())
+        {
+            path->append(client->fsaccess->localseparator);
+        }
+
+        path->append(n.path);
+    }
+}
+
+void Sync::fingerprintahead(int q)
+{
+    for (vector<std::shared_ptr<FingerprintJob> >::iterator it = fingerprintjobs.begin(); it != fingerprintjobs.end(); )
+    {
+        if (!(*it)->finished())
+        {
+            it++;
+            continue;
+        }
+
+        for (FingerprintJob::Entry& e : (*it)->entries)
+        {
+            if (e.fingerprint.isvalid)
+            {
+                PrefetchedFingerprint& p = prefetchedfingerprints[e.localpath];
+                p.fsid = e.fsid;
+                p.fsidvalid = e.fsidvalid;
+                p.fingerprint = e.fingerprint;
+            }
+            fingerprinting.erase(e.localpath);
+        }
+        it = fingerprintjobs.erase(it);
+    }
+
+    // items are queued in timestamp order: stop at the first one that is too
+    // recent to be scanned, its file may still be being written
+    dstime dsmin = Waiter::ds - SCANNING_DELAY_DS;
+    std::shared_ptr<FingerprintJob> batch;
+    string path;
+
+    for (size_t i = 0; i < dirnotify->notifyq[q].size() && i < FINGERPRINTS_AHEAD
+                    && fingerprinting.size() < FINGERPRINTS_AHEAD; i++)
+    {
+        const Notification& n = dirnotify->notifyq[q][i];
+        if (n.timestamp > dsmin)
+        {
+            break;
+        }
+
+        if (n.localnode == (LocalNode*)~0 || n.rescan)
+        {
+            continue;
+        }
+
+        notificationpath(n, &path);
+        if (prefetchedfingerprints.count(path) || !fingerprinting.insert(path).second)
+        {
+            continue;
+        }
+
+        if (!batch)
+        {
+            batch = std::make_shared<FingerprintJob>();
+            batch->fsaccess = client->fsaccess;
+            batch->cache = client->fingerprintcache;
+        }
+
+        // folders are skipped by the job
+        FingerprintJob::Entry e;
+        e.localpath = path;
+        batch->entries.push_back(std::move(e));
+
+        if (batch->entries.size() >= FINGERPRINTS_AHEAD_BATCH)
+        {
+            scanworkers()->submit(batch);
+            fingerprintjobs.push_back(std::move(batch));
+        }
+    }
+
+    if (batch)
+    {
+        scanworkers()->submit(batch);
+        fingerprintjobs.push_back(std::move(batch));
+    }
+}
+
+bool Sync::fingerprint(LocalNode* l, FileAccess* fa, const string& localpath)
+{
+    stats.fingerprinted++;
+    stats.fingerprintspeed.calculateSpeed(1);
+
+    map<string, PrefetchedFingerprint>::iterator it = prefetchedfingerprints.find(localpath);
+    if (it == prefetchedfingerprints.end())
+    {
+        return FingerprintCache::genfingerprint(client->fingerprintcache.get(), l, fa);
+    }
+
+    PrefetchedFingerprint p = it->second;
+    prefetchedfingerprints.erase(it);
+
+    // the file must not have changed since it was read
+    if (p.fingerprint.size != fa->size || p.fingerprint.mtime != fa->mtime
+     || p.fsidvalid != fa->fsidvalid || (fa->fsidvalid && p.fsid != fa->fsid))
+    {
+        return FingerprintCache::genfingerprint(client->fingerprintcache.get(), l, fa);
+    }
+
+    // as FileFingerprint::genfingerprint() would have found it
+    bool changed = !l->isvalid
+                || l->size != p.fingerprint.size
+                || l->mtime != p.fingerprint.mtime
+                || memcmp(l->crc, p.fingerprint.crc, sizeof l->crc);
+
+    static_cast<FileFingerprint&>(*l) = p.fingerprint;
+    return changed;
+}
+
 // check local path - if !localname, localpath is relative to l, with l == NULL
 // being the root of the sync
 // if localname is set, localpath is absolute and localname its last component
 // path references a new FOLDERNODE: returns created node
 // path references a existing FILENODE: returns node
 // otherwise, returns NULL
-LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, dstime *backoffds, bool wejustcreatedthisfolder)
+LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, dstime *backoffds, bool wejustcreatedthisfolder, const NotifyAttributes* attributes)
 {
+    Trace::Span ts("checkpath");
     LocalNode* ll = l;
     bool newnode = false, changed = false;
     bool isroot;
@@ -1019,8 +1568,7 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
             return NULL;
         }
 
-        string name = newname.size() ? newname : l->name;
-        client->fsaccess->local2name(&name);
+        string name = localname2name(newname.size() ? newname : l->name);
 
         if (!client->app->sync_syncable(this, name.c_str(), &tmppath))
         {
@@ -1064,10 +1612,25 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
         }
 
         // match cached LocalNode state during initial/rescan to prevent costly re-fingerprinting
-        // (just compare the fsids, sizes and mtimes to detect changes)
-        if (fa->fopen(localname ? localpath : &tmppath, false, false))
+        // (just compare the fsids, sizes and mtimes to detect changes) - the attributes
+        // from the directory listing, if any, spare opening the item
+        NotifyAttributes opened;
+        if (!attributes || attributes->fsid == UNDEF)
         {
-            if (cl && fa->fsidvalid && fa->fsid == cl->fsid)
+            attributes = NULL;
+            if (fa->fopen(localname ? localpath : &tmppath, false, false))
+            {
+                opened.type = fa->type;
+                opened.size = fa->size;
+                opened.mtime = fa->mtime;
+                opened.fsid = fa->fsidvalid ? fa->fsid : UNDEF;
+                attributes = &opened;
+            }
+        }
+
+        if (attributes)
+        {
+            if (cl && attributes->fsid != UNDEF && attributes->fsid == cl->fsid)
             {
                 // node found and same file
                 l = cl;
@@ -1075,14 +1638,20 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
                 l->setnotseen(0);
 
                 // if it's a file, size and mtime must match to qualify
-                if (l->type != FILENODE || (l->size == fa->size && l->mtime == fa->mtime))
+                if (l->type != FILENODE || (l->size == attributes->size && l->mtime == attributes->mtime))
                 {
                     LOG_verbose << "Cached localnode is still valid. Type: " << l->type << "  Size: " << l->size << "  Mtime: " << l->mtime;
                     l->scanseqno = scanseqno;
 
                     if (l->type == FOLDERNODE)
                     {
-                        scan(localname ? localpath : &tmppath, fa.get());
+                        if (l->mtime != attributes->mtime)
+                        {
+                            l->mtime = attributes->mtime;
+                            statecacheadd(l);
+                        }
+
+                        scan(localname ? localpath : &tmppath, attributes == &opened ? fa.get() : NULL);
                     }
                     else
                     {
@@ -1103,11 +1672,15 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
             if (cl)
             {
                 LOG_verbose << "Outdated localnode. Type: " << cl->type << "  Size: " << cl->size << "  Mtime: " << cl->mtime
-                            << "    FaType: " << fa->type << "  FaSize: " << fa->size << "  FaMtime: " << fa->mtime;
+                            << "    FaType: " << (attributes ? attributes->type : fa->type)
+                            << "  FaSize: " << (attributes ? attributes->size : fa->size)
+                            << "  FaMtime: " << (attributes ? attributes->mtime : fa->mtime);
             }
             else
             {
-                LOG_verbose << "New file. FaType: " << fa->type << "  FaSize: " << fa->size << "  FaMtime: " << fa->mtime;
+                LOG_verbose << "New file. FaType: " << (attributes ? attributes->type : fa->type)
+                            << "  FaSize: " << (attributes ? attributes->size : fa->size)
+                            << "  FaMtime: " << (attributes ? attributes->mtime : fa->mtime);
             }
             return NULL;
         }
@@ -1208,7 +1781,7 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
 
                             m_off_t dsize = l->size > 0 ? l->size : 0;
 
-                            if (l->genfingerprint(fa.get()) && l->size >= 0)
+                            if (FingerprintCache::genfingerprint(client->fingerprintcache.get(), l, fa.get()) && l->size >= 0)
                             {
                                 localbytes -= dsize - l->size;
                             }
@@ -1442,6 +2015,18 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
             // detect file changes or recurse into new subfolders
             if (l->type == FOLDERNODE)
             {
+                // recorded for assignFilesystemIds(), which trusts the names
+                // of the children of unchanged folders
+                if (l->mtime != fa->mtime)
+                {
+                    l->mtime = fa->mtime;
+
+                    if (!newnode && !isroot)
+                    {
+                        statecacheadd(l);
+                    }
+                }
+
                 if (newnode)
                 {
                     scan(localname ? localpath : &tmppath, fa.get());
@@ -1478,7 +2063,7 @@ LocalNode* Sync::checkpath(LocalNode* l, string* localpath, string* localname, d
                         localbytes -= l->size;
                     }
 
-                    if (l->genfingerprint(fa.get()))
+                    if (fingerprint(l, fa.get(), localname ? *localpath : tmppath))
                     {
                         changed = true;
                         l->bumpnagleds();
@@ -1568,6 +2153,12 @@ dstime Sync::procscanq(int q)
     size_t t = dirnotify->notifyq[q].size();
     dstime dsmin = Waiter::ds - SCANNING_DELAY_DS;
     LocalNode* l;
+    string path;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+                                                   + std::chrono::milliseconds(client->syncscanbudget);
+
+    prefetchahead();
+    fingerprintahead(q);
 
     while (t--)
     {
@@ -1579,10 +2170,64 @@ dstime Sync::procscanq(int q)
             return dirnotify->notifyq[q].front().timestamp - dsmin;
         }
 
-        if ((l = dirnotify->notifyq[q].front().localnode) != (LocalNode*)~0)
+        // collapsed notifications of a known folder's children (otherwise
+        // the folder is checked like any other path)
+        if (dirnotify->notifyq[q].front().rescan
+                && (l = dirnotify->notifyq[q].front().path == localroot.localname
+                        ? &localroot
+                        : localnodebypath(NULL, &dirnotify->notifyq[q].front().path))
+                && l->type == FOLDERNODE)
         {
+            path = dirnotify->notifyq[q].front().path;
+            rescan(l, &path);
+            l = NULL;
+        }
+        else if ((l = dirnotify->notifyq[q].front().localnode) != (LocalNode*)~0)
+        {
+            // wait for the listing of the folder being prefetched, or of the one it
+            // is in, which goes on with the folders in it
+            if (listing.size())
+            {
+                notificationpath(dirnotify->notifyq[q].front(), &path);
+                string basepath;
+                if (l)
+                {
+                    l->getlocalpath(&basepath);
+                }
+
+                if (listing.count(path) || (l && listing.count(basepath)))
+                {
+                    prefetchahead();
+                    if (listing.count(path) || (l && listing.count(basepath)))
+                    {
+                        LOG_verbose << "Scanning postponed. Listing in progress";
+                        return 1;
+                    }
+                }
+            }
+
+            // wait for the file being fingerprinted by the workers, which
+            // wake up the SDK thread when they are done
+            if (fingerprinting.size())
+            {
+                notificationpath(dirnotify->notifyq[q].front(), &path);
+                if (fingerprinting.count(path))
+                {
+                    fingerprintahead(q);
+                    if (fingerprinting.count(path))
+                    {
+                        LOG_verbose << "Scanning postponed. Fingerprint in progress";
+                        return 1;
+                    }
+                }
+            }
+
             dstime backoffds = 0;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
             l = checkpath(l, &dirnotify->notifyq[q].front().path, NULL, &backoffds);
+            stats.checkpathtime += std::chrono::steady_clock::now() - start;
+            stats.scanned++;
+            stats.scanspeed.calculateSpeed(1);
             if (backoffds)
             {
                 LOG_verbose << "Scanning deferred during " << backoffds << " ds";
@@ -1600,20 +2245,23 @@ dstime Sync::procscanq(int q)
                 return 0;
             }
         }
-        else
+        else if (dirnotify->notifyq[q].front().path.size())
         {
             string utf8path;
             client->fsaccess->local2path(&dirnotify->notifyq[q].front().path, &utf8path);
             LOG_debug << "Notification skipped: " << utf8path;
         }
 
-        dirnotify->notifyq[q].pop_front();
+        dirnotify->pop(DirNotify::notifyqueue(q));
 
-        // we return control to the application in case a filenode was added
+        // we return control to the application once the time budget is spent
         // (in order to avoid lengthy blocking episodes due to multiple
-        // consecutive fingerprint calculations)
-        // or if new nodes are being added due to a copy/delete operation
-        if ((l && l != (LocalNode*)~0 && l->type == FILENODE) || client->syncadding)
+        // consecutive fingerprint calculations), in case a filenode was added
+        // if there is no budget, or if new nodes are being added due to a
+        // copy/delete operation
+        if ((client->syncscanbudget ? std::chrono::steady_clock::now() >= deadline
+                                    : l && l != (LocalNode*)~0 && l->type == FILENODE)
+                || client->syncadding)
         {
             break;
         }
@@ -1629,6 +2277,14 @@ dstime Sync::procscanq(int q)
     else if (!dirnotify->notifyq[!q].size())
     {
         cachenodes();
+
+        prefetchedlistings.clear();
+        prefetchedfingerprints.clear();
+        namecache.clear();
+
+        // what remains wasn't needed by the scan
+        prefetchlists.clear();
+        listing.clear();
     }
 
     return dstime(~0);
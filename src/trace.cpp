@@ -0,0 +1,258 @@
+/**
+ * @file trace.cpp
+ * @brief Lightweight tracing of the hot paths
+ *
+ * (c) 2013-2020 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/trace.h"
+#include "mega/logging.h"
+
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+namespace mega {
+
+namespace {
+
+struct TraceEvent
+{
+    const char* name;
+    const void* id;
+    int64_t ts;     // microseconds since the first event of the process
+    char phase;
+};
+
+struct TraceBuffer
+{
+    // only contended while dumping or clearing
+    std::mutex mutex;
+
+    std::vector<TraceEvent> events;
+    uint64_t next = 0;      // events recorded, the ring position is next % size
+    unsigned tid = 0;
+    const char* name = nullptr;
+    bool ended = false;     // its thread is gone
+};
+
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    size_t buffersize = Trace::DEFAULT_BUFFER_SIZE;
+    unsigned nexttid = 1;
+};
+
+// buffers of ended threads kept for dumps, so that thread churn doesn't grow the registry
+const size_t MAX_ENDED_BUFFERS = 32;
+
+// never destroyed: threads may still end after static destruction
+TraceRegistry& registry()
+{
+    static TraceRegistry* r = new TraceRegistry;
+    return *r;
+}
+
+const std::chrono::steady_clock::time_point& epoch()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+
+// the buffer of a thread, handed over to the registry when the thread ends
+struct ThreadBuffer
+{
+    std::shared_ptr<TraceBuffer> buffer;
+
+    ~ThreadBuffer()
+    {
+        if (buffer)
+        {
+            std::lock_guard<std::mutex> g(buffer->mutex);
+            buffer->ended = true;
+        }
+    }
+};
+
+thread_local ThreadBuffer threadBuffer;
+thread_local const char* threadName = nullptr;
+
+bool hasended(TraceBuffer& buffer)
+{
+    std::lock_guard<std::mutex> g(buffer.mutex);
+    return buffer.ended;
+}
+
+TraceBuffer* currentbuffer()
+{
+    if (!threadBuffer.buffer)
+    {
+        std::shared_ptr<TraceBuffer> buffer = std::make_shared<TraceBuffer>();
+        TraceRegistry& r = registry();
+
+        std::lock_guard<std::mutex> g(r.mutex);
+        buffer->events.resize(r.buffersize);
+        buffer->tid = r.nexttid++;
+        buffer->name = threadName;
+
+        size_t ended = 0;
+        for (size_t i = r.buffers.size(); i--; )
+        {
+            if (hasended(*r.buffers[i]) && ++ended > MAX_ENDED_BUFFERS)
+            {
+                r.buffers.erase(r.buffers.begin() + i);
+            }
+        }
+
+        r.buffers.push_back(buffer);
+        threadBuffer.buffer = std::move(buffer);
+    }
+
+    return threadBuffer.buffer.get();
+}
+
+} // namespace
+
+std::atomic<bool> Trace::sEnabled(false);
+const size_t Trace::DEFAULT_BUFFER_SIZE;
+
+void Trace::record(char phase, const char* name, const void* id)
+{
+    TraceBuffer* buffer = currentbuffer();
+    int64_t ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch()).count();
+
+    std::lock_guard<std::mutex> g(buffer->mutex);
+    if (!buffer->events.empty())
+    {
+        TraceEvent& e = buffer->events[buffer->next++ % buffer->events.size()];
+        e.name = name;
+        e.id = id;
+        e.ts = ts;
+        e.phase = phase;
+    }
+}
+
+void Trace::enable(bool enable)
+{
+    epoch();
+    sEnabled.store(enable, std::memory_order_relaxed);
+    LOG_info << "Tracing " << (enable ? "enabled" : "disabled");
+}
+
+void Trace::setbuffersize(size_t events)
+{
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> g(r.mutex);
+    r.buffersize = events;
+}
+
+void Trace::threadname(const char* name)
+{
+    // the buffer is only created once the thread records something
+    threadName = name;
+
+    if (TraceBuffer* buffer = threadBuffer.buffer.get())
+    {
+        std::lock_guard<std::mutex> g(buffer->mutex);
+        buffer->name = name;
+    }
+}
+
+string Trace::dump()
+{
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        TraceRegistry& r = registry();
+        std::lock_guard<std::mutex> g(r.mutex);
+        buffers = r.buffers;
+    }
+
+    std::ostringstream s;
+    const char* separator = "";
+    s << "{\"traceEvents\":[";
+
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        TraceBuffer& buffer = *buffers[i];
+        std::lock_guard<std::mutex> g(buffer.mutex);
+
+        if (buffer.name)
+        {
+            s << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.tid
+              << ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+            separator = ",";
+        }
+
+        // once the ring has wrapped, the oldest spans may have lost their beginning
+        uint64_t count = std::min<uint64_t>(buffer.next, buffer.events.size());
+        int depth = 0;
+        for (uint64_t n = buffer.next - count; n < buffer.next; n++)
+        {
+            const TraceEvent& e = buffer.events[n % buffer.events.size()];
+
+            if (e.phase == 'B')
+            {
+                depth++;
+            }
+            else if (e.phase == 'E')
+            {
+                if (!depth)
+                {
+                    continue;
+                }
+                depth--;
+            }
+
+            s << separator << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+              << "\",\"ts\":" << e.ts << ",\"pid\":1,\"tid\":" << buffer.tid;
+
+            if (e.phase == 'b' || e.phase == 'e')
+            {
+                s << ",\"cat\":\"" << e.name << "\",\"id\":\"0x" << std::hex << uintptr_t(e.id) << std::dec << "\"";
+            }
+
+            s << "}";
+            separator = ",";
+        }
+    }
+
+    s << "]}";
+    return s.str();
+}
+
+void Trace::clear()
+{
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> g(r.mutex);
+
+    for (size_t i = r.buffers.size(); i--; )
+    {
+        if (hasended(*r.buffers[i]))
+        {
+            r.buffers.erase(r.buffers.begin() + i);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> bg(r.buffers[i]->mutex);
+            r.buffers[i]->next = 0;
+        }
+    }
+}
+
+} // namespace
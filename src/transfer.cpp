@@ -32,6 +32,82 @@
 
 namespace mega {
 
+UploadStream::UploadStream(InputStreamAccess* is, m_time_t cmtime)
+    : stream(is)
+    , size(is->size())
+    , mtime(cmtime)
+    , fingerprint(size)
+{
+}
+
+StreamFileAccess::StreamFileAccess(std::shared_ptr<UploadStream> cupload, Waiter* w)
+    : FileAccess(w)
+    , upload(std::move(cupload))
+{
+    size = upload->size;
+    mtime = upload->mtime;
+    fsid = UNDEF;
+    fsidvalid = false;
+    type = FILENODE;
+    retry = false;
+    errorcode = 0;
+}
+
+bool StreamFileAccess::fopen(string*, bool read, bool write)
+{
+    retry = false;
+    return read && !write;
+}
+
+bool StreamFileAccess::fwrite(const byte*, unsigned, m_off_t)
+{
+    retry = false;
+    return false;
+}
+
+void StreamFileAccess::updatelocalname(string*)
+{
+}
+
+bool StreamFileAccess::sysread(byte* dst, unsigned len, m_off_t pos)
+{
+    retry = false;
+
+    // the data before pos has been consumed, and the stream can't skip ahead
+    if (pos != upload->pos || pos + len > upload->size)
+    {
+        LOG_err << "Non-sequential read of an upload stream at " << pos << " (" << upload->pos << ")";
+        return false;
+    }
+
+    if (!upload->stream->read(dst, len))
+    {
+        LOG_err << "Unable to read " << len << " bytes of an upload stream at " << pos;
+        return false;
+    }
+
+    upload->fingerprint.add(dst, len, pos);
+    upload->pos += len;
+    return true;
+}
+
+bool StreamFileAccess::sysstat(m_time_t* curr_mtime, m_off_t* curr_size)
+{
+    *curr_mtime = upload->mtime;
+    *curr_size = upload->size;
+    type = FILENODE;
+    return true;
+}
+
+bool StreamFileAccess::sysopen(bool)
+{
+    return true;
+}
+
+void StreamFileAccess::sysclose()
+{
+}
+
 Transfer::Transfer(MegaClient* cclient, direction_t ctype)
     : bt(cclient->rng)
 {
@@ -53,10 +129,13 @@ Transfer::Transfer(MegaClient* cclient, direction_t ctype)
     finished = false;
     lastaccesstime = 0;
     ultoken = NULL;
+    localfsid = UNDEF;
 
     priority = 0;
     state = TRANSFERSTATE_NONE;
 
+    bt.schedule(&client->transferretries, this);
+
     skipserialization = false;
 
     faputcompletion_it = client->faputcompletion.end();
@@ -82,11 +161,15 @@ Transfer::~Transfer()
         (*it)->terminated();
     }
 
-    if (transfers_it != client->transfers[type].end())
+    // the queues are cleared at once when they are torn down
+    if (!client->tearingdown)
     {
-        client->transfers[type].erase(transfers_it);
+        if (transfers_it != client->transfers[type].end())
+        {
+            client->transfers[type].erase(transfers_it);
+        }
+        client->transferlist.removetransfer(this);
     }
-    client->transferlist.removetransfer(this);
 
     if (slot)
     {
@@ -105,6 +188,11 @@ Transfer::~Transfer()
         delete [] ultoken;
     }
 
+    if (urlprefetch)
+    {
+        urlprefetch->cancel();
+    }
+
     if (finished)
     {
         if (type == GET && localfilename.size())
@@ -116,6 +204,39 @@ Transfer::~Transfer()
 }
 
 bool Transfer::serialize(string *d)
+{
+    return serializerecord(d, &chunkmacs);
+}
+
+bool Transfer::changedchunkmacs(chunkmac_map* changed) const
+{
+    size_t kept = 0;
+
+    for (chunkmac_map::const_iterator it = chunkmacs.begin(); it != chunkmacs.end(); it++)
+    {
+        chunkmac_map::const_iterator cached = cachedchunkmacs.find(it->first);
+
+        if (cached == cachedchunkmacs.end())
+        {
+            (*changed)[it->first] = it->second;
+            continue;
+        }
+
+        kept++;
+
+        if (memcmp(cached->second.mac, it->second.mac, sizeof it->second.mac)
+         || cached->second.offset != it->second.offset
+         || cached->second.finished != it->second.finished)
+        {
+            (*changed)[it->first] = it->second;
+        }
+    }
+
+    // the count is serialized as an unsigned short
+    return kept == cachedchunkmacs.size() && changed->size() <= USHRT_MAX;
+}
+
+bool Transfer::serializerecord(string *d, const chunkmac_map* macs)
 {
     unsigned short ll;
 
@@ -130,7 +251,14 @@ bool Transfer::serialize(string *d)
     d->append((const char*)&metamac, sizeof(metamac));
     d->append((const char*)transferkey, sizeof (transferkey));
 
-    chunkmacs.serialize(*d);
+    if (macs)
+    {
+        macs->serialize(*d);
+    }
+    else
+    {
+        chunkmac_map().serialize(*d);
+    }
 
     if (!FileFingerprint::serialize(d))
     {
@@ -173,7 +301,10 @@ bool Transfer::serialize(string *d)
     char s = static_cast<char>(state);
     d->append((const char*)&s, sizeof(s));
     d->append((const char*)&priority, sizeof(priority));
-    d->append("", 1);
+
+    // version 1: the file system id of the local file follows
+    d->append("\1", 1);
+    d->append((const char*)&localfsid, sizeof(localfsid));
     return true;
 }
 
@@ -294,12 +425,15 @@ Transfer *Transfer::unserialize(MegaClient *client, string *d, transfer_map* tra
     combinedUrls.assign(ptr, ll);
     for (size_t p = 0; p < ll; )
     {
-        size_t n = combinedUrls.find('\0');
-        t->tempurls.push_back(combinedUrls.substr(p, n));
-        assert(!t->tempurls.back().empty());
-        p += (n == std::string::npos) ? ll : (n + 1);
+        size_t n = combinedUrls.find('\0', p);
+        if (n == std::string::npos)
+        {
+            n = ll;
+        }
+        t->tempurls.push_back(combinedUrls.substr(p, n - p));
+        p = n + 1;
     }
-    if (!t->tempurls.empty() && t->tempurls.size() != 1 && t->tempurls.size() != RAIDPARTS)
+    if (std::find(t->tempurls.begin(), t->tempurls.end(), string()) != t->tempurls.end())
     {
         LOG_err << "Transfer unserialization failed - temp URL incorrect components";
         delete t;
@@ -318,13 +452,19 @@ Transfer *Transfer::unserialize(MegaClient *client, string *d, transfer_map* tra
     t->priority =  MemAccess::get<uint64_t>(ptr);
     ptr += sizeof(uint64_t);
 
-    if (*ptr)
+    char version = *ptr++;
+    if (version > 1 || (version == 1 && ptr + sizeof(handle) > end))
     {
         LOG_err << "Transfer unserialization failed - invalid version";
         delete t;
         return NULL;
     }
-    ptr++;
+
+    if (version == 1)
+    {
+        t->localfsid = MemAccess::get<handle>(ptr);
+        ptr += sizeof(handle);
+    }
 
     t->chunkmacs.calcprogress(t->size, t->pos, t->progresscompleted);
 
@@ -509,9 +649,18 @@ void Transfer::addAnyMissingMediaFileAttributes(Node* node, /*const*/ std::strin
 
             // always get the attribute string; it may indicate this version of the mediaInfo library was unable to interpret the file
             MediaProperties vp;
-            vp.extractMediaPropertyFileAttributes(localpath, client->fsaccess);
-
-            if (type == PUT)
+            const FileFingerprint& fp = (type == PUT) ? *(FileFingerprint*)this : *(FileFingerprint*)node;
+            if (!client->cachedmediaproperties(fp, vp))
+            {
+                // read by a worker, MediaInfo may need several MB of large files
+                client->extractmediaproperties(fp, &localpath, type == PUT, (type == PUT) ? uploadhandle : node->nodehandle, attrKey);
+                if (type == PUT)
+                {
+                    // the upload completes once the attribute is ready (see MegaClient::execmediajobs)
+                    minfa++;
+                }
+            }
+            else if (type == PUT)
             {
                 minfa += client->mediaFileInfo.queueMediaPropertiesFileAttributesForUpload(vp, attrKey, client, uploadhandle);
             }
@@ -814,6 +963,14 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
                         LOG_debug << "Identical node downloaded to the same folder";
                         success = true;
                     }
+                    // not for syncs, which tell the files apart by their fsid
+                    else if (client->hardlinkdownloads && !(*it)->syncxfer
+                             && client->fsaccess->linklocal(tmplocalname.size() ? &tmplocalname : &localfilename,
+                                                            &localname))
+                    {
+                        LOG_debug << "Download hard linked to the target path";
+                        success = true;
+                    }
                     else if (client->fsaccess->copylocal(tmplocalname.size() ? &tmplocalname : &localfilename,
                                                    &localname, mtime))
                     {
@@ -846,7 +1003,7 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
 
                                 if (missingattr)
                                 {
-                                    client->gfx->gendimensionsputfa(NULL, &localname, n->nodehandle, n->nodecipher(), missingattr);
+                                    client->gfx->gendimensionsputfa(NULL, &localname, n->nodehandle, n->nodecipher(), missingattr, true, n);
                                 }
 
                                 addAnyMissingMediaFileAttributes(n, localname);
@@ -859,6 +1016,8 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
                 {
                     if (success)
                     {
+                        client->queuedurable(localname);
+
                         // prevent deletion of associated Transfer object in completed()
                         client->filecachedel(*it, &committer);
                         client->app->file_complete(*it);
@@ -944,6 +1103,33 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
             slot->fa.reset();
         }
 
+        if (uploadstream)
+        {
+            // the fingerprint of the data read, for the node attributes
+            FileFingerprint fp;
+            if (uploadstream->pos != size || !uploadstream->fingerprint.get(&fp, uploadstream->mtime))
+            {
+                LOG_err << "Incomplete upload stream: " << uploadstream->pos << " of " << size;
+                return failed(API_EREAD, committer);
+            }
+
+            if (transfers_it != client->transfers[type].end())
+            {
+                client->transfers[type].erase(transfers_it);
+            }
+            *(FileFingerprint*)this = fp;
+            auto inserted = client->transfers[type].insert(pair<FileFingerprint*, Transfer*>((FileFingerprint*)this, this));
+            transfers_it = inserted.second ? inserted.first : client->transfers[type].end();
+
+            for (file_list::iterator it = files.begin(); it != files.end(); it++)
+            {
+                *(FileFingerprint*)(*it) = fp;
+            }
+
+            client->checkfacompletion(uploadhandle, this);
+            return;
+        }
+
         // files must not change during a PUT transfer
         for (file_list::iterator it = files.begin(); it != files.end(); )
         {
@@ -1050,6 +1236,8 @@ void Transfer::completefiles()
         files.erase(it++);
     }
     ids.push_back(dbid);
+    ids.insert(ids.end(), chunkmacdeltas.begin(), chunkmacdeltas.end());
+    chunkmacdeltas.clear();
 }
 
 m_off_t Transfer::nextpos()
@@ -1097,6 +1285,7 @@ DirectReadNode::DirectReadNode(MegaClient* cclient, handle ch, bool cp, SymmCiph
 
     retries = 0;
     size = 0;
+    lastreadend = 0;
     
     pendingcmd = NULL;
     
@@ -1169,7 +1358,7 @@ void DirectReadNode::retry(error e, dstime timeleft)
     {
         (*it)->abort();
 
-        if (e)
+        if (e && !(*it)->readahead)
         {
             dstime retryds = client->app->pread_failure(e, retries, (*it)->appdata, timeleft);
 
@@ -1225,12 +1414,7 @@ void DirectReadNode::cmdresult(error e, dstime timeleft)
             DirectRead* dr = *it;
             assert(dr->drq_it == client->drq.end());
 
-            if (dr->drbuf.tempUrlVector().empty())
-            {
-                // DirectRead starting
-                dr->drbuf.setIsRaid(dr->drn->tempurls, dr->offset, dr->offset + dr->count, dr->drn->size, 2097152);  // 2 MB max buffer usage approx for streaming
-            }
-            else
+            if (!dr->drbuf.tempUrlVector().empty())
             {
                 // URLs have been re-requested, eg. due to temp URL expiry.  Keep any parts downloaded already
                 dr->drbuf.updateUrlsAndResetPos(dr->drn->tempurls);
@@ -1239,7 +1423,8 @@ void DirectReadNode::cmdresult(error e, dstime timeleft)
             dr->drq_it = client->drq.insert(client->drq.end(), *it);
         }
 
-        schedule(DirectReadSlot::TIMEOUT_DS);
+        // a prefetched node waits for its reads as long as a completed one
+        schedule(reads.empty() ? DirectReadSlot::TEMPURL_TIMEOUT_DS : DirectReadSlot::TIMEOUT_DS);
     }
     else
     {
@@ -1270,24 +1455,69 @@ void DirectReadNode::enqueue(m_off_t offset, m_off_t count, int reqtag, void* ap
     new DirectRead(this, count, offset, reqtag, appdata);
 }
 
+void DirectReadNode::readahead(m_off_t pos)
+{
+    m_off_t count = std::min(std::min(DirectReadCache::READAHEAD, client->drcache.getmaxsize() / 4), size - pos);
+    if (count <= 0 || tempurls.empty())
+    {
+        return;
+    }
+
+    for (dr_list::iterator it = reads.begin(); it != reads.end(); it++)
+    {
+        if ((*it)->offset <= pos && pos < (*it)->offset + (*it)->count)
+        {
+            // already being read
+            return;
+        }
+    }
+
+    LOG_debug << "Streaming read ahead " << pos << " - " << (pos + count);
+    DirectRead* dr = new DirectRead(this, count, pos, 0, NULL);
+    dr->readahead = true;
+}
+
+// next piece to deliver: the one of connection 0, or the one at the current position for parallel sub-ranges
+RaidBufferManager::FilePiece* DirectReadSlot::nextOutputPiece(unsigned& connectionNum)
+{
+    if (!parallel)
+    {
+        connectionNum = 0;
+        return dr->drbuf.getAsyncOutputBufferPointer(0);
+    }
+
+    for (unsigned i = unsigned(reqs.size()); i--; )
+    {
+        RaidBufferManager::FilePiece* piece = dr->drbuf.getAsyncOutputBufferPointer(i);
+        if (piece && piece->pos == pos)
+        {
+            connectionNum = i;
+            return piece;
+        }
+    }
+    return NULL;
+}
+
 bool DirectReadSlot::processAnyOutputPieces()
 {
     bool continueDirectRead = true;
     TransferBufferManager::FilePiece* outputPiece;
-    while (continueDirectRead && (outputPiece = dr->drbuf.getAsyncOutputBufferPointer(0)))
+    unsigned connectionNum;
+    while (continueDirectRead && (outputPiece = nextOutputPiece(connectionNum)))
     {
         size_t len = outputPiece->buf.datalen();
         speed = speedController.calculateSpeed();
         meanSpeed = speedController.getMeanSpeed();
         dr->drn->client->httpio->updatedownloadspeed(len);
-        continueDirectRead = dr->drn->client->app->pread_data(outputPiece->buf.datastart(), len, pos, speed, meanSpeed, dr->appdata);
+        dr->drn->client->transferquotadownloaded += len;
+        dr->drn->client->drcache.store(dr->drn->h, pos, outputPiece->buf.datastart(), len);
+        continueDirectRead = dr->readahead || dr->drn->client->app->pread_data(outputPiece->buf.datastart(), len, pos, speed, meanSpeed, dr->appdata);
 
-        dr->drbuf.bufferWriteCompleted(0, true);
+        dr->drbuf.bufferWriteCompleted(connectionNum, true);
 
         if (continueDirectRead)
         {
             pos += len;
-            dr->drn->partiallen += len;
             dr->progress += len;
         }
     }
@@ -1296,13 +1526,43 @@ bool DirectReadSlot::processAnyOutputPieces()
 
 bool DirectReadSlot::doio()
 {
+    m_off_t startpos = pos;
+
     for (unsigned connectionNum = unsigned(reqs.size()); connectionNum--; )
     {
         HttpReq* req = reqs[connectionNum];
 
-        if (req->status == REQ_INFLIGHT || req->status == REQ_SUCCESS)
+        // a sub-range ahead of the delivered data is kept in the request until its turn
+        bool held = parallel && dr->drbuf.getAsyncOutputBufferPointer(connectionNum);
+
+        if ((req->status == REQ_INFLIGHT || req->status == REQ_SUCCESS) && req->buf)
+        {
+            // bounded request received into a pooled buffer, handed over whole when complete
+            if (req->bufpos > req->notifiedbufpos)
+            {
+                dr->drn->partiallen += req->bufpos - req->notifiedbufpos;
+                req->notifiedbufpos = req->bufpos;
+                dr->drn->schedule(DirectReadSlot::TIMEOUT_DS);
+            }
+
+            if (req->status == REQ_SUCCESS && !held)
+            {
+                m_off_t piecepos = req->pos;
+                req->pos += req->bufpos;
+
+                dr->drbuf.submitBuffer(connectionNum, new RaidBufferManager::FilePiece(piecepos, req->release_buf()));
+
+                if (!processAnyOutputPieces())
+                {
+                    // app-requested abort
+                    delete dr;
+                    return true;
+                }
+            }
+        }
+        else if (req->status == REQ_INFLIGHT || req->status == REQ_SUCCESS)
         {
-            if (req->in.size())
+            if (req->in.size() && !held)
             {
                 unsigned n = unsigned(req->in.size());
 
@@ -1322,6 +1582,7 @@ bool DirectReadSlot::doio()
                     req->contentlength -= n;
                     req->bufpos = 0;
                     req->pos += n;
+                    dr->drn->partiallen += n;
 
                     dr->drbuf.submitBuffer(connectionNum, np);
 
@@ -1342,11 +1603,11 @@ bool DirectReadSlot::doio()
                     }
                 }
             }
+        }
 
-            if (req->status == REQ_SUCCESS)
-            {
-                req->status = REQ_READY;
-            }
+        if (req->status == REQ_SUCCESS && req->in.empty() && !req->buf)
+        {
+            req->status = REQ_READY;
         }
         
         if (req->status == REQ_READY)
@@ -1354,10 +1615,15 @@ bool DirectReadSlot::doio()
             bool newBufferSupplied = false, pauseForRaid = false;
             std::pair<m_off_t, m_off_t> posrange = dr->drbuf.nextNPosForConnection(connectionNum, newBufferSupplied, pauseForRaid);
 
+            if (parallel)
+            {
+                posrange.second = std::min(posrange.second, posrange.first + SUBRANGE_SIZE);
+            }
+
             // we might have a raid-reassembled block to write, or a previously loaded block, or a skip block to process.
             processAnyOutputPieces();
 
-            if (!newBufferSupplied && !pauseForRaid)
+            if (!newBufferSupplied && !pauseForRaid && !(parallel && dr->drbuf.getAsyncOutputBufferPointer(connectionNum)))
             {
                 if (posrange.first >= posrange.second)
                 {
@@ -1372,10 +1638,8 @@ bool DirectReadSlot::doio()
                     }
                     if (allDone)
                     {
-                        dr->drn->schedule(DirectReadSlot::TEMPURL_TIMEOUT_DS);
-
                         // remove and delete completed read request, then remove slot
-                        delete dr;
+                        dr->completed();
                         return true;
                     }
                 }
@@ -1389,6 +1653,20 @@ bool DirectReadSlot::doio()
                     }
 
                     req->pos = posrange.first;
+
+                    if (parallel || dr->drbuf.isRaid())
+                    {
+                        // the size is bounded: receive straight into a pooled buffer (with room for
+                        // the SymmCipher::ctr_crypt padding) and hand it over without copying
+                        size_t len = size_t(posrange.second - posrange.first);
+                        if (req->buf)
+                        {
+                            HttpBufferPool::release(req->buf, req->bufcapacity);
+                        }
+                        req->buf = HttpBufferPool::allocate(len + SymmCipher::BLOCKSIZE, &req->bufcapacity);
+                        req->buflen = m_off_t(len);
+                    }
+
                     req->posturl = adjustURLPort(dr->drbuf.tempURL(connectionNum));
                     req->posturl.append(buf);
                     LOG_debug << "POST URL: " << req->posturl;
@@ -1458,9 +1736,84 @@ bool DirectReadSlot::doio()
         }
     }
 
+    if (parallel && pos != startpos)
+    {
+        // data held by other connections may be deliverable now
+        for (size_t i = reqs.size(); i--; )
+        {
+            if ((reqs[i]->in.size() || (reqs[i]->buf && reqs[i]->status == REQ_SUCCESS))
+                    && !dr->drbuf.getAsyncOutputBufferPointer(unsigned(i)))
+            {
+                return true;
+            }
+        }
+    }
+
     return false;
 }
 
+bool DirectRead::start()
+{
+    if (!drbuf.tempUrlVector().empty())
+    {
+        // restarted slot: keep any parts downloaded already
+        return true;
+    }
+
+    // deliver the data already cached, then request the rest
+    DirectReadCache& cache = drn->client->drcache;
+    size_t len;
+    const byte* data;
+    m_off_t start = progress;
+
+    while (progress < count && (data = cache.find(drn->h, offset + progress, &len)))
+    {
+        len = size_t(std::min<m_off_t>(len, count - progress));
+
+        if (!readahead && !drn->client->app->pread_data((byte*)data, len, offset + progress, 0, 0, appdata))
+        {
+            // app-requested abort
+            delete this;
+            return false;
+        }
+        progress += len;
+    }
+
+    if (progress > start)
+    {
+        LOG_debug << "Streaming data from cache: " << (progress - start) << " bytes at " << (offset + start);
+    }
+
+    if (progress >= count)
+    {
+        completed();
+        return false;
+    }
+
+    drbuf.setIsRaid(drn->tempurls, offset + progress, offset + count, drn->size, 2097152);  // 2 MB max buffer usage approx for streaming
+    return true;
+}
+
+void DirectRead::completed()
+{
+    DirectReadNode* node = drn;
+    m_off_t end = offset + count;
+    bool sequential = !readahead && offset == node->lastreadend;
+
+    if (!readahead)
+    {
+        node->lastreadend = end;
+    }
+
+    node->schedule(DirectReadSlot::TEMPURL_TIMEOUT_DS);
+    delete this;
+
+    if (sequential && node->client->drcache.getmaxsize())
+    {
+        node->readahead(end);
+    }
+}
+
 // abort active read, remove from pending queue
 void DirectRead::abort()
 {
@@ -1484,6 +1837,7 @@ DirectRead::DirectRead(DirectReadNode* cdrn, m_off_t ccount, m_off_t coffset, in
     progress = 0;
     reqtag = creqtag;
     appdata = cappdata;
+    readahead = false;
 
     drs = NULL;
 
@@ -1491,8 +1845,7 @@ DirectRead::DirectRead(DirectReadNode* cdrn, m_off_t ccount, m_off_t coffset, in
     
     if (!drn->tempurls.empty())
     {
-        // we already have tempurl(s): queue for immediate fetching
-        drbuf.setIsRaid(drn->tempurls, offset, offset + count, drn->size, 2097152);  // 2 MB max buffer usage approx
+        // we already have tempurl(s): queue for immediate fetching (see DirectRead::start)
         drq_it = drn->client->drq.insert(drn->client->drq.end(), this);
     }
     else
@@ -1552,8 +1905,15 @@ DirectReadSlot::DirectReadSlot(DirectRead* cdr)
 
     speed = meanSpeed = 0;
 
+    size_t connections = dr->drbuf.tempUrlVector().size();
+    if (!dr->drbuf.isRaid())
+    {
+        connections = std::max<size_t>(connections, size_t(std::min<m_off_t>(MAX_CONNECTIONS, (dr->count - dr->progress) / SUBRANGE_SIZE)));
+    }
+    parallel = !dr->drbuf.isRaid() && connections > 1;
+
     assert(reqs.empty());
-    for (size_t i = dr->drbuf.tempUrlVector().size(); i--; )
+    for (size_t i = connections; i--; )
     {
         reqs.push_back(new HttpReq(true));
         reqs.back()->status = REQ_READY;
@@ -1573,95 +1933,346 @@ DirectReadSlot::~DirectReadSlot()
     LOG_debug << "Deleting DirectReadSlot";
     for (size_t i = reqs.size(); i--; )
     {
+        // sub-ranges not delivered yet are fetched again by the next slot
+        if (parallel && dr->drbuf.getAsyncOutputBufferPointer(unsigned(i)))
+        {
+            dr->drbuf.bufferWriteCompleted(unsigned(i), false);
+        }
         delete reqs[i];
     }
 }
 
-bool priority_comparator(Transfer* i, Transfer *j)
+void TransferTree::update(Node* n)
 {
-    return (i->priority < j->priority);
+    n->count = 1 + count(n->left) + count(n->right);
+
+    if (n->left)
+    {
+        n->left->parent = n;
+    }
+
+    if (n->right)
+    {
+        n->right->parent = n;
+    }
 }
 
-TransferList::TransferList()
+// split a subtree into the transfers before a priority and the others
+void TransferTree::split(Node* n, uint64_t priority, Node*& lower, Node*& upper)
 {
-    currentpriority = PRIORITY_START;
+    if (!n)
+    {
+        lower = upper = nullptr;
+    }
+    else if (n->transfer->priority < priority)
+    {
+        split(n->right, priority, n->right, upper);
+        update(n);
+        lower = n;
+    }
+    else
+    {
+        split(n->left, priority, lower, n->left);
+        update(n);
+        upper = n;
+    }
 }
 
-void TransferList::addtransfer(Transfer *transfer, DBTableTransactionCommitter& committer, bool startFirst)
+// join two subtrees, all the transfers of the first one going before the second one's
+TransferTree::Node* TransferTree::merge(Node* lower, Node* upper)
 {
-    if (transfer->state != TRANSFERSTATE_PAUSED)
+    if (!lower)
     {
-        transfer->state = TRANSFERSTATE_QUEUED;
+        return upper;
     }
 
-    if (!transfer->priority)
+    if (!upper)
     {
-        if (startFirst && transfers[transfer->type].size())
-        {
-            transfer_list::iterator dstit = transfers[transfer->type].begin();
-            transfer->priority = (*dstit)->priority - PRIORITY_STEP;
-            prepareIncreasePriority(transfer, transfers[transfer->type].end(), dstit, committer);
-            transfers[transfer->type].push_front(transfer);
-        }
-        else
-        {
-            currentpriority += PRIORITY_STEP;
-            transfer->priority = currentpriority;
-            assert(!transfers[transfer->type].size() || transfers[transfer->type][transfers[transfer->type].size() - 1]->priority < transfer->priority);
-            transfers[transfer->type].push_back(transfer);
-        }
-
-        client->transfercacheadd(transfer, &committer);
+        return lower;
     }
-    else
+
+    if (lower->heap > upper->heap)
     {
-        transfer_list::iterator it = std::lower_bound(transfers[transfer->type].begin(), transfers[transfer->type].end(), transfer, priority_comparator);
-        assert(it == transfers[transfer->type].end() || (*it)->priority != transfer->priority);
-        transfers[transfer->type].insert(it, transfer);
+        lower->right = merge(lower->right, upper);
+        update(lower);
+        return lower;
     }
+
+    upper->left = merge(lower, upper->left);
+    update(upper);
+    return upper;
 }
 
-void TransferList::removetransfer(Transfer *transfer)
+void TransferTree::clear(Node* n)
 {
-    transfer_list::iterator it = iterator(transfer);
-    if (it != transfers[transfer->type].end())
+    if (n)
     {
-        transfers[transfer->type].erase(it);
+        clear(n->left);
+        clear(n->right);
+        delete n;
     }
 }
 
-void TransferList::movetransfer(Transfer *transfer, Transfer *prevTransfer, DBTableTransactionCommitter& committer)
+TransferTree::Node* TransferTree::first(Node* n)
 {
-    transfer_list::iterator dstit = iterator(prevTransfer);
-    if (dstit == transfers[prevTransfer->type].end())
+    while (n && n->left)
     {
-        return;
+        n = n->left;
     }
-    movetransfer(transfer, dstit, committer);
+    return n;
 }
 
-void TransferList::movetransfer(Transfer *transfer, unsigned int position, DBTableTransactionCommitter& committer)
+TransferTree::Node* TransferTree::last(Node* n)
 {
-    transfer_list::iterator it = iterator(transfer);
-    if (it == transfers[transfer->type].end())
+    while (n && n->right)
     {
-        return;
+        n = n->right;
     }
+    return n;
+}
 
-    transfer_list::iterator dstit;
-    if (position >= transfers[transfer->type].size())
+TransferTree::Node* TransferTree::next(Node* n)
+{
+    if (n->right)
     {
-        dstit = transfers[transfer->type].end();
+        return first(n->right);
     }
-    else
+
+    while (n->parent && n->parent->right == n)
     {
-        dstit = transfers[transfer->type].begin() + position;
+        n = n->parent;
     }
-
-    movetransfer(it, dstit, committer);
+    return n->parent;
 }
 
-void TransferList::movetransfer(Transfer *transfer, transfer_list::iterator dstit, DBTableTransactionCommitter& committer)
+TransferTree::Node* TransferTree::prev(Node* n)
+{
+    if (n->left)
+    {
+        return last(n->left);
+    }
+
+    while (n->parent && n->parent->left == n)
+    {
+        n = n->parent;
+    }
+    return n->parent;
+}
+
+TransferTree::iterator TransferTree::at(size_t position)
+{
+    Node* n = root;
+    while (n)
+    {
+        size_t before = count(n->left);
+        if (position == before)
+        {
+            break;
+        }
+
+        if (position < before)
+        {
+            n = n->left;
+        }
+        else
+        {
+            position -= before + 1;
+            n = n->right;
+        }
+    }
+    return iterator(this, n);
+}
+
+size_t TransferTree::index(const iterator& it) const
+{
+    Node* n = it.node;
+    if (!n)
+    {
+        return size();
+    }
+
+    size_t position = count(n->left);
+    for (; n->parent; n = n->parent)
+    {
+        if (n->parent->right == n)
+        {
+            position += count(n->parent->left) + 1;
+        }
+    }
+    return position;
+}
+
+TransferTree::iterator TransferTree::lower_bound(uint64_t priority)
+{
+    Node* found = nullptr;
+    for (Node* n = root; n; )
+    {
+        if (n->transfer->priority < priority)
+        {
+            n = n->right;
+        }
+        else
+        {
+            found = n;
+            n = n->left;
+        }
+    }
+    return iterator(this, found);
+}
+
+TransferTree::iterator TransferTree::insert(Transfer* transfer)
+{
+    // xorshift: random heap keys keep the tree balanced whatever the insertion order
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node* n = new Node;
+    n->transfer = transfer;
+    n->parent = n->left = n->right = nullptr;
+    n->count = 1;
+    n->heap = seed;
+
+    Node* lower;
+    Node* upper;
+    split(root, transfer->priority, lower, upper);
+    root = merge(merge(lower, n), upper);
+    root->parent = nullptr;
+    return iterator(this, n);
+}
+
+void TransferTree::erase(iterator it)
+{
+    Node* n = it.node;
+    Node* parent = n->parent;
+    Node* joined = merge(n->left, n->right);
+
+    if (joined)
+    {
+        joined->parent = parent;
+    }
+
+    if (!parent)
+    {
+        root = joined;
+    }
+    else if (parent->left == n)
+    {
+        parent->left = joined;
+    }
+    else
+    {
+        parent->right = joined;
+    }
+
+    for (; parent; parent = parent->parent)
+    {
+        parent->count--;
+    }
+
+    delete n;
+}
+
+void TransferTree::clear()
+{
+    clear(root);
+    root = nullptr;
+}
+
+TransferTree::~TransferTree()
+{
+    clear(root);
+}
+
+TransferList::TransferList()
+{
+    currentpriority = PRIORITY_START;
+}
+
+void TransferList::addtransfer(Transfer *transfer, DBTableTransactionCommitter& committer, bool startFirst)
+{
+    if (transfer->state != TRANSFERSTATE_PAUSED)
+    {
+        transfer->state = TRANSFERSTATE_QUEUED;
+    }
+
+    if (!transfer->priority)
+    {
+        if (startFirst && transfers[transfer->type].size())
+        {
+            transfer_list::iterator dstit = transfers[transfer->type].begin();
+            transfer->priority = (*dstit)->priority > PRIORITY_STEP
+                    ? (*dstit)->priority - PRIORITY_STEP
+                    : renumber(transfers[transfer->type], dstit, committer);
+            prepareIncreasePriority(transfer, transfers[transfer->type].end(), dstit, committer);
+            transfers[transfer->type].insert(transfer);
+        }
+        else
+        {
+            if (currentpriority > UINT64_MAX - PRIORITY_STEP)
+            {
+                transfer->priority = renumber(transfers[transfer->type], transfers[transfer->type].end(), committer);
+            }
+            else
+            {
+                currentpriority += PRIORITY_STEP;
+                transfer->priority = currentpriority;
+            }
+            assert(!transfers[transfer->type].size() || (*--transfers[transfer->type].end())->priority < transfer->priority);
+            transfers[transfer->type].insert(transfer);
+        }
+
+        client->transfercacheadd(transfer, &committer);
+    }
+    else
+    {
+        transfer_list::iterator it = transfers[transfer->type].lower_bound(transfer->priority);
+        assert(it == transfers[transfer->type].end() || (*it)->priority != transfer->priority);
+        transfers[transfer->type].insert(transfer);
+    }
+}
+
+void TransferList::removetransfer(Transfer *transfer)
+{
+    transfer_list::iterator it = iterator(transfer);
+    if (it != transfers[transfer->type].end())
+    {
+        transfers[transfer->type].erase(it);
+    }
+}
+
+void TransferList::movetransfer(Transfer *transfer, Transfer *prevTransfer, DBTableTransactionCommitter& committer)
+{
+    transfer_list::iterator dstit = iterator(prevTransfer);
+    if (dstit == transfers[prevTransfer->type].end())
+    {
+        return;
+    }
+    movetransfer(transfer, dstit, committer);
+}
+
+void TransferList::movetransfer(Transfer *transfer, unsigned int position, DBTableTransactionCommitter& committer)
+{
+    transfer_list::iterator it = iterator(transfer);
+    if (it == transfers[transfer->type].end())
+    {
+        return;
+    }
+
+    transfer_list::iterator dstit;
+    if (position >= transfers[transfer->type].size())
+    {
+        dstit = transfers[transfer->type].end();
+    }
+    else
+    {
+        dstit = transfers[transfer->type].begin() + position;
+    }
+
+    movetransfer(it, dstit, committer);
+}
+
+void TransferList::movetransfer(Transfer *transfer, transfer_list::iterator dstit, DBTableTransactionCommitter& committer)
 {
     transfer_list::iterator it = iterator(transfer);
     if (it == transfers[transfer->type].end())
@@ -1679,85 +2290,179 @@ void TransferList::movetransfer(transfer_list::iterator it, transfer_list::itera
         return;
     }
 
-    if ((it + 1) == dstit)
+    transfer_list::iterator nextit = it;
+    if (++nextit == dstit)
     {
         LOG_warn << "Trying to move to the same position";
         return;
     }
 
     Transfer *transfer = (*it);
-    if (dstit == transfers[transfer->type].end())
+    transfer_list& list = transfers[transfer->type];
+    if (dstit == list.end())
     {
         LOG_debug << "Moving transfer to the last position";
-        prepareDecreasePriority(transfer, it, dstit);
+        prepareDecreasePriority(transfer, nextit, dstit);
 
-        transfers[transfer->type].erase(it);
-        currentpriority += PRIORITY_STEP;
-        transfer->priority = currentpriority;
-        assert(!transfers[transfer->type].size() || transfers[transfer->type][transfers[transfer->type].size() - 1]->priority < transfer->priority);
-        transfers[transfer->type].push_back(transfer);
+        list.erase(it);
+        if (currentpriority > UINT64_MAX - PRIORITY_STEP)
+        {
+            transfer->priority = renumber(list, list.end(), committer);
+        }
+        else
+        {
+            currentpriority += PRIORITY_STEP;
+            transfer->priority = currentpriority;
+        }
+        assert(!list.size() || (*--list.end())->priority < transfer->priority);
+        list.insert(transfer);
         client->transfercacheadd(transfer, &committer);
         client->app->transfer_update(transfer);
         return;
     }
 
-    int srcindex = int(std::distance(transfers[transfer->type].begin(), it));
-    int dstindex = int(std::distance(transfers[transfer->type].begin(), dstit));
+    size_t srcindex = list.index(it);
+    size_t dstindex = list.index(dstit);
     LOG_debug << "Moving transfer from " << srcindex << " to " << dstindex;
 
+    list.erase(it);
+
     uint64_t prevpriority = 0;
     uint64_t nextpriority = 0;
 
     nextpriority = (*dstit)->priority;
-    if (dstit != transfers[transfer->type].begin())
+    if (dstit != list.begin())
     {
-        transfer_list::iterator previt = dstit - 1;
-        prevpriority = (*previt)->priority;
+        transfer_list::iterator previt = dstit;
+        prevpriority = (*--previt)->priority;
     }
     else
     {
-        prevpriority = nextpriority - 2 * PRIORITY_STEP;
+        // no lower than 0, which makeroom() then renumbers from
+        prevpriority = nextpriority > 2 * PRIORITY_STEP ? nextpriority - 2 * PRIORITY_STEP : 0;
     }
 
-    uint64_t newpriority = (prevpriority + nextpriority) / 2;
+    uint64_t newpriority = prevpriority + (nextpriority - prevpriority) / 2;
     LOG_debug << "Moving transfer between priority " << prevpriority << " and " << nextpriority << ". New: " << newpriority;
     if (prevpriority == newpriority)
     {
         LOG_warn << "There is no space for the move. Adjusting priorities.";
-        int positions = dstindex;
-        uint64_t fixedPriority = transfers[transfer->type][0]->priority - PRIORITY_STEP * (positions + 1);
-        for (int i = 0; i < positions; i++)
-        {
-            Transfer *t = transfers[transfer->type][i];
-            LOG_debug << "Adjusting priority of transfer " << i << " to " << fixedPriority;
-            t->priority = fixedPriority;
-            client->transfercacheadd(t, &committer);
-            client->app->transfer_update(t);
-            fixedPriority += PRIORITY_STEP;
-        }
-        newpriority = fixedPriority;
-        LOG_debug << "Fixed priority: " << fixedPriority;
+        newpriority = makeroom(list, dstit, committer);
+        LOG_debug << "Fixed priority: " << newpriority;
     }
 
     transfer->priority = newpriority;
     if (srcindex > dstindex)
     {
-        prepareIncreasePriority(transfer, it, dstit, committer);
+        prepareIncreasePriority(transfer, list.end(), dstit, committer);
     }
     else
     {
-        prepareDecreasePriority(transfer, it, dstit);
-        dstindex--;
+        prepareDecreasePriority(transfer, nextit, dstit);
     }
 
-    transfers[transfer->type].erase(it);
-    transfer_list::iterator fit = transfers[transfer->type].begin() + dstindex;
-    assert(fit == transfers[transfer->type].end() || (*fit)->priority != transfer->priority);
-    transfers[transfer->type].insert(fit, transfer);
+    assert((*dstit)->priority != transfer->priority);
+    list.insert(transfer);
     client->transfercacheadd(transfer, &committer);
     client->app->transfer_update(transfer);
 }
 
+// spread the priorities of the transfers around the position before dstit so
+// that there is room for one more there, over a window that doubles until the
+// gaps are wide enough: a few neighbours are rewritten rather than the whole queue
+uint64_t TransferList::makeroom(transfer_list& list, transfer_list::iterator dstit, DBTableTransactionCommitter& committer)
+{
+    size_t position = list.index(dstit);
+    size_t size = list.size();
+
+    for (size_t radius = 1; ; radius *= 2)
+    {
+        size_t first = position > radius ? position - radius : 0;
+        size_t last = std::min(size, position + radius);
+        uint64_t window = last - first + 1;
+
+        // exclusive bounds, open at the ends of the queue unless those run out of priorities
+        uint64_t margin = 2 * PRIORITY_STEP * window;
+        if ((!first && list[0]->priority <= margin)
+         || (last == size && list[size - 1]->priority > UINT64_MAX - margin))
+        {
+            return renumber(list, dstit, committer);
+        }
+
+        uint64_t low = first ? list[first - 1]->priority : list[0]->priority - margin;
+        uint64_t high = last < size ? list[last]->priority : list[size - 1]->priority + margin;
+        uint64_t step = (high - low) / (window + 1);
+        if (step < 2 * radius)
+        {
+            continue;
+        }
+
+        uint64_t priority = low;
+        uint64_t freepriority = 0;
+        transfer_list::iterator it = list.at(first);
+        for (size_t i = first; i < last; i++, it++)
+        {
+            if (i == position)
+            {
+                priority += step;
+                freepriority = priority;
+            }
+
+            priority += step;
+            Transfer *t = *it;
+            LOG_debug << "Adjusting priority of transfer " << i << " to " << priority;
+            t->priority = priority;
+            client->transfercacheadd(t, &committer);
+            client->app->transfer_update(t);
+        }
+
+        currentpriority = std::max(currentpriority, list[size - 1]->priority);
+        return freepriority;
+    }
+}
+
+// reassign the priorities of both queues from PRIORITY_START once one of them reaches
+// either end of the range, keeping their order and leaving a free priority before dstit
+uint64_t TransferList::renumber(transfer_list& list, transfer_list::iterator dstit, DBTableTransactionCommitter& committer)
+{
+    LOG_warn << "Transfer priorities exhausted. Renumbering the queues.";
+
+    size_t position = list.index(dstit);
+    uint64_t freepriority = 0;
+    currentpriority = PRIORITY_START;
+
+    for (int d = GET; d == GET || d == PUT; d++)
+    {
+        transfer_list& queue = transfers[d];
+        uint64_t priority = PRIORITY_START;
+        size_t i = 0;
+
+        for (transfer_list::iterator it = queue.begin(); ; it++, i++)
+        {
+            if (&queue == &list && i == position)
+            {
+                priority += PRIORITY_STEP;
+                freepriority = priority;
+            }
+
+            if (it == queue.end())
+            {
+                break;
+            }
+
+            priority += PRIORITY_STEP;
+            Transfer *t = *it;
+            t->priority = priority;
+            client->transfercacheadd(t, &committer);
+            client->app->transfer_update(t);
+        }
+
+        currentpriority = std::max(currentpriority, priority);
+    }
+
+    return freepriority;
+}
+
 void TransferList::movetofirst(Transfer *transfer, DBTableTransactionCommitter& committer)
 {
     movetransfer(transfer, transfers[transfer->type].begin(), committer);
@@ -1894,7 +2599,7 @@ transfer_list::iterator TransferList::iterator(Transfer *transfer)
         return transfer_list::iterator();
     }
 
-    transfer_list::iterator it = std::lower_bound(transfers[transfer->type].begin(), transfers[transfer->type].end(), transfer, priority_comparator);
+    transfer_list::iterator it = transfers[transfer->type].lower_bound(transfer->priority);
     if (it != transfers[transfer->type].end() && (*it) == transfer)
     {
         return it;
@@ -1905,6 +2610,31 @@ transfer_list::iterator TransferList::iterator(Transfer *transfer)
 
 Transfer *TransferList::nexttransfer(direction_t direction)
 {
+    Transfer *transfer = scheduledtransfer(direction);
+    if (transfer && direction == GET && !transfer->slot)
+    {
+        m_off_t quotaleft = client->transferquotaleft();
+        if (quotaleft >= 0)
+        {
+            return quotatransfer(transfer, quotaleft);
+        }
+    }
+    return transfer;
+}
+
+// the ready transfer picked by the transfer schedule
+Transfer *TransferList::scheduledtransfer(direction_t direction)
+{
+    if (client->transferschedule == TRANSFERSCHEDULE_SMALLFIRST)
+    {
+        return smallesttransfer(direction);
+    }
+
+    if (client->transferschedule == TRANSFERSCHEDULE_FAIR)
+    {
+        return fairtransfer(direction);
+    }
+
     for (transfer_list::iterator it = transfers[direction].begin(); it != transfers[direction].end(); it++)
     {
         Transfer *transfer = (*it);
@@ -1918,6 +2648,115 @@ Transfer *TransferList::nexttransfer(direction_t direction)
     return NULL;
 }
 
+// the smallest ready transfer (the first one in queue order if several),
+// a transfer whose file open has finished goes first
+Transfer *TransferList::smallesttransfer(direction_t direction)
+{
+    Transfer *smallest = NULL;
+    for (transfer_list::iterator it = transfers[direction].begin(); it != transfers[direction].end(); it++)
+    {
+        Transfer *transfer = (*it);
+        if (transfer->asyncopencontext && transfer->asyncopencontext->finished)
+        {
+            return transfer;
+        }
+
+        if (!transfer->slot && isReady(transfer) && (!smallest || transfer->size < smallest->size))
+        {
+            smallest = transfer;
+        }
+    }
+    return smallest;
+}
+
+// the download picked by the schedule if it can complete within the transfer quota
+// left after the downloads in progress, otherwise the queued download closest to
+// completion that can. NULL if none can, so that the downloads in progress finish
+// before the quota runs out instead of sharing it with ones that would be cut short
+// (without downloads in progress, the scheduled one starts and the server decides)
+Transfer *TransferList::quotatransfer(Transfer *scheduled, m_off_t quotaleft)
+{
+    bool downloading = false;
+    for (transferslot_list::iterator it = client->tslots.begin(); it != client->tslots.end(); it++)
+    {
+        Transfer *transfer = (*it)->transfer;
+        if (transfer->type == GET)
+        {
+            downloading = true;
+            quotaleft -= transfer->size - transfer->progresscompleted;
+        }
+    }
+
+    if (!downloading || scheduled->size - scheduled->progresscompleted <= quotaleft)
+    {
+        return scheduled;
+    }
+
+    Transfer *closest = NULL;
+    m_off_t closestleft = 0;
+    for (transfer_list::iterator it = transfers[GET].begin(); it != transfers[GET].end(); it++)
+    {
+        Transfer *transfer = (*it);
+        m_off_t left = transfer->size - transfer->progresscompleted;
+        if (!transfer->slot && isReady(transfer) && left <= quotaleft && (!closest || left < closestleft))
+        {
+            closest = transfer;
+            closestleft = left;
+        }
+    }
+    return closest;
+}
+
+// the first ready transfer of the class with the fewest slots for its weight
+Transfer *TransferList::fairtransfer(direction_t direction)
+{
+    map<int, unsigned> slots;
+    for (transferslot_list::iterator it = client->tslots.begin(); it != client->tslots.end(); it++)
+    {
+        if ((*it)->transfer->type == direction)
+        {
+            slots[client->app->transfer_class((*it)->transfer)]++;
+        }
+    }
+
+    Transfer *fairest = NULL;
+    unsigned fairestslots = 0;
+    unsigned fairestweight = 1;
+    for (transfer_list::iterator it = transfers[direction].begin(); it != transfers[direction].end(); it++)
+    {
+        Transfer *transfer = (*it);
+        if (transfer->asyncopencontext && transfer->asyncopencontext->finished)
+        {
+            return transfer;
+        }
+
+        if (transfer->slot || !isReady(transfer))
+        {
+            continue;
+        }
+
+        int c = client->app->transfer_class(transfer);
+        map<int, unsigned>::iterator sit = slots.find(c);
+        unsigned used = (sit == slots.end()) ? 0 : sit->second;
+        map<int, unsigned>::iterator wit = client->transferclassweights.find(c);
+        unsigned weight = (wit == client->transferclassweights.end() || !wit->second) ? 1 : wit->second;
+
+        // used / weight < fairestslots / fairestweight
+        if (!fairest || uint64_t(used) * fairestweight < uint64_t(fairestslots) * weight)
+        {
+            fairest = transfer;
+            fairestslots = used;
+            fairestweight = weight;
+
+            if (!used)
+            {
+                break;
+            }
+        }
+    }
+    return fairest;
+}
+
 Transfer *TransferList::transferat(direction_t direction, unsigned int position)
 {
     if (transfers[direction].size() > position)
@@ -1964,11 +2803,12 @@ void TransferList::prepareIncreasePriority(Transfer *transfer, transfer_list::it
     }
 }
 
-void TransferList::prepareDecreasePriority(Transfer *transfer, transfer_list::iterator it, transfer_list::iterator dstit)
+// nextit: the transfer that followed the one moved down
+void TransferList::prepareDecreasePriority(Transfer *transfer, transfer_list::iterator nextit, transfer_list::iterator dstit)
 {
     if (transfer->slot && transfer->state == TRANSFERSTATE_ACTIVE)
     {
-        transfer_list::iterator cit = it + 1;
+        transfer_list::iterator cit = nextit;
         while (cit != transfers[transfer->type].end())
         {
             if (!(*cit)->slot && isReady(*cit))
@@ -1999,4 +2839,152 @@ bool TransferList::isReady(Transfer *transfer)
             && transfer->bt.armed());
 }
 
+m_off_t TransferRateLimit::currentrate(m_time_t t) const
+{
+    if (periods.size())
+    {
+        struct tm dt;
+        m_localtime(t, &dt);
+        int minute = dt.tm_hour * 60 + dt.tm_min;
+
+        for (vector<Period>::const_iterator it = periods.begin(); it != periods.end(); it++)
+        {
+            if (it->start <= it->end ? (minute >= it->start && minute < it->end)
+                                     : (minute >= it->start || minute < it->end))
+            {
+                return it->rate;
+            }
+        }
+    }
+    return rate;
+}
+
+void TransferRateLimit::refill()
+{
+    m_off_t r = currentrate(m_time());
+
+    if (r != updatedrate || updated == NEVER)
+    {
+        // a new rate starts with a full bucket
+        tokens = burst;
+        updatedrate = r;
+    }
+    else if (r > 0 && Waiter::ds > updated)
+    {
+        tokens = std::min(burst, tokens + r * m_off_t(Waiter::ds - updated) / 10);
+    }
+    updated = Waiter::ds;
+}
+
+dstime TransferRateLimit::wait()
+{
+    refill();
+
+    if (updatedrate <= 0 || tokens >= 0)
+    {
+        return 0;
+    }
+    return dstime((-tokens * 10 + updatedrate - 1) / updatedrate);
+}
+
+void TransferRateLimit::consume(m_off_t bytes)
+{
+    if (updatedrate > 0)
+    {
+        tokens -= bytes;
+    }
+}
+
+void DirectReadCache::setmaxsize(m_off_t bytes)
+{
+    maxsize = bytes > 0 ? bytes : 0;
+    evict();
+}
+
+const byte* DirectReadCache::find(handle h, m_off_t pos, size_t* len)
+{
+    map<BlockKey, Block>::iterator it = blocks.find(BlockKey(h, pos / BLOCKSIZE));
+    if (it == blocks.end())
+    {
+        return NULL;
+    }
+
+    Block& b = it->second;
+    size_t offset = size_t(pos % BLOCKSIZE);
+    if (offset < b.start || offset >= b.start + b.data.size())
+    {
+        return NULL;
+    }
+
+    lru.splice(lru.begin(), lru, b.lru_it);
+
+    *len = b.start + b.data.size() - offset;
+    return (const byte*)b.data.data() + (offset - b.start);
+}
+
+void DirectReadCache::store(handle h, m_off_t pos, const byte* data, size_t len)
+{
+    if (!maxsize)
+    {
+        return;
+    }
+
+    while (len)
+    {
+        BlockKey key(h, pos / BLOCKSIZE);
+        size_t offset = size_t(pos % BLOCKSIZE);
+        size_t n = std::min<size_t>(len, size_t(BLOCKSIZE) - offset);
+
+        map<BlockKey, Block>::iterator it = blocks.find(key);
+        if (it == blocks.end())
+        {
+            it = blocks.insert(pair<BlockKey, Block>(key, Block())).first;
+            it->second.start = offset;
+            it->second.lru_it = lru.insert(lru.begin(), key);
+        }
+        else
+        {
+            lru.splice(lru.begin(), lru, it->second.lru_it);
+        }
+
+        // only extend the contiguous data of the block
+        Block& b = it->second;
+        size_t end = b.start + b.data.size();
+        if (offset <= end && offset + n > end && offset >= b.start)
+        {
+            b.data.append((const char*)data + (end - offset), offset + n - end);
+            size += m_off_t(offset + n - end);
+        }
+
+        pos += n;
+        data += n;
+        len -= n;
+    }
+
+    evict();
+}
+
+void DirectReadCache::evict()
+{
+    while (size > maxsize && !lru.empty())
+    {
+        map<BlockKey, Block>::iterator it = blocks.find(lru.back());
+        size -= m_off_t(it->second.data.size());
+        blocks.erase(it);
+        lru.pop_back();
+    }
+}
+
+void DirectReadCache::clear()
+{
+    blocks.clear();
+    lru.clear();
+    size = 0;
+}
+
+int MegaApp::transfer_class(Transfer* t)
+{
+    return t->tag;
+}
+
 } // namespace
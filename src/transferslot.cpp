@@ -29,6 +29,7 @@
 #include "mega/utils.h"
 #include "mega/logging.h"
 #include "mega/raid.h"
+#include "mega/trace.h"
 
 namespace mega {
 
@@ -50,9 +51,31 @@ const dstime TransferSlot::PROGRESSTIMEOUT = 10;
 
 const m_off_t TransferSlot::MAX_UPLOAD_GAP = 62914560; // 60 MB (up to 63 chunks)
 
+// adaptive slots: requests shorter than FAST_REQUEST are dominated by the
+// round trip, requests longer than SLOW_REQUEST risk timeouts on poor links
+const dstime TransferSlot::ADAPT_INTERVAL = 50;
+const dstime TransferSlot::FAST_REQUEST = 20;
+const dstime TransferSlot::SLOW_REQUEST = 100;
+const unsigned TransferSlot::ADAPT_PROBE_INTERVALS = 6;
+const m_off_t TransferSlot::MIN_ADAPTIVE_REQ_SIZE = 1048576; // 1 MB
+const m_off_t TransferSlot::MAX_ADAPTIVE_REQ_SIZE = 16777216; // 16 MB (the largest request accepted)
+const int TransferSlot::MAX_ADAPTIVE_CONNECTIONS = 8;
+
+// hedged downloads: a copy is only worth its bandwidth for real stragglers, so
+// requests shorter than HEDGE_MIN_DELAY aren't duplicated, whatever their p90
+const unsigned TransferSlot::HEDGE_SAMPLES = 20;
+const unsigned TransferSlot::HEDGE_MIN_SAMPLES = 5;
+const dstime TransferSlot::HEDGE_MIN_DELAY = 20;
+const unsigned TransferSlot::MAX_HEDGES = 2;
+
+// beyond the inline buffer of any std::string implementation
+const size_t TransferSlot::READAHEADMINCAPACITY = 64;
+
 TransferSlot::TransferSlot(Transfer* ctransfer)
     : retrybt(ctransfer->client->rng)
-    , fa(ctransfer->client->fsaccess->newfileaccess())
+    , fa(ctransfer->uploadstream
+            ? std::unique_ptr<FileAccess>(new StreamFileAccess(ctransfer->uploadstream, ctransfer->client->waiter))
+            : ctransfer->client->fsaccess->newfileaccess())
 {
     starttime = 0;
     lastprogressreport = 0;
@@ -71,10 +94,23 @@ TransferSlot::TransferSlot(Transfer* ctransfer)
     fileattrsmutable = 0;
 
     connections = 0;
+    activeconnections = 0;
     reqs = NULL;
     asyncIO = NULL;
     pendingcmd = NULL;
 
+    adaptive = false;
+    adaptds = 0;
+    adaptprogress = 0;
+    adaptreqtime = 0;
+    adaptrequests = 0;
+    adaptfailures = 0;
+    adaptlastspeed = 0;
+    adaptstep = 1;
+    adaptholds = 0;
+
+    hedging = false;
+
     transfer = ctransfer;
     transfer->slot = this;
     transfer->state = TRANSFERSTATE_ACTIVE;
@@ -132,8 +168,45 @@ bool TransferSlot::createconnectionsonce()
             return false;   // too soon, we don't know raid / non-raid yet
         }
 
-        connections = transferbuf.isRaid() ? RAIDPARTS : (transfer->size > 131072 ? transfer->client->connections[transfer->type] : 1);
-        LOG_debug << "Populating transfer slot with " << connections << " connections, max request size of " << maxRequestSize << " bytes";
+        connections = transferbuf.isRaid() ? RAIDPARTS : (transfer->size > 131072 ? transfer->client->transferconnections(transfer->type) : 1);
+        activeconnections = connections;
+
+        // the low power preset doesn't add connections nor duplicate requests
+        bool lowpower = transfer->client->powerpolicy.lowpower();
+
+        if (transfer->client->adaptivetransfers && !lowpower && !transferbuf.isRaid() && transfer->size > 131072)
+        {
+            // start as configured, room to grow
+            adaptive = true;
+            connections = std::max(connections, MAX_ADAPTIVE_CONNECTIONS);
+            adaptds = Waiter::ds;
+        }
+
+        if (transfer->type == GET && transferbuf.sourceCount() > 1 && transfer->size > 131072)
+        {
+            // at least one connection per source
+            activeconnections = std::max(activeconnections, std::min(int(transferbuf.sourceCount()), MAX_ADAPTIVE_CONNECTIONS));
+            connections = std::max(connections, activeconnections);
+        }
+
+        if (transfer->client->hedgedownloads && !lowpower && transfer->type == GET)
+        {
+            hedging = true;
+            hedges.resize(connections);
+            hedgestart.resize(connections);
+        }
+
+        if (adaptive || hedging || transferbuf.sourceCount() > 1)
+        {
+            reqstart.resize(connections);
+        }
+
+        if (transfer->type == PUT && transfer->client->uploadreadahead && fa->asyncavailable())
+        {
+            readaheads.resize(connections);
+        }
+
+        LOG_debug << "Populating transfer slot with " << activeconnections << " (" << connections << ") connections, max request size of " << maxRequestSize << " bytes";
         reqs = new HttpReqXfer*[connections]();
         asyncIO = new AsyncIOContext*[connections]();
     }
@@ -206,6 +279,7 @@ TransferSlot::~TransferSlot()
                 if (outputPiece)
                 {
                     anyData = true;
+                    outputPiece->waitFinalized();
                     if (fa && fa->fwrite(outputPiece->buf.datastart(), static_cast<unsigned>(outputPiece->buf.datalen()), outputPiece->pos))
                     {
 
@@ -255,6 +329,16 @@ TransferSlot::~TransferSlot()
         transfer->client->asyncfopens--;
     }
 
+    for (size_t i = hedges.size(); i--; )
+    {
+        delete hedges[i];
+    }
+
+    for (size_t i = readaheads.size(); i--; )
+    {
+        delete readaheads[i].io;   // waits for the read
+    }
+
     while (connections--)
     {
         delete asyncIO[connections];
@@ -288,6 +372,28 @@ void TransferSlot::toggleport(HttpReqXfer *req)
     }
 }
 
+// temp URL with the alternative port, if in use
+string TransferSlot::connectionurl(const string& tempurl)
+{
+    string url = tempurl;
+    if ((transfer->type == GET ? transfer->client->usealtdownport : transfer->client->usealtupport)
+            && !memcmp(url.c_str(), "http:", 5))
+    {
+        size_t index = url.find("/", 8);
+        if (index != string::npos && url.find(":", 8) == string::npos)
+        {
+            url.insert(index, ":8080");
+        }
+    }
+    return url;
+}
+
+// send a prepared request to another temp URL (prepare() appends the range to it)
+void TransferSlot::retarget(HttpReqXfer* req, const string& tempurl)
+{
+    req->posturl = connectionurl(tempurl) + req->posturl.substr(req->posturl.rfind('/'));
+}
+
 // abort all HTTP connections
 void TransferSlot::disconnect()
 {
@@ -298,6 +404,11 @@ void TransferSlot::disconnect()
             reqs[i]->disconnect();
         }
     }
+
+    for (unsigned i = unsigned(hedges.size()); i--; )
+    {
+        cancelhedge(i);
+    }
 }
 
 // coalesce block macs into file mac
@@ -328,6 +439,7 @@ int64_t TransferSlot::macsmac(chunkmac_map* m)
 void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committer)
 {
     CodeCounter::ScopeTimer pbt(client->performanceStats.transferslotDoio);
+    Trace::Span ts("transferslot doio");
 
     if (!fa || (transfer->size && transfer->progresscompleted == transfer->size)
             || (transfer->type == PUT && transfer->ultoken))
@@ -385,6 +497,24 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
     dstime backoff = 0;
     m_off_t p = 0;
 
+    // bandwidth limits of the transfer and of its class (the same one for a transfer on its own)
+    TransferRateLimit* ratelimits[2] = { NULL, NULL };
+    if (client->transferratelimits.size())
+    {
+        int keys[2] = { transfer->files.size() ? transfer->files.front()->tag : transfer->tag,
+                        client->app->transfer_class(transfer) };
+
+        for (int k = 0; k < 2; k++)
+        {
+            map<int, TransferRateLimit>::iterator it = client->transferratelimits.find(keys[k]);
+            if (it != client->transferratelimits.end() && (!k || keys[1] != keys[0]))
+            {
+                ratelimits[k] = &it->second;
+            }
+        }
+    }
+    bool paced = false;
+
     if (errorcount > 4)
     {
         LOG_warn << "Failed transfer: too many errors";
@@ -399,6 +529,10 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
             if (transfer->type == GET && reqs[i]->contentlength == reqs[i]->size && transferbuf.detectSlowestRaidConnection(i, slowestConnection))
             {
                 LOG_debug << "Connection " << slowestConnection << " is the slowest to reply, using the other 5.";
+                if (hedging)
+                {
+                    cancelhedge(slowestConnection);
+                }
                 delete reqs[slowestConnection];
                 reqs[slowestConnection] = NULL;
                 transferbuf.resetPart(slowestConnection);
@@ -406,6 +540,11 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                 continue;
             }
 
+            if (hedging && hedges[i])
+            {
+                checkhedge(i);
+            }
+
             if (reqs[i]->status == REQ_FAILURE && reqs[i]->httpstatus == 200 && transfer->type == GET && transferbuf.isRaid())  // the request started out successfully, hence status==200 in the reply headers
             {
                 // check if we got some data and the failure occured partway through the part chunk.  If so, best not to waste it, convert to success case with less data
@@ -436,6 +575,20 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                             LOG_warn << "Connection " << i << " is slow or stalled, trying the other 5 cloudraid connections";
                             reqs[i]->disconnect();
                             reqs[i]->status = REQ_READY;
+                            if (hedging)
+                            {
+                                cancelhedge(i);
+                            }
+                            break;
+                        }
+                    }
+
+                    if (hedging && !hedges[i])
+                    {
+                        dstime delay = hedgedelay();
+                        if (delay && Waiter::ds - reqstart[i] > delay)
+                        {
+                            hedge(i);
                         }
                     }
                     break;
@@ -451,15 +604,36 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                     lastdata = Waiter::ds;
                     transfer->lastaccesstime = m_time();
 
-                    if (!transferbuf.isRaid())
+                    // a download whose buffer was already handed over (its piece may still be
+                    // decrypting, or its write is being retried) has been accounted for already
+                    if (transfer->type != GET || !static_cast<HttpReqDL*>(reqs[i])->buffer_released)
                     {
-                        LOG_debug << "Transfer request finished (" << transfer->type << ") Position: " << transferbuf.transferPos(i) << " (" << transfer->pos << ") Size: " << reqs[i]->size
-                            << " Completed: " << (transfer->progresscompleted + reqs[i]->size) << " of " << transfer->size;
-                    }
-                    else
-                    {
-                        LOG_debug << "Transfer request finished (" << transfer->type << ") " << " on connection " << i << " part pos: " << transferbuf.transferPos(i) << " of part size " << transferbuf.raidPartSize(i, transfer->size)
-                            << " Overall Completed: " << (transfer->progresscompleted) << " of " << transfer->size;
+                        if (adaptive && reqs[i]->size)
+                        {
+                            adaptrequests++;
+                            adaptreqtime += Waiter::ds - reqstart[i];
+                        }
+
+                        if (hedging && reqs[i]->size)
+                        {
+                            requestdone(Waiter::ds - reqstart[i]);
+                        }
+
+                        if (transfer->type == GET && reqs[i]->size && transferbuf.sourceCount() > 1)
+                        {
+                            transferbuf.sourceRequestDone(i, reqs[i]->size, Waiter::ds - reqstart[i]);
+                        }
+
+                        if (!transferbuf.isRaid())
+                        {
+                            LOG_debug << "Transfer request finished (" << transfer->type << ") Position: " << transferbuf.transferPos(i) << " (" << transfer->pos << ") Size: " << reqs[i]->size
+                                << " Completed: " << (transfer->progresscompleted + reqs[i]->size) << " of " << transfer->size;
+                        }
+                        else
+                        {
+                            LOG_debug << "Transfer request finished (" << transfer->type << ") " << " on connection " << i << " part pos: " << transferbuf.transferPos(i) << " of part size " << transferbuf.raidPartSize(i, transfer->size)
+                                << " Overall Completed: " << (transfer->progresscompleted) << " of " << transfer->size;
+                        }
                     }
 
                     if (transfer->type == PUT)
@@ -611,6 +785,14 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                             }
 
                             TransferBufferManager::FilePiece* outputPiece = transferbuf.getAsyncOutputBufferPointer(i);
+                            if (outputPiece && !outputPiece->isFinalized())
+                            {
+                                // still being decrypted, written once the worker is done;
+                                // its data counts as in progress, like a pending write
+                                p += outputPiece->buf.datalen();
+                                break;
+                            }
+
                             if (outputPiece)
                             {
 
@@ -730,6 +912,13 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                     }
                     break;
 
+                case REQ_ENCRYPTING:
+                    if (static_cast<HttpReqUL*>(reqs[i])->encrypted(&transfer->chunkmacs))
+                    {
+                        reqs[i]->status = REQ_PREPARED;
+                    }
+                    break;
+
                 case REQ_ASYNCIO:
                     if (asyncIO[i]->finished)
                     {
@@ -740,22 +929,24 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                             {
                                 LOG_verbose << "Async read succeeded";
                                 m_off_t npos = asyncIO[i]->pos + asyncIO[i]->len;
-                                string finaltempurl = transferbuf.tempURL(i);
-                                if (client->usealtupport && !memcmp(finaltempurl.c_str(), "http:", 5))
+                                string finaltempurl = connectionurl(transferbuf.tempURL(i));
+
+                                if (client->cryptoworkers)
                                 {
-                                    size_t index = finaltempurl.find("/", 8);
-                                    if(index != string::npos && finaltempurl.find(":", 8) == string::npos)
-                                    {
-                                        finaltempurl.insert(index, ":8080");
-                                    }
+                                    static_cast<HttpReqUL*>(reqs[i])->prepareasync(client->cryptoworkers.get(), finaltempurl.c_str(),
+                                                                                    transfer->transfercipher(), transfer->ctriv,
+                                                                                    asyncIO[i]->pos, npos);
+                                    reqs[i]->status = REQ_ENCRYPTING;
+                                }
+                                else
+                                {
+                                    reqs[i]->prepare(finaltempurl.c_str(), transfer->transfercipher(),
+                                             &transfer->chunkmacs, transfer->ctriv,
+                                             asyncIO[i]->pos, npos);
+                                    reqs[i]->status = REQ_PREPARED;
                                 }
-
-                                reqs[i]->prepare(finaltempurl.c_str(), transfer->transfercipher(),
-                                         &transfer->chunkmacs, transfer->ctriv,
-                                         asyncIO[i]->pos, npos);
 
                                 reqs[i]->pos = ChunkedHash::chunkfloor(asyncIO[i]->pos);
-                                reqs[i]->status = REQ_PREPARED;
                             }
                             else
                             {
@@ -849,6 +1040,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
                 case REQ_FAILURE:
                     LOG_warn << "Failed chunk. HTTP status: " << reqs[i]->httpstatus;
+                    adaptfailures++;
                     if (reqs[i]->httpstatus && reqs[i]->contenttype.find("text/html") != string::npos
                             && !memcmp(reqs[i]->posturl.c_str(), "http:", 5))
                     {
@@ -889,7 +1081,13 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                     }
                     else if (reqs[i]->httpstatus == 403 || reqs[i]->httpstatus == 404)
                     {
-                        if (!tryRaidRecoveryFromHttpGetError(i))
+                        if (transfer->type == GET && transferbuf.sourceRequestFailed(i, true))
+                        {
+                            // retry the range from another source of the file
+                            retarget(reqs[i], transferbuf.tempURL(i));
+                            reqs[i]->status = REQ_PREPARED;
+                        }
+                        else if (!tryRaidRecoveryFromHttpGetError(i))
                         {
                             return transfer->failed(API_EAGAIN, committer);
                         }
@@ -928,6 +1126,11 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                                 toggleport(reqs[i]);
                             }
                         }
+
+                        if (transfer->type == GET && transferbuf.sourceRequestFailed(i, false))
+                        {
+                            retarget(reqs[i], transferbuf.tempURL(i));
+                        }
                         reqs[i]->status = REQ_PREPARED;
                     }
 
@@ -938,11 +1141,47 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
         if (!failure)
         {
-            if (!reqs[i] || (reqs[i]->status == REQ_READY))
+            ReadAhead* ra = NULL;
+            if ((!reqs[i] || (reqs[i]->status == REQ_READY)) && i < activeconnections
+                    && transfer->type == PUT && !asyncIO[i] && readaheads.size())
+            {
+                // the connection's own read-ahead, else one left by a connection that adapt() retired:
+                // its range was taken from the transfer already and would never be sent otherwise
+                ra = readaheads[i].io ? &readaheads[i] : NULL;
+                for (unsigned j = activeconnections; !ra && j < readaheads.size(); j++)
+                {
+                    if (readaheads[j].io)
+                    {
+                        ra = &readaheads[j];
+                    }
+                }
+            }
+
+            if (ra)
+            {
+                // the next range was read while the previous one was being sent
+                if (!reqs[i])
+                {
+                    reqs[i] = new HttpReqUL();
+                }
+
+                // the read may still be in flight: its buffer moves with the string (see readahead())
+                *reqs[i]->out = std::move(ra->data);
+                assert((byte*)reqs[i]->out->data() == ra->io->buffer);
+                asyncIO[i] = ra->io;
+                ra->io = NULL;
+                reqs[i]->status = REQ_ASYNCIO;
+
+                // process it right away if already read
+                i++;
+                continue;
+            }
+
+            if ((!reqs[i] || (reqs[i]->status == REQ_READY)) && i < activeconnections)
             {
                 bool newInputBufferSupplied = false;
                 bool pauseConnectionInputForRaid = false;
-                std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, maxRequestSize, connections, newInputBufferSupplied, pauseConnectionInputForRaid);
+                std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, maxRequestSize, activeconnections, newInputBufferSupplied, pauseConnectionInputForRaid);
 
                 // we might have a raid-reassembled block to write, or a previously loaded block, or a skip block to process.
                 bool newOutputBufferSupplied = false;
@@ -1010,26 +1249,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
                     if (prepare)
                     {
-                        string finaltempurl = transferbuf.tempURL(i);
-                        if (transfer->type == GET && client->usealtdownport
-                                && !memcmp(finaltempurl.c_str(), "http:", 5))
-                        {
-                            size_t index = finaltempurl.find("/", 8);
-                            if(index != string::npos && finaltempurl.find(":", 8) == string::npos)
-                            {
-                                finaltempurl.insert(index, ":8080");
-                            }
-                        }
-
-                        if (transfer->type == PUT && client->usealtupport
-                                && !memcmp(finaltempurl.c_str(), "http:", 5))
-                        {
-                            size_t index = finaltempurl.find("/", 8);
-                            if(index != string::npos && finaltempurl.find(":", 8) == string::npos)
-                            {
-                                finaltempurl.insert(index, ":8080");
-                            }
-                        }
+                        string finaltempurl = connectionurl(transferbuf.tempURL(i));
 
                         unsigned size = (unsigned)(posrange.second - posrange.first);
                         if (size > 16777216)
@@ -1043,11 +1263,21 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                             return transfer->failed(API_EINTERNAL, committer);
                         }
 
-                        reqs[i]->prepare(finaltempurl.c_str(), transfer->transfercipher(),
-                                                               &transfer->chunkmacs, transfer->ctriv,
-                                                               posrange.first, posrange.second);
+                        if (transfer->type == PUT && client->cryptoworkers)
+                        {
+                            static_cast<HttpReqUL*>(reqs[i])->prepareasync(client->cryptoworkers.get(), finaltempurl.c_str(),
+                                                                            transfer->transfercipher(), transfer->ctriv,
+                                                                            posrange.first, posrange.second);
+                            reqs[i]->status = REQ_ENCRYPTING;
+                        }
+                        else
+                        {
+                            reqs[i]->prepare(finaltempurl.c_str(), transfer->transfercipher(),
+                                                                   &transfer->chunkmacs, transfer->ctriv,
+                                                                   posrange.first, posrange.second);
+                            reqs[i]->status = REQ_PREPARED;
+                        }
                         reqs[i]->pos = ChunkedHash::chunkfloor(posrange.first);
-                        reqs[i]->status = REQ_PREPARED;
                     }
 
                     transferbuf.transferPos(i) = std::max<m_off_t>(transferbuf.transferPos(i), posrange.second);
@@ -1070,10 +1300,59 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                 }
             }
 
+            if (reqs[i] && (reqs[i]->status == REQ_PREPARED) && (ratelimits[0] || ratelimits[1]))
+            {
+                dstime wait = 0;
+                for (int k = 0; k < 2; k++)
+                {
+                    if (ratelimits[k])
+                    {
+                        wait = std::max(wait, ratelimits[k]->wait());
+                    }
+                }
+
+                if (wait)
+                {
+                    // keep the request prepared until the limits allow it
+                    if (!backoff || wait < backoff)
+                    {
+                        backoff = wait;
+                    }
+                    paced = true;
+                    continue;
+                }
+
+                for (int k = 0; k < 2; k++)
+                {
+                    if (ratelimits[k])
+                    {
+                        ratelimits[k]->consume(reqs[i]->size);
+                    }
+                }
+            }
+
             if (reqs[i] && (reqs[i]->status == REQ_PREPARED))
             {
                 reqs[i]->minspeed = true;
-                reqs[i]->post(client);
+                if (client->backgroundhttpio)
+                {
+                    // the OS carries it on while the app is suspended
+                    reqs[i]->post(client->backgroundhttpio);
+                }
+                else
+                {
+                    reqs[i]->post(client);
+                }
+
+                if (reqstart.size())
+                {
+                    reqstart[i] = Waiter::ds;
+                }
+
+                if (readaheads.size())
+                {
+                    readahead(i);
+                }
             }
         }
     }
@@ -1084,7 +1363,12 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
         p += transferbuf.progress();
     }
     p += transfer->progresscompleted;
-    
+
+    if (adaptive)
+    {
+        adapt(p);
+    }
+
     if (p != progressreported || (Waiter::ds - lastprogressreport) > PROGRESSTIMEOUT)
     {
         if (p != progressreported)
@@ -1099,6 +1383,10 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
             else
             {
                 client->httpio->updatedownloadspeed(diff);
+                if (diff > 0)
+                {
+                    client->transferquotadownloaded += diff;
+                }
             }
 
             progressreported = p;
@@ -1109,6 +1397,37 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
         progress();
     }
 
+    if (paced)
+    {
+        // waiting for the rate limits isn't a stalled transfer
+        bool inflight = false;
+        for (int i = connections; i--; )
+        {
+            if (reqs[i] && reqs[i]->status == REQ_INFLIGHT)
+            {
+                inflight = true;
+                break;
+            }
+        }
+
+        if (!inflight)
+        {
+            lastdata = Waiter::ds;
+        }
+    }
+
+    // the OS reports the background requests when they finish, and retries
+    // them on its own meanwhile
+    for (int i = connections; i--; )
+    {
+        if (reqs[i] && reqs[i]->status == REQ_INFLIGHT
+                && reqs[i]->httpio && reqs[i]->httpio == client->backgroundhttpio)
+        {
+            reqs[i]->lastdata = Waiter::ds;
+            lastdata = Waiter::ds;
+        }
+    }
+
     if (Waiter::ds - lastdata >= XFERTIMEOUT && !failure)
     {
         LOG_warn << "Failed chunk due to a timeout";
@@ -1134,6 +1453,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
             if (reqs[i] && reqs[i]->status == REQ_INFLIGHT)
             {
                 chunkfailed = true;
+                adaptfailures++;
                 client->setchunkfailed(&reqs[i]->posturl);
                 reqs[i]->disconnect();
 
@@ -1146,6 +1466,11 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
             }
         }
 
+        for (unsigned i = unsigned(hedges.size()); i--; )
+        {
+            cancelhedge(i);
+        }
+
         if (!chunkfailed)
         {
             LOG_warn << "Transfer failed due to a timeout";
@@ -1172,6 +1497,206 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 }
 
 
+void TransferSlot::adapt(m_off_t progress)
+{
+    dstime elapsed = Waiter::ds - adaptds;
+    if (elapsed < ADAPT_INTERVAL)
+    {
+        return;
+    }
+
+    m_off_t speed = (progress - adaptprogress) * 10 / elapsed;
+    dstime meanrequest = adaptrequests ? adaptreqtime / adaptrequests : 0;
+    m_off_t requestsize = maxRequestSize;
+    int active = activeconnections;
+
+    // request size (only downloads request several chunks at once)
+    if (adaptfailures || meanrequest > SLOW_REQUEST)
+    {
+        maxRequestSize = std::max(maxRequestSize / 2, MIN_ADAPTIVE_REQ_SIZE);
+    }
+    else if (adaptrequests && meanrequest < FAST_REQUEST)
+    {
+        maxRequestSize = std::min(maxRequestSize * 2, MAX_ADAPTIVE_REQ_SIZE);
+    }
+
+    // connections: keep adding while the speed grows, undo the last one that didn't help
+    if (adaptfailures)
+    {
+        if (activeconnections > 1)
+        {
+            activeconnections--;
+        }
+        adaptstep = 0;
+        adaptholds = 0;
+    }
+    else if (adaptstep > 0)
+    {
+        if (adaptlastspeed && speed * 10 < adaptlastspeed * 11)
+        {
+            activeconnections--;
+            adaptstep = 0;
+            adaptholds = 0;
+        }
+        else if (activeconnections < connections)
+        {
+            activeconnections++;
+        }
+        else
+        {
+            adaptstep = 0;
+        }
+    }
+    else if (++adaptholds >= ADAPT_PROBE_INTERVALS && activeconnections < connections)
+    {
+        // conditions change: probe again from time to time
+        activeconnections++;
+        adaptstep = 1;
+        adaptholds = 0;
+    }
+
+    if (requestsize != maxRequestSize || active != activeconnections)
+    {
+        LOG_debug << "Transfer slot tuned to " << activeconnections << " connections and requests of "
+                  << maxRequestSize << " bytes (" << speed << " B/s, requests of " << meanrequest << " ds, "
+                  << adaptfailures << " failures)";
+    }
+
+    adaptlastspeed = speed;
+    adaptds = Waiter::ds;
+    adaptprogress = progress;
+    adaptreqtime = 0;
+    adaptrequests = 0;
+    adaptfailures = 0;
+}
+
+void TransferSlot::readahead(unsigned i)
+{
+    unsigned inflight = 0;
+    for (size_t j = readaheads.size(); j--; )
+    {
+        inflight += readaheads[j].io != NULL;
+    }
+
+    if (readaheads[i].io || inflight >= transfer->client->uploadreadahead)
+    {
+        return;
+    }
+
+    bool newInputBufferSupplied = false;
+    bool pauseConnectionInputForRaid = false;
+    std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, maxRequestSize, activeconnections, newInputBufferSupplied, pauseConnectionInputForRaid);
+    if (posrange.second <= posrange.first)
+    {
+        return;
+    }
+
+    unsigned size = unsigned(posrange.second - posrange.first);
+    LOG_verbose << "Reading ahead " << size << " bytes at " << posrange.first << " for connection " << i;
+
+    // the buffer is handed over to the request by moving the string while the read may be
+    // in flight: keep it on the heap, where a move doesn't relocate it (unlike a short string)
+    string& data = readaheads[i].data;
+    data.clear();
+    data.reserve(std::max<size_t>(size + SymmCipher::BLOCKSIZE, READAHEADMINCAPACITY));
+    readaheads[i].io = fa->asyncfread(&data, size, (-(int)size) & (SymmCipher::BLOCKSIZE - 1), posrange.first);
+    transferbuf.transferPos(i) = std::max<m_off_t>(transferbuf.transferPos(i), posrange.second);
+}
+
+void TransferSlot::requestdone(dstime duration)
+{
+    reqtimes.push_back(duration);
+    if (reqtimes.size() > HEDGE_SAMPLES)
+    {
+        reqtimes.pop_front();
+    }
+}
+
+dstime TransferSlot::hedgedelay() const
+{
+    if (reqtimes.size() < HEDGE_MIN_SAMPLES)
+    {
+        return 0;
+    }
+
+    vector<dstime> sorted(reqtimes.begin(), reqtimes.end());
+    size_t p90 = (sorted.size() * 9 + 9) / 10 - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + p90, sorted.end());
+
+    return std::max(sorted[p90], HEDGE_MIN_DELAY);
+}
+
+void TransferSlot::hedge(unsigned i)
+{
+    unsigned inflight = 0;
+    for (unsigned j = unsigned(hedges.size()); j--; )
+    {
+        inflight += hedges[j] != NULL;
+    }
+
+    HttpReqDL* original = static_cast<HttpReqDL*>(reqs[i]);
+    if (inflight >= MAX_HEDGES || !original->size || original->bufpos >= original->size)
+    {
+        return;
+    }
+
+    // same range, from the best other source of the file if there are several
+    string tempurl = transferbuf.sourceCount() > 1 ? connectionurl(transferbuf.alternativeTempURL(i))
+                                                   : original->posturl.substr(0, original->posturl.rfind('/'));
+
+    LOG_debug << "Connection " << i << " is late (" << (Waiter::ds - reqstart[i]) << " ds, " << original->bufpos
+              << " of " << original->size << " bytes), hedging the request at " << original->dlpos;
+
+    HttpReqDL* copy = new HttpReqDL();
+    copy->prepare(tempurl.c_str(), transfer->transfercipher(), &transfer->chunkmacs, transfer->ctriv,
+                  original->dlpos, original->dlpos + original->size);
+    copy->minspeed = true;
+    copy->post(transfer->client);
+
+    hedges[i] = copy;
+    hedgestart[i] = Waiter::ds;
+}
+
+void TransferSlot::checkhedge(unsigned i)
+{
+    HttpReqDL* copy = hedges[i];
+
+    if (copy->status == REQ_FAILURE)
+    {
+        LOG_debug << "Hedged request on connection " << i << " failed";
+        cancelhedge(i);
+        return;
+    }
+
+    // use the copy if it beats the original to completion, or outlives it
+    bool swap = reqs[i]->status == REQ_INFLIGHT ? copy->status == REQ_SUCCESS
+                                                : reqs[i]->status == REQ_FAILURE && copy->status == REQ_INFLIGHT;
+
+    if (swap)
+    {
+        LOG_debug << "Hedged request on connection " << i << (copy->status == REQ_SUCCESS ? " finished first" : " replaces the failed one");
+        reqs[i]->disconnect();
+        delete reqs[i];
+        reqs[i] = copy;
+        reqstart[i] = hedgestart[i];
+        hedges[i] = NULL;
+    }
+    else if (reqs[i]->status != REQ_INFLIGHT)
+    {
+        cancelhedge(i);
+    }
+}
+
+void TransferSlot::cancelhedge(unsigned i)
+{
+    if (hedges[i])
+    {
+        hedges[i]->disconnect();
+        delete hedges[i];
+        hedges[i] = NULL;
+    }
+}
+
 bool TransferSlot::tryRaidRecoveryFromHttpGetError(unsigned connectionNum)
 {
     // If we are downloding a cloudraid file then we may be able to ignore one connection and download from the other 5.
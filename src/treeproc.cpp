@@ -40,16 +40,6 @@ void TreeProcShareKeys::get(Command* c)
     snk.get(c);
 }
 
-void TreeProcForeignKeys::proc(MegaClient* client, Node* n)
-{
-    if (n->foreignkey)
-    {
-        client->nodekeyrewrite.push_back(n->nodehandle);
-
-        n->foreignkey = false;
-    }
-}
-
 // total disk space / node count
 TreeProcDU::TreeProcDU()
 {
@@ -21,6 +21,7 @@
 
 #include "mega.h"
 #include "mega/megaclient.h"
+#include <algorithm>
 #include <utility>
 
 namespace mega {
@@ -823,30 +824,28 @@ void UserAlerts::add(UserAlert::Base* unb)
         return;
     }
 
-    if (!alerts.empty() && unb->type == UserAlert::type_put && alerts.back()->type == UserAlert::type_put)
+    UserAlert::NewSharedNodes* np = unb->type == UserAlert::type_put ? dynamic_cast<UserAlert::NewSharedNodes*>(unb) : NULL;
+    if (np && !ISUNDEF(np->parentHandle))
     {
-        // If it's file/folders added, and the prior one is for the same user and within 5 mins then we can combine instead
-        UserAlert::NewSharedNodes* np = dynamic_cast<UserAlert::NewSharedNodes*>(unb);
-        UserAlert::NewSharedNodes* op = dynamic_cast<UserAlert::NewSharedNodes*>(alerts.back());
-        if (np && op)
+        // files/folders added by the same user to the same folder within 5 mins are combined
+        auto it = lastSharedNodes.find(std::make_pair(np->userHandle, np->parentHandle));
+        if (it != lastSharedNodes.end() && np->timestamp - it->second->timestamp < MERGEINTERVAL)
         {
-            if (np->userHandle == op->userHandle && np->timestamp - op->timestamp < 300 && 
-                np->parentHandle == op->parentHandle && !ISUNDEF(np->parentHandle))
-            {
-                op->fileCount += np->fileCount;
-                op->folderCount += np->folderCount;
-                LOG_debug << "Merged user alert, type " << np->type << " ts " << np->timestamp;
+            UserAlert::NewSharedNodes* op = it->second;
+            op->fileCount += np->fileCount;
+            op->folderCount += np->folderCount;
+            LOG_debug << "Merged user alert, type " << np->type << " ts " << np->timestamp;
 
-                if (catchupdone && (useralertnotify.empty() || useralertnotify.back() != alerts.back()))
-                {
-                    alerts.back()->seen = false;
-                    alerts.back()->tag = 0;
-                    useralertnotify.push_back(alerts.back());
-                    LOG_debug << "Updated user alert added to notify queue";
-                }
-                delete unb;
-                return;
+            // tag is -1 once notified
+            if (catchupdone && op->tag == -1)
+            {
+                op->seen = false;
+                op->tag = 0;
+                useralertnotify.push_back(op);
+                LOG_debug << "Updated user alert added to notify queue";
             }
+            delete unb;
+            return;
         }
     }
 
@@ -860,6 +859,7 @@ void UserAlerts::add(UserAlert::Base* unb)
                 (*i)->relevant = false;
                 if (catchupdone)
                 {
+                    (*i)->tag = 0;
                     useralertnotify.push_back(*i);
                 }
             }
@@ -870,12 +870,46 @@ void UserAlerts::add(UserAlert::Base* unb)
     alerts.push_back(unb);
     LOG_debug << "Added user alert, type " << alerts.back()->type << " ts " << alerts.back()->timestamp;
 
+    if (np && !ISUNDEF(np->parentHandle))
+    {
+        lastSharedNodes[std::make_pair(np->userHandle, np->parentHandle)] = np;
+    }
+
     if (catchupdone)
     {
         unb->tag = 0;
         useralertnotify.push_back(unb);
         LOG_debug << "New user alert added to notify queue";
     }
+
+    while (alerts.size() > MAXALERTS)
+    {
+        evict();
+    }
+}
+
+void UserAlerts::evict()
+{
+    UserAlert::Base* b = alerts.front();
+    alerts.pop_front();
+
+    if (b->type == UserAlert::type_put)
+    {
+        UserAlert::NewSharedNodes* np = dynamic_cast<UserAlert::NewSharedNodes*>(b);
+        auto it = np ? lastSharedNodes.find(std::make_pair(np->userHandle, np->parentHandle)) : lastSharedNodes.end();
+        if (it != lastSharedNodes.end() && it->second == np)
+        {
+            lastSharedNodes.erase(it);
+        }
+    }
+
+    if (b->tag != -1)
+    {
+        // not notified yet
+        useralertnotify.erase(std::remove(useralertnotify.begin(), useralertnotify.end(), b), useralertnotify.end());
+    }
+
+    delete b;
 }
 
 void UserAlerts::startprovisional()
@@ -1159,6 +1193,7 @@ void UserAlerts::clear()
     }
     alerts.clear();
     useralertnotify.clear();
+    lastSharedNodes.clear();
     begincatchup = false;
     catchupdone = false;
     catchup_last_timestamp = 0;
@@ -24,6 +24,7 @@
 #include "mega/megaclient.h"
 #include "mega/base64.h"
 
+#include <cmath>
 #include <iomanip>
 
 #if defined(_WIN32) && defined(_MSC_VER)
@@ -268,6 +269,225 @@ void chunkmac_map::calcprogress(m_off_t size, m_off_t& chunkpos, m_off_t& progre
     }
 }
 
+Node*& node_map::operator[](handle h)
+{
+    assert(!ISUNDEF(h));
+
+    size_t i = lookup(h);
+    if (i != NOTFOUND)
+    {
+        return mSlots[i].second;
+    }
+
+    // keep the load factor at or below 1/2 so that probe sequences stay short
+    if ((mCount + 1) * 2 > mSlots.size())
+    {
+        rehash(mSlots.empty() ? 64 : mSlots.size() * 2);
+    }
+
+    for (i = home(h); !ISUNDEF(mSlots[i].first); i = (i + 1) & (mSlots.size() - 1));
+
+    mSlots[i].first = h;
+    mSlots[i].second = NULL;
+    mCount++;
+    return mSlots[i].second;
+}
+
+size_t node_map::erase(handle h)
+{
+    size_t i = lookup(h);
+    if (i == NOTFOUND)
+    {
+        return 0;
+    }
+
+    // backward-shift deletion: pull up the following entries of the probe
+    // sequence so that no tombstones are needed
+    size_t mask = mSlots.size() - 1;
+    for (size_t j = (i + 1) & mask; !ISUNDEF(mSlots[j].first); j = (j + 1) & mask)
+    {
+        size_t k = home(mSlots[j].first);
+
+        // the entry at j can move to i unless its home lies cyclically in (i, j]
+        if ((i <= j) ? (k <= i || k > j) : (k <= i && k > j))
+        {
+            mSlots[i] = mSlots[j];
+            i = j;
+        }
+    }
+
+    mSlots[i].first = UNDEF;
+    mSlots[i].second = NULL;
+    mCount--;
+    return 1;
+}
+
+void node_map::clear()
+{
+    vector<value_type>().swap(mSlots);
+    mCount = 0;
+}
+
+void node_map::reserve(size_t n)
+{
+    size_t capacity = 64;
+    while (capacity < n * 2)
+    {
+        capacity *= 2;
+    }
+
+    if (capacity > mSlots.size())
+    {
+        rehash(capacity);
+    }
+}
+
+void node_map::rehash(size_t capacity)
+{
+    vector<value_type> old(capacity, value_type(UNDEF, (Node*)NULL));
+    old.swap(mSlots);
+
+    for (vector<value_type>::iterator it = old.begin(); it != old.end(); it++)
+    {
+        if (!ISUNDEF(it->first))
+        {
+            size_t i = home(it->first);
+            while (!ISUNDEF(mSlots[i].first))
+            {
+                i = (i + 1) & (capacity - 1);
+            }
+            mSlots[i] = *it;
+        }
+    }
+}
+
+LocalNode*& localnode_map::operator[](const string* name)
+{
+    assert(name);
+
+    size_t i = lookup(name);
+    if (i != NOTFOUND)
+    {
+        return mSlots[i].second;
+    }
+
+    // merge the second run once it outgrows the square root of the total, and
+    // drop the tombstones before they outnumber the entries
+    size_t tail = mSlots.size() - mSorted;
+    if ((tail >= 32 && tail * tail > mSlots.size()) || mSlots.size() - mCount > mCount)
+    {
+        compact();
+    }
+
+    i = lowerbound(mSorted, mSlots.size(), name);
+    mSlots.insert(mSlots.begin() + i, value_type(name, (LocalNode*)NULL));
+    mCount++;
+    return mSlots[i].second;
+}
+
+size_t localnode_map::erase(const string* name)
+{
+    size_t i = lookup(name);
+    if (i == NOTFOUND)
+    {
+        return 0;
+    }
+
+    erase(iterator(mSlots.data() + i, mSlots.data() + mSlots.size()));
+    return 1;
+}
+
+void localnode_map::erase(iterator it)
+{
+    it->first = NULL;
+    it->second = NULL;
+    mCount--;
+}
+
+void localnode_map::clear()
+{
+    vector<value_type>().swap(mSlots);
+    mSorted = 0;
+    mCount = 0;
+}
+
+// first position in [lo, hi) whose entry isn't below name, if tombstones are skipped
+size_t localnode_map::lowerbound(size_t lo, size_t hi, const string* name) const
+{
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t i = mid;
+
+        while (i < hi && !mSlots[i].second)
+        {
+            i++;
+        }
+
+        if (i < hi && *mSlots[i].first < *name)
+        {
+            lo = i + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+size_t localnode_map::lookup(size_t lo, size_t hi, const string* name) const
+{
+    size_t i = lowerbound(lo, hi, name);
+
+    while (i < hi && !mSlots[i].second)
+    {
+        i++;
+    }
+
+    return (i < hi && !(*name < *mSlots[i].first)) ? i : NOTFOUND;
+}
+
+size_t localnode_map::lookup(const string* name) const
+{
+    if (!mCount)
+    {
+        return NOTFOUND;
+    }
+
+    size_t i = lookup(0, mSorted, name);
+    return i != NOTFOUND ? i : lookup(mSorted, mSlots.size(), name);
+}
+
+void localnode_map::compact()
+{
+    size_t n = 0;
+    size_t sorted = 0;
+
+    for (size_t i = 0; i < mSlots.size(); i++)
+    {
+        if (mSlots[i].second)
+        {
+            if (i < mSorted)
+            {
+                sorted++;
+            }
+            mSlots[n++] = mSlots[i];
+        }
+    }
+
+    mSlots.resize(n);
+    std::inplace_merge(mSlots.begin(), mSlots.begin() + sorted, mSlots.end(),
+                       [](const value_type& a, const value_type& b) { return *a.first < *b.first; });
+    mSorted = n;
+
+    if (mSlots.capacity() / 4 > n)
+    {
+        mSlots.shrink_to_fit();
+    }
+}
+
 bool CacheableReader::unserializechunkmacs(chunkmac_map& m)
 {
     if (m.unserialize(ptr, end))   // ptr is adjusted by reference
@@ -1516,6 +1736,74 @@ std::string Utils::hexToString(const std::string &input)
     return output;
 }
 
+const size_t TransientArena::BLOCKSIZE;
+
+void* TransientArena::allocate(size_t size, size_t align)
+{
+    mStats.allocations++;
+    mStats.bytes += size;
+
+    for (;;)
+    {
+        if (mCurrent < mBlocks.size())
+        {
+            Block& block = mBlocks[mCurrent];
+
+            // blocks are aligned for any fundamental type
+            size_t offset = (mUsed + align - 1) & ~(align - 1);
+            if (offset + size <= block.size)
+            {
+                mUsed = offset + size;
+                mStats.peak = std::max(mStats.peak, mFilled + mUsed);
+                return block.data.get() + offset;
+            }
+
+            // the rest of this block is wasted until the next reset
+            mFilled += block.size;
+            mCurrent++;
+            mUsed = 0;
+            continue;
+        }
+
+        // a request larger than a block gets a block of its own
+        size_t blocksize = std::max<size_t>(BLOCKSIZE, size + align);
+        mBlocks.push_back(Block{ std::unique_ptr<char[]>(new char[blocksize]), blocksize });
+        mStats.blocks++;
+    }
+}
+
+char* TransientArena::copy(const char* data, size_t len)
+{
+    char* s = static_cast<char*>(allocate(len + 1, 1));
+    memcpy(s, data, len);
+    s[len] = 0;
+    return s;
+}
+
+void TransientArena::reset(Stats* totals)
+{
+    if (totals)
+    {
+        totals->allocations += mStats.allocations;
+        totals->bytes += mStats.bytes;
+        totals->blocks += mStats.blocks;
+        totals->peak = std::max(totals->peak, mStats.peak);
+    }
+
+    // oversized blocks aren't kept, so that one large packet doesn't pin them
+    if (!mBlocks.empty() && mBlocks[0].size != BLOCKSIZE)
+    {
+        mBlocks.clear();
+    }
+    else if (mBlocks.size() > 1)
+    {
+        mBlocks.resize(1);
+    }
+
+    mCurrent = mUsed = mFilled = 0;
+    mStats = Stats();
+}
+
 long long abs(long long n)
 {
     // for pre-c++11 where this version is not defined yet
@@ -2002,6 +2290,110 @@ void NodeCounter::operator -= (const NodeCounter& o)
     versions -= o.versions;
 }
 
+std::atomic<unsigned> CodeCounter::LatencySampler::interval{0};
+
+CodeCounter::LatencySampler::LatencySampler()
+{
+    reset();
+}
+
+int CodeCounter::LatencySampler::bucket(uint64_t us)
+{
+    if (us < SUBBUCKETS)
+    {
+        return int(us);
+    }
+
+    int e = 0;
+    while (us >> (e + 1))
+    {
+        e++;
+    }
+
+    int b = SUBBUCKETS * (e - 1) + int((us >> (e - 2)) & (SUBBUCKETS - 1));
+    return std::min(b, BUCKETS - 1);
+}
+
+uint64_t CodeCounter::LatencySampler::bucketmid(int b)
+{
+    if (b < SUBBUCKETS)
+    {
+        return uint64_t(b);
+    }
+
+    int e = b / SUBBUCKETS + 1;
+    uint64_t width = uint64_t(1) << (e - 2);
+    return uint64_t(SUBBUCKETS + b % SUBBUCKETS) * width + width / 2;
+}
+
+void CodeCounter::LatencySampler::add(high_resolution_clock::duration d)
+{
+    uint64_t us = uint64_t(std::max<int64_t>(0, duration_cast<microseconds>(d).count()));
+
+    std::atomic<uint64_t>& c = counts[bucket(us)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (us > maxus.load(std::memory_order_relaxed))
+    {
+        maxus.store(us, std::memory_order_relaxed);
+    }
+}
+
+uint64_t CodeCounter::LatencySampler::percentile(double p) const
+{
+    uint64_t total = samples();
+    if (!total)
+    {
+        return 0;
+    }
+
+    uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(p * double(total))));
+    if (target >= total)
+    {
+        return maxus.load(std::memory_order_relaxed);
+    }
+
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        seen += counts[b].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            return std::min(bucketmid(b), maxus.load(std::memory_order_relaxed));
+        }
+    }
+    return maxus.load(std::memory_order_relaxed);
+}
+
+uint64_t CodeCounter::LatencySampler::samples() const
+{
+    uint64_t total = 0;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        total += counts[b].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void CodeCounter::LatencySampler::tojson(std::ostream& s) const
+{
+    s << "{\"samples\":" << samples()
+      << ",\"p50us\":" << percentile(0.5)
+      << ",\"p90us\":" << percentile(0.9)
+      << ",\"p99us\":" << percentile(0.99)
+      << ",\"maxus\":" << maxus.load(std::memory_order_relaxed) << "}";
+}
+
+void CodeCounter::LatencySampler::reset()
+{
+    calls.store(0, std::memory_order_relaxed);
+    maxus.store(0, std::memory_order_relaxed);
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        counts[b].store(0, std::memory_order_relaxed);
+    }
+}
+
 } // namespace
 
 
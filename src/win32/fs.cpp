@@ -21,11 +21,17 @@
 
 #include "mega.h"
 
+#ifndef WINDOWS_PHONE
+#include <winioctl.h>
+#include <thread>
+#endif
+
 namespace mega {
 WinFileAccess::WinFileAccess(Waiter *w) : FileAccess(w)
 {
     hFile = INVALID_HANDLE_VALUE;
     hFind = INVALID_HANDLE_VALUE;
+    completionport = false;
 
     fsidvalid = false;
 }
@@ -201,6 +207,13 @@ bool WinFileAccess::sysopen(bool async)
         return false;
     }
 
+#ifndef WINDOWS_PHONE
+    if (async)
+    {
+        bindcompletionport();
+    }
+#endif
+
     return true;
 }
 
@@ -213,11 +226,72 @@ void WinFileAccess::sysclose()
     {
         CloseHandle(hFile);
         hFile = INVALID_HANDLE_VALUE;
+        completionport = false;
     }
 }
 
 #ifndef WINDOWS_PHONE
 
+// A single I/O completion port for the process, with a thread dequeuing the
+// completions: async operations complete while the SDK thread is busy, not only
+// when it's in an alertable wait, as with the APCs of ReadFileEx/WriteFileEx.
+// Handles that can't be associated with it keep using the APCs.
+class WinIoCompletionPort
+{
+public:
+    // NULL if it can't be created. Never destroyed, like the thread
+    static WinIoCompletionPort* instance()
+    {
+        static WinIoCompletionPort* port = create();
+        return port;
+    }
+
+    bool associate(HANDLE hFile)
+    {
+        return CreateIoCompletionPort(hFile, port, 0, 0) == port;
+    }
+
+private:
+    HANDLE port;
+
+    static WinIoCompletionPort* create()
+    {
+        HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+        if (!port)
+        {
+            LOG_warn << "Unable to create the I/O completion port: " << GetLastError();
+            return NULL;
+        }
+
+        WinIoCompletionPort* completionport = new WinIoCompletionPort;
+        completionport->port = port;
+        std::thread(&WinIoCompletionPort::dequeue, completionport).detach();
+
+        LOG_debug << "Using an I/O completion port for async file operations";
+        return completionport;
+    }
+
+    void dequeue()
+    {
+        for (;;)
+        {
+            DWORD transferred = 0;
+            ULONG_PTR key;
+            LPOVERLAPPED overlapped = NULL;
+            BOOL ok = GetQueuedCompletionStatus(port, &transferred, &key, &overlapped, INFINITE);
+            if (!overlapped)
+            {
+                LOG_err << "I/O completion port wait failed: " << GetLastError();
+                Sleep(100);
+                continue;
+            }
+
+            WinFileAccess::asyncopcompleted(static_cast<WinAsyncOverlapped*>(overlapped)->context,
+                                            ok ? 0 : GetLastError(), transferred);
+        }
+    }
+};
+
 WinAsyncIOContext::WinAsyncIOContext() : AsyncIOContext()
 {
     overlapped = NULL;
@@ -250,10 +324,19 @@ AsyncIOContext *WinFileAccess::newasynccontext()
     return new WinAsyncIOContext();
 }
 
-VOID WinFileAccess::asyncopfinished(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped)
+void WinFileAccess::bindcompletionport()
 {
-    WinAsyncIOContext *context = (WinAsyncIOContext *)(lpOverlapped->hEvent);
-    context->failed = dwErrorCode || dwNumberOfBytesTransfered != context->len;
+    WinIoCompletionPort* port = WinIoCompletionPort::instance();
+    completionport = port && port->associate(hFile);
+    if (port && !completionport)
+    {
+        LOG_warn << "Unable to use the I/O completion port for a file: " << GetLastError();
+    }
+}
+
+void WinFileAccess::asyncopcompleted(WinAsyncIOContext *context, DWORD error, DWORD transferred)
+{
+    context->failed = error || transferred != context->len;
     if (!context->failed)
     {
         if (context->op == AsyncIOContext::READ)
@@ -268,15 +351,64 @@ VOID WinFileAccess::asyncopfinished(DWORD dwErrorCode, DWORD dwNumberOfBytesTran
     }
     else
     {
-        LOG_warn << "Async operation finished with error: " << dwErrorCode;
+        LOG_warn << "Async operation finished with error: " << error;
     }
 
-    context->retry = WinFileSystemAccess::istransient(dwErrorCode);
+    context->retry = WinFileSystemAccess::istransient(error);
+
+    // the context may be deleted as soon as it's finished
+    asyncfscallback userCallback = context->userCallback;
+    void *userData = context->userData;
     context->finished = true;
+    if (userCallback)
+    {
+        userCallback(userData);
+    }
+}
+
+VOID WinFileAccess::asyncopfinished(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped)
+{
+    asyncopcompleted(static_cast<WinAsyncOverlapped*>(lpOverlapped)->context, dwErrorCode, dwNumberOfBytesTransfered);
+}
+
+bool WinFileAccess::startasyncop(WinAsyncIOContext *context, bool write)
+{
+    WinAsyncOverlapped *overlapped = new WinAsyncOverlapped;
+    memset(overlapped, 0, sizeof (WinAsyncOverlapped));
+    overlapped->Offset = context->pos & 0xFFFFFFFF;
+    overlapped->OffsetHigh = (context->pos >> 32) & 0xFFFFFFFF;
+    overlapped->context = context;
+    context->overlapped = overlapped;
+
+    if (completionport)
+    {
+        // a completion is queued to the port even when the operation completes at once
+        BOOL r = write ? WriteFile(hFile, (LPCVOID)context->buffer, (DWORD)context->len, NULL, overlapped)
+                       : ReadFile(hFile, (LPVOID)context->buffer, (DWORD)context->len, NULL, overlapped);
+        if (r || GetLastError() == ERROR_IO_PENDING)
+        {
+            return true;
+        }
+    }
+    else if (write ? WriteFileEx(hFile, (LPCVOID)context->buffer, (DWORD)context->len, overlapped, asyncopfinished)
+                   : ReadFileEx(hFile, (LPVOID)context->buffer, (DWORD)context->len, overlapped, asyncopfinished))
+    {
+        return true;
+    }
+
+    DWORD e = GetLastError();
+    context->retry = WinFileSystemAccess::istransient(e);
+    context->failed = true;
+    context->finished = true;
+    context->overlapped = NULL;
+    delete overlapped;
+
+    LOG_warn << "Async " << (write ? "write" : "read") << " failed at startup: " << e;
     if (context->userCallback)
     {
         context->userCallback(context->userData);
     }
+    return false;
 }
 
 #endif
@@ -328,30 +460,7 @@ void WinFileAccess::asyncsysread(AsyncIOContext *context)
         return;
     }
 
-    OVERLAPPED *overlapped = new OVERLAPPED;
-    memset(overlapped, 0, sizeof (OVERLAPPED));
-
-    overlapped->Offset = winContext->pos & 0xFFFFFFFF;
-    overlapped->OffsetHigh = (winContext->pos >> 32) & 0xFFFFFFFF;
-    overlapped->hEvent = winContext;
-    winContext->overlapped = overlapped;
-
-    if (!ReadFileEx(hFile, (LPVOID)winContext->buffer, (DWORD)winContext->len,
-                   overlapped, asyncopfinished))
-    {
-        DWORD e = GetLastError();
-        winContext->retry = WinFileSystemAccess::istransient(e);
-        winContext->failed = true;
-        winContext->finished = true;
-        winContext->overlapped = NULL;
-        delete overlapped;
-
-        LOG_warn << "Async read failed at startup: " << e;
-        if (winContext->userCallback)
-        {
-            winContext->userCallback(winContext->userData);
-        }
-    }
+    startasyncop(winContext, false);
 #endif
 }
 
@@ -376,29 +485,7 @@ void WinFileAccess::asyncsyswrite(AsyncIOContext *context)
         return;
     }
 
-    OVERLAPPED *overlapped = new OVERLAPPED;
-    memset(overlapped, 0, sizeof (OVERLAPPED));
-    overlapped->Offset = winContext->pos & 0xFFFFFFFF;
-    overlapped->OffsetHigh = (winContext->pos >> 32) & 0xFFFFFFFF;
-    overlapped->hEvent = winContext;
-    winContext->overlapped = overlapped;
-
-    if (!WriteFileEx(hFile, (LPVOID)winContext->buffer, (DWORD)winContext->len,
-                   overlapped, asyncopfinished))
-    {
-        DWORD e = GetLastError();
-        winContext->retry = WinFileSystemAccess::istransient(e);
-        winContext->failed = true;
-        winContext->finished = true;
-        winContext->overlapped = NULL;
-        delete overlapped;
-
-        LOG_warn << "Async write failed at startup: "  << e;
-        if (winContext->userCallback)
-        {
-            winContext->userCallback(winContext->userData);
-        }
-    }
+    startasyncop(winContext, true);
 #endif
 }
 
@@ -642,6 +729,13 @@ bool WinFileAccess::fopen(string* name, bool read, bool write, bool async)
         }
     }
 
+#ifndef WINDOWS_PHONE
+    if (async)
+    {
+        bindcompletionport();
+    }
+#endif
+
     return true;
 }
 
@@ -809,6 +903,78 @@ bool WinFileSystemAccess::renamelocal(string* oldname, string* newname, bool rep
     return r;
 }
 
+#if !defined(WINDOWS_PHONE) && defined(FSCTL_DUPLICATE_EXTENTS_TO_FILE) && defined(FILE_SUPPORTS_BLOCK_REFCOUNTING)
+// ReFS block cloning: the copy shares the clusters of the file until either is
+// written to. The source and the target are on the same volume, the ranges are
+// whole clusters (the last one past the end of the file) and below 4 GB each
+static bool cloneblocks(LPCWSTR oldname, LPCWSTR newname)
+{
+    HANDLE hSource = CreateFileW(oldname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (hSource == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool done = false;
+    DWORD flags, sectorspercluster, bytespersector, freeclusters, totalclusters;
+    LARGE_INTEGER size;
+    WCHAR volume[MAX_PATH];
+
+    if (GetVolumeInformationByHandleW(hSource, NULL, 0, NULL, NULL, &flags, NULL, 0)
+            && (flags & FILE_SUPPORTS_BLOCK_REFCOUNTING)
+            && GetFileSizeEx(hSource, &size)
+            && GetVolumePathNameW(oldname, volume, MAX_PATH)
+            && GetDiskFreeSpaceW(volume, &sectorspercluster, &bytespersector, &freeclusters, &totalclusters))
+    {
+        HANDLE hTarget = CreateFileW(newname, GENERIC_READ | GENERIC_WRITE | DELETE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+        if (hTarget != INVALID_HANDLE_VALUE)
+        {
+            FILE_END_OF_FILE_INFO eof;
+            eof.EndOfFile = size;
+            done = !!SetFileInformationByHandle(hTarget, FileEndOfFileInfo, &eof, sizeof eof);
+
+            LONGLONG cluster = LONGLONG(sectorspercluster) * bytespersector;
+            LONGLONG chunk = (LONGLONG(1) << 30) / cluster * cluster;
+
+            DUPLICATE_EXTENTS_DATA extents;
+            extents.FileHandle = hSource;
+
+            for (LONGLONG offset = 0; done && offset < size.QuadPart; offset += chunk)
+            {
+                LONGLONG length = (std::min)(chunk, size.QuadPart - offset);
+                extents.SourceFileOffset.QuadPart = offset;
+                extents.TargetFileOffset.QuadPart = offset;
+                extents.ByteCount.QuadPart = (length + cluster - 1) / cluster * cluster;
+
+                DWORD returned;
+                done = !!DeviceIoControl(hTarget, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof extents,
+                                         NULL, 0, &returned, NULL);
+            }
+
+            // as CopyFileW() does
+            FILETIME ctime, atime, mtime;
+            if (done && GetFileTime(hSource, &ctime, &atime, &mtime))
+            {
+                SetFileTime(hTarget, &ctime, &atime, &mtime);
+            }
+
+            if (!done)
+            {
+                // let CopyFileW() start over
+                FILE_DISPOSITION_INFO disposition;
+                disposition.DeleteFile = TRUE;
+                SetFileInformationByHandle(hTarget, FileDispositionInfo, &disposition, sizeof disposition);
+            }
+
+            CloseHandle(hTarget);
+        }
+    }
+
+    CloseHandle(hSource);
+    return done;
+}
+#endif
+
 bool WinFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t)
 {
     oldname->append("", 1);
@@ -816,6 +982,9 @@ bool WinFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t)
 
 #ifdef WINDOWS_PHONE
     bool r = SUCCEEDED(CopyFile2((LPCWSTR)oldname->data(), (LPCWSTR)newname->data(), NULL));
+#elif defined(FSCTL_DUPLICATE_EXTENTS_TO_FILE) && defined(FILE_SUPPORTS_BLOCK_REFCOUNTING)
+    bool r = cloneblocks((LPCWSTR)oldname->data(), (LPCWSTR)newname->data())
+            || CopyFileW((LPCWSTR)oldname->data(), (LPCWSTR)newname->data(), FALSE);
 #else
     bool r = !!CopyFileW((LPCWSTR)oldname->data(), (LPCWSTR)newname->data(), FALSE);
 #endif
@@ -833,6 +1002,34 @@ bool WinFileSystemAccess::copylocal(string* oldname, string* newname, m_time_t)
     return r;
 }
 
+bool WinFileSystemAccess::linklocal(string* oldname, string* newname)
+{
+#ifdef WINDOWS_PHONE
+    return false;
+#else
+    oldname->append("", 1);
+    newname->append("", 1);
+
+    bool r = !!CreateHardLinkW((LPCWSTR)newname->data(), (LPCWSTR)oldname->data(), NULL);
+    if (!r && GetLastError() == ERROR_ALREADY_EXISTS && DeleteFileW((LPCWSTR)newname->data()))
+    {
+        r = !!CreateHardLinkW((LPCWSTR)newname->data(), (LPCWSTR)oldname->data(), NULL);
+    }
+
+    newname->resize(newname->size() - 1);
+    oldname->resize(oldname->size() - 1);
+
+    if (!r)
+    {
+        DWORD e = GetLastError();
+        LOG_debug << "Unable to link file. Error code: " << e;
+        transient_error = istransient(e);
+    }
+
+    return r;
+#endif
+}
+
 bool WinFileSystemAccess::rmdirlocal(string* name)
 {
     name->append("", 1);
@@ -1290,22 +1487,244 @@ bool WinDirNotify::fsstableids() const
     return true;
 }
 
+#ifndef WINDOWS_PHONE
+// the USN journal is read through a handle to the volume, which only
+// elevated processes can open
+static HANDLE openjournalvolume(const string& localbasepath)
+{
+    string path = localbasepath;
+    path.append("", 1);
+    path.append("", 1);
+
+    wchar_t mountpoint[MAX_PATH + 1], volume[MAX_PATH + 1];
+    if (!GetVolumePathNameW((LPCWSTR)path.data(), mountpoint, MAX_PATH)
+     || !GetVolumeNameForVolumeMountPointW(mountpoint, volume, MAX_PATH))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    // \\?\Volume{...} without the trailing backslash is the volume itself
+    size_t len = wcslen(volume);
+    if (len && volume[len - 1] == L'\\')
+    {
+        volume[len - 1] = 0;
+    }
+
+    return CreateFileW(volume, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL, OPEN_EXISTING, 0, NULL);
+}
+
+// journal id and next USN
+static bool queryjournalposition(HANDLE hVolume, string* position)
+{
+    USN_JOURNAL_DATA_V0 data;
+    DWORD bytes;
+    if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &data, sizeof data, &bytes, NULL))
+    {
+        return false;
+    }
+
+    position->assign((const char*)&data.UsnJournalID, sizeof data.UsnJournalID);
+    position->append((const char*)&data.NextUsn, sizeof data.NextUsn);
+    return true;
+}
+#endif
+
+bool WinDirNotify::journalposition(string* position)
+{
+#ifndef WINDOWS_PHONE
+    HANDLE hVolume = openjournalvolume(localbasepath);
+    if (hVolume == INVALID_HANDLE_VALUE)
+    {
+        LOG_debug << "USN journal not available. Error code: " << GetLastError();
+        return false;
+    }
+
+    bool ok = queryjournalposition(hVolume, position);
+    CloseHandle(hVolume);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+// each record names an entry by its parent folder's file reference number,
+// which is the fsid of the folder's LocalNode; entries below folders that
+// are not synced (yet) are covered by the scan of their new ancestor
+bool WinDirNotify::journalchanges(const string& position)
+{
+#if defined(ENABLE_SYNC) && !defined(WINDOWS_PHONE)
+    DWORDLONG journalid;
+    USN usn;
+
+    if (position.size() != sizeof journalid + sizeof usn)
+    {
+        return false;
+    }
+    memcpy(&journalid, position.data(), sizeof journalid);
+    memcpy(&usn, position.data() + sizeof journalid, sizeof usn);
+
+    HANDLE hVolume = openjournalvolume(localbasepath);
+    if (hVolume == INVALID_HANDLE_VALUE)
+    {
+        LOG_debug << "USN journal not available. Error code: " << GetLastError();
+        return false;
+    }
+
+    USN_JOURNAL_DATA_V0 data;
+    DWORD bytes;
+    if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &data, sizeof data, &bytes, NULL)
+     || data.UsnJournalID != journalid || usn < data.FirstUsn || usn > data.NextUsn)
+    {
+        LOG_warn << "The USN journal doesn't cover the changes since the last session";
+        CloseHandle(hVolume);
+        return false;
+    }
+
+    // the sync's root isn't part of the state cache
+    handle rootfsid = UNDEF;
+    auto fa = sync->client->fsaccess->newfileaccess();
+    string rootpath = localbasepath;
+    if (fa->fopen(&rootpath, true, false) && fa->fsidvalid)
+    {
+        rootfsid = fa->fsid;
+    }
+
+    READ_USN_JOURNAL_DATA_V0 rd = { usn, 0xFFFFFFFF, FALSE, 0, 0, journalid };
+    string buf;
+    buf.resize(65536);
+    set<pair<LocalNode*, string> > notified;
+    bool ok = true;
+
+    while (rd.StartUsn < data.NextUsn)
+    {
+        if (!DeviceIoControl(hVolume, FSCTL_READ_USN_JOURNAL, &rd, sizeof rd,
+                             (LPVOID)buf.data(), DWORD(buf.size()), &bytes, NULL))
+        {
+            LOG_warn << "Unable to read the USN journal. Error code: " << GetLastError();
+            ok = false;
+            break;
+        }
+
+        if (bytes <= sizeof(USN))
+        {
+            break;
+        }
+
+        USN_RECORD_V2* record;
+        for (DWORD pos = sizeof(USN); pos < bytes; pos += record->RecordLength)
+        {
+            record = (USN_RECORD_V2*)(buf.data() + pos);
+            if (record->MajorVersion != 2)
+            {
+                continue;
+            }
+
+            LocalNode* parent = NULL;
+            if (record->ParentFileReferenceNumber == rootfsid)
+            {
+                parent = &sync->localroot;
+            }
+            else
+            {
+                handlelocalnode_map::iterator it = sync->client->fsidnode.find(record->ParentFileReferenceNumber);
+                if (it != sync->client->fsidnode.end() && it->second->sync == sync && it->second->type == FOLDERNODE)
+                {
+                    parent = it->second;
+                }
+            }
+
+            if (!parent)
+            {
+                continue;
+            }
+
+            string name((const char*)record + record->FileNameOffset, record->FileNameLength);
+
+            // skip the local debris folder
+            if (parent == &sync->localroot && name == ignore)
+            {
+                continue;
+            }
+
+            // both ends of renames: the old name is found missing, the new
+            // one is matched by fsid
+            if (notified.insert(std::make_pair(parent, name)).second)
+            {
+                notify(DIREVENTS, parent, name.data(), name.size());
+            }
+        }
+
+        rd.StartUsn = *(USN*)buf.data();
+    }
+
+    CloseHandle(hVolume);
+
+    if (ok)
+    {
+        LOG_debug << "Changes in the USN journal since the last session: " << notified.size();
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
+
+#ifndef WINDOWS_PHONE
+// FILE_NOTIFY_EXTENDED_INFORMATION and ReadDirectoryChangesExW (Windows 10 1709),
+// which older SDKs don't declare
+typedef struct _MEGAFILE_NOTIFY_EXTENDED_INFORMATION {
+    DWORD NextEntryOffset;
+    DWORD Action;
+    LARGE_INTEGER CreationTime;
+    LARGE_INTEGER LastModificationTime;
+    LARGE_INTEGER LastChangeTime;
+    LARGE_INTEGER LastAccessTime;
+    LARGE_INTEGER AllocatedLength;
+    LARGE_INTEGER FileSize;
+    DWORD FileAttributes;
+    DWORD ReparsePointTag;
+    LARGE_INTEGER FileId;
+    LARGE_INTEGER ParentFileId;
+    DWORD FileNameLength;
+    WCHAR FileName[1];
+} MEGAFILE_NOTIFY_EXTENDED_INFORMATION;
+
+static const int MEGAReadDirectoryNotifyExtendedInformation = 2;
+
+typedef BOOL (WINAPI* ReadDirectoryChangesExWPtr)(HANDLE, LPVOID, DWORD, BOOL, DWORD, LPDWORD,
+                                                  LPOVERLAPPED, LPOVERLAPPED_COMPLETION_ROUTINE, int);
+
+static ReadDirectoryChangesExWPtr readdirectorychangesexw()
+{
+    static ReadDirectoryChangesExWPtr ReadDirectoryChangesExW = []() {
+        HMODULE hMod = GetModuleHandleW(L"kernel32.dll");
+        return hMod ? (ReadDirectoryChangesExWPtr)(void*)GetProcAddress(hMod, "ReadDirectoryChangesExW") : NULL;
+    }();
+    return ReadDirectoryChangesExW;
+}
+#endif
+
 VOID CALLBACK WinDirNotify::completion(DWORD dwErrorCode, DWORD dwBytes, LPOVERLAPPED lpOverlapped)
 {
 #ifndef WINDOWS_PHONE
-    WinDirNotify *dirnotify = (WinDirNotify*)lpOverlapped->hEvent;
-    if (!dirnotify->exit && dwErrorCode != ERROR_OPERATION_ABORTED)
+    WinDirNotifyRead* read = static_cast<WinDirNotifyRead*>(lpOverlapped);
+    WinDirNotify *dirnotify = read->dirnotify;
+
+    dirnotify->pending--;
+
+    if (!dirnotify->exit && dwErrorCode != ERROR_OPERATION_ABORTED && dwErrorCode != ERROR_NOTIFY_CLEANUP)
     {
-        dirnotify->process(dwBytes);
+        dirnotify->process(read, dwBytes);
     }
     else
     {
-        dirnotify->enabled = false;
+        delete read;
     }
 #endif
 }
 
-void WinDirNotify::process(DWORD dwBytes)
+void WinDirNotify::process(WinDirNotifyRead* read, DWORD dwBytes)
 {
 #ifndef WINDOWS_PHONE
     if (!dwBytes)
@@ -1313,60 +1732,81 @@ void WinDirNotify::process(DWORD dwBytes)
 #ifdef ENABLE_SYNC
         LOG_err << "Empty filesystem notification: " << (localrootnode ? localrootnode->name.c_str() : "NULL")
                 << " errors: " << error;
-        error++;
-        readchanges();
-        notify(DIREVENTS, localrootnode, NULL, 0);
 #endif
+        error++;
+
+        // the changes were lost by a full buffer: start over with larger ones
+        if (read->hDirectory == hDirectory && (buffersize >= MAXBUFFERSIZE || !reopen()))
+        {
+            readchanges(read);
+        }
+        else
+        {
+            delete read;
+        }
+
+        overflow();
+        return;
     }
-    else
-    {
-        assert(dwBytes >= offsetof(FILE_NOTIFY_INFORMATION, FileName) + sizeof(wchar_t));
 
-        char* ptr = (char*)notifybuf[active].data();
+    assert(dwBytes >= offsetof(FILE_NOTIFY_INFORMATION, FileName) + sizeof(wchar_t));
 
-        active ^= 1;
+    journalmark = read->journalmark;
 
-        readchanges();
+    // ensure accuracy of the notification timestamps
+    WAIT_CLASS::bumpds();
 
-        // ensure accuracy of the notification timestamps
-		WAIT_CLASS::bumpds();
+    // we trust the OS to always return conformant data
+    for (char* ptr = (char*)read->buffer.data(); ; )
+    {
+        DWORD next, action, namelength;
+        const char* name;
+        NotifyAttributes attributes;
+        const NotifyAttributes* known = NULL;
 
-        // we trust the OS to always return conformant data
-        for (;;)
+        if (read->extended)
         {
-            FILE_NOTIFY_INFORMATION* fni = (FILE_NOTIFY_INFORMATION*)ptr;
-
-            // skip the local debris folder
-            // also, we skip the old name in case of renames
-            if (fni->Action != FILE_ACTION_RENAMED_OLD_NAME
-             && (fni->FileNameLength < ignore.size()
-              || memcmp((char*)fni->FileName, ignore.data(), ignore.size())
-              || (fni->FileNameLength > ignore.size()
-               && memcmp((char*)fni->FileName + ignore.size(), (const char*)(const wchar_t*)L"\\", sizeof(wchar_t)))))
+            MEGAFILE_NOTIFY_EXTENDED_INFORMATION* fni = (MEGAFILE_NOTIFY_EXTENDED_INFORMATION*)ptr;
+            next = fni->NextEntryOffset;
+            action = fni->Action;
+            name = (const char*)fni->FileName;
+            namelength = fni->FileNameLength;
+
+            // what fopen() would tell about the item, as long as it still exists
+            if (action != FILE_ACTION_REMOVED && !WinFileAccess::skipattributes(fni->FileAttributes))
             {
-                if (SimpleLogger::logCurrentLevel >= logDebug)
-                {
-                    string local, path;
-                    local.assign((char*)fni->FileName, fni->FileNameLength);
-                    path.resize((local.size() + 1) * 4 / sizeof(wchar_t));
-                    path.resize(WideCharToMultiByte(CP_UTF8, 0, (wchar_t*)local.data(),
-                                                     int(local.size() / sizeof(wchar_t)),
-                                                     (char*)path.data(),
-                                                     int(path.size() + 1),
-                                                     NULL, NULL));
-#ifdef ENABLE_SYNC
-
-                    LOG_debug << "Filesystem notification. Root: " << (localrootnode ? localrootnode->name.c_str() : "NULL") << "   Path: " << path;
-#endif
-                }
-#ifdef ENABLE_SYNC
-                notify(DIREVENTS, localrootnode, (char*)fni->FileName, fni->FileNameLength);
-#endif
+                FILETIME ft;
+                ft.dwLowDateTime = fni->LastModificationTime.LowPart;
+                ft.dwHighDateTime = DWORD(fni->LastModificationTime.HighPart);
+
+                attributes.type = (fni->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? FOLDERNODE : FILENODE;
+                attributes.size = fni->FileSize.QuadPart;
+                attributes.mtime = FileTime_to_POSIX(&ft);
+                attributes.fsid = handle(fni->FileId.QuadPart);
+                known = &attributes;
             }
-            else if (SimpleLogger::logCurrentLevel >= logDebug)
+        }
+        else
+        {
+            FILE_NOTIFY_INFORMATION* fni = (FILE_NOTIFY_INFORMATION*)ptr;
+            next = fni->NextEntryOffset;
+            action = fni->Action;
+            name = (const char*)fni->FileName;
+            namelength = fni->FileNameLength;
+        }
+
+        // skip the local debris folder
+        // also, we skip the old name in case of renames
+        if (action != FILE_ACTION_RENAMED_OLD_NAME
+         && (namelength < ignore.size()
+          || memcmp(name, ignore.data(), ignore.size())
+          || (namelength > ignore.size()
+           && memcmp(name + ignore.size(), (const char*)(const wchar_t*)L"\\", sizeof(wchar_t)))))
+        {
+            if (SimpleLogger::logCurrentLevel >= logDebug)
             {
                 string local, path;
-                local.assign((char*)fni->FileName, fni->FileNameLength);
+                local.assign(name, namelength);
                 path.resize((local.size() + 1) * 4 / sizeof(wchar_t));
                 path.resize(WideCharToMultiByte(CP_UTF8, 0, (wchar_t*)local.data(),
                                                  int(local.size() / sizeof(wchar_t)),
@@ -1374,70 +1814,185 @@ void WinDirNotify::process(DWORD dwBytes)
                                                  int(path.size() + 1),
                                                  NULL, NULL));
 #ifdef ENABLE_SYNC
-                LOG_debug << "Skipped filesystem notification. Root: " << (localrootnode ? localrootnode->name.c_str() : "NULL") << "   Path: " << path;
+
+                LOG_debug << "Filesystem notification. Root: " << (localrootnode ? localrootnode->name.c_str() : "NULL") << "   Path: " << path;
 #endif
             }
+#ifdef ENABLE_SYNC
+            notify(DIREVENTS, localrootnode, name, namelength, false, known);
+#endif
+        }
+        else if (SimpleLogger::logCurrentLevel >= logDebug)
+        {
+            string local, path;
+            local.assign(name, namelength);
+            path.resize((local.size() + 1) * 4 / sizeof(wchar_t));
+            path.resize(WideCharToMultiByte(CP_UTF8, 0, (wchar_t*)local.data(),
+                                             int(local.size() / sizeof(wchar_t)),
+                                             (char*)path.data(),
+                                             int(path.size() + 1),
+                                             NULL, NULL));
+#ifdef ENABLE_SYNC
+            LOG_debug << "Skipped filesystem notification. Root: " << (localrootnode ? localrootnode->name.c_str() : "NULL") << "   Path: " << path;
+#endif
+        }
 
+        if (!next)
+        {
+            break;
+        }
 
-            if (!fni->NextEntryOffset)
-            {
-                break;
-            }
+        ptr += next;
+    }
 
-            ptr += fni->NextEntryOffset;
-        }
+    // reads of a replaced handle are not queued again
+    if (read->hDirectory == hDirectory)
+    {
+        readchanges(read);
+    }
+    else
+    {
+        delete read;
     }
 #endif
 }
 
-// request change notifications on the subtree under hDirectory
-void WinDirNotify::readchanges()
+// recover the changes lost by an overflow: those after the journal mark if
+// the USN journal can tell them, otherwise the whole sync is rescanned
+void WinDirNotify::overflow()
 {
-#ifndef WINDOWS_PHONE
-    if (ReadDirectoryChangesW(hDirectory, (LPVOID)notifybuf[active].data(),
-                              (DWORD)notifybuf[active].size(), TRUE,
-                              FILE_NOTIFY_CHANGE_FILE_NAME
-                            | FILE_NOTIFY_CHANGE_DIR_NAME
-                            | FILE_NOTIFY_CHANGE_LAST_WRITE
-                            | FILE_NOTIFY_CHANGE_SIZE
-                            | FILE_NOTIFY_CHANGE_CREATION,
-                              &dwBytes, &overlapped, completion))
+#if defined(ENABLE_SYNC) && !defined(WINDOWS_PHONE)
+    if (sync && journalmark.size() && journalchanges(journalmark))
     {
-        failed = 0;
-        enabled = true;
+        LOG_debug << "Lost filesystem notifications recovered from the USN journal";
+        return;
     }
-    else
+
+    notify(DIREVENTS, localrootnode, NULL, 0);
+#endif
+}
+
+// request change notifications on the subtree under hDirectory
+void WinDirNotify::readchanges(WinDirNotifyRead* read)
+{
+#ifndef WINDOWS_PHONE
+    for (;;)
     {
-        enabled = false;
+        ZeroMemory(static_cast<OVERLAPPED*>(read), sizeof(OVERLAPPED));
+        read->hDirectory = hDirectory;
+        read->extended = extended;
+        read->buffer.resize(buffersize);
+
+        if (hJournalVolume == INVALID_HANDLE_VALUE || !queryjournalposition(hJournalVolume, &read->journalmark))
+        {
+            read->journalmark.clear();
+        }
+
+        DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME
+                     | FILE_NOTIFY_CHANGE_DIR_NAME
+                     | FILE_NOTIFY_CHANGE_LAST_WRITE
+                     | FILE_NOTIFY_CHANGE_SIZE
+                     | FILE_NOTIFY_CHANGE_CREATION;
+
+        if (read->extended
+                ? readdirectorychangesexw()(hDirectory, (LPVOID)read->buffer.data(), (DWORD)read->buffer.size(), TRUE,
+                                            filter, &read->dwBytes, read, completion,
+                                            MEGAReadDirectoryNotifyExtendedInformation)
+                : ReadDirectoryChangesW(hDirectory, (LPVOID)read->buffer.data(), (DWORD)read->buffer.size(), TRUE,
+                                        filter, &read->dwBytes, read, completion))
+        {
+            pending++;
+            failed = 0;
+            return;
+        }
+
         DWORD e = GetLastError();
         LOG_warn << "ReadDirectoryChanges not available. Error code: " << e << " errors: " << error;
-        if (e == ERROR_NOTIFY_ENUM_DIR && error < 10)
+
+        if (e == ERROR_INVALID_PARAMETER && buffersize > MINBUFFERSIZE)
+        {
+            // buffers over 64 KB are rejected for network shares
+            buffersize = MINBUFFERSIZE;
+        }
+        else if (read->extended && (e == ERROR_INVALID_PARAMETER || e == ERROR_INVALID_FUNCTION || e == ERROR_NOT_SUPPORTED))
+        {
+            // the filesystem doesn't provide the extended information
+            extended = false;
+        }
+        else if (e == ERROR_NOTIFY_ENUM_DIR && error < 10)
         {
             // notification buffer overflow
             error++;
-            readchanges();
         }
         else
         {
             // permanent failure - switch to scanning mode
+            delete read;
             failed = e;
             failreason = "Fatal error returned by ReadDirectoryChangesW";
+            return;
         }
     }
 #endif
 }
 
+// the system buffers the changes between reads in a buffer of the size of
+// the first read of the handle: take a new handle for larger reads
+bool WinDirNotify::reopen()
+{
+#ifndef WINDOWS_PHONE
+    string path = localbasepath;
+    WinFileSystemAccess::sanitizedriveletter(&path);
+    path.append("", 1);
+
+    HANDLE h = CreateFileW((LPCWSTR)path.data(),
+                           FILE_LIST_DIRECTORY,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                           NULL);
+
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        LOG_warn << "Unable to reopen the folder for notifications. Error: " << GetLastError();
+        return false;
+    }
+
+    // the reads of the old handle complete as cancelled once it's closed
+    HANDLE old = hDirectory;
+    hDirectory = h;
+    buffersize = buffersize * 2 < MAXBUFFERSIZE ? buffersize * 2 : MAXBUFFERSIZE;
+
+    LOG_debug << "Filesystem notification buffers grown to " << buffersize << " bytes";
+
+    for (int i = NUMREADS; i--; )
+    {
+        WinDirNotifyRead* read = new WinDirNotifyRead;
+        read->dirnotify = this;
+        readchanges(read);
+    }
+
+    CloseHandle(old);
+    return true;
+#else
+    return false;
+#endif
+}
+
 WinDirNotify::WinDirNotify(string* localbasepath, string* ignore) : DirNotify(localbasepath, ignore)
 {
 #ifndef WINDOWS_PHONE
-    ZeroMemory(&overlapped, sizeof(overlapped));
-    overlapped.hEvent = this;
-    enabled = false;
     exit = false;
-    active = 0;
+    pending = 0;
+    buffersize = INITIALBUFFERSIZE;
+    extended = readdirectorychangesexw() != NULL;
 
-    notifybuf[0].resize(65534);
-    notifybuf[1].resize(65534);
+    if ((hJournalVolume = openjournalvolume(*localbasepath)) == INVALID_HANDLE_VALUE
+     || !queryjournalposition(hJournalVolume, &journalmark))
+    {
+        LOG_debug << "Filesystem notification overflows can't be recovered from the USN journal";
+    }
 
     int added = WinFileSystemAccess::sanitizedriveletter(localbasepath);
     localbasepath->append("", 1);
@@ -1451,7 +2006,13 @@ WinDirNotify::WinDirNotify(string* localbasepath, string* ignore) : DirNotify(lo
                                   NULL)) != INVALID_HANDLE_VALUE)
     {
         failed = 0;
-        readchanges();
+
+        for (int i = NUMREADS; i--; )
+        {
+            WinDirNotifyRead* read = new WinDirNotifyRead;
+            read->dirnotify = this;
+            readchanges(read);
+        }
     }
     else
     {
@@ -1471,17 +2032,21 @@ WinDirNotify::~WinDirNotify()
 #ifndef WINDOWS_PHONE
     if (hDirectory != INVALID_HANDLE_VALUE)
     {
-        if (enabled)
-        {
-            CancelIo(hDirectory);
-            while (enabled)
-            {
-                SleepEx(INFINITE, true);
-            }
-        }
-
+        CancelIo(hDirectory);
         CloseHandle(hDirectory);
     }
+
+    // also the reads of replaced handles
+    while (pending)
+    {
+        SleepEx(INFINITE, true);
+    }
+
+    if (hJournalVolume != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hJournalVolume);
+    }
+
     fsaccess->dirnotifys.erase(this);
 #endif
 }
@@ -1606,7 +2171,7 @@ bool WinDirAccess::dopen(string* name, FileAccess* f, bool glob)
 }
 
 // FIXME: implement followsymlinks
-bool WinDirAccess::dnext(string* /*path*/, string* name, bool /*followsymlinks*/, nodetype_t* type)
+bool WinDirAccess::dnext(string* /*path*/, string* name, bool /*followsymlinks*/, nodetype_t* type, NotifyAttributes* attributes)
 {
     for (;;)
     {
@@ -1624,6 +2189,15 @@ bool WinDirAccess::dnext(string* /*path*/, string* name, bool /*followsymlinks*/
                 *type = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? FOLDERNODE : FILENODE;
             }
 
+            if (attributes)
+            {
+                // the search data carries no file index, so the fsid stays unknown
+                attributes->type = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? FOLDERNODE : FILENODE;
+                attributes->size = attributes->type == FILENODE ? ((m_off_t)ffd.nFileSizeHigh << 32) + (m_off_t)ffd.nFileSizeLow : 0;
+                attributes->mtime = FileTime_to_POSIX(&ffd.ftLastWriteTime);
+                attributes->fsid = UNDEF;
+            }
+
             ffdvalid = false;
             return true;
         }
@@ -1666,4 +2240,110 @@ WinDirAccess::~WinDirAccess()
         FindClose(hFind);
     }
 }
+
+#ifndef WINDOWS_PHONE
+// named file mappings of the session, backed by the paging file
+static std::wstring sharedmemoryname(const string& name)
+{
+    string prefixed = "Local\\" + name;
+    std::wstring wname(prefixed.size() + 1, L'\0');
+    int len = MultiByteToWideChar(CP_UTF8, 0, prefixed.c_str(), -1, &wname[0], int(wname.size()));
+    wname.resize(len ? len - 1 : 0);
+    return wname;
+}
+
+bool SharedMemory::create(const string& name, size_t size)
+{
+    close();
+
+    uint64_t size64 = size;
+    HANDLE h = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                  DWORD(size64 >> 32), DWORD(size64), sharedmemoryname(name).c_str());
+    if (!h || GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        LOG_err << "Unable to create shared memory " << name << ": " << GetLastError();
+        if (h)
+        {
+            CloseHandle(h);
+        }
+        return false;
+    }
+
+    void* data = MapViewOfFile(h, FILE_MAP_WRITE, 0, 0, size);
+    if (!data)
+    {
+        LOG_err << "Unable to map shared memory " << name << ": " << GetLastError();
+        CloseHandle(h);
+        return false;
+    }
+
+    mHandle = h;
+    mData = static_cast<byte*>(data);
+    mSize = size;
+    return true;
+}
+
+bool SharedMemory::open(const string& name)
+{
+    close();
+
+    HANDLE h = OpenFileMappingW(FILE_MAP_READ, FALSE, sharedmemoryname(name).c_str());
+    if (!h)
+    {
+        return false;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    void* data = MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+    if (!data || !VirtualQuery(data, &info, sizeof info))
+    {
+        if (data)
+        {
+            UnmapViewOfFile(data);
+        }
+        CloseHandle(h);
+        return false;
+    }
+
+    // the size of the view is rounded up to whole pages
+    mHandle = h;
+    mData = static_cast<byte*>(data);
+    mSize = info.RegionSize;
+    return true;
+}
+
+void SharedMemory::close()
+{
+    if (mData)
+    {
+        UnmapViewOfFile(mData);
+        CloseHandle(mHandle);
+        mData = nullptr;
+        mHandle = nullptr;
+        mSize = 0;
+    }
+}
+
+void SharedMemory::remove(const string&)
+{
+}
+#else
+bool SharedMemory::create(const string&, size_t)
+{
+    return false;
+}
+
+bool SharedMemory::open(const string&)
+{
+    return false;
+}
+
+void SharedMemory::close()
+{
+}
+
+void SharedMemory::remove(const string&)
+{
+}
+#endif
 } // namespace
@@ -0,0 +1,127 @@
+/**
+ * @file tests/tool/base64bench.cpp
+ * @brief Offline tool to benchmark the base64 encoding and decoding
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Random data is encoded and decoded in blocks of the sizes the client deals
+// with: node handles, user handles, keys and attributes. Every pass is timed
+// with the default btoa()/atob() with a length and with the btoaScalar()/atob()
+// references, and the outputs are checked to match. Build the SDK with
+// -DMEGA_BASE64_NO_SIMD to time the scalar kernels of the default functions too.
+
+#include "mega.h"
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static void report(const string& pass, size_t bytes, int iterations, std::chrono::nanoseconds elapsed)
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    cout << std::left << std::setw(24) << pass << std::right << std::fixed << std::setprecision(1)
+         << std::setw(12) << seconds * 1e9 / iterations << " ns"
+         << std::setw(12) << (seconds > 0 ? double(bytes) * iterations / seconds / 1e6 : 0) << " MB/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 1000000;
+
+    if (argc == 3 && !strcmp(argv[1], "-n"))
+    {
+        iterations = atoi(argv[2]);
+    }
+    else if (argc != 1)
+    {
+        iterations = 0;
+    }
+
+    if (iterations < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [-n iterations]" << endl;
+        return 1;
+    }
+
+    // handles, keys, a typical attribute string, a large attribute
+    const int sizes[] = { MegaClient::NODEHANDLE, MegaClient::USERHANDLE, FILENODEKEYLENGTH, 96, 4096 };
+    std::mt19937 rng(1);
+
+    for (int size : sizes)
+    {
+        std::vector<byte> data(size);
+        for (auto& b : data)
+        {
+            b = byte(rng());
+        }
+
+        std::vector<char> encoded(size * 4 / 3 + 4);
+        std::vector<char> expected(encoded.size());
+        std::vector<byte> decoded(size + 3);
+        int n = Base64::btoaScalar(data.data(), size, expected.data());
+        int dn = 0;
+
+        // the volatile sink keeps the loops from being optimized out
+        volatile int sink = 0;
+
+        for (int scalar = 0; scalar < 2; scalar++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++)
+            {
+                sink = scalar ? Base64::btoaScalar(data.data(), size, encoded.data())
+                              : Base64::btoa(data.data(), size, encoded.data());
+            }
+            std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+            if (sink != n || memcmp(encoded.data(), expected.data(), size_t(n)))
+            {
+                cerr << "Encoded output differs for " << size << " bytes" << (scalar ? " (scalar)" : "") << endl;
+                return 1;
+            }
+            report("btoa " + std::to_string(size) + (scalar ? " scalar" : ""), size_t(size), iterations, elapsed);
+        }
+
+        for (int scalar = 0; scalar < 2; scalar++)
+        {
+            std::fill(decoded.begin(), decoded.end(), byte(0));
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++)
+            {
+                dn = scalar ? Base64::atob(expected.data(), decoded.data(), int(decoded.size()))
+                            : Base64::atob(expected.data(), size_t(n), decoded.data(), int(decoded.size()));
+            }
+            std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+            if (dn != size || memcmp(decoded.data(), data.data(), size_t(size)))
+            {
+                cerr << "Decoded output differs for " << size << " bytes" << (scalar ? " (scalar)" : "") << endl;
+                return 1;
+            }
+            report("atob " + std::to_string(size) + (scalar ? " scalar" : ""), size_t(size), iterations, elapsed);
+        }
+    }
+
+    return 0;
+}
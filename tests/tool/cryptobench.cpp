@@ -0,0 +1,184 @@
+/**
+ * @file tests/tool/cryptobench.cpp
+ * @brief Offline tool to benchmark the cryptographic primitives
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Each primitive is run on random data for a number of iterations, and its
+// latency per call and throughput are reported: the symmetric ciphers of the
+// Crypto++ backend over a buffer of the given size (transfer chunks, node keys
+// and attributes), the chunk MAC fold of a file of that size, the RSA
+// decryption of share keys, the key derivation of logins, and the EdDSA and
+// ECDH operations of the libsodium backend when it is built in. Rebuild the
+// SDK against a different backend or library build to compare them.
+
+#include "mega.h"
+
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static void report(const char* pass, size_t bytes, int iterations, std::chrono::nanoseconds elapsed)
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    cout << std::left << std::setw(24) << pass << std::right << std::fixed << std::setprecision(3)
+         << std::setw(14) << seconds * 1e6 / iterations << " us";
+
+    if (bytes)
+    {
+        cout << std::setprecision(1) << std::setw(12) << (seconds > 0 ? double(bytes) * iterations / seconds / 1e6 : 0) << " MB/s";
+    }
+
+    cout << endl;
+}
+
+static void timeit(const char* pass, size_t bytes, int iterations, const std::function<void()>& f)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        f();
+    }
+    report(pass, bytes, iterations, std::chrono::steady_clock::now() - start);
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 100;
+    size_t buflen = 1 << 20;
+    int i = 1;
+
+    for (; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "-n"))
+        {
+            iterations = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-s"))
+        {
+            buflen = size_t(atoi(argv[i + 1])) * 1024;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i != argc || iterations < 1 || !buflen)
+    {
+        cerr << "Usage: " << argv[0] << " [-n iterations] [-s buffer size in KB]" << endl;
+        return 1;
+    }
+
+    PrnGen rng;
+
+    byte keybytes[SymmCipher::KEYLENGTH];
+    rng.genblock(keybytes, sizeof keybytes);
+
+    SymmCipher key;
+    key.setkey(keybytes);
+
+    // padded to the block size, as the transfer buffers are
+    string buf(buflen, '\0');
+    rng.genblock((byte*)buf.data(), buf.size());
+    byte* data = (byte*)buf.data();
+
+    byte iv[SymmCipher::BLOCKSIZE];
+    rng.genblock(iv, sizeof iv);
+
+    byte mac[SymmCipher::BLOCKSIZE];
+
+    cout << "Buffers of " << buflen << " bytes, " << iterations << " iterations" << endl;
+
+    timeit("ctr_crypt", buflen, iterations, [&]() { key.ctr_crypt(data, unsigned(buflen), 0, 0x0123456789abcdefULL, NULL, true); });
+    timeit("ctr_crypt mac", buflen, iterations, [&]() { key.ctr_crypt(data, unsigned(buflen), 0, 0x0123456789abcdefULL, mac, true); });
+    timeit("ctr_crypt mac decrypt", buflen, iterations, [&]() { key.ctr_crypt(data, unsigned(buflen), 0, 0x0123456789abcdefULL, mac, false); });
+    timeit("ecb_encrypt", buflen, iterations, [&]() { key.ecb_encrypt(data, data, buflen); });
+    timeit("cbc_encrypt", buflen, iterations, [&]() { key.cbc_encrypt(data, buflen, iv); });
+    timeit("cbc_decrypt", buflen, iterations, [&]() { key.cbc_decrypt(data, buflen, iv); });
+
+    string plain(buf), result;
+    timeit("ccm_encrypt", buflen, iterations, [&]() { result.clear(); key.ccm_encrypt(&plain, iv, 12, 16, &result); });
+    string ccm(result);
+    timeit("ccm_decrypt", buflen, iterations, [&]() { result.clear(); key.ccm_decrypt(&ccm, iv, 12, 16, &result); });
+    timeit("gcm_encrypt", buflen, iterations, [&]() { result.clear(); key.gcm_encrypt(&plain, iv, 12, 16, &result); });
+    string gcm(result);
+    timeit("gcm_decrypt", buflen, iterations, [&]() { result.clear(); key.gcm_decrypt(&gcm, iv, 12, 16, &result); });
+
+    // the chunk MACs of a file of buflen bytes
+    chunkmac_map macs;
+    for (m_off_t pos = 0; pos < m_off_t(buflen); pos = ChunkedHash::chunkceil(pos, buflen))
+    {
+        rng.genblock(macs[pos].mac, sizeof macs[pos].mac);
+        macs[pos].finished = true;
+    }
+    timeit("macsmac", 0, iterations, [&]() { macs.macsmac(&key); });
+
+    HashCRC32 crc;
+    byte crcout[4];
+    timeit("HashCRC32", buflen, iterations, [&]() { crc.add(data, unsigned(buflen)); crc.get(crcout); });
+
+    // RSA-2048, as the share keys are decrypted with
+    AsymmCipher privkey, pubkey;
+    CryptoPP::Integer pubk[AsymmCipher::PUBKEY];
+    privkey.genkeypair(rng, privkey.key, pubk, 2048);
+    pubkey.key[AsymmCipher::PUB_PQ] = pubk[AsymmCipher::PUB_PQ];
+    pubkey.key[AsymmCipher::PUB_E] = pubk[AsymmCipher::PUB_E];
+
+    byte sharekey[SymmCipher::KEYLENGTH];
+    byte rsabuf[AsymmCipher::MAXKEYLENGTH];
+    int rsalen = pubkey.encrypt(rng, keybytes, sizeof keybytes, rsabuf, sizeof rsabuf);
+    int rsaiterations = std::max(iterations / 10, 1);
+    timeit("AsymmCipher encrypt", 0, rsaiterations, [&]() { pubkey.encrypt(rng, keybytes, sizeof keybytes, rsabuf, sizeof rsabuf); });
+    timeit("AsymmCipher decrypt", 0, rsaiterations, [&]() { privkey.decrypt(rsabuf, rsalen, sharekey, sizeof sharekey); });
+
+    // the login key derivation
+    byte password[16], salt[32], derived[2 * SymmCipher::KEYLENGTH];
+    rng.genblock(password, sizeof password);
+    rng.genblock(salt, sizeof salt);
+    PBKDF2_HMAC_SHA512 pbkdf2;
+    timeit("PBKDF2_HMAC_SHA512", 0, std::max(iterations / 100, 1), [&]() {
+        pbkdf2.deriveKey(derived, sizeof derived, password, sizeof password, salt, sizeof salt, 100000);
+    });
+
+#ifdef USE_SODIUM
+    EdDSA signkey(rng);
+    string sig;
+    timeit("EdDSA signKey", 0, iterations, [&]() { sig.clear(); signkey.signKey(keybytes, sizeof keybytes, &sig); });
+    timeit("EdDSA verifyKey", 0, iterations, [&]() { EdDSA::verifyKey(keybytes, sizeof keybytes, &sig, signkey.pubKey); });
+
+    ECDH sender, receiver;
+    byte nonce[crypto_box_NONCEBYTES];
+    rng.genblock(nonce, sizeof nonce);
+    string boxplain(crypto_box_ZEROBYTES + buflen, '\0'), boxcipher(boxplain.size(), '\0');
+    timeit("ECDH encrypt", buflen, iterations, [&]() {
+        sender.encrypt((byte*)boxcipher.data(), (const byte*)boxplain.data(), boxplain.size(), nonce, receiver.pubKey, sender.privKey);
+    });
+    timeit("ECDH decrypt", buflen, iterations, [&]() {
+        receiver.decrypt((byte*)boxplain.data(), (const byte*)boxcipher.data(), boxcipher.size(), nonce, sender.pubKey, receiver.privKey);
+    });
+#endif
+
+    return 0;
+}
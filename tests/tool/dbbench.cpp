@@ -0,0 +1,226 @@
+/**
+ * @file tests/tool/dbbench.cpp
+ * @brief Offline tool to benchmark the loading of a local state cache
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// The state cache is replayed through MegaClient::fetchsc() exactly as when
+// resuming a session, but the client is never exec()'d: the requests queued by
+// login() are discarded and nothing goes to the network.
+
+#include "mega.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const char* const recordtypes[] = { "scsn", "node", "user", "localnode", "pcr", "transfer",
+                                           "file", "chat", "snapshot", "chunkmacs" };
+
+struct DbBenchApp : public MegaApp
+{
+};
+
+static void usage(const char* name)
+{
+    cerr << "Usage: " << name << " [-n iterations] [-lazy] [-snapshots] <cache folder> <session>" << endl;
+    cerr << "       " << name << " -export <cache folder> <session> <file>" << endl;
+    cerr << "       " << name << " -compare <file> <file>" << endl;
+    cerr << "   (the session is the one printed by megacli's \"session\" command)" << endl;
+}
+
+static MegaClient* newclient(DbBenchApp* app, string folder)
+{
+    if (folder.size() && folder[folder.size() - 1] != '/' && folder[folder.size() - 1] != '\\')
+    {
+        folder.append("/");
+    }
+
+    return new MegaClient(app, new WAIT_CLASS, new HTTPIO_CLASS, new FSACCESS_CLASS,
+                      #ifdef DBACCESS_CLASS
+                          new DBACCESS_CLASS(&folder),
+                      #else
+                          NULL,
+                      #endif
+                          NULL, "N9tSBJDC", "dbbench");
+}
+
+// resume the session from its cache only
+static bool opencache(MegaClient* client, const string& session)
+{
+    byte sessionraw[64];
+    if (session.size() >= sizeof sessionraw * 4 / 3)
+    {
+        return false;
+    }
+
+    int size = Base64::atob(session.c_str(), sessionraw, sizeof sessionraw);
+    client->login(sessionraw, size);
+
+    return client->sctable && !ISUNDEF(client->cachedscsn);
+}
+
+static void report(const MegaClient::ScLoadStats* stats, std::chrono::nanoseconds total, size_t nodes)
+{
+    cout << std::left << std::setw(10) << "type" << std::right
+         << std::setw(10) << "records" << std::setw(14) << "bytes"
+         << std::setw(12) << "read ms" << std::setw(12) << "decode ms"
+         << std::setw(12) << "MB/s" << std::setw(14) << "records/s" << endl;
+
+    for (uint32_t type = 0; type <= DbTable::TYPEMASK; type++)
+    {
+        const MegaClient::ScLoadStats& s = stats[type];
+        if (!s.records)
+        {
+            continue;
+        }
+
+        double seconds = std::chrono::duration<double>(s.readtime + s.decodetime).count();
+
+        cout << std::left << std::setw(10);
+        if (type < sizeof recordtypes / sizeof *recordtypes)
+        {
+            cout << recordtypes[type];
+        }
+        else
+        {
+            cout << type;
+        }
+
+        cout << std::right << std::fixed << std::setprecision(1)
+             << std::setw(10) << s.records << std::setw(14) << s.bytes
+             << std::setw(12) << std::chrono::duration<double, std::milli>(s.readtime).count()
+             << std::setw(12) << std::chrono::duration<double, std::milli>(s.decodetime).count()
+             << std::setw(12) << (seconds > 0 ? s.bytes / seconds / 1e6 : 0)
+             << std::setw(14) << std::setprecision(0) << (seconds > 0 ? s.records / seconds : 0) << endl;
+    }
+
+    cout << "fetchsc: " << std::setprecision(1) << std::chrono::duration<double, std::milli>(total).count()
+         << " ms, " << nodes << " nodes" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SimpleLogger::setLogLevel(getenv("MEGA_DEBUG") ? logDebug : logWarning);
+
+    DbBenchApp app;
+    int iterations = 1;
+    bool lazy = false;
+    bool snapshots = false;
+    int i = 1;
+
+    if (argc == 4 && !strcmp(argv[1], "-compare"))
+    {
+        MegaClient* client = newclient(&app, "");
+        bool equal = client->compareDatabases(argv[2], argv[3]);
+        cout << (equal ? "Databases are equal" : "Databases are different") << endl;
+        delete client;
+        return equal ? 0 : 1;
+    }
+
+    if (argc == 5 && !strcmp(argv[1], "-export"))
+    {
+        MegaClient* client = newclient(&app, argv[2]);
+        if (!opencache(client, argv[3]))
+        {
+            cerr << "No state cache for this session in " << argv[2] << endl;
+            delete client;
+            return 1;
+        }
+
+        client->exportDatabase(argv[4]);
+        delete client;
+        return 0;
+    }
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lazy"))
+        {
+            lazy = true;
+        }
+        else if (!strcmp(argv[i], "-snapshots"))
+        {
+            snapshots = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (argc - i != 2 || iterations < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    MegaClient* client = newclient(&app, argv[i]);
+    if (lazy)
+    {
+        client->setlazynodeloading(true);
+    }
+
+    if (snapshots)
+    {
+        client->setscsnapshots(true);
+    }
+
+    for (int n = 1; n <= iterations; n++)
+    {
+        if (!opencache(client, argv[i + 1]))
+        {
+            cerr << "No state cache for this session in " << argv[i] << endl;
+            delete client;
+            return 1;
+        }
+
+        MegaClient::ScLoadStats stats[DbTable::TYPEMASK + 1];
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool loaded = client->loadstatecache(stats);
+        std::chrono::nanoseconds total = std::chrono::steady_clock::now() - start;
+
+        if (!loaded)
+        {
+            cerr << "The state cache could not be loaded" << endl;
+            delete client;
+            return 1;
+        }
+
+        if (iterations > 1)
+        {
+            cout << "Iteration " << n << endl;
+        }
+        report(stats, total, client->nodes.size());
+
+        // close the cache without removing it
+        client->locallogout();
+    }
+
+    delete client;
+    return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file tests/tool/jsonbench.cpp
+ * @brief Offline tool to benchmark the JSON scanner on captured API payloads
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// The payload is a response body as logged at debug level, e.g. a fetchnodes
+// ("f") response or a batch of action packets from an sc request. Two passes
+// are timed: skipping the whole payload in a single storeobject(), and walking
+// it element by element with getnameid()/storeobject()/unescape() as the
+// client does. Build the SDK with -DMEGA_JSON_NO_SIMD for the scalar reference.
+
+#include "mega.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// visit every element, returning the number of values stored
+static size_t walk(JSON& json)
+{
+    size_t values = 0;
+    string value;
+
+    if (json.enterobject())
+    {
+        while (json.getnameid() != EOO)
+        {
+            if (*json.pos == '{' || *json.pos == '[')
+            {
+                values += walk(json);
+            }
+            else if (json.storeobject(&value))
+            {
+                JSON::unescape(&value);
+                values++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        json.leaveobject();
+    }
+    else if (json.enterarray())
+    {
+        for (;;)
+        {
+            if (*json.pos == ',')
+            {
+                json.pos++;
+            }
+
+            if (*json.pos == '{' || *json.pos == '[')
+            {
+                values += walk(json);
+            }
+            else if (json.storeobject(&value))
+            {
+                JSON::unescape(&value);
+                values++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        json.leavearray();
+    }
+
+    return values;
+}
+
+static void report(const char* pass, size_t bytes, int iterations, std::chrono::nanoseconds elapsed)
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    cout << std::left << std::setw(8) << pass << std::right << std::fixed << std::setprecision(1)
+         << std::setw(12) << seconds * 1000 / iterations << " ms"
+         << std::setw(12) << (seconds > 0 ? double(bytes) * iterations / seconds / 1e6 : 0) << " MB/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 10;
+    int i = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-n"))
+    {
+        iterations = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (argc - i != 1 || iterations < 1)
+    {
+        cerr << "Usage: " << argv[0] << " [-n iterations] <payload file>" << endl;
+        return 1;
+    }
+
+    std::ifstream file(argv[i], std::ios::binary);
+    if (!file)
+    {
+        cerr << "Unable to read " << argv[i] << endl;
+        return 1;
+    }
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    string payload = contents.str();
+
+    cout << payload.size() << " bytes" << endl;
+
+    JSON json;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        json.begin(payload.c_str());
+        if (!json.storeobject())
+        {
+            cerr << "The payload is not a complete JSON object or array" << endl;
+            return 1;
+        }
+    }
+    report("skip", payload.size(), iterations, std::chrono::steady_clock::now() - start);
+
+    size_t values = 0;
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        json.begin(payload.c_str());
+        values = walk(json);
+    }
+    report("walk", payload.size(), iterations, std::chrono::steady_clock::now() - start);
+
+    cout << values << " values" << endl;
+    return 0;
+}
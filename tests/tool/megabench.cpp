@@ -0,0 +1,658 @@
+/**
+ * @file tests/tool/megabench.cpp
+ * @brief Offline tool to benchmark the node tree operations on synthetic accounts
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// A synthetic account (folder tree, file versions, inbound shares and a few
+// nodes in the rubbish bin) is generated as the "f" array of a fetchnodes
+// response, with real node keys and encrypted attributes, and fed to
+// MegaClient::readnodes() the way CommandFetchNodes does. The client is never
+// exec()'d: nothing goes to the network. The tree is then written to a state
+// cache in a temporary table (initsc, updatesc), reloaded from it (fetchsc),
+// and queried the way the intermediate layer does (search, getChildren,
+// getRecentNodes). With -json the results are printed as a single JSON object
+// to be tracked across releases.
+
+#include "mega.h"
+#include "megaapi_impl.h"
+
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct MegaBenchApp : public MegaApp
+{
+};
+
+struct BenchParams
+{
+    size_t nodes = 100000;
+    int depth = 8;
+    int fanout = 16;
+    int shares = 0;
+    int versions = 0;
+    int iterations = 10;
+    string folder = ".";
+    bool json = false;
+};
+
+struct BenchResult
+{
+    string name;
+    int iterations;
+    size_t items;   // nodes processed per iteration
+    std::chrono::nanoseconds elapsed;
+};
+
+struct TreeStats
+{
+    size_t folders = 0;
+    size_t files = 0;
+    size_t versions = 0;
+    size_t bytes = 0;   // size of the JSON
+};
+
+// synthetic "f" array of a fetchnodes response
+class TreeGenerator
+{
+public:
+    TreeGenerator(MegaClient* client, const BenchParams& params)
+        : mClient(client), mParams(params)
+    {
+    }
+
+    string generate(TreeStats& stats)
+    {
+        mJson = "[";
+        mNextHandle = 1;
+        mCount = 0;
+
+        handle root = addroot(ROOTNODE);
+        addroot(INCOMINGNODE);
+        handle rubbish = addroot(RUBBISHNODE);
+
+        // the rubbish bin and each inbound share get a slice of the nodes
+        size_t slice = mParams.nodes / (20 + mParams.shares);
+        size_t budget = mParams.nodes - slice * (1 + mParams.shares);
+
+        addtree(root, &mClient->key, mSelf, budget);
+        addtree(rubbish, &mClient->key, mSelf, slice);
+
+        for (int i = 0; i < mParams.shares; i++)
+        {
+            byte sharekey[SymmCipher::KEYLENGTH];
+            mClient->rng.genblock(sharekey, sizeof sharekey);
+
+            string sk = encryptkey(&mClient->key, sharekey, sizeof sharekey);
+
+            // the parent of an inbound share isn't in the account
+            handle h = newhandle();
+            SymmCipher cipher(sharekey);
+            string keyprefix = Base64Str<MegaClient::NODEHANDLE>(h).chars;
+            string attrs = attributes(FOLDERNODE, i, keyprefix, &cipher, 0, 0);
+
+            mJson.append(",{\"h\":\"").append(Base64Str<MegaClient::NODEHANDLE>(h))
+                 .append("\",\"p\":\"").append(Base64Str<MegaClient::NODEHANDLE>(h ^ 0xffffffffff))
+                 .append("\",\"u\":\"").append(Base64Str<MegaClient::USERHANDLE>(mSharer))
+                 .append("\",\"t\":1,\"a\":\"").append(attrs)
+                 .append("\",\"k\":\"").append(mKey)
+                 .append("\",\"ts\":").append(std::to_string(timestamp()))
+                 .append(",\"su\":\"").append(Base64Str<MegaClient::USERHANDLE>(mSharer))
+                 .append("\",\"sk\":\"").append(sk).append("\",\"r\":0}");
+            mFolders++;
+
+            addtree(h, &cipher, h, slice - 1);
+        }
+
+        mJson.append("]");
+
+        stats.folders = mFolders;
+        stats.files = mFiles;
+        stats.versions = mVersions;
+        stats.bytes = mJson.size();
+        return std::move(mJson);
+    }
+
+    handle self() const { return mSelf; }
+
+private:
+    MegaClient* mClient;
+    const BenchParams& mParams;
+
+    string mJson;
+    handle mNextHandle = 1;
+    size_t mCount = 0;
+    size_t mFolders = 0, mFiles = 0, mVersions = 0;
+
+    const handle mSelf = 0x0123456789abcdef;
+    const handle mSharer = 0x1122334455667788;
+
+    // the node key, encrypted with the key of its owner (the last one set)
+    string mKey;
+
+    handle newhandle()
+    {
+        return mNextHandle++;
+    }
+
+    // creation times spread over the last two years
+    m_time_t timestamp()
+    {
+        return m_time() - m_time_t(mClient->rng.genuint32(2 * 365 * 86400));
+    }
+
+    string encryptkey(SymmCipher* cipher, const byte* key, size_t len)
+    {
+        byte buf[FILENODEKEYLENGTH];
+        memcpy(buf, key, len);
+        cipher->ecb_encrypt(buf, buf, len);
+        return Base64::btoa(string((const char*)buf, len));
+    }
+
+    // encrypted attributes of a new node, leaves its encrypted key in mKey
+    string attributes(nodetype_t type, size_t n, const string& keyprefix, SymmCipher* owner, m_off_t size, m_time_t mtime)
+    {
+        byte key[FILENODEKEYLENGTH];
+        size_t keylen = type == FILENODE ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+        mClient->rng.genblock(key, keylen);
+        mKey = keyprefix + ":" + encryptkey(owner, key, keylen);
+
+        static const char* const extensions[] = { ".jpg", ".mp4", ".pdf", ".txt", ".docx", ".png", ".zip", ".mov" };
+
+        string json = "\"n\":\"";
+        if (type == FILENODE)
+        {
+            json.append("file").append(std::to_string(n)).append(extensions[n % (sizeof extensions / sizeof *extensions)]);
+
+            FileFingerprint fp;
+            fp.size = size;
+            fp.mtime = mtime;
+            mClient->rng.genblock((byte*)fp.crc, sizeof fp.crc);
+            fp.isvalid = true;
+
+            string c;
+            fp.serializefingerprint(&c);
+            json.append("\",\"c\":\"").append(c);
+        }
+        else
+        {
+            json.append("folder").append(std::to_string(n));
+        }
+        json.append("\"");
+
+        SymmCipher cipher;
+        string nodekey((const char*)key, keylen);
+        cipher.setkey(&nodekey);
+
+        string attrstring;
+        mClient->makeattr(&cipher, &attrstring, json.c_str());
+        return Base64::btoa(attrstring);
+    }
+
+    handle addroot(nodetype_t type)
+    {
+        handle h = newhandle();
+        mJson.append(mJson.size() > 1 ? ",{" : "{")
+             .append("\"h\":\"").append(Base64Str<MegaClient::NODEHANDLE>(h))
+             .append("\",\"u\":\"").append(Base64Str<MegaClient::USERHANDLE>(mSelf))
+             .append("\",\"t\":").append(std::to_string(type))
+             .append(",\"ts\":").append(std::to_string(m_time())).append("}");
+        return h;
+    }
+
+    void addnode(handle h, handle parent, handle owner, nodetype_t type, const string& attrs, m_off_t size, m_time_t ts)
+    {
+        mJson.append(",{\"h\":\"").append(Base64Str<MegaClient::NODEHANDLE>(h))
+             .append("\",\"p\":\"").append(Base64Str<MegaClient::NODEHANDLE>(parent))
+             .append("\",\"u\":\"").append(Base64Str<MegaClient::USERHANDLE>(owner))
+             .append("\",\"t\":").append(std::to_string(type))
+             .append(",\"a\":\"").append(attrs)
+             .append("\",\"k\":\"").append(mKey).append("\"");
+
+        if (type == FILENODE)
+        {
+            mJson.append(",\"s\":").append(std::to_string(size));
+        }
+
+        mJson.append(",\"ts\":").append(std::to_string(ts)).append("}");
+        mCount++;
+    }
+
+    // the nodes keyed with `cipher` are prefixed with `keyhandle` (our own
+    // user handle, or the handle of the inbound share they belong to)
+    void addtree(handle top, SymmCipher* cipher, handle keyhandle, size_t budget)
+    {
+        string keyprefix = keyhandle == mSelf ? string(Base64Str<MegaClient::USERHANDLE>(mSelf))
+                                              : string(Base64Str<MegaClient::NODEHANDLE>(keyhandle));
+        handle owner = keyhandle == mSelf ? mSelf : mSharer;
+
+        // breadth first: a quarter of the children of each folder are folders,
+        // down to the maximum depth; the remaining budget is spread over them as files
+        std::deque<std::pair<handle, int>> pending;
+        vector<handle> folders;
+        pending.emplace_back(top, 0);
+        folders.push_back(top);
+
+        size_t added = 0;
+        size_t next = 0;
+        while (added < budget)
+        {
+            handle parent;
+            int depth;
+
+            if (!pending.empty())
+            {
+                parent = pending.front().first;
+                depth = pending.front().second;
+                pending.pop_front();
+            }
+            else
+            {
+                parent = folders[next++ % folders.size()];
+                depth = mParams.depth;
+            }
+
+            int subfolders = depth < mParams.depth ? (mParams.fanout + 3) / 4 : 0;
+            for (int i = 0; i < mParams.fanout && added < budget; i++)
+            {
+                handle h = newhandle();
+                m_time_t ts = timestamp();
+
+                if (i < subfolders)
+                {
+                    string attrs = attributes(FOLDERNODE, mCount, keyprefix, cipher, 0, 0);
+                    addnode(h, parent, owner, FOLDERNODE, attrs, 0, ts);
+                    pending.emplace_back(h, depth + 1);
+                    folders.push_back(h);
+                    mFolders++;
+                    added++;
+                    continue;
+                }
+
+                m_off_t size = 1 + mClient->rng.genuint32(1 << 24);
+                string attrs = attributes(FILENODE, mCount, keyprefix, cipher, size, ts);
+                addnode(h, parent, owner, FILENODE, attrs, size, ts);
+                mFiles++;
+                added++;
+
+                // one file in ten has previous versions, each one the child of the newer one
+                if (mParams.versions && !(mFiles % 10))
+                {
+                    handle current = h;
+                    for (int v = 0; v < mParams.versions && added < budget; v++)
+                    {
+                        handle vh = newhandle();
+                        m_time_t vts = ts - 3600 * (v + 1);
+                        string vattrs = attributes(FILENODE, mCount, keyprefix, cipher, size, vts);
+                        addnode(vh, current, owner, FILENODE, vattrs, size, vts);
+                        current = vh;
+                        mVersions++;
+                        added++;
+                    }
+                }
+            }
+        }
+    }
+};
+
+// resident memory of the process, 0 if unknown
+static size_t residentbytes()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (statm >> pages >> resident)
+    {
+        return resident * size_t(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
+static BenchResult timeit(const char* name, int iterations, size_t items, const std::function<void()>& f)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        f();
+    }
+    return BenchResult{ name, iterations, items, std::chrono::steady_clock::now() - start };
+}
+
+// visit the subtree below n (excluding n), the way MegaApiImpl::processTree() does
+static void walktree(Node* n, TreeProcessor* processor)
+{
+    for (node_list::iterator it = n->children.begin(); it != n->children.end(); it++)
+    {
+        processor->processNode(*it);
+        if ((*it)->type == FOLDERNODE)
+        {
+            walktree(*it, processor);
+        }
+    }
+}
+
+static void report(const BenchParams& params, const TreeStats& tree, size_t nodes, size_t memory, const vector<BenchResult>& results)
+{
+    if (params.json)
+    {
+        cout << "{\"nodes\":" << nodes << ",\"folders\":" << tree.folders << ",\"files\":" << tree.files
+             << ",\"versions\":" << tree.versions << ",\"shares\":" << params.shares
+             << ",\"depth\":" << params.depth << ",\"fanout\":" << params.fanout
+             << ",\"jsonbytes\":" << tree.bytes << ",\"bytespernode\":" << (nodes ? memory / nodes : 0)
+             << ",\"results\":[";
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchResult& r = results[i];
+            double ms = std::chrono::duration<double, std::milli>(r.elapsed).count() / r.iterations;
+
+            cout << (i ? "," : "") << "{\"name\":\"" << r.name << "\",\"iterations\":" << r.iterations
+                 << ",\"items\":" << r.items << std::fixed << std::setprecision(3) << ",\"ms\":" << ms
+                 << ",\"nspernode\":" << (r.items ? ms * 1e6 / r.items : 0) << "}";
+        }
+
+        cout << "]}" << endl;
+        return;
+    }
+
+    cout << nodes << " nodes: " << tree.folders << " folders, " << tree.files << " files, "
+         << tree.versions << " versions, " << params.shares << " inbound shares ("
+         << tree.bytes << " bytes of JSON)" << endl;
+
+    if (memory)
+    {
+        cout << "Memory: " << memory / nodes << " bytes per node" << endl;
+    }
+
+    cout << std::left << std::setw(24) << "operation" << std::right
+         << std::setw(12) << "iterations" << std::setw(12) << "nodes"
+         << std::setw(14) << "ms" << std::setw(14) << "ns/node" << endl;
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        double ms = std::chrono::duration<double, std::milli>(r.elapsed).count() / r.iterations;
+
+        cout << std::left << std::setw(24) << r.name << std::right << std::fixed
+             << std::setw(12) << r.iterations << std::setw(12) << r.items
+             << std::setprecision(3) << std::setw(14) << ms
+             << std::setprecision(1) << std::setw(14) << (r.items ? ms * 1e6 / r.items : 0) << endl;
+    }
+}
+
+static void usage(const char* name)
+{
+    cerr << "Usage: " << name << " [-nodes count] [-depth levels] [-fanout children] [-shares count]" << endl;
+    cerr << "       [-versions count] [-n iterations] [-cache folder] [-json]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SimpleLogger::setLogLevel(getenv("MEGA_DEBUG") ? logDebug : logWarning);
+
+    BenchParams params;
+    int i = 1;
+
+    for (; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-json"))
+        {
+            params.json = true;
+        }
+        else if (i + 1 >= argc)
+        {
+            break;
+        }
+        else if (!strcmp(argv[i], "-nodes"))
+        {
+            params.nodes = size_t(atoll(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-depth"))
+        {
+            params.depth = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-fanout"))
+        {
+            params.fanout = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-shares"))
+        {
+            params.shares = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-versions"))
+        {
+            params.versions = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-n"))
+        {
+            params.iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-cache"))
+        {
+            params.folder = argv[++i];
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i != argc || params.nodes < 100 || params.depth < 1 || params.fanout < 1
+            || params.shares < 0 || size_t(params.shares) > params.nodes / 100
+            || params.versions < 0 || params.iterations < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    string folder = params.folder;
+    if (folder.size() && folder[folder.size() - 1] != '/' && folder[folder.size() - 1] != '\\')
+    {
+        folder.append("/");
+    }
+
+    MegaBenchApp app;
+    MegaClient* client = new MegaClient(&app, new WAIT_CLASS, new HTTPIO_CLASS, new FSACCESS_CLASS,
+                                    #ifdef DBACCESS_CLASS
+                                        new DBACCESS_CLASS(&folder),
+                                    #else
+                                        NULL,
+                                    #endif
+                                        NULL, "N9tSBJDC", "megabench");
+
+    byte masterkey[SymmCipher::KEYLENGTH];
+    client->rng.genblock(masterkey, sizeof masterkey);
+    client->key.setkey(masterkey);
+
+    TreeGenerator generator(client, params);
+    TreeStats tree;
+    string f = generator.generate(tree);
+
+    vector<BenchResult> results;
+
+    // 1. the fetchnodes response
+    client->me = generator.self();
+    client->fetchingnodes = true;
+    Base64::btoa((const byte*)&client->me, sizeof client->me, client->scsn);
+
+    size_t memory = residentbytes();
+
+    results.push_back(timeit("readnodes", 1, 0, [&]() {
+        client->json.begin(f.c_str());
+        client->readnodes(&client->json, 0);
+    }));
+
+    results.push_back(timeit("applykeys", 1, 0, [&]() {
+        client->mergenewshares(0);
+        client->applykeys();
+    }));
+
+    size_t nodes = client->nodes.size();
+    size_t resident = residentbytes();
+    memory = resident > memory ? resident - memory : 0;
+    results[0].items = results[1].items = nodes;
+
+    // the JSON is gone once a real response is processed
+    f.clear();
+    f.shrink_to_fit();
+
+    // 2. serialization of the nodes as cache records
+    string record;
+    size_t recordbytes = 0;
+    results.push_back(timeit("serialize", 1, nodes, [&]() {
+        for (node_map::iterator it = client->nodes.begin(); it != client->nodes.end(); it++)
+        {
+            record.clear();
+            it->second->serialize(&record);
+            recordbytes += record.size();
+        }
+    }));
+
+    // 3. the state cache
+    if (client->dbaccess)
+    {
+        string dbname = "megabench";
+        client->sctable = client->dbaccess->open(client->rng, client->fsaccess, &dbname, false, false);
+    }
+
+    if (client->sctable)
+    {
+        results.push_back(timeit("initsc", 1, nodes, [&]() {
+            client->initsc();
+            client->commitsc(false);
+        }));
+        client->fetchingnodes = false;
+
+        // rename one file in a hundred
+        size_t renamed = 0;
+        for (node_map::iterator it = client->nodes.begin(); it != client->nodes.end(); it++)
+        {
+            Node* n = it->second;
+            if (n->type == FILENODE && !(n->nodehandle % 100))
+            {
+                n->attrs.map['n'].insert(0, "renamed ");
+                n->changed.attrs = true;
+                client->notifynode(n);
+                renamed++;
+            }
+        }
+
+        results.push_back(timeit("updatesc", 1, renamed, [&]() {
+            client->updatesc();
+            client->commitsc(false);
+        }));
+        client->notifypurge();
+
+        // resume from the cache, the way a session is resumed
+        handle cachedscsn = client->cachedscsn;
+        client->locallogout();
+        client->key.setkey(masterkey);
+        client->me = generator.self();
+
+        string dbname = "megabench";
+        client->sctable = client->dbaccess->open(client->rng, client->fsaccess, &dbname, false, false);
+        client->cachedscsn = cachedscsn;
+
+        MegaClient::ScLoadStats stats[DbTable::TYPEMASK + 1];
+        results.push_back(timeit("fetchsc", 1, nodes, [&]() {
+            if (!client->loadstatecache(stats))
+            {
+                cerr << "The state cache could not be loaded" << endl;
+            }
+        }));
+    }
+    else
+    {
+        client->fetchingnodes = false;
+        cerr << "No state cache available, skipping initsc, updatesc and fetchsc" << endl;
+    }
+
+    // 4. the queries of the intermediate layer
+    Node* root = client->nodebyhandle(client->rootnodes[0]);
+
+    results.push_back(timeit("search", params.iterations, nodes, [&]() {
+        SearchTreeProcessor processor("file1");
+        walktree(root, &processor);
+    }));
+
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        client->setnodenameindex(true);
+        results.push_back(BenchResult{ "search index build", 1, nodes, std::chrono::steady_clock::now() - start });
+    }
+
+    results.push_back(timeit("search indexed", params.iterations, nodes, [&]() {
+        node_vector v;
+        client->mNodeNameIndex.search("file1", v);
+    }));
+
+    vector<Node*> folders;
+    for (node_map::iterator it = client->nodes.begin(); it != client->nodes.end(); it++)
+    {
+        if (it->second->type != FILENODE)
+        {
+            folders.push_back(it->second);
+        }
+    }
+
+    results.push_back(timeit("getChildren", params.iterations, nodes, [&]() {
+        for (size_t j = 0; j < folders.size(); j++)
+        {
+            node_vector v(folders[j]->children.begin(), folders[j]->children.end());
+            MegaApiImpl::sortByComparatorFunction(v, MegaApi::ORDER_DEFAULT_ASC, *client);
+        }
+    }));
+
+    results.push_back(timeit("getRecentNodes", params.iterations, 0, [&]() {
+        client->getRecentNodes(10000, m_time() - 90 * 86400, false);
+    }));
+    results.back().items = client->getRecentNodes(10000, m_time() - 90 * 86400, false).size();
+
+    results.push_back(timeit("getRecentActions", params.iterations, 0, [&]() {
+        client->getRecentActions(10000, m_time() - 90 * 86400);
+    }));
+    results.back().items = results[results.size() - 2].items;
+
+    report(params, tree, nodes, memory, results);
+
+    if (!params.json)
+    {
+        cout << "Cache records: " << recordbytes / (nodes ? nodes : 1) << " bytes per node" << endl;
+    }
+
+    if (client->sctable)
+    {
+        client->sctable->remove();
+    }
+
+    delete client;
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file tests/tool/raidbench.cpp
+ * @brief Offline tool to benchmark the combining of raid parts
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Six random parts (the parity computed from the five data parts) are combined
+// into a file buffer as RaidBufferManager does for each raid line: with all the
+// parts present, with the parity missing, and with each data part missing in
+// turn, so it's rebuilt from the parity. Every pass is timed with the default
+// combineParts() and with the combinePartsScalar() reference, and the outputs
+// are checked to match the original data.
+
+#include "mega.h"
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+typedef void (*combinefunc)(byte*, byte* const[], size_t);
+
+static void report(const char* pass, size_t bytes, int iterations, std::chrono::nanoseconds elapsed)
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    cout << std::left << std::setw(16) << pass << std::right << std::fixed << std::setprecision(1)
+         << std::setw(12) << seconds * 1000 / iterations << " ms"
+         << std::setw(12) << (seconds > 0 ? double(bytes) * iterations / seconds / 1e6 : 0) << " MB/s" << endl;
+}
+
+static std::chrono::nanoseconds timecombine(combinefunc combine, byte* dest, byte* const inputbufs[], size_t partslen, int iterations)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        combine(dest, inputbufs, partslen);
+    }
+    return std::chrono::steady_clock::now() - start;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 100;
+    size_t partslen = 1 << 20;
+    int i = 1;
+
+    for (; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "-n"))
+        {
+            iterations = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-s"))
+        {
+            partslen = size_t(atoi(argv[i + 1])) * 1024;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i != argc || iterations < 1 || !partslen || partslen % RAIDSECTOR)
+    {
+        cerr << "Usage: " << argv[0] << " [-n iterations] [-s part size in KB]" << endl;
+        return 1;
+    }
+
+    std::vector<std::vector<byte>> parts(RAIDPARTS, std::vector<byte>(partslen));
+    std::mt19937 rng(1);
+    for (unsigned j = 1; j < RAIDPARTS; j++)
+    {
+        for (size_t k = 0; k < partslen; k++)
+        {
+            parts[j][k] = byte(rng());
+            parts[0][k] ^= parts[j][k];
+        }
+    }
+
+    std::vector<byte> expected(partslen * (RAIDPARTS - 1));
+    std::vector<byte> output(expected.size());
+
+    byte* inputbufs[RAIDPARTS];
+    for (unsigned j = 0; j < RAIDPARTS; j++)
+    {
+        inputbufs[j] = parts[j].data();
+    }
+    RaidBufferManager::combinePartsScalar(expected.data(), inputbufs, partslen);
+
+    cout << RAIDPARTS << " parts of " << partslen << " bytes" << endl;
+
+    // -1: all present, 0: no parity, then each data part
+    for (int missing = -1; missing < int(RAIDPARTS); missing++)
+    {
+        for (unsigned j = 0; j < RAIDPARTS; j++)
+        {
+            inputbufs[j] = int(j) == missing ? NULL : parts[j].data();
+        }
+
+        string pass = missing < 0 ? "all" : missing ? "no data " + std::to_string(missing) : "no parity";
+
+        for (int scalar = 0; scalar < 2; scalar++)
+        {
+            std::fill(output.begin(), output.end(), byte(0));
+            std::chrono::nanoseconds elapsed = timecombine(scalar ? RaidBufferManager::combinePartsScalar : RaidBufferManager::combineParts,
+                                                           output.data(), inputbufs, partslen, iterations);
+
+            if (output != expected)
+            {
+                cerr << "Combined output differs for " << pass << (scalar ? " (scalar)" : "") << endl;
+                return 1;
+            }
+
+            report((pass + (scalar ? " scalar" : "")).c_str(), expected.size(), iterations, elapsed);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+/**
+ * @file tests/tool/screplay.cpp
+ * @brief Offline tool to replay recorded action packets against a state cache
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// The sc responses recorded by MegaClient::recordsc() (MegaApi::recordActionPackets)
+// are fed to MegaClient::procsc() the way exec() does, after loading the state
+// cache of the session as when resuming it. The responses recorded before the
+// SCSN of the cache are skipped, and the replay stops at a gap in the
+// sequence. The client is never exec()'d: nothing goes to the network.
+//
+// The time spent in each type of action packet and in notifypurge() is
+// reported, along with the longest uninterrupted procsc() run, which is how
+// long the SDK thread stalls. The cache is committed to at the end of each
+// response as the SDK would: replay against a copy of it.
+
+#include "mega.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct ScReplayApp : public MegaApp
+{
+};
+
+struct ReplayStats
+{
+    size_t responses = 0;
+    size_t skipped = 0;
+    size_t bytes = 0;
+    uint64_t runs = 0;      // procsc() calls, more than responses when it yields
+    std::chrono::nanoseconds elapsed{0};
+    std::chrono::nanoseconds longestrun{0};
+    std::chrono::nanoseconds longestresponse{0};
+};
+
+// one "sc <scsn> <length>\n<response>\n" record of the recording
+static bool readrecord(std::istream& in, string& scsn, string& response)
+{
+    string tag;
+    size_t length;
+    if (!(in >> tag >> scsn >> length) || tag != "sc" || in.get() != '\n')
+    {
+        return false;
+    }
+
+    response.resize(length);
+    return in.read(&response[0], std::streamsize(length)) && in.get() == '\n';
+}
+
+static string packettype(nameid id)
+{
+    string name;
+    for (; id; id >>= 8)
+    {
+        name.insert(name.begin(), char(id & 0xff));
+    }
+    return name;
+}
+
+static void report(const MegaClient::ScStats& stats, const ReplayStats& replay, size_t nodes, bool json)
+{
+    double totalms = std::chrono::duration<double, std::milli>(replay.elapsed).count();
+    std::chrono::nanoseconds accounted = stats.notifypurge.time;
+    for (auto& it : stats.actionpackets)
+    {
+        accounted += it.second.time;
+    }
+    double otherms = std::chrono::duration<double, std::milli>(replay.elapsed - accounted).count();
+
+    if (json)
+    {
+        cout << "{\"responses\":" << replay.responses << ",\"skipped\":" << replay.skipped
+             << ",\"bytes\":" << replay.bytes << ",\"nodes\":" << nodes << ",\"runs\":" << replay.runs
+             << std::fixed << std::setprecision(3) << ",\"ms\":" << totalms
+             << ",\"longestrunms\":" << std::chrono::duration<double, std::milli>(replay.longestrun).count()
+             << ",\"longestresponsems\":" << std::chrono::duration<double, std::milli>(replay.longestresponse).count()
+             << ",\"otherms\":" << otherms << ",\"types\":[";
+
+        const char* separator = "";
+        auto entry = [&](const string& name, const MegaClient::ScStats::Entry& e) {
+            cout << separator << "{\"type\":\"" << name << "\",\"count\":" << e.count
+                 << ",\"ms\":" << std::chrono::duration<double, std::milli>(e.time).count()
+                 << ",\"maxms\":" << std::chrono::duration<double, std::milli>(e.max).count() << "}";
+            separator = ",";
+        };
+
+        for (auto& it : stats.actionpackets)
+        {
+            entry(packettype(it.first), it.second);
+        }
+        entry("notifypurge", stats.notifypurge);
+
+        cout << "]}" << endl;
+        return;
+    }
+
+    cout << std::left << std::setw(14) << "type" << std::right << std::setw(10) << "count"
+         << std::setw(12) << "total ms" << std::setw(12) << "mean us" << std::setw(12) << "max ms" << endl;
+
+    auto entry = [](const string& name, const MegaClient::ScStats::Entry& e) {
+        cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(1)
+             << std::setw(10) << e.count
+             << std::setw(12) << std::chrono::duration<double, std::milli>(e.time).count()
+             << std::setw(12) << (e.count ? std::chrono::duration<double, std::micro>(e.time).count() / e.count : 0)
+             << std::setw(12) << std::chrono::duration<double, std::milli>(e.max).count() << endl;
+    };
+
+    for (auto& it : stats.actionpackets)
+    {
+        entry(packettype(it.first), it.second);
+    }
+    entry("notifypurge", stats.notifypurge);
+
+    cout << std::setprecision(1) << replay.responses << " responses replayed (" << replay.skipped << " skipped), "
+         << replay.bytes << " bytes, " << nodes << " nodes" << endl;
+    cout << "procsc: " << totalms << " ms in " << replay.runs << " runs, longest run "
+         << std::chrono::duration<double, std::milli>(replay.longestrun).count() << " ms, longest response "
+         << std::chrono::duration<double, std::milli>(replay.longestresponse).count() << " ms, "
+         << otherms << " ms outside the action packets" << endl;
+}
+
+static void usage(const char* name)
+{
+    cerr << "Usage: " << name << " [-json] <cache folder> <session> <recording>" << endl;
+    cerr << "   (the session is the one printed by megacli's \"session\" command)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SimpleLogger::setLogLevel(getenv("MEGA_DEBUG") ? logDebug : logWarning);
+
+    bool json = false;
+    int i = 1;
+
+    if (i < argc && !strcmp(argv[i], "-json"))
+    {
+        json = true;
+        i++;
+    }
+
+    if (argc - i != 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    string folder = argv[i];
+    if (folder.size() && folder[folder.size() - 1] != '/' && folder[folder.size() - 1] != '\\')
+    {
+        folder.append("/");
+    }
+
+    std::ifstream recording(argv[i + 2], std::ios::binary);
+    if (!recording)
+    {
+        cerr << "Unable to open " << argv[i + 2] << endl;
+        return 1;
+    }
+
+    ScReplayApp app;
+    MegaClient* client = new MegaClient(&app, new WAIT_CLASS, new HTTPIO_CLASS, new FSACCESS_CLASS,
+                                    #ifdef DBACCESS_CLASS
+                                        new DBACCESS_CLASS(&folder),
+                                    #else
+                                        NULL,
+                                    #endif
+                                        NULL, "N9tSBJDC", "screplay");
+
+    // resume the session from its cache only
+    byte sessionraw[64];
+    string session = argv[i + 1];
+    if (session.size() < sizeof sessionraw * 4 / 3)
+    {
+        int size = Base64::atob(session.c_str(), sessionraw, sizeof sessionraw);
+        client->login(sessionraw, size);
+    }
+
+    if (!client->loadstatecache(nullptr))
+    {
+        cerr << "No state cache for this session in " << argv[i] << endl;
+        delete client;
+        return 1;
+    }
+
+    // as fetchnodes() leaves it after loading the cache, without the requests
+    // queued by login(), which would postpone the commits at the end of each response
+    client->reqs.clear();
+    client->statecurrent = false;
+    client->sctable->begin();
+    client->pendingsccommit = false;
+    Base64::btoa((byte*)&client->cachedscsn, sizeof client->cachedscsn, client->scsn);
+
+    MegaClient::ScStats stats;
+    ReplayStats replay;
+    client->scstats = &stats;
+
+    string scsn, response;
+    while (readrecord(recording, scsn, response))
+    {
+        if (scsn != client->scsn)
+        {
+            if (!replay.responses)
+            {
+                // recorded before the cache
+                replay.skipped++;
+                continue;
+            }
+
+            cerr << "Gap in the recording: expected SCSN " << client->scsn << ", found " << scsn << endl;
+            break;
+        }
+
+        std::chrono::nanoseconds responsetime{0};
+
+        client->jsonsc.begin(response.c_str());
+        client->jsonsc.enterobject();
+
+        // procsc() returns false when it yields or stops for syncdown(): resume it
+        // as the next exec() would
+        for (bool done = false; !done; )
+        {
+            client->execscheduler.begin(ExecScheduler::SC);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            done = client->procsc();
+            std::chrono::nanoseconds run = std::chrono::steady_clock::now() - start;
+            client->execscheduler.end(ExecScheduler::SC, client->scyielded);
+
+            replay.runs++;
+            replay.longestrun = std::max(replay.longestrun, run);
+            responsetime += run;
+        }
+
+        client->jsonsc.pos = NULL;
+
+        replay.responses++;
+        replay.bytes += response.size();
+        replay.elapsed += responsetime;
+        replay.longestresponse = std::max(replay.longestresponse, responsetime);
+    }
+
+    client->scstats = nullptr;
+
+    if (!replay.responses)
+    {
+        cerr << "No response in the recording follows SCSN " << client->scsn << endl;
+    }
+
+    report(stats, replay, client->nodes.size(), json);
+
+    delete client;
+    return replay.responses ? 0 : 1;
+}
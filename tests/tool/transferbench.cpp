@@ -0,0 +1,1039 @@
+/**
+ * @file tests/tool/transferbench.cpp
+ * @brief Offline tool to benchmark transfers against a loopback storage server
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// An HTTP server on 127.0.0.1 emulates the storage servers: ranged GETs of
+// the tempurls of a file, either whole or as the 6 parts of a RAID file, and
+// the chunk POSTs of uploads, answered with an upload token once the whole
+// file has arrived. It also answers the "g" and "u" API commands with its own
+// tempurls (MegaClient::APIURL points to it), so that the transfers go through
+// the regular code paths: TransferSlot, RaidBufferManager, and DirectReadSlot
+// for streaming. The file is encrypted with a random key, and the downloads
+// verify its MAC as usual.
+//
+// Each connection can be given a latency per request, a bandwidth limit and a
+// loss rate (requests whose connection drops halfway through the body, from a
+// seeded generator), to measure the throughput and the client CPU cost of the
+// transfers in reproducible conditions. The CPU time of the server threads is
+// not included in the client figures.
+
+#include "mega.h"
+
+#include <atomic>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using namespace mega;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+#ifndef _WIN32
+
+struct BenchParams
+{
+    m_off_t size = 64 << 20;
+    int latency = 0;        // ms per request
+    int bandwidth = 0;      // KB/s per connection, 0 for unlimited
+    double loss = 0;        // % of requests dropped
+    int connections = 0;    // per transfer, 0 for the SDK's default
+    unsigned seed = 1;
+    int timeout = 600;      // s per transfer
+    string folder = ".";
+    bool json = false;
+};
+
+struct BenchResult
+{
+    string name;
+    m_off_t bytes;
+    std::chrono::nanoseconds elapsed;
+    std::chrono::nanoseconds cpu;   // of the client: process minus server threads
+    int requests;
+    int dropped;
+    error e;
+};
+
+static int64_t cputime(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// the encrypted file served by the storage server
+struct ServedFile
+{
+    // handles of the file for the "g" command: one URL, or 6 for RAID
+    static const handle PLAIN = 1;
+    static const handle RAID = 2;
+
+    m_off_t size = 0;
+    string encrypted;
+    string parts[RAIDPARTS];
+
+    byte filekey[FILENODEKEYLENGTH];
+    string attrstring;      // base64 "at" of the "g" command
+
+    void generate(MegaClient* client, m_off_t filesize)
+    {
+        size = filesize;
+
+        // padded to the block size, as EncryptBufferByChunks requires
+        encrypted.assign(size_t((size + SymmCipher::BLOCKSIZE - 1) & -SymmCipher::BLOCKSIZE), '\0');
+        client->rng.genblock((byte*)encrypted.data(), size_t(size));
+
+        byte aeskey[SymmCipher::KEYLENGTH];
+        client->rng.genblock(aeskey, sizeof aeskey);
+        int64_t ctriv;
+        client->rng.genblock((byte*)&ctriv, sizeof ctriv);
+
+        SymmCipher cipher;
+        cipher.setkey(aeskey);
+
+        chunkmac_map macs;
+        string suffix;
+        EncryptBufferByChunks((byte*)encrypted.data(), &cipher, &macs, uint64_t(ctriv)).encrypt(0, size, suffix);
+        encrypted.resize(size_t(size));
+
+        // the node key layout: AES key ^ (CTR IV, meta MAC), CTR IV, meta MAC
+        MemAccess::set<int64_t>(filekey + SymmCipher::KEYLENGTH, ctriv);
+        MemAccess::set<int64_t>(filekey + SymmCipher::KEYLENGTH + sizeof(int64_t), macs.macsmac(&cipher));
+        memcpy(filekey, aeskey, sizeof aeskey);
+        SymmCipher::xorblock(filekey + SymmCipher::KEYLENGTH, filekey);
+
+        string attrs;
+        client->makeattr(&cipher, &attrs, "\"n\":\"transferbench\"");
+        attrstring = Base64::btoa(attrs);
+
+        // RAID: sectors of each line round robin to parts 1 to 5, their XOR to part 0
+        for (unsigned p = 0; p < RAIDPARTS; p++)
+        {
+            parts[p].reserve(size_t(RaidBufferManager::raidPartSize(p, size)));
+        }
+
+        for (m_off_t line = 0; line < size; line += RAIDLINE)
+        {
+            byte parity[RAIDSECTOR] = { 0 };
+
+            for (unsigned p = 1; p < RAIDPARTS; p++)
+            {
+                m_off_t pos = line + (p - 1) * RAIDSECTOR;
+                if (pos < size)
+                {
+                    size_t len = size_t(std::min<m_off_t>(RAIDSECTOR, size - pos));
+                    parts[p].append(encrypted, size_t(pos), len);
+                    for (size_t i = 0; i < len; i++)
+                    {
+                        parity[i] ^= byte(encrypted[size_t(pos) + i]);
+                    }
+                }
+            }
+
+            parts[0].append((const char*)parity, sizeof parity);
+        }
+
+        parts[0].resize(size_t(RaidBufferManager::raidPartSize(0, size)));
+    }
+};
+
+// a minimal HTTP/1.1 server with persistent connections, one thread each
+class StorageServer
+{
+public:
+    StorageServer(const BenchParams& params, const ServedFile& file)
+        : mParams(params), mFile(file), mRng(params.seed)
+    {
+    }
+
+    ~StorageServer()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        mListen = socket(AF_INET, SOCK_STREAM, 0);
+        if (mListen < 0)
+        {
+            return false;
+        }
+
+        int one = 1;
+        setsockopt(mListen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t addrlen = sizeof addr;
+        if (bind(mListen, (struct sockaddr*)&addr, sizeof addr) || listen(mListen, 64)
+                || getsockname(mListen, (struct sockaddr*)&addr, &addrlen))
+        {
+            close(mListen);
+            mListen = -1;
+            return false;
+        }
+
+        mUrl = "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)) + "/";
+        mAcceptThread = std::thread([this]() { acceptloop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if (mListen < 0)
+        {
+            return;
+        }
+
+        shutdown(mListen, SHUT_RDWR);
+        mAcceptThread.join();
+        close(mListen);
+        mListen = -1;
+
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> g(mMutex);
+            for (int fd : mConnections)
+            {
+                shutdown(fd, SHUT_RDWR);
+            }
+            threads.swap(mThreads);
+        }
+
+        for (std::thread& t : threads)
+        {
+            t.join();
+        }
+    }
+
+    const string& url() const
+    {
+        return mUrl;
+    }
+
+    // CPU time spent serving requests
+    std::chrono::nanoseconds cpu() const
+    {
+        return std::chrono::nanoseconds(mCpu.load());
+    }
+
+    int requests() const
+    {
+        return mRequests;
+    }
+
+    int dropped() const
+    {
+        return mDropped;
+    }
+
+private:
+    const BenchParams& mParams;
+    const ServedFile& mFile;
+
+    int mListen = -1;
+    string mUrl;
+    std::thread mAcceptThread;
+
+    std::mutex mMutex;
+    std::vector<std::thread> mThreads;
+    std::set<int> mConnections;
+    std::mt19937 mRng;
+
+    // bytes received per upload, by position to tell retried chunks apart
+    std::map<int, std::pair<m_off_t, std::map<m_off_t, m_off_t>>> mUploads;
+    int mNextUpload = 0;
+
+    std::atomic<int64_t> mCpu{0};
+    std::atomic<int> mRequests{0};
+    std::atomic<int> mDropped{0};
+
+    struct Request
+    {
+        string method;
+        string path;
+        string body;
+        size_t contentlength = 0;
+    };
+
+    // sleeps to hold the connection to the bandwidth limit
+    struct Pacer
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double rate;    // bytes per second
+        double bytes = 0;
+
+        explicit Pacer(int kbps) : rate(kbps * 1024.0) { }
+
+        void account(size_t len)
+        {
+            if (rate > 0)
+            {
+                bytes += len;
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double>(bytes / rate)));
+            }
+        }
+
+        size_t slice() const
+        {
+            return rate > 0 ? 16384 : 262144;
+        }
+    };
+
+    void acceptloop()
+    {
+        for (;;)
+        {
+            int fd = accept(mListen, NULL, NULL);
+            if (fd < 0)
+            {
+                return;
+            }
+
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+            std::lock_guard<std::mutex> g(mMutex);
+            mConnections.insert(fd);
+            mThreads.emplace_back([this, fd]() { serve(fd); });
+        }
+    }
+
+    void serve(int fd)
+    {
+        string buffered;
+        Request request;
+
+        while (readrequest(fd, buffered, request))
+        {
+            int64_t start = cputime(CLOCK_THREAD_CPUTIME_ID);
+            bool keep = process(fd, request, buffered);
+            mCpu += cputime(CLOCK_THREAD_CPUTIME_ID) - start;
+            mRequests++;
+
+            if (!keep)
+            {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> g(mMutex);
+        mConnections.erase(fd);
+        close(fd);
+    }
+
+    static bool fill(int fd, string& buffered)
+    {
+        char buf[65536];
+        ssize_t r = recv(fd, buf, sizeof buf, 0);
+        if (r <= 0)
+        {
+            return false;
+        }
+        buffered.append(buf, size_t(r));
+        return true;
+    }
+
+    // the request line and headers; the body is read by process()
+    static bool readrequest(int fd, string& buffered, Request& request)
+    {
+        size_t end;
+        while ((end = buffered.find("\r\n\r\n")) == string::npos)
+        {
+            if (!fill(fd, buffered))
+            {
+                return false;
+            }
+        }
+
+        string headers = buffered.substr(0, end);
+        buffered.erase(0, end + 4);
+
+        size_t sp1 = headers.find(' ');
+        size_t sp2 = headers.find(' ', sp1 + 1);
+        if (sp1 == string::npos || sp2 == string::npos)
+        {
+            return false;
+        }
+
+        request.method = headers.substr(0, sp1);
+        request.path = headers.substr(sp1 + 1, sp2 - sp1 - 1);
+        request.body.clear();
+        request.contentlength = 0;
+
+        for (size_t pos = headers.find("\r\n"); pos != string::npos; pos = headers.find("\r\n", pos + 2))
+        {
+            static const char name[] = "content-length:";
+            if (headers.size() - pos - 2 >= sizeof name - 1
+                    && !strncasecmp(headers.c_str() + pos + 2, name, sizeof name - 1))
+            {
+                request.contentlength = size_t(atoll(headers.c_str() + pos + 2 + sizeof name - 1));
+            }
+        }
+
+        return true;
+    }
+
+    bool drop()
+    {
+        if (mParams.loss <= 0)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> g(mMutex);
+        return std::uniform_real_distribution<double>(0, 100)(mRng) < mParams.loss;
+    }
+
+    // returns false if the connection is to be closed
+    bool process(int fd, Request& request, string& buffered)
+    {
+        bool dropping = drop();
+        Pacer pacer(mParams.bandwidth);
+
+        // the body, paced in the upload direction
+        size_t limit = dropping ? request.contentlength / 2 : request.contentlength;
+        while (request.body.size() < limit)
+        {
+            if (buffered.empty() && !fill(fd, buffered))
+            {
+                return false;
+            }
+
+            size_t len = std::min(std::min(buffered.size(), limit - request.body.size()), pacer.slice());
+            request.body.append(buffered, 0, len);
+            buffered.erase(0, len);
+            pacer.account(len);
+        }
+
+        if (dropping)
+        {
+            mDropped++;
+            return false;
+        }
+
+        if (mParams.latency)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(mParams.latency));
+        }
+
+        if (request.method == "POST" && !request.path.compare(0, 3, "/cs"))
+        {
+            return respond(fd, "application/json", api(request.body), pacer, false);
+        }
+
+        if (request.method == "POST" && !request.path.compare(0, 4, "/ul/"))
+        {
+            return respond(fd, "application/octet-stream", upload(request), pacer, false);
+        }
+
+        if (request.method == "GET" && !request.path.compare(0, 4, "/dl/"))
+        {
+            // /dl/<x or RAID part>/<first>-<last>
+            const string* data = NULL;
+            size_t slash = request.path.find('/', 4);
+            string part = request.path.substr(4, slash == string::npos ? slash : slash - 4);
+
+            if (part == "x")
+            {
+                data = &mFile.encrypted;
+            }
+            else if (part.size() == 1 && part[0] >= '0' && part[0] < '0' + RAIDPARTS)
+            {
+                data = &mFile.parts[part[0] - '0'];
+            }
+
+            if (data && slash != string::npos)
+            {
+                size_t first = size_t(atoll(request.path.c_str() + slash + 1));
+                size_t dash = request.path.find('-', slash);
+                size_t last = dash == string::npos ? data->size() - 1 : size_t(atoll(request.path.c_str() + dash + 1));
+
+                first = std::min(first, data->size());
+                last = std::min(last + 1, data->size());
+                return respond(fd, "application/octet-stream", data->substr(first, last > first ? last - first : 0), pacer, dropping);
+            }
+        }
+
+        return respond(fd, "text/plain", "", pacer, false, "404 Not Found");
+    }
+
+    bool respond(int fd, const char* type, const string& body, Pacer& pacer, bool dropping, const char* status = "200 OK")
+    {
+        std::ostringstream s;
+        s << "HTTP/1.1 " << status << "\r\nContent-Type: " << type << "\r\nContent-Length: " << body.size()
+          << "\r\nConnection: keep-alive\r\n\r\n";
+        string headers = s.str();
+
+        if (!sendall(fd, headers.data(), headers.size()))
+        {
+            return false;
+        }
+
+        size_t limit = dropping ? body.size() / 2 : body.size();
+        for (size_t pos = 0; pos < limit; )
+        {
+            size_t len = std::min(limit - pos, pacer.slice());
+            if (!sendall(fd, body.data() + pos, len))
+            {
+                return false;
+            }
+            pos += len;
+            pacer.account(len);
+        }
+
+        if (dropping)
+        {
+            mDropped++;
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool sendall(int fd, const char* data, size_t len)
+    {
+        while (len)
+        {
+            ssize_t w = send(fd, data, len, 0);
+            if (w <= 0)
+            {
+                return false;
+            }
+            data += w;
+            len -= size_t(w);
+        }
+        return true;
+    }
+
+    // the commands of a "cs" request, all but "g" and "u" answered with 0
+    string api(const string& body)
+    {
+        JSON json;
+        json.begin(body.c_str());
+
+        if (!json.enterarray())
+        {
+            return std::to_string(API_EARGS);
+        }
+
+        string result = "[";
+        while (json.enterobject())
+        {
+            string command;
+            handle h = UNDEF;
+            m_off_t size = 0;
+
+            for (nameid name; (name = json.getnameid()) != EOO; )
+            {
+                switch (name)
+                {
+                    case 'a':
+                        json.storeobject(&command);
+                        break;
+
+                    case 'n':
+                    case 'p':
+                        h = json.gethandle(MegaClient::NODEHANDLE);
+                        break;
+
+                    case 's':
+                        size = json.getint();
+                        break;
+
+                    default:
+                        json.storeobject();
+                }
+            }
+            json.leaveobject();
+
+            if (result.size() > 1)
+            {
+                result.append(",");
+            }
+
+            if (command == "g" && (h == ServedFile::PLAIN || h == ServedFile::RAID))
+            {
+                result.append("{\"s\":").append(std::to_string(mFile.size))
+                      .append(",\"at\":\"").append(mFile.attrstring).append("\",\"g\":");
+
+                if (h == ServedFile::PLAIN)
+                {
+                    result.append("\"").append(mUrl).append("dl/x\"");
+                }
+                else
+                {
+                    result.append("[");
+                    for (unsigned p = 0; p < RAIDPARTS; p++)
+                    {
+                        result.append(p ? ",\"" : "\"").append(mUrl).append("dl/").append(std::to_string(p)).append("\"");
+                    }
+                    result.append("]");
+                }
+
+                result.append("}");
+            }
+            else if (command == "g")
+            {
+                result.append(std::to_string(API_ENOENT));
+            }
+            else if (command == "u")
+            {
+                std::lock_guard<std::mutex> g(mMutex);
+                int id = mNextUpload++;
+                mUploads[id].first = size;
+                result.append("{\"p\":\"").append(mUrl).append("ul/").append(std::to_string(id)).append("\"}");
+            }
+            else
+            {
+                result.append("0");
+            }
+        }
+
+        return result.append("]");
+    }
+
+    // /ul/<id>/<pos>?c=<crc>: nothing until the last byte, then the token
+    string upload(const Request& request)
+    {
+        int id = atoi(request.path.c_str() + 4);
+        size_t slash = request.path.find('/', 4);
+        if (slash == string::npos)
+        {
+            return std::to_string(API_EARGS);
+        }
+        m_off_t pos = atoll(request.path.c_str() + slash + 1);
+
+        std::lock_guard<std::mutex> g(mMutex);
+        auto it = mUploads.find(id);
+        if (it == mUploads.end())
+        {
+            return std::to_string(API_ENOENT);
+        }
+
+        it->second.second[pos] = m_off_t(request.body.size());
+
+        m_off_t received = 0;
+        for (auto& chunk : it->second.second)
+        {
+            received += chunk.second;
+        }
+
+        if (received < it->second.first)
+        {
+            return string();
+        }
+
+        // a new style token: its last byte is 1
+        string token(NewNode::UPLOADTOKENLEN, '\0');
+        MemAccess::set<int>((byte*)token.data(), id);
+        token[NewNode::UPLOADTOKENLEN - 1] = 1;
+        return token;
+    }
+};
+
+struct TransferBenchApp : public MegaApp
+{
+    m_off_t streamed = 0;
+    bool streamdone = false;
+    error streamerror = API_OK;
+
+    bool pread_data(byte*, m_off_t len, m_off_t, m_off_t, m_off_t, void*) override
+    {
+        streamed += len;
+        return true;
+    }
+
+    dstime pread_failure(error e, int retry, void*, dstime) override
+    {
+        if (retry >= 5)
+        {
+            streamerror = e;
+            streamdone = true;
+            return ~(dstime)0;
+        }
+        return 0;
+    }
+};
+
+// a transfer whose outcome is kept rather than turned into a new node
+struct BenchFile : public File
+{
+    bool done = false;
+    error e = API_OK;
+
+    void completed(Transfer*, LocalNode*) override
+    {
+        done = true;
+    }
+
+    bool failed(error err) override
+    {
+        e = err;
+        done = true;
+        return false;
+    }
+
+    void terminated() override
+    {
+        if (!done)
+        {
+            e = API_EINCOMPLETE;
+            done = true;
+        }
+    }
+};
+
+static bool run(MegaClient* client, const BenchParams& params, const std::function<bool()>& done)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(params.timeout);
+
+    for (;;)
+    {
+        client->exec();
+
+        if (done())
+        {
+            return true;
+        }
+
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+
+        client->wait();
+    }
+}
+
+static BenchResult measure(const char* name, MegaClient* client, StorageServer& server, const BenchParams& params,
+                           const std::function<void()>& start, const std::function<bool()>& done, const std::function<error()>& result)
+{
+    int requests = server.requests();
+    int dropped = server.dropped();
+    std::chrono::nanoseconds servercpu = server.cpu();
+    int64_t cpu = cputime(CLOCK_PROCESS_CPUTIME_ID);
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+
+    start();
+    bool finished = run(client, params, done);
+
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - t;
+    std::chrono::nanoseconds clientcpu = std::chrono::nanoseconds(cputime(CLOCK_PROCESS_CPUTIME_ID) - cpu) - (server.cpu() - servercpu);
+
+    return BenchResult{ name, params.size, elapsed, clientcpu, server.requests() - requests,
+                        server.dropped() - dropped, finished ? result() : API_EAGAIN };
+}
+
+static void report(const BenchParams& params, const vector<BenchResult>& results)
+{
+    if (params.json)
+    {
+        cout << "{\"size\":" << params.size << ",\"latency\":" << params.latency << ",\"bandwidth\":" << params.bandwidth
+             << ",\"loss\":" << params.loss << ",\"connections\":" << params.connections << ",\"results\":[";
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchResult& r = results[i];
+            double seconds = std::chrono::duration<double>(r.elapsed).count();
+            double cpu = std::chrono::duration<double>(r.cpu).count();
+
+            cout << (i ? "," : "") << "{\"name\":\"" << r.name << "\",\"error\":" << r.e << std::fixed << std::setprecision(3)
+                 << ",\"seconds\":" << seconds << ",\"mbps\":" << (seconds > 0 ? r.bytes / seconds / 1e6 : 0)
+                 << ",\"cpuseconds\":" << cpu << ",\"cpupergb\":" << (r.bytes ? cpu * 1e9 / r.bytes : 0)
+                 << ",\"requests\":" << r.requests << ",\"dropped\":" << r.dropped << "}";
+        }
+
+        cout << "]}" << endl;
+        return;
+    }
+
+    cout << "File of " << params.size << " bytes, latency " << params.latency << " ms, bandwidth "
+         << (params.bandwidth ? std::to_string(params.bandwidth) + " KB/s" : string("unlimited"))
+         << " per connection, loss " << params.loss << "%" << endl;
+
+    for (const BenchResult& r : results)
+    {
+        double seconds = std::chrono::duration<double>(r.elapsed).count();
+        double cpu = std::chrono::duration<double>(r.cpu).count();
+
+        cout << std::left << std::setw(16) << r.name << std::right << std::fixed << std::setprecision(3)
+             << std::setw(10) << seconds << " s" << std::setprecision(1)
+             << std::setw(10) << (seconds > 0 ? r.bytes / seconds / 1e6 : 0) << " MB/s" << std::setprecision(3)
+             << std::setw(10) << cpu << " s CPU" << std::setw(10) << (r.bytes ? cpu * 1e9 / r.bytes : 0) << " s/GB"
+             << std::setw(8) << r.requests << " requests";
+
+        if (r.dropped)
+        {
+            cout << " (" << r.dropped << " dropped)";
+        }
+
+        if (r.e)
+        {
+            cout << "  FAILED: ";
+            if (r.e == API_EAGAIN)
+            {
+                cout << "timeout";
+            }
+            else
+            {
+                cout << "error " << r.e;
+            }
+        }
+
+        cout << endl;
+    }
+}
+
+static void usage(const char* name)
+{
+    cerr << "Usage: " << name << " [-s file size in MB] [-latency ms] [-bw KB/s per connection] [-loss %]" << endl;
+    cerr << "       [-c connections] [-seed n] [-timeout s] [-tmp folder] [-json]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    SimpleLogger::setLogLevel(getenv("MEGA_DEBUG") ? logDebug : logWarning);
+
+    BenchParams params;
+    int i = 1;
+
+    for (; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-json"))
+        {
+            params.json = true;
+        }
+        else if (i + 1 >= argc)
+        {
+            break;
+        }
+        else if (!strcmp(argv[i], "-s"))
+        {
+            params.size = m_off_t(atof(argv[++i]) * (1 << 20));
+        }
+        else if (!strcmp(argv[i], "-latency"))
+        {
+            params.latency = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-bw"))
+        {
+            params.bandwidth = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-loss"))
+        {
+            params.loss = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            params.connections = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-seed"))
+        {
+            params.seed = unsigned(atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-timeout"))
+        {
+            params.timeout = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-tmp"))
+        {
+            params.folder = argv[++i];
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i != argc || params.size < 1 || params.latency < 0 || params.bandwidth < 0
+            || params.loss < 0 || params.loss >= 100 || params.connections < 0 || params.timeout < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    string folder = params.folder;
+    if (folder.size() && folder[folder.size() - 1] != '/')
+    {
+        folder.append("/");
+    }
+
+    // dropped connections must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    TransferBenchApp app;
+    ServedFile file;
+    StorageServer server(params, file);
+
+    if (!server.start())
+    {
+        cerr << "Unable to listen on 127.0.0.1" << endl;
+        return 1;
+    }
+
+    MegaClient::APIURL = server.url();
+    MegaClient* client = new MegaClient(&app, new WAIT_CLASS, new HTTPIO_CLASS, new FSACCESS_CLASS, NULL, NULL,
+                                        "N9tSBJDC", "transferbench");
+
+    if (params.connections)
+    {
+        client->setmaxconnections(GET, params.connections);
+        client->setmaxconnections(PUT, params.connections);
+    }
+
+    file.generate(client, params.size);
+
+    string dlname = folder + "transferbench.dl";
+    string ulname = folder + "transferbench.ul";
+    string dllocal, ullocal;
+    client->fsaccess->path2local(&dlname, &dllocal);
+    client->fsaccess->path2local(&ulname, &ullocal);
+
+    // the upload source
+    {
+        auto fa = client->fsaccess->newfileaccess();
+        string data(size_t(params.size), '\0');
+        client->rng.genblock((byte*)data.data(), data.size());
+        if (!fa->fopen(&ullocal, false, true) || !fa->fwrite((const byte*)data.data(), unsigned(data.size()), 0))
+        {
+            cerr << "Unable to write " << ulname << endl;
+            delete client;
+            return 1;
+        }
+    }
+
+    vector<BenchResult> results;
+
+    auto download = [&](const char* name, handle h) {
+        std::unique_ptr<BenchFile> f(new BenchFile);
+        f->h = h;
+        f->hprivate = false;
+        f->hforeign = false;
+        f->size = params.size;
+        f->mtime = m_time();
+        f->name = "transferbench";
+        f->localname = dllocal;
+        memcpy(f->filekey, file.filekey, sizeof f->filekey);
+
+        results.push_back(measure(name, client, server, params, [&]() {
+            DBTableTransactionCommitter committer(client->tctable);
+            client->startxfer(GET, f.get(), committer);
+        }, [&]() { return f->done; }, [&]() { return f->e; }));
+
+        if (f->transfer)
+        {
+            DBTableTransactionCommitter committer(client->tctable);
+            client->stopxfer(f.get(), &committer);
+        }
+        client->fsaccess->unlinklocal(&dllocal);
+    };
+
+    // 1. one tempurl, ranged requests on several connections
+    download("download", ServedFile::PLAIN);
+
+    // 2. the 6 parts of a RAID file
+    download("download raid", ServedFile::RAID);
+
+    // 3. chunk uploads, until the token
+    {
+        std::unique_ptr<BenchFile> f(new BenchFile);
+        f->h = UNDEF;
+        f->name = "transferbench";
+        f->localname = ullocal;
+
+        results.push_back(measure("upload", client, server, params, [&]() {
+            DBTableTransactionCommitter committer(client->tctable);
+            if (!client->startxfer(PUT, f.get(), committer))
+            {
+                f->e = API_EREAD;
+                f->done = true;
+            }
+        }, [&]() { return f->done; }, [&]() { return f->e; }));
+
+        if (f->transfer)
+        {
+            DBTableTransactionCommitter committer(client->tctable);
+            client->stopxfer(f.get(), &committer);
+        }
+    }
+
+    // 4. streaming, through the direct read slots
+    {
+        byte transferkey[SymmCipher::KEYLENGTH];
+        memcpy(transferkey, file.filekey, sizeof transferkey);
+        SymmCipher::xorblock(file.filekey + SymmCipher::KEYLENGTH, transferkey);
+
+        SymmCipher key;
+        key.setkey(transferkey);
+        int64_t ctriv = MemAccess::get<int64_t>((const char*)file.filekey + SymmCipher::KEYLENGTH);
+
+        results.push_back(measure("stream raid", client, server, params, [&]() {
+            client->pread(ServedFile::RAID, &key, ctriv, params.size, 0, NULL);
+        }, [&]() { return app.streamdone || app.streamed >= params.size; }, [&]() { return app.streamerror; }));
+    }
+
+    client->fsaccess->unlinklocal(&ullocal);
+
+    report(params, results);
+
+    delete client;
+    server.stop();
+
+    for (const BenchResult& r : results)
+    {
+        if (r.e)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#else
+
+int main()
+{
+    std::cerr << "tool_transferbench is not supported on Windows" << std::endl;
+    return 1;
+}
+
+#endif
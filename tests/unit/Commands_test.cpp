@@ -292,3 +292,157 @@ TEST(Commands, CommandGetCountryCallingCodes_processResult_errorCodeReceived)
     ASSERT_EQ(nullptr, app.mCountryCallingCodes);
     ASSERT_EQ(jsonLength, std::distance(jsonBegin, json.pos)); // assert json has been parsed all the way
 }
+
+namespace {
+
+class PlainCommand : public Command
+{
+public:
+    PlainCommand(const char* name, bool independent)
+    {
+        cmd(name);
+        orderIndependent = independent;
+    }
+};
+
+size_t countCommands(const string& request, const string& name)
+{
+    size_t count = 0;
+    for (size_t pos = 0; (pos = request.find("\"" + name + "\"", pos)) != string::npos; pos++)
+    {
+        count++;
+    }
+    return count;
+}
+
+} // anonymous
+
+TEST(Commands, RequestDispatcher_pipelinesOrderIndependentCommands)
+{
+    RequestDispatcher reqs;
+    reqs.setmaxpipelined(2);
+
+    reqs.add(new PlainCommand("uga", true));
+    reqs.add(new PlainCommand("p", false));
+    reqs.add(new PlainCommand("uga", true));
+
+    // the reads go out together, next to the ordered batch
+    ASSERT_TRUE(reqs.pipelinedready());
+    string pipelined;
+    bool suppressSID = true;
+    int channel = reqs.pipelinedrequest(&pipelined, suppressSID);
+    ASSERT_EQ(2u, countCommands(pipelined, "uga"));
+    ASSERT_EQ(0u, countCommands(pipelined, "p"));
+    ASSERT_FALSE(reqs.pipelinedready());
+    ASSERT_EQ(1u, reqs.pipelinedinflight());
+
+    ASSERT_TRUE(reqs.cmdspending());
+    string ordered;
+    reqs.serverrequest(&ordered, suppressSID);
+    ASSERT_EQ(1u, countCommands(ordered, "p"));
+    ASSERT_EQ(0u, countCommands(ordered, "uga"));
+    ASSERT_FALSE(reqs.cmdspending());
+
+    // a failed pipelined batch is retried, in order once pipelining is disabled
+    reqs.requeuepipelined(channel);
+    ASSERT_EQ(0u, reqs.pipelinedinflight());
+    ASSERT_TRUE(reqs.pipelinedready());
+
+    reqs.setmaxpipelined(0);
+    ASSERT_FALSE(reqs.pipelinedready());
+    ASSERT_TRUE(reqs.cmdspending());
+
+    reqs.requeuerequest();
+    reqs.serverrequest(&ordered, suppressSID);
+    ASSERT_EQ(1u, countCommands(ordered, "p"));
+    reqs.requeuerequest();
+
+    reqs.add(new PlainCommand("uga", true));
+    ASSERT_FALSE(reqs.pipelinedready());
+
+    reqs.clear();
+    ASSERT_FALSE(reqs.cmdspending());
+}
+
+TEST(Commands, RequestDispatcher_resendsFailedBatchesUnchanged)
+{
+    RequestDispatcher reqs;
+    reqs.add(new PlainCommand("p", false));
+
+    string out;
+    bool suppressSID = true;
+    reqs.serverrequest(&out, suppressSID);
+
+    // the commands added meanwhile don't join the batch resent under the same ID
+    ASSERT_FALSE(reqs.requeuerequest());
+    reqs.add(new PlainCommand("ug", false));
+    reqs.serverrequest(&out, suppressSID);
+    ASSERT_EQ(1u, countCommands(out, "p"));
+    ASSERT_EQ(0u, countCommands(out, "ug"));
+
+    ASSERT_FALSE(reqs.requeuerequest());
+    reqs.serverrequest(&out, suppressSID);
+    ASSERT_EQ(1u, countCommands(out, "p"));
+    ASSERT_EQ(0u, countCommands(out, "ug"));
+
+    reqs.clear();
+}
+
+TEST(Commands, RequestDispatcher_serverRequestReplacesOutputBuffer)
+{
+    RequestDispatcher reqs;
+    PlainCommand* first = new PlainCommand("ug", false);
+    first->arg("k", (const byte*)"\x01\x02\x03", 3);
+    reqs.add(first);
+    reqs.add(new PlainCommand("p", false));
+
+    string out = "left over from a previous batch";
+    bool suppressSID = true;
+    reqs.serverrequest(&out, suppressSID);
+    ASSERT_EQ("[{\"a\":\"ug\",\"k\":\"AQID\"},{\"a\":\"p\"}]", out);
+    ASSERT_FALSE(suppressSID);
+
+    reqs.clear();
+}
+
+TEST(Commands, RequestDispatcher_adaptsBatchSize)
+{
+    RequestDispatcher reqs;
+    for (int i = 0; i < 1000; i++)
+    {
+        reqs.add(new PlainCommand("p", false));
+    }
+
+    string out;
+    bool suppressSID = true;
+    reqs.serverrequest(&out, suppressSID);
+    ASSERT_EQ(1000u, countCommands(out, "p"));
+
+    // a rejected batch is resent in halves, which are new batches
+    reqs.batchrejected();
+    ASSERT_EQ(500u, reqs.getbatchlimit());
+    ASSERT_TRUE(reqs.requeuerequest());
+    reqs.serverrequest(&out, suppressSID);
+    ASSERT_EQ(500u, countCommands(out, "p"));
+
+    // a slow one halves the next batches, but is resent as it was if it fails
+    reqs.batchcompleted(RequestDispatcher::SLOW_BATCH * 2);
+    ASSERT_EQ(250u, reqs.getbatchlimit());
+    ASSERT_FALSE(reqs.requeuerequest());
+    reqs.serverrequest(&out, suppressSID);
+    ASSERT_EQ(500u, countCommands(out, "p"));
+
+    // and fast full ones let it grow back
+    reqs.batchcompleted(std::chrono::milliseconds(100));
+    ASSERT_EQ(500u, reqs.getbatchlimit());
+
+    // never below the minimum
+    for (int i = 0; i < 10; i++)
+    {
+        reqs.batchrejected();
+    }
+    ASSERT_EQ(size_t(RequestDispatcher::MIN_BATCH_COMMANDS), reqs.getbatchlimit());
+
+    reqs.clear();
+    ASSERT_EQ(size_t(RequestDispatcher::MAX_COMMANDS), reqs.getbatchlimit());
+}
@@ -163,6 +163,190 @@ TEST(Crypto, AES_CCM)
     ASSERT_STREQ(result.data(), plainText.data()) << "CCM decryption: plain text doesn't match the expected value";
 }
 
+namespace {
+
+// reference implementation of SymmCipher::ctr_crypt, one block at a time
+void ctrCryptByBlock(SymmCipher& key, byte* data, unsigned len, m_off_t pos, SymmCipher::ctr_iv ctriv, byte* mac, bool encrypt)
+{
+    byte ctr[SymmCipher::BLOCKSIZE], tmp[SymmCipher::BLOCKSIZE];
+
+    MemAccess::set<int64_t>(ctr, ctriv);
+    SymmCipher::setint64(pos / SymmCipher::BLOCKSIZE, ctr + sizeof ctriv);
+
+    memcpy(mac, ctr, sizeof ctriv);
+    memcpy(mac + sizeof ctriv, ctr, sizeof ctriv);
+
+    while ((int)len > 0)
+    {
+        if (encrypt)
+        {
+            SymmCipher::xorblock(data, mac);
+            key.ecb_encrypt(mac);
+            key.ecb_encrypt(ctr, tmp);
+            SymmCipher::xorblock(tmp, data);
+        }
+        else
+        {
+            key.ecb_encrypt(ctr, tmp);
+            SymmCipher::xorblock(tmp, data);
+            SymmCipher::xorblock(data, mac, std::min<int>(len, SymmCipher::BLOCKSIZE));
+            key.ecb_encrypt(mac);
+        }
+
+        len -= SymmCipher::BLOCKSIZE;
+        data += SymmCipher::BLOCKSIZE;
+        SymmCipher::incblock(ctr);
+    }
+}
+
+}
+
+// Test that AES-CTR with chunk MAC matches the block-by-block definition,
+// for partial blocks and for counters carrying over their low bytes
+TEST(Crypto, AES_CTR_MAC)
+{
+    PrnGen rng;
+    byte keyBytes[SymmCipher::KEYLENGTH];
+    rng.genblock(keyBytes, sizeof keyBytes);
+
+    SymmCipher key;
+    key.setkey(keyBytes);
+
+    const unsigned lens[] = { 1, 16, 17, 1000, 4096, 100000 };
+    const m_off_t positions[] = { 0, 16 * 250, 16 * 65530 };
+    const SymmCipher::ctr_iv ctrivs[] = { 0x0123456789abcdefULL, ~0ULL };
+
+    for (unsigned len : lens)
+    {
+        for (m_off_t pos : positions)
+        {
+            for (SymmCipher::ctr_iv ctriv : ctrivs)
+            {
+                unsigned padded = (len + SymmCipher::BLOCKSIZE - 1) & ~(SymmCipher::BLOCKSIZE - 1);
+                string plain(padded, '\0');
+                rng.genblock((byte*)plain.data(), len);
+
+                string expected = plain, actual = plain;
+                byte expectedMac[SymmCipher::BLOCKSIZE], actualMac[SymmCipher::BLOCKSIZE];
+
+                ctrCryptByBlock(key, (byte*)expected.data(), len, pos, ctriv, expectedMac, true);
+                key.ctr_crypt((byte*)actual.data(), len, pos, ctriv, actualMac, true);
+                ASSERT_EQ(0, memcmp(expected.data(), actual.data(), len)) << "len " << len << " pos " << pos;
+                ASSERT_EQ(0, memcmp(expectedMac, actualMac, sizeof actualMac)) << "len " << len << " pos " << pos;
+
+                ctrCryptByBlock(key, (byte*)expected.data(), len, pos, ctriv, expectedMac, false);
+                key.ctr_crypt((byte*)actual.data(), len, pos, ctriv, actualMac, false);
+                ASSERT_EQ(0, memcmp(plain.data(), actual.data(), len)) << "len " << len << " pos " << pos;
+                ASSERT_EQ(0, memcmp(expectedMac, actualMac, sizeof actualMac)) << "len " << len << " pos " << pos;
+            }
+        }
+    }
+}
+
+// Test the CRC32 of file fingerprints: the check value of the standard, and
+// the accelerated implementation against the portable one at any alignment
+TEST(Crypto, HashCRC32)
+{
+    HashCRC32 crc32;
+    byte out[4];
+    crc32.add((const byte*)"123456789", 9);
+    crc32.get(out);
+
+    const byte expected[] = { 0x26, 0x39, 0xf4, 0xcb };
+    ASSERT_EQ(0, memcmp(out, expected, sizeof out));
+
+    PrnGen rng;
+    byte buf[20000];
+    rng.genblock(buf, sizeof buf);
+
+    const size_t lens[] = { 0, 1, 15, 16, 63, 64, 65, 1000, 8192, sizeof buf - 3 };
+    for (size_t len : lens)
+    {
+        for (size_t offset = 0; offset < 3; offset++)
+        {
+            ASSERT_EQ(HashCRC32::updatescalar(0xFFFFFFFF, buf + offset, len), HashCRC32::update(0xFFFFFFFF, buf + offset, len))
+                    << "len " << len << " offset " << offset;
+        }
+    }
+}
+
+// Test RSA decryption with the precomputed CRT exponents, and without them
+TEST(Crypto, RSA_decrypt)
+{
+    PrnGen rng;
+
+    AsymmCipher privkey, pubkey;
+    CryptoPP::Integer pubk[AsymmCipher::PUBKEY];
+    privkey.genkeypair(rng, privkey.key, pubk, 2048);
+    pubkey.key[AsymmCipher::PUB_PQ] = pubk[AsymmCipher::PUB_PQ];
+    pubkey.key[AsymmCipher::PUB_E] = pubk[AsymmCipher::PUB_E];
+
+    byte plain[SymmCipher::KEYLENGTH], decrypted[SymmCipher::KEYLENGTH];
+    byte cipher[AsymmCipher::MAXKEYLENGTH];
+    rng.genblock(plain, sizeof plain);
+
+    int cipherlen = pubkey.encrypt(rng, plain, sizeof plain, cipher, sizeof cipher);
+    ASSERT_GT(cipherlen, 0);
+
+    ASSERT_TRUE(privkey.decrypt(cipher, cipherlen, decrypted, sizeof decrypted));
+    ASSERT_EQ(0, memcmp(plain, decrypted, sizeof plain));
+
+    // a private key loaded from its serialized form
+    string privks;
+    AsymmCipher::serializeintarray(privkey.key, AsymmCipher::PRIVKEY, &privks);
+    AsymmCipher loaded;
+    ASSERT_TRUE(loaded.setkey(AsymmCipher::PRIVKEY, (const byte*)privks.data(), int(privks.size())));
+
+    memset(decrypted, 0, sizeof decrypted);
+    ASSERT_TRUE(loaded.decrypt(cipher, cipherlen, decrypted, sizeof decrypted));
+    ASSERT_EQ(0, memcmp(plain, decrypted, sizeof plain));
+}
+
+// Test that an upload encrypted in parts gives the same data, chunk MACs and
+// CRC as when it is encrypted in one go
+TEST(Crypto, EncryptChunksJob_parts)
+{
+    PrnGen rng;
+
+    EncryptChunksJob whole, split;
+    rng.genblock(whole.key, sizeof whole.key);
+    whole.ctriv = 0x0123456789abcdefULL;
+    whole.pos = 3 * 131072;
+    whole.npos = whole.pos + 5000000 + 7;
+    whole.data.resize(size_t((whole.npos - whole.pos + SymmCipher::BLOCKSIZE - 1) & -SymmCipher::BLOCKSIZE));
+    rng.genblock((byte*)whole.data.data(), size_t(whole.npos - whole.pos));
+
+    memcpy(split.key, whole.key, sizeof split.key);
+    split.ctriv = whole.ctriv;
+    split.pos = whole.pos;
+    split.npos = whole.npos;
+    split.data = whole.data;
+
+    whole.split(1);
+    ASSERT_EQ(1u, whole.parts.size());
+    whole.run();
+
+    split.split(4);
+    ASSERT_GT(split.parts.size(), 1u);
+    for (size_t i = split.parts.size(); i--; )
+    {
+        split.run(unsigned(i));
+    }
+
+    chunkmac_map wholemacs, splitmacs;
+    string wholesuffix, splitsuffix;
+    whole.result(&wholemacs, &wholesuffix);
+    split.result(&splitmacs, &splitsuffix);
+
+    ASSERT_EQ(whole.data, split.data);
+    ASSERT_EQ(wholesuffix, splitsuffix);
+    ASSERT_EQ(wholemacs.size(), splitmacs.size());
+    for (chunkmac_map::iterator it = wholemacs.begin(); it != wholemacs.end(); it++)
+    {
+        ASSERT_EQ(0, memcmp(it->second.mac, splitmacs[it->first].mac, sizeof it->second.mac)) << "chunk " << it->first;
+    }
+}
+
 #ifdef ENABLE_CHAT
 // Test functions of Ed25519:
 // - Binary & Hex fingerprints of public key
@@ -0,0 +1,172 @@
+/**
+ * @file tests/unit/Logging_test.cpp
+ * @brief Mega SDK unit tests for the asynchronous logging mode
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <mega/logging.h>
+
+#ifndef ENABLE_LOG_PERFORMANCE
+
+namespace
+{
+
+enum TestEnum { TEST_ENUM_VALUE = 7 };
+
+struct Captured
+{
+    int level;
+    std::string source;
+    std::string message;
+};
+
+class CapturingLogger : public mega::Logger
+{
+public:
+    std::mutex mutex;
+    std::vector<Captured> messages;
+
+    void log(const char*, int loglevel, const char* source, const char* message) override
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        messages.push_back(Captured{loglevel, source ? source : "", message});
+    }
+};
+
+class AsyncLogging : public ::testing::Test
+{
+protected:
+    CapturingLogger logger;
+    mega::Logger* previousLogger = nullptr;
+    mega::LogLevel previousLevel = mega::logInfo;
+
+    void SetUp() override
+    {
+        previousLogger = mega::SimpleLogger::logger;
+        previousLevel = mega::SimpleLogger::logCurrentLevel;
+        mega::SimpleLogger::setOutputClass(&logger);
+        mega::SimpleLogger::setLogLevel(mega::logMax);
+    }
+
+    void TearDown() override
+    {
+        mega::SimpleLogger::setAsync(false);
+        mega::SimpleLogger::setOutputClass(previousLogger);
+        mega::SimpleLogger::setLogLevel(previousLevel);
+    }
+
+    void logMixed(int line)
+    {
+        const char* text = "text";
+        std::string str = "string";
+        const void* pointer = &line;
+        const char* null = nullptr;
+        mega::SimpleLogger(mega::logInfo, "file.cpp", line)
+            << text << ' ' << str << ' ' << -12 << ' ' << 34u << ' ' << int64_t(-5000000000)
+            << ' ' << uint64_t(18446744073709551615ull) << ' ' << 1.5 << ' ' << 0.1f << ' ' << true
+            << ' ' << pointer << ' ' << null << ' ' << TEST_ENUM_VALUE << ' ' << short(-3);
+    }
+};
+
+} // namespace
+
+TEST_F(AsyncLogging, FormatsLikeSynchronousMode)
+{
+    logMixed(10);
+
+    mega::SimpleLogger::setAsync(true);
+    logMixed(10);
+    mega::SimpleLogger::flush();
+
+    ASSERT_EQ(logger.messages.size(), 2u);
+    EXPECT_EQ(logger.messages[0].level, mega::logInfo);
+    EXPECT_EQ(logger.messages[1].level, mega::logInfo);
+    EXPECT_EQ(logger.messages[0].source, "file.cpp:10");
+    EXPECT_EQ(logger.messages[1].source, "file.cpp:10");
+    EXPECT_EQ(logger.messages[0].message, logger.messages[1].message);
+}
+
+TEST_F(AsyncLogging, KeepsTheOrderOfEachThread)
+{
+    mega::SimpleLogger::setAsync(true);
+    uint64_t dropped = mega::SimpleLogger::asyncDropped();
+
+    const int threads = 4;
+    const int messages = 500;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([t]() {
+            for (int i = 0; i < messages; i++)
+            {
+                LOG_debug << t << " " << i;
+            }
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    mega::SimpleLogger::setAsync(false);
+
+    std::vector<int> next(threads, 0);
+    size_t count = 0;
+    for (auto& m : logger.messages)
+    {
+        int t, i;
+        if (sscanf(m.message.c_str(), "%d %d", &t, &i) == 2 && t >= 0 && t < threads)
+        {
+            EXPECT_EQ(i, next[t]);
+            next[t] = i + 1;
+            count++;
+        }
+    }
+    EXPECT_EQ(count + mega::SimpleLogger::asyncDropped() - dropped, size_t(threads * messages));
+}
+
+TEST_F(AsyncLogging, DropsMessagesLargerThanTheBuffer)
+{
+    mega::SimpleLogger::setAsync(true, 4096);
+    uint64_t dropped = mega::SimpleLogger::asyncDropped();
+
+    // the buffer size applies to the threads that log afterwards
+    std::thread([]() {
+        LOG_info << "before";
+        LOG_info << std::string(10000, 'x');
+        LOG_info << "after";
+    }).join();
+
+    mega::SimpleLogger::flush();
+
+    EXPECT_EQ(mega::SimpleLogger::asyncDropped(), dropped + 1);
+    ASSERT_EQ(logger.messages.size(), 3u);
+    EXPECT_EQ(logger.messages[0].message, "before");
+    EXPECT_EQ(logger.messages[1].message, "after");
+    EXPECT_EQ(logger.messages[2].level, mega::logWarning);
+    EXPECT_NE(logger.messages[2].message.find("1 log messages dropped"), std::string::npos);
+}
+
+#endif
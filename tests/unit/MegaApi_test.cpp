@@ -22,6 +22,7 @@
 // Note: The tests in this module are meant to be pure unit tests: Fast tests without I/O.
 
 #include <atomic>
+#include <map>
 #include <memory>
 #include <thread>
 
@@ -222,3 +223,614 @@ TEST(MegaApi, getMimeType)
 
     ASSERT_EQ(600, successCount);
 }
+
+TEST(MegaApi, MegaNodeList_bulkGettersMatchTheNodes)
+{
+    std::string nodekey, attrstring, fileattrstring;
+    const char* names[] = {"a.txt", "", "\xc3\xa9t\xc3\xa9", "folder"};
+
+    std::unique_ptr<::mega::MegaNodeList> list{::mega::MegaNodeList::createInstance()};
+    for (int i = 0; i < 4; ++i)
+    {
+        int type = i == 3 ? ::mega::MegaNode::TYPE_FOLDER : ::mega::MegaNode::TYPE_FILE;
+        ::mega::MegaNodePrivate node{names[i], type, 100 * i, 0, 1000 + i, ::mega::MegaHandle(10 + i),
+                                     &nodekey, &attrstring, &fileattrstring, nullptr, nullptr, ::mega::INVALID_HANDLE};
+        list->addNode(&node);
+    }
+
+    ::mega::MegaHandle handles[5];
+    int64_t sizes[4], mtimes[4];
+    int types[4];
+    ASSERT_EQ(4, list->getHandles(handles, 5));
+    ASSERT_EQ(4, list->getSizes(sizes, 4));
+    ASSERT_EQ(2, list->getModificationTimes(mtimes, 2));
+    ASSERT_EQ(4, list->getTypes(types, 4));
+
+    int offsets[5];
+    int length = list->getNames(nullptr, 0, offsets, 5);
+    std::vector<char> blob(length);
+    ASSERT_EQ(length, list->getNames(blob.data(), length, nullptr, 0));
+    ASSERT_EQ(length, offsets[4]);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ::mega::MegaNode* node = list->get(i);
+        ASSERT_EQ(node->getHandle(), handles[i]);
+        ASSERT_EQ(node->getSize(), sizes[i]);
+        ASSERT_EQ(node->getType(), types[i]);
+        if (i < 2)
+        {
+            ASSERT_EQ(node->getModificationTime(), mtimes[i]);
+        }
+        ASSERT_EQ(std::string(node->getName()), std::string(blob.data() + offsets[i], offsets[i + 1] - offsets[i]));
+    }
+}
+
+namespace {
+
+// in-memory state cache
+class MemoryDbTable : public DbTable
+{
+public:
+    std::map<uint32_t, std::string> records;
+
+    MemoryDbTable(PrnGen& rng)
+        : DbTable(rng, false)
+    {
+    }
+
+    void rewind() override { mIt = records.begin(); }
+
+    bool next(uint32_t* id, std::string* data) override
+    {
+        if (mIt == records.end())
+        {
+            return false;
+        }
+        *id = mIt->first;
+        *data = mIt->second;
+        ++mIt;
+        return true;
+    }
+
+    bool get(uint32_t id, std::string* data) override
+    {
+        auto it = records.find(id);
+        if (it == records.end())
+        {
+            return false;
+        }
+        *data = it->second;
+        return true;
+    }
+
+    bool put(uint32_t id, char* data, unsigned len) override
+    {
+        records[id].assign(data, len);
+        return true;
+    }
+
+    bool del(uint32_t id) override { records.erase(id); return true; }
+    void truncate() override { records.clear(); }
+    void begin() override { }
+    void commit() override { }
+    void abort() override { }
+    void remove() override { records.clear(); }
+
+private:
+    std::map<uint32_t, std::string>::iterator mIt;
+};
+
+// MegaApiImpl of a client that is not logged in, giving access to its MegaClient
+class OfflineApiImpl : public MegaApiImpl
+{
+public:
+    OfflineApiImpl()
+        : MegaApiImpl(nullptr, "appkey", (const char*)nullptr, "unit tests")
+    {
+    }
+
+    using MegaApiImpl::client;
+    using MegaApiImpl::sdkMutex;
+    using MegaApiImpl::nodes_updated;
+    using MegaApiImpl::lazyNodeEntries;
+    using MegaApiImpl::pread_data;
+};
+
+// files written to the state cache of the client and loaded back lazily
+class LazyNodes : public ::testing::Test
+{
+protected:
+    std::unique_ptr<OfflineApiImpl> api;
+    MegaClient* client = nullptr;
+
+    void SetUp() override
+    {
+        api.reset(new OfflineApiImpl);
+        client = api->client;
+
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+        byte key[SymmCipher::KEYLENGTH] = { 1, 2, 3, 4 };
+        client->key.setkey(key);
+        client->sctable = new MemoryDbTable(client->rng);
+    }
+
+    // a full file with a name, a fingerprint and a custom attribute (sdkMutex locked)
+    Node* fullFile(handle h, const char* name, m_time_t mtime, m_off_t size)
+    {
+        node_vector dp;
+        Node* n = new Node(client, &dp, h, UNDEF, FILENODE, size, 1, "", 1000);
+
+        byte nodekey[FILENODEKEYLENGTH];
+        for (size_t i = 0; i < sizeof nodekey; i++)
+        {
+            nodekey[i] = byte(h + i);
+        }
+        n->setkey(nodekey);
+
+        FileFingerprint ffp;
+        ffp.size = size;
+        ffp.mtime = mtime;
+        ffp.crc[0] = int32_t(h);
+        ffp.isvalid = true;
+        ffp.serializefingerprint(&n->attrs.map['c']);
+        n->attrs.map['n'] = name;
+        n->attrs.map[AttrMap::string2nameid("_foo")] = "bar";
+        n->setfingerprint();
+        return n;
+    }
+
+    // replace a node with its skeleton loaded from its record in the state cache (sdkMutex locked)
+    Node* reloadLazily(Node* n, uint32_t dbid)
+    {
+        EXPECT_TRUE(client->sctable->put(dbid, n, &client->key));
+        handle h = n->nodehandle;
+        delete n;
+        client->nodes.erase(h);
+
+        std::string data;
+        EXPECT_TRUE(client->sctable->get(dbid, &data, &client->key));
+
+        node_vector dp;
+        client->lazynodeloading = true;
+        Node* lazy = Node::unserialize(client, &data, &dp);
+        client->lazynodeloading = false;
+
+        EXPECT_NE(nullptr, lazy);
+        if (lazy)
+        {
+            lazy->dbid = dbid;
+            EXPECT_TRUE(lazy->lazy);
+        }
+        return lazy;
+    }
+};
+
+// downloads queued in the transfer list of the client, with given priorities
+class TransferPriorities : public ::testing::Test
+{
+protected:
+    std::unique_ptr<OfflineApiImpl> api;
+    MegaClient* client = nullptr;
+    MegaApp app;    // no callbacks to the MegaApiImpl for transfers it doesn't know
+    std::vector<Transfer*> queued;
+
+    void SetUp() override
+    {
+        api.reset(new OfflineApiImpl);
+        client = api->client;
+
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+        client->app = &app;
+    }
+
+    void TearDown() override
+    {
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+        for (size_t i = 0; i < queued.size(); i++)
+        {
+            delete queued[i];
+        }
+        client->app = api.get();
+    }
+
+    // (sdkMutex locked)
+    void queue(const std::vector<uint64_t>& priorities)
+    {
+        DBTableTransactionCommitter committer(nullptr);
+        for (size_t i = 0; i < priorities.size(); i++)
+        {
+            Transfer* t = new Transfer(client, GET);
+            t->priority = priorities[i];
+            client->transferlist.addtransfer(t, committer);
+            queued.push_back(t);
+        }
+        client->transferlist.currentpriority = std::max(client->transferlist.currentpriority, priorities.back());
+    }
+
+    // the queue holds these of the queued transfers, in this order, with increasing priorities (sdkMutex locked)
+    void expectOrder(const std::vector<size_t>& order)
+    {
+        transfer_list& list = client->transferlist.transfers[GET];
+        ASSERT_EQ(order.size(), list.size());
+
+        uint64_t previous = 0;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            EXPECT_EQ(queued[order[i]], list[i]) << "position " << i;
+            EXPECT_LT(previous, list[i]->priority) << "position " << i;
+            previous = list[i]->priority;
+        }
+        EXPECT_LE(previous, client->transferlist.currentpriority);
+    }
+};
+
+} // anonymous
+
+TEST_F(LazyNodes, MegaNodeFromALazyNodeHasItsAttributes)
+{
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+
+    Node* n = fullFile(0x123456, "photo.jpg", 1500000000, 4096);
+    std::unique_ptr<MegaNode> expected{MegaNodePrivate::fromNode(n)};
+
+    Node* lazy = reloadLazily(n, 16 + MegaClient::CACHEDNODE);
+    ASSERT_NE(nullptr, lazy);
+
+    std::unique_ptr<MegaNode> node{MegaNodePrivate::fromNode(lazy)};
+    ASSERT_FALSE(lazy->lazy);
+    ASSERT_STREQ("photo.jpg", node->getName());
+    ASSERT_STREQ("bar", node->getCustomAttr("foo"));
+    ASSERT_NE(nullptr, node->getFingerprint());
+    ASSERT_STREQ(expected->getFingerprint(), node->getFingerprint());
+    ASSERT_EQ(1500000000, node->getModificationTime());
+    ASSERT_EQ(4096, node->getSize());
+}
+
+TEST_F(LazyNodes, MegaNodeListColumnsOfLazyNodes)
+{
+    std::unique_ptr<MegaNodeList> list;
+    {
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+
+        Node* lazy[3];
+        for (int i = 0; i < 3; i++)
+        {
+            std::string name = "file" + std::to_string(i);
+            Node* n = fullFile(handle(0x1000 + i), name.c_str(), 1500000000 + i, 100 * (i + 1));
+            lazy[i] = reloadLazily(n, uint32_t(16 * (i + 1) + MegaClient::CACHEDNODE));
+            ASSERT_NE(nullptr, lazy[i]);
+        }
+        list.reset(new MegaNodeListLazy(api.get(), lazy, 3));
+    }
+
+    int64_t sizes[3], mtimes[3];
+    int types[3];
+    ASSERT_EQ(3, list->getSizes(sizes, 3));
+    ASSERT_EQ(3, list->getModificationTimes(mtimes, 3));
+    ASSERT_EQ(3, list->getTypes(types, 3));
+
+    int offsets[4];
+    int length = list->getNames(nullptr, 0, offsets, 4);
+    std::vector<char> names(length);
+    ASSERT_EQ(length, list->getNames(names.data(), length, nullptr, 0));
+
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(100 * (i + 1), sizes[i]);
+        ASSERT_EQ(1500000000 + i, mtimes[i]);
+        ASSERT_EQ(MegaNode::TYPE_FILE, types[i]);
+        ASSERT_EQ("file" + std::to_string(i), std::string(names.data() + offsets[i], offsets[i + 1] - offsets[i]));
+    }
+}
+
+TEST_F(LazyNodes, UpdatedNodesAreMaterializedInTheirListsOnly)
+{
+    std::unique_ptr<MegaNodeList> list;
+    {
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+
+        Node* files[3];
+        for (int i = 0; i < 3; i++)
+        {
+            std::string name = "file" + std::to_string(i);
+            files[i] = fullFile(handle(0x1000 + i), name.c_str(), 1500000000 + i, 100 * (i + 1));
+        }
+        list.reset(new MegaNodeListLazy(api.get(), files, 3));
+        ASSERT_EQ(3u, api->lazyNodeEntries.size());
+
+        // the update of file1 only creates its entry, which outlives the Node
+        files[1]->changed.removed = true;
+        api->nodes_updated(&files[1], 1);
+        ASSERT_EQ(2u, api->lazyNodeEntries.size());
+        ASSERT_EQ(0u, api->lazyNodeEntries.count(handle(0x1001)));
+
+        delete files[1];
+        client->nodes.erase(handle(0x1001));
+    }
+
+    ASSERT_NE(nullptr, list->get(1));
+    ASSERT_STREQ("file1", list->get(1)->getName());
+    ASSERT_NE(nullptr, list->get(0));
+    ASSERT_STREQ("file0", list->get(0)->getName());
+
+    list.reset();
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+    ASSERT_TRUE(api->lazyNodeEntries.empty());
+}
+
+TEST_F(LazyNodes, FullReloadKeepsListsLazy)
+{
+    std::unique_ptr<MegaNodeList> list;
+    {
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+
+        Node* files[2];
+        files[0] = fullFile(0x3000, "before0", 1500000000, 10);
+        files[1] = fullFile(0x3001, "before1", 1500000001, 20);
+        list.reset(new MegaNodeListLazy(api.get(), files, 2));
+
+        // no entry is read by the reload; the renamed node is read as it is afterwards
+        api->nodes_updated(nullptr, 2);
+        ASSERT_EQ(2u, api->lazyNodeEntries.size());
+        files[1]->attrs.map['n'] = "after1";
+    }
+
+    ASSERT_NE(nullptr, list->get(1));
+    ASSERT_STREQ("after1", list->get(1)->getName());
+
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+    ASSERT_EQ(1u, api->lazyNodeEntries.count(handle(0x3000)));
+}
+
+TEST_F(LazyNodes, SnapshotReadsLazyNodesOnFirstAccess)
+{
+    std::unique_ptr<MegaNodeSnapshot> snapshot;
+    Node* lazy[2];
+    {
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+
+        Node* n = fullFile(0x2000, "loaded.txt", 1500000000, 10);
+        lazy[0] = reloadLazily(fullFile(0x2001, "lazy0.txt", 1500000001, 20), 16 + MegaClient::CACHEDNODE);
+        lazy[1] = reloadLazily(fullFile(0x2002, "lazy1.txt", 1500000002, 30), 32 + MegaClient::CACHEDNODE);
+        ASSERT_NE(nullptr, lazy[0]);
+        ASSERT_NE(nullptr, lazy[1]);
+
+        node_vector nodes{ n, lazy[0], lazy[1] };
+        snapshot.reset(new MegaNodeSnapshotPrivate(api.get(), 1, "scsn", nodes));
+        ASSERT_TRUE(lazy[0]->lazy);
+        ASSERT_TRUE(lazy[1]->lazy);
+        ASSERT_EQ(2u, api->lazyNodeEntries.size());
+    }
+
+    ASSERT_EQ(3, snapshot->size());
+    ASSERT_EQ(20, snapshot->getSize(1));
+    ASSERT_TRUE(lazy[0]->lazy);
+
+    ASSERT_STREQ("lazy0.txt", snapshot->getName(1));
+    ASSERT_EQ(1500000001, snapshot->getModificationTime(1));
+    ASSERT_NE(nullptr, snapshot->getFingerprint(1));
+    ASSERT_FALSE(lazy[0]->lazy);
+    ASSERT_TRUE(lazy[1]->lazy);
+
+    // the buffer has the strings of every entry
+    std::unique_ptr<MegaNodeSnapshot> copy(snapshot->copy());
+    const char* buffer = copy->getBuffer();
+    const MegaNodeSnapshotPrivate::Record* records = reinterpret_cast<const MegaNodeSnapshotPrivate::Record*>(buffer);
+    ASSERT_GT(copy->getBufferSize(), 3 * sizeof(MegaNodeSnapshotPrivate::Record));
+    ASSERT_STREQ("loaded.txt", buffer + records[0].name);
+    ASSERT_STREQ("lazy0.txt", buffer + records[1].name);
+    ASSERT_STREQ("lazy1.txt", buffer + records[2].name);
+    ASSERT_EQ(1500000002, records[2].mtime);
+    ASSERT_STREQ(copy->getFingerprint(2), buffer + records[2].fingerprint);
+
+    snapshot.reset();
+    copy.reset();
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+    ASSERT_TRUE(api->lazyNodeEntries.empty());
+}
+
+TEST_F(TransferPriorities, MoveToTheHeadWithoutPrioritiesLeft)
+{
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+    queue({ 1, 2, 3 });
+
+    DBTableTransactionCommitter committer(nullptr);
+    client->transferlist.movetofirst(queued[2], committer);
+    expectOrder({ 2, 0, 1 });
+
+    Transfer* t = new Transfer(client, GET);
+    queued.push_back(t);
+    client->transferlist.addtransfer(t, committer, true);
+    expectOrder({ 3, 2, 0, 1 });
+}
+
+TEST_F(TransferPriorities, MoveToTheTailWithoutPrioritiesLeft)
+{
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+    queue({ UINT64_MAX - 2, UINT64_MAX - 1, UINT64_MAX });
+
+    DBTableTransactionCommitter committer(nullptr);
+    client->transferlist.movetolast(queued[0], committer);
+    expectOrder({ 1, 2, 0 });
+
+    client->transferlist.currentpriority = UINT64_MAX;
+    Transfer* t = new Transfer(client, GET);
+    queued.push_back(t);
+    client->transferlist.addtransfer(t, committer);
+    expectOrder({ 1, 2, 0, 3 });
+}
+
+TEST_F(TransferPriorities, MoveBetweenAdjacentPriorities)
+{
+    std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+    uint64_t start = TransferList::PRIORITY_START;
+    queue({ start, start + 1, start + 2, start + 3 });
+
+    DBTableTransactionCommitter committer(nullptr);
+    client->transferlist.movetransfer(queued[3], 1u, committer);
+    expectOrder({ 0, 3, 1, 2 });
+
+    client->transferlist.movetransfer(queued[0], 3u, committer);
+    expectOrder({ 3, 1, 0, 2 });
+}
+
+#ifdef USE_ZLIB
+namespace {
+
+// text that shrinks, but not to nothing
+std::string compressibleContent(size_t size)
+{
+    std::string content;
+    for (unsigned i = 0; content.size() < size; i++)
+    {
+        content += "line " + std::to_string(i * 7919 % 100003) + "\n";
+    }
+    content.resize(size);
+    return content;
+}
+
+// the stream of an upload compressed in frames of frameSize bytes
+std::string deflateFrames(const std::string& content, size_t frameSize)
+{
+    ZlibDeflater deflater;
+    std::string stream;
+    std::string piece;
+    for (size_t pos = 0; pos < content.size(); pos += frameSize)
+    {
+        size_t len = std::min(frameSize, content.size() - pos);
+        EXPECT_TRUE(deflater.deflate((const byte*)content.data() + pos, len, pos + len == content.size(), &piece));
+        stream += piece;
+    }
+    return stream;
+}
+
+// the content streamed to the listener of a transfer
+class StreamingListener : public MegaTransferListener
+{
+public:
+    std::string data;
+    bool finished = false;
+    int error = API_OK;
+
+    bool onTransferData(MegaApi*, MegaTransfer*, char* buffer, size_t size) override
+    {
+        data.append(buffer, size);
+        return true;
+    }
+
+    void onTransferFinish(MegaApi*, MegaTransfer*, MegaError* e) override
+    {
+        finished = true;
+        error = e->getErrorCode();
+    }
+};
+
+// streaming of a node uploaded compressed, delivered to pread_data in pieces
+class CompressedStreaming : public ::testing::Test
+{
+protected:
+    std::unique_ptr<OfflineApiImpl> api;
+    StreamingListener listener;
+    std::string content = compressibleContent(300000);
+    std::string stream = deflateFrames(content, 65536);
+
+    void SetUp() override
+    {
+        api.reset(new OfflineApiImpl);
+    }
+
+    // the compressed bytes read before the transfer asked to stop
+    size_t read(m_off_t start, m_off_t end, size_t pieceSize)
+    {
+        MegaTransferPrivate* transfer = new MegaTransferPrivate(MegaTransfer::TYPE_LOCAL_HTTP_DOWNLOAD, &listener);
+        transfer->setTotalBytes(m_off_t(stream.size()));
+        transfer->setInflater(new ZlibInflater(start, end + 1));
+
+        std::lock_guard<std::recursive_timed_mutex> g(api->sdkMutex);
+        size_t pos = 0;
+        while (pos < stream.size())
+        {
+            size_t len = std::min(pieceSize, stream.size() - pos);
+            bool more = api->pread_data((byte*)stream.data() + pos, m_off_t(len), m_off_t(pos), 0, 0, transfer);
+            pos += len;
+            if (!more)
+            {
+                break;
+            }
+        }
+        return pos;
+    }
+};
+
+} // anonymous
+
+TEST(CompressedTransfers, FramesInflateBackToTheContent)
+{
+    std::string content = compressibleContent(3 * 65536 + 100);
+    std::string stream = deflateFrames(content, 65536);
+    ASSERT_LT(stream.size() * 10, content.size() * 9);
+
+    ZlibInflater inflater;
+    std::string inflated;
+    std::string piece;
+    for (size_t pos = 0; pos < stream.size(); pos += 1000)
+    {
+        ASSERT_TRUE(inflater.inflate((const byte*)stream.data() + pos, std::min<size_t>(1000, stream.size() - pos), &piece));
+        inflated += piece;
+    }
+    ASSERT_EQ(content, inflated);
+    ASSERT_FALSE(inflater.done());
+}
+
+TEST(CompressedTransfers, InflaterKeepsTheRangeAndStopsAtItsEnd)
+{
+    std::string content = compressibleContent(300000);
+    std::string stream = deflateFrames(content, 65536);
+
+    ZlibInflater inflater(100000, 150000);
+    std::string inflated;
+    std::string piece;
+    size_t pos = 0;
+    while (!inflater.done() && pos < stream.size())
+    {
+        size_t len = std::min<size_t>(777, stream.size() - pos);
+        ASSERT_TRUE(inflater.inflate((const byte*)stream.data() + pos, len, &piece));
+        inflated += piece;
+        pos += len;
+    }
+    ASSERT_TRUE(inflater.done());
+    ASSERT_LT(pos, stream.size());
+    ASSERT_EQ(content.substr(100000, 50000), inflated);
+}
+
+TEST_F(CompressedStreaming, OffsetReadDeliversTheRangeOfTheContent)
+{
+    size_t consumed = read(70000, 129999, 1024);
+    ASSERT_TRUE(listener.finished);
+    ASSERT_EQ(API_OK, listener.error);
+    ASSERT_EQ(content.substr(70000, 60000), listener.data);
+
+    // the rest of the stream isn't read
+    ASSERT_LT(consumed, stream.size());
+}
+
+TEST_F(CompressedStreaming, OffsetReadUpToTheEndOfTheContent)
+{
+    m_off_t start = m_off_t(content.size()) - 10;
+    size_t consumed = read(start, m_off_t(content.size()) - 1, 4096);
+    ASSERT_TRUE(listener.finished);
+    ASSERT_EQ(API_OK, listener.error);
+    ASSERT_EQ(content.substr(size_t(start)), listener.data);
+    ASSERT_EQ(stream.size(), consumed);
+}
+
+TEST_F(CompressedStreaming, TruncatedStreamFails)
+{
+    stream.resize(stream.size() / 2);
+    read(0, m_off_t(content.size()) - 1, 4096);
+    ASSERT_TRUE(listener.finished);
+    ASSERT_EQ(API_EREAD, listener.error);
+    ASSERT_EQ(content.substr(0, listener.data.size()), listener.data);
+}
+#endif
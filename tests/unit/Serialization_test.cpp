@@ -200,3 +200,76 @@ TEST(Serialization, CacheableReaderWriter)
     ASSERT_EQ(mp2.is_VFR, true);
     ASSERT_EQ(mp2.no_audio, false);
 }
+
+TEST(Serialization, chunkmac_map_delta)
+{
+    // a transfer's cached chunk MACs are its record's plus the delta records
+    // appended later, unserialized on top of them in order
+    chunkmac_map cached;
+    cached[0].offset = 100;
+    cached[0].finished = false;
+    cached[131072].finished = true;
+
+    chunkmac_map delta;
+    delta[0].offset = 131072;
+    delta[0].finished = true;
+    delta[393216].offset = 10;
+
+    string record, deltarecord;
+    cached.serialize(record);
+    delta.serialize(deltarecord);
+
+    chunkmac_map loaded;
+    const char* ptr = record.data();
+    ASSERT_TRUE(loaded.unserialize(ptr, record.data() + record.size()));
+    ptr = deltarecord.data();
+    ASSERT_TRUE(loaded.unserialize(ptr, deltarecord.data() + deltarecord.size()));
+
+    ASSERT_EQ(3u, loaded.size());
+    ASSERT_TRUE(loaded[0].finished);
+    ASSERT_EQ(131072u, loaded[0].offset);
+    ASSERT_TRUE(loaded[131072].finished);
+    ASSERT_EQ(10u, loaded[393216].offset);
+}
+
+TEST(Serialization, AttrMap)
+{
+    // kept sorted by name whatever the order of insertion, as the serialization expects
+    AttrMap attrs;
+    attrs.map['n'] = "name";
+    attrs.map[MAKENAMEID2('c', '0')] = "custom";
+    attrs.map['c'] = "fingerprint";
+    ASSERT_TRUE(attrs.map.insert(std::make_pair(nameid('a'), string("first"))).second);
+    ASSERT_FALSE(attrs.map.insert(std::make_pair(nameid('n'), string("other"))).second);
+
+    ASSERT_EQ(4u, attrs.map.size());
+    nameid previous = 0;
+    for (auto& it : attrs.map)
+    {
+        ASSERT_LT(previous, it.first);
+        previous = it.first;
+    }
+
+    ASSERT_EQ(1u, attrs.map.count('c'));
+    ASSERT_EQ(0u, attrs.map.count('d'));
+    ASSERT_EQ(attrs.map.end(), attrs.map.find('d'));
+    ASSERT_EQ("name", attrs.map.find('n')->second);
+
+    string record;
+    attrs.serialize(&record);
+
+    AttrMap loaded;
+    ASSERT_EQ(record.data() + record.size(), loaded.unserialize(record.data(), record.data() + record.size()));
+    ASSERT_TRUE(loaded.map == attrs.map);
+
+    string json;
+    loaded.getjson(&json);
+    ASSERT_EQ("\"a\":\"first\",\"c\":\"fingerprint\",\"n\":\"name\",\"c0\":\"custom\"", json);
+
+    ASSERT_EQ(1u, loaded.map.erase('c'));
+    ASSERT_EQ(0u, loaded.map.erase('c'));
+    loaded.map.erase(loaded.map.find('a'));
+    ASSERT_EQ(2u, loaded.map.size());
+    ASSERT_EQ("name", loaded.map['n']);
+    ASSERT_EQ("custom", loaded.map[MAKENAMEID2('c', '0')]);
+}
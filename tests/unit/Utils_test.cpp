@@ -0,0 +1,915 @@
+/**
+ * @file tests/unit/Utils_test.cpp
+ * @brief Mega SDK unit tests for utility containers and parsers
+ *
+ * (c) 2020 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Note: The tests in this module are meant to be pure unit tests: Fast tests without I/O.
+
+#include <map>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <mega.h>
+#include <mega/mega_utf8proc.h>
+#include <mega/backofftimer.h>
+#include <mega/db.h>
+#include <mega/filefingerprint.h>
+#include <mega/http.h>
+#include <mega/json.h>
+#include <mega/types.h>
+#include <mega/utils.h>
+#include <mega/base64.h>
+
+namespace
+{
+
+mega::Node* fakeNode(mega::handle h)
+{
+    // node_map never dereferences its values
+    return reinterpret_cast<mega::Node*>(static_cast<uintptr_t>(h | 1));
+}
+
+// in-memory DbTable
+class MemoryDbTable : public mega::DbTable
+{
+public:
+    std::map<uint32_t, std::string> records;
+    int commits = 0;
+
+    MemoryDbTable(mega::PrnGen& rng)
+        : DbTable(rng, false)
+    {
+    }
+
+    void rewind() override { mIt = records.begin(); }
+
+    bool next(uint32_t* id, std::string* data) override
+    {
+        if (mIt == records.end())
+        {
+            return false;
+        }
+        *id = mIt->first;
+        *data = mIt->second;
+        ++mIt;
+        return true;
+    }
+
+    bool get(uint32_t id, std::string* data) override
+    {
+        auto it = records.find(id);
+        if (it == records.end())
+        {
+            return false;
+        }
+        *data = it->second;
+        return true;
+    }
+
+    bool put(uint32_t id, char* data, unsigned len) override
+    {
+        records[id].assign(data, len);
+        return true;
+    }
+
+    bool del(uint32_t id) override { records.erase(id); return true; }
+    void truncate() override { records.clear(); }
+    void begin() override { }
+    void commit() override { commits++; }
+    void abort() override { }
+    void remove() override { records.clear(); }
+
+private:
+    std::map<uint32_t, std::string>::iterator mIt;
+};
+
+} // anonymous
+
+TEST(Utils, node_map_insertFindErase)
+{
+    mega::node_map nodes;
+    ASSERT_TRUE(nodes.empty());
+    ASSERT_TRUE(nodes.find(42) == nodes.end());
+    ASSERT_TRUE(nodes.find(mega::UNDEF) == nodes.end());
+
+    nodes[42] = fakeNode(42);
+    ASSERT_EQ(1u, nodes.size());
+    ASSERT_TRUE(nodes.find(42) != nodes.end());
+    ASSERT_EQ(fakeNode(42), nodes.find(42)->second);
+
+    ASSERT_EQ(1u, nodes.erase(42));
+    ASSERT_EQ(0u, nodes.erase(42));
+    ASSERT_TRUE(nodes.find(42) == nodes.end());
+    ASSERT_TRUE(nodes.begin() == nodes.end());
+}
+
+TEST(Utils, node_map_matchesStdMap)
+{
+    mega::node_map nodes;
+    std::map<mega::handle, mega::Node*> reference;
+
+    // few distinct handles, so collisions, erasures and re-insertions are frequent
+    std::mt19937_64 rng(1234);
+    for (int i = 0; i < 100000; i++)
+    {
+        mega::handle h = rng() % 5000;
+        if (rng() % 3)
+        {
+            nodes[h] = fakeNode(h);
+            reference[h] = fakeNode(h);
+        }
+        else
+        {
+            ASSERT_EQ(reference.erase(h), nodes.erase(h));
+        }
+    }
+
+    ASSERT_EQ(reference.size(), nodes.size());
+
+    for (const auto& p : reference)
+    {
+        auto it = nodes.find(p.first);
+        ASSERT_TRUE(it != nodes.end());
+        ASSERT_EQ(p.second, it->second);
+    }
+
+    size_t visited = 0;
+    for (mega::node_map::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+    {
+        ASSERT_EQ(1u, reference.count(it->first));
+        visited++;
+    }
+    ASSERT_EQ(reference.size(), visited);
+
+    nodes.clear();
+    ASSERT_TRUE(nodes.empty());
+    ASSERT_TRUE(nodes.begin() == nodes.end());
+}
+
+TEST(Utils, localnode_map_matchesStdMap)
+{
+    // localnode_map never dereferences its values
+    auto fakeLocalNode = [](size_t i) { return reinterpret_cast<mega::LocalNode*>(static_cast<uintptr_t>(i * 2 + 1)); };
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 3000; i++)
+    {
+        names.push_back("name" + std::to_string(i * 7919 % 3000));
+    }
+
+    mega::localnode_map children;
+    std::map<std::string, mega::LocalNode*> reference;
+
+    std::mt19937 rng(1234);
+    for (int i = 0; i < 100000; i++)
+    {
+        size_t k = rng() % names.size();
+        if (rng() % 3)
+        {
+            children[&names[k]] = fakeLocalNode(k);
+            reference[names[k]] = fakeLocalNode(k);
+        }
+        else
+        {
+            // looked up by value, not by pointer
+            std::string name = names[k];
+            ASSERT_EQ(reference.erase(name), children.erase(&name));
+        }
+    }
+
+    ASSERT_EQ(reference.size(), children.size());
+
+    for (const auto& p : reference)
+    {
+        auto it = children.find(&p.first);
+        ASSERT_TRUE(it != children.end());
+        ASSERT_EQ(p.second, it->second);
+    }
+
+    // erasing the current entry doesn't disturb the iteration
+    size_t visited = 0;
+    for (mega::localnode_map::iterator it = children.begin(); it != children.end(); )
+    {
+        ASSERT_EQ(1u, reference.count(*it->first));
+        children.erase(it++->first);
+        visited++;
+    }
+    ASSERT_EQ(reference.size(), visited);
+    ASSERT_TRUE(children.empty());
+    ASSERT_TRUE(children.begin() == children.end());
+
+    children[&names[0]] = fakeLocalNode(0);
+    ASSERT_EQ(1u, children.size());
+    ASSERT_EQ(fakeLocalNode(0), children.find(&names[0])->second);
+
+    children.clear();
+    ASSERT_TRUE(children.empty());
+    ASSERT_TRUE(children.find(&names[0]) == children.end());
+}
+
+TEST(Utils, localnode_index_keysByValue)
+{
+    auto fakeLocalNode = [](size_t i) { return reinterpret_cast<mega::LocalNode*>(static_cast<uintptr_t>(i * 2 + 1)); };
+
+    std::string name = "PROGRA~1", other = "Program Files";
+    mega::localnode_index index;
+    index[{ fakeLocalNode(1), &other, false }] = fakeLocalNode(2);
+    index[{ fakeLocalNode(1), &name, true }] = fakeLocalNode(2);
+    index[{ fakeLocalNode(1), &name, false }] = fakeLocalNode(3);
+    index[{ fakeLocalNode(4), &name, false }] = fakeLocalNode(5);
+    ASSERT_EQ(4u, index.size());
+
+    // looked up by value, not by pointer; long and short names don't collide
+    std::string t = "PROGRA~1";
+    ASSERT_EQ(fakeLocalNode(3), index.find({ fakeLocalNode(1), &t, false })->second);
+    ASSERT_EQ(fakeLocalNode(2), index.find({ fakeLocalNode(1), &t, true })->second);
+    ASSERT_EQ(fakeLocalNode(5), index.find({ fakeLocalNode(4), &t, false })->second);
+    ASSERT_TRUE(index.find({ fakeLocalNode(4), &t, true }) == index.end());
+
+    t = "Program Files";
+    ASSERT_EQ(1u, index.erase({ fakeLocalNode(1), &t, false }));
+    ASSERT_TRUE(index.find({ fakeLocalNode(1), &other, false }) == index.end());
+}
+
+TEST(JSON, objectend_partialData)
+{
+    const std::string data = "{\"h\":\"a}b\",\"a\":\"x\\\"}\",\"k\":[1,{\"x\":2}]},{\"h\"";
+    const char* begin = data.c_str();
+    const char* end = begin + data.size();
+
+    const char* objectEnd = mega::JSON::objectend(begin, end);
+    ASSERT_TRUE(objectEnd != nullptr);
+    ASSERT_EQ(',', *objectEnd);
+
+    // incomplete objects, including a cut inside a string or an escape sequence
+    for (const char* cut = begin; cut < objectEnd; ++cut)
+    {
+        ASSERT_EQ(nullptr, mega::JSON::objectend(begin, cut));
+    }
+    ASSERT_EQ(nullptr, mega::JSON::objectend(objectEnd + 1, end));
+}
+
+TEST(JSON, valueend_partialData)
+{
+    const std::string data = "[{\"a\":1},-9,\"x\\\",]\",[2,3]]";
+    const char* begin = data.c_str() + 1;
+    const char* end = data.c_str() + data.size();
+
+    const char* objectEnd = mega::JSON::valueend(begin, end);
+    ASSERT_TRUE(objectEnd != nullptr);
+    ASSERT_EQ(',', *objectEnd);
+
+    const char* numberEnd = mega::JSON::valueend(objectEnd + 1, end);
+    ASSERT_TRUE(numberEnd != nullptr);
+    ASSERT_EQ(std::string(",\"x"), std::string(numberEnd, 3));
+
+    const char* stringEnd = mega::JSON::valueend(numberEnd + 1, end);
+    ASSERT_TRUE(stringEnd != nullptr);
+    ASSERT_EQ(std::string(",[2"), std::string(stringEnd, 3));
+
+    const char* arrayEnd = mega::JSON::valueend(stringEnd + 1, end);
+    ASSERT_TRUE(arrayEnd != nullptr);
+    ASSERT_EQ(end - 1, arrayEnd);
+
+    // a scalar is incomplete until its separator has arrived
+    for (const char* cut = objectEnd + 1; cut <= numberEnd; ++cut)
+    {
+        ASSERT_EQ(nullptr, mega::JSON::valueend(objectEnd + 1, cut));
+    }
+    for (const char* cut = numberEnd + 1; cut <= stringEnd; ++cut)
+    {
+        ASSERT_EQ(nullptr, mega::JSON::valueend(numberEnd + 1, cut));
+    }
+}
+
+TEST(JSON, storeobject_stringsAtAllAlignments)
+{
+    // the string scanner reads aligned blocks, so move every quote, escape
+    // and terminator across block boundaries
+    for (size_t padding = 0; padding < 40; ++padding)
+    {
+        const std::string value = std::string(padding, 'x') + "a\\\\\\\"b\\\\";
+        const std::string data = "{\"n\":\"" + value + "\",\"k\":[\"" + std::string(padding, ']') + "\"]},7";
+
+        mega::JSON json;
+        json.begin(data.c_str());
+        std::string object;
+        ASSERT_TRUE(json.storeobject(&object));
+        ASSERT_EQ(data.substr(0, data.size() - 2), object);
+        ASSERT_EQ(',', *json.pos);
+
+        json.begin(data.c_str());
+        ASSERT_TRUE(json.enterobject());
+        ASSERT_EQ('n', json.getnameid());
+        std::string name;
+        ASSERT_TRUE(json.storeobject(&name));
+        ASSERT_EQ(value, name);
+
+        // unterminated strings are rejected, wherever they end
+        const std::string cut = "\"" + std::string(padding, 'x') + "\\\"";
+        json.begin(cut.c_str());
+        ASSERT_FALSE(json.storeobject());
+        const std::string cutEscape = "\"" + std::string(padding, 'x') + "\\";
+        json.begin(cutEscape.c_str());
+        ASSERT_FALSE(json.storeobject());
+    }
+}
+
+TEST(JSON, unescape)
+{
+    struct { const char* in; const char* out; } cases[] = {
+        { "", "" },
+        { "plain", "plain" },
+        { "a\\nb\\rc\\bd\\fe\\tf", "a\nb\rc\bd\fe\tf" },
+        { "\\\\n", "\\n" },
+        { "\\\"quoted\\\"", "\"quoted\"" },
+        { "\\u0041\\u00e9x", "A\xe9x" },
+        { "\\/", "/" },
+        { "end\\", "end\\" },
+        { "\\u00", "u00" },
+    };
+
+    for (const auto& c : cases)
+    {
+        std::string s = c.in;
+        mega::JSON::unescape(&s);
+        ASSERT_EQ(c.out, s) << c.in;
+    }
+}
+
+TEST(AsyncDbTable, writesInOrderAndReadsPendingRecords)
+{
+    mega::PrnGen rng;
+    MemoryDbTable* memory = new MemoryDbTable(rng);
+    mega::AsyncDbTable table(rng, memory, nullptr);
+
+    std::string a = "first", b = "second";
+    table.begin();
+    ASSERT_TRUE(table.put(16, (char*)a.data(), unsigned(a.size())));
+    ASSERT_TRUE(table.put(16, (char*)b.data(), unsigned(b.size())));
+    ASSERT_TRUE(table.del(32));
+
+    mega::dbrecord_vector batch;
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        mega::DbRecord r;
+        r.id = 48 + 16 * i;
+        r.data = std::to_string(i);
+        batch.push_back(std::move(r));
+    }
+    ASSERT_TRUE(table.putmany(batch));
+    table.commit();
+
+    // the newest queued version of each record is visible right away
+    std::string data;
+    ASSERT_TRUE(table.get(16, &data));
+    ASSERT_EQ(b, data);
+    ASSERT_FALSE(table.get(32, &data));
+    ASSERT_TRUE(table.get(48 + 16 * 99, &data));
+    ASSERT_EQ("99", data);
+
+    table.flush();
+    ASSERT_TRUE(table.committed());
+    ASSERT_FALSE(table.writefailed());
+    ASSERT_EQ(1, memory->commits);
+    ASSERT_EQ(101u, memory->records.size());
+    ASSERT_EQ(b, memory->records[16]);
+
+    // a truncation hides everything written before it
+    table.truncate();
+    ASSERT_FALSE(table.get(16, &data));
+    ASSERT_TRUE(memory->records.empty());
+}
+
+TEST(AsyncDbTable, deletesBatches)
+{
+    mega::PrnGen rng;
+    MemoryDbTable* memory = new MemoryDbTable(rng);
+    mega::AsyncDbTable table(rng, memory, nullptr);
+
+    mega::dbrecord_vector batch;
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        mega::DbRecord r;
+        r.id = 16 + 16 * i;
+        r.data = std::to_string(i);
+        batch.push_back(std::move(r));
+
+        if (i % 2)
+        {
+            ids.push_back(16 + 16 * i);
+        }
+    }
+
+    table.begin();
+    ASSERT_TRUE(table.putmany(batch));
+    ASSERT_TRUE(table.delmany(ids));
+    table.commit();
+
+    // the deletions are visible before they are written
+    std::string data;
+    ASSERT_TRUE(table.get(16, &data));
+    ASSERT_FALSE(table.get(32, &data));
+
+    table.flush();
+    ASSERT_FALSE(table.writefailed());
+    ASSERT_EQ(50u, memory->records.size());
+    ASSERT_EQ(0u, memory->records.count(32));
+    ASSERT_EQ("98", memory->records[16 + 16 * 98]);
+}
+
+TEST(Utils, transientArena)
+{
+    mega::TransientArena arena;
+
+    char* a = arena.copy("abc", 3);
+    ASSERT_STREQ("abc", a);
+
+    double* d = static_cast<double*>(arena.allocate(sizeof(double), alignof(double)));
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(d) % alignof(double));
+
+    // a request larger than a block gets one of its own
+    void* big = arena.allocate(3 * mega::TransientArena::BLOCKSIZE);
+    ASSERT_NE(nullptr, big);
+
+    {
+        mega::TransientArena::Scope scope(arena);
+        arena.copy("scoped", 6);
+    }
+    // the scope's allocation is handed out again
+    char* b = arena.copy("xyz", 3);
+    ASSERT_STREQ("xyz", b);
+
+    mega::transient_vector<int> v((mega::ArenaAllocator<int>(arena)));
+    for (int i = 0; i < 10000; i++)
+    {
+        v.push_back(i);
+    }
+    ASSERT_EQ(9999, v.back());
+
+    mega::TransientArena::Stats totals;
+    arena.reset(&totals);
+    ASSERT_GE(totals.allocations, 5u);
+    ASSERT_GE(totals.blocks, 2u);
+    ASSERT_GE(totals.peak, 3 * mega::TransientArena::BLOCKSIZE);
+
+    mega::TransientArena::Stats next;
+    arena.copy("again", 5);
+    arena.reset(&next);
+    ASSERT_EQ(1u, next.allocations);
+
+    // values copied out of JSON match the string overload
+    mega::JSON json;
+    json.begin("[\"firstname\",12,{\"a\":1}]");
+    ASSERT_TRUE(json.enterarray());
+    ASSERT_STREQ("firstname", json.storeobject(arena));
+    ASSERT_STREQ("12", json.storeobject(arena));
+    ASSERT_STREQ("{\"a\":1}", json.storeobject(arena));
+    ASSERT_EQ(nullptr, json.storeobject(arena));
+}
+
+TEST(Utils, memoryUsage)
+{
+    // short strings are stored inline
+    std::string shortString = "abc";
+    ASSERT_EQ(0u, mega::MemoryUsage::of(shortString));
+
+    std::string longString(1000, 'x');
+    ASSERT_GE(mega::MemoryUsage::of(longString), 1001u);
+
+    std::vector<int> v;
+    v.reserve(100);
+    ASSERT_EQ(v.capacity() * sizeof(int), mega::MemoryUsage::vector(v));
+
+    std::map<int, int> m = { { 1, 1 }, { 2, 2 } };
+    ASSERT_EQ(2 * (mega::MemoryUsage::TREENODE + sizeof(std::pair<const int, int>)), mega::MemoryUsage::tree(m));
+
+    mega::node_map nodes;
+    ASSERT_EQ(0u, nodes.memoryusage());
+    nodes[1] = fakeNode(1);
+    ASSERT_GE(nodes.memoryusage(), sizeof(mega::node_map::value_type));
+}
+
+TEST(Utils, latencySamplerPercentiles)
+{
+    unsigned interval = mega::CodeCounter::LatencySampler::interval;
+    mega::CodeCounter::LatencySampler::interval = 3;
+
+    mega::CodeCounter::LatencySampler sampler;
+    int sampled = 0;
+    for (int i = 0; i < 30; i++)
+    {
+        sampled += sampler.sample();
+    }
+    ASSERT_EQ(10, sampled);
+
+    for (int us = 1; us <= 1000; us++)
+    {
+        sampler.add(std::chrono::microseconds(us));
+    }
+    ASSERT_NEAR(500.0, double(sampler.percentile(0.5)), 500 * 0.125);
+    ASSERT_NEAR(990.0, double(sampler.percentile(0.99)), 990 * 0.125);
+    ASSERT_EQ(1000u, sampler.percentile(1));
+
+    std::ostringstream json;
+    sampler.tojson(json);
+    ASSERT_EQ(0u, json.str().find("{\"samples\":1000,"));
+
+    sampler.reset();
+    ASSERT_EQ(0u, sampler.percentile(0.5));
+
+    mega::CodeCounter::LatencySampler::interval = 0;
+    ASSERT_FALSE(sampler.sample());
+    mega::CodeCounter::LatencySampler::interval = interval;
+}
+
+TEST(Utils, streamFingerprintMatchesFileFingerprint)
+{
+    struct MemoryStream : public mega::InputStreamAccess
+    {
+        const std::string& data;
+        size_t pos = 0;
+
+        MemoryStream(const std::string& cdata) : data(cdata) { }
+
+        m_off_t size() override { return m_off_t(data.size()); }
+
+        bool read(mega::byte* buf, unsigned len) override
+        {
+            if (pos + len > data.size())
+            {
+                return false;
+            }
+            if (buf)
+            {
+                memcpy(buf, data.data() + pos, len);
+            }
+            pos += len;
+            return true;
+        }
+    };
+
+    std::mt19937 gen(7);
+    for (size_t size : { 0, 5, 16, 17, 1000, 8192, 8193, 8256, 100000, 3 << 20 })
+    {
+        std::string data(size, '\0');
+        for (auto& c : data)
+        {
+            c = char(gen());
+        }
+
+        MemoryStream is(data);
+        mega::FileFingerprint expected;
+        expected.genfingerprint(&is, 1234);
+
+        // added in chunks of any size, as an upload reads them
+        mega::StreamFingerprint sf(static_cast<m_off_t>(size));
+        mega::FileFingerprint fp;
+        size_t pos = 0;
+        while (pos < size)
+        {
+            size_t len = std::min(size - pos, size_t(gen() % 20000 + 1));
+            ASSERT_FALSE(sf.get(&fp, 1234));
+            sf.add(reinterpret_cast<const mega::byte*>(data.data()) + pos, len, m_off_t(pos));
+            pos += len;
+        }
+
+        ASSERT_TRUE(sf.get(&fp, 1234)) << size;
+        ASSERT_EQ(expected.size, fp.size);
+        ASSERT_EQ(expected.mtime, fp.mtime);
+        ASSERT_EQ(0, memcmp(expected.crc, fp.crc, sizeof fp.crc)) << size;
+    }
+}
+
+TEST(Utils, base64MatchesScalarReference)
+{
+    std::mt19937 rng(5);
+
+    for (int size = 0; size < 200; size++)
+    {
+        std::string data(size, '\0');
+        for (auto& c : data)
+        {
+            c = char(rng());
+        }
+
+        char expected[300];
+        char encoded[300];
+        int n = mega::Base64::btoaScalar((const mega::byte*)data.data(), size, expected);
+        ASSERT_EQ(n, mega::Base64::btoa((const mega::byte*)data.data(), size, encoded)) << size;
+        ASSERT_STREQ(expected, encoded) << size;
+
+        std::string decoded(size + 3, '\0');
+        decoded.resize(mega::Base64::atob(encoded, size_t(n), (mega::byte*)&decoded[0], int(decoded.size())));
+        ASSERT_EQ(data, decoded) << size;
+        ASSERT_EQ(data, mega::Base64::atob(std::string(encoded))) << size;
+
+        // '+' and '/' are accepted, and decoding stops at the first invalid character
+        // or when the output is full, as without a length
+        std::string standard(encoded);
+        for (auto& c : standard)
+        {
+            c = c == '-' ? '+' : c == '_' ? '/' : c;
+        }
+        ASSERT_EQ(data, mega::Base64::atob(standard)) << size;
+
+        if (n > 1)
+        {
+            std::string corrupt(encoded);
+            corrupt[rng() % n] = '.';
+
+            mega::byte reference[200];
+            mega::byte output[200];
+            int limit = int(rng() % (size + 1));
+            int r = mega::Base64::atob(corrupt.c_str(), reference, limit);
+            ASSERT_EQ(r, mega::Base64::atob(corrupt.data(), corrupt.size(), output, limit)) << size;
+            ASSERT_EQ(0, memcmp(reference, output, size_t(r))) << size;
+        }
+    }
+}
+
+TEST(Utils, base64Handles)
+{
+    mega::handle h = 0x0000123456789abcULL;
+    mega::Base64Str<6> encoded(h);
+
+    mega::handle decoded;
+    ASSERT_TRUE(mega::Base64::atohandle(encoded, &decoded, 6));
+    ASSERT_EQ(h, decoded);
+
+    ASSERT_FALSE(mega::Base64::atohandle("AAAA", &decoded, 6));
+    ASSERT_FALSE(mega::Base64::atohandle(encoded, &decoded, 8));
+}
+
+TEST(Utils, speedControllerMatchesSlidingWindow)
+{
+    const int interval = mega::SpeedController::SPEED_MEAN_INTERVAL_DS;
+    mega::dstime savedds = mega::Waiter::ds;
+
+    // the bytes of each decisecond within the last interval
+    std::map<mega::dstime, m_off_t> reference;
+    mega::SpeedController controller;
+
+    std::mt19937 rng(7);
+    mega::Waiter::ds = 1000;
+    for (int i = 0; i < 20000; i++)
+    {
+        switch (rng() % 8)
+        {
+            case 0: mega::Waiter::ds += rng() % (2 * interval); break;
+            case 1: case 2: mega::Waiter::ds += 1; break;
+            default: break;
+        }
+
+        int64_t bytes = (rng() % 4) ? int64_t(rng() % 100000) : 0;
+        m_off_t speed = controller.calculateSpeed(bytes);
+
+        reference.erase(reference.begin(), reference.lower_bound(mega::Waiter::ds - interval + 1));
+        if (bytes > 0)
+        {
+            reference[mega::Waiter::ds] += bytes;
+        }
+
+        m_off_t total = 0;
+        for (auto& it : reference)
+        {
+            total += it.second;
+        }
+        ASSERT_EQ(speed, total * 10 / interval) << "at step " << i;
+    }
+
+    mega::Waiter::ds = savedds;
+}
+
+namespace
+{
+
+using mega::dstime;     // for NEVER
+
+bool isDue(const mega::TimerWheel& wheel, const mega::BackoffTimer* timer)
+{
+    for (const mega::BackoffTimer* t = wheel.firstdue(); t; t = wheel.nextdue(t))
+    {
+        if (t == timer)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // anonymous
+
+TEST(TimerWheel, levelBoundaries)
+{
+    mega::dstime savedds = mega::Waiter::ds;
+    mega::Waiter::ds = 1000;
+
+    mega::PrnGen rng;
+    mega::TimerWheel wheel;
+
+    // the last and first delays of each level, and one beyond the last level
+    const mega::dstime span = mega::dstime(1) << (mega::TimerWheel::SLOTBITS * mega::TimerWheel::LEVELS);
+    std::vector<mega::dstime> delays;
+    for (int level = 1; level < mega::TimerWheel::LEVELS; level++)
+    {
+        mega::dstime boundary = mega::dstime(1) << (mega::TimerWheel::SLOTBITS * level);
+        delays.push_back(boundary - 1);
+        delays.push_back(boundary);
+    }
+    delays.push_back(span - 1);
+    delays.push_back(span + 5);
+
+    std::vector<std::unique_ptr<mega::BackoffTimer>> timers;
+    for (size_t i = 0; i < delays.size(); i++)
+    {
+        timers.emplace_back(new mega::BackoffTimer(rng));
+        timers.back()->schedule(&wheel, nullptr);
+        timers.back()->backoff(delays[i]);
+    }
+    ASSERT_EQ(delays.size(), wheel.size());
+
+    for (size_t i = 0; i < delays.size(); i++)
+    {
+        wheel.advance(1000 + delays[i] - 1);
+        ASSERT_FALSE(isDue(wheel, timers[i].get())) << "delay " << delays[i];
+
+        wheel.advance(1000 + delays[i]);
+        ASSERT_TRUE(isDue(wheel, timers[i].get())) << "delay " << delays[i];
+
+        for (size_t j = i + 1; j < delays.size(); j++)
+        {
+            ASSERT_FALSE(isDue(wheel, timers[j].get())) << "delay " << delays[j] << " at " << delays[i];
+        }
+    }
+    ASSERT_EQ(delays.size(), wheel.size());
+
+    timers.clear();
+    ASSERT_EQ(0u, wheel.size());
+    mega::Waiter::ds = savedds;
+}
+
+TEST(TimerWheel, cascadesDownTheLevels)
+{
+    mega::dstime savedds = mega::Waiter::ds;
+    mega::Waiter::ds = 12345;
+
+    mega::PrnGen rng;
+    mega::TimerWheel wheel;
+    mega::BackoffTimer timer(rng);
+    timer.schedule(&wheel, nullptr);
+
+    // a few slots into the third level, not aligned with any slot boundary
+    const mega::dstime delay = 3 * (mega::dstime(1) << (2 * mega::TimerWheel::SLOTBITS)) + 77;
+    timer.backoff(delay);
+    const mega::dstime deadline = 12345 + delay;
+
+    // every event before the deadline moves the timer one level down at most, without making it due
+    int events = 0;
+    mega::dstime next;
+    while ((next = wheel.nextevent()) < deadline)
+    {
+        ASSERT_GT(next, mega::dstime(12345));
+        wheel.advance(next);
+        ASSERT_FALSE(isDue(wheel, &timer)) << "at " << next;
+        ASSERT_LE(++events, mega::TimerWheel::LEVELS);
+    }
+
+    ASSERT_EQ(deadline, next);
+    ASSERT_GT(events, 0);
+    wheel.advance(deadline);
+    ASSERT_TRUE(isDue(wheel, &timer));
+    ASSERT_EQ(NEVER, wheel.nextevent());
+
+    mega::Waiter::ds = savedds;
+}
+
+TEST(TimerWheel, removesArmedTimers)
+{
+    mega::dstime savedds = mega::Waiter::ds;
+    mega::Waiter::ds = 500;
+
+    mega::PrnGen rng;
+    mega::TimerWheel wheel;
+    mega::BackoffTimer first(rng), second(rng), third(rng);
+    first.schedule(&wheel, &first);
+    second.schedule(&wheel, &second);
+    third.schedule(&wheel, &third);
+    first.backoff(10);
+    second.backoff(10);
+    third.backoff(1000);
+    ASSERT_EQ(3u, wheel.size());
+
+    wheel.advance(510);
+    ASSERT_TRUE(isDue(wheel, &first));
+    ASSERT_TRUE(isDue(wheel, &second));
+
+    // reset while due: it leaves the due list, the other stays
+    first.reset();
+    ASSERT_FALSE(isDue(wheel, &first));
+    ASSERT_TRUE(isDue(wheel, &second));
+    ASSERT_EQ(2u, wheel.size());
+
+    // reset while pending in a slot: the slot is released
+    third.reset();
+    ASSERT_EQ(1u, wheel.size());
+    ASSERT_EQ(NEVER, wheel.nextevent());
+
+    // a fired timer leaves the wheel too
+    mega::Waiter::ds = 510;
+    mega::dstime waituntil = NEVER;
+    second.update(&waituntil);
+    ASSERT_EQ(nullptr, wheel.firstdue());
+    ASSERT_EQ(0u, wheel.size());
+
+    mega::Waiter::ds = savedds;
+}
+
+TEST(TimerWheel, nextEventAfterAdvance)
+{
+    mega::dstime savedds = mega::Waiter::ds;
+    mega::Waiter::ds = 64 * 10;
+
+    mega::PrnGen rng;
+    mega::TimerWheel wheel;
+    ASSERT_EQ(NEVER, wheel.nextevent());
+
+    mega::BackoffTimer timer(rng);
+    timer.schedule(&wheel, nullptr);
+    timer.backoff(10);
+    ASSERT_EQ(mega::dstime(64 * 10 + 10), wheel.nextevent());
+
+    // advancing short of the trigger time keeps it as the next event
+    wheel.advance(64 * 10 + 5);
+    ASSERT_EQ(mega::dstime(64 * 10 + 10), wheel.nextevent());
+
+    // a timer scheduled after the advance is placed relative to the new time
+    mega::Waiter::ds = 64 * 10 + 5;
+    mega::BackoffTimer later(rng);
+    later.schedule(&wheel, nullptr);
+    later.backoff(100);
+    ASSERT_EQ(mega::dstime(64 * 10 + 10), wheel.nextevent());
+
+    wheel.advance(64 * 10 + 10);
+    ASSERT_TRUE(isDue(wheel, &timer));
+    mega::dstime next = wheel.nextevent();
+    ASSERT_GT(next, mega::dstime(64 * 10 + 10));
+    ASSERT_LE(next, mega::dstime(64 * 10 + 105));
+
+    wheel.advance(64 * 10 + 105);
+    ASSERT_TRUE(isDue(wheel, &later));
+    ASSERT_EQ(NEVER, wheel.nextevent());
+
+    mega::Waiter::ds = savedds;
+}
+
+TEST(Utils, normalizeMatchesUtf8procOverTheBMP)
+{
+    // names that skip utf8proc_NFC() must be the ones it leaves unchanged: check each
+    // code point alone, after and before starters it could compose with
+    mega::FSACCESS_CLASS fsaccess;
+    const char* contexts[][2] = { { "", "" }, { "a", "" }, { "", "a" }, { "\xe1\x84\x80", "" }, { "e", "x" } };
+
+    for (utf8proc_int32_t c = 1; c < 0x10000; c++)
+    {
+        if (c >= 0xD800 && c < 0xE000)
+        {
+            continue;   // surrogates aren't valid UTF-8
+        }
+
+        utf8proc_uint8_t encoded[4];
+        utf8proc_ssize_t length = utf8proc_encode_char(c, encoded);
+        ASSERT_GT(length, 0);
+
+        for (size_t i = 0; i < sizeof contexts / sizeof *contexts; i++)
+        {
+            std::string name = std::string(contexts[i][0]) + std::string((const char*)encoded, size_t(length)) + contexts[i][1];
+
+            char* expected = (char*)utf8proc_NFC((const utf8proc_uint8_t*)name.c_str());
+            ASSERT_NE(nullptr, expected);
+            std::string reference(expected);
+            free(expected);
+
+            fsaccess.normalize(&name);
+            ASSERT_EQ(reference, name) << "code point " << std::hex << c << " in context " << i;
+        }
+    }
+}